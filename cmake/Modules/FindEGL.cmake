@@ -0,0 +1,31 @@
+# Once done these will be defined:
+#
+#  EGL_FOUND
+#  EGL_INCLUDE_DIR
+#  EGL_LIBRARIES
+#
+
+if(EGL_INCLUDE_DIR AND EGL_LIBRARIES)
+	set(EGL_FOUND TRUE)
+else()
+	find_package(PkgConfig QUIET)
+	if (PKG_CONFIG_FOUND)
+		pkg_check_modules(_EGL QUIET egl)
+	endif()
+
+	find_path(EGL_INC_DIR
+		NAMES EGL/egl.h
+		HINTS
+			${_EGL_INCLUDE_DIRS}
+			/usr/include /usr/local/include /opt/local/include)
+
+	find_library(EGL_LIB
+		NAMES EGL libEGL
+		HINTS ${_EGL_LIBRARY_DIRS} /usr/lib /usr/local/lib /opt/local/lib)
+
+	set(EGL_INCLUDE_DIR ${EGL_INC_DIR} CACHE PATH "EGL include dir")
+	set(EGL_LIBRARIES ${EGL_LIB} CACHE STRING "EGL libraries")
+
+	find_package_handle_standard_args(EGL DEFAULT_MSG EGL_LIB EGL_INC_DIR)
+	mark_as_advanced(EGL_INC_DIR EGL_LIB)
+endif()
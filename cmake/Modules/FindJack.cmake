@@ -0,0 +1,31 @@
+# Once done these will be defined:
+#
+#  Jack_FOUND
+#  Jack_INCLUDE_DIR
+#  Jack_LIBRARIES
+#
+
+if(Jack_INCLUDE_DIR AND Jack_LIBRARIES)
+	set(Jack_FOUND TRUE)
+else()
+	find_package(PkgConfig QUIET)
+	if (PKG_CONFIG_FOUND)
+		pkg_check_modules(_JACK QUIET jack)
+	endif()
+
+	find_path(JACK_INCLUDE_DIR
+		NAMES jack/jack.h
+		HINTS
+			${_JACK_INCLUDE_DIRS}
+			/usr/include /usr/local/include /opt/local/include)
+
+	find_library(JACK_LIB
+		NAMES jack
+		HINTS ${_JACK_LIBRARY_DIRS} /usr/lib /usr/local/lib /opt/local/lib)
+
+	set(Jack_INCLUDE_DIR ${JACK_INCLUDE_DIR} CACHE PATH "JACK include dir")
+	set(Jack_LIBRARIES ${JACK_LIB} CACHE STRING "JACK libraries")
+
+	find_package_handle_standard_args(Jack DEFAULT_MSG JACK_LIB JACK_INCLUDE_DIR)
+	mark_as_advanced(JACK_INCLUDE_DIR JACK_LIB)
+endif()
@@ -0,0 +1,38 @@
+# Once done these will be defined:
+#
+#  Libsrt_FOUND
+#  Libsrt_INCLUDE_DIR
+#  Libsrt_LIBRARIES
+#
+
+if(Libsrt_INCLUDE_DIR AND Libsrt_LIBRARIES)
+	set(Libsrt_FOUND TRUE)
+else()
+	find_package(PkgConfig QUIET)
+	if (PKG_CONFIG_FOUND)
+		pkg_check_modules(_SRT QUIET srt)
+	endif()
+
+	if(CMAKE_SIZEOF_VOID_P EQUAL 8)
+		set(_lib_suffix 64)
+	else()
+		set(_lib_suffix 32)
+	endif()
+
+	find_path(SRT_INCLUDE_DIR
+		NAMES srt/srt.h
+		HINTS
+			ENV srtPath
+			${_SRT_INCLUDE_DIRS}
+			/usr/include /usr/local/include /opt/local/include /sw/include)
+
+	find_library(SRT_LIB
+		NAMES srt libsrt
+		HINTS ${SRT_INCLUDE_DIR}/../lib ${SRT_INCLUDE_DIR}/lib${_lib_suffix} ${_SRT_LIBRARY_DIRS} /usr/lib /usr/local/lib /opt/local/lib /sw/lib)
+
+	set(Libsrt_INCLUDE_DIR ${SRT_INCLUDE_DIR} CACHE PATH "libsrt include dir")
+	set(Libsrt_LIBRARIES ${SRT_LIB} CACHE STRING "libsrt libraries")
+
+	find_package_handle_standard_args(Libsrt DEFAULT_MSG SRT_LIB SRT_INCLUDE_DIR)
+	mark_as_advanced(SRT_INCLUDE_DIR SRT_LIB)
+endif()
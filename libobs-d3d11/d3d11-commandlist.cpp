@@ -0,0 +1,133 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "d3d11-subsystem.hpp"
+
+struct gs_command_list {
+	ComPtr<ID3D11CommandList> list;
+};
+
+/*
+ * A deferred device has its own context and its own copy of the render state
+ * cache, but creates its state objects on the immediate device's D3D11
+ * device, which is free-threaded.  The runtime emulates command lists on
+ * drivers that don't support them natively, so this can't fail for lack of
+ * driver support.
+ */
+gs_device::gs_device(gs_device *immediate)
+	: factory              (immediate->factory),
+	  device               (immediate->device),
+	  immediate            (immediate),
+	  curRenderTarget      (&defaultSwap.target),
+	  curZStencilBuffer    (&defaultSwap.zs),
+	  curRenderSide        (0),
+	  curIndexBuffer       (NULL),
+	  curVertexBuffer      (NULL),
+	  curVertexShader      (NULL),
+	  curPixelShader       (NULL),
+	  curSwapChain         (&defaultSwap),
+	  zstencilStateChanged (true),
+	  rasterStateChanged   (true),
+	  blendStateChanged    (true),
+	  curDepthStencilState (NULL),
+	  curRasterState       (NULL),
+	  curBlendState        (NULL),
+	  curToplogy           (D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED)
+{
+	HRESULT hr;
+
+	matrix4_identity(&curProjMatrix);
+	matrix4_identity(&curViewMatrix);
+	matrix4_identity(&curViewProjMatrix);
+
+	memset(&viewport, 0, sizeof(viewport));
+
+	for (size_t i = 0; i < GS_MAX_TEXTURES; i++) {
+		curTextures[i] = NULL;
+		curSamplers[i] = NULL;
+	}
+
+	hr = device->CreateDeferredContext(0, context.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to create deferred context", hr);
+}
+
+extern "C" EXPORT device_t device_create_deferred(device_t device)
+{
+	gs_device *deferred = NULL;
+
+	if (device->immediate) {
+		blog(LOG_ERROR, "device_create_deferred (D3D11): Deferred "
+		                "contexts can't be created from another "
+		                "deferred context");
+		return NULL;
+	}
+
+	try {
+		deferred = new gs_device(device);
+	} catch (HRError error) {
+		blog(LOG_ERROR, "device_create_deferred (D3D11): %s (%08lX)",
+				error.str, error.hr);
+	}
+
+	return deferred;
+}
+
+extern "C" EXPORT commandlist_t device_finish_commandlist(device_t device)
+{
+	ComPtr<ID3D11CommandList> list;
+	HRESULT hr;
+
+	if (!device->immediate) {
+		blog(LOG_ERROR, "device_finish_commandlist (D3D11): Not a "
+		                "deferred context");
+		return NULL;
+	}
+
+	/* keeping the deferred context's state means the state cached in the
+	 * device is still valid when the next list is recorded */
+	hr = device->context->FinishCommandList(true, list.Assign());
+	if (FAILED(hr)) {
+		blog(LOG_ERROR, "device_finish_commandlist (D3D11): "
+		                "FinishCommandList failed (%08lX)", hr);
+		return NULL;
+	}
+
+	gs_command_list *commandList = new gs_command_list;
+	commandList->list = list;
+	return commandList;
+}
+
+extern "C" EXPORT void device_execute_commandlist(device_t device,
+		commandlist_t list)
+{
+	if (device->immediate) {
+		blog(LOG_ERROR, "device_execute_commandlist (D3D11): Command "
+		                "lists can only be executed on the immediate "
+		                "context");
+		return;
+	}
+
+	/* the immediate context's state is restored afterward, otherwise it
+	 * would be cleared and no longer match what the device has cached */
+	device->context->ExecuteCommandList(list->list, true);
+}
+
+extern "C" EXPORT void commandlist_destroy(commandlist_t list)
+{
+	delete list;
+}
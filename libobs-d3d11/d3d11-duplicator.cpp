@@ -0,0 +1,371 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "d3d11-subsystem.hpp"
+
+#include <dxgi1_2.h>
+
+/* above this many changed rectangles, just copy the whole frame */
+#define MAX_FRAME_RECTS 64
+
+struct gs_duplicator {
+	ComPtr<IDXGIOutputDuplication> duplicator;
+	gs_device                      *device;
+	gs_texture_2d                  *texture;
+
+	vector<uint8_t>                metadata;
+
+	gs_texture_2d                  *cursor;
+	vector<uint8_t>                shape;
+	DXGI_OUTDUPL_POINTER_SHAPE_INFO shapeInfo;
+	POINT                          cursorPos;
+	bool                           cursorVisible;
+
+	void InitDuplicator(HMONITOR monitor);
+	bool CopyChangedRects(ID3D11Texture2D *frame,
+			const DXGI_OUTDUPL_FRAME_INFO &info);
+	void CopyFrame(ID3D11Texture2D *frame,
+			const DXGI_OUTDUPL_FRAME_INFO &info);
+	void UpdateCursor(const DXGI_OUTDUPL_FRAME_INFO &info);
+	void UpdateCursorTexture();
+
+	gs_duplicator(device_t device, HMONITOR monitor);
+	~gs_duplicator();
+};
+
+void gs_duplicator::InitDuplicator(HMONITOR monitor)
+{
+	ComPtr<IDXGIDevice>  dxgiDevice;
+	ComPtr<IDXGIAdapter> adapter;
+	ComPtr<IDXGIOutput>  output;
+	ComPtr<IDXGIOutput1> output1;
+	DXGI_OUTPUT_DESC     desc;
+	HRESULT hr;
+
+	hr = device->device->QueryInterface(__uuidof(IDXGIDevice),
+			(void**)dxgiDevice.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to get DXGI device", hr);
+
+	hr = dxgiDevice->GetAdapter(adapter.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to get adapter", hr);
+
+	/* outputs are matched by monitor handle, the enumeration order of
+	 * DXGI and GDI doesn't have to be the same */
+	for (UINT i = 0;; i++) {
+		hr = adapter->EnumOutputs(i, output.Assign());
+		if (hr == DXGI_ERROR_NOT_FOUND)
+			throw "Monitor is not connected to the device's adapter";
+		if (FAILED(hr))
+			throw HRError("Failed to enumerate outputs", hr);
+
+		if (SUCCEEDED(output->GetDesc(&desc)) &&
+		    desc.Monitor == monitor)
+			break;
+	}
+
+	hr = output->QueryInterface(__uuidof(IDXGIOutput1),
+			(void**)output1.Assign());
+	if (FAILED(hr))
+		throw HRError("DXGI 1.2 is not available", hr);
+
+	hr = output1->DuplicateOutput(device->device, duplicator.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to duplicate output", hr);
+}
+
+gs_duplicator::gs_duplicator(device_t device, HMONITOR monitor)
+	: device        (device),
+	  texture       (nullptr),
+	  cursor        (nullptr),
+	  cursorVisible (false)
+{
+	memset(&shapeInfo, 0, sizeof(shapeInfo));
+	cursorPos.x = 0;
+	cursorPos.y = 0;
+
+	InitDuplicator(monitor);
+}
+
+gs_duplicator::~gs_duplicator()
+{
+	delete texture;
+	delete cursor;
+}
+
+/*
+ * The acquired frame always holds the complete desktop, the move and dirty
+ * rectangles only tell which parts of it changed since the last frame.  So
+ * copying the destination of every move and every dirty rectangle from the
+ * frame is enough to bring the texture up to date.
+ */
+bool gs_duplicator::CopyChangedRects(ID3D11Texture2D *frame,
+		const DXGI_OUTDUPL_FRAME_INFO &info)
+{
+	ID3D11DeviceContext *context = device->context;
+	UINT moveSize = 0, dirtySize = 0;
+	HRESULT hr;
+
+	if (!info.TotalMetadataBufferSize)
+		return false;
+	if (info.TotalMetadataBufferSize > metadata.size())
+		metadata.resize(info.TotalMetadataBufferSize);
+
+	DXGI_OUTDUPL_MOVE_RECT *moves =
+		(DXGI_OUTDUPL_MOVE_RECT*)metadata.data();
+
+	hr = duplicator->GetFrameMoveRects((UINT)metadata.size(), moves,
+			&moveSize);
+	if (FAILED(hr))
+		return false;
+
+	RECT *dirty = (RECT*)(metadata.data() + moveSize);
+	hr = duplicator->GetFrameDirtyRects(
+			(UINT)metadata.size() - moveSize, dirty, &dirtySize);
+	if (FAILED(hr))
+		return false;
+
+	size_t numMoves = moveSize  / sizeof(DXGI_OUTDUPL_MOVE_RECT);
+	size_t numDirty = dirtySize / sizeof(RECT);
+
+	if (numMoves + numDirty > MAX_FRAME_RECTS)
+		return false;
+
+	for (size_t i = 0; i < numMoves + numDirty; i++) {
+		const RECT &rect = (i < numMoves) ?
+			moves[i].DestinationRect : dirty[i - numMoves];
+		D3D11_BOX box;
+
+		box.left   = rect.left;
+		box.top    = rect.top;
+		box.right  = rect.right;
+		box.bottom = rect.bottom;
+		box.front  = 0;
+		box.back   = 1;
+
+		context->CopySubresourceRegion(texture->texture, 0,
+				rect.left, rect.top, 0, frame, 0, &box);
+	}
+
+	return true;
+}
+
+void gs_duplicator::CopyFrame(ID3D11Texture2D *frame,
+		const DXGI_OUTDUPL_FRAME_INFO &info)
+{
+	D3D11_TEXTURE2D_DESC desc;
+
+	frame->GetDesc(&desc);
+
+	if (!texture || texture->width != desc.Width ||
+	                texture->height != desc.Height) {
+		delete texture;
+		texture = nullptr;
+
+		texture = new gs_texture_2d(device, desc.Width, desc.Height,
+				GS_BGRA, 1, nullptr, 0, GS_TEXTURE_2D,
+				false, false);
+
+	} else if (CopyChangedRects(frame, info)) {
+		return;
+	}
+
+	device->context->CopyResource(texture->texture, frame);
+}
+
+static inline uint32_t GetMonochromePixel(const uint8_t *mask,
+		uint32_t pitch, uint32_t height, uint32_t x, uint32_t y)
+{
+	uint8_t  bit     = 0x80 >> (x & 7);
+	uint32_t offset  = y * pitch + x / 8;
+	bool     andMask = (mask[offset] & bit) != 0;
+	bool     xorMask = (mask[offset + height * pitch] & bit) != 0;
+
+	/* inverted pixels can't be blended, draw them black */
+	if (andMask)
+		return xorMask ? 0xFF000000 : 0;
+	return xorMask ? 0xFFFFFFFF : 0xFF000000;
+}
+
+static inline uint32_t GetMaskedColorPixel(const uint8_t *data,
+		uint32_t pitch, uint32_t x, uint32_t y)
+{
+	uint32_t pixel = *(const uint32_t*)(data + y * pitch + x * 4);
+
+	/* an alpha of 0xFF means the color is XORed with the screen, which
+	 * is only approximated here */
+	if ((pixel & 0xFF000000) == 0)
+		return pixel | 0xFF000000;
+	return (pixel & 0x00FFFFFF) ? (pixel | 0xFF000000) : 0;
+}
+
+/* converts the pointer shape to a BGRA texture */
+void gs_duplicator::UpdateCursorTexture()
+{
+	uint32_t width  = shapeInfo.Width;
+	uint32_t height = shapeInfo.Height;
+	uint32_t pitch  = shapeInfo.Pitch;
+	vector<uint32_t> pixels;
+
+	if (shapeInfo.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME)
+		height /= 2;
+
+	delete cursor;
+	cursor = nullptr;
+
+	if (!width || !height)
+		return;
+
+	pixels.resize(width * height);
+
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			uint32_t &pixel = pixels[y * width + x];
+
+			switch (shapeInfo.Type) {
+			case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME:
+				pixel = GetMonochromePixel(shape.data(), pitch,
+						height, x, y);
+				break;
+			case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MASKED_COLOR:
+				pixel = GetMaskedColorPixel(shape.data(),
+						pitch, x, y);
+				break;
+			default:
+				pixel = *(const uint32_t*)(shape.data() +
+						y * pitch + x * 4);
+			}
+		}
+	}
+
+	const void *data = pixels.data();
+	cursor = new gs_texture_2d(device, width, height, GS_BGRA, 1, &data,
+			0, GS_TEXTURE_2D, false, false);
+}
+
+void gs_duplicator::UpdateCursor(const DXGI_OUTDUPL_FRAME_INFO &info)
+{
+	UINT size;
+	HRESULT hr;
+
+	/* the position is only valid if the mouse was updated */
+	if (info.LastMouseUpdateTime.QuadPart == 0)
+		return;
+
+	cursorVisible = info.PointerPosition.Visible != 0;
+	cursorPos     = info.PointerPosition.Position;
+
+	if (!info.PointerShapeBufferSize)
+		return;
+
+	shape.resize(info.PointerShapeBufferSize);
+
+	hr = duplicator->GetFramePointerShape((UINT)shape.size(),
+			shape.data(), &size, &shapeInfo);
+	if (FAILED(hr)) {
+		blog(LOG_WARNING, "duplicator_update_frame (D3D11): Failed "
+		                  "to get pointer shape (%08lX)", hr);
+		return;
+	}
+
+	UpdateCursorTexture();
+}
+
+extern "C" EXPORT duplicator_t device_duplicator_create(device_t device,
+		void *monitor)
+{
+	gs_duplicator *duplicator = nullptr;
+
+	try {
+		duplicator = new gs_duplicator(device, (HMONITOR)monitor);
+
+	} catch (HRError error) {
+		blog(LOG_DEBUG, "device_duplicator_create (D3D11): %s (%08lX)",
+				error.str, error.hr);
+	} catch (const char *error) {
+		blog(LOG_DEBUG, "device_duplicator_create (D3D11): %s",
+				error);
+	}
+
+	return duplicator;
+}
+
+extern "C" EXPORT void duplicator_destroy(duplicator_t duplicator)
+{
+	delete duplicator;
+}
+
+extern "C" EXPORT bool duplicator_update_frame(duplicator_t d)
+{
+	DXGI_OUTDUPL_FRAME_INFO info;
+	ComPtr<IDXGIResource>   resource;
+	ComPtr<ID3D11Texture2D> frame;
+	bool success = true;
+	HRESULT hr;
+
+	hr = d->duplicator->AcquireNextFrame(0, &info, resource.Assign());
+	if (hr == DXGI_ERROR_WAIT_TIMEOUT)
+		return true;
+
+	if (hr == DXGI_ERROR_ACCESS_LOST) {
+		return false;
+
+	} else if (FAILED(hr)) {
+		blog(LOG_ERROR, "duplicator_update_frame (D3D11): Failed to "
+		                "acquire frame (%08lX)", hr);
+		return false;
+	}
+
+	try {
+		d->UpdateCursor(info);
+
+		/* frames with only mouse updates don't change the desktop */
+		if (info.LastPresentTime.QuadPart != 0) {
+			hr = resource->QueryInterface(__uuidof(ID3D11Texture2D),
+					(void**)frame.Assign());
+			if (FAILED(hr))
+				throw HRError("Failed to query texture", hr);
+
+			d->CopyFrame(frame, info);
+		}
+
+	} catch (HRError error) {
+		blog(LOG_ERROR, "duplicator_update_frame (D3D11): %s (%08lX)",
+				error.str, error.hr);
+		success = false;
+	}
+
+	d->duplicator->ReleaseFrame();
+	return success;
+}
+
+extern "C" EXPORT texture_t duplicator_gettexture(duplicator_t duplicator)
+{
+	return duplicator->texture;
+}
+
+extern "C" EXPORT texture_t duplicator_getcursor(duplicator_t duplicator,
+		int32_t *x, int32_t *y)
+{
+	if (!duplicator->cursorVisible || !duplicator->cursor)
+		return nullptr;
+
+	*x = duplicator->cursorPos.x;
+	*y = duplicator->cursorPos.y;
+	return duplicator->cursor;
+}
@@ -135,15 +135,41 @@ void gs_shader::BuildConstantBuffer()
 		shader_setdefault(this, &params[i]);
 }
 
+static bool LoadCachedShader(const char *key, ID3D10Blob **shader)
+{
+	size_t size;
+	void   *data = gs_shader_cache_load(key, &size);
+	bool   success;
+
+	if (!data)
+		return false;
+
+	success = SUCCEEDED(D3DCreateBlob(size, shader));
+	if (success)
+		memcpy((*shader)->GetBufferPointer(), data, size);
+
+	bfree(data);
+	return success;
+}
+
 void gs_shader::Compile(const char *shaderString, const char *file,
 		const char *target, ID3D10Blob **shader)
 {
 	ComPtr<ID3D10Blob> errorsBlob;
-	HRESULT hr;
+	string             cacheKey;
+	HRESULT            hr;
 
 	if (!shaderString)
 		throw "No shader string specified";
 
+	cacheKey  = "d3d11:";
+	cacheKey += target;
+	cacheKey += "\n";
+	cacheKey += shaderString;
+
+	if (LoadCachedShader(cacheKey.c_str(), shader))
+		return;
+
 	hr = D3DCompile(shaderString, strlen(shaderString), file, NULL, NULL,
 			"main", target,
 			D3D10_SHADER_OPTIMIZATION_LEVEL1, 0,
@@ -154,55 +180,67 @@ void gs_shader::Compile(const char *shaderString, const char *file,
 		else
 			throw HRError("Failed to compile shader", hr);
 	}
+
+	gs_shader_cache_save(cacheKey.c_str(), (*shader)->GetBufferPointer(),
+			(*shader)->GetBufferSize());
 }
 
-inline void gs_shader::UpdateParam(vector<uint8_t> &constData,
-		shader_param &param, bool &upload)
+inline void gs_shader::UpdateParam(gs_device *target, shader_param &param,
+		bool &upload)
 {
 	if (param.type != SHADER_PARAM_TEXTURE) {
 		if (!param.curValue.size())
 			throw "Not all shader parameters were set";
 
-		constData.insert(constData.end(),
-				param.curValue.begin(),
-				param.curValue.end());
-
-		if (param.changed) {
+		if (param.changed)
 			upload = true;
-			param.changed = false;
-		}
 	} else if (param.curValue.size() == sizeof(texture_t)) {
 		texture_t tex;
 		memcpy(&tex, param.curValue.data(), sizeof(texture_t));
-		device_load_texture(device, tex, param.textureID);
+		device_load_texture(target, tex, param.textureID);
 	}
 }
 
-void gs_shader::UploadParams()
+/* the constants are uploaded on the context being drawn with, which isn't
+ * the shader's own device when drawing on a deferred context.  they're
+ * only gathered when a value has actually changed since the last draw */
+void gs_shader::UploadParams(gs_device *target)
 {
-	vector<uint8_t> constData;
-	bool            upload = false;
-
-	constData.reserve(constantSize);
+	bool upload = false;
 
 	for (size_t i = 0; i < params.size(); i++)
-		UpdateParam(constData, params[i], upload);
+		UpdateParam(target, params[i], upload);
+
+	if (!upload)
+		return;
+
+	constData.clear();
+
+	for (size_t i = 0; i < params.size(); i++) {
+		shader_param &param = params[i];
+
+		if (param.type == SHADER_PARAM_TEXTURE)
+			continue;
+
+		constData.insert(constData.end(),
+				param.curValue.begin(),
+				param.curValue.end());
+		param.changed = false;
+	}
 
 	if (constData.size() != constantSize)
 		throw "Invalid constant data size given to shader";
 
-	if (upload) {
-		D3D11_MAPPED_SUBRESOURCE map;
-		HRESULT hr;
+	D3D11_MAPPED_SUBRESOURCE map;
+	HRESULT hr;
 
-		hr = device->context->Map(constants, 0, D3D11_MAP_WRITE_DISCARD,
-				0, &map);
-		if (FAILED(hr))
-			throw HRError("Could not lock constant buffer", hr);
+	hr = target->context->Map(constants, 0, D3D11_MAP_WRITE_DISCARD, 0,
+			&map);
+	if (FAILED(hr))
+		throw HRError("Could not lock constant buffer", hr);
 
-		memcpy(map.pData, constData.data(), constData.size());
-		device->context->Unmap(constants, 0);
-	}
+	memcpy(map.pData, constData.data(), constData.size());
+	target->context->Unmap(constants, 0);
 }
 
 void shader_destroy(shader_t shader)
@@ -19,7 +19,8 @@
 
 gs_stage_surface::gs_stage_surface(device_t device, uint32_t width,
 		uint32_t height, gs_color_format colorFormat)
-	: device     (device),
+	: staged     (false),
+	  device     (device),
 	  width      (width),
 	  height     (height),
 	  format     (colorFormat),
@@ -41,4 +42,10 @@ gs_stage_surface::gs_stage_surface(device_t device, uint32_t width,
 	hr = device->device->CreateTexture2D(&td, NULL, texture.Assign());
 	if (FAILED(hr))
 		throw HRError("Failed to create 2D texture", hr);
+
+	D3D11_QUERY_DESC qd = {D3D11_QUERY_EVENT, 0};
+
+	hr = device->device->CreateQuery(&qd, query.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to create stage surface query", hr);
 }
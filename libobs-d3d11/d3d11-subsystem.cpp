@@ -28,6 +28,42 @@
 static const IID dxgiFactory2 =
 {0x50c83a1c, 0xe072, 0x4c48, {0x87, 0xb0, 0x36, 0x30, 0xfa, 0x36, 0xa6, 0xd0}};
 
+/* newer than the headers: flip discard is Windows 10, and tearing needs the
+ * DXGI 1.5 runtime.  swap chains fall back to older modes when creating them
+ * with one fails */
+static const DXGI_SWAP_EFFECT SWAP_EFFECT_FLIP_SEQUENTIAL =
+	(DXGI_SWAP_EFFECT)3;
+static const DXGI_SWAP_EFFECT SWAP_EFFECT_FLIP_DISCARD = (DXGI_SWAP_EFFECT)4;
+#define SWAP_CHAIN_FLAG_ALLOW_TEARING 2048
+#define PRESENT_ALLOW_TEARING         0x200
+
+#define SWAP_FLAG_WAITABLE DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT
+
+struct swap_mode {
+	DXGI_SWAP_EFFECT effect;
+	UINT             flags;
+};
+
+static const swap_mode swapModes[] = {
+	{SWAP_EFFECT_FLIP_DISCARD,
+		SWAP_FLAG_WAITABLE | SWAP_CHAIN_FLAG_ALLOW_TEARING},
+	{SWAP_EFFECT_FLIP_DISCARD,    SWAP_FLAG_WAITABLE},
+	{SWAP_EFFECT_FLIP_SEQUENTIAL, SWAP_FLAG_WAITABLE},
+	{SWAP_EFFECT_FLIP_SEQUENTIAL, 0},
+	{DXGI_SWAP_EFFECT_DISCARD,    0}
+};
+
+#define NUM_SWAP_MODES (sizeof(swapModes) / sizeof(swap_mode))
+
+/* flip model swap chains only support these, and need two buffers */
+static inline bool flip_format_supported(DXGI_FORMAT format)
+{
+	return format == DXGI_FORMAT_B8G8R8A8_UNORM ||
+	       format == DXGI_FORMAT_R8G8B8A8_UNORM ||
+	       format == DXGI_FORMAT_R10G10B10A2_UNORM ||
+	       format == DXGI_FORMAT_R16G16B16A16_FLOAT;
+}
+
 static inline void make_swap_desc(DXGI_SWAP_CHAIN_DESC &desc,
 		gs_init_data *data)
 {
@@ -42,17 +78,47 @@ static inline void make_swap_desc(DXGI_SWAP_CHAIN_DESC &desc,
 	desc.Windowed          = true;
 }
 
+void gs_swap_chain::InitHeadlessTarget(uint32_t cx, uint32_t cy)
+{
+	D3D11_TEXTURE2D_DESC td;
+	HRESULT hr;
+
+	target.width  = cx ? cx : 1;
+	target.height = cy ? cy : 1;
+
+	memset(&td, 0, sizeof(td));
+	td.Width            = target.width;
+	td.Height           = target.height;
+	td.MipLevels        = 1;
+	td.ArraySize        = 1;
+	td.Format           = target.dxgiFormat;
+	td.BindFlags        = D3D11_BIND_RENDER_TARGET;
+	td.SampleDesc.Count = 1;
+	td.Usage            = D3D11_USAGE_DEFAULT;
+
+	hr = device->device->CreateTexture2D(&td, NULL,
+			target.texture.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to create headless render target", hr);
+}
+
 void gs_swap_chain::InitTarget(uint32_t cx, uint32_t cy)
 {
 	HRESULT hr;
 
-	target.width  = cx;
-	target.height = cy;
+	/* headless devices have no swap chain, so the default target is a
+	 * plain texture that's never presented */
+	if (!swap) {
+		InitHeadlessTarget(cx, cy);
+	} else {
+		target.width  = cx;
+		target.height = cy;
 
-	hr = swap->GetBuffer(0, __uuidof(ID3D11Texture2D),
-			(void**)target.texture.Assign());
-	if (FAILED(hr))
-		throw HRError("Failed to get swap buffer texture", hr);
+		hr = swap->GetBuffer(0, __uuidof(ID3D11Texture2D),
+				(void**)target.texture.Assign());
+		if (FAILED(hr))
+			throw HRError("Failed to get swap buffer texture", hr);
+	}
 
 	hr = device->device->CreateRenderTargetView(target.texture, NULL,
 			target.renderTarget[0].Assign());
@@ -83,15 +149,18 @@ void gs_swap_chain::Resize(uint32_t cx, uint32_t cy)
 	zs.texture.Clear();
 	zs.view.Clear();
 
-	if (cx == 0 || cy == 0) {
-		GetClientRect(hwnd, &clientRect);
-		if (cx == 0) cx = clientRect.right;
-		if (cy == 0) cy = clientRect.bottom;
-	}
+	if (swap) {
+		if (cx == 0 || cy == 0) {
+			GetClientRect(hwnd, &clientRect);
+			if (cx == 0) cx = clientRect.right;
+			if (cy == 0) cy = clientRect.bottom;
+		}
 
-	hr = swap->ResizeBuffers(numBuffers, cx, cy, target.dxgiFormat, 0);
-	if (FAILED(hr))
-		throw HRError("Failed to resize swap buffers", hr);
+		hr = swap->ResizeBuffers(numBuffers, cx, cy,
+				target.dxgiFormat, flags);
+		if (FAILED(hr))
+			throw HRError("Failed to resize swap buffers", hr);
+	}
 
 	InitTarget(cx, cy);
 	InitZStencilBuffer(cx, cy);
@@ -111,24 +180,83 @@ void gs_swap_chain::Init(gs_init_data *data)
 	InitZStencilBuffer(data->cx, data->cy);
 }
 
-gs_swap_chain::gs_swap_chain(gs_device *device, gs_init_data *data)
-	: device     (device),
-	  numBuffers (data->num_backbuffers),
-	  hwnd       ((HWND)data->window.hwnd)
+void gs_swap_chain::CreateSwap(gs_init_data *data)
 {
-	HRESULT hr;
 	DXGI_SWAP_CHAIN_DESC swapDesc;
+	bool canFlip;
+	HRESULT hr = E_FAIL;
 
 	make_swap_desc(swapDesc, data);
-	hr = device->factory->CreateSwapChain(device->device, &swapDesc,
-			swap.Assign());
+	canFlip = GetWinVer() >= 0x602 &&
+		flip_format_supported(swapDesc.BufferDesc.Format);
+
+	for (size_t i = 0; i < NUM_SWAP_MODES; i++) {
+		const swap_mode &mode = swapModes[i];
+		bool modeFlip = mode.effect != DXGI_SWAP_EFFECT_DISCARD;
+
+		if (modeFlip && !canFlip)
+			continue;
+
+		swapDesc.SwapEffect  = mode.effect;
+		swapDesc.Flags       = mode.flags;
+		swapDesc.BufferCount = (modeFlip && data->num_backbuffers < 2) ?
+			2 : data->num_backbuffers;
+
+		hr = device->factory->CreateSwapChain(device->device,
+				&swapDesc, swap.Assign());
+		if (SUCCEEDED(hr)) {
+			flip       = modeFlip;
+			flags      = mode.flags;
+			numBuffers = swapDesc.BufferCount;
+			break;
+		}
+	}
+
 	if (FAILED(hr))
 		throw HRError("Failed to create swap chain", hr);
 
+	if ((flags & SWAP_FLAG_WAITABLE) != 0) {
+		ComPtr<IDXGISwapChain2> swap2;
+
+		hr = swap->QueryInterface(__uuidof(IDXGISwapChain2),
+				(void**)swap2.Assign());
+		if (SUCCEEDED(hr)) {
+			/* a single queued frame, previews only need the
+			 * latest one */
+			swap2->SetMaximumFrameLatency(1);
+			waitable = swap2->GetFrameLatencyWaitableObject();
+		}
+	}
+
+	blog(LOG_DEBUG, "Created %s swap chain%s%s",
+			flip ? "flip model" : "blt model",
+			waitable ? ", waitable" : "",
+			(flags & SWAP_CHAIN_FLAG_ALLOW_TEARING) ?
+				", tearing allowed" : "");
+}
+
+gs_swap_chain::gs_swap_chain(gs_device *device, gs_init_data *data)
+	: device     (device),
+	  numBuffers (data->num_backbuffers),
+	  hwnd       ((HWND)data->window.hwnd),
+	  flip       (false),
+	  flags      (0),
+	  waitable   (NULL)
+{
+	CreateSwap(data);
 	Init(data);
 }
 
-void gs_device::InitFactory(uint32_t adapterIdx, IDXGIAdapter1 **padapter)
+const static D3D_FEATURE_LEVEL featureLevels[] =
+{
+	D3D_FEATURE_LEVEL_11_0,
+	D3D_FEATURE_LEVEL_10_1,
+	D3D_FEATURE_LEVEL_10_0,
+	D3D_FEATURE_LEVEL_9_3,
+};
+
+void gs_device::InitFactory(uint32_t adapterIdx, IDXGIAdapter1 **padapter,
+		bool headless)
 {
 	HRESULT hr;
 	IID factoryIID = (GetWinVer() >= 0x602) ? dxgiFactory2 :
@@ -139,49 +267,79 @@ void gs_device::InitFactory(uint32_t adapterIdx, IDXGIAdapter1 **padapter)
 		throw HRError("Failed to create DXGIFactory", hr);
 
 	hr = factory->EnumAdapters1(adapterIdx, padapter);
-	if (FAILED(hr))
+	if (FAILED(hr)) {
+		/* headless devices can still use WARP without any adapter,
+		 * such as on servers without a GPU */
+		if (headless) {
+			blog(LOG_WARNING, "Failed to enumerate DXGIAdapter "
+			                  "(%08lX), using WARP", hr);
+			return;
+		}
+
 		throw HRError("Failed to enumerate DXGIAdapter", hr);
+	}
 }
 
-const static D3D_FEATURE_LEVEL featureLevels[] =
+void gs_device::InitHeadlessDevice(IDXGIAdapter *adapter, uint32_t flags,
+		D3D_FEATURE_LEVEL *levelUsed)
 {
-	D3D_FEATURE_LEVEL_11_0,
-	D3D_FEATURE_LEVEL_10_1,
-	D3D_FEATURE_LEVEL_10_0,
-	D3D_FEATURE_LEVEL_9_3,
-};
+	HRESULT hr = E_FAIL;
+
+	if (adapter) {
+		hr = D3D11CreateDevice(adapter, D3D_DRIVER_TYPE_UNKNOWN, NULL,
+				flags, featureLevels,
+				sizeof(featureLevels) / sizeof(D3D_FEATURE_LEVEL),
+				D3D11_SDK_VERSION, device.Assign(),
+				levelUsed, context.Assign());
+		if (SUCCEEDED(hr))
+			return;
+
+		blog(LOG_WARNING, "Failed to create headless device on "
+		                  "adapter (%08lX), using WARP", hr);
+	}
+
+	hr = D3D11CreateDevice(NULL, D3D_DRIVER_TYPE_WARP, NULL, flags,
+			featureLevels,
+			sizeof(featureLevels) / sizeof(D3D_FEATURE_LEVEL),
+			D3D11_SDK_VERSION, device.Assign(),
+			levelUsed, context.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to create headless device", hr);
+}
 
 void gs_device::InitDevice(gs_init_data *data, IDXGIAdapter *adapter)
 {
 	wstring adapterName;
-	DXGI_SWAP_CHAIN_DESC swapDesc;
 	DXGI_ADAPTER_DESC desc;
 	D3D_FEATURE_LEVEL levelUsed;
 	HRESULT hr;
 
-	make_swap_desc(swapDesc, data);
-
 	uint32_t createFlags = D3D11_CREATE_DEVICE_BGRA_SUPPORT;
 #ifdef _DEBUG
 	//createFlags |= D3D11_CREATE_DEVICE_DEBUG;
 #endif
 
-	adapterName = (adapter->GetDesc(&desc) == S_OK) ? desc.Description :
-		L"<unknown>";
+	adapterName = (adapter && adapter->GetDesc(&desc) == S_OK) ?
+		desc.Description : L"<unknown>";
 
 	char *adapterNameUTF8;
 	os_wcs_to_utf8_ptr(adapterName.c_str(), 0, &adapterNameUTF8);
 	blog(LOG_INFO, "Loading up D3D11 on adapter %s", adapterNameUTF8);
 	bfree(adapterNameUTF8);
 
-	hr = D3D11CreateDeviceAndSwapChain(adapter, D3D_DRIVER_TYPE_UNKNOWN,
-			NULL, createFlags, featureLevels,
-			sizeof(featureLevels) / sizeof(D3D_FEATURE_LEVEL),
-			D3D11_SDK_VERSION, &swapDesc,
-			defaultSwap.swap.Assign(), device.Assign(),
-			&levelUsed, context.Assign());
-	if (FAILED(hr))
-		throw HRError("Failed to create device and swap chain", hr);
+	if (!gs_window_valid(&data->window)) {
+		InitHeadlessDevice(adapter, createFlags, &levelUsed);
+	} else {
+		/* the swap chain is created from the factory, so it can use
+		 * the flip model */
+		hr = D3D11CreateDevice(adapter, D3D_DRIVER_TYPE_UNKNOWN, NULL,
+				createFlags, featureLevels,
+				sizeof(featureLevels) / sizeof(D3D_FEATURE_LEVEL),
+				D3D11_SDK_VERSION, device.Assign(),
+				&levelUsed, context.Assign());
+		if (FAILED(hr))
+			throw HRError("Failed to create device", hr);
+	}
 
 	blog(LOG_INFO, "D3D11 loaded sucessfully, feature level used: %u",
 			(uint32_t)levelUsed);
@@ -189,6 +347,8 @@ void gs_device::InitDevice(gs_init_data *data, IDXGIAdapter *adapter)
 	defaultSwap.device     = this;
 	defaultSwap.hwnd       = (HWND)data->window.hwnd;
 	defaultSwap.numBuffers = data->num_backbuffers;
+	if (gs_window_valid(&data->window))
+		defaultSwap.CreateSwap(data);
 	defaultSwap.Init(data);
 }
 
@@ -266,8 +426,10 @@ ID3D11BlendState *gs_device::AddBlendState()
 		bd.RenderTarget[i].BlendEnable    = blendState.blendEnabled;
 		bd.RenderTarget[i].BlendOp        = D3D11_BLEND_OP_ADD;
 		bd.RenderTarget[i].BlendOpAlpha   = D3D11_BLEND_OP_ADD;
-		bd.RenderTarget[i].SrcBlendAlpha  = D3D11_BLEND_ONE;
-		bd.RenderTarget[i].DestBlendAlpha = D3D11_BLEND_ZERO;
+		bd.RenderTarget[i].SrcBlendAlpha  =
+			ConvertGSBlendType(blendState.srcFactorAlpha);
+		bd.RenderTarget[i].DestBlendAlpha =
+			ConvertGSBlendType(blendState.destFactorAlpha);
 		bd.RenderTarget[i].SrcBlend =
 			ConvertGSBlendType(blendState.srcFactor);
 		bd.RenderTarget[i].DestBlend =
@@ -286,6 +448,21 @@ ID3D11BlendState *gs_device::AddBlendState()
 	return state;
 }
 
+template<typename Saved, typename State>
+static inline Saved *FindState(vector<Saved> &states, const State &state)
+{
+	size_t hash = HashState(state);
+
+	for (size_t i = 0; i < states.size(); i++) {
+		Saved &saved = states[i];
+		if (saved.hash == hash &&
+		    memcmp(&saved, &state, sizeof(State)) == 0)
+			return &saved;
+	}
+
+	return nullptr;
+}
+
 void gs_device::UpdateZStencilState()
 {
 	ID3D11DepthStencilState *state = NULL;
@@ -293,16 +470,8 @@ void gs_device::UpdateZStencilState()
 	if (!zstencilStateChanged)
 		return;
 
-	for (size_t i = 0; i < zstencilStates.size(); i++) {
-		SavedZStencilState &s = zstencilStates[i];
-		if (memcmp(&s, &zstencilState, sizeof(zstencilState)) == 0) {
-			state = s.state;
-			break;
-		}
-	}
-
-	if (!state)
-		state = AddZStencilState();
+	SavedZStencilState *saved = FindState(zstencilStates, zstencilState);
+	state = saved ? saved->state.Get() : AddZStencilState();
 
 	if (state != curDepthStencilState) {
 		context->OMSetDepthStencilState(state, 0);
@@ -319,16 +488,8 @@ void gs_device::UpdateRasterState()
 	if (!rasterStateChanged)
 		return;
 
-	for (size_t i = 0; i < rasterStates.size(); i++) {
-		SavedRasterState &s = rasterStates[i];
-		if (memcmp(&s, &rasterState, sizeof(rasterState)) == 0) {
-			state = s.state;
-			break;
-		}
-	}
-
-	if (!state)
-		state = AddRasterState();
+	SavedRasterState *saved = FindState(rasterStates, rasterState);
+	state = saved ? saved->state.Get() : AddRasterState();
 
 	if (state != curRasterState) {
 		context->RSSetState(state);
@@ -345,16 +506,8 @@ void gs_device::UpdateBlendState()
 	if (!blendStateChanged)
 		return;
 
-	for (size_t i = 0; i < blendStates.size(); i++) {
-		SavedBlendState &s = blendStates[i];
-		if (memcmp(&s, &blendState, sizeof(blendState)) == 0) {
-			state = s.state;
-			break;
-		}
-	}
-
-	if (!state)
-		state = AddBlendState();
+	SavedBlendState *saved = FindState(blendStates, blendState);
+	state = saved ? saved->state.Get() : AddBlendState();
 
 	if (state != curBlendState) {
 		float f[4] = {1.0f, 1.0f, 1.0f, 1.0f};
@@ -387,7 +540,8 @@ void gs_device::UpdateViewProjMatrix()
 }
 
 gs_device::gs_device(gs_init_data *data)
-	: curRenderTarget      (NULL),
+	: immediate            (NULL),
+	  curRenderTarget      (NULL),
 	  curZStencilBuffer    (NULL),
 	  curRenderSide        (0),
 	  curIndexBuffer       (NULL),
@@ -416,7 +570,8 @@ gs_device::gs_device(gs_init_data *data)
 		curSamplers[i] = NULL;
 	}
 
-	InitFactory(data->adapter, adapter.Assign());
+	InitFactory(data->adapter, adapter.Assign(),
+			!gs_window_valid(&data->window));
 	InitDevice(data, adapter);
 	device_setrendertarget(this, NULL, NULL);
 }
@@ -602,13 +757,22 @@ samplerstate_t device_create_samplerstate(device_t device,
 	return ss;
 }
 
+/* effect shaders are compiled on deferred contexts by the compile threads,
+ * but are drawn with on the immediate one.  shaders are only created with
+ * the D3D11 device, which both share */
+static inline gs_device *ShaderOwner(gs_device *device)
+{
+	return device->immediate ? device->immediate : device;
+}
+
 shader_t device_create_vertexshader(device_t device,
 		const char *shader_string, const char *file,
 		char **error_string)
 {
 	gs_vertex_shader *shader = NULL;
 	try {
-		shader = new gs_vertex_shader(device, file, shader_string);
+		shader = new gs_vertex_shader(ShaderOwner(device), file,
+				shader_string);
 
 	} catch (HRError error) {
 		blog(LOG_ERROR, "device_create_vertexshader (D3D11): %s "
@@ -637,7 +801,8 @@ shader_t device_create_pixelshader(device_t device,
 {
 	gs_pixel_shader *shader = NULL;
 	try {
-		shader = new gs_pixel_shader(device, file, shader_string);
+		shader = new gs_pixel_shader(ShaderOwner(device), file,
+				shader_string);
 
 	} catch (HRError error) {
 		blog(LOG_ERROR, "device_create_pixelshader (D3D11): %s "
@@ -1074,6 +1239,8 @@ void device_stage_texture(device_t device, stagesurf_t dst, texture_t src)
 			      "dimensions";
 
 		device->CopyTex(dst->texture, 0, 0, src, 0, 0, 0, 0);
+		device->context->End(dst->query);
+		dst->staged = true;
 
 	} catch (const char *error) {
 		blog(LOG_ERROR, "device_copy_texture (D3D11): %s", error);
@@ -1106,8 +1273,8 @@ void device_draw(device_t device, enum gs_draw_mode draw_mode,
 		device->UpdateRasterState();
 		device->UpdateZStencilState();
 		device->UpdateViewProjMatrix();
-		device->curVertexShader->UploadParams();
-		device->curPixelShader->UploadParams();
+		device->curVertexShader->UploadParams(device);
+		device->curPixelShader->UploadParams(device);
 
 	} catch (const char *error) {
 		blog(LOG_ERROR, "device_draw (D3D11): %s", error);
@@ -1189,7 +1356,38 @@ void device_clear(device_t device, uint32_t clear_flags, struct vec4 *color,
 
 void device_present(device_t device)
 {
-	device->curSwapChain->swap->Present(0, 0);
+	gs_swap_chain *swap = device->curSwapChain;
+	UINT presentFlags = DXGI_PRESENT_DO_NOT_WAIT;
+	HRESULT hr;
+
+	if (!swap->swap)
+		return;
+
+	if ((swap->flags & SWAP_CHAIN_FLAG_ALLOW_TEARING) != 0)
+		presentFlags |= PRESENT_ALLOW_TEARING;
+
+	/* if the queue is still full the frame is dropped rather than
+	 * waiting, the next one is more recent anyway */
+	hr = swap->swap->Present(0, presentFlags);
+	if (hr == DXGI_ERROR_WAS_STILL_DRAWING)
+		return;
+
+	/* presenting a flip model swap chain unbinds its back buffer */
+	if (swap->flip && device->curRenderTarget == &swap->target) {
+		ID3D11RenderTargetView *rt = swap->target.renderTarget[0];
+		device->context->OMSetRenderTargets(1, &rt,
+				device->curZStencilBuffer->view);
+	}
+}
+
+bool device_swapchain_ready(device_t device)
+{
+	gs_swap_chain *swap = device->curSwapChain;
+
+	if (!swap->waitable)
+		return true;
+
+	return WaitForSingleObject(swap->waitable, 0) == WAIT_OBJECT_0;
 }
 
 void device_setcullmode(device_t device, enum gs_cull_mode mode)
@@ -1261,13 +1459,26 @@ void device_enable_color(device_t device, bool red, bool green,
 void device_blendfunction(device_t device, enum gs_blend_type src,
 		enum gs_blend_type dest)
 {
-	if (device->blendState.srcFactor  == src &&
-	    device->blendState.destFactor == dest)
+	/* alpha is written as-is unless a separate function is used */
+	device_blendfunction_separate(device, src, dest,
+			GS_BLEND_ONE, GS_BLEND_ZERO);
+}
+
+void device_blendfunction_separate(device_t device,
+		enum gs_blend_type src_c, enum gs_blend_type dest_c,
+		enum gs_blend_type src_a, enum gs_blend_type dest_a)
+{
+	if (device->blendState.srcFactor       == src_c &&
+	    device->blendState.destFactor      == dest_c &&
+	    device->blendState.srcFactorAlpha  == src_a &&
+	    device->blendState.destFactorAlpha == dest_a)
 		return;
 
-	device->blendState.srcFactor  = src;
-	device->blendState.destFactor = dest;
-	device->blendStateChanged     = true;
+	device->blendState.srcFactor       = src_c;
+	device->blendState.destFactor      = dest_c;
+	device->blendState.srcFactorAlpha  = src_a;
+	device->blendState.destFactorAlpha = dest_a;
+	device->blendStateChanged          = true;
 }
 
 void device_depthfunction(device_t device, enum gs_depth_test test)
@@ -1386,6 +1597,15 @@ void device_getviewport(device_t device, struct gs_rect *rect)
 void device_setscissorrect(device_t device, struct gs_rect *rect)
 {
 	D3D11_RECT d3drect;
+
+	if (device->rasterState.scissorEnabled != (rect != NULL)) {
+		device->rasterState.scissorEnabled = rect != NULL;
+		device->rasterStateChanged = true;
+	}
+
+	if (!rect)
+		return;
+
 	d3drect.left   = rect->x;
 	d3drect.top    = rect->y;
 	d3drect.right  = rect->x + rect->cx;
@@ -1620,11 +1840,28 @@ enum gs_color_format stagesurface_getcolorformat(stagesurf_t stagesurf)
 	return stagesurf->format;
 }
 
+/* the query completes once the GPU has executed the copy, which is when the
+ * surface can be mapped without waiting.  GetData flushes the command
+ * buffer so a pending copy is guaranteed to be submitted */
+bool stagesurface_isready(stagesurf_t stagesurf)
+{
+	if (!stagesurf->staged)
+		return true;
+
+	HRESULT hr = stagesurf->device->context->GetData(stagesurf->query,
+			NULL, 0, 0);
+	return hr != S_FALSE;
+}
+
 bool stagesurface_map(stagesurf_t stagesurf, uint8_t **data, uint32_t *linesize)
 {
 	D3D11_MAPPED_SUBRESOURCE map;
-	if (FAILED(stagesurf->device->context->Map(stagesurf->texture, 0,
-			D3D11_MAP_READ, 0, &map)))
+
+	/* never block the caller: if the copy is still in flight, the map
+	 * fails and the caller tries again later */
+	HRESULT hr = stagesurf->device->context->Map(stagesurf->texture, 0,
+			D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &map);
+	if (FAILED(hr))
 		return false;
 
 	*data = (uint8_t*)map.pData;
@@ -1694,6 +1931,55 @@ void vertexbuffer_flush(vertbuffer_t vertbuffer, bool rebuild)
 	}
 }
 
+void vertexbuffer_flush_range(vertbuffer_t vertbuffer, size_t start,
+		size_t num, bool discard)
+{
+	if (!vertbuffer->dynamic) {
+		blog(LOG_ERROR, "vertexbuffer_flush_range: vertex buffer is "
+		                "not dynamic");
+		return;
+	}
+
+	if (!num || start + num > vertbuffer->numVerts) {
+		blog(LOG_ERROR, "vertexbuffer_flush_range: invalid range");
+		return;
+	}
+
+	try {
+		vb_data *data = vertbuffer->vbd.data;
+
+		vertbuffer->FlushBufferRange(vertbuffer->vertexBuffer,
+				data->points, sizeof(vec3), start, num,
+				discard);
+
+		if (vertbuffer->normalBuffer)
+			vertbuffer->FlushBufferRange(vertbuffer->normalBuffer,
+					data->normals, sizeof(vec3),
+					start, num, discard);
+
+		if (vertbuffer->tangentBuffer)
+			vertbuffer->FlushBufferRange(vertbuffer->tangentBuffer,
+					data->tangents, sizeof(vec3),
+					start, num, discard);
+
+		if (vertbuffer->colorBuffer)
+			vertbuffer->FlushBufferRange(vertbuffer->colorBuffer,
+					data->colors, sizeof(uint32_t),
+					start, num, discard);
+
+		for (size_t i = 0; i < vertbuffer->uvBuffers.size(); i++) {
+			tvertarray &tv = data->tvarray[i];
+			vertbuffer->FlushBufferRange(vertbuffer->uvBuffers[i],
+					tv.array, tv.width*sizeof(float),
+					start, num, discard);
+		}
+
+	} catch (HRError error) {
+		blog(LOG_ERROR, "vertexbuffer_flush_range (D3D11): %s (%08lX)",
+				error.str, error.hr);
+	}
+}
+
 struct vb_data *vertexbuffer_getdata(vertbuffer_t vertbuffer)
 {
 	return vertbuffer->vbd.data;
@@ -1762,6 +2048,23 @@ extern "C" EXPORT texture_t device_create_gdi_texture(device_t device,
 	return texture;
 }
 
+extern "C" EXPORT texture_t device_texture_open_shared(device_t device,
+		uint32_t handle)
+{
+	gs_texture *texture = nullptr;
+	try {
+		texture = new gs_texture_2d(device, handle);
+	} catch (HRError error) {
+		blog(LOG_ERROR, "device_texture_open_shared (D3D11): %s "
+		                "(%08lX)", error.str, error.hr);
+	} catch (const char *error) {
+		blog(LOG_ERROR, "device_texture_open_shared (D3D11): %s",
+				error);
+	}
+
+	return texture;
+}
+
 static inline bool TextureGDICompatible(gs_texture_2d *tex2d, const char *func)
 {
 	if (!tex2d->isGDICompatible) {
@@ -24,6 +24,7 @@
 
 #include <windows.h>
 #include <dxgi.h>
+#include <dxgi1_3.h>
 #include <d3d11.h>
 #include <d3dcompiler.h>
 
@@ -75,11 +76,38 @@ static inline DXGI_FORMAT ConvertGSTextureFormat(gs_color_format format)
 	case GS_DXT1:        return DXGI_FORMAT_BC1_UNORM;
 	case GS_DXT3:        return DXGI_FORMAT_BC2_UNORM;
 	case GS_DXT5:        return DXGI_FORMAT_BC3_UNORM;
+	case GS_R8G8:        return DXGI_FORMAT_R8G8_UNORM;
 	}
 
 	return DXGI_FORMAT_UNKNOWN;
 }
 
+static inline gs_color_format ConvertDXGITextureFormat(DXGI_FORMAT format)
+{
+	switch ((unsigned long)format) {
+	case DXGI_FORMAT_A8_UNORM:           return GS_A8;
+	case DXGI_FORMAT_R8_UNORM:           return GS_R8;
+	case DXGI_FORMAT_R8G8B8A8_UNORM:     return GS_RGBA;
+	case DXGI_FORMAT_B8G8R8X8_UNORM:     return GS_BGRX;
+	case DXGI_FORMAT_B8G8R8A8_UNORM:     return GS_BGRA;
+	case DXGI_FORMAT_R10G10B10A2_UNORM:  return GS_R10G10B10A2;
+	case DXGI_FORMAT_R16G16B16A16_UNORM: return GS_RGBA16;
+	case DXGI_FORMAT_R16_UNORM:          return GS_R16;
+	case DXGI_FORMAT_R16G16B16A16_FLOAT: return GS_RGBA16F;
+	case DXGI_FORMAT_R32G32B32A32_FLOAT: return GS_RGBA32F;
+	case DXGI_FORMAT_R16G16_FLOAT:       return GS_RG16F;
+	case DXGI_FORMAT_R32G32_FLOAT:       return GS_RG32F;
+	case DXGI_FORMAT_R16_FLOAT:          return GS_R16F;
+	case DXGI_FORMAT_R32_FLOAT:          return GS_R32F;
+	case DXGI_FORMAT_BC1_UNORM:          return GS_DXT1;
+	case DXGI_FORMAT_BC2_UNORM:          return GS_DXT3;
+	case DXGI_FORMAT_BC3_UNORM:          return GS_DXT5;
+	case DXGI_FORMAT_R8G8_UNORM:         return GS_R8G8;
+	}
+
+	return GS_UNKNOWN;
+}
+
 static inline DXGI_FORMAT ConvertGSZStencilFormat(gs_zstencil_format format)
 {
 	switch (format) {
@@ -188,6 +216,9 @@ struct gs_vertex_buffer {
 
 	void FlushBuffer(ID3D11Buffer *buffer, void *array,
 			size_t elementSize);
+	void FlushBufferRange(ID3D11Buffer *buffer, void *array,
+			size_t elementSize, size_t start, size_t num,
+			bool discard);
 
 	void MakeBufferList(gs_vertex_shader *shader,
 			vector<ID3D11Buffer*> &buffers,
@@ -280,6 +311,8 @@ struct gs_texture_2d : gs_texture {
 			gs_color_format colorFormat, uint32_t levels,
 			const void **data, uint32_t flags, gs_texture_type type,
 			bool gdiCompatible, bool shared);
+
+	gs_texture_2d(device_t device, uint32_t handle);
 };
 
 struct gs_zstencil_buffer {
@@ -308,6 +341,11 @@ struct gs_zstencil_buffer {
 struct gs_stage_surface {
 	ComPtr<ID3D11Texture2D> texture;
 
+	/* event query issued after each copy to the surface, so readiness can
+	 * be polled without mapping it */
+	ComPtr<ID3D11Query>     query;
+	bool                    staged;
+
 	gs_device       *device;
 	uint32_t        width, height;
 	gs_color_format format;
@@ -357,10 +395,11 @@ struct gs_shader {
 	vector<shader_param> params;
 	ComPtr<ID3D11Buffer> constants;
 	size_t               constantSize;
+	vector<uint8_t>      constData;
 
-	inline void UpdateParam(vector<uint8_t> &constData, shader_param &param,
+	inline void UpdateParam(gs_device *target, shader_param &param,
 			bool &upload);
-	void UploadParams();
+	void UploadParams(gs_device *target);
 
 	void BuildConstantBuffer();
 	void Compile(const char *shaderStr, const char *file,
@@ -441,6 +480,15 @@ struct gs_swap_chain {
 	gs_zstencil_buffer             zs;
 	ComPtr<IDXGISwapChain>         swap;
 
+	/* flip model swap chains are presented without a copy through the
+	 * compositor, and signal the waitable object when a buffer is free.
+	 * the flags have to be passed to ResizeBuffers again */
+	bool                           flip;
+	UINT                           flags;
+	HANDLE                         waitable;
+
+	void CreateSwap(gs_init_data *data);
+	void InitHeadlessTarget(uint32_t cx, uint32_t cy);
 	void InitTarget(uint32_t cx, uint32_t cy);
 	void InitZStencilBuffer(uint32_t cx, uint32_t cy);
 	void Resize(uint32_t cx, uint32_t cy);
@@ -449,17 +497,43 @@ struct gs_swap_chain {
 	inline gs_swap_chain()
 		: device     (NULL),
 		  numBuffers (0),
-		  hwnd       (NULL)
+		  hwnd       (NULL),
+		  flip       (false),
+		  flags      (0),
+		  waitable   (NULL)
 	{
 	}
 
 	gs_swap_chain(gs_device *device, gs_init_data *data);
+
+	inline ~gs_swap_chain()
+	{
+		if (waitable)
+			CloseHandle(waitable);
+	}
 };
 
+/* FNV-1a of the raw state, which is compared with memcmp as well, so the
+ * saved states can be told apart without comparing every one of them */
+template<typename T> static inline size_t HashState(const T &state)
+{
+	const uint8_t *data = (const uint8_t*)&state;
+	uint32_t      hash  = 2166136261U;
+
+	for (size_t i = 0; i < sizeof(T); i++) {
+		hash ^= data[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
 struct BlendState {
 	bool          blendEnabled;
 	gs_blend_type srcFactor;
 	gs_blend_type destFactor;
+	gs_blend_type srcFactorAlpha;
+	gs_blend_type destFactorAlpha;
 
 	bool          redEnabled;
 	bool          greenEnabled;
@@ -467,13 +541,15 @@ struct BlendState {
 	bool          alphaEnabled;
 
 	inline BlendState()
-		: blendEnabled (true),
-		  srcFactor    (GS_BLEND_SRCALPHA),
-		  destFactor   (GS_BLEND_INVSRCALPHA),
-		  redEnabled   (true),
-		  greenEnabled (true),
-		  blueEnabled  (true),
-		  alphaEnabled (true)
+		: blendEnabled    (true),
+		  srcFactor       (GS_BLEND_SRCALPHA),
+		  destFactor      (GS_BLEND_INVSRCALPHA),
+		  srcFactorAlpha  (GS_BLEND_ONE),
+		  destFactorAlpha (GS_BLEND_ZERO),
+		  redEnabled      (true),
+		  greenEnabled    (true),
+		  blueEnabled     (true),
+		  alphaEnabled    (true)
 	{
 	}
 
@@ -485,8 +561,11 @@ struct BlendState {
 
 struct SavedBlendState : BlendState {
 	ComPtr<ID3D11BlendState> state;
+	size_t                   hash;
 
-	inline SavedBlendState(const BlendState &val) : BlendState(val)
+	inline SavedBlendState(const BlendState &val)
+		: BlendState (val),
+		  hash       (HashState(val))
 	{
 	}
 };
@@ -533,9 +612,11 @@ struct ZStencilState {
 
 struct SavedZStencilState : ZStencilState {
 	ComPtr<ID3D11DepthStencilState> state;
+	size_t                          hash;
 
 	inline SavedZStencilState(const ZStencilState &val)
-		: ZStencilState (val)
+		: ZStencilState (val),
+		  hash          (HashState(val))
 	{
 	}
 };
@@ -558,9 +639,11 @@ struct RasterState {
 
 struct SavedRasterState : RasterState {
 	ComPtr<ID3D11RasterizerState> state;
+	size_t                        hash;
 
 	inline SavedRasterState(const RasterState &val)
-	       : RasterState (val)
+	       : RasterState (val),
+	         hash        (HashState(val))
 	{
 	}
 };
@@ -575,6 +658,10 @@ struct gs_device {
 	ComPtr<ID3D11DeviceContext> context;
 	gs_swap_chain               defaultSwap;
 
+	/* set for devices that record on a deferred context, which share the
+	 * D3D11 device of this immediate one */
+	gs_device                   *immediate;
+
 	gs_texture_2d               *curRenderTarget;
 	gs_zstencil_buffer          *curZStencilBuffer;
 	int                         curRenderSide;
@@ -608,7 +695,10 @@ struct gs_device {
 	matrix4                     curViewMatrix;
 	matrix4                     curViewProjMatrix;
 
-	void InitFactory(uint32_t adapterIdx, IDXGIAdapter1 **adapter);
+	void InitFactory(uint32_t adapterIdx, IDXGIAdapter1 **adapter,
+			bool headless);
+	void InitHeadlessDevice(IDXGIAdapter *adapter, uint32_t flags,
+			D3D_FEATURE_LEVEL *levelUsed);
 	void InitDevice(gs_init_data *data, IDXGIAdapter *adapter);
 
 	ID3D11DepthStencilState *AddZStencilState();
@@ -625,4 +715,5 @@ struct gs_device {
 	void UpdateViewProjMatrix();
 
 	gs_device(gs_init_data *data);
+	gs_device(gs_device *immediate);
 };
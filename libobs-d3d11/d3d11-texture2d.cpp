@@ -25,6 +25,7 @@ void gs_texture_2d::InitSRD(vector<D3D11_SUBRESOURCE_DATA> &srd,
 	uint32_t texSizeBytes  = height * rowSizeBytes / 8;
 	size_t   textures      = type == GS_TEXTURE_2D ? 1 : 6;
 	uint32_t actual_levels = levels;
+	bool     compressed    = gs_is_compressed_format(format);
 	
 	if (!actual_levels)
 		actual_levels = gs_num_total_levels(width, height);
@@ -34,8 +35,19 @@ void gs_texture_2d::InitSRD(vector<D3D11_SUBRESOURCE_DATA> &srd,
 	for (size_t i = 0; i < textures; i++) {
 		uint32_t newRowSize = rowSizeBytes;
 		uint32_t newTexSize = texSizeBytes;
+		uint32_t levelWidth  = width;
+		uint32_t levelHeight = height;
 
 		for (uint32_t j = 0; j < actual_levels; j++) {
+			/* compressed pitches are for rows of 4x4 blocks */
+			if (compressed) {
+				newRowSize = gs_get_compressed_row_size(format,
+						levelWidth);
+				newTexSize = gs_get_compressed_level_size(
+						format, levelWidth,
+						levelHeight);
+			}
+
 			D3D11_SUBRESOURCE_DATA newSRD;
 			newSRD.pSysMem          = *data;
 			newSRD.SysMemPitch      = newRowSize; 
@@ -44,6 +56,8 @@ void gs_texture_2d::InitSRD(vector<D3D11_SUBRESOURCE_DATA> &srd,
 
 			newRowSize /= 2;
 			newTexSize /= 4;
+			levelWidth  = levelWidth  > 1 ? levelWidth  / 2 : 1;
+			levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
 			data++;
 		}
 	}
@@ -100,12 +114,14 @@ void gs_texture_2d::InitResourceView()
 	memset(&resourceDesc, 0, sizeof(resourceDesc));
 	resourceDesc.Format = dxgiFormat;
 
+	/* -1 makes every level of the texture visible, including uploaded
+	 * mipmaps and not just generated ones */
 	if (type == GS_TEXTURE_CUBE) {
 		resourceDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
-		resourceDesc.TextureCube.MipLevels = genMipmaps ? -1 : 1;
+		resourceDesc.TextureCube.MipLevels = -1;
 	} else {
 		resourceDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-		resourceDesc.Texture2D.MipLevels = genMipmaps ? -1 : 1;
+		resourceDesc.Texture2D.MipLevels = -1;
 	}
 
 	hr = device->device->CreateShaderResourceView(texture, &resourceDesc,
@@ -161,3 +177,30 @@ gs_texture_2d::gs_texture_2d(device_t device, uint32_t width, uint32_t height,
 	if (isRenderTarget)
 		InitRenderTargets();
 }
+
+gs_texture_2d::gs_texture_2d(device_t device, uint32_t handle)
+	: gs_texture      (device, GS_TEXTURE_2D, 1, GS_UNKNOWN),
+	  isGDICompatible (false),
+	  isShared        (true),
+	  isDynamic       (false),
+	  isRenderTarget  (false),
+	  genMipmaps      (false),
+	  sharedHandle    ((HANDLE)(uintptr_t)handle)
+{
+	D3D11_TEXTURE2D_DESC td;
+	HRESULT hr;
+
+	hr = device->device->OpenSharedResource(sharedHandle,
+			__uuidof(ID3D11Texture2D), (void**)texture.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to open shared texture", hr);
+
+	texture->GetDesc(&td);
+
+	width      = td.Width;
+	height     = td.Height;
+	dxgiFormat = td.Format;
+	format     = ConvertDXGITextureFormat(td.Format);
+
+	InitResourceView();
+}
@@ -0,0 +1,165 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "d3d11-subsystem.hpp"
+
+/*
+ * Timestamp queries are issued on the context of the device that created
+ * them, but their results can only be read back on the immediate context, so
+ * timers created from a deferred device read back through its parent.
+ */
+struct gs_timer {
+	ComPtr<ID3D11Query> queryBegin;
+	ComPtr<ID3D11Query> queryEnd;
+	device_t            device;
+
+	gs_timer(device_t device);
+};
+
+struct gs_timer_range {
+	ComPtr<ID3D11Query> queryDisjoint;
+	device_t            device;
+
+	gs_timer_range(device_t device);
+};
+
+static inline ID3D11DeviceContext *readback_context(device_t device)
+{
+	return device->immediate ? device->immediate->context : device->context;
+}
+
+gs_timer::gs_timer(device_t device)
+	: device (device)
+{
+	D3D11_QUERY_DESC desc;
+	HRESULT hr;
+
+	desc.Query     = D3D11_QUERY_TIMESTAMP;
+	desc.MiscFlags = 0;
+
+	hr = device->device->CreateQuery(&desc, queryBegin.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to create timestamp query", hr);
+
+	hr = device->device->CreateQuery(&desc, queryEnd.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to create timestamp query", hr);
+}
+
+gs_timer_range::gs_timer_range(device_t device)
+	: device (device)
+{
+	D3D11_QUERY_DESC desc;
+	HRESULT hr;
+
+	desc.Query     = D3D11_QUERY_TIMESTAMP_DISJOINT;
+	desc.MiscFlags = 0;
+
+	hr = device->device->CreateQuery(&desc, queryDisjoint.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to create timestamp disjoint query", hr);
+}
+
+extern "C" EXPORT gputimer_t device_create_timer(device_t device)
+{
+	gs_timer *timer = NULL;
+
+	try {
+		timer = new gs_timer(device);
+	} catch (HRError error) {
+		blog(LOG_ERROR, "device_create_timer (D3D11): %s (%08lX)",
+				error.str, error.hr);
+	}
+
+	return timer;
+}
+
+extern "C" EXPORT void gputimer_destroy(gputimer_t timer)
+{
+	delete timer;
+}
+
+extern "C" EXPORT void gputimer_begin(gputimer_t timer)
+{
+	timer->device->context->End(timer->queryBegin);
+}
+
+extern "C" EXPORT void gputimer_end(gputimer_t timer)
+{
+	timer->device->context->End(timer->queryEnd);
+}
+
+extern "C" EXPORT bool gputimer_get_data(gputimer_t timer, uint64_t *ticks)
+{
+	ID3D11DeviceContext *context = readback_context(timer->device);
+	uint64_t begin, end;
+
+	/* never flushes, results that aren't ready yet are simply missed */
+	if (context->GetData(timer->queryBegin, &begin, sizeof(begin),
+				D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return false;
+	if (context->GetData(timer->queryEnd, &end, sizeof(end),
+				D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return false;
+
+	*ticks = end > begin ? end - begin : 0;
+	return true;
+}
+
+extern "C" EXPORT gputimer_range_t device_create_timer_range(device_t device)
+{
+	gs_timer_range *range = NULL;
+
+	try {
+		range = new gs_timer_range(device);
+	} catch (HRError error) {
+		blog(LOG_ERROR, "device_create_timer_range (D3D11): %s (%08lX)",
+				error.str, error.hr);
+	}
+
+	return range;
+}
+
+extern "C" EXPORT void gputimer_range_destroy(gputimer_range_t range)
+{
+	delete range;
+}
+
+extern "C" EXPORT void gputimer_range_begin(gputimer_range_t range)
+{
+	range->device->context->Begin(range->queryDisjoint);
+}
+
+extern "C" EXPORT void gputimer_range_end(gputimer_range_t range)
+{
+	range->device->context->End(range->queryDisjoint);
+}
+
+extern "C" EXPORT bool gputimer_range_get_data(gputimer_range_t range,
+		bool *disjoint, uint64_t *frequency)
+{
+	ID3D11DeviceContext *context = readback_context(range->device);
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT data;
+
+	if (context->GetData(range->queryDisjoint, &data, sizeof(data),
+				D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return false;
+
+	*disjoint  = !!data.Disjoint;
+	*frequency = data.Frequency;
+	return true;
+}
@@ -71,6 +71,10 @@ static NSOpenGLContext *gl_context_create(struct gs_init_data *info)
 
 	ADD_ATTR2(NSOpenGLPFADepthSize, 16);
 
+	/* headless contexts aren't tied to the GPU driving a display */
+	if(!info->window.view)
+		ADD_ATTR(NSOpenGLPFAAllowOfflineRenderers);
+
 	ADD_ATTR(0);
 
 #undef ADD_ATTR2
@@ -91,7 +95,12 @@ static NSOpenGLContext *gl_context_create(struct gs_init_data *info)
 		return NULL;
 	}
 
-	[context setView:info->window.view];
+	if(info->window.view)
+		[context setView:info->window.view];
+
+	/* keep flushBuffer from waiting for the next display refresh */
+	GLint interval = 0;
+	[context setValues:&interval forParameter:NSOpenGLCPSwapInterval];
 
 	return context;
 }
@@ -104,8 +113,15 @@ static bool gl_init_default_swap(struct gl_platform *plat, device_t dev,
 
 	plat->swap.device = dev;
 	plat->swap.info	  = *info;
-	plat->swap.wi     = gl_windowinfo_create(info);
 
+	/* without a view, the default swap chain is never presented and
+	 * everything is rendered to textures */
+	if(!info->window.view) {
+		plat->swap.wi = bzalloc(sizeof(struct gl_windowinfo));
+		return true;
+	}
+
+	plat->swap.wi     = gl_windowinfo_create(info);
 	return plat->swap.wi != NULL;
 }
 
@@ -130,6 +146,33 @@ fail:
 	return NULL;
 }
 
+/* the shared context has no view, it only renders to textures */
+struct gl_platform *gl_platform_create_shared(device_t device,
+		struct gl_platform *parent)
+{
+	struct gl_platform *plat = bzalloc(sizeof(struct gl_platform));
+
+	plat->context = [[NSOpenGLContext alloc]
+		initWithFormat:[parent->context pixelFormat]
+		shareContext:parent->context];
+	if(!plat->context) {
+		blog(LOG_ERROR, "Failed to create shared context");
+		goto fail;
+	}
+
+	plat->swap.device           = device;
+	plat->swap.info             = parent->swap.info;
+	plat->swap.info.window.view = nil;
+	plat->swap.wi               = bzalloc(sizeof(struct gl_windowinfo));
+
+	[plat->context makeCurrentContext];
+	return plat;
+
+fail:
+	gl_platform_destroy(plat);
+	return NULL;
+}
+
 struct gs_swap_chain *gl_platform_getswap(struct gl_platform *platform)
 {
 	if(platform)
@@ -212,11 +255,15 @@ void device_load_swapchain(device_t device, swapchain_t swap)
 		return;
 
 	device->cur_swap = swap;
-	[device->plat->context setView:swap->wi->view];
+	if(swap->wi->view)
+		[device->plat->context setView:swap->wi->view];
 }
 
 void device_present(device_t device)
 {
+	if(!device->cur_swap->wi->view)
+		return;
+
 	[device->plat->context flushBuffer];
 }
 
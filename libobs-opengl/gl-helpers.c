@@ -18,16 +18,21 @@
 #include "gl-subsystem.h"
 
 bool gl_init_face(GLenum target, GLenum type, uint32_t num_levels,
-		GLenum format, GLint internal_format, bool compressed,
+		GLenum format, GLint internal_format,
+		enum gs_color_format color_format,
 		uint32_t width, uint32_t height, uint32_t size,
 		const void ***p_data)
 {
 	bool success = true;
+	bool compressed = gs_is_compressed_format(color_format);
 	const void **data = p_data ? *p_data : NULL;
 	uint32_t i;
 
 	for (i = 0; i < num_levels; i++) {
 		if (compressed) {
+			/* levels smaller than a block still take up a block */
+			size = gs_get_compressed_level_size(color_format,
+					width, height);
 			glCompressedTexImage2D(target, i, internal_format,
 					width, height, 0, size,
 					data ? *data : NULL);
@@ -148,6 +153,35 @@ bool gl_create_buffer(GLenum target, GLuint *buffer, GLsizeiptr size,
 	return success;
 }
 
+bool update_buffer_range(GLenum target, GLuint buffer, const void *data,
+		size_t offset, size_t size, bool discard)
+{
+	GLbitfield access = GL_MAP_WRITE_BIT;
+	void *ptr;
+	bool success = true;
+
+	/* without a discard the range is known to be idle, so the map can
+	 * skip synchronizing with the GPU entirely */
+	if (discard)
+		access |= GL_MAP_INVALIDATE_BUFFER_BIT;
+	else
+		access |= GL_MAP_INVALIDATE_RANGE_BIT |
+		          GL_MAP_UNSYNCHRONIZED_BIT;
+
+	if (!gl_bind_buffer(target, buffer))
+		return false;
+
+	ptr = glMapBufferRange(target, offset, size, access);
+	success = gl_success("glMapBufferRange");
+	if (success && ptr) {
+		memcpy(ptr, data, size);
+		glUnmapBuffer(target);
+	}
+
+	gl_bind_buffer(target, 0);
+	return success;
+}
+
 bool update_buffer(GLenum target, GLuint buffer, void *data, size_t size)
 {
 	void *ptr;
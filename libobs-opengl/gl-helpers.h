@@ -144,7 +144,8 @@ static inline bool gl_get_integer_v(GLenum pname, GLint *params)
 }
 
 extern bool gl_init_face(GLenum target, GLenum type, uint32_t num_levels,
-		GLenum format, GLint internal_format, bool compressed,
+		GLenum format, GLint internal_format,
+		enum gs_color_format color_format,
 		uint32_t width, uint32_t height, uint32_t size,
 		const void ***p_data);
 
@@ -159,3 +160,5 @@ extern bool gl_create_buffer(GLenum target, GLuint *buffer, GLsizeiptr size,
 
 extern bool update_buffer(GLenum target, GLuint buffer, void *data,
 		size_t size);
+extern bool update_buffer_range(GLenum target, GLuint buffer,
+		const void *data, size_t offset, size_t size, bool discard);
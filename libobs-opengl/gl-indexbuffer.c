@@ -40,7 +40,7 @@ indexbuffer_t device_create_indexbuffer(device_t device,
 	struct gs_index_buffer *ib = bzalloc(sizeof(struct gs_index_buffer));
 	size_t width = type == GS_UNSIGNED_LONG ? sizeof(long) : sizeof(short);
 
-	ib->device  = device;
+	ib->device  = gl_object_owner(device);
 	ib->data    = indices;
 	ib->dynamic = flags & GS_DYNAMIC;
 	ib->num     = num;
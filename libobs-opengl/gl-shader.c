@@ -78,7 +78,6 @@ static bool gl_add_param(struct gs_shader *shader, struct shader_var *var,
 	}
 
 	da_move(param.def_value, var->default_val);
-	da_copy(param.cur_value, param.def_value);
 
 	param.param = glGetUniformLocation(shader->program, param.name);
 	if (!gl_success("glGetUniformLocation"))
@@ -195,18 +194,110 @@ static inline bool gl_process_attribs(struct gs_shader *shader,
 	return true;
 }
 
+static inline bool has_program_binary(void)
+{
+	return GLAD_GL_VERSION_4_1 || GLAD_GL_ARB_get_program_binary;
+}
+
+/* program binaries are only valid for the driver that created them */
+static void gl_get_cache_key(struct dstr *key, const char *shader_str)
+{
+	dstr_printf(key, "gl:%s:%s:%s\n",
+			(const char*)glGetString(GL_VENDOR),
+			(const char*)glGetString(GL_RENDERER),
+			(const char*)glGetString(GL_VERSION));
+	dstr_cat(key, shader_str);
+}
+
+static bool gl_load_program_binary(struct gs_shader *shader, const char *key)
+{
+	uint8_t *data;
+	size_t  size;
+	GLenum  format;
+	GLint   linked = 0;
+
+	data = gs_shader_cache_load(key, &size);
+	if (!data)
+		return false;
+
+	if (size <= sizeof(format))
+		goto fail;
+
+	memcpy(&format, data, sizeof(format));
+
+	shader->program = glCreateProgram();
+	if (!gl_success("glCreateProgram") || !shader->program)
+		goto fail;
+
+	glProgramParameteri(shader->program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+	glProgramBinary(shader->program, format, data + sizeof(format),
+			(GLsizei)(size - sizeof(format)));
+
+	/* binaries are rejected after driver updates, which is expected */
+	while (glGetError() != GL_NO_ERROR);
+
+	glGetProgramiv(shader->program, GL_LINK_STATUS, &linked);
+	if (!gl_success("glGetProgramiv") || !linked) {
+		glDeleteProgram(shader->program);
+		shader->program = 0;
+		goto fail;
+	}
+
+	bfree(data);
+	return true;
+
+fail:
+	bfree(data);
+	return false;
+}
+
+static void gl_save_program_binary(struct gs_shader *shader, const char *key)
+{
+	uint8_t *data;
+	GLint   length  = 0;
+	GLsizei written = 0;
+	GLenum  format;
+
+	glGetProgramiv(shader->program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (!gl_success("glGetProgramiv") || length <= 0)
+		return;
+
+	data = bmalloc(sizeof(format) + length);
+	glGetProgramBinary(shader->program, length, &written, &format,
+			data + sizeof(format));
+
+	if (gl_success("glGetProgramBinary") && written > 0) {
+		memcpy(data, &format, sizeof(format));
+		gs_shader_cache_save(key, data, sizeof(format) + written);
+	}
+
+	bfree(data);
+}
+
 static bool gl_shader_init(struct gs_shader *shader,
 		struct gl_shader_parser *glsp,
 		const char *file, char **error_string)
 {
 	GLenum type = convert_shader_type(shader->type);
+	struct dstr cache_key = {0};
+	bool use_cache = has_program_binary();
+	bool cached = false;
 	int compiled = 0;
 	bool success = true;
 
-	shader->program = glCreateShaderProgramv(type, 1,
-			(const GLchar**)&glsp->gl_string.array);
-	if (!gl_success("glCreateShaderProgramv") || !shader->program)
-		return false;
+	if (use_cache) {
+		gl_get_cache_key(&cache_key, glsp->gl_string.array);
+		cached = gl_load_program_binary(shader, cache_key.array);
+	}
+
+	if (!cached) {
+		shader->program = glCreateShaderProgramv(type, 1,
+				(const GLchar**)&glsp->gl_string.array);
+		if (!gl_success("glCreateShaderProgramv") || !shader->program) {
+			dstr_free(&cache_key);
+			return false;
+		}
+	}
 
 	blog(LOG_DEBUG, "+++++++++++++++++++++++++++++++++++");
 	blog(LOG_DEBUG, "  GL shader string for: %s", file);
@@ -223,6 +314,10 @@ static bool gl_shader_init(struct gs_shader *shader,
 
 	gl_get_program_info(shader->program, file, error_string);
 
+	if (success && use_cache && !cached)
+		gl_save_program_binary(shader, cache_key.array);
+	dstr_free(&cache_key);
+
 	if (success)
 		success = gl_add_params(shader, glsp);
 	/* Only vertex shaders actually require input attributes */
@@ -241,7 +336,7 @@ static struct gs_shader *shader_create(device_t device, enum shader_type type,
 	struct gl_shader_parser glsp;
 	bool success = true;
 
-	shader->device = device;
+	shader->device = gl_object_owner(device);
 	shader->type   = type;
 
 	gl_shader_parser_init(&glsp, type);
@@ -359,9 +454,24 @@ sparam_t shader_getworldmatrix(shader_t shader)
 	return shader->world;
 }
 
+/* returns false if the uniform already has this value.  effects upload all
+ * of their parameters whenever a pass begins, so for scenes with many items
+ * most of these calls would otherwise set the same values again */
+static bool update_cur_value(struct shader_param *param, const void *val,
+		size_t size)
+{
+	if (param->cur_value.num == size &&
+	    memcmp(param->cur_value.array, val, size) == 0)
+		return false;
+
+	da_copy_array(param->cur_value, val, size);
+	return true;
+}
+
 void shader_setbool(shader_t shader, sparam_t param, bool val)
 {
-	if (matching_shader(shader, param)) {
+	if (matching_shader(shader, param) &&
+	    update_cur_value(param, &val, sizeof(val))) {
 		glProgramUniform1i(shader->program, param->param, (GLint)val);
 		gl_success("glProgramUniform1i");
 	}
@@ -369,7 +479,8 @@ void shader_setbool(shader_t shader, sparam_t param, bool val)
 
 void shader_setfloat(shader_t shader, sparam_t param, float val)
 {
-	if (matching_shader(shader, param)) {
+	if (matching_shader(shader, param) &&
+	    update_cur_value(param, &val, sizeof(val))) {
 		glProgramUniform1f(shader->program, param->param, val);
 		gl_success("glProgramUniform1f");
 	}
@@ -377,7 +488,8 @@ void shader_setfloat(shader_t shader, sparam_t param, float val)
 
 void shader_setint(shader_t shader, sparam_t param, int val)
 {
-	if (matching_shader(shader, param)) {
+	if (matching_shader(shader, param) &&
+	    update_cur_value(param, &val, sizeof(val))) {
 		glProgramUniform1i(shader->program, param->param, val);
 		gl_success("glProgramUniform1i");
 	}
@@ -389,7 +501,8 @@ void shader_setmatrix3(shader_t shader, sparam_t param,
 	struct matrix4 mat;
 	matrix4_from_matrix3(&mat, val);
 
-	if (matching_shader(shader, param)) {
+	if (matching_shader(shader, param) &&
+	    update_cur_value(param, &mat, sizeof(mat))) {
 		glProgramUniformMatrix4fv(shader->program, param->param, 1,
 				false, mat.x.ptr);
 		gl_success("glProgramUniformMatrix4fv");
@@ -399,7 +512,8 @@ void shader_setmatrix3(shader_t shader, sparam_t param,
 void shader_setmatrix4(shader_t shader, sparam_t param,
 		const struct matrix4 *val)
 {
-	if (matching_shader(shader, param)) {
+	if (matching_shader(shader, param) &&
+	    update_cur_value(param, val, sizeof(*val))) {
 		glProgramUniformMatrix4fv(shader->program, param->param, 1,
 				false, val->x.ptr);
 		gl_success("glProgramUniformMatrix4fv");
@@ -409,7 +523,8 @@ void shader_setmatrix4(shader_t shader, sparam_t param,
 void shader_setvec2(shader_t shader, sparam_t param,
 		const struct vec2 *val)
 {
-	if (matching_shader(shader, param)) {
+	if (matching_shader(shader, param) &&
+	    update_cur_value(param, val, sizeof(*val))) {
 		glProgramUniform2fv(shader->program, param->param, 1, val->ptr);
 		gl_success("glProgramUniform2fv");
 	}
@@ -418,7 +533,8 @@ void shader_setvec2(shader_t shader, sparam_t param,
 void shader_setvec3(shader_t shader, sparam_t param,
 		const struct vec3 *val)
 {
-	if (matching_shader(shader, param)) {
+	if (matching_shader(shader, param) &&
+	    update_cur_value(param, val, sizeof(*val))) {
 		glProgramUniform3fv(shader->program, param->param, 1, val->ptr);
 		gl_success("glProgramUniform3fv");
 	}
@@ -427,7 +543,8 @@ void shader_setvec3(shader_t shader, sparam_t param,
 void shader_setvec4(shader_t shader, sparam_t param,
 		const struct vec4 *val)
 {
-	if (matching_shader(shader, param)) {
+	if (matching_shader(shader, param) &&
+	    update_cur_value(param, val, sizeof(*val))) {
 		glProgramUniform4fv(shader->program, param->param, 1, val->ptr);
 		gl_success("glProgramUniform4fv");
 	}
@@ -440,10 +557,12 @@ void shader_settexture(shader_t shader, sparam_t param, texture_t val)
 }
 
 static void shader_setval_data(shader_t shader, sparam_t param,
-		const void *val, int count)
+		const void *val, size_t size, int count)
 {
 	if (!matching_shader(shader, param))
 		return;
+	if (!update_cur_value(param, val, size))
+		return;
 
 	if (param->type == SHADER_PARAM_BOOL ||
 	    param->type == SHADER_PARAM_INT) {
@@ -521,7 +640,7 @@ void shader_setval(shader_t shader, sparam_t param, const void *val,
 	if (param->type == SHADER_PARAM_TEXTURE)
 		shader_settexture(shader, param, *(texture_t*)val);
 	else
-		shader_setval_data(shader, param, val, count);
+		shader_setval_data(shader, param, val, size, count);
 }
 
 void shader_setdefault(shader_t shader, sparam_t param)
@@ -17,15 +17,26 @@
 
 #include "gl-subsystem.h"
 
-static bool create_pixel_pack_buffer(struct gs_stage_surface *surf)
+static inline bool has_sync(void)
+{
+	return GLAD_GL_VERSION_3_2 || GLAD_GL_ARB_sync;
+}
+
+static inline void free_fence(struct gs_stage_surface *surf, int idx)
+{
+	if (surf->fences[idx]) {
+		glDeleteSync(surf->fences[idx]);
+		surf->fences[idx] = NULL;
+	}
+}
+
+static bool create_pixel_pack_buffer(struct gs_stage_surface *surf,
+		GLuint buffer)
 {
 	GLsizeiptr size;
 	bool success = true;
 
-	if (!gl_gen_buffers(1, &surf->pack_buffer))
-		return false;
-
-	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, surf->pack_buffer))
+	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, buffer))
 		return false;
 
 	size  = surf->width * surf->bytes_per_pixel;
@@ -56,20 +67,31 @@ stagesurf_t device_create_stagesurface(device_t device, uint32_t width,
 	surf->gl_type            = get_gl_format_type(color_format);
 	surf->bytes_per_pixel    = gs_get_format_bpp(color_format)/8;
 
-	if (!create_pixel_pack_buffer(surf)) {
-		blog(LOG_ERROR, "device_create_stagesurface (GL) failed");
-		stagesurface_destroy(surf);
-		return NULL;
+	if (!gl_gen_buffers(NUM_PACK_BUFFERS, surf->pack_buffers))
+		goto fail;
+
+	for (size_t i = 0; i < NUM_PACK_BUFFERS; i++) {
+		if (!create_pixel_pack_buffer(surf, surf->pack_buffers[i]))
+			goto fail;
 	}
 
 	return surf;
+
+fail:
+	blog(LOG_ERROR, "device_create_stagesurface (GL) failed");
+	stagesurface_destroy(surf);
+	return NULL;
 }
 
 void stagesurface_destroy(stagesurf_t stagesurf)
 {
 	if (stagesurf) {
-		if (stagesurf->pack_buffer)
-			gl_delete_buffers(1, &stagesurf->pack_buffer);
+		for (int i = 0; i < NUM_PACK_BUFFERS; i++)
+			free_fence(stagesurf, i);
+
+		if (stagesurf->pack_buffers[0])
+			gl_delete_buffers(NUM_PACK_BUFFERS,
+					stagesurf->pack_buffers);
 
 		bfree(stagesurf);
 	}
@@ -106,6 +128,28 @@ static bool can_stage(struct gs_stage_surface *dst, struct gs_texture_2d *src)
 	return true;
 }
 
+/* moves to the next pack buffer and returns it for the new transfer */
+static inline GLuint next_pack_buffer(struct gs_stage_surface *surf)
+{
+	if (++surf->cur_buffer == NUM_PACK_BUFFERS)
+		surf->cur_buffer = 0;
+
+	free_fence(surf, surf->cur_buffer);
+	surf->staged = false;
+	return surf->pack_buffers[surf->cur_buffer];
+}
+
+static inline void finish_stage(struct gs_stage_surface *surf)
+{
+	if (has_sync()) {
+		surf->fences[surf->cur_buffer] =
+			glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		gl_success("glFenceSync");
+	}
+
+	surf->staged = true;
+}
+
 #ifdef __APPLE__
 
 /* Apparently for mac, PBOs won't do an asynchronous transfer unless you use
@@ -120,7 +164,7 @@ void device_stage_texture(device_t device, stagesurf_t dst, texture_t src)
 	if (!can_stage(dst, tex2d))
 		goto failed;
 
-	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, dst->pack_buffer))
+	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, next_pack_buffer(dst)))
 		goto failed;
 
 	fbo = get_fbo(device, dst->width, dst->height, dst->format);
@@ -140,6 +184,7 @@ void device_stage_texture(device_t device, stagesurf_t dst, texture_t src)
 	if (!gl_success("glReadPixels"))
 		goto failed_unbind_all;
 
+	finish_stage(dst);
 	success = true;
 
 failed_unbind_all:
@@ -161,7 +206,7 @@ void device_stage_texture(device_t device, stagesurf_t dst, texture_t src)
 	if (!can_stage(dst, tex2d))
 		goto failed;
 
-	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, dst->pack_buffer))
+	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, next_pack_buffer(dst)))
 		goto failed;
 	if (!gl_bind_texture(GL_TEXTURE_2D, tex2d->base.texture))
 		goto failed;
@@ -170,6 +215,8 @@ void device_stage_texture(device_t device, stagesurf_t dst, texture_t src)
 	if (!gl_success("glGetTexImage"))
 		goto failed;
 
+	finish_stage(dst);
+
 	gl_bind_texture(GL_TEXTURE_2D, 0);
 	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
 	return;
@@ -199,18 +246,48 @@ enum gs_color_format stagesurface_getcolorformat(stagesurf_t stagesurf)
 	return stagesurf->format;
 }
 
+bool stagesurface_isready(stagesurf_t stagesurf)
+{
+	GLsync fence = stagesurf->fences[stagesurf->cur_buffer];
+	GLenum result;
+
+	if (!stagesurf->staged)
+		return false;
+	if (!fence)
+		return true;
+
+	result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+		return false;
+	if (result == GL_WAIT_FAILED)
+		gl_success("glClientWaitSync");
+
+	free_fence(stagesurf, stagesurf->cur_buffer);
+	return true;
+}
+
+/* maps the most recent transfer into this surface, waiting for it if it
+ * hasn't finished.  callers that want to avoid the wait keep their own ring
+ * of surfaces and map the oldest one, the second pack buffer only keeps a
+ * new transfer out of the buffer that's still mapped */
 bool stagesurface_map(stagesurf_t stagesurf, uint8_t **data, uint32_t *linesize)
 {
-	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, stagesurf->pack_buffer))
+	GLuint buffer = stagesurf->pack_buffers[stagesurf->cur_buffer];
+
+	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, buffer))
 		goto fail;
 
+	free_fence(stagesurf, stagesurf->cur_buffer);
+
 	*data = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
 	if (!gl_success("glMapBuffer"))
 		goto fail;
 
 	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
 
-	*linesize = stagesurf->bytes_per_pixel * stagesurf->width;
+	/* rows of the pack buffer are padded to 4 bytes */
+	*linesize = (stagesurf->bytes_per_pixel * stagesurf->width + 3) &
+		0xFFFFFFFC;
 	return true;
 
 fail:
@@ -220,7 +297,9 @@ fail:
 
 void stagesurface_unmap(stagesurf_t stagesurf)
 {
-	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, stagesurf->pack_buffer))
+	GLuint buffer = stagesurf->pack_buffers[stagesurf->cur_buffer];
+
+	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, buffer))
 		return;
 
 	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
@@ -120,6 +120,11 @@ static bool gl_init_extensions(struct gs_device* device)
 	else
 		device->copy_type = COPY_TYPE_FBO_BLIT;
 
+	/* persistent mapping needs fences to know when a buffer is free */
+	device->buffer_storage =
+		(GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) &&
+		(GLAD_GL_VERSION_3_2 || GLAD_GL_ARB_sync);
+
 	return true;
 }
 
@@ -170,6 +175,26 @@ const char *device_preprocessor_name(void)
 	return "_OPENGL";
 }
 
+/* called with the new context current */
+static bool gl_init_device(struct gs_device *device)
+{
+	if (!gl_init_extensions(device))
+		return false;
+
+	gl_enable(GL_CULL_FACE);
+	memset(&device->cur_state, 0xFF, sizeof(device->cur_state));
+
+	glGenProgramPipelines(1, &device->pipeline);
+	if (!gl_success("glGenProgramPipelines"))
+		return false;
+
+	glBindProgramPipeline(device->pipeline);
+	if (!gl_success("glBindProgramPipeline"))
+		return false;
+
+	return true;
+}
+
 device_t device_create(struct gs_init_data *info)
 {
 	struct gs_device *device = bzalloc(sizeof(struct gs_device));
@@ -178,17 +203,50 @@ device_t device_create(struct gs_init_data *info)
 	if (!device->plat)
 		goto fail;
 
-	if (!gl_init_extensions(device))
+	if (!gl_init_device(device))
 		goto fail;
-	
-	gl_enable(GL_CULL_FACE);
-	
-	glGenProgramPipelines(1, &device->pipeline);
-	if (!gl_success("glGenProgramPipelines"))
+
+	device_leavecontext(device);
+	device->cur_swap = gl_platform_getswap(device->plat);
+
+	return device;
+
+fail:
+	blog(LOG_ERROR, "device_create (GL) failed");
+	bfree(device);
+	return NULL;
+}
+
+static inline bool has_sync(void)
+{
+	return GLAD_GL_VERSION_3_2 || GLAD_GL_ARB_sync;
+}
+
+/*
+ * A shared device has its own context in the share group of the parent's, so
+ * that a loader thread can create and upload textures while the parent's
+ * context renders.  it's created on the thread that's going to use it, with
+ * no context current, and leaves no context current.
+ */
+device_t device_create_shared(device_t parent)
+{
+	struct gs_device *device;
+
+	/* objects are handed to the parent's context with fences */
+	if (!has_sync()) {
+		blog(LOG_WARNING, "device_create_shared (GL): ARB_sync is "
+		                  "required for shared contexts");
+		return NULL;
+	}
+
+	device = bzalloc(sizeof(struct gs_device));
+	device->share_parent = parent;
+
+	device->plat = gl_platform_create_shared(device, parent->plat);
+	if (!device->plat)
 		goto fail;
 
-	glBindProgramPipeline(device->pipeline);
-	if (!gl_success("glBindProgramPipeline"))
+	if (!gl_init_device(device))
 		goto fail;
 
 	device_leavecontext(device);
@@ -197,11 +255,47 @@ device_t device_create(struct gs_init_data *info)
 	return device;
 
 fail:
-	blog(LOG_ERROR, "device_create (GL) failed");
-	bfree(device);
+	blog(LOG_ERROR, "device_create_shared (GL) failed");
+	device_destroy(device);
 	return NULL;
 }
 
+gpufence_t device_create_fence(device_t device)
+{
+	struct gs_fence *fence;
+
+	if (!has_sync())
+		return NULL;
+
+	fence = bzalloc(sizeof(struct gs_fence));
+	fence->device = gl_object_owner(device);
+	fence->sync   = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	if (!gl_success("glFenceSync") || !fence->sync) {
+		bfree(fence);
+		return NULL;
+	}
+
+	/* another context can only wait on commands that have been sent */
+	glFlush();
+	return fence;
+}
+
+void gpufence_destroy(gpufence_t fence)
+{
+	if (!fence)
+		return;
+
+	glDeleteSync(fence->sync);
+	gl_success("glDeleteSync");
+	bfree(fence);
+}
+
+void gpufence_wait(gpufence_t fence)
+{
+	glWaitSync(fence->sync, 0, GL_TIMEOUT_IGNORED);
+	gl_success("glWaitSync");
+}
+
 void device_destroy(device_t device)
 {
 	if (device) {
@@ -289,7 +383,7 @@ samplerstate_t device_create_samplerstate(device_t device,
 	struct gs_sampler_state *sampler;
 
 	sampler = bzalloc(sizeof(struct gs_sampler_state));
-	sampler->device = device;
+	sampler->device = gl_object_owner(device);
 	sampler->ref    = 1;
 
 	convert_sampler_info(sampler, info);
@@ -647,6 +741,26 @@ static inline struct fbo_info *get_fbo_by_tex(struct gs_device *device,
 	return get_fbo(device, width, height, tex->format);
 }
 
+/*
+ * FBOs remember their attachment by pointer, so the attachment has to be
+ * forgotten when the texture is destroyed, otherwise a new texture allocated
+ * at the same address would never be attached
+ */
+void release_render_target(struct gs_device *device, texture_t tex)
+{
+	for (size_t i = 0; i < device->fbos.num; i++) {
+		struct fbo_info *fbo = device->fbos.array[i];
+		if (fbo->cur_render_target == tex)
+			fbo->cur_render_target = NULL;
+	}
+
+	if (device->cur_render_target == tex) {
+		gl_bind_framebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		device->cur_render_target = NULL;
+		device->cur_fbo           = NULL;
+	}
+}
+
 static bool set_current_fbo(device_t device, struct fbo_info *fbo)
 {
 	if (device->cur_fbo != fbo) {
@@ -997,76 +1111,103 @@ enum gs_cull_mode device_getcullmode(device_t device)
 	return device->cur_cull_mode;
 }
 
-void device_enable_blending(device_t device, bool enable)
+static inline void set_enabled(int *cur, GLenum capability, bool enable)
 {
+	if (*cur == (int)enable)
+		return;
+
+	*cur = (int)enable;
 	if (enable)
-		gl_enable(GL_BLEND);
+		gl_enable(capability);
 	else
-		gl_disable(GL_BLEND);
+		gl_disable(capability);
+}
 
-	UNUSED_PARAMETER(device);
+void device_enable_blending(device_t device, bool enable)
+{
+	set_enabled(&device->cur_state.blend, GL_BLEND, enable);
 }
 
 void device_enable_depthtest(device_t device, bool enable)
 {
-	if (enable)
-		gl_enable(GL_DEPTH_TEST);
-	else
-		gl_disable(GL_DEPTH_TEST);
-
-	UNUSED_PARAMETER(device);
+	set_enabled(&device->cur_state.depth_test, GL_DEPTH_TEST, enable);
 }
 
 void device_enable_stenciltest(device_t device, bool enable)
 {
-	if (enable)
-		gl_enable(GL_STENCIL_TEST);
-	else
-		gl_disable(GL_STENCIL_TEST);
-
-	UNUSED_PARAMETER(device);
+	set_enabled(&device->cur_state.stencil_test, GL_STENCIL_TEST, enable);
 }
 
 void device_enable_stencilwrite(device_t device, bool enable)
 {
-	if (enable)
-		glStencilMask(0xFFFFFFFF);
-	else
-		glStencilMask(0);
+	if (device->cur_state.stencil_write == (int)enable)
+		return;
 
-	UNUSED_PARAMETER(device);
+	device->cur_state.stencil_write = (int)enable;
+	glStencilMask(enable ? 0xFFFFFFFF : 0);
 }
 
 void device_enable_color(device_t device, bool red, bool green,
 		bool blue, bool alpha)
 {
-	glColorMask(red, green, blue, alpha);
+	int mask = (red ? 1 : 0) | (green ? 2 : 0) | (blue ? 4 : 0) |
+	           (alpha ? 8 : 0);
 
-	UNUSED_PARAMETER(device);
+	if (device->cur_state.color_mask == mask)
+		return;
+
+	device->cur_state.color_mask = mask;
+	glColorMask(red, green, blue, alpha);
 }
 
 void device_blendfunction(device_t device, enum gs_blend_type src,
 		enum gs_blend_type dest)
 {
-	GLenum gl_src = convert_gs_blend_type(src);
-	GLenum gl_dst = convert_gs_blend_type(dest);
+	device_blendfunction_separate(device, src, dest, src, dest);
+}
+
+void device_blendfunction_separate(device_t device,
+		enum gs_blend_type src_c, enum gs_blend_type dest_c,
+		enum gs_blend_type src_a, enum gs_blend_type dest_a)
+{
+	GLenum *cur = device->cur_state.blend_func;
+	GLenum gl_src_c = convert_gs_blend_type(src_c);
+	GLenum gl_dst_c = convert_gs_blend_type(dest_c);
+	GLenum gl_src_a = convert_gs_blend_type(src_a);
+	GLenum gl_dst_a = convert_gs_blend_type(dest_a);
 
-	glBlendFunc(gl_src, gl_dst);
-	if (!gl_success("glBlendFunc"))
-		blog(LOG_ERROR, "device_blendfunction (GL) failed");
+	if (cur[0] == gl_src_c && cur[1] == gl_dst_c &&
+	    cur[2] == gl_src_a && cur[3] == gl_dst_a)
+		return;
 
-	UNUSED_PARAMETER(device);
+	glBlendFuncSeparate(gl_src_c, gl_dst_c, gl_src_a, gl_dst_a);
+	if (!gl_success("glBlendFuncSeparate")) {
+		blog(LOG_ERROR, "device_blendfunction_separate (GL) failed");
+		memset(cur, 0xFF, sizeof(device->cur_state.blend_func));
+		return;
+	}
+
+	cur[0] = gl_src_c;
+	cur[1] = gl_dst_c;
+	cur[2] = gl_src_a;
+	cur[3] = gl_dst_a;
 }
 
 void device_depthfunction(device_t device, enum gs_depth_test test)
 {
 	GLenum gl_test = convert_gs_depth_test(test);
 
+	if (device->cur_state.depth_func == gl_test)
+		return;
+
 	glDepthFunc(gl_test);
-	if (!gl_success("glDepthFunc"))
+	if (!gl_success("glDepthFunc")) {
 		blog(LOG_ERROR, "device_depthfunction (GL) failed");
+		device->cur_state.depth_func = (GLenum)-1;
+		return;
+	}
 
-	UNUSED_PARAMETER(device);
+	device->cur_state.depth_func = gl_test;
 }
 
 void device_stencilfunction(device_t device, enum gs_stencil_side side,
@@ -1149,12 +1290,12 @@ static inline uint32_t get_target_height(struct gs_device *device)
 		return cubetexture_getsize(device->cur_render_target);
 }
 
-void device_setviewport(device_t device, int x, int y, int width,
-		int height)
+/* GL uses bottom-up coordinates for viewports and scissor rects.  We want
+ * top-down */
+static inline uint32_t get_base_height(device_t device)
 {
 	uint32_t base_height;
 
-	/* GL uses bottom-up coordinates for viewports.  We want top-down */
 	if (device->cur_render_target) {
 		base_height = get_target_height(device);
 	} else {
@@ -1162,6 +1303,14 @@ void device_setviewport(device_t device, int x, int y, int width,
 		gl_getclientsize(device->cur_swap, &dw, &base_height);
 	}
 
+	return base_height;
+}
+
+void device_setviewport(device_t device, int x, int y, int width,
+		int height)
+{
+	uint32_t base_height = get_base_height(device);
+
 	glViewport(x, base_height - y - height, width, height);
 	if (!gl_success("glViewport"))
 		blog(LOG_ERROR, "device_setviewport (GL) failed");
@@ -1179,10 +1328,27 @@ void device_getviewport(device_t device, struct gs_rect *rect)
 
 void device_setscissorrect(device_t device, struct gs_rect *rect)
 {
-	UNUSED_PARAMETER(device);
-	glScissor(rect->x, rect->y, rect->cx, rect->cy);
+	uint32_t base_height;
+
+	if (!rect) {
+		if (!gl_disable(GL_SCISSOR_TEST))
+			blog(LOG_ERROR, "device_setscissorrect (GL) failed");
+		return;
+	}
+
+	if (!gl_enable(GL_SCISSOR_TEST))
+		goto fail;
+
+	base_height = get_base_height(device);
+	glScissor(rect->x, base_height - rect->y - rect->cy,
+			rect->cx, rect->cy);
 	if (!gl_success("glScissor"))
-		blog(LOG_ERROR, "device_setscissorrect (GL) failed");
+		goto fail;
+
+	return;
+
+fail:
+	blog(LOG_ERROR, "device_setscissorrect (GL) failed");
 }
 
 void device_ortho(device_t device, float left, float right,
@@ -56,6 +56,7 @@ static inline GLint convert_gs_format(enum gs_color_format format)
 	case GS_DXT1:        return GL_RGB;
 	case GS_DXT3:        return GL_RGBA;
 	case GS_DXT5:        return GL_RGBA;
+	case GS_R8G8:        return GL_RG;
 	case GS_UNKNOWN:     return 0;
 	}
 
@@ -82,6 +83,7 @@ static inline GLint convert_gs_internal_format(enum gs_color_format format)
 	case GS_DXT1:        return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
 	case GS_DXT3:        return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
 	case GS_DXT5:        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case GS_R8G8:        return GL_RG8;
 	case GS_UNKNOWN:     return 0;
 	}
 
@@ -108,6 +110,7 @@ static inline GLenum get_gl_format_type(enum gs_color_format format)
 	case GS_DXT1:        return GL_UNSIGNED_BYTE;
 	case GS_DXT3:        return GL_UNSIGNED_BYTE;
 	case GS_DXT5:        return GL_UNSIGNED_BYTE;
+	case GS_R8G8:        return GL_UNSIGNED_BYTE;
 	case GS_UNKNOWN:     return 0;
 	}
 
@@ -390,13 +393,28 @@ struct gs_texture {
 	samplerstate_t       cur_sampler;
 };
 
+/* dynamic textures cycle through several unpack buffers so that mapping
+ * never waits on the upload of the previous frame */
+#define NUM_UNPACK_BUFFERS 3
+
 struct gs_texture_2d {
 	struct gs_texture    base;
 
 	uint32_t             width;
 	uint32_t             height;
 	bool                 gen_mipmaps;
-	GLuint               unpack_buffer;
+
+	GLuint               unpack_buffers[NUM_UNPACK_BUFFERS];
+	GLsync               unpack_fences[NUM_UNPACK_BUFFERS];
+	void                 *unpack_ptrs[NUM_UNPACK_BUFFERS];
+	GLsizeiptr           unpack_size;
+	int                  cur_unpack;
+	bool                 persistent;
+
+#ifdef __linux__
+	/* GLX pixmap the texture is bound to, see gl-x11.c */
+	unsigned long        glx_pixmap;
+#endif
 };
 
 struct gs_texture_cube {
@@ -405,6 +423,8 @@ struct gs_texture_cube {
 	uint32_t             size;
 };
 
+#define NUM_PACK_BUFFERS 2
+
 struct gs_stage_surface {
 	device_t             device;
 
@@ -416,7 +436,28 @@ struct gs_stage_surface {
 	GLenum               gl_format;
 	GLint                gl_internal_format;
 	GLenum               gl_type;
-	GLuint               pack_buffer;
+
+	/* staging alternates between pack buffers so a new transfer never has
+	 * to wait on a buffer that is still mapped.  each transfer is fenced
+	 * so readiness can be queried without stalling */
+	GLuint               pack_buffers[NUM_PACK_BUFFERS];
+	GLsync               fences[NUM_PACK_BUFFERS];
+	int                  cur_buffer;
+	bool                 staged;
+};
+
+struct gs_timer {
+	device_t             device;
+	GLuint               queries[2];
+};
+
+struct gs_timer_range {
+	device_t             device;
+};
+
+struct gs_fence {
+	device_t             device;
+	GLsync               sync;
 };
 
 struct gs_zstencil_buffer {
@@ -453,10 +494,24 @@ static inline void fbo_info_destroy(struct fbo_info *fbo)
 	}
 }
 
+/* render state last set through the device functions, so setting the same
+ * state again doesn't reach the driver.  every member is all bits set while
+ * the state is unknown */
+struct gl_render_state {
+	int                  blend;
+	int                  depth_test;
+	int                  stencil_test;
+	int                  stencil_write;
+	int                  color_mask;
+	GLenum               blend_func[4];
+	GLenum               depth_func;
+};
+
 struct gs_device {
 	struct gl_platform   *plat;
 	GLuint               pipeline;
 	enum copy_type       copy_type;
+	bool                 buffer_storage;
 
 	texture_t            cur_render_target;
 	zstencil_t           cur_zstencil_buffer;
@@ -470,6 +525,7 @@ struct gs_device {
 	swapchain_t          cur_swap;
 
 	enum gs_cull_mode    cur_cull_mode;
+	struct gl_render_state cur_state;
 	struct gs_rect       cur_viewport;
 
 	struct matrix4       cur_proj;
@@ -480,15 +536,31 @@ struct gs_device {
 
 	DARRAY(struct fbo_info*) fbos;
 	struct fbo_info          *cur_fbo;
+
+	/* for shared devices, the device whose context they share objects
+	 * with */
+	struct gs_device         *share_parent;
 };
 
+/* objects created on a shared device belong to the device it shares with,
+ * which outlives it and is where they end up being used.  vertex buffers
+ * can't be, their vertex arrays aren't shared between contexts */
+static inline struct gs_device *gl_object_owner(struct gs_device *device)
+{
+	return device->share_parent ? device->share_parent : device;
+}
+
 extern struct fbo_info *get_fbo(struct gs_device *device,
 		uint32_t width, uint32_t height, enum gs_color_format format);
+extern void             release_render_target(struct gs_device *device,
+		texture_t tex);
 
 extern void                  gl_update(device_t device);
 
 extern struct gl_platform   *gl_platform_create(device_t device,
                                                 struct gs_init_data *info);
+extern struct gl_platform   *gl_platform_create_shared(device_t device,
+                                                struct gl_platform *parent);
 extern struct gs_swap_chain *gl_platform_getswap(struct gl_platform *platform);
 extern void                  gl_platform_destroy(struct gl_platform *platform);
 
@@ -501,3 +573,7 @@ extern void                  gl_windowinfo_destroy(struct gl_windowinfo *wi);
 extern void                  gl_getclientsize(struct gs_swap_chain *swap,
                                               uint32_t *width,
                                               uint32_t *height);
+
+#ifdef __linux__
+extern void gl_platform_release_pixmap(struct gs_texture_2d *tex);
+#endif
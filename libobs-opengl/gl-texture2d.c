@@ -22,7 +22,6 @@ static bool upload_texture_2d(struct gs_texture_2d *tex, const void **data)
 	uint32_t row_size   = tex->width  * gs_get_format_bpp(tex->base.format);
 	uint32_t tex_size   = tex->height * row_size / 8;
 	uint32_t num_levels = tex->base.levels;
-	bool     compressed = gs_is_compressed_format(tex->base.format);
 	bool     success;
 
 	if (!num_levels)
@@ -33,7 +32,8 @@ static bool upload_texture_2d(struct gs_texture_2d *tex, const void **data)
 
 	success = gl_init_face(GL_TEXTURE_2D, tex->base.gl_type, num_levels,
 			tex->base.gl_format, tex->base.gl_internal_format,
-			compressed, tex->width, tex->height, tex_size, &data);
+			tex->base.format, tex->width, tex->height, tex_size,
+			&data);
 
 	if (!gl_tex_param_i(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, num_levels-1))
 		success = false;
@@ -43,16 +43,46 @@ static bool upload_texture_2d(struct gs_texture_2d *tex, const void **data)
 	return success;
 }
 
-static bool create_pixel_unpack_buffer(struct gs_texture_2d *tex)
+#define PERSISTENT_MAP_FLAGS \
+	(GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+static inline void free_unpack_fence(struct gs_texture_2d *tex, int idx)
 {
-	GLsizeiptr size;
-	bool success = true;
+	if (tex->unpack_fences[idx]) {
+		glDeleteSync(tex->unpack_fences[idx]);
+		tex->unpack_fences[idx] = NULL;
+	}
+}
 
-	if (!gl_gen_buffers(1, &tex->unpack_buffer))
+static bool init_unpack_buffer(struct gs_texture_2d *tex, int idx)
+{
+	if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, tex->unpack_buffers[idx]))
 		return false;
 
-	if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, tex->unpack_buffer))
-		return false;
+	if (tex->persistent) {
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, tex->unpack_size, 0,
+				PERSISTENT_MAP_FLAGS);
+		if (!gl_success("glBufferStorage"))
+			return false;
+
+		tex->unpack_ptrs[idx] = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+				0, tex->unpack_size, PERSISTENT_MAP_FLAGS);
+		if (!gl_success("glMapBufferRange") || !tex->unpack_ptrs[idx])
+			return false;
+	} else {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, tex->unpack_size, 0,
+				GL_STREAM_DRAW);
+		if (!gl_success("glBufferData"))
+			return false;
+	}
+
+	return true;
+}
+
+static bool create_pixel_unpack_buffers(struct gs_texture_2d *tex)
+{
+	GLsizeiptr size;
+	bool success = true;
 
 	size = tex->width * gs_get_format_bpp(tex->base.format);
 	if (!gs_is_compressed_format(tex->base.format)) {
@@ -64,9 +94,18 @@ static bool create_pixel_unpack_buffer(struct gs_texture_2d *tex)
 		size /= 8;
 	}
 
-	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_DYNAMIC_DRAW);
-	if (!gl_success("glBufferData"))
-		success = false;
+	tex->unpack_size = size;
+	tex->persistent  = tex->base.device->buffer_storage;
+
+	if (!gl_gen_buffers(NUM_UNPACK_BUFFERS, tex->unpack_buffers))
+		return false;
+
+	for (int i = 0; i < NUM_UNPACK_BUFFERS; i++) {
+		if (!init_unpack_buffer(tex, i)) {
+			success = false;
+			break;
+		}
+	}
 
 	if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0))
 		success = false;
@@ -79,7 +118,7 @@ texture_t device_create_texture(device_t device, uint32_t width,
 		uint32_t levels, const void **data, uint32_t flags)
 {
 	struct gs_texture_2d *tex = bzalloc(sizeof(struct gs_texture_2d));
-	tex->base.device             = device;
+	tex->base.device             = gl_object_owner(device);
 	tex->base.type               = GS_TEXTURE_2D;
 	tex->base.format             = color_format;
 	tex->base.levels             = levels;
@@ -98,7 +137,7 @@ texture_t device_create_texture(device_t device, uint32_t width,
 		goto fail;
 
 	if (!tex->base.is_dummy) {
-		if (tex->base.is_dynamic && !create_pixel_unpack_buffer(tex))
+		if (tex->base.is_dynamic && !create_pixel_unpack_buffers(tex))
 			goto fail;
 		if (!upload_texture_2d(tex, data))
 			goto fail;
@@ -131,9 +170,21 @@ void texture_destroy(texture_t tex)
 
 	if (tex->cur_sampler)
 		samplerstate_destroy(tex->cur_sampler);
+	if (tex->is_render_target)
+		release_render_target(tex->device, tex);
 
-	if (!tex->is_dummy && tex->is_dynamic && tex2d->unpack_buffer)
-		gl_delete_buffers(1, &tex2d->unpack_buffer);
+	if (!tex->is_dummy && tex->is_dynamic && tex2d->unpack_buffers[0]) {
+		for (int i = 0; i < NUM_UNPACK_BUFFERS; i++)
+			free_unpack_fence(tex2d, i);
+
+		/* deleting the buffers also releases persistent mappings */
+		gl_delete_buffers(NUM_UNPACK_BUFFERS, tex2d->unpack_buffers);
+	}
+
+#ifdef __linux__
+	if (tex2d->glx_pixmap)
+		gl_platform_release_pixmap(tex2d);
+#endif
 
 	if (tex->texture)
 		gl_delete_textures(1, &tex->texture);
@@ -164,9 +215,31 @@ enum gs_color_format texture_getcolorformat(texture_t tex)
 	return tex->format;
 }
 
+/* waits until the GPU has finished reading from a persistent buffer */
+static bool wait_unpack_fence(struct gs_texture_2d *tex, int idx)
+{
+	GLenum result;
+
+	if (!tex->unpack_fences[idx])
+		return true;
+
+	result = glClientWaitSync(tex->unpack_fences[idx],
+			GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL);
+	free_unpack_fence(tex, idx);
+
+	if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+		blog(LOG_WARNING, "wait_unpack_fence: glClientWaitSync "
+		                  "failed");
+		return false;
+	}
+
+	return true;
+}
+
 bool texture_map(texture_t tex, void **ptr, uint32_t *linesize)
 {
 	struct gs_texture_2d *tex2d = (struct gs_texture_2d*)tex;
+	int idx;
 
 	if (!is_texture_2d(tex, "texture_map"))
 		goto fail;
@@ -176,20 +249,40 @@ bool texture_map(texture_t tex, void **ptr, uint32_t *linesize)
 		goto fail;
 	}
 
-	if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, tex2d->unpack_buffer))
-		goto fail;
+	if (++tex2d->cur_unpack == NUM_UNPACK_BUFFERS)
+		tex2d->cur_unpack = 0;
+	idx = tex2d->cur_unpack;
 
-	*ptr = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
-	if (!gl_success("glMapBuffer"))
-		goto fail;
+	if (tex2d->persistent) {
+		if (!wait_unpack_fence(tex2d, idx))
+			goto fail;
 
-	gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		*ptr = tex2d->unpack_ptrs[idx];
+
+	} else {
+		if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER,
+					tex2d->unpack_buffers[idx]))
+			goto fail;
+
+		/* orphan the old storage rather than waiting for it */
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, tex2d->unpack_size, 0,
+				GL_STREAM_DRAW);
+		if (!gl_success("glBufferData"))
+			goto fail;
+
+		*ptr = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		if (!gl_success("glMapBuffer"))
+			goto fail;
+
+		gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
 
 	*linesize = tex2d->width * gs_get_format_bpp(tex->format) / 8;
 	*linesize = (*linesize + 3) & 0xFFFFFFFC;
 	return true;
 
 fail:
+	gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
 	blog(LOG_ERROR, "texture_map (GL) failed");
 	return false;
 }
@@ -197,25 +290,33 @@ fail:
 void texture_unmap(texture_t tex)
 {
 	struct gs_texture_2d *tex2d = (struct gs_texture_2d*)tex;
+	int idx;
+
 	if (!is_texture_2d(tex, "texture_unmap"))
 		goto failed;
 
-	if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, tex2d->unpack_buffer))
+	idx = tex2d->cur_unpack;
+	if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, tex2d->unpack_buffers[idx]))
 		goto failed;
 
-	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-	if (!gl_success("glUnmapBuffer"))
-		goto failed;
+	if (!tex2d->persistent) {
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		if (!gl_success("glUnmapBuffer"))
+			goto failed;
+	}
 
 	if (!gl_bind_texture(GL_TEXTURE_2D, tex2d->base.texture))
 		goto failed;
 
-	glTexImage2D(GL_TEXTURE_2D, 0, tex->gl_internal_format,
-			tex2d->width, tex2d->height, 0,
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex2d->width, tex2d->height,
 			tex->gl_format, tex->gl_type, 0);
-	if (!gl_success("glTexImage2D"))
+	if (!gl_success("glTexSubImage2D"))
 		goto failed;
 
+	if (tex2d->persistent)
+		tex2d->unpack_fences[idx] = glFenceSync(
+				GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
 	gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
 	gl_bind_texture(GL_TEXTURE_2D, 0);
 	return;
@@ -237,6 +338,40 @@ bool texture_isrect(texture_t tex)
 	return tex2d->base.gl_target == GL_TEXTURE_RECTANGLE;
 }
 
+bool texture_setimage_region(texture_t tex, uint32_t x, uint32_t y,
+		uint32_t cx, uint32_t cy, const void *data, uint32_t linesize)
+{
+	struct gs_texture_2d *tex2d = (struct gs_texture_2d*)tex;
+	uint32_t bytes_per_pixel;
+	bool success = true;
+
+	if (!is_texture_2d(tex, "texture_setimage_region"))
+		goto fail;
+
+	bytes_per_pixel = gs_get_format_bpp(tex->format) / 8;
+	if (gs_is_compressed_format(tex->format) || !bytes_per_pixel ||
+	    x + cx > tex2d->width || y + cy > tex2d->height)
+		goto fail;
+
+	if (!gl_bind_texture(GL_TEXTURE_2D, tex2d->base.texture))
+		goto fail;
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, linesize / bytes_per_pixel);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, cx, cy,
+			tex->gl_format, tex->gl_type, data);
+	if (!gl_success("glTexSubImage2D"))
+		success = false;
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	gl_bind_texture(GL_TEXTURE_2D, 0);
+	if (success)
+		return true;
+
+fail:
+	blog(LOG_ERROR, "texture_setimage_region (GL) failed");
+	return false;
+}
+
 void *texture_getobj(texture_t tex)
 {
 	struct gs_texture_2d *tex2d = (struct gs_texture_2d*)tex;
@@ -23,7 +23,6 @@ static inline bool upload_texture_cube(struct gs_texture_cube *tex,
 	uint32_t row_size   = tex->size * gs_get_format_bpp(tex->base.format);
 	uint32_t tex_size   = tex->size * row_size / 8;
 	uint32_t num_levels = tex->base.levels;
-	bool     compressed = gs_is_compressed_format(tex->base.format);
 	GLenum   gl_type    = get_gl_format_type(tex->base.format);
 	bool     success    = true;
 	uint32_t i;
@@ -40,7 +39,7 @@ static inline bool upload_texture_cube(struct gs_texture_cube *tex,
 		if (!gl_init_face(target, gl_type, num_levels,
 					tex->base.gl_format,
 					tex->base.gl_internal_format,
-					compressed, tex->size, tex->size,
+					tex->base.format, tex->size, tex->size,
 					tex_size, &data))
 			success = false;
 
@@ -63,7 +62,7 @@ texture_t device_create_cubetexture(device_t device, uint32_t size,
 		const void **data, uint32_t flags)
 {
 	struct gs_texture_cube *tex = bzalloc(sizeof(struct gs_texture_cube));
-	tex->base.device             = device;
+	tex->base.device             = gl_object_owner(device);
 	tex->base.type               = GS_TEXTURE_CUBE;
 	tex->base.format             = color_format;
 	tex->base.levels             = levels;
@@ -92,6 +91,9 @@ void cubetexture_destroy(texture_t tex)
 	if (!tex)
 		return;
 
+	if (tex->is_render_target)
+		release_render_target(tex->device, tex);
+
 	if (tex->texture) {
 		glDeleteTextures(1, &tex->texture);
 		gl_success("glDeleteTextures");
@@ -0,0 +1,123 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "gl-subsystem.h"
+
+static inline bool has_timer_query(void)
+{
+	return GLAD_GL_VERSION_3_3 || GLAD_GL_ARB_timer_query;
+}
+
+gputimer_t device_create_timer(device_t device)
+{
+	struct gs_timer *timer;
+
+	if (!has_timer_query())
+		return NULL;
+
+	timer = bzalloc(sizeof(struct gs_timer));
+	timer->device = device;
+
+	glGenQueries(2, timer->queries);
+	if (!gl_success("glGenQueries")) {
+		bfree(timer);
+		return NULL;
+	}
+
+	return timer;
+}
+
+void gputimer_destroy(gputimer_t timer)
+{
+	if (!timer)
+		return;
+
+	glDeleteQueries(2, timer->queries);
+	gl_success("glDeleteQueries");
+	bfree(timer);
+}
+
+void gputimer_begin(gputimer_t timer)
+{
+	glQueryCounter(timer->queries[0], GL_TIMESTAMP);
+	gl_success("glQueryCounter");
+}
+
+void gputimer_end(gputimer_t timer)
+{
+	glQueryCounter(timer->queries[1], GL_TIMESTAMP);
+	gl_success("glQueryCounter");
+}
+
+bool gputimer_get_data(gputimer_t timer, uint64_t *ticks)
+{
+	GLint     available = 0;
+	GLuint64  begin, end;
+
+	/* the end timestamp is always written last */
+	glGetQueryObjectiv(timer->queries[1], GL_QUERY_RESULT_AVAILABLE,
+			&available);
+	if (!gl_success("glGetQueryObjectiv") || !available)
+		return false;
+
+	glGetQueryObjectui64v(timer->queries[0], GL_QUERY_RESULT, &begin);
+	glGetQueryObjectui64v(timer->queries[1], GL_QUERY_RESULT, &end);
+	if (!gl_success("glGetQueryObjectui64v"))
+		return false;
+
+	*ticks = end > begin ? end - begin : 0;
+	return true;
+}
+
+/* GL timestamps are always in nanoseconds and can't become invalid, so a
+ * range only exists to match the D3D11 queries */
+gputimer_range_t device_create_timer_range(device_t device)
+{
+	struct gs_timer_range *range;
+
+	if (!has_timer_query())
+		return NULL;
+
+	range = bzalloc(sizeof(struct gs_timer_range));
+	range->device = device;
+	return range;
+}
+
+void gputimer_range_destroy(gputimer_range_t range)
+{
+	bfree(range);
+}
+
+void gputimer_range_begin(gputimer_range_t range)
+{
+	UNUSED_PARAMETER(range);
+}
+
+void gputimer_range_end(gputimer_range_t range)
+{
+	UNUSED_PARAMETER(range);
+}
+
+bool gputimer_range_get_data(gputimer_range_t range, bool *disjoint,
+		uint64_t *frequency)
+{
+	*disjoint  = false;
+	*frequency = 1000000000;
+
+	UNUSED_PARAMETER(range);
+	return true;
+}
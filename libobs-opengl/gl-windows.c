@@ -34,6 +34,10 @@ struct gl_windowinfo {
 struct gl_platform {
 	HGLRC hrc;
 	struct gs_swap_chain swap;
+
+	/* created when no window is given (headless), never shown or
+	 * presented */
+	HWND hidden_window;
 };
 
 /* For now, only support basic 32bit formats for graphics output. */
@@ -185,6 +189,29 @@ static inline HGLRC gl_init_context(HDC hdc)
 	return gl_init_basic_context(hdc);
 }
 
+/* same kind of context as gl_init_context, sharing objects with @share */
+static inline HGLRC gl_init_shared_context(HDC hdc, HGLRC share)
+{
+#ifdef _DEBUG
+	const int *ctx_attribs = attribs;
+#else
+	const int *ctx_attribs = NULL;
+#endif
+	HGLRC hglrc = wglCreateContextAttribsARB(hdc, share, ctx_attribs);
+	if (!hglrc) {
+		blog(LOG_ERROR, "wglCreateContextAttribsARB failed, %u",
+				GetLastError());
+		return NULL;
+	}
+
+	if (!wgl_make_current(hdc, hglrc)) {
+		wglDeleteContext(hglrc);
+		return NULL;
+	}
+
+	return hglrc;
+}
+
 static bool gl_dummy_context_init(struct dummy_context *dummy)
 {
 	PIXELFORMATDESCRIPTOR pfd;
@@ -376,6 +403,7 @@ struct gl_platform *gl_platform_create(device_t device,
 {
 	struct gl_platform *plat = bzalloc(sizeof(struct gl_platform));
 	struct dummy_context dummy;
+	struct gs_init_data hidden_info;
 	int pixel_format;
 	PIXELFORMATDESCRIPTOR pfd;
 
@@ -393,6 +421,18 @@ struct gl_platform *gl_platform_create(device_t device,
 
 	gl_dummy_context_free(&dummy);
 
+	if (!gs_window_valid(&info->window)) {
+		plat->hidden_window = gl_create_dummy_window();
+		if (!plat->hidden_window)
+			goto fail;
+
+		hidden_info             = *info;
+		hidden_info.window.hwnd = plat->hidden_window;
+		info                    = &hidden_info;
+		blog(LOG_INFO, "No window given, using a hidden window for a "
+		               "headless context");
+	}
+
 	if (!init_default_swap(plat, device, pixel_format, &pfd, info))
 		goto fail;
 
@@ -414,6 +454,47 @@ fail:
 	return NULL;
 }
 
+/* the shared context gets a hidden window with the parent's pixel format,
+ * so the two never have the same device context current on two threads */
+struct gl_platform *gl_platform_create_shared(device_t device,
+		struct gl_platform *parent)
+{
+	struct gl_platform *plat = bzalloc(sizeof(struct gl_platform));
+	HDC parent_hdc = parent->swap.wi->hdc;
+	struct gs_init_data info = parent->swap.info;
+	int pixel_format;
+	PIXELFORMATDESCRIPTOR pfd;
+
+	pixel_format = GetPixelFormat(parent_hdc);
+	if (!pixel_format ||
+	    !DescribePixelFormat(parent_hdc, pixel_format, sizeof(pfd),
+		    &pfd)) {
+		blog(LOG_ERROR, "Failed to get the parent pixel format, %u",
+				GetLastError());
+		goto fail;
+	}
+
+	plat->hidden_window = gl_create_dummy_window();
+	if (!plat->hidden_window)
+		goto fail;
+
+	info.window.hwnd = plat->hidden_window;
+
+	if (!init_default_swap(plat, device, pixel_format, &pfd, &info))
+		goto fail;
+
+	plat->hrc = gl_init_shared_context(plat->swap.wi->hdc, parent->hrc);
+	if (!plat->hrc)
+		goto fail;
+
+	return plat;
+
+fail:
+	blog(LOG_ERROR, "gl_platform_create_shared failed");
+	gl_platform_destroy(plat);
+	return NULL;
+}
+
 struct gs_swap_chain *gl_platform_getswap(struct gl_platform *platform)
 {
 	return &platform->swap;
@@ -428,6 +509,9 @@ void gl_platform_destroy(struct gl_platform *plat)
 		}
 
 		gl_windowinfo_destroy(plat->swap.wi);
+
+		if (plat->hidden_window)
+			DestroyWindow(plat->hidden_window);
 		bfree(plat);
 	}
 }
@@ -482,6 +566,10 @@ void device_entercontext(device_t device)
 
 	if (!wgl_make_current(hdc, device->plat->hrc))
 		blog(LOG_ERROR, "device_load_swapchain (GL) failed");
+
+	/* the swap interval belongs to the window, so set it for each one */
+	if (GLAD_WGL_EXT_swap_control)
+		wglSwapIntervalEXT(0);
 }
 
 void device_leavecontext(device_t device)
@@ -509,6 +597,9 @@ void device_load_swapchain(device_t device, swapchain_t swap)
 
 void device_present(device_t device)
 {
+	if (device->cur_swap->wi->hwnd == device->plat->hidden_window)
+		return;
+
 	if (!SwapBuffers(device->cur_swap->wi->hdc)) {
 		blog(LOG_ERROR, "SwapBuffers failed, GetLastError "
 				"returned %u", GetLastError());
@@ -520,6 +611,13 @@ extern void gl_getclientsize(struct gs_swap_chain *swap,
 		uint32_t *width, uint32_t *height)
 {
 	RECT rc;
+
+	if (swap->wi->hwnd == swap->device->plat->hidden_window) {
+		*width  = swap->info.cx;
+		*height = swap->info.cy;
+		return;
+	}
+
 	GetClientRect(swap->wi->hwnd, &rc);
 	*width  = rc.right;
 	*height = rc.bottom;
@@ -18,11 +18,21 @@
 #include <X11/Xlib.h>
 
 #include <stdio.h>
+#include <string.h>
 
 #include "gl-subsystem.h"
 
 #include <glad/glad_glx.h>
 
+#ifdef USE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#endif
+
 static const int fb_attribs[] = {
 	/* Hardcoded for now... */
 	GLX_STENCIL_SIZE, 8,
@@ -53,6 +63,19 @@ struct gl_platform {
 	GLXContext context;
 	GLXFBConfig fbcfg;
 	struct gs_swap_chain swap;
+
+	/* created without a window, the context is never presented */
+	bool headless;
+
+	/* shares objects with another context, and uses its display and
+	 * default swap chain instead of owning them */
+	bool shared;
+#ifdef USE_EGL
+	EGLDisplay egl_display;
+	EGLConfig  egl_config;
+	EGLContext egl_context;
+	EGLSurface egl_surface;
+#endif
 };
 
 extern struct gs_swap_chain *gl_platform_getswap(struct gl_platform *platform)
@@ -79,6 +102,12 @@ extern void gl_getclientsize(struct gs_swap_chain *swap,
 {
 	XWindowAttributes info = { 0 };
 
+	if (swap->device->plat->headless) {
+		*width  = swap->info.cx;
+		*height = swap->info.cy;
+		return;
+	}
+
 	XGetWindowAttributes(swap->wi->display, swap->wi->id, &info);
 
 	*height = info.height;
@@ -134,13 +163,348 @@ static bool handle_x_error(Display *disp, const char *error_string)
 	return false;
 }
 
+/* ------------------------------------------------------------------------- */
+/* headless contexts
+ *
+ *   Without a window, the context is created with EGL instead of GLX, so no
+ * X server is needed.  GPU devices are used directly when the driver exposes
+ * them (EGL_EXT_platform_device), with the adapter index selecting the
+ * device.  Everything is rendered to textures, so the context doesn't need a
+ * surface unless the driver lacks EGL_KHR_surfaceless_context. */
+
+#ifdef USE_EGL
+#define MAX_EGL_DEVICES 16
+
+static const EGLint egl_config_attribs[] = {
+	EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+	EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+	EGL_RED_SIZE, 8,
+	EGL_GREEN_SIZE, 8,
+	EGL_BLUE_SIZE, 8,
+	EGL_ALPHA_SIZE, 8,
+	EGL_NONE
+};
+
+static const EGLint egl_ctx_attribs[] = {
+#ifdef _DEBUG
+	EGL_CONTEXT_FLAGS_KHR, EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR,
+#endif
+	EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+	EGL_CONTEXT_MINOR_VERSION_KHR, 2,
+	EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+		EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+	EGL_NONE
+};
+
+static const EGLint egl_pbuffer_attribs[] = {
+	EGL_WIDTH, 16,
+	EGL_HEIGHT, 16,
+	EGL_NONE
+};
+
+static bool egl_has_extension(EGLDisplay display, const char *extension)
+{
+	const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+	size_t     len         = strlen(extension);
+
+	while (extensions && *extensions) {
+		const char *end = strchr(extensions, ' ');
+		size_t     cur_len = end ? (size_t)(end - extensions) :
+			strlen(extensions);
+
+		if (cur_len == len && strncmp(extensions, extension, len) == 0)
+			return true;
+
+		extensions = end ? end + 1 : NULL;
+	}
+
+	return false;
+}
+
+static EGLDisplay egl_get_display(uint32_t adapter)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+	PFNEGLQUERYDEVICESEXTPROC       query_devices;
+	EGLDeviceEXT                    devices[MAX_EGL_DEVICES];
+	EGLint                          num_devices = 0;
+	EGLDisplay                      display;
+
+	/* client extensions are only available with EGL_EXT_client_extensions,
+	 * otherwise this fails and the default display is used */
+	if (!egl_has_extension(EGL_NO_DISPLAY, "EGL_EXT_platform_base"))
+		return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+		eglGetProcAddress("eglGetPlatformDisplayEXT");
+	query_devices = (PFNEGLQUERYDEVICESEXTPROC)
+		eglGetProcAddress("eglQueryDevicesEXT");
+
+	if (get_platform_display && query_devices &&
+	    egl_has_extension(EGL_NO_DISPLAY, "EGL_EXT_platform_device") &&
+	    query_devices(MAX_EGL_DEVICES, devices, &num_devices) &&
+	    num_devices > 0) {
+		if (adapter >= (uint32_t)num_devices) {
+			blog(LOG_WARNING, "EGL device %u not found, using "
+			                  "device 0", adapter);
+			adapter = 0;
+		}
+
+		display = get_platform_display(EGL_PLATFORM_DEVICE_EXT,
+				devices[adapter], NULL);
+		if (display != EGL_NO_DISPLAY)
+			return display;
+	}
+
+	if (get_platform_display &&
+	    egl_has_extension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless")) {
+		display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+				EGL_DEFAULT_DISPLAY, NULL);
+		if (display != EGL_NO_DISPLAY)
+			return display;
+	}
+
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static void *egl_get_proc_address(const char *name)
+{
+	return (void*)eglGetProcAddress(name);
+}
+
+static bool gl_headless_make_current(struct gl_platform *plat, bool current)
+{
+	EGLBoolean success;
+
+	/* the bound API is per thread, and contexts are entered from threads
+	 * other than the one that created them */
+	eglBindAPI(EGL_OPENGL_API);
+
+	if (current)
+		success = eglMakeCurrent(plat->egl_display, plat->egl_surface,
+				plat->egl_surface, plat->egl_context);
+	else
+		success = eglMakeCurrent(plat->egl_display, EGL_NO_SURFACE,
+				EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+	return success == EGL_TRUE;
+}
+
+static void gl_headless_destroy(struct gl_platform *plat)
+{
+	if (plat->egl_display == EGL_NO_DISPLAY)
+		return;
+
+	eglMakeCurrent(plat->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+			EGL_NO_CONTEXT);
+
+	if (plat->egl_surface != EGL_NO_SURFACE)
+		eglDestroySurface(plat->egl_display, plat->egl_surface);
+	if (plat->egl_context != EGL_NO_CONTEXT)
+		eglDestroyContext(plat->egl_display, plat->egl_context);
+
+	eglTerminate(plat->egl_display);
+}
+
+static bool gl_headless_init(struct gl_platform *plat, uint32_t adapter)
+{
+	EGLint    major = 0, minor = 0;
+	EGLint    num_configs = 0;
+	EGLConfig config;
+
+	plat->egl_display = egl_get_display(adapter);
+	if (plat->egl_display == EGL_NO_DISPLAY) {
+		blog(LOG_ERROR, "Unable to get an EGL display.");
+		return false;
+	}
+
+	if (!eglInitialize(plat->egl_display, &major, &minor)) {
+		blog(LOG_ERROR, "Failed to initialize EGL.");
+		plat->egl_display = EGL_NO_DISPLAY;
+		return false;
+	}
+
+	blog(LOG_INFO, "EGL %i.%i, vendor: %s", major, minor,
+			eglQueryString(plat->egl_display, EGL_VENDOR));
+
+	if (!egl_has_extension(plat->egl_display, "EGL_KHR_create_context")) {
+		blog(LOG_ERROR, "EGL_KHR_create_context not supported!");
+		return false;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		blog(LOG_ERROR, "EGL does not support desktop OpenGL.");
+		return false;
+	}
+
+	if (!eglChooseConfig(plat->egl_display, egl_config_attribs, &config,
+				1, &num_configs) || num_configs == 0) {
+		blog(LOG_ERROR, "No EGL framebuffer configurations found.");
+		return false;
+	}
+
+	plat->egl_config  = config;
+	plat->egl_context = eglCreateContext(plat->egl_display, config,
+			EGL_NO_CONTEXT, egl_ctx_attribs);
+	if (plat->egl_context == EGL_NO_CONTEXT) {
+		blog(LOG_ERROR, "Failed to create EGL OpenGL context.");
+		return false;
+	}
+
+	if (!egl_has_extension(plat->egl_display,
+				"EGL_KHR_surfaceless_context")) {
+		plat->egl_surface = eglCreatePbufferSurface(plat->egl_display,
+				config, egl_pbuffer_attribs);
+		if (plat->egl_surface == EGL_NO_SURFACE) {
+			blog(LOG_ERROR, "Failed to create EGL pbuffer.");
+			return false;
+		}
+	}
+
+	if (!gl_headless_make_current(plat, true)) {
+		blog(LOG_ERROR, "Failed to make EGL context current.");
+		return false;
+	}
+
+	gladLoadGLLoader(egl_get_proc_address);
+	if (!GLVersion.major) {
+		blog(LOG_ERROR, "Failed to load OpenGL entry functions.");
+		return false;
+	}
+
+	return true;
+}
+
+static struct gl_platform *gl_headless_create(device_t device,
+		struct gs_init_data *info)
+{
+	struct gl_platform *plat = bzalloc(sizeof(struct gl_platform));
+
+	plat->headless    = true;
+	plat->egl_display = EGL_NO_DISPLAY;
+	plat->egl_context = EGL_NO_CONTEXT;
+	plat->egl_surface = EGL_NO_SURFACE;
+
+	if (!gl_headless_init(plat, info->adapter)) {
+		gl_headless_destroy(plat);
+		bfree(plat);
+		return NULL;
+	}
+
+	blog(LOG_INFO, "OpenGL version: %s (headless)",
+			glGetString(GL_VERSION));
+
+	device->plat = plat;
+
+	plat->swap.device               = device;
+	plat->swap.info                 = *info;
+	plat->swap.info.format          = GS_RGBA;
+	plat->swap.info.zsformat        = GS_Z24_S8;
+	plat->swap.info.num_backbuffers = 1;
+	plat->swap.wi                   = gl_windowinfo_create(info);
+
+	device->cur_swap = &plat->swap;
+	return plat;
+}
+
+static bool gl_headless_init_shared(struct gl_platform *plat,
+		struct gl_platform *parent)
+{
+	plat->egl_display = parent->egl_display;
+	plat->egl_config  = parent->egl_config;
+
+	eglBindAPI(EGL_OPENGL_API);
+
+	plat->egl_context = eglCreateContext(plat->egl_display,
+			plat->egl_config, parent->egl_context,
+			egl_ctx_attribs);
+	if (plat->egl_context == EGL_NO_CONTEXT) {
+		blog(LOG_ERROR, "Failed to create shared EGL OpenGL context.");
+		return false;
+	}
+
+	/* a surface can only be current to one context at a time */
+	if (parent->egl_surface != EGL_NO_SURFACE) {
+		plat->egl_surface = eglCreatePbufferSurface(plat->egl_display,
+				plat->egl_config, egl_pbuffer_attribs);
+		if (plat->egl_surface == EGL_NO_SURFACE) {
+			blog(LOG_ERROR, "Failed to create EGL pbuffer.");
+			return false;
+		}
+	}
+
+	if (!gl_headless_make_current(plat, true)) {
+		blog(LOG_ERROR, "Failed to make EGL context current.");
+		return false;
+	}
+
+	return true;
+}
+
+/* the display belongs to the parent context */
+static void gl_headless_destroy_shared(struct gl_platform *plat)
+{
+	if (plat->egl_display == EGL_NO_DISPLAY)
+		return;
+
+	eglMakeCurrent(plat->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+			EGL_NO_CONTEXT);
+
+	if (plat->egl_surface != EGL_NO_SURFACE)
+		eglDestroySurface(plat->egl_display, plat->egl_surface);
+	if (plat->egl_context != EGL_NO_CONTEXT)
+		eglDestroyContext(plat->egl_display, plat->egl_context);
+}
+
+#else
+
+static inline bool gl_headless_make_current(struct gl_platform *plat,
+		bool current)
+{
+	UNUSED_PARAMETER(plat);
+	UNUSED_PARAMETER(current);
+	return false;
+}
+
+static inline void gl_headless_destroy(struct gl_platform *plat)
+{
+	UNUSED_PARAMETER(plat);
+}
+
+static inline struct gl_platform *gl_headless_create(device_t device,
+		struct gs_init_data *info)
+{
+	UNUSED_PARAMETER(device);
+	UNUSED_PARAMETER(info);
+
+	blog(LOG_ERROR, "No window was given, and libobs-opengl was built "
+	                "without EGL, which is required for headless "
+	                "contexts.");
+	return NULL;
+}
+
+static inline bool gl_headless_init_shared(struct gl_platform *plat,
+		struct gl_platform *parent)
+{
+	UNUSED_PARAMETER(plat);
+	UNUSED_PARAMETER(parent);
+	return false;
+}
+
+static inline void gl_headless_destroy_shared(struct gl_platform *plat)
+{
+	UNUSED_PARAMETER(plat);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
 struct gl_platform *gl_platform_create(device_t device,
 		struct gs_init_data *info)
 {
 	int num_configs = 0;
 	int error_base = 0, event_base = 0;
 	Display *display = info->window.display;
-	struct gl_platform *plat = bzalloc(sizeof(struct gl_platform));
+	struct gl_platform *plat;
 	GLXFBConfig* configs;
 	XWindowAttributes attrs;
 	int screen;
@@ -148,6 +512,11 @@ struct gl_platform *gl_platform_create(device_t device,
 
 	print_info_stuff(info);
 
+	if (!gs_window_valid(&info->window))
+		return gl_headless_create(device, info);
+
+	plat = bzalloc(sizeof(struct gl_platform));
+
 	if (!display) {
 		blog(LOG_ERROR, "Unable to find display. DISPLAY variable "
 		                "may not be set correctly.");
@@ -267,11 +636,86 @@ fail0:
 	return NULL;
 }
 
+/* the shared context is made current on the window of the parent's default
+ * swap chain (GLX allows a drawable to be current to several contexts), but
+ * it only ever renders to textures */
+struct gl_platform *gl_platform_create_shared(device_t device,
+		struct gl_platform *parent)
+{
+	struct gl_platform *plat = bzalloc(sizeof(struct gl_platform));
+	Display *display = parent->swap.wi->display;
+
+	plat->shared      = true;
+	plat->headless    = parent->headless;
+	plat->fbcfg       = parent->fbcfg;
+	plat->swap        = parent->swap;
+	plat->swap.device = device;
+#ifdef USE_EGL
+	plat->egl_display = EGL_NO_DISPLAY;
+	plat->egl_context = EGL_NO_CONTEXT;
+	plat->egl_surface = EGL_NO_SURFACE;
+#endif
+
+	device->plat     = plat;
+	device->cur_swap = &plat->swap;
+
+	if (plat->headless) {
+		if (!gl_headless_init_shared(plat, parent))
+			goto fail;
+		return plat;
+	}
+
+	handle_x_error(display, NULL);
+
+	plat->context = glXCreateContextAttribsARB(display, plat->fbcfg,
+			parent->context, true, ctx_attribs);
+	if (!plat->context) {
+		blog(LOG_ERROR, "Failed to create shared OpenGL context.");
+		goto fail;
+	}
+
+	if (handle_x_error(display, "Failed to create shared OpenGL context."))
+		goto fail;
+
+	if (!glXMakeCurrent(display, plat->swap.wi->glxid, plat->context)) {
+		blog(LOG_ERROR, "Failed to make shared context current.");
+		goto fail;
+	}
+
+	return plat;
+
+fail:
+	gl_platform_destroy(plat);
+	device->plat = NULL;
+	return NULL;
+}
+
 void gl_platform_destroy(struct gl_platform *platform)
 {
 	if (!platform)
 		return;
 
+	if (platform->shared) {
+		if (platform->headless) {
+			gl_headless_destroy_shared(platform);
+		} else if (platform->context) {
+			Display *dpy = platform->swap.wi->display;
+
+			glXMakeCurrent(dpy, None, NULL);
+			glXDestroyContext(dpy, platform->context);
+		}
+
+		bfree(platform);
+		return;
+	}
+
+	if (platform->headless) {
+		gl_headless_destroy(platform);
+		gl_windowinfo_destroy(platform->swap.wi);
+		bfree(platform);
+		return;
+	}
+
 	Display *dpy = platform->swap.wi->display;
 
 	glXMakeCurrent(dpy, None, NULL);
@@ -291,6 +735,12 @@ bool gl_platform_init_swapchain(struct gs_swap_chain *swap)
 	XSetWindowAttributes swa;
 	XWindowAttributes attrs;
 
+	if (plat->headless) {
+		blog(LOG_ERROR, "Swap chains can't be created with a headless "
+		                "context");
+		return false;
+	}
+
 	XErrorHandler phandler = XSetErrorHandler(err_handler);
 
 	gl_platform_cleanup_swapchain(swap);
@@ -327,6 +777,11 @@ bool gl_platform_init_swapchain(struct gs_swap_chain *swap)
 	if (handle_x_error(display, "Failed creating intermediate GLX window"))
 		goto fail;
 
+	/* displays are drawn from the video thread, which must never wait
+	 * on a vertical blank */
+	if (GLAD_GLX_EXT_swap_control)
+		glXSwapIntervalEXT(display, info->glxid, 0);
+
 	XFreeColormap(display, cmap);
 	XFree(vi);
 
@@ -371,6 +826,12 @@ void device_entercontext(device_t device)
 	XID window = device->cur_swap->wi->glxid;
 	Display *display = device->cur_swap->wi->display;
 
+	if (device->plat->headless) {
+		if (!gl_headless_make_current(device->plat, true))
+			blog(LOG_ERROR, "Failed to make context current.");
+		return;
+	}
+
 	if (!glXMakeCurrent(display, window, context)) {
 		blog(LOG_ERROR, "Failed to make context current.");
 	}
@@ -380,6 +841,12 @@ void device_leavecontext(device_t device)
 {
 	Display *display = device->cur_swap->wi->display;
 
+	if (device->plat->headless) {
+		if (!gl_headless_make_current(device->plat, false))
+			blog(LOG_ERROR, "Failed to reset current context.");
+		return;
+	}
+
 	if (!glXMakeCurrent(display, None, NULL)) {
 		blog(LOG_ERROR, "Failed to reset current context.");
 	}
@@ -390,6 +857,9 @@ void gl_update(device_t device)
 	Display *display = device->cur_swap->wi->display;
 	XID window = device->cur_swap->wi->int_id;
 
+	if (device->plat->headless)
+		return;
+
 	XResizeWindow(display, window,
 			device->cur_swap->info.cx, device->cur_swap->info.cy);
 }
@@ -402,6 +872,12 @@ void device_load_swapchain(device_t device, swapchain_t swap)
 	if (device->cur_swap == swap)
 		return;
 
+	/* the only swap chain of a headless context is the default one */
+	if (device->plat->headless) {
+		device->cur_swap = swap;
+		return;
+	}
+
 	Display *dpy = swap->wi->display;
 	XID window = swap->wi->glxid;
 	GLXContext ctx = device->plat->context;
@@ -418,5 +894,183 @@ void device_present(device_t device)
 	Display *display = device->cur_swap->wi->display;
 	XID window = device->cur_swap->wi->glxid;
 
+	if (device->plat->headless)
+		return;
+
 	glXSwapBuffers(display, window);
 }
+
+/* ------------------------------------------------------------------------- */
+/* GLX_EXT_texture_from_pixmap */
+
+static bool get_pixmap_fbconfig(Display *display, unsigned int depth,
+		GLXFBConfig *fbcfg, bool *rgba)
+{
+	static const int attribs[] = {
+		GLX_BIND_TO_TEXTURE_TARGETS_EXT, GLX_TEXTURE_2D_BIT_EXT,
+		GLX_DRAWABLE_TYPE, GLX_PIXMAP_BIT,
+		GLX_X_RENDERABLE, true,
+		GLX_DOUBLEBUFFER, false,
+		GLX_RENDER_TYPE, GLX_RGBA_BIT,
+		None
+	};
+
+	int num_configs = 0;
+	bool found = false;
+	GLXFBConfig *configs = glXChooseFBConfig(display,
+			DefaultScreen(display), attribs, &num_configs);
+
+	if (!configs)
+		return false;
+
+	/* the config has to match the depth of the pixmap, 32 bit pixmaps
+	 * are bound with alpha */
+	for (int i = 0; i < num_configs && !found; i++) {
+		XVisualInfo *vi = glXGetVisualFromFBConfig(display, configs[i]);
+		int bind = 0;
+
+		if (!vi)
+			continue;
+
+		if (vi->depth == (int)depth) {
+			*rgba = depth == 32;
+			glXGetFBConfigAttrib(display, configs[i], *rgba ?
+					GLX_BIND_TO_TEXTURE_RGBA_EXT :
+					GLX_BIND_TO_TEXTURE_RGB_EXT, &bind);
+
+			if (bind) {
+				*fbcfg = configs[i];
+				found  = true;
+			}
+		}
+
+		XFree(vi);
+	}
+
+	XFree(configs);
+	return found;
+}
+
+EXPORT texture_t device_create_texture_from_pixmap(device_t device,
+		unsigned long pixmap, bool *flip)
+{
+	Display *display = device->plat->swap.wi->display;
+	struct gs_texture_2d *tex = NULL;
+	GLXPixmap glx_pixmap = 0;
+	GLXFBConfig fbcfg;
+	XErrorHandler phandler;
+	Window root;
+	int x, y, inverted = 0;
+	unsigned int width, height, border, depth;
+	bool rgba = false;
+
+	if (!GLAD_GLX_EXT_texture_from_pixmap) {
+		blog(LOG_ERROR, "GLX_EXT_texture_from_pixmap not supported");
+		return NULL;
+	}
+
+	phandler = XSetErrorHandler(err_handler);
+
+	if (!XGetGeometry(display, pixmap, &root, &x, &y, &width, &height,
+				&border, &depth) ||
+	    handle_x_error(display, "Failed to get pixmap geometry"))
+		goto fail;
+
+	if (!get_pixmap_fbconfig(display, depth, &fbcfg, &rgba)) {
+		blog(LOG_ERROR, "No fb config for pixmaps of depth %u", depth);
+		goto fail;
+	}
+
+	const int pixmap_attribs[] = {
+		GLX_TEXTURE_TARGET_EXT, GLX_TEXTURE_2D_EXT,
+		GLX_TEXTURE_FORMAT_EXT, rgba ?
+			GLX_TEXTURE_FORMAT_RGBA_EXT :
+			GLX_TEXTURE_FORMAT_RGB_EXT,
+		None
+	};
+
+	glx_pixmap = glXCreatePixmap(display, fbcfg, pixmap, pixmap_attribs);
+	if (handle_x_error(display, "Failed to create GLX pixmap"))
+		goto fail;
+
+	glXGetFBConfigAttrib(display, fbcfg, GLX_Y_INVERTED_EXT, &inverted);
+
+	const enum gs_color_format color_format = rgba ? GS_BGRA : GS_BGRX;
+
+	tex = bzalloc(sizeof(struct gs_texture_2d));
+	tex->base.device             = device;
+	tex->base.type               = GS_TEXTURE_2D;
+	tex->base.format             = color_format;
+	tex->base.levels             = 1;
+	tex->base.gl_format          = convert_gs_format(color_format);
+	tex->base.gl_internal_format = convert_gs_internal_format(color_format);
+	tex->base.gl_type            = get_gl_format_type(color_format);
+	tex->base.gl_target          = GL_TEXTURE_2D;
+	tex->width                   = width;
+	tex->height                  = height;
+	tex->glx_pixmap              = glx_pixmap;
+
+	if (!gl_gen_textures(1, &tex->base.texture))
+		goto fail;
+	if (!gl_bind_texture(GL_TEXTURE_2D, tex->base.texture))
+		goto fail;
+
+	glXBindTexImageEXT(display, glx_pixmap, GLX_FRONT_LEFT_EXT, NULL);
+	if (handle_x_error(display, "Failed to bind pixmap to texture"))
+		goto fail;
+
+	if (!gl_tex_param_i(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0))
+		goto fail;
+	if (!gl_bind_texture(GL_TEXTURE_2D, 0))
+		goto fail;
+
+	XSetErrorHandler(phandler);
+
+	/* unless the pixmap is y-inverted, its first row is at the bottom */
+	*flip = !inverted;
+	return (texture_t)tex;
+
+fail:
+	if (tex)
+		texture_destroy((texture_t)tex);
+	else if (glx_pixmap)
+		glXDestroyPixmap(display, glx_pixmap);
+
+	XSetErrorHandler(phandler);
+	blog(LOG_ERROR, "device_create_texture_from_pixmap (GL) failed");
+	return NULL;
+}
+
+bool texture_rebind_pixmap(texture_t texture)
+{
+	struct gs_texture_2d *tex = (struct gs_texture_2d*)texture;
+	Display *display;
+
+	if (texture->type != GS_TEXTURE_2D || !tex->glx_pixmap)
+		return false;
+
+	display = texture->device->plat->swap.wi->display;
+
+	if (!gl_bind_texture(GL_TEXTURE_2D, texture->texture))
+		return false;
+
+	glXReleaseTexImageEXT(display, tex->glx_pixmap, GLX_FRONT_LEFT_EXT);
+	glXBindTexImageEXT(display, tex->glx_pixmap, GLX_FRONT_LEFT_EXT, NULL);
+
+	return gl_bind_texture(GL_TEXTURE_2D, 0);
+}
+
+void gl_platform_release_pixmap(struct gs_texture_2d *tex)
+{
+	Display *display = tex->base.device->plat->swap.wi->display;
+
+	if (tex->base.texture &&
+	    gl_bind_texture(GL_TEXTURE_2D, tex->base.texture)) {
+		glXReleaseTexImageEXT(display, tex->glx_pixmap,
+				GLX_FRONT_LEFT_EXT);
+		gl_bind_texture(GL_TEXTURE_2D, 0);
+	}
+
+	glXDestroyPixmap(display, tex->glx_pixmap);
+	tex->glx_pixmap = 0;
+}
@@ -26,10 +26,12 @@
  *
  *   Stack format is:
  *     [size_t    param1_name_size]
+ *     [size_t    param1_id]
  *     [char[]    param1_name]
  *     [size_t    param1_data_size]
  *     [uint8_t[] param1_data]
  *     [size_t    param2_name_size]
+ *     [size_t    param2_id]
  *     [char[]    param2_name]
  *     [size_t    param2_data_size]
  *     [uint8_t[] param2_data]
@@ -37,7 +39,8 @@
  *     [size_t    0]
  *
  *   Strings and string sizes always include the null terminator to allow for
- * direct referencing.
+ * direct referencing.  The ID is the hash of the name, so names are only
+ * compared when the IDs match.
  */
 
 static inline void cd_serialize(uint8_t **pos, void *ptr, size_t size)
@@ -63,7 +66,7 @@ static inline const char *cd_serialize_string(uint8_t **pos)
 	return (size != 0) ? str : NULL;
 }
 
-static bool cd_getparam(calldata_t data, const char *name,
+static bool cd_getparam(calldata_t data, const char *name, size_t id,
 		uint8_t **pos)
 {
 	size_t name_size;
@@ -75,11 +78,12 @@ static bool cd_getparam(calldata_t data, const char *name,
 
 	name_size = cd_serialize_size(pos);
 	while (name_size != 0) {
+		size_t     param_id   = cd_serialize_size(pos);
 		const char *param_name = (const char *)*pos;
 		size_t param_size;
 
 		*pos += name_size;
-		if (strcmp(param_name, name) == 0)
+		if (param_id == id && strcmp(param_name, name) == 0)
 			return true;
 
 		param_size = cd_serialize_size(pos);
@@ -92,14 +96,14 @@ static bool cd_getparam(calldata_t data, const char *name,
 	return false;
 }
 
-static inline void cd_copy_string(uint8_t **pos, const char *str, size_t len)
+static inline void cd_copy_name(uint8_t **pos, const char *name, size_t id,
+		size_t len)
 {
-	if (!len)
-		len = strlen(str)+1;
-
 	*(size_t*)*pos = len;
 	*pos += sizeof(size_t);
-	memcpy(*pos, str, len);
+	*(size_t*)*pos = id;
+	*pos += sizeof(size_t);
+	memcpy(*pos, name, len);
 	*pos += len;
 }
 
@@ -115,13 +119,13 @@ static inline void cd_copy_data(uint8_t **pos, const void *in, size_t size)
 }
 
 static inline void cd_set_first_param(calldata_t data, const char *name,
-		const void *in, size_t size)
+		size_t id, const void *in, size_t size)
 {
 	uint8_t *pos;
 	size_t capacity;
 	size_t name_len = strlen(name)+1;
 
-	capacity = sizeof(size_t)*3 + name_len + size;
+	capacity = sizeof(size_t)*4 + name_len + size;
 	data->size = capacity;
 
 	if (capacity < 128)
@@ -129,9 +133,10 @@ static inline void cd_set_first_param(calldata_t data, const char *name,
 
 	data->capacity = capacity;
 	data->stack    = bmalloc(capacity);
+	data->fixed    = false;
 
 	pos = data->stack;
-	cd_copy_string(&pos, name, name_len);
+	cd_copy_name(&pos, name, id, name_len);
 	cd_copy_data(&pos, in, size);
 	*(size_t*)pos = 0;
 }
@@ -151,7 +156,17 @@ static inline void cd_ensure_capacity(calldata_t data, uint8_t **pos,
 	if (new_capacity < new_size)
 		new_capacity = new_size;
 
-	data->stack    = brealloc(data->stack, new_capacity);
+	if (data->fixed) {
+		/* caller-owned storage overflowed, move to the heap */
+		uint8_t *stack = bmalloc(new_capacity);
+		memcpy(stack, data->stack, data->size);
+
+		data->stack = stack;
+		data->fixed = false;
+	} else {
+		data->stack = brealloc(data->stack, new_capacity);
+	}
+
 	data->capacity = new_capacity;
 
 	*pos = data->stack + offset;
@@ -167,7 +182,7 @@ bool calldata_getdata(calldata_t data, const char *name, void *out, size_t size)
 	if (!data || !name || !*name)
 		return false;
 
-	if (!cd_getparam(data, name, &pos))
+	if (!cd_getparam(data, name, calldata_param_id(name), &pos))
 		return false;
 
 	data_size = cd_serialize_size(&pos);
@@ -182,16 +197,19 @@ void calldata_setdata(calldata_t data, const char *name, const void *in,
 		size_t size)
 {
 	uint8_t *pos;
+	size_t  id;
 
 	if (!data || !name || !*name)
 		return;
 
+	id = calldata_param_id(name);
+
 	if (!data->stack) {
-		cd_set_first_param(data, name, in, size);
+		cd_set_first_param(data, name, id, in, size);
 		return;
 	}
 
-	if (cd_getparam(data, name, &pos)) {
+	if (cd_getparam(data, name, id, &pos)) {
 		size_t cur_size = *(size_t*)pos;
 
 		if (cur_size < size) {
@@ -214,11 +232,11 @@ void calldata_setdata(calldata_t data, const char *name, const void *in,
 
 	} else {
 		size_t name_len = strlen(name)+1;
-		size_t offset = name_len + size + sizeof(size_t)*2;
+		size_t offset = name_len + size + sizeof(size_t)*3;
 		cd_ensure_capacity(data, &pos, data->size + offset);
 		data->size += offset;
 
-		cd_copy_string(&pos, name, 0);
+		cd_copy_name(&pos, name, id, name_len);
 		cd_copy_data(&pos, in, size);
 		*(size_t*)pos = 0;
 	}
@@ -230,7 +248,7 @@ bool calldata_getstring(calldata_t data, const char *name, const char **str)
 	if (!data || !name || !*name)
 		return false;
 
-	if (!cd_getparam(data, name, &pos))
+	if (!cd_getparam(data, name, calldata_param_id(name), &pos))
 		return false;
 
 	*str = cd_serialize_string(&pos);
@@ -19,6 +19,7 @@
 #include <string.h>
 #include "../util/c99defs.h"
 #include "../util/bmem.h"
+#include "../util/hash.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,6 +48,7 @@ struct calldata {
 	size_t  size;     /* size of the stack, in bytes */
 	size_t  capacity; /* capacity of the stack, in bytes */
 	uint8_t *stack;
+	bool    fixed;    /* stack is caller-owned storage */
 };
 
 typedef struct calldata *calldata_t;
@@ -56,9 +58,40 @@ static inline void calldata_init(struct calldata *data)
 	memset(data, 0, sizeof(struct calldata));
 }
 
+/**
+ * Initializes calldata to use caller-owned storage (usually on the stack) so
+ * that setting parameters doesn't allocate unless the storage overflows, in
+ * which case it moves to the heap.  calldata_free must still be called.
+ */
+static inline void calldata_init_fixed(struct calldata *data, uint8_t *stack,
+		size_t size)
+{
+	data->stack    = stack;
+	data->capacity = size;
+	data->fixed    = true;
+
+	/* empty stack, just the terminator */
+	data->size     = sizeof(size_t);
+	*(size_t*)stack = 0;
+}
+
 static inline void calldata_free(struct calldata *data)
 {
-	bfree(data->stack);
+	if (!data->fixed)
+		bfree(data->stack);
+}
+
+/** suggested size for calldata_init_fixed, fits several small parameters */
+#define CALLDATA_FIXED_SIZE 256
+
+/**
+ * Parameter names are identified by a hash that is stored with each
+ * parameter, so looking up a parameter only compares names once the hashes
+ * match.  Declarations store the IDs of their parameters (see decl.h).
+ */
+static inline size_t calldata_param_id(const char *name)
+{
+	return (size_t)hash_fnv1a(name);
 }
 
 EXPORT bool calldata_getdata(calldata_t data, const char *name, void *out,
@@ -141,6 +141,9 @@ static int parse_param(struct cf_parser *cfp, struct decl_info *decl)
 	if (is_reserved_name(param.name))
 		err_reserved_name(cfp, param.name);
 
+	if (param.name)
+		param.id = calldata_param_id(param.name);
+
 	da_push_back(decl->params, &param);
 	return PARSE_SUCCESS;
 }
@@ -226,6 +229,7 @@ fail:
 
 	if (success && ret_param.type != CALL_PARAM_TYPE_VOID) {
 		ret_param.name = bstrdup("return");
+		ret_param.id   = calldata_param_id(ret_param.name);
 		da_push_back(decl->params, &ret_param);
 	}
 
@@ -25,6 +25,7 @@ extern "C" {
 
 struct decl_param {
 	char                 *name;
+	size_t               id;    /* calldata_param_id of the name */
 	enum call_param_type type;
 	uint32_t             flags;
 };
@@ -15,31 +15,471 @@
  */
 
 #include "../util/darray.h"
+#include "../util/hash.h"
 #include "../util/threading.h"
+#include "../util/platform.h"
 
 #include "decl.h"
 #include "signal.h"
 
+/*
+ *   Signals are emitted without taking any locks.  Each signal publishes an
+ * immutable list of callbacks which is replaced (never modified) when
+ * callbacks are connected or disconnected.  Emitters register themselves in
+ * one of two reader counts while they use the list, so a disconnect can wait
+ * for the emitters that may still see the old list before freeing it, while
+ * emitters that start afterward use the other count and don't hold it up.
+ *
+ *   Signals are never removed once added, so the name lookup is a fixed hash
+ * table that is only ever prepended to.
+ *
+ *   Queued callbacks have a connection object that outlives the callback
+ * list, because signals queued for it can still be waiting after it has
+ * been disconnected or its signal handler has been destroyed.
+ */
+
+#define SIGNAL_HASH_BUCKETS 64
+
+struct queued_callback;
+
 struct signal_callback {
 	signal_callback_t callback;
 	void *data;
+	struct queued_callback *queued;
+};
+
+struct signal_callbacks {
+	size_t                         num;
+	struct signal_callback         array[1];
 };
 
 struct signal_info {
 	struct decl_info               func;
-	DARRAY(struct signal_callback) callbacks;
+	uint32_t                       hash;
+
+	struct signal_callbacks        *volatile callbacks;
+	DARRAY(struct signal_callbacks*) retired;
+
+	volatile long                  epoch;
+	volatile long                  readers[2];
+
+	/* only taken when changing the callbacks */
 	pthread_mutex_t                mutex;
 
 	struct signal_info             *next;
+	struct signal_info             *hash_next;
+};
+
+/* ------------------------------------------------------------------------- */
+/* signal queues */
+
+struct queued_callback {
+	signal_callback_t              callback;
+	void                           *data;
+	struct signal_queue            *queue;
+	uint32_t                       flags;
+
+	/* copied from the signal, which may be gone by the time its last
+	 * queued signal is called */
+	char                           *signal;
+	DARRAY(char*)                  ptr_params;
+
+	/* held by the connection and by each queued signal */
+	volatile long                  refs;
+	volatile long                  disconnected;
+
+	/* latest parameters of a coalescing callback */
+	struct queued_signal *volatile coalesced;
+};
+
+struct queued_signal {
+	struct queued_signal *volatile next;
+	struct queued_callback         *qc;
+	struct calldata                params;
+};
+
+struct signal_queue {
+	/* intrusive multi-producer single-consumer list: emitters swap
+	 * themselves in at the head, and the dispatcher takes from the
+	 * tail, which starts at the stub */
+	struct queued_signal *volatile head;
+	struct queued_signal           *tail;
+	struct queued_signal           stub;
+	volatile long                  count;
+
+	signal_hold_t                  hold;
+	signal_release_t               release;
+	signal_wakeup_t                wakeup;
+	void                           *wakeup_param;
+
+	/* only one thread dispatches at a time */
+	pthread_mutex_t                dispatch_mutex;
+	pthread_t                      dispatcher;
+	struct queued_callback *volatile current;
+
+	os_sem_t                       sem;
+	pthread_t                      thread;
+	bool                           thread_active;
+	volatile bool                  stop;
 };
 
+static inline void *load_ptr(void *volatile *ptr)
+{
+	return os_atomic_load_ptr((void *const volatile*)ptr);
+}
+
+static struct queued_callback *queued_callback_create(
+		const struct decl_info *func, signal_callback_t callback,
+		void *data, signal_queue_t queue, uint32_t flags)
+{
+	struct queued_callback *qc = bzalloc(sizeof(struct queued_callback));
+
+	qc->callback = callback;
+	qc->data     = data;
+	qc->queue    = queue;
+	qc->flags    = flags;
+	qc->signal   = bstrdup(func->name);
+	qc->refs     = 1;
+
+	for (size_t i = 0; i < func->params.num; i++) {
+		struct decl_param *param = func->params.array+i;
+
+		if (param->type == CALL_PARAM_TYPE_PTR) {
+			char *name = bstrdup(param->name);
+			da_push_back(qc->ptr_params, &name);
+		}
+	}
+
+	return qc;
+}
+
+static void queued_callback_release(struct queued_callback *qc)
+{
+	if (os_atomic_dec_long(&qc->refs) != 0)
+		return;
+
+	for (size_t i = 0; i < qc->ptr_params.num; i++)
+		bfree(qc->ptr_params.array[i]);
+	da_free(qc->ptr_params);
+	bfree(qc->signal);
+	bfree(qc);
+}
+
+static void hold_params(struct signal_queue *queue,
+		struct queued_callback *qc, calldata_t params)
+{
+	if (!queue->hold)
+		return;
+
+	for (size_t i = 0; i < qc->ptr_params.num; i++) {
+		const char *name = qc->ptr_params.array[i];
+		void       *ptr  = NULL;
+
+		if (!calldata_getptr(params, name, &ptr) || !ptr)
+			continue;
+		if (!queue->hold(qc->signal, name, ptr))
+			calldata_setptr(params, name, NULL);
+	}
+}
+
+static void free_queued_signal(struct signal_queue *queue,
+		struct queued_callback *qc, struct queued_signal *qs)
+{
+	if (!qs)
+		return;
+
+	for (size_t i = 0; queue->release && i < qc->ptr_params.num; i++) {
+		const char *name = qc->ptr_params.array[i];
+		void       *ptr  = NULL;
+
+		if (calldata_getptr(&qs->params, name, &ptr) && ptr)
+			queue->release(name, ptr);
+	}
+
+	calldata_free(&qs->params);
+	bfree(qs);
+}
+
+static inline void mpsc_push(struct signal_queue *queue,
+		struct queued_signal *qs)
+{
+	struct queued_signal *prev;
+
+	qs->next = NULL;
+	prev = os_atomic_set_ptr((void *volatile*)&queue->head, qs);
+	os_atomic_set_ptr((void *volatile*)&prev->next, qs);
+}
+
+/* returns NULL if the queue is empty, or if the next signal's emitter is
+ * between swapping in its signal and linking it, in which case it posts or
+ * wakes the dispatcher again once it's done */
+static struct queued_signal *mpsc_pop(struct signal_queue *queue)
+{
+	struct queued_signal *tail = queue->tail;
+	struct queued_signal *next = load_ptr((void *volatile*)&tail->next);
+
+	if (tail == &queue->stub) {
+		if (!next)
+			return NULL;
+
+		queue->tail = next;
+		tail        = next;
+		next        = load_ptr((void *volatile*)&next->next);
+	}
+
+	if (next) {
+		queue->tail = next;
+		return tail;
+	}
+
+	if (tail != load_ptr((void *volatile*)&queue->head))
+		return NULL;
+
+	mpsc_push(queue, &queue->stub);
+
+	next = load_ptr((void *volatile*)&tail->next);
+	if (next) {
+		queue->tail = next;
+		return tail;
+	}
+
+	return NULL;
+}
+
+static void queue_signal(struct queued_callback *qc, calldata_t params)
+{
+	struct signal_queue  *queue = qc->queue;
+	struct queued_signal *qs, *old;
+	long                 count;
+
+	if (os_atomic_load_long(&qc->disconnected))
+		return;
+
+	qs = bzalloc(sizeof(struct queued_signal));
+	if (params && params->size) {
+		qs->params.stack    = bmemdup(params->stack, params->size);
+		qs->params.size     = params->size;
+		qs->params.capacity = params->size;
+	}
+
+	hold_params(queue, qc, &qs->params);
+
+	/* a coalescing callback only has its latest parameters kept, and
+	 * a signal is only queued when there weren't any yet */
+	if ((qc->flags & SIGNAL_COALESCE) != 0) {
+		old = os_atomic_set_ptr((void *volatile*)&qc->coalesced, qs);
+		if (old) {
+			free_queued_signal(queue, qc, old);
+			return;
+		}
+
+		qs = bzalloc(sizeof(struct queued_signal));
+	}
+
+	os_atomic_inc_long(&qc->refs);
+	qs->qc = qc;
+
+	count = os_atomic_inc_long(&queue->count);
+	mpsc_push(queue, qs);
+
+	if (queue->thread_active)
+		os_sem_post(queue->sem);
+	else if (count == 1 && queue->wakeup)
+		queue->wakeup(queue->wakeup_param);
+}
+
+static inline struct queued_signal *take_params(struct queued_signal *qs)
+{
+	struct queued_callback *qc = qs->qc;
+
+	if ((qc->flags & SIGNAL_COALESCE) == 0)
+		return qs;
+
+	return os_atomic_set_ptr((void *volatile*)&qc->coalesced, NULL);
+}
+
+static void drop_signal(struct signal_queue *queue, struct queued_signal *qs)
+{
+	struct queued_callback *qc     = qs->qc;
+	struct queued_signal   *params = take_params(qs);
+
+	if (params != qs)
+		free_queued_signal(queue, qc, params);
+	free_queued_signal(queue, qc, qs);
+	queued_callback_release(qc);
+}
+
+static void dispatch_signal(struct signal_queue *queue,
+		struct queued_signal *qs)
+{
+	struct queued_callback *qc     = qs->qc;
+	struct queued_signal   *params = take_params(qs);
+
+	/* a disconnect sets its flag before checking for the current
+	 * callback, this sets the current callback before checking the flag,
+	 * so one of them always sees the other */
+	if (params) {
+		os_atomic_set_ptr((void *volatile*)&queue->current, qc);
+		if (!os_atomic_load_long(&qc->disconnected))
+			qc->callback(qc->data, &params->params);
+		os_atomic_set_ptr((void *volatile*)&queue->current, NULL);
+	}
+
+	if (params != qs)
+		free_queued_signal(queue, qc, params);
+	free_queued_signal(queue, qc, qs);
+	queued_callback_release(qc);
+}
+
+/* called with the dispatch mutex held */
+static size_t dispatch_signals(struct signal_queue *queue)
+{
+	struct queued_signal *qs;
+	size_t num = 0;
+
+	queue->dispatcher = pthread_self();
+
+	while ((qs = mpsc_pop(queue)) != NULL) {
+		os_atomic_dec_long(&queue->count);
+		dispatch_signal(queue, qs);
+		num++;
+	}
+
+	return num;
+}
+
+/* once this returns the callback won't be called again, unless this is
+ * called from the callback itself */
+static void disconnect_queued(struct queued_callback *qc)
+{
+	struct signal_queue *queue = qc->queue;
+
+	os_atomic_set_long(&qc->disconnected, 1);
+
+	while (load_ptr((void *volatile*)&queue->current) == qc) {
+		if (pthread_equal(queue->dispatcher, pthread_self()))
+			break;
+		os_sleep_ms(0);
+	}
+
+	queued_callback_release(qc);
+}
+
+static void *signal_queue_thread(void *param)
+{
+	struct signal_queue *queue = param;
+
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "signal queue");
+
+	while (os_sem_wait(queue->sem) == 0 && !queue->stop) {
+		pthread_mutex_lock(&queue->dispatch_mutex);
+		dispatch_signals(queue);
+		pthread_mutex_unlock(&queue->dispatch_mutex);
+	}
+
+	return NULL;
+}
+
+signal_queue_t signal_queue_create(bool dispatch_thread)
+{
+	struct signal_queue *queue = bzalloc(sizeof(struct signal_queue));
+
+	queue->head = &queue->stub;
+	queue->tail = &queue->stub;
+
+	if (pthread_mutex_init(&queue->dispatch_mutex, NULL) != 0)
+		goto fail_mutex;
+
+	if (dispatch_thread) {
+		if (os_sem_init(&queue->sem, 0) != 0)
+			goto fail;
+		if (pthread_create(&queue->thread, NULL, signal_queue_thread,
+					queue) != 0)
+			goto fail;
+
+		queue->thread_active = true;
+	}
+
+	return queue;
+
+fail:
+	if (queue->sem)
+		os_sem_destroy(queue->sem);
+	pthread_mutex_destroy(&queue->dispatch_mutex);
+fail_mutex:
+	blog(LOG_ERROR, "Couldn't create signal queue");
+	bfree(queue);
+	return NULL;
+}
+
+void signal_queue_destroy(signal_queue_t queue)
+{
+	struct queued_signal *qs;
+
+	if (!queue)
+		return;
+
+	if (queue->thread_active) {
+		queue->stop = true;
+		os_sem_post(queue->sem);
+		pthread_join(queue->thread, NULL);
+		os_sem_destroy(queue->sem);
+	}
+
+	while ((qs = mpsc_pop(queue)) != NULL)
+		drop_signal(queue, qs);
+
+	pthread_mutex_destroy(&queue->dispatch_mutex);
+	bfree(queue);
+}
+
+void signal_queue_set_hold(signal_queue_t queue, signal_hold_t hold,
+		signal_release_t release)
+{
+	if (!queue)
+		return;
+
+	queue->hold    = hold;
+	queue->release = release;
+}
+
+void signal_queue_set_wakeup(signal_queue_t queue, signal_wakeup_t wakeup,
+		void *param)
+{
+	if (!queue)
+		return;
+
+	queue->wakeup_param = param;
+	queue->wakeup       = wakeup;
+}
+
+size_t signal_queue_dispatch(signal_queue_t queue)
+{
+	size_t num;
+
+	if (!queue || queue->thread_active)
+		return 0;
+
+	pthread_mutex_lock(&queue->dispatch_mutex);
+	num = dispatch_signals(queue);
+	pthread_mutex_unlock(&queue->dispatch_mutex);
+
+	/* an emitter that was still linking its signal didn't wake us, as
+	 * the queue wasn't empty when it started */
+	if (os_atomic_load_long(&queue->count) > 0 && queue->wakeup)
+		queue->wakeup(queue->wakeup_param);
+
+	return num;
+}
+
+/* ------------------------------------------------------------------------- */
+
 static inline struct signal_info *signal_info_create(struct decl_info *info)
 {
-	struct signal_info *si = bmalloc(sizeof(struct signal_info));
+	struct signal_info *si = bzalloc(sizeof(struct signal_info));
 
 	si->func = *info;
-	si->next = NULL;
-	da_init(si->callbacks);
+	si->hash = hash_fnv1a(info->name);
 
 	if (pthread_mutex_init(&si->mutex, NULL) != 0) {
 		blog(LOG_ERROR, "Could not create signal");
@@ -52,21 +492,41 @@ static inline struct signal_info *signal_info_create(struct decl_info *info)
 	return si;
 }
 
+static inline void free_retired_callbacks(struct signal_info *si)
+{
+	for (size_t i = 0; i < si->retired.num; i++)
+		bfree(si->retired.array[i]);
+	da_resize(si->retired, 0);
+}
+
 static inline void signal_info_destroy(struct signal_info *si)
 {
 	if (si) {
+		struct signal_callbacks *list = si->callbacks;
+
+		for (size_t i = 0; list && i < list->num; i++) {
+			if (list->array[i].queued)
+				disconnect_queued(list->array[i].queued);
+		}
+
+		free_retired_callbacks(si);
+		da_free(si->retired);
+		bfree(si->callbacks);
+
 		pthread_mutex_destroy(&si->mutex);
 		decl_info_free(&si->func);
-		da_free(si->callbacks);
 		bfree(si);
 	}
 }
 
-static inline size_t signal_get_callback_idx(struct signal_info *si,
+static inline size_t signal_get_callback_idx(struct signal_callbacks *list,
 		signal_callback_t callback, void *data)
 {
-	for (size_t i = 0; i < si->callbacks.num; i++) {
-		struct signal_callback *sc = si->callbacks.array+i;
+	if (!list)
+		return DARRAY_INVALID;
+
+	for (size_t i = 0; i < list->num; i++) {
+		struct signal_callback *sc = list->array+i;
 
 		if (sc->callback == callback && sc->data == data)
 			return i;
@@ -75,27 +535,69 @@ static inline size_t signal_get_callback_idx(struct signal_info *si,
 	return DARRAY_INVALID;
 }
 
+static inline struct signal_callbacks *alloc_callbacks(size_t num)
+{
+	struct signal_callbacks *list;
+
+	list = bmalloc(sizeof(struct signal_callbacks) +
+			sizeof(struct signal_callback) * (num - 1));
+	list->num = num;
+	return list;
+}
+
+static inline struct signal_callbacks *get_callbacks(struct signal_info *si)
+{
+	return os_atomic_load_ptr((void *const volatile*)&si->callbacks);
+}
+
+static inline struct signal_callbacks *publish_callbacks(
+		struct signal_info *si, struct signal_callbacks *list)
+{
+	return os_atomic_set_ptr((void *volatile*)&si->callbacks, list);
+}
+
+/* waits until no emitter can still be using a list that was replaced before
+ * this call.  must be called with the signal mutex held */
+static void wait_for_emitters(struct signal_info *si)
+{
+	for (int i = 0; i < 2; i++) {
+		long idx = os_atomic_load_long(&si->epoch);
+		os_atomic_set_long(&si->epoch, idx ^ 1);
+
+		while (os_atomic_load_long(&si->readers[idx]) > 0)
+			os_sleep_ms(0);
+	}
+}
+
 struct signal_handler {
 	struct signal_info *first;
+	struct signal_info *volatile buckets[SIGNAL_HASH_BUCKETS];
+
+	/* only taken when adding signals */
 	pthread_mutex_t    mutex;
 };
 
+static inline struct signal_info *volatile *get_bucket(
+		struct signal_handler *handler, uint32_t hash)
+{
+	return &handler->buckets[hash % SIGNAL_HASH_BUCKETS];
+}
+
 static struct signal_info *getsignal(signal_handler_t handler,
-		const char *name, struct signal_info **p_last)
+		const char *name)
 {
-	struct signal_info *signal, *last= NULL;
+	uint32_t           hash = hash_fnv1a(name);
+	struct signal_info *signal;
 
-	signal = handler->first;
+	signal = os_atomic_load_ptr(
+			(void *const volatile*)get_bucket(handler, hash));
 	while (signal != NULL) {
-		if (strcmp(signal->func.name, name) == 0)
+		if (signal->hash == hash && strcmp(signal->func.name, name) == 0)
 			break;
 
-		last = signal;
-		signal = signal->next;
+		signal = signal->hash_next;
 	}
 
-	if (p_last)
-		*p_last = last;
 	return signal;
 }
 
@@ -103,8 +605,7 @@ static struct signal_info *getsignal(signal_handler_t handler,
 
 signal_handler_t signal_handler_create(void)
 {
-	struct signal_handler *handler = bmalloc(sizeof(struct signal_handler));
-	handler->first = NULL;
+	struct signal_handler *handler = bzalloc(sizeof(struct signal_handler));
 
 	if (pthread_mutex_init(&handler->mutex, NULL) != 0) {
 		blog(LOG_ERROR, "Couldn't create signal handler!");
@@ -133,7 +634,8 @@ void signal_handler_destroy(signal_handler_t handler)
 bool signal_handler_add(signal_handler_t handler, const char *signal_decl)
 {
 	struct decl_info func = {0};
-	struct signal_info *sig, *last;
+	struct signal_info *sig;
+	struct signal_info *volatile *bucket;
 	bool success = true;
 
 	if (!parse_decl_string(&func, signal_decl)) {
@@ -143,17 +645,24 @@ bool signal_handler_add(signal_handler_t handler, const char *signal_decl)
 
 	pthread_mutex_lock(&handler->mutex);
 
-	sig = getsignal(handler, func.name, &last);
+	sig = getsignal(handler, func.name);
 	if (sig) {
 		blog(LOG_WARNING, "Signal declaration '%s' exists", func.name);
 		decl_info_free(&func);
 		success = false;
 	} else {
 		sig = signal_info_create(&func);
-		if (!last)
+		if (sig) {
+			sig->next      = handler->first;
 			handler->first = sig;
-		else
-			last->next = sig;
+
+			/* fully set up before it becomes visible to lookups */
+			bucket         = get_bucket(handler, sig->hash);
+			sig->hash_next = *bucket;
+			os_atomic_set_ptr((void *volatile*)bucket, sig);
+		} else {
+			success = false;
+		}
 	}
 
 	pthread_mutex_unlock(&handler->mutex);
@@ -161,81 +670,144 @@ bool signal_handler_add(signal_handler_t handler, const char *signal_decl)
 	return success;
 }
 
-void signal_handler_connect(signal_handler_t handler, const char *signal,
-		signal_callback_t callback, void *data)
+static void connect_callback(signal_handler_t handler, const char *signal,
+		signal_callback_t callback, void *data,
+		signal_queue_t queue, uint32_t flags)
 {
-	struct signal_info *sig, *last;
-	struct signal_callback cb_data = {callback, data};
-	size_t idx;
+	struct signal_info *sig;
+	struct signal_callbacks *old_list, *new_list;
+	size_t num;
 
 	if (!handler)
 		return;
 
-	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, signal, &last);
+	sig = getsignal(handler, signal);
 	if (!sig)
 		return;
 
-	pthread_mutex_unlock(&handler->mutex);
+	pthread_mutex_lock(&sig->mutex);
 
-	/* -------------- */
+	old_list = sig->callbacks;
 
-	pthread_mutex_lock(&sig->mutex);
+	if (signal_get_callback_idx(old_list, callback, data) ==
+			DARRAY_INVALID) {
+		num = old_list ? old_list->num : 0;
+
+		new_list = alloc_callbacks(num + 1);
+		if (num)
+			memcpy(new_list->array, old_list->array,
+					sizeof(struct signal_callback) * num);
+		new_list->array[num].callback = callback;
+		new_list->array[num].data     = data;
+		new_list->array[num].queued   = queue ?
+			queued_callback_create(&sig->func, callback, data,
+					queue, flags) : NULL;
+
+		publish_callbacks(sig, new_list);
+
+		/* connecting doesn't wait for emitters (it may be done from
+		 * within a callback), so the old list is freed later */
+		if (old_list)
+			da_push_back(sig->retired, &old_list);
+	}
 
-	idx = signal_get_callback_idx(sig, callback, data);
-	if (idx == DARRAY_INVALID)
-		da_push_back(sig->callbacks, &cb_data);
-	
 	pthread_mutex_unlock(&sig->mutex);
 }
 
-static inline struct signal_info *getsignal_locked(signal_handler_t handler,
-		const char *name)
+void signal_handler_connect(signal_handler_t handler, const char *signal,
+		signal_callback_t callback, void *data)
 {
-	struct signal_info *sig;
-
-	if (!handler)
-		return NULL;
+	connect_callback(handler, signal, callback, data, NULL, 0);
+}
 
-	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, name, NULL);
-	pthread_mutex_unlock(&handler->mutex);
+void signal_handler_connect_queued(signal_handler_t handler,
+		const char *signal, signal_callback_t callback, void *data,
+		signal_queue_t queue, uint32_t flags)
+{
+	if (!queue)
+		return;
 
-	return sig;
+	connect_callback(handler, signal, callback, data, queue, flags);
 }
 
 void signal_handler_disconnect(signal_handler_t handler, const char *signal,
 		signal_callback_t callback, void *data)
 {
-	struct signal_info *sig = getsignal_locked(handler, signal);
+	struct signal_info *sig;
+	struct signal_callbacks *old_list, *new_list = NULL;
+	struct queued_callback *queued;
 	size_t idx;
 
+	if (!handler)
+		return;
+
+	sig = getsignal(handler, signal);
 	if (!sig)
 		return;
 
 	pthread_mutex_lock(&sig->mutex);
 
-	idx = signal_get_callback_idx(sig, callback, data);
-	if (idx != DARRAY_INVALID)
-		da_erase(sig->callbacks, idx);
-	
+	old_list = sig->callbacks;
+	idx = signal_get_callback_idx(old_list, callback, data);
+
+	if (idx != DARRAY_INVALID) {
+		queued = old_list->array[idx].queued;
+
+		if (old_list->num > 1) {
+			new_list = alloc_callbacks(old_list->num - 1);
+			memcpy(new_list->array, old_list->array,
+					sizeof(struct signal_callback) * idx);
+			memcpy(new_list->array + idx, old_list->array + idx + 1,
+					sizeof(struct signal_callback) *
+					(old_list->num - idx - 1));
+		}
+
+		publish_callbacks(sig, new_list);
+
+		/* the callback must not be called once this returns, so wait
+		 * for any emitter that may still be using the old list */
+		wait_for_emitters(sig);
+
+		/* no emitter can queue new signals for it now, and the ones
+		 * that are already queued are dropped */
+		if (queued)
+			disconnect_queued(queued);
+
+		bfree(old_list);
+		free_retired_callbacks(sig);
+	}
+
 	pthread_mutex_unlock(&sig->mutex);
 }
 
 void signal_handler_signal(signal_handler_t handler, const char *signal,
 		calldata_t params)
 {
-	struct signal_info *sig = getsignal_locked(handler, signal);
+	struct signal_info *sig;
+	struct signal_callbacks *list;
+	long idx;
 
+	if (!handler)
+		return;
+
+	sig = getsignal(handler, signal);
 	if (!sig)
 		return;
 
-	pthread_mutex_lock(&sig->mutex);
+	idx = os_atomic_load_long(&sig->epoch);
+	os_atomic_inc_long(&sig->readers[idx]);
 
-	for (size_t i = 0; i < sig->callbacks.num; i++) {
-		struct signal_callback *cb = sig->callbacks.array+i;
-		cb->callback(cb->data, params);
+	list = get_callbacks(sig);
+	if (list) {
+		for (size_t i = 0; i < list->num; i++) {
+			struct signal_callback *cb = list->array+i;
+
+			if (cb->queued)
+				queue_signal(cb->queued, params);
+			else
+				cb->callback(cb->data, params);
+		}
 	}
 
-	pthread_mutex_unlock(&sig->mutex);
+	os_atomic_dec_long(&sig->readers[idx]);
 }
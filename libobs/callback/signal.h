@@ -57,12 +57,89 @@ static inline bool signal_handler_add_array(signal_handler_t handler,
 
 EXPORT void signal_handler_connect(signal_handler_t handler, const char *signal,
 		signal_callback_t callback, void *data);
+/**
+ * Disconnects a callback.  Once this returns the callback will not be called
+ * again, so this waits for any emission of the signal that is in progress on
+ * other threads.  Do not disconnect from a callback of the same signal.
+ */
 EXPORT void signal_handler_disconnect(signal_handler_t handler,
 		const char *signal, signal_callback_t callback, void *data);
 
 EXPORT void signal_handler_signal(signal_handler_t handler, const char *signal,
 		calldata_t params);
 
+/* ------------------------------------------------------------------------- */
+
+/*
+ * Signal queues
+ *
+ *   Callbacks are normally called on the thread that emits the signal, which
+ * can be the video thread or an output's thread.  A callback connected with
+ * signal_handler_connect_queued is called from a signal queue instead: the
+ * emitting thread only copies the parameters and pushes them on the queue
+ * without taking any locks.  The queue calls its callbacks either on its
+ * own thread, or when signal_queue_dispatch is called (for example by a UI
+ * thread, after the wakeup callback has told it to).
+ *
+ *   The parameters are copied when the signal is emitted, so queued
+ * callbacks can't return out-parameters.  Pointer parameters are passed
+ * through the hold callback of the queue, which can add a reference to the
+ * object so that it's still valid when the callback is called.
+ */
+
+struct signal_queue;
+typedef struct signal_queue *signal_queue_t;
+
+/**
+ * Called when a signal is queued, for each non-NULL pointer parameter.
+ * Returns false if the object can't be kept, in which case the callback gets
+ * NULL for it.  The release callback is called for each pointer that was
+ * kept once the callback has been called.
+ */
+typedef bool (*signal_hold_t)(const char *signal, const char *param,
+		void *ptr);
+typedef void (*signal_release_t)(const char *param, void *ptr);
+
+/** Called from an emitting thread when the empty queue gets a signal */
+typedef void (*signal_wakeup_t)(void *param);
+
+/** a queued signal replaces the parameters of one of the same callback that
+ * hasn't been called yet, for signals that are emitted often */
+#define SIGNAL_COALESCE (1<<0)
+
+/**
+ * Creates a signal queue.  If @dispatch_thread is true, the queue calls its
+ * callbacks on its own thread, otherwise they are called by
+ * signal_queue_dispatch.
+ */
+EXPORT signal_queue_t signal_queue_create(bool dispatch_thread);
+
+/**
+ * Destroys a signal queue.  Signals that are still queued are dropped.  All
+ * callbacks connected with the queue have to be disconnected first.
+ */
+EXPORT void signal_queue_destroy(signal_queue_t queue);
+
+EXPORT void signal_queue_set_hold(signal_queue_t queue, signal_hold_t hold,
+		signal_release_t release);
+EXPORT void signal_queue_set_wakeup(signal_queue_t queue,
+		signal_wakeup_t wakeup, void *param);
+
+/**
+ * Calls the callbacks of the signals queued so far on the calling thread,
+ * and returns how many were called.  Only for queues without a dispatch
+ * thread.
+ */
+EXPORT size_t signal_queue_dispatch(signal_queue_t queue);
+
+/**
+ * Connects a callback that's called from @queue.  Disconnect it with
+ * signal_handler_disconnect, which also drops its queued signals.
+ */
+EXPORT void signal_handler_connect_queued(signal_handler_t handler,
+		const char *signal, signal_callback_t callback, void *data,
+		signal_queue_t queue, uint32_t flags);
+
 #ifdef __cplusplus
 }
 #endif
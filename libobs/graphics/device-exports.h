@@ -50,6 +50,10 @@ EXPORT stagesurf_t device_create_stagesurface(device_t device, uint32_t width,
 		uint32_t height, enum gs_color_format color_format);
 EXPORT samplerstate_t device_create_samplerstate(device_t device,
 		struct gs_sampler_info *info);
+EXPORT gputimer_t device_create_timer(device_t device);
+EXPORT gputimer_range_t device_create_timer_range(device_t device);
+EXPORT device_t device_create_shared(device_t device);
+EXPORT gpufence_t device_create_fence(device_t device);
 EXPORT shader_t device_create_vertexshader(device_t device,
 		const char *shader, const char *file,
 		char **error_string);
@@ -93,6 +97,7 @@ EXPORT void device_load_swapchain(device_t device, swapchain_t swapchain);
 EXPORT void device_clear(device_t device, uint32_t clear_flags,
 		struct vec4 *color, float depth, uint8_t stencil);
 EXPORT void device_present(device_t device);
+EXPORT bool device_swapchain_ready(device_t device);
 EXPORT void device_setcullmode(device_t device, enum gs_cull_mode mode);
 EXPORT enum gs_cull_mode device_getcullmode(device_t device);
 EXPORT void device_enable_blending(device_t device, bool enable);
@@ -103,6 +108,9 @@ EXPORT void device_enable_color(device_t device, bool red, bool green,
 		bool blue, bool alpha);
 EXPORT void device_blendfunction(device_t device, enum gs_blend_type src,
 		enum gs_blend_type dest);
+EXPORT void device_blendfunction_separate(device_t device,
+		enum gs_blend_type src_c, enum gs_blend_type dest_c,
+		enum gs_blend_type src_a, enum gs_blend_type dest_a);
 EXPORT void device_depthfunction(device_t device, enum gs_depth_test test);
 EXPORT void device_stencilfunction(device_t device, enum gs_stencil_side side,
 		enum gs_depth_test test);
@@ -986,9 +986,8 @@ static inline void ep_write_param(struct dstr *shader, struct ep_param *param,
 	if (param->is_const) {
 		dstr_cat(shader, "const ");
 	} else if (param->is_uniform) {
-		struct dstr new;
-		dstr_init_copy(&new, param->name);
-		darray_push_back(sizeof(struct dstr), used_params, &new);
+		darray_push_back(sizeof(struct ep_param*), used_params,
+				&param);
 
 		dstr_cat(shader, "uniform ");
 	}
@@ -1290,8 +1289,9 @@ static void ep_compile_param(struct effect_parser *ep, size_t idx)
 	param_in = ep->params.array+idx;
 	param_in->param = param;
 
-	param->name    = bstrdup(param_in->name);
-	param->section = EFFECT_PARAM;
+	param->name      = bstrdup(param_in->name);
+	param->name_hash = hash_fnv1a(param->name);
+	param->section   = EFFECT_PARAM;
 	param->effect  = ep->effect;
 	da_move(param->default_val, param_in->default_val);
 
@@ -1318,34 +1318,46 @@ static void ep_compile_param(struct effect_parser *ep, size_t idx)
 		ep->effect->world = param;
 }
 
-static bool ep_compile_pass_shaderparams(struct effect_parser *ep,
-		struct darray *pass_params, struct darray *used_params,
-		shader_t shader)
+/* the effect params are known as soon as the shader string is made, the
+ * shader params only once the shader exists */
+static void ep_compile_pass_shaderparams(struct darray *pass_params,
+		struct darray *used_params)
 {
 	size_t i;
 	darray_resize(sizeof(struct pass_shaderparam), pass_params,
 			used_params->num);
 
 	for (i = 0; i < pass_params->num; i++) {
-		struct dstr *param_name;
+		struct ep_param **param_in;
 		struct pass_shaderparam *param;
 
-		param_name = darray_item(sizeof(struct dstr), used_params, i);
+		param_in = darray_item(sizeof(struct ep_param*), used_params,
+				i);
 		param = darray_item(sizeof(struct pass_shaderparam),
 				pass_params, i);
 
-		param->eparam = effect_getparambyname(ep->effect,
-				param_name->array);
-		param->sparam = shader_getparambyname(shader,
-				param_name->array);
-
-		if (!param->sparam) {
-			blog(LOG_ERROR, "Effect shader parameter not found");
-			return false;
-		}
+		/* params are compiled before techniques, so the effect param
+		 * is already known without looking it up by name */
+		param->eparam = (*param_in)->param;
+		param->sparam = NULL;
 	}
+}
 
-	return true;
+static void ep_defer_pass_shader(struct effect_parser *ep,
+		struct effect_pass *pass, enum shader_type type,
+		struct dstr *shader_str, struct dstr *location)
+{
+	struct effect_shader_job *job = da_push_back_new(
+			ep->effect->compile_jobs);
+
+	job->effect     = ep->effect;
+	job->pass       = pass;
+	job->type       = type;
+	job->shader_str = shader_str->array;
+	job->location   = location->array;
+
+	dstr_init(shader_str);
+	dstr_init(location);
 }
 
 static inline bool ep_compile_pass_shader(struct effect_parser *ep,
@@ -1355,7 +1367,7 @@ static inline bool ep_compile_pass_shader(struct effect_parser *ep,
 {
 	struct dstr shader_str;
 	struct dstr location;
-	struct darray used_params; /* struct dstr */
+	struct darray used_params; /* struct ep_param* */
 	struct darray *pass_params = NULL; /* struct pass_shaderparam */
 	shader_t shader = NULL;
 	bool success = true;
@@ -1378,20 +1390,10 @@ static inline bool ep_compile_pass_shader(struct effect_parser *ep,
 	if (type == SHADER_VERTEX) {
 		ep_makeshaderstring(ep, &shader_str,
 				&pass_in->vertex_program.da, &used_params);
-
-		pass->vertshader = gs_create_vertexshader(shader_str.array,
-				location.array, NULL);
-
-		shader = pass->vertshader;
 		pass_params = &pass->vertshader_params.da;
 	} else if (type == SHADER_PIXEL) {
 		ep_makeshaderstring(ep, &shader_str,
 				&pass_in->fragment_program.da, &used_params);
-
-		pass->pixelshader = gs_create_pixelshader(shader_str.array,
-				location.array, NULL);
-
-		shader = pass->pixelshader;
 		pass_params = &pass->pixelshader_params.da;
 	}
 
@@ -1401,14 +1403,27 @@ static inline bool ep_compile_pass_shader(struct effect_parser *ep,
 	blog(LOG_DEBUG, "%s", shader_str.array);
 	blog(LOG_DEBUG, "+++++++++++++++++++++++++++++++++++");
 
-	if (shader)
-		success = ep_compile_pass_shaderparams(ep, pass_params,
-				&used_params, shader);
-	else
-		success = false;
+	ep_compile_pass_shaderparams(pass_params, &used_params);
+
+	if (ep->defer_shaders) {
+		ep_defer_pass_shader(ep, pass, type, &shader_str, &location);
+
+	} else {
+		if (type == SHADER_VERTEX) {
+			shader = gs_create_vertexshader(shader_str.array,
+					location.array, NULL);
+			pass->vertshader = shader;
+		} else if (type == SHADER_PIXEL) {
+			shader = gs_create_pixelshader(shader_str.array,
+					location.array, NULL);
+			pass->pixelshader = shader;
+		}
+
+		success = shader &&
+			effect_link_shader_params(pass_params, shader);
+	}
 
 	dstr_free(&location);
-	dstr_array_free(used_params.array, used_params.num);
 	darray_free(&used_params);
 	dstr_free(&shader_str);
 
@@ -1452,6 +1467,7 @@ static inline bool ep_compile_technique(struct effect_parser *ep, size_t idx)
 	tech_in = ep->techniques.array+idx;
 
 	tech->name = bstrdup(tech_in->name);
+	tech->name_hash = hash_fnv1a(tech->name);
 	tech->section = EFFECT_TECHNIQUE;
 	tech->effect = ep->effect;
 
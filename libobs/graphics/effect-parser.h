@@ -251,6 +251,10 @@ struct effect_parser {
 	DARRAY(struct ep_sampler)   samplers;
 	DARRAY(struct ep_technique) techniques;
 
+	/* pass shaders are added to the compile jobs of the effect instead of
+	 * being created while parsing */
+	bool defer_shaders;
+
 	/* internal vars */
 	DARRAY(struct cf_lexer) files;
 	DARRAY(struct cf_token) tokens;
@@ -270,6 +274,7 @@ static inline void ep_init(struct effect_parser *ep)
 	da_init(ep->tokens);
 
 	ep->cur_pass = NULL;
+	ep->defer_shaders = false;
 	cf_parser_init(&ep->cfp);
 }
 
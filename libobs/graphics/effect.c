@@ -24,6 +24,7 @@
 void effect_destroy(effect_t effect)
 {
 	if (effect) {
+		effect_cancel_shaders(effect);
 		effect_free(effect);
 		bfree(effect);
 	}
@@ -31,11 +32,13 @@ void effect_destroy(effect_t effect)
 
 technique_t effect_gettechnique(effect_t effect, const char *name)
 {
-	if (!effect) return NULL;
+	if (!effect || !name) return NULL;
+
+	uint32_t hash = hash_fnv1a(name);
 
 	for (size_t i = 0; i < effect->techniques.num; i++) {
 		struct effect_technique *tech = effect->techniques.array+i;
-		if (strcmp(tech->name, name) == 0)
+		if (tech->name_hash == hash && strcmp(tech->name, name) == 0)
 			return tech;
 	}
 
@@ -46,12 +49,34 @@ size_t technique_begin(technique_t tech)
 {
 	if (!tech) return 0;
 
+	/* an effect whose shaders failed has nothing to draw with */
+	if (!effect_finish_shaders(tech->effect))
+		return 0;
+
 	tech->effect->cur_technique = tech;
 	tech->effect->graphics->cur_effect = tech->effect;
 
 	return tech->passes.num;
 }
 
+bool effect_link_shader_params(struct darray *pass_params, shader_t shader)
+{
+	for (size_t i = 0; i < pass_params->num; i++) {
+		struct pass_shaderparam *param = darray_item(
+				sizeof(struct pass_shaderparam), pass_params, i);
+
+		param->sparam = shader_getparambyname(shader,
+				param->eparam->name);
+
+		if (!param->sparam) {
+			blog(LOG_ERROR, "Effect shader parameter not found");
+			return false;
+		}
+	}
+
+	return true;
+}
+
 void technique_end(technique_t tech)
 {
 	if (!tech) return;
@@ -215,20 +240,35 @@ eparam_t effect_getparambyidx(effect_t effect, size_t param)
 
 eparam_t effect_getparambyname(effect_t effect, const char *name)
 {
-	if (!effect) return NULL;
+	if (!effect || !name) return NULL;
 
 	struct effect_param *params = effect->params.array;
+	uint32_t hash = hash_fnv1a(name);
 
 	for (size_t i = 0; i < effect->params.num; i++) {
 		struct effect_param *param = params+i;
 
-		if (strcmp(param->name, name) == 0)
+		if (param->name_hash == hash && strcmp(param->name, name) == 0)
 			return param;
 	}
 
 	return NULL;
 }
 
+bool effect_getparams(effect_t effect, const char *const *names,
+		eparam_t *params, size_t num)
+{
+	bool found_all = true;
+
+	for (size_t i = 0; i < num; i++) {
+		params[i] = effect_getparambyname(effect, names[i]);
+		if (!params[i])
+			found_all = false;
+	}
+
+	return found_all;
+}
+
 static inline bool matching_effect(effect_t effect, eparam_t param)
 {
 	if (effect != param->effect) {
@@ -345,6 +385,16 @@ void effect_setval(effect_t effect, eparam_t param, const void *val,
 	effect_setval_inline(effect, param, val, size);
 }
 
+void effect_setfloats(effect_t effect, const eparam_t *params,
+		const float *vals, size_t num)
+{
+	for (size_t i = 0; i < num; i++) {
+		if (params[i])
+			effect_setval_inline(effect, params[i], vals+i,
+					sizeof(float));
+	}
+}
+
 void effect_setdefault(effect_t effect, eparam_t param)
 {
 	effect_setval_inline(effect, param, param->default_val.array,
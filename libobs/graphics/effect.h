@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include "../util/threading.h"
+#include "../util/hash.h"
 #include "effect-parser.h"
 #include "graphics.h"
 
@@ -48,6 +50,7 @@ enum effect_section {
 
 struct effect_param {
 	char *name;
+	uint32_t name_hash;
 	enum effect_section section;
 
 	enum shader_param_type type;
@@ -113,6 +116,7 @@ static inline void effect_pass_free(struct effect_pass *pass)
 
 struct effect_technique {
 	char *name;
+	uint32_t name_hash;
 	enum effect_section section;
 	struct gs_effect *effect;
 
@@ -135,6 +139,20 @@ static inline void effect_technique_free(struct effect_technique *t)
 
 /* ------------------------------------------------------------------------- */
 
+/* a pass shader waiting to be compiled by the compile threads of the
+ * graphics context, see shader-compile.c */
+struct effect_shader_job {
+	struct gs_effect   *effect;
+	struct effect_pass *pass;
+	enum shader_type   type;
+	char               *shader_str;
+	char               *location;
+
+	/* filled in by the thread that compiled it */
+	shader_t           shader;
+	gpufence_t         fence;
+};
+
 struct gs_effect {
 	bool processing;
 	char *effect_path, *effect_dir;
@@ -147,6 +165,15 @@ struct gs_effect {
 
 	eparam_t view_proj, world, scale;
 	graphics_t graphics;
+
+	/* shaders are compiled in the background unless an error string is
+	 * wanted, and the effect waits on them the first time a technique
+	 * is used */
+	DARRAY(struct effect_shader_job) compile_jobs;
+	volatile long compile_pending;
+	os_event_t compile_event;
+	bool compile_queued;
+	bool compile_failed;
 };
 
 static inline void effect_init(effect_t effect)
@@ -172,6 +199,23 @@ static inline void effect_free(effect_t effect)
 }
 
 EXPORT void effect_upload_params(effect_t effect, bool changed_only);
+
+/* looks up the shader params of a pass, whose effect params are already
+ * known */
+extern bool effect_link_shader_params(struct darray *pass_params,
+		shader_t shader);
+
+/* hands the compile jobs of a parsed effect to the compile threads */
+extern void effect_queue_shaders(effect_t effect);
+
+/* waits for the shaders of the effect (compiling the ones no thread has
+ * started yet) and puts them in its passes.  returns false if any of them
+ * failed */
+extern bool effect_finish_shaders(effect_t effect);
+
+/* waits for the compile threads to let go of the effect, without compiling
+ * what's left */
+extern void effect_cancel_shaders(effect_t effect);
 EXPORT void effect_upload_shader_params(effect_t effect, shader_t shader,
 		struct darray *pass_params, bool changed_only);
 
@@ -0,0 +1,275 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "graphics.h"
+#include "../util/base.h"
+#include "../util/bmem.h"
+#include "../util/threading.h"
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+
+static pthread_once_t av_register_once = PTHREAD_ONCE_INIT;
+
+static void register_formats(void)
+{
+	av_register_all();
+}
+
+struct ffmpeg_image {
+	const char         *file;
+	AVFormatContext    *fmt_ctx;
+	AVCodecContext     *decoder_ctx;
+	AVCodec            *decoder;
+	AVStream           *stream;
+	int                stream_idx;
+
+	int                cx, cy;
+	enum AVPixelFormat format;
+};
+
+static bool ffmpeg_image_open_decoder_context(struct ffmpeg_image *info)
+{
+	int ret = av_find_best_stream(info->fmt_ctx, AVMEDIA_TYPE_VIDEO,
+			-1, 1, NULL, 0);
+	if (ret < 0) {
+		blog(LOG_WARNING, "Couldn't find video stream in file '%s': %d",
+				info->file, ret);
+		return false;
+	}
+
+	info->stream_idx  = ret;
+	info->stream      = info->fmt_ctx->streams[ret];
+	info->decoder_ctx = info->stream->codec;
+	info->decoder     = avcodec_find_decoder(info->decoder_ctx->codec_id);
+
+	if (!info->decoder) {
+		blog(LOG_WARNING, "Failed to find decoder for file '%s'",
+				info->file);
+		return false;
+	}
+
+	ret = avcodec_open2(info->decoder_ctx, info->decoder, NULL);
+	if (ret < 0) {
+		blog(LOG_WARNING, "Failed to open video codec for file '%s': "
+		                  "%d", info->file, ret);
+		return false;
+	}
+
+	return true;
+}
+
+static void ffmpeg_image_free(struct ffmpeg_image *info)
+{
+	avcodec_close(info->decoder_ctx);
+	avformat_close_input(&info->fmt_ctx);
+}
+
+static bool ffmpeg_image_init(struct ffmpeg_image *info, const char *file)
+{
+	int ret;
+
+	if (!file || !*file)
+		return false;
+
+	memset(info, 0, sizeof(struct ffmpeg_image));
+	info->file       = file;
+	info->stream_idx = -1;
+
+	ret = avformat_open_input(&info->fmt_ctx, file, NULL, NULL);
+	if (ret < 0) {
+		blog(LOG_WARNING, "Failed to open file '%s': %d", file, ret);
+		return false;
+	}
+
+	ret = avformat_find_stream_info(info->fmt_ctx, NULL);
+	if (ret < 0) {
+		blog(LOG_WARNING, "Could not find stream info for file '%s': %d",
+				file, ret);
+		goto fail;
+	}
+
+	if (!ffmpeg_image_open_decoder_context(info))
+		goto fail;
+
+	info->cx     = info->decoder_ctx->width;
+	info->cy     = info->decoder_ctx->height;
+	info->format = info->decoder_ctx->pix_fmt;
+	return true;
+
+fail:
+	ffmpeg_image_free(info);
+	return false;
+}
+
+static bool ffmpeg_image_reformat_frame(struct ffmpeg_image *info,
+		AVFrame *frame, uint8_t *out, int linesize)
+{
+	struct SwsContext *sws_ctx = NULL;
+	int               ret      = 0;
+
+	if (info->format == AV_PIX_FMT_RGBA ||
+	    info->format == AV_PIX_FMT_BGRA ||
+	    info->format == AV_PIX_FMT_BGR0) {
+
+		if (linesize != frame->linesize[0]) {
+			int min_line = linesize < frame->linesize[0] ?
+				linesize : frame->linesize[0];
+
+			for (int y = 0; y < info->cy; y++)
+				memcpy(out + y * linesize,
+				       frame->data[0] + y * frame->linesize[0],
+				       min_line);
+		} else {
+			memcpy(out, frame->data[0], linesize * info->cy);
+		}
+
+	} else {
+		sws_ctx = sws_getContext(info->cx, info->cy, info->format,
+				info->cx, info->cy, AV_PIX_FMT_BGRA,
+				SWS_POINT, NULL, NULL, NULL);
+		if (!sws_ctx) {
+			blog(LOG_WARNING, "Failed to create scale context "
+			                  "for '%s'", info->file);
+			return false;
+		}
+
+		ret = sws_scale(sws_ctx, (const uint8_t *const*)frame->data,
+				frame->linesize, 0, info->cy, &out, &linesize);
+		sws_freeContext(sws_ctx);
+
+		if (ret < 0) {
+			blog(LOG_WARNING, "sws_scale failed for '%s': %d",
+					info->file, ret);
+			return false;
+		}
+
+		info->format = AV_PIX_FMT_BGRA;
+	}
+
+	return true;
+}
+
+static bool ffmpeg_image_decode(struct ffmpeg_image *info, uint8_t *out,
+		int linesize)
+{
+	AVPacket packet    = {0};
+	bool     success   = false;
+	AVFrame  *frame    = av_frame_alloc();
+	int      got_frame = 0;
+	int      ret;
+
+	if (!frame) {
+		blog(LOG_WARNING, "Failed to create frame data for '%s'",
+				info->file);
+		return false;
+	}
+
+	ret = av_read_frame(info->fmt_ctx, &packet);
+	if (ret < 0) {
+		blog(LOG_WARNING, "Failed to read image frame from '%s': %d",
+				info->file, ret);
+		goto fail;
+	}
+
+	while (!got_frame) {
+		ret = avcodec_decode_video2(info->decoder_ctx, frame,
+				&got_frame, &packet);
+		if (ret < 0) {
+			blog(LOG_WARNING, "Failed to decode frame for '%s': %d",
+					info->file, ret);
+			goto fail;
+		}
+
+		/* some decoders need an empty packet to flush the frame */
+		if (!got_frame) {
+			av_free_packet(&packet);
+			av_init_packet(&packet);
+			packet.data = NULL;
+			packet.size = 0;
+
+			ret = avcodec_decode_video2(info->decoder_ctx, frame,
+					&got_frame, &packet);
+			if (ret < 0 || !got_frame)
+				goto fail;
+		}
+	}
+
+	success = ffmpeg_image_reformat_frame(info, frame, out, linesize);
+
+fail:
+	av_free_packet(&packet);
+	av_frame_free(&frame);
+	return success;
+}
+
+static inline enum gs_color_format convert_format(enum AVPixelFormat format)
+{
+	switch ((int)format) {
+	case AV_PIX_FMT_RGBA: return GS_RGBA;
+	case AV_PIX_FMT_BGRA: return GS_BGRA;
+	case AV_PIX_FMT_BGR0: return GS_BGRX;
+	}
+
+	return GS_BGRX;
+}
+
+uint8_t *gs_create_texture_file_data(const char *file,
+		enum gs_color_format *format,
+		uint32_t *cx_out, uint32_t *cy_out)
+{
+	struct ffmpeg_image image;
+	uint8_t *data = NULL;
+
+	pthread_once(&av_register_once, register_formats);
+
+	if (ffmpeg_image_init(&image, file)) {
+		data = bmalloc(image.cx * image.cy * 4);
+
+		if (ffmpeg_image_decode(&image, data, image.cx * 4)) {
+			*format = convert_format(image.format);
+			*cx_out = (uint32_t)image.cx;
+			*cy_out = (uint32_t)image.cy;
+		} else {
+			bfree(data);
+			data = NULL;
+		}
+
+		ffmpeg_image_free(&image);
+	}
+
+	return data;
+}
+
+texture_t gs_create_texture_from_file(const char *file, uint32_t flags)
+{
+	enum gs_color_format format;
+	uint32_t             cx;
+	uint32_t             cy;
+	uint8_t              *data = gs_create_texture_file_data(file, &format,
+	                                                         &cx, &cy);
+	texture_t            tex = NULL;
+
+	if (data) {
+		tex = gs_create_texture(cx, cy, format, 1,
+				(const void**)&data, flags);
+		bfree(data);
+	}
+
+	return tex;
+}
@@ -83,6 +83,7 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT(device_endscene);
 	GRAPHICS_IMPORT(device_clear);
 	GRAPHICS_IMPORT(device_present);
+	GRAPHICS_IMPORT_OPTIONAL(device_swapchain_ready);
 	GRAPHICS_IMPORT(device_setcullmode);
 	GRAPHICS_IMPORT(device_getcullmode);
 	GRAPHICS_IMPORT(device_enable_blending);
@@ -91,6 +92,7 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT(device_enable_stencilwrite);
 	GRAPHICS_IMPORT(device_enable_color);
 	GRAPHICS_IMPORT(device_blendfunction);
+	GRAPHICS_IMPORT(device_blendfunction_separate);
 	GRAPHICS_IMPORT(device_depthfunction);
 	GRAPHICS_IMPORT(device_stencilfunction);
 	GRAPHICS_IMPORT(device_stencilop);
@@ -117,6 +119,7 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT(texture_unmap);
 	GRAPHICS_IMPORT_OPTIONAL(texture_isrect);
 	GRAPHICS_IMPORT(texture_getobj);
+	GRAPHICS_IMPORT_OPTIONAL(texture_setimage_region);
 
 	GRAPHICS_IMPORT(cubetexture_destroy);
 	GRAPHICS_IMPORT(cubetexture_getsize);
@@ -132,6 +135,7 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT(stagesurface_getwidth);
 	GRAPHICS_IMPORT(stagesurface_getheight);
 	GRAPHICS_IMPORT(stagesurface_getcolorformat);
+	GRAPHICS_IMPORT(stagesurface_isready);
 	GRAPHICS_IMPORT(stagesurface_map);
 	GRAPHICS_IMPORT(stagesurface_unmap);
 
@@ -141,6 +145,7 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 
 	GRAPHICS_IMPORT(vertexbuffer_destroy);
 	GRAPHICS_IMPORT(vertexbuffer_flush);
+	GRAPHICS_IMPORT_OPTIONAL(vertexbuffer_flush_range);
 	GRAPHICS_IMPORT(vertexbuffer_getdata);
 
 	GRAPHICS_IMPORT(indexbuffer_destroy);
@@ -149,6 +154,22 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT(indexbuffer_numindices);
 	GRAPHICS_IMPORT(indexbuffer_gettype);
 
+	GRAPHICS_IMPORT_OPTIONAL(device_create_timer);
+	GRAPHICS_IMPORT_OPTIONAL(gputimer_destroy);
+	GRAPHICS_IMPORT_OPTIONAL(gputimer_begin);
+	GRAPHICS_IMPORT_OPTIONAL(gputimer_end);
+	GRAPHICS_IMPORT_OPTIONAL(gputimer_get_data);
+	GRAPHICS_IMPORT_OPTIONAL(device_create_timer_range);
+	GRAPHICS_IMPORT_OPTIONAL(gputimer_range_destroy);
+	GRAPHICS_IMPORT_OPTIONAL(gputimer_range_begin);
+	GRAPHICS_IMPORT_OPTIONAL(gputimer_range_end);
+	GRAPHICS_IMPORT_OPTIONAL(gputimer_range_get_data);
+
+	GRAPHICS_IMPORT_OPTIONAL(device_create_shared);
+	GRAPHICS_IMPORT_OPTIONAL(device_create_fence);
+	GRAPHICS_IMPORT_OPTIONAL(gpufence_destroy);
+	GRAPHICS_IMPORT_OPTIONAL(gpufence_wait);
+
 	GRAPHICS_IMPORT(shader_destroy);
 	GRAPHICS_IMPORT(shader_numparams);
 	GRAPHICS_IMPORT(shader_getparambyidx);
@@ -179,6 +200,21 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT_OPTIONAL(device_create_gdi_texture);
 	GRAPHICS_IMPORT_OPTIONAL(texture_get_dc);
 	GRAPHICS_IMPORT_OPTIONAL(texture_release_dc);
+	GRAPHICS_IMPORT_OPTIONAL(device_texture_open_shared);
+	GRAPHICS_IMPORT_OPTIONAL(device_duplicator_create);
+	GRAPHICS_IMPORT_OPTIONAL(duplicator_destroy);
+	GRAPHICS_IMPORT_OPTIONAL(duplicator_update_frame);
+	GRAPHICS_IMPORT_OPTIONAL(duplicator_gettexture);
+	GRAPHICS_IMPORT_OPTIONAL(duplicator_getcursor);
+	GRAPHICS_IMPORT_OPTIONAL(device_create_deferred);
+	GRAPHICS_IMPORT_OPTIONAL(device_finish_commandlist);
+	GRAPHICS_IMPORT_OPTIONAL(device_execute_commandlist);
+	GRAPHICS_IMPORT_OPTIONAL(commandlist_destroy);
+
+	/* X11 specific functions */
+#elif defined(__linux__)
+	GRAPHICS_IMPORT_OPTIONAL(device_create_texture_from_pixmap);
+	GRAPHICS_IMPORT_OPTIONAL(texture_rebind_pixmap);
 #endif
 
 	return success;
@@ -100,6 +100,7 @@ struct gs_exports {
 	void (*device_clear)(device_t device, uint32_t clear_flags,
 			struct vec4 *color, float depth, uint8_t stencil);
 	void (*device_present)(device_t device);
+	bool (*device_swapchain_ready)(device_t device);
 	void (*device_setcullmode)(device_t device, enum gs_cull_mode mode);
 	enum gs_cull_mode (*device_getcullmode)(device_t device);
 	void (*device_enable_blending)(device_t device, bool enable);
@@ -110,6 +111,9 @@ struct gs_exports {
 			bool blue, bool alpha);
 	void (*device_blendfunction)(device_t device, enum gs_blend_type src,
 			enum gs_blend_type dest);
+	void (*device_blendfunction_separate)(device_t device,
+			enum gs_blend_type src_c, enum gs_blend_type dest_c,
+			enum gs_blend_type src_a, enum gs_blend_type dest_a);
 	void (*device_depthfunction)(device_t device, enum gs_depth_test test);
 	void (*device_stencilfunction)(device_t device,
 			enum gs_stencil_side side, enum gs_depth_test test);
@@ -146,6 +150,9 @@ struct gs_exports {
 	void     (*texture_unmap)(texture_t tex);
 	bool     (*texture_isrect)(texture_t tex);
 	void    *(*texture_getobj)(texture_t tex);
+	bool     (*texture_setimage_region)(texture_t tex,
+			uint32_t x, uint32_t y, uint32_t cx, uint32_t cy,
+			const void *data, uint32_t linesize);
 
 	void     (*cubetexture_destroy)(texture_t cubetex);
 	uint32_t (*cubetexture_getsize)(texture_t cubetex);
@@ -162,6 +169,7 @@ struct gs_exports {
 	uint32_t (*stagesurface_getheight)(stagesurf_t stagesurf);
 	enum gs_color_format (*stagesurface_getcolorformat)(
 			stagesurf_t stagesurf);
+	bool     (*stagesurface_isready)(stagesurf_t stagesurf);
 	bool     (*stagesurface_map)(stagesurf_t stagesurf,
 			uint8_t **data, uint32_t *linesize);
 	void     (*stagesurface_unmap)(stagesurf_t stagesurf);
@@ -172,6 +180,8 @@ struct gs_exports {
 
 	void (*vertexbuffer_destroy)(vertbuffer_t vertbuffer);
 	void (*vertexbuffer_flush)(vertbuffer_t vertbuffer, bool rebuild);
+	void (*vertexbuffer_flush_range)(vertbuffer_t vertbuffer,
+			size_t start, size_t num, bool discard);
 	struct vb_data *(*vertexbuffer_getdata)(vertbuffer_t vertbuffer);
 
 	void   (*indexbuffer_destroy)(indexbuffer_t indexbuffer);
@@ -180,6 +190,24 @@ struct gs_exports {
 	size_t (*indexbuffer_numindices)(indexbuffer_t indexbuffer);
 	enum gs_index_type (*indexbuffer_gettype)(indexbuffer_t indexbuffer);
 
+	gputimer_t (*device_create_timer)(device_t device);
+	void (*gputimer_destroy)(gputimer_t timer);
+	void (*gputimer_begin)(gputimer_t timer);
+	void (*gputimer_end)(gputimer_t timer);
+	bool (*gputimer_get_data)(gputimer_t timer, uint64_t *ticks);
+
+	gputimer_range_t (*device_create_timer_range)(device_t device);
+	void (*gputimer_range_destroy)(gputimer_range_t range);
+	void (*gputimer_range_begin)(gputimer_range_t range);
+	void (*gputimer_range_end)(gputimer_range_t range);
+	bool (*gputimer_range_get_data)(gputimer_range_t range,
+			bool *disjoint, uint64_t *frequency);
+
+	device_t (*device_create_shared)(device_t device);
+	gpufence_t (*device_create_fence)(device_t device);
+	void (*gpufence_destroy)(gpufence_t fence);
+	void (*gpufence_wait)(gpufence_t fence);
+
 	void (*shader_destroy)(shader_t shader);
 	int (*shader_numparams)(shader_t shader);
 	sparam_t (*shader_getparambyidx)(shader_t shader, uint32_t param);
@@ -219,32 +247,159 @@ struct gs_exports {
 
 	void *(*texture_get_dc)(texture_t gdi_tex);
 	void (*texture_release_dc)(texture_t gdi_tex);
+
+	texture_t (*device_texture_open_shared)(device_t device,
+			uint32_t handle);
+
+	duplicator_t (*device_duplicator_create)(device_t device,
+			void *monitor);
+	void (*duplicator_destroy)(duplicator_t duplicator);
+	bool (*duplicator_update_frame)(duplicator_t duplicator);
+	texture_t (*duplicator_gettexture)(duplicator_t duplicator);
+	texture_t (*duplicator_getcursor)(duplicator_t duplicator,
+			int32_t *x, int32_t *y);
+
+	device_t (*device_create_deferred)(device_t device);
+	commandlist_t (*device_finish_commandlist)(device_t device);
+	void (*device_execute_commandlist)(device_t device,
+			commandlist_t list);
+	void (*commandlist_destroy)(commandlist_t list);
+
+#elif defined(__linux__)
+	texture_t (*device_create_texture_from_pixmap)(device_t device,
+			unsigned long pixmap, bool *flip);
+	bool (*texture_rebind_pixmap)(texture_t texture);
 #endif
 };
 
+struct blend_state {
+	bool                   enabled;
+	bool                   separate;
+	enum gs_blend_type     src_c;
+	enum gs_blend_type     dest_c;
+	enum gs_blend_type     src_a;
+	enum gs_blend_type     dest_a;
+};
+
+#define SPRITE_BATCH_COUNT 256
+
+struct sprite_batch_run {
+	texture_t              tex;
+	uint32_t               start;
+	uint32_t               count;
+};
+
+struct sprite_batch {
+	bool                   active;
+	bool                   flushing;
+	struct gs_effect       *effect;
+	struct effect_param    *image;
+	struct effect_technique *tech;
+
+	vertbuffer_t           buffer;
+	uint32_t               count;
+	DARRAY(struct sprite_batch_run) runs;
+};
+
+struct sprite_crop {
+	bool                   active;
+	texture_t              target;
+	float                  left, top, right, bottom;
+};
+
+struct gs_ortho_area {
+	bool                   valid;
+	float                  left, right, top, bottom;
+};
+
 struct graphics_subsystem {
 	void                   *module;
 	device_t               device;
 	struct gs_exports      exports;
 
+	/* for deferred and shared contexts, the context they record for or
+	 * share objects with.  the module belongs to that one */
+	struct graphics_subsystem *parent;
+
 	DARRAY(struct gs_rect) viewport_stack;
 
 	DARRAY(struct matrix3) matrix_stack;
 	size_t                 cur_matrix;
 
 	struct matrix4         projection;
+
+	/* the area of the current projection if it's orthographic, kept
+	 * along with the device's projection stack */
+	struct gs_ortho_area   ortho;
+	DARRAY(struct gs_ortho_area) ortho_stack;
 	struct gs_effect       *cur_effect;
 
-	vertbuffer_t           sprite_buffer;
+	struct blend_state     cur_blend_state;
+	DARRAY(struct blend_state) blend_state_stack;
+
+	struct sprite_batch    sprite_batch;
+	struct sprite_crop     sprite_crop;
 
 	bool                   using_immediate;
 	struct vb_data         *vbd;
 	vertbuffer_t           immediate_vertbuffer;
+	size_t                 immediate_pos;
+	bool                   immediate_discard;
 	DARRAY(struct vec3)    verts;
 	DARRAY(struct vec3)    norms;
 	DARRAY(uint32_t)       colors;
 	DARRAY(struct vec2)    texverts[16];
 
+	char                   *shader_cache_path;
+
+	/* effect shader compile threads of a main context, started when the
+	 * first effect is created, see shader-compile.c */
+	pthread_mutex_t        compile_mutex;
+	os_sem_t               compile_sem;
+	DARRAY(struct effect_shader_job*) compile_queue;
+	DARRAY(pthread_t)      compile_threads;
+	bool                   compile_started;
+	bool                   compile_stop;
+
+	DARRAY(struct gs_texture_render*) texrender_pool;
+	gs_memory_owner_t      texrender_pool_owner;
+
 	pthread_mutex_t        mutex;
 	volatile long          ref;
 };
+
+/* destroys the pooled render targets, called with the device context
+ * entered */
+extern void texrender_pool_free(struct graphics_subsystem *graphics);
+
+/* creates the context a compile thread creates shaders on: a shared context
+ * if the module supports them, otherwise a deferred one.  D3D11 creates
+ * shaders directly on its free-threaded device, so a deferred context works
+ * just as well */
+extern int gs_create_compile_context(graphics_t parent, graphics_t *pchild);
+
+/* starts the compile threads of @graphics if they aren't running yet, and
+ * returns whether effect shaders can be compiled on them */
+extern bool gs_can_compile_shaders_async(struct graphics_subsystem *graphics);
+
+/* stops the compile threads, shaders they haven't started on are compiled
+ * by whoever waits on them */
+extern void gs_stop_shader_compile(struct graphics_subsystem *graphics);
+
+/* memory accounting, see graphics-memory.c */
+enum gs_resource_type {
+	GS_RESOURCE_TEXTURE,
+	GS_RESOURCE_STAGESURF,
+	GS_RESOURCE_ZSTENCIL,
+	GS_RESOURCE_VERTBUFFER,
+	GS_RESOURCE_TEXRENDER
+};
+
+extern void gs_memory_track(const void *resource, enum gs_resource_type type,
+		uint64_t bytes);
+extern void gs_memory_untrack(const void *resource);
+
+extern uint64_t gs_texture_memory_size(uint32_t width, uint32_t height,
+		uint32_t depth, enum gs_color_format format, uint32_t levels,
+		uint32_t flags);
+extern uint64_t gs_vertbuffer_memory_size(const struct vb_data *data);
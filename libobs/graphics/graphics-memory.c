@@ -0,0 +1,250 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ *   Keeps track of the GPU memory used by textures, stage surfaces, zstencil
+ * buffers, vertex buffers and texture renderers.  Every resource is counted
+ * towards the memory owner that was current on the thread that created it,
+ * until the resource is destroyed.  Sizes are estimated from the dimensions
+ * and format of the resources, the drivers may use more.
+ */
+
+#include "../util/bmem.h"
+#include "../util/threading.h"
+#include "graphics-internal.h"
+
+struct gs_memory_owner {
+	struct gs_memory_usage usage;
+};
+
+struct tracked_resource {
+	const void             *resource;
+	struct gs_memory_owner *owner;
+	enum gs_resource_type  type;
+	uint64_t               bytes;
+};
+
+#ifdef _MSC_VER
+static __declspec(thread) struct gs_memory_owner *thread_owner = NULL;
+#else
+static __thread struct gs_memory_owner *thread_owner = NULL;
+#endif
+
+/* sorted by resource pointer */
+static pthread_mutex_t                resources_mutex =
+	PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(struct tracked_resource) resources;
+static struct gs_memory_usage          total_usage;
+
+static size_t find_resource(const void *resource, bool *found)
+{
+	size_t low  = 0;
+	size_t high = resources.num;
+
+	while (low < high) {
+		size_t mid = (low + high) / 2;
+		const void *cur = resources.array[mid].resource;
+
+		if (cur == resource) {
+			*found = true;
+			return mid;
+		}
+
+		if ((uintptr_t)cur < (uintptr_t)resource)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	*found = false;
+	return low;
+}
+
+static void add_usage(struct gs_memory_usage *usage,
+		enum gs_resource_type type, uint64_t bytes, bool add)
+{
+	uint32_t *count = NULL;
+
+	switch (type) {
+	case GS_RESOURCE_TEXTURE:       count = &usage->textures;       break;
+	case GS_RESOURCE_STAGESURF:     count = &usage->stage_surfaces; break;
+	case GS_RESOURCE_ZSTENCIL:      count = &usage->zstencils;      break;
+	case GS_RESOURCE_VERTBUFFER:    count = &usage->vertex_buffers; break;
+	case GS_RESOURCE_TEXRENDER:     count = &usage->texrenders;     break;
+	}
+
+	if (add) {
+		usage->bytes += bytes;
+		(*count)++;
+	} else {
+		usage->bytes -= bytes;
+		(*count)--;
+	}
+}
+
+void gs_memory_track(const void *resource, enum gs_resource_type type,
+		uint64_t bytes)
+{
+	struct tracked_resource tracked = {resource, thread_owner, type, bytes};
+	size_t idx;
+	bool   found;
+
+	if (!resource)
+		return;
+
+	pthread_mutex_lock(&resources_mutex);
+
+	idx = find_resource(resource, &found);
+	if (!found) {
+		da_insert(resources, idx, &tracked);
+
+		add_usage(&total_usage, type, bytes, true);
+		if (tracked.owner)
+			add_usage(&tracked.owner->usage, type, bytes, true);
+	}
+
+	pthread_mutex_unlock(&resources_mutex);
+}
+
+void gs_memory_untrack(const void *resource)
+{
+	struct tracked_resource *tracked;
+	size_t idx;
+	bool   found;
+
+	if (!resource)
+		return;
+
+	pthread_mutex_lock(&resources_mutex);
+
+	idx = find_resource(resource, &found);
+	if (found) {
+		tracked = resources.array+idx;
+
+		add_usage(&total_usage, tracked->type, tracked->bytes, false);
+		if (tracked->owner)
+			add_usage(&tracked->owner->usage, tracked->type,
+					tracked->bytes, false);
+
+		da_erase(resources, idx);
+		if (!resources.num)
+			da_free(resources);
+	}
+
+	pthread_mutex_unlock(&resources_mutex);
+}
+
+uint64_t gs_texture_memory_size(uint32_t width, uint32_t height,
+		uint32_t depth, enum gs_color_format format, uint32_t levels,
+		uint32_t flags)
+{
+	uint64_t bytes = (uint64_t)width * height * depth *
+		gs_get_format_bpp(format) / 8;
+
+	/* a full mip chain is a third bigger */
+	if (levels != 1 || (flags & GS_BUILDMIPMAPS) != 0)
+		bytes += bytes / 3;
+
+	return bytes;
+}
+
+uint64_t gs_vertbuffer_memory_size(const struct vb_data *data)
+{
+	uint64_t vertex_size = 0;
+
+	if (!data)
+		return 0;
+
+	if (data->points)   vertex_size += sizeof(struct vec3);
+	if (data->normals)  vertex_size += sizeof(struct vec3);
+	if (data->tangents) vertex_size += sizeof(struct vec3);
+	if (data->colors)   vertex_size += sizeof(uint32_t);
+
+	for (size_t i = 0; i < data->num_tex; i++)
+		vertex_size += data->tvarray[i].width * sizeof(float);
+
+	return vertex_size * data->num;
+}
+
+/* ------------------------------------------------------------------------- */
+
+gs_memory_owner_t gs_memory_owner_create(void)
+{
+	return bzalloc(sizeof(struct gs_memory_owner));
+}
+
+void gs_memory_owner_destroy(gs_memory_owner_t owner)
+{
+	size_t leaked = 0;
+
+	if (!owner)
+		return;
+
+	/* resources that outlive their owner are only counted in the total
+	 * from then on */
+	pthread_mutex_lock(&resources_mutex);
+	for (size_t i = 0; i < resources.num; i++) {
+		if (resources.array[i].owner == owner) {
+			resources.array[i].owner = NULL;
+			leaked++;
+		}
+	}
+	pthread_mutex_unlock(&resources_mutex);
+
+	if (leaked)
+		blog(LOG_DEBUG, "gs_memory_owner_destroy: %u graphics "
+		                "resource(s) outlived their owner",
+		                (unsigned int)leaked);
+
+	if (thread_owner == owner)
+		thread_owner = NULL;
+
+	bfree(owner);
+}
+
+gs_memory_owner_t gs_set_memory_owner(gs_memory_owner_t owner)
+{
+	gs_memory_owner_t prev = thread_owner;
+	thread_owner = owner;
+	return prev;
+}
+
+gs_memory_owner_t gs_get_memory_owner(void)
+{
+	return thread_owner;
+}
+
+void gs_memory_owner_get_usage(gs_memory_owner_t owner,
+		struct gs_memory_usage *usage)
+{
+	if (!owner || !usage)
+		return;
+
+	pthread_mutex_lock(&resources_mutex);
+	*usage = owner->usage;
+	pthread_mutex_unlock(&resources_mutex);
+}
+
+void gs_get_memory_usage(struct gs_memory_usage *usage)
+{
+	if (!usage)
+		return;
+
+	pthread_mutex_lock(&resources_mutex);
+	*usage = total_usage;
+	pthread_mutex_unlock(&resources_mutex);
+}
@@ -34,7 +34,9 @@ static __declspec(thread) graphics_t thread_graphics = NULL;
 static __thread graphics_t thread_graphics = NULL;
 #endif
 
-#define IMMEDIATE_COUNT 512
+/* immediate draws and single sprites are suballocated from this ring, so
+ * each draw only uploads its own vertices */
+#define IMMEDIATE_COUNT 4096
 
 bool load_graphics_imports(struct gs_exports *exports, void *module,
 		const char *module_name);
@@ -59,27 +61,28 @@ static bool graphics_init_immediate_vb(struct graphics_subsystem *graphics)
 	if (!graphics->immediate_vertbuffer)
 		return false;
 
+	graphics->immediate_pos     = 0;
+	graphics->immediate_discard = true;
+
 	return true;
 }
 
-static bool graphics_init_sprite_vb(struct graphics_subsystem *graphics)
+static bool graphics_init_sprite_batch_vb(struct graphics_subsystem *graphics)
 {
 	struct vb_data *vbd;
+	size_t num = SPRITE_BATCH_COUNT * 6;
 
 	vbd = vbdata_create();
-	vbd->num     = 4;
-	vbd->points  = bmalloc(sizeof(struct vec3) * 4);
+	vbd->num     = num;
+	vbd->points  = bzalloc(sizeof(struct vec3) * num);
 	vbd->num_tex = 1;
 	vbd->tvarray = bmalloc(sizeof(struct tvertarray));
 	vbd->tvarray[0].width = 2;
-	vbd->tvarray[0].array = bmalloc(sizeof(struct vec2) * 4);
-
-	memset(vbd->points,           0, sizeof(struct vec3) * 4);
-	memset(vbd->tvarray[0].array, 0, sizeof(struct vec2) * 4);
+	vbd->tvarray[0].array = bzalloc(sizeof(struct vec2) * num);
 
-	graphics->sprite_buffer = graphics->exports.
+	graphics->sprite_batch.buffer = graphics->exports.
 		device_create_vertexbuffer(graphics->device, vbd, GS_DYNAMIC);
-	if (!graphics->sprite_buffer)
+	if (!graphics->sprite_batch.buffer)
 		return false;
 
 	return true;
@@ -92,14 +95,22 @@ static bool graphics_init(struct graphics_subsystem *graphics)
 	matrix3_identity(&top_mat);
 	da_push_back(graphics->matrix_stack, &top_mat);
 
+	graphics->cur_blend_state.enabled = true;
+	graphics->cur_blend_state.src_c   = GS_BLEND_SRCALPHA;
+	graphics->cur_blend_state.dest_c  = GS_BLEND_INVSRCALPHA;
+	graphics->cur_blend_state.src_a   = GS_BLEND_SRCALPHA;
+	graphics->cur_blend_state.dest_a  = GS_BLEND_INVSRCALPHA;
+
 	graphics->exports.device_entercontext(graphics->device);
 
 	if (!graphics_init_immediate_vb(graphics))
 		return false;
-	if (!graphics_init_sprite_vb(graphics))
+	if (!graphics_init_sprite_batch_vb(graphics))
 		return false;
 	if (pthread_mutex_init(&graphics->mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&graphics->compile_mutex, NULL) != 0)
+		return false;
 
 	graphics->exports.device_leavecontext(graphics->device);
 
@@ -113,6 +124,7 @@ int gs_create(graphics_t *pgraphics, const char *module,
 
 	graphics_t graphics = bzalloc(sizeof(struct graphics_subsystem));
 	pthread_mutex_init_value(&graphics->mutex);
+	pthread_mutex_init_value(&graphics->compile_mutex);
 
 	if (!data->num_backbuffers)
 		data->num_backbuffers = 1;
@@ -147,21 +159,39 @@ void gs_destroy(graphics_t graphics)
 	if (!graphics)
 		return;
 
-	while (thread_graphics)
-		gs_leavecontext();
+	/* the compile threads destroy their own contexts, which use this
+	 * one's device */
+	if (!graphics->parent)
+		gs_stop_shader_compile(graphics);
+
+	/* a deferred or shared context can be destroyed from the thread that
+	 * created it without leaving that thread's own context */
+	if (!graphics->parent || thread_graphics == graphics) {
+		while (thread_graphics)
+			gs_leavecontext();
+	}
 
 	if (graphics->device) {
 		graphics->exports.device_entercontext(graphics->device);
-		graphics->exports.vertexbuffer_destroy(graphics->sprite_buffer);
+		texrender_pool_free(graphics);
+		graphics->exports.vertexbuffer_destroy(
+				graphics->sprite_batch.buffer);
 		graphics->exports.vertexbuffer_destroy(
 				graphics->immediate_vertbuffer);
 		graphics->exports.device_destroy(graphics->device);
 	}
 
 	pthread_mutex_destroy(&graphics->mutex);
+	pthread_mutex_destroy(&graphics->compile_mutex);
 	da_free(graphics->matrix_stack);
+	da_free(graphics->ortho_stack);
 	da_free(graphics->viewport_stack);
-	if (graphics->module)
+	da_free(graphics->blend_state_stack);
+	da_free(graphics->texrender_pool);
+	da_free(graphics->compile_queue);
+	da_free(graphics->sprite_batch.runs);
+	bfree(graphics->shader_cache_path);
+	if (graphics->module && !graphics->parent)
 		os_dlclose(graphics->module);
 	bfree(graphics);
 }
@@ -342,6 +372,73 @@ static inline void reset_immediate_arrays(graphics_t graphics)
 		da_init(graphics->texverts[i]);
 }
 
+/* points the immediate arrays at the unused part of the ring, keeping
+ * anything already written */
+static void set_immediate_arrays(graphics_t graphics)
+{
+	struct vb_data *vbd     = graphics->vbd;
+	size_t         pos      = graphics->immediate_pos;
+	size_t         capacity = IMMEDIATE_COUNT - pos;
+
+	graphics->verts.array       = vbd->points + pos;
+	graphics->norms.array       = vbd->normals + pos;
+	graphics->colors.array      = vbd->colors + pos;
+	graphics->texverts[0].array = (struct vec2*)vbd->tvarray[0].array + pos;
+
+	graphics->verts.capacity       = capacity;
+	graphics->norms.capacity       = capacity;
+	graphics->colors.capacity      = capacity;
+	graphics->texverts[0].capacity = capacity;
+
+	/* vertices without a color are drawn white */
+	memset(graphics->colors.array + graphics->colors.num, 0xFF,
+			sizeof(uint32_t) * (capacity - graphics->colors.num));
+}
+
+/* moves the vertices of the draw in progress to the start of the ring.  the
+ * next upload discards the buffer, so draws already queued are unaffected */
+static void wrap_immediate(graphics_t graphics)
+{
+	struct vb_data *vbd = graphics->vbd;
+	size_t         pos  = graphics->immediate_pos;
+
+	memmove(vbd->points, vbd->points + pos,
+			sizeof(struct vec3) * graphics->verts.num);
+	memmove(vbd->normals, vbd->normals + pos,
+			sizeof(struct vec3) * graphics->norms.num);
+	memmove(vbd->colors, vbd->colors + pos,
+			sizeof(uint32_t) * graphics->colors.num);
+	memmove(vbd->tvarray[0].array,
+			(struct vec2*)vbd->tvarray[0].array + pos,
+			sizeof(struct vec2) * graphics->texverts[0].num);
+
+	graphics->immediate_pos     = 0;
+	graphics->immediate_discard = true;
+	set_immediate_arrays(graphics);
+}
+
+/* reserves num vertices of the ring and returns the index of the first */
+static size_t alloc_immediate(graphics_t graphics, size_t num)
+{
+	size_t start;
+
+	if (graphics->immediate_pos + num > IMMEDIATE_COUNT) {
+		graphics->immediate_pos     = 0;
+		graphics->immediate_discard = true;
+	}
+
+	start = graphics->immediate_pos;
+	graphics->immediate_pos += num;
+	return start;
+}
+
+static void flush_immediate(graphics_t graphics, size_t start, size_t num)
+{
+	vertexbuffer_flush_range(graphics->immediate_vertbuffer, start, num,
+			graphics->immediate_discard);
+	graphics->immediate_discard = false;
+}
+
 void gs_renderstart(bool b_new)
 {
 	graphics_t graphics = thread_graphics;
@@ -356,18 +453,13 @@ void gs_renderstart(bool b_new)
 	} else {
 		graphics->vbd = vertexbuffer_getdata(
 				graphics->immediate_vertbuffer);
-		memset(graphics->vbd->colors, 0xFF,
-				sizeof(uint32_t) * IMMEDIATE_COUNT);
-
-		graphics->verts.array       = graphics->vbd->points;
-		graphics->norms.array       = graphics->vbd->normals;
-		graphics->colors.array      = graphics->vbd->colors;
-		graphics->texverts[0].array = graphics->vbd->tvarray[0].array;
-
-		graphics->verts.capacity       = IMMEDIATE_COUNT;
-		graphics->norms.capacity       = IMMEDIATE_COUNT;
-		graphics->colors.capacity      = IMMEDIATE_COUNT;
-		graphics->texverts[0].capacity = IMMEDIATE_COUNT;
+
+		if (graphics->immediate_pos == IMMEDIATE_COUNT) {
+			graphics->immediate_pos     = 0;
+			graphics->immediate_discard = true;
+		}
+
+		set_immediate_arrays(graphics);
 	}
 }
 
@@ -420,11 +512,13 @@ void gs_renderstop(enum gs_draw_mode mode)
 	}
 
 	if (graphics->using_immediate) {
-		vertexbuffer_flush(graphics->immediate_vertbuffer, false);
+		size_t start = alloc_immediate(graphics, num);
+
+		flush_immediate(graphics, start, num);
 
 		gs_load_vertexbuffer(graphics->immediate_vertbuffer);
 		gs_load_indexbuffer(NULL);
-		gs_draw(mode, 0, (uint32_t)num);
+		gs_draw(mode, (uint32_t)start, (uint32_t)num);
 
 		reset_immediate_arrays(graphics);
 	} else {
@@ -507,7 +601,13 @@ static inline bool validvertsize(graphics_t graphics, size_t num,
 	if (!graphics)
 		return false;
 
-	if (graphics->using_immediate && num == IMMEDIATE_COUNT) {
+	if (graphics->using_immediate &&
+	    num == IMMEDIATE_COUNT - graphics->immediate_pos) {
+		if (graphics->immediate_pos) {
+			wrap_immediate(graphics);
+			return true;
+		}
+
 		blog(LOG_ERROR, "%s: tried to use over %u "
 				"for immediate rendering",
 				name, IMMEDIATE_COUNT);
@@ -620,6 +720,8 @@ effect_t gs_create_effect(const char *effect_string, const char *filename,
 	effect->graphics = thread_graphics;
 
 	ep_init(&parser);
+	parser.defer_shaders = gs_can_compile_shaders_async(thread_graphics);
+
 	success = ep_parse(&parser, effect, effect_string, filename);
 	if (!success) {
 		if (error_string)
@@ -627,6 +729,18 @@ effect_t gs_create_effect(const char *effect_string, const char *filename,
 					&parser.cfp.error_list);
 		effect_destroy(effect);
 		effect = NULL;
+
+	} else if (effect->compile_jobs.num) {
+		effect_queue_shaders(effect);
+
+		/* shader errors can only be reported once they're compiled,
+		 * which still happens in parallel */
+		if (error_string && !effect_finish_shaders(effect)) {
+			*error_string = bstrdup("Failed to compile shaders, "
+			                        "see the log for details");
+			effect_destroy(effect);
+			effect = NULL;
+		}
 	}
 
 	ep_free(&parser);
@@ -675,14 +789,6 @@ shader_t gs_create_pixelshader_from_file(const char *file, char **error_string)
 	return shader;
 }
 
-texture_t gs_create_texture_from_file(const char *file, uint32_t flags)
-{
-	/* TODO */
-	UNUSED_PARAMETER(file);
-	UNUSED_PARAMETER(flags);
-	return NULL;
-}
-
 texture_t gs_create_cubetexture_from_file(const char *file, uint32_t flags)
 {
 	/* TODO */
@@ -722,51 +828,363 @@ static inline void assign_sprite_uv(float *start, float *end, bool flip)
 	}
 }
 
-static void build_sprite(struct vb_data *data, float fcx, float fcy,
+/* texture coordinates of a sprite */
+struct sprite_uv {
+	float start_u, end_u;
+	float start_v, end_v;
+};
+
+/* the part of the sprite that's drawn, in sprite units */
+struct sprite_rect {
+	float x0, y0;
+	float x1, y1;
+};
+
+static void build_sprite(struct vec3 *points, struct vec2 *tvarray,
+		const struct sprite_rect *rect,
 		float start_u, float end_u, float start_v, float end_v)
 {
-	struct vec2 *tvarray = data->tvarray[0].array;
-
-	vec3_zero(data->points);
-	vec3_set(data->points+1,  fcx, 0.0f, 0.0f);
-	vec3_set(data->points+2, 0.0f,  fcy, 0.0f);
-	vec3_set(data->points+3,  fcx,  fcy, 0.0f);
+	vec3_set(points,   rect->x0, rect->y0, 0.0f);
+	vec3_set(points+1, rect->x1, rect->y0, 0.0f);
+	vec3_set(points+2, rect->x0, rect->y1, 0.0f);
+	vec3_set(points+3, rect->x1, rect->y1, 0.0f);
 	vec2_set(tvarray,   start_u, start_v);
 	vec2_set(tvarray+1, end_u,   start_v);
 	vec2_set(tvarray+2, start_u, end_v);
 	vec2_set(tvarray+3, end_u,   end_v);
 }
 
-static inline void build_sprite_norm(struct vb_data *data, float fcx, float fcy,
+static inline void get_sprite_uv(struct sprite_uv *uv, texture_t tex,
 		uint32_t flip)
 {
-	float start_u, end_u;
-	float start_v, end_v;
+	if (texture_isrect(tex)) {
+		float width  = (float)texture_getwidth(tex);
+		float height = (float)texture_getheight(tex);
 
-	assign_sprite_uv(&start_u, &end_u, (flip & GS_FLIP_U) != 0);
-	assign_sprite_uv(&start_v, &end_v, (flip & GS_FLIP_V) != 0);
-	build_sprite(data, fcx, fcy, start_u, end_u, start_v, end_v);
+		assign_sprite_rect(&uv->start_u, &uv->end_u, width,
+				(flip & GS_FLIP_U) != 0);
+		assign_sprite_rect(&uv->start_v, &uv->end_v, height,
+				(flip & GS_FLIP_V) != 0);
+	} else {
+		assign_sprite_uv(&uv->start_u, &uv->end_u,
+				(flip & GS_FLIP_U) != 0);
+		assign_sprite_uv(&uv->start_v, &uv->end_v,
+				(flip & GS_FLIP_V) != 0);
+	}
 }
 
-static inline void build_sprite_rect(struct vb_data *data, texture_t tex,
-		float fcx, float fcy, uint32_t flip)
+static inline void assign_sprite_region(float *start, float *end, float pos,
+		float size, float tex_size, bool rect, bool flip)
+{
+	float scale = rect ? 1.0f : 1.0f / tex_size;
+
+	if (!flip) {
+		*start = pos * scale;
+		*end   = (pos + size) * scale;
+	} else {
+		*start = (pos + size) * scale;
+		*end   = pos * scale;
+	}
+}
+
+static inline void get_sprite_region_uv(struct sprite_uv *uv, texture_t tex,
+		uint32_t flip, uint32_t x, uint32_t y, uint32_t cx, uint32_t cy)
 {
-	float start_u, end_u;
-	float start_v, end_v;
 	float width  = (float)texture_getwidth(tex);
 	float height = (float)texture_getheight(tex);
+	bool  rect   = texture_isrect(tex);
 
-	assign_sprite_rect(&start_u, &end_u, width,  (flip & GS_FLIP_U) != 0);
-	assign_sprite_rect(&start_v, &end_v, height, (flip & GS_FLIP_V) != 0);
-	build_sprite(data, fcx, fcy, start_u, end_u, start_v, end_v);
+	assign_sprite_region(&uv->start_u, &uv->end_u, (float)x, (float)cx,
+			width, rect, (flip & GS_FLIP_U) != 0);
+	assign_sprite_region(&uv->start_v, &uv->end_v, (float)y, (float)cy,
+			height, rect, (flip & GS_FLIP_V) != 0);
+}
+
+/* ------------------------------------------------------------------------- */
+/* sprite batching */
+
+static inline bool batch_flushable(struct sprite_batch *batch)
+{
+	return batch->count && !batch->flushing;
+}
+
+/* begins the pass that was active again after the batch was drawn with its
+ * own technique */
+static inline void resume_pass(graphics_t graphics, struct gs_effect *effect,
+		struct effect_technique *tech, struct effect_pass *pass)
+{
+	if (tech && pass) {
+		technique_begin(tech);
+		technique_beginpass(tech, (size_t)(pass - tech->passes.array));
+	}
+
+	graphics->cur_effect = effect;
+}
+
+static void draw_sprite_batch_runs(graphics_t graphics)
+{
+	struct sprite_batch *batch = &graphics->sprite_batch;
+
+	/* runs always start at the beginning of the buffer */
+	vertexbuffer_flush_range(batch->buffer, 0, batch->count * 6, true);
+	gs_load_vertexbuffer(batch->buffer);
+	gs_load_indexbuffer(NULL);
+
+	/* the vertices have already been transformed */
+	gs_matrix_push();
+	gs_matrix_identity();
+
+	for (size_t i = 0; i < batch->runs.num; i++) {
+		struct sprite_batch_run *run = batch->runs.array+i;
+
+		effect_settexture(batch->effect, batch->image, run->tex);
+		effect_updateparams(batch->effect);
+
+		graphics->exports.device_draw(graphics->device, GS_TRIS,
+				run->start * 6, run->count * 6);
+	}
+
+	gs_matrix_pop();
+}
+
+static void flush_sprite_batch(graphics_t graphics)
+{
+	struct sprite_batch     *batch = &graphics->sprite_batch;
+	struct gs_effect        *effect = batch->effect;
+	struct effect_param     *image = batch->image;
+	struct gs_effect        *prev_effect = graphics->cur_effect;
+	struct effect_technique *prev_tech = NULL;
+	struct effect_pass      *prev_pass = NULL;
+	bool                    in_pass;
+
+	if (!batch_flushable(batch))
+		return;
+
+	if (prev_effect) {
+		prev_tech = prev_effect->cur_technique;
+		prev_pass = prev_effect->cur_pass;
+	}
+
+	batch->flushing = true;
+
+	/* flushed while a sprite's own pass is still active (for example when
+	 * the source draws something else), so restore its image afterward */
+	in_pass = effect->cur_technique == batch->tech && effect->cur_pass;
+
+	if (in_pass) {
+		DARRAY(uint8_t) saved_val;
+
+		da_init(saved_val);
+		da_copy(saved_val, image->cur_val);
+
+		draw_sprite_batch_runs(graphics);
+
+		da_copy(image->cur_val, saved_val);
+		da_free(saved_val);
+		image->changed = true;
+		effect_updateparams(effect);
+
+	} else {
+		technique_begin(batch->tech);
+		technique_beginpass(batch->tech, 0);
+
+		draw_sprite_batch_runs(graphics);
+
+		technique_endpass(batch->tech);
+		technique_end(batch->tech);
+
+		resume_pass(graphics, prev_effect, prev_tech, prev_pass);
+	}
+
+	batch->count = 0;
+	da_resize(batch->runs, 0);
+	batch->flushing = false;
+}
+
+static inline void add_batch_run(struct sprite_batch *batch, texture_t tex)
+{
+	struct sprite_batch_run *run = NULL;
+
+	if (batch->runs.num)
+		run = da_end(batch->runs);
+
+	if (!run || run->tex != tex) {
+		run = da_push_back_new(batch->runs);
+		run->tex   = tex;
+		run->start = batch->count;
+	}
+
+	run->count++;
+}
+
+/* queues a sprite if a batch is active and the sprite is being drawn with
+ * the batch's effect.  the sprite is transformed on the CPU so consecutive
+ * sprites can be drawn with a single draw call */
+static bool batch_sprite(graphics_t graphics, texture_t tex,
+		const struct sprite_rect *rect, const struct sprite_uv *uv)
+{
+	struct sprite_batch *batch  = &graphics->sprite_batch;
+	struct gs_effect    *effect = graphics->cur_effect;
+	struct vec3         points[4];
+	struct vec2         uvs[4];
+	struct vb_data      *data;
+	struct vec3         *out_points;
+	struct vec2         *out_uvs;
+	struct matrix3      transform;
+	static const size_t order[6] = {0, 1, 2, 2, 1, 3};
+
+	if (!batch->active || batch->flushing || effect != batch->effect)
+		return false;
+	if (!effect->cur_pass || effect->cur_technique->passes.num != 1)
+		return false;
+
+	if (batch->tech != effect->cur_technique ||
+	    batch->count == SPRITE_BATCH_COUNT)
+		flush_sprite_batch(graphics);
+
+	batch->tech = effect->cur_technique;
+
+	build_sprite(points, uvs, rect, uv->start_u, uv->end_u,
+			uv->start_v, uv->end_v);
+
+	gs_matrix_get(&transform);
+	vec3_transform_array(points, points, 4, &transform);
+
+	data       = vertexbuffer_getdata(batch->buffer);
+	out_points = data->points + batch->count * 6;
+	out_uvs    = (struct vec2*)data->tvarray[0].array + batch->count * 6;
+
+	for (size_t i = 0; i < 6; i++) {
+		vec3_copy(out_points+i, points+order[i]);
+		vec2_copy(out_uvs+i,    uvs+order[i]);
+	}
+
+	add_batch_run(batch, tex);
+	batch->count++;
+	return true;
+}
+
+void gs_sprite_batch_begin(effect_t effect, eparam_t image)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics || !effect || !image) return;
+
+	flush_sprite_batch(graphics);
+
+	graphics->sprite_batch.active = true;
+	graphics->sprite_batch.effect = effect;
+	graphics->sprite_batch.image  = image;
+	graphics->sprite_batch.tech   = NULL;
+}
+
+void gs_sprite_batch_flush(void)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics) return;
+
+	flush_sprite_batch(graphics);
+}
+
+void gs_sprite_batch_end(void)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics) return;
+
+	flush_sprite_batch(graphics);
+	graphics->sprite_batch.active = false;
+	graphics->sprite_batch.effect = NULL;
+	graphics->sprite_batch.image  = NULL;
+}
+
+void gs_set_sprite_crop(float left, float top, float right, float bottom)
+{
+	graphics_t graphics = thread_graphics;
+	struct sprite_crop *crop;
+
+	if (!graphics) return;
+
+	crop = &graphics->sprite_crop;
+	crop->active = left > 0.0f || top > 0.0f ||
+	               right > 0.0f || bottom > 0.0f;
+	crop->target = gs_getrendertarget();
+	crop->left   = fmaxf(left,   0.0f);
+	crop->top    = fmaxf(top,    0.0f);
+	crop->right  = fmaxf(right,  0.0f);
+	crop->bottom = fmaxf(bottom, 0.0f);
+}
+
+void gs_reset_sprite_crop(void)
+{
+	graphics_t graphics = thread_graphics;
+	if (graphics)
+		graphics->sprite_crop.active = false;
+}
+
+static inline void crop_sprite_axis(float *start_uv, float *end_uv,
+		float *start, float *end, float size, float crop0, float crop1)
+{
+	float uv_size = *end_uv - *start_uv;
+
+	*start     = crop0;
+	*end       = size - crop1;
+	*start_uv += uv_size * (crop0 / size);
+	*end_uv   -= uv_size * (crop1 / size);
+}
+
+/* returns false if nothing of the sprite is left to draw */
+static bool crop_sprite(graphics_t graphics, struct sprite_rect *rect,
+		struct sprite_uv *uv)
+{
+	struct sprite_crop *crop = &graphics->sprite_crop;
+	float cx = rect->x1;
+	float cy = rect->y1;
+
+	if (!crop->active || crop->target != gs_getrendertarget())
+		return true;
+	if (crop->left + crop->right >= cx || crop->top + crop->bottom >= cy)
+		return false;
+
+	crop_sprite_axis(&uv->start_u, &uv->end_u, &rect->x0, &rect->x1, cx,
+			crop->left, crop->right);
+	crop_sprite_axis(&uv->start_v, &uv->end_v, &rect->y0, &rect->y1, cy,
+			crop->top, crop->bottom);
+	return true;
+}
+
+static void draw_sprite(graphics_t graphics, texture_t tex, float fcx,
+		float fcy, struct sprite_uv *uv)
+{
+	struct sprite_rect rect = {0.0f, 0.0f, fcx, fcy};
+	struct vb_data *data;
+	size_t         start;
+
+	if (!crop_sprite(graphics, &rect, uv))
+		return;
+	if (batch_sprite(graphics, tex, &rect, uv))
+		return;
+
+	data  = vertexbuffer_getdata(graphics->immediate_vertbuffer);
+	start = alloc_immediate(graphics, 4);
+
+	build_sprite(data->points + start,
+			(struct vec2*)data->tvarray[0].array + start,
+			&rect, uv->start_u, uv->end_u,
+			uv->start_v, uv->end_v);
+	memset(data->colors + start, 0xFF, sizeof(uint32_t) * 4);
+
+	flush_immediate(graphics, start, 4);
+	gs_load_vertexbuffer(graphics->immediate_vertbuffer);
+	gs_load_indexbuffer(NULL);
+
+	gs_draw(GS_TRISTRIP, (uint32_t)start, 4);
 }
 
 void gs_draw_sprite(texture_t tex, uint32_t flip, uint32_t width,
 		uint32_t height)
 {
 	graphics_t graphics = thread_graphics;
+	struct sprite_uv uv;
 	float fcx, fcy;
-	struct vb_data *data;
 
 	assert(tex);
 	if (!tex || !thread_graphics)
@@ -780,17 +1198,28 @@ void gs_draw_sprite(texture_t tex, uint32_t flip, uint32_t width,
 	fcx = width  ? (float)width  : (float)texture_getwidth(tex);
 	fcy = height ? (float)height : (float)texture_getheight(tex);
 
-	data = vertexbuffer_getdata(graphics->sprite_buffer);
-	if (texture_isrect(tex))
-		build_sprite_rect(data, tex, fcx, fcy, flip);
-	else
-		build_sprite_norm(data, fcx, fcy, flip);
+	get_sprite_uv(&uv, tex, flip);
+	draw_sprite(graphics, tex, fcx, fcy, &uv);
+}
 
-	vertexbuffer_flush(graphics->sprite_buffer, false);
-	gs_load_vertexbuffer(graphics->sprite_buffer);
-	gs_load_indexbuffer(NULL);
+void gs_draw_sprite_subregion(texture_t tex, uint32_t flip,
+		uint32_t sub_x, uint32_t sub_y,
+		uint32_t sub_cx, uint32_t sub_cy)
+{
+	graphics_t graphics = thread_graphics;
+	struct sprite_uv uv;
 
-	gs_draw(GS_TRISTRIP, 0, 0);
+	assert(tex);
+	if (!tex || !thread_graphics || !sub_cx || !sub_cy)
+		return;
+
+	if (gs_gettexturetype(tex) != GS_TEXTURE_2D) {
+		blog(LOG_ERROR, "A sprite must be a 2D texture");
+		return;
+	}
+
+	get_sprite_region_uv(&uv, tex, flip, sub_x, sub_y, sub_cx, sub_cy);
+	draw_sprite(graphics, tex, (float)sub_cx, (float)sub_cy, &uv);
 }
 
 void gs_draw_cube_backdrop(texture_t cubetex, const struct quat *rot,
@@ -852,6 +1281,32 @@ void gs_viewport_pop(void)
 	da_pop_back(thread_graphics->viewport_stack);
 }
 
+void gs_blend_state_push(void)
+{
+	if (!thread_graphics) return;
+
+	da_push_back(thread_graphics->blend_state_stack,
+			&thread_graphics->cur_blend_state);
+}
+
+void gs_blend_state_pop(void)
+{
+	struct blend_state *state;
+	if (!thread_graphics || !thread_graphics->blend_state_stack.num)
+		return;
+
+	state = da_end(thread_graphics->blend_state_stack);
+
+	gs_enable_blending(state->enabled);
+	if (state->separate)
+		gs_blendfunction_separate(state->src_c, state->dest_c,
+				state->src_a, state->dest_a);
+	else
+		gs_blendfunction(state->src_c, state->dest_c);
+
+	da_pop_back(thread_graphics->blend_state_stack);
+}
+
 void texture_setimage(texture_t tex, const void *data, uint32_t linesize,
 		bool flip)
 {
@@ -914,6 +1369,8 @@ void gs_perspective(float angle, float aspect, float near, float far)
 
 	graphics->exports.device_frustum(graphics->device, xmin, xmax,
 			ymin, ymax, near, far);
+
+	graphics->ortho.valid = false;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -977,6 +1434,7 @@ texture_t gs_create_texture(uint32_t width, uint32_t height,
 		const void **data, uint32_t flags)
 {
 	graphics_t graphics = thread_graphics;
+	texture_t tex;
 	bool pow2tex = is_pow2(width) && is_pow2(height);
 	bool uses_mipmaps = (flags & GS_BUILDMIPMAPS || levels != 1);
 
@@ -1000,8 +1458,11 @@ texture_t gs_create_texture(uint32_t width, uint32_t height,
 		levels = 1;
 	}
 
-	return graphics->exports.device_create_texture(graphics->device,
+	tex = graphics->exports.device_create_texture(graphics->device,
 			width, height, color_format, levels, data, flags);
+	gs_memory_track(tex, GS_RESOURCE_TEXTURE, gs_texture_memory_size(
+				width, height, 1, color_format, levels, flags));
+	return tex;
 }
 
 texture_t gs_create_cubetexture(uint32_t size,
@@ -1009,6 +1470,7 @@ texture_t gs_create_cubetexture(uint32_t size,
 		const void **data, uint32_t flags)
 {
 	graphics_t graphics = thread_graphics;
+	texture_t tex;
 	bool pow2tex = is_pow2(size);
 	bool uses_mipmaps = (flags & GS_BUILDMIPMAPS || levels != 1);
 
@@ -1033,8 +1495,11 @@ texture_t gs_create_cubetexture(uint32_t size,
 		data   = NULL;
 	}
 
-	return graphics->exports.device_create_cubetexture(graphics->device,
+	tex = graphics->exports.device_create_cubetexture(graphics->device,
 			size, color_format, levels, data, flags);
+	gs_memory_track(tex, GS_RESOURCE_TEXTURE, gs_texture_memory_size(
+				size, size, 6, color_format, levels, flags));
+	return tex;
 }
 
 texture_t gs_create_volumetexture(uint32_t width, uint32_t height,
@@ -1042,31 +1507,45 @@ texture_t gs_create_volumetexture(uint32_t width, uint32_t height,
 		uint32_t levels, const void **data, uint32_t flags)
 {
 	graphics_t graphics = thread_graphics;
+	texture_t tex;
 	if (!graphics) return NULL;
 
-	return graphics->exports.device_create_volumetexture(graphics->device,
+	tex = graphics->exports.device_create_volumetexture(graphics->device,
 			width, height, depth, color_format, levels, data,
 			flags);
+	gs_memory_track(tex, GS_RESOURCE_TEXTURE, gs_texture_memory_size(
+				width, height, depth, color_format, levels,
+				flags));
+	return tex;
 }
 
 zstencil_t gs_create_zstencil(uint32_t width, uint32_t height,
 		enum gs_zstencil_format format)
 {
 	graphics_t graphics = thread_graphics;
+	zstencil_t zstencil;
 	if (!graphics) return NULL;
 
-	return graphics->exports.device_create_zstencil(graphics->device,
+	zstencil = graphics->exports.device_create_zstencil(graphics->device,
 			width, height, format);
+	gs_memory_track(zstencil, GS_RESOURCE_ZSTENCIL,
+			(uint64_t)width * height * 4);
+	return zstencil;
 }
 
 stagesurf_t gs_create_stagesurface(uint32_t width, uint32_t height,
 		enum gs_color_format color_format)
 {
 	graphics_t graphics = thread_graphics;
+	stagesurf_t stagesurf;
 	if (!graphics) return NULL;
 
-	return graphics->exports.device_create_stagesurface(graphics->device,
-			width, height, color_format);
+	stagesurf = graphics->exports.device_create_stagesurface(
+			graphics->device, width, height, color_format);
+	gs_memory_track(stagesurf, GS_RESOURCE_STAGESURF,
+			gs_texture_memory_size(width, height, 1, color_format,
+				1, 0));
+	return stagesurf;
 }
 
 samplerstate_t gs_create_samplerstate(struct gs_sampler_info *info)
@@ -1102,10 +1581,15 @@ vertbuffer_t gs_create_vertexbuffer(struct vb_data *data,
 		uint32_t flags)
 {
 	graphics_t graphics = thread_graphics;
+	uint64_t bytes = gs_vertbuffer_memory_size(data);
+	vertbuffer_t vertbuffer;
 	if (!graphics) return NULL;
 
-	return graphics->exports.device_create_vertexbuffer(graphics->device,
-			data, flags);
+	/* the buffer takes ownership of the data */
+	vertbuffer = graphics->exports.device_create_vertexbuffer(
+			graphics->device, data, flags);
+	gs_memory_track(vertbuffer, GS_RESOURCE_VERTBUFFER, bytes);
+	return vertbuffer;
 }
 
 indexbuffer_t gs_create_indexbuffer(enum gs_index_type type,
@@ -1225,6 +1709,8 @@ void gs_setrendertarget(texture_t tex, zstencil_t zstencil)
 	graphics_t graphics = thread_graphics;
 	if (!graphics) return;
 
+	flush_sprite_batch(graphics);
+
 	graphics->exports.device_setrendertarget(graphics->device, tex,
 			zstencil);
 }
@@ -1280,6 +1766,8 @@ void gs_draw(enum gs_draw_mode draw_mode, uint32_t start_vert,
 	graphics_t graphics = thread_graphics;
 	if (!graphics) return;
 
+	flush_sprite_batch(graphics);
+
 	graphics->exports.device_draw(graphics->device, draw_mode,
 			start_vert, num_verts);
 }
@@ -1289,6 +1777,8 @@ void gs_endscene(void)
 	graphics_t graphics = thread_graphics;
 	if (!graphics) return;
 
+	flush_sprite_batch(graphics);
+
 	graphics->exports.device_endscene(graphics->device);
 }
 
@@ -1304,6 +1794,9 @@ void gs_clear(uint32_t clear_flags, struct vec4 *color, float depth,
 		uint8_t stencil)
 {
 	graphics_t graphics = thread_graphics;
+	if (!graphics) return;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_clear(graphics->device, clear_flags, color,
 			depth, stencil);
 }
@@ -1316,6 +1809,17 @@ void gs_present(void)
 	graphics->exports.device_present(graphics->device);
 }
 
+bool gs_swapchain_ready(void)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics) return false;
+
+	if (!graphics->exports.device_swapchain_ready)
+		return true;
+
+	return graphics->exports.device_swapchain_ready(graphics->device);
+}
+
 void gs_setcullmode(enum gs_cull_mode mode)
 {
 	graphics_t graphics = thread_graphics;
@@ -1337,6 +1841,9 @@ void gs_enable_blending(bool enable)
 	graphics_t graphics = thread_graphics;
 	if (!graphics) return;
 
+	flush_sprite_batch(graphics);
+
+	graphics->cur_blend_state.enabled = enable;
 	graphics->exports.device_enable_blending(graphics->device, enable);
 }
 
@@ -1378,9 +1885,34 @@ void gs_blendfunction(enum gs_blend_type src, enum gs_blend_type dest)
 	graphics_t graphics = thread_graphics;
 	if (!graphics) return;
 
+	flush_sprite_batch(graphics);
+
+	graphics->cur_blend_state.separate = false;
+	graphics->cur_blend_state.src_c    = src;
+	graphics->cur_blend_state.dest_c   = dest;
+	graphics->cur_blend_state.src_a    = src;
+	graphics->cur_blend_state.dest_a   = dest;
 	graphics->exports.device_blendfunction(graphics->device, src, dest);
 }
 
+void gs_blendfunction_separate(
+		enum gs_blend_type src_c, enum gs_blend_type dest_c,
+		enum gs_blend_type src_a, enum gs_blend_type dest_a)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics) return;
+
+	flush_sprite_batch(graphics);
+
+	graphics->cur_blend_state.separate = true;
+	graphics->cur_blend_state.src_c    = src_c;
+	graphics->cur_blend_state.dest_c   = dest_c;
+	graphics->cur_blend_state.src_a    = src_a;
+	graphics->cur_blend_state.dest_a   = dest_a;
+	graphics->exports.device_blendfunction_separate(graphics->device,
+			src_c, dest_c, src_a, dest_a);
+}
+
 void gs_depthfunction(enum gs_depth_test test)
 {
 	graphics_t graphics = thread_graphics;
@@ -1453,6 +1985,8 @@ void gs_setviewport(int x, int y, int width, int height)
 	graphics_t graphics = thread_graphics;
 	if (!graphics) return;
 
+	flush_sprite_batch(graphics);
+
 	graphics->exports.device_setviewport(graphics->device, x, y, width,
 			height);
 }
@@ -1470,6 +2004,8 @@ void gs_setscissorrect(struct gs_rect *rect)
 	graphics_t graphics = thread_graphics;
 	if (!graphics) return;
 
+	flush_sprite_batch(graphics);
+
 	graphics->exports.device_setscissorrect(graphics->device, rect);
 }
 
@@ -1479,8 +2015,16 @@ void gs_ortho(float left, float right, float top, float bottom, float znear,
 	graphics_t graphics = thread_graphics;
 	if (!graphics) return;
 
+	flush_sprite_batch(graphics);
+
 	graphics->exports.device_ortho(graphics->device, left, right, top,
 			bottom, znear, zfar);
+
+	graphics->ortho.valid  = true;
+	graphics->ortho.left   = left;
+	graphics->ortho.right  = right;
+	graphics->ortho.top    = top;
+	graphics->ortho.bottom = bottom;
 }
 
 void gs_frustum(float left, float right, float top, float bottom, float znear,
@@ -1489,8 +2033,12 @@ void gs_frustum(float left, float right, float top, float bottom, float znear,
 	graphics_t graphics = thread_graphics;
 	if (!graphics) return;
 
+	flush_sprite_batch(graphics);
+
 	graphics->exports.device_frustum(graphics->device, left, right, top,
 			bottom, znear, zfar);
+
+	graphics->ortho.valid = false;
 }
 
 void gs_projection_push(void)
@@ -1499,6 +2047,7 @@ void gs_projection_push(void)
 	if (!graphics) return;
 
 	graphics->exports.device_projection_push(graphics->device);
+	da_push_back(graphics->ortho_stack, &graphics->ortho);
 }
 
 void gs_projection_pop(void)
@@ -1506,7 +2055,27 @@ void gs_projection_pop(void)
 	graphics_t graphics = thread_graphics;
 	if (!graphics) return;
 
+	flush_sprite_batch(graphics);
+
 	graphics->exports.device_projection_pop(graphics->device);
+
+	if (graphics->ortho_stack.num) {
+		size_t last = graphics->ortho_stack.num - 1;
+		graphics->ortho = graphics->ortho_stack.array[last];
+		da_pop_back(graphics->ortho_stack);
+	}
+}
+
+bool gs_getortho(float *left, float *right, float *top, float *bottom)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics || !graphics->ortho.valid) return false;
+
+	*left   = graphics->ortho.left;
+	*right  = graphics->ortho.right;
+	*top    = graphics->ortho.top;
+	*bottom = graphics->ortho.bottom;
+	return true;
 }
 
 void swapchain_destroy(swapchain_t swapchain)
@@ -1673,6 +2242,7 @@ void texture_destroy(texture_t tex)
 	graphics_t graphics = thread_graphics;
 	if (!graphics || !tex) return;
 
+	gs_memory_untrack(tex);
 	graphics->exports.texture_destroy(tex);
 }
 
@@ -1735,11 +2305,25 @@ void *texture_getobj(texture_t tex)
 	return graphics->exports.texture_getobj(tex);
 }
 
+bool texture_setimage_region(texture_t tex, uint32_t x, uint32_t y,
+		uint32_t cx, uint32_t cy, const void *data, uint32_t linesize)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics || !tex || !data) return false;
+
+	if (graphics->exports.texture_setimage_region)
+		return graphics->exports.texture_setimage_region(tex, x, y,
+				cx, cy, data, linesize);
+	else
+		return false;
+}
+
 void cubetexture_destroy(texture_t cubetex)
 {
 	graphics_t graphics = thread_graphics;
 	if (!graphics || !cubetex) return;
 
+	gs_memory_untrack(cubetex);
 	graphics->exports.cubetexture_destroy(cubetex);
 }
 
@@ -1764,6 +2348,7 @@ void volumetexture_destroy(texture_t voltex)
 	graphics_t graphics = thread_graphics;
 	if (!graphics || !voltex) return;
 
+	gs_memory_untrack(voltex);
 	graphics->exports.volumetexture_destroy(voltex);
 }
 
@@ -1804,6 +2389,7 @@ void stagesurface_destroy(stagesurf_t stagesurf)
 	graphics_t graphics = thread_graphics;
 	if (!graphics || !stagesurf) return;
 
+	gs_memory_untrack(stagesurf);
 	graphics->exports.stagesurface_destroy(stagesurf);
 }
 
@@ -1831,6 +2417,14 @@ enum gs_color_format stagesurface_getcolorformat(stagesurf_t stagesurf)
 	return graphics->exports.stagesurface_getcolorformat(stagesurf);
 }
 
+bool stagesurface_isready(stagesurf_t stagesurf)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics || !stagesurf) return false;
+
+	return graphics->exports.stagesurface_isready(stagesurf);
+}
+
 bool stagesurface_map(stagesurf_t stagesurf, uint8_t **data, uint32_t *linesize)
 {
 	graphics_t graphics = thread_graphics;
@@ -1851,6 +2445,7 @@ void zstencil_destroy(zstencil_t zstencil)
 {
 	if (!thread_graphics || !zstencil) return;
 
+	gs_memory_untrack(zstencil);
 	thread_graphics->exports.zstencil_destroy(zstencil);
 }
 
@@ -1866,6 +2461,7 @@ void vertexbuffer_destroy(vertbuffer_t vertbuffer)
 	graphics_t graphics = thread_graphics;
 	if (!graphics || !vertbuffer) return;
 
+	gs_memory_untrack(vertbuffer);
 	graphics->exports.vertexbuffer_destroy(vertbuffer);
 }
 
@@ -1876,6 +2472,19 @@ void vertexbuffer_flush(vertbuffer_t vertbuffer, bool rebuild)
 	thread_graphics->exports.vertexbuffer_flush(vertbuffer, rebuild);
 }
 
+void vertexbuffer_flush_range(vertbuffer_t vertbuffer, size_t start,
+		size_t num, bool discard)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics || !vertbuffer) return;
+
+	if (graphics->exports.vertexbuffer_flush_range)
+		graphics->exports.vertexbuffer_flush_range(vertbuffer,
+				start, num, discard);
+	else
+		graphics->exports.vertexbuffer_flush(vertbuffer, false);
+}
+
 struct vb_data *vertexbuffer_getdata(vertbuffer_t vertbuffer)
 {
 	if (!thread_graphics || !vertbuffer) return NULL;
@@ -1919,6 +2528,169 @@ enum gs_index_type indexbuffer_gettype(indexbuffer_t indexbuffer)
 	return thread_graphics->exports.indexbuffer_gettype(indexbuffer);
 }
 
+gputimer_t gs_create_timer(void)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics || !graphics->exports.device_create_timer)
+		return NULL;
+
+	return graphics->exports.device_create_timer(graphics->device);
+}
+
+void gputimer_destroy(gputimer_t timer)
+{
+	if (!thread_graphics || !timer) return;
+
+	thread_graphics->exports.gputimer_destroy(timer);
+}
+
+void gputimer_begin(gputimer_t timer)
+{
+	if (!thread_graphics || !timer) return;
+
+	thread_graphics->exports.gputimer_begin(timer);
+}
+
+void gputimer_end(gputimer_t timer)
+{
+	if (!thread_graphics || !timer) return;
+
+	thread_graphics->exports.gputimer_end(timer);
+}
+
+bool gputimer_get_data(gputimer_t timer, uint64_t *ticks)
+{
+	if (!thread_graphics || !timer || !ticks) return false;
+
+	return thread_graphics->exports.gputimer_get_data(timer, ticks);
+}
+
+gputimer_range_t gs_create_timer_range(void)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics || !graphics->exports.device_create_timer_range)
+		return NULL;
+
+	return graphics->exports.device_create_timer_range(graphics->device);
+}
+
+void gputimer_range_destroy(gputimer_range_t range)
+{
+	if (!thread_graphics || !range) return;
+
+	thread_graphics->exports.gputimer_range_destroy(range);
+}
+
+void gputimer_range_begin(gputimer_range_t range)
+{
+	if (!thread_graphics || !range) return;
+
+	thread_graphics->exports.gputimer_range_begin(range);
+}
+
+void gputimer_range_end(gputimer_range_t range)
+{
+	if (!thread_graphics || !range) return;
+
+	thread_graphics->exports.gputimer_range_end(range);
+}
+
+bool gputimer_range_get_data(gputimer_range_t range, bool *disjoint,
+		uint64_t *frequency)
+{
+	if (!thread_graphics || !range || !disjoint || !frequency)
+		return false;
+
+	return thread_graphics->exports.gputimer_range_get_data(range,
+			disjoint, frequency);
+}
+
+/* creates a context on a device made from the parent's device, which uses
+ * the parent's module */
+static int create_child_context(graphics_t parent, graphics_t *pchild,
+		device_t (*create_device)(device_t parent_device))
+{
+	graphics_t graphics = bzalloc(sizeof(struct graphics_subsystem));
+	pthread_mutex_init_value(&graphics->mutex);
+	pthread_mutex_init_value(&graphics->compile_mutex);
+
+	graphics->module  = parent->module;
+	graphics->exports = parent->exports;
+	graphics->parent  = parent;
+
+	if (parent->shader_cache_path)
+		graphics->shader_cache_path =
+			bstrdup(parent->shader_cache_path);
+
+	graphics->device = create_device(parent->device);
+	if (!graphics->device)
+		goto error;
+
+	if (!graphics_init(graphics))
+		goto error;
+
+	*pchild = graphics;
+	return GS_SUCCESS;
+
+error:
+	gs_destroy(graphics);
+	return GS_ERROR_FAIL;
+}
+
+int gs_create_compile_context(graphics_t parent, graphics_t *pchild)
+{
+	int errorcode = gs_create_shared(parent, pchild);
+
+	if (errorcode != GS_ERROR_NOT_SUPPORTED)
+		return errorcode;
+
+#ifdef _WIN32
+	if (parent->exports.device_create_deferred)
+		return create_child_context(parent, pchild,
+				parent->exports.device_create_deferred);
+#endif
+
+	return GS_ERROR_NOT_SUPPORTED;
+}
+
+int gs_create_shared(graphics_t parent, graphics_t *pshared)
+{
+	if (!parent || !pshared)
+		return GS_ERROR_FAIL;
+	if (!parent->exports.device_create_shared ||
+	    !parent->exports.device_create_fence)
+		return GS_ERROR_NOT_SUPPORTED;
+
+	return create_child_context(parent, pshared,
+			parent->exports.device_create_shared);
+}
+
+gpufence_t gs_create_fence(void)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics || !graphics->exports.device_create_fence)
+		return NULL;
+
+	/* sprites batched so far are part of what the fence waits for */
+	flush_sprite_batch(graphics);
+
+	return graphics->exports.device_create_fence(graphics->device);
+}
+
+void gpufence_destroy(gpufence_t fence)
+{
+	if (!thread_graphics || !fence) return;
+
+	thread_graphics->exports.gpufence_destroy(fence);
+}
+
+void gpufence_wait(gpufence_t fence)
+{
+	if (!thread_graphics || !fence) return;
+
+	thread_graphics->exports.gpufence_wait(fence);
+}
+
 #ifdef __APPLE__
 
 /** Platform specific functions */
@@ -1983,4 +2755,136 @@ void texture_release_dc(texture_t gdi_tex)
 		thread_graphics->exports.texture_release_dc(gdi_tex);
 }
 
+texture_t gs_texture_open_shared(uint32_t handle)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics) return NULL;
+
+	if (graphics->exports.device_texture_open_shared)
+		return graphics->exports.device_texture_open_shared(
+				graphics->device, handle);
+	return NULL;
+}
+
+duplicator_t gs_create_duplicator(void *monitor)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics || !monitor) return NULL;
+
+	if (graphics->exports.device_duplicator_create)
+		return graphics->exports.device_duplicator_create(
+				graphics->device, monitor);
+	return NULL;
+}
+
+void duplicator_destroy(duplicator_t duplicator)
+{
+	if (!thread_graphics || !duplicator)
+		return;
+
+	if (thread_graphics->exports.duplicator_destroy)
+		thread_graphics->exports.duplicator_destroy(duplicator);
+}
+
+bool duplicator_update_frame(duplicator_t duplicator)
+{
+	if (!thread_graphics || !duplicator)
+		return false;
+
+	if (thread_graphics->exports.duplicator_update_frame)
+		return thread_graphics->exports.duplicator_update_frame(
+				duplicator);
+	return false;
+}
+
+texture_t duplicator_gettexture(duplicator_t duplicator)
+{
+	if (!thread_graphics || !duplicator)
+		return NULL;
+
+	if (thread_graphics->exports.duplicator_gettexture)
+		return thread_graphics->exports.duplicator_gettexture(
+				duplicator);
+	return NULL;
+}
+
+texture_t duplicator_getcursor(duplicator_t duplicator, int32_t *x, int32_t *y)
+{
+	if (!thread_graphics || !duplicator || !x || !y)
+		return NULL;
+
+	if (thread_graphics->exports.duplicator_getcursor)
+		return thread_graphics->exports.duplicator_getcursor(
+				duplicator, x, y);
+	return NULL;
+}
+
+int gs_create_deferred(graphics_t *pdeferred)
+{
+	graphics_t parent = thread_graphics;
+
+	if (!parent || !pdeferred)
+		return GS_ERROR_FAIL;
+	if (!parent->exports.device_create_deferred)
+		return GS_ERROR_NOT_SUPPORTED;
+
+	return create_child_context(parent, pdeferred,
+			parent->exports.device_create_deferred);
+}
+
+commandlist_t gs_finish_commandlist(void)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics || !graphics->parent) return NULL;
+
+	/* sprites batched so far have to be part of this list */
+	flush_sprite_batch(graphics);
+
+	if (graphics->exports.device_finish_commandlist)
+		return graphics->exports.device_finish_commandlist(
+				graphics->device);
+	return NULL;
+}
+
+void gs_execute_commandlist(commandlist_t list)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics || graphics->parent || !list) return;
+
+	if (graphics->exports.device_execute_commandlist)
+		graphics->exports.device_execute_commandlist(
+				graphics->device, list);
+}
+
+void commandlist_destroy(commandlist_t list)
+{
+	if (!thread_graphics || !list)
+		return;
+
+	if (thread_graphics->exports.commandlist_destroy)
+		thread_graphics->exports.commandlist_destroy(list);
+}
+
+#elif defined(__linux__)
+
+texture_t gs_create_texture_from_pixmap(unsigned long pixmap, bool *flip)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics || !pixmap || !flip ||
+			!graphics->exports.device_create_texture_from_pixmap)
+		return NULL;
+
+	return graphics->exports.device_create_texture_from_pixmap(
+			graphics->device, pixmap, flip);
+}
+
+bool texture_rebind_pixmap(texture_t texture)
+{
+	graphics_t graphics = thread_graphics;
+	if (!graphics || !texture || !graphics->exports.texture_rebind_pixmap)
+		return false;
+
+	return graphics->exports.texture_rebind_pixmap(texture);
+}
+
 #endif
@@ -71,7 +71,8 @@ enum gs_color_format {
 	GS_R32F,
 	GS_DXT1,
 	GS_DXT3,
-	GS_DXT5
+	GS_DXT5,
+	GS_R8G8
 };
 
 enum gs_zstencil_format {
@@ -246,6 +247,10 @@ struct effect_pass;
 struct effect_param;
 struct gs_device;
 struct graphics_subsystem;
+struct gs_memory_owner;
+struct gs_timer;
+struct gs_timer_range;
+struct gs_fence;
 
 typedef struct gs_texture         *texture_t;
 typedef struct gs_stage_surface   *stagesurf_t;
@@ -262,6 +267,10 @@ typedef struct effect_technique   *technique_t;
 typedef struct effect_param       *eparam_t;
 typedef struct gs_device          *device_t;
 typedef struct graphics_subsystem *graphics_t;
+typedef struct gs_memory_owner    *gs_memory_owner_t;
+typedef struct gs_timer           *gputimer_t;
+typedef struct gs_timer_range     *gputimer_range_t;
+typedef struct gs_fence           *gpufence_t;
 
 /* ---------------------------------------------------
  * shader functions
@@ -355,6 +364,16 @@ EXPORT void technique_endpass(technique_t technique);
 EXPORT size_t effect_numparams(effect_t effect);
 EXPORT eparam_t effect_getparambyidx(effect_t effect, size_t param);
 EXPORT eparam_t effect_getparambyname(effect_t effect, const char *name);
+
+/**
+ * Looks up several parameters at once, so parameters that are set on every
+ * draw can be looked up when the effect is loaded instead.  Parameters that
+ * aren't found are set to NULL.
+ *
+ * @return  true if all parameters were found
+ */
+EXPORT bool effect_getparams(effect_t effect, const char *const *names,
+		eparam_t *params, size_t num);
 EXPORT void effect_getparaminfo(effect_t effect, eparam_t param,
 		struct effect_param_info *info);
 
@@ -378,6 +397,10 @@ EXPORT void effect_setvec4(effect_t effect, eparam_t param,
 EXPORT void effect_settexture(effect_t effect, eparam_t param, texture_t val);
 EXPORT void effect_setval(effect_t effect, eparam_t param, const void *val,
 		size_t size);
+
+/** Sets a float for each parameter, skipping parameters that are NULL */
+EXPORT void effect_setfloats(effect_t effect, const eparam_t *params,
+		const float *vals, size_t num);
 EXPORT void effect_setdefault(effect_t effect, eparam_t param);
 
 /* ---------------------------------------------------
@@ -392,6 +415,55 @@ EXPORT void texrender_end(texrender_t texrender);
 EXPORT void texrender_reset(texrender_t texrender);
 EXPORT texture_t texrender_gettexture(texrender_t texrender);
 
+/*
+ * Render targets shared by everything that only needs one until it's been
+ * drawn from, such as filters.  A target is acquired for a size and format,
+ * rendered to and drawn from, then released again to be used for something
+ * else, so only as many targets exist as are in use at the same time.
+ * Targets that haven't been used for a while are destroyed by
+ * texrender_pool_trim, which should be called once per frame.
+ */
+EXPORT texrender_t texrender_pool_acquire(enum gs_color_format format,
+		uint32_t cx, uint32_t cy);
+EXPORT void texrender_pool_release(texrender_t texrender);
+EXPORT void texrender_pool_trim(void);
+
+/* ---------------------------------------------------
+ * memory accounting
+ * --------------------------------------------------- */
+
+/** estimated GPU memory used by graphics resources */
+struct gs_memory_usage {
+	uint64_t bytes;
+	uint32_t textures;
+	uint32_t stage_surfaces;
+	uint32_t zstencils;
+	uint32_t vertex_buffers;
+	uint32_t texrenders;
+};
+
+/*
+ * Textures, stage surfaces, zstencil buffers, vertex buffers and texture
+ * renderers count towards the memory owner that's current on the thread
+ * creating them, until they're destroyed.  Owners are set around the code
+ * creating resources for something, and the previous owner put back after.
+ */
+EXPORT gs_memory_owner_t gs_memory_owner_create(void);
+EXPORT void gs_memory_owner_destroy(gs_memory_owner_t owner);
+
+/** sets the owner for this thread, returns the previous one */
+EXPORT gs_memory_owner_t gs_set_memory_owner(gs_memory_owner_t owner);
+EXPORT gs_memory_owner_t gs_get_memory_owner(void);
+
+EXPORT void gs_memory_owner_get_usage(gs_memory_owner_t owner,
+		struct gs_memory_usage *usage);
+
+/** gets the usage of all resources, with or without an owner */
+EXPORT void gs_get_memory_usage(struct gs_memory_usage *usage);
+
+/** gets the usage of the pooled render targets of the current context */
+EXPORT void texrender_pool_get_usage(struct gs_memory_usage *usage);
+
 /* ---------------------------------------------------
  * graphics subsystem
  * --------------------------------------------------- */
@@ -407,6 +479,7 @@ EXPORT texture_t texrender_gettexture(texrender_t texrender);
 #define GS_SUCCESS               0
 #define GS_ERROR_MODULENOTFOUND -1
 #define GS_ERROR_FAIL           -2
+#define GS_ERROR_NOT_SUPPORTED  -3
 
 struct gs_window {
 #if defined(_WIN32)
@@ -420,6 +493,24 @@ struct gs_window {
 #endif
 };
 
+/**
+ * Returns whether a window was given.  Without one, the graphics subsystem
+ * creates a headless device that only renders to textures.
+ */
+static inline bool gs_window_valid(const struct gs_window *window)
+{
+#if defined(_WIN32)
+	return window->hwnd != NULL;
+#elif defined(__APPLE__)
+	return window->view != nil;
+#elif defined(__linux__)
+	return window->id != 0;
+#else
+	UNUSED_PARAMETER(window);
+	return false;
+#endif
+}
+
 struct gs_init_data {
 	struct gs_window        window;
 	uint32_t                cx, cy;
@@ -469,6 +560,16 @@ EXPORT void gs_texcoord2v(const struct vec2 *v, int unit);
 EXPORT input_t gs_getinput(void);
 EXPORT effect_t gs_geteffect(void);
 
+/**
+ * Creates an effect.  Syntax errors are reported right away, but the
+ * shaders of its passes are compiled in the background when the graphics
+ * module allows it, and the effect waits for them the first time one of its
+ * techniques is begun.  If they failed, the techniques of the effect have no
+ * passes.
+ *
+ *   Passing @error_string waits for the shaders before returning, so that
+ * shader errors are reported as well.
+ */
 EXPORT effect_t gs_create_effect_from_file(const char *file,
 		char **error_string);
 EXPORT effect_t gs_create_effect(const char *effect_string,
@@ -479,6 +580,28 @@ EXPORT shader_t gs_create_vertexshader_from_file(const char *file,
 EXPORT shader_t gs_create_pixelshader_from_file(const char *file,
 		char **error_string);
 
+/**
+ * Sets the directory that compiled shaders are cached in.  NULL disables
+ * the cache.  Must be set before shaders are created to have any effect.
+ */
+EXPORT void gs_set_shader_cache_path(const char *path);
+
+/**
+ * Shader cache functions for graphics modules.  The key is any string that
+ * uniquely identifies the compiled result (shader text, compiler target,
+ * driver version, etc).  Loaded data must be freed with bfree.
+ */
+EXPORT void *gs_shader_cache_load(const char *key, size_t *size);
+EXPORT void gs_shader_cache_save(const char *key, const void *data,
+		size_t size);
+
+/**
+ * Decodes an image file into 32bit pixel data.  Returns NULL on failure,
+ * otherwise the data must be freed with bfree.
+ */
+EXPORT uint8_t *gs_create_texture_file_data(const char *file,
+		enum gs_color_format *format, uint32_t *cx, uint32_t *cy);
+
 EXPORT texture_t gs_create_texture_from_file(const char *file,
 		uint32_t flags);
 EXPORT texture_t gs_create_cubetexture_from_file(const char *flie,
@@ -499,6 +622,38 @@ EXPORT texture_t gs_create_volumetexture_from_file(const char *flie,
 EXPORT void gs_draw_sprite(texture_t tex, uint32_t flip, uint32_t width,
 		uint32_t height);
 
+/** Draws a region of a texture as a sprite of the region's size */
+EXPORT void gs_draw_sprite_subregion(texture_t tex, uint32_t flip,
+		uint32_t sub_x, uint32_t sub_y,
+		uint32_t sub_cx, uint32_t sub_cy);
+
+/**
+ * Begins batching sprites.
+ *
+ *   While a batch is active, sprites drawn with gs_draw_sprite inside a
+ * single-pass technique of the given effect are transformed on the CPU and
+ * queued rather than drawn.  Queued sprites are drawn together (one draw call
+ * for each run of sprites using the same texture, which is assigned to the
+ * image parameter) when the batch is flushed or ended, or before any other
+ * drawing or change of render state.
+ */
+EXPORT void gs_sprite_batch_begin(effect_t effect, eparam_t image);
+EXPORT void gs_sprite_batch_flush(void);
+EXPORT void gs_sprite_batch_end(void);
+
+/**
+ * Crops the sprites drawn to the current render target.
+ *
+ *   The values are in units of the sprite size, and are cut off the sides of
+ * the sprite by shrinking the quad and its texture coordinates, so the rest
+ * of the sprite stays in place.  Sprites drawn to other render targets in the
+ * mean time (such as intermediate passes) aren't affected.  Cleared by
+ * gs_reset_sprite_crop.
+ */
+EXPORT void gs_set_sprite_crop(float left, float top, float right,
+		float bottom);
+EXPORT void gs_reset_sprite_crop(void);
+
 EXPORT void gs_draw_cube_backdrop(texture_t cubetex, const struct quat *rot,
 		float left, float right, float top, float bottom, float znear);
 
@@ -513,6 +668,10 @@ EXPORT void gs_set3dmode(double fovy, double znear, double zvar);
 EXPORT void gs_viewport_push(void);
 EXPORT void gs_viewport_pop(void);
 
+/** saves/restores blending enablement and the blend function */
+EXPORT void gs_blend_state_push(void);
+EXPORT void gs_blend_state_pop(void);
+
 EXPORT void texture_setimage(texture_t tex, const void *data,
 		uint32_t linesize, bool invert);
 EXPORT void cubetexture_setimage(texture_t cubetex, uint32_t side,
@@ -600,6 +759,13 @@ EXPORT void gs_clear(uint32_t clear_flags, struct vec4 *color,
 		float depth, uint8_t stencil);
 EXPORT void gs_present(void);
 
+/**
+ * Returns false if the loaded swap chain has no free buffer yet, in which
+ * case the frame can be skipped instead of waiting for one in gs_present.
+ * Always true for graphics modules that can't tell.
+ */
+EXPORT bool gs_swapchain_ready(void);
+
 EXPORT void gs_setcullmode(enum gs_cull_mode mode);
 EXPORT enum gs_cull_mode gs_getcullmode(void);
 
@@ -610,6 +776,9 @@ EXPORT void gs_enable_stencilwrite(bool enable);
 EXPORT void gs_enable_color(bool red, bool green, bool blue, bool alpha);
 
 EXPORT void gs_blendfunction(enum gs_blend_type src, enum gs_blend_type dest);
+EXPORT void gs_blendfunction_separate(
+		enum gs_blend_type src_c, enum gs_blend_type dest_c,
+		enum gs_blend_type src_a, enum gs_blend_type dest_a);
 EXPORT void gs_depthfunction(enum gs_depth_test test);
 
 EXPORT void gs_stencilfunction(enum gs_stencil_side side,
@@ -627,6 +796,7 @@ EXPORT void gs_setcolorramp(float gamma, float brightness, float contrast);
 
 EXPORT void gs_setviewport(int x, int y, int width, int height);
 EXPORT void gs_getviewport(struct gs_rect *rect);
+/** enables the scissor test with the given rect, or disables it if NULL */
 EXPORT void gs_setscissorrect(struct gs_rect *rect);
 
 EXPORT void gs_ortho(float left, float right, float top, float bottom,
@@ -637,6 +807,12 @@ EXPORT void gs_frustum(float left, float right, float top, float bottom,
 EXPORT void gs_projection_push(void);
 EXPORT void gs_projection_pop(void);
 
+/**
+ * Gets the area of the current projection, as given to gs_ortho.  Returns
+ * false if the current projection isn't orthographic.
+ */
+EXPORT bool gs_getortho(float *left, float *right, float *top, float *bottom);
+
 EXPORT void     swapchain_destroy(swapchain_t swapchain);
 
 EXPORT void     texture_destroy(texture_t tex);
@@ -654,6 +830,13 @@ EXPORT bool     texture_isrect(texture_t tex);
  * For example, for GL, this is a GLuint*.  For D3D11, ID3D11Texture2D*.
  */
 EXPORT void    *texture_getobj(texture_t tex);
+/**
+ * Updates a sub-rectangle of a texture.  @data holds @cy rows of @linesize
+ * bytes.  Not supported by every graphics module, returns false if the
+ * region could not be updated.
+ */
+EXPORT bool     texture_setimage_region(texture_t tex, uint32_t x, uint32_t y,
+		uint32_t cx, uint32_t cy, const void *data, uint32_t linesize);
 
 EXPORT void     cubetexture_destroy(texture_t cubetex);
 EXPORT uint32_t cubetexture_getsize(texture_t cubetex);
@@ -669,6 +852,7 @@ EXPORT void     stagesurface_destroy(stagesurf_t stagesurf);
 EXPORT uint32_t stagesurface_getwidth(stagesurf_t stagesurf);
 EXPORT uint32_t stagesurface_getheight(stagesurf_t stagesurf);
 EXPORT enum gs_color_format stagesurface_getcolorformat(stagesurf_t stagesurf);
+EXPORT bool     stagesurface_isready(stagesurf_t stagesurf);
 EXPORT bool     stagesurface_map(stagesurf_t stagesurf, uint8_t **data,
 		uint32_t *linesize);
 EXPORT void     stagesurface_unmap(stagesurf_t stagesurf);
@@ -679,6 +863,16 @@ EXPORT void     samplerstate_destroy(samplerstate_t samplerstate);
 
 EXPORT void     vertexbuffer_destroy(vertbuffer_t vertbuffer);
 EXPORT void     vertexbuffer_flush(vertbuffer_t vertbuffer, bool rebuild);
+
+/**
+ * Uploads only vertices [start, start+num) of a dynamic vertex buffer.
+ *
+ * With discard, the rest of the buffer's contents become undefined.  Without
+ * it, the caller guarantees that no draw already queued uses the range, so
+ * the upload never has to wait for the GPU.
+ */
+EXPORT void     vertexbuffer_flush_range(vertbuffer_t vertbuffer,
+		size_t start, size_t num, bool discard);
 EXPORT struct vb_data *vertexbuffer_getdata(vertbuffer_t vertbuffer);
 
 EXPORT void     indexbuffer_destroy(indexbuffer_t indexbuffer);
@@ -687,6 +881,80 @@ EXPORT void     *indexbuffer_getdata(indexbuffer_t indexbuffer);
 EXPORT size_t   indexbuffer_numindices(indexbuffer_t indexbuffer);
 EXPORT enum gs_index_type indexbuffer_gettype(indexbuffer_t indexbuffer);
 
+/* ------------------------------------------------------------------------- */
+/* GPU timer queries */
+
+/**
+ * Creates a timer that measures how long the GPU takes to execute the
+ * commands issued between gputimer_begin and gputimer_end.  The results only
+ * become available a few frames later, so a timer should be read back with
+ * gputimer_get_data before it's reused, instead of waiting on it.
+ *
+ *   Timers are only meaningful between the begin and end of a timer range,
+ * which tells whether the timestamps are valid and what their frequency is.
+ *
+ * Returns NULL if the graphics module doesn't support timer queries.
+ */
+EXPORT gputimer_t gs_create_timer(void);
+EXPORT void     gputimer_destroy(gputimer_t timer);
+EXPORT void     gputimer_begin(gputimer_t timer);
+EXPORT void     gputimer_end(gputimer_t timer);
+
+/**
+ * Gets the elapsed time of a timer in ticks of its range's frequency.
+ * Returns false without waiting if the GPU hasn't gotten that far yet.
+ */
+EXPORT bool     gputimer_get_data(gputimer_t timer, uint64_t *ticks);
+
+EXPORT gputimer_range_t gs_create_timer_range(void);
+EXPORT void     gputimer_range_destroy(gputimer_range_t range);
+EXPORT void     gputimer_range_begin(gputimer_range_t range);
+EXPORT void     gputimer_range_end(gputimer_range_t range);
+
+/**
+ * Gets whether the timestamps of the timers in the range are invalid (for
+ * example because the GPU clock changed), and the number of ticks per
+ * second.  Returns false without waiting if the results aren't ready yet.
+ */
+EXPORT bool     gputimer_range_get_data(gputimer_range_t range,
+		bool *disjoint, uint64_t *frequency);
+
+/* ------------------------------------------------------------------------- */
+/* shared contexts */
+
+/**
+ * Creates a graphics context that shares textures, samplers, shaders and
+ * index buffers with @parent, so that a loader thread can create and upload
+ * them without waiting on the thread rendering with @parent.  Vertex buffers
+ * can't be shared.
+ *
+ *   The context has to be created, used and destroyed by a single thread,
+ * which shouldn't have another context current at the time it's created.
+ * Objects created on it belong to @parent.  Before @parent uses one, the
+ * shared context should create a fence after the upload, which @parent
+ * waits on with gpufence_wait.
+ *
+ * Returns GS_ERROR_NOT_SUPPORTED if the graphics module can't share objects
+ * between contexts, in which case uploads should be queued for @parent's
+ * thread instead.  Destroy it with gs_destroy, before @parent.
+ */
+EXPORT int gs_create_shared(graphics_t parent, graphics_t *shared);
+
+/**
+ * Creates a fence that's signaled when the commands issued on the current
+ * context so far have completed.  Returns NULL if the graphics module
+ * doesn't support fences.
+ */
+EXPORT gpufence_t gs_create_fence(void);
+EXPORT void     gpufence_destroy(gpufence_t fence);
+
+/**
+ * Makes the GPU wait for a fence created on another context before running
+ * the commands issued next on the current context.  Doesn't block the
+ * calling thread.
+ */
+EXPORT void     gpufence_wait(gpufence_t fence);
+
 #ifdef __APPLE__
 
 /** platform specific function for creating (GL_TEXTURE_RECTANGLE) textures
@@ -704,6 +972,74 @@ EXPORT texture_t gs_create_gdi_texture(uint32_t width, uint32_t height);
 EXPORT void *texture_get_dc(texture_t gdi_tex);
 EXPORT void texture_release_dc(texture_t gdi_tex);
 
+/**
+ * Opens a texture that was shared by another device or process.  The handle
+ * is a legacy DXGI shared handle, which is the same in 32 and 64 bit
+ * processes.  The format and size are taken from the shared texture.
+ */
+EXPORT texture_t gs_texture_open_shared(uint32_t handle);
+
+typedef struct gs_duplicator *duplicator_t;
+
+/**
+ * Creates a desktop duplicator (DXGI 1.2, windows 8 and up) for the monitor
+ * with the given HMONITOR handle.  Returns NULL if duplication isn't
+ * available.
+ */
+EXPORT duplicator_t gs_create_duplicator(void *monitor);
+EXPORT void duplicator_destroy(duplicator_t duplicator);
+
+/**
+ * Copies the changed parts of the desktop into the duplicator's texture.
+ * Returns false if the duplicator has become invalid (for example after a
+ * mode change) and has to be recreated.
+ */
+EXPORT bool duplicator_update_frame(duplicator_t duplicator);
+EXPORT texture_t duplicator_gettexture(duplicator_t duplicator);
+
+/**
+ * Gets the hardware cursor shape and the position of its top left corner
+ * relative to the monitor.  Returns NULL if the cursor isn't visible.
+ */
+EXPORT texture_t duplicator_getcursor(duplicator_t duplicator,
+		int32_t *x, int32_t *y);
+
+typedef struct gs_command_list *commandlist_t;
+
+/**
+ * Creates a graphics context that records into a D3D11 deferred context
+ * instead of drawing, for building command lists on a worker thread while
+ * the video thread renders.  It shares all resources with the immediate
+ * context that is current on the calling thread, but has its own render
+ * state, so it can be entered by another thread at the same time.
+ *
+ *   Resources should still be created, mapped and staged on the immediate
+ * context, and an effect shouldn't be used by two contexts at once.
+ *
+ * Returns GS_ERROR_NOT_SUPPORTED if the graphics module can't record
+ * command lists.  Destroy it with gs_destroy.
+ */
+EXPORT int gs_create_deferred(graphics_t *deferred);
+
+/** Ends recording on the current deferred context and returns the list */
+EXPORT commandlist_t gs_finish_commandlist(void);
+
+/** Plays back a command list on the current immediate context */
+EXPORT void gs_execute_commandlist(commandlist_t list);
+EXPORT void commandlist_destroy(commandlist_t list);
+
+#elif defined(__linux__)
+
+/**
+ * X11 specific function for creating a texture that is bound directly to an
+ * X pixmap (GLX_EXT_texture_from_pixmap), without copying it.  @flip is set
+ * if the texture has to be drawn vertically flipped.
+ */
+EXPORT texture_t gs_create_texture_from_pixmap(unsigned long pixmap,
+		bool *flip);
+/** makes the current contents of the pixmap visible through the texture */
+EXPORT bool     texture_rebind_pixmap(texture_t texture);
+
 #endif
 
 /* inline functions used by modules */
@@ -728,6 +1064,7 @@ static inline uint32_t gs_get_format_bpp(enum gs_color_format format)
 	case GS_DXT1:        return 4;
 	case GS_DXT3:        return 8;
 	case GS_DXT5:        return 8;
+	case GS_R8G8:        return 16;
 	case GS_UNKNOWN:     return 0;
 	}
 
@@ -739,6 +1076,22 @@ static inline bool gs_is_compressed_format(enum gs_color_format format)
 	return (format == GS_DXT1 || format == GS_DXT3 || format == GS_DXT5);
 }
 
+/* compressed formats are stored in rows of 4x4 pixel blocks */
+static inline uint32_t gs_get_compressed_row_size(enum gs_color_format format,
+		uint32_t width)
+{
+	uint32_t block_size = (format == GS_DXT1) ? 8 : 16;
+	uint32_t blocks     = (width + 3) / 4;
+	return (blocks ? blocks : 1) * block_size;
+}
+
+static inline uint32_t gs_get_compressed_level_size(
+		enum gs_color_format format, uint32_t width, uint32_t height)
+{
+	uint32_t rows = (height + 3) / 4;
+	return (rows ? rows : 1) * gs_get_compressed_row_size(format, width);
+}
+
 static inline uint32_t gs_num_total_levels(uint32_t width, uint32_t height)
 {
 	uint32_t size = width > height ? width : height;
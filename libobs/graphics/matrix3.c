@@ -74,13 +74,36 @@ void matrix3_from_matrix4(struct matrix3 *dst, const struct matrix4 *m)
 	dst->t.w = 0.0f;
 }
 
+static inline __m128 rotate_columns(__m128 v, __m128 c0, __m128 c1,
+		__m128 c2)
+{
+	return _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(0,0,0,0)), c0),
+			_mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1,1,1,1)), c1)),
+			_mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2,2,2,2)), c2));
+}
+
 void matrix3_mul(struct matrix3 *dst, const struct matrix3 *m1,
 		const struct matrix3 *m2)
 {
-	vec3_rotate(&dst->x, &m1->x, m2);
-	vec3_rotate(&dst->y, &m1->y, m2);
-	vec3_rotate(&dst->z, &m1->z, m2);
-	vec3_transform(&dst->t, &m1->t, m2);
+	__m128 c0 = m2->x.m, c1 = m2->y.m, c2 = m2->z.m, c3 = _mm_setzero_ps();
+	__m128 x, y, z, t;
+
+	/* m2 is transposed once so every row of m1 is rotated without any
+	 * horizontal adds; dst can be m1, so nothing is written until the
+	 * end */
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+	x = rotate_columns(m1->x.m, c0, c1, c2);
+	y = rotate_columns(m1->y.m, c0, c1, c2);
+	z = rotate_columns(m1->z.m, c0, c1, c2);
+	t = _mm_sub_ps(rotate_columns(m1->t.m, c0, c1, c2),
+	               rotate_columns(m2->t.m, c0, c1, c2));
+
+	dst->x.m = x;
+	dst->y.m = y;
+	dst->z.m = z;
+	dst->t.m = t;
 }
 
 void matrix3_rotate(struct matrix3 *dst, const struct matrix3 *m,
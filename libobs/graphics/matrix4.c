@@ -32,19 +32,27 @@ void matrix4_mul(struct matrix4 *dst, const struct matrix4 *m1,
 		const struct matrix4 *m2)
 {
 	const struct vec4 *m1v = (const struct vec4*)m1;
-	const float *m2f = (const float*)m2;
-	struct vec4 out[4];
-	int i, j;
+	__m128 out[4];
+	int i;
 
+	/* each row of the result is a linear combination of the rows of m2,
+	 * so no horizontal adds or transposes are needed */
 	for (i = 0; i < 4; i++) {
-		for (j=0; j<4; j++) {
-			struct vec4 temp;
-			vec4_set(&temp, m2f[j], m2f[j+4], m2f[j+8], m2f[j+12]);
-			out[i].ptr[j] = vec4_dot(&m1v[i], &temp);
-		}
+		__m128 r = m1v[i].m;
+		__m128 x = _mm_shuffle_ps(r, r, _MM_SHUFFLE(0, 0, 0, 0));
+		__m128 y = _mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 z = _mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2));
+		__m128 w = _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3));
+
+		out[i] = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(x, m2->x.m), _mm_mul_ps(y, m2->y.m)),
+			_mm_add_ps(_mm_mul_ps(z, m2->z.m), _mm_mul_ps(w, m2->t.m)));
 	}
 
-	matrix4_copy(dst, (struct matrix4*)out);
+	dst->x.m = out[0];
+	dst->y.m = out[1];
+	dst->z.m = out[2];
+	dst->t.m = out[3];
 }
 
 static inline void get_3x3_submatrix(float *dst, const struct matrix4 *m,
@@ -98,49 +106,110 @@ float matrix4_determinant(const struct matrix4 *m)
 	return result;
 }
 
-bool matrix4_inv(struct matrix4 *dst, const struct matrix4 *m)
+#define swizzle(v, x, y, z, w) _mm_shuffle_ps(v, v, _MM_SHUFFLE(w, z, y, x))
+
+/* products of 2x2 matrices packed in to one register as (m00 m01 m10 m11),
+ * where adj is the adjugate (the inverse scaled by the determinant) */
+static inline __m128 mat2_mul(__m128 a, __m128 b)
 {
-	struct vec4 *dstv = (struct vec4 *)dst;
-	float det = matrix4_determinant(m);
-	float m3x3[9];
-	int   i, j, sign;
+	return _mm_add_ps(_mm_mul_ps(a, swizzle(b, 0, 3, 0, 3)),
+	                  _mm_mul_ps(swizzle(a, 1, 0, 3, 2),
+	                             swizzle(b, 2, 1, 2, 1)));
+}
+
+/* adj(a) * b */
+static inline __m128 mat2_adj_mul(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(swizzle(a, 3, 3, 0, 0), b),
+	                  _mm_mul_ps(swizzle(a, 1, 1, 2, 2),
+	                             swizzle(b, 2, 3, 0, 1)));
+}
+
+/* a * adj(b) */
+static inline __m128 mat2_mul_adj(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(a, swizzle(b, 3, 0, 3, 0)),
+	                  _mm_mul_ps(swizzle(a, 1, 0, 3, 2),
+	                             swizzle(b, 2, 1, 2, 1)));
+}
 
-	if (fabs(det) < 0.0005f)
+/*
+ * Blockwise inverse: the matrix is split in to four 2x2 blocks
+ *
+ *   | A B |
+ *   | C D |
+ *
+ * and the inverse is built from their adjugates and determinants, which keeps
+ * every step in SSE registers instead of expanding sixteen 3x3 cofactors.
+ */
+bool matrix4_inv(struct matrix4 *dst, const struct matrix4 *m)
+{
+	__m128 r0 = m->x.m, r1 = m->y.m, r2 = m->z.m, r3 = m->t.m;
+	__m128 a = _mm_movelh_ps(r0, r1);
+	__m128 b = _mm_movehl_ps(r1, r0);
+	__m128 c = _mm_movelh_ps(r2, r3);
+	__m128 d = _mm_movehl_ps(r3, r2);
+	__m128 det_sub, det_a, det_b, det_c, det_d;
+	__m128 d_c, a_b, x, y, z, w, tr, det;
+	struct vec4 det_v;
+
+	/* (|A| |B| |C| |D|) */
+	det_sub = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)),
+		           _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)),
+		           _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0))));
+
+	det_a = swizzle(det_sub, 0, 0, 0, 0);
+	det_b = swizzle(det_sub, 1, 1, 1, 1);
+	det_c = swizzle(det_sub, 2, 2, 2, 2);
+	det_d = swizzle(det_sub, 3, 3, 3, 3);
+
+	d_c = mat2_adj_mul(d, c);
+	a_b = mat2_adj_mul(a, b);
+
+	x = _mm_sub_ps(_mm_mul_ps(det_d, a), mat2_mul(b, d_c));
+	w = _mm_sub_ps(_mm_mul_ps(det_a, d), mat2_mul(c, a_b));
+	y = _mm_sub_ps(_mm_mul_ps(det_b, c), mat2_mul_adj(d, a_b));
+	z = _mm_sub_ps(_mm_mul_ps(det_c, b), mat2_mul_adj(a, d_c));
+
+	/* |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C) */
+	tr = _mm_mul_ps(a_b, swizzle(d_c, 0, 2, 1, 3));
+	tr = _mm_add_ps(tr, _mm_movehl_ps(tr, tr));
+	tr = _mm_add_ps(tr, swizzle(tr, 1, 1, 1, 1));
+
+	det = _mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c));
+	det = _mm_sub_ps(det, swizzle(tr, 0, 0, 0, 0));
+
+	det_v.m = det;
+	if (fabs(det_v.x) < 0.0005f)
 		return false;
 
-	for (i = 0; i < 4; i++) {
-		for (j = 0; j < 4; j++) {
-			sign = 1 - ((i+j) % 2) * 2;
-			get_3x3_submatrix(m3x3, m, i, j);
-			dstv[j].ptr[i] = get_3x3_determinant(m3x3) *
-			                  (float)sign / det;
-		}
-	}
+	det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+
+	x = _mm_mul_ps(x, det);
+	y = _mm_mul_ps(y, det);
+	z = _mm_mul_ps(z, det);
+	w = _mm_mul_ps(w, det);
 
+	/* the adjugate shuffle and the block interleave in one step */
+	dst->x.m = _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3));
+	dst->y.m = _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2));
+	dst->z.m = _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3));
+	dst->t.m = _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2));
 	return true;
 }
 
+#undef swizzle
+
 void matrix4_transpose(struct matrix4 *dst, const struct matrix4 *m)
 {
-	struct matrix4 temp;
-
-	/* TODO: Add SSE */
-	temp.x.x = m->x.x;
-	temp.x.y = m->y.x;
-	temp.x.z = m->z.x;
-	temp.x.w = m->t.x;
-	temp.y.x = m->x.y;
-	temp.y.y = m->y.y;
-	temp.y.z = m->z.y;
-	temp.y.w = m->t.y;
-	temp.z.x = m->x.z;
-	temp.z.y = m->y.z;
-	temp.z.z = m->z.z;
-	temp.z.w = m->t.z;
-	temp.t.x = m->x.w;
-	temp.t.y = m->y.w;
-	temp.t.z = m->z.w;
-	temp.t.w = m->t.w;
-
-	matrix4_copy(dst, &temp);
+	__m128 x = m->x.m, y = m->y.m, z = m->z.m, t = m->t.m;
+
+	_MM_TRANSPOSE4_PS(x, y, z, t);
+
+	dst->x.m = x;
+	dst->y.m = y;
+	dst->z.m = z;
+	dst->t.m = t;
 }
@@ -0,0 +1,175 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <stdio.h>
+#include "../util/base.h"
+#include "../util/dstr.h"
+#include "../util/platform.h"
+#include "../util/threading.h"
+#include "graphics-internal.h"
+
+/*
+ * Compiled shader binaries are stored as <cache path>/<hash>.bin, where the
+ * hash is taken from a key string chosen by the graphics module (usually the
+ * final shader text plus anything that affects compilation, like the driver
+ * version).  A second hash and the key length are stored in the file to
+ * catch hash collisions.  Bump SHADER_CACHE_VERSION when the format changes.
+ */
+
+#define SHADER_CACHE_VERSION 1
+
+static volatile long tmp_file_id = 0;
+
+struct shader_cache_header {
+	char     magic[4];
+	uint32_t version;
+	uint64_t key_hash;
+	uint64_t key_len;
+	uint64_t size;
+};
+
+static inline uint64_t hash_fnv1a(const char *str, uint64_t hash)
+{
+	while (*str) {
+		hash ^= (uint8_t)*(str++);
+		hash *= 0x100000001B3ULL;
+	}
+
+	return hash;
+}
+
+static inline uint64_t hash_djb2(const char *str)
+{
+	uint64_t hash = 5381;
+
+	while (*str)
+		hash = ((hash << 5) + hash) + (uint8_t)*(str++);
+
+	return hash;
+}
+
+static bool get_cache_file(struct graphics_subsystem *graphics,
+		const char *key, struct dstr *file)
+{
+	if (!graphics || !graphics->shader_cache_path || !key)
+		return false;
+
+	dstr_printf(file, "%s/%016llx.bin", graphics->shader_cache_path,
+			(unsigned long long)hash_fnv1a(key,
+				0xCBF29CE484222325ULL));
+	return true;
+}
+
+void gs_set_shader_cache_path(const char *path)
+{
+	graphics_t graphics = gs_getcontext();
+	if (!graphics) return;
+
+	bfree(graphics->shader_cache_path);
+	graphics->shader_cache_path = NULL;
+
+	if (path && *path) {
+		if (os_mkdir(path) == MKDIR_ERROR) {
+			blog(LOG_WARNING, "Could not create shader cache "
+			                  "directory '%s'", path);
+			return;
+		}
+
+		graphics->shader_cache_path = bstrdup(path);
+	}
+}
+
+void *gs_shader_cache_load(const char *key, size_t *size)
+{
+	struct shader_cache_header header;
+	struct dstr file = {0};
+	void  *data = NULL;
+	FILE  *f;
+
+	if (!get_cache_file(gs_getcontext(), key, &file))
+		return NULL;
+
+	f = os_fopen(file.array, "rb");
+	dstr_free(&file);
+	if (!f)
+		return NULL;
+
+	if (fread(&header, 1, sizeof(header), f) != sizeof(header))
+		goto finish;
+
+	if (memcmp(header.magic, "GSSC", 4) != 0              ||
+	    header.version  != SHADER_CACHE_VERSION           ||
+	    header.key_hash != hash_djb2(key)                 ||
+	    header.key_len  != (uint64_t)strlen(key)          ||
+	    !header.size)
+		goto finish;
+
+	data = bmalloc((size_t)header.size);
+	if (fread(data, 1, (size_t)header.size, f) != (size_t)header.size) {
+		bfree(data);
+		data = NULL;
+		goto finish;
+	}
+
+	*size = (size_t)header.size;
+
+finish:
+	fclose(f);
+	return data;
+}
+
+void gs_shader_cache_save(const char *key, const void *data, size_t size)
+{
+	struct shader_cache_header header = {{'G', 'S', 'S', 'C'}};
+	struct dstr file     = {0};
+	struct dstr tmp_file = {0};
+	bool  success;
+	FILE  *f;
+
+	if (!data || !size || !get_cache_file(gs_getcontext(), key, &file))
+		return;
+
+	header.version  = SHADER_CACHE_VERSION;
+	header.key_hash = hash_djb2(key);
+	header.key_len  = (uint64_t)strlen(key);
+	header.size     = (uint64_t)size;
+
+	/* write to a temporary file first so that other instances never load
+	 * a partially written binary.  effects share a lot of shaders, so the
+	 * compile threads can be saving the same one at once */
+	dstr_copy_dstr(&tmp_file, &file);
+	dstr_catf(&tmp_file, ".%ld.tmp", os_atomic_inc_long(&tmp_file_id));
+
+	f = os_fopen(tmp_file.array, "wb");
+	if (!f)
+		goto finish;
+
+	success = fwrite(&header, 1, sizeof(header), f) == sizeof(header) &&
+	          fwrite(data, 1, size, f) == size;
+	fclose(f);
+
+	remove(file.array);
+	if (!success || rename(tmp_file.array, file.array) != 0) {
+		blog(LOG_WARNING, "Failed to write shader cache file '%s'",
+				file.array);
+		remove(tmp_file.array);
+	}
+
+finish:
+	dstr_free(&tmp_file);
+	dstr_free(&file);
+}
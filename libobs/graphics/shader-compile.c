@@ -0,0 +1,337 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "../util/base.h"
+#include "../util/bmem.h"
+#include "../util/platform.h"
+#include "graphics-internal.h"
+#include "effect.h"
+
+/*
+ * Compiling the shaders of an effect is what makes creating one slow, and
+ * plugins create theirs one after another while they load.  A parsed
+ * effect's pass shaders are compiled on a few threads instead, each with
+ * its own shared (GL) or deferred (D3D11) context, and the effect only
+ * waits for them the first time a technique of it is used.  Whoever waits
+ * compiles the shaders no thread has started on yet, so an effect used
+ * right after it's created isn't slower than before.
+ */
+
+#define MAX_COMPILE_THREADS 4
+
+static void compile_shader(struct effect_shader_job *job, bool worker)
+{
+	if (job->type == SHADER_VERTEX)
+		job->shader = gs_create_vertexshader(job->shader_str,
+				job->location, NULL);
+	else
+		job->shader = gs_create_pixelshader(job->shader_str,
+				job->location, NULL);
+
+	/* the main context can't use a GL program before the commands that
+	 * created it have finished.  D3D11 doesn't support fences, and
+	 * doesn't need them */
+	if (worker && job->shader)
+		job->fence = gs_create_fence();
+}
+
+static void *compile_thread(void *param)
+{
+	struct graphics_subsystem *graphics = param;
+	graphics_t context = NULL;
+
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "shader compile");
+
+	if (gs_create_compile_context(graphics, &context) != GS_SUCCESS) {
+		blog(LOG_WARNING, "Failed to create a shader compile context, "
+		                  "shaders are compiled when their effects "
+		                  "are first used");
+		return NULL;
+	}
+
+	while (os_sem_wait(graphics->compile_sem) == 0) {
+		struct effect_shader_job *job = NULL;
+		bool stop;
+
+		pthread_mutex_lock(&graphics->compile_mutex);
+		stop = graphics->compile_stop;
+		if (!stop && graphics->compile_queue.num) {
+			job = graphics->compile_queue.array[0];
+			da_erase(graphics->compile_queue, 0);
+		}
+		pthread_mutex_unlock(&graphics->compile_mutex);
+
+		if (stop)
+			break;
+		if (!job)
+			continue;
+
+		gs_entercontext(context);
+		compile_shader(job, true);
+		gs_leavecontext();
+
+		if (os_atomic_dec_long(&job->effect->compile_pending) == 0)
+			os_event_signal(job->effect->compile_event);
+	}
+
+	gs_destroy(context);
+	return NULL;
+}
+
+static void start_compile_threads(struct graphics_subsystem *graphics)
+{
+	int threads = os_get_logical_cores() - 1;
+
+	if (threads < 1)
+		threads = 1;
+	if (threads > MAX_COMPILE_THREADS)
+		threads = MAX_COMPILE_THREADS;
+
+	if (os_sem_init(&graphics->compile_sem, 0) != 0)
+		return;
+
+	for (int i = 0; i < threads; i++) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, compile_thread,
+					graphics) == 0)
+			da_push_back(graphics->compile_threads, &thread);
+	}
+
+	if (!graphics->compile_threads.num) {
+		blog(LOG_WARNING, "Failed to create shader compile threads");
+		os_sem_destroy(graphics->compile_sem);
+		graphics->compile_sem = NULL;
+	}
+}
+
+static inline bool has_compile_contexts(
+		struct graphics_subsystem *graphics)
+{
+#ifdef _WIN32
+	if (graphics->exports.device_create_deferred)
+		return true;
+#endif
+	return graphics->exports.device_create_shared &&
+		graphics->exports.device_create_fence;
+}
+
+bool gs_can_compile_shaders_async(struct graphics_subsystem *graphics)
+{
+	bool success;
+
+	/* contexts made from another one compile on their own thread */
+	if (!graphics || graphics->parent)
+		return false;
+
+	if (!has_compile_contexts(graphics))
+		return false;
+
+	pthread_mutex_lock(&graphics->compile_mutex);
+
+	if (!graphics->compile_started && !graphics->compile_stop) {
+		graphics->compile_started = true;
+		start_compile_threads(graphics);
+	}
+
+	success = graphics->compile_threads.num && !graphics->compile_stop;
+
+	pthread_mutex_unlock(&graphics->compile_mutex);
+	return success;
+}
+
+void gs_stop_shader_compile(struct graphics_subsystem *graphics)
+{
+	pthread_mutex_lock(&graphics->compile_mutex);
+	graphics->compile_stop = true;
+	pthread_mutex_unlock(&graphics->compile_mutex);
+
+	if (!graphics->compile_threads.num)
+		return;
+
+	for (size_t i = 0; i < graphics->compile_threads.num; i++)
+		os_sem_post(graphics->compile_sem);
+	for (size_t i = 0; i < graphics->compile_threads.num; i++)
+		pthread_join(graphics->compile_threads.array[i], NULL);
+
+	os_sem_destroy(graphics->compile_sem);
+	graphics->compile_sem = NULL;
+
+	da_free(graphics->compile_threads);
+}
+
+void effect_queue_shaders(effect_t effect)
+{
+	struct graphics_subsystem *graphics = effect->graphics;
+	size_t num = effect->compile_jobs.num;
+
+	if (os_event_init(&effect->compile_event, OS_EVENT_TYPE_MANUAL) != 0) {
+		effect->compile_event = NULL;
+		return;
+	}
+
+	effect->compile_pending = (long)num;
+	effect->compile_queued  = true;
+
+	pthread_mutex_lock(&graphics->compile_mutex);
+	for (size_t i = 0; i < num; i++) {
+		struct effect_shader_job *job = effect->compile_jobs.array+i;
+		da_push_back(graphics->compile_queue, &job);
+	}
+	pthread_mutex_unlock(&graphics->compile_mutex);
+
+	for (size_t i = 0; i < num; i++)
+		os_sem_post(graphics->compile_sem);
+}
+
+/* takes back the jobs of the effect that are still queued */
+static void unqueue_shaders(effect_t effect,
+		struct darray *jobs /* struct effect_shader_job* */)
+{
+	struct graphics_subsystem *graphics = effect->graphics;
+
+	pthread_mutex_lock(&graphics->compile_mutex);
+
+	for (size_t i = graphics->compile_queue.num; i > 0; i--) {
+		struct effect_shader_job *job =
+			graphics->compile_queue.array[i-1];
+
+		if (job->effect == effect) {
+			darray_push_back(sizeof(struct effect_shader_job*),
+					jobs, &job);
+			da_erase(graphics->compile_queue, i-1);
+		}
+	}
+
+	pthread_mutex_unlock(&graphics->compile_mutex);
+}
+
+/* waits for the compile threads to be done with the jobs of the effect.
+ * the ones they haven't started on are taken back first, and compiled on
+ * the calling thread in the meantime if @compile is set */
+static void wait_for_threads(effect_t effect, bool compile)
+{
+	struct darray jobs; /* struct effect_shader_job* */
+	bool wait = true;
+
+	darray_init(&jobs);
+	unqueue_shaders(effect, &jobs);
+
+	for (size_t i = 0; i < jobs.num; i++) {
+		struct effect_shader_job **job = darray_item(
+				sizeof(struct effect_shader_job*), &jobs, i);
+
+		if (compile)
+			compile_shader(*job, false);
+
+		/* the threads only signal when they finish the last job, so
+		 * there's nothing to wait for if this thread did */
+		if (os_atomic_dec_long(&effect->compile_pending) == 0)
+			wait = false;
+	}
+
+	if (wait)
+		os_event_wait(effect->compile_event);
+
+	darray_free(&jobs);
+	os_event_destroy(effect->compile_event);
+	effect->compile_event  = NULL;
+	effect->compile_queued = false;
+}
+
+static bool finish_shader(struct effect_shader_job *job)
+{
+	struct effect_pass *pass = job->pass;
+	shader_t shader = job->shader;
+	struct darray *pass_params;
+
+	if (!shader)
+		return false;
+
+	/* the pass owns the shader from now on */
+	job->shader = NULL;
+
+	if (job->type == SHADER_VERTEX) {
+		pass->vertshader = shader;
+		pass_params = &pass->vertshader_params.da;
+	} else {
+		pass->pixelshader = shader;
+		pass_params = &pass->pixelshader_params.da;
+	}
+
+	return effect_link_shader_params(pass_params, shader);
+}
+
+static void free_jobs(effect_t effect)
+{
+	for (size_t i = 0; i < effect->compile_jobs.num; i++) {
+		struct effect_shader_job *job = effect->compile_jobs.array+i;
+
+		if (job->fence) {
+			gpufence_wait(job->fence);
+			gpufence_destroy(job->fence);
+		}
+
+		bfree(job->shader_str);
+		bfree(job->location);
+		shader_destroy(job->shader);
+	}
+
+	da_free(effect->compile_jobs);
+}
+
+bool effect_finish_shaders(effect_t effect)
+{
+	if (!effect->compile_jobs.num)
+		return !effect->compile_failed;
+
+	if (effect->compile_queued) {
+		wait_for_threads(effect, true);
+	} else {
+		for (size_t i = 0; i < effect->compile_jobs.num; i++)
+			compile_shader(effect->compile_jobs.array+i, false);
+	}
+
+	for (size_t i = 0; i < effect->compile_jobs.num; i++) {
+		struct effect_shader_job *job = effect->compile_jobs.array+i;
+
+		if (job->fence) {
+			gpufence_wait(job->fence);
+			gpufence_destroy(job->fence);
+			job->fence = NULL;
+		}
+
+		if (!finish_shader(job))
+			effect->compile_failed = true;
+	}
+
+	free_jobs(effect);
+
+	if (effect->compile_failed)
+		blog(LOG_ERROR, "Failed to compile the shaders of effect '%s'",
+				effect->effect_path ? effect->effect_path : "");
+
+	return !effect->compile_failed;
+}
+
+void effect_cancel_shaders(effect_t effect)
+{
+	if (effect->compile_queued)
+		wait_for_threads(effect, false);
+
+	free_jobs(effect);
+}
@@ -0,0 +1,365 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <string.h>
+#include "../util/bmem.h"
+#include "texture-compress.h"
+
+static inline uint32_t min_u32(uint32_t a, uint32_t b)
+{
+	return a < b ? a : b;
+}
+
+/* converts to tightly packed RGBA, replicating the edges into the padding */
+static uint8_t *convert_to_rgba(const uint8_t *data,
+		enum gs_color_format format, uint32_t cx, uint32_t cy,
+		uint32_t padded_cx, uint32_t padded_cy, bool *has_alpha)
+{
+	uint8_t *rgba = bmalloc(padded_cx * padded_cy * 4);
+	uint8_t *out  = rgba;
+	bool    bgr   = (format != GS_RGBA);
+
+	*has_alpha = false;
+
+	for (uint32_t y = 0; y < padded_cy; y++) {
+		const uint8_t *row = data + min_u32(y, cy - 1) * cx * 4;
+
+		for (uint32_t x = 0; x < padded_cx; x++) {
+			const uint8_t *src = row + min_u32(x, cx - 1) * 4;
+
+			out[0] = bgr ? src[2] : src[0];
+			out[1] = src[1];
+			out[2] = bgr ? src[0] : src[2];
+			out[3] = (format == GS_BGRX) ? 255 : src[3];
+
+			if (out[3] != 255)
+				*has_alpha = true;
+			out += 4;
+		}
+	}
+
+	return rgba;
+}
+
+static void downsample(uint8_t *dst, uint32_t dst_cx, uint32_t dst_cy,
+		const uint8_t *src, uint32_t src_cx, uint32_t src_cy)
+{
+	size_t pitch = src_cx * 4;
+
+	for (uint32_t y = 0; y < dst_cy; y++) {
+		const uint8_t *row0 = src + min_u32(y*2,   src_cy-1) * pitch;
+		const uint8_t *row1 = src + min_u32(y*2+1, src_cy-1) * pitch;
+
+		for (uint32_t x = 0; x < dst_cx; x++) {
+			uint32_t x0 = min_u32(x*2,   src_cx-1) * 4;
+			uint32_t x1 = min_u32(x*2+1, src_cx-1) * 4;
+
+			for (size_t c = 0; c < 4; c++) {
+				uint32_t sum = row0[x0+c] + row0[x1+c] +
+				               row1[x0+c] + row1[x1+c];
+				*(dst++) = (uint8_t)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+static void fetch_block(uint8_t block[16][4], const uint8_t *rgba,
+		uint32_t cx, uint32_t cy, uint32_t bx, uint32_t by)
+{
+	for (uint32_t y = 0; y < 4; y++) {
+		uint32_t py = min_u32(by*4 + y, cy - 1);
+
+		for (uint32_t x = 0; x < 4; x++) {
+			uint32_t px = min_u32(bx*4 + x, cx - 1);
+			memcpy(block[y*4 + x], rgba + (py * cx + px) * 4, 4);
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline uint16_t pack_565(const int *color)
+{
+	return (uint16_t)(((color[0] >> 3) << 11) |
+	                  ((color[1] >> 2) << 5) |
+	                   (color[2] >> 3));
+}
+
+static inline void unpack_565(int *color, uint16_t val)
+{
+	int r = (val >> 11) & 0x1F;
+	int g = (val >> 5)  & 0x3F;
+	int b =  val        & 0x1F;
+
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+static inline void write_u16(uint8_t *out, uint16_t val)
+{
+	out[0] = (uint8_t)(val & 0xFF);
+	out[1] = (uint8_t)(val >> 8);
+}
+
+/*
+ * fits the endpoints to the bounding box of the block, flipping the box
+ * diagonal to follow the correlation of the channels, and insetting it a
+ * little so the endpoints aren't pulled out by single outliers
+ */
+static void fit_color_endpoints(uint8_t block[16][4], int *max, int *min)
+{
+	int mean[3] = {0, 0, 0};
+	int cov_rg = 0, cov_rb = 0, cov_gb = 0;
+
+	for (size_t c = 0; c < 3; c++) {
+		max[c] = 0;
+		min[c] = 255;
+	}
+
+	for (size_t i = 0; i < 16; i++) {
+		for (size_t c = 0; c < 3; c++) {
+			int val = block[i][c];
+			if (val > max[c]) max[c] = val;
+			if (val < min[c]) min[c] = val;
+			mean[c] += val;
+		}
+	}
+
+	for (size_t c = 0; c < 3; c++) {
+		int inset;
+
+		mean[c] = (mean[c] + 8) / 16;
+		inset   = (max[c] - min[c]) >> 4;
+		max[c] -= inset;
+		min[c] += inset;
+	}
+
+	for (size_t i = 0; i < 16; i++) {
+		int r = block[i][0] - mean[0];
+		int g = block[i][1] - mean[1];
+		int b = block[i][2] - mean[2];
+
+		cov_rg += r * g;
+		cov_rb += r * b;
+		cov_gb += g * b;
+	}
+
+	/* red is the reference axis unless it doesn't vary */
+	if (max[0] != min[0]) {
+		if (cov_rg < 0) {int t = max[1]; max[1] = min[1]; min[1] = t;}
+		if (cov_rb < 0) {int t = max[2]; max[2] = min[2]; min[2] = t;}
+	} else if (cov_gb < 0) {
+		int t = max[2]; max[2] = min[2]; min[2] = t;
+	}
+}
+
+static void encode_color_block(uint8_t *out, uint8_t block[16][4])
+{
+	int      max[3], min[3];
+	int      palette[4][3];
+	uint16_t c0, c1;
+	uint32_t indices = 0;
+
+	fit_color_endpoints(block, max, min);
+
+	c0 = pack_565(max);
+	c1 = pack_565(min);
+
+	/* c0 > c1 selects the four color mode, c0 == c1 is drawn as c0 with
+	 * the indices all zero */
+	if (c0 < c1) {
+		uint16_t t = c0; c0 = c1; c1 = t;
+	}
+
+	write_u16(out,     c0);
+	write_u16(out + 2, c1);
+
+	if (c0 != c1) {
+		unpack_565(palette[0], c0);
+		unpack_565(palette[1], c1);
+
+		for (size_t c = 0; c < 3; c++) {
+			palette[2][c] = (2*palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2*palette[1][c]) / 3;
+		}
+
+		for (size_t i = 0; i < 16; i++) {
+			uint32_t best      = 0;
+			int      best_dist = 0x7FFFFFFF;
+
+			for (uint32_t j = 0; j < 4; j++) {
+				int dr = block[i][0] - palette[j][0];
+				int dg = block[i][1] - palette[j][1];
+				int db = block[i][2] - palette[j][2];
+				int dist = dr*dr + dg*dg + db*db;
+
+				if (dist < best_dist) {
+					best_dist = dist;
+					best      = j;
+				}
+			}
+
+			indices |= best << (i * 2);
+		}
+	}
+
+	write_u16(out + 4, (uint16_t)(indices & 0xFFFF));
+	write_u16(out + 6, (uint16_t)(indices >> 16));
+}
+
+static void encode_alpha_block(uint8_t *out, uint8_t block[16][4])
+{
+	int      a0 = 0, a1 = 255;
+	int      palette[8];
+	uint64_t indices = 0;
+
+	for (size_t i = 0; i < 16; i++) {
+		if (block[i][3] > a0) a0 = block[i][3];
+		if (block[i][3] < a1) a1 = block[i][3];
+	}
+
+	out[0] = (uint8_t)a0;
+	out[1] = (uint8_t)a1;
+
+	/* a0 > a1 selects the eight alpha mode */
+	if (a0 != a1) {
+		palette[0] = a0;
+		palette[1] = a1;
+		for (int j = 1; j < 7; j++)
+			palette[j + 1] = ((7 - j) * a0 + j * a1) / 7;
+
+		for (size_t i = 0; i < 16; i++) {
+			uint64_t best      = 0;
+			int      best_dist = 256;
+
+			for (uint64_t j = 0; j < 8; j++) {
+				int dist = block[i][3] - palette[j];
+				if (dist < 0)
+					dist = -dist;
+
+				if (dist < best_dist) {
+					best_dist = dist;
+					best      = j;
+				}
+			}
+
+			indices |= best << (i * 3);
+		}
+	}
+
+	for (size_t i = 0; i < 6; i++)
+		out[2 + i] = (uint8_t)(indices >> (i * 8));
+}
+
+static void encode_level(uint8_t *out, enum gs_color_format format,
+		const uint8_t *rgba, uint32_t cx, uint32_t cy)
+{
+	uint32_t blocks_x = (cx + 3) / 4;
+	uint32_t blocks_y = (cy + 3) / 4;
+	uint8_t  block[16][4];
+
+	for (uint32_t by = 0; by < blocks_y; by++) {
+		for (uint32_t bx = 0; bx < blocks_x; bx++) {
+			fetch_block(block, rgba, cx, cy, bx, by);
+
+			if (format == GS_DXT5) {
+				encode_alpha_block(out, block);
+				out += 8;
+			}
+
+			encode_color_block(out, block);
+			out += 8;
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool gs_compress_image(struct gs_compressed_image *image,
+		const uint8_t *data, enum gs_color_format format,
+		uint32_t cx, uint32_t cy)
+{
+	uint32_t level_cx, level_cy;
+	size_t   size = 0;
+	uint8_t  *rgba;
+	uint8_t  *out;
+	bool     has_alpha;
+
+	memset(image, 0, sizeof(struct gs_compressed_image));
+
+	if (!data || !cx || !cy)
+		return false;
+	if (format != GS_RGBA && format != GS_BGRA && format != GS_BGRX)
+		return false;
+
+	image->cx     = (cx + 3) & ~3;
+	image->cy     = (cy + 3) & ~3;
+	image->levels = gs_num_total_levels(image->cx, image->cy) + 1;
+	if (image->levels > GS_COMPRESSED_MAX_LEVELS)
+		image->levels = GS_COMPRESSED_MAX_LEVELS;
+
+	rgba = convert_to_rgba(data, format, cx, cy, image->cx, image->cy,
+			&has_alpha);
+	image->format = has_alpha ? GS_DXT5 : GS_DXT1;
+
+	level_cx = image->cx;
+	level_cy = image->cy;
+	for (uint32_t i = 0; i < image->levels; i++) {
+		size += gs_get_compressed_level_size(image->format,
+				level_cx, level_cy);
+		level_cx = level_cx > 1 ? level_cx / 2 : 1;
+		level_cy = level_cy > 1 ? level_cy / 2 : 1;
+	}
+
+	image->data = bmalloc(size);
+	out         = image->data;
+	level_cx    = image->cx;
+	level_cy    = image->cy;
+
+	for (uint32_t i = 0; i < image->levels; i++) {
+		image->level_data[i] = out;
+		encode_level(out, image->format, rgba, level_cx, level_cy);
+		out += gs_get_compressed_level_size(image->format,
+				level_cx, level_cy);
+
+		if (i + 1 < image->levels) {
+			uint32_t next_cx = level_cx > 1 ? level_cx / 2 : 1;
+			uint32_t next_cy = level_cy > 1 ? level_cy / 2 : 1;
+			uint8_t  *next   = bmalloc(next_cx * next_cy * 4);
+
+			downsample(next, next_cx, next_cy,
+					rgba, level_cx, level_cy);
+			bfree(rgba);
+
+			rgba     = next;
+			level_cx = next_cx;
+			level_cy = next_cy;
+		}
+	}
+
+	bfree(rgba);
+	return true;
+}
+
+void gs_compressed_image_free(struct gs_compressed_image *image)
+{
+	if (image) {
+		bfree(image->data);
+		memset(image, 0, sizeof(struct gs_compressed_image));
+	}
+}
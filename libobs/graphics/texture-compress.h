@@ -0,0 +1,60 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "graphics.h"
+
+/*
+ * CPU block compression of static images
+ *
+ *   Encodes 32bit images to DXT1 when they're opaque and to DXT5 when they
+ * have alpha, with a box filtered mipmap chain.  The encoder is a simple
+ * bounding box fit, which is fast enough to run while loading images and
+ * is good enough for artwork that's mostly drawn scaled down.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GS_COMPRESSED_MAX_LEVELS 32
+
+struct gs_compressed_image {
+	enum gs_color_format format;
+
+	/* padded to a multiple of 4 */
+	uint32_t             cx;
+	uint32_t             cy;
+
+	uint32_t             levels;
+	uint8_t              *data;
+	const uint8_t        *level_data[GS_COMPRESSED_MAX_LEVELS];
+};
+
+/**
+ * Compresses image data of the GS_RGBA, GS_BGRA or GS_BGRX formats.
+ * Returns false if the format can't be compressed.
+ */
+EXPORT bool gs_compress_image(struct gs_compressed_image *image,
+		const uint8_t *data, enum gs_color_format format,
+		uint32_t cx, uint32_t cy);
+EXPORT void gs_compressed_image_free(struct gs_compressed_image *image);
+
+#ifdef __cplusplus
+}
+#endif
@@ -21,7 +21,7 @@
  */
 
 #include <assert.h>
-#include "graphics.h"
+#include "graphics-internal.h"
 
 struct gs_texture_render {
 	texture_t  target, prev_target;
@@ -33,6 +33,13 @@ struct gs_texture_render {
 	enum gs_zstencil_format zsformat;
 
 	bool rendered;
+
+	/* the target is created for the owner the texrender was created for */
+	gs_memory_owner_t owner;
+
+	/* pooled render targets */
+	bool     in_use;
+	uint32_t unused_frames;
 };
 
 texrender_t texrender_create(enum gs_color_format format,
@@ -42,13 +49,16 @@ texrender_t texrender_create(enum gs_color_format format,
 	texrender = bzalloc(sizeof(struct gs_texture_render));
 	texrender->format   = format;
 	texrender->zsformat = zsformat;
+	texrender->owner    = gs_get_memory_owner();
 
+	gs_memory_track(texrender, GS_RESOURCE_TEXRENDER, 0);
 	return texrender;
 }
 
 void texrender_destroy(texrender_t texrender)
 {
 	if (texrender) {
+		gs_memory_untrack(texrender);
 		texture_destroy(texrender->target);
 		zstencil_destroy(texrender->zs);
 		bfree(texrender);
@@ -58,6 +68,9 @@ void texrender_destroy(texrender_t texrender)
 static bool texrender_resetbuffer(texrender_t texrender, uint32_t cx,
 		uint32_t cy)
 {
+	gs_memory_owner_t prev_owner;
+	bool success = true;
+
 	if (!texrender)
 		return false;
 
@@ -69,22 +82,24 @@ static bool texrender_resetbuffer(texrender_t texrender, uint32_t cx,
 	texrender->cx     = cx;
 	texrender->cy     = cy;
 
+	prev_owner = gs_set_memory_owner(texrender->owner);
+
 	texrender->target = gs_create_texture(cx, cy, texrender->format,
 			1, NULL, GS_RENDERTARGET);
 	if (!texrender->target)
-		return false;
+		success = false;
 
-	if (texrender->zsformat != GS_ZS_NONE) {
+	if (success && texrender->zsformat != GS_ZS_NONE) {
 		texrender->zs = gs_create_zstencil(cx, cy, texrender->zsformat);
 		if (!texrender->zs) {
 			texture_destroy(texrender->target);
 			texrender->target = NULL;
-
-			return false;
+			success = false;
 		}
 	}
 
-	return true;
+	gs_set_memory_owner(prev_owner);
+	return success;
 }
 
 bool texrender_begin(texrender_t texrender, uint32_t cx, uint32_t cy)
@@ -143,3 +158,124 @@ texture_t texrender_gettexture(texrender_t texrender)
 {
 	return texrender ? texrender->target : NULL;
 }
+
+/* ------------------------------------------------------------------------- */
+/* pooled render targets, only used with the graphics context entered */
+
+/* frames a pooled target can go unused before it's destroyed */
+#define MAX_UNUSED_FRAMES 60
+
+static inline bool pooled_target_matches(struct gs_texture_render *texrender,
+		enum gs_color_format format, uint32_t cx, uint32_t cy)
+{
+	return !texrender->in_use &&
+	       texrender->format == format &&
+	       texrender->cx     == cx &&
+	       texrender->cy     == cy;
+}
+
+texrender_t texrender_pool_acquire(enum gs_color_format format,
+		uint32_t cx, uint32_t cy)
+{
+	graphics_t graphics = gs_getcontext();
+	struct gs_texture_render *texrender = NULL;
+
+	if (!graphics)
+		return NULL;
+
+	for (size_t i = 0; i < graphics->texrender_pool.num; i++) {
+		struct gs_texture_render *pooled =
+			graphics->texrender_pool.array[i];
+
+		if (pooled_target_matches(pooled, format, cx, cy)) {
+			texrender = pooled;
+			break;
+		}
+	}
+
+	/* the target itself is created by texrender_begin */
+	if (!texrender) {
+		gs_memory_owner_t prev_owner;
+
+		if (!graphics->texrender_pool_owner)
+			graphics->texrender_pool_owner =
+				gs_memory_owner_create();
+
+		prev_owner = gs_set_memory_owner(
+				graphics->texrender_pool_owner);
+		texrender = texrender_create(format, GS_ZS_NONE);
+		gs_set_memory_owner(prev_owner);
+
+		da_push_back(graphics->texrender_pool, &texrender);
+	}
+
+	texrender->in_use        = true;
+	texrender->unused_frames = 0;
+	texrender->rendered      = false;
+	return texrender;
+}
+
+void texrender_pool_release(texrender_t texrender)
+{
+	if (texrender)
+		texrender->in_use = false;
+}
+
+void texrender_pool_trim(void)
+{
+	graphics_t graphics = gs_getcontext();
+	size_t i = 0;
+
+	if (!graphics)
+		return;
+
+	while (i < graphics->texrender_pool.num) {
+		struct gs_texture_render *texrender =
+			graphics->texrender_pool.array[i];
+
+		if (!texrender->in_use &&
+		    ++texrender->unused_frames > MAX_UNUSED_FRAMES) {
+			texrender_destroy(texrender);
+			da_erase(graphics->texrender_pool, i);
+		} else {
+			i++;
+		}
+	}
+}
+
+void texrender_pool_free(struct graphics_subsystem *graphics)
+{
+	for (size_t i = 0; i < graphics->texrender_pool.num; i++) {
+		struct gs_texture_render *texrender =
+			graphics->texrender_pool.array[i];
+
+		gs_memory_untrack(texrender->target);
+		gs_memory_untrack(texrender->zs);
+		gs_memory_untrack(texrender);
+
+		if (texrender->target)
+			graphics->exports.texture_destroy(texrender->target);
+		if (texrender->zs)
+			graphics->exports.zstencil_destroy(texrender->zs);
+		bfree(texrender);
+	}
+
+	da_resize(graphics->texrender_pool, 0);
+
+	gs_memory_owner_destroy(graphics->texrender_pool_owner);
+	graphics->texrender_pool_owner = NULL;
+}
+
+void texrender_pool_get_usage(struct gs_memory_usage *usage)
+{
+	graphics_t graphics = gs_getcontext();
+
+	if (!usage)
+		return;
+
+	if (graphics && graphics->texrender_pool_owner)
+		gs_memory_owner_get_usage(graphics->texrender_pool_owner,
+				usage);
+	else
+		memset(usage, 0, sizeof(struct gs_memory_usage));
+}
@@ -49,6 +49,36 @@ void vec3_transform(struct vec3 *dst, const struct vec3 *v,
 	dst->z = vec3_dot(&temp, &m->z);
 }
 
+void vec3_transform_array(struct vec3 *dst, const struct vec3 *v,
+		size_t count, const struct matrix3 *m)
+{
+	__m128 c0 = m->x.m, c1 = m->y.m, c2 = m->z.m, c3 = _mm_setzero_ps();
+	__m128 t;
+	size_t i;
+
+	/* with the axes transposed in to columns, each point is just three
+	 * multiplies and adds instead of three horizontal dot products.  the
+	 * translation is rotated once up front, since (v-t)*m = v*m - t*m */
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+	t = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(m->t.x), c0),
+			_mm_mul_ps(_mm_set1_ps(m->t.y), c1)),
+			_mm_mul_ps(_mm_set1_ps(m->t.z), c2));
+
+	for (i = 0; i < count; i++) {
+		__m128 p = v[i].m;
+		__m128 x = _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0));
+		__m128 y = _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 z = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2));
+
+		dst[i].m = _mm_sub_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(x, c0),
+				_mm_mul_ps(y, c1)),
+				_mm_mul_ps(z, c2)), t);
+	}
+}
+
 void vec3_mirror(struct vec3 *dst, const struct vec3 *v, const struct plane *p)
 {
 	struct vec3 temp;
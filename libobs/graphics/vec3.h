@@ -221,6 +221,10 @@ EXPORT void vec3_rotate(struct vec3 *dst, const struct vec3 *v,
 EXPORT void vec3_transform(struct vec3 *dst, const struct vec3 *v,
 		const struct matrix3 *m);
 
+/* transforms count points at once, dst and v can be the same array */
+EXPORT void vec3_transform_array(struct vec3 *dst, const struct vec3 *v,
+		size_t count, const struct matrix3 *m);
+
 EXPORT void vec3_mirror(struct vec3 *dst, const struct vec3 *v,
 		const struct plane *p);
 EXPORT void vec3_mirrorv(struct vec3 *dst, const struct vec3 *v,
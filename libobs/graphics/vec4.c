@@ -21,12 +21,28 @@
 void vec4_transform(struct vec4 *dst, const struct vec4 *v,
 		const struct matrix4 *m)
 {
-	struct vec4 temp;
+	vec4_transform_array(dst, v, 1, m);
+}
+
+void vec4_transform_array(struct vec4 *dst, const struct vec4 *v,
+		size_t count, const struct matrix4 *m)
+{
+	__m128 c0 = m->x.m, c1 = m->y.m, c2 = m->z.m, c3 = m->t.m;
+	size_t i;
+
+	/* transposed once, so each vector is four multiplies and adds rather
+	 * than four horizontal dot products */
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
 
-	temp.x = vec4_dot(&m->x, v);
-	temp.y = vec4_dot(&m->y, v);
-	temp.z = vec4_dot(&m->z, v);
-	temp.w = vec4_dot(&m->t, v);
+	for (i = 0; i < count; i++) {
+		__m128 p = v[i].m;
+		__m128 x = _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0));
+		__m128 y = _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 z = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2));
+		__m128 w = _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3));
 
-	vec4_copy(dst, &temp);
+		dst[i].m = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(x, c0), _mm_mul_ps(y, c1)),
+				_mm_add_ps(_mm_mul_ps(z, c2), _mm_mul_ps(w, c3)));
+	}
 }
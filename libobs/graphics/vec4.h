@@ -245,6 +245,10 @@ static inline void vec4_from_bgra(struct vec4 *dst, uint32_t bgra)
 EXPORT void vec4_transform(struct vec4 *dst, const struct vec4 *v,
 		const struct matrix4 *m);
 
+/* transforms count vectors at once, dst and v can be the same array */
+EXPORT void vec4_transform_array(struct vec4 *dst, const struct vec4 *v,
+		size_t count, const struct matrix4 *m);
+
 #ifdef __cplusplus
 }
 #endif
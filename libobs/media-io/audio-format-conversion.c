@@ -0,0 +1,244 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <math.h>
+#include <string.h>
+#include "audio-format-conversion.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define USE_SSE2_CONV
+#endif
+
+#ifndef CLAMP
+#define CLAMP(val, minval, maxval) \
+	((val > maxval) ? maxval : ((val < minval) ? minval : val))
+#endif
+
+/* the packed format with the same sample type */
+static inline enum audio_format sample_type(enum audio_format format)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT_PLANAR: return AUDIO_FORMAT_U8BIT;
+	case AUDIO_FORMAT_16BIT_PLANAR: return AUDIO_FORMAT_16BIT;
+	case AUDIO_FORMAT_32BIT_PLANAR: return AUDIO_FORMAT_32BIT;
+	case AUDIO_FORMAT_FLOAT_PLANAR: return AUDIO_FORMAT_FLOAT;
+	default:                        return format;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* single samples, through float */
+
+static inline float read_sample(const uint8_t *data, enum audio_format type,
+		size_t idx)
+{
+	switch (type) {
+	case AUDIO_FORMAT_U8BIT:
+		return ((float)data[idx] - 128.0f) / 128.0f;
+	case AUDIO_FORMAT_16BIT:
+		return (float)((const int16_t*)data)[idx] / 32768.0f;
+	case AUDIO_FORMAT_32BIT:
+		return (float)((double)((const int32_t*)data)[idx] /
+				2147483648.0);
+	case AUDIO_FORMAT_FLOAT:
+		return ((const float*)data)[idx];
+	default:
+		return 0.0f;
+	}
+}
+
+static inline void write_sample(uint8_t *data, enum audio_format type,
+		size_t idx, float val)
+{
+	val = CLAMP(val, -1.0f, 1.0f);
+
+	switch (type) {
+	case AUDIO_FORMAT_U8BIT:
+		data[idx] = (uint8_t)(lrintf(val * 127.0f) + 128);
+		break;
+	case AUDIO_FORMAT_16BIT:
+		((int16_t*)data)[idx] = (int16_t)lrintf(val * 32767.0f);
+		break;
+	case AUDIO_FORMAT_32BIT:
+		((int32_t*)data)[idx] = (int32_t)((double)val * 2147483647.0);
+		break;
+	case AUDIO_FORMAT_FLOAT:
+		((float*)data)[idx] = val;
+		break;
+	default:
+		break;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* contiguous runs of samples with the same layout */
+
+static void float_to_s16(int16_t *out, const float *in, size_t count)
+{
+	size_t i = 0;
+
+#ifdef USE_SSE2_CONV
+	__m128 min_val = _mm_set1_ps(-1.0f);
+	__m128 max_val = _mm_set1_ps(1.0f);
+	__m128 scale   = _mm_set1_ps(32767.0f);
+
+	for (; i + 8 <= count; i += 8) {
+		__m128 a = _mm_loadu_ps(in + i);
+		__m128 b = _mm_loadu_ps(in + i + 4);
+
+		a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(a, min_val), max_val),
+				scale);
+		b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(b, min_val), max_val),
+				scale);
+
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(
+					_mm_cvtps_epi32(a),
+					_mm_cvtps_epi32(b)));
+	}
+#endif
+
+	for (; i < count; i++) {
+		float val = CLAMP(in[i], -1.0f, 1.0f);
+		out[i] = (int16_t)lrintf(val * 32767.0f);
+	}
+}
+
+static void s16_to_float(float *out, const int16_t *in, size_t count)
+{
+	size_t i = 0;
+
+#ifdef USE_SSE2_CONV
+	__m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+
+	for (; i + 8 <= count; i += 8) {
+		__m128i v  = _mm_loadu_si128((const __m128i*)(in + i));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+		_mm_storeu_ps(out + i,
+				_mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(out + i + 4,
+				_mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+#endif
+
+	for (; i < count; i++)
+		out[i] = (float)in[i] / 32768.0f;
+}
+
+static void convert_run(uint8_t *out, enum audio_format out_type,
+		const uint8_t *in, enum audio_format in_type, size_t count)
+{
+	if (out_type == in_type) {
+		memcpy(out, in, count * get_audio_bytes_per_channel(in_type));
+
+	} else if (in_type == AUDIO_FORMAT_FLOAT &&
+	           out_type == AUDIO_FORMAT_16BIT) {
+		float_to_s16((int16_t*)out, (const float*)in, count);
+
+	} else if (in_type == AUDIO_FORMAT_16BIT &&
+	           out_type == AUDIO_FORMAT_FLOAT) {
+		s16_to_float((float*)out, (const int16_t*)in, count);
+
+	} else {
+		for (size_t i = 0; i < count; i++)
+			write_sample(out, out_type, i,
+					read_sample(in, in_type, i));
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* planar <-> packed */
+
+#define DEFINE_COPY_STRIDED(name, type) \
+static void name(uint8_t *out_data, size_t out_stride, \
+		const uint8_t *in_data, size_t in_stride, size_t count) \
+{ \
+	type       *out = (type*)out_data; \
+	const type *in  = (const type*)in_data; \
+	for (size_t i = 0; i < count; i++) \
+		out[i * out_stride] = in[i * in_stride]; \
+}
+
+DEFINE_COPY_STRIDED(copy_strided_8,  uint8_t)
+DEFINE_COPY_STRIDED(copy_strided_16, uint16_t)
+DEFINE_COPY_STRIDED(copy_strided_32, uint32_t)
+
+/* converts one channel, where either side may be interleaved with the other
+ * channels.  offsets and strides are in samples */
+static void convert_channel(uint8_t *out, enum audio_format out_type,
+		size_t out_offset, size_t out_stride,
+		const uint8_t *in, enum audio_format in_type,
+		size_t in_offset, size_t in_stride, size_t count)
+{
+	size_t size = get_audio_bytes_per_channel(in_type);
+
+	if (out_type == in_type) {
+		out += out_offset * size;
+		in  += in_offset  * size;
+
+		if (size == 1)
+			copy_strided_8(out, out_stride, in, in_stride, count);
+		else if (size == 2)
+			copy_strided_16(out, out_stride, in, in_stride, count);
+		else
+			copy_strided_32(out, out_stride, in, in_stride, count);
+		return;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		float val = read_sample(in, in_type,
+				in_offset + i * in_stride);
+		write_sample(out, out_type, out_offset + i * out_stride, val);
+	}
+}
+
+void audio_convert_format(
+		uint8_t *const output[], enum audio_format out_format,
+		const uint8_t *const input[], enum audio_format in_format,
+		uint32_t channels, uint32_t frames)
+{
+	enum audio_format out_type   = sample_type(out_format);
+	enum audio_format in_type    = sample_type(in_format);
+	bool              out_planar = is_audio_planar(out_format);
+	bool              in_planar  = is_audio_planar(in_format);
+
+	if (!channels || !frames)
+		return;
+
+	if (!in_planar && !out_planar) {
+		convert_run(output[0], out_type, input[0], in_type,
+				(size_t)frames * channels);
+
+	} else if (in_planar && out_planar) {
+		for (uint32_t ch = 0; ch < channels; ch++)
+			convert_run(output[ch], out_type, input[ch], in_type,
+					frames);
+
+	} else if (in_planar) {
+		for (uint32_t ch = 0; ch < channels; ch++)
+			convert_channel(output[0], out_type, ch, channels,
+					input[ch], in_type, 0, 1, frames);
+
+	} else {
+		for (uint32_t ch = 0; ch < channels; ch++)
+			convert_channel(output[ch], out_type, 0, 1,
+					input[0], in_type, ch, channels,
+					frames);
+	}
+}
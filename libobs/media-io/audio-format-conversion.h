@@ -0,0 +1,43 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+#include "audio-io.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Converts audio between sample formats (including planar <-> packed) without
+ * changing the sample rate or speaker layout.  Used by the resampler instead
+ * of libswresample when only the sample format differs.
+ *
+ *   Samples are converted straight from one format to the other when the
+ * layout of the data matches, with SSE2 for float <-> 16bit, otherwise they
+ * go through float.
+ */
+EXPORT void audio_convert_format(
+		uint8_t *const output[], enum audio_format out_format,
+		const uint8_t *const input[], enum audio_format in_format,
+		uint32_t channels, uint32_t frames);
+
+#ifdef __cplusplus
+}
+#endif
@@ -22,25 +22,90 @@
 #include "../util/darray.h"
 #include "../util/circlebuf.h"
 #include "../util/platform.h"
+#include "../util/trace.h"
+#include "../util/job-system.h"
 
 #include "audio-io.h"
 #include "audio-resampler.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define USE_SSE2_MIX
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define USE_NEON_MIX
+#endif
+
 /* #define DEBUG_AUDIO */
 
 #define nop() do {int invalid = 0;} while(0)
 
-struct audio_input {
+/* inputs that want the same conversion share one of these, so the mix is
+ * only converted once per tick for all of them */
+struct audio_converter {
 	struct audio_convert_info conversion;
 	audio_resampler_t         resampler;
+	long                      refs;
+
+	/* result of the current tick */
+	bool                      converted;
+	bool                      success;
+	struct audio_data         data;
+};
+
+struct audio_input {
+	struct audio_convert_info conversion;
+	struct audio_converter    *converter;
 
 	void (*callback)(void *param, struct audio_data *data);
 	void *param;
 };
 
-static inline void audio_input_free(struct audio_input *input)
+/* levels are written by one thread and read without locks by any other.
+ * the writer makes seq odd while writing, readers retry if seq was odd or
+ * changed while they were copying */
+struct levels_snapshot {
+	volatile long              seq;
+	volatile uint32_t          channels;
+	volatile float             peak[MAX_AUDIO_CHANNELS];
+	volatile float             rms[MAX_AUDIO_CHANNELS];
+};
+
+static void publish_levels(struct levels_snapshot *snapshot,
+		const struct audio_levels *levels)
+{
+	os_atomic_inc_long(&snapshot->seq);
+
+	snapshot->channels = levels->channels;
+	for (size_t i = 0; i < MAX_AUDIO_CHANNELS; i++) {
+		snapshot->peak[i] = levels->peak[i];
+		snapshot->rms[i]  = levels->rms[i];
+	}
+
+	os_atomic_inc_long(&snapshot->seq);
+}
+
+#define LEVELS_READ_TRIES 64
+
+static bool read_levels(struct levels_snapshot *snapshot,
+		struct audio_levels *levels)
 {
-	audio_resampler_destroy(input->resampler);
+	for (int tries = 0; tries < LEVELS_READ_TRIES; tries++) {
+		long seq = os_atomic_load_long(&snapshot->seq);
+		if (seq & 1)
+			continue;
+
+		levels->channels = snapshot->channels;
+		for (size_t i = 0; i < MAX_AUDIO_CHANNELS; i++) {
+			levels->peak[i] = snapshot->peak[i];
+			levels->rms[i]  = snapshot->rms[i];
+		}
+
+		if (os_atomic_load_long(&snapshot->seq) == seq)
+			return true;
+	}
+
+	return false;
 }
 
 struct audio_line {
@@ -53,10 +118,20 @@ struct audio_line {
 	uint64_t                   base_timestamp;
 	uint64_t                   last_timestamp;
 
+	/* bytes from the front of the buffers to the end of the last data that
+	 * wasn't silent.  when it's 0 the line has nothing to be heard and
+	 * isn't mixed */
+	size_t                     audible_end;
+
+	struct levels_snapshot     levels;
+
 	/* states whether this line is still being used.  if not, then when the
 	 * buffer is depleted, it's destroyed */
 	bool                       alive;
 
+	/* mix buses this line is mixed in to, one bit per bus */
+	uint32_t                   mixers;
+
 	struct audio_line          **prev_next;
 	struct audio_line          *next;
 };
@@ -73,6 +148,13 @@ static inline void audio_line_destroy_data(struct audio_line *line)
 	bfree(line);
 }
 
+/* a line that is mixed in to the current audio tick */
+struct mix_job {
+	struct audio_line          *line;
+	size_t                     time_offset;
+	size_t                     size;
+};
+
 struct audio_output {
 	struct audio_output_info   info;
 	size_t                     block_size;
@@ -82,15 +164,51 @@ struct audio_output {
 	pthread_t                  thread;
 	os_event_t                 stop_event;
 
+	/* low latency mode: signaled by lines once they've buffered enough
+	 * data to mix the next period.  lines read next_mix_time with their
+	 * own mutex held rather than line_mutex, so it's accessed
+	 * atomically */
+	os_event_t                 data_event;
+	uint64_t                   period_ns;
+	volatile uint64_t          next_mix_time;
+
 	DARRAY(uint8_t)            mix_buffers[MAX_AV_PLANES];
+	DARRAY(struct mix_job)     mix_jobs;
+	struct levels_snapshot     levels;
+
+	/* with planar audio and many lines, planes are mixed in parallel on
+	 * these shared workers (and the audio thread), see
+	 * audio_output_set_job_system */
+	job_system_t               jobs;
 
 	bool                       initialized;
 
+	/* mix buses.  mixes[0] is the output itself, the others only have
+	 * their own info, mix buffers and inputs, and are mixed by the
+	 * parent's thread along with it */
+	struct audio_output        *parent;
+	size_t                     mix_idx;
+	struct audio_output        *mixes[MAX_AUDIO_MIXES];
+	size_t                     num_mixes;
+	uint32_t                   active_mixes;
+
 	pthread_mutex_t            line_mutex;
 	struct audio_line          *first_line;
 
 	pthread_mutex_t            input_mutex;
 	DARRAY(struct audio_input) inputs;
+	DARRAY(struct audio_converter*) converters;
+
+	/* master clock, set on the output itself, and held locked by the
+	 * audio thread while the buses are being output */
+	pthread_mutex_t            clock_mutex;
+	media_clock_t              clock;
+
+	/* each bus resamples its mix to the clock's rate before converting
+	 * it for its inputs */
+	audio_resampler_t          clock_resampler;
+	double                     clock_ratio;
+	DARRAY(uint8_t)            clock_buffers[MAX_AV_PLANES];
 };
 
 static inline void audio_output_removeline(struct audio_output *audio,
@@ -164,6 +282,9 @@ static inline void clear_excess_audio_data(struct audio_line *line,
 
 		circlebuf_pop_front(&line->buffers[i], NULL, clear_size);
 	}
+
+	line->audible_end = (size < line->audible_end) ?
+		line->audible_end - size : 0;
 }
 
 static inline uint64_t min_uint64(uint64_t a, uint64_t b)
@@ -188,93 +309,239 @@ static inline size_t min_size(size_t a, size_t b)
 #define MIN_S32 -2147483647
 #define MAX_S32  2147483647
 
-#define MIX_BUFFER_SIZE 256
+/* lines needed before planes are mixed in parallel */
+#define MIX_THREAD_MIN_LINES 4
 
-/* TODO: optimize mixing */
-static void mix_u8(uint8_t *mix, struct circlebuf *buf, size_t size)
+static void mix_u8(uint8_t *mix, const uint8_t *vals, size_t size)
 {
-	uint8_t  vals[MIX_BUFFER_SIZE];
 	register int16_t mix_val;
 
-	while (size) {
-		size_t pop_count = min_size(size, sizeof(vals));
-		size -= pop_count;
-
-		circlebuf_pop_front(buf, vals, pop_count);
-
-		for (size_t i = 0; i < pop_count; i++) {
-			mix_val =  (int16_t)*mix - 128;
-			mix_val += (int16_t)vals[i] - 128;
-			mix_val = CLAMP(mix_val, MIN_S8, MAX_S8) + 128;
-			*(mix++) = (uint8_t)mix_val;
-		}
+	for (size_t i = 0; i < size; i++) {
+		mix_val =  (int16_t)*mix - 128;
+		mix_val += (int16_t)vals[i] - 128;
+		mix_val = CLAMP(mix_val, MIN_S8, MAX_S8) + 128;
+		*(mix++) = (uint8_t)mix_val;
 	}
 }
 
-static void mix_s16(uint8_t *mix_in, struct circlebuf *buf, size_t size)
+static void mix_s16(uint8_t *mix_in, const uint8_t *vals_in, size_t size)
 {
-	int16_t *mix = (int16_t*)mix_in;
-	int16_t vals[MIX_BUFFER_SIZE];
+	int16_t       *mix  = (int16_t*)mix_in;
+	const int16_t *vals = (const int16_t*)vals_in;
+	size_t        count = size / sizeof(int16_t);
+	size_t        i     = 0;
 	register int32_t mix_val;
 
-	while (size) {
-		size_t pop_count = min_size(size, sizeof(vals));
-		size -= pop_count;
+#ifdef USE_SSE2_MIX
+	__m128i min_val = _mm_set1_epi16(MIN_S16);
 
-		circlebuf_pop_front(buf, vals, pop_count);
-		pop_count /= sizeof(int16_t);
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(mix + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(vals + i));
+		__m128i sum = _mm_max_epi16(_mm_adds_epi16(a, b), min_val);
+		_mm_storeu_si128((__m128i*)(mix + i), sum);
+	}
+#endif
 
-		for (size_t i = 0; i < pop_count; i++) {
-			mix_val =  (int32_t)*mix;
-			mix_val += (int32_t)vals[i];
-			*(mix++) = (int16_t)CLAMP(mix_val, MIN_S16, MAX_S16);
-		}
+	for (; i < count; i++) {
+		mix_val =  (int32_t)mix[i];
+		mix_val += (int32_t)vals[i];
+		mix[i] = (int16_t)CLAMP(mix_val, MIN_S16, MAX_S16);
 	}
 }
 
-static void mix_s32(uint8_t *mix_in, struct circlebuf *buf, size_t size)
+static void mix_s32(uint8_t *mix_in, const uint8_t *vals_in, size_t size)
 {
-	int32_t *mix = (int32_t*)mix_in;
-	int32_t vals[MIX_BUFFER_SIZE];
+	int32_t       *mix  = (int32_t*)mix_in;
+	const int32_t *vals = (const int32_t*)vals_in;
+	size_t        count = size / sizeof(int32_t);
 	register int64_t mix_val;
 
-	while (size) {
-		size_t pop_count = min_size(size, sizeof(vals));
-		size -= pop_count;
+	for (size_t i = 0; i < count; i++) {
+		mix_val =  (int64_t)mix[i];
+		mix_val += (int64_t)vals[i];
+		mix[i] = (int32_t)CLAMP(mix_val, MIN_S32, MAX_S32);
+	}
+}
 
-		circlebuf_pop_front(buf, vals, pop_count);
-		pop_count /= sizeof(int32_t);
+static void mix_float(uint8_t *mix_in, const uint8_t *vals_in, size_t size)
+{
+	float       *mix  = (float*)mix_in;
+	const float *vals = (const float*)vals_in;
+	size_t      count = size / sizeof(float);
+	size_t      i     = 0;
+	register float mix_val;
 
-		for (size_t i = 0; i < pop_count; i++) {
-			mix_val =  (int64_t)*mix;
-			mix_val += (int64_t)vals[i];
-			*(mix++) = (int32_t)CLAMP(mix_val, MIN_S32, MAX_S32);
-		}
+#if defined(USE_SSE2_MIX)
+	__m128 min_val = _mm_set1_ps(-1.0f);
+	__m128 max_val = _mm_set1_ps(1.0f);
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 sum = _mm_add_ps(_mm_loadu_ps(mix + i),
+		                        _mm_loadu_ps(vals + i));
+		sum = _mm_min_ps(_mm_max_ps(sum, min_val), max_val);
+		_mm_storeu_ps(mix + i, sum);
+	}
+#elif defined(USE_NEON_MIX)
+	float32x4_t min_val = vdupq_n_f32(-1.0f);
+	float32x4_t max_val = vdupq_n_f32(1.0f);
+
+	for (; i + 4 <= count; i += 4) {
+		float32x4_t sum = vaddq_f32(vld1q_f32(mix + i),
+		                            vld1q_f32(vals + i));
+		sum = vminq_f32(vmaxq_f32(sum, min_val), max_val);
+		vst1q_f32(mix + i, sum);
+	}
+#endif
+
+	for (; i < count; i++) {
+		mix_val = mix[i] + vals[i];
+		mix[i]  = CLAMP(mix_val, -1.0f, 1.0f);
 	}
 }
 
-static void mix_float(uint8_t *mix_in, struct circlebuf *buf, size_t size)
+/* peak and sum of squares of a channel */
+struct channel_levels {
+	float  peak;
+	double sum_sq;
+};
+
+static void measure_float(const float *vals, size_t count,
+		struct channel_levels *cl)
 {
-	float *mix = (float*)mix_in;
-	float vals[MIX_BUFFER_SIZE];
-	register float mix_val;
+	float  peak   = 0.0f;
+	double sum_sq = 0.0;
+	size_t i      = 0;
+
+#if defined(USE_SSE2_MIX)
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 peak4    = _mm_setzero_ps();
+	__m128 sum4     = _mm_setzero_ps();
+	float  tmp[4];
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 v = _mm_loadu_ps(vals + i);
+		peak4 = _mm_max_ps(peak4, _mm_and_ps(v, abs_mask));
+		sum4  = _mm_add_ps(sum4, _mm_mul_ps(v, v));
+	}
 
-	while (size) {
-		size_t pop_count = min_size(size, sizeof(vals));
-		size -= pop_count;
+	_mm_storeu_ps(tmp, peak4);
+	peak = fmaxf(fmaxf(tmp[0], tmp[1]), fmaxf(tmp[2], tmp[3]));
+	_mm_storeu_ps(tmp, sum4);
+	sum_sq = (double)tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#elif defined(USE_NEON_MIX)
+	float32x4_t peak4 = vdupq_n_f32(0.0f);
+	float32x4_t sum4  = vdupq_n_f32(0.0f);
+	float       tmp[4];
+
+	for (; i + 4 <= count; i += 4) {
+		float32x4_t v = vld1q_f32(vals + i);
+		peak4 = vmaxq_f32(peak4, vabsq_f32(v));
+		sum4  = vmlaq_f32(sum4, v, v);
+	}
 
-		circlebuf_pop_front(buf, vals, pop_count);
-		pop_count /= sizeof(float);
+	vst1q_f32(tmp, peak4);
+	peak = fmaxf(fmaxf(tmp[0], tmp[1]), fmaxf(tmp[2], tmp[3]));
+	vst1q_f32(tmp, sum4);
+	sum_sq = (double)tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#endif
 
-		for (size_t i = 0; i < pop_count; i++) {
-			mix_val =  *mix + vals[i];
-			*(mix++) = CLAMP(mix_val, -1.0f, 1.0f);
-		}
+	for (; i < count; i++) {
+		float val = fabsf(vals[i]);
+		if (val > peak)
+			peak = val;
+		sum_sq += (double)val * val;
 	}
+
+	cl->peak   = peak;
+	cl->sum_sq = sum_sq;
 }
 
-static inline void mix_audio(enum audio_format format,
-		uint8_t *mix, struct circlebuf *buf, size_t size)
+static inline float sample_to_float(enum audio_format format,
+		const uint8_t *ptr)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT:
+	case AUDIO_FORMAT_U8BIT_PLANAR:
+		return ((float)*ptr - 128.0f) / 128.0f;
+	case AUDIO_FORMAT_16BIT:
+	case AUDIO_FORMAT_16BIT_PLANAR:
+		return (float)*(const int16_t*)ptr / 32768.0f;
+	case AUDIO_FORMAT_32BIT:
+	case AUDIO_FORMAT_32BIT_PLANAR:
+		return (float)((double)*(const int32_t*)ptr / 2147483648.0);
+	case AUDIO_FORMAT_FLOAT:
+	case AUDIO_FORMAT_FLOAT_PLANAR:
+		return *(const float*)ptr;
+	case AUDIO_FORMAT_UNKNOWN:
+		break;
+	}
+
+	return 0.0f;
+}
+
+/* integer and interleaved audio, one sample every <stride> bytes */
+static void measure_samples(enum audio_format format, const uint8_t *data,
+		size_t count, size_t stride, struct channel_levels *cl)
+{
+	float  peak   = 0.0f;
+	double sum_sq = 0.0;
+
+	for (size_t i = 0; i < count; i++) {
+		float val = fabsf(sample_to_float(format, data));
+		if (val > peak)
+			peak = val;
+		sum_sq += (double)val * val;
+		data += stride;
+	}
+
+	cl->peak   = peak;
+	cl->sum_sq = sum_sq;
+}
+
+static void measure_levels(struct audio_output *audio,
+		uint8_t *const data[], uint32_t frames, float volume,
+		struct audio_levels *levels)
+{
+	enum audio_format format      = audio->info.format;
+	size_t            sample_size = get_audio_bytes_per_channel(format);
+	bool              planar      = audio->planes > 1;
+
+	memset(levels, 0, sizeof(*levels));
+	levels->channels = (uint32_t)min_size(audio->channels,
+			MAX_AUDIO_CHANNELS);
+
+	if (!frames || volume <= 0.0f)
+		return;
+
+	for (uint32_t ch = 0; ch < levels->channels; ch++) {
+		struct channel_levels cl;
+
+		if (planar && (format == AUDIO_FORMAT_FLOAT_PLANAR))
+			measure_float((const float*)data[ch], frames, &cl);
+		else if (planar)
+			measure_samples(format, data[ch], frames,
+					sample_size, &cl);
+		else
+			measure_samples(format, data[0] + ch * sample_size,
+					frames, audio->block_size, &cl);
+
+		levels->peak[ch] = cl.peak * volume;
+		levels->rms[ch]  = (float)sqrt(cl.sum_sq / frames) * volume;
+	}
+}
+
+static inline bool levels_audible(const struct audio_levels *levels)
+{
+	for (uint32_t ch = 0; ch < levels->channels; ch++)
+		if (levels->peak[ch] > 0.0f)
+			return true;
+	return false;
+}
+
+typedef void (*mix_func_t)(uint8_t *mix, const uint8_t *vals, size_t size);
+
+static inline mix_func_t get_mix_func(enum audio_format format)
 {
 	switch (format) {
 	case AUDIO_FORMAT_UNKNOWN:
@@ -282,90 +549,267 @@ static inline void mix_audio(enum audio_format format,
 
 	case AUDIO_FORMAT_U8BIT:
 	case AUDIO_FORMAT_U8BIT_PLANAR:
-		mix_u8(mix, buf, size); break;
+		return mix_u8;
 
 	case AUDIO_FORMAT_16BIT:
 	case AUDIO_FORMAT_16BIT_PLANAR:
-		mix_s16(mix, buf, size); break;
+		return mix_s16;
 
 	case AUDIO_FORMAT_32BIT:
 	case AUDIO_FORMAT_32BIT_PLANAR:
-		mix_s32(mix, buf, size); break;
+		return mix_s32;
 
 	case AUDIO_FORMAT_FLOAT:
 	case AUDIO_FORMAT_FLOAT_PLANAR:
-		mix_float(mix, buf, size); break;
+		return mix_float;
 	}
+
+	return NULL;
 }
 
-static inline bool mix_audio_line(struct audio_output *audio,
-		struct audio_line *line, size_t size, uint64_t timestamp)
+/* mixes straight out of the circular buffer's memory (at most two contiguous
+ * spans) in to every bus the line is routed to, then pops the data */
+static inline void mix_audio(struct audio_output *audio, mix_func_t mix_func,
+		uint32_t mixers, size_t plane, size_t offset,
+		struct circlebuf *buf, size_t size)
 {
-	size_t time_offset = ts_diff_bytes(audio,
-			line->base_timestamp, timestamp);
-	if (time_offset > size)
-		return false;
+	struct circlebuf_span span;
+
+	if (!size)
+		return;
+
+	if (mix_func && mixers) {
+		circlebuf_peek_span(buf, size, &span);
+
+		for (size_t i = 0; i < audio->num_mixes; i++) {
+			uint8_t *mix;
+
+			if ((mixers & (1 << i)) == 0)
+				continue;
+
+			mix = audio->mixes[i]->mix_buffers[plane].array +
+				offset;
+
+			mix_func(mix, span.data[0], span.size[0]);
+			if (span.size[1])
+				mix_func(mix + span.size[0], span.data[1],
+						span.size[1]);
+		}
+	}
+
+	circlebuf_consume(buf, size);
+}
+
+static void mix_plane(struct audio_output *audio, size_t plane)
+{
+	mix_func_t mix_func = get_mix_func(audio->info.format);
+
+	for (size_t i = 0; i < audio->mix_jobs.num; i++) {
+		struct mix_job   *job = audio->mix_jobs.array+i;
+		struct circlebuf *buf = &job->line->buffers[plane];
+
+		mix_audio(audio, mix_func,
+				job->line->mixers & audio->active_mixes,
+				plane, job->time_offset, buf,
+				min_size(job->size, buf->size));
+	}
+}
+
+static void mix_plane_job(void *param, size_t plane)
+{
+	mix_plane(param, plane);
+}
+
+static void mix_all_planes(struct audio_output *audio)
+{
+	job_system_t js = os_atomic_load_ptr((void *volatile *)&audio->jobs);
+
+	if (js && audio->planes > 1 &&
+	    audio->mix_jobs.num >= MIX_THREAD_MIN_LINES) {
+		job_parallel_for(js, audio->planes, mix_plane_job, audio,
+				JOB_PRIORITY_HIGH, 0);
+		return;
+	}
+
+	for (size_t i = 0; i < audio->planes; i++)
+		mix_plane(audio, i);
+}
 
-	size -= time_offset;
+/* lines that are silent or not routed to any bus in use only have their
+ * data for this tick removed */
+static inline bool skip_line_mix(struct audio_output *audio,
+		struct audio_line *line)
+{
+	return !line->audible_end || !(line->mixers & audio->active_mixes);
+}
+
+static void consume_line_data(struct audio_line *line, size_t size)
+{
+	for (size_t i = 0; i < line->audio->planes; i++)
+		circlebuf_consume(&line->buffers[i],
+				min_size(size, line->buffers[i].size));
+
+	line->audible_end = (size < line->audible_end) ?
+		line->audible_end - size : 0;
+}
+
+/* locks the line and queues it for mixing if it has data for this tick.
+ * the line stays locked until the tick has been mixed. */
+static inline void add_mix_job(struct audio_output *audio,
+		struct audio_line *line, size_t size, uint64_t timestamp,
+		uint64_t end_timestamp)
+{
+	struct mix_job job;
+
+	pthread_mutex_lock(&line->mutex);
+
+	if (line->buffers[0].size && line->base_timestamp < timestamp) {
+		clear_excess_audio_data(line, timestamp);
+		line->base_timestamp = timestamp;
+	}
+
+	job.line        = line;
+	job.time_offset = ts_diff_bytes(audio, line->base_timestamp,
+			timestamp);
+
+	if (job.time_offset > size) {
+		pthread_mutex_unlock(&line->mutex);
+		return;
+	}
+
+	job.size = size - job.time_offset;
 
 #ifdef DEBUG_AUDIO
-	blog(LOG_DEBUG, "shaved off %lu bytes", size);
+	blog(LOG_DEBUG, "shaved off %lu bytes", job.size);
 #endif
 
-	for (size_t i = 0; i < audio->planes; i++) {
-		size_t pop_size = min_size(size, line->buffers[i].size);
-
-		mix_audio(audio->info.format,
-				audio->mix_buffers[i].array + time_offset,
-				&line->buffers[i], pop_size);
+	if (skip_line_mix(audio, line)) {
+		consume_line_data(line, job.size);
+		line->base_timestamp = end_timestamp;
+		pthread_mutex_unlock(&line->mutex);
+		return;
 	}
 
-	return true;
+	da_push_back(audio->mix_jobs, &job);
 }
 
-static bool resample_audio_output(struct audio_input *input,
-		struct audio_data *data)
+static void convert_audio_output(struct audio_converter *converter,
+		const struct audio_data *mix)
 {
-	bool success = true;
+	uint8_t  *output[MAX_AV_PLANES];
+	uint32_t frames;
+	uint64_t offset;
+
+	memset(output, 0, sizeof(output));
 
-	if (input->resampler) {
-		uint8_t  *output[MAX_AV_PLANES];
-		uint32_t frames;
-		uint64_t offset;
+	converter->converted = true;
+	converter->success   = audio_resampler_resample(converter->resampler,
+			output, &frames, &offset,
+			(const uint8_t *const *)mix->data, mix->frames);
 
-		memset(output, 0, sizeof(output));
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		converter->data.data[i] = output[i];
+	converter->data.frames    = frames;
+	converter->data.timestamp = mix->timestamp - offset;
+	converter->data.volume    = mix->volume;
+}
 
-		success = audio_resampler_resample(input->resampler,
-				output, &frames, &offset,
-				(const uint8_t *const *)data->data,
-				data->frames);
+/* ratio changes smaller than this aren't worth resetting the resampler's
+ * compensation for */
+#define CLOCK_RATIO_THRESHOLD 0.000001
 
-		for (size_t i = 0; i < MAX_AV_PLANES; i++)
-			data->data[i] = output[i];
-		data->frames     = frames;
-		data->timestamp -= offset;
+/* stretches the mix by the rate of the master clock relative to the system
+ * clock, and returns false if it couldn't be resampled */
+static bool resample_to_clock(struct audio_output *audio,
+		media_clock_t clock, struct audio_data *mix)
+{
+	uint8_t  *output[MAX_AV_PLANES];
+	uint32_t frames;
+	uint64_t offset;
+	double   ratio = media_clock_rate(clock);
+	size_t   planes = audio->planes;
+	size_t   bytes;
+
+	if (!audio->clock_resampler) {
+		struct resample_info info = {
+			.samples_per_sec = audio->info.samples_per_sec,
+			.format          = audio->info.format,
+			.speakers        = audio->info.speakers
+		};
+
+		audio->clock_resampler = audio_resampler_create(&info, &info);
+		audio->clock_ratio     = 1.0;
+		if (!audio->clock_resampler)
+			return false;
 	}
 
-	return success;
+	if (fabs(ratio - audio->clock_ratio) > CLOCK_RATIO_THRESHOLD) {
+		if (!audio_resampler_set_ratio(audio->clock_resampler, ratio))
+			return false;
+		audio->clock_ratio = ratio;
+	}
+
+	memset(output, 0, sizeof(output));
+
+	if (!audio_resampler_resample(audio->clock_resampler, output, &frames,
+				&offset, (const uint8_t *const *)mix->data,
+				mix->frames))
+		return false;
+
+	/* the resampler's buffers are reused on the next call, and converters
+	 * may hold on to the data, so it's copied to the bus */
+	bytes = frames * audio->block_size;
+	for (size_t i = 0; i < planes; i++) {
+		da_copy_array(audio->clock_buffers[i], output[i], bytes);
+		mix->data[i] = audio->clock_buffers[i].array;
+	}
+
+	mix->frames     = frames;
+	mix->timestamp -= offset;
+	return true;
 }
 
 static inline void do_audio_output(struct audio_output *audio,
-		uint64_t timestamp, uint32_t frames)
+		media_clock_t clock, uint64_t timestamp, uint32_t frames)
 {
-	struct audio_data data;
+	struct audio_data mix;
 	for (size_t i = 0; i < MAX_AV_PLANES; i++)
-		data.data[i] = audio->mix_buffers[i].array;
-	data.frames = frames;
-	data.timestamp = timestamp;
-	data.volume = 1.0f;
+		mix.data[i] = audio->mix_buffers[i].array;
+	mix.frames = frames;
+	mix.timestamp = timestamp;
+	mix.volume = 1.0f;
+
+	if (clock) {
+		if (!resample_to_clock(audio, clock, &mix))
+			return;
+	} else if (audio->clock_resampler) {
+		audio_resampler_destroy(audio->clock_resampler);
+		audio->clock_resampler = NULL;
+	}
 
 	pthread_mutex_lock(&audio->input_mutex);
 
+	for (size_t i = 0; i < audio->converters.num; i++)
+		audio->converters.array[i]->converted = false;
+
 	for (size_t i = 0; i < audio->inputs.num; i++) {
-		struct audio_input *input = audio->inputs.array+i;
+		struct audio_input     *input     = audio->inputs.array+i;
+		struct audio_converter *converter = input->converter;
+		struct audio_data      data;
+
+		if (converter) {
+			if (!converter->converted)
+				convert_audio_output(converter, &mix);
+			if (!converter->success)
+				continue;
+
+			data = converter->data;
+		} else {
+			data = mix;
+		}
 
-		if (resample_audio_output(input, &data))
-			input->callback(input->param, &data);
+		/* each input gets its own copy in case it modifies it */
+		input->callback(input->param, &data);
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
@@ -388,13 +832,27 @@ static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 	 * of data that was sampled to ensure seamless transmission */
 	audio_time = prev_time + conv_frames_to_time(audio, frames);
 
-	/* resize and clear mix buffers */
-	for (size_t i = 0; i < audio->planes; i++) {
-		da_resize(audio->mix_buffers[i], bytes);
-		memset(audio->mix_buffers[i].array, 0, bytes);
+	/* resize and clear the mix buffers of the buses that are in use, the
+	 * others aren't mixed at all */
+	audio->active_mixes = 0;
+
+	for (size_t i = 0; i < audio->num_mixes; i++) {
+		struct audio_output *mix = audio->mixes[i];
+
+		if (!audio_output_active(mix))
+			continue;
+
+		for (size_t j = 0; j < audio->planes; j++) {
+			da_resize(mix->mix_buffers[j], bytes);
+			memset(mix->mix_buffers[j].array, 0, bytes);
+		}
+
+		audio->active_mixes |= 1 << i;
 	}
 
-	/* mix audio lines */
+	/* gather audio lines */
+	da_resize(audio->mix_jobs, 0);
+
 	while (line) {
 		struct audio_line *next = line->next;
 
@@ -407,45 +865,133 @@ static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 			}
 		}
 
-		pthread_mutex_lock(&line->mutex);
+		add_mix_job(audio, line, bytes, prev_time, audio_time);
+		line = next;
+	}
 
-		if (line->buffers[0].size && line->base_timestamp < prev_time) {
-			clear_excess_audio_data(line, prev_time);
-			line->base_timestamp = prev_time;
-		}
+	/* mix audio lines */
+	mix_all_planes(audio);
 
-		if (mix_audio_line(audio, line, bytes, prev_time))
-			line->base_timestamp = audio_time;
+	for (size_t i = 0; i < audio->mix_jobs.num; i++) {
+		struct mix_job    *job   = audio->mix_jobs.array+i;
+		struct audio_line *mixed = job->line;
 
-		pthread_mutex_unlock(&line->mutex);
+		mixed->audible_end = (job->size < mixed->audible_end) ?
+			mixed->audible_end - job->size : 0;
+		mixed->base_timestamp = audio_time;
+		pthread_mutex_unlock(&mixed->mutex);
+	}
 
-		line = next;
+	for (size_t i = 0; i < audio->num_mixes; i++) {
+		struct audio_output *mix = audio->mixes[i];
+		struct audio_levels levels;
+		uint8_t             *data[MAX_AV_PLANES];
+
+		if ((audio->active_mixes & (1 << i)) == 0)
+			continue;
+
+		for (size_t j = 0; j < audio->planes; j++)
+			data[j] = mix->mix_buffers[j].array;
+
+		measure_levels(audio, data, frames, 1.0f, &levels);
+		publish_levels(&mix->levels, &levels);
 	}
 
 	/* output */
-	do_audio_output(audio, prev_time, frames);
+	pthread_mutex_lock(&audio->clock_mutex);
+
+	for (size_t i = 0; i < audio->num_mixes; i++)
+		if ((audio->active_mixes & (1 << i)) != 0)
+			do_audio_output(audio->mixes[i], audio->clock,
+					prev_time, frames);
+
+	pthread_mutex_unlock(&audio->clock_mutex);
 
 	return audio_time;
 }
 
-/* sample audio 40 times a second */
+/* by default, sample audio 40 times a second */
 #define AUDIO_WAIT_TIME (1000/40)
 
+static inline uint64_t line_end_time(struct audio_line *line)
+{
+	size_t frames = line->buffers[0].size / line->audio->block_size;
+	return line->base_timestamp +
+		conv_frames_to_time(line->audio, (uint32_t)frames);
+}
+
+/* in low latency mode, returns the time up to which every active line has
+ * data, or 0 if there are no active lines */
+static uint64_t get_buffered_time(struct audio_output *audio)
+{
+	struct audio_line *line = audio->first_line;
+	uint64_t buffered_time = 0;
+
+	while (line) {
+		pthread_mutex_lock(&line->mutex);
+
+		if (line->buffers[0].size) {
+			uint64_t end_time = line_end_time(line);
+			if (!buffered_time || end_time < buffered_time)
+				buffered_time = end_time;
+		}
+
+		pthread_mutex_unlock(&line->mutex);
+		line = line->next;
+	}
+
+	return buffered_time;
+}
+
+static uint64_t get_mix_time(struct audio_output *audio, uint64_t prev_time,
+		uint64_t buffer_time)
+{
+	uint64_t cur_time = os_gettime_ns();
+	uint64_t deadline = cur_time - buffer_time;
+
+	if (audio->info.low_latency) {
+		uint64_t buffered_time = get_buffered_time(audio);
+
+		if (buffered_time > cur_time)
+			buffered_time = cur_time;
+		if (buffered_time >= prev_time + audio->period_ns &&
+		    buffered_time > deadline)
+			return buffered_time;
+	}
+
+	return (deadline > prev_time) ? deadline : prev_time;
+}
+
 static void *audio_thread(void *param)
 {
 	struct audio_output *audio = param;
 	uint64_t buffer_time = audio->info.buffer_ms * 1000000;
 	uint64_t prev_time = os_gettime_ns() - buffer_time;
+	unsigned long period_ms = (unsigned long)(audio->period_ns / 1000000);
 	uint64_t audio_time;
+	uint64_t start;
+
+	os_thread_init(OS_THREAD_CLASS_AUDIO, "audio-io");
+
+	os_atomic_set_uint64(&audio->next_mix_time,
+			prev_time + audio->period_ns);
 
 	while (os_event_try(audio->stop_event) == EAGAIN) {
-		os_sleep_ms(AUDIO_WAIT_TIME);
+		if (audio->info.low_latency)
+			os_event_timedwait(audio->data_event, period_ms);
+		else
+			os_sleep_ms(period_ms);
 
 		pthread_mutex_lock(&audio->line_mutex);
 
-		audio_time = os_gettime_ns() - buffer_time;
+		start = trace_begin();
+		audio_time = get_mix_time(audio, prev_time, buffer_time);
 		audio_time = mix_and_output(audio, audio_time, prev_time);
 		prev_time  = audio_time;
+		trace_end("audio_mix", start);
+
+		os_atomic_set_uint64(&audio->next_mix_time,
+				prev_time + audio->period_ns);
 
 		pthread_mutex_unlock(&audio->line_mutex);
 	}
@@ -468,32 +1014,88 @@ static size_t audio_get_input_idx(audio_t video,
 	return DARRAY_INVALID;
 }
 
-static inline bool audio_input_init(struct audio_input *input,
-		struct audio_output *audio)
+static inline bool same_conversion(const struct audio_convert_info *a,
+		const struct audio_convert_info *b)
 {
-	if (input->conversion.format          != audio->info.format          ||
-	    input->conversion.samples_per_sec != audio->info.samples_per_sec ||
-	    input->conversion.speakers        != audio->info.speakers) {
-		struct resample_info from = {
-			.format          = audio->info.format,
-			.samples_per_sec = audio->info.samples_per_sec,
-			.speakers        = audio->info.speakers
-		};
+	return a->format          == b->format          &&
+	       a->samples_per_sec == b->samples_per_sec &&
+	       a->speakers        == b->speakers;
+}
 
-		struct resample_info to = {
-			.format          = input->conversion.format,
-			.samples_per_sec = input->conversion.samples_per_sec,
-			.speakers        = input->conversion.speakers
-		};
+static struct audio_converter *get_converter(struct audio_output *audio,
+		const struct audio_convert_info *conversion)
+{
+	struct audio_converter *converter;
 
-		input->resampler = audio_resampler_create(&to, &from);
-		if (!input->resampler) {
-			blog(LOG_ERROR, "audio_input_init: Failed to "
-			                "create resampler");
-			return false;
+	for (size_t i = 0; i < audio->converters.num; i++) {
+		converter = audio->converters.array[i];
+
+		if (same_conversion(&converter->conversion, conversion)) {
+			converter->refs++;
+			return converter;
 		}
-	} else {
-		input->resampler = NULL;
+	}
+
+	struct resample_info from = {
+		.format          = audio->info.format,
+		.samples_per_sec = audio->info.samples_per_sec,
+		.speakers        = audio->info.speakers
+	};
+
+	struct resample_info to = {
+		.format          = conversion->format,
+		.samples_per_sec = conversion->samples_per_sec,
+		.speakers        = conversion->speakers
+	};
+
+	audio_resampler_t resampler = audio_resampler_create(&to, &from);
+	if (!resampler)
+		return NULL;
+
+	converter = bzalloc(sizeof(struct audio_converter));
+	converter->conversion = *conversion;
+	converter->resampler  = resampler;
+	converter->refs       = 1;
+	da_push_back(audio->converters, &converter);
+	return converter;
+}
+
+static void release_converter(struct audio_output *audio,
+		struct audio_converter *converter)
+{
+	if (!converter || --converter->refs != 0)
+		return;
+
+	da_erase_item(audio->converters, &converter);
+	audio_resampler_destroy(converter->resampler);
+	bfree(converter);
+}
+
+static inline void audio_input_free(struct audio_output *audio,
+		struct audio_input *input)
+{
+	release_converter(audio, input->converter);
+}
+
+static inline bool audio_input_init(struct audio_input *input,
+		struct audio_output *audio)
+{
+	const struct audio_convert_info output_info = {
+		.format          = audio->info.format,
+		.samples_per_sec = audio->info.samples_per_sec,
+		.speakers        = audio->info.speakers
+	};
+
+	if (same_conversion(&input->conversion, &output_info)) {
+		input->converter = NULL;
+		return true;
+	}
+
+	input->converter = get_converter(audio, &input->conversion);
+	if (!input->converter) {
+		blog(LOG_ERROR, "audio_input_init: Failed to "
+		                "create resampler");
+		return false;
 	}
 
 	return true;
@@ -552,7 +1154,7 @@ void audio_output_disconnect(audio_t audio,
 
 	size_t idx = audio_get_input_idx(audio, callback, param);
 	if (idx != DARRAY_INVALID) {
-		audio_input_free(audio->inputs.array+idx);
+		audio_input_free(audio, audio->inputs.array+idx);
 		da_erase(audio->inputs, idx);
 	}
 
@@ -562,7 +1164,46 @@ void audio_output_disconnect(audio_t audio,
 static inline bool valid_audio_params(struct audio_output_info *info)
 {
 	return info->format && info->name && info->samples_per_sec > 0 &&
-	       info->speakers > 0;
+	       info->speakers > 0 && info->mixes <= MAX_AUDIO_MIXES;
+}
+
+static struct audio_output *audio_output_create_mix(
+		struct audio_output *parent, size_t mix_idx)
+{
+	struct audio_output *mix = bzalloc(sizeof(struct audio_output));
+
+	memcpy(&mix->info, &parent->info, sizeof(struct audio_output_info));
+	mix->channels   = parent->channels;
+	mix->planes     = parent->planes;
+	mix->block_size = parent->block_size;
+	mix->period_ns  = parent->period_ns;
+	mix->parent     = parent;
+	mix->mix_idx    = mix_idx;
+
+	if (pthread_mutex_init(&mix->input_mutex, NULL) != 0) {
+		bfree(mix);
+		return NULL;
+	}
+
+	return mix;
+}
+
+static void audio_output_free_mix(struct audio_output *mix)
+{
+	for (size_t i = 0; i < mix->inputs.num; i++)
+		audio_input_free(mix, mix->inputs.array+i);
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		da_free(mix->mix_buffers[i]);
+		da_free(mix->clock_buffers[i]);
+	}
+
+	audio_resampler_destroy(mix->clock_resampler);
+
+	da_free(mix->inputs);
+	da_free(mix->converters);
+	pthread_mutex_destroy(&mix->input_mutex);
+	bfree(mix);
 }
 
 int audio_output_open(audio_t *audio, struct audio_output_info *info)
@@ -584,6 +1225,8 @@ int audio_output_open(audio_t *audio, struct audio_output_info *info)
 	out->planes     = planar ? out->channels : 1;
 	out->block_size = (planar ? 1 : out->channels) *
 	                  get_audio_bytes_per_channel(info->format);
+	out->period_ns  = (info->period_ms ? info->period_ms : AUDIO_WAIT_TIME)
+	                  * 1000000ULL;
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		goto fail;
@@ -593,8 +1236,23 @@ int audio_output_open(audio_t *audio, struct audio_output_info *info)
 		goto fail;
 	if (pthread_mutex_init(&out->input_mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutex_init(&out->clock_mutex, NULL) != 0)
+		goto fail;
 	if (os_event_init(&out->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
+	if (os_event_init(&out->data_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
+	out->mixes[0]  = out;
+	out->num_mixes = 1;
+
+	for (size_t i = 1; i < info->mixes; i++) {
+		out->mixes[i] = audio_output_create_mix(out, i);
+		if (!out->mixes[i])
+			goto fail;
+		out->num_mixes++;
+	}
+
 	if (pthread_create(&out->thread, NULL, audio_thread, out) != 0)
 		goto fail;
 
@@ -612,14 +1270,19 @@ void audio_output_close(audio_t audio)
 	void *thread_ret;
 	struct audio_line *line;
 
-	if (!audio)
+	/* mix buses are freed along with their parent */
+	if (!audio || audio->parent)
 		return;
 
 	if (audio->initialized) {
 		os_event_signal(audio->stop_event);
+		os_event_signal(audio->data_event);
 		pthread_join(audio->thread, &thread_ret);
 	}
 
+	for (size_t i = 1; i < audio->num_mixes; i++)
+		audio_output_free_mix(audio->mixes[i]);
+
 	line = audio->first_line;
 	while (line) {
 		struct audio_line *next = line->next;
@@ -628,13 +1291,20 @@ void audio_output_close(audio_t audio)
 	}
 
 	for (size_t i = 0; i < audio->inputs.num; i++)
-		audio_input_free(audio->inputs.array+i);
+		audio_input_free(audio, audio->inputs.array+i);
 
-	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
 		da_free(audio->mix_buffers[i]);
+		da_free(audio->clock_buffers[i]);
+	}
 
+	audio_resampler_destroy(audio->clock_resampler);
+	da_free(audio->mix_jobs);
 	da_free(audio->inputs);
+	da_free(audio->converters);
 	os_event_destroy(audio->stop_event);
+	os_event_destroy(audio->data_event);
+	pthread_mutex_destroy(&audio->clock_mutex);
 	pthread_mutex_destroy(&audio->line_mutex);
 	bfree(audio);
 }
@@ -644,7 +1314,13 @@ audio_line_t audio_output_createline(audio_t audio, const char *name)
 	if (!audio) return NULL;
 
 	struct audio_line *line = bzalloc(sizeof(struct audio_line));
-	line->alive = true;
+	line->alive  = true;
+	line->mixers = 1 << audio->mix_idx;
+
+	/* lines always belong to the output that does the mixing */
+	if (audio->parent)
+		audio = audio->parent;
+
 	line->audio = audio;
 
 	if (pthread_mutex_init(&line->mutex, NULL) != 0) {
@@ -670,6 +1346,65 @@ audio_line_t audio_output_createline(audio_t audio, const char *name)
 	return line;
 }
 
+audio_t audio_output_get_mix(audio_t audio, size_t mix_idx)
+{
+	if (!audio)
+		return NULL;
+	if (audio->parent)
+		audio = audio->parent;
+
+	return (mix_idx < audio->num_mixes) ? audio->mixes[mix_idx] : NULL;
+}
+
+size_t audio_output_num_mixes(audio_t audio)
+{
+	if (!audio)
+		return 0;
+	if (audio->parent)
+		audio = audio->parent;
+
+	return audio->num_mixes;
+}
+
+void audio_line_set_mixers(audio_line_t line, uint32_t mixers)
+{
+	if (!line) return;
+
+	pthread_mutex_lock(&line->mutex);
+	line->mixers = mixers;
+	pthread_mutex_unlock(&line->mutex);
+}
+
+uint32_t audio_line_get_mixers(audio_line_t line)
+{
+	return line ? line->mixers : 0;
+}
+
+bool audio_line_get_levels(audio_line_t line, struct audio_levels *levels)
+{
+	if (!line || !levels) return false;
+	return read_levels(&line->levels, levels);
+}
+
+bool audio_output_get_levels(audio_t audio, struct audio_levels *levels)
+{
+	if (!audio || !levels) return false;
+	return read_levels(&audio->levels, levels);
+}
+
+bool audio_line_audible(audio_line_t line)
+{
+	bool audible;
+
+	if (!line) return false;
+
+	pthread_mutex_lock(&line->mutex);
+	audible = line->audible_end != 0;
+	pthread_mutex_unlock(&line->mutex);
+
+	return audible;
+}
+
 const struct audio_output_info *audio_output_getinfo(audio_t audio)
 {
 	return audio ? &audio->info : NULL;
@@ -685,6 +1420,28 @@ void audio_line_destroy(struct audio_line *line)
 	}
 }
 
+void audio_output_set_clock(audio_t audio, media_clock_t clock)
+{
+	if (!audio)
+		return;
+	if (audio->parent)
+		audio = audio->parent;
+
+	pthread_mutex_lock(&audio->clock_mutex);
+	audio->clock = clock;
+	pthread_mutex_unlock(&audio->clock_mutex);
+}
+
+void audio_output_set_job_system(audio_t audio, job_system_t jobs)
+{
+	if (!audio)
+		return;
+	if (audio->parent)
+		audio = audio->parent;
+
+	os_atomic_set_ptr((void *volatile *)&audio->jobs, jobs);
+}
+
 bool audio_output_active(audio_t audio)
 {
 	if (!audio) return false;
@@ -711,8 +1468,6 @@ uint32_t audio_output_samplerate(audio_t audio)
 	return audio ? audio->info.samples_per_sec : 0;
 }
 
-/* TODO: Optimization of volume multiplication functions */
-
 static inline void mul_vol_u8bit(void *array, float volume, size_t total_num)
 {
 	uint8_t *vals = array;
@@ -727,12 +1482,12 @@ static inline void mul_vol_u8bit(void *array, float volume, size_t total_num)
 
 static inline void mul_vol_16bit(void *array, float volume, size_t total_num)
 {
-	uint16_t *vals = array;
+	int16_t *vals = array;
 	int64_t vol = (int64_t)(volume * 32767.0f);
 
 	for (size_t i = 0; i < total_num; i++) {
 		int64_t output = (int64_t)vals[i] * vol / 32767;
-		vals[i] = (int32_t)CLAMP(output, MIN_S16, MAX_S16);
+		vals[i] = (int16_t)CLAMP(output, MIN_S16, MAX_S16);
 	}
 }
 
@@ -781,51 +1536,98 @@ static inline void mul_vol_32bit(void *array, float volume, size_t total_num)
 
 static inline void mul_vol_float(void *array, float volume, size_t total_num)
 {
-	float *vals = array;
+	float  *vals = array;
+	size_t i     = 0;
+
+#if defined(USE_SSE2_MIX)
+	__m128 vol = _mm_set1_ps(volume);
+
+	for (; i + 4 <= total_num; i += 4)
+		_mm_storeu_ps(vals + i, _mm_mul_ps(_mm_loadu_ps(vals + i), vol));
+#elif defined(USE_NEON_MIX)
+	float32x4_t vol = vdupq_n_f32(volume);
+
+	for (; i + 4 <= total_num; i += 4)
+		vst1q_f32(vals + i, vmulq_f32(vld1q_f32(vals + i), vol));
+#endif
 
-	for (size_t i = 0; i < total_num; i++)
+	for (; i < total_num; i++)
 		vals[i] *= volume;
 }
 
+static void mul_vol(enum audio_format format, void *array, float volume,
+		size_t total_num)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT:
+	case AUDIO_FORMAT_U8BIT_PLANAR:
+		mul_vol_u8bit(array, volume, total_num);
+		break;
+	case AUDIO_FORMAT_16BIT:
+	case AUDIO_FORMAT_16BIT_PLANAR:
+		mul_vol_16bit(array, volume, total_num);
+		break;
+	case AUDIO_FORMAT_32BIT:
+	case AUDIO_FORMAT_32BIT_PLANAR:
+		mul_vol_32bit(array, volume, total_num);
+		break;
+	case AUDIO_FORMAT_FLOAT:
+	case AUDIO_FORMAT_FLOAT_PLANAR:
+		mul_vol_float(array, volume, total_num);
+		break;
+	case AUDIO_FORMAT_UNKNOWN:
+		blog(LOG_ERROR, "mul_vol: Unknown format");
+		break;
+	}
+}
+
+/* the data is copied straight in to the line's buffer and the volume is
+ * applied to it there.  samples can only be split across the end of the
+ * buffer if its capacity isn't a multiple of the sample size, in which case
+ * the volume is applied to a separate copy and that is placed instead */
 static void audio_line_place_data_pos(struct audio_line *line,
 		const struct audio_data *data, size_t position)
 {
-	bool   planar     = line->audio->planes > 1;
-	size_t total_num  = data->frames * (planar ? 1 : line->audio->channels);
-	size_t total_size = data->frames * line->audio->block_size;
+	enum audio_format format  = line->audio->info.format;
+	size_t sample_size = get_audio_bytes_per_channel(format);
+	size_t total_size  = data->frames * line->audio->block_size;
+	bool   set_volume  = data->volume != 1.0f;
+	struct audio_levels levels;
+	bool   audible;
+
+	measure_levels(line->audio, data->data, data->frames, data->volume,
+			&levels);
+	publish_levels(&line->levels, &levels);
+	audible = levels_audible(&levels);
 
 	for (size_t i = 0; i < line->audio->planes; i++) {
-		da_copy_array(line->volume_buffers[i], data->data[i],
-				total_size);
-
-		uint8_t *array = line->volume_buffers[i].array;
-
-		switch (line->audio->info.format) {
-		case AUDIO_FORMAT_U8BIT:
-		case AUDIO_FORMAT_U8BIT_PLANAR:
-			mul_vol_u8bit(array, data->volume, total_num);
-			break;
-		case AUDIO_FORMAT_16BIT:
-		case AUDIO_FORMAT_16BIT_PLANAR:
-			mul_vol_16bit(array, data->volume, total_num);
-			break;
-		case AUDIO_FORMAT_32BIT:
-		case AUDIO_FORMAT_32BIT_PLANAR:
-			mul_vol_32bit(array, data->volume, total_num);
-			break;
-		case AUDIO_FORMAT_FLOAT:
-		case AUDIO_FORMAT_FLOAT_PLANAR:
-			mul_vol_float(array, data->volume, total_num);
-			break;
-		case AUDIO_FORMAT_UNKNOWN:
-			blog(LOG_ERROR, "audio_line_place_data_pos: "
-					"Unknown format");
-			break;
+		struct circlebuf      *buf = &line->buffers[i];
+		struct circlebuf_span span;
+
+		circlebuf_place(buf, position, data->data[i], total_size);
+		if (!set_volume)
+			continue;
+
+		if (buf->capacity % sample_size != 0) {
+			da_copy_array(line->volume_buffers[i], data->data[i],
+					total_size);
+			mul_vol(format, line->volume_buffers[i].array,
+					data->volume, total_size / sample_size);
+			circlebuf_place(buf, position,
+					line->volume_buffers[i].array,
+					total_size);
+			continue;
 		}
 
-		circlebuf_place(&line->buffers[i], position,
-				line->volume_buffers[i].array, total_size);
+		circlebuf_get_span(buf, buf->start_pos + position, total_size,
+				&span);
+		for (size_t j = 0; j < 2 && span.size[j]; j++)
+			mul_vol(format, span.data[j], data->volume,
+					span.size[j] / sample_size);
 	}
+
+	if (audible && line->audible_end < position + total_size)
+		line->audible_end = position + total_size;
 }
 
 static void audio_line_place_data(struct audio_line *line,
@@ -871,5 +1673,10 @@ void audio_line_output(audio_line_t line, const struct audio_data *data)
 		                line->base_timestamp);
 	}
 
+	if (line->audio->info.low_latency &&
+	    line_end_time(line) >=
+	    os_atomic_load_uint64(&line->audio->next_mix_time))
+		os_event_signal(line->audio->data_event);
+
 	pthread_mutex_unlock(&line->mutex);
 }
@@ -18,7 +18,9 @@
 #pragma once
 
 #include "media-io-defs.h"
+#include "media-clock.h"
 #include "../util/c99defs.h"
+#include "../util/job-system.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,6 +31,9 @@ extern "C" {
  * for the media.
  */
 
+#define MAX_AUDIO_MIXES 6
+#define MAX_AUDIO_CHANNELS 8
+
 struct audio_output;
 struct audio_line;
 typedef struct audio_output *audio_t;
@@ -69,6 +74,17 @@ struct audio_data {
 	float               volume;
 };
 
+/**
+ * Peak and RMS levels of each channel of the last data of a line or mix, as
+ * linear values where 1.0 is full scale.  Line levels include the line's
+ * volume.
+ */
+struct audio_levels {
+	uint32_t            channels;
+	float               peak[MAX_AUDIO_CHANNELS];
+	float               rms[MAX_AUDIO_CHANNELS];
+};
+
 struct audio_output_info {
 	const char          *name;
 
@@ -76,6 +92,26 @@ struct audio_output_info {
 	enum audio_format   format;
 	enum speaker_layout speakers;
 	uint64_t            buffer_ms;
+
+	/**
+	 * Mixing period in milliseconds.  0 uses the default period (25ms).
+	 */
+	uint32_t            period_ms;
+
+	/**
+	 * Low latency mode.  Instead of only mixing once data is buffer_ms
+	 * old, audio is mixed as soon as every active line has buffered at
+	 * least one period of new data.  buffer_ms then acts as the deadline
+	 * for lines that fall behind.
+	 */
+	bool                low_latency;
+
+	/**
+	 * Number of mix buses, up to MAX_AUDIO_MIXES.  0 is the same as 1.
+	 * Every bus is mixed in the same pass and has its own outputs (see
+	 * audio_output_get_mix).
+	 */
+	size_t              mixes;
 };
 
 struct audio_convert_info {
@@ -188,10 +224,63 @@ EXPORT size_t audio_output_channels(audio_t audio);
 EXPORT uint32_t audio_output_samplerate(audio_t audio);
 EXPORT const struct audio_output_info *audio_output_getinfo(audio_t audio);
 
+/**
+ * Gets a mix bus of an audio output.  Mix 0 is the audio output itself.  The
+ * returned handle can be connected to like any other audio output, and is
+ * freed along with the audio output it belongs to (closing it does nothing).
+ * Returns NULL if the bus doesn't exist.
+ */
+EXPORT audio_t audio_output_get_mix(audio_t audio, size_t mix_idx);
+
+/** Returns the number of mix buses of an audio output */
+EXPORT size_t audio_output_num_mixes(audio_t audio);
+
+/**
+ * Sets a master clock to resample the output of every mix bus to, so each
+ * second of that clock gets the full sample rate, or NULL to stop.  Mixing
+ * and timestamps still follow the system clock.  The clock must stay valid
+ * until it has been replaced or the output has been closed.
+ */
+EXPORT void audio_output_set_clock(audio_t audio, media_clock_t clock);
+
+/**
+ * Sets the job system that the planes of planar audio are mixed in parallel
+ * with when there are many lines, or NULL to mix them all on the audio
+ * thread.  The job system must outlive the output.
+ */
+EXPORT void audio_output_set_job_system(audio_t audio, job_system_t jobs);
+
+/**
+ * Creates a line.  Lines are mixed in to all buses set with
+ * audio_line_set_mixers; creating a line on a mix bus initially routes it to
+ * that bus only.
+ */
 EXPORT audio_line_t audio_output_createline(audio_t audio, const char *name);
 EXPORT void audio_line_destroy(audio_line_t line);
 EXPORT void audio_line_output(audio_line_t line, const struct audio_data *data);
 
+/** Sets which mix buses a line is mixed in to, one bit per bus */
+EXPORT void audio_line_set_mixers(audio_line_t line, uint32_t mixers);
+EXPORT uint32_t audio_line_get_mixers(audio_line_t line);
+
+/**
+ * Returns whether any of the data buffered in a line is audible.  Lines with
+ * only digital silence or muted data buffered are not mixed.
+ */
+EXPORT bool audio_line_audible(audio_line_t line);
+
+/**
+ * Gets the levels of the data most recently output to a line.  Doesn't lock,
+ * so it can be polled from any thread at display rate.  Returns false if the
+ * levels were being updated the whole time.
+ */
+EXPORT bool audio_line_get_levels(audio_line_t line,
+		struct audio_levels *levels);
+
+/** Gets the levels of the most recent mix of an output or mix bus */
+EXPORT bool audio_output_get_levels(audio_t audio,
+		struct audio_levels *levels);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,291 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <math.h>
+
+#include "../util/bmem.h"
+#include "../util/base.h"
+#include "../util/circlebuf.h"
+#include "../util/threading.h"
+
+#include "audio-monitor.h"
+
+/* the fill level is averaged over roughly this many pulls by the device */
+#define FILL_SMOOTHING        0.01
+
+/* how often the stretch ratio is recalculated, in seconds of output */
+#define ADJUST_INTERVAL_SEC   1
+
+/* ratio change per second of buffered audio away from the target.  10ms of
+ * error is corrected over about ten seconds.  the integral part learns the
+ * actual clock difference so the buffer settles at the target itself */
+#define ADJUST_GAIN           0.1
+#define ADJUST_INTEGRAL_GAIN  0.02
+
+/* largest stretch, which stays well under what can be heard as a change in
+ * pitch */
+#define MAX_RATIO_ADJUST      0.005
+
+/* the buffer is cut back to the target when it gets this many times over
+ * it, like when the device stopped pulling for a while */
+#define MAX_BUFFER_TARGETS    4
+
+struct audio_monitor {
+	struct resample_info info;
+	size_t               block_size;
+	uint32_t             target_frames;
+
+	/* only touched by the pushing thread */
+	audio_resampler_t    resampler;
+	double               applied_ratio;
+	bool                 stretching;
+
+	pthread_mutex_t      mutex;
+	struct circlebuf     buffer;
+	bool                 primed;
+	double               avg_fill;
+	uint32_t             frames_since_adjust;
+	double               ratio;
+	double               drift;
+	long                 underruns;
+};
+
+audio_monitor_t audio_monitor_create(const struct resample_info *info,
+		uint32_t latency_ms)
+{
+	struct audio_monitor *monitor;
+
+	if (!info || is_audio_planar(info->format) ||
+	    info->format == AUDIO_FORMAT_UNKNOWN) {
+		blog(LOG_ERROR, "audio_monitor_create: Unsupported format");
+		return NULL;
+	}
+
+	if (latency_ms < AUDIO_MONITOR_MIN_LATENCY_MS)
+		latency_ms = AUDIO_MONITOR_MIN_LATENCY_MS;
+	else if (latency_ms > AUDIO_MONITOR_MAX_LATENCY_MS)
+		latency_ms = AUDIO_MONITOR_MAX_LATENCY_MS;
+
+	monitor = bzalloc(sizeof(struct audio_monitor));
+	monitor->info          = *info;
+	monitor->block_size    = get_audio_size(info->format, info->speakers,
+			1);
+	monitor->target_frames = info->samples_per_sec * latency_ms / 1000;
+	monitor->avg_fill      = (double)monitor->target_frames;
+	monitor->ratio         = 1.0;
+	monitor->applied_ratio = 1.0;
+
+	if (pthread_mutex_init(&monitor->mutex, NULL) != 0) {
+		bfree(monitor);
+		return NULL;
+	}
+
+	/* same format on both sides, so it's only used once the ratio has
+	 * been changed */
+	monitor->resampler = audio_resampler_create(info, info);
+	if (!monitor->resampler) {
+		audio_monitor_destroy(monitor);
+		return NULL;
+	}
+
+	return monitor;
+}
+
+void audio_monitor_destroy(audio_monitor_t monitor)
+{
+	if (!monitor)
+		return;
+
+	audio_resampler_destroy(monitor->resampler);
+	circlebuf_free(&monitor->buffer);
+	pthread_mutex_destroy(&monitor->mutex);
+	bfree(monitor);
+}
+
+static inline size_t target_size(const struct audio_monitor *monitor)
+{
+	return monitor->target_frames * monitor->block_size;
+}
+
+void audio_monitor_push(audio_monitor_t monitor, const struct audio_data *data)
+{
+	const uint8_t *input  = NULL;
+	uint32_t      frames  = 0;
+	uint8_t       *output[MAX_AV_PLANES];
+	uint64_t      offset;
+	double        ratio;
+	size_t        size;
+
+	if (!monitor || !data || !data->frames)
+		return;
+
+	pthread_mutex_lock(&monitor->mutex);
+	ratio = monitor->ratio;
+	pthread_mutex_unlock(&monitor->mutex);
+
+	if (fabs(ratio - monitor->applied_ratio) > 0.00001 &&
+	    audio_resampler_set_ratio(monitor->resampler, ratio)) {
+		monitor->applied_ratio = ratio;
+		monitor->stretching    = true;
+	}
+
+	memset(output, 0, sizeof(output));
+	if (monitor->stretching &&
+	    audio_resampler_resample(monitor->resampler, output, &frames,
+				&offset, (const uint8_t *const *)data->data,
+				data->frames)) {
+		input = output[0];
+	} else {
+		input  = data->data[0];
+		frames = data->frames;
+	}
+
+	size = frames * monitor->block_size;
+
+	pthread_mutex_lock(&monitor->mutex);
+
+	circlebuf_push_back(&monitor->buffer, input, size);
+
+	if (monitor->buffer.size > target_size(monitor) * MAX_BUFFER_TARGETS) {
+		size_t excess = monitor->buffer.size - target_size(monitor);
+		circlebuf_pop_front(&monitor->buffer, NULL, excess);
+		monitor->avg_fill = (double)monitor->target_frames;
+
+		blog(LOG_DEBUG, "audio_monitor_push: Dropped %u frames of "
+		                "buffered audio",
+		                (unsigned)(excess / monitor->block_size));
+	}
+
+	pthread_mutex_unlock(&monitor->mutex);
+}
+
+static inline void fill_silence(const struct audio_monitor *monitor,
+		uint8_t *output, size_t size)
+{
+	bool u8 = monitor->info.format == AUDIO_FORMAT_U8BIT;
+	memset(output, u8 ? 0x80 : 0, size);
+}
+
+static inline double clamp_adjust(double adjust)
+{
+	if (adjust > MAX_RATIO_ADJUST)
+		return MAX_RATIO_ADJUST;
+	if (adjust < -MAX_RATIO_ADJUST)
+		return -MAX_RATIO_ADJUST;
+	return adjust;
+}
+
+/* called with the mutex locked, once per pull by the device */
+static void update_ratio(struct audio_monitor *monitor, uint32_t frames)
+{
+	double fill = (double)(monitor->buffer.size / monitor->block_size);
+	double error;
+	double adjust;
+
+	monitor->avg_fill += (fill - monitor->avg_fill) * FILL_SMOOTHING;
+	monitor->frames_since_adjust += frames;
+
+	if (monitor->frames_since_adjust <
+			monitor->info.samples_per_sec * ADJUST_INTERVAL_SEC)
+		return;
+
+	monitor->frames_since_adjust = 0;
+
+	error  = (monitor->avg_fill - (double)monitor->target_frames) /
+		(double)monitor->info.samples_per_sec;
+
+	monitor->drift += error * ADJUST_INTEGRAL_GAIN;
+	monitor->drift  = clamp_adjust(monitor->drift);
+
+	adjust = clamp_adjust(monitor->drift + error * ADJUST_GAIN);
+
+	/* too much buffered means the device is slower than the audio clock,
+	 * so less audio has to be produced for the same input */
+	monitor->ratio = 1.0 - adjust;
+}
+
+void audio_monitor_pop(audio_monitor_t monitor, uint8_t *output,
+		uint32_t frames)
+{
+	size_t size = frames * monitor->block_size;
+	size_t available;
+
+	if (!monitor) {
+		memset(output, 0, size);
+		return;
+	}
+
+	pthread_mutex_lock(&monitor->mutex);
+
+	if (!monitor->primed) {
+		if (monitor->buffer.size < target_size(monitor)) {
+			pthread_mutex_unlock(&monitor->mutex);
+			fill_silence(monitor, output, size);
+			return;
+		}
+
+		monitor->primed   = true;
+		monitor->avg_fill = (double)monitor->target_frames;
+	}
+
+	update_ratio(monitor, frames);
+
+	available = monitor->buffer.size;
+	if (available >= size) {
+		circlebuf_pop_front(&monitor->buffer, output, size);
+	} else {
+		circlebuf_pop_front(&monitor->buffer, output, available);
+		fill_silence(monitor, output + available, size - available);
+
+		/* build the buffer back up to the target before playing again,
+		 * rather than running dry on every pull */
+		monitor->primed = false;
+		monitor->underruns++;
+
+		blog(LOG_DEBUG, "audio_monitor_pop: Buffer ran dry (%ld "
+		                "times so far)", monitor->underruns);
+	}
+
+	pthread_mutex_unlock(&monitor->mutex);
+}
+
+void audio_monitor_clear(audio_monitor_t monitor)
+{
+	if (!monitor)
+		return;
+
+	pthread_mutex_lock(&monitor->mutex);
+	circlebuf_free(&monitor->buffer);
+	monitor->primed              = false;
+	monitor->avg_fill            = (double)monitor->target_frames;
+	monitor->frames_since_adjust = 0;
+	pthread_mutex_unlock(&monitor->mutex);
+}
+
+uint32_t audio_monitor_buffered_frames(audio_monitor_t monitor)
+{
+	uint32_t frames;
+
+	if (!monitor)
+		return 0;
+
+	pthread_mutex_lock(&monitor->mutex);
+	frames = (uint32_t)(monitor->buffer.size / monitor->block_size);
+	pthread_mutex_unlock(&monitor->mutex);
+
+	return frames;
+}
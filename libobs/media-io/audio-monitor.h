@@ -0,0 +1,76 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+#include "audio-io.h"
+#include "audio-resampler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Audio monitor buffer
+ *
+ *   Jitter buffer between an audio output and a playback device.  Audio is
+ * pushed from the output's raw audio callback, already converted to the
+ * device's format, and pulled by the device at its own rate.  The device
+ * clock and the audio clock are never exactly the same, so the fill level of
+ * the buffer is watched and the pushed audio is stretched or shrunk very
+ * slightly to keep it at the target latency.
+ *
+ *   Only interleaved formats are supported, which is what devices take.
+ */
+
+struct audio_monitor;
+typedef struct audio_monitor *audio_monitor_t;
+
+#define AUDIO_MONITOR_MIN_LATENCY_MS 5
+#define AUDIO_MONITOR_MAX_LATENCY_MS 500
+
+/**
+ * Creates a monitor buffer for a device format
+ *
+ * @param  info        Format of the device, which must be interleaved
+ * @param  latency_ms  Target amount of buffered audio
+ */
+EXPORT audio_monitor_t audio_monitor_create(const struct resample_info *info,
+		uint32_t latency_ms);
+EXPORT void audio_monitor_destroy(audio_monitor_t monitor);
+
+/** Adds audio in the device format, from the audio output's thread */
+EXPORT void audio_monitor_push(audio_monitor_t monitor,
+		const struct audio_data *data);
+
+/**
+ * Fills a device buffer, from the device's thread.  Until the target latency
+ * has been buffered, and after running dry, silence is output.
+ */
+EXPORT void audio_monitor_pop(audio_monitor_t monitor, uint8_t *output,
+		uint32_t frames);
+
+/** Removes all buffered audio, like when the device is restarted */
+EXPORT void audio_monitor_clear(audio_monitor_t monitor);
+
+/** Gets the number of frames currently buffered */
+EXPORT uint32_t audio_monitor_buffered_frames(audio_monitor_t monitor);
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,17 +15,28 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <math.h>
 #include "../util/bmem.h"
 #include "audio-resampler.h"
+#include "audio-format-conversion.h"
 #include "audio-io.h"
 #include <libavutil/avutil.h>
 #include <libavformat/avformat.h>
 #include <libswresample/swresample.h>
 
+/* sample count compensation is spread across this many seconds of output,
+ * which gives a resolution of a tenth of a sample per second */
+#define RATIO_COMPENSATION_SECONDS 10
+
 struct audio_resampler {
 	struct SwrContext   *context;
 	bool                opened;
 
+	/* only the sample format differs, so libswresample isn't used */
+	bool                native;
+	enum audio_format   native_input_format;
+	enum audio_format   native_output_format;
+
 	uint32_t            input_freq;
 	uint64_t            input_layout;
 	enum AVSampleFormat input_format;
@@ -77,11 +88,34 @@ static inline uint64_t convert_speaker_layout(enum speaker_layout layout)
 	return 0;
 }
 
+static bool create_context(struct audio_resampler *rs)
+{
+	int errcode;
+
+	rs->context = swr_alloc_set_opts(NULL,
+		rs->output_layout, rs->output_format, rs->output_freq,
+		rs->input_layout,  rs->input_format,  rs->input_freq,
+		0, NULL);
+
+	if (!rs->context) {
+		blog(LOG_ERROR, "swr_alloc_set_opts failed");
+		return false;
+	}
+
+	errcode = swr_init(rs->context);
+	if (errcode != 0) {
+		blog(LOG_ERROR, "avresample_open failed: error code %d",
+				errcode);
+		return false;
+	}
+
+	return true;
+}
+
 audio_resampler_t audio_resampler_create(const struct resample_info *dst,
 		const struct resample_info *src)
 {
 	struct audio_resampler *rs = bzalloc(sizeof(struct audio_resampler));
-	int errcode;
 
 	rs->opened        = false;
 	rs->input_freq    = src->samples_per_sec;
@@ -94,21 +128,16 @@ audio_resampler_t audio_resampler_create(const struct resample_info *dst,
 	rs->output_format = convert_audio_format(dst->format);
 	rs->output_planes = is_audio_planar(dst->format) ? rs->output_ch : 1;
 
-	rs->context = swr_alloc_set_opts(NULL,
-		rs->output_layout, rs->output_format, dst->samples_per_sec,
-		rs->input_layout,  rs->input_format,  src->samples_per_sec,
-		0, NULL);
-
-	if (!rs->context) {
-		blog(LOG_ERROR, "swr_alloc_set_opts failed");
-		audio_resampler_destroy(rs);
-		return NULL;
+	if (src->samples_per_sec == dst->samples_per_sec &&
+	    src->speakers        == dst->speakers        &&
+	    src->speakers        != SPEAKERS_UNKNOWN) {
+		rs->native               = true;
+		rs->native_input_format  = src->format;
+		rs->native_output_format = dst->format;
+		return rs;
 	}
 
-	errcode = swr_init(rs->context);
-	if (errcode != 0) {
-		blog(LOG_ERROR, "avresample_open failed: error code %d",
-				errcode);
+	if (!create_context(rs)) {
 		audio_resampler_destroy(rs);
 		return NULL;
 	}
@@ -128,12 +157,77 @@ void audio_resampler_destroy(audio_resampler_t rs)
 	}
 }
 
+bool audio_resampler_set_ratio(audio_resampler_t rs, double ratio)
+{
+	int distance, delta;
+
+	if (!rs) return false;
+
+	/* a native resampler only converts the sample format, so it needs a
+	 * real context before its rate can be adjusted */
+	if (rs->native) {
+		if (!create_context(rs)) {
+			if (rs->context)
+				swr_free(&rs->context);
+			return false;
+		}
+
+		rs->native = false;
+	}
+
+	distance = (int)rs->output_freq * RATIO_COMPENSATION_SECONDS;
+	delta    = (int)lround((ratio - 1.0) * (double)distance);
+
+	if (swr_set_compensation(rs->context, delta, distance) < 0) {
+		blog(LOG_ERROR, "swr_set_compensation failed for ratio %g",
+				ratio);
+		return false;
+	}
+
+	return true;
+}
+
+static bool resample_native(struct audio_resampler *rs,
+		 uint8_t *output[], uint32_t *out_frames, uint64_t *ts_offset,
+		 const uint8_t *const input[], uint32_t in_frames)
+{
+	if ((int)in_frames > rs->output_size) {
+		if (rs->output_buffer[0])
+			av_freep(&rs->output_buffer[0]);
+
+		if (av_samples_alloc(rs->output_buffer, NULL, rs->output_ch,
+					(int)in_frames, rs->output_format,
+					0) < 0) {
+			blog(LOG_ERROR, "av_samples_alloc failed");
+			rs->output_size = 0;
+			return false;
+		}
+
+		rs->output_size = (int)in_frames;
+	}
+
+	audio_convert_format(rs->output_buffer, rs->native_output_format,
+			input, rs->native_input_format,
+			rs->output_ch, in_frames);
+
+	for (uint32_t i = 0; i < rs->output_planes; i++)
+		output[i] = rs->output_buffer[i];
+
+	*out_frames = in_frames;
+	*ts_offset  = 0;
+	return true;
+}
+
 bool audio_resampler_resample(audio_resampler_t rs,
 		 uint8_t *output[], uint32_t *out_frames, uint64_t *ts_offset,
 		 const uint8_t *const input[], uint32_t in_frames)
 {
 	if (!rs) return false;
 
+	if (rs->native)
+		return resample_native(rs, output, out_frames, ts_offset,
+				input, in_frames);
+
 	struct SwrContext *context = rs->context;
 	int ret;
 
@@ -37,6 +37,14 @@ EXPORT audio_resampler_t audio_resampler_create(const struct resample_info *dst,
 		const struct resample_info *src);
 EXPORT void audio_resampler_destroy(audio_resampler_t resampler);
 
+/**
+ * Stretches the output by the given ratio of output to input samples, on
+ * top of the sample rate conversion, to follow a clock that runs slightly
+ * faster or slower than the one the input was timed with
+ */
+EXPORT bool audio_resampler_set_ratio(audio_resampler_t resampler,
+		double ratio);
+
 EXPORT bool audio_resampler_resample(audio_resampler_t resampler,
 		 uint8_t *output[], uint32_t *out_frames, uint64_t *ts_offset,
 		 const uint8_t *const input[], uint32_t in_frames);
@@ -15,10 +15,246 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include "../util/base.h"
+#include "../util/threading.h"
 #include "format-conversion.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || \
+    defined(__i386__)
+#define USE_X86_CONVERSION
 #include <xmmintrin.h>
 #include <emmintrin.h>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#define USE_AVX2_CONVERSION
+#elif defined(__clang__) || __GNUC__ > 4 || \
+      (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#include <cpuid.h>
+#include <immintrin.h>
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2  __attribute__((target("avx2")))
+#define USE_AVX2_CONVERSION
+#else
+/* older compilers can't build ssse3/avx2 code without building the whole
+ * file for it, so only the sse2 paths are available */
+#include <cpuid.h>
+#endif
+
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define USE_NEON_CONVERSION
+#include <arm_neon.h>
+#endif
+
+static FORCE_INLINE uint32_t min_uint32(uint32_t a, uint32_t b)
+{
+	return a < b ? a : b;
+}
+
+/* number of packed 422 pairs per line, each of which is 4 bytes of input and
+ * two 4 byte pixels of output */
+static FORCE_INLINE uint32_t get_422_width_d2(uint32_t in_linesize,
+		uint32_t out_linesize)
+{
+	return min_uint32(in_linesize / 4, out_linesize / 8);
+}
+
+/* ------------------------------------------------------------------------- */
+/* scalar reference implementations
+ *
+ * These are used when no SIMD path is available, for the tails of rows
+ * that don't fit in to a full vector, and to validate the SIMD paths. */
+
+static FORCE_INLINE void compress_uyvx_block_c(
+		const uint8_t *line1, const uint8_t *line2,
+		uint8_t *lum0, uint8_t *lum1, uint8_t *u, uint8_t *v)
+{
+	lum0[0] = line1[1];
+	lum0[1] = line1[5];
+	lum1[0] = line2[1];
+	lum1[1] = line2[5];
+
+	*u = (uint8_t)((line1[0] + line1[4] + line2[0] + line2[4]) >> 2);
+	*v = (uint8_t)((line1[2] + line1[6] + line2[2] + line2[6]) >> 2);
+}
+
+void compress_uyvx_to_i420_c(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t y;
+
+	for (y = start_y; y < end_y; y += 2) {
+		const uint8_t *line1 = input + y * in_linesize;
+		const uint8_t *line2 = line1 + in_linesize;
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *u    = output[1] + (y>>1) * out_linesize[1];
+		uint8_t *v    = output[2] + (y>>1) * out_linesize[2];
+		uint32_t x;
+
+		for (x = 0; x < width; x += 2)
+			compress_uyvx_block_c(line1 + x*4, line2 + x*4,
+					lum0 + x, lum1 + x,
+					u + (x>>1), v + (x>>1));
+	}
+}
+
+void compress_uyvx_to_nv12_c(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t y;
+
+	for (y = start_y; y < end_y; y += 2) {
+		const uint8_t *line1 = input + y * in_linesize;
+		const uint8_t *line2 = line1 + in_linesize;
+		uint8_t *lum0   = output[0] + y * out_linesize[0];
+		uint8_t *lum1   = lum0 + out_linesize[0];
+		uint8_t *chroma = output[1] + (y>>1) * out_linesize[1];
+		uint32_t x;
+
+		for (x = 0; x < width; x += 2)
+			compress_uyvx_block_c(line1 + x*4, line2 + x*4,
+					lum0 + x, lum1 + x,
+					chroma + x, chroma + x + 1);
+	}
+}
+
+static FORCE_INLINE void decompress_420_row_c(
+		const uint8_t *lum0, const uint8_t *lum1,
+		const uint8_t *chroma0, const uint8_t *chroma1,
+		uint32_t *output0, uint32_t *output1,
+		uint32_t start_x, uint32_t width_d2)
+{
+	uint32_t x;
+
+	for (x = start_x; x < width_d2; x++) {
+		uint32_t out = (chroma0[x] << 8) | (chroma1[x] << 16);
+
+		output0[x*2]   = lum0[x*2]   | out;
+		output0[x*2+1] = lum0[x*2+1] | out;
+		output1[x*2]   = lum1[x*2]   | out;
+		output1[x*2+1] = lum1[x*2+1] | out;
+	}
+}
+
+static FORCE_INLINE void decompress_nv12_row_c(
+		const uint8_t *lum0, const uint8_t *lum1,
+		const uint16_t *chroma,
+		uint32_t *output0, uint32_t *output1,
+		uint32_t start_x, uint32_t width_d2)
+{
+	uint32_t x;
+
+	for (x = start_x; x < width_d2; x++) {
+		uint32_t out = chroma[x] << 8;
+
+		output0[x*2]   = lum0[x*2]   | out;
+		output0[x*2+1] = lum0[x*2+1] | out;
+		output1[x*2]   = lum1[x*2]   | out;
+		output1[x*2+1] = lum1[x*2+1] | out;
+	}
+}
+
+static FORCE_INLINE void decompress_422_row_c(
+		const uint32_t *input32, uint32_t *output32,
+		uint32_t start_x, uint32_t width_d2, bool leading_lum)
+{
+	uint32_t x;
+
+	if (leading_lum) {
+		for (x = start_x; x < width_d2; x++) {
+			uint32_t dw = input32[x];
+
+			output32[x*2] = dw;
+			dw &= 0xFFFFFF00;
+			dw |= (uint8_t)(dw>>16);
+			output32[x*2+1] = dw;
+		}
+	} else {
+		for (x = start_x; x < width_d2; x++) {
+			uint32_t dw = input32[x];
+
+			output32[x*2] = dw;
+			dw &= 0xFFFF00FF;
+			dw |= (dw>>16) & 0xFF00;
+			output32[x*2+1] = dw;
+		}
+	}
+}
+
+/* the 420/nv12/422 row helpers are shared with the SIMD versions, which
+ * start them at the first pixel that didn't fit in to a full vector */
+#define DECOMPRESS_420_ROWS(row_func)                                         \
+	uint32_t start_y_d2 = start_y/2;                                      \
+	uint32_t width_d2   = min_uint32(in_linesize[0], out_linesize)/2;     \
+	uint32_t height_d2  = end_y/2;                                        \
+	uint32_t y;                                                           \
+                                                                              \
+	for (y = start_y_d2; y < height_d2; y++) {                            \
+		const uint8_t *lum0 = input[0] + y * 2 * in_linesize[0];      \
+		const uint8_t *lum1 = lum0 + in_linesize[0];                  \
+		uint32_t *output0 = (uint32_t*)(output + y * 2 * out_linesize);\
+		uint32_t *output1 = (uint32_t*)((uint8_t*)output0 +           \
+				out_linesize);                                \
+                                                                              \
+		row_func;                                                     \
+	}
+
+void decompress_420_c(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	DECOMPRESS_420_ROWS(
+		decompress_420_row_c(lum0, lum1,
+				input[1] + y * in_linesize[1],
+				input[2] + y * in_linesize[2],
+				output0, output1, 0, width_d2)
+	);
+}
+
+void decompress_nv12_c(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	DECOMPRESS_420_ROWS(
+		decompress_nv12_row_c(lum0, lum1,
+				(const uint16_t*)(input[1] + y * in_linesize[1]),
+				output0, output1, 0, width_d2)
+	);
+}
+
+void decompress_422_c(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum)
+{
+	uint32_t width_d2 = get_422_width_d2(in_linesize, out_linesize);
+	uint32_t y;
+
+	for (y = start_y; y < end_y; y++)
+		decompress_422_row_c(
+				(const uint32_t*)(input + y*in_linesize),
+				(uint32_t*)(output + y*out_linesize),
+				0, width_d2, leading_lum);
+}
+
+#ifdef USE_X86_CONVERSION
+
+/* ------------------------------------------------------------------------- */
+/* SSE2 */
+
 /* ...surprisingly, if I don't use a macro to force inlining, it causes the
  * CPU usage to boost by a tremendous amount in debug builds. */
 
@@ -72,13 +308,38 @@ do {                                                                          \
 	*(uint16_t*)(v_plane+chroma_pos) = (uint16_t)(packed_vals>>16);       \
 } while (false)
 
+/* writes 16 YUVX pixels from 16 luma values and 8 chroma values duplicated
+ * in to 16 */
+#define store_yuvx_16(output, lum, u_dup, v_dup, zero)                        \
+do {                                                                          \
+	__m128i yu_lo = _mm_unpacklo_epi8(lum, u_dup);                        \
+	__m128i yu_hi = _mm_unpackhi_epi8(lum, u_dup);                        \
+	__m128i v_lo  = _mm_unpacklo_epi8(v_dup, zero);                       \
+	__m128i v_hi  = _mm_unpackhi_epi8(v_dup, zero);                       \
+                                                                              \
+	_mm_storeu_si128((__m128i*)(output) + 0,                              \
+			_mm_unpacklo_epi16(yu_lo, v_lo));                     \
+	_mm_storeu_si128((__m128i*)(output) + 1,                              \
+			_mm_unpackhi_epi16(yu_lo, v_lo));                     \
+	_mm_storeu_si128((__m128i*)(output) + 2,                              \
+			_mm_unpacklo_epi16(yu_hi, v_hi));                     \
+	_mm_storeu_si128((__m128i*)(output) + 3,                              \
+			_mm_unpackhi_epi16(yu_hi, v_hi));                     \
+} while (false)
 
-static FORCE_INLINE uint32_t min_uint32(uint32_t a, uint32_t b)
-{
-	return a < b ? a : b;
-}
+#define decompress_420_16(lum0, lum1, output0, output1, u8, v8, zero)         \
+do {                                                                          \
+	__m128i u_dup = _mm_unpacklo_epi8(u8, u8);                            \
+	__m128i v_dup = _mm_unpacklo_epi8(v8, v8);                            \
+	__m128i lum;                                                          \
+                                                                              \
+	lum = _mm_loadu_si128((const __m128i*)(lum0));                        \
+	store_yuvx_16(output0, lum, u_dup, v_dup, zero);                      \
+	lum = _mm_loadu_si128((const __m128i*)(lum1));                        \
+	store_yuvx_16(output1, lum, u_dup, v_dup, zero);                      \
+} while (false)
 
-void compress_uyvx_to_i420(
+static void compress_uyvx_to_i420_sse2(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
@@ -116,7 +377,7 @@ void compress_uyvx_to_i420(
 	}
 }
 
-void compress_uyvx_to_nv12(
+static void compress_uyvx_to_nv12_sse2(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
@@ -152,123 +413,642 @@ void compress_uyvx_to_nv12(
 	}
 }
 
-void decompress_420(
+static void decompress_420_sse2(
 		const uint8_t *const input[], const uint32_t in_linesize[],
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output, uint32_t out_linesize)
 {
-	uint32_t start_y_d2 = start_y/2;
-	uint32_t width_d2   = min_uint32(in_linesize[0], out_linesize)/2;
-	uint32_t height_d2  = end_y/2;
-	uint32_t y;
+	__m128i zero = _mm_setzero_si128();
 
-	for (y = start_y_d2; y < height_d2; y++) {
+	DECOMPRESS_420_ROWS(
 		const uint8_t *chroma0 = input[1] + y * in_linesize[1];
 		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
-		register const uint8_t *lum0, *lum1;
-		register uint32_t *output0, *output1;
 		uint32_t x;
 
-		lum0 = input[0] + y * 2 * in_linesize[0];
-		lum1 = lum0 + in_linesize[0];
-		output0 = (uint32_t*)(output + y * 2 * in_linesize[0]);
-		output1 = (uint32_t*)((uint8_t*)output0 + in_linesize[0]);
+		for (x = 0; x + 8 <= width_d2; x += 8) {
+			__m128i u8 = _mm_loadl_epi64(
+					(const __m128i*)(chroma0 + x));
+			__m128i v8 = _mm_loadl_epi64(
+					(const __m128i*)(chroma1 + x));
 
-		for (x = 0; x < width_d2; x++) {
-			uint32_t out;
-			out = (*(chroma0++) << 8) | (*(chroma1++) << 16);
+			decompress_420_16(lum0 + x*2, lum1 + x*2,
+					output0 + x*2, output1 + x*2,
+					u8, v8, zero);
+		}
 
-			*(output0++) = *(lum0++) | out;
-			*(output0++) = *(lum0++) | out;
+		decompress_420_row_c(lum0, lum1, chroma0, chroma1,
+				output0, output1, x, width_d2)
+	);
+}
 
-			*(output1++) = *(lum1++) | out;
-			*(output1++) = *(lum1++) | out;
+static void decompress_nv12_sse2(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	__m128i zero    = _mm_setzero_si128();
+	__m128i lo_mask = _mm_set1_epi16(0x00FF);
+
+	DECOMPRESS_420_ROWS(
+		const uint8_t *chroma = input[1] + y * in_linesize[1];
+		uint32_t x;
+
+		for (x = 0; x + 8 <= width_d2; x += 8) {
+			__m128i uv = _mm_loadu_si128(
+					(const __m128i*)(chroma + x*2));
+			__m128i u8 = _mm_packus_epi16(
+					_mm_and_si128(uv, lo_mask), zero);
+			__m128i v8 = _mm_packus_epi16(
+					_mm_srli_epi16(uv, 8), zero);
+
+			decompress_420_16(lum0 + x*2, lum1 + x*2,
+					output0 + x*2, output1 + x*2,
+					u8, v8, zero);
+		}
+
+		decompress_nv12_row_c(lum0, lum1, (const uint16_t*)chroma,
+				output0, output1, x, width_d2)
+	);
+}
+
+#ifdef USE_AVX2_CONVERSION
+
+/* ------------------------------------------------------------------------- */
+/* SSSE3 */
+
+TARGET_SSSE3
+static void decompress_422_ssse3(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum)
+{
+	uint32_t width_d2 = get_422_width_d2(in_linesize, out_linesize);
+	uint32_t y;
+
+	/* each packed pair becomes two pixels, the second of which takes the
+	 * second luma value of the pair */
+	__m128i shuf_lo = leading_lum ?
+		_mm_setr_epi8(0,1,2,3, 2,1,2,3, 4,5,6,7,  6,5,6,7) :
+		_mm_setr_epi8(0,1,2,3, 0,3,2,3, 4,5,6,7,  4,7,6,7);
+	__m128i shuf_hi = _mm_add_epi8(shuf_lo, _mm_set1_epi8(8));
+
+	for (y = start_y; y < end_y; y++) {
+		const uint32_t *input32 = (const uint32_t*)(input +
+				y*in_linesize);
+		uint32_t *output32 = (uint32_t*)(output + y*out_linesize);
+		uint32_t x;
+
+		for (x = 0; x + 4 <= width_d2; x += 4) {
+			__m128i val = _mm_loadu_si128(
+					(const __m128i*)(input32 + x));
+			__m128i *out = (__m128i*)(output32 + x*2);
+
+			_mm_storeu_si128(out,   _mm_shuffle_epi8(val, shuf_lo));
+			_mm_storeu_si128(out+1, _mm_shuffle_epi8(val, shuf_hi));
 		}
+
+		decompress_422_row_c(input32, output32, x, width_d2,
+				leading_lum);
 	}
 }
 
-void decompress_nv12(
-		const uint8_t *const input[], const uint32_t in_linesize[],
+/* ------------------------------------------------------------------------- */
+/* AVX2 */
+
+/* 8 uyvx pixels per line, lanes hold pixels 0-3 and 4-7 */
+#define avx2_pack_lum(lum_plane, lum_pos, line, lum_shuf, lum_perm)           \
+do {                                                                          \
+	__m256i lum_val = _mm256_permutevar8x32_epi32(                        \
+			_mm256_shuffle_epi8(line, lum_shuf), lum_perm);       \
+                                                                              \
+	_mm_storel_epi64((__m128i*)(lum_plane + lum_pos),                     \
+			_mm256_castsi256_si128(lum_val));                     \
+} while (false)
+
+/* averages the 2x2 chroma blocks of 8 pixels, leaving u0 v0 .. u3 v3 as
+ * bytes in the low 8 bytes */
+#define avx2_avg_chroma(line1, line2, uv_mask, uv_perm, result)               \
+do {                                                                          \
+	__m256i add_val = _mm256_add_epi16(                                   \
+			_mm256_and_si256(line1, uv_mask),                     \
+			_mm256_and_si256(line2, uv_mask));                    \
+	add_val = _mm256_add_epi16(add_val,                                   \
+			_mm256_shuffle_epi32(add_val, _MM_SHUFFLE(2,3,0,1))); \
+	add_val = _mm256_srli_epi16(add_val, 2);                              \
+	add_val = _mm256_permutevar8x32_epi32(add_val, uv_perm);              \
+                                                                              \
+	result = _mm256_castsi256_si128(add_val);                             \
+	result = _mm_packus_epi16(result, result);                            \
+} while (false)
+
+#define AVX2_COMPRESS_CONSTANTS                                               \
+	__m256i lum_shuf = _mm256_setr_epi8(                                  \
+			1,5,9,13, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1,      \
+			1,5,9,13, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1);     \
+	__m256i lum_perm = _mm256_setr_epi32(0,4,0,0, 0,0,0,0);               \
+	__m256i uv_perm  = _mm256_setr_epi32(0,2,4,6, 0,2,4,6);               \
+	__m256i uv_mask  = _mm256_set1_epi16(0x00FF);                         \
+	__m128i lum_mask_128 = _mm_set1_epi32(0x0000FF00);                    \
+	__m128i uv_mask_128  = _mm_set1_epi16(0x00FF)
+
+TARGET_AVX2
+static void compress_uyvx_to_i420_avx2(
+		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
-		uint8_t *output, uint32_t out_linesize)
+		uint8_t *output[], const uint32_t out_linesize[])
 {
-	uint32_t start_y_d2 = start_y/2;
-	uint32_t width_d2   = min_uint32(in_linesize[0], out_linesize)/2;
-	uint32_t height_d2  = end_y/2;
+	uint8_t  *lum_plane   = output[0];
+	uint8_t  *u_plane     = output[1];
+	uint8_t  *v_plane     = output[2];
+	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
 	uint32_t y;
 
-	for (y = start_y_d2; y < height_d2; y++) {
-		const uint16_t *chroma;
-		register const uint8_t *lum0, *lum1;
-		register uint32_t *output0, *output1;
+	__m128i uv_split = _mm_setr_epi8(0,2,4,6, 1,3,5,7,
+			8,10,12,14, 9,11,13,15);
+	AVX2_COMPRESS_CONSTANTS;
+
+	for (y = start_y; y < end_y; y += 2) {
+		uint32_t y_pos        = y      * in_linesize;
+		uint32_t chroma_y_pos = (y>>1) * out_linesize[1];
+		uint32_t lum_y_pos    = y      * out_linesize[0];
 		uint32_t x;
 
-		chroma = (const uint16_t*)(input[1] + y * in_linesize[1]);
-		lum0 = input[0] + y * 2 * in_linesize[0];
-		lum1 = lum0 + in_linesize[0];
-		output0 = (uint32_t*)(output + y * 2 * out_linesize);
-		output1 = (uint32_t*)((uint8_t*)output0 + out_linesize);
+		for (x = 0; x + 8 <= width; x += 8) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+			__m128i  uv;
 
-		for (x = 0; x < width_d2; x++) {
-			uint32_t out = *(chroma++) << 8;
+			__m256i line1 = _mm256_loadu_si256(
+					(const __m256i*)img);
+			__m256i line2 = _mm256_loadu_si256(
+					(const __m256i*)(img + in_linesize));
+
+			avx2_pack_lum(lum_plane, lum_pos0, line1,
+					lum_shuf, lum_perm);
+			avx2_pack_lum(lum_plane, lum_pos1, line2,
+					lum_shuf, lum_perm);
+			avx2_avg_chroma(line1, line2, uv_mask, uv_perm, uv);
+
+			uv = _mm_shuffle_epi8(uv, uv_split);
+			*(uint32_t*)(u_plane + chroma_y_pos + (x>>1)) =
+				(uint32_t)_mm_cvtsi128_si32(uv);
+			*(uint32_t*)(v_plane + chroma_y_pos + (x>>1)) =
+				(uint32_t)_mm_cvtsi128_si32(
+						_mm_srli_si128(uv, 4));
+		}
 
-			*(output0++) = *(lum0++) | out;
-			*(output0++) = *(lum0++) | out;
+		for (; x < width; x += 4) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+
+			__m128i line1 = _mm_loadu_si128((const __m128i*)img);
+			__m128i line2 = _mm_loadu_si128(
+					(const __m128i*)(img + in_linesize));
 
-			*(output1++) = *(lum1++) | out;
-			*(output1++) = *(lum1++) | out;
+			pack_lum(lum_plane, lum_pos0, lum_pos1,
+					line1, line2, lum_mask_128);
+			pack_ch_2plane(u_plane, v_plane,
+					chroma_y_pos + (x>>1),
+					line1, line2, uv_mask_128);
 		}
 	}
 }
 
-void decompress_422(
+TARGET_AVX2
+static void compress_uyvx_to_nv12_avx2(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
-		uint8_t *output, uint32_t out_linesize,
-		bool leading_lum)
+		uint8_t *output[], const uint32_t out_linesize[])
 {
-	uint32_t width_d2 = min_uint32(in_linesize, out_linesize)/2;
+	uint8_t *lum_plane    = output[0];
+	uint8_t *chroma_plane = output[1];
+	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
 	uint32_t y;
 
-	register const uint32_t *input32;
-	register const uint32_t *input32_end;
-	register uint32_t       *output32;
+	AVX2_COMPRESS_CONSTANTS;
 
-	if (leading_lum) {
-		for (y = start_y; y < end_y; y++) {
-			input32     = (const uint32_t*)(input + y*in_linesize);
-			input32_end = input32 + width_d2;
-			output32    = (uint32_t*)(output + y*out_linesize);
+	for (y = start_y; y < end_y; y += 2) {
+		uint32_t y_pos        = y      * in_linesize;
+		uint32_t chroma_y_pos = (y>>1) * out_linesize[1];
+		uint32_t lum_y_pos    = y      * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x + 8 <= width; x += 8) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+			__m128i  uv;
 
-			while(input32 < input32_end) {
-				register uint32_t dw = *input32;
+			__m256i line1 = _mm256_loadu_si256(
+					(const __m256i*)img);
+			__m256i line2 = _mm256_loadu_si256(
+					(const __m256i*)(img + in_linesize));
 
-				output32[0] = dw;
-				dw &= 0xFFFFFF00;
-				dw |= (uint8_t)(dw>>16);
-				output32[1] = dw;
+			avx2_pack_lum(lum_plane, lum_pos0, line1,
+					lum_shuf, lum_perm);
+			avx2_pack_lum(lum_plane, lum_pos1, line2,
+					lum_shuf, lum_perm);
+			avx2_avg_chroma(line1, line2, uv_mask, uv_perm, uv);
 
-				output32 += 2;
-				input32++;
-			}
+			_mm_storel_epi64(
+				(__m128i*)(chroma_plane + chroma_y_pos + x),
+				uv);
 		}
-	} else {
-		for (y = start_y; y < end_y; y++) {
-			input32     = (const uint32_t*)(input + y*in_linesize);
-			input32_end = input32 + width_d2;
-			output32    = (uint32_t*)(output + y*out_linesize);
 
-			while (input32 < input32_end) {
-				register uint32_t dw = *input32;
+		for (; x < width; x += 4) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+
+			__m128i line1 = _mm_loadu_si128((const __m128i*)img);
+			__m128i line2 = _mm_loadu_si128(
+					(const __m128i*)(img + in_linesize));
+
+			pack_lum(lum_plane, lum_pos0, lum_pos1,
+					line1, line2, lum_mask_128);
+			pack_ch_1plane(chroma_plane, chroma_y_pos + x,
+					line1, line2, uv_mask_128);
+		}
+	}
+}
+
+#endif
+
+#elif defined(USE_NEON_CONVERSION)
+
+/* ------------------------------------------------------------------------- */
+/* NEON */
+
+#define neon_avg_chroma(ch1, ch2) \
+	vshrn_n_u16(vpadalq_u8(vpaddlq_u8(ch1), ch2), 2)
+
+static void compress_uyvx_to_i420_neon(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t y;
+
+	for (y = start_y; y < end_y; y += 2) {
+		const uint8_t *line1 = input + y * in_linesize;
+		const uint8_t *line2 = line1 + in_linesize;
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *u    = output[1] + (y>>1) * out_linesize[1];
+		uint8_t *v    = output[2] + (y>>1) * out_linesize[2];
+		uint32_t x;
+
+		for (x = 0; x + 16 <= width; x += 16) {
+			uint8x16x4_t px1 = vld4q_u8(line1 + x*4);
+			uint8x16x4_t px2 = vld4q_u8(line2 + x*4);
+
+			vst1q_u8(lum0 + x, px1.val[1]);
+			vst1q_u8(lum1 + x, px2.val[1]);
+			vst1_u8(u + (x>>1), neon_avg_chroma(px1.val[0],
+						px2.val[0]));
+			vst1_u8(v + (x>>1), neon_avg_chroma(px1.val[2],
+						px2.val[2]));
+		}
+
+		for (; x < width; x += 2)
+			compress_uyvx_block_c(line1 + x*4, line2 + x*4,
+					lum0 + x, lum1 + x,
+					u + (x>>1), v + (x>>1));
+	}
+}
+
+static void compress_uyvx_to_nv12_neon(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t y;
+
+	for (y = start_y; y < end_y; y += 2) {
+		const uint8_t *line1 = input + y * in_linesize;
+		const uint8_t *line2 = line1 + in_linesize;
+		uint8_t *lum0   = output[0] + y * out_linesize[0];
+		uint8_t *lum1   = lum0 + out_linesize[0];
+		uint8_t *chroma = output[1] + (y>>1) * out_linesize[1];
+		uint32_t x;
+
+		for (x = 0; x + 16 <= width; x += 16) {
+			uint8x16x4_t px1 = vld4q_u8(line1 + x*4);
+			uint8x16x4_t px2 = vld4q_u8(line2 + x*4);
+			uint8x8x2_t  uv;
+
+			vst1q_u8(lum0 + x, px1.val[1]);
+			vst1q_u8(lum1 + x, px2.val[1]);
+
+			uv.val[0] = neon_avg_chroma(px1.val[0], px2.val[0]);
+			uv.val[1] = neon_avg_chroma(px1.val[2], px2.val[2]);
+			vst2_u8(chroma + x, uv);
+		}
+
+		for (; x < width; x += 2)
+			compress_uyvx_block_c(line1 + x*4, line2 + x*4,
+					lum0 + x, lum1 + x,
+					chroma + x, chroma + x + 1);
+	}
+}
+
+static FORCE_INLINE void neon_decompress_420_16(
+		const uint8_t *lum0, const uint8_t *lum1,
+		uint32_t *output0, uint32_t *output1,
+		uint8x8_t u8, uint8x8_t v8)
+{
+	uint8x8x2_t  u_dup = vzip_u8(u8, u8);
+	uint8x8x2_t  v_dup = vzip_u8(v8, v8);
+	uint8x16x4_t px;
+
+	px.val[1] = vcombine_u8(u_dup.val[0], u_dup.val[1]);
+	px.val[2] = vcombine_u8(v_dup.val[0], v_dup.val[1]);
+	px.val[3] = vdupq_n_u8(0);
+
+	px.val[0] = vld1q_u8(lum0);
+	vst4q_u8((uint8_t*)output0, px);
+	px.val[0] = vld1q_u8(lum1);
+	vst4q_u8((uint8_t*)output1, px);
+}
+
+static void decompress_420_neon(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	DECOMPRESS_420_ROWS(
+		const uint8_t *chroma0 = input[1] + y * in_linesize[1];
+		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
+		uint32_t x;
+
+		for (x = 0; x + 8 <= width_d2; x += 8)
+			neon_decompress_420_16(lum0 + x*2, lum1 + x*2,
+					output0 + x*2, output1 + x*2,
+					vld1_u8(chroma0 + x),
+					vld1_u8(chroma1 + x));
+
+		decompress_420_row_c(lum0, lum1, chroma0, chroma1,
+				output0, output1, x, width_d2)
+	);
+}
+
+static void decompress_nv12_neon(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	DECOMPRESS_420_ROWS(
+		const uint8_t *chroma = input[1] + y * in_linesize[1];
+		uint32_t x;
+
+		for (x = 0; x + 8 <= width_d2; x += 8) {
+			uint8x8x2_t uv = vld2_u8(chroma + x*2);
+
+			neon_decompress_420_16(lum0 + x*2, lum1 + x*2,
+					output0 + x*2, output1 + x*2,
+					uv.val[0], uv.val[1]);
+		}
+
+		decompress_nv12_row_c(lum0, lum1, (const uint16_t*)chroma,
+				output0, output1, x, width_d2)
+	);
+}
+
+static void decompress_422_neon(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum)
+{
+	uint32_t width_d2 = get_422_width_d2(in_linesize, out_linesize);
+	uint32_t y;
+
+	/* byte index of the second luma value of each packed pair, and of the
+	 * byte it replaces in the second pixel */
+	int second_lum = leading_lum ? 2 : 3;
+	int first_lum  = leading_lum ? 0 : 1;
 
-				output32[0] = dw;
-				dw &= 0xFFFF00FF;
-				dw |= (dw>>16) & 0xFF00;
-				output32[1] = dw;
+	for (y = start_y; y < end_y; y++) {
+		const uint32_t *input32 = (const uint32_t*)(input +
+				y*in_linesize);
+		uint32_t *output32 = (uint32_t*)(output + y*out_linesize);
+		uint32_t x;
+
+		for (x = 0; x + 16 <= width_d2; x += 16) {
+			uint8x16x4_t in = vld4q_u8((const uint8_t*)
+					(input32 + x));
+			uint8x16x4_t out_lo, out_hi;
 
-				output32 += 2;
-				input32++;
+			for (int i = 0; i < 4; i++) {
+				uint8x16x2_t zip = vzipq_u8(in.val[i],
+						in.val[i == first_lum ?
+							second_lum : i]);
+				out_lo.val[i] = zip.val[0];
+				out_hi.val[i] = zip.val[1];
 			}
+
+			vst4q_u8((uint8_t*)(output32 + x*2),      out_lo);
+			vst4q_u8((uint8_t*)(output32 + x*2 + 16), out_hi);
 		}
+
+		decompress_422_row_c(input32, output32, x, width_d2,
+				leading_lum);
 	}
 }
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* runtime selection */
+
+typedef void (*compress_func_t)(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[]);
+
+typedef void (*decompress_planar_func_t)(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize);
+
+typedef void (*decompress_422_func_t)(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum);
+
+static struct {
+	compress_func_t          compress_i420;
+	compress_func_t          compress_nv12;
+	decompress_planar_func_t decompress_420;
+	decompress_planar_func_t decompress_nv12;
+	decompress_422_func_t    decompress_422;
+} conversion = {
+	compress_uyvx_to_i420_c,
+	compress_uyvx_to_nv12_c,
+	decompress_420_c,
+	decompress_nv12_c,
+	decompress_422_c
+};
+
+static pthread_once_t conversion_once = PTHREAD_ONCE_INIT;
+
+#ifdef USE_X86_CONVERSION
+
+#define CPU_SSE2  (1<<0)
+#define CPU_SSSE3 (1<<1)
+#define CPU_AVX2  (1<<2)
+
+static void get_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t get_xcr0(void)
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile (".byte 0x0f, 0x01, 0xd0" /* xgetbv */
+			: "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static uint32_t get_cpu_flags(void)
+{
+	uint32_t regs[4];
+	uint32_t max_leaf;
+	uint32_t flags = 0;
+
+	get_cpuid(0, 0, regs);
+	max_leaf = regs[0];
+	if (max_leaf < 1)
+		return 0;
+
+	get_cpuid(1, 0, regs);
+	if (regs[3] & (1<<26))
+		flags |= CPU_SSE2;
+	if (regs[2] & (1<<9))
+		flags |= CPU_SSSE3;
+
+	/* avx2 also requires the OS to save the ymm registers */
+	if (max_leaf >= 7 && (regs[2] & (1<<27)) && (regs[2] & (1<<28)) &&
+	    (get_xcr0() & 0x6) == 0x6) {
+		get_cpuid(7, 0, regs);
+		if (regs[1] & (1<<5))
+			flags |= CPU_AVX2;
+	}
+
+	return flags;
+}
+
+#endif
+
+static void select_conversion_funcs(void)
+{
+	const char *compress_path   = "C";
+	const char *decompress_path = "C";
+
+#if defined(USE_X86_CONVERSION)
+	uint32_t flags = get_cpu_flags();
+
+	if (flags & CPU_SSE2) {
+		conversion.compress_i420   = compress_uyvx_to_i420_sse2;
+		conversion.compress_nv12   = compress_uyvx_to_nv12_sse2;
+		conversion.decompress_420  = decompress_420_sse2;
+		conversion.decompress_nv12 = decompress_nv12_sse2;
+		compress_path = decompress_path = "SSE2";
+	}
+
+#ifdef USE_AVX2_CONVERSION
+	if (flags & CPU_SSSE3) {
+		conversion.decompress_422  = decompress_422_ssse3;
+		decompress_path = "SSE2/SSSE3";
+	}
+
+	if (flags & CPU_AVX2) {
+		conversion.compress_i420   = compress_uyvx_to_i420_avx2;
+		conversion.compress_nv12   = compress_uyvx_to_nv12_avx2;
+		compress_path = "AVX2";
+	}
+#endif
+
+#elif defined(USE_NEON_CONVERSION)
+	conversion.compress_i420   = compress_uyvx_to_i420_neon;
+	conversion.compress_nv12   = compress_uyvx_to_nv12_neon;
+	conversion.decompress_420  = decompress_420_neon;
+	conversion.decompress_nv12 = decompress_nv12_neon;
+	conversion.decompress_422  = decompress_422_neon;
+	compress_path = decompress_path = "NEON";
+#endif
+
+	blog(LOG_INFO, "Format conversion: using %s compression, "
+	               "%s decompression", compress_path, decompress_path);
+}
+
+static inline void init_conversion_funcs(void)
+{
+	pthread_once(&conversion_once, select_conversion_funcs);
+}
+
+void compress_uyvx_to_i420(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	init_conversion_funcs();
+	conversion.compress_i420(input, in_linesize, start_y, end_y,
+			output, out_linesize);
+}
+
+void compress_uyvx_to_nv12(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	init_conversion_funcs();
+	conversion.compress_nv12(input, in_linesize, start_y, end_y,
+			output, out_linesize);
+}
+
+void decompress_420(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	init_conversion_funcs();
+	conversion.decompress_420(input, in_linesize, start_y, end_y,
+			output, out_linesize);
+}
+
+void decompress_nv12(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	init_conversion_funcs();
+	conversion.decompress_nv12(input, in_linesize, start_y, end_y,
+			output, out_linesize);
+}
+
+void decompress_422(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum)
+{
+	init_conversion_funcs();
+	conversion.decompress_422(input, in_linesize, start_y, end_y,
+			output, out_linesize, leading_lum);
+}
@@ -25,6 +25,9 @@ extern "C" {
 
 /*
  * Functions for converting to and from packed 444 YUV
+ *
+ *   The fastest implementation supported by the CPU is selected the first
+ * time one of these is called.
  */
 
 EXPORT void compress_uyvx_to_i420(
@@ -53,6 +56,37 @@ EXPORT void decompress_422(
 		uint8_t *output, uint32_t out_linesize,
 		bool leading_lum);
 
+/*
+ * Scalar reference implementations of the above, for validating the SIMD
+ * implementations against
+ */
+
+EXPORT void compress_uyvx_to_i420_c(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[]);
+
+EXPORT void compress_uyvx_to_nv12_c(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[]);
+
+EXPORT void decompress_nv12_c(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize);
+
+EXPORT void decompress_420_c(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize);
+
+EXPORT void decompress_422_c(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum);
+
 #ifdef __cplusplus
 }
 #endif
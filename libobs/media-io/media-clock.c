@@ -0,0 +1,200 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <math.h>
+#include "../util/bmem.h"
+#include "../util/base.h"
+#include "../util/platform.h"
+#include "../util/threading.h"
+#include "media-clock.h"
+
+/* the rate is measured over intervals of at least a second, and smoothed
+ * across intervals so a single late sample can't throw it off */
+#define RATE_INTERVAL_NS 1000000000ULL
+#define RATE_SMOOTHING   0.1
+
+/* a measured rate further off than this means the clock jumped (or was
+ * reset), so the measurement starts over rather than being trusted */
+#define MAX_RATE_ERROR   0.01
+
+/* how long past the estimated time a wait keeps going before giving up on
+ * a clock that has stalled */
+#define STALL_TIMEOUT_NS 1000000000ULL
+
+struct media_clock {
+	struct media_clock_info info;
+	pthread_mutex_t         mutex;
+
+	/* the most recent clock/system time pair */
+	uint64_t                last_clock;
+	uint64_t                last_sys;
+
+	/* the pair the current rate interval started at */
+	uint64_t                ref_clock;
+	uint64_t                ref_sys;
+
+	double                  rate;
+	bool                    sampled;
+};
+
+media_clock_t media_clock_create(const struct media_clock_info *info)
+{
+	struct media_clock *clock;
+
+	if (!info || !info->get_time)
+		return NULL;
+
+	clock = bzalloc(sizeof(struct media_clock));
+	clock->info = *info;
+	clock->rate = 1.0;
+
+	if (pthread_mutex_init(&clock->mutex, NULL) != 0) {
+		blog(LOG_ERROR, "media_clock_create: Failed to create mutex");
+		bfree(clock);
+		return NULL;
+	}
+
+	return clock;
+}
+
+void media_clock_destroy(media_clock_t clock)
+{
+	if (clock) {
+		pthread_mutex_destroy(&clock->mutex);
+		bfree(clock);
+	}
+}
+
+/* reads the clock between two system time reads, and pairs it with the
+ * middle of the two, which keeps the call overhead out of the estimate */
+static void sample_clock(struct media_clock *clock)
+{
+	uint64_t sys_start  = os_gettime_ns();
+	uint64_t clock_time = clock->info.get_time(clock->info.param);
+	uint64_t sys_end    = os_gettime_ns();
+	uint64_t sys_time   = sys_start + (sys_end - sys_start) / 2;
+	double   rate;
+
+	clock->last_clock = clock_time;
+	clock->last_sys   = sys_time;
+
+	if (!clock->sampled || clock_time < clock->ref_clock) {
+		clock->ref_clock = clock_time;
+		clock->ref_sys   = sys_time;
+		clock->sampled   = true;
+		return;
+	}
+
+	if (sys_time - clock->ref_sys < RATE_INTERVAL_NS)
+		return;
+
+	rate = (double)(clock_time - clock->ref_clock) /
+	       (double)(sys_time   - clock->ref_sys);
+
+	if (fabs(rate - 1.0) <= MAX_RATE_ERROR)
+		clock->rate += (rate - clock->rate) * RATE_SMOOTHING;
+	else
+		blog(LOG_DEBUG, "media_clock: Ignoring measured rate %g, "
+		                "the clock may have jumped", rate);
+
+	clock->ref_clock = clock_time;
+	clock->ref_sys   = sys_time;
+}
+
+uint64_t media_clock_gettime(media_clock_t clock)
+{
+	uint64_t time;
+
+	if (!clock)
+		return os_gettime_ns();
+
+	pthread_mutex_lock(&clock->mutex);
+	sample_clock(clock);
+	time = clock->last_clock;
+	pthread_mutex_unlock(&clock->mutex);
+
+	return time;
+}
+
+uint64_t media_clock_to_system(media_clock_t clock, uint64_t time)
+{
+	int64_t  diff;
+	uint64_t sys_time;
+
+	if (!clock)
+		return time;
+
+	pthread_mutex_lock(&clock->mutex);
+	sample_clock(clock);
+	diff     = (int64_t)(time - clock->last_clock);
+	sys_time = clock->last_sys + (int64_t)((double)diff / clock->rate);
+	pthread_mutex_unlock(&clock->mutex);
+
+	return sys_time;
+}
+
+double media_clock_rate(media_clock_t clock)
+{
+	double rate;
+
+	if (!clock)
+		return 1.0;
+
+	pthread_mutex_lock(&clock->mutex);
+	rate = clock->rate;
+	pthread_mutex_unlock(&clock->mutex);
+
+	return rate;
+}
+
+void media_clock_wait_until(media_clock_t clock, uint64_t time, bool precise)
+{
+	uint64_t timeout;
+
+	if (!clock) {
+		if (precise)
+			os_sleepto_ns_precise(time);
+		else
+			os_sleepto_ns(time);
+		return;
+	}
+
+	if (clock->info.wait_until &&
+	    clock->info.wait_until(clock->info.param, time))
+		return;
+
+	/* the rate estimate can be slightly off, so sleep again for whatever
+	 * is left until the clock itself has reached the time */
+	timeout = media_clock_to_system(clock, time) + STALL_TIMEOUT_NS;
+
+	while (media_clock_gettime(clock) < time) {
+		uint64_t sys_time = media_clock_to_system(clock, time);
+		bool     slept;
+
+		if (os_gettime_ns() >= timeout) {
+			blog(LOG_WARNING, "media_clock: Clock appears to have "
+			                  "stalled");
+			break;
+		}
+
+		slept = precise ?
+			os_sleepto_ns_precise(sys_time) :
+			os_sleepto_ns(sys_time);
+		if (!slept)
+			os_sleep_ms(0);
+	}
+}
@@ -0,0 +1,79 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Media clock
+ *
+ *   Lets an external time reference, such as the clock of a capture card or
+ * a PTP clock, drive the output timing instead of the system clock.  The
+ * clock's time is continuously compared with os_gettime_ns to estimate its
+ * rate, so times on it can be converted to system time and audio can be
+ * resampled to it.
+ */
+
+struct media_clock;
+typedef struct media_clock *media_clock_t;
+
+struct media_clock_info {
+	/** Returns the current time of the clock, in nanoseconds */
+	uint64_t (*get_time)(void *param);
+
+	/**
+	 * (Optional) Blocks until the clock reaches the given time, for clocks
+	 * that can signal their own ticks.  Returns false if it couldn't wait,
+	 * in which case the wait is estimated with the system clock.
+	 */
+	bool (*wait_until)(void *param, uint64_t time);
+
+	void *param;
+};
+
+EXPORT media_clock_t media_clock_create(const struct media_clock_info *info);
+EXPORT void media_clock_destroy(media_clock_t clock);
+
+/** Returns the current time of the clock, in nanoseconds */
+EXPORT uint64_t media_clock_gettime(media_clock_t clock);
+
+/** Converts a time of the clock to the equivalent os_gettime_ns time */
+EXPORT uint64_t media_clock_to_system(media_clock_t clock, uint64_t time);
+
+/**
+ * Returns the estimated rate of the clock relative to the system clock,
+ * or 1.0 until enough time has passed to measure it
+ */
+EXPORT double media_clock_rate(media_clock_t clock);
+
+/**
+ * Waits until the clock reaches the given time
+ *
+ * @param  precise  Sleeps with os_sleepto_ns_precise when the clock can't
+ *                  wait on its own
+ */
+EXPORT void media_clock_wait_until(media_clock_t clock, uint64_t time,
+		bool precise);
+
+#ifdef __cplusplus
+}
+#endif
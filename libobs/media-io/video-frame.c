@@ -83,6 +83,95 @@ void video_frame_init(struct video_frame *frame, enum video_format format,
 		frame->data[0] = bmalloc(size);
 		frame->linesize[0] = width*4;
 		break;
+
+	case VIDEO_FORMAT_I444:
+		size = width * height;
+		ALIGN_SIZE(size, alignment);
+		frame->data[0] = bmalloc(size * 3);
+		frame->data[1] = (uint8_t*)frame->data[0] + size;
+		frame->data[2] = (uint8_t*)frame->data[1] + size;
+		frame->linesize[0] = width;
+		frame->linesize[1] = width;
+		frame->linesize[2] = width;
+		break;
+
+	case VIDEO_FORMAT_I422:
+		size = width * height;
+		ALIGN_SIZE(size, alignment);
+		offsets[0] = size;
+		size += (width/2) * height;
+		ALIGN_SIZE(size, alignment);
+		offsets[1] = size;
+		size += (width/2) * height;
+		ALIGN_SIZE(size, alignment);
+		frame->data[0] = bmalloc(size);
+		frame->data[1] = (uint8_t*)frame->data[0] + offsets[0];
+		frame->data[2] = (uint8_t*)frame->data[0] + offsets[1];
+		frame->linesize[0] = width;
+		frame->linesize[1] = width/2;
+		frame->linesize[2] = width/2;
+		break;
 	}
 }
 
+
+static inline void copy_plane(uint8_t *dst, uint32_t dst_linesize,
+		const uint8_t *src, uint32_t src_linesize, uint32_t rows)
+{
+	uint32_t row_size = (dst_linesize < src_linesize) ?
+		dst_linesize : src_linesize;
+
+	if (dst_linesize == src_linesize) {
+		memcpy(dst, src, (size_t)src_linesize * rows);
+		return;
+	}
+
+	for (uint32_t y = 0; y < rows; y++)
+		memcpy(dst + y * dst_linesize, src + y * src_linesize,
+				row_size);
+}
+
+void video_frame_copy(struct video_frame *dst, const struct video_frame *src,
+		enum video_format format, uint32_t height)
+{
+	if (!dst || !src) return;
+
+	switch (format) {
+	case VIDEO_FORMAT_NONE:
+		return;
+
+	case VIDEO_FORMAT_I420:
+		copy_plane(dst->data[0], dst->linesize[0],
+				src->data[0], src->linesize[0], height);
+		copy_plane(dst->data[1], dst->linesize[1],
+				src->data[1], src->linesize[1], height/2);
+		copy_plane(dst->data[2], dst->linesize[2],
+				src->data[2], src->linesize[2], height/2);
+		break;
+
+	case VIDEO_FORMAT_NV12:
+		copy_plane(dst->data[0], dst->linesize[0],
+				src->data[0], src->linesize[0], height);
+		copy_plane(dst->data[1], dst->linesize[1],
+				src->data[1], src->linesize[1], height/2);
+		break;
+
+	case VIDEO_FORMAT_YVYU:
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+		copy_plane(dst->data[0], dst->linesize[0],
+				src->data[0], src->linesize[0], height);
+		break;
+
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_I422:
+		for (size_t i = 0; i < 3; i++)
+			copy_plane(dst->data[i], dst->linesize[i],
+					src->data[i], src->linesize[i],
+					height);
+		break;
+	}
+}
@@ -16,10 +16,14 @@
 ******************************************************************************/
 
 #include <assert.h>
+#include <stdlib.h>
 #include "../util/bmem.h"
 #include "../util/platform.h"
 #include "../util/threading.h"
 #include "../util/darray.h"
+#include "../util/profiler.h"
+#include "../util/job-system.h"
+#include "../callback/signal.h"
 
 #include "format-conversion.h"
 #include "video-io.h"
@@ -28,23 +32,72 @@
 
 #define MAX_CONVERT_BUFFERS 3
 
-struct video_input {
-	struct video_scale_info   conversion;
+struct video_output;
+
+/*
+ * A scaled/converted version of the output.  Inputs that ask for the same
+ * conversion share one, so each rendition is only scaled once per frame.
+ * Where possible a conversion is scaled from a larger conversion of the
+ * same format rather than from the full output (e.g. 480p from 720p
+ * instead of from 1080p).
+ *
+ * Each conversion is a job on the job system, which scales the frame and
+ * then calls its inputs.  Conversions that cascade from it are jobs that
+ * depend on it.  Without a job system they're all processed on the video
+ * thread.
+ *
+ * External conversions aren't scaled here; their frames are produced by
+ * the owner of the output (e.g. rendered on the GPU) and handed over with
+ * video_output_swap_scaled_frame.
+ *
+ * Inputs with a frame rate divisor only get every Nth frame.  A conversion
+ * is only scaled for frames that at least one of its inputs (or of the
+ * conversions cascading from it) takes, so lower frame rate inputs also
+ * scale fewer frames.
+ *
+ * Frames are flagged as duplicates per input, so a frame is only a
+ * duplicate if nothing changed since the last frame that input got.
+ * External conversions never flag duplicates, as their frames can lag
+ * behind the output frame.
+ */
+struct video_conversion {
+	struct video_scale_info   info;
 	video_scaler_t            scaler;
 	struct video_frame        frame[MAX_CONVERT_BUFFERS];
 	int                       cur_frame;
 
+	struct video_data         data;
+	bool                      success;
+
+	struct video_conversion   *parent;
+	size_t                    refs;
+
+	bool                      external;
+	int                       next_frame;
+	bool                      new_frame;
+	uint64_t                  next_timestamp;
+
+	/* set by the video thread before each frame */
+	bool                      needed;
+
+	struct video_output       *video;
+	job_t                     job;
+};
+
+struct video_input {
+	struct video_conversion   *conversion;
+
+	uint32_t                  frame_rate_divisor;
+	uint64_t                  frame_count;
+	bool                      skip;
+
+	/* whether any frame since the last one it got was new */
+	bool                      changed;
+
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
 };
 
-static inline void video_input_free(struct video_input *input)
-{
-	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-		video_frame_free(&input->frame[i]);
-	video_scaler_destroy(input->scaler);
-}
-
 struct video_output {
 	struct video_output_info   info;
 
@@ -60,90 +113,408 @@ struct video_output {
 	uint64_t                   frame_time;
 	volatile uint64_t          cur_video_time;
 
+	/* frame intervals are scheduled from start_time by count, rather
+	 * than by adding up the (rounded) frame time */
+	uint64_t                   start_time;
+	uint64_t                   frame_count;
+	enum video_pacing_mode     pacing_mode;
+
+	/* with a master clock, start_time and the frame deadlines are times
+	 * of that clock.  cur_clock is the one the video thread is running on,
+	 * and clock_mutex is held while it's in use so a replaced clock can be
+	 * destroyed as soon as video_output_set_clock returns */
+	pthread_mutex_t            clock_mutex;
+	media_clock_t              clock;
+	media_clock_t              cur_clock;
+
 	bool                       initialized;
 
 	pthread_mutex_t            input_mutex;
 	DARRAY(struct video_input) inputs;
+
+	DARRAY(struct video_conversion*) conversions;
+	job_system_t               jobs;
+
+	bool (*external_supported)(void *param,
+			const struct video_scale_info *info);
+	void                       *external_param;
+	volatile long              external_revision;
+
+	/* inputs that need the unscaled frame, either directly or to
+	 * scale on the CPU */
+	volatile long              base_inputs;
+
+	profile_point_t            profile_point;
+
+	/* frame statistics, only written by the video thread */
+	enum video_catchup_mode    catchup_mode;
+	volatile long              frames_rendered;
+	volatile long              frames_duplicated;
+	volatile long              frames_late;
+	signal_handler_t           signals;
+
+	/* pacing statistics, protected by data_mutex */
+	uint64_t                   pacing_frames;
+	int64_t                    pacing_error_total;
+	uint64_t                   pacing_jitter_total;
+	uint64_t                   pacing_max_jitter;
+	uint64_t                   last_output_time;
+	uint64_t                   last_deadline;
 };
 
 /* ------------------------------------------------------------------------- */
 
-static inline void video_swapframes(struct video_output *video)
+/* returns false if no new frame was supplied, and the previous frame is
+ * output again */
+static inline bool video_swapframes(struct video_output *video)
 {
 	if (video->new_frame) {
 		video->cur_frame = video->next_frame;
 		video->new_frame = false;
+		return true;
 	}
+
+	video->cur_frame.duplicate = true;
+	return false;
 }
 
-static inline bool scale_video_output(struct video_input *input,
-		struct video_data *data)
+/* makes the most recently supplied external frame current.  only called
+ * with both data_mutex and input_mutex held */
+static void swap_external_frames(struct video_output *video)
 {
-	bool success = true;
+	for (size_t i = 0; i < video->conversions.num; i++) {
+		struct video_conversion *conv = video->conversions.array[i];
+		struct video_frame      *frame;
 
-	if (input->scaler) {
-		struct video_frame *frame;
+		if (!conv->external || !conv->new_frame)
+			continue;
 
-		if (++input->cur_frame == MAX_CONVERT_BUFFERS)
-			input->cur_frame = 0;
+		conv->cur_frame = conv->next_frame;
+		conv->new_frame = false;
 
-		frame = &input->frame[input->cur_frame];
+		frame = &conv->frame[conv->cur_frame];
+		for (size_t j = 0; j < MAX_AV_PLANES; j++) {
+			conv->data.data[j]     = frame->data[j];
+			conv->data.linesize[j] = frame->linesize[j];
+		}
 
-		success = video_scaler_scale(input->scaler,
-				frame->data, frame->linesize,
-				(const uint8_t * const*)data->data,
-				data->linesize);
+		conv->data.timestamp = conv->next_timestamp;
+		conv->data.duplicate = false;
+	}
+}
 
-		if (success) {
-			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-				data->data[i]     = frame->data[i];
-				data->linesize[i] = frame->linesize[i];
-			}
+static bool scale_conversion(struct video_conversion *conv,
+		const struct video_data *src)
+{
+	struct video_frame *frame;
+	bool success;
+
+	if (!conv->scaler)
+		return false;
+
+	if (++conv->cur_frame == MAX_CONVERT_BUFFERS)
+		conv->cur_frame = 0;
+
+	frame = &conv->frame[conv->cur_frame];
+
+	success = video_scaler_scale(conv->scaler,
+			frame->data, frame->linesize,
+			(const uint8_t * const*)src->data, src->linesize);
+
+	if (success) {
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			conv->data.data[i]     = frame->data[i];
+			conv->data.linesize[i] = frame->linesize[i];
 		}
+
+		conv->data.timestamp = src->timestamp;
+		conv->data.duplicate = src->duplicate;
 	}
 
 	return success;
 }
 
+static inline void call_inputs(struct video_output *video,
+		struct video_conversion *conv, const struct video_data *data)
+{
+	for (size_t i = 0; i < video->inputs.num; i++) {
+		struct video_input *input = video->inputs.array+i;
+
+		if (input->conversion == conv && !input->skip) {
+			struct video_data frame = *data;
+			frame.duplicate = data->duplicate && !input->changed;
+			input->callback(input->param, &frame);
+		}
+	}
+}
+
+static void process_conversion(struct video_conversion *conv)
+{
+	struct video_output *video = conv->video;
+	const struct video_data *src = conv->parent ?
+		&conv->parent->data : &video->cur_frame;
+	bool parent_valid = conv->parent ?
+		conv->parent->success : video->cur_frame.data[0] != NULL;
+
+	if (!conv->needed)
+		conv->success = false;
+	else if (conv->external)
+		conv->success = conv->data.data[0] != NULL;
+	else
+		conv->success = parent_valid && scale_conversion(conv, src);
+
+	if (conv->success)
+		call_inputs(video, conv, &conv->data);
+}
+
+static void conversion_job(void *param)
+{
+	process_conversion(param);
+}
+
+/* decides which inputs take this frame, and which conversions have to be
+ * scaled for them.  only called with input_mutex held */
+static void update_skipped_inputs(struct video_output *video)
+{
+	for (size_t i = 0; i < video->conversions.num; i++)
+		video->conversions.array[i]->needed = false;
+
+	for (size_t i = 0; i < video->inputs.num; i++) {
+		struct video_input      *input = video->inputs.array+i;
+		struct video_conversion *conv  = input->conversion;
+
+		if (!input->skip)
+			input->changed = false;
+		if (!video->cur_frame.duplicate)
+			input->changed = true;
+
+		input->skip = (input->frame_count++ %
+				input->frame_rate_divisor) != 0;
+		if (input->skip)
+			continue;
+
+		for (; conv && !conv->needed; conv = conv->parent)
+			conv->needed = true;
+	}
+}
+
 static inline void video_output_cur_frame(struct video_output *video)
 {
-	if (!video->cur_frame.data[0])
-		return;
+	size_t num_conversions;
 
 	pthread_mutex_lock(&video->input_mutex);
 
-	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array+i;
-		if (scale_video_output(input, &video->cur_frame))
-			input->callback(input->param, &video->cur_frame);
+	swap_external_frames(video);
+	update_skipped_inputs(video);
+
+	num_conversions = video->conversions.num;
+
+	for (size_t i = 0; i < num_conversions; i++) {
+		struct video_conversion *conv = video->conversions.array[i];
+		if (conv->needed)
+			conv->job = job_create(video->jobs, conversion_job,
+					conv, JOB_PRIORITY_HIGH);
+	}
+
+	/* parents always come before the conversions cascading from them,
+	 * so conversions without a job can be processed in order here */
+	for (size_t i = 0; i < num_conversions; i++) {
+		struct video_conversion *conv = video->conversions.array[i];
+
+		if (!conv->job) {
+			process_conversion(conv);
+			continue;
+		}
+
+		if (conv->parent && conv->parent->job)
+			job_add_dependency(conv->job, conv->parent->job);
+		job_submit(conv->job);
+	}
+
+	if (video->cur_frame.data[0])
+		call_inputs(video, NULL, &video->cur_frame);
+
+	/* the current frame must stay valid until every conversion using
+	 * it (directly or through a cascade) is done */
+	for (size_t i = 0; i < num_conversions; i++) {
+		struct video_conversion *conv = video->conversions.array[i];
+
+		if (conv->job) {
+			job_wait(conv->job);
+			job_release(conv->job);
+			conv->job = NULL;
+		}
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
 }
 
+static void signal_frame_missed(struct video_output *video, bool duplicated,
+		long late_frames)
+{
+	uint8_t stack[CALLDATA_FIXED_SIZE];
+	struct calldata params;
+	calldata_init_fixed(&params, stack, sizeof(stack));
+
+	calldata_setptr(&params, "video", video);
+	calldata_setbool(&params, "duplicated", duplicated);
+	calldata_setint(&params, "late_frames", late_frames);
+
+	signal_handler_signal(video->signals, "frame_missed", &params);
+
+	calldata_free(&params);
+}
+
+/* the exact start time of a frame interval.  rates like 59.94 don't have
+ * a whole number of nanoseconds per frame, so this is computed from the
+ * frame count to keep rounding errors from adding up */
+static inline uint64_t frame_deadline(struct video_output *video,
+		uint64_t count)
+{
+	uint64_t num = video->info.fps_num;
+	uint64_t den = video->info.fps_den * 1000000000ULL;
+
+	return video->start_time + (count / num) * den +
+		(count % num) * den / num;
+}
+
+static inline uint64_t current_time(struct video_output *video)
+{
+	return video->cur_clock ?
+		media_clock_gettime(video->cur_clock) : os_gettime_ns();
+}
+
+/* waits for a frame deadline, and returns the system time it corresponds
+ * to, which is what frames are timestamped with */
+static inline uint64_t sleep_to(struct video_output *video, uint64_t time)
+{
+	bool precise = video->pacing_mode == VIDEO_PACING_PRECISE;
+
+	if (!video->cur_clock) {
+		if (precise)
+			os_sleepto_ns_precise(time);
+		else
+			os_sleepto_ns(time);
+		return time;
+	}
+
+	media_clock_wait_until(video->cur_clock, time, precise);
+	return media_clock_to_system(video->cur_clock, time);
+}
+
+/* restarts the frame schedule when the master clock has been changed.
+ * must be called with clock_mutex locked */
+static inline void update_clock(struct video_output *video)
+{
+	if (video->clock != video->cur_clock) {
+		video->cur_clock   = video->clock;
+		video->start_time  = current_time(video);
+		video->frame_count = 0;
+	}
+}
+
+/* compares when the frame was output with when it was scheduled, both for
+ * the frame itself and for the interval since the previous one */
+static void update_pacing_stats(struct video_output *video,
+		uint64_t deadline, uint64_t now)
+{
+	if (video->pacing_frames) {
+		int64_t interval  = (int64_t)(now - video->last_output_time);
+		int64_t nominal   = (int64_t)(deadline - video->last_deadline);
+		uint64_t jitter   = (uint64_t)llabs(interval - nominal);
+
+		video->pacing_jitter_total += jitter;
+		if (jitter > video->pacing_max_jitter)
+			video->pacing_max_jitter = jitter;
+	}
+
+	video->pacing_error_total += (int64_t)(now - deadline);
+	video->pacing_frames++;
+	video->last_output_time = now;
+	video->last_deadline    = deadline;
+}
+
+/* returns the number of whole frame intervals the thread is behind
+ * schedule.  with VIDEO_CATCHUP_SKIP those intervals are dropped and the
+ * schedule is moved forward, otherwise the frames are output back-to-back
+ * until the thread has caught up */
+static long check_late_frames(struct video_output *video)
+{
+	uint64_t now = current_time(video);
+	uint64_t cur_time = frame_deadline(video, video->frame_count);
+	long late;
+
+	if (now < cur_time + video->frame_time)
+		return 0;
+
+	late = (long)((now - cur_time) / video->frame_time);
+
+	if (video->catchup_mode == VIDEO_CATCHUP_SKIP) {
+		video->frame_count += (uint64_t)late;
+		os_atomic_set_long(&video->frames_late,
+				os_atomic_load_long(&video->frames_late) + late);
+	} else {
+		os_atomic_inc_long(&video->frames_late);
+	}
+
+	return late;
+}
+
 static void *video_thread(void *param)
 {
 	struct video_output *video = param;
-	uint64_t cur_time = os_gettime_ns();
+
+	os_thread_init(OS_THREAD_CLASS_VIDEO, "video-io");
+
+	video->start_time  = os_gettime_ns();
+	video->frame_count = 0;
 
 	while (os_event_try(video->stop_event) == EAGAIN) {
-		/* wait half a frame, update frame */
-		cur_time += (video->frame_time/2);
-		os_sleepto_ns(cur_time);
+		uint64_t cur_time, next_time, half_time;
+		uint64_t start, output_time;
+		bool new_frame;
+		long late;
+
+		pthread_mutex_lock(&video->clock_mutex);
+
+		update_clock(video);
+		late = check_late_frames(video);
 
-		video->cur_video_time = cur_time;
+		cur_time  = frame_deadline(video, video->frame_count);
+		next_time = frame_deadline(video, ++video->frame_count);
+		half_time = cur_time + (next_time - cur_time) / 2;
+
+		/* wait half a frame, update frame.  coalesced, the frame is
+		 * updated right away, that wait returns immediately */
+		if (video->pacing_mode == VIDEO_PACING_COALESCED)
+			half_time = cur_time;
+
+		video->cur_video_time = sleep_to(video, half_time);
 		os_event_signal(video->update_event);
 
 		/* wait another half a frame, swap and output frames */
-		cur_time += (video->frame_time/2);
-		os_sleepto_ns(cur_time);
+		output_time = sleep_to(video, next_time);
+
+		pthread_mutex_unlock(&video->clock_mutex);
 
 		pthread_mutex_lock(&video->data_mutex);
 
-		video_swapframes(video);
+		update_pacing_stats(video, output_time, os_gettime_ns());
+
+		new_frame = video_swapframes(video);
+
+		start = profile_start();
 		video_output_cur_frame(video);
+		profile_end(video->profile_point, start);
 
 		pthread_mutex_unlock(&video->data_mutex);
+
+		os_atomic_inc_long(new_frame ?
+				&video->frames_rendered :
+				&video->frames_duplicated);
+
+		if (!new_frame || late)
+			signal_frame_missed(video, !new_frame, late);
 	}
 
 	return NULL;
@@ -151,6 +522,11 @@ static void *video_thread(void *param)
 
 /* ------------------------------------------------------------------------- */
 
+static const char *video_output_signals[] = {
+	"void frame_missed(ptr video, bool duplicated, int late_frames)",
+	NULL
+};
+
 static inline bool valid_video_params(struct video_output_info *info)
 {
 	return info->height != 0 && info->width != 0 && info->fps_den != 0 &&
@@ -172,11 +548,22 @@ int video_output_open(video_t *video, struct video_output_info *info)
 	out->frame_time = (uint64_t)(1000000000.0 * (double)info->fps_den /
 		(double)info->fps_num);
 	out->initialized = false;
+	out->profile_point = profile_point_get("video_output_cur_frame");
+	out->catchup_mode  = VIDEO_CATCHUP_BURST;
+	out->pacing_mode   = VIDEO_PACING_SLEEP;
+
+	out->signals = signal_handler_create();
+	if (!out->signals)
+		goto fail;
+	if (!signal_handler_add_array(out->signals, video_output_signals))
+		goto fail;
 
 	if (pthread_mutex_init(&out->data_mutex, NULL) != 0)
 		goto fail;
 	if (pthread_mutex_init(&out->input_mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutex_init(&out->clock_mutex, NULL) != 0)
+		goto fail;
 	if (os_event_init(&out->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
 	if (os_event_init(&out->update_event, OS_EVENT_TYPE_AUTO) != 0)
@@ -193,6 +580,8 @@ fail:
 	return VIDEO_OUTPUT_FAIL;
 }
 
+static void video_conversion_destroy(struct video_conversion *conv);
+
 void video_output_close(video_t video)
 {
 	if (!video)
@@ -200,14 +589,34 @@ void video_output_close(video_t video)
 
 	video_output_stop(video);
 
-	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
+	if (video->frames_rendered || video->frames_duplicated) {
+		struct video_pacing_stats stats;
+
+		blog(LOG_INFO, "video_output_close: %ld frames rendered, "
+		               "%ld duplicated, %ld late",
+		               os_atomic_load_long(&video->frames_rendered),
+		               os_atomic_load_long(&video->frames_duplicated),
+		               os_atomic_load_long(&video->frames_late));
+
+		video_output_get_pacing_stats(video, &stats);
+		blog(LOG_INFO, "video_output_close: pacing drift %lld ns, "
+		               "jitter %llu ns (max %llu ns)",
+		               (long long)stats.drift,
+		               (unsigned long long)stats.jitter,
+		               (unsigned long long)stats.max_jitter);
+	}
+
+	for (size_t i = 0; i < video->conversions.num; i++)
+		video_conversion_destroy(video->conversions.array[i]);
+	da_free(video->conversions);
 	da_free(video->inputs);
 
 	os_event_destroy(video->update_event);
 	os_event_destroy(video->stop_event);
 	pthread_mutex_destroy(&video->data_mutex);
 	pthread_mutex_destroy(&video->input_mutex);
+	pthread_mutex_destroy(&video->clock_mutex);
+	signal_handler_destroy(video->signals);
 	bfree(video);
 }
 
@@ -224,46 +633,191 @@ static size_t video_get_input_idx(video_t video,
 	return DARRAY_INVALID;
 }
 
-static inline bool video_input_init(struct video_input *input,
-		struct video_output *video)
-{
-	if (input->conversion.width  != video->info.width ||
-	    input->conversion.height != video->info.height ||
-	    input->conversion.format != video->info.format) {
-		struct video_scale_info from = {
-			.format = video->info.format,
-			.width  = video->info.width,
-			.height = video->info.height,
-		};
-
-		int ret = video_scaler_create(&input->scaler,
-				&input->conversion, &from,
-				VIDEO_SCALE_FAST_BILINEAR);
-		if (ret != VIDEO_SCALER_SUCCESS) {
-			if (ret == VIDEO_SCALER_BAD_CONVERSION)
-				blog(LOG_ERROR, "video_input_init: Bad "
-				                "scale conversion type");
-			else
-				blog(LOG_ERROR, "video_input_init: Failed to "
-				                "create scaler");
-
-			return false;
-		}
+static inline bool scale_info_equal(const struct video_scale_info *a,
+		const struct video_scale_info *b)
+{
+	return a->format     == b->format &&
+	       a->width      == b->width  &&
+	       a->height     == b->height &&
+	       a->range      == b->range  &&
+	       a->colorspace == b->colorspace;
+}
+
+static inline bool is_base_conversion(struct video_output *video,
+		const struct video_scale_info *info)
+{
+	return info->width  == video->info.width  &&
+	       info->height == video->info.height &&
+	       info->format == video->info.format;
+}
+
+/* finds the smallest existing conversion that can be scaled down to the
+ * new one */
+static struct video_conversion *find_cascade_parent(
+		struct video_output *video,
+		const struct video_scale_info *info)
+{
+	struct video_conversion *best = NULL;
+
+	for (size_t i = 0; i < video->conversions.num; i++) {
+		struct video_conversion *conv = video->conversions.array[i];
+
+		if (conv->external                            ||
+		    conv->info.format     != info->format     ||
+		    conv->info.range      != info->range      ||
+		    conv->info.colorspace != info->colorspace ||
+		    conv->info.width      <  info->width      ||
+		    conv->info.height     <  info->height)
+			continue;
+
+		if (!best || (uint64_t)conv->info.width * conv->info.height <
+		             (uint64_t)best->info.width * best->info.height)
+			best = conv;
+	}
+
+	return best;
+}
+
+static bool video_conversion_init_scaler(struct video_conversion *conv)
+{
+	struct video_output *video = conv->video;
+	struct video_scale_info from;
+	int ret;
+
+	if (conv->parent) {
+		from = conv->parent->info;
+	} else {
+		memset(&from, 0, sizeof(from));
+		from.format = video->info.format;
+		from.width  = video->info.width;
+		from.height = video->info.height;
+	}
+
+	video_scaler_destroy(conv->scaler);
+	conv->scaler = NULL;
 
-		for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-			video_frame_init(&input->frame[i],
-					input->conversion.format,
-					input->conversion.width,
-					input->conversion.height);
+	ret = video_scaler_create(&conv->scaler, &conv->info, &from,
+			VIDEO_SCALE_FAST_BILINEAR);
+	if (ret != VIDEO_SCALER_SUCCESS) {
+		if (ret == VIDEO_SCALER_BAD_CONVERSION)
+			blog(LOG_ERROR, "video_conversion_init_scaler: Bad "
+			                "scale conversion type");
+		else
+			blog(LOG_ERROR, "video_conversion_init_scaler: "
+			                "Failed to create scaler");
+
+		return false;
 	}
 
+	video_scaler_set_job_system(conv->scaler, video->jobs);
 	return true;
 }
 
+static void video_conversion_destroy(struct video_conversion *conv)
+{
+	if (!conv)
+		return;
+
+	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
+		video_frame_free(&conv->frame[i]);
+	video_scaler_destroy(conv->scaler);
+	bfree(conv);
+}
+
+static struct video_conversion *video_conversion_create(
+		struct video_output *video,
+		const struct video_scale_info *info)
+{
+	struct video_conversion *conv = bzalloc(sizeof(*conv));
+	conv->video    = video;
+	conv->info     = *info;
+	conv->external = video->external_supported &&
+		video->external_supported(video->external_param, info);
+	conv->parent   = conv->external ?
+		NULL : find_cascade_parent(video, info);
+
+	if (!conv->external && !video_conversion_init_scaler(conv))
+		goto fail;
+
+	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
+		video_frame_init(&conv->frame[i], info->format,
+				info->width, info->height);
+
+	return conv;
+
+fail:
+	video_conversion_destroy(conv);
+	return NULL;
+}
+
+static struct video_conversion *get_conversion(struct video_output *video,
+		const struct video_scale_info *info)
+{
+	struct video_conversion *conv;
+
+	for (size_t i = 0; i < video->conversions.num; i++) {
+		conv = video->conversions.array[i];
+
+		if (scale_info_equal(&conv->info, info)) {
+			conv->refs++;
+			return conv;
+		}
+	}
+
+	conv = video_conversion_create(video, info);
+	if (conv) {
+		conv->refs = 1;
+		da_push_back(video->conversions, &conv);
+
+		if (conv->external)
+			os_atomic_inc_long(&video->external_revision);
+	}
+
+	return conv;
+}
+
+static void release_conversion(struct video_output *video,
+		struct video_conversion *conv)
+{
+	if (!conv || --conv->refs != 0)
+		return;
+
+	/* anything cascading from this conversion now scales from its
+	 * parent instead */
+	for (size_t i = 0; i < video->conversions.num; i++) {
+		struct video_conversion *child = video->conversions.array[i];
+
+		if (child->parent == conv) {
+			child->parent = conv->parent;
+			video_conversion_init_scaler(child);
+		}
+	}
+
+	if (conv->external)
+		os_atomic_inc_long(&video->external_revision);
+
+	da_erase_item(video->conversions, &conv);
+	video_conversion_destroy(conv);
+}
+
+static inline bool input_uses_base(const struct video_input *input)
+{
+	return !input->conversion || !input->conversion->external;
+}
+
 bool video_output_connect(video_t video,
 		const struct video_scale_info *conversion,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param)
+{
+	return video_output_connect2(video, conversion, 1, callback, param);
+}
+
+bool video_output_connect2(video_t video,
+		const struct video_scale_info *conversion,
+		uint32_t frame_rate_divisor,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param)
 {
 	bool success = false;
 
@@ -273,28 +827,47 @@ bool video_output_connect(video_t video,
 	pthread_mutex_lock(&video->input_mutex);
 
 	if (video_get_input_idx(video, callback, param) == DARRAY_INVALID) {
-		struct video_input input;
+		struct video_input      input;
+		struct video_scale_info info;
+
 		memset(&input, 0, sizeof(input));
+		memset(&info, 0, sizeof(info));
 
-		input.callback = callback;
-		input.param    = param;
+		input.callback           = callback;
+		input.param              = param;
+		input.frame_rate_divisor = frame_rate_divisor ?
+			frame_rate_divisor : 1;
+
+		/* the first frame is new to the input either way */
+		input.skip               = true;
+		input.changed            = true;
 
 		if (conversion) {
-			input.conversion = *conversion;
+			info = *conversion;
 		} else {
-			input.conversion.format    = video->info.format;
-			input.conversion.width     = video->info.width;
-			input.conversion.height    = video->info.height;
+			info.format = video->info.format;
+			info.width  = video->info.width;
+			info.height = video->info.height;
 		}
 
-		if (input.conversion.width == 0)
-			input.conversion.width = video->info.width;
-		if (input.conversion.height == 0)
-			input.conversion.height = video->info.height;
+		if (info.width == 0)
+			info.width = video->info.width;
+		if (info.height == 0)
+			info.height = video->info.height;
+
+		success = true;
 
-		success = video_input_init(&input, video);
-		if (success)
+		if (!is_base_conversion(video, &info)) {
+			input.conversion = get_conversion(video, &info);
+			success = input.conversion != NULL;
+		}
+
+		if (success) {
 			da_push_back(video->inputs, &input);
+
+			if (input_uses_base(&input))
+				os_atomic_inc_long(&video->base_inputs);
+		}
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
@@ -313,7 +886,12 @@ void video_output_disconnect(video_t video,
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array+idx);
+		struct video_input *input = video->inputs.array+idx;
+
+		if (input_uses_base(input))
+			os_atomic_dec_long(&video->base_inputs);
+
+		release_conversion(video, input->conversion);
 		da_erase(video->inputs, idx);
 	}
 
@@ -326,6 +904,96 @@ bool video_output_active(video_t video)
 	return video->inputs.num != 0;
 }
 
+bool video_output_base_active(video_t video)
+{
+	if (!video) return false;
+	return os_atomic_load_long(&video->base_inputs) != 0;
+}
+
+void video_output_set_external_scaler(video_t video,
+		bool (*supported)(void *param,
+			const struct video_scale_info *info),
+		void *param)
+{
+	if (!video)
+		return;
+
+	pthread_mutex_lock(&video->input_mutex);
+	video->external_supported = supported;
+	video->external_param     = param;
+	pthread_mutex_unlock(&video->input_mutex);
+}
+
+long video_output_external_revision(video_t video)
+{
+	return video ? os_atomic_load_long(&video->external_revision) : 0;
+}
+
+void video_output_enum_external(video_t video,
+		void (*enum_proc)(void *param,
+			const struct video_scale_info *info),
+		void *param)
+{
+	if (!video || !enum_proc)
+		return;
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	for (size_t i = 0; i < video->conversions.num; i++) {
+		struct video_conversion *conv = video->conversions.array[i];
+		if (conv->external)
+			enum_proc(param, &conv->info);
+	}
+
+	pthread_mutex_unlock(&video->input_mutex);
+}
+
+static struct video_conversion *find_external_conversion(
+		struct video_output *video,
+		const struct video_scale_info *info)
+{
+	for (size_t i = 0; i < video->conversions.num; i++) {
+		struct video_conversion *conv = video->conversions.array[i];
+		if (conv->external && scale_info_equal(&conv->info, info))
+			return conv;
+	}
+
+	return NULL;
+}
+
+void video_output_swap_scaled_frame(video_t video,
+		const struct video_scale_info *info, struct video_data *frame)
+{
+	struct video_conversion *conv;
+
+	if (!video || !info || !frame)
+		return;
+
+	pthread_mutex_lock(&video->data_mutex);
+	pthread_mutex_lock(&video->input_mutex);
+
+	conv = find_external_conversion(video, info);
+	if (conv) {
+		struct video_frame src;
+		int next = conv->cur_frame + 1;
+
+		if (next == MAX_CONVERT_BUFFERS)
+			next = 0;
+
+		memcpy(src.data, frame->data, sizeof(src.data));
+		memcpy(src.linesize, frame->linesize, sizeof(src.linesize));
+		video_frame_copy(&conv->frame[next], &src, info->format,
+				info->height);
+
+		conv->next_frame     = next;
+		conv->next_timestamp = frame->timestamp;
+		conv->new_frame      = true;
+	}
+
+	pthread_mutex_unlock(&video->input_mutex);
+	pthread_mutex_unlock(&video->data_mutex);
+}
+
 const struct video_output_info *video_output_getinfo(video_t video)
 {
 	return video ? &video->info : NULL;
@@ -333,11 +1001,36 @@ const struct video_output_info *video_output_getinfo(video_t video)
 
 void video_output_swap_frame(video_t video, struct video_data *frame)
 {
+	bool changed;
+
 	if (!video) return;
 
 	pthread_mutex_lock(&video->data_mutex);
+
+	/* a frame replaced before it was output still counts as a change */
+	changed = video->new_frame && !video->next_frame.duplicate;
+
 	video->next_frame = *frame;
 	video->new_frame = true;
+	if (changed)
+		video->next_frame.duplicate = false;
+	pthread_mutex_unlock(&video->data_mutex);
+}
+
+void video_output_repeat_frame(video_t video, uint64_t timestamp)
+{
+	if (!video) return;
+
+	pthread_mutex_lock(&video->data_mutex);
+
+	/* a frame that's already waiting is newer than the current one */
+	if (!video->new_frame && video->cur_frame.data[0]) {
+		video->next_frame           = video->cur_frame;
+		video->next_frame.timestamp = timestamp;
+		video->next_frame.duplicate = true;
+		video->new_frame            = true;
+	}
+
 	pthread_mutex_unlock(&video->data_mutex);
 }
 
@@ -391,3 +1084,96 @@ double video_output_framerate(video_t video)
 
 	return (double)video->info.fps_num / (double)video->info.fps_den;
 }
+
+void video_output_set_catchup_mode(video_t video,
+		enum video_catchup_mode mode)
+{
+	if (video)
+		video->catchup_mode = mode;
+}
+
+enum video_catchup_mode video_output_get_catchup_mode(video_t video)
+{
+	return video ? video->catchup_mode : VIDEO_CATCHUP_BURST;
+}
+
+void video_output_set_pacing_mode(video_t video, enum video_pacing_mode mode)
+{
+	if (video)
+		video->pacing_mode = mode;
+}
+
+enum video_pacing_mode video_output_get_pacing_mode(video_t video)
+{
+	return video ? video->pacing_mode : VIDEO_PACING_SLEEP;
+}
+
+void video_output_get_pacing_stats(video_t video,
+		struct video_pacing_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	if (!video)
+		return;
+
+	pthread_mutex_lock(&video->data_mutex);
+
+	stats->frames     = video->pacing_frames;
+	stats->max_jitter = video->pacing_max_jitter;
+
+	if (video->pacing_frames)
+		stats->drift = video->pacing_error_total /
+			(int64_t)video->pacing_frames;
+	if (video->pacing_frames > 1)
+		stats->jitter = video->pacing_jitter_total /
+			(video->pacing_frames - 1);
+
+	pthread_mutex_unlock(&video->data_mutex);
+}
+
+void video_output_set_clock(video_t video, media_clock_t clock)
+{
+	if (!video)
+		return;
+
+	pthread_mutex_lock(&video->clock_mutex);
+	video->clock = clock;
+	pthread_mutex_unlock(&video->clock_mutex);
+}
+
+void video_output_set_job_system(video_t video, job_system_t jobs)
+{
+	if (!video)
+		return;
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	video->jobs = jobs;
+	for (size_t i = 0; i < video->conversions.num; i++)
+		video_scaler_set_job_system(video->conversions.array[i]->scaler,
+				jobs);
+
+	pthread_mutex_unlock(&video->input_mutex);
+}
+
+uint32_t video_output_get_frames_rendered(video_t video)
+{
+	return video ?
+		(uint32_t)os_atomic_load_long(&video->frames_rendered) : 0;
+}
+
+uint32_t video_output_get_frames_duplicated(video_t video)
+{
+	return video ?
+		(uint32_t)os_atomic_load_long(&video->frames_duplicated) : 0;
+}
+
+uint32_t video_output_get_frames_late(video_t video)
+{
+	return video ?
+		(uint32_t)os_atomic_load_long(&video->frames_late) : 0;
+}
+
+signal_handler_t video_output_get_signal_handler(video_t video)
+{
+	return video ? video->signals : NULL;
+}
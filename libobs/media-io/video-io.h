@@ -18,6 +18,9 @@
 #pragma once
 
 #include "media-io-defs.h"
+#include "media-clock.h"
+#include "../callback/signal.h"
+#include "../util/job-system.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,12 +47,20 @@ enum video_format {
 	VIDEO_FORMAT_RGBA,
 	VIDEO_FORMAT_BGRA,
 	VIDEO_FORMAT_BGRX,
+
+	/* planar 444/422 formats, three-plane */
+	VIDEO_FORMAT_I444,
+	VIDEO_FORMAT_I422,
 };
 
 struct video_data {
 	uint8_t           *data[MAX_AV_PLANES];
 	uint32_t          linesize[MAX_AV_PLANES];
 	uint64_t          timestamp;
+
+	/* true if the content is the same as the previous frame the
+	 * receiver got, e.g. a repeated frame or an unchanged scene */
+	bool              duplicate;
 };
 
 struct video_output_info {
@@ -70,6 +81,8 @@ static inline bool format_is_yuv(enum video_format format)
 	case VIDEO_FORMAT_YVYU:
 	case VIDEO_FORMAT_YUY2:
 	case VIDEO_FORMAT_UYVY:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_I422:
 		return true;
 	case VIDEO_FORMAT_NONE:
 	case VIDEO_FORMAT_RGBA:
@@ -87,6 +100,8 @@ enum video_scale_type {
 	VIDEO_SCALE_FAST_BILINEAR,
 	VIDEO_SCALE_BILINEAR,
 	VIDEO_SCALE_BICUBIC,
+	VIDEO_SCALE_LANCZOS,
+	VIDEO_SCALE_AREA,
 };
 
 enum video_colorspace {
@@ -101,6 +116,52 @@ enum video_range_type {
 	VIDEO_RANGE_FULL
 };
 
+/**
+ * What the output thread does when it falls a whole frame or more behind
+ * schedule (for example when the system stalls)
+ */
+enum video_catchup_mode {
+	/** Output the missed frames back-to-back (default).  Every frame
+	 * interval still gets a frame, so frame counts stay in sync. */
+	VIDEO_CATCHUP_BURST,
+
+	/** Drop the missed intervals and resume at the current time; this
+	 * leaves a gap in the frame timestamps. */
+	VIDEO_CATCHUP_SKIP,
+};
+
+/** How the output thread waits for each frame interval */
+enum video_pacing_mode {
+	/** Relative sleeps, cheapest but least precise (default) */
+	VIDEO_PACING_SLEEP,
+
+	/** Absolute-deadline sleeps followed by a short spin, for outputs
+	 * that need steady frame timing.  Uses a little more CPU. */
+	VIDEO_PACING_PRECISE,
+
+	/** Relative sleeps, but only one per frame: the next frame is updated
+	 * as soon as the previous one has been output instead of half a frame
+	 * later, so the thread wakes up half as often.  Rendering gets a whole
+	 * frame of time, and frames are half a frame older when output. */
+	VIDEO_PACING_COALESCED,
+};
+
+/** Frame timing measured by the output thread, in nanoseconds */
+struct video_pacing_stats {
+	/** Frames measured */
+	uint64_t frames;
+
+	/** Average time frames were output past their scheduled time */
+	int64_t  drift;
+
+	/** Average difference between the time since the previous frame
+	 * and the frame interval */
+	uint64_t jitter;
+
+	/** Largest of those differences */
+	uint64_t max_jitter;
+};
+
 struct video_scale_info {
 	enum video_format     format;
 	uint32_t              width;
@@ -126,14 +187,70 @@ EXPORT bool video_output_connect(video_t video,
 		const struct video_scale_info *conversion,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param);
+
+/**
+ * Connects an input that only receives every frame_rate_divisor'th frame,
+ * so it runs at a fraction of the output's frame rate.  The frames it
+ * skips are not scaled for it.  0 and 1 receive every frame.
+ */
+EXPORT bool video_output_connect2(video_t video,
+		const struct video_scale_info *conversion,
+		uint32_t frame_rate_divisor,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param);
 EXPORT void video_output_disconnect(video_t video,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param);
 
 EXPORT bool video_output_active(video_t video);
 
+/**
+ * Returns true if any input needs the unscaled output frame, either
+ * directly or to be scaled on the CPU.
+ */
+EXPORT bool video_output_base_active(video_t video);
+
+/**
+ * Lets the owner of the output produce some scaled/converted frames itself
+ * (e.g. by rendering them on the GPU) instead of having them scaled on the
+ * CPU.  'supported' is called for each newly requested conversion, and
+ * frames must then be supplied for the conversions it accepts with
+ * video_output_swap_scaled_frame.
+ */
+EXPORT void video_output_set_external_scaler(video_t video,
+		bool (*supported)(void *param,
+			const struct video_scale_info *info),
+		void *param);
+
+/**
+ * Returns a value that changes whenever an external conversion is added or
+ * removed, so the list only needs to be enumerated when it changes.
+ */
+EXPORT long video_output_external_revision(video_t video);
+
+/** Enumerates the conversions that are handled externally */
+EXPORT void video_output_enum_external(video_t video,
+		void (*enum_proc)(void *param,
+			const struct video_scale_info *info),
+		void *param);
+
+/**
+ * Supplies the next frame of an external conversion.  The data is copied,
+ * so it only needs to remain valid for the duration of the call.
+ */
+EXPORT void video_output_swap_scaled_frame(video_t video,
+		const struct video_scale_info *info, struct video_data *frame);
+
 EXPORT const struct video_output_info *video_output_getinfo(video_t video);
 EXPORT void video_output_swap_frame(video_t video, struct video_data *frame);
+
+/**
+ * Outputs the current frame again as a duplicate with a new timestamp, for
+ * when the frame is known not to have changed.  Unlike a frame that isn't
+ * supplied in time, this doesn't count as a duplicated frame.  The frame's
+ * data must stay valid until the next one is swapped in.
+ */
+EXPORT void video_output_repeat_frame(video_t video, uint64_t timestamp);
 EXPORT bool video_output_wait(video_t video);
 EXPORT uint64_t video_getframetime(video_t video);
 EXPORT uint64_t video_gettime(video_t video);
@@ -143,6 +260,50 @@ EXPORT uint32_t video_output_width(video_t video);
 EXPORT uint32_t video_output_height(video_t video);
 EXPORT double video_output_framerate(video_t video);
 
+EXPORT void video_output_set_catchup_mode(video_t video,
+		enum video_catchup_mode mode);
+EXPORT enum video_catchup_mode video_output_get_catchup_mode(video_t video);
+
+EXPORT void video_output_set_pacing_mode(video_t video,
+		enum video_pacing_mode mode);
+EXPORT enum video_pacing_mode video_output_get_pacing_mode(video_t video);
+EXPORT void video_output_get_pacing_stats(video_t video,
+		struct video_pacing_stats *stats);
+
+/**
+ * Sets a master clock that drives the frame cadence instead of the system
+ * clock, or NULL to go back to the system clock.  Frames are still
+ * timestamped with system time.  The clock must stay valid until it has
+ * been replaced or the output has been closed.
+ */
+EXPORT void video_output_set_clock(video_t video, media_clock_t clock);
+
+/**
+ * Sets the job system that conversions (and the bands of large frames) are
+ * scaled on, or NULL to scale them all on the video thread.  The job system
+ * must outlive the output.
+ */
+EXPORT void video_output_set_job_system(video_t video, job_system_t jobs);
+
+/** Frame intervals that output a newly supplied frame */
+EXPORT uint32_t video_output_get_frames_rendered(video_t video);
+
+/** Frame intervals where no new frame was supplied in time, so the previous
+ * frame was output again */
+EXPORT uint32_t video_output_get_frames_duplicated(video_t video);
+
+/** Frame intervals that the output thread itself was late for (or skipped,
+ * with VIDEO_CATCHUP_SKIP) */
+EXPORT uint32_t video_output_get_frames_late(video_t video);
+
+/**
+ * Signals:
+ *   void frame_missed(ptr video, bool duplicated, int late_frames)
+ *     Called from the output thread (without any locks held) after any
+ *     duplicated or late frame.
+ */
+EXPORT signal_handler_t video_output_get_signal_handler(video_t video);
+
 
 #ifdef __cplusplus
 }
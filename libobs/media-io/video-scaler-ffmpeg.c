@@ -16,13 +16,49 @@
 ******************************************************************************/
 
 #include "../util/bmem.h"
+#include "../util/platform.h"
+#include "../util/job-system.h"
 #include "video-scaler.h"
+#include "video-frame.h"
 
 #include <libswscale/swscale.h>
 
+/* frames are split into horizontal bands that are scaled concurrently on the
+ * job system, each by its own swscale context.  the filters of a band need the rows around
+ * it, so interior bands are scaled with a margin of extra rows into a
+ * scratch frame, and only their own rows are copied to the output. */
+
+#define MAX_SCALER_BANDS     8
+#define MIN_BAND_ROWS        64
+#define MIN_BAND_MARGIN_ROWS 8
+
+struct scaler_band {
+	struct SwsContext  *swscale;
+	int                src_y;
+	int                src_height;
+
+	uint32_t           dst_y;
+	uint32_t           dst_height;
+	uint32_t           margin_top;
+	uint32_t           scratch_height;
+	bool               use_scratch;
+	struct video_frame scratch;
+};
+
 struct video_scaler {
-	struct SwsContext *swscale;
-	int src_height;
+	enum video_format   src_format;
+	enum video_format   dst_format;
+	struct scaler_band  bands[MAX_SCALER_BANDS];
+	size_t              num_bands;
+
+	/* state of the frame being scaled, read by the band jobs */
+	uint8_t             **output;
+	const uint32_t      *out_linesize;
+	const uint8_t       *const *input;
+	const uint32_t      *in_linesize;
+	volatile bool       failed;
+
+	job_system_t        jobs;
 };
 
 static inline enum AVPixelFormat get_ffmpeg_video_format(
@@ -38,11 +74,27 @@ static inline enum AVPixelFormat get_ffmpeg_video_format(
 	case VIDEO_FORMAT_RGBA: return AV_PIX_FMT_RGBA;
 	case VIDEO_FORMAT_BGRA: return AV_PIX_FMT_BGRA;
 	case VIDEO_FORMAT_BGRX: return AV_PIX_FMT_BGRA;
+	case VIDEO_FORMAT_I444: return AV_PIX_FMT_YUV444P;
+	case VIDEO_FORMAT_I422: return AV_PIX_FMT_YUV422P;
 	}
 
 	return AV_PIX_FMT_NONE;
 }
 
+/* swscale picks its SIMD code at runtime, but how much of the work stays on
+ * it depends on the filter: fast bilinear has vectorized horizontal scaling
+ * but aliases on larger downscales, where area averaging is both better and
+ * about as fast.  unscaled conversions ignore the filter. */
+static inline int get_default_scale_type(const struct video_scale_info *dst,
+		const struct video_scale_info *src)
+{
+	if (src->width  >= dst->width  * 2 ||
+	    src->height >= dst->height * 2)
+		return SWS_AREA;
+
+	return SWS_FAST_BILINEAR;
+}
+
 static inline int get_ffmpeg_scale_type(enum video_scale_type type)
 {
 	switch (type) {
@@ -51,6 +103,8 @@ static inline int get_ffmpeg_scale_type(enum video_scale_type type)
 	case VIDEO_SCALE_FAST_BILINEAR: return SWS_FAST_BILINEAR;
 	case VIDEO_SCALE_BILINEAR:      return SWS_BILINEAR | SWS_AREA;
 	case VIDEO_SCALE_BICUBIC:       return SWS_BICUBIC;
+	case VIDEO_SCALE_LANCZOS:       return SWS_LANCZOS;
+	case VIDEO_SCALE_AREA:          return SWS_AREA;
 	}
 
 	return SWS_POINT;
@@ -80,42 +134,135 @@ static inline int get_ffmpeg_range_type(enum video_range_type type)
 
 #define FIXED_1_0 (1<<16)
 
-int video_scaler_create(video_scaler_t *scaler_out,
+static inline size_t get_plane_count(enum video_format format)
+{
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_I422: return 3;
+	case VIDEO_FORMAT_NV12: return 2;
+	default:                return 1;
+	}
+}
+
+/* vertical subsampling of a plane, as a shift of the row */
+static inline int get_plane_shift(enum video_format format, size_t plane)
+{
+	if (plane == 0)
+		return 0;
+
+	return (format == VIDEO_FORMAT_I420 || format == VIDEO_FORMAT_NV12) ?
+		1 : 0;
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/* band edges have to map to whole source rows, and have to be even so that
+ * subsampled chroma rows aren't split.  returns the number of bands,
+ * filling in the band rows. */
+static size_t plan_bands(struct video_scaler *scaler,
+		const struct video_scale_info *dst,
+		const struct video_scale_info *src)
+{
+	uint32_t g          = gcd(src->height, dst->height);
+	uint32_t dst_unit   = dst->height / g;
+	uint32_t src_unit   = src->height / g;
+	uint32_t margin     = 0;
+	size_t   max_bands  = (size_t)os_get_logical_cores();
+	size_t   num_bands;
+	uint32_t units, units_per_band;
+
+	if (max_bands > MAX_SCALER_BANDS)
+		max_bands = MAX_SCALER_BANDS;
+
+	if ((dst_unit & 1) || (src_unit & 1)) {
+		dst_unit *= 2;
+		src_unit *= 2;
+	}
+
+	units     = dst->height / dst_unit;
+	num_bands = dst->height / MIN_BAND_ROWS;
+	if (num_bands > max_bands)
+		num_bands = max_bands;
+	if (num_bands > units)
+		num_bands = units;
+	if (num_bands < 2 || dst->height % dst_unit != 0)
+		return 1;
+
+	while (margin < MIN_BAND_MARGIN_ROWS ||
+	       margin / dst_unit * src_unit < MIN_BAND_MARGIN_ROWS)
+		margin += dst_unit;
+
+	units_per_band = units / (uint32_t)num_bands;
+
+	for (size_t i = 0; i < num_bands; i++) {
+		struct scaler_band *band = &scaler->bands[i];
+		uint32_t first = (uint32_t)i * units_per_band;
+		uint32_t last  = (i == num_bands - 1) ?
+			units : first + units_per_band;
+		uint32_t top    = first ? margin : 0;
+		uint32_t bottom = (last < units) ? margin : 0;
+
+		if (top > first * dst_unit)
+			top = first * dst_unit;
+		if (bottom > (units - last) * dst_unit)
+			bottom = (units - last) * dst_unit;
+
+		band->dst_y       = first * dst_unit;
+		band->dst_height  = (last - first) * dst_unit;
+		band->margin_top     = top;
+		band->scratch_height = band->dst_height + top + bottom;
+		band->use_scratch    = true;
+
+		band->src_y      = (int)((band->dst_y - top) / dst_unit *
+				src_unit);
+		band->src_height = (int)((band->dst_height + top + bottom) /
+				dst_unit * src_unit);
+
+		video_frame_init(&band->scratch, dst->format, dst->width,
+				band->scratch_height);
+	}
+
+	return num_bands;
+}
+
+static bool init_band_context(struct scaler_band *band,
 		const struct video_scale_info *dst,
 		const struct video_scale_info *src,
-		enum video_scale_type type)
+		int scale_type)
 {
 	enum AVPixelFormat format_src = get_ffmpeg_video_format(src->format);
 	enum AVPixelFormat format_dst = get_ffmpeg_video_format(dst->format);
-	int                scale_type = get_ffmpeg_scale_type(type);
 	const int          *coeff_src = get_ffmpeg_coeffs(src->colorspace);
 	const int          *coeff_dst = get_ffmpeg_coeffs(dst->colorspace);
 	int                range_src  = get_ffmpeg_range_type(src->range);
 	int                range_dst  = get_ffmpeg_range_type(dst->range);
-	struct video_scaler *scaler;
+	int                dst_height = (int)band->dst_height;
 	int ret;
 
-	if (!scaler_out)
-		return VIDEO_SCALER_FAILED;
-
-	if (format_src == AV_PIX_FMT_NONE ||
-	    format_dst == AV_PIX_FMT_NONE)
-		return VIDEO_SCALER_BAD_CONVERSION;
-
-	scaler = bzalloc(sizeof(struct video_scaler));
-	scaler->src_height = src->height;
+	if (band->use_scratch)
+		dst_height = (int)band->scratch_height;
 
-	scaler->swscale = sws_getCachedContext(NULL,
-			src->width, src->height, format_src,
-			dst->width, dst->height, format_dst,
+	band->swscale = sws_getCachedContext(NULL,
+			src->width, band->src_height, format_src,
+			dst->width, dst_height, format_dst,
 			scale_type, NULL, NULL, NULL);
-	if (!scaler->swscale) {
+	if (!band->swscale) {
 		blog(LOG_ERROR, "video_scaler_create: Could not create "
 		                "swscale");
-		goto fail;
+		return false;
 	}
 
-	ret = sws_setColorspaceDetails(scaler->swscale,
+	ret = sws_setColorspaceDetails(band->swscale,
 			coeff_src, range_src,
 			coeff_dst, range_dst,
 			0, FIXED_1_0, FIXED_1_0);
@@ -124,6 +271,45 @@ int video_scaler_create(video_scaler_t *scaler_out,
 		                "sws_setColorspaceDetails failed, ignoring");
 	}
 
+	return true;
+}
+
+int video_scaler_create(video_scaler_t *scaler_out,
+		const struct video_scale_info *dst,
+		const struct video_scale_info *src,
+		enum video_scale_type type)
+{
+	enum AVPixelFormat format_src = get_ffmpeg_video_format(src->format);
+	enum AVPixelFormat format_dst = get_ffmpeg_video_format(dst->format);
+	int                scale_type = get_ffmpeg_scale_type(type);
+	struct video_scaler *scaler;
+
+	if (!scaler_out)
+		return VIDEO_SCALER_FAILED;
+
+	if (format_src == AV_PIX_FMT_NONE ||
+	    format_dst == AV_PIX_FMT_NONE)
+		return VIDEO_SCALER_BAD_CONVERSION;
+
+	if (type == VIDEO_SCALE_DEFAULT)
+		scale_type = get_default_scale_type(dst, src);
+
+	scaler = bzalloc(sizeof(struct video_scaler));
+	scaler->src_format = src->format;
+	scaler->dst_format = dst->format;
+	scaler->num_bands  = plan_bands(scaler, dst, src);
+
+	if (scaler->num_bands == 1) {
+		scaler->bands[0].src_height = (int)src->height;
+		scaler->bands[0].dst_height = dst->height;
+	}
+
+	for (size_t i = 0; i < scaler->num_bands; i++) {
+		if (!init_band_context(&scaler->bands[i], dst, src,
+					scale_type))
+			goto fail;
+	}
+
 	*scaler_out = scaler;
 	return VIDEO_SCALER_SUCCESS;
 
@@ -135,21 +321,43 @@ fail:
 void video_scaler_destroy(video_scaler_t scaler)
 {
 	if (scaler) {
-		sws_freeContext(scaler->swscale);
+		for (size_t i = 0; i < scaler->num_bands; i++) {
+			struct scaler_band *band = &scaler->bands[i];
+
+			sws_freeContext(band->swscale);
+			video_frame_free(&band->scratch);
+		}
+
 		bfree(scaler);
 	}
 }
 
-bool video_scaler_scale(video_scaler_t scaler,
-		uint8_t *output[], const uint32_t out_linesize[],
-		const uint8_t *const input[], const uint32_t in_linesize[])
+static bool scale_band(struct video_scaler *scaler, struct scaler_band *band)
 {
-	if (!scaler)
-		return false;
+	const uint8_t *input[MAX_AV_PLANES]  = {0};
+	uint8_t       *output[MAX_AV_PLANES] = {0};
+	const uint32_t *out_linesize = scaler->out_linesize;
+	int ret;
+
+	for (size_t i = 0; i < get_plane_count(scaler->src_format); i++) {
+		int shift = get_plane_shift(scaler->src_format, i);
+		input[i] = scaler->input[i] +
+			(size_t)(band->src_y >> shift) *
+			scaler->in_linesize[i];
+	}
+
+	if (band->use_scratch) {
+		for (size_t i = 0; i < MAX_AV_PLANES; i++)
+			output[i] = band->scratch.data[i];
+		out_linesize = band->scratch.linesize;
+	} else {
+		for (size_t i = 0; i < MAX_AV_PLANES; i++)
+			output[i] = scaler->output[i];
+	}
 
-	int ret = sws_scale(scaler->swscale,
-			input, (const int *)in_linesize,
-			0, scaler->src_height,
+	ret = sws_scale(band->swscale,
+			input, (const int *)scaler->in_linesize,
+			0, band->src_height,
 			output, (const int *)out_linesize);
 	if (ret <= 0) {
 		blog(LOG_ERROR, "video_scaler_scale: sws_scale failed: %d",
@@ -157,5 +365,63 @@ bool video_scaler_scale(video_scaler_t scaler,
 		return false;
 	}
 
+	if (band->use_scratch) {
+		struct video_frame src_rows = {0};
+		struct video_frame dst_rows = {0};
+
+		for (size_t i = 0; i < get_plane_count(scaler->dst_format);
+				i++) {
+			int shift = get_plane_shift(scaler->dst_format, i);
+
+			src_rows.data[i] = band->scratch.data[i] +
+				(size_t)(band->margin_top >> shift) *
+				band->scratch.linesize[i];
+			src_rows.linesize[i] = band->scratch.linesize[i];
+
+			dst_rows.data[i] = scaler->output[i] +
+				(size_t)(band->dst_y >> shift) *
+				scaler->out_linesize[i];
+			dst_rows.linesize[i] = scaler->out_linesize[i];
+		}
+
+		video_frame_copy(&dst_rows, &src_rows, scaler->dst_format,
+				band->dst_height);
+	}
+
 	return true;
 }
+
+static void scale_band_job(void *param, size_t idx)
+{
+	struct video_scaler *scaler = param;
+
+	if (!scale_band(scaler, &scaler->bands[idx]))
+		scaler->failed = true;
+}
+
+void video_scaler_set_job_system(video_scaler_t scaler, job_system_t jobs)
+{
+	if (scaler)
+		scaler->jobs = jobs;
+}
+
+bool video_scaler_scale(video_scaler_t scaler,
+		uint8_t *output[], const uint32_t out_linesize[],
+		const uint8_t *const input[], const uint32_t in_linesize[])
+{
+	if (!scaler)
+		return false;
+
+	scaler->output       = output;
+	scaler->out_linesize = out_linesize;
+	scaler->input        = input;
+	scaler->in_linesize  = in_linesize;
+	scaler->failed       = false;
+
+	/* the calling thread scales bands as well, and scales all of them
+	 * without a job system */
+	job_parallel_for(scaler->jobs, scaler->num_bands, scale_band_job,
+			scaler, JOB_PRIORITY_HIGH, 0);
+
+	return !scaler->failed;
+}
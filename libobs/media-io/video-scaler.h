@@ -18,6 +18,7 @@
 #pragma once
 
 #include "../util/c99defs.h"
+#include "../util/job-system.h"
 #include "video-io.h"
 
 #ifdef __cplusplus
@@ -37,6 +38,11 @@ EXPORT int video_scaler_create(video_scaler_t *scaler,
 		enum video_scale_type type);
 EXPORT void video_scaler_destroy(video_scaler_t scaler);
 
+/* bands of large frames are scaled in parallel on this job system, or all on
+ * the calling thread if it's NULL */
+EXPORT void video_scaler_set_job_system(video_scaler_t scaler,
+		job_system_t jobs);
+
 EXPORT bool video_scaler_scale(video_scaler_t scaler,
 		uint8_t *output[], const uint32_t out_linesize[],
 		const uint8_t *const input[], const uint32_t in_linesize[]);
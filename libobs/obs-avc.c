@@ -33,13 +33,6 @@ enum {
 	NAL_FILLER    = 12,
 };
 
-enum {
-	NAL_PRIORITY_DISPOSABLE = 0,
-	NAL_PRIORITY_LOW        = 1,
-	NAL_PRIORITY_HIGH       = 2,
-	NAL_PRIORITY_HIGHEST    = 3,
-};
-
 /* NOTE: I noticed that FFmpeg does some unusual special handling of certain
  * scenarios that I was unaware of, so instead of just searching for {0, 0, 1}
  * we'll just use the code from FFmpeg - http://www.ffmpeg.org/ */
@@ -81,70 +74,210 @@ static const uint8_t *ff_avc_find_startcode_internal(const uint8_t *p,
 	return end + 3;
 }
 
-const uint8_t *obs_avc_find_startcode(const uint8_t *p, const uint8_t *end)
-{
-	const uint8_t *out= ff_avc_find_startcode_internal(p, end);
-	if (p < out && out < end && !out[-1]) out--;
-	return out;
-}
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define USE_SSE2_STARTCODE
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define USE_NEON_STARTCODE
+#endif
 
-static inline int get_drop_priority(int priority)
+#if defined(USE_SSE2_STARTCODE) || defined(USE_NEON_STARTCODE)
+
+/* Compares three overlapping loads against {0, 0, 1} to test 16 positions
+ * at once.  Once a block contains a match, the byte loop below finds where
+ * it is, so the vector code never has to locate the matching byte itself. */
+static const uint8_t *find_startcode_simd(const uint8_t *p,
+		const uint8_t *end)
 {
-	switch (priority) {
-	case NAL_PRIORITY_DISPOSABLE: return NAL_PRIORITY_DISPOSABLE;
-	case NAL_PRIORITY_LOW:        return NAL_PRIORITY_LOW;
+#ifdef USE_SSE2_STARTCODE
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one  = _mm_set1_epi8(1);
+
+	for (; end - p >= 19; p += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)p);
+		__m128i b = _mm_loadu_si128((const __m128i*)(p + 1));
+		__m128i c = _mm_loadu_si128((const __m128i*)(p + 2));
+		__m128i m = _mm_and_si128(
+				_mm_and_si128(_mm_cmpeq_epi8(a, zero),
+				              _mm_cmpeq_epi8(b, zero)),
+				_mm_cmpeq_epi8(c, one));
+
+		if (_mm_movemask_epi8(m))
+			break;
+	}
+#else
+	const uint8x16_t zero = vdupq_n_u8(0);
+	const uint8x16_t one  = vdupq_n_u8(1);
+
+	for (; end - p >= 19; p += 16) {
+		uint8x16_t a = vld1q_u8(p);
+		uint8x16_t b = vld1q_u8(p + 1);
+		uint8x16_t c = vld1q_u8(p + 2);
+		uint64x2_t m = vreinterpretq_u64_u8(vandq_u8(
+				vandq_u8(vceqq_u8(a, zero), vceqq_u8(b, zero)),
+				vceqq_u8(c, one)));
+
+		if (vgetq_lane_u64(m, 0) | vgetq_lane_u64(m, 1))
+			break;
+	}
+#endif
+
+	for (; end - p > 3; p++) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+			return p;
 	}
 
-	return NAL_PRIORITY_HIGHEST;
+	return end;
 }
 
-static void serialize_avc_data(struct serializer *s, const uint8_t *data,
-		size_t size, bool *is_keyframe, int *priority)
+#define find_startcode find_startcode_simd
+#else
+#define find_startcode ff_avc_find_startcode_internal
+#endif
+
+const uint8_t *obs_avc_find_startcode(const uint8_t *p, const uint8_t *end)
+{
+	const uint8_t *out = find_startcode(p, end);
+	if (p < out && out < end && !out[-1]) out--;
+	return out;
+}
+
+void obs_avc_parse_nals(struct obs_avc_nals *info, const uint8_t *data,
+		size_t size)
 {
 	const uint8_t *nal_start, *nal_end;
 	const uint8_t *end = data+size;
-	int type;
+
+	da_init(info->nals);
+	info->priority = -1;
+	info->keyframe = false;
 
 	nal_start = obs_avc_find_startcode(data, end);
 	while (true) {
+		struct obs_avc_nal *nal;
+
 		while (nal_start < end && !*(nal_start++));
 
 		if (nal_start == end)
 			break;
 
-		type = nal_start[0] & 0x1F;
+		nal_end = obs_avc_find_startcode(nal_start, end);
 
-		if (type == NAL_SLICE_IDR || type == NAL_SLICE) {
-			if (is_keyframe)
-				*is_keyframe = (type == NAL_SLICE_IDR);
-			if (priority)
-				*priority = nal_start[0] >> 5;
+		nal          = da_push_back_new(info->nals);
+		nal->data    = nal_start;
+		nal->size    = nal_end - nal_start;
+		nal->type    = nal_start[0] & 0x1F;
+		nal->ref_idc = nal_start[0] >> 5;
+
+		if (nal->type == NAL_SLICE_IDR || nal->type == NAL_SLICE) {
+			info->keyframe = (nal->type == NAL_SLICE_IDR);
+			info->priority = nal->ref_idc;
 		}
 
-		nal_end = obs_avc_find_startcode(nal_start, end);
-		s_wb32(s, (uint32_t)(nal_end - nal_start));
-		s_write(s, nal_start, nal_end - nal_start);
 		nal_start = nal_end;
 	}
 }
 
+void obs_avc_nals_free(struct obs_avc_nals *info)
+{
+	da_free(info->nals);
+}
+
+static inline int get_drop_priority(int priority)
+{
+	switch (priority) {
+	case OBS_NAL_PRIORITY_DISPOSABLE: return OBS_NAL_PRIORITY_DISPOSABLE;
+	case OBS_NAL_PRIORITY_LOW:        return OBS_NAL_PRIORITY_LOW;
+	}
+
+	return OBS_NAL_PRIORITY_HIGHEST;
+}
+
+/* the parsed NAL units are known up front, so the output is allocated once
+ * at its final size instead of growing while it's written */
+static void serialize_avc_data(struct serializer *s,
+		const struct obs_avc_nals *info)
+{
+	for (size_t i = 0; i < info->nals.num; i++) {
+		const struct obs_avc_nal *nal = info->nals.array+i;
+
+		s_wb32(s, (uint32_t)nal->size);
+		s_write(s, nal->data, nal->size);
+	}
+}
+
+static inline size_t get_avcc_size(const struct obs_avc_nals *info)
+{
+	size_t size = 0;
+
+	for (size_t i = 0; i < info->nals.num; i++)
+		size += info->nals.array[i].size + 4;
+
+	return size;
+}
+
 void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 		const struct encoder_packet *src)
 {
 	struct array_output_data output;
 	struct serializer s;
+	struct obs_avc_nals info;
+	long ref = 1;
+
+	/* already in the right format, so just share the encoder's data */
+	if (src->avcc) {
+		obs_encoder_packet_ref(avc_packet,
+				(struct encoder_packet*)src);
+		avc_packet->drop_priority =
+			get_drop_priority(avc_packet->priority);
+		return;
+	}
+
+	obs_avc_parse_nals(&info, src->data, src->size);
 
 	array_output_serializer_init(&s, &output);
+	da_reserve(output.bytes, sizeof(ref) + get_avcc_size(&info));
 	*avc_packet = *src;
 
-	serialize_avc_data(&s, src->data, src->size, &avc_packet->keyframe,
-			&avc_packet->priority);
+	if (info.priority >= 0) {
+		avc_packet->keyframe = info.keyframe;
+		avc_packet->priority = info.priority;
+	}
+
+	/* the output is a reference counted packet, so reserve room for the
+	 * reference count in front of the data */
+	s_write(&s, &ref, sizeof(ref));
+	serialize_avc_data(&s, &info);
+	obs_avc_nals_free(&info);
 
-	avc_packet->data          = output.bytes.array;
-	avc_packet->size          = output.bytes.num;
+	avc_packet->data          = output.bytes.array + sizeof(ref);
+	avc_packet->size          = output.bytes.num - sizeof(ref);
 	avc_packet->drop_priority = get_drop_priority(avc_packet->priority);
 }
 
+void obs_avcc_to_annexb(uint8_t *data, size_t size)
+{
+	const uint8_t *end = data + size;
+
+	while (end - data >= 4) {
+		size_t nal_size = ((size_t)data[0] << 24) |
+		                  ((size_t)data[1] << 16) |
+		                  ((size_t)data[2] << 8)  |
+		                  ((size_t)data[3]);
+
+		if (nal_size > (size_t)(end - data) - 4)
+			break;
+
+		data[0] = 0;
+		data[1] = 0;
+		data[2] = 0;
+		data[3] = 1;
+
+		data += nal_size + 4;
+	}
+}
+
 static inline bool has_start_code(const uint8_t *data)
 {
 	if (data[0] != 0 || data[1] != 0)
@@ -157,30 +290,23 @@ static void get_sps_pps(const uint8_t *data, size_t size,
 		const uint8_t **sps, size_t *sps_size,
 		const uint8_t **pps, size_t *pps_size)
 {
-	const uint8_t *nal_start, *nal_end;
-	const uint8_t *end = data+size;
-	int type;
+	struct obs_avc_nals info;
 
-	nal_start = obs_avc_find_startcode(data, end);
-	while (true) {
-		while (nal_start < end && !*(nal_start++));
+	obs_avc_parse_nals(&info, data, size);
 
-		if (nal_start == end)
-			break;
+	for (size_t i = 0; i < info.nals.num; i++) {
+		const struct obs_avc_nal *nal = info.nals.array+i;
 
-		nal_end = obs_avc_find_startcode(nal_start, end);
-
-		type = nal_start[0] & 0x1F;
-		if (type == NAL_SPS) {
-			*sps = nal_start;
-			*sps_size = nal_end - nal_start;
-		} else if (type == NAL_PPS) {
-			*pps = nal_start;
-			*pps_size = nal_end - nal_start;
+		if (nal->type == NAL_SPS) {
+			*sps = nal->data;
+			*sps_size = nal->size;
+		} else if (nal->type == NAL_PPS) {
+			*pps = nal->data;
+			*pps_size = nal->size;
 		}
-
-		nal_start = nal_end;
 	}
+
+	obs_avc_nals_free(&info);
 }
 
 size_t obs_parse_avc_header(uint8_t **header, const uint8_t *data, size_t size)
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "util/c99defs.h"
+#include "util/darray.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -25,15 +26,49 @@ extern "C" {
 
 struct encoder_packet;
 
+enum {
+	OBS_NAL_PRIORITY_DISPOSABLE = 0,
+	OBS_NAL_PRIORITY_LOW        = 1,
+	OBS_NAL_PRIORITY_HIGH       = 2,
+	OBS_NAL_PRIORITY_HIGHEST    = 3,
+};
+
+/** NAL unit of Annex B data, not including its start code */
+struct obs_avc_nal {
+	const uint8_t *data;
+	size_t        size;
+	int           type;
+	int           ref_idc;
+};
+
+/** Annex B data split in to its NAL units */
+struct obs_avc_nals {
+	DARRAY(struct obs_avc_nal) nals;
+
+	/** Reference idc of the last slice, or -1 if there are no slices */
+	int                        priority;
+	/** Whether the last slice is an IDR slice */
+	bool                       keyframe;
+};
+
 /* Helpers for parsing AVC NAL units.  */
 
 EXPORT const uint8_t *obs_avc_find_startcode(const uint8_t *p,
 		const uint8_t *end);
+
+/* finds all NAL units in a single pass over the data */
+EXPORT void obs_avc_parse_nals(struct obs_avc_nals *info,
+		const uint8_t *data, size_t size);
+EXPORT void obs_avc_nals_free(struct obs_avc_nals *info);
+/* the parsed packet is reference counted (see obs_encoder_packet_ref) */
 EXPORT void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 		const struct encoder_packet *src);
 EXPORT size_t obs_parse_avc_header(uint8_t **header, const uint8_t *data,
 		size_t size);
 
+/* replaces the 32 bit sizes of AVCC data with start codes in place */
+EXPORT void obs_avcc_to_annexb(uint8_t *data, size_t size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,312 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "graphics/vec4.h"
+#include "obs-internal.h"
+
+static inline bool valid_canvas_info(const struct obs_canvas_info *info)
+{
+	return info && info->fps_num && info->fps_den &&
+	       info->base_width && info->base_height;
+}
+
+static bool obs_canvas_init_textures(struct obs_canvas *canvas)
+{
+	canvas->render_texture = gs_create_texture(canvas->base_width,
+			canvas->base_height, GS_RGBA, 1, NULL, GS_RENDERTARGET);
+	if (!canvas->render_texture)
+		return false;
+
+	if (canvas->output_width  != canvas->base_width ||
+	    canvas->output_height != canvas->base_height) {
+		canvas->output_texture = gs_create_texture(
+				canvas->output_width, canvas->output_height,
+				GS_RGBA, 1, NULL, GS_RENDERTARGET);
+		if (!canvas->output_texture)
+			return false;
+	}
+
+	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		canvas->copy_surfaces[i] = gs_create_stagesurface(
+				canvas->output_width, canvas->output_height,
+				GS_RGBA);
+		if (!canvas->copy_surfaces[i])
+			return false;
+	}
+
+	return true;
+}
+
+static void obs_canvas_free_textures(struct obs_canvas *canvas)
+{
+	if (canvas->mapped_surface) {
+		stagesurface_unmap(canvas->mapped_surface);
+		canvas->mapped_surface = NULL;
+	}
+
+	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		stagesurface_destroy(canvas->copy_surfaces[i]);
+		canvas->copy_surfaces[i] = NULL;
+	}
+
+	texture_destroy(canvas->output_texture);
+	texture_destroy(canvas->render_texture);
+	canvas->output_texture = NULL;
+	canvas->render_texture = NULL;
+}
+
+obs_canvas_t obs_canvas_create(const struct obs_canvas_info *info)
+{
+	struct obs_canvas *canvas;
+	struct video_output_info vi;
+	bool success;
+
+	if (!obs || !obs_graphics()) {
+		blog(LOG_ERROR, "obs_canvas_create: Video has not been reset");
+		return NULL;
+	}
+
+	if (!valid_canvas_info(info)) {
+		blog(LOG_ERROR, "obs_canvas_create: Invalid canvas info");
+		return NULL;
+	}
+
+	canvas = bzalloc(sizeof(struct obs_canvas));
+	canvas->base_width    = info->base_width;
+	canvas->base_height   = info->base_height;
+	canvas->output_width  = info->output_width  ?
+		info->output_width  : info->base_width;
+	canvas->output_height = info->output_height ?
+		info->output_height : info->base_height;
+	canvas->frame_time    = 1000000000ULL * info->fps_den / info->fps_num;
+
+	if (!obs_view_init(&canvas->view)) {
+		bfree(canvas);
+		return NULL;
+	}
+
+	vi.name    = "canvas";
+	vi.format  = VIDEO_FORMAT_RGBA;
+	vi.fps_num = info->fps_num;
+	vi.fps_den = info->fps_den;
+	vi.width   = canvas->output_width;
+	vi.height  = canvas->output_height;
+
+	if (video_output_open(&canvas->video, &vi) != VIDEO_OUTPUT_SUCCESS) {
+		blog(LOG_ERROR, "obs_canvas_create: Could not open video "
+		                "output");
+		obs_view_free(&canvas->view);
+		bfree(canvas);
+		return NULL;
+	}
+
+	video_output_set_job_system(canvas->video, obs->jobs);
+
+	gs_entercontext(obs->video.graphics);
+	success = obs_canvas_init_textures(canvas);
+	gs_leavecontext();
+
+	if (!success) {
+		blog(LOG_ERROR, "obs_canvas_create: Failed to create "
+		                "textures");
+		obs_canvas_destroy(canvas);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&obs->data.canvases_mutex);
+	canvas->prev_next      = &obs->data.first_canvas;
+	canvas->next           = obs->data.first_canvas;
+	obs->data.first_canvas = canvas;
+	if (canvas->next)
+		canvas->next->prev_next = &canvas->next;
+	pthread_mutex_unlock(&obs->data.canvases_mutex);
+
+	return canvas;
+}
+
+void obs_canvas_destroy(obs_canvas_t canvas)
+{
+	if (!canvas)
+		return;
+
+	if (canvas->prev_next) {
+		pthread_mutex_lock(&obs->data.canvases_mutex);
+		*canvas->prev_next = canvas->next;
+		if (canvas->next)
+			canvas->next->prev_next = canvas->prev_next;
+		pthread_mutex_unlock(&obs->data.canvases_mutex);
+	}
+
+	if (canvas->video) {
+		video_output_stop(canvas->video);
+		video_output_close(canvas->video);
+	}
+
+	gs_entercontext(obs->video.graphics);
+	obs_canvas_free_textures(canvas);
+	gs_leavecontext();
+
+	obs_view_free(&canvas->view);
+	bfree(canvas);
+}
+
+obs_view_t obs_canvas_view(obs_canvas_t canvas)
+{
+	return canvas ? &canvas->view : NULL;
+}
+
+video_t obs_canvas_video(obs_canvas_t canvas)
+{
+	return canvas ? canvas->video : NULL;
+}
+
+bool obs_canvas_get_info(obs_canvas_t canvas, struct obs_canvas_info *info)
+{
+	const struct video_output_info *vi;
+
+	if (!canvas || !info)
+		return false;
+
+	vi = video_output_getinfo(canvas->video);
+	info->fps_num       = vi->fps_num;
+	info->fps_den       = vi->fps_den;
+	info->base_width    = canvas->base_width;
+	info->base_height   = canvas->base_height;
+	info->output_width  = canvas->output_width;
+	info->output_height = canvas->output_height;
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* rendering, called from the video thread */
+
+static inline void set_canvas_render_size(uint32_t width, uint32_t height)
+{
+	gs_enable_depthtest(false);
+	gs_enable_blending(false);
+	gs_setcullmode(GS_NEITHER);
+
+	gs_ortho(0.0f, (float)width, 0.0f, (float)height, -100.0f, 100.0f);
+	gs_setviewport(0, 0, width, height);
+}
+
+static void render_canvas_output(struct obs_canvas *canvas)
+{
+	effect_t    effect = obs->video.default_effect;
+	technique_t tech   = effect_gettechnique(effect, "Draw");
+	eparam_t    image  = effect_getparambyname(effect, "image");
+	size_t      passes, i;
+
+	gs_setrendertarget(canvas->output_texture, NULL);
+	set_canvas_render_size(canvas->output_width, canvas->output_height);
+
+	effect_settexture(effect, image, canvas->render_texture);
+
+	passes = technique_begin(tech);
+	for (i = 0; i < passes; i++) {
+		technique_beginpass(tech, i);
+		gs_draw_sprite(canvas->render_texture, 0,
+				canvas->output_width, canvas->output_height);
+		technique_endpass(tech);
+	}
+	technique_end(tech);
+}
+
+static void render_canvas(struct obs_canvas *canvas, uint64_t timestamp)
+{
+	int         cur    = canvas->cur_texture;
+	int         oldest = (cur + 1) % NUM_TEXTURES;
+	stagesurf_t copy   = canvas->copy_surfaces[cur];
+	stagesurf_t oldest_copy = canvas->copy_surfaces[oldest];
+	struct video_data frame;
+	struct vec4 clear_color;
+
+	if (canvas->mapped_surface) {
+		stagesurface_unmap(canvas->mapped_surface);
+		canvas->mapped_surface = NULL;
+	}
+
+	vec4_set(&clear_color, 0.0f, 0.0f, 0.0f, 1.0f);
+
+	gs_beginscene();
+
+	gs_setrendertarget(canvas->render_texture, NULL);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 1.0f, 0);
+
+	set_canvas_render_size(canvas->base_width, canvas->base_height);
+	obs_view_render(&canvas->view);
+
+	if (canvas->output_texture)
+		render_canvas_output(canvas);
+
+	gs_stage_texture(copy, canvas->output_texture ?
+			canvas->output_texture : canvas->render_texture);
+	canvas->textures_copied[cur]   = true;
+	canvas->copied_timestamps[cur] = timestamp;
+
+	gs_setrendertarget(NULL, NULL);
+	gs_enable_blending(true);
+
+	gs_endscene();
+
+	/* same as the main output, the frame staged a pipeline's depth ago
+	 * is output, so the map normally doesn't have to wait */
+	memset(&frame, 0, sizeof(frame));
+
+	if (canvas->textures_copied[oldest] &&
+	    stagesurface_map(oldest_copy, &frame.data[0],
+		    &frame.linesize[0])) {
+		canvas->mapped_surface = oldest_copy;
+		frame.timestamp = canvas->copied_timestamps[oldest];
+		video_output_swap_frame(canvas->video, &frame);
+	}
+
+	canvas->cur_texture = oldest;
+}
+
+static inline bool canvas_frame_due(struct obs_canvas *canvas,
+		uint64_t timestamp)
+{
+	if (timestamp < canvas->next_time)
+		return false;
+
+	/* don't try to catch up on frames that were missed */
+	canvas->next_time += canvas->frame_time;
+	if (canvas->next_time <= timestamp)
+		canvas->next_time = timestamp + canvas->frame_time;
+
+	return true;
+}
+
+void obs_render_canvases(uint64_t timestamp)
+{
+	struct obs_canvas *canvas;
+
+	pthread_mutex_lock(&obs->data.canvases_mutex);
+
+	canvas = obs->data.first_canvas;
+	while (canvas) {
+		/* only render canvases that something is connected to */
+		if (video_output_active(canvas->video) &&
+		    canvas_frame_due(canvas, timestamp))
+			render_canvas(canvas, timestamp);
+
+		canvas = canvas->next;
+	}
+
+	pthread_mutex_unlock(&obs->data.canvases_mutex);
+}
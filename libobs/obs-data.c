@@ -18,18 +18,27 @@
 #include "util/bmem.h"
 #include "util/threading.h"
 #include "util/darray.h"
+#include "util/dstr.h"
+#include "util/hash.h"
+#include "util/platform.h"
+#include "util/array-serializer.h"
 #include "graphics/vec2.h"
 #include "graphics/vec3.h"
 #include "graphics/vec4.h"
 #include "graphics/quat.h"
 #include "obs-data.h"
 
-#include <jansson.h>
+#include <errno.h>
+#include <locale.h>
+#include <math.h>
 
 struct obs_data_item {
 	volatile long        ref;
 	struct obs_data      *parent;
 	struct obs_data_item *next;
+	struct obs_data_item **prev_next;
+	struct obs_data_item *hash_next;
+	uint32_t             hash;
 	enum obs_data_type   type;
 	size_t               name_len;
 	size_t               data_len;
@@ -39,12 +48,21 @@ struct obs_data_item {
 struct obs_data {
 	volatile long        ref;
 	char                 *json;
+	DARRAY(uint8_t)      binary;
 	struct obs_data_item *first_item;
+	bool                 dirty;
+
+	/* hash index of the items, only built once there are enough items
+	 * for the linear search to become noticeable */
+	size_t               num_items;
+	size_t               num_buckets;
+	struct obs_data_item **buckets;
 };
 
 struct obs_data_array {
 	volatile long        ref;
 	DARRAY(obs_data_t)   objects;
+	bool                 dirty;
 };
 
 struct obs_data_number {
@@ -58,6 +76,9 @@ struct obs_data_number {
 /* ------------------------------------------------------------------------- */
 /* Item structure, designed to be one allocation only */
 
+#define HASH_INDEX_MIN_ITEMS 16
+#define HASH_INDEX_MIN_BUCKETS 32
+
 /* ensures data after the name has alignment (in case of SSE) */
 static inline size_t get_name_align_size(const char *name)
 {
@@ -142,6 +163,7 @@ static struct obs_data_item *obs_data_item_create(const char *name,
 
 	item->capacity = total_size;
 	item->type     = type;
+	item->hash     = hash_fnv1a(name);
 	item->name_len = name_size;
 	item->data_len = size;
 	item->ref      = 1;
@@ -153,56 +175,131 @@ static struct obs_data_item *obs_data_item_create(const char *name,
 	return item;
 }
 
-static struct obs_data_item **get_item_prev_next(struct obs_data *data,
-		struct obs_data_item *current)
+static inline struct obs_data_item **get_bucket(struct obs_data *data,
+		uint32_t hash)
 {
-	if (!current || !data)
-		return NULL;
+	return &data->buckets[hash & (data->num_buckets - 1)];
+}
 
-	struct obs_data_item **prev_next = &data->first_item;
-	struct obs_data_item *item       = data->first_item;
+static void hash_index_resize(struct obs_data *data, size_t num_buckets)
+{
+	struct obs_data_item *item = data->first_item;
+
+	bfree(data->buckets);
+	data->buckets     = bzalloc(num_buckets * sizeof(struct obs_data_item*));
+	data->num_buckets = num_buckets;
 
 	while (item) {
-		if (item == current)
-			return prev_next;
+		struct obs_data_item **bucket = get_bucket(data, item->hash);
+		item->hash_next = *bucket;
+		*bucket         = item;
 
-		prev_next = &item->next;
-		item      = item->next;
+		item = item->next;
 	}
+}
 
-	return NULL;
+static void hash_index_insert(struct obs_data *data, struct obs_data_item *item)
+{
+	struct obs_data_item **bucket;
+
+	if (!data->buckets) {
+		if (data->num_items > HASH_INDEX_MIN_ITEMS)
+			hash_index_resize(data, HASH_INDEX_MIN_BUCKETS);
+		return;
+
+	} else if (data->num_items > data->num_buckets) {
+		/* resizing also indexes the new item */
+		hash_index_resize(data, data->num_buckets * 2);
+		return;
+	}
+
+	bucket          = get_bucket(data, item->hash);
+	item->hash_next = *bucket;
+	*bucket         = item;
 }
 
-static inline void obs_data_item_detach(struct obs_data_item *item)
+/* replaces 'old_ptr' in its hash bucket with 'new_ptr' (or with the next item
+ * in the bucket if 'new_ptr' is NULL).  'old_ptr' may already be freed by a
+ * reallocation, so it's only compared against, never read from */
+static void hash_index_replace(struct obs_data *data, uint32_t hash,
+		struct obs_data_item *old_ptr, struct obs_data_item *new_ptr)
 {
-	struct obs_data_item **prev_next = get_item_prev_next(item->parent,
-			item);
+	struct obs_data_item **bucket;
+
+	if (!data->buckets)
+		return;
+
+	bucket = get_bucket(data, hash);
+	while (*bucket) {
+		if (*bucket == old_ptr) {
+			*bucket = new_ptr ? new_ptr : (*bucket)->hash_next;
+			break;
+		}
 
-	if (prev_next) {
-		*prev_next = item->next;
-		item->next = NULL;
+		bucket = &(*bucket)->hash_next;
 	}
 }
 
+static void obs_data_item_attach(struct obs_data *data,
+		struct obs_data_item *item)
+{
+	item->parent    = data;
+	item->prev_next = &data->first_item;
+	item->next      = data->first_item;
+	if (item->next)
+		item->next->prev_next = &item->next;
+	data->first_item = item;
+
+	data->num_items++;
+	hash_index_insert(data, item);
+}
+
+static inline void obs_data_item_detach(struct obs_data_item *item)
+{
+	if (!item->prev_next)
+		return;
+
+	*item->prev_next = item->next;
+	if (item->next)
+		item->next->prev_next = item->prev_next;
+
+	hash_index_replace(item->parent, item->hash, item, NULL);
+	item->parent->num_items--;
+
+	item->prev_next = NULL;
+	item->next      = NULL;
+	item->hash_next = NULL;
+}
+
 static inline void obs_data_item_reattach(struct obs_data_item *old_ptr,
 		struct obs_data_item *new_ptr)
 {
-	struct obs_data_item **prev_next = get_item_prev_next(new_ptr->parent,
-			old_ptr);
+	if (!new_ptr->prev_next)
+		return;
 
-	if (prev_next)
-		*prev_next = new_ptr;
+	*new_ptr->prev_next = new_ptr;
+	if (new_ptr->next)
+		new_ptr->next->prev_next = &new_ptr->next;
+
+	hash_index_replace(new_ptr->parent, new_ptr->hash, old_ptr,
+			new_ptr);
 }
 
 static struct obs_data_item *obs_data_item_ensure_capacity(
 		struct obs_data_item *item)
 {
 	size_t new_size = obs_data_item_total_size(item);
+	size_t min_grow = item->capacity + item->capacity / 2;
 	struct obs_data_item *new_item;
 
 	if (item->capacity >= new_size)
 		return item;
 
+	/* grow with some slack so that values which keep changing size (such
+	 * as strings being edited) don't reallocate on every change */
+	if (new_size < min_grow)
+		new_size = min_grow;
+
 	new_item = brealloc(item, new_size);
 	new_item->capacity = new_size;
 
@@ -217,6 +314,187 @@ static inline void obs_data_item_destroy(struct obs_data_item *item)
 	bfree(item);
 }
 
+/* ------------------------------------------------------------------------- */
+/* Change tracking
+ *
+ *   Each object and array only flags changes to its own values.  Objects can
+ * be shared by more than one parent, so instead of propagating the flag
+ * upward, checking a parent also checks its children.  When a child is stored
+ * in a parent, the parent's flag takes over for it, and setting a value that
+ * is equal to the current one doesn't count as a change.  This way things
+ * like save callbacks that rebuild the same values don't show up as changes.
+ */
+
+static bool data_equal(struct obs_data *a, struct obs_data *b);
+
+static bool array_equal(struct obs_data_array *a, struct obs_data_array *b)
+{
+	if (a == b)
+		return true;
+	if (!a || !b || a->objects.num != b->objects.num)
+		return false;
+
+	for (size_t i = 0; i < a->objects.num; i++)
+		if (!data_equal(a->objects.array[i], b->objects.array[i]))
+			return false;
+
+	return true;
+}
+
+static bool item_value_equal(struct obs_data_item *item, const void *data,
+		size_t size, enum obs_data_type type)
+{
+	const struct obs_data_number *num1, *num2;
+
+	if (item->type != type)
+		return false;
+
+	switch (type) {
+	case OBS_DATA_NULL:
+		return true;
+
+	case OBS_DATA_STRING:
+		return item->data_len == size &&
+		       memcmp(get_item_data(item), data, size) == 0;
+
+	case OBS_DATA_NUMBER:
+		num1 = get_item_data(item);
+		num2 = data;
+		if (num1->type != num2->type)
+			return false;
+		return num1->type == OBS_DATA_NUM_DOUBLE ?
+			num1->double_val == num2->double_val :
+			num1->int_val    == num2->int_val;
+
+	case OBS_DATA_BOOLEAN:
+		return *(bool*)get_item_data(item) == *(const bool*)data;
+
+	case OBS_DATA_OBJECT:
+		return data_equal(get_item_obj(item), *(obs_data_t*)data);
+
+	case OBS_DATA_ARRAY:
+		return array_equal(get_item_array(item),
+				*(obs_data_array_t*)data);
+	}
+
+	return false;
+}
+
+static struct obs_data_item *get_item(struct obs_data *data, const char *name);
+
+static bool data_equal(struct obs_data *a, struct obs_data *b)
+{
+	struct obs_data_item *item;
+
+	if (a == b)
+		return true;
+	if (!a || !b || a->num_items != b->num_items)
+		return false;
+
+	item = a->first_item;
+	while (item) {
+		struct obs_data_item *other = get_item(b, get_item_name(item));
+
+		if (!other || !item_value_equal(other, get_item_data(item),
+					item->data_len, item->type))
+			return false;
+
+		item = item->next;
+	}
+
+	return true;
+}
+
+static inline bool is_child_type(enum obs_data_type type)
+{
+	return type == OBS_DATA_OBJECT || type == OBS_DATA_ARRAY;
+}
+
+static bool array_is_dirty(struct obs_data_array *array);
+
+static bool item_is_dirty(struct obs_data_item *item)
+{
+	if (item->type == OBS_DATA_OBJECT)
+		return obs_data_is_dirty(get_item_obj(item));
+	else if (item->type == OBS_DATA_ARRAY)
+		return array_is_dirty(get_item_array(item));
+
+	return false;
+}
+
+static bool array_is_dirty(struct obs_data_array *array)
+{
+	if (!array)
+		return false;
+	if (array->dirty)
+		return true;
+
+	for (size_t i = 0; i < array->objects.num; i++)
+		if (obs_data_is_dirty(array->objects.array[i]))
+			return true;
+
+	return false;
+}
+
+static void array_clear_dirty(struct obs_data_array *array)
+{
+	if (!array)
+		return;
+
+	array->dirty = false;
+	for (size_t i = 0; i < array->objects.num; i++)
+		obs_data_clear_dirty(array->objects.array[i]);
+}
+
+static void child_clear_dirty(const void *data, enum obs_data_type type)
+{
+	if (type == OBS_DATA_OBJECT)
+		obs_data_clear_dirty(*(obs_data_t*)data);
+	else if (type == OBS_DATA_ARRAY)
+		array_clear_dirty(*(obs_data_array_t*)data);
+}
+
+bool obs_data_is_dirty(obs_data_t data)
+{
+	struct obs_data_item *item;
+
+	if (!data)
+		return false;
+	if (data->dirty)
+		return true;
+
+	item = data->first_item;
+	while (item) {
+		if (item_is_dirty(item))
+			return true;
+		item = item->next;
+	}
+
+	return false;
+}
+
+void obs_data_clear_dirty(obs_data_t data)
+{
+	struct obs_data_item *item;
+
+	if (!data)
+		return;
+
+	data->dirty = false;
+
+	item = data->first_item;
+	while (item) {
+		if (item->type == OBS_DATA_OBJECT)
+			obs_data_clear_dirty(get_item_obj(item));
+		else if (item->type == OBS_DATA_ARRAY)
+			array_clear_dirty(get_item_array(item));
+
+		item = item->next;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
 static inline void obs_data_item_setdata(
 		struct obs_data_item **p_item, const void *data, size_t size,
 		enum obs_data_type type)
@@ -225,6 +503,18 @@ static inline void obs_data_item_setdata(
 		return;
 
 	struct obs_data_item *item = *p_item;
+	bool changed;
+
+	if (is_child_type(type) && item->type == type &&
+	    *(void**)get_item_data(item) == *(void**)data)
+		/* storing the same child again counts its changes */
+		changed = item_is_dirty(item);
+	else
+		changed = !item_value_equal(item, data, size, type);
+
+	if (!changed && !is_child_type(type))
+		return;
+
 	item_data_release(item);
 
 	item->data_len = size;
@@ -234,164 +524,917 @@ static inline void obs_data_item_setdata(
 	if (size) {
 		memcpy(get_item_data(item), data, size);
 		item_data_addref(item);
+		child_clear_dirty(data, type);
 	}
 
+	if (changed && item->parent)
+		item->parent->dirty = true;
+
 	*p_item = item;
 }
 
 /* ------------------------------------------------------------------------- */
+/* JSON encoding
+ *
+ *   obs_data is written and read as JSON directly, without building a
+ * jansson tree in between.  The output is formatted the same as jansson's
+ * json_dumps with JSON_PRESERVE_ORDER | JSON_INDENT(4), and the parser
+ * accepts the same documents as json_loads with JSON_REJECT_DUPLICATES, so
+ * files look and load the same as before.
+ */
+
+#define JSON_INDENT    4
+#define JSON_MAX_DEPTH 128
 
-static void obs_data_add_json_item(obs_data_t data, const char *key,
-		json_t *json);
+static void write_json_object(struct dstr *out, struct obs_data *data,
+		int depth);
 
-static inline void obs_data_add_json_object_data(obs_data_t data, json_t *jobj)
+static inline void write_json_indent(struct dstr *out, int depth)
 {
-	const char *item_key;
-	json_t *jitem;
+	dstr_cat_ch(out, '\n');
+	for (int i = 0; i < depth * JSON_INDENT; i++)
+		dstr_cat_ch(out, ' ');
+}
+
+static void write_json_string(struct dstr *out, const char *str)
+{
+	const char *start = str;
+
+	dstr_cat_ch(out, '"');
 
-	json_object_foreach (jobj, item_key, jitem) {
-		obs_data_add_json_item(data, item_key, jitem);
+	for (; *str; str++) {
+		unsigned char ch = (unsigned char)*str;
+		const char    *esc;
+		char          seq[8];
+
+		if (ch != '"' && ch != '\\' && ch >= 0x20)
+			continue;
+
+		switch (ch) {
+		case '"':  esc = "\\\""; break;
+		case '\\': esc = "\\\\"; break;
+		case '\b': esc = "\\b";  break;
+		case '\f': esc = "\\f";  break;
+		case '\n': esc = "\\n";  break;
+		case '\r': esc = "\\r";  break;
+		case '\t': esc = "\\t";  break;
+		default:
+			snprintf(seq, sizeof(seq), "\\u%04X", ch);
+			esc = seq;
+		}
+
+		dstr_ncat(out, start, str - start);
+		dstr_cat(out, esc);
+		start = str + 1;
 	}
+
+	dstr_ncat(out, start, str - start);
+	dstr_cat_ch(out, '"');
 }
 
-static inline void obs_data_add_json_object(obs_data_t data, const char *key,
-		json_t *jobj)
+/* same as jansson: always has a '.' or an exponent so it's read back as a
+ * double, and the exponent has no '+' or leading zeros */
+static void write_json_double(struct dstr *out, double val)
 {
-	obs_data_t sub_obj = obs_data_create();
+	char buf[64];
+	char *exp, *digits, *end;
+	char *point = localeconv()->decimal_point;
+
+	snprintf(buf, sizeof(buf), "%.17g", val);
+
+	if (*point != '.') {
+		char *pos = strchr(buf, *point);
+		if (pos)
+			*pos = '.';
+	}
+
+	if (!strchr(buf, '.') && !strchr(buf, 'e'))
+		strcat(buf, ".0");
+
+	exp = strchr(buf, 'e');
+	if (exp) {
+		digits = exp + 1;
+		if (*digits == '-')
+			digits++;
 
-	obs_data_add_json_object_data(sub_obj, jobj);
-	obs_data_setobj(data, key, sub_obj);
-	obs_data_release(sub_obj);
+		end = digits;
+		while (*end == '+' || *end == '0')
+			end++;
+
+		memmove(digits, end, strlen(end) + 1);
+	}
+
+	dstr_cat(out, buf);
 }
 
-static void obs_data_add_json_array(obs_data_t data, const char *key,
-		json_t *jarray)
+static bool write_json_value(struct dstr *out, struct obs_data_item *item,
+		int depth)
 {
-	obs_data_array_t array = obs_data_array_create();
-	size_t idx;
-	json_t *jitem;
+	struct obs_data_number *num;
+	struct obs_data_array  *array;
+
+	switch (item->type) {
+	case OBS_DATA_STRING:
+		write_json_string(out, get_item_data(item));
+		return true;
+
+	case OBS_DATA_NUMBER:
+		num = get_item_data(item);
+		if (num->type == OBS_DATA_NUM_INT)
+			dstr_catf(out, "%lld", num->int_val);
+		else
+			write_json_double(out, num->double_val);
+		return true;
+
+	case OBS_DATA_BOOLEAN:
+		dstr_cat(out, *(bool*)get_item_data(item) ? "true" : "false");
+		return true;
+
+	case OBS_DATA_OBJECT:
+		write_json_object(out, get_item_obj(item), depth);
+		return true;
+
+	case OBS_DATA_ARRAY:
+		array = get_item_array(item);
+		if (!array || !array->objects.num) {
+			dstr_cat(out, "[]");
+			return true;
+		}
 
-	json_array_foreach (jarray, idx, jitem) {
-		obs_data_t item;
+		dstr_cat_ch(out, '[');
+		for (size_t i = 0; i < array->objects.num; i++) {
+			if (i)
+				dstr_cat_ch(out, ',');
+			write_json_indent(out, depth + 1);
+			write_json_object(out, array->objects.array[i],
+					depth + 1);
+		}
+		write_json_indent(out, depth);
+		dstr_cat_ch(out, ']');
+		return true;
 
-		if (!json_is_object(jitem))
+	case OBS_DATA_NULL:
+		break;
+	}
+
+	return false;
+}
+
+/* jansson can't store these, so they were never saved */
+static inline bool json_writable(struct obs_data_item *item)
+{
+	struct obs_data_number *num;
+
+	if (item->type == OBS_DATA_NULL)
+		return false;
+	if (item->type != OBS_DATA_NUMBER)
+		return true;
+
+	num = get_item_data(item);
+	return num->type == OBS_DATA_NUM_INT || isfinite(num->double_val);
+}
+
+static void write_json_object(struct dstr *out, struct obs_data *data,
+		int depth)
+{
+	struct obs_data_item *item = data ? data->first_item : NULL;
+	bool first = true;
+
+	for (; item; item = item->next) {
+		if (!json_writable(item))
 			continue;
 
-		item = obs_data_create();
-		obs_data_add_json_object_data(item, jitem);
-		obs_data_array_push_back(array, item);
-		obs_data_release(item);
+		dstr_cat_ch(out, first ? '{' : ',');
+		write_json_indent(out, depth + 1);
+		write_json_string(out, get_item_name(item));
+		dstr_cat(out, ": ");
+		write_json_value(out, item, depth + 1);
+		first = false;
 	}
 
-	obs_data_setarray(data, key, array);
+	if (first) {
+		dstr_cat(out, "{}");
+	} else {
+		write_json_indent(out, depth);
+		dstr_cat_ch(out, '}');
+	}
+}
+
+struct json_reader {
+	const char  *pos;
+	const char  *line_start;
+	int         line;
+	int         depth;
+	const char  *error;
+
+	/* keys and strings are decoded in to these, and only copied when
+	 * they're stored */
+	struct dstr key;
+	struct dstr str;
+};
+
+static inline bool json_fail(struct json_reader *r, const char *error)
+{
+	if (!r->error)
+		r->error = error;
+	return false;
+}
+
+static inline void skip_json_ws(struct json_reader *r)
+{
+	for (;;) {
+		char ch = *r->pos;
+
+		if (ch == '\n') {
+			r->line++;
+			r->line_start = r->pos + 1;
+		} else if (ch != ' ' && ch != '\t' && ch != '\r') {
+			break;
+		}
+
+		r->pos++;
+	}
+}
+
+static inline bool read_json_ch(struct json_reader *r, char ch)
+{
+	skip_json_ws(r);
+	if (*r->pos != ch)
+		return false;
+
+	r->pos++;
+	return true;
+}
+
+static inline int json_hex_val(char ch)
+{
+	if (ch >= '0' && ch <= '9') return ch - '0';
+	if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+	if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+	return -1;
+}
+
+static bool read_json_hex4(struct json_reader *r, uint32_t *val)
+{
+	*val = 0;
+
+	for (int i = 0; i < 4; i++) {
+		int digit = json_hex_val(r->pos[i]);
+		if (digit < 0)
+			return json_fail(r, "invalid escape");
+		*val = (*val << 4) | (uint32_t)digit;
+	}
+
+	r->pos += 4;
+	return true;
+}
+
+static void cat_utf8(struct dstr *dst, uint32_t cp)
+{
+	char buf[4];
+	size_t len;
+
+	if (cp < 0x80) {
+		buf[0] = (char)cp;
+		len = 1;
+	} else if (cp < 0x800) {
+		buf[0] = (char)(0xC0 | (cp >> 6));
+		buf[1] = (char)(0x80 | (cp & 0x3F));
+		len = 2;
+	} else if (cp < 0x10000) {
+		buf[0] = (char)(0xE0 | (cp >> 12));
+		buf[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+		buf[2] = (char)(0x80 | (cp & 0x3F));
+		len = 3;
+	} else {
+		buf[0] = (char)(0xF0 | (cp >> 18));
+		buf[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+		buf[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+		buf[3] = (char)(0x80 | (cp & 0x3F));
+		len = 4;
+	}
+
+	dstr_ncat(dst, buf, len);
+}
+
+static bool read_json_unicode(struct json_reader *r, struct dstr *dst)
+{
+	uint32_t cp, low;
+
+	if (!read_json_hex4(r, &cp))
+		return false;
+
+	if (cp >= 0xDC00 && cp <= 0xDFFF)
+		return json_fail(r, "invalid Unicode surrogate");
+
+	if (cp >= 0xD800 && cp <= 0xDBFF) {
+		if (r->pos[0] != '\\' || r->pos[1] != 'u')
+			return json_fail(r, "invalid Unicode surrogate");
+
+		r->pos += 2;
+		if (!read_json_hex4(r, &low))
+			return false;
+		if (low < 0xDC00 || low > 0xDFFF)
+			return json_fail(r, "invalid Unicode surrogate");
+
+		cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+	}
+
+	if (cp == 0)
+		return json_fail(r, "\\u0000 is not allowed");
+
+	cat_utf8(dst, cp);
+	return true;
+}
+
+static bool read_json_string(struct json_reader *r, struct dstr *dst)
+{
+	const char *start;
+
+	dstr_resize(dst, 0);
+
+	if (!read_json_ch(r, '"'))
+		return json_fail(r, "expected a string");
+
+	start = r->pos;
+
+	for (;;) {
+		unsigned char ch = (unsigned char)*r->pos;
+
+		if (ch == '"' || ch == '\\' || ch < 0x20)
+			dstr_ncat(dst, start, r->pos - start);
+
+		if (ch == '"') {
+			r->pos++;
+			break;
+		} else if (ch < 0x20) {
+			return json_fail(r, ch ? "control character in string"
+			                       : "unterminated string");
+		} else if (ch == '\\') {
+			char esc = r->pos[1];
+			r->pos += 2;
+
+			switch (esc) {
+			case '"':  dstr_cat_ch(dst, '"');  break;
+			case '\\': dstr_cat_ch(dst, '\\'); break;
+			case '/':  dstr_cat_ch(dst, '/');  break;
+			case 'b':  dstr_cat_ch(dst, '\b'); break;
+			case 'f':  dstr_cat_ch(dst, '\f'); break;
+			case 'n':  dstr_cat_ch(dst, '\n'); break;
+			case 'r':  dstr_cat_ch(dst, '\r'); break;
+			case 't':  dstr_cat_ch(dst, '\t'); break;
+			case 'u':
+				if (!read_json_unicode(r, dst))
+					return false;
+				break;
+			default:
+				return json_fail(r, "invalid escape");
+			}
+
+			start = r->pos;
+		} else {
+			r->pos++;
+		}
+	}
+
+	/* an empty dstr has no array */
+	if (!dst->array)
+		dstr_copy(dst, "");
+	return true;
+}
+
+static bool read_json_number(struct json_reader *r, obs_data_t data,
+		const char *key)
+{
+	const char *start = r->pos;
+	const char *pos   = r->pos;
+	bool       is_real = false;
+	char       buf[64];
+	char       *end;
+	char       *point;
+
+	if (*pos == '-')
+		pos++;
+
+	if (*pos == '0') {
+		pos++;
+	} else if (*pos >= '1' && *pos <= '9') {
+		while (*pos >= '0' && *pos <= '9') pos++;
+	} else {
+		return json_fail(r, "invalid token");
+	}
+
+	if (*pos == '.') {
+		is_real = true;
+		pos++;
+		if (*pos < '0' || *pos > '9')
+			return json_fail(r, "invalid real number");
+		while (*pos >= '0' && *pos <= '9') pos++;
+	}
+
+	if (*pos == 'e' || *pos == 'E') {
+		is_real = true;
+		pos++;
+		if (*pos == '+' || *pos == '-')
+			pos++;
+		if (*pos < '0' || *pos > '9')
+			return json_fail(r, "invalid real number");
+		while (*pos >= '0' && *pos <= '9') pos++;
+	}
+
+	if ((size_t)(pos - start) >= sizeof(buf))
+		return json_fail(r, "number too long");
+
+	memcpy(buf, start, pos - start);
+	buf[pos - start] = 0;
+	r->pos = pos;
+
+	if (!is_real) {
+		long long val;
+
+		errno = 0;
+		val = strtoll(buf, &end, 10);
+		if (errno == ERANGE)
+			return json_fail(r, "too big integer");
+
+		obs_data_setint(data, key, val);
+		return true;
+	}
+
+	/* strtod expects the decimal point of the current locale */
+	point = localeconv()->decimal_point;
+	if (*point != '.') {
+		char *dot = strchr(buf, '.');
+		if (dot)
+			*dot = *point;
+	}
+
+	errno = 0;
+	obs_data_setdouble(data, key, strtod(buf, &end));
+	if (errno == ERANGE)
+		return json_fail(r, "real number overflow");
+	return true;
+}
+
+static inline bool read_json_literal(struct json_reader *r, const char *lit)
+{
+	size_t len = strlen(lit);
+
+	if (strncmp(r->pos, lit, len) != 0)
+		return json_fail(r, "invalid token");
+
+	r->pos += len;
+	return true;
+}
+
+static bool read_json_object_items(struct json_reader *r, obs_data_t data);
+static bool read_json_value(struct json_reader *r, obs_data_t data,
+		const char *key);
+
+static obs_data_t read_json_object(struct json_reader *r)
+{
+	obs_data_t obj = obs_data_create();
+
+	if (!read_json_object_items(r, obj)) {
+		obs_data_release(obj);
+		return NULL;
+	}
+
+	return obj;
+}
+
+/* only objects can be stored in arrays, anything else is skipped */
+static bool read_json_array(struct json_reader *r, obs_data_t data,
+		const char *key)
+{
+	obs_data_array_t array = obs_data_array_create();
+	obs_data_t       skip  = NULL;
+	bool             success = true;
+
+	r->pos++;
+
+	if (read_json_ch(r, ']'))
+		goto done;
+
+	do {
+		skip_json_ws(r);
+
+		if (*r->pos == '{') {
+			obs_data_t obj = read_json_object(r);
+			if (!obj) {
+				success = false;
+				break;
+			}
+
+			obs_data_array_push_back(array, obj);
+			obs_data_release(obj);
+		} else {
+			if (!skip)
+				skip = obs_data_create();
+			if (!read_json_value(r, skip, "")) {
+				success = false;
+				break;
+			}
+		}
+	} while (read_json_ch(r, ','));
+
+	if (success && !read_json_ch(r, ']'))
+		success = json_fail(r, "']' expected");
+
+done:
+	if (success)
+		obs_data_setarray(data, key, array);
+
+	obs_data_release(skip);
 	obs_data_array_release(array);
+	return success;
 }
 
-static void obs_data_add_json_item(obs_data_t data, const char *key,
-		json_t *json)
-{
-	if (json_is_object(json))
-		obs_data_add_json_object(data, key, json);
-	else if (json_is_array(json))
-		obs_data_add_json_array(data, key, json);
-	else if (json_is_string(json))
-		obs_data_setstring(data, key, json_string_value(json));
-	else if (json_is_integer(json))
-		obs_data_setint(data, key, json_integer_value(json));
-	else if (json_is_real(json))
-		obs_data_setdouble(data, key, json_real_value(json));
-	else if (json_is_true(json))
+static bool read_json_value(struct json_reader *r, obs_data_t data,
+		const char *key)
+{
+	obs_data_t obj;
+	char       *key_copy;
+	bool       success;
+
+	skip_json_ws(r);
+
+	switch (*r->pos) {
+	case '"':
+		if (!read_json_string(r, &r->str))
+			return false;
+		obs_data_setstring(data, key, r->str.array);
+		return true;
+
+	case '{':
+		/* the key buffer is reused by the items of the object */
+		key_copy = bstrdup(key);
+		obj      = read_json_object(r);
+		if (obj) {
+			obs_data_setobj(data, key_copy, obj);
+			obs_data_release(obj);
+		}
+		bfree(key_copy);
+		return obj != NULL;
+
+	case '[':
+		key_copy = bstrdup(key);
+		success  = read_json_array(r, data, key_copy);
+		bfree(key_copy);
+		return success;
+
+	case 't':
+		if (!read_json_literal(r, "true"))
+			return false;
 		obs_data_setbool(data, key, true);
-	else if (json_is_false(json))
+		return true;
+
+	case 'f':
+		if (!read_json_literal(r, "false"))
+			return false;
 		obs_data_setbool(data, key, false);
+		return true;
+
+	case 'n':
+		return read_json_literal(r, "null");
+	}
+
+	return read_json_number(r, data, key);
+}
+
+static bool read_json_object_items(struct json_reader *r, obs_data_t data)
+{
+	bool success = true;
+
+	if (++r->depth > JSON_MAX_DEPTH)
+		return json_fail(r, "maximum nesting depth exceeded");
+
+	if (!read_json_ch(r, '{'))
+		return json_fail(r, "'{' expected");
+
+	if (read_json_ch(r, '}'))
+		goto done;
+
+	do {
+		if (!read_json_string(r, &r->key)) {
+			success = false;
+			break;
+		}
+
+		if (get_item(data, r->key.array)) {
+			success = json_fail(r, "duplicate object key");
+			break;
+		}
+
+		if (!read_json_ch(r, ':')) {
+			success = json_fail(r, "':' expected");
+			break;
+		}
+
+		if (!read_json_value(r, data, r->key.array)) {
+			success = false;
+			break;
+		}
+	} while (read_json_ch(r, ','));
+
+	if (success && !read_json_ch(r, '}'))
+		success = json_fail(r, "'}' expected");
+
+done:
+	r->depth--;
+	return success;
+}
+
+static bool read_json(obs_data_t data, const char *json_string, int *line,
+		const char **error)
+{
+	struct json_reader r = {0};
+	bool success;
+
+	r.pos        = json_string;
+	r.line_start = json_string;
+	r.line       = 1;
+
+	success = read_json_object_items(&r, data);
+	if (success) {
+		skip_json_ws(&r);
+		if (*r.pos)
+			success = json_fail(&r, "end of file expected");
+	}
+
+	*line  = r.line;
+	*error = r.error;
+
+	dstr_free(&r.key);
+	dstr_free(&r.str);
+	return success;
 }
 
 /* ------------------------------------------------------------------------- */
+/* Binary encoding
+ *
+ *   All values are little endian and strings are stored with their null
+ * terminator, so a file can be decoded straight from a read-only mapping
+ * without first being copied or parsed in to an intermediate form.
+ *
+ *   header:  "OBSD", u32 version, u64 size of the root object
+ *   object:  u32 item count, items
+ *   item:    u8 type, u32 name length, name + '\0', value
+ *   value:   string  - u32 length, string + '\0'
+ *            number  - u8 number type, i64 or double
+ *            boolean - u8
+ *            object  - object
+ *            array   - u32 object count, objects
+ */
+
+#define BINARY_MAGIC     "OBSD"
+#define BINARY_VERSION   1
+#define BINARY_MAX_DEPTH 128
 
-static inline void set_json_string(json_t *json, const char *name,
-		obs_data_item_t item)
+static void write_binary_object(struct serializer *s, struct obs_data *data);
+
+static inline void write_binary_string(struct serializer *s, const char *str)
 {
-	const char *val = obs_data_item_getstring(item);
-	json_object_set_new(json, name, json_string(val));
+	size_t len = strlen(str);
+
+	s_wl32(s, (uint32_t)len);
+	s_write(s, str, len + 1);
 }
 
-static inline void set_json_number(json_t *json, const char *name,
-		obs_data_item_t item)
+static void write_binary_array(struct serializer *s,
+		struct obs_data_array *array)
 {
-	enum obs_data_number_type type = obs_data_item_numtype(item);
+	size_t count = array ? array->objects.num : 0;
 
-	if (type == OBS_DATA_NUM_INT) {
-		long long val = obs_data_item_getint(item);
-		json_object_set_new(json, name, json_integer(val));
-	} else {
-		double val = obs_data_item_getdouble(item);
-		json_object_set_new(json, name, json_real(val));
+	s_wl32(s, (uint32_t)count);
+	for (size_t i = 0; i < count; i++)
+		write_binary_object(s, array->objects.array[i]);
+}
+
+static void write_binary_item(struct serializer *s, struct obs_data_item *item)
+{
+	struct obs_data_number *num;
+
+	s_w8(s, (uint8_t)item->type);
+	write_binary_string(s, get_item_name(item));
+
+	switch (item->type) {
+	case OBS_DATA_NULL:
+		break;
+
+	case OBS_DATA_STRING:
+		write_binary_string(s, get_item_data(item));
+		break;
+
+	case OBS_DATA_NUMBER:
+		num = get_item_data(item);
+		s_w8(s, (uint8_t)num->type);
+		if (num->type == OBS_DATA_NUM_DOUBLE)
+			s_wld(s, num->double_val);
+		else
+			s_wl64(s, (uint64_t)num->int_val);
+		break;
+
+	case OBS_DATA_BOOLEAN:
+		s_w8(s, *(bool*)get_item_data(item) ? 1 : 0);
+		break;
+
+	case OBS_DATA_OBJECT:
+		write_binary_object(s, get_item_obj(item));
+		break;
+
+	case OBS_DATA_ARRAY:
+		write_binary_array(s, get_item_array(item));
+		break;
+	}
+}
+
+static void write_binary_object(struct serializer *s, struct obs_data *data)
+{
+	struct obs_data_item *item = data ? data->first_item : NULL;
+
+	s_wl32(s, data ? (uint32_t)data->num_items : 0);
+
+	while (item) {
+		write_binary_item(s, item);
+		item = item->next;
 	}
 }
 
-static inline void set_json_bool(json_t *json, const char *name,
-		obs_data_item_t item)
+struct binary_reader {
+	const uint8_t *data;
+	size_t        size;
+	size_t        pos;
+	int           depth;
+	bool          error;
+};
+
+static inline bool binary_has(struct binary_reader *r, size_t size)
 {
-	bool val = obs_data_item_getbool(item);
-	json_object_set_new(json, name, val ? json_true() : json_false());
+	if (r->error || size > r->size - r->pos) {
+		r->error = true;
+		return false;
+	}
+
+	return true;
 }
 
-static json_t *obs_data_to_json(obs_data_t data);
+static inline uint64_t read_binary_le(struct binary_reader *r, size_t size)
+{
+	uint64_t val = 0;
 
-static inline void set_json_obj(json_t *json, const char *name,
-		obs_data_item_t item)
+	if (!binary_has(r, size))
+		return 0;
+
+	for (size_t i = 0; i < size; i++)
+		val |= (uint64_t)r->data[r->pos + i] << (i * 8);
+
+	r->pos += size;
+	return val;
+}
+
+static inline uint8_t read_binary_u8(struct binary_reader *r)
 {
-	obs_data_t obj = obs_data_item_getobj(item);
-	json_object_set_new(json, name, obs_data_to_json(obj));
-	obs_data_release(obj);
+	return (uint8_t)read_binary_le(r, 1);
 }
 
-static inline void set_json_array(json_t *json, const char *name,
-		obs_data_item_t item)
+static inline uint32_t read_binary_u32(struct binary_reader *r)
 {
-	json_t           *jarray = json_array();
-	obs_data_array_t array   = obs_data_item_getarray(item);
-	size_t           count   = obs_data_array_count(array);
+	return (uint32_t)read_binary_le(r, 4);
+}
 
-	for (size_t idx = 0; idx < count; idx++) {
-		obs_data_t sub_item = obs_data_array_item(array, idx);
-		json_t     *jitem   = obs_data_to_json(sub_item);
-		json_array_append_new(jarray, jitem);
-		obs_data_release(sub_item);
+static inline uint64_t read_binary_u64(struct binary_reader *r)
+{
+	return read_binary_le(r, 8);
+}
+
+/* returns a pointer directly in to the source data */
+static const char *read_binary_string(struct binary_reader *r)
+{
+	size_t len = read_binary_u32(r);
+	const char *str;
+
+	if (!binary_has(r, len + 1))
+		return NULL;
+
+	str = (const char*)r->data + r->pos;
+	if (str[len] != 0) {
+		r->error = true;
+		return NULL;
 	}
 
-	json_object_set_new(json, name, jarray);
-	obs_data_array_release(array);
+	r->pos += len + 1;
+	return str;
 }
 
-static json_t *obs_data_to_json(obs_data_t data)
+static obs_data_t read_binary_object(struct binary_reader *r);
+
+static obs_data_array_t read_binary_array(struct binary_reader *r)
 {
-	json_t *json = json_object();
-	obs_data_item_t item = obs_data_first(data);
+	obs_data_array_t array = obs_data_array_create();
+	uint32_t count = read_binary_u32(r);
 
-	while (item) {
-		enum obs_data_type type = obs_data_item_gettype(item);
-		const char *name        = get_item_name(item);
-
-		if (type == OBS_DATA_STRING)
-			set_json_string(json, name, item);
-		else if (type == OBS_DATA_NUMBER)
-			set_json_number(json, name, item);
-		else if (type == OBS_DATA_BOOLEAN)
-			set_json_bool(json, name, item);
-		else if (type == OBS_DATA_OBJECT)
-			set_json_obj(json, name, item);
-		else if (type == OBS_DATA_ARRAY)
-			set_json_array(json, name, item);
-
-		obs_data_item_next(&item);
+	for (uint32_t i = 0; i < count && !r->error; i++) {
+		obs_data_t obj = read_binary_object(r);
+		if (obj) {
+			obs_data_array_push_back(array, obj);
+			obs_data_release(obj);
+		}
 	}
 
-	return json;
+	return array;
+}
+
+static void read_binary_number(struct binary_reader *r, obs_data_t data,
+		const char *name)
+{
+	uint8_t  type = read_binary_u8(r);
+	uint64_t val  = read_binary_u64(r);
+
+	if (r->error)
+		return;
+
+	if (type == OBS_DATA_NUM_DOUBLE) {
+		double d;
+		memcpy(&d, &val, sizeof(d));
+		obs_data_setdouble(data, name, d);
+	} else {
+		obs_data_setint(data, name, (long long)val);
+	}
+}
+
+static void read_binary_item(struct binary_reader *r, obs_data_t data)
+{
+	uint8_t    type = read_binary_u8(r);
+	const char *name = read_binary_string(r);
+	const char *str;
+	obs_data_t obj;
+	obs_data_array_t array;
+
+	if (r->error)
+		return;
+
+	switch (type) {
+	case OBS_DATA_NULL:
+		break;
+
+	case OBS_DATA_STRING:
+		str = read_binary_string(r);
+		if (str)
+			obs_data_setstring(data, name, str);
+		break;
+
+	case OBS_DATA_NUMBER:
+		read_binary_number(r, data, name);
+		break;
+
+	case OBS_DATA_BOOLEAN:
+		obs_data_setbool(data, name, read_binary_u8(r) != 0);
+		break;
+
+	case OBS_DATA_OBJECT:
+		obj = read_binary_object(r);
+		if (obj) {
+			obs_data_setobj(data, name, obj);
+			obs_data_release(obj);
+		}
+		break;
+
+	case OBS_DATA_ARRAY:
+		array = read_binary_array(r);
+		obs_data_setarray(data, name, array);
+		obs_data_array_release(array);
+		break;
+
+	default:
+		r->error = true;
+	}
+}
+
+static obs_data_t read_binary_object(struct binary_reader *r)
+{
+	obs_data_t data;
+	uint32_t   count;
+
+	if (++r->depth > BINARY_MAX_DEPTH) {
+		r->error = true;
+		return NULL;
+	}
+
+	data  = obs_data_create();
+	count = read_binary_u32(r);
+
+	for (uint32_t i = 0; i < count && !r->error; i++)
+		read_binary_item(r, data);
+
+	r->depth--;
+	return data;
 }
 
 /* ------------------------------------------------------------------------- */
 
+/* ------------------------------------------------------------------------- */
+
 obs_data_t obs_data_create()
 {
 	struct obs_data *data = bzalloc(sizeof(struct obs_data));
@@ -403,17 +1446,21 @@ obs_data_t obs_data_create()
 obs_data_t obs_data_create_from_json(const char *json_string)
 {
 	obs_data_t data = obs_data_create();
+	const char *error;
+	int line;
 
-	json_error_t error;
-	json_t *root = json_loads(json_string, JSON_REJECT_DUPLICATES, &error);
+	if (!json_string)
+		json_string = "";
 
-	if (root) {
-		obs_data_add_json_object_data(data, root);
-		json_decref(root);
-	} else {
+	/* a document that fails to parse leaves nothing behind, the same
+	 * as when it was loaded with jansson first */
+	if (!read_json(data, json_string, &line, &error)) {
 		blog(LOG_ERROR, "obs-data.c: [obs_data_create_from_json] "
 		                "Failed reading json string (%d): %s",
-		                error.line, error.text);
+		                line, error);
+
+		obs_data_release(data);
+		data = obs_data_create();
 	}
 
 	return data;
@@ -431,12 +1478,20 @@ static inline void obs_data_destroy(struct obs_data *data)
 
 	while (item) {
 		struct obs_data_item *next = item->next;
+
+		/* items can still be referenced after their parent is gone */
+		item->parent    = NULL;
+		item->prev_next = NULL;
+		item->next      = NULL;
+		item->hash_next = NULL;
+
 		obs_data_item_release(&item);
 		item = next;
 	}
 
-	/* NOTE: don't use bfree for json text, allocated by json */
-	free(data->json);
+	bfree(data->json);
+	da_free(data->binary);
+	bfree(data->buckets);
 	bfree(data);
 }
 
@@ -452,28 +1507,149 @@ const char *obs_data_getjson(obs_data_t data)
 {
 	if (!data) return NULL;
 
-	/* NOTE: don't use libobs bfree for json text */
-	free(data->json);
-	data->json = NULL;
+	struct dstr json = {0};
 
-	json_t *root = obs_data_to_json(data);
-	data->json = json_dumps(root, JSON_PRESERVE_ORDER | JSON_INDENT(4));
-	json_decref(root);
+	write_json_object(&json, data, 0);
+
+	bfree(data->json);
+	data->json = json.array;
 
 	return data->json;
 }
 
+const void *obs_data_getbinary(obs_data_t data, size_t *size)
+{
+	struct array_output_data output;
+	struct serializer s;
+	size_t body_start;
+
+	if (!data || !size) return NULL;
+
+	array_output_serializer_init(&s, &output);
+
+	s_write(&s, BINARY_MAGIC, 4);
+	s_wl32(&s, BINARY_VERSION);
+	s_wl64(&s, 0);
+
+	body_start = output.bytes.num;
+	write_binary_object(&s, data);
+
+	/* fill in the size of the root object now that it's known */
+	for (size_t i = 0; i < 8; i++)
+		output.bytes.array[8 + i] = (uint8_t)(
+			(uint64_t)(output.bytes.num - body_start) >> (i * 8));
+
+	da_free(data->binary);
+	data->binary.array    = output.bytes.array;
+	data->binary.num      = output.bytes.num;
+	data->binary.capacity = output.bytes.capacity;
+
+	*size = data->binary.num;
+	return data->binary.array;
+}
+
+obs_data_t obs_data_create_from_binary(const void *data, size_t size)
+{
+	struct binary_reader r = {data, size, 0, 0, false};
+	obs_data_t obj;
+	uint32_t   version;
+	uint64_t   body_size;
+
+	if (!data || size < 16 || memcmp(data, BINARY_MAGIC, 4) != 0) {
+		blog(LOG_ERROR, "obs-data.c: [obs_data_create_from_binary] "
+		                "Invalid data");
+		return NULL;
+	}
+
+	r.pos     = 4;
+	version   = read_binary_u32(&r);
+	body_size = read_binary_u64(&r);
+
+	if (version != BINARY_VERSION) {
+		blog(LOG_ERROR, "obs-data.c: [obs_data_create_from_binary] "
+		                "Unsupported version %u", version);
+		return NULL;
+	}
+
+	if (body_size != (uint64_t)(size - r.pos)) {
+		blog(LOG_ERROR, "obs-data.c: [obs_data_create_from_binary] "
+		                "Data is truncated");
+		return NULL;
+	}
+
+	obj = read_binary_object(&r);
+	if (r.error) {
+		blog(LOG_ERROR, "obs-data.c: [obs_data_create_from_binary] "
+		                "Data is corrupt");
+		obs_data_release(obj);
+		return NULL;
+	}
+
+	return obj;
+}
+
+obs_data_t obs_data_create_from_binary_file(const char *path)
+{
+	obs_data_t data;
+	size_t     size;
+	void       *map = os_map_file(path, &size);
+
+	if (!map)
+		return NULL;
+
+	data = obs_data_create_from_binary(map, size);
+	os_unmap_file(map, size);
+	return data;
+}
+
+bool obs_data_save_binary_file(obs_data_t data, const char *path)
+{
+	const void *binary;
+	size_t     size = 0;
+	bool       success;
+	FILE       *f;
+
+	binary = obs_data_getbinary(data, &size);
+	if (!binary || !path)
+		return false;
+
+	f = os_fopen(path, "wb");
+	if (!f)
+		return false;
+
+	success = fwrite(binary, 1, size, f) == size;
+	fclose(f);
+	return success;
+}
+
 static struct obs_data_item *get_item(struct obs_data *data, const char *name)
 {
-	if (!data) return NULL;
+	if (!data || !name) return NULL;
 
-	struct obs_data_item *item = data->first_item;
+	uint32_t hash = hash_fnv1a(name);
+	struct obs_data_item *item;
 
-	while (item) {
-		if (strcmp(get_item_name(item), name) == 0)
-			return item;
+	if (data->buckets) {
+		item = *get_bucket(data, hash);
 
-		item = item->next;
+		while (item) {
+			if (item->hash == hash &&
+			    strcmp(get_item_name(item), name) == 0)
+				return item;
+
+			item = item->hash_next;
+		}
+
+	} else {
+		item = data->first_item;
+
+		while (item) {
+			if (item->hash == hash &&
+			    strcmp(get_item_name(item), name) == 0)
+				return item;
+
+			item = item->next;
+		}
 	}
 
 	return NULL;
@@ -495,10 +1671,11 @@ static void set_item_data(struct obs_data *data, struct obs_data_item *item,
 {
 	if (!item) {
 		item = obs_data_item_create(name, ptr, size, type);
-		item->next = data->first_item;
-		item->parent = data;
-
-		data->first_item = item;
+		if (item) {
+			obs_data_item_attach(data, item);
+			child_clear_dirty(ptr, type);
+			data->dirty = true;
+		}
 
 	} else {
 		obs_data_item_setdata(&item, ptr, size, type);
@@ -551,11 +1728,60 @@ void obs_data_apply(obs_data_t target, obs_data_t apply_data)
 	}
 }
 
+static obs_data_array_t copy_array(obs_data_array_t array)
+{
+	obs_data_array_t copy = obs_data_array_create();
+
+	for (size_t i = 0; i < array->objects.num; i++) {
+		obs_data_t obj = obs_data_create_copy(array->objects.array[i]);
+		obs_data_array_push_back(copy, obj);
+		obs_data_release(obj);
+	}
+
+	return copy;
+}
+
+obs_data_t obs_data_create_copy(obs_data_t data)
+{
+	struct obs_data_item *item;
+	obs_data_t           copy;
+
+	if (!data)
+		return NULL;
+
+	copy = obs_data_create();
+
+	for (item = data->first_item; item; item = item->next) {
+		const char       *name = get_item_name(item);
+		obs_data_t       obj;
+		obs_data_array_t array;
+
+		if (item->type == OBS_DATA_OBJECT) {
+			obj = obs_data_create_copy(get_item_obj(item));
+			obs_data_setobj(copy, name, obj);
+			obs_data_release(obj);
+
+		} else if (item->type == OBS_DATA_ARRAY) {
+			array = get_item_array(item);
+			array = array ? copy_array(array) : NULL;
+			obs_data_setarray(copy, name, array);
+			obs_data_array_release(array);
+
+		} else {
+			copy_item(copy, item);
+		}
+	}
+
+	copy->dirty = false;
+	return copy;
+}
+
 void obs_data_erase(obs_data_t data, const char *name)
 {
 	struct obs_data_item *item = get_item(data, name);
 
 	if (item) {
+		data->dirty = true;
 		obs_data_item_detach(item);
 		obs_data_item_release(&item);
 	}
@@ -758,6 +1984,8 @@ size_t obs_data_array_push_back(obs_data_array_t array, obs_data_t obj)
 		return 0;
 
 	os_atomic_inc_long(&obj->ref);
+	obs_data_clear_dirty(obj);
+	array->dirty = true;
 	return da_push_back(array->objects, &obj);
 }
 
@@ -767,6 +1995,8 @@ void obs_data_array_insert(obs_data_array_t array, size_t idx, obs_data_t obj)
 		return;
 
 	os_atomic_inc_long(&obj->ref);
+	obs_data_clear_dirty(obj);
+	array->dirty = true;
 	da_insert(array->objects, idx, &obj);
 }
 
@@ -775,6 +2005,7 @@ void obs_data_array_erase(obs_data_array_t array, size_t idx)
 	if (array) {
 		obs_data_release(array->objects.array[idx]);
 		da_erase(array->objects, idx);
+		array->dirty = true;
 	}
 }
 
@@ -833,6 +2064,9 @@ void obs_data_item_release(obs_data_item_t *item)
 void obs_data_item_remove(obs_data_item_t *item)
 {
 	if (item && *item) {
+		if ((*item)->prev_next)
+			(*item)->parent->dirty = true;
+
 		obs_data_item_detach(*item);
 		obs_data_item_release(item);
 	}
@@ -865,7 +2099,7 @@ void obs_data_item_setint(obs_data_item_t *item, long long val)
 	struct obs_data_number num;
 	num.type    = OBS_DATA_NUM_INT;
 	num.int_val = val;
-	obs_data_item_setdata(item, &val, sizeof(struct obs_data_number),
+	obs_data_item_setdata(item, &num, sizeof(struct obs_data_number),
 			OBS_DATA_NUMBER);
 }
 
@@ -874,7 +2108,7 @@ void obs_data_item_setdouble(obs_data_item_t *item, double val)
 	struct obs_data_number num;
 	num.type       = OBS_DATA_NUM_DOUBLE;
 	num.double_val = val;
-	obs_data_item_setdata(item, &val, sizeof(struct obs_data_number),
+	obs_data_item_setdata(item, &num, sizeof(struct obs_data_number),
 			OBS_DATA_NUMBER);
 }
 
@@ -67,10 +67,38 @@ EXPORT void obs_data_release(obs_data_t data);
 
 EXPORT const char *obs_data_getjson(obs_data_t data);
 
+/**
+ * Binary encoding of the data, versioned and designed to be decoded directly
+ * from a memory mapped file.  Converts losslessly to and from JSON.
+ *
+ *   obs_data_getbinary returns memory owned by the data object which is valid
+ * until the next call or until the object is destroyed.  The create functions
+ * return NULL if the data is invalid, corrupt, or a different version.
+ */
+EXPORT const void *obs_data_getbinary(obs_data_t data, size_t *size);
+EXPORT obs_data_t obs_data_create_from_binary(const void *data, size_t size);
+EXPORT obs_data_t obs_data_create_from_binary_file(const char *path);
+EXPORT bool obs_data_save_binary_file(obs_data_t data, const char *path);
+
 EXPORT void obs_data_apply(obs_data_t target, obs_data_t apply_data);
 
+/**
+ * Creates a deep copy of the data, child objects and arrays are copied as
+ * well, so nothing changed in the original afterwards shows up in the copy.
+ */
+EXPORT obs_data_t obs_data_create_copy(obs_data_t data);
+
 EXPORT void obs_data_erase(obs_data_t data, const char *name);
 
+/**
+ * Change tracking.  Returns true if any value in the object (or in any of its
+ * child objects/arrays) was changed since the object was created, stored in
+ * a parent, or last cleared.  Setting a value equal to its current value is
+ * not a change.
+ */
+EXPORT bool obs_data_is_dirty(obs_data_t data);
+EXPORT void obs_data_clear_dirty(obs_data_t data);
+
 /* Set functions */
 EXPORT void obs_data_setstring(obs_data_t data, const char *name,
 		const char *val);
@@ -23,6 +23,7 @@ bool obs_display_init(struct obs_display *display,
 		struct gs_init_data *graphics_data)
 {
 	pthread_mutex_init_value(&display->draw_callbacks_mutex);
+	display->visible = true;
 
 	if (graphics_data) {
 		display->swap = gs_create_swapchain(graphics_data);
@@ -112,6 +113,17 @@ void obs_display_resize(obs_display_t display, uint32_t cx, uint32_t cy)
 	pthread_mutex_unlock(&display->draw_callbacks_mutex);
 }
 
+void obs_display_set_visible(obs_display_t display, bool visible)
+{
+	if (display)
+		display->visible = visible;
+}
+
+bool obs_display_visible(obs_display_t display)
+{
+	return display ? display->visible : false;
+}
+
 void obs_display_add_draw_callback(obs_display_t display,
 		void (*draw)(void *param, uint32_t cx, uint32_t cy),
 		void *param)
@@ -138,7 +150,9 @@ void obs_display_remove_draw_callback(obs_display_t display,
 	pthread_mutex_unlock(&display->draw_callbacks_mutex);
 }
 
-static inline void render_display_begin(struct obs_display *display)
+/* returns false if the swap chain has no free buffer, in which case the
+ * frame is skipped so that presenting never waits on the compositor */
+static inline bool render_display_begin(struct obs_display *display)
 {
 	struct vec4 clear_color;
 
@@ -149,6 +163,9 @@ static inline void render_display_begin(struct obs_display *display)
 		display->size_changed = false;
 	}
 
+	if (!gs_swapchain_ready())
+		return false;
+
 	gs_beginscene();
 
 	vec4_set(&clear_color, 0.3f, 0.3f, 0.3f, 1.0f);
@@ -162,6 +179,7 @@ static inline void render_display_begin(struct obs_display *display)
 	gs_ortho(0.0f, (float)display->cx,
 			0.0f, (float)display->cy, -100.0f, 100.0f);
 	gs_setviewport(0, 0, display->cx, display->cy);
+	return true;
 }
 
 static inline void render_display_end()
@@ -174,7 +192,12 @@ void render_display(struct obs_display *display)
 {
 	if (!display) return;
 
-	render_display_begin(display);
+	/* nothing can be seen, so don't even present */
+	if (!display->visible || !display->cx || !display->cy)
+		return;
+
+	if (!render_display_begin(display))
+		return;
 
 	pthread_mutex_lock(&display->draw_callbacks_mutex);
 
@@ -0,0 +1,279 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "obs-internal.h"
+
+/* the encode device is a second, headless graphics device (usually on
+ * another adapter) that gpu encoders encode from, so that encoding doesn't
+ * compete with rendering on the main device.  D3D11 can't share textures
+ * between adapters, so the output texture is staged and downloaded on the
+ * main device like any other frame, and uploaded to the encode device by
+ * its own thread */
+
+static void encode_frame(struct obs_encode_device *ed, const uint8_t *data,
+		uint64_t timestamp)
+{
+	struct obs_core_data *obs_data = &obs->data;
+
+	gs_entercontext(ed->graphics);
+
+	texture_setimage(ed->texture, data, ed->width * 4, false);
+
+	/* iterate backwards: an encoder that fails stops itself and is
+	 * removed from the list */
+	pthread_mutex_lock(&obs_data->gpu_encoders_mutex);
+	for (size_t i = obs_data->gpu_encoders.num; i > 0; i--)
+		obs_encoder_receive_texture(obs_data->gpu_encoders.array[i-1],
+				ed->texture, timestamp);
+	pthread_mutex_unlock(&obs_data->gpu_encoders_mutex);
+
+	gs_leavecontext();
+}
+
+static void *encode_device_thread(void *param)
+{
+	struct obs_encode_device *ed = param;
+
+	os_thread_init(OS_THREAD_CLASS_ENCODER, "obs encode device");
+
+	while (os_sem_wait(ed->sem) == 0 && !ed->stop) {
+		uint8_t  *data;
+		uint64_t timestamp;
+
+		/* the video thread never touches the front frame while it's
+		 * counted, so it can be uploaded without holding the lock */
+		pthread_mutex_lock(&ed->mutex);
+		data      = ed->frames[ed->frame_read];
+		timestamp = ed->frame_times[ed->frame_read];
+		pthread_mutex_unlock(&ed->mutex);
+
+		encode_frame(ed, data, timestamp);
+
+		pthread_mutex_lock(&ed->mutex);
+		ed->frame_read = (ed->frame_read + 1) % ENCODE_DEVICE_FRAMES;
+		ed->frame_count--;
+		pthread_mutex_unlock(&ed->mutex);
+	}
+
+	return NULL;
+}
+
+static bool init_main_device_surfaces(struct obs_encode_device *ed,
+		struct obs_video_info *ovi)
+{
+	bool success = true;
+
+	ed->num_surfaces = (int)ovi->pipeline_depth;
+
+	gs_entercontext(obs->video.graphics);
+
+	for (int i = 0; i < ed->num_surfaces; i++) {
+		ed->surfaces[i] = gs_create_stagesurface(ed->width,
+				ed->height, GS_RGBA);
+		if (!ed->surfaces[i])
+			success = false;
+	}
+
+	gs_leavecontext();
+	return success;
+}
+
+bool obs_init_encode_device(struct obs_video_info *ovi)
+{
+	struct obs_encode_device *ed = &obs->video.encode_device;
+	struct gs_init_data      graphics_data = {0};
+	int                      errorcode;
+
+	memset(ed, 0, sizeof(struct obs_encode_device));
+	pthread_mutex_init_value(&ed->mutex);
+	ed->width  = ovi->output_width;
+	ed->height = ovi->output_height;
+
+	graphics_data.cx              = ovi->output_width;
+	graphics_data.cy              = ovi->output_height;
+	graphics_data.num_backbuffers = 1;
+	graphics_data.format          = GS_RGBA;
+	graphics_data.zsformat        = GS_ZS_NONE;
+	graphics_data.adapter         = ovi->encode_adapter;
+
+	/* no window, so the device is headless */
+	errorcode = gs_create(&ed->graphics, ovi->graphics_module,
+			&graphics_data);
+	if (errorcode != GS_SUCCESS) {
+		blog(LOG_ERROR, "Failed to create encode device on adapter "
+		                "%u", ovi->encode_adapter);
+		ed->graphics = NULL;
+		return false;
+	}
+
+	gs_entercontext(ed->graphics);
+	ed->texture = gs_create_texture(ed->width, ed->height, GS_RGBA, 1,
+			NULL, GS_DYNAMIC);
+	gs_leavecontext();
+
+	if (!ed->texture)
+		goto fail;
+	if (!init_main_device_surfaces(ed, ovi))
+		goto fail;
+
+	for (size_t i = 0; i < ENCODE_DEVICE_FRAMES; i++)
+		ed->frames[i] = bmalloc(ed->width * ed->height * 4);
+
+	if (pthread_mutex_init(&ed->mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&ed->sem, 0) != 0)
+		goto fail;
+	if (pthread_create(&ed->thread, NULL, encode_device_thread, ed) != 0)
+		goto fail;
+
+	ed->thread_active = true;
+
+	blog(LOG_INFO, "GPU encoders use the encode device on adapter %u",
+			ovi->encode_adapter);
+	return true;
+
+fail:
+	blog(LOG_ERROR, "Failed to initialize encode device");
+	obs_free_encode_device();
+	return false;
+}
+
+void obs_free_encode_device(void)
+{
+	struct obs_encode_device *ed = &obs->video.encode_device;
+
+	if (!ed->graphics)
+		return;
+
+	if (ed->thread_active) {
+		ed->stop = true;
+		os_sem_post(ed->sem);
+		pthread_join(ed->thread, NULL);
+	}
+
+	if (ed->frames_dropped)
+		blog(LOG_INFO, "Encode device: %llu frames dropped",
+				(unsigned long long)ed->frames_dropped);
+
+	gs_entercontext(obs->video.graphics);
+	for (int i = 0; i < MAX_NUM_STAGE_SURFACES; i++)
+		stagesurface_destroy(ed->surfaces[i]);
+	gs_leavecontext();
+
+	gs_entercontext(ed->graphics);
+	texture_destroy(ed->texture);
+	gs_leavecontext();
+
+	gs_destroy(ed->graphics);
+
+	for (size_t i = 0; i < ENCODE_DEVICE_FRAMES; i++)
+		bfree(ed->frames[i]);
+
+	if (ed->sem)
+		os_sem_destroy(ed->sem);
+	pthread_mutex_destroy(&ed->mutex);
+
+	memset(ed, 0, sizeof(struct obs_encode_device));
+}
+
+/* copies a downloaded frame to the frames ring, dropping it if the encode
+ * device is behind */
+static void queue_frame(struct obs_encode_device *ed, const uint8_t *data,
+		uint32_t linesize, uint64_t timestamp)
+{
+	uint32_t row  = ed->width * 4;
+	uint8_t  *dst;
+	size_t   write;
+
+	pthread_mutex_lock(&ed->mutex);
+	if (ed->frame_count == ENCODE_DEVICE_FRAMES) {
+		pthread_mutex_unlock(&ed->mutex);
+		ed->frames_dropped++;
+		return;
+	}
+	write = (ed->frame_read + ed->frame_count) % ENCODE_DEVICE_FRAMES;
+	pthread_mutex_unlock(&ed->mutex);
+
+	dst = ed->frames[write];
+
+	if (linesize == row) {
+		memcpy(dst, data, row * ed->height);
+	} else {
+		for (uint32_t y = 0; y < ed->height; y++)
+			memcpy(dst + y * row, data + y * linesize, row);
+	}
+
+	ed->frame_times[write] = timestamp;
+
+	pthread_mutex_lock(&ed->mutex);
+	ed->frame_count++;
+	pthread_mutex_unlock(&ed->mutex);
+
+	os_sem_post(ed->sem);
+}
+
+/* called by the video thread within the main graphics context.  like the
+ * main output, copies are downloaded in order and only once the main device
+ * has finished them, so a frame reaches the encoders a pipeline depth
+ * late */
+void obs_encode_device_output(texture_t texture, uint64_t timestamp)
+{
+	struct obs_encode_device *ed = &obs->video.encode_device;
+	int write;
+
+	while (ed->stage_pending) {
+		stagesurf_t surface = ed->surfaces[ed->stage_read];
+		uint8_t     *data;
+		uint32_t    linesize;
+
+		if (!stagesurface_isready(surface))
+			break;
+
+		if (stagesurface_map(surface, &data, &linesize)) {
+			queue_frame(ed, data, linesize,
+					ed->surface_times[ed->stage_read]);
+			stagesurface_unmap(surface);
+		}
+
+		ed->stage_read = (ed->stage_read + 1) % ed->num_surfaces;
+		ed->stage_pending--;
+	}
+
+	if (!texture)
+		return;
+
+	/* the oldest copy is dropped rather than waited for */
+	if (ed->stage_pending == ed->num_surfaces) {
+		ed->stage_read = (ed->stage_read + 1) % ed->num_surfaces;
+		ed->stage_pending--;
+		ed->frames_dropped++;
+	}
+
+	write = (ed->stage_read + ed->stage_pending) % ed->num_surfaces;
+	gs_stage_texture(ed->surfaces[write], texture);
+	ed->surface_times[write] = timestamp;
+	ed->stage_pending++;
+}
+
+graphics_t obs_encode_graphics(void)
+{
+	if (!obs)
+		return NULL;
+
+	return obs->video.encode_device.graphics ?
+		obs->video.encode_device.graphics : obs->video.graphics;
+}
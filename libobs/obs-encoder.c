@@ -15,19 +15,23 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include "util/platform.h"
 #include "obs.h"
 #include "obs-internal.h"
 
-static inline struct obs_encoder_info *get_encoder_info(const char *id)
+static inline struct obs_encoder_info *find_encoder(const char *id)
 {
-	for (size_t i = 0; i < obs->encoder_types.num; i++) {
-		struct obs_encoder_info *info = obs->encoder_types.array+i;
+	size_t idx = obs_type_index_find(&obs->encoder_index, id);
+	return (idx != DARRAY_INVALID) ? obs->encoder_types.array+idx : NULL;
+}
 
-		if (strcmp(info->id, id) == 0)
-			return info;
-	}
+static struct obs_encoder_info *get_encoder_info(const char *id)
+{
+	struct obs_encoder_info *info = find_encoder(id);
 
-	return NULL;
+	if (!info && obs_load_deferred_type(MODULE_TYPE_ENCODER, id))
+		info = find_encoder(id);
+	return info;
 }
 
 const char *obs_encoder_getdisplayname(const char *id, const char *locale)
@@ -36,11 +40,60 @@ const char *obs_encoder_getdisplayname(const char *id, const char *locale)
 	return ei ? ei->getname(locale) : NULL;
 }
 
+static void get_queue_latency_proc(void *data, calldata_t params)
+{
+	struct obs_encoder *encoder = data;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+	calldata_setint(params, "latency_ns",
+			(long long)encoder->queue_latency);
+	pthread_mutex_unlock(&encoder->queue_mutex);
+}
+
+static void get_frames_skipped_proc(void *data, calldata_t params)
+{
+	struct obs_encoder *encoder = data;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+	calldata_setint(params, "frames_skipped",
+			(long long)encoder->frames_skipped);
+	pthread_mutex_unlock(&encoder->queue_mutex);
+}
+
+static void init_profile_point(struct obs_encoder *encoder)
+{
+	struct dstr_small small;
+	struct dstr       *point_name = dstr_small_init(&small);
+
+	dstr_printf(point_name, "do_encode: %s",
+			encoder->context.name ? encoder->context.name : "");
+	encoder->profile_point = profile_point_get(point_name->array);
+	dstr_free(point_name);
+}
+
+static bool init_encode_mutex(struct obs_encoder *encoder)
+{
+	pthread_mutexattr_t attr;
+	bool success;
+
+	if (pthread_mutexattr_init(&attr) != 0)
+		return false;
+
+	success = pthread_mutexattr_settype(&attr,
+			PTHREAD_MUTEX_RECURSIVE) == 0 &&
+		pthread_mutex_init(&encoder->encode_mutex, &attr) == 0;
+
+	pthread_mutexattr_destroy(&attr);
+	return success;
+}
+
 static bool init_encoder(struct obs_encoder *encoder, const char *name,
 		obs_data_t settings)
 {
 	pthread_mutex_init_value(&encoder->callbacks_mutex);
 	pthread_mutex_init_value(&encoder->outputs_mutex);
+	pthread_mutex_init_value(&encoder->queue_mutex);
+	pthread_mutex_init_value(&encoder->encode_mutex);
 
 	if (!obs_context_data_init(&encoder->context, settings, name))
 		return false;
@@ -48,10 +101,25 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 		return false;
 	if (pthread_mutex_init(&encoder->outputs_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&encoder->queue_mutex, NULL) != 0)
+		return false;
+	if (!init_encode_mutex(encoder))
+		return false;
+
+	if (encoder->info.type == OBS_ENCODER_VIDEO) {
+		proc_handler_add(encoder->context.procs,
+				"void get_queue_latency(out int latency_ns)",
+				get_queue_latency_proc, encoder);
+		proc_handler_add(encoder->context.procs,
+				"void get_frames_skipped(out int "
+				"frames_skipped)",
+				get_frames_skipped_proc, encoder);
+	}
 
 	if (encoder->info.defaults)
 		encoder->info.defaults(encoder->context.settings);
 
+	init_profile_point(encoder);
 	return true;
 }
 
@@ -68,6 +136,7 @@ static struct obs_encoder *create_encoder(const char *id,
 
 	encoder = bzalloc(sizeof(struct obs_encoder));
 	encoder->info = *ei;
+	encoder->frame_rate_divisor = 1;
 
 	success = init_encoder(encoder, name, settings);
 	if (!success) {
@@ -122,11 +191,185 @@ static inline struct audio_convert_info *get_audio_info(
 static inline struct video_scale_info *get_video_info(
 		struct obs_encoder *encoder, struct video_scale_info *info)
 {
+	const struct video_output_info *voi;
+	bool custom = false;
+
 	if (encoder->info.video_info)
-		if (encoder->info.video_info(encoder->context.data, info))
-			return info;
+		custom = encoder->info.video_info(encoder->context.data, info);
+
+	if (encoder->scaled_width || encoder->scaled_height) {
+		if (!custom) {
+			voi = video_output_getinfo(encoder->media);
+			info->format     = voi->format;
+			info->range      = VIDEO_RANGE_DEFAULT;
+			info->colorspace = VIDEO_CS_DEFAULT;
+		}
 
-	return NULL;
+		info->width  = obs_encoder_get_width(encoder);
+		info->height = obs_encoder_get_height(encoder);
+		custom = true;
+	}
+
+	return custom ? info : NULL;
+}
+
+static inline bool can_gpu_encode(struct obs_encoder *encoder,
+		struct video_scale_info *info)
+{
+	return (encoder->info.caps & OBS_ENCODER_CAP_GPU_TEXTURE) != 0 &&
+		encoder->info.encode_texture &&
+		encoder->media == obs->video.video &&
+		!info;
+}
+
+static void add_gpu_encoder(struct obs_encoder *encoder)
+{
+	encoder->gpu_frame_count = 0;
+
+	pthread_mutex_lock(&obs->data.gpu_encoders_mutex);
+	da_push_back(obs->data.gpu_encoders, &encoder);
+	pthread_mutex_unlock(&obs->data.gpu_encoders_mutex);
+
+	encoder->gpu_encode = true;
+}
+
+static void remove_gpu_encoder(struct obs_encoder *encoder)
+{
+	pthread_mutex_lock(&obs->data.gpu_encoders_mutex);
+	da_erase_item(obs->data.gpu_encoders, &encoder);
+	pthread_mutex_unlock(&obs->data.gpu_encoders_mutex);
+
+	encoder->gpu_encode = false;
+}
+
+static void *encode_thread(void *param);
+
+static void free_video_queue(struct obs_encoder *encoder)
+{
+	for (size_t i = 0; i < ENCODER_QUEUE_SIZE; i++)
+		video_frame_free(&encoder->queue[i].frame);
+
+	encoder->queue_start = 0;
+	encoder->queue_count = 0;
+}
+
+static void stop_encode_thread(struct obs_encoder *encoder);
+
+static void start_encode_thread(struct obs_encoder *encoder,
+		const struct video_scale_info *info)
+{
+	const struct video_output_info *voi;
+	uint32_t width  = obs_encoder_get_width(encoder);
+	uint32_t height = obs_encoder_get_height(encoder);
+
+	/* the thread of an encoder that failed is still waiting to be
+	 * joined */
+	if (encoder->encode_thread_active)
+		stop_encode_thread(encoder);
+
+	voi = video_output_getinfo(encoder->media);
+	encoder->queue_format = info ? info->format : voi->format;
+	encoder->queue_height = height;
+	encoder->queue_latency  = 0;
+	encoder->frames_skipped = 0;
+	encoder->queue_changed  = true;
+	encoder->encode_thread_stop  = false;
+	encoder->encode_thread_abort = false;
+
+	for (size_t i = 0; i < ENCODER_QUEUE_SIZE; i++)
+		video_frame_init(&encoder->queue[i].frame,
+				encoder->queue_format, width, height);
+
+	if (os_sem_init(&encoder->encode_sem, 0) != 0)
+		return;
+
+	encoder->encode_thread_active = pthread_create(
+			&encoder->encode_thread, NULL, encode_thread,
+			encoder) == 0;
+}
+
+static void stop_encode_thread(struct obs_encoder *encoder)
+{
+	void *thread_ret;
+
+	if (encoder->encode_thread_active) {
+		/* an encoder that fails stops itself from its own thread,
+		 * which can't join itself.  the thread only leaves its loop,
+		 * and it's joined and cleaned up after by whoever starts or
+		 * destroys the encoder next */
+		if (pthread_equal(pthread_self(), encoder->encode_thread)) {
+			encoder->encode_thread_abort = true;
+			return;
+		}
+
+		/* the video is disconnected by now, so the thread encodes
+		 * the frames that are still queued and then exits */
+		encoder->encode_thread_stop = true;
+		os_sem_post(encoder->encode_sem);
+
+		pthread_join(encoder->encode_thread, &thread_ret);
+		encoder->encode_thread_active = false;
+	}
+
+	os_sem_destroy(encoder->encode_sem);
+	encoder->encode_sem = NULL;
+	free_video_queue(encoder);
+}
+
+/* two encoders with the same fingerprint get the same input and have the
+ * same settings, so they produce the same packets */
+static void get_fingerprint(struct obs_encoder *encoder, struct dstr *fp)
+{
+	dstr_printf(fp, "%s:%p:", encoder->info.id, encoder->media);
+
+	if (encoder->info.type == OBS_ENCODER_VIDEO)
+		dstr_catf(fp, "%ux%u:%u:", encoder->scaled_width,
+				encoder->scaled_height,
+				encoder->frame_rate_divisor);
+
+	dstr_cat(fp, obs_data_getjson(encoder->context.settings));
+}
+
+static void update_fingerprint(struct obs_encoder *encoder)
+{
+	pthread_mutex_lock(&obs->data.encoders_mutex);
+
+	if (encoder->active && !encoder->exclusive)
+		get_fingerprint(encoder, &encoder->fingerprint);
+	else
+		dstr_free(&encoder->fingerprint);
+
+	pthread_mutex_unlock(&obs->data.encoders_mutex);
+}
+
+obs_encoder_t obs_encoder_find_equivalent(obs_encoder_t encoder)
+{
+	struct obs_encoder *found = NULL;
+	struct obs_encoder *cur;
+	struct dstr        fp = {0};
+
+	if (!encoder || encoder->active)
+		return NULL;
+
+	get_fingerprint(encoder, &fp);
+
+	pthread_mutex_lock(&obs->data.encoders_mutex);
+
+	cur = obs->data.first_encoder;
+	while (cur) {
+		if (cur != encoder && !dstr_isempty(&cur->fingerprint) &&
+		    dstr_cmp(&cur->fingerprint, fp.array) == 0) {
+			found = cur;
+			break;
+		}
+
+		cur = (struct obs_encoder*)cur->context.next;
+	}
+
+	pthread_mutex_unlock(&obs->data.encoders_mutex);
+
+	dstr_free(&fp);
+	return found;
 }
 
 static void add_connection(struct obs_encoder *encoder)
@@ -142,11 +385,20 @@ static void add_connection(struct obs_encoder *encoder)
 		struct video_scale_info *info = NULL;
 
 		info = get_video_info(encoder, &video_info);
-		video_output_connect(encoder->media, info, receive_video,
-				encoder);
+
+		if (can_gpu_encode(encoder, info)) {
+			add_gpu_encoder(encoder);
+		} else {
+			start_encode_thread(encoder, info);
+			video_output_connect2(encoder->media, info,
+					encoder->frame_rate_divisor,
+					receive_video, encoder);
+		}
 	}
 
-	encoder->active = true;
+	encoder->active        = true;
+	encoder->context_fresh = false;
+	update_fingerprint(encoder);
 }
 
 static void remove_connection(struct obs_encoder *encoder)
@@ -154,11 +406,17 @@ static void remove_connection(struct obs_encoder *encoder)
 	if (encoder->info.type == OBS_ENCODER_AUDIO)
 		audio_output_disconnect(encoder->media, receive_audio,
 				encoder);
-	else
+	else if (encoder->gpu_encode)
+		remove_gpu_encoder(encoder);
+	else {
 		video_output_disconnect(encoder->media, receive_video,
 				encoder);
+		stop_encode_thread(encoder);
+	}
 
-	encoder->active = false;
+	encoder->active    = false;
+	encoder->exclusive = false;
+	update_fingerprint(encoder);
 }
 
 static inline void free_audio_buffers(struct obs_encoder *encoder)
@@ -181,13 +439,19 @@ static void obs_encoder_actually_destroy(obs_encoder_t encoder)
 		da_free(encoder->outputs);
 		pthread_mutex_unlock(&encoder->outputs_mutex);
 
+		if (encoder->encode_thread_active)
+			stop_encode_thread(encoder);
+
 		free_audio_buffers(encoder);
+		dstr_free(&encoder->fingerprint);
 
 		if (encoder->context.data)
 			encoder->info.destroy(encoder->context.data);
 		da_free(encoder->callbacks);
 		pthread_mutex_destroy(&encoder->callbacks_mutex);
 		pthread_mutex_destroy(&encoder->outputs_mutex);
+		pthread_mutex_destroy(&encoder->queue_mutex);
+		pthread_mutex_destroy(&encoder->encode_mutex);
 		obs_context_data_free(&encoder->context);
 		bfree(encoder);
 	}
@@ -201,6 +465,7 @@ void obs_encoder_destroy(obs_encoder_t encoder)
 		bool destroy;
 
 		obs_context_data_remove(&encoder->context);
+		obs_encoder_end_prewarm(encoder);
 
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 		destroy = encoder->callbacks.num == 0;
@@ -256,13 +521,36 @@ obs_properties_t obs_encoder_properties(obs_encoder_t encoder,
 
 void obs_encoder_update(obs_encoder_t encoder, obs_data_t settings)
 {
+	char *old_settings = NULL;
+
 	if (!encoder) return;
 
+	/* the settings and the context are shared with the encode thread */
+	pthread_mutex_lock(&encoder->encode_mutex);
+
+	/* a context created ahead of time is only kept if nothing changed */
+	if (encoder->context_fresh)
+		old_settings = bstrdup(obs_data_getjson(
+					encoder->context.settings));
+
 	obs_data_apply(encoder->context.settings, settings);
 
+	if (old_settings) {
+		if (strcmp(old_settings,
+			   obs_data_getjson(encoder->context.settings)) != 0)
+			encoder->context_fresh = false;
+		bfree(old_settings);
+	}
+
 	if (encoder->info.update && encoder->context.data)
 		encoder->info.update(encoder->context.data,
 				encoder->context.settings);
+
+	pthread_mutex_unlock(&encoder->encode_mutex);
+
+	/* from now on, only outputs that want the new settings share it */
+	if (encoder->active)
+		update_fingerprint(encoder);
 }
 
 bool obs_encoder_get_extra_data(obs_encoder_t encoder, uint8_t **extra_data,
@@ -297,7 +585,10 @@ static void intitialize_audio_encoder(struct obs_encoder *encoder)
 	struct audio_convert_info info;
 	get_audio_info(encoder, &info);
 
-	encoder->samplerate = info.samples_per_sec;
+	/* encoders can ask for audio at another rate, and their timestamps
+	 * are in that rate */
+	encoder->samplerate   = info.samples_per_sec;
+	encoder->timebase_den = info.samples_per_sec;
 	encoder->planes     = get_audio_planes(info.format, info.speakers);
 	encoder->blocksize  = get_audio_size(info.format, info.speakers, 1);
 	encoder->framesize  = encoder->info.frame_size(encoder->context.data);
@@ -313,11 +604,21 @@ bool obs_encoder_initialize(obs_encoder_t encoder)
 	if (encoder->active)
 		return true;
 
-	if (encoder->context.data)
-		encoder->info.destroy(encoder->context.data);
+	/* a context that hasn't been used yet can be kept, which saves
+	 * creating the encoder and its headers again when starting */
+	pthread_mutex_lock(&encoder->encode_mutex);
+
+	if (!encoder->context.data || !encoder->context_fresh) {
+		if (encoder->context.data)
+			encoder->info.destroy(encoder->context.data);
+
+		encoder->context.data = encoder->info.create(
+				encoder->context.settings, encoder);
+		encoder->context_fresh = encoder->context.data != NULL;
+	}
+
+	pthread_mutex_unlock(&encoder->encode_mutex);
 
-	encoder->context.data = encoder->info.create(encoder->context.settings,
-			encoder);
 	if (!encoder->context.data)
 		return false;
 
@@ -367,9 +668,48 @@ void obs_encoder_start(obs_encoder_t encoder,
 	if (first) {
 		encoder->cur_pts = 0;
 		add_connection(encoder);
+
+	/* new callbacks wait for a keyframe, so don't make them wait for
+	 * the keyframe interval */
+	} else if (idx == DARRAY_INVALID) {
+		obs_encoder_request_keyframe(encoder);
 	}
 }
 
+static void discard_packet(void *param, struct encoder_packet *packet)
+{
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(packet);
+}
+
+bool obs_encoder_prewarm(obs_encoder_t encoder)
+{
+	if (!encoder || !encoder->media)
+		return false;
+	if (encoder->prewarmed)
+		return true;
+	if (!obs_encoder_initialize(encoder))
+		return false;
+
+	encoder->prewarmed = true;
+	obs_encoder_start(encoder, discard_packet, encoder);
+	return true;
+}
+
+void obs_encoder_end_prewarm(obs_encoder_t encoder)
+{
+	if (!encoder || !encoder->prewarmed)
+		return;
+
+	encoder->prewarmed = false;
+	obs_encoder_stop(encoder, discard_packet, encoder);
+}
+
+bool obs_encoder_prewarmed(obs_encoder_t encoder)
+{
+	return encoder ? encoder->prewarmed : false;
+}
+
 void obs_encoder_stop(obs_encoder_t encoder,
 		void (*new_packet)(void *param, struct encoder_packet *packet),
 		void *param)
@@ -381,17 +721,23 @@ void obs_encoder_stop(obs_encoder_t encoder,
 
 	pthread_mutex_lock(&encoder->callbacks_mutex);
 
-	idx = get_callback_idx(encoder, new_packet, param);
-	if (idx != DARRAY_INVALID) {
+	idx  = get_callback_idx(encoder, new_packet, param);
+	last = idx != DARRAY_INVALID && encoder->callbacks.num == 1;
+	if (idx != DARRAY_INVALID && !last)
 		da_erase(encoder->callbacks, idx);
-		last = (encoder->callbacks.num == 0);
-	}
 
 	pthread_mutex_unlock(&encoder->callbacks_mutex);
 
 	if (last) {
+		/* the last callback is only removed once the connection is,
+		 * so it still gets the packets of the frames that were
+		 * queued when it stopped */
 		remove_connection(encoder);
 
+		pthread_mutex_lock(&encoder->callbacks_mutex);
+		da_free(encoder->callbacks);
+		pthread_mutex_unlock(&encoder->callbacks_mutex);
+
 		if (encoder->destroy_on_stop)
 			obs_encoder_actually_destroy(encoder);
 	}
@@ -411,8 +757,11 @@ void obs_encoder_set_video(obs_encoder_t encoder, video_t video)
 
 	voi = video_output_getinfo(video);
 
+	if (encoder->media != video)
+		encoder->context_fresh = false;
+
 	encoder->media        = video;
-	encoder->timebase_num = voi->fps_den;
+	encoder->timebase_num = voi->fps_den * encoder->frame_rate_divisor;
 	encoder->timebase_den = voi->fps_num;
 }
 
@@ -421,11 +770,120 @@ void obs_encoder_set_audio(obs_encoder_t encoder, audio_t audio)
 	if (!audio || !encoder || encoder->info.type != OBS_ENCODER_AUDIO)
 		return;
 
+	if (encoder->media != audio)
+		encoder->context_fresh = false;
+
 	encoder->media        = audio;
 	encoder->timebase_num = 1;
 	encoder->timebase_den = audio_output_samplerate(audio);
 }
 
+void obs_encoder_set_scaled_size(obs_encoder_t encoder, uint32_t width,
+		uint32_t height)
+{
+	if (!encoder || encoder->info.type != OBS_ENCODER_VIDEO)
+		return;
+
+	if (encoder->active) {
+		blog(LOG_WARNING, "encoder '%s': Cannot set the scaled "
+		                  "resolution while the encoder is active",
+		                  encoder->context.name);
+		return;
+	}
+
+	if (encoder->scaled_width != width || encoder->scaled_height != height)
+		encoder->context_fresh = false;
+
+	encoder->scaled_width  = width;
+	encoder->scaled_height = height;
+}
+
+void obs_encoder_set_frame_rate_divisor(obs_encoder_t encoder,
+		uint32_t divisor)
+{
+	if (!encoder || encoder->info.type != OBS_ENCODER_VIDEO)
+		return;
+
+	if (encoder->active) {
+		blog(LOG_WARNING, "encoder '%s': Cannot set the frame rate "
+		                  "divisor while the encoder is active",
+		                  encoder->context.name);
+		return;
+	}
+
+	if (!divisor)
+		divisor = 1;
+	if (encoder->frame_rate_divisor != divisor)
+		encoder->context_fresh = false;
+
+	encoder->frame_rate_divisor = divisor;
+
+	if (encoder->media) {
+		const struct video_output_info *voi =
+			video_output_getinfo(encoder->media);
+		encoder->timebase_num = voi->fps_den *
+			encoder->frame_rate_divisor;
+	}
+}
+
+void obs_encoder_request_keyframe(obs_encoder_t encoder)
+{
+	if (!encoder || encoder->info.type != OBS_ENCODER_VIDEO)
+		return;
+
+	os_atomic_set_long(&encoder->keyframe_requested, 1);
+}
+
+uint32_t obs_encoder_get_frame_rate_divisor(obs_encoder_t encoder)
+{
+	return (encoder && encoder->info.type == OBS_ENCODER_VIDEO) ?
+		encoder->frame_rate_divisor : 0;
+}
+
+uint32_t obs_encoder_get_sample_rate(obs_encoder_t encoder)
+{
+	if (!encoder || !encoder->media ||
+	    encoder->info.type != OBS_ENCODER_AUDIO)
+		return 0;
+
+	return encoder->samplerate ?
+		encoder->samplerate :
+		audio_output_samplerate(encoder->media);
+}
+
+size_t obs_encoder_get_frame_size(obs_encoder_t encoder)
+{
+	if (!encoder || encoder->info.type != OBS_ENCODER_AUDIO)
+		return 0;
+
+	return encoder->framesize;
+}
+
+uint32_t obs_encoder_get_width(obs_encoder_t encoder)
+{
+	if (!encoder || !encoder->media ||
+	    encoder->info.type != OBS_ENCODER_VIDEO)
+		return 0;
+
+	return encoder->scaled_width ?
+		encoder->scaled_width : video_output_width(encoder->media);
+}
+
+uint32_t obs_encoder_get_height(obs_encoder_t encoder)
+{
+	if (!encoder || !encoder->media ||
+	    encoder->info.type != OBS_ENCODER_VIDEO)
+		return 0;
+
+	return encoder->scaled_height ?
+		encoder->scaled_height : video_output_height(encoder->media);
+}
+
+proc_handler_t obs_encoder_prochandler(obs_encoder_t encoder)
+{
+	return encoder ? encoder->context.procs : NULL;
+}
+
 video_t obs_encoder_video(obs_encoder_t encoder)
 {
 	return (encoder && encoder->info.type == OBS_ENCODER_VIDEO) ?
@@ -446,10 +904,46 @@ static inline bool get_sei(struct obs_encoder *encoder,
 	return false;
 }
 
+bool obs_encoder_encode(obs_encoder_t encoder,
+		struct encoder_frame *frame, struct encoder_packet *packet,
+		bool *received_packet)
+{
+	bool success;
+
+	if (!encoder || !frame || !packet || !received_packet)
+		return false;
+	if (!encoder->context.data || encoder->active)
+		return false;
+
+	memset(packet, 0, sizeof(struct encoder_packet));
+	packet->timebase_num = encoder->timebase_num;
+	packet->timebase_den = encoder->timebase_den;
+	packet->encoder      = encoder;
+	*received_packet     = false;
+
+	pthread_mutex_lock(&encoder->encode_mutex);
+	encoder->context_fresh = false;
+	success = encoder->info.encode(encoder->context.data, frame, packet,
+			received_packet);
+	pthread_mutex_unlock(&encoder->encode_mutex);
+
+	return success;
+}
+
+bool obs_encoder_get_sei_data(obs_encoder_t encoder,
+		uint8_t **sei_data, size_t *size)
+{
+	if (!encoder || !encoder->context.data)
+		return false;
+
+	return get_sei(encoder, sei_data, size);
+}
+
 static void send_first_video_packet(struct obs_encoder *encoder,
 		struct encoder_callback *cb, struct encoder_packet *packet)
 {
 	struct encoder_packet first_packet;
+	struct encoder_packet sei_packet;
 	DARRAY(uint8_t)       data;
 	uint8_t               *sei;
 	size_t                size;
@@ -462,20 +956,24 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 
 	if (!get_sei(encoder, &sei, &size)) {
 		cb->new_packet(cb->param, packet);
+		cb->sent_first_packet = true;
 		return;
 	}
 
 	da_push_back_array(data, sei, size);
 	da_push_back_array(data, packet->data, packet->size);
 
-	first_packet      = *packet;
-	first_packet.data = data.array;
-	first_packet.size = data.num;
+	sei_packet      = *packet;
+	sei_packet.data = data.array;
+	sei_packet.size = data.num;
+
+	obs_encoder_packet_create_instance(&first_packet, &sei_packet);
+	da_free(data);
 
 	cb->new_packet(cb->param, &first_packet);
 	cb->sent_first_packet = true;
 
-	da_free(data);
+	obs_encoder_packet_release(&first_packet);
 }
 
 static inline void send_packet(struct obs_encoder *encoder,
@@ -499,17 +997,28 @@ static void full_stop(struct obs_encoder *encoder)
 }
 
 static inline void do_encode(struct obs_encoder *encoder,
-		struct encoder_frame *frame)
+		struct encoder_frame *frame, texture_t texture)
 {
 	struct encoder_packet pkt = {0};
+	struct encoder_packet shared;
 	bool received = false;
 	bool success;
+	uint64_t start;
 
 	pkt.timebase_num = encoder->timebase_num;
 	pkt.timebase_den = encoder->timebase_den;
+	pkt.encoder      = encoder;
 
-	success = encoder->info.encode(encoder->context.data, frame, &pkt,
-			&received);
+	start = profile_start();
+	pthread_mutex_lock(&encoder->encode_mutex);
+	if (texture)
+		success = encoder->info.encode_texture(encoder->context.data,
+				texture, encoder->cur_pts, &pkt, &received);
+	else
+		success = encoder->info.encode(encoder->context.data, frame,
+				&pkt, &received);
+	pthread_mutex_unlock(&encoder->encode_mutex);
+	profile_end(encoder->profile_point, start);
 	if (!success) {
 		full_stop(encoder);
 		blog(LOG_ERROR, "Error encoding with encoder '%s'",
@@ -521,38 +1030,137 @@ static inline void do_encode(struct obs_encoder *encoder,
 		/* we use system time here to ensure sync with other encoders,
 		 * you do not want to use relative timestamps here */
 		pkt.dts_usec = encoder->start_ts / 1000 + packet_dts_usec(&pkt);
+		pkt.sys_dts_usec = pkt.dts_usec;
+
+		/* copy the encoder's output once; every output shares it */
+		obs_encoder_packet_create_instance(&shared, &pkt);
 
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
 		for (size_t i = 0; i < encoder->callbacks.num; i++) {
 			struct encoder_callback *cb;
 			cb = encoder->callbacks.array+i;
-			send_packet(encoder, cb, &pkt);
+			send_packet(encoder, cb, &shared);
 		}
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+		obs_encoder_packet_release(&shared);
 	}
 }
 
+/* copies the frame in to the encoder's queue; the encode itself happens on
+ * the encoder thread so that a slow encoder doesn't hold up the video output
+ * or any other encoders */
 static void receive_video(void *param, struct video_data *frame)
 {
-	struct obs_encoder    *encoder  = param;
-	struct encoder_frame  enc_frame;
+	struct obs_encoder *encoder = param;
 
-	memset(&enc_frame, 0, sizeof(struct encoder_frame));
-
-	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-		enc_frame.data[i]     = frame->data[i];
-		enc_frame.linesize[i] = frame->linesize[i];
-	}
+	pthread_mutex_lock(&encoder->queue_mutex);
 
 	if (!encoder->start_ts)
 		encoder->start_ts = frame->timestamp;
 
-	enc_frame.frames = 1;
-	enc_frame.pts    = encoder->cur_pts;
+	/* a queued frame is only a duplicate if every frame since the last
+	 * queued one was, including any skipped while the queue was full */
+	if (!frame->duplicate)
+		encoder->queue_changed = true;
+
+	if (encoder->queue_count == ENCODER_QUEUE_SIZE) {
+		encoder->frames_skipped++;
+
+	} else {
+		size_t idx = (encoder->queue_start + encoder->queue_count) %
+			ENCODER_QUEUE_SIZE;
+		struct encoder_queued_frame *queued = encoder->queue+idx;
+		struct video_frame src;
+
+		memcpy(src.data, frame->data, sizeof(src.data));
+		memcpy(src.linesize, frame->linesize, sizeof(src.linesize));
+		video_frame_copy(&queued->frame, &src, encoder->queue_format,
+				encoder->queue_height);
+
+		queued->pts         = encoder->cur_pts;
+		queued->queued_time = os_gettime_ns();
+		queued->duplicate   = !encoder->queue_changed;
+		encoder->queue_changed = false;
+		encoder->queue_count++;
+
+		os_sem_post(encoder->encode_sem);
+	}
+
+	encoder->cur_pts += encoder->timebase_num;
+
+	pthread_mutex_unlock(&encoder->queue_mutex);
+}
+
+static void *encode_thread(void *param)
+{
+	struct obs_encoder *encoder = param;
+
+	os_thread_init(OS_THREAD_CLASS_ENCODER, "obs encoder");
+
+	while (os_sem_wait(encoder->encode_sem) == 0) {
+		struct encoder_queued_frame *queued;
+		struct encoder_frame        enc_frame;
+
+		/* each queued frame posts once, and stopping posts once more
+		 * after the last one, so a stop only ends the loop once the
+		 * queue is drained */
+		pthread_mutex_lock(&encoder->queue_mutex);
+		if (encoder->encode_thread_abort ||
+		    (encoder->encode_thread_stop && !encoder->queue_count)) {
+			pthread_mutex_unlock(&encoder->queue_mutex);
+			break;
+		}
+
+		/* the producer never touches the front slot while it's
+		 * counted, so it can be encoded without holding the lock */
+		queued = encoder->queue + encoder->queue_start;
+		encoder->queue_latency = os_gettime_ns() -
+			queued->queued_time;
+		pthread_mutex_unlock(&encoder->queue_mutex);
+
+		memset(&enc_frame, 0, sizeof(struct encoder_frame));
+
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			enc_frame.data[i]     = queued->frame.data[i];
+			enc_frame.linesize[i] = queued->frame.linesize[i];
+		}
+
+		enc_frame.frames    = 1;
+		enc_frame.pts       = queued->pts;
+		enc_frame.duplicate = queued->duplicate;
+		enc_frame.force_keyframe = os_atomic_set_long(
+				&encoder->keyframe_requested, 0) != 0;
+
+		do_encode(encoder, &enc_frame, NULL);
+
+		/* stopped by a failed encode, the rest of the queue is left
+		 * for the thread that joins this one to free */
+		if (encoder->encode_thread_abort)
+			break;
+
+		pthread_mutex_lock(&encoder->queue_mutex);
+		if (++encoder->queue_start == ENCODER_QUEUE_SIZE)
+			encoder->queue_start = 0;
+		encoder->queue_count--;
+		pthread_mutex_unlock(&encoder->queue_mutex);
+	}
+
+	return NULL;
+}
 
-	do_encode(encoder, &enc_frame);
+void obs_encoder_receive_texture(struct obs_encoder *encoder,
+		texture_t texture, uint64_t timestamp)
+{
+	if (encoder->gpu_frame_count++ % encoder->frame_rate_divisor != 0)
+		return;
+
+	if (!encoder->start_ts)
+		encoder->start_ts = timestamp;
+
+	do_encode(encoder, NULL, texture);
 
 	encoder->cur_pts += encoder->timebase_num;
 }
@@ -604,19 +1212,38 @@ static void send_audio_data(struct obs_encoder *encoder)
 
 	memset(&enc_frame, 0, sizeof(struct encoder_frame));
 
+	bool direct = (encoder->info.caps & OBS_ENCODER_CAP_DIRECT_AUDIO) != 0;
+
+	/* encoders that allow it encode straight out of the circular buffer,
+	 * the frame data then only has to be copied when it wraps around the
+	 * end of the buffer */
 	for (size_t i = 0; i < encoder->planes; i++) {
-		circlebuf_pop_front(&encoder->audio_input_buffer[i],
-				encoder->audio_output_buffer[i],
-				encoder->framesize_bytes);
+		struct circlebuf_span span;
+
+		circlebuf_peek_span(&encoder->audio_input_buffer[i],
+				encoder->framesize_bytes, &span);
+
+		if (!direct || span.size[1]) {
+			memcpy(encoder->audio_output_buffer[i],
+					span.data[0], span.size[0]);
+			memcpy(encoder->audio_output_buffer[i] + span.size[0],
+					span.data[1], span.size[1]);
+			enc_frame.data[i] = encoder->audio_output_buffer[i];
+		} else {
+			enc_frame.data[i] = span.data[0];
+		}
 
-		enc_frame.data[i]     = encoder->audio_output_buffer[i];
 		enc_frame.linesize[i] = (uint32_t)encoder->framesize_bytes;
 	}
 
 	enc_frame.frames = (uint32_t)encoder->framesize;
 	enc_frame.pts    = encoder->cur_pts;
 
-	do_encode(encoder, &enc_frame);
+	do_encode(encoder, &enc_frame, NULL);
+
+	for (size_t i = 0; i < encoder->planes; i++)
+		circlebuf_consume(&encoder->audio_input_buffer[i],
+				encoder->framesize_bytes);
 
 	encoder->cur_pts += encoder->framesize;
 }
@@ -664,3 +1291,44 @@ void obs_free_encoder_packet(struct encoder_packet *packet)
 	bfree(packet->data);
 	memset(packet, 0, sizeof(struct encoder_packet));
 }
+
+/* reference counted packet data is preceded by its reference count */
+void obs_encoder_packet_create_instance(struct encoder_packet *dst,
+		const struct encoder_packet *src)
+{
+	long *p_refs;
+
+	*dst = *src;
+
+	p_refs = bmalloc(sizeof(long) + src->size);
+	*p_refs = 1;
+
+	dst->data = (uint8_t*)(p_refs + 1);
+	memcpy(dst->data, src->data, src->size);
+}
+
+void obs_encoder_packet_ref(struct encoder_packet *dst,
+		struct encoder_packet *src)
+{
+	if (!src) return;
+
+	if (src->data) {
+		long *p_refs = ((long*)src->data) - 1;
+		os_atomic_inc_long(p_refs);
+	}
+
+	*dst = *src;
+}
+
+void obs_encoder_packet_release(struct encoder_packet *packet)
+{
+	if (!packet) return;
+
+	if (packet->data) {
+		long *p_refs = ((long*)packet->data) - 1;
+		if (os_atomic_dec_long(p_refs) == 0)
+			bfree(p_refs);
+	}
+
+	memset(packet, 0, sizeof(struct encoder_packet));
+}
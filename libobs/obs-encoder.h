@@ -17,6 +17,19 @@
 
 #pragma once
 
+/**
+ * Encoder can encode directly from the GPU output texture (see
+ * obs_encoder_info::encode_texture), skipping the download to system memory.
+ */
+#define OBS_ENCODER_CAP_GPU_TEXTURE (1<<0)
+
+/**
+ * Audio encoder only reads the frame data during the encode call, so it can be
+ * given a pointer straight in to the encoder's input buffer instead of a copy.
+ * The data must not be modified or used after encode returns.
+ */
+#define OBS_ENCODER_CAP_DIRECT_AUDIO (1<<1)
+
 /** Specifies the encoder type */
 enum obs_encoder_type {
 	OBS_ENCODER_AUDIO,
@@ -38,12 +51,28 @@ struct encoder_packet {
 
 	bool                  keyframe;     /**< Is a keyframe */
 
+	/**
+	 * Video data is already in AVCC format
+	 *
+	 * Each NAL unit is preceded by its size as a 32 bit big endian value
+	 * instead of a start code, and the encoder has set the keyframe and
+	 * priority values itself, so the data doesn't have to be parsed
+	 * again.  Extra data is still expected to use start codes.
+	 */
+	bool                  avcc;
+
 	/* ---------------------------------------------------------------- */
 	/* Internal video variables (will be parsed automatically) */
 
 	/* DTS in microseconds */
 	int64_t               dts_usec;
 
+	/**
+	 * DTS in system time microseconds.  Outputs make dts_usec relative
+	 * to the start of the output, this stays the same.
+	 */
+	int64_t               sys_dts_usec;
+
 	/**
 	 * Packet priority
 	 *
@@ -59,6 +88,12 @@ struct encoder_packet {
 	 * priority or higher to continue transmission.
 	 */
 	int                   drop_priority;
+
+	/** Audio track of the output this packet is for */
+	size_t                track_idx;
+
+	/** Encoder that created this packet */
+	obs_encoder_t         encoder;
 };
 
 /** Encoder input frame */
@@ -74,6 +109,21 @@ struct encoder_frame {
 
 	/** Presentation timestamp */
 	int64_t               pts;
+
+	/**
+	 * Video only:  true if the frame is the same as the previous frame
+	 * given to the encoder.  Encoders may skip it (making the stream
+	 * variable frame rate) or encode it more cheaply, but are still
+	 * given every frame.  Texture encoders never get this.
+	 */
+	bool                  duplicate;
+
+	/**
+	 * Video only:  true if a keyframe was requested with
+	 * obs_encoder_request_keyframe.  The encoder should make this frame
+	 * a keyframe (IDR for h264).  Texture encoders never get this.
+	 */
+	bool                  force_keyframe;
 };
 
 /**
@@ -162,7 +212,16 @@ struct obs_encoder_info {
 
 	/**
 	 * Updates the settings for this encoder (usually used for things like
-	 * changeing birate while active)
+	 * changing bitrate while active)
+	 *
+	 * While the encoder is active this may be called from any thread,
+	 * though never at the same time as encode or encode_texture, which
+	 * libobs serializes it with.  Video encoders are expected to apply
+	 * changes to the bitrate, the buffer size (VBV) and the keyframe
+	 * interval to the running encoder without restarting it, so outputs
+	 * can adjust them mid-stream.  If a
+	 * changed setting can't be applied live, return false and keep
+	 * encoding with the old settings.
 	 *
 	 * @param  data      Data associated with this encoder context
 	 * @param  settings  New settings for this encoder
@@ -211,6 +270,41 @@ struct obs_encoder_info {
 	 *                    otherwise
 	 */
 	bool (*video_info)(void *data, struct video_scale_info *info);
+
+	/**
+	 * Encoder capability flags (OBS_ENCODER_CAP_*)
+	 */
+	uint32_t caps;
+
+	/**
+	 * Video encoder only:  Encodes a frame straight from the GPU.  Used
+	 * instead of encode when OBS_ENCODER_CAP_GPU_TEXTURE is set, the
+	 * encoder is on the main video output and video_info does not request
+	 * a different format.
+	 *
+	 * Called from the graphics thread within the graphics context, or
+	 * from the encode device thread within the encode device's context
+	 * if there is one (see obs_encode_graphics).  Use texture_getobj to
+	 * get the native texture object (ID3D11Texture2D with D3D11, pointer
+	 * to the GLuint texture name with OpenGL).  The texture is only valid
+	 * for the duration of the call, so the encoder must copy or submit it
+	 * before returning.
+	 *
+	 * The texture is the output texture at the output size.  With GPU
+	 * conversion its color is already in YUV (U in red, Y in green, V in
+	 * blue), otherwise it is RGBA.
+	 *
+	 * @param       data             Data associated with this encoder
+	 *                               context
+	 * @param       texture          Output texture for this frame
+	 * @param       pts              Presentation timestamp
+	 * @param[out]  packet           Encoder packet output, if any
+	 * @param[out]  received_packet  Set to true if a packet was received,
+	 *                               false otherwise
+	 * @return                       true if successful, false otherwise.
+	 */
+	bool (*encode_texture)(void *data, texture_t texture, int64_t pts,
+			struct encoder_packet *packet, bool *received_packet);
 };
 
 EXPORT void obs_register_encoder_s(const struct obs_encoder_info *info,
@@ -0,0 +1,279 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "obs-internal.h"
+
+/*
+ * GPU time is measured with timer queries, which are issued while a frame is
+ * rendered and read back when their frame comes around in the ring again.
+ * By then the GPU has almost always finished them, and results that still
+ * aren't ready are dropped instead of waited on, so measuring never stalls
+ * the video thread.
+ *
+ *   Everything here is only used in the graphics context of the video, which
+ * is what serializes the video thread with anything else rendering in it.
+ */
+
+static const char *stage_point_names[OBS_GPU_STAGE_COUNT] = {
+	"gpu_render_main",
+	"gpu_render_output",
+	"gpu_convert",
+	"gpu_scaled_outputs",
+	"gpu_canvases",
+	"gpu_displays"
+};
+
+void obs_gpu_timing_init(struct obs_gpu_timing *timing)
+{
+	memset(timing, 0, sizeof(struct obs_gpu_timing));
+
+	for (size_t i = 0; i < OBS_GPU_STAGE_COUNT; i++)
+		timing->stage_points[i] = profile_point_get(
+				stage_point_names[i]);
+}
+
+static void release_samples(struct obs_gpu_frame *frame)
+{
+	for (size_t i = 0; i < frame->samples.num; i++)
+		obs_source_release(frame->samples.array[i].source);
+
+	da_resize(frame->samples, 0);
+	frame->pending = false;
+}
+
+void obs_gpu_timing_free(struct obs_gpu_timing *timing)
+{
+	graphics_t graphics = obs->video.graphics;
+
+	if (!graphics)
+		return;
+
+	gs_entercontext(graphics);
+
+	if (timing->cur_frame)
+		gputimer_range_end(timing->cur_frame->range);
+	timing->cur_frame = NULL;
+
+	for (size_t i = 0; i < GPU_TIMING_FRAMES; i++) {
+		struct obs_gpu_frame *frame = timing->frames+i;
+
+		release_samples(frame);
+		da_free(frame->samples);
+
+		for (size_t j = 0; j < frame->timers.num; j++)
+			gputimer_destroy(frame->timers.array[j]);
+		da_free(frame->timers);
+
+		gputimer_range_destroy(frame->range);
+		frame->range = NULL;
+	}
+
+	gs_leavecontext();
+}
+
+static inline uint64_t ticks_to_ns(uint64_t ticks, uint64_t frequency)
+{
+	return (uint64_t)((double)ticks * 1000000000.0 / (double)frequency);
+}
+
+static inline void add_source_time(struct obs_source *source, long frame_id,
+		enum obs_gpu_sample_type type, uint64_t ns)
+{
+	if (source->gpu_time_frame != frame_id) {
+		source->gpu_time_frame = frame_id;
+		source->gpu_time_sum   = 0;
+		source->gpu_pass_sum   = 0;
+	}
+
+	if (type == GPU_SAMPLE_SOURCE)
+		source->gpu_time_sum += ns;
+	else
+		source->gpu_pass_sum += ns;
+}
+
+static void resolve_frame(struct obs_gpu_timing *timing,
+		struct obs_gpu_frame *frame)
+{
+	uint64_t stage_ns[OBS_GPU_STAGE_COUNT] = {0};
+	bool     stage_used[OBS_GPU_STAGE_COUNT] = {false};
+	uint64_t frequency;
+	bool     disjoint;
+	long     frame_id;
+
+	if (!gputimer_range_get_data(frame->range, &disjoint, &frequency) ||
+	    disjoint || !frequency) {
+		release_samples(frame);
+		return;
+	}
+
+	frame_id = os_atomic_inc_long(&timing->resolved);
+
+	for (size_t i = 0; i < frame->samples.num; i++) {
+		struct obs_gpu_sample *sample = frame->samples.array+i;
+		uint64_t ticks, ns;
+
+		if (!gputimer_get_data(frame->timers.array[i], &ticks))
+			continue;
+
+		ns = ticks_to_ns(ticks, frequency);
+
+		if (sample->type == GPU_SAMPLE_STAGE) {
+			stage_ns[sample->stage]  += ns;
+			stage_used[sample->stage] = true;
+		} else {
+			add_source_time(sample->source, frame_id,
+					sample->type, ns);
+		}
+	}
+
+	/* sums are only published once the frame is complete, a source can
+	 * be rendered more than once per frame */
+	for (size_t i = 0; i < frame->samples.num; i++) {
+		struct obs_source *source = frame->samples.array[i].source;
+
+		if (source && source->gpu_time_frame == frame_id) {
+			os_atomic_set_long(&source->gpu_time_us,
+					(long)(source->gpu_time_sum / 1000));
+			os_atomic_set_long(&source->gpu_pass_us,
+					(long)(source->gpu_pass_sum / 1000));
+		}
+	}
+
+	for (size_t i = 0; i < OBS_GPU_STAGE_COUNT; i++) {
+		if (!stage_used[i])
+			continue;
+
+		os_atomic_set_long(&timing->stage_time_us[i],
+				(long)(stage_ns[i] / 1000));
+		profile_add_sample(timing->stage_points[i], stage_ns[i]);
+		trace_counter(stage_point_names[i],
+				(double)stage_ns[i] / 1000000.0);
+	}
+
+	release_samples(frame);
+}
+
+void obs_gpu_timing_frame(struct obs_gpu_timing *timing)
+{
+	struct obs_gpu_frame *frame;
+
+	if (timing->cur_frame) {
+		gputimer_range_end(timing->cur_frame->range);
+		timing->cur_frame->pending = true;
+		timing->cur_frame = NULL;
+	}
+
+	frame = timing->frames + timing->next_frame;
+	if (++timing->next_frame == GPU_TIMING_FRAMES)
+		timing->next_frame = 0;
+
+	if (frame->pending)
+		resolve_frame(timing, frame);
+
+	if ((!profiler_enabled() && !trace_enabled()) || timing->unsupported)
+		return;
+
+	if (!frame->range) {
+		frame->range = gs_create_timer_range();
+		if (!frame->range) {
+			blog(LOG_INFO, "GPU timer queries aren't supported, "
+			               "GPU time won't be measured");
+			timing->unsupported = true;
+			return;
+		}
+	}
+
+	gputimer_range_begin(frame->range);
+	timing->cur_frame = frame;
+}
+
+static gputimer_t get_timer(struct obs_gpu_frame *frame)
+{
+	size_t idx = frame->samples.num;
+	gputimer_t timer;
+
+	if (idx < frame->timers.num)
+		return frame->timers.array[idx];
+
+	timer = gs_create_timer();
+	if (timer)
+		da_push_back(frame->timers, &timer);
+	return timer;
+}
+
+gputimer_t obs_gpu_timer_begin(enum obs_gpu_sample_type type,
+		enum obs_gpu_stage stage, struct obs_source *source)
+{
+	struct obs_gpu_timing *timing = &obs->video.gpu_timing;
+	struct obs_gpu_frame  *frame  = timing->cur_frame;
+	struct obs_gpu_sample *sample;
+	gputimer_t timer;
+
+	if (!frame || gs_getcontext() != obs->video.graphics)
+		return NULL;
+
+	timer = get_timer(frame);
+	if (!timer)
+		return NULL;
+
+	sample = da_push_back_new(frame->samples);
+	sample->type   = type;
+	sample->stage  = stage;
+	sample->source = source;
+	if (source)
+		obs_source_addref(source);
+
+	gputimer_begin(timer);
+	return timer;
+}
+
+static inline double us_to_ms(long us)
+{
+	return (double)us / 1000.0;
+}
+
+double obs_get_gpu_stage_time_ms(enum obs_gpu_stage stage)
+{
+	if (!obs || stage >= OBS_GPU_STAGE_COUNT)
+		return 0.0;
+
+	return us_to_ms(obs->video.gpu_timing.stage_time_us[stage]);
+}
+
+/* a source that hasn't been rendered in the last few resolved frames keeps
+ * its old sums, so they're treated as stale */
+static inline bool source_time_valid(obs_source_t source)
+{
+	long resolved = obs->video.gpu_timing.resolved;
+	return resolved - source->gpu_time_frame < GPU_TIMING_FRAMES;
+}
+
+double obs_source_get_gpu_time_ms(obs_source_t source)
+{
+	if (!obs || !source || !source_time_valid(source))
+		return 0.0;
+
+	return us_to_ms(source->gpu_time_us);
+}
+
+double obs_filter_get_gpu_pass_time_ms(obs_source_t filter)
+{
+	if (!obs || !filter || !source_time_valid(filter))
+		return 0.0;
+
+	return us_to_ms(filter->gpu_pass_us);
+}
@@ -0,0 +1,236 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "obs-internal.h"
+
+/* uploads are dropped while more than this much data is waiting, so a
+ * stalled video thread can't make the queue grow without bound */
+#define MAX_PENDING_UPLOAD_SIZE (256 * 1024 * 1024)
+
+enum graphics_cmd_type {
+	GRAPHICS_CMD_TASK,
+	GRAPHICS_CMD_SETIMAGE,
+	GRAPHICS_CMD_SETIMAGE_REGION,
+	GRAPHICS_CMD_DESTROY_TEXTURE
+};
+
+/* commands are stored in the ring buffer, followed by <size> bytes of
+ * upload data */
+struct graphics_cmd {
+	enum graphics_cmd_type type;
+	obs_graphics_task_t    task;
+	void                   *param;
+	texture_t              texture;
+	uint32_t               linesize;
+	uint32_t               x, y, cx, cy;
+	bool                   flip;
+	size_t                 size;
+};
+
+bool obs_init_graphics_queue(void)
+{
+	struct obs_graphics_queue *queue = &obs->video.graphics_queue;
+
+	circlebuf_init(&queue->commands);
+	da_init(queue->upload_data);
+	queue->num_commands   = 0;
+	queue->pending_upload = 0;
+	queue->dropping       = false;
+
+	return pthread_mutex_init(&queue->mutex, NULL) == 0;
+}
+
+void obs_free_graphics_queue(void)
+{
+	struct obs_graphics_queue *queue = &obs->video.graphics_queue;
+
+	/* run whatever is left so that queued destroys still happen */
+	obs_execute_graphics_queue();
+
+	circlebuf_free(&queue->commands);
+	da_free(queue->upload_data);
+	pthread_mutex_destroy(&queue->mutex);
+}
+
+static void push_command(struct obs_graphics_queue *queue,
+		const struct graphics_cmd *cmd, const void *data)
+{
+	circlebuf_push_back(&queue->commands, cmd, sizeof(*cmd));
+	if (cmd->size)
+		circlebuf_push_back(&queue->commands, data, cmd->size);
+
+	queue->num_commands++;
+}
+
+void obs_queue_graphics_task(obs_graphics_task_t task, void *param)
+{
+	struct obs_graphics_queue *queue;
+	struct graphics_cmd cmd = {0};
+
+	if (!obs || !task)
+		return;
+
+	queue = &obs->video.graphics_queue;
+	cmd.type  = GRAPHICS_CMD_TASK;
+	cmd.task  = task;
+	cmd.param = param;
+
+	pthread_mutex_lock(&queue->mutex);
+	push_command(queue, &cmd, NULL);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+void obs_queue_texture_destroy(texture_t tex)
+{
+	struct obs_graphics_queue *queue;
+	struct graphics_cmd cmd = {0};
+
+	if (!obs || !tex)
+		return;
+
+	queue = &obs->video.graphics_queue;
+	cmd.type    = GRAPHICS_CMD_DESTROY_TEXTURE;
+	cmd.texture = tex;
+
+	pthread_mutex_lock(&queue->mutex);
+	push_command(queue, &cmd, NULL);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+static bool push_upload(struct obs_graphics_queue *queue,
+		const struct graphics_cmd *cmd, const void *data)
+{
+	bool success = true;
+
+	pthread_mutex_lock(&queue->mutex);
+
+	if (queue->pending_upload + cmd->size > MAX_PENDING_UPLOAD_SIZE) {
+		if (!queue->dropping)
+			blog(LOG_WARNING, "Too much texture upload data "
+			                  "pending, dropping uploads");
+		queue->dropping = true;
+		success = false;
+	} else {
+		queue->dropping = false;
+		queue->pending_upload += cmd->size;
+		push_command(queue, cmd, data);
+	}
+
+	pthread_mutex_unlock(&queue->mutex);
+	return success;
+}
+
+bool obs_queue_texture_setimage(texture_t tex, const void *data,
+		uint32_t linesize, uint32_t height, bool flip)
+{
+	struct graphics_cmd cmd = {0};
+
+	if (!obs || !tex || !data)
+		return false;
+
+	cmd.type     = GRAPHICS_CMD_SETIMAGE;
+	cmd.texture  = tex;
+	cmd.linesize = linesize;
+	cmd.flip     = flip;
+	cmd.size     = (size_t)linesize * (size_t)height;
+
+	return push_upload(&obs->video.graphics_queue, &cmd, data);
+}
+
+bool obs_queue_texture_setimage_region(texture_t tex, const void *data,
+		uint32_t linesize, uint32_t x, uint32_t y,
+		uint32_t cx, uint32_t cy)
+{
+	struct graphics_cmd cmd = {0};
+
+	if (!obs || !tex || !data || !cx || !cy)
+		return false;
+
+	cmd.type     = GRAPHICS_CMD_SETIMAGE_REGION;
+	cmd.texture  = tex;
+	cmd.linesize = linesize;
+	cmd.x        = x;
+	cmd.y        = y;
+	cmd.cx       = cx;
+	cmd.cy       = cy;
+	cmd.size     = (size_t)linesize * (size_t)cy;
+
+	return push_upload(&obs->video.graphics_queue, &cmd, data);
+}
+
+static inline void execute_command(struct obs_graphics_queue *queue,
+		struct graphics_cmd *cmd)
+{
+	switch (cmd->type) {
+	case GRAPHICS_CMD_TASK:
+		cmd->task(cmd->param);
+		break;
+
+	case GRAPHICS_CMD_SETIMAGE:
+		texture_setimage(cmd->texture, queue->upload_data.array,
+				cmd->linesize, cmd->flip);
+		break;
+
+	case GRAPHICS_CMD_SETIMAGE_REGION:
+		if (!texture_setimage_region(cmd->texture, cmd->x, cmd->y,
+					cmd->cx, cmd->cy, queue->upload_data.array,
+					cmd->linesize))
+			blog(LOG_WARNING, "Texture region update failed");
+		break;
+
+	case GRAPHICS_CMD_DESTROY_TEXTURE:
+		texture_destroy(cmd->texture);
+		break;
+	}
+}
+
+void obs_execute_graphics_queue(void)
+{
+	struct obs_graphics_queue *queue = &obs->video.graphics_queue;
+	struct graphics_cmd cmd;
+	size_t count;
+
+	pthread_mutex_lock(&queue->mutex);
+	count = queue->num_commands;
+	pthread_mutex_unlock(&queue->mutex);
+
+	if (!count)
+		return;
+
+	gs_entercontext(obs->video.graphics);
+
+	/* only run the commands that were queued before this point, tasks
+	 * that queue more work have to wait until the next frame */
+	while (count--) {
+		pthread_mutex_lock(&queue->mutex);
+
+		circlebuf_pop_front(&queue->commands, &cmd, sizeof(cmd));
+		if (cmd.size) {
+			da_resize(queue->upload_data, cmd.size);
+			circlebuf_pop_front(&queue->commands,
+					queue->upload_data.array, cmd.size);
+			queue->pending_upload -= cmd.size;
+		}
+
+		queue->num_commands--;
+		pthread_mutex_unlock(&queue->mutex);
+
+		execute_command(queue, &cmd);
+	}
+
+	gs_leavecontext();
+}
@@ -0,0 +1,694 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "util/platform.h"
+#include "graphics/texture-compress.h"
+#include "obs-internal.h"
+
+/* images no larger than this in either dimension are packed into atlases */
+#define IMAGE_ATLAS_SIZE        1024
+#define IMAGE_ATLAS_MAX_IMAGE   256
+#define IMAGE_ATLAS_PADDING     1
+
+#define IMAGE_LOAD_THREADS      2
+
+enum image_state {
+	IMAGE_LOADING,
+	IMAGE_LOADED,
+	IMAGE_FAILED
+};
+
+struct obs_image_atlas {
+	texture_t               texture;
+	enum gs_color_format    format;
+	long                    refs;
+
+	/* simple shelf packer, space is reclaimed when the atlas empties */
+	uint32_t                shelf_x;
+	uint32_t                shelf_y;
+	uint32_t                shelf_cy;
+};
+
+/* decoded image, waiting to be uploaded.  loaders with a shared context
+ * upload it themselves, then it's only waiting for the fence */
+struct image_data {
+	uint8_t                 *data;
+	enum gs_color_format    format;
+	uint32_t                cx;
+	uint32_t                cy;
+
+	bool                    compressed;
+	struct gs_compressed_image compressed_image;
+
+	texture_t               texture;
+	gpufence_t              fence;
+};
+
+struct obs_image {
+	char                    *path;
+	int64_t                 mtime;
+	long                    refs;
+	volatile long           state;
+
+	/* filled in by the loader threads for async images */
+	struct image_data       pending;
+
+	uint32_t                cx;
+	uint32_t                cy;
+	texture_t               texture;
+	bool                    compressed;
+
+	struct obs_image_atlas  *atlas;
+	uint32_t                x;
+	uint32_t                y;
+
+	struct obs_image        *next;
+	struct obs_image        **prev_next;
+};
+
+bool obs_init_image_cache(void)
+{
+	struct obs_image_cache *cache = &obs->video.image_cache;
+
+	cache->use_atlas = true;
+	return pthread_mutex_init(&cache->mutex, NULL) == 0;
+}
+
+static void atlas_destroy(struct obs_image_cache *cache,
+		struct obs_image_atlas *atlas)
+{
+	da_erase_item(cache->atlases, &atlas);
+	texture_destroy(atlas->texture);
+	bfree(atlas);
+}
+
+static void free_image_data(struct image_data *idata)
+{
+	if (idata->compressed)
+		gs_compressed_image_free(&idata->compressed_image);
+	texture_destroy(idata->texture);
+	gpufence_destroy(idata->fence);
+	bfree(idata->data);
+	memset(idata, 0, sizeof(struct image_data));
+}
+
+static void image_destroy(struct obs_image_cache *cache,
+		struct obs_image *image)
+{
+	if (image->prev_next)
+		*image->prev_next = image->next;
+	if (image->next)
+		image->next->prev_next = image->prev_next;
+
+	if (image->atlas) {
+		if (--image->atlas->refs == 0)
+			atlas_destroy(cache, image->atlas);
+	} else {
+		texture_destroy(image->texture);
+	}
+
+	free_image_data(&image->pending);
+	bfree(image->path);
+	bfree(image);
+}
+
+/* called with the graphics context entered, before the graphics queue is
+ * freed so that no more uploads can be queued after it */
+void obs_stop_image_loaders(void)
+{
+	struct obs_image_cache *cache = &obs->video.image_cache;
+
+	pthread_mutex_lock(&cache->mutex);
+	cache->stop_loading = true;
+	pthread_mutex_unlock(&cache->mutex);
+
+	if (!cache->loaders.num)
+		return;
+
+	for (size_t i = 0; i < cache->loaders.num; i++)
+		os_sem_post(cache->load_sem);
+	for (size_t i = 0; i < cache->loaders.num; i++)
+		pthread_join(cache->loaders.array[i], NULL);
+
+	pthread_mutex_lock(&cache->mutex);
+
+	/* images that never got decoded, the loaders held a reference */
+	for (size_t i = 0; i < cache->load_queue.num; i++) {
+		struct obs_image *image = cache->load_queue.array[i];
+
+		os_atomic_set_long(&image->state, IMAGE_FAILED);
+		if (--image->refs == 0)
+			image_destroy(cache, image);
+	}
+
+	da_free(cache->load_queue);
+	pthread_mutex_unlock(&cache->mutex);
+
+	da_free(cache->loaders);
+	os_sem_destroy(cache->load_sem);
+	cache->load_sem = NULL;
+}
+
+void obs_free_image_cache(void)
+{
+	struct obs_image_cache *cache = &obs->video.image_cache;
+	size_t leaked = 0;
+
+	while (cache->first_image) {
+		image_destroy(cache, cache->first_image);
+		leaked++;
+	}
+
+	if (leaked)
+		blog(LOG_WARNING, "%u cached images were never released",
+				(unsigned int)leaked);
+
+	while (cache->atlases.num)
+		atlas_destroy(cache, cache->atlases.array[0]);
+
+	da_free(cache->atlases);
+	pthread_mutex_destroy(&cache->mutex);
+}
+
+void obs_set_image_atlas_enabled(bool enabled)
+{
+	if (obs)
+		obs->video.image_cache.use_atlas = enabled;
+}
+
+void obs_set_image_compression_enabled(bool enabled)
+{
+	if (obs)
+		obs->video.image_cache.use_compression = enabled;
+}
+
+static struct obs_image *find_image(struct obs_image_cache *cache,
+		const char *path, int64_t mtime)
+{
+	struct obs_image *image = cache->first_image;
+
+	while (image) {
+		if (image->state != IMAGE_FAILED &&
+		    image->mtime == mtime && strcmp(image->path, path) == 0)
+			return image;
+		image = image->next;
+	}
+
+	return NULL;
+}
+
+static bool atlas_alloc(struct obs_image_atlas *atlas,
+		uint32_t cx, uint32_t cy, uint32_t *x, uint32_t *y)
+{
+	uint32_t shelf_x  = atlas->shelf_x;
+	uint32_t shelf_y  = atlas->shelf_y;
+	uint32_t shelf_cy = atlas->shelf_cy;
+
+	if (shelf_x + cx > IMAGE_ATLAS_SIZE) {
+		shelf_y += shelf_cy;
+		shelf_x  = 0;
+		shelf_cy = 0;
+	}
+
+	if (shelf_y + cy > IMAGE_ATLAS_SIZE)
+		return false;
+
+	*x = shelf_x;
+	*y = shelf_y;
+
+	atlas->shelf_x  = shelf_x + cx;
+	atlas->shelf_y  = shelf_y;
+	atlas->shelf_cy = (cy > shelf_cy) ? cy : shelf_cy;
+	return true;
+}
+
+static struct obs_image_atlas *atlas_create(struct obs_image_cache *cache,
+		enum gs_color_format format)
+{
+	struct obs_image_atlas *atlas;
+	uint8_t *zero = bzalloc(IMAGE_ATLAS_SIZE * IMAGE_ATLAS_SIZE * 4);
+	texture_t tex;
+
+	tex = gs_create_texture(IMAGE_ATLAS_SIZE, IMAGE_ATLAS_SIZE, format, 1,
+			(const void**)&zero, 0);
+	bfree(zero);
+
+	if (!tex) {
+		blog(LOG_WARNING, "Failed to create image atlas texture");
+		return NULL;
+	}
+
+	atlas = bzalloc(sizeof(struct obs_image_atlas));
+	atlas->texture = tex;
+	atlas->format  = format;
+	da_push_back(cache->atlases, &atlas);
+	return atlas;
+}
+
+static bool image_pack(struct obs_image_cache *cache, struct obs_image *image,
+		enum gs_color_format format, texture_t tex)
+{
+	uint32_t cx = image->cx + IMAGE_ATLAS_PADDING;
+	uint32_t cy = image->cy + IMAGE_ATLAS_PADDING;
+	struct obs_image_atlas *atlas = NULL;
+
+	for (size_t i = 0; i < cache->atlases.num; i++) {
+		struct obs_image_atlas *cur = cache->atlases.array[i];
+
+		if (cur->format == format &&
+		    atlas_alloc(cur, cx, cy, &image->x, &image->y)) {
+			atlas = cur;
+			break;
+		}
+	}
+
+	if (!atlas) {
+		atlas = atlas_create(cache, format);
+		if (!atlas || !atlas_alloc(atlas, cx, cy, &image->x, &image->y))
+			return false;
+	}
+
+	gs_copy_texture_region(atlas->texture, image->x, image->y,
+			tex, 0, 0, image->cx, image->cy);
+
+	image->atlas   = atlas;
+	image->texture = atlas->texture;
+	atlas->refs++;
+	return true;
+}
+
+static inline bool use_atlas(struct obs_image_cache *cache,
+		struct image_data *idata)
+{
+	return cache->use_atlas && !idata->compressed &&
+		idata->cx <= IMAGE_ATLAS_MAX_IMAGE &&
+		idata->cy <= IMAGE_ATLAS_MAX_IMAGE;
+}
+
+/* creates the texture of the image data on the current context, falling
+ * back to an uncompressed texture if the compressed one fails */
+static texture_t create_image_texture(struct image_data *idata)
+{
+	const uint8_t *data = idata->data;
+	texture_t tex;
+
+	if (idata->compressed) {
+		struct gs_compressed_image *ci = &idata->compressed_image;
+
+		tex = gs_create_texture(ci->cx, ci->cy, ci->format,
+				ci->levels, (const void**)ci->level_data, 0);
+		if (tex)
+			return tex;
+
+		gs_compressed_image_free(ci);
+		idata->compressed = false;
+	}
+
+	return gs_create_texture(idata->cx, idata->cy, idata->format, 1,
+			(const void**)&data, 0);
+}
+
+/* images small enough are copied into an atlas, the others keep the texture
+ * of the image data */
+static bool image_upload(struct obs_image_cache *cache, struct obs_image *image,
+		struct image_data *idata)
+{
+	image->cx = idata->cx;
+	image->cy = idata->cy;
+
+	if (idata->texture) {
+		gpufence_wait(idata->fence);
+	} else {
+		idata->texture = create_image_texture(idata);
+		if (!idata->texture)
+			return false;
+	}
+
+	if (use_atlas(cache, idata) &&
+	    image_pack(cache, image, idata->format, idata->texture))
+		return true;
+
+	image->texture    = idata->texture;
+	image->compressed = idata->compressed;
+	idata->texture    = NULL;
+	return true;
+}
+
+/* uploads the image data on a loader's shared context, so that only waiting
+ * for the upload and packing it into an atlas is left for the graphics
+ * queue */
+static void preload_image(graphics_t loader_graphics,
+		struct image_data *idata)
+{
+	gs_entercontext(loader_graphics);
+
+	idata->texture = create_image_texture(idata);
+	if (idata->texture) {
+		idata->fence = gs_create_fence();
+
+		/* without a fence the texture can't be handed over */
+		if (!idata->fence) {
+			texture_destroy(idata->texture);
+			idata->texture = NULL;
+		}
+	}
+
+	gs_leavecontext();
+}
+
+/* images too large for the atlases are block compressed if enabled, which
+ * only works for 8 bit per channel formats */
+static bool decode_image(struct obs_image_cache *cache, const char *path,
+		struct image_data *idata)
+{
+	memset(idata, 0, sizeof(struct image_data));
+
+	idata->data = gs_create_texture_file_data(path, &idata->format,
+			&idata->cx, &idata->cy);
+	if (!idata->data)
+		return false;
+
+	if (cache->use_compression &&
+	    (idata->cx > IMAGE_ATLAS_MAX_IMAGE ||
+	     idata->cy > IMAGE_ATLAS_MAX_IMAGE))
+		idata->compressed = gs_compress_image(&idata->compressed_image,
+				idata->data, idata->format,
+				idata->cx, idata->cy);
+
+	return true;
+}
+
+static inline void link_image(struct obs_image_cache *cache,
+		struct obs_image *image)
+{
+	image->prev_next   = &cache->first_image;
+	image->next        = cache->first_image;
+	cache->first_image = image;
+	if (image->next)
+		image->next->prev_next = &image->next;
+}
+
+/* called with the graphics context entered and the cache locked */
+static void finish_load(struct obs_image_cache *cache, struct obs_image *image,
+		struct image_data *idata)
+{
+	bool success = idata->data && image_upload(cache, image, idata);
+
+	if (!success)
+		blog(LOG_WARNING, "Failed to load image '%s'", image->path);
+
+	os_atomic_set_long(&image->state,
+			success ? IMAGE_LOADED : IMAGE_FAILED);
+}
+
+static void upload_image_task(void *param)
+{
+	struct obs_image_cache *cache = &obs->video.image_cache;
+	struct obs_image *image = param;
+
+	pthread_mutex_lock(&cache->mutex);
+
+	/* obs_image_get may have finished loading it in the meantime */
+	if (image->state == IMAGE_LOADING)
+		finish_load(cache, image, &image->pending);
+
+	free_image_data(&image->pending);
+	if (--image->refs == 0)
+		image_destroy(cache, image);
+
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+/* each loader uploads on its own shared context when the graphics module
+ * supports them, so that adding an image never costs the video thread more
+ * than a copy into an atlas */
+static graphics_t create_loader_graphics(void)
+{
+	graphics_t graphics = NULL;
+	int errorcode = gs_create_shared(obs->video.graphics, &graphics);
+
+	if (errorcode == GS_ERROR_NOT_SUPPORTED)
+		return NULL;
+	if (errorcode != GS_SUCCESS) {
+		blog(LOG_WARNING, "Failed to create a shared graphics context "
+		                  "for an image loader, uploading on the "
+		                  "video thread");
+		return NULL;
+	}
+
+	return graphics;
+}
+
+static void *image_loader_thread(void *param)
+{
+	struct obs_image_cache *cache = param;
+	graphics_t loader_graphics;
+
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "image loader");
+
+	loader_graphics = create_loader_graphics();
+
+	while (os_sem_wait(cache->load_sem) == 0) {
+		struct obs_image *image = NULL;
+		bool stop;
+
+		pthread_mutex_lock(&cache->mutex);
+		stop = cache->stop_loading;
+		if (!stop && cache->load_queue.num) {
+			image = cache->load_queue.array[0];
+			da_erase(cache->load_queue, 0);
+		}
+		pthread_mutex_unlock(&cache->mutex);
+
+		if (stop)
+			break;
+		if (!image)
+			continue;
+
+		/* a failed decode is queued too, so the task can mark it as
+		 * failed and release it */
+		if (decode_image(cache, image->path, &image->pending) &&
+		    loader_graphics)
+			preload_image(loader_graphics, &image->pending);
+
+		obs_queue_graphics_task(upload_image_task, image);
+	}
+
+	gs_destroy(loader_graphics);
+	return NULL;
+}
+
+/* called with the cache locked */
+static bool start_loaders(struct obs_image_cache *cache)
+{
+	if (cache->loaders.num)
+		return true;
+	if (cache->stop_loading)
+		return false;
+	if (os_sem_init(&cache->load_sem, 0) != 0)
+		return false;
+
+	for (size_t i = 0; i < IMAGE_LOAD_THREADS; i++) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, image_loader_thread,
+					cache) == 0)
+			da_push_back(cache->loaders, &thread);
+	}
+
+	if (!cache->loaders.num) {
+		blog(LOG_WARNING, "Failed to create image loader threads");
+		os_sem_destroy(cache->load_sem);
+		cache->load_sem = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+obs_image_t obs_image_get_async(const char *path)
+{
+	struct obs_image_cache *cache;
+	struct obs_image *image;
+	int64_t mtime;
+
+	if (!obs || !path || !*path)
+		return NULL;
+
+	obs_wait_video_reset();
+	cache = &obs->video.image_cache;
+	mtime = os_get_file_mtime(path);
+	if (mtime < 0) {
+		blog(LOG_WARNING, "obs_image_get_async: Could not stat '%s'",
+				path);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&cache->mutex);
+
+	image = find_image(cache, path, mtime);
+	if (image) {
+		image->refs++;
+		pthread_mutex_unlock(&cache->mutex);
+		return image;
+	}
+
+	if (!start_loaders(cache)) {
+		pthread_mutex_unlock(&cache->mutex);
+		return obs_image_get(path);
+	}
+
+	/* the loaders hold the second reference until it's uploaded */
+	image = bzalloc(sizeof(struct obs_image));
+	image->path  = bstrdup(path);
+	image->mtime = mtime;
+	image->refs  = 2;
+	image->state = IMAGE_LOADING;
+	link_image(cache, image);
+	da_push_back(cache->load_queue, &image);
+
+	pthread_mutex_unlock(&cache->mutex);
+
+	os_sem_post(cache->load_sem);
+	return image;
+}
+
+obs_image_t obs_image_get(const char *path)
+{
+	struct obs_image_cache *cache;
+	struct obs_image *image;
+	struct image_data idata;
+	int64_t mtime;
+
+	if (!obs || !path || !*path)
+		return NULL;
+
+	obs_wait_video_reset();
+	cache = &obs->video.image_cache;
+	mtime = os_get_file_mtime(path);
+	if (mtime < 0) {
+		blog(LOG_WARNING, "obs_image_get: Could not stat '%s'", path);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&cache->mutex);
+	image = find_image(cache, path, mtime);
+	if (image)
+		image->refs++;
+	pthread_mutex_unlock(&cache->mutex);
+
+	if (image && image->state != IMAGE_LOADING)
+		return image;
+
+	/* images that are still loading asynchronously are finished here
+	 * instead of waiting for the loaders, which could be waiting for
+	 * the graphics context held by the caller */
+	decode_image(cache, path, &idata);
+
+	gs_entercontext(obs->video.graphics);
+	pthread_mutex_lock(&cache->mutex);
+
+	/* another thread may have loaded the same file in the meantime */
+	if (!image) {
+		image = find_image(cache, path, mtime);
+		if (image)
+			image->refs++;
+	}
+
+	if (image) {
+		if (image->state == IMAGE_LOADING)
+			finish_load(cache, image, &idata);
+
+	} else {
+		image = bzalloc(sizeof(struct obs_image));
+		image->path  = bstrdup(path);
+		image->mtime = mtime;
+		image->refs  = 1;
+		image->state = IMAGE_LOADING;
+		link_image(cache, image);
+		finish_load(cache, image, &idata);
+	}
+
+	if (image->state == IMAGE_FAILED) {
+		if (--image->refs == 0)
+			image_destroy(cache, image);
+		image = NULL;
+	}
+
+	pthread_mutex_unlock(&cache->mutex);
+
+	free_image_data(&idata);
+	gs_leavecontext();
+	return image;
+}
+
+bool obs_image_loaded(obs_image_t image)
+{
+	return image && image->state == IMAGE_LOADED;
+}
+
+void obs_image_release(obs_image_t image)
+{
+	struct obs_image_cache *cache;
+
+	if (!obs || !image)
+		return;
+
+	cache = &obs->video.image_cache;
+
+	gs_entercontext(obs->video.graphics);
+	pthread_mutex_lock(&cache->mutex);
+
+	if (--image->refs == 0)
+		image_destroy(cache, image);
+
+	pthread_mutex_unlock(&cache->mutex);
+	gs_leavecontext();
+}
+
+uint32_t obs_image_getwidth(obs_image_t image)
+{
+	return obs_image_loaded(image) ? image->cx : 0;
+}
+
+uint32_t obs_image_getheight(obs_image_t image)
+{
+	return obs_image_loaded(image) ? image->cy : 0;
+}
+
+texture_t obs_image_gettexture(obs_image_t image)
+{
+	return obs_image_loaded(image) ? image->texture : NULL;
+}
+
+void obs_image_draw(obs_image_t image, effect_t effect)
+{
+	eparam_t param;
+
+	if (!obs_image_loaded(image))
+		return;
+
+	param = effect_getparambyname(effect, "image");
+	effect_settexture(effect, param, image->texture);
+
+	/* compressed textures are padded to whole blocks */
+	if (image->atlas || image->compressed)
+		gs_draw_sprite_subregion(image->texture, 0, image->x, image->y,
+				image->cx, image->cy);
+	else
+		gs_draw_sprite(image->texture, 0, 0, 0);
+}
@@ -21,6 +21,7 @@
 #include "util/darray.h"
 #include "util/circlebuf.h"
 #include "util/dstr.h"
+#include "util/hash.h"
 #include "util/threading.h"
 #include "callback/signal.h"
 #include "callback/proc.h"
@@ -29,11 +30,22 @@
 
 #include "media-io/audio-resampler.h"
 #include "media-io/video-io.h"
+#include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
 
 #include "obs.h"
 
-#define NUM_TEXTURES 2
+/* frames that can be in flight between rendering and CPU readback */
+#define NUM_TEXTURES     2
+#define MAX_NUM_TEXTURES 4
+
+/* each downscale level halves the base texture, so 16x at most */
+#define MAX_DOWNSCALE_LEVELS 4
+
+/* the main output stages into a ring this much deeper than the texture
+ * pipeline, so copies get a few more frames to finish before they're read */
+#define NUM_EXTRA_STAGE_SURFACES 2
+#define MAX_NUM_STAGE_SURFACES   (MAX_NUM_TEXTURES + NUM_EXTRA_STAGE_SURFACES)
 #define MICROSECOND_DEN 1000000
 
 static inline int64_t packet_dts_usec(struct encoder_packet *packet)
@@ -49,13 +61,63 @@ struct draw_callback {
 /* ------------------------------------------------------------------------- */
 /* modules */
 
+enum obs_module_type_kind {
+	MODULE_TYPE_INPUT,
+	MODULE_TYPE_FILTER,
+	MODULE_TYPE_TRANSITION,
+	MODULE_TYPE_OUTPUT,
+	MODULE_TYPE_ENCODER,
+	MODULE_TYPE_SERVICE,
+	MODULE_TYPE_COUNT
+};
+
+struct obs_module_type {
+	enum obs_module_type_kind kind;
+	char                      *id;
+};
+
 struct obs_module {
-	char *name;
-	void *module;
+	char                           *name;
+	void                           *module;
+	int64_t                        mtime;
+
+	/* types registered by the module, for deferred modules these come
+	 * from the module manifest */
+	DARRAY(struct obs_module_type) types;
 };
 
 extern void free_module(struct obs_module *mod);
 
+/* loads the deferred module that registers the type, if there is one */
+extern bool obs_load_deferred_type(enum obs_module_type_kind kind,
+		const char *id);
+
+/* loads all deferred modules that register types of the given kind */
+extern void obs_load_deferred_kind(enum obs_module_type_kind kind);
+
+struct obs_type_slot {
+	const char *id;
+	uint32_t   hash;
+	size_t     idx;
+};
+
+/* open addressing index of type ids to their position in a type array.  ids
+ * point to the registered info's string, which stays valid for as long as
+ * its module is loaded */
+struct obs_type_index {
+	struct obs_type_slot *slots;
+	size_t               num_slots;
+	size_t               num;
+};
+
+/* the first type registered with an id is kept if there are duplicates */
+extern void obs_type_index_insert(struct obs_type_index *index,
+		const char *id, size_t idx);
+/* returns DARRAY_INVALID if not found */
+extern size_t obs_type_index_find(const struct obs_type_index *index,
+		const char *id);
+extern void obs_type_index_free(struct obs_type_index *index);
+
 
 /* ------------------------------------------------------------------------- */
 /* views */
@@ -63,17 +125,65 @@ extern void free_module(struct obs_module *mod);
 struct obs_view {
 	pthread_mutex_t                 channels_mutex;
 	obs_source_t                    channels[MAX_CHANNELS];
+
+	/* sources preloaded to be set as the channels next */
+	obs_source_t                    preloads[MAX_CHANNELS];
+
+	/* incremented whenever a channel changes */
+	volatile long                   revision;
 };
 
 extern bool obs_view_init(struct obs_view *view);
 extern void obs_view_free(struct obs_view *view);
 
+/* ends the preload of the channel if it's the given source, called once the
+ * source has been set as the channel */
+extern void obs_view_consume_preload(struct obs_view *view, uint32_t channel,
+		obs_source_t source);
+
+/* like obs_source_get_content_revision, for everything the view renders */
+extern bool obs_view_get_content_revision(struct obs_view *view,
+		uint64_t *revision);
+
+
+/* ------------------------------------------------------------------------- */
+/* canvases */
+
+/* an additional video mix with its own view, resolution, and frame rate.
+ * canvases are rendered on the video thread from the same source ticks as
+ * the main output, and output RGBA frames through their own video_t */
+struct obs_canvas {
+	struct obs_view                 view;
+	video_t                         video;
+
+	uint32_t                        base_width;
+	uint32_t                        base_height;
+	uint32_t                        output_width;
+	uint32_t                        output_height;
+	uint64_t                        frame_time;
+	uint64_t                        next_time;
+
+	texture_t                       render_texture;
+	texture_t                       output_texture;
+	stagesurf_t                     copy_surfaces[NUM_TEXTURES];
+	bool                            textures_copied[NUM_TEXTURES];
+	uint64_t                        copied_timestamps[NUM_TEXTURES];
+	stagesurf_t                     mapped_surface;
+	int                             cur_texture;
+
+	struct obs_canvas               *next;
+	struct obs_canvas               **prev_next;
+};
+
+extern void obs_render_canvases(uint64_t timestamp);
+
 
 /* ------------------------------------------------------------------------- */
 /* displays */
 
 struct obs_display {
 	bool                            size_changed;
+	bool                            visible;
 	uint32_t                        cx, cy;
 	swapchain_t                     swap;
 	pthread_mutex_t                 draw_callbacks_mutex;
@@ -88,35 +198,414 @@ extern bool obs_display_init(struct obs_display *display,
 extern void obs_display_free(struct obs_display *display);
 
 
+/* ------------------------------------------------------------------------- */
+/* source tick jobs */
+
+#define MAX_TICK_JOBS 8
+
+struct obs_tick_pool {
+	job_t                           jobs[MAX_TICK_JOBS];
+	size_t                          num_jobs;
+
+	/* referenced sources with OBS_SOURCE_THREADED_TICK for the current
+	 * frame.  each job (and the video thread) takes the next unticked
+	 * source by atomically incrementing next_source until the list is
+	 * exhausted */
+	DARRAY(struct obs_source*)      sources;
+	volatile long                   next_source;
+	float                           seconds;
+};
+
+/* ------------------------------------------------------------------------- */
+/* source preloading, see obs-preload.c */
+
+/* the thread is started the first time a source is preloaded */
+struct obs_preloader {
+	pthread_mutex_t                 mutex;
+	struct circlebuf                tasks;
+	os_sem_t                        task_sem;
+	pthread_t                       thread;
+	bool                            started;
+	bool                            threaded;
+};
+
+extern bool obs_preloader_init(struct obs_preloader *preloader);
+extern void obs_preloader_free(struct obs_preloader *preloader);
+
+/* shows the source on the preload thread and keeps a reference to it until
+ * the preload is ended */
+extern void obs_preload_source(struct obs_source *source);
+extern void obs_end_preload_source(struct obs_source *source);
+
+/* ------------------------------------------------------------------------- */
+/* mjpeg decoding, see obs-mjpeg.c */
+
+#define MAX_MJPEG_THREADS 8
+
+/* compressed frames of all sources are decoded by one set of threads, which
+ * are started the first time a source outputs mjpeg */
+struct obs_mjpeg_pool {
+	pthread_mutex_t                 mutex;
+	struct circlebuf                jobs;
+	os_sem_t                        job_sem;
+	pthread_t                       threads[MAX_MJPEG_THREADS];
+	size_t                          num_threads;
+	bool                            started;
+	volatile bool                   stop;
+};
+
+/* a decoded frame waiting for the frames submitted before it */
+struct mjpeg_result {
+	uint64_t                        seq;
+	struct source_frame             *frame;
+};
+
+extern bool obs_mjpeg_pool_init(struct obs_mjpeg_pool *pool);
+extern void obs_mjpeg_pool_free(struct obs_mjpeg_pool *pool);
+extern bool obs_mjpeg_pool_push(struct obs_mjpeg_pool *pool,
+		struct obs_source *source, uint64_t seq, const void *data,
+		size_t size, uint64_t timestamp);
+
+/* ------------------------------------------------------------------------- */
+/* real-time audio, see obs-rt-audio.c */
+
+struct obs_rt_audio;
+
+/* the real-time audio rings of all sources are drained by one thread, which
+ * is started the first time a source creates a ring */
+struct obs_rt_audio_pool {
+	pthread_mutex_t                 mutex;
+	DARRAY(struct obs_rt_audio*)    rings;
+	os_sem_t                        sem;
+	pthread_t                       thread;
+	bool                            started;
+	volatile bool                   stop;
+};
+
+extern bool obs_rt_audio_pool_init(struct obs_rt_audio_pool *pool);
+extern void obs_rt_audio_pool_free(struct obs_rt_audio_pool *pool);
+
+
+/* ------------------------------------------------------------------------- */
+/* gpu conversion/scaling */
+
+#define MAX_CONVERSION_PLANES 3
+
+/* each plane of a yuv frame is rendered to its own render target by
+ * format_conversion.effect, and staged to its own surface, so the mapped
+ * surfaces can be handed to encoders as they are */
+struct obs_conversion_plane {
+	const char                      *tech;
+	enum gs_color_format            format;
+	uint32_t                        width;
+	uint32_t                        height;
+};
+
+struct obs_conversion_layout {
+	size_t                          num_planes;
+	struct obs_conversion_plane     planes[MAX_CONVERSION_PLANES];
+};
+
+extern bool obs_calc_conversion_layout(struct obs_conversion_layout *layout,
+		enum video_format format, uint32_t width, uint32_t height);
+
+/* textures and surfaces can be NULL to only create the other */
+extern bool obs_create_conversion_planes(
+		const struct obs_conversion_layout *layout,
+		texture_t *textures, stagesurf_t *surfaces);
+
+/* maps the staged planes in to the frame.  if any plane fails, the ones
+ * already mapped are unmapped again */
+extern bool obs_map_conversion_planes(stagesurf_t *surfaces,
+		size_t num_planes, struct video_data *frame);
+extern void obs_unmap_conversion_planes(stagesurf_t *surfaces);
+
+/* a scaled/converted copy of the output that an encoder has requested,
+ * rendered from the base texture on the GPU rather than scaled from the
+ * output frame on the CPU */
+struct obs_scaled_output {
+	struct video_scale_info         info;
+	struct obs_conversion_layout    layout;
+
+	stagesurf_t                     copy_surfaces[MAX_NUM_TEXTURES]
+	                                        [MAX_CONVERSION_PLANES];
+	texture_t                       output_textures[MAX_NUM_TEXTURES];
+	texture_t                       convert_textures[MAX_NUM_TEXTURES]
+	                                        [MAX_CONVERSION_PLANES];
+	bool                            textures_output[MAX_NUM_TEXTURES];
+	bool                            textures_converted[MAX_NUM_TEXTURES];
+	bool                            textures_copied[MAX_NUM_TEXTURES];
+	uint64_t                        output_timestamps[MAX_NUM_TEXTURES];
+	uint64_t                        converted_timestamps[
+	                                        MAX_NUM_TEXTURES];
+	uint64_t                        copied_timestamps[MAX_NUM_TEXTURES];
+	stagesurf_t                     *mapped_surfaces;
+
+	struct video_data               frame;
+	bool                            frame_ready;
+	bool                            used;
+};
+
+
 /* ------------------------------------------------------------------------- */
 /* core */
 
+struct obs_video_profile {
+	profile_point_t                 tick_sources;
+	profile_point_t                 graphics_queue;
+	profile_point_t                 render_displays;
+	profile_point_t                 render_video;
+	profile_point_t                 download_frame;
+	profile_point_t                 output_video_data;
+	profile_point_t                 frame;
+};
+
+/* gpu timer queries, see obs-gpu-timing.c.  frames are read back
+ * GPU_TIMING_FRAMES-1 frames after they were rendered */
+#define GPU_TIMING_FRAMES 4
+
+enum obs_gpu_sample_type {
+	GPU_SAMPLE_STAGE,
+	GPU_SAMPLE_SOURCE,
+	GPU_SAMPLE_FILTER_PASS
+};
+
+struct obs_gpu_sample {
+	enum obs_gpu_sample_type        type;
+	enum obs_gpu_stage              stage;
+	struct obs_source               *source;
+};
+
+struct obs_gpu_frame {
+	gputimer_range_t                range;
+
+	/* timers are kept with the frame and reused, samples.array[i] is
+	 * measured by timers.array[i] */
+	DARRAY(gputimer_t)              timers;
+	DARRAY(struct obs_gpu_sample)   samples;
+	bool                            pending;
+};
+
+struct obs_gpu_timing {
+	struct obs_gpu_frame            frames[GPU_TIMING_FRAMES];
+	struct obs_gpu_frame            *cur_frame;
+	size_t                          next_frame;
+	bool                            unsupported;
+
+	/* incremented for every frame that's read back */
+	volatile long                   resolved;
+	volatile long                   stage_time_us[OBS_GPU_STAGE_COUNT];
+	profile_point_t                 stage_points[OBS_GPU_STAGE_COUNT];
+};
+
+extern void obs_gpu_timing_init(struct obs_gpu_timing *timing);
+extern void obs_gpu_timing_free(struct obs_gpu_timing *timing);
+
+/* called in the graphics context at the start of each output frame, ends
+ * the previous frame and reads back the oldest one */
+extern void obs_gpu_timing_frame(struct obs_gpu_timing *timing);
+
+/* return NULL if nothing is being timed right now.  calls can be nested,
+ * and only the outermost render of a source is timed */
+extern gputimer_t obs_gpu_timer_begin(enum obs_gpu_sample_type type,
+		enum obs_gpu_stage stage, struct obs_source *source);
+
+static inline void obs_gpu_timer_end(gputimer_t timer)
+{
+	if (timer)
+		gputimer_end(timer);
+}
+
+/* shared textures for image files, see obs-image-cache.c */
+struct obs_image;
+struct obs_image_atlas;
+
+struct obs_image_cache {
+	pthread_mutex_t                 mutex;
+	struct obs_image                *first_image;
+	DARRAY(struct obs_image_atlas*) atlases;
+	bool                            use_atlas;
+	bool                            use_compression;
+
+	/* async images are decoded by the loaders, and uploaded on their
+	 * shared contexts if possible.  the graphics queue then waits for
+	 * the upload (or does it) and packs them into the atlases */
+	DARRAY(pthread_t)               loaders;
+	DARRAY(struct obs_image*)       load_queue;
+	os_sem_t                        load_sem;
+	bool                            stop_loading;
+};
+
+extern bool obs_init_image_cache(void);
+extern void obs_stop_image_loaders(void);
+extern void obs_free_image_cache(void);
+
+/* deferred graphics work, see obs-graphics-queue.c */
+struct obs_graphics_queue {
+	pthread_mutex_t                 mutex;
+	struct circlebuf                commands;
+	size_t                          num_commands;
+	size_t                          pending_upload;
+	bool                            dropping;
+	DARRAY(uint8_t)                 upload_data;
+};
+
+extern bool obs_init_graphics_queue(void);
+extern void obs_free_graphics_queue(void);
+extern void obs_execute_graphics_queue(void);
+
+/* second device that gpu encoders run on, see obs-encode-device.c.  frames
+ * cross over through system memory: they're staged on the main device,
+ * copied into the frames ring by the video thread, and uploaded by the
+ * encode device thread */
+#define ENCODE_DEVICE_FRAMES 3
+
+struct obs_encode_device {
+	graphics_t                      graphics;
+	texture_t                       texture;
+	uint32_t                        width;
+	uint32_t                        height;
+
+	/* on the main device, only used by the video thread */
+	stagesurf_t                     surfaces[MAX_NUM_STAGE_SURFACES];
+	uint64_t                        surface_times[MAX_NUM_STAGE_SURFACES];
+	int                             num_surfaces;
+	int                             stage_read;
+	int                             stage_pending;
+
+	pthread_mutex_t                 mutex;
+	uint8_t                         *frames[ENCODE_DEVICE_FRAMES];
+	uint64_t                        frame_times[ENCODE_DEVICE_FRAMES];
+	size_t                          frame_read;
+	size_t                          frame_count;
+	uint64_t                        frames_dropped;
+
+	os_sem_t                        sem;
+	pthread_t                       thread;
+	bool                            thread_active;
+	volatile bool                   stop;
+};
+
+extern bool obs_init_encode_device(struct obs_video_info *ovi);
+extern void obs_free_encode_device(void);
+extern void obs_encode_device_output(texture_t texture, uint64_t timestamp);
+
+/* format_conversion.effect parameters, which are set for every converted
+ * frame.  the float parameters come first, in the order they're set */
+enum conversion_param {
+	CONVERSION_WIDTH,
+	CONVERSION_HEIGHT,
+	CONVERSION_WIDTH_I,
+	CONVERSION_HEIGHT_I,
+	CONVERSION_WIDTH_D2,
+	CONVERSION_HEIGHT_D2,
+	CONVERSION_WIDTH_D2_I,
+	CONVERSION_HEIGHT_D2_I,
+	CONVERSION_INPUT_HEIGHT,
+	CONVERSION_IMAGE,
+	CONVERSION_IMAGE_1,
+	CONVERSION_IMAGE_2,
+
+	NUM_CONVERSION_PARAMS
+};
+
 struct obs_core_video {
 	graphics_t                      graphics;
-	stagesurf_t                     copy_surfaces[NUM_TEXTURES];
-	texture_t                       render_textures[NUM_TEXTURES];
-	texture_t                       output_textures[NUM_TEXTURES];
-	texture_t                       convert_textures[NUM_TEXTURES];
-	bool                            textures_rendered[NUM_TEXTURES];
-	bool                            textures_output[NUM_TEXTURES];
-	bool                            textures_copied[NUM_TEXTURES];
-	bool                            textures_converted[NUM_TEXTURES];
-	struct source_frame             convert_frames[NUM_TEXTURES];
+
+	/* owns the textures and surfaces of the video output itself */
+	gs_memory_owner_t               gpu_owner;
+	texture_t                       render_textures[MAX_NUM_TEXTURES];
+	texture_t                       output_textures[MAX_NUM_TEXTURES];
+	texture_t                       convert_textures[MAX_NUM_TEXTURES]
+	                                        [MAX_CONVERSION_PLANES];
+	bool                            textures_rendered[MAX_NUM_TEXTURES];
+	bool                            textures_output[MAX_NUM_TEXTURES];
+	bool                            textures_converted[MAX_NUM_TEXTURES];
+	struct source_frame             convert_frames[MAX_NUM_TEXTURES];
+
+	/* whether each texture is the same as the one rendered, output or
+	 * converted before it, which follows the frame down the pipeline so
+	 * the downloaded frame can be flagged as a duplicate */
+	bool                            rendered_unchanged[MAX_NUM_TEXTURES];
+	bool                            output_unchanged[MAX_NUM_TEXTURES];
+	bool                            converted_unchanged[MAX_NUM_TEXTURES];
+	bool                            staged_unchanged[
+	                                        MAX_NUM_STAGE_SURFACES];
+	bool                            stage_continuous;
+
+	/* the time of the frame each texture was rendered for, which follows
+	 * it down the pipeline the same way */
+	uint64_t                        rendered_timestamps[MAX_NUM_TEXTURES];
+	uint64_t                        output_timestamps[MAX_NUM_TEXTURES];
+	uint64_t                        converted_timestamps[
+	                                        MAX_NUM_TEXTURES];
+	uint64_t                        staged_timestamps[
+	                                        MAX_NUM_STAGE_SURFACES];
+	bool                            view_revision_valid;
+	uint64_t                        view_revision;
+
+	/* in efficiency mode, the pipeline goes idle once the main view has
+	 * been unchanged for more frames than it holds.  nothing is rendered
+	 * or downloaded while idle, and the preview is slowed down */
+	bool                            efficiency_mode;
+	bool                            idle;
+	uint32_t                        unchanged_frames;
+
+	/* incremented before each frame is rendered */
+	uint64_t                        frame_count;
+
+	/* staged copies waiting to be downloaded are the stage_pending
+	 * surfaces starting at stage_read, oldest first.  without gpu
+	 * conversion, a copy is only the first surface */
+	stagesurf_t                     copy_surfaces[MAX_NUM_STAGE_SURFACES]
+	                                        [MAX_CONVERSION_PLANES];
+	int                             num_stage_surfaces;
+	int                             stage_read;
+	int                             stage_pending;
 	effect_t                        default_effect;
+	effect_t                        default_rect_effect;
 	effect_t                        conversion_effect;
-	stagesurf_t                     mapped_surface;
+	eparam_t                        conversion_params[
+	                                        NUM_CONVERSION_PARAMS];
+	stagesurf_t                     *mapped_surfaces;
 	int                             cur_texture;
+	int                             num_textures;
 
 	video_t                         video;
 	pthread_t                       video_thread;
 	bool                            thread_initialized;
+	struct obs_tick_pool            tick_pool;
+
+	/* obs_reset_video_async runs on reset_thread, which is joined by
+	 * whoever calls obs_wait_video_reset first (under reset_mutex) */
+	pthread_mutex_t                 reset_mutex;
+	pthread_t                       reset_thread;
+	volatile bool                   reset_pending;
+	bool                            reset_result;
+	struct obs_video_info           reset_info;
+	char                            *reset_module;
 
 	bool                            gpu_conversion;
-	const char                      *conversion_tech;
-	uint32_t                        conversion_height;
-	uint32_t                        plane_offsets[3];
-	uint32_t                        plane_sizes[3];
-	uint32_t                        plane_linewidth[3];
+	struct obs_conversion_layout    conversion;
+
+	/* the base texture is halved through the downscale textures until
+	 * it's less than twice the output size, and then scaled the rest of
+	 * the way by the output effect, which is done in two separable
+	 * passes through separable_texture for bicubic and lanczos */
+	enum video_scale_type           output_scale_type;
+	texture_t                       downscale_textures[
+	                                        MAX_DOWNSCALE_LEVELS];
+	size_t                          num_downscale_levels;
+	texture_t                       separable_texture;
+
+	bool                            gpu_scaling;
+	enum video_scale_type           scale_type;
+	effect_t                        bicubic_effect;
+	effect_t                        lanczos_effect;
+	effect_t                        deinterlace_effect;
+	long                            scaled_revision;
+	DARRAY(struct obs_scaled_output*) scaled_outputs;
+	DARRAY(struct video_scale_info) scaled_infos;
 
 	uint32_t                        output_width;
 	uint32_t                        output_height;
@@ -124,10 +613,26 @@ struct obs_core_video {
 	uint32_t                        base_height;
 
 	struct obs_display              main_display;
+
+	/* displays are rendered after each output frame, at most once every
+	 * preview_interval_ns (0 for every frame).  disabling the preview
+	 * skips the main display entirely */
+	bool                            preview_enabled;
+	uint64_t                        preview_interval_ns;
+	uint64_t                        next_preview_ns;
+
+	/* no window was given, so there's no main display to render */
+	bool                            headless;
+
+	struct obs_video_profile        profile;
+	struct obs_gpu_timing           gpu_timing;
+	struct obs_image_cache          image_cache;
+	struct obs_graphics_queue       graphics_queue;
+	struct obs_encode_device        encode_device;
+	char                            *shader_cache_path;
 };
 
 struct obs_core_audio {
-	/* TODO: sound output subsystem */
 	audio_t                         audio;
 
 	float                           user_volume;
@@ -139,19 +644,52 @@ struct obs_core_data {
 	pthread_mutex_t                 user_sources_mutex;
 	DARRAY(struct obs_source*)      user_sources;
 
+	/* hash index of user_sources by name, protected by
+	 * user_sources_mutex */
+	struct obs_source               **source_buckets;
+	size_t                          num_source_buckets;
+
 	struct obs_source               *first_source;
+
+	/* all sources, packed for the per-frame tick and split by whether
+	 * they can tick on the tick pool, protected by sources_mutex */
+	DARRAY(struct obs_source*)      tick_sources;
+	DARRAY(struct obs_source*)      threaded_tick_sources;
+
+	/* in the order they were suspended, protected by sources_mutex */
+	DARRAY(struct obs_source*)      suspended_sources;
+	uint64_t                        suspend_memory_budget;
+
 	struct obs_display              *first_display;
+	struct obs_canvas               *first_canvas;
 	struct obs_output               *first_output;
 	struct obs_encoder              *first_encoder;
 	struct obs_service              *first_service;
 
 	pthread_mutex_t                 sources_mutex;
 	pthread_mutex_t                 displays_mutex;
+	pthread_mutex_t                 canvases_mutex;
 	pthread_mutex_t                 outputs_mutex;
 	pthread_mutex_t                 encoders_mutex;
 	pthread_mutex_t                 services_mutex;
 
+	/* video encoders taking the output texture instead of raw frames */
+	pthread_mutex_t                 gpu_encoders_mutex;
+	DARRAY(struct obs_encoder*)     gpu_encoders;
+
+	/* bumped whenever a child is added to or removed from any source,
+	 * which invalidates all cached source trees */
+	pthread_mutex_t                 tree_mutex;
+	long                            tree_revision;
+
 	struct obs_view                 main_view;
+	struct obs_mjpeg_pool           mjpeg_pool;
+	struct obs_rt_audio_pool        rt_audio_pool;
+	struct obs_preloader            preloader;
+
+	/* names of sources removed or renamed since the last save, protected
+	 * by sources_mutex */
+	DARRAY(char*)                   removed_source_names;
 
 	long long                       unnamed_index;
 
@@ -160,18 +698,36 @@ struct obs_core_data {
 
 struct obs_core {
 	DARRAY(struct obs_module)       modules;
+
+	/* modules known from the manifest that are loaded the first time one
+	 * of their types is used, protected by module_mutex */
+	DARRAY(struct obs_module)       deferred_modules;
+	pthread_mutex_t                 module_mutex;
+
 	DARRAY(struct obs_source_info)  input_types;
 	DARRAY(struct obs_source_info)  filter_types;
 	DARRAY(struct obs_source_info)  transition_types;
 	DARRAY(struct obs_output_info)  output_types;
 	DARRAY(struct obs_encoder_info) encoder_types;
 	DARRAY(struct obs_service_info) service_types;
+	struct obs_type_index           input_index;
+	struct obs_type_index           filter_index;
+	struct obs_type_index           transition_index;
+	struct obs_type_index           output_index;
+	struct obs_type_index           encoder_index;
+	struct obs_type_index           service_index;
 	DARRAY(struct obs_modal_ui)     modal_ui_callbacks;
 	DARRAY(struct obs_modeless_ui)  modeless_ui_callbacks;
 
 	signal_handler_t                signals;
 	proc_handler_t                  procs;
 
+	/* shared by libobs and plugins, see obs_job_system */
+	job_system_t                    jobs;
+
+	/* kept here so it's applied again when video or audio is reset */
+	media_clock_t                   master_clock;
+
 	/* segmented into multiple sub-structures to keep things a bit more
 	 * clean and organized */
 	struct obs_core_video           video;
@@ -183,6 +739,10 @@ extern struct obs_core *obs;
 
 extern void *obs_video_thread(void *param);
 
+extern bool obs_scaled_output_supported(void *param,
+		const struct video_scale_info *info);
+extern void obs_free_scaled_outputs(struct obs_core_video *video);
+
 
 /* ------------------------------------------------------------------------- */
 /* obs shared context data */
@@ -213,9 +773,82 @@ extern void obs_context_data_setname(struct obs_context_data *context,
 		const char *name);
 
 
+/* ------------------------------------------------------------------------- */
+/* async frame rings */
+
+/*
+ * Bounded single-producer/single-consumer ring of frame pointers.  head is
+ * only written by the producer and tail only by the consumer, so neither side
+ * needs a lock.  Indices wrap at twice the capacity so a full ring can be
+ * told apart from an empty one.
+ */
+
+#define FRAME_RING_SIZE 16
+#define FRAME_RING_MASK (FRAME_RING_SIZE - 1)
+#define FRAME_RING_WRAP (FRAME_RING_SIZE * 2 - 1)
+
+struct frame_ring {
+	struct source_frame             *frames[FRAME_RING_SIZE];
+	volatile long                   head;
+	volatile long                   tail;
+};
+
+static inline size_t frame_ring_count(const struct frame_ring *ring)
+{
+	long head = os_atomic_load_long(&ring->head);
+	long tail = os_atomic_load_long(&ring->tail);
+	return (size_t)((head - tail) & FRAME_RING_WRAP);
+}
+
+/* producer only.  returns false if the ring is full */
+static inline bool frame_ring_push(struct frame_ring *ring,
+		struct source_frame *frame)
+{
+	long head = ring->head;
+
+	if (frame_ring_count(ring) == FRAME_RING_SIZE)
+		return false;
+
+	ring->frames[head & FRAME_RING_MASK] = frame;
+	os_atomic_set_long(&ring->head, (head + 1) & FRAME_RING_WRAP);
+	return true;
+}
+
+/* consumer only.  idx 0 is the oldest frame in the ring */
+static inline struct source_frame *frame_ring_peek(
+		const struct frame_ring *ring, size_t idx)
+{
+	if (idx >= frame_ring_count(ring))
+		return NULL;
+	return ring->frames[(ring->tail + idx) & FRAME_RING_MASK];
+}
+
+/* consumer only */
+static inline struct source_frame *frame_ring_pop(struct frame_ring *ring)
+{
+	long tail = ring->tail;
+	struct source_frame *frame;
+
+	if (!frame_ring_count(ring))
+		return NULL;
+
+	frame = ring->frames[tail & FRAME_RING_MASK];
+	os_atomic_set_long(&ring->tail, (tail + 1) & FRAME_RING_WRAP);
+	return frame;
+}
+
+
 /* ------------------------------------------------------------------------- */
 /* sources  */
 
+/* trees are listed children first, so the descendants of the child of an
+ * entry are the entries from first up to the entry itself */
+struct source_tree_entry {
+	struct obs_source               *parent;
+	struct obs_source               *child;
+	size_t                          first;
+};
+
 struct obs_source {
 	struct obs_context_data         context;
 	struct obs_source_info          info;
@@ -224,6 +857,40 @@ struct obs_source {
 	/* signals to call the source update in the video thread */
 	bool                            defer_update;
 
+	/* immutable copy of the settings, replaced as a whole by
+	 * obs_source_update so the video thread can read it without locking.
+	 * replaced snapshots are only released on the next video tick, once
+	 * nothing on the video thread can still be using them */
+	obs_data_t volatile             settings_snapshot;
+	pthread_mutex_t                 snapshot_mutex;
+	DARRAY(obs_data_t)              retired_snapshots;
+	volatile long                   snapshots_retired;
+
+	/* sources with OBS_SOURCE_DEFERRED_CREATE only hold their settings
+	 * until they're first shown.  created is set once context.data is
+	 * valid, create_mutex keeps them from being created twice, and
+	 * load_pending makes the load callback run once they're created */
+	pthread_mutex_t                 create_mutex;
+	volatile long                   created;
+	bool                            load_pending;
+
+	/* the graphics resources created by the source and by libobs for it
+	 * count towards this */
+	gs_memory_owner_t               gpu_owner;
+
+	/* gpu time of the last resolved frame the source was rendered in,
+	 * see obs-gpu-timing.c.  gpu_timing_depth and the sums are only used
+	 * in the graphics context of the video thread */
+	int                             gpu_timing_depth;
+	volatile long                   gpu_time_frame;
+	uint64_t                        gpu_time_sum;
+	uint64_t                        gpu_pass_sum;
+	volatile long                   gpu_time_us;
+	volatile long                   gpu_pass_us;
+
+	/* incremented whenever the video of a static source changes */
+	volatile long                   content_revision;
+
 	/* ensures show/hide are only called once */
 	volatile long                   show_refs;
 
@@ -233,11 +900,39 @@ struct obs_source {
 	/* prevents infinite recursion when enumerating sources */
 	volatile long                   enum_refs;
 
+	/* position in the tick list of obs_core_data */
+	size_t                          tick_idx;
+	bool                            ticking;
+
+	/* input sources that aren't shown anywhere are suspended by the video
+	 * thread, which stops ticking them and drops their frames.  once the
+	 * suspended sources go over the memory budget, the ones suspended
+	 * first have their textures released as well.  only used from the
+	 * video thread, with sources_mutex held */
+	bool                            suspended;
+	bool                            resources_released;
+
+	/* user source name index chain */
+	struct obs_source               *name_next;
+	uint32_t                        name_hash;
+	bool                            name_indexed;
+
+	/* flattened obs_source_enum_tree order of the source's descendants,
+	 * protected by tree_mutex and only valid while tree_revision matches
+	 * the one in obs_core_data */
+	DARRAY(struct source_tree_entry) tree;
+	long                            tree_revision;
+	bool                            tree_valid;
+
 	/* used to indicate that the source has been removed and all
 	 * references to it should be released (not exactly how I would prefer
 	 * to handle things but it's the best option) */
 	bool                            removed;
 
+	/* set if the source has to be saved even if its settings haven't
+	 * changed, such as when it is new or was renamed */
+	bool                            save_pending;
+
 	/* timing (if video is present, is based upon video) */
 	volatile bool                   timing_set;
 	volatile uint64_t               timing_adjust;
@@ -269,12 +964,21 @@ struct obs_source {
 	struct resample_info            sample_info;
 	audio_resampler_t               resampler;
 	audio_line_t                    audio_line;
+	bool                            audio_active;
 	pthread_mutex_t                 audio_mutex;
+	/* the audio data points at the resampler's output, or at the source's
+	 * own data when it doesn't need resampling, and is only copied to
+	 * the storage when audio filters need to write to the source's data */
 	struct filtered_audio           audio_data;
+	bool                            audio_data_borrowed;
+	uint8_t                         *audio_storage[MAX_AV_PLANES];
 	size_t                          audio_storage_size;
+	/* audio from real-time threads, see obs_source_output_rt_audio */
+	struct obs_rt_audio             *rt_audio;
 	float                           user_volume;
 	float                           present_volume;
 	int64_t                         sync_offset;
+	uint32_t                        audio_mixers;
 
 	/* transition volume is meant to store the sum of transitioning volumes
 	 * of a source, i.e. if a source is within both the "to" and "from"
@@ -283,8 +987,21 @@ struct obs_source {
 	 * to the presentation volume. */
 	float                           transition_volume;
 
-	/* async video data */
+	/* transitions only: the tree of the transition, held from
+	 * obs_transition_begin_frame to obs_transition_end_frame, and the
+	 * child frozen in to a texture by obs_transition_freeze */
+	struct darray                   transition_tree;
+	struct obs_source               *frozen_child;
+	texrender_t                     freeze_texrender;
+	bool                            freeze_valid;
+	uint32_t                        freeze_cx;
+	uint32_t                        freeze_cy;
+
+	/* async video data.  with gpu conversion of planar formats the async
+	 * texture holds the luma plane and the chroma planes get their own
+	 * textures (one interleaved texture for nv12) */
 	texture_t                       async_texture;
+	texture_t                       async_chroma_textures[2];
 	texrender_t                     async_convert_texrender;
 	bool                            async_gpu_conversion;
 	enum video_format               async_format;
@@ -293,22 +1010,82 @@ struct obs_source {
 	float                           async_color_range_min[3];
 	float                           async_color_range_max[3];
 	bool                            async_flip;
-	DARRAY(struct source_frame*)    video_frames;
-	pthread_mutex_t                 video_mutex;
+	struct frame_ring               video_frames;
+	struct frame_ring               frame_cache;
+	volatile long                   async_frames_dropped;
 	uint32_t                        async_width;
 	uint32_t                        async_height;
 	uint32_t                        async_convert_width;
 	uint32_t                        async_convert_height;
+	bool                            async_unbuffered;
+
+	/* mjpeg frames out on the decode pool.  decoded frames are output in
+	 * submission order, so frames that finish early wait in mjpeg_results
+	 * (sorted by seq) until the frames before them are done.  protected
+	 * by mjpeg_mutex, which also serializes output of the decoded frames
+	 * and use of the frame cache by the decode threads */
+	pthread_mutex_t                 mjpeg_mutex;
+	uint64_t                        mjpeg_next_seq;
+	uint64_t                        mjpeg_next_output;
+	volatile long                   mjpeg_pending;
+	DARRAY(struct mjpeg_result)     mjpeg_results;
+
+	/* deinterlacing of async video, the previous frame is kept for the
+	 * motion-adaptive modes */
+	enum obs_deinterlace_mode       deinterlace_mode;
+	enum obs_deinterlace_field_order deinterlace_field_order;
+	texture_t                       async_prev_texture;
+	texrender_t                     deinterlace_texrender;
+	bool                            deinterlace_dirty;
+	bool                            deinterlace_second_field;
+	uint64_t                        deinterlace_frame_ts;
+	uint64_t                        deinterlace_frame_sys_time;
+	uint64_t                        deinterlace_half_duration;
 
 	/* filters */
 	struct obs_source               *filter_parent;
 	struct obs_source               *filter_target;
 	DARRAY(struct obs_source*)      filters;
 	pthread_mutex_t                 filter_mutex;
-	texrender_t                     filter_texrender;
 	bool                            rendering_filter;
+
+	/* async frames waiting for threaded filters, protected by
+	 * filter_queue_mutex.  at most one filter job is scheduled at a time,
+	 * and it runs until the queue is empty */
+	struct frame_ring               filter_queue;
+	pthread_mutex_t                 filter_queue_mutex;
+	job_t                           filter_job;
+	bool                            filter_job_scheduled;
+	bool                            filter_jobs_active;
+	bool                            filter_jobs_stop;
+
+	/* pointwise filters combined with the ones below them in the chain,
+	 * stored on the topmost filter of each run */
+	effect_t                        fused_effect;
+	struct dstr                     fused_shader;
+
+	/* a cached source is rendered to render_cache the first time it's
+	 * drawn in a frame, and the texture is drawn the other times.  the
+	 * cache is valid for one frame_count and size.  in auto mode, sources
+	 * are cached when they were drawn more than once in the previous
+	 * frame (by several scenes, views or displays) */
+	enum obs_render_cache_mode      render_cache_mode;
+	texrender_t                     render_cache;
+	uint64_t                        render_cache_frame;
+	uint32_t                        render_cache_cx;
+	uint32_t                        render_cache_cy;
+	uint64_t                        render_count_frame;
+	uint32_t                        render_count;
+	bool                            use_render_cache;
+	bool                            rendering_cache;
 };
 
+extern struct source_frame *obs_source_mjpeg_allocframe(
+		struct obs_source *source, enum video_format format,
+		uint32_t width, uint32_t height);
+extern void obs_source_mjpeg_decoded(struct obs_source *source,
+		uint64_t seq, struct source_frame *frame);
+
 extern bool obs_source_init_context(struct obs_source *source,
 		obs_data_t settings, const char *name);
 extern bool obs_source_init(struct obs_source *source,
@@ -316,6 +1093,32 @@ extern bool obs_source_init(struct obs_source *source,
 
 extern void obs_source_destroy(struct obs_source *source);
 
+/* references the source unless it's already being destroyed */
+extern bool obs_source_try_addref(struct obs_source *source);
+
+/* blending for rendering in to a cache texture, and for drawing the cache
+ * texture afterward.  the cache is premultiplied */
+extern void obs_set_cache_blend(void);
+extern void obs_draw_cache_texture(texture_t tex, uint32_t cx, uint32_t cy);
+
+/* whether the source will be drawn from its render cache this frame */
+extern bool obs_source_render_cache_active(const struct obs_source *source);
+
+/* marks all cached source trees out of date, must be called whenever the
+ * children a source enumerates change */
+extern void obs_source_invalidate_trees(void);
+
+/* suspends or resumes the source depending on whether it's shown, and
+ * releases the resources of the suspended sources that are over the memory
+ * budget.  called from the video thread with sources_mutex held */
+extern void obs_source_update_suspended(struct obs_source *source);
+extern void obs_release_suspended_resources(void);
+
+/* update the user source name index, called with user_sources_mutex held
+ * (implemented in obs.c) */
+extern void obs_source_index_insert(struct obs_source *source);
+extern void obs_source_index_remove(struct obs_source *source);
+
 enum view_type {
 	MAIN_VIEW,
 	AUX_VIEW
@@ -325,6 +1128,13 @@ extern void obs_source_activate(obs_source_t source, enum view_type type);
 extern void obs_source_deactivate(obs_source_t source, enum view_type type);
 extern void obs_source_video_tick(obs_source_t source, float seconds);
 
+/* implemented in obs-scene.c */
+extern bool obs_scene_get_content_revision(obs_source_t scene_source,
+		uint64_t *revision);
+
+/* references the item unless it's already being destroyed */
+extern bool obs_sceneitem_try_addref(obs_sceneitem_t item);
+
 
 /* ------------------------------------------------------------------------- */
 /* outputs  */
@@ -334,27 +1144,38 @@ struct obs_output {
 	struct obs_output_info          info;
 
 	bool                            received_video;
-	bool                            received_audio;
+	bool                            received_audio[MAX_AUDIO_MIXES];
 	int64_t                         first_video_ts;
 	int64_t                         video_offset;
-	int64_t                         audio_offset;
-	int64_t                         highest_audio_ts;
-	int64_t                         highest_video_ts;
+	int64_t                         audio_offsets[MAX_AUDIO_MIXES];
 	pthread_mutex_t                 interleaved_mutex;
-	DARRAY(struct encoder_packet)   interleaved_packets;
+	struct circlebuf                interleaved_video;
+	struct circlebuf                interleaved_audio[MAX_AUDIO_MIXES];
 
 	bool                            active;
+	uint32_t                        capture_flags;
 	video_t                         video;
 	audio_t                         audio;
 	obs_encoder_t                   video_encoder;
-	obs_encoder_t                   audio_encoder;
+	obs_encoder_t                   audio_encoders[MAX_AUDIO_MIXES];
 	obs_service_t                   service;
 
+	/* while the output uses an equivalent encoder that was already
+	 * running in place of its own, its own encoders are kept here */
+	bool                            share_encoders;
+	obs_encoder_t                   own_video_encoder;
+	obs_encoder_t                   own_audio_encoders[MAX_AUDIO_MIXES];
+
 	bool                            video_conversion_set;
 	bool                            audio_conversion_set;
 	struct video_scale_info         video_conversion;
 	struct audio_convert_info       audio_conversion;
 
+	/* used by obs_output_stop_async */
+	pthread_t                       stop_thread;
+	bool                            stop_thread_active;
+	volatile bool                   stopping;
+
 	bool                            valid;
 };
 
@@ -371,6 +1192,15 @@ struct encoder_callback {
 	void *param;
 };
 
+#define ENCODER_QUEUE_SIZE 4
+
+struct encoder_queued_frame {
+	struct video_frame              frame;
+	int64_t                         pts;
+	uint64_t                        queued_time;
+	bool                            duplicate;
+};
+
 struct obs_encoder {
 	struct obs_context_data         context;
 	struct obs_encoder_info         info;
@@ -382,15 +1212,43 @@ struct obs_encoder {
 	size_t                          framesize_bytes;
 
 	bool                            active;
+	bool                            gpu_encode;
 
 	uint32_t                        timebase_num;
 	uint32_t                        timebase_den;
 
+	uint32_t                        scaled_width;
+	uint32_t                        scaled_height;
+
+	uint32_t                        frame_rate_divisor;
+	uint64_t                        gpu_frame_count;
+
 	int64_t                         cur_pts;
 
 	struct circlebuf                audio_input_buffer[MAX_AV_PLANES];
 	uint8_t                         *audio_output_buffer[MAX_AV_PLANES];
 
+	/* video frames are copied in to a bounded queue and encoded on the
+	 * encoder's own thread.  when the queue is full, new frames are
+	 * skipped */
+	struct encoder_queued_frame     queue[ENCODER_QUEUE_SIZE];
+	size_t                          queue_start;
+	size_t                          queue_count;
+	enum video_format               queue_format;
+	uint32_t                        queue_height;
+	bool                            queue_changed;
+	volatile long                   keyframe_requested;
+	pthread_mutex_t                 queue_mutex;
+	os_sem_t                        encode_sem;
+	pthread_t                       encode_thread;
+	bool                            encode_thread_active;
+	volatile bool                   encode_thread_stop;
+	volatile bool                   encode_thread_abort;
+	uint64_t                        queue_latency;
+	uint32_t                        frames_skipped;
+
+	profile_point_t                 profile_point;
+
 	/* if a video encoder is paired with an audio encoder, make it start
 	 * up at the specific timestamp.  if this is the audio encoder,
 	 * wait_for_video makes it wait until it's ready to sync up with
@@ -404,14 +1262,34 @@ struct obs_encoder {
 
 	bool                            destroy_on_stop;
 
+	/* the context hasn't encoded anything yet and was created with the
+	 * current settings, so obs_encoder_initialize can keep it */
+	bool                            context_fresh;
+
+	/* kept encoding in to a discard callback by obs_encoder_prewarm */
+	bool                            prewarmed;
+
+	/* while active, identifies what the encoder produces so other
+	 * outputs can share it.  empty if the encoder is exclusive to the
+	 * outputs that use it.  protected by obs->data.encoders_mutex */
+	struct dstr                     fingerprint;
+	bool                            exclusive;
+
 	/* stores the video/audio media output pointer.  video_t or audio_t */
 	void                            *media;
 
+	/* serializes the update, encode and create/destroy callbacks of the
+	 * context, so settings can be changed from any thread while the
+	 * encoder is running.  recursive, so an encoder can update itself */
+	pthread_mutex_t                 encode_mutex;
+
 	pthread_mutex_t                 callbacks_mutex;
 	DARRAY(struct encoder_callback) callbacks;
 };
 
-extern bool obs_encoder_initialize(obs_encoder_t encoder);
+/* returns an active encoder that produces the same data as the given
+ * (inactive) encoder, or NULL if there isn't one */
+extern obs_encoder_t obs_encoder_find_equivalent(obs_encoder_t encoder);
 
 extern void obs_encoder_start(obs_encoder_t encoder,
 		void (*new_packet)(void *param, struct encoder_packet *packet),
@@ -420,6 +1298,9 @@ extern void obs_encoder_stop(obs_encoder_t encoder,
 		void (*new_packet)(void *param, struct encoder_packet *packet),
 		void *param);
 
+extern void obs_encoder_receive_texture(struct obs_encoder *encoder,
+		texture_t texture, uint64_t timestamp);
+
 extern void obs_encoder_add_output(struct obs_encoder *encoder,
 		struct obs_output *output);
 extern void obs_encoder_remove_output(struct obs_encoder *encoder,
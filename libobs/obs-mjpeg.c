@@ -0,0 +1,334 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "obs-internal.h"
+#include "util/platform.h"
+
+#include <libavcodec/avcodec.h>
+
+/*
+ * Decodes the MJPEG frames of all sources on one set of threads instead of
+ * on the capture thread of each source.  Each thread has its own decoder,
+ * and takes the next job from the shared queue.  Decoded frames are written
+ * into frames from the frame cache of the source and handed back to the
+ * source, which outputs them in submission order.
+ */
+
+struct mjpeg_job {
+	struct obs_source *source;
+	uint64_t          seq;
+	uint64_t          timestamp;
+	uint8_t           *data;
+	size_t            size;
+};
+
+struct mjpeg_decoder {
+	AVCodecContext    *context;
+	AVFrame           *frame;
+	bool              warned_format;
+
+	float             color_matrix[16];
+	float             color_range_min[3];
+	float             color_range_max[3];
+};
+
+static pthread_once_t codec_register_once = PTHREAD_ONCE_INIT;
+
+static void register_codecs(void)
+{
+	avcodec_register_all();
+}
+
+static void mjpeg_decoder_free(struct mjpeg_decoder *decoder)
+{
+	if (decoder->context) {
+		avcodec_close(decoder->context);
+		av_free(decoder->context);
+	}
+	if (decoder->frame)
+		av_frame_free(&decoder->frame);
+}
+
+static bool mjpeg_decoder_init(struct mjpeg_decoder *decoder)
+{
+	AVCodec *codec;
+
+	memset(decoder, 0, sizeof(struct mjpeg_decoder));
+	pthread_once(&codec_register_once, register_codecs);
+
+	codec = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
+	if (!codec)
+		return false;
+
+	decoder->context = avcodec_alloc_context3(codec);
+	decoder->frame   = av_frame_alloc();
+	if (!decoder->context || !decoder->frame)
+		goto fail;
+
+	if (avcodec_open2(decoder->context, codec, NULL) < 0)
+		goto fail;
+
+	/* jpeg is always full range bt.601 */
+	video_format_get_parameters(VIDEO_CS_601, VIDEO_RANGE_FULL,
+			decoder->color_matrix, decoder->color_range_min,
+			decoder->color_range_max);
+	return true;
+
+fail:
+	mjpeg_decoder_free(decoder);
+	return false;
+}
+
+static void copy_plane(uint8_t *dst, uint32_t dst_linesize,
+		const uint8_t *src, int src_linesize,
+		uint32_t width, uint32_t height)
+{
+	for (uint32_t y = 0; y < height; y++)
+		memcpy(dst + y * dst_linesize, src + y * src_linesize, width);
+}
+
+/* 4:2:2 planar can't be drawn, the packed version of it can */
+static void pack_yuy2(struct source_frame *out, const AVFrame *frame)
+{
+	for (uint32_t y = 0; y < out->height; y++) {
+		const uint8_t *lum = frame->data[0] + y * frame->linesize[0];
+		const uint8_t *u   = frame->data[1] + y * frame->linesize[1];
+		const uint8_t *v   = frame->data[2] + y * frame->linesize[2];
+		uint8_t       *dst = out->data[0] + y * out->linesize[0];
+
+		for (uint32_t x = 0; x < out->width / 2; x++) {
+			*(dst++) = lum[x * 2];
+			*(dst++) = u[x];
+			*(dst++) = lum[x * 2 + 1];
+			*(dst++) = v[x];
+		}
+	}
+}
+
+static inline enum video_format output_format(enum AVPixelFormat format)
+{
+	switch (format) {
+	case AV_PIX_FMT_YUVJ420P:
+	case AV_PIX_FMT_YUV420P:
+		return VIDEO_FORMAT_I420;
+	case AV_PIX_FMT_YUVJ422P:
+	case AV_PIX_FMT_YUV422P:
+		return VIDEO_FORMAT_YUY2;
+	default:
+		return VIDEO_FORMAT_NONE;
+	}
+}
+
+static struct source_frame *convert_frame(struct mjpeg_decoder *decoder,
+		const struct mjpeg_job *job)
+{
+	const AVFrame       *frame  = decoder->frame;
+	enum video_format   format  = output_format(frame->format);
+	uint32_t            width   = (uint32_t)frame->width;
+	uint32_t            height  = (uint32_t)frame->height;
+	struct source_frame *out;
+
+	if (format == VIDEO_FORMAT_NONE) {
+		if (!decoder->warned_format)
+			blog(LOG_WARNING, "mjpeg decoder: unsupported "
+			                  "sampling format %d", frame->format);
+		decoder->warned_format = true;
+		return NULL;
+	}
+
+	out = obs_source_mjpeg_allocframe(job->source, format, width, height);
+
+	if (format == VIDEO_FORMAT_I420) {
+		copy_plane(out->data[0], out->linesize[0],
+				frame->data[0], frame->linesize[0],
+				width, height);
+		copy_plane(out->data[1], out->linesize[1],
+				frame->data[1], frame->linesize[1],
+				width / 2, height / 2);
+		copy_plane(out->data[2], out->linesize[2],
+				frame->data[2], frame->linesize[2],
+				width / 2, height / 2);
+	} else {
+		pack_yuy2(out, frame);
+	}
+
+	out->timestamp  = job->timestamp;
+	out->full_range = true;
+	out->flip       = false;
+	memcpy(out->color_matrix, decoder->color_matrix, sizeof(float) * 16);
+	memcpy(out->color_range_min, decoder->color_range_min,
+			sizeof(float) * 3);
+	memcpy(out->color_range_max, decoder->color_range_max,
+			sizeof(float) * 3);
+	return out;
+}
+
+static struct source_frame *decode_job(struct mjpeg_decoder *decoder,
+		const struct mjpeg_job *job)
+{
+	AVPacket packet;
+	int      got_frame = 0;
+	int      ret;
+
+	av_init_packet(&packet);
+	packet.data = job->data;
+	packet.size = (int)job->size;
+
+	ret = avcodec_decode_video2(decoder->context, decoder->frame,
+			&got_frame, &packet);
+	if (ret < 0 || !got_frame)
+		return NULL;
+
+	return convert_frame(decoder, job);
+}
+
+static inline void free_job(struct mjpeg_job *job)
+{
+	obs_source_release(job->source);
+	bfree(job->data);
+}
+
+static void *mjpeg_thread(void *param)
+{
+	struct obs_mjpeg_pool *pool = param;
+	struct mjpeg_decoder  decoder;
+	bool                  valid;
+
+	os_thread_init(OS_THREAD_CLASS_VIDEO, "obs mjpeg decode");
+
+	valid = mjpeg_decoder_init(&decoder);
+	if (!valid)
+		blog(LOG_ERROR, "mjpeg decoder: failed to create decoder");
+
+	while (os_sem_wait(pool->job_sem) == 0 && !pool->stop) {
+		struct mjpeg_job job;
+
+		pthread_mutex_lock(&pool->mutex);
+		circlebuf_pop_front(&pool->jobs, &job, sizeof(job));
+		pthread_mutex_unlock(&pool->mutex);
+
+		obs_source_mjpeg_decoded(job.source, job.seq,
+				valid ? decode_job(&decoder, &job) : NULL);
+		free_job(&job);
+	}
+
+	if (valid)
+		mjpeg_decoder_free(&decoder);
+	return NULL;
+}
+
+/* called with the pool mutex held */
+static void start_threads(struct obs_mjpeg_pool *pool)
+{
+	size_t num_threads = (size_t)os_get_logical_cores() / 2;
+
+	if (num_threads > MAX_MJPEG_THREADS)
+		num_threads = MAX_MJPEG_THREADS;
+	if (!num_threads)
+		num_threads = 1;
+
+	for (size_t i = 0; i < num_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, mjpeg_thread,
+					pool) != 0)
+			break;
+		pool->num_threads++;
+	}
+
+	if (!pool->num_threads)
+		blog(LOG_ERROR, "mjpeg decoder: failed to create decode "
+		                "threads, mjpeg frames will be dropped");
+
+	pool->started = true;
+}
+
+bool obs_mjpeg_pool_init(struct obs_mjpeg_pool *pool)
+{
+	memset(pool, 0, sizeof(struct obs_mjpeg_pool));
+	pthread_mutex_init_value(&pool->mutex);
+
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&pool->job_sem, 0) != 0)
+		return false;
+
+	circlebuf_init(&pool->jobs);
+	return true;
+}
+
+void obs_mjpeg_pool_free(struct obs_mjpeg_pool *pool)
+{
+	struct mjpeg_job job;
+	void *thread_ret;
+
+	pool->stop = true;
+
+	for (size_t i = 0; i < pool->num_threads; i++)
+		os_sem_post(pool->job_sem);
+	for (size_t i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], &thread_ret);
+
+	/* the sources of jobs that were never decoded are being freed too,
+	 * so nothing is output for them */
+	while (pool->jobs.size) {
+		circlebuf_pop_front(&pool->jobs, &job, sizeof(job));
+		free_job(&job);
+	}
+
+	circlebuf_free(&pool->jobs);
+	os_sem_destroy(pool->job_sem);
+	pthread_mutex_destroy(&pool->mutex);
+
+	memset(pool, 0, sizeof(struct obs_mjpeg_pool));
+}
+
+bool obs_mjpeg_pool_push(struct obs_mjpeg_pool *pool,
+		struct obs_source *source, uint64_t seq, const void *data,
+		size_t size, uint64_t timestamp)
+{
+	struct mjpeg_job job;
+	bool             success;
+
+	/* the decoder reads in blocks, and needs zeroed padding after the
+	 * data */
+	job.source    = source;
+	job.seq       = seq;
+	job.timestamp = timestamp;
+	job.size      = size;
+	job.data      = bmalloc(size + FF_INPUT_BUFFER_PADDING_SIZE);
+	memcpy(job.data, data, size);
+	memset(job.data + size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+
+	pthread_mutex_lock(&pool->mutex);
+
+	if (!pool->started)
+		start_threads(pool);
+
+	success = pool->num_threads && !pool->stop;
+	if (success) {
+		obs_source_addref(source);
+		circlebuf_push_back(&pool->jobs, &job, sizeof(job));
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (success)
+		os_sem_post(pool->job_sem);
+	else
+		bfree(job.data);
+
+	return success;
+}
@@ -17,6 +17,7 @@
 
 #include "util/platform.h"
 #include "util/dstr.h"
+#include "util/threading.h"
 
 #include "obs-defs.h"
 #include "obs-internal.h"
@@ -54,28 +55,453 @@ static int call_module_load(void *module, const char *path)
 	return MODULE_SUCCESS;
 }
 
+static const char *type_kind_names[MODULE_TYPE_COUNT] = {
+	"input",
+	"filter",
+	"transition",
+	"output",
+	"encoder",
+	"service"
+};
+
+static size_t get_type_count(enum obs_module_type_kind kind)
+{
+	switch (kind) {
+	case MODULE_TYPE_INPUT:      return obs->input_types.num;
+	case MODULE_TYPE_FILTER:     return obs->filter_types.num;
+	case MODULE_TYPE_TRANSITION: return obs->transition_types.num;
+	case MODULE_TYPE_OUTPUT:     return obs->output_types.num;
+	case MODULE_TYPE_ENCODER:    return obs->encoder_types.num;
+	case MODULE_TYPE_SERVICE:    return obs->service_types.num;
+	case MODULE_TYPE_COUNT:      break;
+	}
+
+	return 0;
+}
+
+static const char *get_type_id(enum obs_module_type_kind kind, size_t idx)
+{
+	switch (kind) {
+	case MODULE_TYPE_INPUT:      return obs->input_types.array[idx].id;
+	case MODULE_TYPE_FILTER:     return obs->filter_types.array[idx].id;
+	case MODULE_TYPE_TRANSITION: return obs->transition_types.array[idx].id;
+	case MODULE_TYPE_OUTPUT:     return obs->output_types.array[idx].id;
+	case MODULE_TYPE_ENCODER:    return obs->encoder_types.array[idx].id;
+	case MODULE_TYPE_SERVICE:    return obs->service_types.array[idx].id;
+	case MODULE_TYPE_COUNT:      break;
+	}
+
+	return NULL;
+}
+
+static void add_module_type(struct obs_module *mod,
+		enum obs_module_type_kind kind, const char *id)
+{
+	struct obs_module_type type = {kind, bstrdup(id)};
+	da_push_back(mod->types, &type);
+}
+
+static void free_module_types(struct obs_module *mod)
+{
+	for (size_t i = 0; i < mod->types.num; i++)
+		bfree(mod->types.array[i].id);
+	da_free(mod->types);
+}
+
+/* calls obs_module_load, and records the types the module registered so
+ * they can be written to the manifest */
+static int init_module(struct obs_module *mod, void *handle)
+{
+	size_t counts[MODULE_TYPE_COUNT];
+	int errorcode;
+
+	for (size_t i = 0; i < MODULE_TYPE_COUNT; i++)
+		counts[i] = get_type_count(i);
+
+	errorcode = call_module_load(handle, mod->name);
+	if (errorcode != MODULE_SUCCESS) {
+		os_dlclose(handle);
+		return errorcode;
+	}
+
+	free_module_types(mod);
+
+	for (size_t i = 0; i < MODULE_TYPE_COUNT; i++) {
+		size_t count = get_type_count(i);
+
+		for (size_t idx = counts[i]; idx < count; idx++)
+			add_module_type(mod, i, get_type_id(i, idx));
+	}
+
+	mod->module = handle;
+	return MODULE_SUCCESS;
+}
+
 int obs_load_module(const char *path)
 {
-	struct obs_module mod;
+	struct obs_module mod = {0};
 	char *plugin_path = find_plugin(path);
+	void *handle;
 	int errorcode;
 
-	mod.module = os_dlopen(plugin_path);
+	handle = os_dlopen(plugin_path);
+	if (plugin_path)
+		mod.mtime = os_get_file_mtime(plugin_path);
 	bfree(plugin_path);
-	if (!mod.module) {
+
+	if (!handle) {
 		blog(LOG_WARNING, "Module '%s' not found", path);
 		return MODULE_FILE_NOT_FOUND;
 	}
 
-	errorcode = call_module_load(mod.module, path);
-	if (errorcode != MODULE_SUCCESS) {
-		os_dlclose(mod.module);
-		return errorcode;
+	mod.name = bstrdup(path);
+
+	pthread_mutex_lock(&obs->module_mutex);
+
+	errorcode = init_module(&mod, handle);
+	if (errorcode == MODULE_SUCCESS)
+		da_push_back(obs->modules, &mod);
+	else
+		free_module(&mod);
+
+	pthread_mutex_unlock(&obs->module_mutex);
+	return errorcode;
+}
+
+static int load_deferred_module(size_t idx)
+{
+	struct obs_module mod = obs->deferred_modules.array[idx];
+	char *plugin_path = find_plugin(mod.name);
+	void *handle;
+	int errorcode;
+
+	da_erase(obs->deferred_modules, idx);
+
+	handle = os_dlopen(plugin_path);
+	bfree(plugin_path);
+
+	if (!handle) {
+		blog(LOG_WARNING, "Deferred module '%s' not found", mod.name);
+		free_module(&mod);
+		return MODULE_FILE_NOT_FOUND;
 	}
 
-	mod.name = bstrdup(path);
-	da_push_back(obs->modules, &mod);
-	return MODULE_SUCCESS;
+	errorcode = init_module(&mod, handle);
+	if (errorcode == MODULE_SUCCESS) {
+		blog(LOG_DEBUG, "Loaded deferred module '%s'", mod.name);
+		da_push_back(obs->modules, &mod);
+	} else {
+		free_module(&mod);
+	}
+
+	return errorcode;
+}
+
+static inline bool module_has_type(const struct obs_module *mod,
+		enum obs_module_type_kind kind, const char *id)
+{
+	for (size_t i = 0; i < mod->types.num; i++) {
+		const struct obs_module_type *type = mod->types.array+i;
+		if (type->kind == kind && strcmp(type->id, id) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+static inline bool module_has_kind(const struct obs_module *mod,
+		enum obs_module_type_kind kind)
+{
+	for (size_t i = 0; i < mod->types.num; i++)
+		if (mod->types.array[i].kind == kind)
+			return true;
+
+	return false;
+}
+
+bool obs_load_deferred_type(enum obs_module_type_kind kind, const char *id)
+{
+	bool loaded = false;
+
+	if (!obs || !id)
+		return false;
+
+	pthread_mutex_lock(&obs->module_mutex);
+
+	for (size_t i = 0; i < obs->deferred_modules.num; i++) {
+		if (module_has_type(obs->deferred_modules.array+i, kind, id)) {
+			loaded = load_deferred_module(i) == MODULE_SUCCESS;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&obs->module_mutex);
+	return loaded;
+}
+
+void obs_load_deferred_kind(enum obs_module_type_kind kind)
+{
+	size_t i = 0;
+
+	if (!obs)
+		return;
+
+	pthread_mutex_lock(&obs->module_mutex);
+
+	while (i < obs->deferred_modules.num) {
+		if (module_has_kind(obs->deferred_modules.array+i, kind))
+			load_deferred_module(i);
+		else
+			i++;
+	}
+
+	pthread_mutex_unlock(&obs->module_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+/* module manifest */
+
+#define MAX_MODULE_OPEN_THREADS 8
+
+struct module_open {
+	const char    *name;
+	char          *file;
+	int64_t       mtime;
+	void          *handle;
+};
+
+struct module_open_list {
+	struct module_open *opens;
+	long               count;
+	volatile long      next;
+};
+
+/* opening the libraries (and whatever they link to) is the slow part of
+ * loading modules and is safe to do in parallel, obs_module_load is still
+ * called serially afterward */
+static void *open_modules_thread(void *data)
+{
+	struct module_open_list *list = data;
+	long idx;
+
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "module loader");
+
+	while ((idx = os_atomic_inc_long(&list->next) - 1) < list->count) {
+		struct module_open *open = list->opens+idx;
+		open->handle = os_dlopen(open->file);
+	}
+
+	return NULL;
+}
+
+static void open_modules(struct module_open *opens, size_t count)
+{
+	struct module_open_list list = {opens, (long)count, 0};
+	pthread_t threads[MAX_MODULE_OPEN_THREADS - 1];
+	size_t    num_threads = 0;
+	size_t    max_threads = (size_t)os_get_logical_cores();
+
+	if (max_threads > MAX_MODULE_OPEN_THREADS)
+		max_threads = MAX_MODULE_OPEN_THREADS;
+	if (max_threads > count)
+		max_threads = count;
+
+	/* the calling thread opens modules as well */
+	while (num_threads + 1 < max_threads) {
+		if (pthread_create(threads+num_threads, NULL,
+					open_modules_thread, &list) != 0)
+			break;
+		num_threads++;
+	}
+
+	open_modules_thread(&list);
+
+	for (size_t i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+}
+
+static obs_data_t load_manifest(const char *path)
+{
+	obs_data_t manifest = NULL;
+	char       *json    = path ? os_quick_read_utf8_file(path) : NULL;
+
+	if (json) {
+		manifest = obs_data_create_from_json(json);
+		bfree(json);
+	}
+
+	/* type registration may change between versions of libobs */
+	if (manifest && obs_data_getint(manifest, "api_version") !=
+			LIBOBS_API_VER) {
+		obs_data_release(manifest);
+		manifest = NULL;
+	}
+
+	if (!manifest) {
+		manifest = obs_data_create();
+		obs_data_setint(manifest, "api_version", LIBOBS_API_VER);
+	}
+
+	return manifest;
+}
+
+static bool get_type_kind(const char *name, enum obs_module_type_kind *kind)
+{
+	for (size_t i = 0; i < MODULE_TYPE_COUNT; i++) {
+		if (name && strcmp(type_kind_names[i], name) == 0) {
+			*kind = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* modules without any types in the manifest are always loaded, they may
+ * have been registering something other than types */
+static bool defer_module(obs_data_t entry, const char *name, int64_t mtime)
+{
+	struct obs_module mod = {0};
+	obs_data_array_t  types;
+	size_t            count;
+
+	if (!entry || mtime == -1 || obs_data_getint(entry, "mtime") != mtime)
+		return false;
+
+	types = obs_data_getarray(entry, "types");
+	count = obs_data_array_count(types);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t item = obs_data_array_item(types, i);
+		const char *id  = obs_data_getstring(item, "id");
+		enum obs_module_type_kind kind;
+
+		if (id && *id && get_type_kind(
+					obs_data_getstring(item, "kind"), &kind))
+			add_module_type(&mod, kind, id);
+
+		obs_data_release(item);
+	}
+
+	obs_data_array_release(types);
+
+	if (!mod.types.num)
+		return false;
+
+	mod.name  = bstrdup(name);
+	mod.mtime = mtime;
+	da_push_back(obs->deferred_modules, &mod);
+	return true;
+}
+
+static void set_manifest_entry(obs_data_t modules, const struct obs_module *mod)
+{
+	obs_data_t       entry = obs_data_create();
+	obs_data_array_t types = obs_data_array_create();
+
+	for (size_t i = 0; i < mod->types.num; i++) {
+		const struct obs_module_type *type = mod->types.array+i;
+		obs_data_t item = obs_data_create();
+
+		obs_data_setstring(item, "kind", type_kind_names[type->kind]);
+		obs_data_setstring(item, "id", type->id);
+		obs_data_array_push_back(types, item);
+		obs_data_release(item);
+	}
+
+	obs_data_setint(entry, "mtime", mod->mtime);
+	obs_data_setarray(entry, "types", types);
+	obs_data_setobj(modules, mod->name, entry);
+
+	obs_data_array_release(types);
+	obs_data_release(entry);
+}
+
+static void save_manifest(obs_data_t manifest, const char *path)
+{
+	const char *json = obs_data_getjson(manifest);
+
+	if (!json || !os_quick_write_utf8_file(path, json, strlen(json), false))
+		blog(LOG_WARNING, "Failed to save module manifest '%s'", path);
+}
+
+static void load_opened_module(obs_data_t modules, struct module_open *open)
+{
+	struct obs_module mod = {0};
+
+	if (!open->handle) {
+		blog(LOG_WARNING, "Module '%s' failed to open", open->name);
+		obs_data_erase(modules, open->name);
+		return;
+	}
+
+	mod.name  = bstrdup(open->name);
+	mod.mtime = open->mtime;
+
+	if (init_module(&mod, open->handle) == MODULE_SUCCESS) {
+		set_manifest_entry(modules, &mod);
+		da_push_back(obs->modules, &mod);
+	} else {
+		obs_data_erase(modules, open->name);
+		free_module(&mod);
+	}
+}
+
+void obs_load_modules(const char **paths, size_t count,
+		const char *manifest_path)
+{
+	DARRAY(struct module_open) opens;
+	obs_data_t manifest;
+	obs_data_t modules;
+
+	if (!obs || !paths)
+		return;
+
+	manifest = load_manifest(manifest_path);
+	modules  = obs_data_getobj(manifest, "modules");
+	if (!modules) {
+		modules = obs_data_create();
+		obs_data_setobj(manifest, "modules", modules);
+	}
+
+	da_init(opens);
+
+	pthread_mutex_lock(&obs->module_mutex);
+
+	for (size_t i = 0; i < count; i++) {
+		struct module_open open = {paths[i], find_plugin(paths[i])};
+		obs_data_t entry;
+
+		if (!open.file) {
+			blog(LOG_WARNING, "Module '%s' not found", paths[i]);
+			continue;
+		}
+
+		open.mtime = os_get_file_mtime(open.file);
+
+		entry = obs_data_getobj(modules, paths[i]);
+		if (defer_module(entry, paths[i], open.mtime))
+			bfree(open.file);
+		else
+			da_push_back(opens, &open);
+		obs_data_release(entry);
+	}
+
+	open_modules(opens.array, opens.num);
+
+	for (size_t i = 0; i < opens.num; i++) {
+		load_opened_module(modules, opens.array+i);
+		bfree(opens.array[i].file);
+	}
+
+	pthread_mutex_unlock(&obs->module_mutex);
+
+	if (opens.num && manifest_path)
+		save_manifest(manifest, manifest_path);
+
+	da_free(opens);
+	obs_data_release(modules);
+	obs_data_release(manifest);
 }
 
 void free_module(struct obs_module *mod)
@@ -93,9 +519,91 @@ void free_module(struct obs_module *mod)
 		os_dlclose(mod->module);
 	}
 
+	free_module_types(mod);
 	bfree(mod->name);
 }
 
+/* ------------------------------------------------------------------------- */
+/* type registries */
+
+#define TYPE_INDEX_MIN_SLOTS 32
+
+static inline struct obs_type_slot *find_slot(struct obs_type_slot *slots,
+		size_t num_slots, const char *id, uint32_t hash)
+{
+	size_t mask = num_slots - 1;
+	size_t pos  = hash & mask;
+
+	while (slots[pos].id) {
+		if (slots[pos].hash == hash && strcmp(slots[pos].id, id) == 0)
+			break;
+		pos = (pos + 1) & mask;
+	}
+
+	return slots+pos;
+}
+
+static void type_index_resize(struct obs_type_index *index, size_t num_slots)
+{
+	struct obs_type_slot *slots = bzalloc(num_slots * sizeof(*slots));
+
+	for (size_t i = 0; i < index->num_slots; i++) {
+		struct obs_type_slot *slot = index->slots+i;
+		if (slot->id)
+			*find_slot(slots, num_slots, slot->id,
+					slot->hash) = *slot;
+	}
+
+	bfree(index->slots);
+	index->slots     = slots;
+	index->num_slots = num_slots;
+}
+
+void obs_type_index_insert(struct obs_type_index *index, const char *id,
+		size_t idx)
+{
+	struct obs_type_slot *slot;
+	uint32_t hash;
+
+	if (!id)
+		return;
+
+	/* keeps the index at most half full so probes stay short */
+	if ((index->num + 1) * 2 > index->num_slots)
+		type_index_resize(index, index->num_slots ?
+				index->num_slots * 2 : TYPE_INDEX_MIN_SLOTS);
+
+	hash = hash_fnv1a(id);
+	slot = find_slot(index->slots, index->num_slots, id, hash);
+	if (slot->id) {
+		blog(LOG_WARNING, "Type '%s' was already registered", id);
+		return;
+	}
+
+	slot->id   = id;
+	slot->hash = hash;
+	slot->idx  = idx;
+	index->num++;
+}
+
+size_t obs_type_index_find(const struct obs_type_index *index, const char *id)
+{
+	struct obs_type_slot *slot;
+
+	if (!index->num || !id)
+		return DARRAY_INVALID;
+
+	slot = find_slot(index->slots, index->num_slots, id,
+			hash_fnv1a(id));
+	return slot->id ? slot->idx : DARRAY_INVALID;
+}
+
+void obs_type_index_free(struct obs_type_index *index)
+{
+	bfree(index->slots);
+	memset(index, 0, sizeof(*index));
+}
+
 #define REGISTER_OBS_DEF(size_var, structure, dest, info)                 \
 	do {                                                              \
 		struct structure data = {0};                              \
@@ -122,6 +630,7 @@ void free_module(struct obs_module *mod)
 void obs_register_source_s(const struct obs_source_info *info, size_t size)
 {
 	struct obs_source_info data = {0};
+	struct obs_type_index *index;
 	struct darray *array;
 
 	CHECK_REQUIRED_VAL(info, getname, obs_register_source);
@@ -139,10 +648,13 @@ void obs_register_source_s(const struct obs_source_info *info, size_t size)
 
 	if (info->type == OBS_SOURCE_TYPE_INPUT) {
 		array = &obs->input_types.da;
+		index = &obs->input_index;
 	} else if (info->type == OBS_SOURCE_TYPE_FILTER) {
 		array = &obs->filter_types.da;
+		index = &obs->filter_index;
 	} else if (info->type == OBS_SOURCE_TYPE_TRANSITION) {
 		array = &obs->transition_types.da;
+		index = &obs->transition_index;
 	} else {
 		blog(LOG_ERROR, "Tried to register unknown source type: %u",
 				info->type);
@@ -150,6 +662,7 @@ void obs_register_source_s(const struct obs_source_info *info, size_t size)
 	}
 
 	darray_push_back(sizeof(struct obs_source_info), array, &data);
+	obs_type_index_insert(index, info->id, array->num - 1);
 }
 
 void obs_register_output_s(const struct obs_output_info *info, size_t size)
@@ -173,6 +686,8 @@ void obs_register_output_s(const struct obs_output_info *info, size_t size)
 	}
 
 	REGISTER_OBS_DEF(size, obs_output_info, obs->output_types, info);
+	obs_type_index_insert(&obs->output_index, info->id,
+			obs->output_types.num - 1);
 }
 
 void obs_register_encoder_s(const struct obs_encoder_info *info, size_t size)
@@ -186,6 +701,8 @@ void obs_register_encoder_s(const struct obs_encoder_info *info, size_t size)
 		CHECK_REQUIRED_VAL(info, frame_size, obs_register_encoder);
 
 	REGISTER_OBS_DEF(size, obs_encoder_info, obs->encoder_types, info);
+	obs_type_index_insert(&obs->encoder_index, info->id,
+			obs->encoder_types.num - 1);
 }
 
 void obs_register_service_s(const struct obs_service_info *info, size_t size)
@@ -195,6 +712,8 @@ void obs_register_service_s(const struct obs_service_info *info, size_t size)
 	CHECK_REQUIRED_VAL(info, destroy, obs_register_service);
 
 	REGISTER_OBS_DEF(size, obs_service_info, obs->service_types, info);
+	obs_type_index_insert(&obs->service_index, info->id,
+			obs->service_types.num - 1);
 }
 
 void obs_regsiter_modal_ui_s(const struct obs_modal_ui *info, size_t size)
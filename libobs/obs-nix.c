@@ -37,14 +37,15 @@ static inline bool check_lib_path(const char* data, const char *path,
 		struct dstr *output)
 {
 	bool result = false;
-	struct dstr tmp;
+	struct dstr_small small;
+	struct dstr *tmp = dstr_small_init(&small);
 	
-	dstr_init_copy(&tmp, "lib");
-	dstr_cat(&tmp, data);
-	dstr_cat(&tmp, ".so");
-	result = check_path(tmp.array, path, output); 
+	dstr_copy(tmp, "lib");
+	dstr_cat(tmp, data);
+	dstr_cat(tmp, ".so");
+	result = check_path(tmp->array, path, output); 
 	
-	dstr_free(&tmp);
+	dstr_free(tmp);
 	
 	return result;
 }
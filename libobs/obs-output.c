@@ -20,14 +20,19 @@
 
 static inline void signal_stop(struct obs_output *output, int code);
 
-static inline const struct obs_output_info *find_output(const char *id)
+static inline const struct obs_output_info *find_output_type(const char *id)
 {
-	size_t i;
-	for (i = 0; i < obs->output_types.num; i++)
-		if (strcmp(obs->output_types.array[i].id, id) == 0)
-			return obs->output_types.array+i;
+	size_t idx = obs_type_index_find(&obs->output_index, id);
+	return (idx != DARRAY_INVALID) ? obs->output_types.array+idx : NULL;
+}
 
-	return NULL;
+static const struct obs_output_info *find_output(const char *id)
+{
+	const struct obs_output_info *info = find_output_type(id);
+
+	if (!info && obs_load_deferred_type(MODULE_TYPE_OUTPUT, id))
+		info = find_output_type(id);
+	return info;
 }
 
 const char *obs_output_getdisplayname(const char *id, const char *locale)
@@ -74,6 +79,7 @@ obs_output_t obs_output_create(const char *id, const char *name,
 	output->info     = *info;
 	output->video    = obs_video();
 	output->audio    = obs_audio();
+	output->share_encoders = true;
 	if (output->info.defaults)
 		output->info.defaults(output->context.settings);
 
@@ -94,17 +100,45 @@ fail:
 	return NULL;
 }
 
+static inline void free_packet_queue(struct circlebuf *queue)
+{
+	struct encoder_packet packet;
+
+	while (queue->size) {
+		circlebuf_pop_front(queue, &packet, sizeof(packet));
+		obs_encoder_packet_release(&packet);
+	}
+
+	circlebuf_free(queue);
+}
+
 static inline void free_packets(struct obs_output *output)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_free_encoder_packet(output->interleaved_packets.array+i);
-	da_free(output->interleaved_packets);
+	free_packet_queue(&output->interleaved_video);
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
+		free_packet_queue(&output->interleaved_audio[i]);
+}
+
+static void wait_for_stop(struct obs_output *output)
+{
+	if (!output->stop_thread_active)
+		return;
+
+	/* destroyed from a stop signal handler */
+	if (pthread_equal(pthread_self(), output->stop_thread))
+		pthread_detach(output->stop_thread);
+	else
+		pthread_join(output->stop_thread, NULL);
+
+	output->stop_thread_active = false;
 }
 
 void obs_output_destroy(obs_output_t output)
 {
 	if (output) {
 		obs_context_data_remove(&output->context);
+		wait_for_stop(output);
 
 		if (output->valid && output->active)
 			output->info.stop(output->context.data);
@@ -124,18 +158,65 @@ void obs_output_destroy(obs_output_t output)
 
 bool obs_output_start(obs_output_t output)
 {
-	return (output != NULL) ?
-		output->info.start(output->context.data) : false;
+	if (!output)
+		return false;
+
+	wait_for_stop(output);
+	return output->info.start(output->context.data);
 }
 
 void obs_output_stop(obs_output_t output)
 {
 	if (output) {
+		/* already being stopped asynchronously */
+		if (output->stop_thread_active) {
+			wait_for_stop(output);
+			return;
+		}
+
 		output->info.stop(output->context.data);
 		signal_stop(output, OBS_OUTPUT_SUCCESS);
 	}
 }
 
+static void *stop_thread(void *data)
+{
+	struct obs_output *output = data;
+
+	os_thread_init(OS_THREAD_CLASS_OUTPUT, "output stop");
+
+	output->info.stop(output->context.data);
+	output->stopping = false;
+	signal_stop(output, OBS_OUTPUT_SUCCESS);
+	return NULL;
+}
+
+void obs_output_stop_async(obs_output_t output)
+{
+	if (!output || output->stopping)
+		return;
+
+	wait_for_stop(output);
+
+	output->stopping           = true;
+	output->stop_thread_active = true;
+
+	if (pthread_create(&output->stop_thread, NULL, stop_thread,
+				output) != 0) {
+		blog(LOG_WARNING, "Failed to create the stop thread of "
+		                  "output '%s', stopping it here",
+		                  output->context.name);
+		output->stopping           = false;
+		output->stop_thread_active = false;
+		obs_output_stop(output);
+	}
+}
+
+bool obs_output_stopping(obs_output_t output)
+{
+	return (output != NULL) ? output->stopping : false;
+}
+
 bool obs_output_active(obs_output_t output)
 {
 	return (output != NULL) ? output->active : false;
@@ -249,8 +330,124 @@ void obs_output_remove_encoder(struct obs_output *output,
 
 	if (output->video_encoder == encoder)
 		output->video_encoder = NULL;
-	else if (output->audio_encoder == encoder)
-		output->audio_encoder = NULL;
+	if (output->own_video_encoder == encoder)
+		output->own_video_encoder = NULL;
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		if (output->audio_encoders[i] == encoder)
+			output->audio_encoders[i] = NULL;
+		if (output->own_audio_encoders[i] == encoder)
+			output->own_audio_encoders[i] = NULL;
+	}
+}
+
+void obs_output_set_share_encoders(obs_output_t output, bool share)
+{
+	if (output)
+		output->share_encoders = share;
+}
+
+/* packets are mapped to their track by encoder, so an encoder can only
+ * encode one track of an output */
+static bool audio_encoder_in_use(const struct obs_output *output,
+		const struct obs_encoder *encoder)
+{
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
+		if (output->audio_encoders[i] == encoder)
+			return true;
+
+	return false;
+}
+
+/* swaps in an equivalent encoder that's already running, so the same data
+ * isn't encoded twice.  the output's own encoder is put back by
+ * restore_own_encoders when data capture ends */
+static void share_encoder(struct obs_output *output, obs_encoder_t *slot,
+		obs_encoder_t *own_slot)
+{
+	struct obs_encoder *encoder = *slot;
+	struct obs_encoder *shared;
+
+	if (!encoder)
+		return;
+
+	if (!output->share_encoders) {
+		encoder->exclusive = true;
+		return;
+	}
+
+	shared = obs_encoder_find_equivalent(encoder);
+	if (!shared)
+		return;
+
+	/* equivalent encoders of two tracks can't both become one */
+	if (shared->info.type == OBS_ENCODER_AUDIO &&
+	    audio_encoder_in_use(output, shared))
+		return;
+
+	blog(LOG_INFO, "output '%s': Sharing encoder '%s' in place of "
+	               "encoder '%s'", output->context.name,
+	               shared->context.name, encoder->context.name);
+
+	/* the shared encoder clears the slot if it goes away before the
+	 * output starts using it */
+	obs_encoder_add_output(shared, output);
+	*own_slot = encoder;
+	*slot     = shared;
+}
+
+/* the shared encoder is only used through the slot from here on, so if it
+ * is destroyed when the output stops using it, it doesn't need to clear the
+ * slot any more */
+static void release_shared_encoder(struct obs_output *output,
+		obs_encoder_t *slot, obs_encoder_t *own_slot)
+{
+	if (*own_slot)
+		obs_encoder_remove_output(*slot, output);
+}
+
+static void restore_own_encoder(obs_encoder_t *slot, obs_encoder_t *own_slot)
+{
+	if (*own_slot) {
+		*slot     = *own_slot;
+		*own_slot = NULL;
+	}
+}
+
+static void release_shared_encoders(struct obs_output *output)
+{
+	release_shared_encoder(output, &output->video_encoder,
+			&output->own_video_encoder);
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
+		release_shared_encoder(output, &output->audio_encoders[i],
+				&output->own_audio_encoders[i]);
+}
+
+static void restore_own_encoders(struct obs_output *output)
+{
+	restore_own_encoder(&output->video_encoder,
+			&output->own_video_encoder);
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
+		restore_own_encoder(&output->audio_encoders[i],
+				&output->own_audio_encoders[i]);
+}
+
+static void share_encoders(struct obs_output *output, bool has_video,
+		bool has_audio)
+{
+	/* in case the last start failed before data capture began */
+	release_shared_encoders(output);
+	restore_own_encoders(output);
+
+	if (has_video)
+		share_encoder(output, &output->video_encoder,
+				&output->own_video_encoder);
+	if (!has_audio)
+		return;
+
+	for (size_t i = 0; i < (has_video ? MAX_AUDIO_MIXES : 1); i++)
+		share_encoder(output, &output->audio_encoders[i],
+				&output->own_audio_encoders[i]);
 }
 
 void obs_output_set_video_encoder(obs_output_t output, obs_encoder_t encoder)
@@ -259,20 +456,52 @@ void obs_output_set_video_encoder(obs_output_t output, obs_encoder_t encoder)
 	if (output->video_encoder == encoder) return;
 	if (encoder && encoder->info.type != OBS_ENCODER_VIDEO) return;
 
+	if (output->own_video_encoder) {
+		obs_encoder_remove_output(output->video_encoder, output);
+		output->own_video_encoder = NULL;
+	}
+
 	obs_encoder_remove_output(encoder, output);
 	obs_encoder_add_output(encoder, output);
 	output->video_encoder = encoder;
 }
 
-void obs_output_set_audio_encoder(obs_output_t output, obs_encoder_t encoder)
+void obs_output_set_audio_encoder_track(obs_output_t output,
+		obs_encoder_t encoder, size_t track)
 {
-	if (!output) return;
-	if (output->audio_encoder == encoder) return;
+	if (!output || track >= MAX_AUDIO_MIXES) return;
+	if (output->audio_encoders[track] == encoder) return;
 	if (encoder && encoder->info.type != OBS_ENCODER_AUDIO) return;
 
+	if (track && (output->info.flags & OBS_OUTPUT_MULTI_TRACK) == 0) {
+		blog(LOG_WARNING, "obs_output_set_audio_encoder_track: "
+		                  "Output '%s' only has one audio track",
+		                  output->context.name);
+		return;
+	}
+
+	if (encoder && audio_encoder_in_use(output, encoder)) {
+		blog(LOG_WARNING, "obs_output_set_audio_encoder_track: "
+		                  "Encoder '%s' already encodes another audio "
+		                  "track of output '%s'",
+		                  encoder->context.name, output->context.name);
+		return;
+	}
+
+	if (output->own_audio_encoders[track]) {
+		obs_encoder_remove_output(output->audio_encoders[track],
+				output);
+		output->own_audio_encoders[track] = NULL;
+	}
+
 	obs_encoder_remove_output(encoder, output);
 	obs_encoder_add_output(encoder, output);
-	output->audio_encoder = encoder;
+	output->audio_encoders[track] = encoder;
+}
+
+void obs_output_set_audio_encoder(obs_output_t output, obs_encoder_t encoder)
+{
+	obs_output_set_audio_encoder_track(output, encoder, 0);
 }
 
 obs_encoder_t obs_output_get_video_encoder(obs_output_t output)
@@ -282,7 +511,14 @@ obs_encoder_t obs_output_get_video_encoder(obs_output_t output)
 
 obs_encoder_t obs_output_get_audio_encoder(obs_output_t output)
 {
-	return output ? output->audio_encoder : NULL;
+	return output ? output->audio_encoders[0] : NULL;
+}
+
+obs_encoder_t obs_output_get_audio_encoder_track(obs_output_t output,
+		size_t track)
+{
+	return (output && track < MAX_AUDIO_MIXES) ?
+		output->audio_encoders[track] : NULL;
 }
 
 void obs_output_set_service(obs_output_t output, obs_service_t service)
@@ -334,7 +570,7 @@ static bool can_begin_data_capture(struct obs_output *output, bool encoded,
 
 	if (has_audio) {
 		if (encoded) {
-			if (!output->audio_encoder)
+			if (!output->audio_encoders[0])
 				return false;
 		} else {
 			if (!output->audio)
@@ -361,7 +597,8 @@ static inline struct audio_convert_info *get_audio_conversion(
 }
 
 static bool prepare_interleaved_packet(struct obs_output *output,
-		struct encoder_packet *out, struct encoder_packet *in)
+		struct encoder_packet *out, struct encoder_packet *in,
+		size_t track)
 {
 	int64_t offset;
 
@@ -383,17 +620,18 @@ static bool prepare_interleaved_packet(struct obs_output *output,
 		    in->dts_usec < output->first_video_ts)
 			return false;
 
-		if (!output->received_audio) {
-			output->audio_offset   = in->dts;
-			output->received_audio = true;
+		if (!output->received_audio[track]) {
+			output->audio_offsets[track]  = in->dts;
+			output->received_audio[track] = true;
 		}
 
-		offset = output->audio_offset;
+		offset = output->audio_offsets[track];
 	}
 
-	obs_duplicate_encoder_packet(out, in);
+	obs_encoder_packet_ref(out, in);
 	out->dts -= offset;
 	out->pts -= offset;
+	out->track_idx = track;
 
 	/* convert the newly adjusted dts to relative dts time to ensure proper
 	 * interleaving.  if we're using an audio encoder that's already been
@@ -405,71 +643,130 @@ static bool prepare_interleaved_packet(struct obs_output *output,
 	return true;
 }
 
-static inline bool has_higher_opposing_ts(struct obs_output *output,
-		struct encoder_packet *packet)
+static inline int64_t front_dts_usec(struct circlebuf *queue)
 {
-	if (packet->type == OBS_ENCODER_VIDEO)
-		return output->highest_audio_ts > packet->dts_usec;
-	else
-		return output->highest_video_ts > packet->dts_usec;
+	struct encoder_packet packet;
+	circlebuf_peek_front(queue, &packet, sizeof(packet));
+	return packet.dts_usec;
 }
 
-static inline void send_interleaved(struct obs_output *output)
+static inline void send_interleaved(struct obs_output *output,
+		struct circlebuf *queue)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
-
-	/* do not send an interleaved packet if there's no packet of the
-	 * opposing type of a higher timstamp in the interleave buffer.
-	 * this ensures that the timestamps are monotonic */
-	if (!has_higher_opposing_ts(output, &out))
-		return;
+	struct encoder_packet out;
 
-	da_erase(output->interleaved_packets, 0);
+	circlebuf_pop_front(queue, &out, sizeof(out));
 	output->info.encoded_packet(output->context.data, &out);
-	obs_free_encoder_packet(&out);
+	obs_encoder_packet_release(&out);
 }
 
-static inline void set_higher_ts(struct obs_output *output,
-		struct encoder_packet *packet)
+/* each encoder outputs packets in dts order, so the video queue and each
+ * audio track's queue are already monotonic and only need to be merged.  a
+ * packet at the front of one queue can only be sent once every other queue
+ * has a packet to compare it against, otherwise a later packet of another
+ * queue could still arrive with a lower timestamp. */
+static void send_interleaved_packets(struct obs_output *output)
 {
-	if (packet->type == OBS_ENCODER_VIDEO) {
-		if (output->highest_video_ts < packet->dts_usec)
-			output->highest_video_ts = packet->dts_usec;
-	} else {
-		if (output->highest_audio_ts < packet->dts_usec)
-			output->highest_audio_ts = packet->dts_usec;
+	struct circlebuf *video = &output->interleaved_video;
+
+	while (video->size) {
+		struct circlebuf *next     = video;
+		int64_t          next_dts = front_dts_usec(video);
+
+		for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+			struct circlebuf *audio = &output->interleaved_audio[i];
+			int64_t          dts;
+
+			if (!output->audio_encoders[i])
+				continue;
+			if (!audio->size)
+				return;
+
+			dts = front_dts_usec(audio);
+			if (dts < next_dts) {
+				next     = audio;
+				next_dts = dts;
+			}
+		}
+
+		send_interleaved(output, next);
 	}
 }
 
+static inline size_t get_track_index(const struct obs_output *output,
+		const struct encoder_packet *packet)
+{
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
+		if (output->audio_encoders[i] == packet->encoder)
+			return i;
+
+	return 0;
+}
+
+static inline bool received_all_audio(const struct obs_output *output)
+{
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
+		if (output->audio_encoders[i] && !output->received_audio[i])
+			return false;
+
+	return true;
+}
+
 static void interleave_packets(void *data, struct encoder_packet *packet)
 {
 	struct obs_output     *output = data;
 	struct encoder_packet out;
-	size_t                idx;
+	size_t                track  = 0;
+
+	if (packet->type == OBS_ENCODER_AUDIO)
+		track = get_track_index(output, packet);
 
 	pthread_mutex_lock(&output->interleaved_mutex);
 
-	if (prepare_interleaved_packet(output, &out, packet)) {
-		for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-			struct encoder_packet *cur_packet;
-			cur_packet = output->interleaved_packets.array + idx;
+	if (prepare_interleaved_packet(output, &out, packet, track)) {
+		struct circlebuf *queue = (out.type == OBS_ENCODER_VIDEO) ?
+			&output->interleaved_video :
+			&output->interleaved_audio[track];
 
-			if (out.dts_usec < cur_packet->dts_usec)
-				break;
-		}
+		circlebuf_push_back(queue, &out, sizeof(out));
 
-		da_insert(output->interleaved_packets, idx, &out);
-		set_higher_ts(output, &out);
-
-		/* when both video and audio have been received, we're ready
-		 * to start sending out packets (one at a time) */
-		if (output->received_audio && output->received_video)
-			send_interleaved(output);
+		/* when video and every audio track have been received, we're
+		 * ready to start sending out packets */
+		if (output->received_video && received_all_audio(output))
+			send_interleaved_packets(output);
 	}
 
 	pthread_mutex_unlock(&output->interleaved_mutex);
 }
 
+/* audio-only capture has nothing to interleave the other tracks with, so
+ * only track 0 is used */
+static void start_audio_encoders(struct obs_output *output, bool has_video,
+		void (*encoded_callback)(void *data,
+			struct encoder_packet *packet),
+		void *param)
+{
+	size_t tracks = has_video ? MAX_AUDIO_MIXES : 1;
+
+	for (size_t i = 0; i < tracks; i++)
+		if (output->audio_encoders[i])
+			obs_encoder_start(output->audio_encoders[i],
+					encoded_callback, param);
+}
+
+static void stop_audio_encoders(struct obs_output *output, bool has_video,
+		void (*encoded_callback)(void *data,
+			struct encoder_packet *packet),
+		void *param)
+{
+	size_t tracks = has_video ? MAX_AUDIO_MIXES : 1;
+
+	for (size_t i = 0; i < tracks; i++)
+		if (output->audio_encoders[i])
+			obs_encoder_stop(output->audio_encoders[i],
+					encoded_callback, param);
+}
+
 static void hook_data_capture(struct obs_output *output, bool encoded,
 		bool has_video, bool has_audio)
 {
@@ -477,10 +774,9 @@ static void hook_data_capture(struct obs_output *output, bool encoded,
 	void *param;
 
 	if (encoded) {
-		output->received_video   = false;
-		output->received_video   = false;
-		output->highest_audio_ts = 0;
-		output->highest_video_ts = 0;
+		output->received_video = false;
+		memset(output->received_audio, 0,
+				sizeof(output->received_audio));
 		free_packets(output);
 
 		encoded_callback = (has_video && has_audio) ?
@@ -492,7 +788,7 @@ static void hook_data_capture(struct obs_output *output, bool encoded,
 			obs_encoder_start(output->video_encoder,
 					encoded_callback, param);
 		if (has_audio)
-			obs_encoder_start(output->audio_encoder,
+			start_audio_encoders(output, has_video,
 					encoded_callback, param);
 	} else {
 		if (has_video)
@@ -510,7 +806,9 @@ static void hook_data_capture(struct obs_output *output, bool encoded,
 
 static inline void signal_start(struct obs_output *output)
 {
-	struct calldata params = {0};
+	uint8_t stack[CALLDATA_FIXED_SIZE];
+	struct calldata params;
+	calldata_init_fixed(&params, stack, sizeof(stack));
 	calldata_setptr(&params, "output", output);
 	signal_handler_signal(output->context.signals, "start", &params);
 	calldata_free(&params);
@@ -518,7 +816,9 @@ static inline void signal_start(struct obs_output *output)
 
 static inline void signal_stop(struct obs_output *output, int code)
 {
-	struct calldata params = {0};
+	uint8_t stack[CALLDATA_FIXED_SIZE];
+	struct calldata params;
+	calldata_init_fixed(&params, stack, sizeof(stack));
 	calldata_setint(&params, "errorcode", code);
 	calldata_setptr(&params, "output", output);
 	signal_handler_signal(output->context.signals, "stop", &params);
@@ -529,12 +829,13 @@ static inline void convert_flags(struct obs_output *output, uint32_t flags,
 		bool *encoded, bool *has_video, bool *has_audio,
 		bool *has_service)
 {
-	*encoded = (output->info.flags & OBS_OUTPUT_ENCODED) != 0;
 	if (!flags)
 		flags = output->info.flags;
 	else
 		flags &= output->info.flags;
 
+	*encoded     = (flags & OBS_OUTPUT_ENCODED) != 0;
+
 	*has_video   = (flags & OBS_OUTPUT_VIDEO)   != 0;
 	*has_audio   = (flags & OBS_OUTPUT_AUDIO)   != 0;
 	*has_service = (flags & OBS_OUTPUT_SERVICE) != 0;
@@ -566,16 +867,29 @@ bool obs_output_initialize_encoders(obs_output_t output, uint32_t flags)
 
 	if (!encoded)
 		return false;
+
+	share_encoders(output, has_video, has_audio);
+
 	if (has_video && !obs_encoder_initialize(output->video_encoder))
 		return false;
-	if (has_audio && !obs_encoder_initialize(output->audio_encoder))
-		return false;
+	if (!has_audio)
+		return true;
 
-	if (has_video && has_audio && !output->audio_encoder->active &&
-	    !output->video_encoder->active) {
-		output->audio_encoder->wait_for_video = true;
-		output->video_encoder->paired_encoder = output->audio_encoder;
-		output->audio_encoder->paired_encoder = output->video_encoder;
+	for (size_t i = 0; i < (has_video ? MAX_AUDIO_MIXES : 1); i++) {
+		struct obs_encoder *audio = output->audio_encoders[i];
+
+		if (!audio)
+			continue;
+		if (!obs_encoder_initialize(audio))
+			return false;
+
+		if (has_video && !audio->active &&
+		    !output->video_encoder->active) {
+			audio->wait_for_video = true;
+			audio->paired_encoder = output->video_encoder;
+			if (!output->video_encoder->paired_encoder)
+				output->video_encoder->paired_encoder = audio;
+		}
 	}
 
 	return true;
@@ -600,6 +914,7 @@ bool obs_output_begin_data_capture(obs_output_t output, uint32_t flags)
 	if (has_service)
 		obs_service_activate(output->service);
 
+	output->capture_flags = flags;
 	output->active = true;
 	signal_start(output);
 	return true;
@@ -612,10 +927,16 @@ void obs_output_end_data_capture(obs_output_t output)
 	void *param;
 
 	if (!output) return;
-	if (!output->active) return;
 
-	convert_flags(output, 0, &encoded, &has_video, &has_audio,
-			&has_service);
+	release_shared_encoders(output);
+
+	if (!output->active) {
+		restore_own_encoders(output);
+		return;
+	}
+
+	convert_flags(output, output->capture_flags, &encoded, &has_video,
+			&has_audio, &has_service);
 
 	if (encoded) {
 		encoded_callback = (has_video && has_audio) ?
@@ -627,7 +948,7 @@ void obs_output_end_data_capture(obs_output_t output)
 			obs_encoder_stop(output->video_encoder,
 					encoded_callback, param);
 		if (has_audio)
-			obs_encoder_stop(output->audio_encoder,
+			stop_audio_encoders(output, has_video,
 					encoded_callback, param);
 	} else {
 		if (has_video)
@@ -643,6 +964,7 @@ void obs_output_end_data_capture(obs_output_t output)
 	if (has_service)
 		obs_service_deactivate(output->service, false);
 
+	restore_own_encoders(output);
 	output->active = false;
 }
 
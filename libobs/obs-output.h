@@ -22,6 +22,18 @@
 #define OBS_OUTPUT_AV          (OBS_OUTPUT_VIDEO | OBS_OUTPUT_AUDIO)
 #define OBS_OUTPUT_ENCODED     (1<<2)
 #define OBS_OUTPUT_SERVICE     (1<<3)
+#define OBS_OUTPUT_MULTI_TRACK (1<<4)
+
+/*
+ * An encoded output that sets OBS_OUTPUT_MULTI_TRACK can be given an audio
+ * encoder for each audio track (see obs_output_set_audio_encoder_track).
+ * Audio packets then have encoder_packet::track_idx set to their track.
+ * Track 0 is always required; other tracks are only used along with video.
+ *
+ * An output that sets OBS_OUTPUT_ENCODED and also implements raw_video and/or
+ * raw_audio can capture either.  Capture is encoded by default; pass flags
+ * without OBS_OUTPUT_ENCODED to the data capture functions for raw data.
+ */
 
 struct encoder_packet;
 
@@ -42,6 +54,11 @@ struct obs_output_info {
 	void (*raw_video)(void *data, struct video_data *frame);
 	void (*raw_audio)(void *data, struct audio_data *frames);
 
+	/**
+	 * Called with each encoded packet.  The packet data is reference
+	 * counted; to keep the packet after returning, use
+	 * obs_encoder_packet_ref instead of copying it.
+	 */
 	void (*encoded_packet)(void *data, struct encoder_packet *packet);
 
 	/* optional */
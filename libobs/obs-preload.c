@@ -0,0 +1,149 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+
+#include "obs-internal.h"
+
+/*
+ * Shows sources ahead of time on a worker thread, so the captures they
+ * start, the devices and media they open and the textures they load when
+ * shown are ready before they're switched to.  Showing and hiding are queued
+ * in order on the same thread, so a source is never shown and hidden by the
+ * preloader at the same time.  Preloaded sources are not rendered until they
+ * are set as the source of a view.
+ */
+
+struct preload_task {
+	struct obs_source               *source;
+	bool                            show;
+};
+
+static void run_task(struct preload_task *task)
+{
+	if (task->show) {
+		obs_source_activate(task->source, AUX_VIEW);
+	} else {
+		obs_source_deactivate(task->source, AUX_VIEW);
+		obs_source_release(task->source);
+	}
+}
+
+static void *preload_thread(void *param)
+{
+	struct obs_preloader *preloader = param;
+
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "obs preload");
+
+	while (os_sem_wait(preloader->task_sem) == 0) {
+		struct preload_task task;
+
+		pthread_mutex_lock(&preloader->mutex);
+		if (!preloader->tasks.size) {
+			pthread_mutex_unlock(&preloader->mutex);
+			break;
+		}
+		circlebuf_pop_front(&preloader->tasks, &task, sizeof(task));
+		pthread_mutex_unlock(&preloader->mutex);
+
+		run_task(&task);
+	}
+
+	return NULL;
+}
+
+bool obs_preloader_init(struct obs_preloader *preloader)
+{
+	memset(preloader, 0, sizeof(struct obs_preloader));
+	pthread_mutex_init_value(&preloader->mutex);
+
+	if (pthread_mutex_init(&preloader->mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&preloader->task_sem, 0) != 0)
+		return false;
+
+	circlebuf_init(&preloader->tasks);
+	return true;
+}
+
+/* the remaining tasks are finished first, so every preloaded source is
+ * hidden and released again */
+void obs_preloader_free(struct obs_preloader *preloader)
+{
+	struct preload_task task;
+
+	if (preloader->threaded) {
+		/* one post too many makes the thread exit once it's done */
+		os_sem_post(preloader->task_sem);
+		pthread_join(preloader->thread, NULL);
+	}
+
+	while (preloader->tasks.size) {
+		circlebuf_pop_front(&preloader->tasks, &task, sizeof(task));
+		run_task(&task);
+	}
+
+	circlebuf_free(&preloader->tasks);
+	os_sem_destroy(preloader->task_sem);
+	pthread_mutex_destroy(&preloader->mutex);
+
+	memset(preloader, 0, sizeof(struct obs_preloader));
+}
+
+static void push_task(struct obs_source *source, bool show)
+{
+	struct obs_preloader *preloader = &obs->data.preloader;
+	struct preload_task  task       = {source, show};
+	bool                 threaded;
+
+	pthread_mutex_lock(&preloader->mutex);
+
+	if (!preloader->started) {
+		preloader->started = true;
+		preloader->threaded = pthread_create(&preloader->thread,
+				NULL, preload_thread, preloader) == 0;
+		if (!preloader->threaded)
+			blog(LOG_WARNING, "Failed to create the preload "
+			                  "thread, sources will be preloaded "
+			                  "synchronously");
+	}
+
+	threaded = preloader->threaded;
+	if (threaded)
+		circlebuf_push_back(&preloader->tasks, &task, sizeof(task));
+
+	pthread_mutex_unlock(&preloader->mutex);
+
+	if (threaded)
+		os_sem_post(preloader->task_sem);
+	else
+		run_task(&task);
+}
+
+void obs_preload_source(struct obs_source *source)
+{
+	if (!source)
+		return;
+
+	obs_source_addref(source);
+	push_task(source, true);
+}
+
+void obs_end_preload_source(struct obs_source *source)
+{
+	if (source)
+		push_task(source, false);
+}
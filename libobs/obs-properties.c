@@ -17,6 +17,8 @@
 
 #include "util/bmem.h"
 #include "util/darray.h"
+#include "util/platform.h"
+#include "util/threading.h"
 #include "obs-properties.h"
 
 static inline void *get_property_data(struct obs_property *prop);
@@ -45,10 +47,18 @@ struct text_data {
 	enum obs_text_type type;
 };
 
+struct list_cache;
+
 struct list_data {
 	DARRAY(struct list_item) items;
 	enum obs_combo_type      type;
 	enum obs_combo_format    format;
+
+	/* async lists only */
+	struct list_cache         *cache;
+	uint64_t                  cache_generation;
+	obs_property_list_ready_t ready;
+	void                      *ready_data;
 };
 
 static inline void list_item_free(struct list_data *data,
@@ -127,10 +137,14 @@ obs_properties_t obs_properties_create_param(const char *locale,
 	return props;
 }
 
+static void list_cache_remove_waiter(struct obs_property *p);
+
 static void obs_property_destroy(struct obs_property *property)
 {
 	if (property->type == OBS_PROPERTY_LIST) {
 		struct list_data *data = get_property_data(property);
+		if (data->cache)
+			list_cache_remove_waiter(property);
 		list_data_free(data);
 	}
 
@@ -572,3 +586,300 @@ double obs_property_list_item_float(obs_property_t p, size_t idx)
 	return (data && idx < data->items.num) ?
 		data->items.array[idx].d : 0.0;
 }
+
+/* ------------------------------------------------------------------------- */
+/* async lists */
+
+/* cached lists older than this are shown right away, but are enumerated
+ * again in the background */
+#define LIST_CACHE_MAX_AGE_NS 10000000000ULL
+
+struct list_cache {
+	char                         *id;
+	obs_property_list_populate_t populate;
+	struct list_data             list;
+
+	/* 0 until the first enumeration has finished */
+	uint64_t                     generation;
+	uint64_t                     populate_time;
+
+	bool                         populating;
+	bool                         repopulate;
+	bool                         thread_active;
+	pthread_t                    thread;
+
+	DARRAY(struct obs_property*) waiters;
+};
+
+static pthread_mutex_t list_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(struct list_cache*) list_caches;
+static bool list_caches_stopping = false;
+
+static void copy_list_items(struct list_data *dst, struct list_data *src)
+{
+	list_data_free(dst);
+
+	for (size_t i = 0; i < src->items.num; i++) {
+		struct list_item *item = src->items.array+i;
+
+		if (src->format == OBS_COMBO_FORMAT_STRING)
+			add_item(dst, item->name, item->str);
+		else if (src->format == OBS_COMBO_FORMAT_INT)
+			add_item(dst, item->name, &item->ll);
+		else
+			add_item(dst, item->name, &item->d);
+	}
+}
+
+static void *list_cache_thread(void *param)
+{
+	struct list_cache *cache = param;
+	bool              done   = false;
+
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "list enumerate");
+
+	while (!done) {
+		obs_properties_t props = obs_properties_create(NULL);
+		obs_property_t   list  = obs_properties_add_list(props,
+				cache->id, NULL, OBS_COMBO_TYPE_LIST,
+				cache->list.format);
+
+		cache->populate(list);
+
+		pthread_mutex_lock(&list_cache_mutex);
+
+		list_data_free(&cache->list);
+		da_move(cache->list.items, get_list_data(list)->items);
+		cache->generation++;
+		cache->populate_time = os_gettime_ns();
+
+		done = !cache->repopulate || list_caches_stopping;
+		cache->repopulate = false;
+		if (done)
+			cache->populating = false;
+
+		for (size_t i = 0; i < cache->waiters.num; i++) {
+			struct obs_property *p    = cache->waiters.array[i];
+			struct list_data    *data = get_list_data(p);
+
+			if (data->ready)
+				data->ready(data->ready_data, p);
+		}
+
+		pthread_mutex_unlock(&list_cache_mutex);
+
+		obs_properties_destroy(props);
+	}
+
+	return NULL;
+}
+
+/* list_cache_mutex must be locked */
+static void list_cache_start(struct list_cache *cache)
+{
+	if (cache->populating || list_caches_stopping)
+		return;
+
+	/* a finished thread no longer touches the cache or the mutex */
+	if (cache->thread_active)
+		pthread_join(cache->thread, NULL);
+
+	cache->populating    = true;
+	cache->thread_active = pthread_create(&cache->thread, NULL,
+			list_cache_thread, cache) == 0;
+
+	if (!cache->thread_active) {
+		blog(LOG_WARNING, "Failed to create the enumeration thread "
+		                  "for list '%s'", cache->id);
+		cache->populating = false;
+	}
+}
+
+/* list_cache_mutex must be locked */
+static struct list_cache *list_cache_find(const char *id)
+{
+	for (size_t i = 0; i < list_caches.num; i++) {
+		struct list_cache *cache = list_caches.array[i];
+		if (strcmp(cache->id, id) == 0)
+			return cache;
+	}
+
+	return NULL;
+}
+
+/* list_cache_mutex must be locked */
+static struct list_cache *list_cache_get(const char *id,
+		enum obs_combo_format format,
+		obs_property_list_populate_t populate)
+{
+	struct list_cache *cache = list_cache_find(id);
+
+	if (cache) {
+		if (cache->list.format != format) {
+			blog(LOG_WARNING, "List cache '%s' was used with "
+			                  "different formats", id);
+			return NULL;
+		}
+
+		return cache;
+	}
+
+	cache = bzalloc(sizeof(struct list_cache));
+	cache->id          = bstrdup(id);
+	cache->populate    = populate;
+	cache->list.type   = OBS_COMBO_TYPE_LIST;
+	cache->list.format = format;
+	da_push_back(list_caches, &cache);
+	return cache;
+}
+
+static void list_cache_remove_waiter(struct obs_property *p)
+{
+	struct list_data *data = get_list_data(p);
+
+	pthread_mutex_lock(&list_cache_mutex);
+	da_erase_item(data->cache->waiters, &p);
+	pthread_mutex_unlock(&list_cache_mutex);
+}
+
+obs_property_t obs_properties_add_async_list(obs_properties_t props,
+		const char *name, const char *desc,
+		enum obs_combo_type type, enum obs_combo_format format,
+		const char *cache_id, obs_property_list_populate_t populate)
+{
+	struct obs_property *p;
+	struct list_data    *data;
+	struct list_cache   *cache;
+	uint64_t            now;
+
+	if (!cache_id || !populate)
+		return NULL;
+
+	p = obs_properties_add_list(props, name, desc, type, format);
+	if (!p)
+		return NULL;
+
+	data = get_list_data(p);
+	now  = os_gettime_ns();
+
+	pthread_mutex_lock(&list_cache_mutex);
+
+	cache = list_cache_get(cache_id, format, populate);
+	if (cache) {
+		data->cache = cache;
+		da_push_back(cache->waiters, &p);
+
+		if (cache->generation) {
+			copy_list_items(data, &cache->list);
+			data->cache_generation = cache->generation;
+		}
+
+		if (!cache->generation ||
+		    now - cache->populate_time > LIST_CACHE_MAX_AGE_NS)
+			list_cache_start(cache);
+	}
+
+	pthread_mutex_unlock(&list_cache_mutex);
+
+	/* fall back to enumerating in place if the cache is unusable */
+	if (!cache)
+		populate(p);
+
+	return p;
+}
+
+void obs_property_list_set_ready_callback(obs_property_t p,
+		obs_property_list_ready_t ready, void *data)
+{
+	struct list_data *list = get_list_data(p);
+	if (!list)
+		return;
+
+	pthread_mutex_lock(&list_cache_mutex);
+	list->ready      = ready;
+	list->ready_data = data;
+	pthread_mutex_unlock(&list_cache_mutex);
+}
+
+bool obs_property_list_pending(obs_property_t p)
+{
+	struct list_data *data = get_list_data(p);
+	bool             pending;
+
+	if (!data || !data->cache)
+		return false;
+
+	pthread_mutex_lock(&list_cache_mutex);
+	pending = data->cache->generation == 0;
+	pthread_mutex_unlock(&list_cache_mutex);
+
+	return pending;
+}
+
+bool obs_property_list_update(obs_property_t p)
+{
+	struct list_data *data    = get_list_data(p);
+	bool             updated = false;
+
+	if (!data || !data->cache)
+		return false;
+
+	pthread_mutex_lock(&list_cache_mutex);
+
+	if (data->cache_generation != data->cache->generation) {
+		copy_list_items(data, &data->cache->list);
+		data->cache_generation = data->cache->generation;
+		updated = true;
+	}
+
+	pthread_mutex_unlock(&list_cache_mutex);
+	return updated;
+}
+
+void obs_property_list_cache_invalidate(const char *cache_id)
+{
+	struct list_cache *cache;
+
+	if (!cache_id)
+		return;
+
+	pthread_mutex_lock(&list_cache_mutex);
+
+	cache = list_cache_find(cache_id);
+	if (cache) {
+		cache->populate_time = 0;
+
+		/* only enumerate right away if a list is being shown */
+		if (cache->populating)
+			cache->repopulate = true;
+		else if (cache->waiters.num)
+			list_cache_start(cache);
+	}
+
+	pthread_mutex_unlock(&list_cache_mutex);
+}
+
+void obs_properties_free_list_caches(void)
+{
+	pthread_mutex_lock(&list_cache_mutex);
+	list_caches_stopping = true;
+	pthread_mutex_unlock(&list_cache_mutex);
+
+	/* threads lock the mutex when they finish, so join without it */
+	for (size_t i = 0; i < list_caches.num; i++) {
+		struct list_cache *cache = list_caches.array[i];
+
+		if (cache->thread_active)
+			pthread_join(cache->thread, NULL);
+
+		list_data_free(&cache->list);
+		da_free(cache->waiters);
+		bfree(cache->id);
+		bfree(cache);
+	}
+
+	pthread_mutex_lock(&list_cache_mutex);
+	da_free(list_caches);
+	list_caches_stopping = false;
+	pthread_mutex_unlock(&list_cache_mutex);
+}
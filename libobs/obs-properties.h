@@ -79,6 +79,7 @@ EXPORT obs_property_t obs_properties_get(obs_properties_t props,
 /* used internally by libobs */
 extern void obs_properties_apply_settings(obs_properties_t props,
 		obs_data_t settings);
+extern void obs_properties_free_list_caches(void);
 
 /* ------------------------------------------------------------------------- */
 
@@ -107,6 +108,38 @@ EXPORT obs_property_t obs_properties_add_list(obs_properties_t props,
 EXPORT obs_property_t obs_properties_add_color(obs_properties_t props,
 		const char *name, const char *description);
 
+/**
+ * Fills a list property with items.  For async lists this is called on a
+ * worker thread, and only the list item functions may be used.
+ */
+typedef void (*obs_property_list_populate_t)(obs_property_t list);
+
+/**
+ * Adds a list that is filled on a worker thread instead of while the
+ * properties are being created.
+ *
+ *   The items are cached and shared by every list that uses the same
+ * cache_id, typically all sources of one type, so the devices or windows are
+ * only enumerated once no matter how many sources or dialogs ask for them.
+ * A cached list is filled right away; if it's old, it's enumerated again in
+ * the background.  The list is empty until the first enumeration finishes,
+ * see obs_property_list_pending.
+ *
+ * @param  cache_id  Identifies the shared list
+ * @param  populate  Called on the worker thread to enumerate the items
+ */
+EXPORT obs_property_t obs_properties_add_async_list(obs_properties_t props,
+		const char *name, const char *description,
+		enum obs_combo_type type, enum obs_combo_format format,
+		const char *cache_id, obs_property_list_populate_t populate);
+
+/**
+ * Invalidates a shared list, for example when a device hotplug notification
+ * arrives.  Lists that are currently in use are enumerated again right away,
+ * otherwise the next list that uses it is.
+ */
+EXPORT void obs_property_list_cache_invalidate(const char *cache_id);
+
 /* ------------------------------------------------------------------------- */
 
 /**
@@ -145,6 +178,25 @@ EXPORT enum obs_combo_format  obs_property_list_format(obs_property_t p);
 
 EXPORT void obs_property_list_clear(obs_property_t p);
 
+/**
+ * Called from the worker thread when an enumeration of an async list has
+ * finished.  Call obs_property_list_update from the thread that owns the
+ * properties to load the new items.
+ */
+typedef void (*obs_property_list_ready_t)(void *data, obs_property_t p);
+
+EXPORT void obs_property_list_set_ready_callback(obs_property_t p,
+		obs_property_list_ready_t ready, void *data);
+
+/** Returns true if an async list hasn't been enumerated yet */
+EXPORT bool obs_property_list_pending(obs_property_t p);
+
+/**
+ * Loads the newest items of an async list.  Returns true if the items were
+ * replaced.
+ */
+EXPORT bool obs_property_list_update(obs_property_t p);
+
 EXPORT void obs_property_list_add_string(obs_property_t p,
 		const char *name, const char *val);
 EXPORT void obs_property_list_add_int(obs_property_t p,
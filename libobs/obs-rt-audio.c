@@ -0,0 +1,287 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "obs-internal.h"
+#include "util/circlebuf-spsc.h"
+
+/*
+ * Audio from real-time threads (audio device callbacks) is copied to a
+ * lock-free ring of the source, and output from one thread shared by all
+ * sources.  The real-time thread never allocates, locks, or resamples.
+ *
+ *   Each entry of a ring is a header followed by the planes of the audio.
+ * An entry is committed all at once, so the consumer always sees whole
+ * entries.
+ */
+
+/* at least this many of the largest entries fit in a ring */
+#define RT_AUDIO_MIN_ENTRIES 8
+/* at least this much audio fits in a ring */
+#define RT_AUDIO_MIN_MS      500
+
+struct rt_audio_header {
+	uint32_t                frames;
+	uint64_t                timestamp;
+};
+
+struct obs_rt_audio {
+	struct obs_source       *source;
+	struct circlebuf_spsc   ring;
+
+	enum audio_format       format;
+	enum speaker_layout     speakers;
+	uint32_t                samples_per_sec;
+	uint32_t                max_frames;
+	size_t                  planes;
+	size_t                  plane_frame_size;
+
+	/* only touched by the consumer */
+	uint8_t                 *data[MAX_AV_PLANES];
+
+	volatile long           dropped;
+};
+
+/* writes to the reserved span, which may wrap around the end of the ring */
+static inline void span_write(struct circlebuf_span *span, size_t *offset,
+		const void *data, size_t size)
+{
+	const uint8_t *src = data;
+
+	while (size) {
+		size_t idx  = *offset < span->size[0] ? 0 : 1;
+		size_t pos  = idx ? *offset - span->size[0] : *offset;
+		size_t copy = span->size[idx] - pos;
+
+		if (copy > size)
+			copy = size;
+
+		memcpy(span->data[idx] + pos, src, copy);
+		src     += copy;
+		size    -= copy;
+		*offset += copy;
+	}
+}
+
+static void drain_ring(struct obs_rt_audio *rt)
+{
+	struct rt_audio_header header;
+	struct source_audio    audio;
+
+	while (circlebuf_spsc_pop_front(&rt->ring, &header, sizeof(header))) {
+		size_t size = header.frames * rt->plane_frame_size;
+
+		memset(&audio, 0, sizeof(audio));
+
+		for (size_t i = 0; i < rt->planes; i++) {
+			circlebuf_spsc_pop_front(&rt->ring, rt->data[i], size);
+			audio.data[i] = rt->data[i];
+		}
+
+		audio.frames          = header.frames;
+		audio.speakers        = rt->speakers;
+		audio.format          = rt->format;
+		audio.samples_per_sec = rt->samples_per_sec;
+		audio.timestamp       = header.timestamp;
+
+		obs_source_output_audio(rt->source, &audio);
+	}
+}
+
+static void *rt_audio_thread(void *param)
+{
+	struct obs_rt_audio_pool *pool = param;
+
+	os_thread_init(OS_THREAD_CLASS_AUDIO, "obs rt audio");
+
+	while (os_sem_wait(pool->sem) == 0 && !pool->stop) {
+		pthread_mutex_lock(&pool->mutex);
+		for (size_t i = 0; i < pool->rings.num; i++)
+			drain_ring(pool->rings.array[i]);
+		pthread_mutex_unlock(&pool->mutex);
+	}
+
+	return NULL;
+}
+
+bool obs_rt_audio_pool_init(struct obs_rt_audio_pool *pool)
+{
+	memset(pool, 0, sizeof(struct obs_rt_audio_pool));
+	pthread_mutex_init_value(&pool->mutex);
+
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&pool->sem, 0) != 0)
+		return false;
+
+	return true;
+}
+
+void obs_rt_audio_pool_free(struct obs_rt_audio_pool *pool)
+{
+	if (pool->started) {
+		pool->stop = true;
+		os_sem_post(pool->sem);
+		pthread_join(pool->thread, NULL);
+	}
+
+	/* the rings are freed with their sources */
+	da_free(pool->rings);
+	os_sem_destroy(pool->sem);
+	pthread_mutex_destroy(&pool->mutex);
+
+	memset(pool, 0, sizeof(struct obs_rt_audio_pool));
+}
+
+static void rt_audio_destroy(struct obs_rt_audio *rt)
+{
+	long dropped = os_atomic_load_long(&rt->dropped);
+
+	if (dropped)
+		blog(LOG_INFO, "Source '%s': %ld real-time audio packets "
+		               "dropped", obs_source_getname(rt->source),
+		               dropped);
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		bfree(rt->data[i]);
+
+	circlebuf_spsc_free(&rt->ring);
+	bfree(rt);
+}
+
+bool obs_source_init_rt_audio(obs_source_t source, enum audio_format format,
+		enum speaker_layout speakers, uint32_t samples_per_sec,
+		uint32_t max_frames)
+{
+	struct obs_rt_audio_pool *pool = &obs->data.rt_audio_pool;
+	struct obs_rt_audio      *rt;
+	size_t                   entry_size;
+	size_t                   capacity;
+
+	if (!source || !max_frames || !samples_per_sec)
+		return false;
+
+	obs_source_free_rt_audio(source);
+
+	rt = bzalloc(sizeof(struct obs_rt_audio));
+	rt->source           = source;
+	rt->format           = format;
+	rt->speakers         = speakers;
+	rt->samples_per_sec  = samples_per_sec;
+	rt->max_frames       = max_frames;
+	rt->planes           = get_audio_planes(format, speakers);
+	rt->plane_frame_size = get_audio_size(format, speakers, 1) /
+		rt->planes;
+
+	entry_size = sizeof(struct rt_audio_header) +
+		rt->planes * rt->plane_frame_size * max_frames;
+	capacity   = (size_t)samples_per_sec * RT_AUDIO_MIN_MS / 1000 *
+		rt->planes * rt->plane_frame_size;
+	if (capacity < entry_size * RT_AUDIO_MIN_ENTRIES)
+		capacity = entry_size * RT_AUDIO_MIN_ENTRIES;
+
+	if (!circlebuf_spsc_init(&rt->ring, capacity)) {
+		blog(LOG_ERROR, "Source '%s': failed to create real-time "
+		                "audio ring", obs_source_getname(source));
+		bfree(rt);
+		return false;
+	}
+
+	for (size_t i = 0; i < rt->planes; i++)
+		rt->data[i] = bmalloc(rt->plane_frame_size * max_frames);
+
+	pthread_mutex_lock(&pool->mutex);
+
+	if (!pool->started) {
+		pool->started = pthread_create(&pool->thread, NULL,
+				rt_audio_thread, pool) == 0;
+		if (!pool->started)
+			blog(LOG_ERROR, "Failed to create real-time audio "
+			                "thread");
+	}
+
+	if (pool->started) {
+		da_push_back(pool->rings, &rt);
+		source->rt_audio = rt;
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (!source->rt_audio) {
+		rt_audio_destroy(rt);
+		return false;
+	}
+
+	return true;
+}
+
+void obs_source_free_rt_audio(obs_source_t source)
+{
+	struct obs_rt_audio_pool *pool = &obs->data.rt_audio_pool;
+	struct obs_rt_audio      *rt;
+
+	if (!source || !source->rt_audio)
+		return;
+
+	/* the consumer drains the rings with the mutex held, so the ring is
+	 * no longer in use once it's removed */
+	pthread_mutex_lock(&pool->mutex);
+	rt = source->rt_audio;
+	da_erase_item(pool->rings, &rt);
+	source->rt_audio = NULL;
+	pthread_mutex_unlock(&pool->mutex);
+
+	rt_audio_destroy(rt);
+}
+
+bool obs_source_output_rt_audio(obs_source_t source,
+		const uint8_t *const data[], uint32_t frames,
+		uint64_t timestamp)
+{
+	struct obs_rt_audio    *rt = source ? source->rt_audio : NULL;
+	struct rt_audio_header header;
+	struct circlebuf_span  span;
+	size_t                 plane_size;
+	size_t                 offset = 0;
+
+	if (!rt || !frames)
+		return false;
+
+	if (frames > rt->max_frames) {
+		os_atomic_inc_long(&rt->dropped);
+		return false;
+	}
+
+	plane_size = frames * rt->plane_frame_size;
+
+	if (!circlebuf_spsc_reserve_span(&rt->ring,
+				sizeof(header) + rt->planes * plane_size,
+				&span)) {
+		os_atomic_inc_long(&rt->dropped);
+		return false;
+	}
+
+	header.frames    = frames;
+	header.timestamp = timestamp;
+
+	span_write(&span, &offset, &header, sizeof(header));
+	for (size_t i = 0; i < rt->planes; i++)
+		span_write(&span, &offset, data[i], plane_size);
+
+	circlebuf_spsc_commit(&rt->ring, offset);
+	os_sem_post(obs->data.rt_audio_pool.sem);
+	return true;
+}
@@ -17,6 +17,8 @@
 
 #include "util/threading.h"
 #include "graphics/math-defs.h"
+#include "graphics/vec4.h"
+#include "graphics/axisang.h"
 #include "obs-scene.h"
 
 static const char *obs_scene_signals[] = {
@@ -27,7 +29,9 @@ static const char *obs_scene_signals[] = {
 
 static inline void signal_item_remove(struct obs_scene_item *item)
 {
-	struct calldata params = {0};
+	uint8_t stack[CALLDATA_FIXED_SIZE];
+	struct calldata params;
+	calldata_init_fixed(&params, stack, sizeof(stack));
 	calldata_setptr(&params, "scene", item->parent);
 	calldata_setptr(&params, "item", item);
 
@@ -46,7 +50,7 @@ static const char *scene_getname(const char *locale)
 static void *scene_create(obs_data_t settings, struct obs_source *source)
 {
 	pthread_mutexattr_t attr;
-	struct obs_scene *scene = bmalloc(sizeof(struct obs_scene));
+	struct obs_scene *scene = bzalloc(sizeof(struct obs_scene));
 	scene->source     = source;
 	scene->first_item = NULL;
 
@@ -61,6 +65,11 @@ static void *scene_create(obs_data_t settings, struct obs_source *source)
 		blog(LOG_ERROR, "scene_create: Couldn't initialize mutex");
 		goto fail;
 	}
+	if (pthread_mutex_init(&scene->retire_mutex, NULL) != 0) {
+		blog(LOG_ERROR, "scene_create: Couldn't initialize mutex");
+		pthread_mutex_destroy(&scene->mutex);
+		goto fail;
+	}
 
 	UNUSED_PARAMETER(settings);
 	return scene;
@@ -89,11 +98,24 @@ static void remove_all_items(struct obs_scene *scene)
 	pthread_mutex_unlock(&scene->mutex);
 }
 
+static void free_render_list(struct scene_render_list *list);
+
 static void scene_destroy(void *data)
 {
 	struct obs_scene *scene = data;
 
 	remove_all_items(scene);
+
+	for (size_t i = 0; i < scene->retired_lists.num; i++)
+		free_render_list(scene->retired_lists.array[i]);
+	da_free(scene->retired_lists);
+	free_render_list(scene->render_list);
+
+	gs_entercontext(obs->video.graphics);
+	texrender_destroy(scene->cache_texrender);
+	gs_leavecontext();
+
+	pthread_mutex_destroy(&scene->retire_mutex);
 	pthread_mutex_destroy(&scene->mutex);
 	bfree(scene);
 }
@@ -130,8 +152,6 @@ static inline void detach_sceneitem(struct obs_scene_item *item)
 
 	if (item->next)
 		item->next->prev = item->prev;
-
-	item->parent = NULL;
 }
 
 static inline void attach_sceneitem(struct obs_scene_item *item,
@@ -152,38 +172,477 @@ static inline void attach_sceneitem(struct obs_scene_item *item,
 	}
 }
 
-static void scene_video_render(void *data, effect_t effect)
+static inline void invalidate_scene(struct obs_scene *scene)
 {
-	struct obs_scene *scene = data;
-	struct obs_scene_item *item;
+	if (scene)
+		os_atomic_inc_long(&scene->revision);
+}
 
-	pthread_mutex_lock(&scene->mutex);
+static void calc_item_transform(struct obs_scene_item *item,
+		struct matrix3 *transform)
+{
+	struct axisang rot;
+	struct vec3    vec;
 
-	item = scene->first_item;
+	matrix3_identity(transform);
 
-	while (item) {
-		if (obs_source_removed(item->source)) {
-			struct obs_scene_item *del_item = item;
-			item = item->next;
+	/* the cropped part of the source starts at the item's position */
+	vec3_set(&vec, item->origin.x + (float)item->crop.left,
+			item->origin.y + (float)item->crop.top, 0.0f);
+	matrix3_translate(transform, transform, &vec);
+
+	vec3_set(&vec, item->scale.x, item->scale.y, 1.0f);
+	matrix3_scale(transform, transform, &vec);
+
+	axisang_set(&rot, 0.0f, 0.0f, 1.0f, RAD(-item->rot));
+	matrix3_rotate_aa(transform, transform, &rot);
+
+	vec3_set(&vec, -item->pos.x, -item->pos.y, 0.0f);
+	matrix3_translate(transform, transform, &vec);
+}
+
+static void free_render_list(struct scene_render_list *list)
+{
+	if (!list)
+		return;
+
+	for (size_t i = 0; i < list->items.num; i++)
+		obs_sceneitem_release(list->items.array[i].item);
+
+	da_free(list->items);
+	bfree(list);
+}
+
+/* only called with the scene mutex held */
+static void update_render_list(struct obs_scene *scene)
+{
+	struct scene_render_list *list = bzalloc(sizeof(*list));
+	struct scene_render_list *prev;
+	struct obs_scene_item    *item;
+	bool                     in_use;
+
+	for (item = scene->first_item; item; item = item->next) {
+		struct scene_render_item *render_item =
+			da_push_back_new(list->items);
+
+		obs_sceneitem_addref(item);
+		render_item->item   = item;
+		render_item->source = item->source;
+		render_item->crop   = item->crop;
+		render_item->zero_scale =
+			close_float(item->scale.x, 0.0f, EPSILON) ||
+			close_float(item->scale.y, 0.0f, EPSILON);
+		calc_item_transform(item, &render_item->transform);
+	}
+
+	prev = os_atomic_set_ptr((void *volatile*)&scene->render_list, list);
+	invalidate_scene(scene);
+
+	if (!prev)
+		return;
+
+	/* a render that started before the swap may still be using it */
+	pthread_mutex_lock(&scene->retire_mutex);
+	in_use = os_atomic_load_long(&scene->render_refs) != 0;
+	if (in_use) {
+		da_push_back(scene->retired_lists, &prev);
+		scene->lists_retired = true;
+	}
+	pthread_mutex_unlock(&scene->retire_mutex);
+
+	if (!in_use)
+		free_render_list(prev);
+}
+
+/* the count is raised before the list is loaded, so the list can't be freed
+ * by update_render_list until release_render_list is called */
+static inline struct scene_render_list *acquire_render_list(
+		struct obs_scene *scene)
+{
+	os_atomic_inc_long(&scene->render_refs);
+	return os_atomic_load_ptr(
+			(void *const volatile*)&scene->render_list);
+}
+
+static void release_render_list(struct obs_scene *scene)
+{
+	if (os_atomic_dec_long(&scene->render_refs) != 0 ||
+	    !scene->lists_retired)
+		return;
+
+	pthread_mutex_lock(&scene->retire_mutex);
+	if (os_atomic_load_long(&scene->render_refs) == 0) {
+		for (size_t i = 0; i < scene->retired_lists.num; i++)
+			free_render_list(scene->retired_lists.array[i]);
+
+		da_resize(scene->retired_lists, 0);
+		scene->lists_retired = false;
+	}
+	pthread_mutex_unlock(&scene->retire_mutex);
+}
+
+static bool get_scene_revision(struct obs_scene *scene,
+		struct scene_render_list *list, uint64_t *revision)
+{
+	uint64_t total = (uint64_t)os_atomic_load_long(&scene->revision);
+
+	for (size_t i = 0; list && i < list->items.num; i++) {
+		struct obs_source *source = list->items.array[i].source;
+		uint64_t item_revision;
+
+		if (obs_source_removed(source))
+			return false;
+		if (!obs_source_get_content_revision(source, &item_revision))
+			return false;
+
+		total += item_revision;
+	}
+
+	*revision = total;
+	return true;
+}
+
+bool obs_scene_get_content_revision(obs_source_t scene_source,
+		uint64_t *revision)
+{
+	struct obs_scene *scene = obs_scene_fromsource(scene_source);
+	bool success;
+
+	if (!scene)
+		return false;
+
+	success = get_scene_revision(scene, acquire_render_list(scene),
+			revision);
+	release_render_list(scene);
+
+	return success;
+}
+
+/* locks the scene of the item (if it's still in one) for changing the item's
+ * transform, publish_transform republishes the render list and unlocks */
+static inline struct obs_scene *lock_item_scene(struct obs_scene_item *item)
+{
+	struct obs_scene *scene = item->parent;
+	if (scene)
+		pthread_mutex_lock(&scene->mutex);
+	return scene;
+}
+
+static inline void publish_transform(struct obs_scene *scene)
+{
+	if (scene) {
+		update_render_list(scene);
+		pthread_mutex_unlock(&scene->mutex);
+	}
+}
+
+/* sources drawn by libobs with the default effect only assign a texture and
+ * draw sprites, so consecutive items of that kind can share a sprite batch */
+static inline bool item_can_batch(struct obs_scene_item *item)
+{
+	struct obs_source *source = item->source;
+	uint32_t flags = source->info.output_flags;
+
+	return source->info.video_render &&
+	       (flags & OBS_SOURCE_VIDEO) != 0 &&
+	       (flags & (OBS_SOURCE_CUSTOM_DRAW | OBS_SOURCE_COLOR_MATRIX)) == 0 &&
+	       source->filters.num == 0 &&
+	       !obs_source_render_cache_active(source);
+}
+
+/* the part of the scene that ends up on the render target */
+struct cull_area {
+	bool  enabled;
+	float left, right;
+	float top, bottom;
+	float min_x, max_x;
+	float min_y, max_y;
+};
+
+/* bounds of an item on the scene */
+struct item_bounds {
+	float min_x, max_x;
+	float min_y, max_y;
+};
+
+static inline bool item_cropped(const struct scene_render_item *render_item)
+{
+	const struct obs_sceneitem_crop *crop = &render_item->crop;
+	return crop->left > 0 || crop->top > 0 ||
+	       crop->right > 0 || crop->bottom > 0;
+}
+
+/* sources that are drawn with sprites to the target of the scene can be
+ * cropped with their texture coordinates, anything else needs a scissor
+ * rect */
+static inline bool item_sprite_crop(struct obs_scene_item *item)
+{
+	struct obs_source *source = item->source;
+
+	return (source->info.output_flags & OBS_SOURCE_CUSTOM_DRAW) == 0 &&
+	       source->filters.num == 0 &&
+	       !obs_source_render_cache_active(source);
+}
+
+static inline bool matrix_is_identity(const struct matrix3 *m)
+{
+	return m->x.x == 1.0f && m->x.y == 0.0f && m->x.z == 0.0f &&
+	       m->y.x == 0.0f && m->y.y == 1.0f && m->y.z == 0.0f &&
+	       m->z.x == 0.0f && m->z.y == 0.0f && m->z.z == 1.0f &&
+	       m->t.x == 0.0f && m->t.y == 0.0f && m->t.z == 0.0f;
+}
+
+/* items are only culled when the scene is drawn straight in to an
+ * orthographic projection, which is how it's drawn to the canvas, the
+ * preview, and its cache.  anything else (such as a scene nested in
+ * another scene) draws all items */
+static void get_cull_area(struct cull_area *area)
+{
+	struct matrix3 cur;
+	float left, right, top, bottom;
+
+	area->enabled = false;
+
+	gs_matrix_get(&cur);
+	if (!matrix_is_identity(&cur))
+		return;
+	if (!gs_getortho(&left, &right, &top, &bottom))
+		return;
+
+	area->enabled = true;
+	area->left    = left;
+	area->right   = right;
+	area->top     = top;
+	area->bottom  = bottom;
+	area->min_x   = fminf(left, right);
+	area->max_x   = fmaxf(left, right);
+	area->min_y   = fminf(top, bottom);
+	area->max_y   = fmaxf(top, bottom);
+}
+
+/* returns false if the source has no size, in which case it might still
+ * draw something */
+static bool get_item_bounds(const struct scene_render_item *render_item,
+		struct item_bounds *bounds)
+{
+	const struct obs_sceneitem_crop *crop = &render_item->crop;
+	const struct matrix3 *m = &render_item->transform;
+	uint32_t cx = obs_source_getwidth(render_item->source);
+	uint32_t cy = obs_source_getheight(render_item->source);
+	float    x0, y0, x1, y1;
+
+	if (!cx || !cy)
+		return false;
+
+	x0 = (float)crop->left;
+	y0 = (float)crop->top;
+	x1 = fmaxf((float)cx - (float)crop->right,  x0);
+	y1 = fmaxf((float)cy - (float)crop->bottom, y0);
+
+	/* bounds of the transformed corners of the source */
+	for (int i = 0; i < 4; i++) {
+		float x  = (i & 1) ? x1 : x0;
+		float y  = (i & 2) ? y1 : y0;
+		float px = m->t.x + x * m->x.x + y * m->y.x;
+		float py = m->t.y + x * m->x.y + y * m->y.y;
+
+		if (i == 0) {
+			bounds->min_x = bounds->max_x = px;
+			bounds->min_y = bounds->max_y = py;
+			continue;
+		}
+
+		bounds->min_x = fminf(bounds->min_x, px);
+		bounds->max_x = fmaxf(bounds->max_x, px);
+		bounds->min_y = fminf(bounds->min_y, py);
+		bounds->max_y = fmaxf(bounds->max_y, py);
+	}
+
+	return true;
+}
+
+static bool item_visible(const struct scene_render_item *render_item,
+		const struct cull_area *area, const struct item_bounds *bounds,
+		bool has_bounds)
+{
+	if (render_item->zero_scale)
+		return false;
+	if (!area->enabled || !has_bounds)
+		return true;
+
+	return bounds->max_x > area->min_x && bounds->min_x < area->max_x &&
+	       bounds->max_y > area->min_y && bounds->min_y < area->max_y;
+}
+
+/* maps the bounds of the item from the projection to the viewport */
+static bool set_item_scissor(const struct cull_area *area,
+		const struct item_bounds *bounds)
+{
+	struct gs_rect viewport, rect;
+	float sx, sy, x0, x1, y0, y1;
+
+	gs_getviewport(&viewport);
+
+	sx = (float)viewport.cx / (area->right  - area->left);
+	sy = (float)viewport.cy / (area->bottom - area->top);
+	x0 = (bounds->min_x - area->left) * sx;
+	x1 = (bounds->max_x - area->left) * sx;
+	y0 = (bounds->min_y - area->top)  * sy;
+	y1 = (bounds->max_y - area->top)  * sy;
+
+	rect.x  = viewport.x + (int)floorf(fminf(x0, x1));
+	rect.y  = viewport.y + (int)floorf(fminf(y0, y1));
+	rect.cx = (int)ceilf(fabsf(x1 - x0));
+	rect.cy = (int)ceilf(fabsf(y1 - y0));
+
+	if (rect.cx <= 0 || rect.cy <= 0)
+		return false;
+
+	gs_setscissorrect(&rect);
+	return true;
+}
+
+static void render_items(struct scene_render_list *list, bool to_cache)
+{
+	effect_t effect = obs->video.default_effect;
+	bool     batching = false;
+	struct cull_area area;
+
+	get_cull_area(&area);
+
+	for (size_t i = 0; list && i < list->items.num; i++) {
+		struct scene_render_item *render_item = list->items.array+i;
+		struct obs_scene_item    *item = render_item->item;
+		bool can_batch;
+
+		/* the list stays referenced, so it's fine to remove the item
+		 * while rendering from it */
+		if (obs_source_removed(render_item->source)) {
+			obs_sceneitem_remove(item);
+			continue;
+		}
 
-			obs_sceneitem_remove(del_item);
+		struct item_bounds bounds;
+		bool has_bounds = get_item_bounds(render_item, &bounds);
+		bool cropped    = item_cropped(render_item);
+		bool scissor    = false;
+
+		if (!item_visible(render_item, &area, &bounds, has_bounds))
 			continue;
+
+		can_batch = item_can_batch(item);
+
+		if (batching && !can_batch) {
+			gs_sprite_batch_end();
+			batching = false;
+		}
+
+		/* items can change the blend function themselves */
+		if (to_cache && !batching)
+			obs_set_cache_blend();
+
+		if (!batching && can_batch) {
+			gs_sprite_batch_begin(effect,
+					effect_getparambyname(effect, "image"));
+			batching = true;
+		}
+
+		if (cropped && item_sprite_crop(item)) {
+			const struct obs_sceneitem_crop *crop =
+				&render_item->crop;
+
+			gs_set_sprite_crop((float)crop->left,
+					(float)crop->top,
+					(float)crop->right,
+					(float)crop->bottom);
+
+		} else if (cropped && area.enabled && has_bounds) {
+			if (batching) {
+				gs_sprite_batch_end();
+				batching = false;
+			}
+
+			scissor = set_item_scissor(&area, &bounds);
+			if (!scissor)
+				continue;
 		}
 
 		gs_matrix_push();
-		gs_matrix_translate3f(item->origin.x, item->origin.y, 0.0f);
-		gs_matrix_scale3f(item->scale.x, item->scale.y, 1.0f);
-		gs_matrix_rotaa4f(0.0f, 0.0f, 1.0f, RAD(-item->rot));
-		gs_matrix_translate3f(-item->pos.x, -item->pos.y, 0.0f);
+		gs_matrix_mul(&render_item->transform);
 
-		obs_source_video_render(item->source);
+		obs_source_video_render(render_item->source);
 
 		gs_matrix_pop();
 
-		item = item->next;
+		if (cropped)
+			gs_reset_sprite_crop();
+		if (scissor)
+			gs_setscissorrect(NULL);
 	}
 
-	pthread_mutex_unlock(&scene->mutex);
+	if (batching)
+		gs_sprite_batch_end();
+}
+
+static bool update_cache(struct obs_scene *scene,
+		struct scene_render_list *list, uint64_t revision,
+		uint32_t cx, uint32_t cy)
+{
+	struct vec4 clear_color;
+
+	if (scene->cache_valid && scene->cache_revision == revision &&
+	    scene->cache_cx == cx && scene->cache_cy == cy)
+		return true;
+
+	if (!scene->cache_texrender)
+		scene->cache_texrender = texrender_create(GS_RGBA, GS_ZS_NONE);
+
+	texrender_reset(scene->cache_texrender);
+	if (!texrender_begin(scene->cache_texrender, cx, cy))
+		return false;
+
+	vec4_zero(&clear_color);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 1.0f, 0);
+	gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+
+	gs_blend_state_push();
+	render_items(list, true);
+	gs_blend_state_pop();
+
+	texrender_end(scene->cache_texrender);
+
+	scene->cache_valid    = true;
+	scene->cache_revision = revision;
+	scene->cache_cx       = cx;
+	scene->cache_cy       = cy;
+	return true;
+}
+
+static inline void draw_cache(struct obs_scene *scene)
+{
+	obs_draw_cache_texture(texrender_gettexture(scene->cache_texrender),
+			scene->cache_cx, scene->cache_cy);
+}
+
+static void scene_video_render(void *data, effect_t effect)
+{
+	struct obs_scene *scene = data;
+	uint32_t cx = obs->video.base_width;
+	uint32_t cy = obs->video.base_height;
+	uint64_t revision;
+
+	/* no locks, edits from other threads publish a new list instead */
+	struct scene_render_list *list = acquire_render_list(scene);
+
+	if (scene->cached && get_scene_revision(scene, list, &revision) &&
+	    update_cache(scene, list, revision, cx, cy)) {
+		draw_cache(scene);
+	} else {
+		scene->cache_valid = false;
+		render_items(list, false);
+	}
+
+	release_render_list(scene);
 
 	UNUSED_PARAMETER(effect);
 }
@@ -202,11 +661,18 @@ static void scene_load_item(struct obs_scene *scene, obs_data_t item_data)
 
 	item = obs_scene_add(scene, source);
 
+	pthread_mutex_lock(&scene->mutex);
 	item->rot     = (float)obs_data_getdouble(item_data, "rot");
 	item->visible = obs_data_getbool(item_data, "visible");
 	obs_data_get_vec2(item_data, "origin", &item->origin);
 	obs_data_get_vec2(item_data, "pos",    &item->pos);
 	obs_data_get_vec2(item_data, "scale",  &item->scale);
+	item->crop.left   = (int)obs_data_getint(item_data, "crop_left");
+	item->crop.top    = (int)obs_data_getint(item_data, "crop_top");
+	item->crop.right  = (int)obs_data_getint(item_data, "crop_right");
+	item->crop.bottom = (int)obs_data_getint(item_data, "crop_bottom");
+	publish_transform(scene);
+
 	obs_source_release(source);
 }
 
@@ -217,6 +683,8 @@ static void scene_load(void *scene, obs_data_t settings)
 
 	remove_all_items(scene);
 
+	obs_scene_set_cached(scene, obs_data_getbool(settings, "cached"));
+
 	if (!items) return;
 
 	count = obs_data_array_count(items);
@@ -241,6 +709,10 @@ static void scene_save_item(obs_data_array_t array, struct obs_scene_item *item)
 	obs_data_set_vec2 (item_data, "origin",  &item->origin);
 	obs_data_set_vec2 (item_data, "pos",     &item->pos);
 	obs_data_set_vec2 (item_data, "scale",   &item->scale);
+	obs_data_setint   (item_data, "crop_left",   item->crop.left);
+	obs_data_setint   (item_data, "crop_top",    item->crop.top);
+	obs_data_setint   (item_data, "crop_right",  item->crop.right);
+	obs_data_setint   (item_data, "crop_bottom", item->crop.bottom);
 
 	obs_data_array_push_back(array, item_data);
 	obs_data_release(item_data);
@@ -262,6 +734,7 @@ static void scene_save(void *data, obs_data_t settings)
 
 	pthread_mutex_unlock(&scene->mutex);
 
+	obs_data_setbool(settings, "cached", scene->cached);
 	obs_data_setarray(settings, "items", array);
 	obs_data_array_release(array);
 }
@@ -326,6 +799,21 @@ obs_scene_t obs_scene_fromsource(obs_source_t source)
 	return source->context.data;
 }
 
+void obs_scene_set_cached(obs_scene_t scene, bool cached)
+{
+	if (!scene)
+		return;
+
+	/* the graphics thread validates the cache against the revision */
+	scene->cached = cached;
+	invalidate_scene(scene);
+}
+
+bool obs_scene_cached(obs_scene_t scene)
+{
+	return scene ? scene->cached : false;
+}
+
 obs_sceneitem_t obs_scene_findsource(obs_scene_t scene, const char *name)
 {
 	struct obs_scene_item *item;
@@ -382,7 +870,9 @@ obs_sceneitem_t obs_scene_add(obs_scene_t scene, obs_source_t source)
 {
 	struct obs_scene_item *last;
 	struct obs_scene_item *item;
-	struct calldata params = {0};
+	uint8_t stack[CALLDATA_FIXED_SIZE];
+	struct calldata params;
+	calldata_init_fixed(&params, stack, sizeof(stack));
 
 	if (!scene)
 		return NULL;
@@ -415,8 +905,12 @@ obs_sceneitem_t obs_scene_add(obs_scene_t scene, obs_source_t source)
 		item->prev = last;
 	}
 
+	update_render_list(scene);
 	pthread_mutex_unlock(&scene->mutex);
 
+	/* obs_source_add_child is called before the item is in the list */
+	obs_source_invalidate_trees();
+
 	calldata_setptr(&params, "scene", scene);
 	calldata_setptr(&params, "item", item);
 	signal_handler_signal(scene->source->context.signals, "item_add",
@@ -441,6 +935,24 @@ void obs_sceneitem_addref(obs_sceneitem_t item)
 		os_atomic_inc_long(&item->ref);
 }
 
+bool obs_sceneitem_try_addref(obs_sceneitem_t item)
+{
+	long refs;
+
+	if (!item)
+		return false;
+
+	/* never takes a reference once the count has reached 0 */
+	refs = os_atomic_load_long(&item->ref);
+	while (refs > 0) {
+		if (os_atomic_compare_swap_long(&item->ref, refs, refs + 1))
+			return true;
+		refs = os_atomic_load_long(&item->ref);
+	}
+
+	return false;
+}
+
 void obs_sceneitem_release(obs_sceneitem_t item)
 {
 	if (!item)
@@ -476,6 +988,8 @@ void obs_sceneitem_remove(obs_sceneitem_t item)
 
 	signal_item_remove(item);
 	detach_sceneitem(item);
+	item->parent = NULL;
+	update_render_list(scene);
 
 	pthread_mutex_unlock(&scene->mutex);
 
@@ -494,31 +1008,43 @@ obs_source_t obs_sceneitem_getsource(obs_sceneitem_t item)
 
 void obs_sceneitem_setpos(obs_sceneitem_t item, const struct vec2 *pos)
 {
-	if (item)
+	if (item) {
+		struct obs_scene *scene = lock_item_scene(item);
 		vec2_copy(&item->pos, pos);
+		publish_transform(scene);
+	}
 }
 
 void obs_sceneitem_setrot(obs_sceneitem_t item, float rot)
 {
-	if (item)
+	if (item) {
+		struct obs_scene *scene = lock_item_scene(item);
 		item->rot = rot;
+		publish_transform(scene);
+	}
 }
 
 void obs_sceneitem_setorigin(obs_sceneitem_t item, const struct vec2 *origin)
 {
-	if (item)
+	if (item) {
+		struct obs_scene *scene = lock_item_scene(item);
 		vec2_copy(&item->origin, origin);
+		publish_transform(scene);
+	}
 }
 
 void obs_sceneitem_setscale(obs_sceneitem_t item, const struct vec2 *scale)
 {
-	if (item)
+	if (item) {
+		struct obs_scene *scene = lock_item_scene(item);
 		vec2_copy(&item->scale, scale);
+		publish_transform(scene);
+	}
 }
 
 void obs_sceneitem_setorder(obs_sceneitem_t item, enum order_movement movement)
 {
-	if (!item) return;
+	if (!item || !item->parent) return;
 
 	struct obs_scene *scene = item->parent;
 
@@ -548,7 +1074,10 @@ void obs_sceneitem_setorder(obs_sceneitem_t item, enum order_movement movement)
 		attach_sceneitem(item, NULL);
 	}
 
+	update_render_list(scene);
 	pthread_mutex_unlock(&scene->mutex);
+
+	obs_source_invalidate_trees();
 	obs_scene_release(scene);
 }
 
@@ -574,3 +1103,23 @@ void obs_sceneitem_getscale(obs_sceneitem_t item, struct vec2 *scale)
 	if (item)
 		vec2_copy(scale, &item->scale);
 }
+
+void obs_sceneitem_setcrop(obs_sceneitem_t item,
+		const struct obs_sceneitem_crop *crop)
+{
+	if (item && crop) {
+		struct obs_scene *scene = lock_item_scene(item);
+		item->crop.left   = crop->left   > 0 ? crop->left   : 0;
+		item->crop.top    = crop->top    > 0 ? crop->top    : 0;
+		item->crop.right  = crop->right  > 0 ? crop->right  : 0;
+		item->crop.bottom = crop->bottom > 0 ? crop->bottom : 0;
+		publish_transform(scene);
+	}
+}
+
+void obs_sceneitem_getcrop(obs_sceneitem_t item,
+		struct obs_sceneitem_crop *crop)
+{
+	if (item && crop)
+		*crop = item->crop;
+}
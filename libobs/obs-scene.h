@@ -19,6 +19,7 @@
 
 #include "obs.h"
 #include "obs-internal.h"
+#include "graphics/matrix3.h"
 
 /* how obs scene! */
 
@@ -34,15 +35,54 @@ struct obs_scene_item {
 	struct vec2           pos;
 	struct vec2           scale;
 	float                 rot;
+	struct obs_sceneitem_crop crop;
+
 
 	/* would do **prev_next, but not really great for reordering */
 	struct obs_scene_item *prev;
 	struct obs_scene_item *next;
 };
 
+/* what the graphics thread renders from, an immutable copy of the item list
+ * with the transforms already combined.  the items are referenced, so they
+ * stay valid while a list still uses them even after they're removed */
+struct scene_render_item {
+	struct obs_scene_item *item;
+	struct obs_source     *source;
+	struct matrix3        transform;
+	bool                  zero_scale;
+	struct obs_sceneitem_crop crop;
+};
+
+struct scene_render_list {
+	DARRAY(struct scene_render_item) items;
+};
+
 struct obs_scene {
 	struct obs_source     *source;
 
 	pthread_mutex_t       mutex;
 	struct obs_scene_item *first_item;
+
+	/* replaced as a whole (with the scene mutex held) whenever the items
+	 * change, rendering only loads it and never locks.  render_refs
+	 * counts the renders using a list right now; lists replaced during a
+	 * render are retired and freed once the render is done */
+	struct scene_render_list *volatile render_list;
+	volatile long         render_refs;
+	pthread_mutex_t       retire_mutex;
+	DARRAY(struct scene_render_list*) retired_lists;
+	volatile bool         lists_retired;
+
+	/* incremented whenever items are added, removed, reordered, or
+	 * transformed */
+	volatile long         revision;
+
+	/* render cache, only used by the graphics thread */
+	volatile bool         cached;
+	bool                  cache_valid;
+	uint64_t              cache_revision;
+	texrender_t           cache_texrender;
+	uint32_t              cache_cx;
+	uint32_t              cache_cy;
 };
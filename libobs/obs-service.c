@@ -17,14 +17,19 @@
 
 #include "obs-internal.h"
 
-static inline const struct obs_service_info *find_service(const char *id)
+static inline const struct obs_service_info *find_service_type(const char *id)
 {
-	size_t i;
-	for (i = 0; i < obs->service_types.num; i++)
-		if (strcmp(obs->service_types.array[i].id, id) == 0)
-			return obs->service_types.array+i;
+	size_t idx = obs_type_index_find(&obs->service_index, id);
+	return (idx != DARRAY_INVALID) ? obs->service_types.array+idx : NULL;
+}
 
-	return NULL;
+static const struct obs_service_info *find_service(const char *id)
+{
+	const struct obs_service_info *info = find_service_type(id);
+
+	if (!info && obs_load_deferred_type(MODULE_TYPE_SERVICE, id))
+		info = find_service_type(id);
+	return info;
 }
 
 const char *obs_service_getdisplayname(const char *id, const char *locale)
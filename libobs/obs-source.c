@@ -24,45 +24,55 @@
 #include "callback/calldata.h"
 #include "graphics/matrix3.h"
 #include "graphics/vec3.h"
+#include "graphics/vec4.h"
 
 #include "obs.h"
 #include "obs-internal.h"
 
 static inline const struct obs_source_info *find_source(struct darray *list,
-		const char *id)
+		const struct obs_type_index *index, const char *id)
 {
-	size_t i;
 	struct obs_source_info *array = list->array;
+	size_t idx = obs_type_index_find(index, id);
 
-	for (i = 0; i < list->num; i++) {
-		struct obs_source_info *info = array+i;
-		if (strcmp(info->id, id) == 0)
-			return info;
-	}
-
-	return NULL;
+	return (idx != DARRAY_INVALID) ? array+idx : NULL;
 }
 
 static const struct obs_source_info *get_source_info(enum obs_source_type type,
 		const char *id)
 {
+	const struct obs_source_info *info;
 	struct darray *list = NULL;
+	struct obs_type_index *index = NULL;
+	enum obs_module_type_kind kind = MODULE_TYPE_INPUT;
 
 	switch (type) {
 	case OBS_SOURCE_TYPE_INPUT:
 		list = &obs->input_types.da;
+		index = &obs->input_index;
+		kind = MODULE_TYPE_INPUT;
 		break;
 
 	case OBS_SOURCE_TYPE_FILTER:
 		list = &obs->filter_types.da;
+		index = &obs->filter_index;
+		kind = MODULE_TYPE_FILTER;
 		break;
 
 	case OBS_SOURCE_TYPE_TRANSITION:
 		list = &obs->transition_types.da;
+		index = &obs->transition_index;
+		kind = MODULE_TYPE_TRANSITION;
 		break;
 	}
 
-	return find_source(list, id);
+	if (!list)
+		return NULL;
+
+	info = find_source(list, index, id);
+	if (!info && obs_load_deferred_type(kind, id))
+		info = find_source(list, index, id);
+	return info;
 }
 
 static const char *source_signals[] = {
@@ -74,6 +84,8 @@ static const char *source_signals[] = {
 	"void show(ptr source)",
 	"void hide(ptr source)",
 	"void volume(ptr source, in out float volume)",
+	"void audio_activate(ptr source)",
+	"void audio_deactivate(ptr source)",
 	NULL
 };
 
@@ -95,6 +107,49 @@ const char *obs_source_getdisplayname(enum obs_source_type type,
 }
 
 /* internal initialization */
+static inline struct darray *get_tick_list(struct obs_source *source)
+{
+	return (source->info.output_flags & OBS_SOURCE_THREADED_TICK) ?
+		&obs->data.threaded_tick_sources.da :
+		&obs->data.tick_sources.da;
+}
+
+static void add_tick_source(struct obs_source *source)
+{
+	struct darray *list = get_tick_list(source);
+
+	pthread_mutex_lock(&obs->data.sources_mutex);
+	source->tick_idx = list->num;
+	source->ticking  = true;
+	darray_push_back(sizeof(struct obs_source*), list, &source);
+	pthread_mutex_unlock(&obs->data.sources_mutex);
+}
+
+/* the last source takes the place of the removed one */
+static void remove_tick_source(struct obs_source *source)
+{
+	struct darray *list = get_tick_list(source);
+	struct obs_source **array;
+
+	pthread_mutex_lock(&obs->data.sources_mutex);
+
+	if (source->ticking) {
+		array = list->array;
+		array[source->tick_idx] = array[list->num - 1];
+		array[source->tick_idx]->tick_idx = source->tick_idx;
+		darray_pop_back(sizeof(struct obs_source*), list);
+
+		source->ticking = false;
+	}
+
+	if (source->suspended) {
+		da_erase_item(obs->data.suspended_sources, &source);
+		source->suspended = false;
+	}
+
+	pthread_mutex_unlock(&obs->data.sources_mutex);
+}
+
 bool obs_source_init(struct obs_source *source,
 		const struct obs_source_info *info)
 {
@@ -103,17 +158,28 @@ bool obs_source_init(struct obs_source *source,
 	source->present_volume = 1.0f;
 	source->sync_offset = 0;
 	pthread_mutex_init_value(&source->filter_mutex);
-	pthread_mutex_init_value(&source->video_mutex);
+	pthread_mutex_init_value(&source->filter_queue_mutex);
 	pthread_mutex_init_value(&source->audio_mutex);
+	pthread_mutex_init_value(&source->mjpeg_mutex);
+	pthread_mutex_init_value(&source->create_mutex);
+	pthread_mutex_init_value(&source->snapshot_mutex);
 
 	memcpy(&source->info, info, sizeof(struct obs_source_info));
 
 	if (pthread_mutex_init(&source->filter_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&source->filter_queue_mutex, NULL) != 0)
+		return false;
 	if (pthread_mutex_init(&source->audio_mutex, NULL) != 0)
 		return false;
-	if (pthread_mutex_init(&source->video_mutex, NULL) != 0)
+	if (pthread_mutex_init(&source->mjpeg_mutex, NULL) != 0)
+		return false;
+	if (pthread_mutex_init(&source->create_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&source->snapshot_mutex, NULL) != 0)
+		return false;
+
+	source->audio_mixers = 1;
 
 	if (info->output_flags & OBS_SOURCE_AUDIO) {
 		source->audio_line = audio_output_createline(obs->audio.audio,
@@ -128,15 +194,17 @@ bool obs_source_init(struct obs_source *source,
 	obs_context_data_insert(&source->context,
 			&obs->data.sources_mutex,
 			&obs->data.first_source);
+	add_tick_source(source);
 	return true;
 }
 
 static inline void obs_source_dosignal(struct obs_source *source,
 		const char *signal_obs, const char *signal_source)
 {
+	uint8_t stack[CALLDATA_FIXED_SIZE];
 	struct calldata data;
 
-	calldata_init(&data);
+	calldata_init_fixed(&data, stack, sizeof(stack));
 	calldata_setptr(&data, "source", source);
 	if (signal_obs)
 		signal_handler_signal(obs->signals, signal_obs, &data);
@@ -158,6 +226,8 @@ obs_source_t obs_source_create(enum obs_source_type type, const char *id,
 	}
 
 	source = bzalloc(sizeof(struct obs_source));
+	source->save_pending = true;
+	source->gpu_owner    = gs_memory_owner_create();
 
 	if (!obs_source_init_context(source, settings, name))
 		goto fail;
@@ -165,9 +235,23 @@ obs_source_t obs_source_create(enum obs_source_type type, const char *id,
 	if (info->defaults)
 		info->defaults(source->context.settings);
 
-	source->context.data = info->create(source->context.settings, source);
-	if (!source->context.data)
-		goto fail;
+	source->settings_snapshot =
+		obs_data_create_copy(source->context.settings);
+
+	/* deferred sources are created once they're first shown */
+	if (type != OBS_SOURCE_TYPE_INPUT ||
+	    (info->output_flags & OBS_SOURCE_DEFERRED_CREATE) == 0) {
+		gs_memory_owner_t prev_owner =
+			gs_set_memory_owner(source->gpu_owner);
+
+		source->context.data = info->create(source->context.settings,
+				source);
+		gs_set_memory_owner(prev_owner);
+
+		if (!source->context.data)
+			goto fail;
+		source->created = true;
+	}
 
 	if (!obs_source_init(source, info))
 		goto fail;
@@ -200,46 +284,141 @@ void source_frame_init(struct source_frame *frame, enum video_format format,
 	}
 }
 
+static void push_filtered_frame(struct obs_source *source,
+		struct source_frame *frame);
+
+/* filters the queued frames in order, and unschedules itself once the queue
+ * is empty */
+static void filter_job(void *data)
+{
+	struct obs_source *source = data;
+
+	for (;;) {
+		struct source_frame *frame = NULL;
+
+		pthread_mutex_lock(&source->filter_queue_mutex);
+		if (!source->filter_jobs_stop)
+			frame = frame_ring_pop(&source->filter_queue);
+		if (!frame)
+			source->filter_job_scheduled = false;
+		pthread_mutex_unlock(&source->filter_queue_mutex);
+
+		if (!frame)
+			break;
+
+		push_filtered_frame(source, frame);
+	}
+}
+
+static void start_filter_jobs(struct obs_source *source)
+{
+	if (source->filter_jobs_active)
+		return;
+
+	source->filter_jobs_active = obs->jobs != NULL;
+
+	if (!source->filter_jobs_active)
+		blog(LOG_WARNING, "No job system to run the threaded filters "
+		                  "of source '%s' on, filtering inline",
+		                  source->context.name);
+}
+
+static void stop_filter_jobs(struct obs_source *source)
+{
+	struct source_frame *frame;
+	job_t job;
+
+	if (!source->filter_jobs_active)
+		return;
+
+	pthread_mutex_lock(&source->filter_queue_mutex);
+	source->filter_jobs_stop = true;
+	job = source->filter_job;
+	source->filter_job = NULL;
+	pthread_mutex_unlock(&source->filter_queue_mutex);
+
+	if (job) {
+		if (!job_cancel(job))
+			job_wait(job);
+		job_release(job);
+	}
+
+	source->filter_jobs_active = false;
+
+	while ((frame = frame_ring_pop(&source->filter_queue)) != NULL)
+		source_frame_destroy(frame);
+}
+
+static inline void release_tree(struct darray *tree);
+
 void obs_source_destroy(struct obs_source *source)
 {
+	struct source_frame *frame;
 	size_t i;
 
 	if (!source)
 		return;
 
 	obs_context_data_remove(&source->context);
+	remove_tick_source(source);
 
 	obs_source_dosignal(source, "source_destroy", "destroy");
 
+	stop_filter_jobs(source);
+
 	if (source->filter_parent)
 		obs_source_filter_remove(source->filter_parent, source);
 
 	for (i = 0; i < source->filters.num; i++)
 		obs_source_release(source->filters.array[i]);
 
-	for (i = 0; i < source->video_frames.num; i++)
-		source_frame_destroy(source->video_frames.array[i]);
+	while ((frame = frame_ring_pop(&source->video_frames)) != NULL)
+		source_frame_destroy(frame);
+	while ((frame = frame_ring_pop(&source->frame_cache)) != NULL)
+		source_frame_destroy(frame);
+	for (i = 0; i < source->mjpeg_results.num; i++)
+		source_frame_destroy(source->mjpeg_results.array[i].frame);
 
 	gs_entercontext(obs->video.graphics);
 	texrender_destroy(source->async_convert_texrender);
+	texrender_destroy(source->deinterlace_texrender);
+	texture_destroy(source->async_prev_texture);
 	texture_destroy(source->async_texture);
+	texture_destroy(source->async_chroma_textures[0]);
+	texture_destroy(source->async_chroma_textures[1]);
+	effect_destroy(source->fused_effect);
 	gs_leavecontext();
 
 	if (source->context.data)
 		source->info.destroy(source->context.data);
 
+	obs_source_free_rt_audio(source);
+
 	for (i = 0; i < MAX_AV_PLANES; i++)
-		bfree(source->audio_data.data[i]);
+		bfree(source->audio_storage[i]);
 
 	audio_line_destroy(source->audio_line);
 	audio_resampler_destroy(source->resampler);
 
-	texrender_destroy(source->filter_texrender);
-	da_free(source->video_frames);
+	texrender_destroy(source->render_cache);
+	texrender_destroy(source->freeze_texrender);
+	obs_source_release(source->frozen_child);
+	release_tree(&source->transition_tree);
+	dstr_free(&source->fused_shader);
+	da_free(source->tree);
 	da_free(source->filters);
+	da_free(source->mjpeg_results);
 	pthread_mutex_destroy(&source->filter_mutex);
+	pthread_mutex_destroy(&source->filter_queue_mutex);
 	pthread_mutex_destroy(&source->audio_mutex);
-	pthread_mutex_destroy(&source->video_mutex);
+	pthread_mutex_destroy(&source->mjpeg_mutex);
+	pthread_mutex_destroy(&source->create_mutex);
+	pthread_mutex_destroy(&source->snapshot_mutex);
+	for (i = 0; i < source->retired_snapshots.num; i++)
+		obs_data_release(source->retired_snapshots.array[i]);
+	da_free(source->retired_snapshots);
+	obs_data_release(source->settings_snapshot);
+	gs_memory_owner_destroy(source->gpu_owner);
 	obs_context_data_free(&source->context);
 	bfree(source);
 }
@@ -250,6 +429,24 @@ void obs_source_addref(obs_source_t source)
 		os_atomic_inc_long(&source->refs);
 }
 
+bool obs_source_try_addref(struct obs_source *source)
+{
+	long refs;
+
+	if (!source)
+		return false;
+
+	refs = os_atomic_load_long(&source->refs);
+
+	while (refs > 0) {
+		if (os_atomic_compare_swap_long(&source->refs, refs, refs + 1))
+			return true;
+		refs = os_atomic_load_long(&source->refs);
+	}
+
+	return false;
+}
+
 void obs_source_release(obs_source_t source)
 {
 	if (!source)
@@ -274,19 +471,31 @@ void obs_source_remove(obs_source_t source)
 
 	source->removed = true;
 
+	pthread_mutex_unlock(&data->sources_mutex);
+
 	obs_source_addref(source);
 
+	pthread_mutex_lock(&data->user_sources_mutex);
+
 	id = da_find(data->user_sources, &source, 0);
 	exists = (id != DARRAY_INVALID);
 	if (exists) {
 		da_erase(data->user_sources, id);
-		obs_source_release(source);
+		obs_source_index_remove(source);
 	}
 
-	pthread_mutex_unlock(&data->sources_mutex);
+	pthread_mutex_unlock(&data->user_sources_mutex);
+
+	if (exists) {
+		char *name = bstrdup(source->context.name);
 
-	if (exists)
+		pthread_mutex_lock(&data->sources_mutex);
+		da_push_back(data->removed_source_names, &name);
+		pthread_mutex_unlock(&data->sources_mutex);
+
+		obs_source_release(source);
 		obs_source_dosignal(source, "source_remove", "remove");
+	}
 
 	obs_source_release(source);
 }
@@ -343,10 +552,120 @@ uint32_t obs_source_get_output_flags(obs_source_t source)
 	return source ? source->info.output_flags : 0;
 }
 
+bool obs_source_get_gpu_memory(obs_source_t source,
+		struct gs_memory_usage *usage)
+{
+	if (!source || !usage)
+		return false;
+
+	gs_memory_owner_get_usage(source->gpu_owner, usage);
+	return true;
+}
+
+uint32_t obs_get_source_output_flags(enum obs_source_type type,
+		const char *id)
+{
+	const struct obs_source_info *info = get_source_info(type, id);
+	return info ? info->output_flags : 0;
+}
+
+static inline bool source_created(obs_source_t source)
+{
+	return os_atomic_load_long(&source->created) != 0;
+}
+
+/* runs the create callback of a deferred source, returns false if it hasn't
+ * been created (or failed to be) */
+static bool create_deferred(obs_source_t source)
+{
+	gs_memory_owner_t prev_owner;
+	bool load = false;
+	void *data;
+
+	if (source_created(source))
+		return true;
+
+	pthread_mutex_lock(&source->create_mutex);
+
+	if (source_created(source) || source->removed) {
+		pthread_mutex_unlock(&source->create_mutex);
+		return source_created(source);
+	}
+
+	prev_owner = gs_set_memory_owner(source->gpu_owner);
+	data = source->info.create(source->context.settings, source);
+	gs_set_memory_owner(prev_owner);
+
+	if (data) {
+		source->context.data = data;
+		load = source->load_pending;
+		source->load_pending = false;
+		os_atomic_set_long(&source->created, true);
+	} else {
+		blog(LOG_ERROR, "Failed to create deferred source '%s'",
+				source->context.name);
+	}
+
+	pthread_mutex_unlock(&source->create_mutex);
+
+	if (!data)
+		return false;
+
+	if (load && source->info.load)
+		source->info.load(data, source->context.settings);
+
+	/* the source may have children now */
+	if (source->info.enum_sources)
+		obs_source_invalidate_trees();
+	return true;
+}
+
+/* called from the UI thread, the previous snapshot might still be in use on
+ * the video thread so it's only retired here */
+static void publish_settings_snapshot(obs_source_t source)
+{
+	obs_data_t snapshot = obs_data_create_copy(source->context.settings);
+	obs_data_t prev = os_atomic_set_ptr(
+			(void *volatile*)&source->settings_snapshot, snapshot);
+
+	if (prev) {
+		pthread_mutex_lock(&source->snapshot_mutex);
+		da_push_back(source->retired_snapshots, &prev);
+		pthread_mutex_unlock(&source->snapshot_mutex);
+		os_atomic_set_long(&source->snapshots_retired, true);
+	}
+}
+
+static void release_retired_snapshots(obs_source_t source)
+{
+	if (!os_atomic_set_long(&source->snapshots_retired, false))
+		return;
+
+	pthread_mutex_lock(&source->snapshot_mutex);
+	for (size_t i = 0; i < source->retired_snapshots.num; i++)
+		obs_data_release(source->retired_snapshots.array[i]);
+	da_resize(source->retired_snapshots, 0);
+	pthread_mutex_unlock(&source->snapshot_mutex);
+}
+
+obs_data_t obs_source_get_settings_snapshot(obs_source_t source)
+{
+	if (!source) return NULL;
+
+	return os_atomic_load_ptr(
+			(void *const volatile*)&source->settings_snapshot);
+}
+
+/* runs on the video thread, so it's given the snapshot rather than the
+ * settings the UI thread may be changing at the same time */
 static void obs_source_deferred_update(obs_source_t source)
 {
-	source->info.update(source->context.data, source->context.settings);
+	gs_memory_owner_t prev_owner = gs_set_memory_owner(source->gpu_owner);
 	source->defer_update = false;
+	source->info.update(source->context.data,
+			obs_source_get_settings_snapshot(source));
+	gs_set_memory_owner(prev_owner);
+	os_atomic_inc_long(&source->content_revision);
 }
 
 void obs_source_update(obs_source_t source, obs_data_t settings)
@@ -354,32 +673,90 @@ void obs_source_update(obs_source_t source, obs_data_t settings)
 	if (!source) return;
 
 	obs_data_apply(source->context.settings, settings);
+	publish_settings_snapshot(source);
+
+	/* deferred sources are created with the stored settings */
+	if (!source_created(source))
+		return;
 
 	if (source->info.update) {
-		if (source->info.output_flags & OBS_SOURCE_VIDEO)
+		if (source->info.output_flags & OBS_SOURCE_VIDEO) {
 			source->defer_update = true;
-		else
+		} else {
+			gs_memory_owner_t prev_owner =
+				gs_set_memory_owner(source->gpu_owner);
 			source->info.update(source->context.data,
 					source->context.settings);
+			gs_set_memory_owner(prev_owner);
+		}
+	}
+}
+
+void obs_source_content_changed(obs_source_t source)
+{
+	if (source)
+		os_atomic_inc_long(&source->content_revision);
+}
+
+static inline bool get_static_revision(obs_source_t source,
+		uint64_t *revision)
+{
+	if (obs_scene_get_content_revision(source, revision))
+		return true;
+	if ((source->info.output_flags & OBS_SOURCE_STATIC_VIDEO) == 0)
+		return false;
+
+	*revision = (uint64_t)os_atomic_load_long(&source->content_revision);
+	return true;
+}
+
+/* the revisions only ever increase, so their sum changes whenever any one
+ * of them does */
+bool obs_source_get_content_revision(obs_source_t source, uint64_t *revision)
+{
+	uint64_t total;
+	bool     success;
+
+	if (!source || !revision)
+		return false;
+
+	success = get_static_revision(source, &total);
+
+	pthread_mutex_lock(&source->filter_mutex);
+
+	for (size_t i = 0; success && i < source->filters.num; i++) {
+		uint64_t filter_revision;
+
+		success = get_static_revision(source->filters.array[i],
+				&filter_revision);
+		total += filter_revision;
 	}
+
+	pthread_mutex_unlock(&source->filter_mutex);
+
+	*revision = total;
+	return success;
 }
 
 static void activate_source(obs_source_t source)
 {
-	if (source->info.activate)
+	if (source->info.activate && source_created(source))
 		source->info.activate(source->context.data);
 	obs_source_dosignal(source, "source_activate", "activate");
 }
 
 static void deactivate_source(obs_source_t source)
 {
-	if (source->info.deactivate)
+	if (source->info.deactivate && source_created(source))
 		source->info.deactivate(source->context.data);
 	obs_source_dosignal(source, "source_deactivate", "deactivate");
 }
 
 static void show_source(obs_source_t source)
 {
+	if (!create_deferred(source))
+		return;
+
 	if (source->info.show)
 		source->info.show(source->context.data);
 	obs_source_dosignal(source, "source_show", "show");
@@ -387,7 +764,7 @@ static void show_source(obs_source_t source)
 
 static void hide_source(obs_source_t source)
 {
-	if (source->info.hide)
+	if (source->info.hide && source_created(source))
 		source->info.hide(source->context.data);
 	obs_source_dosignal(source, "source_hide", "hide");
 }
@@ -465,19 +842,158 @@ void obs_source_deactivate(obs_source_t source, enum view_type type)
 	}
 }
 
+static inline bool source_idle(struct obs_source *source)
+{
+	return source->info.type == OBS_SOURCE_TYPE_INPUT &&
+	       source_created(source) &&
+	       os_atomic_load_long(&source->show_refs) == 0;
+}
+
+void obs_source_update_suspended(struct obs_source *source)
+{
+	struct obs_core_data *data = &obs->data;
+	bool idle = source_idle(source);
+
+	if (idle == source->suspended)
+		return;
+
+	source->suspended = idle;
+
+	if (idle) {
+		da_push_back(data->suspended_sources, &source);
+		return;
+	}
+
+	da_erase_item(data->suspended_sources, &source);
+
+	if (source->resources_released) {
+		source->resources_released = false;
+		if (source->info.resume)
+			source->info.resume(source->context.data);
+	}
+}
+
+/* estimated from the source's size, the format of its textures isn't
+ * tracked */
+static uint64_t suspended_memory(struct obs_source *source)
+{
+	uint64_t frame_size;
+	uint64_t surfaces = 0;
+
+	if (source->resources_released)
+		return 0;
+
+	frame_size = (uint64_t)obs_source_getwidth(source) *
+		(uint64_t)obs_source_getheight(source) * 4;
+
+	if (source->async_texture)           surfaces++;
+	if (source->async_prev_texture)      surfaces++;
+	if (source->async_convert_texrender) surfaces++;
+	if (source->deinterlace_texrender)   surfaces++;
+	if (source->render_cache)            surfaces++;
+	if (source->info.suspend)            surfaces++;
+
+	return frame_size * surfaces;
+}
+
+/* the textures are all created again the next time they're needed */
+static void release_resources(struct obs_source *source)
+{
+	gs_entercontext(obs->video.graphics);
+
+	texrender_destroy(source->async_convert_texrender);
+	texrender_destroy(source->deinterlace_texrender);
+	texrender_destroy(source->render_cache);
+	texture_destroy(source->async_prev_texture);
+	texture_destroy(source->async_texture);
+	texture_destroy(source->async_chroma_textures[0]);
+	texture_destroy(source->async_chroma_textures[1]);
+	source->async_convert_texrender  = NULL;
+	source->deinterlace_texrender    = NULL;
+	source->render_cache             = NULL;
+	source->async_prev_texture       = NULL;
+	source->async_texture            = NULL;
+	source->async_chroma_textures[0] = NULL;
+	source->async_chroma_textures[1] = NULL;
+
+	if (source->info.suspend)
+		source->info.suspend(source->context.data);
+
+	gs_leavecontext();
+
+	source->resources_released = true;
+}
+
+void obs_release_suspended_resources(void)
+{
+	struct obs_core_data *data = &obs->data;
+	uint64_t total = 0;
+	size_t   i;
+
+	for (i = 0; i < data->suspended_sources.num; i++)
+		total += suspended_memory(data->suspended_sources.array[i]);
+
+	for (i = 0; i < data->suspended_sources.num; i++) {
+		struct obs_source *source = data->suspended_sources.array[i];
+		uint64_t size;
+
+		if (total <= data->suspend_memory_budget)
+			break;
+
+		size = suspended_memory(source);
+		if (!size)
+			continue;
+
+		release_resources(source);
+		total -= size;
+	}
+}
+
+static void drop_frames(struct obs_source *source);
+
+static void cycle_frames(struct obs_source *source);
+
 void obs_source_video_tick(obs_source_t source, float seconds)
 {
 	if (!source) return;
 
+	/* the previous frame is done, so nothing refers to them any more */
+	release_retired_snapshots(source);
+
+	/* nothing to tick until the source has been created */
+	if (!source_created(source))
+		return;
+
+	if (source->suspended) {
+		if (source->info.output_flags & OBS_SOURCE_ASYNC)
+			drop_frames(source);
+		return;
+	}
+
 	if (source->defer_update)
 		obs_source_deferred_update(source);
 
-	/* reset the filter render texture information once every frame */
-	if (source->filter_texrender)
-		texrender_reset(source->filter_texrender);
+	if (source->info.output_flags & OBS_SOURCE_ASYNC)
+		cycle_frames(source);
 
-	if (source->info.video_tick)
+	if (source->info.video_tick) {
+		gs_memory_owner_t prev_owner =
+			gs_set_memory_owner(source->gpu_owner);
 		source->info.video_tick(source->context.data, seconds);
+		gs_set_memory_owner(prev_owner);
+	}
+}
+
+uint32_t obs_source_get_async_queue_depth(obs_source_t source)
+{
+	return source ? (uint32_t)frame_ring_count(&source->video_frames) : 0;
+}
+
+uint32_t obs_source_get_async_frames_dropped(obs_source_t source)
+{
+	return source ?
+		(uint32_t)os_atomic_load_long(&source->async_frames_dropped) :
+		0;
 }
 
 /* unless the value is 3+ hours worth of frames, this won't overflow */
@@ -586,6 +1102,8 @@ static inline enum convert_type get_convert_type(enum video_format format)
 	case VIDEO_FORMAT_RGBA:
 	case VIDEO_FORMAT_BGRA:
 	case VIDEO_FORMAT_BGRX:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_I422:
 		return CONVERT_NONE;
 	}
 
@@ -600,6 +1118,16 @@ static inline bool set_packed422_sizes(struct obs_source *source,
 	return true;
 }
 
+/* the luma plane is uploaded as-is, the chroma planes are half size in both
+ * directions and are upsampled by the texture filtering */
+static inline bool set_planar420_sizes(struct obs_source *source,
+		struct source_frame *frame)
+{
+	source->async_convert_height = frame->height;
+	source->async_convert_width = frame->width;
+	return true;
+}
+
 static inline bool init_gpu_conversion(struct obs_source *source,
 		struct source_frame *frame)
 {
@@ -610,8 +1138,7 @@ static inline bool init_gpu_conversion(struct obs_source *source,
 
 		case CONVERT_NV12:
 		case CONVERT_420:
-			/* TODO: implement conversion */
-			break;
+			return set_planar420_sizes(source, frame);
 
 		case CONVERT_NONE:
 			assert(false && "No conversion requested");
@@ -621,6 +1148,45 @@ static inline bool init_gpu_conversion(struct obs_source *source,
 	return false;
 }
 
+static inline enum gs_color_format convert_texture_format(
+		enum convert_type type)
+{
+	switch (type) {
+		case CONVERT_NV12:
+		case CONVERT_420:
+			return GS_R8;
+
+		case CONVERT_422_U:
+		case CONVERT_422_Y:
+		case CONVERT_NONE:
+			break;
+	}
+	return GS_RGBA;
+}
+
+static bool create_chroma_textures(struct obs_source *source,
+		struct source_frame *frame, enum convert_type type)
+{
+	uint32_t cx = (frame->width  + 1) / 2;
+	uint32_t cy = (frame->height + 1) / 2;
+
+	if (type == CONVERT_NV12) {
+		source->async_chroma_textures[0] = gs_create_texture(cx, cy,
+				GS_R8G8, 1, NULL, GS_DYNAMIC);
+		return source->async_chroma_textures[0] != NULL;
+
+	} else if (type == CONVERT_420) {
+		source->async_chroma_textures[0] = gs_create_texture(cx, cy,
+				GS_R8, 1, NULL, GS_DYNAMIC);
+		source->async_chroma_textures[1] = gs_create_texture(cx, cy,
+				GS_R8, 1, NULL, GS_DYNAMIC);
+		return source->async_chroma_textures[0] &&
+		       source->async_chroma_textures[1];
+	}
+
+	return true;
+}
+
 static inline bool set_async_texture_size(struct obs_source *source,
 		struct source_frame *frame)
 {
@@ -635,7 +1201,11 @@ static inline bool set_async_texture_size(struct obs_source *source,
 	}
 
 	texture_destroy(source->async_texture);
+	texture_destroy(source->async_chroma_textures[0]);
+	texture_destroy(source->async_chroma_textures[1]);
 	texrender_destroy(source->async_convert_texrender);
+	source->async_chroma_textures[0] = NULL;
+	source->async_chroma_textures[1] = NULL;
 	source->async_convert_texrender = NULL;
 
 	if (cur != CONVERT_NONE && init_gpu_conversion(source, frame)) {
@@ -647,7 +1217,11 @@ static inline bool set_async_texture_size(struct obs_source *source,
 		source->async_texture = gs_create_texture(
 				source->async_convert_width,
 				source->async_convert_height,
-				GS_RGBA, 1, NULL, GS_DYNAMIC);
+				convert_texture_format(cur), 1, NULL,
+				GS_DYNAMIC);
+
+		if (!create_chroma_textures(source, frame, cur))
+			return false;
 
 	} else {
 		source->async_gpu_conversion = false;
@@ -665,18 +1239,27 @@ static inline bool set_async_texture_size(struct obs_source *source,
 	return true;
 }
 
-static void upload_raw_frame(texture_t tex, const struct source_frame *frame)
+static void upload_raw_frame(struct obs_source *source,
+		const struct source_frame *frame)
 {
+	texture_t *chroma = source->async_chroma_textures;
+
 	switch (get_convert_type(frame->format)) {
 		case CONVERT_422_U:
 		case CONVERT_422_Y:
-			texture_setimage(tex, frame->data[0],
+			texture_setimage(source->async_texture, frame->data[0],
 					frame->linesize[0], false);
 			break;
 
-		case CONVERT_NV12:
 		case CONVERT_420:
-			assert(false && "Conversion not yet implemented");
+			texture_setimage(chroma[1], frame->data[2],
+					frame->linesize[2], false);
+			/* fall through */
+		case CONVERT_NV12:
+			texture_setimage(source->async_texture, frame->data[0],
+					frame->linesize[0], false);
+			texture_setimage(chroma[0], frame->data[1],
+					frame->linesize[1], false);
 			break;
 
 		case CONVERT_NONE:
@@ -697,8 +1280,14 @@ static const char *select_conversion_technique(enum video_format format)
 		case VIDEO_FORMAT_YVYU:
 			return "YVYU_Reverse";
 
-		case VIDEO_FORMAT_NV12:
 		case VIDEO_FORMAT_I420:
+			return "I420_Reverse";
+
+		case VIDEO_FORMAT_NV12:
+			return "NV12_Reverse";
+
+		case VIDEO_FORMAT_I444:
+		case VIDEO_FORMAT_I422:
 			assert(false && "Conversion not yet implemented");
 			break;
 
@@ -726,32 +1315,44 @@ static bool update_async_texrender(struct obs_source *source,
 
 	texrender_reset(texrender);
 
-	upload_raw_frame(tex, frame);
+	upload_raw_frame(source, frame);
 
 	uint32_t cx = source->async_width;
 	uint32_t cy = source->async_height;
 
 	effect_t conv = obs->video.conversion_effect;
+	eparam_t *params = obs->video.conversion_params;
 	technique_t tech = effect_gettechnique(conv,
 			select_conversion_technique(frame->format));
 
+	const float vals[] = {
+		[CONVERSION_WIDTH]        = (float)cx,
+		[CONVERSION_HEIGHT]       = (float)cy,
+		[CONVERSION_WIDTH_I]      = 1.0f / cx,
+		[CONVERSION_HEIGHT_I]     = 1.0f / cy,
+		[CONVERSION_WIDTH_D2]     = cx * 0.5f,
+		[CONVERSION_HEIGHT_D2]    = cy * 0.5f,
+		[CONVERSION_WIDTH_D2_I]   = 1.0f / (cx * 0.5f),
+		[CONVERSION_HEIGHT_D2_I]  = 1.0f / (cy * 0.5f),
+		[CONVERSION_INPUT_HEIGHT] = (float)cy
+	};
+
 	if (!texrender_begin(texrender, cx, cy))
 		return false;
 
 	technique_begin(tech);
 	technique_beginpass(tech, 0);
 
-	effect_settexture(conv, effect_getparambyname(conv, "image"),
-			tex);
-	set_eparam(conv, "width",  (float)cx);
-	set_eparam(conv, "height", (float)cy);
-	set_eparam(conv, "width_i",  1.0f / cx);
-	set_eparam(conv, "height_i", 1.0f / cy);
-	set_eparam(conv, "width_d2",  cx  * 0.5f);
-	set_eparam(conv, "height_d2", cy * 0.5f);
-	set_eparam(conv, "width_d2_i",  1.0f / (cx  * 0.5f));
-	set_eparam(conv, "height_d2_i", 1.0f / (cy * 0.5f));
-	set_eparam(conv, "input_height", (float)cy);
+	effect_settexture(conv, params[CONVERSION_IMAGE], tex);
+	effect_settexture(conv, params[CONVERSION_IMAGE_1],
+			source->async_chroma_textures[0]);
+	effect_settexture(conv, params[CONVERSION_IMAGE_2],
+			source->async_chroma_textures[1]);
+
+	/* the plane offsets are only used when packing for output */
+	effect_setfloats(conv, params + CONVERSION_WIDTH,
+			vals + CONVERSION_WIDTH,
+			CONVERSION_IMAGE - CONVERSION_WIDTH);
 
 	gs_ortho(0.f, (float)cx, 0.f, (float)cy, -100.f, 100.f);
 
@@ -760,6 +1361,11 @@ static bool update_async_texrender(struct obs_source *source,
 	technique_endpass(tech);
 	technique_end(tech);
 
+	/* the chroma textures belong to this source, so don't leave them set
+	 * on the shared effect */
+	effect_settexture(conv, params[CONVERSION_IMAGE_1], NULL);
+	effect_settexture(conv, params[CONVERSION_IMAGE_2], NULL);
+
 	texrender_end(texrender);
 
 	return true;
@@ -818,15 +1424,176 @@ static bool update_async_texture(struct obs_source *source,
 	return true;
 }
 
+static inline bool deinterlacing(struct obs_source *source)
+{
+	return source->deinterlace_mode != OBS_DEINTERLACE_MODE_DISABLE &&
+		obs->video.deinterlace_effect;
+}
+
+static inline bool deinterlace_2x(enum obs_deinterlace_mode mode)
+{
+	return mode == OBS_DEINTERLACE_MODE_BOB_2X ||
+	       mode == OBS_DEINTERLACE_MODE_LINEAR_2X ||
+	       mode == OBS_DEINTERLACE_MODE_YADIF_2X;
+}
+
+static inline texture_t get_async_output_texture(struct obs_source *source)
+{
+	if (source->async_convert_texrender)
+		return texrender_gettexture(source->async_convert_texrender);
+	return source->async_texture;
+}
+
+/* keeps the last frame's output before it's replaced by the new frame */
+static void save_prev_async_texture(struct obs_source *source)
+{
+	texture_t cur = get_async_output_texture(source);
+	texture_t prev = source->async_prev_texture;
+	uint32_t cx, cy;
+
+	if (!cur)
+		return;
+
+	cx = texture_getwidth(cur);
+	cy = texture_getheight(cur);
+
+	if (!prev || texture_getwidth(prev) != cx ||
+	             texture_getheight(prev) != cy) {
+		texture_destroy(prev);
+		prev = gs_create_texture(cx, cy, GS_RGBA, 1, NULL,
+				GS_RENDERTARGET);
+		source->async_prev_texture = prev;
+	}
+
+	if (prev)
+		gs_copy_texture(prev, cur);
+}
+
+/* the duration of a frame is taken from the timestamps of the frames around
+ * it, and used to tell when to switch to the second field in 2x modes */
+static void deinterlace_new_frame(struct obs_source *source,
+		const struct source_frame *frame)
+{
+	uint64_t duration = frame->timestamp - source->deinterlace_frame_ts;
+
+	if (source->deinterlace_frame_ts && duration < MAX_TIMESTAMP_JUMP)
+		source->deinterlace_half_duration = duration / 2;
+
+	source->deinterlace_frame_ts       = frame->timestamp;
+	source->deinterlace_frame_sys_time = os_gettime_ns();
+	source->deinterlace_second_field   = false;
+	source->deinterlace_dirty          = true;
+}
+
+static inline bool deinterlace_get_second_field(struct obs_source *source)
+{
+	uint64_t elapsed;
+
+	if (!deinterlace_2x(source->deinterlace_mode) ||
+	    !source->deinterlace_half_duration)
+		return false;
+
+	elapsed = os_gettime_ns() - source->deinterlace_frame_sys_time;
+	return elapsed >= source->deinterlace_half_duration;
+}
+
+static const char *select_deinterlace_technique(enum obs_deinterlace_mode mode)
+{
+	switch (mode) {
+	case OBS_DEINTERLACE_MODE_LINEAR:
+	case OBS_DEINTERLACE_MODE_LINEAR_2X:
+		return "Linear";
+
+	case OBS_DEINTERLACE_MODE_YADIF:
+	case OBS_DEINTERLACE_MODE_YADIF_2X:
+		return "Yadif";
+
+	case OBS_DEINTERLACE_MODE_BOB:
+	case OBS_DEINTERLACE_MODE_BOB_2X:
+	case OBS_DEINTERLACE_MODE_DISABLE:
+		break;
+	}
+
+	return "Bob";
+}
+
+/* renders the deinterlaced frame once per frame (or field), sources that are
+ * drawn more than once per output frame reuse the result */
+static bool deinterlace_render(struct obs_source *source)
+{
+	effect_t    effect = obs->video.deinterlace_effect;
+	texture_t   cur    = get_async_output_texture(source);
+	texture_t   prev   = source->async_prev_texture;
+	bool        second = deinterlace_get_second_field(source);
+	technique_t tech;
+	uint32_t    cx, cy;
+	float       field;
+
+	if (!cur)
+		return false;
+
+	if (!source->deinterlace_texrender) {
+		source->deinterlace_texrender =
+			texrender_create(GS_RGBA, GS_ZS_NONE);
+		source->deinterlace_dirty = true;
+	}
+
+	if (!source->deinterlace_dirty &&
+	    source->deinterlace_second_field == second)
+		return true;
+
+	cx = texture_getwidth(cur);
+	cy = texture_getheight(cur);
+
+	if (!prev || texture_getwidth(prev) != cx ||
+	             texture_getheight(prev) != cy)
+		prev = cur;
+
+	field = source->deinterlace_field_order ==
+		OBS_DEINTERLACE_FIELD_ORDER_TOP ? 0.0f : 1.0f;
+	if (second)
+		field = 1.0f - field;
+
+	texrender_reset(source->deinterlace_texrender);
+	if (!texrender_begin(source->deinterlace_texrender, cx, cy))
+		return false;
+
+	tech = effect_gettechnique(effect,
+			select_deinterlace_technique(source->deinterlace_mode));
+
+	technique_begin(tech);
+	technique_beginpass(tech, 0);
+
+	effect_settexture(effect, effect_getparambyname(effect, "image"), cur);
+	effect_settexture(effect, effect_getparambyname(effect,
+				"previous_image"), prev);
+	set_eparam(effect, "field",    field);
+	set_eparam(effect, "height",   (float)cy);
+	set_eparam(effect, "height_i", 1.0f / cy);
+
+	gs_ortho(0.f, (float)cx, 0.f, (float)cy, -100.f, 100.f);
+
+	gs_draw_sprite(cur, 0, cx, cy);
+
+	technique_endpass(tech);
+	technique_end(tech);
+
+	texrender_end(source->deinterlace_texrender);
+
+	source->deinterlace_dirty        = false;
+	source->deinterlace_second_field = second;
+	return true;
+}
+
 static inline void obs_source_draw_texture(struct obs_source *source,
 		effect_t effect, float *color_matrix,
 		float const *color_range_min, float const *color_range_max)
 {
-	texture_t tex = source->async_texture;
+	texture_t tex = get_async_output_texture(source);
 	eparam_t  param;
 
-	if (source->async_convert_texrender)
-		tex = texrender_gettexture(source->async_convert_texrender);
+	if (deinterlacing(source) && source->deinterlace_texrender)
+		tex = texrender_gettexture(source->deinterlace_texrender);
 
 	if (color_range_min) {
 		size_t const size = sizeof(float) * 3;
@@ -878,18 +1645,33 @@ static void obs_source_draw_async_texture(struct obs_source *source)
 	}
 }
 
-static void obs_source_render_async_video(obs_source_t source)
+void obs_source_render_async_video(obs_source_t source)
 {
-	struct source_frame *frame = obs_source_getframe(source);
+	struct source_frame *frame;
+
+	if (!source)
+		return;
+
+	frame = obs_source_getframe(source);
 	if (frame) {
 		if (!set_async_texture_size(source, frame))
 			return;
+		if (deinterlacing(source))
+			save_prev_async_texture(source);
 		if (!update_async_texture(source, frame))
 			return;
+
+		deinterlace_new_frame(source, frame);
 	}
 
-	if (source->async_texture)
+	if (source->async_texture) {
+		if (deinterlacing(source) && !deinterlace_render(source)) {
+			texrender_destroy(source->deinterlace_texrender);
+			source->deinterlace_texrender = NULL;
+		}
+
 		obs_source_draw_async_texture(source);
+	}
 
 	obs_source_releaseframe(source, frame);
 }
@@ -934,9 +1716,172 @@ static inline void obs_source_main_render(obs_source_t source)
 				custom_draw ? NULL : gs_geteffect());
 }
 
+static bool render_pointwise_filters(obs_source_t filter);
+
+void obs_set_cache_blend(void)
+{
+	/* colors are blended normally, but alpha is accumulated so the
+	 * result can be drawn as premultiplied alpha */
+	gs_blendfunction_separate(GS_BLEND_SRCALPHA, GS_BLEND_INVSRCALPHA,
+			GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+}
+
+void obs_draw_cache_texture(texture_t tex, uint32_t cx, uint32_t cy)
+{
+	effect_t    effect = obs->video.default_effect;
+	technique_t tech   = effect_gettechnique(effect, "Draw");
+	size_t      passes;
+
+	effect_settexture(effect, effect_getparambyname(effect, "image"), tex);
+
+	/* the cache must be blended even if the caller renders without
+	 * blending, so its empty areas are left untouched */
+	gs_blend_state_push();
+	gs_enable_blending(true);
+	gs_blendfunction_separate(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA,
+			GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+
+	passes = technique_begin(tech);
+	for (size_t i = 0; i < passes; i++) {
+		technique_beginpass(tech, i);
+		gs_draw_sprite(tex, 0, cx, cy);
+		technique_endpass(tech);
+	}
+	technique_end(tech);
+
+	gs_blend_state_pop();
+}
+
+static void render_video(obs_source_t source);
+
+/* filters and the parent drawn at the end of its own filter chain are part
+ * of the parent's render, so only the outermost draw is counted/cached */
+static inline bool render_cacheable(obs_source_t source)
+{
+	return !source->filter_parent     &&
+	       !source->rendering_filter  &&
+	       !source->rendering_cache;
+}
+
+bool obs_source_render_cache_active(const struct obs_source *source)
+{
+	uint64_t frame = obs->video.frame_count;
+
+	switch (source->render_cache_mode) {
+	case OBS_RENDER_CACHE_AUTO:     break;
+	case OBS_RENDER_CACHE_ALWAYS:   return true;
+	case OBS_RENDER_CACHE_DISABLED: return false;
+	}
+
+	/* decided from the previous frame until the first draw of this one
+	 * stores the decision */
+	if (source->render_count_frame == frame)
+		return source->use_render_cache;
+
+	return source->render_count_frame + 1 == frame &&
+	       source->render_count > 1;
+}
+
+/* counts the draws of the source in this frame, returns whether the
+ * render cache should be used for it */
+static bool count_render(obs_source_t source)
+{
+	uint64_t frame = obs->video.frame_count;
+
+	if (source->render_count_frame != frame) {
+		source->use_render_cache =
+			obs_source_render_cache_active(source);
+		source->render_count_frame = frame;
+		source->render_count       = 0;
+	}
+
+	source->render_count++;
+	return obs_source_render_cache_active(source);
+}
+
+static inline bool render_cache_valid(obs_source_t source,
+		uint32_t cx, uint32_t cy)
+{
+	return source->render_cache_frame == obs->video.frame_count &&
+	       source->render_cache_cx    == cx &&
+	       source->render_cache_cy    == cy;
+}
+
+static bool render_cached(obs_source_t source)
+{
+	uint32_t  cx = obs_source_getwidth(source);
+	uint32_t  cy = obs_source_getheight(source);
+	texture_t tex;
+
+	if (!cx || !cy)
+		return false;
+
+	if (!source->render_cache)
+		source->render_cache = texrender_create(GS_RGBA, GS_ZS_NONE);
+
+	if (!render_cache_valid(source, cx, cy)) {
+		struct vec4 clear_color;
+
+		texrender_reset(source->render_cache);
+		if (!texrender_begin(source->render_cache, cx, cy))
+			return false;
+
+		vec4_zero(&clear_color);
+		gs_clear(GS_CLEAR_COLOR, &clear_color, 1.0f, 0);
+		gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+
+		gs_blend_state_push();
+		gs_enable_blending(true);
+		obs_set_cache_blend();
+
+		source->rendering_cache = true;
+		render_video(source);
+		source->rendering_cache = false;
+
+		gs_blend_state_pop();
+		texrender_end(source->render_cache);
+
+		source->render_cache_frame = obs->video.frame_count;
+		source->render_cache_cx    = cx;
+		source->render_cache_cy    = cy;
+	}
+
+	tex = texrender_gettexture(source->render_cache);
+	if (!tex)
+		return false;
+
+	obs_draw_cache_texture(tex, cx, cy);
+	return true;
+}
+
 void obs_source_video_render(obs_source_t source)
 {
-	if (!source) return;
+	gs_memory_owner_t prev_owner;
+	gputimer_t        timer = NULL;
+
+	if (!source || !source_created(source)) return;
+
+	prev_owner = gs_set_memory_owner(source->gpu_owner);
+
+	/* a source is rendered again within itself by its filters, which
+	 * is already part of the outermost render */
+	if (source->gpu_timing_depth++ == 0)
+		timer = obs_gpu_timer_begin(GPU_SAMPLE_SOURCE, 0, source);
+
+	if (!render_cacheable(source) || !count_render(source) ||
+	    !render_cached(source))
+		render_video(source);
+
+	obs_gpu_timer_end(timer);
+	source->gpu_timing_depth--;
+
+	gs_set_memory_owner(prev_owner);
+}
+
+static void render_video(obs_source_t source)
+{
+	if (source->filter_parent && render_pointwise_filters(source))
+		return;
 
 	if (source->filters.num && !source->rendering_filter)
 		obs_source_render_filters(source);
@@ -953,7 +1898,7 @@ void obs_source_video_render(obs_source_t source)
 
 uint32_t obs_source_getwidth(obs_source_t source)
 {
-	if (!source) return 0;
+	if (!source || !source_created(source)) return 0;
 
 	if (source->info.getwidth)
 		return source->info.getwidth(source->context.data);
@@ -962,7 +1907,7 @@ uint32_t obs_source_getwidth(obs_source_t source)
 
 uint32_t obs_source_getheight(obs_source_t source)
 {
-	if (!source) return 0;
+	if (!source || !source_created(source)) return 0;
 
 	if (source->info.getheight)
 		return source->info.getheight(source->context.data);
@@ -998,11 +1943,19 @@ void obs_source_filter_add(obs_source_t source, obs_source_t filter)
 	}
 
 	da_push_back(source->filters, &filter);
+	os_atomic_inc_long(&source->content_revision);
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
 	filter->filter_parent = source;
 	filter->filter_target = source;
+
+	/* frames stay queued for the life of the source once started, and
+	 * only one filter job runs at a time, so filtered frames stay in
+	 * order */
+	if (filter->info.filter_video &&
+	    (filter->info.output_flags & OBS_SOURCE_THREADED_FILTER_VIDEO))
+		start_filter_jobs(source);
 }
 
 void obs_source_filter_remove(obs_source_t source, obs_source_t filter)
@@ -1024,6 +1977,7 @@ void obs_source_filter_remove(obs_source_t source, obs_source_t filter)
 	}
 
 	da_erase(source->filters, idx);
+	os_atomic_inc_long(&source->content_revision);
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
@@ -1070,6 +2024,8 @@ void obs_source_filter_setorder(obs_source_t source, obs_source_t filter,
 			source : source->filters.array[idx+1];
 		source->filters.array[i]->filter_target = next_filter;
 	}
+
+	os_atomic_inc_long(&source->content_revision);
 }
 
 obs_data_t obs_source_getsettings(obs_source_t source)
@@ -1144,6 +2100,13 @@ static void copy_frame_data(struct source_frame *dst,
 		copy_frame_data_plane(dst, src, 1, dst->height/2);
 		break;
 
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_I422:
+		copy_frame_data_plane(dst, src, 0, dst->height);
+		copy_frame_data_plane(dst, src, 1, dst->height);
+		copy_frame_data_plane(dst, src, 2, dst->height);
+		break;
+
 	case VIDEO_FORMAT_YVYU:
 	case VIDEO_FORMAT_YUY2:
 	case VIDEO_FORMAT_UYVY:
@@ -1155,146 +2118,383 @@ static void copy_frame_data(struct source_frame *dst,
 	}
 }
 
-static inline struct source_frame *cache_video(const struct source_frame *frame)
+static inline bool frame_matches(const struct source_frame *frame,
+		enum video_format format, uint32_t width, uint32_t height)
 {
-	/* TODO: use an actual cache */
-	struct source_frame *new_frame = source_frame_create(frame->format,
-			frame->width, frame->height);
-
-	copy_frame_data(new_frame, frame);
-	return new_frame;
+	return frame->format == format &&
+	       frame->width  == width  &&
+	       frame->height == height;
 }
 
-static bool new_frame_ready(obs_source_t source, uint64_t sys_time);
+/* hands a frame back to the producing side for reuse.  only called from the
+ * thread that consumes frames (the video thread) */
+static void recycle_frame(struct obs_source *source,
+		struct source_frame *frame)
+{
+	if (frame && !frame_ring_push(&source->frame_cache, frame))
+		source_frame_destroy(frame);
+}
 
-static inline void cycle_frames(struct obs_source *source)
+/* only called from the thread that outputs frames */
+static struct source_frame *get_cached_frame(struct obs_source *source,
+		enum video_format format, uint32_t width, uint32_t height)
 {
-	if (source->video_frames.num && !source->activate_refs)
-		new_frame_ready(source, os_gettime_ns());
+	struct source_frame *frame;
+
+	/* frames left over from a previous format or size are of no further
+	 * use */
+	while ((frame = frame_ring_pop(&source->frame_cache)) != NULL) {
+		if (frame_matches(frame, format, width, height))
+			return frame;
+		source_frame_destroy(frame);
+	}
+
+	return source_frame_create(format, width, height);
 }
 
-void obs_source_output_video(obs_source_t source,
+static inline struct source_frame *cache_video(struct obs_source *source,
 		const struct source_frame *frame)
 {
-	if (!source || !frame)
-		return;
+	struct source_frame *new_frame = get_cached_frame(source,
+			frame->format, frame->width, frame->height);
+
+	copy_frame_data(new_frame, frame);
+	return new_frame;
+}
 
-	struct source_frame *output = cache_video(frame);
+static void push_filtered_frame(struct obs_source *source,
+		struct source_frame *frame)
+{
+	bool dropped = false;
 
+	/* pushed under the lock too: while threaded filters are starting up,
+	 * the output thread and a filter job can both get here */
 	pthread_mutex_lock(&source->filter_mutex);
-	output = filter_async_video(source, output);
+	frame = filter_async_video(source, frame);
+	if (frame && !frame_ring_push(&source->video_frames, frame))
+		dropped = true;
 	pthread_mutex_unlock(&source->filter_mutex);
 
-	if (output) {
-		pthread_mutex_lock(&source->video_mutex);
-		cycle_frames(source);
-		da_push_back(source->video_frames, &output);
-		pthread_mutex_unlock(&source->video_mutex);
+	if (dropped) {
+		source_frame_destroy(frame);
+		os_atomic_inc_long(&source->async_frames_dropped);
 	}
 }
 
-static inline struct filtered_audio *filter_async_audio(obs_source_t source,
-		struct filtered_audio *in)
-{
-	size_t i;
-	for (i = source->filters.num; i > 0; i--) {
-		struct obs_source *filter = source->filters.array[i-1];
-		if (filter->info.filter_audio) {
-			in = filter->info.filter_audio(filter->context.data,
-					in);
-			if (!in)
-				return NULL;
-		}
-	}
-
-	return in;
-}
+/* frames waiting for threaded filters beyond this are dropped, oldest first,
+ * so slow filters add a bounded amount of latency */
+#define FILTER_QUEUE_DEPTH 4
 
-static inline void reset_resampler(obs_source_t source,
-		const struct source_audio *audio)
+static void queue_filter_frame(struct obs_source *source,
+		struct source_frame *frame)
 {
-	const struct audio_output_info *obs_info;
-	struct resample_info output_info;
-
-	obs_info = audio_output_getinfo(obs->audio.audio);
+	struct source_frame *dropped = NULL;
+	job_t               finished = NULL;
 
-	output_info.format           = obs_info->format;
-	output_info.samples_per_sec  = obs_info->samples_per_sec;
-	output_info.speakers         = obs_info->speakers;
+	pthread_mutex_lock(&source->filter_queue_mutex);
 
-	source->sample_info.format          = audio->format;
-	source->sample_info.samples_per_sec = audio->samples_per_sec;
-	source->sample_info.speakers        = audio->speakers;
+	if (frame_ring_count(&source->filter_queue) >= FILTER_QUEUE_DEPTH)
+		dropped = frame_ring_pop(&source->filter_queue);
+	frame_ring_push(&source->filter_queue, frame);
 
-	if (source->sample_info.samples_per_sec == obs_info->samples_per_sec &&
-	    source->sample_info.format          == obs_info->format          &&
-	    source->sample_info.speakers        == obs_info->speakers) {
-		source->audio_failed = false;
-		return;
+	if (!source->filter_job_scheduled && !source->filter_jobs_stop) {
+		finished = source->filter_job;
+		source->filter_job = job_create(obs->jobs, filter_job, source,
+				JOB_PRIORITY_NORMAL);
+		source->filter_job_scheduled = source->filter_job != NULL;
+		job_submit(source->filter_job);
 	}
 
-	audio_resampler_destroy(source->resampler);
-	source->resampler = audio_resampler_create(&output_info,
-			&source->sample_info);
+	pthread_mutex_unlock(&source->filter_queue_mutex);
 
-	source->audio_failed = source->resampler == NULL;
-	if (source->resampler == NULL)
-		blog(LOG_ERROR, "creation of resampler failed");
+	job_release(finished);
+
+	if (dropped) {
+		source_frame_destroy(dropped);
+		os_atomic_inc_long(&source->async_frames_dropped);
+	}
 }
 
-static inline void copy_audio_data(obs_source_t source,
-		const uint8_t *const data[], uint32_t frames, uint64_t ts)
+/* the planar 444/422 formats are output formats only, there's no way to
+ * upload them for drawing */
+static inline bool async_format_supported(enum video_format format)
 {
-	size_t planes    = audio_output_planes(obs->audio.audio);
-	size_t blocksize = audio_output_blocksize(obs->audio.audio);
-	size_t size      = (size_t)frames * blocksize;
-	bool   resize    = source->audio_storage_size < size;
-
-	source->audio_data.frames    = frames;
-	source->audio_data.timestamp = ts;
+	return format != VIDEO_FORMAT_I444 && format != VIDEO_FORMAT_I422;
+}
 
-	for (size_t i = 0; i < planes; i++) {
-		/* ensure audio storage capacity */
-		if (resize) {
-			bfree(source->audio_data.data[i]);
-			source->audio_data.data[i] = bmalloc(size);
-		}
+static void output_async_frame(struct obs_source *source,
+		struct source_frame *output)
+{
+	if (!output)
+		return;
 
-		memcpy(source->audio_data.data[i], data[i], size);
+	if (!async_format_supported(output->format)) {
+		source_frame_destroy(output);
+		return;
 	}
 
-	if (resize)
-		source->audio_storage_size = size;
+	if (source->filter_jobs_active)
+		queue_filter_frame(source, output);
+	else
+		push_filtered_frame(source, output);
 }
 
-/* resamples/remixes new audio to the designated main audio output format */
-static void process_audio(obs_source_t source, const struct source_audio *audio)
+void obs_source_output_video(obs_source_t source,
+		const struct source_frame *frame)
 {
-	if (source->sample_info.samples_per_sec != audio->samples_per_sec ||
-	    source->sample_info.format          != audio->format          ||
-	    source->sample_info.speakers        != audio->speakers)
-		reset_resampler(source, audio);
-
-	if (source->audio_failed)
+	if (!source || !frame)
 		return;
 
-	if (source->resampler) {
-		uint8_t  *output[MAX_AV_PLANES];
-		uint32_t frames;
+	output_async_frame(source, cache_video(source, frame));
+}
+
+struct source_frame *obs_source_allocframe(obs_source_t source,
+		enum video_format format, uint32_t width, uint32_t height)
+{
+	if (!source)
+		return NULL;
+
+	return get_cached_frame(source, format, width, height);
+}
+
+void obs_source_output_video_direct(obs_source_t source,
+		struct source_frame *frame)
+{
+	if (!frame)
+		return;
+
+	if (!source) {
+		source_frame_destroy(frame);
+		return;
+	}
+
+	output_async_frame(source, frame);
+}
+
+/* frames a source can have out on the decode pool at once.  beyond this, new
+ * frames are dropped so a pool that falls behind doesn't add latency */
+#define MAX_MJPEG_PENDING 4
+
+void obs_source_output_mjpeg(obs_source_t source, const void *data,
+		size_t size, uint64_t timestamp)
+{
+	uint64_t seq;
+
+	if (!source || !data || !size)
+		return;
+
+	if (os_atomic_inc_long(&source->mjpeg_pending) > MAX_MJPEG_PENDING) {
+		os_atomic_dec_long(&source->mjpeg_pending);
+		os_atomic_inc_long(&source->async_frames_dropped);
+		return;
+	}
+
+	pthread_mutex_lock(&source->mjpeg_mutex);
+	seq = source->mjpeg_next_seq++;
+	pthread_mutex_unlock(&source->mjpeg_mutex);
+
+	if (!obs_mjpeg_pool_push(&obs->data.mjpeg_pool, source, seq,
+				data, size, timestamp))
+		obs_source_mjpeg_decoded(source, seq, NULL);
+}
+
+struct source_frame *obs_source_mjpeg_allocframe(struct obs_source *source,
+		enum video_format format, uint32_t width, uint32_t height)
+{
+	struct source_frame *frame;
+
+	pthread_mutex_lock(&source->mjpeg_mutex);
+	frame = get_cached_frame(source, format, width, height);
+	pthread_mutex_unlock(&source->mjpeg_mutex);
+
+	return frame;
+}
+
+static void insert_mjpeg_result(struct obs_source *source, uint64_t seq,
+		struct source_frame *frame)
+{
+	struct mjpeg_result result = {seq, frame};
+	size_t              idx    = source->mjpeg_results.num;
+
+	while (idx > 0 && source->mjpeg_results.array[idx-1].seq > seq)
+		idx--;
+
+	da_insert(source->mjpeg_results, idx, &result);
+}
+
+/* frame is NULL if the frame couldn't be decoded, which still lets the
+ * frames after it through */
+void obs_source_mjpeg_decoded(struct obs_source *source, uint64_t seq,
+		struct source_frame *frame)
+{
+	pthread_mutex_lock(&source->mjpeg_mutex);
+
+	insert_mjpeg_result(source, seq, frame);
+
+	while (source->mjpeg_results.num) {
+		struct mjpeg_result result = source->mjpeg_results.array[0];
+
+		if (result.seq != source->mjpeg_next_output)
+			break;
+
+		da_erase(source->mjpeg_results, 0);
+		source->mjpeg_next_output++;
+		os_atomic_dec_long(&source->mjpeg_pending);
+
+		output_async_frame(source, result.frame);
+	}
+
+	pthread_mutex_unlock(&source->mjpeg_mutex);
+}
+
+static inline struct filtered_audio *filter_async_audio(obs_source_t source,
+		struct filtered_audio *in)
+{
+	size_t i;
+	for (i = source->filters.num; i > 0; i--) {
+		struct obs_source *filter = source->filters.array[i-1];
+		if (filter->info.filter_audio) {
+			in = filter->info.filter_audio(filter->context.data,
+					in);
+			if (!in)
+				return NULL;
+		}
+	}
+
+	return in;
+}
+
+static inline void reset_resampler(obs_source_t source,
+		const struct source_audio *audio)
+{
+	const struct audio_output_info *obs_info;
+	struct resample_info output_info;
+
+	obs_info = audio_output_getinfo(obs->audio.audio);
+
+	output_info.format           = obs_info->format;
+	output_info.samples_per_sec  = obs_info->samples_per_sec;
+	output_info.speakers         = obs_info->speakers;
+
+	source->sample_info.format          = audio->format;
+	source->sample_info.samples_per_sec = audio->samples_per_sec;
+	source->sample_info.speakers        = audio->speakers;
+
+	if (source->sample_info.samples_per_sec == obs_info->samples_per_sec &&
+	    source->sample_info.format          == obs_info->format          &&
+	    source->sample_info.speakers        == obs_info->speakers) {
+		source->audio_failed = false;
+		return;
+	}
+
+	audio_resampler_destroy(source->resampler);
+	source->resampler = audio_resampler_create(&output_info,
+			&source->sample_info);
+
+	source->audio_failed = source->resampler == NULL;
+	if (source->resampler == NULL)
+		blog(LOG_ERROR, "creation of resampler failed");
+}
+
+static inline void set_audio_data(obs_source_t source,
+		const uint8_t *const data[], uint32_t frames, uint64_t ts,
+		bool borrowed)
+{
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		source->audio_data.data[i] = (uint8_t*)data[i];
+
+	source->audio_data.frames    = frames;
+	source->audio_data.timestamp = ts;
+	source->audio_data_borrowed  = borrowed;
+}
+
+/* filters modify the data in place, which can't be done to the const data
+ * of the source itself, so that data is copied first */
+static void make_audio_data_writable(obs_source_t source)
+{
+	size_t planes    = audio_output_planes(obs->audio.audio);
+	size_t blocksize = audio_output_blocksize(obs->audio.audio);
+	size_t size      = (size_t)source->audio_data.frames * blocksize;
+
+	if (!source->audio_data_borrowed)
+		return;
+
+	if (source->audio_storage_size < size) {
+		size_t new_size = source->audio_storage_size * 2;
+		if (new_size < size)
+			new_size = size;
+
+		for (size_t i = 0; i < planes; i++) {
+			bfree(source->audio_storage[i]);
+			source->audio_storage[i] = bmalloc(new_size);
+		}
+
+		source->audio_storage_size = new_size;
+	}
+
+	for (size_t i = 0; i < planes; i++) {
+		memcpy(source->audio_storage[i], source->audio_data.data[i],
+				size);
+		source->audio_data.data[i] = source->audio_storage[i];
+	}
+
+	source->audio_data_borrowed = false;
+}
+
+static inline bool has_audio_filters(obs_source_t source)
+{
+	for (size_t i = 0; i < source->filters.num; i++)
+		if (source->filters.array[i]->info.filter_audio)
+			return true;
+	return false;
+}
+
+/* resamples/remixes new audio to the designated main audio output format.
+ * the output is not copied, the resampler's buffer stays valid until the
+ * next call */
+static bool process_audio(obs_source_t source, const struct source_audio *audio)
+{
+	if (source->sample_info.samples_per_sec != audio->samples_per_sec ||
+	    source->sample_info.format          != audio->format          ||
+	    source->sample_info.speakers        != audio->speakers)
+		reset_resampler(source, audio);
+
+	if (source->audio_failed)
+		return false;
+
+	if (source->resampler) {
+		uint8_t  *output[MAX_AV_PLANES];
+		uint32_t frames;
 		uint64_t offset;
 
 		memset(output, 0, sizeof(output));
 
-		audio_resampler_resample(source->resampler,
-				output, &frames, &offset,
-				audio->data, audio->frames);
+		if (!audio_resampler_resample(source->resampler,
+					output, &frames, &offset,
+					audio->data, audio->frames))
+			return false;
 
-		copy_audio_data(source, (const uint8_t *const *)output, frames,
-				audio->timestamp - offset);
+		set_audio_data(source, (const uint8_t *const *)output, frames,
+				audio->timestamp - offset, false);
 	} else {
-		copy_audio_data(source, audio->data, audio->frames,
-				audio->timestamp);
+		set_audio_data(source, audio->data, audio->frames,
+				audio->timestamp, true);
 	}
+
+	return true;
+}
+
+/* returns true if the source went from silent to audible or the other way
+ * around with this audio */
+static inline bool update_audio_active(obs_source_t source)
+{
+	bool active = audio_line_audible(source->audio_line);
+
+	if (active == source->audio_active)
+		return false;
+
+	source->audio_active = active;
+	return true;
 }
 
 void obs_source_output_audio(obs_source_t source,
@@ -1302,14 +2502,19 @@ void obs_source_output_audio(obs_source_t source,
 {
 	uint32_t flags;
 	struct filtered_audio *output;
+	bool active_changed = false;
 
 	if (!source || !audio)
 		return;
 
 	flags = source->info.output_flags;
-	process_audio(source, audio);
+	if (!process_audio(source, audio))
+		return;
 
 	pthread_mutex_lock(&source->filter_mutex);
+
+	if (has_audio_filters(source))
+		make_audio_data_writable(source);
 	output = filter_async_audio(source, &source->audio_data);
 
 	if (output) {
@@ -1328,12 +2533,23 @@ void obs_source_output_audio(obs_source_t source,
 			data.frames    = output->frames;
 			data.timestamp = output->timestamp;
 			source_output_audio_line(source, &data);
+
+			active_changed = update_audio_active(source);
 		}
 
 		pthread_mutex_unlock(&source->audio_mutex);
 	}
 
 	pthread_mutex_unlock(&source->filter_mutex);
+
+	if (active_changed) {
+		if (source->audio_active)
+			obs_source_dosignal(source, "source_audio_activate",
+					"audio_activate");
+		else
+			obs_source_dosignal(source, "source_audio_deactivate",
+					"audio_deactivate");
+	}
 }
 
 static inline bool frame_out_of_bounds(obs_source_t source, uint64_t ts)
@@ -1343,7 +2559,8 @@ static inline bool frame_out_of_bounds(obs_source_t source, uint64_t ts)
 
 static bool new_frame_ready(obs_source_t source, uint64_t sys_time)
 {
-	struct source_frame *next_frame = source->video_frames.array[0];
+	struct frame_ring   *frames     = &source->video_frames;
+	struct source_frame *next_frame = frame_ring_peek(frames, 0);
 	struct source_frame *frame      = NULL;
 	uint64_t sys_offset = sys_time - source->last_sys_timestamp;
 	uint64_t frame_time = next_frame->timestamp;
@@ -1359,14 +2576,16 @@ static bool new_frame_ready(obs_source_t source, uint64_t sys_time)
 	}
 
 	while (frame_offset <= sys_offset) {
-		source_frame_destroy(frame);
+		if (frame) {
+			recycle_frame(source, frame);
+			os_atomic_inc_long(&source->async_frames_dropped);
+		}
 
-		if (source->video_frames.num == 1)
+		if (frame_ring_count(frames) == 1)
 			return true;
 
-		frame = next_frame;
-		da_erase(source->video_frames, 0);
-		next_frame = source->video_frames.array[0];
+		frame = frame_ring_pop(frames);
+		next_frame = frame_ring_peek(frames, 0);
 
 		/* more timestamp checking and compensating */
 		if ((next_frame->timestamp - frame_time) > MAX_TIMESTAMP_JUMP) {
@@ -1379,21 +2598,63 @@ static bool new_frame_ready(obs_source_t source, uint64_t sys_time)
 		frame_offset = frame_time - source->last_frame_ts;
 	}
 
-	return frame != NULL;
+	if (frame) {
+		recycle_frame(source, frame);
+		os_atomic_inc_long(&source->async_frames_dropped);
+		return true;
+	}
+
+	return false;
 }
 
 static inline struct source_frame *get_closest_frame(obs_source_t source,
 		uint64_t sys_time)
 {
-	if (new_frame_ready(source, sys_time)) {
-		struct source_frame *frame = source->video_frames.array[0];
-		da_erase(source->video_frames, 0);
-		return frame;
-	}
+	if (new_frame_ready(source, sys_time))
+		return frame_ring_pop(&source->video_frames);
 
 	return NULL;
 }
 
+/* unbuffered sources always show the newest frame, everything queued before
+ * it is dropped */
+static struct source_frame *get_newest_frame(obs_source_t source)
+{
+	struct frame_ring *frames = &source->video_frames;
+
+	while (frame_ring_count(frames) > 1) {
+		recycle_frame(source, frame_ring_pop(frames));
+		os_atomic_inc_long(&source->async_frames_dropped);
+	}
+
+	return frame_ring_pop(frames);
+}
+
+/* suspended sources never display their frames, so they're handed straight
+ * back for reuse */
+static void drop_frames(struct obs_source *source)
+{
+	struct source_frame *frame;
+
+	while ((frame = frame_ring_pop(&source->video_frames)) != NULL)
+		recycle_frame(source, frame);
+}
+
+/* sources that aren't being displayed never request frames, so drop the
+ * frames that have already passed instead of letting the queue fill up */
+static void cycle_frames(struct obs_source *source)
+{
+	if (!frame_ring_count(&source->video_frames) || source->show_refs)
+		return;
+
+	if (source->async_unbuffered) {
+		recycle_frame(source, get_newest_frame(source));
+		os_atomic_inc_long(&source->async_frames_dropped);
+	} else {
+		new_frame_ready(source, os_gettime_ns());
+	}
+}
+
 /*
  * Ensures that cached frames are displayed on time.  If multiple frames
  * were cached between renders, then releases the unnecessary frames and uses
@@ -1408,17 +2669,16 @@ struct source_frame *obs_source_getframe(obs_source_t source)
 	if (!source)
 		return NULL;
 
-	pthread_mutex_lock(&source->video_mutex);
-
-	if (!source->video_frames.num)
-		goto unlock;
+	if (!frame_ring_count(&source->video_frames))
+		return NULL;
 
 	sys_time = os_gettime_ns();
 
-	if (!source->last_frame_ts) {
-		frame = source->video_frames.array[0];
-		da_erase(source->video_frames, 0);
-
+	if (source->async_unbuffered) {
+		frame = get_newest_frame(source);
+		source->last_frame_ts = frame->timestamp;
+	} else if (!source->last_frame_ts) {
+		frame = frame_ring_pop(&source->video_frames);
 		source->last_frame_ts = frame->timestamp;
 	} else {
 		frame = get_closest_frame(source, sys_time);
@@ -1428,23 +2688,18 @@ struct source_frame *obs_source_getframe(obs_source_t source)
 	if (frame) {
 		source->timing_adjust = sys_time - frame->timestamp;
 		source->timing_set = true;
+		obs_source_addref(source);
 	}
 
 	source->last_sys_timestamp = sys_time;
 
-unlock:
-	pthread_mutex_unlock(&source->video_mutex);
-
-	if (frame)
-		obs_source_addref(source);
-
 	return frame;
 }
 
 void obs_source_releaseframe(obs_source_t source, struct source_frame *frame)
 {
 	if (source && frame) {
-		source_frame_destroy(frame);
+		recycle_frame(source, frame);
 		obs_source_release(source);
 	}
 }
@@ -1456,8 +2711,35 @@ const char *obs_source_getname(obs_source_t source)
 
 void obs_source_setname(obs_source_t source, const char *name)
 {
+	char *old_name;
+
 	if (!source) return;
-	obs_context_data_setname(&source->context, name);
+
+	old_name = bstrdup(source->context.name);
+
+	pthread_mutex_lock(&obs->data.user_sources_mutex);
+
+	if (source->name_indexed) {
+		obs_source_index_remove(source);
+		obs_context_data_setname(&source->context, name);
+		obs_source_index_insert(source);
+	} else {
+		obs_context_data_setname(&source->context, name);
+	}
+
+	pthread_mutex_unlock(&obs->data.user_sources_mutex);
+
+	/* saved data is tracked by name, so a rename is stored as a removal of
+	 * the old name and a save of the source under the new one */
+	if (old_name && strcmp(old_name, source->context.name) != 0) {
+		pthread_mutex_lock(&obs->data.sources_mutex);
+		da_push_back(obs->data.removed_source_names, &old_name);
+		pthread_mutex_unlock(&obs->data.sources_mutex);
+
+		source->save_pending = true;
+	} else {
+		bfree(old_name);
+	}
 }
 
 void obs_source_gettype(obs_source_t source, enum obs_source_type *type,
@@ -1504,18 +2786,18 @@ static inline void render_filter_tex(texture_t tex, effect_t effect,
 	technique_end(tech);
 }
 
-void obs_source_process_filter(obs_source_t filter, effect_t effect,
-		uint32_t width, uint32_t height, enum gs_color_format format,
+static void process_filter(obs_source_t filter, obs_source_t target,
+		effect_t effect, uint32_t width, uint32_t height,
+		enum gs_color_format format,
 		enum allow_direct_render allow_direct)
 {
-	obs_source_t target, parent;
+	obs_source_t parent;
+	texrender_t  texrender;
+	gputimer_t   timer;
 	uint32_t     target_flags, parent_flags;
 	int          cx, cy;
 	bool         use_matrix, expects_def, can_directly;
 
-	if (!filter) return;
-
-	target       = obs_filter_gettarget(filter);
 	parent       = obs_filter_getparent(filter);
 	target_flags = target->info.output_flags;
 	parent_flags = parent->info.output_flags;
@@ -1530,27 +2812,227 @@ void obs_source_process_filter(obs_source_t filter, effect_t effect,
 	 * using the filter effect instead of rendering to texture to reduce
 	 * the total number of passes */
 	if (can_directly && expects_def && target == parent) {
+		timer = obs_gpu_timer_begin(GPU_SAMPLE_FILTER_PASS, 0, filter);
 		render_filter_bypass(target, effect, use_matrix);
+		obs_gpu_timer_end(timer);
 		return;
 	}
 
-	if (!filter->filter_texrender)
-		filter->filter_texrender = texrender_create(format,
-				GS_ZS_NONE);
+	/* the target is only needed until it's been drawn, so it's shared
+	 * with everything else that renders to one in this frame */
+	texrender = texrender_pool_acquire(format, cx, cy);
 
-	if (texrender_begin(filter->filter_texrender, cx, cy)) {
+	if (texrender_begin(texrender, cx, cy)) {
 		gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
 		if (expects_def && parent == target)
 			obs_source_default_render(parent, use_matrix);
 		else
 			obs_source_video_render(target);
-		texrender_end(filter->filter_texrender);
+		texrender_end(texrender);
 	}
 
 	/* --------------------------- */
 
-	render_filter_tex(texrender_gettexture(filter->filter_texrender),
-			effect, width, height, use_matrix);
+	timer = obs_gpu_timer_begin(GPU_SAMPLE_FILTER_PASS, 0, filter);
+	render_filter_tex(texrender_gettexture(texrender), effect, width,
+			height, use_matrix);
+	obs_gpu_timer_end(timer);
+
+	texrender_pool_release(texrender);
+}
+
+void obs_source_process_filter(obs_source_t filter, effect_t effect,
+		uint32_t width, uint32_t height, enum gs_color_format format,
+		enum allow_direct_render allow_direct)
+{
+	if (!filter) return;
+
+	process_filter(filter, obs_filter_gettarget(filter), effect,
+			width, height, format, allow_direct);
+}
+
+/* ------------------------------------------------------------------------- */
+/* pointwise filter fusion */
+
+#define MAX_FUSED_FILTERS 16
+
+static const char *fused_header =
+"uniform float4x4 ViewProj;\n"
+"uniform float4x4 color_matrix;\n"
+"uniform float3 color_range_min = {0.0, 0.0, 0.0};\n"
+"uniform float3 color_range_max = {1.0, 1.0, 1.0};\n"
+"uniform texture2d image;\n"
+"\n"
+"sampler_state def_sampler {\n"
+"	Filter   = Linear;\n"
+"	AddressU = Clamp;\n"
+"	AddressV = Clamp;\n"
+"};\n"
+"\n"
+"struct VertInOut {\n"
+"	float4 pos : POSITION;\n"
+"	float2 uv  : TEXCOORD0;\n"
+"};\n"
+"\n"
+"VertInOut VSDefault(VertInOut vert_in)\n"
+"{\n"
+"	VertInOut vert_out;\n"
+"	vert_out.pos = mul(float4(vert_in.pos.xyz, 1.0), ViewProj);\n"
+"	vert_out.uv  = vert_in.uv;\n"
+"	return vert_out;\n"
+"}\n"
+"\n";
+
+static const char *fused_footer =
+"float4 PSDrawBare(VertInOut vert_in) : TARGET\n"
+"{\n"
+"	return pointwise_process(image.Sample(def_sampler, vert_in.uv));\n"
+"}\n"
+"\n"
+"float4 PSDrawMatrix(VertInOut vert_in) : TARGET\n"
+"{\n"
+"	float4 yuv = image.Sample(def_sampler, vert_in.uv);\n"
+"	yuv.xyz = clamp(yuv.xyz, color_range_min, color_range_max);\n"
+"	return pointwise_process(\n"
+"		saturate(mul(float4(yuv.xyz, 1.0), color_matrix)));\n"
+"}\n"
+"\n"
+"technique Draw\n"
+"{\n"
+"	pass\n"
+"	{\n"
+"		vertex_shader = VSDefault(vert_in);\n"
+"		pixel_shader  = PSDrawBare(vert_in);\n"
+"	}\n"
+"}\n"
+"\n"
+"technique DrawMatrix\n"
+"{\n"
+"	pass\n"
+"	{\n"
+"		vertex_shader = VSDefault(vert_in);\n"
+"		pixel_shader  = PSDrawMatrix(vert_in);\n"
+"	}\n"
+"}\n";
+
+static inline const char *pointwise_shader(obs_source_t filter)
+{
+	if (!filter->filter_parent ||
+	    !filter->info.filter_pointwise_shader ||
+	    !filter->info.filter_pointwise_params)
+		return NULL;
+
+	return filter->info.filter_pointwise_shader(filter->context.data);
+}
+
+static inline void pointwise_prefix(char *prefix, size_t size, size_t idx)
+{
+	snprintf(prefix, size, "pointwise%u_", (unsigned int)idx);
+}
+
+static void build_fused_shader(struct dstr *shader, const char **code,
+		size_t num)
+{
+	struct dstr filter_code = {0};
+	char        prefix[32];
+	size_t      i;
+
+	dstr_copy(shader, fused_header);
+
+	for (i = 0; i < num; i++) {
+		pointwise_prefix(prefix, sizeof(prefix), i);
+
+		dstr_copy(&filter_code, code[i]);
+		dstr_replace(&filter_code, "$", prefix);
+		dstr_cat_dstr(shader, &filter_code);
+		dstr_cat(shader, "\n\n");
+	}
+
+	/* the run is stored from the top of the chain down, and the filter
+	 * closest to the source has to be applied first */
+	dstr_cat(shader, "float4 pointwise_process(float4 rgba)\n{\n");
+	for (i = num; i > 0; i--)
+		dstr_catf(shader, "\trgba = pointwise%u_process(rgba);\n",
+				(unsigned int)(i-1));
+	dstr_cat(shader, "\treturn rgba;\n}\n\n");
+
+	dstr_cat(shader, fused_footer);
+	dstr_free(&filter_code);
+}
+
+/* the combined effect is only rebuilt when the code changes.  code that
+ * failed to compile is remembered as well, so it isn't retried every frame */
+static effect_t get_fused_effect(obs_source_t filter, struct dstr *shader)
+{
+	char *errors = NULL;
+
+	if (filter->fused_shader.array &&
+	    dstr_cmp(&filter->fused_shader, shader->array) == 0)
+		return filter->fused_effect;
+
+	effect_destroy(filter->fused_effect);
+	filter->fused_effect = gs_create_effect(shader->array,
+			"pointwise filters", &errors);
+
+	if (!filter->fused_effect)
+		blog(LOG_WARNING, "Failed to combine the pointwise filters of "
+		                  "'%s', they will be drawn separately: %s",
+		                  filter->filter_parent->context.name,
+		                  errors ? errors : "(unknown error)");
+
+	bfree(errors);
+	dstr_move(&filter->fused_shader, shader);
+	return filter->fused_effect;
+}
+
+/*
+ * Draws filter and the consecutive pointwise filters below it as one pass
+ * with a combined effect, rendering what's below the run only once instead
+ * of once per filter.  Returns false if the filter should render itself.
+ */
+static bool render_pointwise_filters(obs_source_t filter)
+{
+	obs_source_t parent = filter->filter_parent;
+	obs_source_t target = filter;
+	obs_source_t run[MAX_FUSED_FILTERS];
+	const char   *code[MAX_FUSED_FILTERS];
+	struct dstr  shader = {0};
+	effect_t     effect;
+	char         prefix[32];
+	size_t       num = 0;
+
+	while (target != parent && num < MAX_FUSED_FILTERS) {
+		const char *target_code = pointwise_shader(target);
+		if (!target_code)
+			break;
+
+		run[num]    = target;
+		code[num++] = target_code;
+		target      = target->filter_target;
+	}
+
+	/* nothing to combine a lone filter with */
+	if (num < 2)
+		return false;
+
+	build_fused_shader(&shader, code, num);
+	effect = get_fused_effect(filter, &shader);
+	dstr_free(&shader);
+
+	if (!effect)
+		return false;
+
+	for (size_t i = 0; i < num; i++) {
+		pointwise_prefix(prefix, sizeof(prefix), i);
+		run[i]->info.filter_pointwise_params(run[i]->context.data,
+				effect, prefix);
+	}
+
+	process_filter(filter, target, effect,
+			obs_source_getwidth(target),
+			obs_source_getheight(target),
+			GS_RGBA, ALLOW_DIRECT_RENDERING);
+	return true;
 }
 
 signal_handler_t obs_source_signalhandler(obs_source_t source)
@@ -1566,7 +3048,9 @@ proc_handler_t obs_source_prochandler(obs_source_t source)
 void obs_source_setvolume(obs_source_t source, float volume)
 {
 	if (source) {
-		struct calldata data = {0};
+		uint8_t stack[CALLDATA_FIXED_SIZE];
+		struct calldata data;
+		calldata_init_fixed(&data, stack, sizeof(stack));
 		calldata_setptr(&data, "source", source);
 		calldata_setfloat(&data, "volume", volume);
 
@@ -1624,33 +3108,97 @@ int64_t obs_source_get_sync_offset(obs_source_t source)
 	return source ? source->sync_offset : 0;
 }
 
-struct source_enum_data {
-	obs_source_enum_proc_t enum_callback;
-	void *param;
-};
+void obs_source_set_deinterlace_mode(obs_source_t source,
+		enum obs_deinterlace_mode mode)
+{
+	if (!source)
+		return;
 
-static void enum_source_tree_callback(obs_source_t parent, obs_source_t child,
-		void *param)
+	source->deinterlace_mode  = mode;
+	source->deinterlace_dirty = true;
+}
+
+void obs_source_set_render_cache_mode(obs_source_t source,
+		enum obs_render_cache_mode mode)
 {
-	struct source_enum_data *data = param;
+	if (source)
+		source->render_cache_mode = mode;
+}
 
-	if (child->info.enum_sources && !child->enum_refs) {
-		os_atomic_inc_long(&child->enum_refs);
+enum obs_render_cache_mode obs_source_get_render_cache_mode(
+		obs_source_t source)
+{
+	return source ? source->render_cache_mode : OBS_RENDER_CACHE_AUTO;
+}
 
-		child->info.enum_sources(child->context.data,
-				enum_source_tree_callback, data);
+bool obs_source_audio_active(obs_source_t source)
+{
+	return source ? source->audio_active : false;
+}
 
-		os_atomic_dec_long(&child->enum_refs);
-	}
+bool obs_source_get_audio_levels(obs_source_t source,
+		struct audio_levels *levels)
+{
+	return source ? audio_line_get_levels(source->audio_line, levels) :
+		false;
+}
 
-	data->enum_callback(parent, child, data->param);
+void obs_source_set_async_unbuffered(obs_source_t source, bool unbuffered)
+{
+	if (source)
+		source->async_unbuffered = unbuffered;
+}
+
+bool obs_source_async_unbuffered(obs_source_t source)
+{
+	return source ? source->async_unbuffered : false;
+}
+
+enum obs_deinterlace_mode obs_source_get_deinterlace_mode(
+		obs_source_t source)
+{
+	return source ? source->deinterlace_mode :
+		OBS_DEINTERLACE_MODE_DISABLE;
+}
+
+void obs_source_set_deinterlace_field_order(obs_source_t source,
+		enum obs_deinterlace_field_order field_order)
+{
+	if (!source)
+		return;
+
+	source->deinterlace_field_order = field_order;
+	source->deinterlace_dirty       = true;
+}
+
+enum obs_deinterlace_field_order obs_source_get_deinterlace_field_order(
+		obs_source_t source)
+{
+	return source ? source->deinterlace_field_order :
+		OBS_DEINTERLACE_FIELD_ORDER_TOP;
+}
+
+void obs_source_set_audio_mixers(obs_source_t source, uint32_t mixers)
+{
+	if (!source || source->audio_mixers == mixers)
+		return;
+
+	source->audio_mixers = mixers;
+	source->save_pending = true;
+	audio_line_set_mixers(source->audio_line, mixers);
+}
+
+uint32_t obs_source_get_audio_mixers(obs_source_t source)
+{
+	return source ? source->audio_mixers : 0;
 }
 
 void obs_source_enum_sources(obs_source_t source,
 		obs_source_enum_proc_t enum_callback,
 		void *param)
 {
-	if (!source || !source->info.enum_sources || source->enum_refs)
+	if (!source || !source->info.enum_sources || source->enum_refs ||
+	    !source_created(source))
 		return;
 
 	obs_source_addref(source);
@@ -1662,23 +3210,115 @@ void obs_source_enum_sources(obs_source_t source,
 	obs_source_release(source);
 }
 
+static void build_tree_callback(obs_source_t parent, obs_source_t child,
+		void *param)
+{
+	struct darray *tree = param;
+	struct source_tree_entry entry = {parent, child, tree->num};
+
+	if (child->info.enum_sources && !child->enum_refs &&
+	    source_created(child)) {
+		os_atomic_inc_long(&child->enum_refs);
+
+		child->info.enum_sources(child->context.data,
+				build_tree_callback, param);
+
+		os_atomic_dec_long(&child->enum_refs);
+	}
+
+	obs_source_addref(child);
+	darray_push_back(sizeof(struct source_tree_entry), param, &entry);
+}
+
+static inline void addref_tree(struct darray *tree)
+{
+	struct source_tree_entry *entries = tree->array;
+
+	for (size_t i = 0; i < tree->num; i++)
+		obs_source_addref(entries[i].child);
+}
+
+static inline void release_tree(struct darray *tree)
+{
+	struct source_tree_entry *entries = tree->array;
+
+	for (size_t i = 0; i < tree->num; i++)
+		obs_source_release(entries[i].child);
+	darray_free(tree);
+}
+
+/*
+ * Gets the descendants of a source in enumeration order, with a reference
+ * held on each of them.  The list is cached on the source and only rebuilt
+ * through enum_sources when a child was added or removed somewhere since.
+ * Children are only released after the revision has been bumped, so a cached
+ * list that's still current never points to a destroyed source.
+ */
+static void get_source_tree(obs_source_t source, struct darray *tree)
+{
+	struct obs_core_data *data = &obs->data;
+	long revision;
+
+	pthread_mutex_lock(&data->tree_mutex);
+	revision = data->tree_revision;
+
+	if (source->tree_valid && source->tree_revision == revision) {
+		darray_copy(sizeof(struct source_tree_entry), tree,
+				&source->tree.da);
+		addref_tree(tree);
+		pthread_mutex_unlock(&data->tree_mutex);
+		return;
+	}
+
+	pthread_mutex_unlock(&data->tree_mutex);
+
+	source->info.enum_sources(source->context.data, build_tree_callback,
+			tree);
+
+	pthread_mutex_lock(&data->tree_mutex);
+
+	if (data->tree_revision == revision) {
+		darray_copy(sizeof(struct source_tree_entry),
+				&source->tree.da, tree);
+		source->tree_revision = revision;
+		source->tree_valid    = true;
+	}
+
+	pthread_mutex_unlock(&data->tree_mutex);
+}
+
+void obs_source_invalidate_trees(void)
+{
+	pthread_mutex_lock(&obs->data.tree_mutex);
+	obs->data.tree_revision++;
+	pthread_mutex_unlock(&obs->data.tree_mutex);
+}
+
 void obs_source_enum_tree(obs_source_t source,
 		obs_source_enum_proc_t enum_callback,
 		void *param)
 {
-	struct source_enum_data data = {enum_callback, param};
+	struct source_tree_entry *entries;
+	struct darray tree;
 
-	if (!source || !source->info.enum_sources || source->enum_refs)
+	if (!source || !source->info.enum_sources || source->enum_refs ||
+	    !source_created(source))
 		return;
 
 	obs_source_addref(source);
+	darray_init(&tree);
 
 	os_atomic_inc_long(&source->enum_refs);
-	source->info.enum_sources(source->context.data,
-			enum_source_tree_callback,
-			&data);
+
+	get_source_tree(source, &tree);
+
+	entries = tree.array;
+	for (size_t i = 0; i < tree.num; i++)
+		enum_callback(entries[i].parent, entries[i].child, param);
+
 	os_atomic_dec_long(&source->enum_refs);
 
+	release_tree(&tree);
 	obs_source_release(source);
 }
 
@@ -1686,6 +3326,8 @@ void obs_source_add_child(obs_source_t parent, obs_source_t child)
 {
 	if (!parent || !child) return;
 
+	obs_source_invalidate_trees();
+
 	for (int i = 0; i < parent->show_refs; i++) {
 		enum view_type type;
 		type = (i < parent->activate_refs) ? MAIN_VIEW : AUX_VIEW;
@@ -1697,6 +3339,8 @@ void obs_source_remove_child(obs_source_t parent, obs_source_t child)
 {
 	if (!parent || !child) return;
 
+	obs_source_invalidate_trees();
+
 	for (int i = 0; i < parent->show_refs; i++) {
 		enum view_type type;
 		type = (i < parent->activate_refs) ? MAIN_VIEW : AUX_VIEW;
@@ -1731,10 +3375,32 @@ static void apply_transition_vol(obs_source_t parent, obs_source_t child,
 	UNUSED_PARAMETER(param);
 }
 
+/*
+ * The tree of the transition is fetched once in begin_frame and kept until
+ * end_frame, so the volumes of children can be set from ranges of that list
+ * instead of walking the tree of each child again.
+ */
 void obs_transition_begin_frame(obs_source_t transition)
 {
+	struct source_tree_entry *entries;
+	struct darray            *tree;
+
 	if (!transition) return;
-	obs_source_enum_tree(transition, reset_transition_vol, NULL);
+
+	tree = &transition->transition_tree;
+	release_tree(tree);
+
+	if (!transition->info.enum_sources || transition->enum_refs ||
+	    !source_created(transition))
+		return;
+
+	os_atomic_inc_long(&transition->enum_refs);
+	get_source_tree(transition, tree);
+	os_atomic_dec_long(&transition->enum_refs);
+
+	entries = tree->array;
+	for (size_t i = 0; i < tree->num; i++)
+		entries[i].child->transition_volume = 0.0f;
 }
 
 void obs_source_set_transition_vol(obs_source_t source, float vol)
@@ -1745,20 +3411,152 @@ void obs_source_set_transition_vol(obs_source_t source, float vol)
 	obs_source_enum_tree(source, add_transition_vol, &vol);
 }
 
+void obs_transition_set_child_vol(obs_source_t transition,
+		obs_source_t child, float vol)
+{
+	struct source_tree_entry *entries;
+	struct darray            *tree;
+
+	if (!transition || !child) return;
+
+	tree    = &transition->transition_tree;
+	entries = tree->array;
+
+	for (size_t i = 0; i < tree->num; i++) {
+		if (entries[i].parent != transition ||
+		    entries[i].child  != child)
+			continue;
+
+		for (size_t j = entries[i].first; j <= i; j++)
+			entries[j].child->transition_volume += vol;
+		return;
+	}
+
+	/* not a direct child of the transition */
+	obs_source_set_transition_vol(child, vol);
+}
+
 void obs_transition_end_frame(obs_source_t transition)
 {
+	struct source_tree_entry *entries;
+	struct darray            *tree;
+
 	if (!transition) return;
-	obs_source_enum_tree(transition, apply_transition_vol, NULL);
+
+	tree    = &transition->transition_tree;
+	entries = tree->array;
+
+	for (size_t i = 0; i < tree->num; i++)
+		apply_transition_vol(entries[i].parent, entries[i].child, NULL);
+
+	release_tree(tree);
+}
+
+void obs_transition_freeze(obs_source_t transition, obs_source_t child)
+{
+	if (!transition || transition->frozen_child == child) return;
+
+	obs_source_addref(child);
+	obs_source_release(transition->frozen_child);
+	transition->frozen_child = child;
+	transition->freeze_valid = false;
+}
+
+void obs_transition_unfreeze(obs_source_t transition)
+{
+	if (!transition) return;
+
+	obs_source_release(transition->frozen_child);
+	transition->frozen_child = NULL;
+	transition->freeze_valid = false;
+}
+
+/* renders the child in to the freeze texture the first time it's drawn, or
+ * again if its size changes */
+static bool update_freeze(obs_source_t transition, obs_source_t child,
+		uint32_t cx, uint32_t cy)
+{
+	struct vec4 clear_color;
+
+	if (transition->freeze_valid && transition->freeze_cx == cx &&
+	    transition->freeze_cy == cy)
+		return true;
+
+	if (!transition->freeze_texrender)
+		transition->freeze_texrender =
+			texrender_create(GS_RGBA, GS_ZS_NONE);
+
+	texrender_reset(transition->freeze_texrender);
+	if (!texrender_begin(transition->freeze_texrender, cx, cy))
+		return false;
+
+	vec4_zero(&clear_color);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 1.0f, 0);
+	gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+
+	gs_blend_state_push();
+	gs_enable_blending(true);
+	obs_set_cache_blend();
+
+	obs_source_video_render(child);
+
+	gs_blend_state_pop();
+	texrender_end(transition->freeze_texrender);
+
+	transition->freeze_valid = true;
+	transition->freeze_cx    = cx;
+	transition->freeze_cy    = cy;
+	return true;
+}
+
+void obs_transition_render_child(obs_source_t transition, obs_source_t child)
+{
+	uint32_t  cx, cy;
+	texture_t tex;
+
+	if (!transition || !child) return;
+
+	if (child != transition->frozen_child) {
+		obs_source_video_render(child);
+		return;
+	}
+
+	cx = obs_source_getwidth(child);
+	cy = obs_source_getheight(child);
+
+	if (!cx || !cy || !update_freeze(transition, child, cx, cy)) {
+		obs_source_video_render(child);
+		return;
+	}
+
+	tex = texrender_gettexture(transition->freeze_texrender);
+	if (tex)
+		obs_draw_cache_texture(tex, cx, cy);
 }
 
 void obs_source_save(obs_source_t source)
 {
-	if (!source || !source->info.save) return;
+	if (!source || !source->info.save || !source_created(source)) return;
 	source->info.save(source->context.data, source->context.settings);
+	publish_settings_snapshot(source);
 }
 
 void obs_source_load(obs_source_t source)
 {
 	if (!source || !source->info.load) return;
+
+	/* loaded once it's created */
+	if (!source_created(source)) {
+		bool pending;
+
+		pthread_mutex_lock(&source->create_mutex);
+		pending = !source_created(source);
+		source->load_pending = pending;
+		pthread_mutex_unlock(&source->create_mutex);
+
+		if (pending)
+			return;
+	}
+
 	source->info.load(source->context.data, source->context.settings);
 }
@@ -88,6 +88,58 @@ enum obs_source_type {
  */
 #define OBS_SOURCE_COLOR_MATRIX (1<<4)
 
+/**
+ * Source video_tick is thread-safe and does not use the graphics subsystem.
+ *
+ * When this is specified, video_tick may be called from a worker thread
+ * concurrently with the ticks of other sources.  Sources without this flag
+ * are always ticked on the video thread, after the threaded ticks have been
+ * dispatched.  The source list isn't locked during threaded ticks, so they
+ * can create and release sources as well.
+ */
+#define OBS_SOURCE_THREADED_TICK (1<<5)
+
+/**
+ * Source video only changes when its settings are updated.
+ *
+ * This allows the rendered output of the source to be cached (for example
+ * by cached scenes).  If the output changes for any other reason (such as
+ * a file being reloaded), call obs_source_content_changed.  Filters can use
+ * this flag as well.
+ */
+#define OBS_SOURCE_STATIC_VIDEO (1<<6)
+
+/**
+ * Filter's filter_video callback is expensive (deinterlacing, denoising).
+ *
+ * Once a filter with this flag is added to a source, the source's async
+ * frames are queued and its filters run on the job system, one frame at a
+ * time in order, so the thread outputting the frames is never held up.  If
+ * the filters fall behind, the oldest queued frames are dropped.
+ */
+#define OBS_SOURCE_THREADED_FILTER_VIDEO (1<<7)
+
+/**
+ * Source create callback is thread-safe.
+ *
+ * When this is specified, sources of this type may be created on worker
+ * threads concurrently with other sources when a scene collection is loaded
+ * with obs_load_sources, so opening their devices or files doesn't hold up
+ * the rest of the collection.  The graphics subsystem can still be used
+ * within obs_enter_graphics/obs_leave_graphics.
+ */
+#define OBS_SOURCE_THREADED_CREATE (1<<8)
+
+/**
+ * Source is only created once it's needed.
+ *
+ * When this is specified, creating an input source only stores its settings,
+ * and the create callback is called the first time the source is shown
+ * (including when it's preloaded).  Until then its updates only change the
+ * stored settings, it has no size, and nothing is rendered for it.
+ */
+#define OBS_SOURCE_DEFERRED_CREATE (1<<9)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t parent, obs_source_t child,
@@ -252,6 +304,10 @@ struct obs_source_info {
 	 * Called to enumerate all sources being used within this source.
 	 * If the source has children it must implement this callback.
 	 *
+	 * The source tree is cached by libobs, so the set of enumerated
+	 * children must only change along with calls to obs_source_add_child
+	 * and obs_source_remove_child.
+	 *
 	 * @param  data           Source data
 	 * @param  enum_callback  Enumeration callback
 	 * @param  param          User data to pass to callback
@@ -280,6 +336,57 @@ struct obs_source_info {
 	 * @param  settings  Settings
 	 */
 	void (*load)(void *data, obs_data_t settings);
+
+	/**
+	 * (Optional) Returns the effect code of a pointwise filter, a filter
+	 * whose output pixel only depends on the same pixel of its input.
+	 * Consecutive pointwise filters of a source are combined in to a
+	 * single pixel shader and drawn in one pass, in which case their
+	 * video_render callbacks are not called.
+	 *
+	 * The code must define a function with the signature
+	 * "float4 $process(float4 rgba)", and every name it declares
+	 * (functions, uniforms, constants) must start with '$', which is
+	 * replaced with a prefix unique to the filter.  The returned string
+	 * should not change unless the filter's code really changes, because
+	 * the combined effect is rebuilt whenever it does.
+	 *
+	 * @note           This function is only used with filter sources.
+	 *
+	 * @param  data    Filter data
+	 * @return         Effect code, or NULL to not be combined
+	 */
+	const char *(*filter_pointwise_shader)(void *data);
+
+	/**
+	 * Sets the parameters of the code returned by filter_pointwise_shader
+	 * on the combined effect.  Required with filter_pointwise_shader.
+	 *
+	 * @param  data    Filter data
+	 * @param  effect  The combined effect
+	 * @param  prefix  What '$' was replaced with; parameter names must be
+	 *                 looked up with it
+	 */
+	void (*filter_pointwise_params)(void *data, effect_t effect,
+			const char *prefix);
+
+	/**
+	 * (Optional) Called from the video thread when an input source that
+	 * hasn't been shown for a while has its GPU resources released to
+	 * stay within the budget set with obs_set_suspend_memory_budget.
+	 * Release whatever GPU resources can be recreated in resume.
+	 *
+	 * @param  data  Source data
+	 */
+	void (*suspend)(void *data);
+
+	/**
+	 * (Optional) Called from the video thread once a source whose suspend
+	 * callback was called is shown again, before it's ticked.
+	 *
+	 * @param  data  Source data
+	 */
+	void (*resume)(void *data);
 };
 
 EXPORT void obs_register_source_s(const struct obs_source_info *info,
@@ -17,13 +17,102 @@
 
 #include "obs.h"
 #include "obs-internal.h"
+#include "util/platform.h"
+#include "graphics/vec2.h"
 #include "graphics/vec4.h"
 #include "media-io/format-conversion.h"
 
+static void run_tick_jobs(struct obs_tick_pool *pool)
+{
+	long num = (long)pool->sources.num;
+	long idx;
+
+	while ((idx = os_atomic_inc_long(&pool->next_source) - 1) < num)
+		obs_source_video_tick(pool->sources.array[idx], pool->seconds);
+}
+
+static void tick_job(void *param)
+{
+	run_tick_jobs(param);
+}
+
+/* hands out the thread-safe ticks to the job system, due by the next frame.
+ * called with sources_mutex held, the sources are referenced so they can be
+ * ticked after it's been released */
+static void start_threaded_ticks(struct obs_tick_pool *pool, float seconds,
+		uint64_t deadline)
+{
+	job_system_t js = obs->jobs;
+	size_t       num_jobs;
+
+	da_resize(pool->sources, 0);
+	for (size_t i = 0; i < obs->data.threaded_tick_sources.num; i++) {
+		struct obs_source *source =
+			obs->data.threaded_tick_sources.array[i];
+		if (obs_source_try_addref(source))
+			da_push_back(pool->sources, &source);
+	}
+
+	/* the video thread takes part as well, so don't bother queueing
+	 * jobs that would have nothing to do */
+	num_jobs = pool->sources.num ? pool->sources.num - 1 : 0;
+	if (num_jobs > job_system_threads(js))
+		num_jobs = job_system_threads(js);
+	if (num_jobs > MAX_TICK_JOBS)
+		num_jobs = MAX_TICK_JOBS;
+
+	pool->seconds     = seconds;
+	pool->next_source = 0;
+	pool->num_jobs    = num_jobs;
+
+	for (size_t i = 0; i < num_jobs; i++) {
+		pool->jobs[i] = job_create(js, tick_job, pool,
+				JOB_PRIORITY_HIGH);
+		job_set_deadline(pool->jobs[i], deadline);
+		job_submit(pool->jobs[i]);
+	}
+}
+
+/* ticks can create or destroy sources, so the list is re-read each time */
+static inline void tick_source_list(struct darray *list, float seconds)
+{
+	for (size_t i = 0; i < list->num; i++) {
+		struct obs_source *source = ((struct obs_source**)list->array)[i];
+		if (source->refs)
+			obs_source_video_tick(source, seconds);
+	}
+}
+
+/* done before the ticks are started, so the workers see the same state */
+static inline void update_suspended(struct darray *list)
+{
+	for (size_t i = 0; i < list->num; i++)
+		obs_source_update_suspended(
+				((struct obs_source**)list->array)[i]);
+}
+
+static void finish_threaded_ticks(struct obs_tick_pool *pool)
+{
+	run_tick_jobs(pool);
+
+	/* jobs that haven't started have nothing left to tick */
+	for (size_t i = 0; i < pool->num_jobs; i++) {
+		if (!job_cancel(pool->jobs[i]))
+			job_wait(pool->jobs[i]);
+		job_release(pool->jobs[i]);
+	}
+
+	pool->num_jobs = 0;
+
+	for (size_t i = 0; i < pool->sources.num; i++)
+		obs_source_release(pool->sources.array[i]);
+	da_resize(pool->sources, 0);
+}
+
 static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 {
 	struct obs_core_data *data = &obs->data;
-	struct obs_source    *source;
+	struct obs_tick_pool *pool = &obs->video.tick_pool;
 	uint64_t             delta_time;
 	float                seconds;
 
@@ -34,30 +123,69 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 
 	pthread_mutex_lock(&data->sources_mutex);
 
-	source = data->first_source;
-	while (source) {
-		if (source->refs)
-			obs_source_video_tick(source, seconds);
-		source = (struct obs_source*)source->context.next;
-	}
+	update_suspended(&data->tick_sources.da);
+	update_suspended(&data->threaded_tick_sources.da);
+	obs_release_suspended_resources();
+
+	start_threaded_ticks(pool, seconds,
+			cur_time + video_getframetime(obs->video.video));
 
+	/* sources that aren't thread-safe or need the graphics context tick
+	 * here while the jobs process the rest */
+	tick_source_list(&data->tick_sources.da, seconds);
+
+	/* threaded ticks can create and destroy sources too, which takes
+	 * sources_mutex, so it isn't held while waiting for them */
 	pthread_mutex_unlock(&data->sources_mutex);
 
+	finish_threaded_ticks(pool);
+
 	return cur_time;
 }
 
 /* in obs-display.c */
 extern void render_display(struct obs_display *display);
 
+/* while the pipeline is idle, displays are still redrawn now and then so a
+ * window that gets uncovered doesn't stay blank */
+#define IDLE_PREVIEW_INTERVAL_NS 1000000000ULL
+
+/* preview frames are scheduled on output frame times, so half a frame of
+ * slack keeps rounding from skipping every other one */
+static inline bool preview_due(uint64_t cur_time)
+{
+	struct obs_core_video *video = &obs->video;
+	uint64_t interval = video->preview_interval_ns;
+	uint64_t slack    = video_getframetime(video->video) / 2;
+
+	if (video->idle && interval < IDLE_PREVIEW_INTERVAL_NS)
+		interval = IDLE_PREVIEW_INTERVAL_NS;
+
+	if (!interval)
+		return true;
+	if (cur_time + slack < video->next_preview_ns)
+		return false;
+
+	video->next_preview_ns += interval;
+	if (video->next_preview_ns <= cur_time)
+		video->next_preview_ns = cur_time + interval;
+
+	return true;
+}
+
 static inline void render_displays(void)
 {
 	struct obs_display *display;
+	gputimer_t         timer;
 
 	if (!obs->data.valid)
 		return;
 
 	gs_entercontext(obs_graphics());
 
+	timer = obs_gpu_timer_begin(GPU_SAMPLE_STAGE, OBS_GPU_STAGE_DISPLAYS,
+			NULL);
+
 	/* render extra displays/swaps */
 	pthread_mutex_lock(&obs->data.displays_mutex);
 
@@ -70,7 +198,10 @@ static inline void render_displays(void)
 	pthread_mutex_unlock(&obs->data.displays_mutex);
 
 	/* render main display */
-	render_display(&obs->video.main_display);
+	if (obs->video.preview_enabled && !obs->video.headless)
+		render_display(&obs->video.main_display);
+
+	obs_gpu_timer_end(timer);
 
 	gs_leavecontext();
 }
@@ -85,20 +216,97 @@ static inline void set_render_size(uint32_t width, uint32_t height)
 	gs_setviewport(0, 0, width, height);
 }
 
+bool obs_map_conversion_planes(stagesurf_t *surfaces, size_t num_planes,
+		struct video_data *frame)
+{
+	for (size_t i = 0; i < num_planes; i++) {
+		if (!stagesurface_map(surfaces[i], &frame->data[i],
+					&frame->linesize[i])) {
+			while (i > 0)
+				stagesurface_unmap(surfaces[--i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void obs_unmap_conversion_planes(stagesurf_t *surfaces)
+{
+	if (!surfaces)
+		return;
+
+	for (size_t i = 0; i < MAX_CONVERSION_PLANES && surfaces[i]; i++)
+		stagesurface_unmap(surfaces[i]);
+}
+
+static inline void stage_planes(stagesurf_t *surfaces, texture_t *textures,
+		size_t num_planes)
+{
+	for (size_t i = 0; i < num_planes; i++)
+		gs_stage_texture(surfaces[i], textures[i]);
+}
+
+static inline size_t num_stage_planes(struct obs_core_video *video)
+{
+	return video->gpu_conversion ? video->conversion.num_planes : 1;
+}
+
 static inline void unmap_last_surface(struct obs_core_video *video)
 {
-	if (video->mapped_surface) {
-		stagesurface_unmap(video->mapped_surface);
-		video->mapped_surface = NULL;
+	obs_unmap_conversion_planes(video->mapped_surfaces);
+	video->mapped_surfaces = NULL;
+}
+
+/* the main view is only known to be unchanged if every source in it has a
+ * content revision, and none of them changed */
+static bool main_view_unchanged(struct obs_core_video *video)
+{
+	uint64_t revision;
+	bool     valid;
+	bool     unchanged;
+
+	valid     = obs_view_get_content_revision(&obs->data.main_view,
+			&revision);
+	unchanged = valid && video->view_revision_valid &&
+		video->view_revision == revision;
+
+	video->view_revision_valid = valid;
+	video->view_revision       = revision;
+	return unchanged;
+}
+
+/* in efficiency mode, the pipeline stops once every texture and staging
+ * surface in it holds the same frame and the last copy has been downloaded.
+ * the video output then repeats that frame, and gpu encoders keep getting
+ * the last output texture */
+static bool pipeline_idle(struct obs_core_video *video, bool unchanged)
+{
+	uint32_t depth = (uint32_t)(video->num_textures +
+			video->num_stage_surfaces);
+
+	if (!unchanged) {
+		video->unchanged_frames = 0;
+		return false;
 	}
+
+	if (video->unchanged_frames <= depth)
+		video->unchanged_frames++;
+
+	/* scaled outputs have their own rings, which aren't tracked */
+	return video->efficiency_mode && !video->scaled_outputs.num &&
+		video->unchanged_frames > depth && !video->stage_pending;
 }
 
 static inline void render_main_texture(struct obs_core_video *video,
-		int cur_texture)
+		int cur_texture, bool unchanged, uint64_t timestamp)
 {
 	struct vec4 clear_color;
 	vec4_set(&clear_color, 0.0f, 0.0f, 0.0f, 1.0f);
 
+	video->rendered_unchanged[cur_texture]  = unchanged;
+	video->rendered_timestamps[cur_texture] = timestamp;
+
 	gs_setrendertarget(video->render_textures[cur_texture], NULL);
 	gs_clear(GS_CLEAR_COLOR, &clear_color, 1.0f, 0);
 
@@ -108,37 +316,42 @@ static inline void render_main_texture(struct obs_core_video *video,
 	video->textures_rendered[cur_texture] = true;
 }
 
-static inline void render_output_texture(struct obs_core_video *video,
-		int cur_texture, int prev_texture)
+/* TODO: replace with programmable code */
+static const float yuv_mat_val[16] =
+{
+	-0.100644f, -0.338572f,  0.439216f,  0.501961f,
+	 0.182586f,  0.614231f,  0.062007f,  0.062745f,
+	 0.439216f, -0.398942f, -0.040274f,  0.501961f,
+	 0.000000f,  0.000000f,  0.000000f,  1.000000f
+};
+
+/* draws the texture in to the target at the target's size, converting it to
+ * packed yuv */
+static void render_yuv_texture(effect_t effect, texture_t texture,
+		texture_t target)
 {
-	texture_t   texture = video->render_textures[prev_texture];
-	texture_t   target  = video->output_textures[cur_texture];
 	uint32_t    width   = texture_getwidth(target);
 	uint32_t    height  = texture_getheight(target);
-
-	/* TODO: replace with actual downscalers or unpackers */
-	effect_t    effect  = video->default_effect;
 	technique_t tech    = effect_gettechnique(effect, "DrawMatrix");
 	eparam_t    image   = effect_getparambyname(effect, "image");
 	eparam_t    matrix  = effect_getparambyname(effect, "color_matrix");
+	eparam_t    dim_i   = effect_getparambyname(effect,
+			"base_dimension_i");
 	size_t      passes, i;
 
-	if (!video->textures_rendered[prev_texture])
-		return;
-
 	gs_setrendertarget(target, NULL);
 	set_render_size(width, height);
 
-	/* TODO: replace with programmable code */
-	const float mat_val[16] =
-	{
-		-0.100644f, -0.338572f,  0.439216f,  0.501961f,
-		 0.182586f,  0.614231f,  0.062007f,  0.062745f,
-		 0.439216f, -0.398942f, -0.040274f,  0.501961f,
-		 0.000000f,  0.000000f,  0.000000f,  1.000000f
-	};
+	/* only the scale effects sample neighboring texels */
+	if (dim_i) {
+		struct vec2 base_i;
+		vec2_set(&base_i,
+				1.0f / (float)texture_getwidth(texture),
+				1.0f / (float)texture_getheight(texture));
+		effect_setvec2(effect, dim_i, &base_i);
+	}
 
-	effect_setval(effect, matrix, mat_val, sizeof(mat_val));
+	effect_setval(effect, matrix, yuv_mat_val, sizeof(yuv_mat_val));
 	effect_settexture(effect, image, texture);
 
 	passes = technique_begin(tech);
@@ -148,204 +361,535 @@ static inline void render_output_texture(struct obs_core_video *video,
 		technique_endpass(tech);
 	}
 	technique_end(tech);
-
-	video->textures_output[cur_texture] = true;
 }
 
-static inline void set_eparam(effect_t effect, const char *name, float val)
+/* each level halves the previous one.  bilinear sampling in the middle of
+ * every 2x2 block averages it, so the chain is a box filter */
+static texture_t render_downscale_chain(struct obs_core_video *video,
+		texture_t texture)
 {
-	eparam_t param = effect_getparambyname(effect, name);
-	effect_setfloat(effect, param, val);
+	effect_t    effect = video->default_effect;
+	technique_t tech   = effect_gettechnique(effect, "Draw");
+	eparam_t    image  = effect_getparambyname(effect, "image");
+
+	for (size_t i = 0; i < video->num_downscale_levels; i++) {
+		texture_t target = video->downscale_textures[i];
+		uint32_t  width  = texture_getwidth(target);
+		uint32_t  height = texture_getheight(target);
+		size_t    passes;
+
+		gs_setrendertarget(target, NULL);
+		set_render_size(width, height);
+		effect_settexture(effect, image, texture);
+
+		passes = technique_begin(tech);
+		for (size_t j = 0; j < passes; j++) {
+			technique_beginpass(tech, j);
+			gs_draw_sprite(texture, 0, width, height);
+			technique_endpass(tech);
+		}
+		technique_end(tech);
+
+		texture = target;
+	}
+
+	return texture;
 }
 
-static void render_convert_texture(struct obs_core_video *video,
-		int cur_texture, int prev_texture)
+/* scales along one axis with the kernel widened by the downscale ratio,
+ * which the downscale chain keeps below 2 */
+static void render_separable_pass(effect_t effect, texture_t texture,
+		texture_t target, bool vertical)
 {
-	texture_t   texture = video->output_textures[prev_texture];
-	texture_t   target  = video->convert_textures[cur_texture];
-	float       fwidth  = (float)video->output_width;
-	float       fheight = (float)video->output_height;
-	size_t      passes, i;
-
-	effect_t    effect  = video->conversion_effect;
+	uint32_t    width   = texture_getwidth(target);
+	uint32_t    height  = texture_getheight(target);
+	uint32_t    src     = vertical ?
+		texture_getheight(texture) : texture_getwidth(texture);
+	uint32_t    dst     = vertical ? height : width;
+	technique_t tech    = effect_gettechnique(effect, vertical ?
+			"DrawSeparableMatrix" : "DrawSeparable");
 	eparam_t    image   = effect_getparambyname(effect, "image");
-	technique_t tech    = effect_gettechnique(effect,
-			video->conversion_tech);
-
-	if (!video->textures_output[prev_texture])
-		return;
+	eparam_t    matrix  = effect_getparambyname(effect, "color_matrix");
+	eparam_t    dim_i   = effect_getparambyname(effect,
+			"base_dimension_i");
+	eparam_t    dir     = effect_getparambyname(effect, "pass_dir");
+	eparam_t    kscale  = effect_getparambyname(effect, "kernel_scale");
+	float       ratio   = (float)src / (float)dst;
+	struct vec2 base_i, pass_dir;
+	size_t      passes;
+
+	vec2_set(&base_i,
+			1.0f / (float)texture_getwidth(texture),
+			1.0f / (float)texture_getheight(texture));
+	vec2_set(&pass_dir, vertical ? 0.0f : 1.0f, vertical ? 1.0f : 0.0f);
 
-	set_eparam(effect, "u_plane_offset", (float)video->plane_offsets[1]);
-	set_eparam(effect, "v_plane_offset", (float)video->plane_offsets[2]);
-	set_eparam(effect, "width",  fwidth);
-	set_eparam(effect, "height", fheight);
-	set_eparam(effect, "width_i",  1.0f / fwidth);
-	set_eparam(effect, "height_i", 1.0f / fheight);
-	set_eparam(effect, "width_d2",  fwidth  * 0.5f);
-	set_eparam(effect, "height_d2", fheight * 0.5f);
-	set_eparam(effect, "width_d2_i",  1.0f / (fwidth  * 0.5f));
-	set_eparam(effect, "height_d2_i", 1.0f / (fheight * 0.5f));
-	set_eparam(effect, "input_height", (float)video->conversion_height);
+	gs_setrendertarget(target, NULL);
+	set_render_size(width, height);
 
+	effect_setvec2(effect, dim_i, &base_i);
+	effect_setvec2(effect, dir, &pass_dir);
+	effect_setfloat(effect, kscale, ratio < 1.0f ? 1.0f :
+			(ratio > 2.0f ? 2.0f : ratio));
+	if (vertical)
+		effect_setval(effect, matrix, yuv_mat_val,
+				sizeof(yuv_mat_val));
 	effect_settexture(effect, image, texture);
 
-	gs_setrendertarget(target, NULL);
-	set_render_size(video->output_width, video->conversion_height);
-
 	passes = technique_begin(tech);
-	for (i = 0; i < passes; i++) {
+	for (size_t i = 0; i < passes; i++) {
 		technique_beginpass(tech, i);
-		gs_draw_sprite(texture, 0, video->output_width,
-				video->conversion_height);
+		gs_draw_sprite(texture, 0, width, height);
 		technique_endpass(tech);
 	}
 	technique_end(tech);
+}
+
+static inline effect_t get_separable_effect(struct obs_core_video *video)
+{
+	if (!video->separable_texture)
+		return NULL;
 
-	video->textures_converted[cur_texture] = true;
+	return (video->output_scale_type == VIDEO_SCALE_LANCZOS) ?
+		video->lanczos_effect : video->bicubic_effect;
 }
 
-static inline void stage_output_texture(struct obs_core_video *video,
+static inline void render_output_texture(struct obs_core_video *video,
 		int cur_texture, int prev_texture)
 {
-	texture_t   texture;
-	bool        texture_ready;
-	stagesurf_t copy = video->copy_surfaces[cur_texture];
+	texture_t texture = video->render_textures[prev_texture];
+	texture_t target  = video->output_textures[cur_texture];
+	effect_t  separable_effect;
 
-	if (video->gpu_conversion) {
-		texture = video->convert_textures[prev_texture];
-		texture_ready = video->textures_converted[prev_texture];
+	if (!video->textures_rendered[prev_texture])
+		return;
+
+	texture          = render_downscale_chain(video, texture);
+	separable_effect = get_separable_effect(video);
+
+	if (separable_effect) {
+		render_separable_pass(separable_effect, texture,
+				video->separable_texture, false);
+		render_separable_pass(separable_effect,
+				video->separable_texture, target, true);
 	} else {
-		texture = video->output_textures[prev_texture];
-		texture_ready = video->output_textures[prev_texture];
+		render_yuv_texture(video->default_effect, texture, target);
 	}
 
-	unmap_last_surface(video);
+	video->textures_output[cur_texture]   = true;
+	video->output_unchanged[cur_texture]  =
+		video->rendered_unchanged[prev_texture];
+	video->output_timestamps[cur_texture] =
+		video->rendered_timestamps[prev_texture];
+}
 
-	if (!texture_ready)
+/* renders each plane of the yuv texture to its own target at the plane's
+ * size */
+static void render_conversion(struct obs_core_video *video,
+		const struct obs_conversion_layout *layout,
+		texture_t texture, texture_t *targets)
+{
+	effect_t effect = video->conversion_effect;
+	eparam_t image  = video->conversion_params[CONVERSION_IMAGE];
+
+	for (size_t i = 0; i < layout->num_planes; i++) {
+		const struct obs_conversion_plane *plane = layout->planes+i;
+		technique_t tech = effect_gettechnique(effect, plane->tech);
+		size_t      passes;
+
+		gs_setrendertarget(targets[i], NULL);
+		set_render_size(plane->width, plane->height);
+
+		/* parameters are reset at the end of each technique */
+		effect_settexture(effect, image, texture);
+
+		passes = technique_begin(tech);
+		for (size_t j = 0; j < passes; j++) {
+			technique_beginpass(tech, j);
+			gs_draw_sprite(texture, 0, plane->width,
+					plane->height);
+			technique_endpass(tech);
+		}
+		technique_end(tech);
+	}
+}
+
+static void render_convert_texture(struct obs_core_video *video,
+		int cur_texture, int prev_texture)
+{
+	if (!video->textures_output[prev_texture])
 		return;
 
-	gs_stage_texture(copy, texture);
+	render_conversion(video, &video->conversion,
+			video->output_textures[prev_texture],
+			video->convert_textures[cur_texture]);
 
-	video->textures_copied[cur_texture] = true;
+	video->textures_converted[cur_texture]   = true;
+	video->converted_unchanged[cur_texture]  =
+		video->output_unchanged[prev_texture];
+	video->converted_timestamps[cur_texture] =
+		video->output_timestamps[prev_texture];
 }
 
-static inline void render_video(struct obs_core_video *video, int cur_texture,
+/* copies the output texture in to the next surface of the staging ring.  if
+ * every surface still holds a copy that hasn't been downloaded, the oldest
+ * one is dropped */
+static inline void stage_output_texture(struct obs_core_video *video,
 		int prev_texture)
 {
-	gs_beginscene();
+	texture_t   *textures;
+	bool        unchanged;
+	uint64_t    timestamp;
+	int         write;
 
-	gs_enable_depthtest(false);
-	gs_setcullmode(GS_NEITHER);
+	unmap_last_surface(video);
 
-	render_main_texture(video, cur_texture);
-	render_output_texture(video, cur_texture, prev_texture);
-	if (video->gpu_conversion)
-		render_convert_texture(video, cur_texture, prev_texture);
+	/* a frame is only a duplicate if the one before it was staged */
+	unchanged = video->stage_continuous;
+	video->stage_continuous = false;
 
-	stage_output_texture(video, cur_texture, prev_texture);
+	/* nothing needs the frame in system memory (inputs that use gpu
+	 * scaled outputs get their frames from those instead) */
+	if (!video_output_base_active(video->video)) {
+		video->stage_pending = 0;
+		return;
+	}
 
-	gs_setrendertarget(NULL, NULL);
-	gs_enable_blending(true);
+	if (video->gpu_conversion) {
+		if (!video->textures_converted[prev_texture])
+			return;
+		textures   = video->convert_textures[prev_texture];
+		unchanged  = unchanged &&
+			video->converted_unchanged[prev_texture];
+		timestamp  = video->converted_timestamps[prev_texture];
+	} else {
+		if (!video->textures_output[prev_texture])
+			return;
+		textures   = &video->output_textures[prev_texture];
+		unchanged  = unchanged &&
+			video->output_unchanged[prev_texture];
+		timestamp  = video->output_timestamps[prev_texture];
+	}
 
-	gs_endscene();
+	/* the copy after a dropped one has to count as changed */
+	if (video->stage_pending == video->num_stage_surfaces) {
+		video->stage_read = (video->stage_read + 1) %
+			video->num_stage_surfaces;
+		video->stage_pending--;
+
+		if (video->stage_pending)
+			video->staged_unchanged[video->stage_read] = false;
+		else
+			unchanged = false;
+	}
+
+	write = (video->stage_read + video->stage_pending) %
+		video->num_stage_surfaces;
+
+	stage_planes(video->copy_surfaces[write], textures,
+			num_stage_planes(video));
+	video->staged_unchanged[write]  = unchanged;
+	video->staged_timestamps[write] = timestamp;
+	video->stage_pending++;
+	video->stage_continuous = true;
 }
 
-static inline bool download_frame(struct obs_core_video *video,
-		int prev_texture, struct video_data *frame)
-{
-	stagesurf_t surface = video->copy_surfaces[prev_texture];
+/* ------------------------------------------------------------------------- */
+/* gpu scaled outputs */
 
-	if (!video->textures_copied[prev_texture])
+bool obs_scaled_output_supported(void *param,
+		const struct video_scale_info *info)
+{
+	/* the output is always converted with a 601 partial range matrix,
+	 * and the chroma planes can be half the size */
+	if (info->format != VIDEO_FORMAT_I420 &&
+	    info->format != VIDEO_FORMAT_NV12 &&
+	    info->format != VIDEO_FORMAT_I444 &&
+	    info->format != VIDEO_FORMAT_I422)
 		return false;
-
-	if (!stagesurface_map(surface, &frame->data[0], &frame->linesize[0]))
+	if (info->range == VIDEO_RANGE_FULL ||
+	    info->colorspace == VIDEO_CS_709)
+		return false;
+	if ((info->width & 1) != 0 || (info->height & 1) != 0)
 		return false;
 
-	video->mapped_surface = surface;
+	UNUSED_PARAMETER(param);
 	return true;
 }
 
-static inline uint32_t calc_linesize(uint32_t pos, uint32_t linesize)
+static void scaled_output_destroy(struct obs_scaled_output *out)
 {
-	uint32_t size = pos % linesize;
-	return size ? size : linesize;
-}
+	if (!out)
+		return;
 
-static void copy_dealign(
-		uint8_t *dst, uint32_t dst_pos, uint32_t dst_linesize,
-		const uint8_t *src, uint32_t src_pos, uint32_t src_linesize,
-		uint32_t remaining)
-{
-	while (remaining) {
-		uint32_t src_remainder = src_pos % src_linesize;
-		uint32_t dst_offset = dst_linesize - src_remainder;
-		uint32_t src_offset = src_linesize - src_remainder;
+	obs_unmap_conversion_planes(out->mapped_surfaces);
+
+	for (size_t i = 0; i < MAX_NUM_TEXTURES; i++) {
+		texture_destroy(out->output_textures[i]);
 
-		if (remaining < dst_offset) {
-			memcpy(dst + dst_pos, src + src_pos, remaining);
-			src_pos += remaining;
-			dst_pos += remaining;
-			remaining = 0;
-		} else {
-			memcpy(dst + dst_pos, src + src_pos, dst_offset);
-			src_pos += src_offset;
-			dst_pos += dst_offset;
-			remaining -= dst_offset;
+		for (size_t j = 0; j < MAX_CONVERSION_PLANES; j++) {
+			stagesurface_destroy(out->copy_surfaces[i][j]);
+			texture_destroy(out->convert_textures[i][j]);
 		}
 	}
+
+	bfree(out);
+}
+
+static struct obs_scaled_output *scaled_output_create(
+		struct obs_core_video *video,
+		const struct video_scale_info *info)
+{
+	struct obs_scaled_output *out = bzalloc(sizeof(*out));
+	uint32_t width  = info->width;
+	uint32_t height = info->height;
+
+	out->info = *info;
+
+	if (!obs_calc_conversion_layout(&out->layout, info->format,
+				width, height))
+		goto fail;
+
+	for (int i = 0; i < video->num_textures; i++) {
+		out->output_textures[i] = gs_create_texture(width, height,
+				GS_RGBA, 1, NULL, GS_RENDERTARGET);
+
+		if (!out->output_textures[i])
+			goto fail;
+		if (!obs_create_conversion_planes(&out->layout,
+					out->convert_textures[i],
+					out->copy_surfaces[i]))
+			goto fail;
+	}
+
+	blog(LOG_INFO, "Rendering %ux%u output on the GPU", width, height);
+	return out;
+
+fail:
+	blog(LOG_ERROR, "Failed to create GPU scaled output (%ux%u), "
+	                "it will not receive any frames", width, height);
+	scaled_output_destroy(out);
+	return NULL;
 }
 
-static inline uint32_t make_aligned_linesize_offset(uint32_t offset,
-		uint32_t dst_linesize, uint32_t src_linesize)
+void obs_free_scaled_outputs(struct obs_core_video *video)
 {
-	uint32_t remainder = offset % dst_linesize;
-	return (offset / dst_linesize) * src_linesize + remainder;
+	for (size_t i = 0; i < video->scaled_outputs.num; i++)
+		scaled_output_destroy(video->scaled_outputs.array[i]);
+
+	da_free(video->scaled_outputs);
+	da_free(video->scaled_infos);
+	video->scaled_revision = 0;
 }
 
-static void fix_gpu_converted_alignment(struct obs_core_video *video,
-		struct video_data *frame, int cur_texture)
+static inline bool scale_info_equal(const struct video_scale_info *a,
+		const struct video_scale_info *b)
 {
-	struct source_frame *new_frame = &video->convert_frames[cur_texture];
-	uint32_t src_linesize = frame->linesize[0];
-	uint32_t dst_linesize = video->output_width * 4;
-	uint32_t src_pos      = 0;
+	return a->format     == b->format &&
+	       a->width      == b->width  &&
+	       a->height     == b->height &&
+	       a->range      == b->range  &&
+	       a->colorspace == b->colorspace;
+}
+
+static void push_scaled_info(void *param, const struct video_scale_info *info)
+{
+	struct obs_core_video *video = param;
+	da_push_back(video->scaled_infos, info);
+}
+
+/* the external conversion list is only enumerated when it's changed, and
+ * outside of the graphics context, because enumerating has to wait for the
+ * video thread to finish with its inputs */
+static bool update_scaled_infos(struct obs_core_video *video)
+{
+	long revision = video_output_external_revision(video->video);
+
+	if (revision == video->scaled_revision)
+		return false;
+
+	video->scaled_revision = revision;
+
+	da_resize(video->scaled_infos, 0);
+	video_output_enum_external(video->video, push_scaled_info, video);
+	return true;
+}
+
+static void sync_scaled_outputs(struct obs_core_video *video)
+{
+	struct obs_scaled_output *out;
 
-	for (size_t i = 0; i < 3; i++) {
-		if (video->plane_linewidth[i] == 0)
-			break;
+	for (size_t i = 0; i < video->scaled_outputs.num; i++)
+		video->scaled_outputs.array[i]->used = false;
 
-		src_pos = make_aligned_linesize_offset(video->plane_offsets[i],
-				dst_linesize, src_linesize);
+	for (size_t i = 0; i < video->scaled_infos.num; i++) {
+		struct video_scale_info *info = video->scaled_infos.array+i;
+		bool found = false;
 
-		copy_dealign(new_frame->data[i], 0, dst_linesize,
-				frame->data[0], src_pos, src_linesize,
-				video->plane_sizes[i]);
+		for (size_t j = 0; j < video->scaled_outputs.num; j++) {
+			out = video->scaled_outputs.array[j];
+
+			if (scale_info_equal(&out->info, info)) {
+				out->used = true;
+				found = true;
+				break;
+			}
+		}
+
+		if (!found) {
+			out = scaled_output_create(video, info);
+			if (out) {
+				out->used = true;
+				da_push_back(video->scaled_outputs, &out);
+			}
+		}
 	}
 
-	/* replace with cached frames */
-	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-		frame->data[i]     = new_frame->data[i];
-		frame->linesize[i] = new_frame->linesize[i];
+	for (size_t i = video->scaled_outputs.num; i > 0; i--) {
+		out = video->scaled_outputs.array[i-1];
+
+		if (!out->used) {
+			scaled_output_destroy(out);
+			da_erase(video->scaled_outputs, i-1);
+		}
 	}
 }
 
-static bool set_gpu_converted_data(struct obs_core_video *video,
-		struct video_data *frame, int cur_texture)
+static inline effect_t get_scale_effect(struct obs_core_video *video)
 {
-	if (frame->linesize[0] == video->output_width*4) {
-		for (size_t i = 0; i < 3; i++) {
-			if (video->plane_linewidth[i] == 0)
-				break;
+	switch (video->scale_type) {
+	case VIDEO_SCALE_DEFAULT:
+	case VIDEO_SCALE_BICUBIC:
+		if (video->bicubic_effect)
+			return video->bicubic_effect;
+		break;
+	case VIDEO_SCALE_LANCZOS:
+		if (video->lanczos_effect)
+			return video->lanczos_effect;
+		break;
+	case VIDEO_SCALE_POINT:
+	case VIDEO_SCALE_FAST_BILINEAR:
+	case VIDEO_SCALE_BILINEAR:
+	case VIDEO_SCALE_AREA:
+		break;
+	}
+
+	return video->default_effect;
+}
 
-			frame->linesize[i] = video->plane_linewidth[i];
-			frame->data[i] =
-				frame->data[0] + video->plane_offsets[i];
+/* each scaled output goes through the same stages as the main output:
+ * scaled from the previous base texture, packed in to planes, and then
+ * staged for readback */
+static void render_scaled_outputs(struct obs_core_video *video,
+		int cur_texture, int prev_texture)
+{
+	effect_t effect = get_scale_effect(video);
+
+	for (size_t i = 0; i < video->scaled_outputs.num; i++) {
+		struct obs_scaled_output *out = video->scaled_outputs.array[i];
+
+		obs_unmap_conversion_planes(out->mapped_surfaces);
+		out->mapped_surfaces = NULL;
+
+		out->textures_output[cur_texture]    = false;
+		out->textures_converted[cur_texture] = false;
+		out->textures_copied[cur_texture]    = false;
+
+		if (video->textures_rendered[prev_texture]) {
+			render_yuv_texture(effect,
+					video->render_textures[prev_texture],
+					out->output_textures[cur_texture]);
+			out->textures_output[cur_texture]   = true;
+			out->output_timestamps[cur_texture] =
+				video->rendered_timestamps[prev_texture];
 		}
 
-	} else {
-		fix_gpu_converted_alignment(video, frame, cur_texture);
+		if (out->textures_output[prev_texture]) {
+			render_conversion(video, &out->layout,
+					out->output_textures[prev_texture],
+					out->convert_textures[cur_texture]);
+			out->textures_converted[cur_texture]   = true;
+			out->converted_timestamps[cur_texture] =
+				out->output_timestamps[prev_texture];
+		}
+
+		if (out->textures_converted[prev_texture]) {
+			stage_planes(out->copy_surfaces[cur_texture],
+					out->convert_textures[prev_texture],
+					out->layout.num_planes);
+			out->textures_copied[cur_texture]   = true;
+			out->copied_timestamps[cur_texture] =
+				out->converted_timestamps[prev_texture];
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void render_video(struct obs_core_video *video, int cur_texture,
+		int prev_texture, bool unchanged, uint64_t timestamp)
+{
+	gputimer_t timer;
+
+	gs_beginscene();
+
+	gs_enable_depthtest(false);
+	gs_setcullmode(GS_NEITHER);
+
+	timer = obs_gpu_timer_begin(GPU_SAMPLE_STAGE,
+			OBS_GPU_STAGE_RENDER_MAIN, NULL);
+	render_main_texture(video, cur_texture, unchanged, timestamp);
+	obs_gpu_timer_end(timer);
+
+	timer = obs_gpu_timer_begin(GPU_SAMPLE_STAGE,
+			OBS_GPU_STAGE_RENDER_OUTPUT, NULL);
+	render_output_texture(video, cur_texture, prev_texture);
+	obs_gpu_timer_end(timer);
+
+	if (video->gpu_conversion) {
+		timer = obs_gpu_timer_begin(GPU_SAMPLE_STAGE,
+				OBS_GPU_STAGE_CONVERT, NULL);
+		render_convert_texture(video, cur_texture, prev_texture);
+		obs_gpu_timer_end(timer);
 	}
 
+	stage_output_texture(video, prev_texture);
+
+	timer = obs_gpu_timer_begin(GPU_SAMPLE_STAGE,
+			OBS_GPU_STAGE_SCALED_OUTPUTS, NULL);
+	render_scaled_outputs(video, cur_texture, prev_texture);
+	obs_gpu_timer_end(timer);
+
+	gs_setrendertarget(NULL, NULL);
+	gs_enable_blending(true);
+
+	gs_endscene();
+}
+
+/* maps the oldest staged copy in the ring.  it was staged a pipeline's
+ * depth ago, so the transfer has normally finished already; if it hasn't,
+ * the map waits for it rather than the frame being skipped.  the frame gets
+ * the time it was rendered for, not the current one */
+static inline bool download_frame(struct obs_core_video *video,
+		struct video_data *frame)
+{
+	stagesurf_t *surfaces;
+	size_t      num_planes = num_stage_planes(video);
+
+	if (!video->stage_pending)
+		return false;
+
+	surfaces = video->copy_surfaces[video->stage_read];
+
+	if (!obs_map_conversion_planes(surfaces, num_planes, frame))
+		return false;
+
+	frame->duplicate  = video->staged_unchanged[video->stage_read];
+	frame->timestamp  = video->staged_timestamps[video->stage_read];
+	video->stage_read = (video->stage_read + 1) %
+		video->num_stage_surfaces;
+	video->stage_pending--;
+
+	video->mapped_surfaces = surfaces;
 	return true;
 }
 
@@ -386,11 +930,8 @@ static inline void output_video_data(struct obs_core_video *video,
 	const struct video_output_info *info;
 	info = video_output_getinfo(video->video);
 
-	if (video->gpu_conversion) {
-		if (!set_gpu_converted_data(video, frame, cur_texture))
-			return;
-
-	} else if (format_is_yuv(info->format)) {
+	/* gpu converted frames are already mapped as separate planes */
+	if (!video->gpu_conversion && format_is_yuv(info->format)) {
 		if (!convert_frame(video, frame, info, cur_texture))
 			return;
 	}
@@ -398,43 +939,189 @@ static inline void output_video_data(struct obs_core_video *video,
 	video_output_swap_frame(video->video, frame);
 }
 
+static void download_scaled_frames(struct obs_core_video *video,
+		int oldest_texture)
+{
+	for (size_t i = 0; i < video->scaled_outputs.num; i++) {
+		struct obs_scaled_output *out = video->scaled_outputs.array[i];
+		stagesurf_t *surfaces = out->copy_surfaces[oldest_texture];
+		struct video_data *frame = &out->frame;
+
+		out->frame_ready = false;
+
+		if (!out->textures_copied[oldest_texture])
+			continue;
+
+		memset(frame, 0, sizeof(struct video_data));
+		if (!obs_map_conversion_planes(surfaces,
+					out->layout.num_planes, frame))
+			continue;
+
+		out->mapped_surfaces = surfaces;
+
+		frame->timestamp = out->copied_timestamps[oldest_texture];
+		out->frame_ready = true;
+	}
+}
+
+/* the frames are copied by the video output, so the surfaces can be
+ * unmapped as usual on the next frame */
+static void output_scaled_frames(struct obs_core_video *video)
+{
+	for (size_t i = 0; i < video->scaled_outputs.num; i++) {
+		struct obs_scaled_output *out = video->scaled_outputs.array[i];
+
+		if (out->frame_ready)
+			video_output_swap_scaled_frame(video->video,
+					&out->info, &out->frame);
+	}
+}
+
+/* hands the output texture directly to encoders that can encode from the
+ * GPU, so they never round-trip through system memory */
+static inline void output_gpu_encoders(struct obs_core_video *video,
+		int prev_texture, uint64_t timestamp)
+{
+	struct obs_core_data *data = &obs->data;
+	texture_t texture;
+
+	pthread_mutex_lock(&data->gpu_encoders_mutex);
+
+	texture = data->gpu_encoders.num &&
+		video->textures_output[prev_texture] ?
+		video->output_textures[prev_texture] : NULL;
+
+	/* the texture was rendered for an earlier frame.  while idle it's
+	 * repeated, and is still current as nothing has changed */
+	if (texture && !video->idle)
+		timestamp = video->output_timestamps[prev_texture];
+
+	/* the encode device thread encodes once the copy gets there */
+	if (video->encode_device.graphics) {
+		pthread_mutex_unlock(&data->gpu_encoders_mutex);
+		obs_encode_device_output(texture, timestamp);
+		return;
+	}
+
+	/* iterate backwards: an encoder that fails stops itself and is
+	 * removed from the list */
+	if (texture) {
+		for (size_t i = data->gpu_encoders.num; i > 0; i--)
+			obs_encoder_receive_texture(
+					data->gpu_encoders.array[i-1],
+					texture, timestamp);
+	}
+
+	pthread_mutex_unlock(&data->gpu_encoders_mutex);
+}
+
 static inline void output_frame(uint64_t timestamp)
 {
 	struct obs_core_video *video = &obs->video;
+	int num_textures = video->num_textures;
 	int cur_texture  = video->cur_texture;
-	int prev_texture = cur_texture == 0 ? NUM_TEXTURES-1 : cur_texture-1;
+	int prev_texture = cur_texture == 0 ? num_textures-1 : cur_texture-1;
+	int oldest       = cur_texture == num_textures-1 ? 0 : cur_texture+1;
 	struct video_data frame;
-	bool frame_ready;
+	bool frame_ready = false;
+	bool scaled_changed;
+	bool unchanged;
+	gputimer_t timer;
+	uint64_t start;
 
 	memset(&frame, 0, sizeof(struct video_data));
 	frame.timestamp = timestamp;
 
+	scaled_changed = video->gpu_scaling && update_scaled_infos(video);
+
 	gs_entercontext(obs_graphics());
 
-	render_video(video, cur_texture, prev_texture);
-	frame_ready = download_frame(video, prev_texture, &frame);
+	obs_gpu_timing_frame(&video->gpu_timing);
+
+	if (scaled_changed)
+		sync_scaled_outputs(video);
+
+	/* checked before rendering, so a change made during the render
+	 * shows up as a change on the next frame */
+	unchanged   = main_view_unchanged(video);
+	video->idle = pipeline_idle(video, unchanged);
+
+	start = profile_start();
+	if (!video->idle)
+		render_video(video, cur_texture, prev_texture, unchanged,
+				timestamp);
+	output_gpu_encoders(video, prev_texture, timestamp);
+	profile_end(video->profile.render_video, start);
+
+	if (!video->idle) {
+		start = profile_start();
+		frame_ready = download_frame(video, &frame);
+		download_scaled_frames(video, oldest);
+		profile_end(video->profile.download_frame, start);
+	}
+
+	timer = obs_gpu_timer_begin(GPU_SAMPLE_STAGE, OBS_GPU_STAGE_CANVASES,
+			NULL);
+	obs_render_canvases(timestamp);
+	obs_gpu_timer_end(timer);
+
+	texrender_pool_trim();
 
 	gs_leavecontext();
 
+	/* idle, the textures stay where they are so the last output texture
+	 * is still the previous one when rendering resumes, and the last
+	 * downloaded frame stays mapped for the video output to repeat */
+	if (video->idle) {
+		video_output_repeat_frame(video->video, timestamp);
+		return;
+	}
+
+	start = profile_start();
 	if (frame_ready)
 		output_video_data(video, &frame, cur_texture);
+	output_scaled_frames(video);
+	profile_end(video->profile.output_video_data, start);
 
-	if (++video->cur_texture == NUM_TEXTURES)
+	if (++video->cur_texture == num_textures)
 		video->cur_texture = 0;
 }
 
 void *obs_video_thread(void *param)
 {
+	struct obs_video_profile *profile = &obs->video.profile;
 	uint64_t last_time = 0;
 
+	os_thread_init(OS_THREAD_CLASS_VIDEO, "obs video");
+
+	/* anything not created for a source belongs to the video output */
+	gs_set_memory_owner(obs->video.gpu_owner);
+
 	while (video_output_wait(obs->video.video)) {
 		uint64_t cur_time = video_gettime(obs->video.video);
+		uint64_t frame_start = profile_start();
+		uint64_t start;
 
+		start = profile_start();
 		last_time = tick_sources(cur_time, last_time);
+		profile_end(profile->tick_sources, start);
 
-		render_displays();
+		start = profile_start();
+		obs_execute_graphics_queue();
+		profile_end(profile->graphics_queue, start);
 
+		obs->video.frame_count++;
 		output_frame(cur_time);
+
+		/* displays go after the output frame so that a slow present
+		 * can only delay the preview */
+		if (preview_due(cur_time)) {
+			start = profile_start();
+			render_displays();
+			profile_end(profile->render_displays, start);
+		}
+
+		profile_end(profile->frame, frame_start);
 	}
 
 	UNUSED_PARAMETER(param);
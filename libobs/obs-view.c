@@ -48,10 +48,13 @@ void obs_view_free(struct obs_view *view)
 {
 	if (!view) return;
 
-	for (size_t i = 0; i < MAX_CHANNELS; i++)
+	for (size_t i = 0; i < MAX_CHANNELS; i++) {
 		obs_source_release(view->channels[i]);
+		obs_end_preload_source(view->preloads[i]);
+	}
 
 	memset(view->channels, 0, sizeof(view->channels));
+	memset(view->preloads, 0, sizeof(view->preloads));
 	pthread_mutex_destroy(&view->channels_mutex);
 }
 
@@ -98,11 +101,14 @@ void obs_view_setsource(obs_view_t view, uint32_t channel,
 
 	prev_source = view->channels[channel];
 	view->channels[channel] = source;
+	os_atomic_inc_long(&view->revision);
 
 	pthread_mutex_unlock(&view->channels_mutex);
 
-	if (source)
+	if (source) {
 		obs_source_activate(source, AUX_VIEW);
+		obs_view_consume_preload(view, channel, source);
+	}
 
 	if (prev_source) {
 		obs_source_deactivate(prev_source, AUX_VIEW);
@@ -110,6 +116,80 @@ void obs_view_setsource(obs_view_t view, uint32_t channel,
 	}
 }
 
+void obs_view_preload(obs_view_t view, uint32_t channel, obs_source_t source)
+{
+	struct obs_source *prev_preload;
+
+	assert(channel < MAX_CHANNELS);
+
+	if (!view) return;
+	if (channel >= MAX_CHANNELS) return;
+
+	pthread_mutex_lock(&view->channels_mutex);
+
+	prev_preload = view->preloads[channel];
+	if (prev_preload == source) {
+		pthread_mutex_unlock(&view->channels_mutex);
+		return;
+	}
+
+	view->preloads[channel] = source;
+
+	/* shown before the previous preload is hidden, in case they share
+	 * child sources */
+	obs_preload_source(source);
+
+	pthread_mutex_unlock(&view->channels_mutex);
+
+	obs_end_preload_source(prev_preload);
+}
+
+void obs_view_consume_preload(struct obs_view *view, uint32_t channel,
+		obs_source_t source)
+{
+	struct obs_source *preload = NULL;
+
+	pthread_mutex_lock(&view->channels_mutex);
+
+	if (view->preloads[channel] == source) {
+		preload = source;
+		view->preloads[channel] = NULL;
+	}
+
+	pthread_mutex_unlock(&view->channels_mutex);
+
+	/* the source is already shown by the view itself at this point, so
+	 * ending the preload doesn't hide it */
+	obs_end_preload_source(preload);
+}
+
+bool obs_view_get_content_revision(struct obs_view *view, uint64_t *revision)
+{
+	uint64_t total   = (uint64_t)os_atomic_load_long(&view->revision);
+	bool     success = true;
+
+	pthread_mutex_lock(&view->channels_mutex);
+
+	for (size_t i = 0; success && i < MAX_CHANNELS; i++) {
+		struct obs_source *source = view->channels[i];
+		uint64_t source_revision;
+
+		if (!source)
+			continue;
+
+		success = !source->removed &&
+			obs_source_get_content_revision(source,
+					&source_revision);
+		if (success)
+			total += source_revision;
+	}
+
+	pthread_mutex_unlock(&view->channels_mutex);
+
+	*revision = total;
+	return success;
+}
+
 void obs_view_render(obs_view_t view)
 {
 	if (!view) return;
@@ -15,6 +15,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include "util/platform.h"
 #include "callback/calldata.h"
 
 #include "obs.h"
@@ -47,107 +48,141 @@ static inline void make_video_info(struct video_output_info *vi,
 	vi->height  = ovi->output_height;
 }
 
-#define PIXEL_SIZE 4
-
-#define GET_ALIGN(val, align) \
-	(((val) + (align-1)) & ~(align-1))
+static inline void set_plane(struct obs_conversion_plane *plane,
+		const char *tech, enum gs_color_format format,
+		uint32_t width, uint32_t height)
+{
+	plane->tech   = tech;
+	plane->format = format;
+	plane->width  = width;
+	plane->height = height;
+}
 
-static inline void set_420p_sizes(const struct obs_video_info *ovi)
+bool obs_calc_conversion_layout(struct obs_conversion_layout *layout,
+		enum video_format format, uint32_t width, uint32_t height)
 {
-	struct obs_core_video *video = &obs->video;
-	uint32_t chroma_pixels;
-	uint32_t total_bytes;
+	struct obs_conversion_plane *planes = layout->planes;
 
-	chroma_pixels = (ovi->output_width * ovi->output_height / 4);
-	chroma_pixels = GET_ALIGN(chroma_pixels, PIXEL_SIZE);
+	memset(layout, 0, sizeof(struct obs_conversion_layout));
 
-	video->plane_offsets[0] = 0;
-	video->plane_offsets[1] = ovi->output_width * ovi->output_height;
-	video->plane_offsets[2] = video->plane_offsets[1] + chroma_pixels;
+	switch ((uint32_t)format) {
+	case VIDEO_FORMAT_I420:
+		set_plane(planes+0, "PlaneY", GS_R8, width,   height);
+		set_plane(planes+1, "PlaneU", GS_R8, width/2, height/2);
+		set_plane(planes+2, "PlaneV", GS_R8, width/2, height/2);
+		layout->num_planes = 3;
+		break;
+	case VIDEO_FORMAT_NV12:
+		set_plane(planes+0, "PlaneY",  GS_R8,   width,   height);
+		set_plane(planes+1, "PlaneUV", GS_R8G8, width/2, height/2);
+		layout->num_planes = 2;
+		break;
+	case VIDEO_FORMAT_I444:
+		set_plane(planes+0, "PlaneY", GS_R8, width, height);
+		set_plane(planes+1, "PlaneU", GS_R8, width, height);
+		set_plane(planes+2, "PlaneV", GS_R8, width, height);
+		layout->num_planes = 3;
+		break;
+	case VIDEO_FORMAT_I422:
+		set_plane(planes+0, "PlaneY", GS_R8, width,   height);
+		set_plane(planes+1, "PlaneU", GS_R8, width/2, height);
+		set_plane(planes+2, "PlaneV", GS_R8, width/2, height);
+		layout->num_planes = 3;
+		break;
+	}
 
-	video->plane_linewidth[0] = ovi->output_width;
-	video->plane_linewidth[1] = ovi->output_width/2;
-	video->plane_linewidth[2] = ovi->output_width/2;
+	return layout->num_planes != 0;
+}
 
-	video->plane_sizes[0] = video->plane_offsets[1];
-	video->plane_sizes[1] = video->plane_sizes[0]/4;
-	video->plane_sizes[2] = video->plane_sizes[1];
+bool obs_create_conversion_planes(const struct obs_conversion_layout *layout,
+		texture_t *textures, stagesurf_t *surfaces)
+{
+	for (size_t i = 0; i < layout->num_planes; i++) {
+		const struct obs_conversion_plane *plane = layout->planes+i;
 
-	total_bytes = video->plane_offsets[2] + chroma_pixels;
+		if (textures) {
+			textures[i] = gs_create_texture(plane->width,
+					plane->height, plane->format, 1, NULL,
+					GS_RENDERTARGET);
+			if (!textures[i])
+				return false;
+		}
 
-	video->conversion_height =
-		(total_bytes/PIXEL_SIZE + ovi->output_width-1) /
-		ovi->output_width;
+		if (surfaces) {
+			surfaces[i] = gs_create_stagesurface(plane->width,
+					plane->height, plane->format);
+			if (!surfaces[i])
+				return false;
+		}
+	}
 
-	video->conversion_height = GET_ALIGN(video->conversion_height, 2);
-	video->conversion_tech = "Planar420";
+	return true;
 }
 
-static inline void set_nv12_sizes(const struct obs_video_info *ovi)
+static bool obs_init_gpu_conversion(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
-	uint32_t chroma_pixels;
-	uint32_t total_bytes;
-
-	chroma_pixels = (ovi->output_width * ovi->output_height / 2);
-	chroma_pixels = GET_ALIGN(chroma_pixels, PIXEL_SIZE);
 
-	video->plane_offsets[0] = 0;
-	video->plane_offsets[1] = ovi->output_width * ovi->output_height;
-
-	video->plane_linewidth[0] = ovi->output_width;
-	video->plane_linewidth[1] = ovi->output_width;
-
-	video->plane_sizes[0] = video->plane_offsets[1];
-	video->plane_sizes[1] = video->plane_sizes[0]/2;
-
-	total_bytes = video->plane_offsets[1] + chroma_pixels;
+	if (!obs_calc_conversion_layout(&video->conversion, ovi->output_format,
+				ovi->output_width, ovi->output_height)) {
+		blog(LOG_INFO, "GPU conversion not available for format: %u",
+				(unsigned int)ovi->output_format);
+		video->gpu_conversion = false;
+		return true;
+	}
 
-	video->conversion_height =
-		(total_bytes/PIXEL_SIZE + ovi->output_width-1) /
-		ovi->output_width;
+	for (int i = 0; i < video->num_textures; i++) {
+		if (!obs_create_conversion_planes(&video->conversion,
+					video->convert_textures[i], NULL))
+			return false;
+	}
 
-	video->conversion_height = GET_ALIGN(video->conversion_height, 2);
-	video->conversion_tech = "NV12";
+	return true;
 }
 
-static inline void calc_gpu_conversion_sizes(const struct obs_video_info *ovi)
+/* the downscale textures are only used within the output pass of a frame,
+ * so one chain is shared by the whole pipeline */
+static bool obs_init_downscale_textures(struct obs_video_info *ovi)
 {
-	obs->video.conversion_height = 0;
-	memset(obs->video.plane_offsets, 0, sizeof(obs->video.plane_offsets));
-	memset(obs->video.plane_sizes, 0, sizeof(obs->video.plane_sizes));
-	memset(obs->video.plane_linewidth, 0,
-		sizeof(obs->video.plane_linewidth));
+	struct obs_core_video *video = &obs->video;
+	uint32_t width  = ovi->base_width;
+	uint32_t height = ovi->base_height;
 
-	switch ((uint32_t)ovi->output_format) {
-	case VIDEO_FORMAT_I420:
-		set_420p_sizes(ovi);
-		break;
-	case VIDEO_FORMAT_NV12:
-		set_nv12_sizes(ovi);
+	switch (ovi->output_scale_type) {
+	case VIDEO_SCALE_DEFAULT:
+	case VIDEO_SCALE_POINT:
+	case VIDEO_SCALE_FAST_BILINEAR:
+		return true;
+	case VIDEO_SCALE_BILINEAR:
+	case VIDEO_SCALE_AREA:
+	case VIDEO_SCALE_BICUBIC:
+	case VIDEO_SCALE_LANCZOS:
 		break;
 	}
-}
 
-static bool obs_init_gpu_conversion(struct obs_video_info *ovi)
-{
-	struct obs_core_video *video = &obs->video;
+	while (video->num_downscale_levels < MAX_DOWNSCALE_LEVELS &&
+	       width  / 2 >= ovi->output_width &&
+	       height / 2 >= ovi->output_height) {
+		texture_t texture;
 
-	calc_gpu_conversion_sizes(ovi);
+		width  /= 2;
+		height /= 2;
 
-	if (!video->conversion_height) {
-		blog(LOG_INFO, "GPU conversion not available for format: %u",
-				(unsigned int)ovi->output_format);
-		video->gpu_conversion = false;
-		return true;
-	}
+		texture = gs_create_texture(width, height, GS_RGBA, 1, NULL,
+				GS_RENDERTARGET);
+		if (!texture)
+			return false;
 
-	for (size_t i = 0; i < NUM_TEXTURES; i++) {
-		video->convert_textures[i] = gs_create_texture(
-				ovi->output_width, video->conversion_height,
-				GS_RGBA, 1, NULL, GS_RENDERTARGET);
+		video->downscale_textures[video->num_downscale_levels++] =
+			texture;
+	}
 
-		if (!video->convert_textures[i])
+	if (ovi->output_scale_type == VIDEO_SCALE_BICUBIC ||
+	    ovi->output_scale_type == VIDEO_SCALE_LANCZOS) {
+		video->separable_texture = gs_create_texture(
+				ovi->output_width, height, GS_RGBA, 1, NULL,
+				GS_RENDERTARGET);
+		if (!video->separable_texture)
 			return false;
 	}
 
@@ -158,17 +193,30 @@ static bool obs_init_textures(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
 	bool yuv = format_is_yuv(ovi->output_format);
-	uint32_t output_height = video->gpu_conversion ?
-		video->conversion_height : ovi->output_height;
-	size_t i;
+	int i;
+
+	video->num_stage_surfaces = video->num_textures +
+		NUM_EXTRA_STAGE_SURFACES;
+	video->stage_read         = 0;
+	video->stage_pending      = 0;
+
+	/* with gpu conversion, each staged copy is a surface per plane */
+	for (i = 0; i < video->num_stage_surfaces; i++) {
+		if (video->gpu_conversion) {
+			if (!obs_create_conversion_planes(&video->conversion,
+						NULL, video->copy_surfaces[i]))
+				return false;
+			continue;
+		}
 
-	for (i = 0; i < NUM_TEXTURES; i++) {
-		video->copy_surfaces[i] = gs_create_stagesurface(
-				ovi->output_width, output_height, GS_RGBA);
+		video->copy_surfaces[i][0] = gs_create_stagesurface(
+				ovi->output_width, ovi->output_height, GS_RGBA);
 
-		if (!video->copy_surfaces[i])
+		if (!video->copy_surfaces[i][0])
 			return false;
+	}
 
+	for (i = 0; i < video->num_textures; i++) {
 		video->render_textures[i] = gs_create_texture(
 				ovi->base_width, ovi->base_height,
 				GS_RGBA, 1, NULL, GS_RENDERTARGET);
@@ -183,14 +231,29 @@ static bool obs_init_textures(struct obs_video_info *ovi)
 		if (!video->output_textures[i])
 			return false;
 
-		if (yuv)
+		if (yuv && !video->gpu_conversion)
 			source_frame_init(&video->convert_frames[i],
 					ovi->output_format,
 					ovi->output_width, ovi->output_height);
 	}
 
-	return true;
-}
+	return obs_init_downscale_textures(ovi);
+}
+
+static const char *conversion_param_names[NUM_CONVERSION_PARAMS] = {
+	[CONVERSION_WIDTH]          = "width",
+	[CONVERSION_HEIGHT]         = "height",
+	[CONVERSION_WIDTH_I]        = "width_i",
+	[CONVERSION_HEIGHT_I]       = "height_i",
+	[CONVERSION_WIDTH_D2]       = "width_d2",
+	[CONVERSION_HEIGHT_D2]      = "height_d2",
+	[CONVERSION_WIDTH_D2_I]     = "width_d2_i",
+	[CONVERSION_HEIGHT_D2_I]    = "height_d2_i",
+	[CONVERSION_INPUT_HEIGHT]   = "input_height",
+	[CONVERSION_IMAGE]          = "image",
+	[CONVERSION_IMAGE_1]        = "image1",
+	[CONVERSION_IMAGE_2]        = "image2"
+};
 
 static bool obs_init_graphics(struct obs_video_info *ovi)
 {
@@ -200,6 +263,7 @@ static bool obs_init_graphics(struct obs_video_info *ovi)
 	int errorcode;
 
 	make_gs_init_data(&graphics_data, ovi);
+	video->headless = !gs_window_valid(&ovi->window);
 
 	errorcode = gs_create(&video->graphics, ovi->graphics_module,
 			&graphics_data);
@@ -210,7 +274,10 @@ static bool obs_init_graphics(struct obs_video_info *ovi)
 		return false;
 	}
 
+	video->gpu_owner = gs_memory_owner_create();
+
 	gs_entercontext(video->graphics);
+	gs_set_shader_cache_path(video->shader_cache_path);
 
 	if (success) {
 		char *filename = find_libobs_data_file("default.effect");
@@ -218,33 +285,120 @@ static bool obs_init_graphics(struct obs_video_info *ovi)
 				NULL);
 		bfree(filename);
 
+#ifdef __APPLE__
+		/* for GL_TEXTURE_RECTANGLE textures such as IOSurfaces */
+		filename = find_libobs_data_file("default_rect.effect");
+		video->default_rect_effect = gs_create_effect_from_file(
+				filename, NULL);
+		bfree(filename);
+#endif
+
 		filename = find_libobs_data_file("format_conversion.effect");
 		video->conversion_effect = gs_create_effect_from_file(filename,
 				NULL);
 		bfree(filename);
 
+		if (video->conversion_effect &&
+		    !effect_getparams(video->conversion_effect,
+				conversion_param_names, video->conversion_params,
+				NUM_CONVERSION_PARAMS))
+			blog(LOG_WARNING, "format_conversion.effect is missing "
+			                  "parameters");
+
+		/* the scale effects are optional, gpu scaling falls back to
+		 * bilinear filtering without them */
+		filename = find_libobs_data_file("bicubic_scale.effect");
+		video->bicubic_effect = gs_create_effect_from_file(filename,
+				NULL);
+		bfree(filename);
+
+		filename = find_libobs_data_file("lanczos_scale.effect");
+		video->lanczos_effect = gs_create_effect_from_file(filename,
+				NULL);
+		bfree(filename);
+
+		/* without it, interlaced sources are drawn as they are */
+		filename = find_libobs_data_file("deinterlace.effect");
+		video->deinterlace_effect = gs_create_effect_from_file(
+				filename, NULL);
+		bfree(filename);
+
 		if (!video->default_effect)
 			success = false;
 		if (!video->conversion_effect)
 			success = false;
+		if (!obs_init_image_cache())
+			success = false;
+		if (!obs_init_graphics_queue())
+			success = false;
 	}
 
 	gs_leavecontext();
 	return success;
 }
 
+static void obs_init_video_profile(struct obs_video_profile *profile)
+{
+	profile->tick_sources      = profile_point_get("tick_sources");
+	profile->graphics_queue    = profile_point_get("graphics_queue");
+	profile->render_displays   = profile_point_get("render_displays");
+	profile->render_video      = profile_point_get("render_video");
+	profile->download_frame    = profile_point_get("download_frame");
+	profile->output_video_data = profile_point_get("output_video_data");
+	profile->frame             = profile_point_get("video_frame");
+}
+
+static void apply_efficiency_mode(struct obs_core_video *video)
+{
+	enum video_pacing_mode pacing;
+
+	if (!video->video)
+		return;
+
+	pacing = video_output_get_pacing_mode(video->video);
+
+	if (video->efficiency_mode)
+		video_output_set_pacing_mode(video->video,
+				VIDEO_PACING_COALESCED);
+	else if (pacing == VIDEO_PACING_COALESCED)
+		video_output_set_pacing_mode(video->video,
+				VIDEO_PACING_SLEEP);
+}
+
 static bool obs_init_video(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
 	struct video_output_info vi;
+	gs_memory_owner_t prev_owner;
+	bool success = true;
 	int errorcode;
 
+	/* there's no cpu path to the planar 444/422 formats */
+	if (!ovi->gpu_conversion && (ovi->output_format == VIDEO_FORMAT_I444 ||
+	                             ovi->output_format == VIDEO_FORMAT_I422)) {
+		blog(LOG_ERROR, "Output format %u requires GPU conversion",
+				(unsigned int)ovi->output_format);
+		return false;
+	}
+
 	make_video_info(&vi, ovi);
 	video->base_width     = ovi->base_width;
 	video->base_height    = ovi->base_height;
 	video->output_width   = ovi->output_width;
 	video->output_height  = ovi->output_height;
 	video->gpu_conversion = ovi->gpu_conversion;
+	video->gpu_scaling    = ovi->gpu_scaling;
+	video->scale_type     = ovi->scale_type;
+	video->output_scale_type = ovi->output_scale_type;
+	video->num_textures   = (int)ovi->pipeline_depth;
+
+	/* the new pipeline starts out empty, so it can't be idle */
+	video->view_revision_valid = false;
+	video->unchanged_frames    = 0;
+	video->idle                = false;
+
+	obs_init_video_profile(&video->profile);
+	obs_gpu_timing_init(&video->gpu_timing);
 
 	errorcode = video_output_open(&video->video, &vi);
 
@@ -257,6 +411,14 @@ static bool obs_init_video(struct obs_video_info *ovi)
 		return false;
 	}
 
+	if (video->gpu_scaling)
+		video_output_set_external_scaler(video->video,
+				obs_scaled_output_supported, video);
+
+	video_output_set_clock(video->video, obs->master_clock);
+	video_output_set_job_system(video->video, obs->jobs);
+	apply_efficiency_mode(video);
+
 	if (!obs_display_init(&video->main_display, NULL))
 		return false;
 
@@ -264,14 +426,24 @@ static bool obs_init_video(struct obs_video_info *ovi)
 	video->main_display.cy = ovi->window_height;
 
 	gs_entercontext(video->graphics);
+	prev_owner = gs_set_memory_owner(video->gpu_owner);
 
 	if (ovi->gpu_conversion && !obs_init_gpu_conversion(ovi))
-		return false;
-	if (!obs_init_textures(ovi))
+		success = false;
+	else if (!obs_init_textures(ovi))
+		success = false;
+
+	gs_set_memory_owner(prev_owner);
+
+	if (!success)
 		return false;
 
 	gs_leavecontext();
 
+	/* gpu encoders can still use the main device without it */
+	if (ovi->separate_encode_device && !obs_init_encode_device(ovi))
+		blog(LOG_WARNING, "Encoding on the main graphics device");
+
 	errorcode = pthread_create(&video->video_thread, NULL,
 			obs_video_thread, obs);
 	if (errorcode != 0)
@@ -294,6 +466,7 @@ static void stop_video(void)
 		}
 	}
 
+	da_free(video->tick_pool.sources);
 }
 
 static void obs_free_video(void)
@@ -308,26 +481,47 @@ static void obs_free_video(void)
 		if (!video->graphics)
 			return;
 
+		obs_gpu_timing_free(&video->gpu_timing);
+		obs_free_encode_device();
+
 		gs_entercontext(video->graphics);
 
-		if (video->mapped_surface) {
-			stagesurface_unmap(video->mapped_surface);
-			video->mapped_surface = NULL;
+		obs_free_scaled_outputs(video);
+
+		obs_unmap_conversion_planes(video->mapped_surfaces);
+		video->mapped_surfaces = NULL;
+
+		for (size_t i = 0; i < MAX_NUM_STAGE_SURFACES; i++) {
+			for (size_t j = 0; j < MAX_CONVERSION_PLANES; j++) {
+				stagesurface_destroy(
+						video->copy_surfaces[i][j]);
+				video->copy_surfaces[i][j] = NULL;
+			}
 		}
 
-		for (size_t i = 0; i < NUM_TEXTURES; i++) {
-			stagesurface_destroy(video->copy_surfaces[i]);
+		for (size_t i = 0; i < MAX_NUM_TEXTURES; i++) {
 			texture_destroy(video->render_textures[i]);
-			texture_destroy(video->convert_textures[i]);
 			texture_destroy(video->output_textures[i]);
 			source_frame_free(&video->convert_frames[i]);
 
-			video->copy_surfaces[i]    = NULL;
+			for (size_t j = 0; j < MAX_CONVERSION_PLANES; j++) {
+				texture_destroy(video->convert_textures[i][j]);
+				video->convert_textures[i][j] = NULL;
+			}
+
 			video->render_textures[i]  = NULL;
-			video->convert_textures[i] = NULL;
 			video->output_textures[i]  = NULL;
 		}
 
+		for (size_t i = 0; i < video->num_downscale_levels; i++) {
+			texture_destroy(video->downscale_textures[i]);
+			video->downscale_textures[i] = NULL;
+		}
+
+		texture_destroy(video->separable_texture);
+		video->separable_texture    = NULL;
+		video->num_downscale_levels = 0;
+
 		gs_leavecontext();
 
 		video->cur_texture = 0;
@@ -341,14 +535,33 @@ static void obs_free_graphics(void)
 	if (video->graphics) {
 		gs_entercontext(video->graphics);
 
+		/* loaders can still queue uploads until they're stopped */
+		obs_stop_image_loaders();
+		obs_free_graphics_queue();
+		obs_free_image_cache();
+
 		effect_destroy(video->default_effect);
+		effect_destroy(video->default_rect_effect);
 		effect_destroy(video->conversion_effect);
-		video->default_effect = NULL;
+		effect_destroy(video->bicubic_effect);
+		effect_destroy(video->lanczos_effect);
+		effect_destroy(video->deinterlace_effect);
+		video->default_effect      = NULL;
+		video->default_rect_effect = NULL;
+		video->conversion_effect   = NULL;
+		memset(video->conversion_params, 0,
+				sizeof(video->conversion_params));
+		video->bicubic_effect      = NULL;
+		video->lanczos_effect      = NULL;
+		video->deinterlace_effect  = NULL;
 
 		gs_leavecontext();
 
 		gs_destroy(video->graphics);
 		video->graphics = NULL;
+
+		gs_memory_owner_destroy(video->gpu_owner);
+		video->gpu_owner = NULL;
 	}
 }
 
@@ -363,9 +576,11 @@ static bool obs_init_audio(struct audio_output_info *ai)
 	audio->present_volume = 1.0f;
 
 	errorcode = audio_output_open(&audio->audio, ai);
-	if (errorcode == AUDIO_OUTPUT_SUCCESS)
+	if (errorcode == AUDIO_OUTPUT_SUCCESS) {
+		audio_output_set_clock(audio->audio, obs->master_clock);
+		audio_output_set_job_system(audio->audio, obs->jobs);
 		return true;
-	else if (errorcode == AUDIO_OUTPUT_INVALIDPARAM)
+	} else if (errorcode == AUDIO_OUTPUT_INVALIDPARAM)
 		blog(LOG_ERROR, "Invalid audio parameters specified");
 	else
 		blog(LOG_ERROR, "Could not open audio output");
@@ -382,6 +597,8 @@ static void obs_free_audio(void)
 	memset(audio, 0, sizeof(struct obs_core_audio));
 }
 
+#define DEFAULT_SUSPEND_MEMORY_BUDGET (256ULL * 1024 * 1024)
+
 static bool obs_init_data(void)
 {
 	struct obs_core_data *data = &obs->data;
@@ -401,14 +618,28 @@ static bool obs_init_data(void)
 		goto fail;
 	if (pthread_mutex_init(&data->displays_mutex, &attr) != 0)
 		goto fail;
+	if (pthread_mutex_init(&data->canvases_mutex, &attr) != 0)
+		goto fail;
 	if (pthread_mutex_init(&data->outputs_mutex, &attr) != 0)
 		goto fail;
 	if (pthread_mutex_init(&data->encoders_mutex, &attr) != 0)
 		goto fail;
 	if (pthread_mutex_init(&data->services_mutex, &attr) != 0)
 		goto fail;
+	if (pthread_mutex_init(&data->gpu_encoders_mutex, &attr) != 0)
+		goto fail;
+	if (pthread_mutex_init(&data->tree_mutex, NULL) != 0)
+		goto fail;
 	if (!obs_view_init(&data->main_view))
 		goto fail;
+	if (!obs_mjpeg_pool_init(&data->mjpeg_pool))
+		goto fail;
+	if (!obs_rt_audio_pool_init(&data->rt_audio_pool))
+		goto fail;
+	if (!obs_preloader_init(&data->preloader))
+		goto fail;
+
+	data->suspend_memory_budget = DEFAULT_SUSPEND_MEMORY_BUDGET;
 
 	data->valid = true;
 
@@ -429,6 +660,13 @@ fail:
 					unfreed); \
 	} while (false)
 
+static void free_removed_source_names(struct obs_core_data *data)
+{
+	for (size_t i = 0; i < data->removed_source_names.num; i++)
+		bfree(data->removed_source_names.array[i]);
+	da_resize(data->removed_source_names, 0);
+}
+
 static void obs_free_data(void)
 {
 	struct obs_core_data *data = &obs->data;
@@ -437,15 +675,35 @@ static void obs_free_data(void)
 
 	obs_view_free(&data->main_view);
 
+	/* decode jobs hold references to sources */
+	obs_mjpeg_pool_free(&data->mjpeg_pool);
+	obs_rt_audio_pool_free(&data->rt_audio_pool);
+
 	blog(LOG_INFO, "Freeing OBS context data");
 
+	/* canvas views hold references to sources */
+	FREE_OBS_LINKED_LIST(canvas);
+
+	/* hides and releases the sources that were still preloaded */
+	obs_preloader_free(&data->preloader);
+
 	if (data->user_sources.num)
 		blog(LOG_INFO, "\t%d user source(s) were remaining",
 				(int)data->user_sources.num);
 
+	/* frames that are still waiting to be read back hold references to
+	 * the sources rendered in them */
+	obs_gpu_timing_free(&obs->video.gpu_timing);
+
 	while (data->user_sources.num)
 		obs_source_remove(data->user_sources.array[0]);
 	da_free(data->user_sources);
+	bfree(data->source_buckets);
+	data->source_buckets     = NULL;
+	data->num_source_buckets = 0;
+
+	free_removed_source_names(data);
+	da_free(data->removed_source_names);
 
 	FREE_OBS_LINKED_LIST(source);
 	FREE_OBS_LINKED_LIST(output);
@@ -456,9 +714,16 @@ static void obs_free_data(void)
 	pthread_mutex_destroy(&data->user_sources_mutex);
 	pthread_mutex_destroy(&data->sources_mutex);
 	pthread_mutex_destroy(&data->displays_mutex);
+	pthread_mutex_destroy(&data->canvases_mutex);
 	pthread_mutex_destroy(&data->outputs_mutex);
 	pthread_mutex_destroy(&data->encoders_mutex);
 	pthread_mutex_destroy(&data->services_mutex);
+	pthread_mutex_destroy(&data->gpu_encoders_mutex);
+	pthread_mutex_destroy(&data->tree_mutex);
+	da_free(data->gpu_encoders);
+	da_free(data->tick_sources);
+	da_free(data->threaded_tick_sources);
+	da_free(data->suspended_sources);
 }
 
 static const char *obs_signals[] = {
@@ -471,6 +736,8 @@ static const char *obs_signals[] = {
 	"void source_show(ptr source)",
 	"void source_hide(ptr source)",
 	"void source_volume(ptr source, in out float volume)",
+	"void source_audio_activate(ptr source)",
+	"void source_audio_deactivate(ptr source)",
 
 	"void channel_change(int channel, in out ptr source, ptr prev_source)",
 	"void master_volume(in out float volume)",
@@ -493,9 +760,44 @@ static inline bool obs_init_handlers(void)
 
 extern const struct obs_source_info scene_info;
 
+static bool obs_init_modules(void)
+{
+	pthread_mutexattr_t attr;
+	bool success = false;
+
+	/* modules may look up their own types while loading */
+	if (pthread_mutexattr_init(&attr) != 0)
+		return false;
+	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
+		goto fail;
+	if (pthread_mutex_init(&obs->module_mutex, &attr) != 0)
+		goto fail;
+
+	success = true;
+
+fail:
+	pthread_mutexattr_destroy(&attr);
+	return success;
+}
+
 static bool obs_init(void)
 {
 	obs = bzalloc(sizeof(struct obs_core));
+	obs->video.preview_enabled = true;
+	obs->video.reset_result    = true;
+
+	pthread_mutex_init_value(&obs->video.reset_mutex);
+	if (pthread_mutex_init(&obs->video.reset_mutex, NULL) != 0)
+		return false;
+
+	obs->jobs = job_system_create(0);
+	if (!obs->jobs)
+		blog(LOG_WARNING, "Failed to start the job system, jobs run "
+		                  "on the threads that use them");
+
+	pthread_mutex_init_value(&obs->module_mutex);
+	if (!obs_init_modules())
+		return false;
 
 	if (!obs_init_data())
 		return false;
@@ -527,12 +829,20 @@ void obs_shutdown(void)
 	if (!obs)
 		return;
 
+	obs_wait_video_reset();
+
 	da_free(obs->input_types);
 	da_free(obs->filter_types);
 	da_free(obs->encoder_types);
 	da_free(obs->transition_types);
 	da_free(obs->output_types);
 	da_free(obs->service_types);
+	obs_type_index_free(&obs->input_index);
+	obs_type_index_free(&obs->filter_index);
+	obs_type_index_free(&obs->transition_index);
+	obs_type_index_free(&obs->output_index);
+	obs_type_index_free(&obs->encoder_index);
+	obs_type_index_free(&obs->service_index);
 	da_free(obs->modal_ui_callbacks);
 	da_free(obs->modeless_ui_callbacks);
 
@@ -542,15 +852,30 @@ void obs_shutdown(void)
 	obs_free_video();
 	obs_free_graphics();
 	obs_free_audio();
+	bfree(obs->video.shader_cache_path);
 	proc_handler_destroy(obs->procs);
 	signal_handler_destroy(obs->signals);
 
+	/* list enumeration threads and jobs run module code */
+	obs_properties_free_list_caches();
+	job_system_destroy(obs->jobs);
+
 	for (size_t i = 0; i < obs->modules.num; i++)
 		free_module(obs->modules.array+i);
 	da_free(obs->modules);
 
+	for (size_t i = 0; i < obs->deferred_modules.num; i++)
+		free_module(obs->deferred_modules.array+i);
+	da_free(obs->deferred_modules);
+	pthread_mutex_destroy(&obs->module_mutex);
+
+	pthread_mutex_destroy(&obs->video.reset_mutex);
+	bfree(obs->video.reset_module);
 	bfree(obs);
 	obs = NULL;
+
+	profiler_free();
+	trace_free();
 }
 
 bool obs_initialized(void)
@@ -558,16 +883,15 @@ bool obs_initialized(void)
 	return obs != NULL;
 }
 
-bool obs_reset_video(struct obs_video_info *ovi)
+static bool reset_video(struct obs_video_info *ovi)
 {
-	if (!obs) return false;
+	struct obs_core_video *video = &obs->video;
+	struct obs_video_info info;
 
 	/* don't allow changing of video settings if active. */
-	if (obs->video.video && video_output_active(obs->video.video))
+	if (video->video && video_output_active(video->video))
 		return false;
 
-	struct obs_core_video *video = &obs->video;
-
 	/* align to multiple-of-two and SSE alignment sizes */
 	ovi->output_width  &= 0xFFFFFFFC;
 	ovi->output_height &= 0xFFFFFFFE;
@@ -580,10 +904,96 @@ bool obs_reset_video(struct obs_video_info *ovi)
 		return true;
 	}
 
-	if (!video->graphics && !obs_init_graphics(ovi))
+	/* the caller's settings are left as they were given */
+	info = *ovi;
+	if (info.pipeline_depth < NUM_TEXTURES ||
+	    info.pipeline_depth > MAX_NUM_TEXTURES)
+		info.pipeline_depth = NUM_TEXTURES;
+
+	if (!video->graphics && !obs_init_graphics(&info))
 		return false;
 
-	return obs_init_video(ovi);
+	return obs_init_video(&info);
+}
+
+bool obs_reset_video(struct obs_video_info *ovi)
+{
+	if (!obs) return false;
+
+	obs_wait_video_reset();
+	return reset_video(ovi);
+}
+
+static void *video_reset_thread(void *param)
+{
+	struct obs_core_video *video = param;
+
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "video reset");
+	video->reset_result = reset_video(&video->reset_info);
+	return NULL;
+}
+
+bool obs_reset_video_async(struct obs_video_info *ovi)
+{
+	struct obs_core_video *video;
+
+	if (!obs) return false;
+
+	obs_wait_video_reset();
+	video = &obs->video;
+
+#ifdef __APPLE__
+	video->reset_result = obs_reset_video(ovi);
+	return video->reset_result;
+#else
+	if (!ovi)
+		return obs_reset_video(ovi);
+
+	/* the caller's structure can be gone by the time the thread uses it */
+	bfree(video->reset_module);
+	video->reset_module                = bstrdup(ovi->graphics_module);
+	video->reset_info                  = *ovi;
+	video->reset_info.graphics_module  = video->reset_module;
+
+	pthread_mutex_lock(&video->reset_mutex);
+
+	if (pthread_create(&video->reset_thread, NULL, video_reset_thread,
+				video) != 0) {
+		pthread_mutex_unlock(&video->reset_mutex);
+		blog(LOG_WARNING, "obs_reset_video_async: Failed to create "
+		                  "the reset thread, resetting now");
+		video->reset_result = reset_video(&video->reset_info);
+		return video->reset_result;
+	}
+
+	video->reset_pending = true;
+	pthread_mutex_unlock(&video->reset_mutex);
+	return true;
+#endif
+}
+
+bool obs_wait_video_reset(void)
+{
+	struct obs_core_video *video;
+
+	if (!obs) return false;
+
+	video = &obs->video;
+	if (!video->reset_pending)
+		return video->reset_result;
+
+	/* the reset itself uses functions that wait for it */
+	if (pthread_equal(video->reset_thread, pthread_self()))
+		return true;
+
+	pthread_mutex_lock(&video->reset_mutex);
+	if (video->reset_pending) {
+		pthread_join(video->reset_thread, NULL);
+		video->reset_pending = false;
+	}
+	pthread_mutex_unlock(&video->reset_mutex);
+
+	return video->reset_result;
 }
 
 bool obs_reset_audio(struct audio_output_info *ai)
@@ -603,10 +1013,14 @@ bool obs_reset_audio(struct audio_output_info *ai)
 
 bool obs_get_video_info(struct obs_video_info *ovi)
 {
-	struct obs_core_video *video = &obs->video;
+	struct obs_core_video *video;
 	const struct video_output_info *info;
 
-	if (!obs || !video->graphics)
+	if (!obs || !obs_wait_video_reset())
+		return false;
+
+	video = &obs->video;
+	if (!video->graphics)
 		return false;
 
 	info = video_output_getinfo(video->video);
@@ -619,6 +1033,11 @@ bool obs_get_video_info(struct obs_video_info *ovi)
 	ovi->output_format = info->format;
 	ovi->fps_num       = info->fps_num;
 	ovi->fps_den       = info->fps_den;
+	ovi->pipeline_depth = (uint32_t)video->num_textures;
+	ovi->gpu_conversion = video->gpu_conversion;
+	ovi->gpu_scaling    = video->gpu_scaling;
+	ovi->scale_type     = video->scale_type;
+	ovi->output_scale_type = video->output_scale_type;
 
 	return true;
 }
@@ -641,6 +1060,8 @@ bool obs_enum_input_types(size_t idx, const char **id)
 {
 	if (!obs) return false;
 
+	if (idx == 0)
+		obs_load_deferred_kind(MODULE_TYPE_INPUT);
 	if (idx >= obs->input_types.num)
 		return false;
 	*id = obs->input_types.array[idx].id;
@@ -651,6 +1072,8 @@ bool obs_enum_filter_types(size_t idx, const char **id)
 {
 	if (!obs) return false;
 
+	if (idx == 0)
+		obs_load_deferred_kind(MODULE_TYPE_FILTER);
 	if (idx >= obs->filter_types.num)
 		return false;
 	*id = obs->filter_types.array[idx].id;
@@ -661,6 +1084,8 @@ bool obs_enum_transition_types(size_t idx, const char **id)
 {
 	if (!obs) return false;
 
+	if (idx == 0)
+		obs_load_deferred_kind(MODULE_TYPE_TRANSITION);
 	if (idx >= obs->transition_types.num)
 		return false;
 	*id = obs->transition_types.array[idx].id;
@@ -671,6 +1096,8 @@ bool obs_enum_output_types(size_t idx, const char **id)
 {
 	if (!obs) return false;
 
+	if (idx == 0)
+		obs_load_deferred_kind(MODULE_TYPE_OUTPUT);
 	if (idx >= obs->output_types.num)
 		return false;
 	*id = obs->output_types.array[idx].id;
@@ -681,6 +1108,8 @@ bool obs_enum_encoder_types(size_t idx, const char **id)
 {
 	if (!obs) return false;
 
+	if (idx == 0)
+		obs_load_deferred_kind(MODULE_TYPE_ENCODER);
 	if (idx >= obs->encoder_types.num)
 		return false;
 	*id = obs->encoder_types.array[idx].id;
@@ -691,6 +1120,8 @@ bool obs_enum_service_types(size_t idx, const char **id)
 {
 	if (!obs) return false;
 
+	if (idx == 0)
+		obs_load_deferred_kind(MODULE_TYPE_SERVICE);
 	if (idx >= obs->service_types.num)
 		return false;
 	*id = obs->service_types.array[idx].id;
@@ -699,7 +1130,10 @@ bool obs_enum_service_types(size_t idx, const char **id)
 
 graphics_t obs_graphics(void)
 {
-	return (obs != NULL) ? obs->video.graphics : NULL;
+	if (!obs) return NULL;
+
+	obs_wait_video_reset();
+	return obs->video.graphics;
 }
 
 audio_t obs_audio(void)
@@ -707,9 +1141,18 @@ audio_t obs_audio(void)
 	return (obs != NULL) ? obs->audio.audio : NULL;
 }
 
+audio_t obs_audio_mix(size_t mix_idx)
+{
+	return (obs != NULL) ?
+		audio_output_get_mix(obs->audio.audio, mix_idx) : NULL;
+}
+
 video_t obs_video(void)
 {
-	return (obs != NULL) ? obs->video.video : NULL;
+	if (!obs) return NULL;
+
+	obs_wait_video_reset();
+	return obs->video.video;
 }
 
 /* TODO: optimize this later so it's not just O(N) string lookups */
@@ -774,14 +1217,17 @@ void *obs_create_ui(const char *name, const char *task, const char *target,
 
 bool obs_add_source(obs_source_t source)
 {
-	struct calldata params = {0};
+	uint8_t stack[CALLDATA_FIXED_SIZE];
+	struct calldata params;
+	calldata_init_fixed(&params, stack, sizeof(stack));
 
 	if (!obs) return false;
 
-	pthread_mutex_lock(&obs->data.sources_mutex);
+	pthread_mutex_lock(&obs->data.user_sources_mutex);
 	da_push_back(obs->data.user_sources, &source);
+	obs_source_index_insert(source);
 	obs_source_addref(source);
-	pthread_mutex_unlock(&obs->data.sources_mutex);
+	pthread_mutex_unlock(&obs->data.user_sources_mutex);
 
 	calldata_setptr(&params, "source", source);
 	signal_handler_signal(obs->signals, "source_add", &params);
@@ -805,7 +1251,9 @@ void obs_set_output_source(uint32_t channel, obs_source_t source)
 
 	struct obs_source *prev_source;
 	struct obs_view *view = &obs->data.main_view;
-	struct calldata params = {0};
+	uint8_t stack[CALLDATA_FIXED_SIZE];
+	struct calldata params;
+	calldata_init_fixed(&params, stack, sizeof(stack));
 
 	pthread_mutex_lock(&view->channels_mutex);
 
@@ -824,8 +1272,10 @@ void obs_set_output_source(uint32_t channel, obs_source_t source)
 
 	pthread_mutex_unlock(&view->channels_mutex);
 
-	if (source)
+	if (source) {
 		obs_source_activate(source, MAIN_VIEW);
+		obs_view_consume_preload(view, channel, source);
+	}
 
 	if (prev_source) {
 		obs_source_deactivate(prev_source, MAIN_VIEW);
@@ -833,6 +1283,12 @@ void obs_set_output_source(uint32_t channel, obs_source_t source)
 	}
 }
 
+void obs_preload_output_source(uint32_t channel, obs_source_t source)
+{
+	if (!obs) return;
+	obs_view_preload(&obs->data.main_view, channel, source);
+}
+
 void obs_enum_sources(bool (*enum_proc)(void*, obs_source_t), void *param)
 {
 	if (!obs) return;
@@ -892,23 +1348,111 @@ void obs_enum_services(bool (*enum_proc)(void*, obs_service_t), void *param)
 			enum_proc, param);
 }
 
-obs_source_t obs_get_source_by_name(const char *name)
+#define SOURCE_INDEX_MIN_BUCKETS 64
+
+static inline const char *source_index_name(struct obs_source *source)
+{
+	return source->context.name ? source->context.name : "";
+}
+
+static inline struct obs_source **get_source_bucket(
+		struct obs_core_data *data, uint32_t hash)
+{
+	return &data->source_buckets[hash & (data->num_source_buckets - 1)];
+}
+
+/* sources are appended to the end of their bucket so that duplicate names
+ * resolve to the first added source, the same as a search of user_sources */
+static void source_bucket_append(struct obs_core_data *data,
+		struct obs_source *source)
+{
+	struct obs_source **bucket = get_source_bucket(data, source->name_hash);
+
+	while (*bucket)
+		bucket = &(*bucket)->name_next;
+
+	source->name_next = NULL;
+	*bucket = source;
+}
+
+static void source_index_resize(struct obs_core_data *data, size_t num_buckets)
+{
+	bfree(data->source_buckets);
+	data->source_buckets     = bzalloc(num_buckets *
+			sizeof(struct obs_source*));
+	data->num_source_buckets = num_buckets;
+
+	for (size_t i = 0; i < data->user_sources.num; i++) {
+		struct obs_source *source = data->user_sources.array[i];
+		if (source->name_indexed)
+			source_bucket_append(data, source);
+	}
+}
+
+void obs_source_index_insert(struct obs_source *source)
 {
 	struct obs_core_data *data = &obs->data;
+
+	source->name_hash    = hash_fnv1a(source_index_name(source));
+	source->name_indexed = true;
+
+	if (data->user_sources.num > data->num_source_buckets) {
+		/* resizing also indexes the new source */
+		source_index_resize(data, data->num_source_buckets ?
+				data->num_source_buckets * 2 :
+				SOURCE_INDEX_MIN_BUCKETS);
+		return;
+	}
+
+	source_bucket_append(data, source);
+}
+
+void obs_source_index_remove(struct obs_source *source)
+{
+	struct obs_core_data *data = &obs->data;
+	struct obs_source **bucket;
+
+	if (!source->name_indexed)
+		return;
+
+	bucket = get_source_bucket(data, source->name_hash);
+	while (*bucket) {
+		if (*bucket == source) {
+			*bucket = source->name_next;
+			break;
+		}
+
+		bucket = &(*bucket)->name_next;
+	}
+
+	source->name_next    = NULL;
+	source->name_indexed = false;
+}
+
+obs_source_t obs_get_source_by_name(const char *name)
+{
+	struct obs_core_data *data;
 	struct obs_source *source = NULL;
-	size_t i;
+	uint32_t hash;
 
-	if (!obs) return NULL;
+	if (!obs || !name) return NULL;
+
+	data = &obs->data;
+	hash = hash_fnv1a(name);
 
 	pthread_mutex_lock(&data->user_sources_mutex);
 
-	for (i = 0; i < data->user_sources.num; i++) {
-		struct obs_source *cur_source = data->user_sources.array[i];
-		if (strcmp(cur_source->context.name, name) == 0) {
-			source = cur_source;
+	if (data->num_source_buckets)
+		source = *get_source_bucket(data, hash);
+
+	while (source) {
+		if (source->name_hash == hash &&
+		    strcmp(source_index_name(source), name) == 0) {
 			obs_source_addref(source);
 			break;
 		}
+
+		source = source->name_next;
 	}
 
 	pthread_mutex_unlock(&data->user_sources_mutex);
@@ -961,12 +1505,69 @@ effect_t obs_get_default_effect(void)
 	return obs->video.default_effect;
 }
 
+effect_t obs_get_default_rect_effect(void)
+{
+	if (!obs) return NULL;
+	return obs->video.default_rect_effect;
+}
+
+void obs_set_shader_cache_path(const char *path)
+{
+	if (!obs) return;
+
+	bfree(obs->video.shader_cache_path);
+	obs->video.shader_cache_path = bstrdup(path);
+}
+
 signal_handler_t obs_signalhandler(void)
 {
 	if (!obs) return NULL;
 	return obs->signals;
 }
 
+/* the objects a signal refers to are only known to exist while it's being
+ * emitted, so a queued signal keeps them referenced until it's called.  a
+ * source or scene item emits from its destruction once nothing references
+ * it anymore, those can't be held and are passed as NULL. */
+static bool signal_hold(const char *signal, const char *param, void *ptr)
+{
+	UNUSED_PARAMETER(signal);
+
+	if (strcmp(param, "source") == 0 || strcmp(param, "prev_source") == 0)
+		return obs_source_try_addref(ptr);
+
+	if (strcmp(param, "scene") == 0)
+		return obs_source_try_addref(obs_scene_getsource(ptr));
+
+	if (strcmp(param, "item") == 0)
+		return obs_sceneitem_try_addref(ptr);
+
+	return true;
+}
+
+static void signal_release(const char *param, void *ptr)
+{
+	if (strcmp(param, "source") == 0 || strcmp(param, "prev_source") == 0)
+		obs_source_release(ptr);
+	else if (strcmp(param, "scene") == 0)
+		obs_source_release(obs_scene_getsource(ptr));
+	else if (strcmp(param, "item") == 0)
+		obs_sceneitem_release(ptr);
+}
+
+signal_queue_t obs_signal_queue_create(bool dispatch_thread)
+{
+	signal_queue_t queue = signal_queue_create(dispatch_thread);
+	signal_queue_set_hold(queue, signal_hold, signal_release);
+	return queue;
+}
+
+job_system_t obs_job_system(void)
+{
+	if (!obs) return NULL;
+	return obs->jobs;
+}
+
 proc_handler_t obs_prochandler(void)
 {
 	if (!obs) return NULL;
@@ -979,6 +1580,7 @@ void obs_add_draw_callback(
 {
 	if (!obs) return;
 
+	obs_wait_video_reset();
 	obs_display_add_draw_callback(&obs->video.main_display, draw, param);
 }
 
@@ -988,24 +1590,100 @@ void obs_remove_draw_callback(
 {
 	if (!obs) return;
 
+	obs_wait_video_reset();
 	obs_display_remove_draw_callback(&obs->video.main_display, draw, param);
 }
 
 void obs_resize(uint32_t cx, uint32_t cy)
 {
-	if (!obs || !obs->video.video || !obs->video.graphics) return;
+	if (!obs || !obs_wait_video_reset()) return;
+	if (!obs->video.video || !obs->video.graphics) return;
 	obs_display_resize(&obs->video.main_display, cx, cy);
 }
 
 void obs_render_main_view(void)
 {
 	if (!obs) return;
+
+	obs_wait_video_reset();
 	obs_view_render(&obs->data.main_view);
 }
 
+void obs_set_preview_fps(uint32_t fps)
+{
+	if (!obs) return;
+	obs->video.preview_interval_ns = fps ? 1000000000ULL / fps : 0;
+}
+
+void obs_set_preview_enabled(bool enable)
+{
+	if (!obs) return;
+	obs->video.preview_enabled = enable;
+}
+
+bool obs_preview_enabled(void)
+{
+	return obs ? obs->video.preview_enabled : false;
+}
+
+void obs_set_efficiency_mode(bool enable)
+{
+	if (!obs) return;
+
+	obs_wait_video_reset();
+	obs->video.efficiency_mode = enable;
+	apply_efficiency_mode(&obs->video);
+}
+
+bool obs_efficiency_mode(void)
+{
+	return obs ? obs->video.efficiency_mode : false;
+}
+
+void obs_set_master_clock(media_clock_t clock)
+{
+	if (!obs) return;
+
+	obs_wait_video_reset();
+	obs->master_clock = clock;
+	video_output_set_clock(obs->video.video, clock);
+	audio_output_set_clock(obs->audio.audio, clock);
+}
+
+media_clock_t obs_get_master_clock(void)
+{
+	return obs ? obs->master_clock : NULL;
+}
+
+void obs_set_suspend_memory_budget(uint64_t bytes)
+{
+	if (!obs) return;
+
+	pthread_mutex_lock(&obs->data.sources_mutex);
+	obs->data.suspend_memory_budget = bytes;
+	pthread_mutex_unlock(&obs->data.sources_mutex);
+}
+
+uint64_t obs_get_suspend_memory_budget(void)
+{
+	return obs ? obs->data.suspend_memory_budget : 0;
+}
+
+void obs_get_video_gpu_memory(struct gs_memory_usage *usage)
+{
+	if (!usage) return;
+
+	if (obs && obs->video.gpu_owner)
+		gs_memory_owner_get_usage(obs->video.gpu_owner, usage);
+	else
+		memset(usage, 0, sizeof(struct gs_memory_usage));
+}
+
 void obs_set_master_volume(float volume)
 {
-	struct calldata data = {0};
+	uint8_t stack[CALLDATA_FIXED_SIZE];
+	struct calldata data;
+	calldata_init_fixed(&data, stack, sizeof(stack));
 
 	if (!obs) return;
 
@@ -1033,32 +1711,147 @@ float obs_get_present_volume(void)
 	return obs ? obs->audio.present_volume : 0.0f;
 }
 
+bool obs_get_audio_levels(size_t mix_idx, struct audio_levels *levels)
+{
+	if (!obs) return false;
+	return audio_output_get_levels(
+			audio_output_get_mix(obs->audio.audio, mix_idx),
+			levels);
+}
+
+#define MAX_LOAD_THREADS 8
+
+struct source_load {
+	obs_data_t                      source_data;
+	obs_data_t                      settings;
+	const char                      *name;
+	const char                      *id;
+	bool                            threaded;
+	obs_source_t                    source;
+};
+
+struct source_loader {
+	DARRAY(struct source_load)      loads;
+	DARRAY(struct source_load*)     threaded_loads;
+	volatile long                   next_threaded;
+};
+
+static void create_loaded_source(struct source_load *load)
+{
+	obs_source_t source = obs_source_create(OBS_SOURCE_TYPE_INPUT,
+			load->id, load->name, load->settings);
+
+	if (source) {
+		obs_source_set_audio_mixers(source, (uint32_t)
+				obs_data_getint(load->source_data, "mixers"));
+		obs_source_set_async_unbuffered(source,
+				obs_data_getbool(load->source_data,
+					"unbuffered"));
+
+		/* loaded sources match what was saved */
+		source->save_pending = false;
+		obs_data_clear_dirty(source->context.settings);
+	}
+
+	load->source = source;
+}
+
+static void *load_thread(void *param)
+{
+	struct source_loader *loader = param;
+	long idx;
+
+	while ((idx = os_atomic_inc_long(&loader->next_threaded) - 1) <
+			(long)loader->threaded_loads.num)
+		create_loaded_source(loader->threaded_loads.array[idx]);
+
+	return NULL;
+}
+
+static void create_loaded_sources(struct source_loader *loader)
+{
+	pthread_t threads[MAX_LOAD_THREADS];
+	size_t    num_threads = 0;
+	size_t    max_threads = (size_t)os_get_logical_cores();
+
+	if (max_threads > MAX_LOAD_THREADS)
+		max_threads = MAX_LOAD_THREADS;
+	if (max_threads > loader->threaded_loads.num)
+		max_threads = loader->threaded_loads.num;
+
+	while (num_threads < max_threads) {
+		if (pthread_create(threads+num_threads, NULL, load_thread,
+					loader) != 0)
+			break;
+		num_threads++;
+	}
+
+	for (size_t i = 0; i < loader->loads.num; i++) {
+		struct source_load *load = loader->loads.array+i;
+		if (!load->threaded)
+			create_loaded_source(load);
+	}
+
+	/* helps out with whatever's left, or creates all of them if no
+	 * threads could be created */
+	load_thread(loader);
+
+	for (size_t i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+}
+
+/*
+ * Sources are all created before any of them are loaded, so the scenes can
+ * find their items no matter what order the sources were saved in.  Creating
+ * the sources doesn't depend on any other source, so the ones that support
+ * it are created on worker threads while the rest are created on this one.
+ */
 void obs_load_sources(obs_data_array_t array)
 {
+	struct source_loader loader = {0};
 	size_t count;
 	size_t i;
 
 	if (!obs) return;
 
 	count = obs_data_array_count(array);
+	da_reserve(loader.loads, count);
 
-	pthread_mutex_lock(&obs->data.user_sources_mutex);
+	for (i = 0; i < count; i++) {
+		struct source_load *load = da_push_back_new(loader.loads);
+		uint32_t flags;
+
+		load->source_data = obs_data_array_item(array, i);
+		load->name     = obs_data_getstring(load->source_data, "name");
+		load->id       = obs_data_getstring(load->source_data, "id");
+		load->settings = obs_data_getobj(load->source_data, "settings");
+
+		obs_data_set_default_int(load->source_data, "mixers", 1);
+
+		flags = obs_get_source_output_flags(OBS_SOURCE_TYPE_INPUT,
+				load->id);
+		load->threaded = (flags & OBS_SOURCE_THREADED_CREATE) != 0;
+	}
 
 	for (i = 0; i < count; i++) {
-		obs_data_t source_data = obs_data_array_item(array, i);
+		struct source_load *load = loader.loads.array+i;
+		if (load->threaded)
+			da_push_back(loader.threaded_loads, &load);
+	}
 
-		const char *name    = obs_data_getstring(source_data, "name");
-		const char *id      = obs_data_getstring(source_data, "id");
-		obs_data_t settings = obs_data_getobj(source_data, "settings");
-		obs_source_t source;
+	create_loaded_sources(&loader);
 
-		source = obs_source_create(OBS_SOURCE_TYPE_INPUT, id, name,
-				settings);
-		obs_add_source(source);
-		obs_source_release(source);
+	pthread_mutex_lock(&obs->data.user_sources_mutex);
+
+	/* added in the saved order, so the source list stays the same */
+	for (i = 0; i < count; i++) {
+		struct source_load *load = loader.loads.array+i;
 
-		obs_data_release(settings);
-		obs_data_release(source_data);
+		obs_add_source(load->source);
+		obs_source_release(load->source);
+
+		obs_data_release(load->settings);
+		obs_data_release(load->source_data);
 	}
 
 	/* tell sources that we want to load */
@@ -1066,6 +1859,9 @@ void obs_load_sources(obs_data_array_t array)
 		obs_source_load(obs->data.user_sources.array[i]);
 
 	pthread_mutex_unlock(&obs->data.user_sources_mutex);
+
+	da_free(loader.threaded_loads);
+	da_free(loader.loads);
 }
 
 static void save_source_data(obs_data_array_t array, obs_source_t source)
@@ -1080,6 +1876,10 @@ static void save_source_data(obs_data_array_t array, obs_source_t source)
 	obs_data_setstring(source_data, "name",     name);
 	obs_data_setstring(source_data, "id",       id);
 	obs_data_setobj   (source_data, "settings", settings);
+	obs_data_setint   (source_data, "mixers",
+			(long long)obs_source_get_audio_mixers(source));
+	obs_data_setbool  (source_data, "unbuffered",
+			obs_source_async_unbuffered(source));
 
 	obs_data_array_push_back(array, source_data);
 
@@ -1102,13 +1902,81 @@ obs_data_array_t obs_save_sources(void)
 		obs_source_t source = obs->data.user_sources.array[i];
 		obs_source_save(source);
 		save_source_data(array, source);
+
+		source->save_pending = false;
+		obs_data_clear_dirty(source->context.settings);
 	}
 
 	pthread_mutex_unlock(&obs->data.user_sources_mutex);
 
+	pthread_mutex_lock(&obs->data.sources_mutex);
+	free_removed_source_names(&obs->data);
+	pthread_mutex_unlock(&obs->data.sources_mutex);
+
+	return array;
+}
+
+static obs_data_array_t save_removed_source_names(void)
+{
+	struct obs_core_data *data = &obs->data;
+	obs_data_array_t array = obs_data_array_create();
+
+	pthread_mutex_lock(&data->sources_mutex);
+
+	for (size_t i = 0; i < data->removed_source_names.num; i++) {
+		obs_data_t name_data = obs_data_create();
+		obs_data_setstring(name_data, "name",
+				data->removed_source_names.array[i]);
+		obs_data_array_push_back(array, name_data);
+		obs_data_release(name_data);
+	}
+
+	free_removed_source_names(data);
+
+	pthread_mutex_unlock(&data->sources_mutex);
 	return array;
 }
 
+obs_data_t obs_save_source_changes(void)
+{
+	obs_data_array_t sources;
+	obs_data_array_t removed;
+	obs_data_t       changes = NULL;
+
+	if (!obs) return NULL;
+
+	sources = obs_data_array_create();
+
+	pthread_mutex_lock(&obs->data.user_sources_mutex);
+
+	for (size_t i = 0; i < obs->data.user_sources.num; i++) {
+		obs_source_t source = obs->data.user_sources.array[i];
+		obs_source_save(source);
+
+		if (source->save_pending ||
+		    obs_data_is_dirty(source->context.settings)) {
+			save_source_data(sources, source);
+
+			source->save_pending = false;
+			obs_data_clear_dirty(source->context.settings);
+		}
+	}
+
+	pthread_mutex_unlock(&obs->data.user_sources_mutex);
+
+	removed = save_removed_source_names();
+
+	if (obs_data_array_count(sources) || obs_data_array_count(removed)) {
+		changes = obs_data_create();
+		obs_data_setarray(changes, "removed", removed);
+		obs_data_setarray(changes, "sources", sources);
+	}
+
+	obs_data_array_release(removed);
+	obs_data_array_release(sources);
+	return changes;
+}
+
 /* ensures that names are never blank */
 static inline char *dup_name(const char *name)
 {
@@ -1150,6 +2018,10 @@ bool obs_context_data_init(
 		obs_data_t              settings,
 		const char              *name)
 {
+	/* sources, outputs and encoders use the graphics context and the
+	 * video output from their create callbacks on */
+	obs_wait_video_reset();
+
 	if (obs_context_data_init_wrap(context, settings, name)) {
 		return true;
 	} else {
@@ -19,6 +19,9 @@
 
 #include "util/c99defs.h"
 #include "util/bmem.h"
+#include "util/profiler.h"
+#include "util/trace.h"
+#include "util/job-system.h"
 #include "graphics/graphics.h"
 #include "graphics/vec2.h"
 #include "media-io/audio-io.h"
@@ -40,6 +43,8 @@ struct obs_scene_item;
 struct obs_output;
 struct obs_encoder;
 struct obs_service;
+struct obs_image;
+struct obs_canvas;
 
 typedef struct obs_display    *obs_display_t;
 typedef struct obs_view       *obs_view_t;
@@ -49,6 +54,8 @@ typedef struct obs_scene_item *obs_sceneitem_t;
 typedef struct obs_output     *obs_output_t;
 typedef struct obs_encoder    *obs_encoder_t;
 typedef struct obs_service    *obs_service_t;
+typedef struct obs_image      *obs_image_t;
+typedef struct obs_canvas     *obs_canvas_t;
 
 #include "obs-source.h"
 #include "obs-encoder.h"
@@ -91,6 +98,38 @@ enum allow_direct_render {
 	ALLOW_DIRECT_RENDERING,
 };
 
+/**
+ * Deinterlacing applied to the asynchronous video of a source.  The 2x modes
+ * output each field of a frame separately, doubling the frame rate.
+ */
+enum obs_deinterlace_mode {
+	OBS_DEINTERLACE_MODE_DISABLE,
+	OBS_DEINTERLACE_MODE_BOB,
+	OBS_DEINTERLACE_MODE_LINEAR,
+	OBS_DEINTERLACE_MODE_YADIF,
+	OBS_DEINTERLACE_MODE_BOB_2X,
+	OBS_DEINTERLACE_MODE_LINEAR_2X,
+	OBS_DEINTERLACE_MODE_YADIF_2X
+};
+
+/**
+ * Whether a source is rendered once per frame to a texture that is drawn
+ * every time the source is drawn in that frame.  In auto mode (the default),
+ * the cache is used while the source is drawn more than once per frame.
+ * Disable it for sources that must be rendered at the size they are drawn.
+ */
+enum obs_render_cache_mode {
+	OBS_RENDER_CACHE_AUTO,
+	OBS_RENDER_CACHE_ALWAYS,
+	OBS_RENDER_CACHE_DISABLED
+};
+
+/** Which field of an interlaced frame was captured first */
+enum obs_deinterlace_field_order {
+	OBS_DEINTERLACE_FIELD_ORDER_TOP,
+	OBS_DEINTERLACE_FIELD_ORDER_BOTTOM
+};
+
 /**
  * Video initialization structure
  */
@@ -117,10 +156,53 @@ struct obs_video_info {
 	/** Video adapter index to use (NOTE: avoid for optimus laptops) */
 	uint32_t            adapter;
 
-	struct gs_window    window;        /**< Window to render to */
+	/**
+	 * Window to render to.  If zeroed, the graphics module creates a
+	 * headless device that doesn't need a display server, and the main
+	 * display is never rendered.
+	 */
+	struct gs_window    window;
 
 	/** Use shaders to convert to different color formats */
 	bool                gpu_conversion;
+
+	/**
+	 * Number of frames that can be in flight between rendering and
+	 * readback.  Higher values give the GPU more time to finish copies
+	 * before they're mapped, at the cost of latency.  Values outside of
+	 * 2-4 use the default (2).
+	 */
+	uint32_t            pipeline_depth;
+
+	/**
+	 * Render the scaled/converted video that encoders request on the GPU
+	 * instead of scaling the output frame on the CPU.  Only I420 and NV12
+	 * requests with default color settings are rendered on the GPU.
+	 */
+	bool                gpu_scaling;
+
+	/** Filter used for GPU scaling (bicubic if default) */
+	enum video_scale_type scale_type;
+
+	/**
+	 * Filter used to scale the base canvas to the output size.  Default,
+	 * point and fast bilinear draw it in a single bilinear pass.  Area
+	 * and bilinear first halve it through a chain of textures until it's
+	 * less than twice the output size, and bicubic and lanczos then
+	 * finish in two separable passes.
+	 */
+	enum video_scale_type output_scale_type;
+
+	/**
+	 * Run GPU encoders on a second, headless device on encode_adapter,
+	 * so that encoding doesn't compete with rendering.  The output frame
+	 * is copied to it through system memory, which adds a pipeline depth
+	 * of latency.  Falls back to the main device if it can't be created.
+	 */
+	bool                separate_encode_device;
+
+	/** Adapter index of the encode device */
+	uint32_t            encode_adapter;
 };
 
 /**
@@ -175,7 +257,12 @@ struct source_frame {
 /* ------------------------------------------------------------------------- */
 /* OBS context */
 
-/** Initializes OBS */
+/**
+ * Initializes OBS
+ *
+ *   The priority and CPU affinity of the threads libobs starts can be set
+ * beforehand with os_set_thread_policy in util/threading.h.
+ */
 EXPORT bool obs_startup(void);
 
 /** Releases all data associated with OBS and terminates the OBS context */
@@ -191,6 +278,27 @@ EXPORT bool obs_initialized(void);
  */
 EXPORT bool obs_reset_video(struct obs_video_info *ovi);
 
+/**
+ * Same as obs_reset_video, except that the graphics device and the video
+ * pipeline are created on another thread, so that modules can be loaded and
+ * settings parsed in the meantime.  Functions that need the graphics context
+ * or the video output (obs_graphics, obs_video, creating sources, outputs,
+ * encoders or displays, ...) wait for it to finish first.
+ *
+ *   The window in @ovi has to stay valid until then.  Returns false if the
+ * reset couldn't be started, use obs_wait_video_reset for the result.
+ *
+ * @note On Mac OSX the reset is done before this returns, as the OpenGL
+ *       context of a view can only be set up from the main thread.
+ */
+EXPORT bool obs_reset_video_async(struct obs_video_info *ovi);
+
+/**
+ * Waits for a reset started by obs_reset_video_async.  Returns whether it
+ * succeeded, or true if none was started.
+ */
+EXPORT bool obs_wait_video_reset(void);
+
 /**
  * Sets base audio output format/channels/samples/etc
  *
@@ -213,6 +321,22 @@ EXPORT bool obs_get_audio_info(struct audio_output_info *ai);
  */
 EXPORT int obs_load_module(const char *path);
 
+/**
+ * Loads a set of plugin modules, using a manifest of the types each module
+ * registers.
+ *
+ *   Modules that are listed in the manifest and haven't changed since are not
+ * loaded until one of their types is created or looked up, or until the types
+ * of that kind are enumerated.  The remaining modules are opened in parallel
+ * and then loaded in order, and the manifest is updated with their types.
+ *
+ * @param  paths          Module names, as with obs_load_module
+ * @param  count          Number of modules
+ * @param  manifest_path  Manifest file to use, or NULL to load all modules
+ */
+EXPORT void obs_load_modules(const char **paths, size_t count,
+		const char *manifest_path);
+
 /**
  * Enumerates all available inputs source types.
  *
@@ -249,9 +373,22 @@ EXPORT bool obs_enum_service_types(size_t idx, const char **id);
 /** Gets the main graphics context for this OBS context */
 EXPORT graphics_t obs_graphics(void);
 
+/**
+ * Gets the graphics context GPU encoders encode on, which is the encode
+ * device if obs_video_info::separate_encode_device is used, or the main
+ * graphics context otherwise.  GPU encoders create their resources on it.
+ */
+EXPORT graphics_t obs_encode_graphics(void);
+
 /** Gets the main audio output handler for this OBS context */
 EXPORT audio_t obs_audio(void);
 
+/**
+ * Gets the audio output of a mix bus (track), see audio_output_info::mixes.
+ * Mix 0 is the same as obs_audio.  Returns NULL if the bus doesn't exist.
+ */
+EXPORT audio_t obs_audio_mix(size_t mix_idx);
+
 /** Gets the main video output handler for this OBS context */
 EXPORT video_t obs_video(void);
 
@@ -268,6 +405,17 @@ EXPORT bool obs_add_source(obs_source_t source);
 /** Sets the primary output source for a channel. */
 EXPORT void obs_set_output_source(uint32_t channel, obs_source_t source);
 
+/**
+ * Preloads a source that's about to be set as the primary output source of a
+ * channel.  The source is shown on a background thread, so anything it
+ * starts or loads when shown is ready by the time it's switched to with
+ * obs_set_output_source.  It isn't rendered or activated until then.
+ *
+ *   Only one source can be preloaded per channel; preloading another source
+ * ends the previous preload.  Passing NULL ends the preload.
+ */
+EXPORT void obs_preload_output_source(uint32_t channel, obs_source_t source);
+
 /**
  * Gets the primary output source for a channel and increments the reference
  * counter for that source.  Use obs_source_release to release.
@@ -323,9 +471,45 @@ EXPORT char *obs_find_plugin_file(const char *file);
 /** Returns the default effect for generic RGB/YUV drawing */
 EXPORT effect_t obs_get_default_effect(void);
 
+/**
+ * Returns the default effect for drawing GL_TEXTURE_RECTANGLE textures, such
+ * as the ones created with gs_create_texture_from_iosurface.  Only available
+ * on Mac OSX, returns NULL elsewhere.
+ */
+EXPORT effect_t obs_get_default_rect_effect(void);
+
+/**
+ * Sets the directory used to cache compiled shaders, or NULL to disable the
+ * cache.  Takes effect the next time the graphics subsystem is created, so
+ * call this before obs_reset_video.
+ */
+EXPORT void obs_set_shader_cache_path(const char *path);
+
 /** Returns the primary obs signal handler */
 EXPORT signal_handler_t obs_signalhandler(void);
 
+/**
+ * Creates a signal queue for signal_handler_connect_queued that keeps the
+ * sources and scene items of the signals it queues referenced until they're
+ * called, so they're still valid on the thread that calls them.
+ *
+ *   Destroy it with signal_queue_destroy before obs_shutdown, after
+ * disconnecting its callbacks.
+ *
+ * @param  dispatch_thread  If true, calls the queued signals on a thread of
+ *                          its own.  Otherwise they're called by
+ *                          signal_queue_dispatch, for example from the UI
+ *                          thread after its wakeup callback is called.
+ */
+EXPORT signal_queue_t obs_signal_queue_create(bool dispatch_thread);
+
+/**
+ * Returns the job system shared by libobs and plugins, for short CPU work
+ * that can run in parallel, or NULL if it couldn't be started.  Jobs still
+ * queued when obs_shutdown is called are run before modules are unloaded.
+ */
+EXPORT job_system_t obs_job_system(void);
+
 /** Returns the primary obs procedure handler */
 EXPORT proc_handler_t obs_prochandler(void);
 
@@ -345,6 +529,92 @@ EXPORT void obs_resize(uint32_t cx, uint32_t cy);
 /** Renders the main view */
 EXPORT void obs_render_main_view(void);
 
+/**
+ * Limits how often the main view and the other displays are redrawn, 0 to
+ * redraw them every output frame (the default).  Displays never redraw
+ * faster than the output.
+ */
+EXPORT void obs_set_preview_fps(uint32_t fps);
+
+/**
+ * Enables or disables the main view.  While disabled, its draw callbacks
+ * are not called at all, so nothing is rendered for it.
+ */
+EXPORT void obs_set_preview_enabled(bool enable);
+
+/** Returns whether the main view is enabled */
+EXPORT bool obs_preview_enabled(void);
+
+/**
+ * Efficiency mode, for unattended machines that mostly output static
+ * content.  Once the main view has stayed unchanged for a few frames, the
+ * output frame isn't rendered, staged or downloaded again until something
+ * changes: the video output repeats the last frame as a duplicate (see
+ * encoder_frame::duplicate), and the displays are only redrawn once a
+ * second.  The video output also switches to VIDEO_PACING_COALESCED, so it
+ * only wakes up once per frame.
+ *
+ *   Sources are still ticked every frame, and extra canvases and GPU scaled
+ * outputs keep rendering (the pipeline doesn't go idle while there are
+ * scaled outputs).  Kept when video is reset.
+ */
+EXPORT void obs_set_efficiency_mode(bool enable);
+EXPORT bool obs_efficiency_mode(void);
+
+/**
+ * Sets an external clock (for example from a capture device or a PTP
+ * client) that drives the frame cadence, and that audio is resampled to.
+ * NULL goes back to the system clock.  The clock must stay valid until
+ * it's been replaced or obs has been shut down.
+ */
+EXPORT void obs_set_master_clock(media_clock_t clock);
+
+/** Returns the current master clock, or NULL for the system clock */
+EXPORT media_clock_t obs_get_master_clock(void);
+
+/**
+ * Sets how much GPU memory (in bytes) input sources that aren't shown
+ * anywhere may keep.  Sources that aren't shown are suspended: they aren't
+ * ticked and their frames are dropped.  Once the suspended sources use more
+ * memory than this, the sources suspended first have their textures
+ * released (and their suspend callbacks called) until they're within it.
+ * 0 releases them all as soon as they're suspended.
+ */
+EXPORT void obs_set_suspend_memory_budget(uint64_t bytes);
+
+/** Gets the memory budget of suspended sources */
+EXPORT uint64_t obs_get_suspend_memory_budget(void);
+
+/**
+ * Gets the estimated GPU memory of the video output itself (render, output
+ * and conversion textures, stage surfaces and scaled outputs).  The usage of
+ * all graphics resources can be had with gs_get_memory_usage.
+ */
+EXPORT void obs_get_video_gpu_memory(struct gs_memory_usage *usage);
+
+/** Stages of the video pipeline that are timed on the GPU */
+enum obs_gpu_stage {
+	OBS_GPU_STAGE_RENDER_MAIN,
+	OBS_GPU_STAGE_RENDER_OUTPUT,
+	OBS_GPU_STAGE_CONVERT,
+	OBS_GPU_STAGE_SCALED_OUTPUTS,
+	OBS_GPU_STAGE_CANVASES,
+	OBS_GPU_STAGE_DISPLAYS,
+
+	OBS_GPU_STAGE_COUNT
+};
+
+/**
+ * Gets how long the GPU took to execute a stage of the video pipeline in the
+ * last frame that was measured.
+ *
+ *   GPU time is only measured while the profiler or tracing is enabled, and
+ * only if the graphics module supports timer queries.  The results are read
+ * back a few frames late, so measuring never waits for the GPU.  Each stage
+ * is also added to the "gpu_*" profile points, and traced as a counter.
+ */
+EXPORT double obs_get_gpu_stage_time_ms(enum obs_gpu_stage stage);
+
 /** Sets the master user volume */
 EXPORT void obs_set_master_volume(float volume);
 
@@ -357,12 +627,27 @@ EXPORT float obs_get_master_volume(void);
 /** Gets the master presentation volume */
 EXPORT float obs_get_present_volume(void);
 
+/**
+ * Gets the peak and RMS levels of the last mix of a mix bus (0 is the main
+ * mix).  Doesn't lock, so it's safe to poll at display rate.
+ */
+EXPORT bool obs_get_audio_levels(size_t mix_idx, struct audio_levels *levels);
+
 /** Loads sources from a data array */
 EXPORT void obs_load_sources(obs_data_array_t array);
 
 /** Saves sources to a data array */
 EXPORT obs_data_array_t obs_save_sources(void);
 
+/**
+ * Saves only what changed since sources were last saved or loaded (by either
+ * this function or obs_save_sources).  Returns NULL if nothing changed,
+ * otherwise an object with a "sources" array in the same format as
+ * obs_save_sources, and a "removed" array of objects with the "name" of each
+ * source that was removed or renamed.  Apply "removed" before "sources".
+ */
+EXPORT obs_data_t obs_save_source_changes(void);
+
 
 /* ------------------------------------------------------------------------- */
 /* View context */
@@ -382,6 +667,13 @@ EXPORT void obs_view_destroy(obs_view_t view);
 EXPORT void obs_view_setsource(obs_view_t view, uint32_t channel,
 		obs_source_t source);
 
+/**
+ * Preloads a source that's about to be set as the source of a channel of
+ * this view context, see obs_preload_output_source.
+ */
+EXPORT void obs_view_preload(obs_view_t view, uint32_t channel,
+		obs_source_t source);
+
 /** Gets the source currently in use for this view context */
 EXPORT obs_source_t obs_view_getsource(obs_view_t view,
 		uint32_t channel);
@@ -390,6 +682,44 @@ EXPORT obs_source_t obs_view_getsource(obs_view_t view,
 EXPORT void obs_view_render(obs_view_t view);
 
 
+/* ------------------------------------------------------------------------- */
+/* Canvases */
+
+struct obs_canvas_info {
+	uint32_t            fps_num;       /**< Canvas FPS numerator */
+	uint32_t            fps_den;       /**< Canvas FPS denominator */
+
+	uint32_t            base_width;    /**< Compositing width */
+	uint32_t            base_height;   /**< Compositing height */
+
+	/** Output size, or 0 to use the base size */
+	uint32_t            output_width;
+	uint32_t            output_height;
+};
+
+/**
+ * Creates an additional video mix.
+ *
+ *   A canvas renders its own view at its own resolution and frame rate,
+ * using the same graphics device and source ticks as the main output.  Its
+ * frames are output as RGBA through obs_canvas_video, which encoders can be
+ * connected to with obs_encoder_set_video.  The canvas frame rate can't be
+ * higher than the main frame rate, and canvases must be destroyed before
+ * obs_reset_video is called with NULL.
+ */
+EXPORT obs_canvas_t obs_canvas_create(const struct obs_canvas_info *info);
+EXPORT void obs_canvas_destroy(obs_canvas_t canvas);
+
+/** Gets the view used to set the sources of a canvas */
+EXPORT obs_view_t obs_canvas_view(obs_canvas_t canvas);
+
+/** Gets the video output of a canvas */
+EXPORT video_t obs_canvas_video(obs_canvas_t canvas);
+
+EXPORT bool obs_canvas_get_info(obs_canvas_t canvas,
+		struct obs_canvas_info *info);
+
+
 /* ------------------------------------------------------------------------- */
 /* Display context */
 
@@ -408,6 +738,17 @@ EXPORT void obs_display_destroy(obs_display_t display);
 /** Changes the size of this display */
 EXPORT void obs_display_resize(obs_display_t display, uint32_t cx, uint32_t cy);
 
+/**
+ * Sets whether the display can currently be seen.  The owner should hide
+ * the display while its window is minimized, hidden or fully covered.
+ * Hidden displays (and displays with a size of zero) are not rendered and
+ * their draw callbacks are not called.
+ */
+EXPORT void obs_display_set_visible(obs_display_t display, bool visible);
+
+/** Returns whether the display is visible */
+EXPORT bool obs_display_visible(obs_display_t display);
+
 /**
  * Adds a draw callback for this display context
  *
@@ -460,6 +801,33 @@ EXPORT bool obs_source_removed(obs_source_t source);
  */
 EXPORT uint32_t obs_source_get_output_flags(obs_source_t source);
 
+/**
+ * Gets the estimated GPU memory used by the source: the resources its
+ * callbacks created, and the textures libobs keeps for it.  Resources shared
+ * between sources (such as the render targets used by filters) aren't
+ * included.
+ */
+EXPORT bool obs_source_get_gpu_memory(obs_source_t source,
+		struct gs_memory_usage *usage);
+
+/**
+ * Gets how long the GPU took to render the source in the last frame that was
+ * measured, including everything drawn within it (its filters, and the
+ * sources of a scene).  Returns 0 if the source wasn't rendered recently, or
+ * if GPU time isn't being measured, see obs_get_gpu_stage_time_ms.
+ */
+EXPORT double obs_source_get_gpu_time_ms(obs_source_t source);
+
+/**
+ * Gets the GPU time of only the filter's own pass in the last frame that was
+ * measured, without the sources and filters it's applied to.
+ */
+EXPORT double obs_filter_get_gpu_pass_time_ms(obs_source_t filter);
+
+/** Gets the output flags of a source type, or 0 if it doesn't exist */
+EXPORT uint32_t obs_get_source_output_flags(enum obs_source_type type,
+		const char *id);
+
 /** Gets the default settings for a source type */
 EXPORT obs_data_t obs_get_source_defaults(enum obs_source_type type,
 		const char *id);
@@ -478,9 +846,36 @@ EXPORT obs_properties_t obs_source_properties(obs_source_t source,
 /** Updates settings for this source */
 EXPORT void obs_source_update(obs_source_t source, obs_data_t settings);
 
-/** Renders a video source. */
+/**
+ * Renders a video source.  A source that is rendered more than once per
+ * frame (for example by a scene and a preview) is only rendered the first
+ * time, and its cached texture is drawn after that, see
+ * obs_source_set_render_cache_mode.
+ */
 EXPORT void obs_source_video_render(obs_source_t source);
 
+/**
+ * Renders the current asynchronous video frame of a source.  Lets async
+ * sources with their own video_render callback (and OBS_SOURCE_CUSTOM_DRAW)
+ * fall back to the default async rendering when they aren't drawing
+ * anything themselves.
+ */
+EXPORT void obs_source_render_async_video(obs_source_t source);
+
+/**
+ * Notifies libobs that the video of a source with OBS_SOURCE_STATIC_VIDEO
+ * has changed for a reason other than a settings update.
+ */
+EXPORT void obs_source_content_changed(obs_source_t source);
+
+/**
+ * Gets a value that changes whenever the rendered video of the source (and
+ * its filters) changes.  Returns false if the video can change at any time,
+ * in which case it must be rendered every frame.
+ */
+EXPORT bool obs_source_get_content_revision(obs_source_t source,
+		uint64_t *revision);
+
 /** Gets the width of a source (if it has video) */
 EXPORT uint32_t obs_source_getwidth(obs_source_t source);
 
@@ -506,6 +901,17 @@ EXPORT void obs_source_filter_setorder(obs_source_t source, obs_source_t filter,
 /** Gets the settings string for a source */
 EXPORT obs_data_t obs_source_getsettings(obs_source_t source);
 
+/**
+ * Gets the current settings snapshot of a source, without locking.
+ *
+ *   The snapshot is an immutable copy of the settings which is replaced as a
+ * whole whenever the source is updated.  It's only meant to be used from the
+ * graphics thread, must not be modified or released, and stays valid until
+ * the next video tick of the source.  Use obs_source_getsettings anywhere
+ * else.
+ */
+EXPORT obs_data_t obs_source_get_settings_snapshot(obs_source_t source);
+
 /** Gets the name of a source */
 EXPORT const char *obs_source_getname(obs_source_t source);
 
@@ -540,6 +946,66 @@ EXPORT void obs_source_set_sync_offset(obs_source_t source, int64_t offset);
 /** Gets the audio sync offset (in nanoseconds) for a source */
 EXPORT int64_t obs_source_get_sync_offset(obs_source_t source);
 
+/**
+ * Sets which audio mix buses (tracks) a source is mixed in to, one bit per
+ * bus.  Defaults to the main mix only (1).
+ */
+EXPORT void obs_source_set_audio_mixers(obs_source_t source, uint32_t mixers);
+
+/** Gets the audio mix buses a source is mixed in to */
+EXPORT uint32_t obs_source_get_audio_mixers(obs_source_t source);
+
+/** Sets whether a source uses the per-frame render cache */
+EXPORT void obs_source_set_render_cache_mode(obs_source_t source,
+		enum obs_render_cache_mode mode);
+
+/** Gets whether a source uses the per-frame render cache */
+EXPORT enum obs_render_cache_mode obs_source_get_render_cache_mode(
+		obs_source_t source);
+
+/** Sets the deinterlacing mode used for the async video of a source */
+EXPORT void obs_source_set_deinterlace_mode(obs_source_t source,
+		enum obs_deinterlace_mode mode);
+
+/** Gets the deinterlacing mode used for the async video of a source */
+EXPORT enum obs_deinterlace_mode obs_source_get_deinterlace_mode(
+		obs_source_t source);
+
+/** Sets the field order of the interlaced async video of a source */
+EXPORT void obs_source_set_deinterlace_field_order(obs_source_t source,
+		enum obs_deinterlace_field_order field_order);
+
+/** Gets the field order of the interlaced async video of a source */
+EXPORT enum obs_deinterlace_field_order obs_source_get_deinterlace_field_order(
+		obs_source_t source);
+
+/**
+ * Returns whether a source's audio is currently audible.  The source emits
+ * the audio_activate and audio_deactivate signals when this changes, silent
+ * and muted audio is not mixed.
+ */
+EXPORT bool obs_source_audio_active(obs_source_t source);
+
+/**
+ * Gets the peak and RMS levels of the audio a source most recently output,
+ * after its volume has been applied.  Doesn't lock, so it's safe to poll at
+ * display rate.
+ */
+EXPORT bool obs_source_get_audio_levels(obs_source_t source,
+		struct audio_levels *levels);
+
+/**
+ * Sets whether a source's async video is unbuffered.  Unbuffered sources
+ * always display the newest frame as soon as it arrives rather than pacing
+ * frames by their timestamps, and any older queued frames are dropped.  This
+ * gives the lowest latency for live cameras at the cost of smoothness.
+ */
+EXPORT void obs_source_set_async_unbuffered(obs_source_t source,
+		bool unbuffered);
+
+/** Returns whether a source's async video is unbuffered */
+EXPORT bool obs_source_async_unbuffered(obs_source_t source);
+
 /** Enumerates child sources used by this source */
 EXPORT void obs_source_enum_sources(obs_source_t source,
 		obs_source_enum_proc_t enum_callback,
@@ -572,14 +1038,73 @@ EXPORT void obs_source_load(obs_source_t source);
 /* ------------------------------------------------------------------------- */
 /* Functions used by sources */
 
-/** Outputs asynchronous video data */
+/**
+ * Outputs asynchronous video data (the frame data is copied).
+ *
+ * Async frames are queued without locking, so a source must only output
+ * video from one thread at a time.  Frames in the planar 444/422 formats
+ * are output formats only, and are dropped.
+ */
 EXPORT void obs_source_output_video(obs_source_t source,
 		const struct source_frame *frame);
 
+/**
+ * Gets a frame from the source's frame cache to write video data into, so it
+ * can be output with obs_source_output_video_direct without a copy.
+ * Allocates a new frame if no unused frame of that format/size is cached.
+ */
+EXPORT struct source_frame *obs_source_allocframe(obs_source_t source,
+		enum video_format format, uint32_t width, uint32_t height);
+
+/**
+ * Outputs asynchronous video data and takes ownership of the frame.  The
+ * frame must come from obs_source_allocframe or source_frame_create, and
+ * must not be used by the caller afterward.
+ */
+EXPORT void obs_source_output_video_direct(obs_source_t source,
+		struct source_frame *frame);
+
+/**
+ * Outputs an MJPEG compressed video frame (the data is copied).
+ *
+ *   The frame is decoded on the decode threads shared by all sources, and
+ * output as async video in the order the frames were submitted.  Frames are
+ * dropped while too many frames of the source are still being decoded.  A
+ * source must not output other video while its MJPEG frames are decoding.
+ */
+EXPORT void obs_source_output_mjpeg(obs_source_t source, const void *data,
+		size_t size, uint64_t timestamp);
+
 /** Outputs audio data (always asynchronous) */
 EXPORT void obs_source_output_audio(obs_source_t source,
 		const struct source_audio *audio);
 
+/**
+ * Prepares a source to output audio from a real-time thread (such as an
+ * audio device callback) with obs_source_output_rt_audio.  The audio always
+ * has the given format, and no more than max_frames frames per call.
+ * Replaces the previous ring of the source, if any.
+ */
+EXPORT bool obs_source_init_rt_audio(obs_source_t source,
+		enum audio_format format, enum speaker_layout speakers,
+		uint32_t samples_per_sec, uint32_t max_frames);
+
+/**
+ * Frees the real-time audio ring of the source.  The real-time thread must
+ * no longer output audio when this is called.
+ */
+EXPORT void obs_source_free_rt_audio(obs_source_t source);
+
+/**
+ * Outputs audio from a real-time thread without allocating or locking.  The
+ * audio is copied to a lock-free ring, then output (resampled and filtered
+ * as with obs_source_output_audio) on a libobs thread.  Returns false if
+ * the audio was dropped because the ring is full.
+ */
+EXPORT bool obs_source_output_rt_audio(obs_source_t source,
+		const uint8_t *const data[], uint32_t frames,
+		uint64_t timestamp);
+
 /** Gets the current async video frame */
 EXPORT struct source_frame *obs_source_getframe(obs_source_t source);
 
@@ -587,6 +1112,15 @@ EXPORT struct source_frame *obs_source_getframe(obs_source_t source);
 EXPORT void obs_source_releaseframe(obs_source_t source,
 		struct source_frame *frame);
 
+/** Returns the number of async video frames waiting to be displayed */
+EXPORT uint32_t obs_source_get_async_queue_depth(obs_source_t source);
+
+/**
+ * Returns the number of async video frames that were dropped, either because
+ * the frame queue was full or because they were too late to be displayed
+ */
+EXPORT uint32_t obs_source_get_async_frames_dropped(obs_source_t source);
+
 /** Default RGB filter handler for generic effect filters */
 EXPORT void obs_source_process_filter(obs_source_t filter, effect_t effect,
 		uint32_t width, uint32_t height, enum gs_color_format format,
@@ -615,9 +1149,122 @@ EXPORT void obs_transition_begin_frame(obs_source_t transition);
  */
 EXPORT void obs_source_set_transition_vol(obs_source_t source, float vol);
 
+/**
+ * Same as obs_source_set_transition_vol for a direct child of the
+ * transition, but only looks up the child in the tree already fetched by
+ * obs_transition_begin_frame.
+ */
+EXPORT void obs_transition_set_child_vol(obs_source_t transition,
+		obs_source_t child, float vol);
+
 /** Ends transition frame and applies new presentation volumes to all sources */
 EXPORT void obs_transition_end_frame(obs_source_t transition);
 
+/**
+ * Freezes a child of a transition.
+ *
+ *   The next time the child is drawn with obs_transition_render_child it's
+ * rendered in to a texture, and afterwards only that texture is drawn, so a
+ * static outgoing scene isn't rendered again on every frame of the
+ * transition.  Only one child can be frozen at a time.  Must be called from
+ * the graphics thread, such as from the video_tick or video_render callback
+ * of the transition.
+ */
+EXPORT void obs_transition_freeze(obs_source_t transition, obs_source_t child);
+EXPORT void obs_transition_unfreeze(obs_source_t transition);
+
+/** Draws a child of a transition, from its texture if it's frozen */
+EXPORT void obs_transition_render_child(obs_source_t transition,
+		obs_source_t child);
+
+
+/* ------------------------------------------------------------------------- */
+/* Graphics queue */
+
+typedef void (*obs_graphics_task_t)(void *param);
+
+/**
+ * Queues a task to be run within the graphics context.
+ *
+ *   Tasks and queued texture operations are run in the order they were
+ * queued, on the video thread before displays and outputs are rendered.
+ * Sources can use this instead of entering the graphics context from their
+ * own threads.
+ */
+EXPORT void obs_queue_graphics_task(obs_graphics_task_t task, void *param);
+
+/**
+ * Queues an upload of new image data to a texture.  The data is copied, so
+ * it can be reused immediately.  Returns false if the upload was dropped
+ * because too much data is already waiting.
+ */
+EXPORT bool obs_queue_texture_setimage(texture_t tex, const void *data,
+		uint32_t linesize, uint32_t height, bool flip);
+
+/**
+ * Queues an update of a sub-rectangle of a texture.  @data holds @cy rows of
+ * @linesize bytes and is copied.  Region updates are only supported by some
+ * graphics modules, see texture_setimage_region.
+ */
+EXPORT bool obs_queue_texture_setimage_region(texture_t tex, const void *data,
+		uint32_t linesize, uint32_t x, uint32_t y,
+		uint32_t cx, uint32_t cy);
+
+/** Queues the destruction of a texture */
+EXPORT void obs_queue_texture_destroy(texture_t tex);
+
+
+/* ------------------------------------------------------------------------- */
+/* Image cache */
+
+/**
+ * Gets a shared image for a file, loading it if necessary.
+ *
+ *   Images are cached by path and modification time, so sources that show
+ * the same file share one texture, and a changed file is loaded again.
+ * Small images are packed into shared atlas textures unless disabled with
+ * obs_set_image_atlas_enabled.  Returns NULL if the file could not be
+ * loaded.
+ */
+EXPORT obs_image_t obs_image_get(const char *path);
+
+/**
+ * Same as obs_image_get, but returns without waiting for the image to load.
+ *
+ *   The file is decoded on a loader thread and uploaded by the graphics
+ * thread.  Until then the image has no size or texture and isn't drawn,
+ * use obs_image_loaded to check for it.  Returns NULL only if the file
+ * doesn't exist.
+ */
+EXPORT obs_image_t obs_image_get_async(const char *path);
+EXPORT void obs_image_release(obs_image_t image);
+
+/** Returns true once the image is loaded and can be drawn */
+EXPORT bool obs_image_loaded(obs_image_t image);
+
+EXPORT uint32_t obs_image_getwidth(obs_image_t image);
+EXPORT uint32_t obs_image_getheight(obs_image_t image);
+
+/**
+ * Returns the texture of the image.  For packed images this is the atlas
+ * texture, so use obs_image_draw to draw the image itself.
+ */
+EXPORT texture_t obs_image_gettexture(obs_image_t image);
+
+/** Draws the image with the "image" parameter of the effect */
+EXPORT void obs_image_draw(obs_image_t image, effect_t effect);
+
+/** Enables or disables packing of newly loaded small images into atlases */
+EXPORT void obs_set_image_atlas_enabled(bool enabled);
+
+/**
+ * Enables or disables block compression of newly loaded images that are too
+ * large for the atlases.  Opaque images are stored as DXT1 and images with
+ * alpha as DXT5, with mipmaps for drawing them scaled down.  This uses 4 to
+ * 8 times less video memory, but is lossy, so it's disabled by default.
+ */
+EXPORT void obs_set_image_compression_enabled(bool enabled);
+
 
 /* ------------------------------------------------------------------------- */
 /* Scenes */
@@ -648,6 +1295,18 @@ EXPORT void obs_scene_enum_items(obs_scene_t scene,
 		bool (*callback)(obs_scene_t, obs_sceneitem_t, void*),
 		void *param);
 
+/**
+ * Enables or disables caching of the scene.
+ *
+ *   A cached scene is rendered to a texture, which is reused for as long as
+ * its items, their transforms, and the content of their sources stay the
+ * same.  Caching is only used while every source of the scene has
+ * OBS_SOURCE_STATIC_VIDEO (or is a scene that can be cached), so it's
+ * mostly useful for overlay scenes.
+ */
+EXPORT void obs_scene_set_cached(obs_scene_t scene, bool cached);
+EXPORT bool obs_scene_cached(obs_scene_t scene);
+
 /** Adds/creates a new scene item for a source */
 EXPORT obs_sceneitem_t obs_scene_add(obs_scene_t scene, obs_source_t source);
 
@@ -678,6 +1337,29 @@ EXPORT float obs_sceneitem_getrot(obs_sceneitem_t item);
 EXPORT void  obs_sceneitem_getorigin(obs_sceneitem_t item, struct vec2 *center);
 EXPORT void  obs_sceneitem_getscale(obs_sceneitem_t item, struct vec2 *scale);
 
+/** Pixels cut off each side of the source of a scene item */
+struct obs_sceneitem_crop {
+	int left;
+	int top;
+	int right;
+	int bottom;
+};
+
+/**
+ * Crops the source of a scene item.
+ *
+ *   The position of the item refers to the top left of what's left of the
+ * source.  Sources drawn as sprites (without filters or custom drawing) are
+ * cropped by their texture coordinates, so cropping costs nothing extra.
+ * Other sources are clipped with a scissor rect, which is only possible when
+ * the scene is drawn directly (not nested in another scene), and which
+ * clips rotated items to their bounding box.
+ */
+EXPORT void obs_sceneitem_setcrop(obs_sceneitem_t item,
+		const struct obs_sceneitem_crop *crop);
+EXPORT void obs_sceneitem_getcrop(obs_sceneitem_t item,
+		struct obs_sceneitem_crop *crop);
+
 
 /* ------------------------------------------------------------------------- */
 /* Outputs */
@@ -701,6 +1383,18 @@ EXPORT bool obs_output_start(obs_output_t output);
 /** Stops the output. */
 EXPORT void obs_output_stop(obs_output_t output);
 
+/**
+ * Stops the output on a thread of its own, so the caller doesn't have to
+ * wait for the final data to be flushed and the connection or file to be
+ * closed.  The "stop" signal is sent from that thread once it's done.
+ * Starting, stopping or destroying the output in the meantime waits for the
+ * stop to finish.
+ */
+EXPORT void obs_output_stop_async(obs_output_t output);
+
+/** Returns whether an asynchronous stop is still in progress */
+EXPORT bool obs_output_stopping(obs_output_t output);
+
 /** Returns whether the output is active */
 EXPORT bool obs_output_active(obs_output_t output);
 
@@ -755,6 +1449,18 @@ EXPORT video_t obs_output_video(obs_output_t output);
 /** Returns the audio media context associated with this output */
 EXPORT audio_t obs_output_audio(obs_output_t output);
 
+/**
+ * Sets whether the output may share encoders with other outputs (enabled by
+ * default).  When an encoded output starts while another encoder with the
+ * same type, settings and input is already running, the output uses that
+ * encoder in place of its own for as long as it's active, rather than
+ * encoding the same data twice; obs_output_get_video_encoder and
+ * obs_output_get_audio_encoder then return the shared encoder.  Outputs
+ * that change the settings of their encoders while active (e.g. to adapt the
+ * bitrate) should disable this before they start.
+ */
+EXPORT void obs_output_set_share_encoders(obs_output_t output, bool share);
+
 /**
  * Sets the current video encoder associated with this output,
  * required for encoded outputs
@@ -769,12 +1475,25 @@ EXPORT void obs_output_set_video_encoder(obs_output_t output,
 EXPORT void obs_output_set_audio_encoder(obs_output_t output,
 		obs_encoder_t encoder);
 
+/**
+ * Sets the audio encoder of an audio track of this output.  Track 0 is the
+ * same as obs_output_set_audio_encoder, other tracks can only be set on
+ * outputs with the OBS_OUTPUT_MULTI_TRACK flag.  Each track needs its own
+ * encoder; an encoder already used by another track is rejected.
+ */
+EXPORT void obs_output_set_audio_encoder_track(obs_output_t output,
+		obs_encoder_t encoder, size_t track);
+
 /** Returns the current video encoder associated with this output */
 EXPORT obs_encoder_t obs_output_get_video_encoder(obs_output_t output);
 
 /** Returns the current audio encoder associated with this output */
 EXPORT obs_encoder_t obs_output_get_audio_encoder(obs_output_t output);
 
+/** Returns the audio encoder of an audio track of this output */
+EXPORT obs_encoder_t obs_output_get_audio_encoder_track(obs_output_t output,
+		size_t track);
+
 /** Sets the current service associated with this output. */
 EXPORT void obs_output_set_service(obs_output_t output, obs_service_t service);
 
@@ -875,7 +1594,8 @@ EXPORT obs_properties_t obs_encoder_properties(obs_encoder_t encoder,
 
 /**
  * Updates the settings of the encoder context.  Usually used for changing
- * bitrate while active
+ * bitrate while active.  Can be called from any thread, it waits for a frame
+ * being encoded to finish before the new settings are applied.
  */
 EXPORT void obs_encoder_update(obs_encoder_t encoder, obs_data_t settings);
 
@@ -892,6 +1612,107 @@ EXPORT void obs_encoder_set_video(obs_encoder_t encoder, video_t video);
 /** Sets the audio output context to be used with this encoder */
 EXPORT void obs_encoder_set_audio(obs_encoder_t encoder, audio_t audio);
 
+/**
+ * Returns the procedure handler for an encoder.  Video encoders provide:
+ *
+ *   void get_queue_latency(out int latency_ns)
+ *       time the last encoded frame waited in the encoder's queue
+ *   void get_frames_skipped(out int frames_skipped)
+ *       frames skipped because the encoder fell behind
+ */
+EXPORT proc_handler_t obs_encoder_prochandler(obs_encoder_t encoder);
+
+/**
+ * Sets the resolution a video encoder encodes at, scaled from the video
+ * output.  Encoders with the same scaled size share the scaled frames, so
+ * several renditions of one output only scale each size once.  0 uses the
+ * video output size.  Must be set before the encoder is started.
+ */
+EXPORT void obs_encoder_set_scaled_size(obs_encoder_t encoder, uint32_t width,
+		uint32_t height);
+
+/**
+ * Makes a video encoder only encode every Nth frame of the video output,
+ * e.g. 2 for a 30fps recording from a 60fps output.  The skipped frames are
+ * not scaled either, and the encoder's timebase is adjusted to match (see
+ * obs_encoder_get_frame_rate_divisor).  Must be set before the encoder is
+ * started.
+ */
+EXPORT void obs_encoder_set_frame_rate_divisor(obs_encoder_t encoder,
+		uint32_t divisor);
+
+/**
+ * Returns the frame rate divisor of a video encoder.  Encoders should divide
+ * the video output's frame rate by it (i.e. multiply fps_den).
+ */
+EXPORT uint32_t obs_encoder_get_frame_rate_divisor(obs_encoder_t encoder);
+
+/**
+ * Asks a video encoder to make the next frame it encodes a keyframe, e.g.
+ * after a reconnect or at a segment boundary, instead of restarting the
+ * encoder.  Safe to call from any thread.  Texture encoders are not told.
+ */
+EXPORT void obs_encoder_request_keyframe(obs_encoder_t encoder);
+
+/**
+ * Creates the encoder's context ahead of time.  Outputs initialize their
+ * encoders when they start, and keep a context created this way as long as
+ * it hasn't encoded anything yet and the encoder's settings, media, scaled
+ * size and frame rate divisor haven't changed since, so the encoder and its
+ * headers don't have to be created while starting.
+ */
+EXPORT bool obs_encoder_initialize(obs_encoder_t encoder);
+
+/**
+ * Initializes the encoder and keeps it encoding, discarding the packets, so
+ * outputs can start without waiting for the encoder to be created.  An
+ * output that starts with a running encoder begins at the next keyframe,
+ * which is requested right away.  The media (see obs_encoder_set_video and
+ * obs_encoder_set_audio) must be set first.
+ */
+EXPORT bool obs_encoder_prewarm(obs_encoder_t encoder);
+
+/** Stops the encoding started by obs_encoder_prewarm */
+EXPORT void obs_encoder_end_prewarm(obs_encoder_t encoder);
+
+/** Returns whether the encoder is being kept encoding by obs_encoder_prewarm */
+EXPORT bool obs_encoder_prewarmed(obs_encoder_t encoder);
+
+/**
+ * Encodes a frame with an initialized encoder directly, for encoders that
+ * are driven by something other than the libobs pipeline (such as the
+ * separate process of the encoder host plugin).  Must not be used while the
+ * encoder is active.  The packet's data belongs to the encoder and is valid
+ * until the next call, and SEI data is not added to the first packet, see
+ * obs_encoder_get_sei_data.
+ */
+EXPORT bool obs_encoder_encode(obs_encoder_t encoder,
+		struct encoder_frame *frame, struct encoder_packet *packet,
+		bool *received_packet);
+
+/** Returns the SEI data of an initialized encoder, if it has any */
+EXPORT bool obs_encoder_get_sei_data(obs_encoder_t encoder,
+		uint8_t **sei_data, size_t *size);
+
+/**
+ * Returns the sample rate an audio encoder encodes at, which is also the
+ * timebase of its packets.  Before the encoder is initialized, this is the
+ * rate of its audio output.
+ */
+EXPORT uint32_t obs_encoder_get_sample_rate(obs_encoder_t encoder);
+
+/**
+ * Returns the frames per packet of an initialized audio encoder, or 0 if it
+ * isn't initialized
+ */
+EXPORT size_t obs_encoder_get_frame_size(obs_encoder_t encoder);
+
+/** Returns the width a video encoder encodes at */
+EXPORT uint32_t obs_encoder_get_width(obs_encoder_t encoder);
+
+/** Returns the height a video encoder encodes at */
+EXPORT uint32_t obs_encoder_get_height(obs_encoder_t encoder);
+
 /**
  * Returns the video output context used with this encoder, or NULL if not
  * a video context
@@ -910,6 +1731,25 @@ EXPORT void obs_duplicate_encoder_packet(struct encoder_packet *dst,
 
 EXPORT void obs_free_encoder_packet(struct encoder_packet *packet);
 
+/**
+ * Creates a reference counted copy of an encoder packet.  The packet data is
+ * immutable from then on, and must be released with
+ * obs_encoder_packet_release.
+ */
+EXPORT void obs_encoder_packet_create_instance(struct encoder_packet *dst,
+		const struct encoder_packet *src);
+
+/**
+ * Adds a reference to a reference counted encoder packet, such as the packets
+ * passed to obs_output_info::encoded_packet.  Both packets share the same
+ * data.
+ */
+EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst,
+		struct encoder_packet *src);
+
+/** Releases a reference to a reference counted encoder packet */
+EXPORT void obs_encoder_packet_release(struct encoder_packet *packet);
+
 
 /* ------------------------------------------------------------------------- */
 /* Stream Services */
@@ -0,0 +1,590 @@
+/*
+ * Copyright (c) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bmem.h"
+#include "base.h"
+#include "dstr.h"
+#include "darray.h"
+#include "platform.h"
+#include "threading.h"
+#include "circlebuf-spsc.h"
+#include "async-log.h"
+
+#define RING_SIZE          (64 * 1024)
+#define MAX_MESSAGE_SIZE   4096
+#define WRITE_INTERVAL_MS  10
+#define REPEAT_INTERVAL_NS 1000000000ULL
+
+/*
+ * Each thread that logs gets a ring, which it's the only producer of.  The
+ * writer thread is the consumer of all rings, and async_log_flush consumes
+ * them as well, so consuming is serialized with write_mutex.  When a
+ * thread exits its ring is marked as exited, and the writer frees it once
+ * everything in it has been written.
+ */
+
+struct log_header {
+	uint64_t           ts;
+	int                level;
+	uint32_t           size;
+};
+
+struct log_ring {
+	struct circlebuf_spsc buf;
+
+	/* only used by the thread the ring belongs to */
+	char               last_msg[MAX_MESSAGE_SIZE];
+	int                last_level;
+	uint64_t           last_time;
+	unsigned long      repeats;
+
+	/* set once the thread has exited, nothing is pushed after that */
+	volatile long      exited;
+};
+
+struct log_entry {
+	uint64_t           ts;
+	int                level;
+	size_t             offset;
+};
+
+struct async_log {
+	struct async_log_info info;
+	struct dstr        path;
+	FILE               *file;
+	uint64_t           file_size;
+
+	pthread_t          thread;
+	os_event_t         stop_event;
+	bool               active;
+
+	pthread_mutex_t    rings_mutex;
+	DARRAY(struct log_ring*) rings;
+	pthread_key_t      ring_key;
+	bool               ring_key_created;
+
+	/* consuming the rings and writing the entries */
+	pthread_mutex_t    write_mutex;
+	DARRAY(struct log_entry) entries;
+	DARRAY(char)       text;
+	long               dropped_reported;
+
+	volatile long      dropped;
+
+	/* threads inside the handler (or a ring destructor).  once accepting
+	 * is cleared, stopping waits for the count to reach 0 before anything
+	 * is freed */
+	volatile long      accepting;
+	volatile long      users;
+};
+
+static struct async_log async_log = {0};
+
+/* incremented when the log is stopped, so threads know their ring is gone */
+static volatile long generation = 1;
+
+#ifdef _MSC_VER
+static __declspec(thread) struct log_ring *thread_ring = NULL;
+static __declspec(thread) long thread_generation = 0;
+#else
+static __thread struct log_ring *thread_ring = NULL;
+static __thread long thread_generation = 0;
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* logging threads */
+
+static struct log_ring *create_ring(void)
+{
+	struct log_ring *ring = bzalloc(sizeof(struct log_ring));
+
+	if (!circlebuf_spsc_init(&ring->buf, RING_SIZE)) {
+		bfree(ring);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&async_log.rings_mutex);
+	da_push_back(async_log.rings, &ring);
+	pthread_mutex_unlock(&async_log.rings_mutex);
+
+	pthread_setspecific(async_log.ring_key, ring);
+	return ring;
+}
+
+static inline bool enter_log(void)
+{
+	os_atomic_inc_long(&async_log.users);
+	if (os_atomic_load_long(&async_log.accepting))
+		return true;
+
+	os_atomic_dec_long(&async_log.users);
+	return false;
+}
+
+static inline void leave_log(void)
+{
+	os_atomic_dec_long(&async_log.users);
+}
+
+static void destroy_ring(struct log_ring *ring)
+{
+	circlebuf_spsc_free(&ring->buf);
+	bfree(ring);
+}
+
+/* called when a thread that has a ring exits */
+static void ring_thread_exit(void *param)
+{
+	struct log_ring *ring = param;
+
+	if (!enter_log())
+		return;
+
+	/* anything logged after this point gets a new ring */
+	if (thread_ring == ring) {
+		thread_ring       = NULL;
+		thread_generation = 0;
+	}
+
+	os_atomic_set_long(&ring->exited, 1);
+	leave_log();
+}
+
+static inline struct log_ring *get_thread_ring(void)
+{
+	long cur_generation = os_atomic_load_long(&generation);
+
+	if (thread_generation != cur_generation) {
+		thread_generation = cur_generation;
+		thread_ring       = create_ring();
+	}
+
+	return thread_ring;
+}
+
+static void push_message(struct log_ring *ring, int level, uint64_t ts,
+		const char *msg)
+{
+	uint8_t           data[sizeof(struct log_header) + MAX_MESSAGE_SIZE];
+	struct log_header header;
+	size_t            len = strlen(msg);
+
+	if (len >= MAX_MESSAGE_SIZE)
+		len = MAX_MESSAGE_SIZE - 1;
+
+	header.ts    = ts;
+	header.level = level;
+	header.size  = (uint32_t)len + 1;
+
+	memcpy(data, &header, sizeof(header));
+	memcpy(data + sizeof(header), msg, len);
+	data[sizeof(header) + len] = 0;
+
+	if (!circlebuf_spsc_push_back(&ring->buf, data,
+				sizeof(header) + header.size))
+		os_atomic_inc_long(&async_log.dropped);
+}
+
+static void push_repeats(struct log_ring *ring, uint64_t ts)
+{
+	char msg[64];
+
+	if (!ring->repeats)
+		return;
+
+	snprintf(msg, sizeof(msg), "(last message repeated %lu times)",
+			ring->repeats);
+	push_message(ring, ring->last_level, ts, msg);
+	ring->repeats = 0;
+}
+
+static void log_message(int level, const char *format, va_list args)
+{
+	struct log_ring *ring;
+	char            msg[MAX_MESSAGE_SIZE];
+	uint64_t        now;
+
+	if (level > async_log.info.level)
+		return;
+
+	vsnprintf(msg, sizeof(msg), format, args);
+
+	if (async_log.info.sync_output)
+		async_log.info.sync_output(level, msg, async_log.info.param);
+
+	ring = get_thread_ring();
+	if (!ring) {
+		os_atomic_inc_long(&async_log.dropped);
+		return;
+	}
+
+	now = os_gettime_ns();
+
+	/* the message is logged again once a second while it's repeating,
+	 * so the log still shows that it's ongoing */
+	if (level == ring->last_level && strcmp(msg, ring->last_msg) == 0 &&
+	    now - ring->last_time < REPEAT_INTERVAL_NS) {
+		ring->repeats++;
+		return;
+	}
+
+	push_repeats(ring, now);
+	push_message(ring, level, now, msg);
+
+	strcpy(ring->last_msg, msg);
+	ring->last_level = level;
+	ring->last_time  = now;
+}
+
+/* a thread can still be in here after the log has been stopped and the
+ * default handler restored, in which case the message is dropped */
+static void async_log_handler(int level, const char *format, va_list args,
+		void *param)
+{
+	if (enter_log()) {
+		log_message(level, format, args);
+		leave_log();
+	}
+
+	UNUSED_PARAMETER(param);
+}
+
+/* ------------------------------------------------------------------------- */
+/* writer */
+
+static void collect_ring(struct log_ring *ring)
+{
+	struct log_header header;
+
+	while (circlebuf_spsc_size(&ring->buf) >= sizeof(header)) {
+		struct log_entry *entry;
+
+		circlebuf_spsc_pop_front(&ring->buf, &header, sizeof(header));
+
+		entry = da_push_back_new(async_log.entries);
+		entry->ts     = header.ts;
+		entry->level  = header.level;
+		entry->offset = async_log.text.num;
+
+		/* a message is always committed together with its header */
+		da_resize(async_log.text, async_log.text.num + header.size);
+		circlebuf_spsc_pop_front(&ring->buf,
+				async_log.text.array + entry->offset,
+				header.size);
+	}
+}
+
+static int cmp_entries(const void *a, const void *b)
+{
+	const struct log_entry *entry_a = a;
+	const struct log_entry *entry_b = b;
+
+	if (entry_a->ts != entry_b->ts)
+		return entry_a->ts < entry_b->ts ? -1 : 1;
+	return entry_a->offset < entry_b->offset ? -1 : 1;
+}
+
+static inline void get_rotated_path(struct dstr *dst, int idx)
+{
+	dstr_printf(dst, "%s.%d", async_log.path.array, idx);
+}
+
+static void rotate_file(void)
+{
+	struct dstr old_path = {0};
+	struct dstr new_path = {0};
+
+	fclose(async_log.file);
+	async_log.file      = NULL;
+	async_log.file_size = 0;
+
+	if (async_log.info.max_files > 0) {
+		get_rotated_path(&old_path, async_log.info.max_files);
+		remove(old_path.array);
+
+		for (int i = async_log.info.max_files - 1; i > 0; i--) {
+			get_rotated_path(&old_path, i);
+			get_rotated_path(&new_path, i + 1);
+			os_rename(old_path.array, new_path.array);
+		}
+
+		get_rotated_path(&new_path, 1);
+		os_rename(async_log.path.array, new_path.array);
+	}
+
+	dstr_free(&old_path);
+	dstr_free(&new_path);
+
+	async_log.file = os_fopen(async_log.path.array, "w");
+}
+
+static void write_console(int level, const char *msg)
+{
+	switch (level) {
+	case LOG_DEBUG:
+		fprintf(stdout, "debug: %s\n", msg);
+		break;
+	case LOG_INFO:
+		fprintf(stdout, "info: %s\n", msg);
+		break;
+	case LOG_WARNING:
+		fprintf(stdout, "warning: %s\n", msg);
+		break;
+	case LOG_ERROR:
+		fprintf(stderr, "error: %s\n", msg);
+	}
+}
+
+static void write_message(int level, const char *msg)
+{
+	if (async_log.info.console)
+		write_console(level, msg);
+
+	if (async_log.file) {
+		int len = fprintf(async_log.file, "%s\n", msg);
+		if (len > 0)
+			async_log.file_size += (uint64_t)len;
+	}
+
+	if (async_log.info.output)
+		async_log.info.output(level, msg, async_log.info.param);
+}
+
+static void write_dropped(void)
+{
+	long dropped = os_atomic_load_long(&async_log.dropped);
+	char msg[64];
+
+	if (dropped == async_log.dropped_reported)
+		return;
+
+	snprintf(msg, sizeof(msg), "(%ld log messages were dropped)",
+			dropped - async_log.dropped_reported);
+	write_message(LOG_WARNING, msg);
+	async_log.dropped_reported = dropped;
+}
+
+static void write_pending(void)
+{
+	pthread_mutex_lock(&async_log.write_mutex);
+
+	pthread_mutex_lock(&async_log.rings_mutex);
+	for (size_t i = 0; i < async_log.rings.num; i++) {
+		struct log_ring *ring = async_log.rings.array[i];
+
+		/* checked before collecting, so an exited ring is only freed
+		 * once its last message has been collected */
+		bool exited = os_atomic_load_long(&ring->exited) != 0;
+
+		collect_ring(ring);
+
+		if (exited) {
+			destroy_ring(ring);
+			da_erase(async_log.rings, i--);
+		}
+	}
+	pthread_mutex_unlock(&async_log.rings_mutex);
+
+	/* threads are interleaved in the order they logged in */
+	qsort(async_log.entries.array, async_log.entries.num,
+			sizeof(struct log_entry), cmp_entries);
+
+	for (size_t i = 0; i < async_log.entries.num; i++) {
+		struct log_entry *entry = async_log.entries.array+i;
+		write_message(entry->level,
+				async_log.text.array + entry->offset);
+	}
+
+	write_dropped();
+
+	if (async_log.entries.num) {
+		if (async_log.info.console) {
+			fflush(stdout);
+			fflush(stderr);
+		}
+		if (async_log.file)
+			fflush(async_log.file);
+	}
+
+	da_resize(async_log.entries, 0);
+	da_resize(async_log.text, 0);
+
+	if (async_log.file && async_log.info.max_file_size &&
+	    async_log.file_size >= async_log.info.max_file_size)
+		rotate_file();
+
+	pthread_mutex_unlock(&async_log.write_mutex);
+}
+
+/* bcrash can happen anywhere, including while the log is being written or
+ * during an allocation, so nothing is allocated or waited on here.  each
+ * ring is written out as is, without ordering the threads by time */
+static void crash_flush(void)
+{
+	struct log_header header;
+	char              msg[MAX_MESSAGE_SIZE];
+
+	if (!enter_log())
+		return;
+
+	if (pthread_mutex_trylock(&async_log.write_mutex) != 0)
+		goto leave;
+	if (pthread_mutex_trylock(&async_log.rings_mutex) != 0)
+		goto unlock_write;
+
+	for (size_t i = 0; i < async_log.rings.num; i++) {
+		struct circlebuf_spsc *buf = &async_log.rings.array[i]->buf;
+
+		while (circlebuf_spsc_size(buf) >= sizeof(header)) {
+			circlebuf_spsc_pop_front(buf, &header, sizeof(header));
+			circlebuf_spsc_pop_front(buf, msg, header.size);
+			write_message(header.level, msg);
+		}
+	}
+
+	pthread_mutex_unlock(&async_log.rings_mutex);
+
+	if (async_log.info.console) {
+		fflush(stdout);
+		fflush(stderr);
+	}
+	if (async_log.file)
+		fflush(async_log.file);
+
+unlock_write:
+	pthread_mutex_unlock(&async_log.write_mutex);
+leave:
+	leave_log();
+}
+
+static void *writer_thread(void *param)
+{
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "log writer");
+
+	while (os_event_timedwait(async_log.stop_event,
+				WRITE_INTERVAL_MS) == ETIMEDOUT)
+		write_pending();
+
+	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void free_async_log(void)
+{
+	if (async_log.ring_key_created)
+		pthread_key_delete(async_log.ring_key);
+
+	for (size_t i = 0; i < async_log.rings.num; i++)
+		destroy_ring(async_log.rings.array[i]);
+
+	da_free(async_log.rings);
+	da_free(async_log.entries);
+	da_free(async_log.text);
+	dstr_free(&async_log.path);
+
+	if (async_log.file)
+		fclose(async_log.file);
+
+	os_event_destroy(async_log.stop_event);
+	pthread_mutex_destroy(&async_log.rings_mutex);
+	pthread_mutex_destroy(&async_log.write_mutex);
+
+	memset(&async_log, 0, sizeof(async_log));
+	os_atomic_inc_long(&generation);
+}
+
+bool async_log_start(const struct async_log_info *info)
+{
+	if (!info || async_log.active)
+		return false;
+
+	async_log.info = *info;
+	if (!async_log.info.level)
+		async_log.info.level = LOG_INFO;
+
+	pthread_mutex_init_value(&async_log.rings_mutex);
+	pthread_mutex_init_value(&async_log.write_mutex);
+
+	if (pthread_mutex_init(&async_log.rings_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&async_log.write_mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&async_log.stop_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+	if (pthread_key_create(&async_log.ring_key, ring_thread_exit) != 0)
+		goto fail;
+	async_log.ring_key_created = true;
+
+	if (info->path) {
+		dstr_copy(&async_log.path, info->path);
+		async_log.file = os_fopen(info->path, "w");
+		if (!async_log.file) {
+			blog(LOG_WARNING, "async_log_start: Failed to open "
+			                  "'%s'", info->path);
+			goto fail;
+		}
+	}
+
+	if (pthread_create(&async_log.thread, NULL, writer_thread, NULL) != 0)
+		goto fail;
+
+	async_log.active = true;
+	os_atomic_set_long(&async_log.accepting, 1);
+	base_set_log_handler(async_log_handler, NULL);
+	base_set_log_flush(crash_flush);
+	return true;
+
+fail:
+	free_async_log();
+	return false;
+}
+
+void async_log_stop(void)
+{
+	if (!async_log.active)
+		return;
+
+	/* anything logged from here on goes to the default handler, and
+	 * threads still in the handler have to leave it before the rings can
+	 * be freed */
+	base_set_log_flush(NULL);
+	base_set_log_handler(NULL, NULL);
+
+	os_atomic_set_long(&async_log.accepting, 0);
+	while (os_atomic_load_long(&async_log.users))
+		os_sleep_ms(1);
+
+	os_event_signal(async_log.stop_event);
+	pthread_join(async_log.thread, NULL);
+
+	write_pending();
+	free_async_log();
+}
+
+void async_log_flush(void)
+{
+	if (async_log.active)
+		write_pending();
+}
+
+long async_log_dropped(void)
+{
+	return os_atomic_load_long(&async_log.dropped);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+
+/*
+ * Asynchronous log handler
+ *
+ *   Installs itself with base_set_log_handler.  blog formats the message on
+ * the calling thread into a ring owned by that thread, which never blocks or
+ * takes a lock, and a background thread writes the rings out to the console
+ * and a log file.  A slow console or disk can only make the rings fill up,
+ * in which case messages are dropped and counted instead of waited on.
+ *
+ *   Repeats of the same message from a thread within a second are counted
+ * instead of logged, and reported when the thread logs something else.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct async_log_info {
+	/** log file, or NULL to only log to the console */
+	const char *path;
+
+	/** once the file is larger, it's renamed to <path>.1 (<path>.1 to
+	 * <path>.2, and so on) and a new one is started.  0 to never rotate */
+	uint64_t   max_file_size;
+
+	/** number of rotated files kept besides the current one */
+	int        max_files;
+
+	/** messages with a higher level than this aren't logged at all */
+	int        level;
+
+	bool       console;
+
+	/** optional extra output, called on the writer thread */
+	void       (*output)(int log_level, const char *msg, void *param);
+	void       *param;
+
+	/** optional, called on the thread that logs before the message is
+	 * queued (repeats included).  it has to be quick and must not log */
+	void       (*sync_output)(int log_level, const char *msg,
+			void *param);
+};
+
+/**
+ * Starts the writer thread and installs the handler.  Returns false if the
+ * file couldn't be opened or the thread couldn't be started, in which case
+ * the current handler is kept.
+ */
+EXPORT bool async_log_start(const struct async_log_info *info);
+
+/** Writes out everything logged so far, and restores the default handler */
+EXPORT void async_log_stop(void);
+
+/** Waits until everything logged so far has been written out */
+EXPORT void async_log_flush(void);
+
+/** Number of messages dropped because a thread's ring was full */
+EXPORT long async_log_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
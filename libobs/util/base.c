@@ -30,6 +30,7 @@ static int log_output_level = LOG_INFO;
 static int  crashing     = 0;
 static void *log_param   = NULL;
 static void *crash_param = NULL;
+static void (*log_flush)(void) = NULL;
 
 static void def_log_handler(int log_level, const char *format,
 		va_list args, void *param)
@@ -101,6 +102,11 @@ void base_set_crash_handler(
 	crash_handler = handler;
 }
 
+void base_set_log_flush(void (*flush)(void))
+{
+	log_flush = flush;
+}
+
 void bcrash(const char *format, ...)
 {
 	va_list args;
@@ -111,6 +117,9 @@ void bcrash(const char *format, ...)
 	}
 
 	crashing = 1;
+	if (log_flush)
+		log_flush();
+
 	va_start(args, format);
 	crash_handler(format, args, crash_param);
 	va_end(args);
@@ -65,6 +65,13 @@ EXPORT void base_set_crash_handler(
 		void (*handler)(const char *, va_list, void *),
 		void *param);
 
+/**
+ * Sets a function that bcrash calls before the crash handler, so that a log
+ * handler that writes its messages later can write out what it still has.
+ * It must not allocate memory or wait on locks.
+ */
+EXPORT void base_set_log_flush(void (*flush)(void));
+
 EXPORT void blogva(int log_level, const char *format, va_list args);
 
 #ifndef _MSC_VER
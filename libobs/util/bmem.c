@@ -84,6 +84,331 @@ static void a_free(void *ptr)
 #endif
 }
 
+/* ------------------------------------------------------------------------- */
+/* cached allocator */
+
+/*
+ * Small allocations are rounded up to a size class and recycled through a
+ * per-thread free list for each class, so most allocations never touch the
+ * system allocator or take a lock.  Threads that collect too many free
+ * blocks hand half of them to a shared pool, which other threads refill
+ * from.  Every block is preceded by an ALIGNMENT sized header that stores
+ * its class, keeping the block itself aligned.
+ */
+
+#define CACHE_NUM_CLASSES  (BMEM_CACHE_NUM_CLASSES - 1)
+#define CACHE_LARGE_CLASS  CACHE_NUM_CLASSES
+#define CACHE_THREAD_MAX   64
+#define CACHE_POOL_MAX     1024
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+static const size_t class_sizes[CACHE_NUM_CLASSES] = {
+	32, 64, 96, 128, 192, 256, 384, 512,
+	768, 1024, 1536, 2048, 3072, 4096, 8192, 16384
+};
+
+struct cache_header {
+	size_t class_idx;
+	size_t size;
+};
+
+struct free_block {
+	struct free_block *next;
+};
+
+struct thread_cache {
+	struct free_block   *blocks[CACHE_NUM_CLASSES];
+	size_t              num_blocks[CACHE_NUM_CLASSES];
+
+	/* only written by the owning thread */
+	long                allocs[BMEM_CACHE_NUM_CLASSES];
+	long                frees[BMEM_CACHE_NUM_CLASSES];
+
+	struct thread_cache *next;
+	struct thread_cache **prev_next;
+};
+
+struct cache_pool {
+	pthread_mutex_t     mutex;
+	struct free_block   *blocks[CACHE_NUM_CLASSES];
+	size_t              num_blocks[CACHE_NUM_CLASSES];
+
+	struct thread_cache *first_cache;
+
+	/* totals of threads that have exited */
+	long                allocs[BMEM_CACHE_NUM_CLASSES];
+	long                frees[BMEM_CACHE_NUM_CLASSES];
+};
+
+static struct cache_pool pool;
+static pthread_key_t cache_key;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static THREAD_LOCAL struct thread_cache *cur_cache = NULL;
+
+static inline struct cache_header *get_header(void *ptr)
+{
+	return (struct cache_header*)((char*)ptr - ALIGNMENT);
+}
+
+static inline size_t get_class(size_t size)
+{
+	for (size_t i = 0; i < CACHE_NUM_CLASSES; i++) {
+		if (size <= class_sizes[i])
+			return i;
+	}
+
+	return CACHE_LARGE_CLASS;
+}
+
+static void *new_block(size_t class_idx, size_t size)
+{
+	struct cache_header *header = a_malloc(ALIGNMENT + size);
+	if (!header)
+		return NULL;
+
+	header->class_idx = class_idx;
+	header->size      = size;
+	return (char*)header + ALIGNMENT;
+}
+
+static inline void push_block(struct free_block **list, size_t *num,
+		void *ptr)
+{
+	struct free_block *block = ptr;
+	block->next = *list;
+	*list = block;
+	(*num)++;
+}
+
+static inline void *pop_block(struct free_block **list, size_t *num)
+{
+	struct free_block *block = *list;
+	if (block) {
+		*list = block->next;
+		(*num)--;
+	}
+
+	return block;
+}
+
+/* moves up to count blocks of a class from one list to another, freeing
+ * blocks that don't fit in to the destination */
+static void move_blocks(struct free_block **src, size_t *src_num,
+		struct free_block **dst, size_t *dst_num,
+		size_t count, size_t dst_max)
+{
+	while (count-- && *src) {
+		void *block = pop_block(src, src_num);
+
+		if (*dst_num < dst_max)
+			push_block(dst, dst_num, block);
+		else
+			a_free(get_header(block));
+	}
+}
+
+static void thread_cache_destroy(void *param)
+{
+	struct thread_cache *cache = param;
+
+	pthread_mutex_lock(&pool.mutex);
+
+	for (size_t i = 0; i < CACHE_NUM_CLASSES; i++)
+		move_blocks(&cache->blocks[i], &cache->num_blocks[i],
+				&pool.blocks[i], &pool.num_blocks[i],
+				cache->num_blocks[i], CACHE_POOL_MAX);
+
+	for (size_t i = 0; i < BMEM_CACHE_NUM_CLASSES; i++) {
+		pool.allocs[i] += cache->allocs[i];
+		pool.frees[i]  += cache->frees[i];
+	}
+
+	*cache->prev_next = cache->next;
+	if (cache->next)
+		cache->next->prev_next = cache->prev_next;
+
+	pthread_mutex_unlock(&pool.mutex);
+
+	if (cur_cache == cache)
+		cur_cache = NULL;
+	free(cache);
+}
+
+static void init_cache_pool(void)
+{
+	pthread_mutex_init(&pool.mutex, NULL);
+	pthread_key_create(&cache_key, thread_cache_destroy);
+}
+
+static struct thread_cache *get_thread_cache(void)
+{
+	struct thread_cache *cache = cur_cache;
+	if (cache)
+		return cache;
+
+	pthread_once(&cache_once, init_cache_pool);
+
+	cache = calloc(1, sizeof(struct thread_cache));
+	if (!cache)
+		return NULL;
+
+	pthread_mutex_lock(&pool.mutex);
+	cache->prev_next = &pool.first_cache;
+	cache->next      = pool.first_cache;
+	pool.first_cache = cache;
+	if (cache->next)
+		cache->next->prev_next = &cache->next;
+	pthread_mutex_unlock(&pool.mutex);
+
+	pthread_setspecific(cache_key, cache);
+	cur_cache = cache;
+	return cache;
+}
+
+static void *cache_malloc(size_t size)
+{
+	struct thread_cache *cache = get_thread_cache();
+	size_t idx = get_class(size);
+	void *ptr;
+
+	if (!cache)
+		return NULL;
+
+	cache->allocs[idx]++;
+
+	if (idx == CACHE_LARGE_CLASS)
+		return new_block(idx, size);
+
+	if (!cache->blocks[idx] && pool.num_blocks[idx]) {
+		pthread_mutex_lock(&pool.mutex);
+		move_blocks(&pool.blocks[idx], &pool.num_blocks[idx],
+				&cache->blocks[idx], &cache->num_blocks[idx],
+				CACHE_THREAD_MAX / 2, CACHE_THREAD_MAX);
+		pthread_mutex_unlock(&pool.mutex);
+	}
+
+	ptr = pop_block(&cache->blocks[idx], &cache->num_blocks[idx]);
+	return ptr ? ptr : new_block(idx, class_sizes[idx]);
+}
+
+static void cache_free(void *ptr)
+{
+	struct thread_cache *cache;
+	size_t idx;
+
+	if (!ptr)
+		return;
+
+	idx   = get_header(ptr)->class_idx;
+	cache = get_thread_cache();
+
+	if (cache)
+		cache->frees[idx]++;
+
+	if (idx == CACHE_LARGE_CLASS || !cache) {
+		a_free(get_header(ptr));
+		return;
+	}
+
+	push_block(&cache->blocks[idx], &cache->num_blocks[idx], ptr);
+
+	if (cache->num_blocks[idx] > CACHE_THREAD_MAX) {
+		pthread_mutex_lock(&pool.mutex);
+		move_blocks(&cache->blocks[idx], &cache->num_blocks[idx],
+				&pool.blocks[idx], &pool.num_blocks[idx],
+				CACHE_THREAD_MAX / 2, CACHE_POOL_MAX);
+		pthread_mutex_unlock(&pool.mutex);
+	}
+}
+
+static void *cache_realloc(void *ptr, size_t size)
+{
+	struct cache_header *header;
+	size_t new_idx;
+	void *new_ptr;
+
+	if (!ptr)
+		return cache_malloc(size);
+
+	header  = get_header(ptr);
+	new_idx = get_class(size);
+
+	/* still fits in the same block */
+	if (header->class_idx == new_idx && new_idx != CACHE_LARGE_CLASS)
+		return ptr;
+
+	if (header->class_idx == CACHE_LARGE_CLASS &&
+	    new_idx == CACHE_LARGE_CLASS) {
+		header = a_realloc(header, ALIGNMENT + size);
+		if (!header)
+			return NULL;
+
+		header->size = size;
+		return (char*)header + ALIGNMENT;
+	}
+
+	new_ptr = cache_malloc(size);
+	if (!new_ptr)
+		return NULL;
+
+	memcpy(new_ptr, ptr, header->size < size ? header->size : size);
+	cache_free(ptr);
+	return new_ptr;
+}
+
+void base_get_cache_allocator(struct base_allocator *defs)
+{
+	defs->malloc  = cache_malloc;
+	defs->realloc = cache_realloc;
+	defs->free    = cache_free;
+}
+
+size_t bmem_cache_get_stats(struct bmem_cache_stats *stats, size_t max)
+{
+	struct thread_cache *cache;
+	size_t num = max < BMEM_CACHE_NUM_CLASSES ?
+		max : BMEM_CACHE_NUM_CLASSES;
+
+	pthread_once(&cache_once, init_cache_pool);
+	pthread_mutex_lock(&pool.mutex);
+
+	for (size_t i = 0; i < num; i++) {
+		long allocs = pool.allocs[i];
+		long frees  = pool.frees[i];
+
+		/* counters of running threads may be slightly out of date */
+		cache = pool.first_cache;
+		while (cache) {
+			allocs += cache->allocs[i];
+			frees  += cache->frees[i];
+			cache   = cache->next;
+		}
+
+		stats[i].block_size = i < CACHE_NUM_CLASSES ?
+			class_sizes[i] : 0;
+		stats[i].allocs     = allocs;
+		stats[i].in_use     = allocs - frees;
+		stats[i].cached     = i < CACHE_NUM_CLASSES ?
+			(long)pool.num_blocks[i] : 0;
+
+		cache = pool.first_cache;
+		while (cache && i < CACHE_NUM_CLASSES) {
+			stats[i].cached += (long)cache->num_blocks[i];
+			cache = cache->next;
+		}
+	}
+
+	pthread_mutex_unlock(&pool.mutex);
+	return num;
+}
+
+/* ------------------------------------------------------------------------- */
+
 static struct base_allocator alloc = {a_malloc, a_realloc, a_free};
 static long num_allocs = 0;
 
@@ -33,6 +33,28 @@ struct base_allocator {
 
 EXPORT void base_set_allocator(struct base_allocator *defs);
 
+/*
+ * Built-in allocator with per-thread caches for small size classes.  Install
+ * it with base_set_allocator before anything has been allocated, as memory
+ * from the previous allocator can't be freed through it.
+ */
+EXPORT void base_get_cache_allocator(struct base_allocator *defs);
+
+/* size classes of the cached allocator, the last one is large allocations */
+#define BMEM_CACHE_NUM_CLASSES 17
+
+struct bmem_cache_stats {
+	size_t block_size; /* 0 for large allocations */
+	long   allocs;     /* total allocations in this class */
+	long   in_use;     /* allocations not yet freed */
+	long   cached;     /* free blocks kept for reuse */
+};
+
+/* gets per size class statistics of the cached allocator, returns the
+ * number of classes written */
+EXPORT size_t bmem_cache_get_stats(struct bmem_cache_stats *stats,
+		size_t max);
+
 EXPORT void *bmalloc(size_t size);
 EXPORT void *brealloc(void *ptr, size_t size);
 EXPORT void bfree(void *ptr);
@@ -548,13 +548,13 @@ static void cf_addew(struct cf_preprocessor *pp, const struct cf_token *token,
 		error_data_add(pp->ed, token->lex->file, row, col,
 				message, error_level);
 	} else {
-		struct dstr formatted;
-		dstr_init(&formatted);
-		dstr_safe_printf(&formatted, message, val1, val2, val3, NULL);
+		struct dstr_small small;
+		struct dstr       *formatted = dstr_small_init(&small);
+		dstr_safe_printf(formatted, message, val1, val2, val3, NULL);
 
 		error_data_add(pp->ed, token->lex->file, row, col,
-				formatted.array, error_level);
-		dstr_free(&formatted);
+				formatted->array, error_level);
+		dstr_free(formatted);
 	}
 }
 
@@ -28,14 +28,14 @@ void cf_adderror(struct cf_parser *p, const char *error, int level,
 		error_data_add(&p->error_list, p->cur_token->lex->file,
 				row, col, error, level);
 	} else {
-		struct dstr formatted;
-		dstr_init(&formatted);
-		dstr_safe_printf(&formatted, error, val1, val2, val3, NULL);
+		struct dstr_small small;
+		struct dstr       *formatted = dstr_small_init(&small);
+		dstr_safe_printf(formatted, error, val1, val2, val3, NULL);
 
 		error_data_add(&p->error_list, p->cur_token->lex->file,
-				row, col, formatted.array, level);
+				row, col, formatted->array, level);
 
-		dstr_free(&formatted);
+		dstr_free(formatted);
 	}
 }
 
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "circlebuf.h"
+#include "threading.h"
+#include <limits.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fixed-capacity, lock-free circular buffer for exactly one producer thread
+ * and one consumer thread.
+ *
+ *   The capacity is a power of two, and the read/write positions are running
+ * byte counts that are allowed to wrap, so the used size is always
+ * write_pos - read_pos.  The producer only ever modifies write_pos and the
+ * consumer only ever modifies read_pos.  The capacity has to stay below
+ * LONG_MAX so the wrapping counters stay unambiguous.
+ */
+
+struct circlebuf_spsc {
+	uint8_t       *data;
+	size_t        capacity;
+	size_t        mask;
+
+	volatile long write_pos;
+	volatile long read_pos;
+};
+
+static inline bool circlebuf_spsc_init(struct circlebuf_spsc *cb,
+		size_t capacity)
+{
+	size_t size = 1;
+
+	memset(cb, 0, sizeof(struct circlebuf_spsc));
+
+	while (size < capacity && size <= (size_t)(LONG_MAX / 2))
+		size <<= 1;
+	if (size < capacity)
+		return false;
+
+	cb->data     = bmalloc(size);
+	cb->capacity = size;
+	cb->mask     = size - 1;
+	return true;
+}
+
+static inline void circlebuf_spsc_free(struct circlebuf_spsc *cb)
+{
+	bfree(cb->data);
+	memset(cb, 0, sizeof(struct circlebuf_spsc));
+}
+
+/** Bytes available to the consumer.  */
+static inline size_t circlebuf_spsc_size(struct circlebuf_spsc *cb)
+{
+	unsigned long write_pos = (unsigned long)os_atomic_load_long(
+			&cb->write_pos);
+	unsigned long read_pos  = (unsigned long)os_atomic_load_long(
+			&cb->read_pos);
+	return (size_t)(write_pos - read_pos);
+}
+
+/** Bytes available to the producer.  */
+static inline size_t circlebuf_spsc_free_space(struct circlebuf_spsc *cb)
+{
+	return cb->capacity - circlebuf_spsc_size(cb);
+}
+
+static inline void circlebuf_spsc_get_span(struct circlebuf_spsc *cb,
+		unsigned long position, size_t size,
+		struct circlebuf_span *span)
+{
+	size_t offset     = (size_t)position & cb->mask;
+	size_t start_size = cb->capacity - offset;
+
+	span->data[0] = cb->data + offset;
+
+	if (start_size < size) {
+		span->size[0] = start_size;
+		span->data[1] = cb->data;
+		span->size[1] = size - start_size;
+	} else {
+		span->size[0] = size;
+		span->data[1] = NULL;
+		span->size[1] = 0;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* producer */
+
+/**
+ * Gets free space for <size> bytes to write to, then call
+ * circlebuf_spsc_commit to make it visible to the consumer.  Returns false
+ * if there isn't enough free space; the buffer never grows.
+ */
+static inline bool circlebuf_spsc_reserve_span(struct circlebuf_spsc *cb,
+		size_t size, struct circlebuf_span *span)
+{
+	if (size > circlebuf_spsc_free_space(cb))
+		return false;
+
+	circlebuf_spsc_get_span(cb, (unsigned long)cb->write_pos, size, span);
+	return true;
+}
+
+static inline void circlebuf_spsc_commit(struct circlebuf_spsc *cb,
+		size_t size)
+{
+	unsigned long write_pos = (unsigned long)cb->write_pos;
+	os_atomic_set_long(&cb->write_pos, (long)(write_pos + size));
+}
+
+static inline bool circlebuf_spsc_push_back(struct circlebuf_spsc *cb,
+		const void *data, size_t size)
+{
+	struct circlebuf_span span;
+
+	if (!circlebuf_spsc_reserve_span(cb, size, &span))
+		return false;
+
+	memcpy(span.data[0], data, span.size[0]);
+	if (span.size[1])
+		memcpy(span.data[1], (const uint8_t*)data + span.size[0],
+				span.size[1]);
+
+	circlebuf_spsc_commit(cb, size);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* consumer */
+
+/**
+ * Gets the first <size> bytes of the buffer without copying them, then call
+ * circlebuf_spsc_consume once done with them.  Returns false if less than
+ * <size> bytes are available.
+ */
+static inline bool circlebuf_spsc_peek_span(struct circlebuf_spsc *cb,
+		size_t size, struct circlebuf_span *span)
+{
+	if (size > circlebuf_spsc_size(cb))
+		return false;
+
+	circlebuf_spsc_get_span(cb, (unsigned long)cb->read_pos, size, span);
+	return true;
+}
+
+static inline void circlebuf_spsc_consume(struct circlebuf_spsc *cb,
+		size_t size)
+{
+	unsigned long read_pos = (unsigned long)cb->read_pos;
+	os_atomic_set_long(&cb->read_pos, (long)(read_pos + size));
+}
+
+static inline bool circlebuf_spsc_pop_front(struct circlebuf_spsc *cb,
+		void *data, size_t size)
+{
+	struct circlebuf_span span;
+
+	if (!circlebuf_spsc_peek_span(cb, size, &span))
+		return false;
+
+	if (data) {
+		memcpy(data, span.data[0], span.size[0]);
+		if (span.size[1])
+			memcpy((uint8_t*)data + span.size[0], span.data[1],
+					span.size[1]);
+	}
+
+	circlebuf_spsc_consume(cb, size);
+	return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -199,6 +199,119 @@ static inline void circlebuf_pop_front(struct circlebuf *cb, void *data,
 		cb->start_pos -= cb->capacity;
 }
 
+/** Reads data at a specific point in the buffer (relative).  */
+static inline void circlebuf_peek_at(struct circlebuf *cb, size_t position,
+		void *data, size_t size)
+{
+	size_t start_size;
+	assert(position + size <= cb->size);
+
+	position += cb->start_pos;
+	if (position >= cb->capacity)
+		position -= cb->capacity;
+
+	start_size = cb->capacity - position;
+
+	if (start_size < size) {
+		memcpy(data, (uint8_t*)cb->data + position, start_size);
+		memcpy((uint8_t*)data + start_size, cb->data,
+				size - start_size);
+	} else {
+		memcpy(data, (uint8_t*)cb->data + position, size);
+	}
+}
+
+/** Removes data from the end of the buffer without reading it.  */
+static inline void circlebuf_pop_back(struct circlebuf *cb, size_t size)
+{
+	assert(size <= cb->size);
+
+	cb->size -= size;
+	if (cb->end_pos < size)
+		cb->end_pos += cb->capacity;
+	cb->end_pos -= size;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Zero-copy access
+ *
+ * A region of the buffer is at most two contiguous spans, the second one is
+ * only used when the region wraps around the end of the allocation.  Spans
+ * are only valid until the next call that modifies the buffer. */
+
+struct circlebuf_span {
+	uint8_t *data[2];
+	size_t  size[2];
+};
+
+static inline void circlebuf_get_span(const struct circlebuf *cb,
+		size_t position, size_t size, struct circlebuf_span *span)
+{
+	size_t start_size;
+
+	if (position >= cb->capacity)
+		position -= cb->capacity;
+
+	start_size = cb->capacity - position;
+	span->data[0] = (uint8_t*)cb->data + position;
+
+	if (start_size < size) {
+		span->size[0] = start_size;
+		span->data[1] = (uint8_t*)cb->data;
+		span->size[1] = size - start_size;
+	} else {
+		span->size[0] = size;
+		span->data[1] = NULL;
+		span->size[1] = 0;
+	}
+}
+
+/** Gets the first <size> bytes of the buffer without copying them.  */
+static inline void circlebuf_peek_span(const struct circlebuf *cb,
+		size_t size, struct circlebuf_span *span)
+{
+	assert(size <= cb->size);
+	circlebuf_get_span(cb, cb->start_pos, size, span);
+}
+
+/** Removes data from the front of the buffer without reading it.  */
+static inline void circlebuf_consume(struct circlebuf *cb, size_t size)
+{
+	circlebuf_pop_front(cb, NULL, size);
+}
+
+/**
+ * Makes room for <size> more bytes at the end of the buffer and gets the
+ * free space to write to.  The data becomes part of the buffer once
+ * circlebuf_commit is called, committing less than was reserved is allowed.
+ */
+static inline void circlebuf_reserve_span(struct circlebuf *cb, size_t size,
+		struct circlebuf_span *span)
+{
+	size_t new_size = cb->size + size;
+
+	if (new_size > cb->capacity) {
+		size_t new_capacity = cb->capacity*2;
+		if (new_size > new_capacity)
+			new_capacity = new_size;
+
+		circlebuf_reserve(cb, new_capacity);
+	}
+
+	circlebuf_get_span(cb, cb->end_pos, size, span);
+}
+
+/** Adds <size> bytes written to a span from circlebuf_reserve_span.  */
+static inline void circlebuf_commit(struct circlebuf *cb, size_t size)
+{
+	assert(cb->size + size <= cb->capacity);
+
+	cb->size += size;
+	cb->end_pos += size;
+	if (cb->end_pos > cb->capacity)
+		cb->end_pos -= cb->capacity;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,11 +18,111 @@
 #include <wchar.h>
 #include "config-file.h"
 #include "platform.h"
+#include "threading.h"
 #include "base.h"
 #include "bmem.h"
 #include "darray.h"
 #include "lexer.h"
 #include "dstr.h"
+#include "hash.h"
+
+/* ------------------------------------------------------------------------- */
+/* name index
+ *
+ * Sections and items are kept in file order for saving, and each array has
+ * an open addressing index of case-insensitive name hashes alongside it.
+ * Both element types start with their name, which is all the index needs to
+ * tell hash collisions apart. */
+
+struct config_slot {
+	uint32_t hash;
+	uint32_t idx; /* index + 1, 0 if empty */
+};
+
+struct config_index {
+	struct config_slot *slots;
+	size_t             num_slots;
+};
+
+#define CONFIG_INDEX_MIN_SLOTS 16
+
+static inline const char *config_element_name(const struct darray *da,
+		size_t element_size, size_t idx)
+{
+	return *(const char**)darray_item(element_size, da, idx);
+}
+
+static size_t config_index_find(const struct config_index *index,
+		const struct darray *da, size_t element_size,
+		const char *name, uint32_t hash)
+{
+	size_t mask, pos;
+
+	if (!index->num_slots)
+		return DARRAY_INVALID;
+
+	mask = index->num_slots - 1;
+	pos  = hash & mask;
+
+	while (index->slots[pos].idx) {
+		const struct config_slot *slot = index->slots+pos;
+		size_t idx = slot->idx - 1;
+
+		if (slot->hash == hash && astrcmpi(name,
+				config_element_name(da, element_size, idx)) == 0)
+			return idx;
+
+		pos = (pos + 1) & mask;
+	}
+
+	return DARRAY_INVALID;
+}
+
+static void config_index_place(struct config_slot *slots, size_t num_slots,
+		uint32_t hash, size_t idx)
+{
+	size_t pos = hash & (num_slots - 1);
+
+	while (slots[pos].idx)
+		pos = (pos + 1) & (num_slots - 1);
+
+	slots[pos].hash = hash;
+	slots[pos].idx  = (uint32_t)(idx + 1);
+}
+
+/* num is the number of indexed elements after this one is added */
+static void config_index_insert(struct config_index *index, size_t num,
+		uint32_t hash, size_t idx)
+{
+	if (num * 2 > index->num_slots) {
+		size_t num_slots = index->num_slots ?
+			index->num_slots * 2 : CONFIG_INDEX_MIN_SLOTS;
+		struct config_slot *slots =
+			bzalloc(num_slots * sizeof(struct config_slot));
+
+		for (size_t i = 0; i < index->num_slots; i++) {
+			struct config_slot *slot = index->slots+i;
+			if (slot->idx)
+				config_index_place(slots, num_slots,
+						slot->hash, slot->idx - 1);
+		}
+
+		bfree(index->slots);
+		index->slots     = slots;
+		index->num_slots = num_slots;
+	}
+
+	config_index_place(index->slots, index->num_slots, hash, idx);
+}
+
+static inline void config_index_free(struct config_index *index)
+{
+	bfree(index->slots);
+	index->slots     = NULL;
+	index->num_slots = 0;
+}
+
+/* ------------------------------------------------------------------------- */
 
 struct config_item {
 	char *name;
@@ -36,8 +136,9 @@ static inline void config_item_free(struct config_item *item)
 }
 
 struct config_section {
-	char *name;
-	struct darray items; /* struct config_item */
+	char                *name;
+	struct darray       items; /* struct config_item */
+	struct config_index index;
 };
 
 static inline void config_section_free(struct config_section *section)
@@ -49,18 +150,127 @@ static inline void config_section_free(struct config_section *section)
 		config_item_free(items+i);
 
 	darray_free(&section->items);
+	config_index_free(&section->index);
 	bfree(section->name);
 }
 
+struct config_sections {
+	struct darray       array; /* struct config_section */
+	struct config_index index;
+};
+
+static void config_sections_free(struct config_sections *sections)
+{
+	struct config_section *array = sections->array.array;
+
+	for (size_t i = 0; i < sections->array.num; i++)
+		config_section_free(array+i);
+
+	darray_free(&sections->array);
+	config_index_free(&sections->index);
+}
+
+static struct config_section *config_find_section(
+		struct config_sections *sections, const char *name,
+		uint32_t hash)
+{
+	size_t idx = config_index_find(&sections->index, &sections->array,
+			sizeof(struct config_section), name, hash);
+
+	return (idx != DARRAY_INVALID) ?
+		darray_item(sizeof(struct config_section), &sections->array,
+				idx) : NULL;
+}
+
+/* sections that appear more than once in a file are merged */
+static struct config_section *config_get_section_n(
+		struct config_sections *sections, const char *name,
+		size_t len)
+{
+	struct config_section *section;
+	char     *name_dup = bstrdup_n(name, len);
+	uint32_t hash      = hash_fnv1a_lower(name_dup);
+
+	section = config_find_section(sections, name_dup, hash);
+	if (section) {
+		bfree(name_dup);
+		return section;
+	}
+
+	section = darray_push_back_new(sizeof(struct config_section),
+			&sections->array);
+	section->name = name_dup;
+
+	config_index_insert(&sections->index, sections->array.num, hash,
+			sections->array.num - 1);
+	return section;
+}
+
+static inline struct config_section *config_get_section_new(
+		struct config_sections *sections, const char *name)
+{
+	return config_get_section_n(sections, name, strlen(name));
+}
+
+static struct config_item *config_find_section_item(
+		struct config_section *section, const char *name,
+		uint32_t hash)
+{
+	size_t idx = config_index_find(&section->index, &section->items,
+			sizeof(struct config_item), name, hash);
+
+	return (idx != DARRAY_INVALID) ?
+		darray_item(sizeof(struct config_item), &section->items, idx) :
+		NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+/* background saving */
+
+/* saves queued within this long of each other are written only once */
+#define CONFIG_SAVE_DELAY_MS 250
+
+struct config_saver {
+	pthread_t       thread;
+	os_event_t      save_event;
+	os_event_t      stop_event;
+
+	pthread_mutex_t mutex;
+	struct dstr     pending;
+	long            pending_gen;
+	bool            has_pending;
+	bool            stop;
+};
+
 struct config_data {
-	char *file;
-	struct darray sections; /* struct config_section */
-	struct darray defaults; /* struct config_section */
+	char                   *file;
+	struct config_sections sections;
+	struct config_sections defaults;
+
+	/* serializes writes of the file itself.  every serialized copy gets
+	 * a generation number, and a copy older than the one already on
+	 * disk is never written over it */
+	pthread_mutex_t        write_mutex;
+	volatile long          save_gen;
+	long                   written_gen;
+	struct config_saver    *saver;
 };
 
+static inline struct config_data *config_data_create(const char *file)
+{
+	struct config_data *config = bzalloc(sizeof(struct config_data));
+
+	if (pthread_mutex_init(&config->write_mutex, NULL) != 0) {
+		bfree(config);
+		return NULL;
+	}
+
+	config->file = bstrdup(file);
+	return config;
+}
+
 config_t config_create(const char *file)
 {
-	struct config_data *config;
 	FILE *f;
 
 	f = os_fopen(file, "wb");
@@ -68,8 +278,7 @@ config_t config_create(const char *file)
 		return NULL;
 	fclose(f);
 
-	config = bzalloc(sizeof(struct config_data));
-	return config;
+	return config_data_create(file);
 }
 
 static inline void remove_ref_whitespace(struct strref *ref)
@@ -115,13 +324,25 @@ static bool config_parse_string(struct lexer *lex, struct strref *ref,
 	return success;
 }
 
-static void config_add_item(struct darray *items, struct strref *name,
-		struct strref *value)
+/* the first of any duplicate items is the one that's used */
+static void config_add_item(struct config_section *section,
+		struct strref *name, struct strref *value)
 {
 	struct config_item item;
+	uint32_t hash;
+
 	item.name  = bstrdup_n(name->array,  name->len);
 	item.value = bstrdup_n(value->array, value->len);
-	darray_push_back(sizeof(struct config_item), items, &item);
+	hash = hash_fnv1a_lower(item.name);
+
+	if (config_find_section_item(section, item.name, hash)) {
+		config_item_free(&item);
+		return;
+	}
+
+	darray_push_back(sizeof(struct config_item), &section->items, &item);
+	config_index_insert(&section->index, section->items.num, hash,
+			section->items.num - 1);
 }
 
 static void config_parse_section(struct config_section *section,
@@ -159,11 +380,11 @@ static void config_parse_section(struct config_section *section,
 		strref_clear(&value);
 		config_parse_string(lex, &value, 0);
 
-		config_add_item(&section->items, &name, &value);
+		config_add_item(section, &name, &value);
 	}
 }
 
-static int config_parse(struct darray *sections, const char *file,
+static int config_parse(struct config_sections *sections, const char *file,
 		bool always_open)
 {
 	char *file_data;
@@ -212,9 +433,7 @@ static int config_parse(struct darray *sections, const char *file,
 		if (!section_name.len)
 			break;
 
-		section = darray_push_back_new(sizeof(struct config_section),
-				sections);
-		section->name = bstrdup_n(section_name.array,
+		section = config_get_section_n(sections, section_name.array,
 				section_name.len);
 		config_parse_section(section, &lex);
 	}
@@ -233,12 +452,10 @@ int config_open(config_t *config, const char *file,
 	if (!config)
 		return CONFIG_ERROR;
 
-	*config = bzalloc(sizeof(struct config_data));
+	*config = config_data_create(file);
 	if (!*config)
 		return CONFIG_ERROR;
 
-	(*config)->file = bstrdup(file);
-
 	errorcode = config_parse(&(*config)->sections, file, always_open);
 
 	if (errorcode != CONFIG_SUCCESS) {
@@ -257,155 +474,292 @@ int config_open_defaults(config_t config, const char *file)
 	return config_parse(&config->defaults, file, false);
 }
 
-int config_save(config_t config)
+/* returns the generation of the serialized copy */
+static long config_serialize(config_t config, struct dstr *str)
 {
-	FILE *f;
-	struct dstr str;
+	long gen = os_atomic_inc_long(&config->save_gen);
 	size_t i, j;
 
-	if (!config)
-		return CONFIG_ERROR;
-
-	dstr_init(&str);
-
-	f = os_fopen(config->file, "wb");
-	if (!f)
-		return CONFIG_FILENOTFOUND;
-
-	for (i = 0; i < config->sections.num; i++) {
+	for (i = 0; i < config->sections.array.num; i++) {
 		struct config_section *section = darray_item(
 				sizeof(struct config_section),
-				&config->sections, i);
+				&config->sections.array, i);
 
-		if (i) dstr_cat(&str, "\n");
+		if (i) dstr_cat(str, "\n");
 
-		dstr_cat(&str, "[");
-		dstr_cat(&str, section->name);
-		dstr_cat(&str, "]\n");
+		dstr_cat(str, "[");
+		dstr_cat(str, section->name);
+		dstr_cat(str, "]\n");
 
 		for (j = 0; j < section->items.num; j++) {
 			struct config_item *item = darray_item(
 					sizeof(struct config_item),
 					&section->items, j);
 
-			dstr_cat(&str, item->name);
-			dstr_cat(&str, "=");
-			dstr_cat(&str, item->value);
-			dstr_cat(&str, "\n");
+			dstr_cat(str, item->name);
+			dstr_cat(str, "=");
+			dstr_cat(str, item->value);
+			dstr_cat(str, "\n");
 		}
 	}
 
+	return gen;
+}
+
+/* writes to a temporary file first and renames it over the old one, so the
+ * file is never left partially written.  a copy older than the last one
+ * written is dropped */
+static int config_write_file(config_t config, const struct dstr *str,
+		long gen)
+{
+	struct dstr temp_file = {0};
+	bool success = false;
+	FILE *f;
+
+	dstr_copy(&temp_file, config->file);
+	dstr_cat(&temp_file, ".tmp");
+
+	pthread_mutex_lock(&config->write_mutex);
+
+	if (gen < config->written_gen) {
+		pthread_mutex_unlock(&config->write_mutex);
+		dstr_free(&temp_file);
+		return CONFIG_SUCCESS;
+	}
+
+	f = os_fopen(temp_file.array, "wb");
+	if (f) {
 #ifdef _WIN32
-	fwrite("\xEF\xBB\xBF", 1, 3, f);
+		fwrite("\xEF\xBB\xBF", 1, 3, f);
 #endif
-	fwrite(str.array, 1, str.len, f);
-	fclose(f);
+		success = !str->len ||
+			fwrite(str->array, 1, str->len, f) == str->len;
+		if (fclose(f) != 0)
+			success = false;
+
+		if (success)
+			success = os_rename(temp_file.array, config->file);
+		if (success)
+			config->written_gen = gen;
+	}
+
+	pthread_mutex_unlock(&config->write_mutex);
+
+	if (!success)
+		blog(LOG_WARNING, "config_write_file: Failed to save '%s'",
+				config->file);
+
+	dstr_free(&temp_file);
+	return f ? (success ? CONFIG_SUCCESS : CONFIG_ERROR) :
+		CONFIG_FILENOTFOUND;
+}
+
+static void *config_saver_thread(void *data)
+{
+	struct config_data  *config = data;
+	struct config_saver *saver  = config->saver;
+
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "config saver");
+
+	while (os_event_wait(saver->save_event) == 0) {
+		struct dstr str = {0};
+		bool has_pending, stop;
+		long gen;
+
+		os_event_timedwait(saver->stop_event, CONFIG_SAVE_DELAY_MS);
+
+		pthread_mutex_lock(&saver->mutex);
+		dstr_move(&str, &saver->pending);
+		gen                = saver->pending_gen;
+		has_pending        = saver->has_pending;
+		stop               = saver->stop;
+		saver->has_pending = false;
+		pthread_mutex_unlock(&saver->mutex);
+
+		if (has_pending)
+			config_write_file(config, &str, gen);
+
+		dstr_free(&str);
+
+		if (stop)
+			break;
+	}
+
+	return NULL;
+}
+
+static void config_saver_destroy(struct config_saver *saver)
+{
+	dstr_free(&saver->pending);
+	os_event_destroy(saver->save_event);
+	os_event_destroy(saver->stop_event);
+	pthread_mutex_destroy(&saver->mutex);
+	bfree(saver);
+}
+
+static bool config_saver_init(config_t config)
+{
+	struct config_saver *saver = bzalloc(sizeof(struct config_saver));
+
+	if (pthread_mutex_init(&saver->mutex, NULL) != 0) {
+		bfree(saver);
+		return false;
+	}
+	if (os_event_init(&saver->save_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+	if (os_event_init(&saver->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+
+	config->saver = saver;
+
+	if (pthread_create(&saver->thread, NULL, config_saver_thread,
+				config) != 0) {
+		config->saver = NULL;
+		goto fail;
+	}
+
+	return true;
+
+fail:
+	config_saver_destroy(saver);
+	return false;
+}
+
+/* writes anything still queued before the thread exits */
+static void config_saver_stop(config_t config)
+{
+	struct config_saver *saver = config->saver;
+
+	pthread_mutex_lock(&saver->mutex);
+	saver->stop = true;
+	pthread_mutex_unlock(&saver->mutex);
+
+	os_event_signal(saver->stop_event);
+	os_event_signal(saver->save_event);
+	pthread_join(saver->thread, NULL);
+
+	config_saver_destroy(saver);
+	config->saver = NULL;
+}
+
+int config_save(config_t config)
+{
+	struct dstr str;
+	int errorcode;
+	long gen;
+
+	if (!config)
+		return CONFIG_ERROR;
+
+	/* anything still queued is older than what's about to be written */
+	if (config->saver) {
+		pthread_mutex_lock(&config->saver->mutex);
+		dstr_free(&config->saver->pending);
+		config->saver->has_pending = false;
+		pthread_mutex_unlock(&config->saver->mutex);
+	}
+
+	dstr_init(&str);
+	gen = config_serialize(config, &str);
+
+	errorcode = config_write_file(config, &str, gen);
 
 	dstr_free(&str);
+	return errorcode;
+}
+
+int config_save_async(config_t config)
+{
+	struct dstr str;
+	long gen;
+
+	if (!config)
+		return CONFIG_ERROR;
+	if (!config->saver && !config_saver_init(config))
+		return config_save(config);
+
+	dstr_init(&str);
+	gen = config_serialize(config, &str);
+
+	pthread_mutex_lock(&config->saver->mutex);
+	if (!config->saver->has_pending || gen > config->saver->pending_gen) {
+		dstr_free(&config->saver->pending);
+		dstr_move(&config->saver->pending, &str);
+		config->saver->pending_gen = gen;
+		config->saver->has_pending = true;
+	}
+	pthread_mutex_unlock(&config->saver->mutex);
 
+	dstr_free(&str);
+
+	os_event_signal(config->saver->save_event);
 	return CONFIG_SUCCESS;
 }
 
 void config_close(config_t config)
 {
-	struct config_section *defaults, *sections;
-	size_t i;
-
 	if (!config) return;
 
-	defaults = config->defaults.array;
-	sections = config->sections.array;
+	if (config->saver)
+		config_saver_stop(config);
 
-	for (i = 0; i < config->defaults.num; i++)
-		config_section_free(defaults+i);
-	for (i = 0; i < config->sections.num; i++)
-		config_section_free(sections+i);
-
-	darray_free(&config->defaults);
-	darray_free(&config->sections);
+	config_sections_free(&config->defaults);
+	config_sections_free(&config->sections);
+	pthread_mutex_destroy(&config->write_mutex);
 	bfree(config->file);
 	bfree(config);
 }
 
 size_t config_num_sections(config_t config)
 {
-	return config->sections.num;
+	return config->sections.array.num;
 }
 
 const char *config_get_section(config_t config, size_t idx)
 {
 	struct config_section *section;
 
-	if (idx >= config->sections.num)
+	if (idx >= config->sections.array.num)
 		return NULL;
 
-	section = darray_item(sizeof(struct config_section), &config->sections,
-			idx);
+	section = darray_item(sizeof(struct config_section),
+			&config->sections.array, idx);
 
 	return section->name;
 }
 
-static struct config_item *config_find_item(struct darray *sections,
+static struct config_item *config_find_item(struct config_sections *sections,
 		const char *section, const char *name)
 {
-	size_t i, j;
-
-	for (i = 0; i < sections->num; i++) {
-		struct config_section *sec = darray_item(
-				sizeof(struct config_section), sections, i);
+	struct config_section *sec;
 
-		if (astrcmpi(sec->name, section) == 0) {
-			for (j = 0; j < sec->items.num; j++) {
-				struct config_item *item = darray_item(
-						sizeof(struct config_item),
-						&sec->items, j);
-
-				if (astrcmpi(item->name, name) == 0)
-					return item;
-			}
-		}
-	}
+	sec = config_find_section(sections, section, hash_fnv1a_lower(section));
+	if (!sec)
+		return NULL;
 
-	return NULL;
+	return config_find_section_item(sec, name, hash_fnv1a_lower(name));
 }
 
-static void config_set_item(struct darray *sections, const char *section,
-		const char *name, char *value)
+static void config_set_item(struct config_sections *sections,
+		const char *section, const char *name, char *value)
 {
-	struct config_section *sec = NULL;
-	struct config_section *array = sections->array;
-	struct config_item *item;
-	size_t i, j;
-
-	for (i = 0; i < sections->num; i++) {
-		struct config_section *cur_sec = array+i;
-		struct config_item *items = cur_sec->items.array;
-
-		if (astrcmpi(cur_sec->name, section) == 0) {
-			for (j = 0; j < cur_sec->items.num; j++) {
-				item = items+j;
-
-				if (astrcmpi(item->name, name) == 0) {
-					bfree(item->value);
-					item->value = value;
-					return;
-				}
-			}
+	struct config_section *sec = config_get_section_new(sections, section);
+	struct config_item    *item;
+	uint32_t              hash = hash_fnv1a_lower(name);
 
-			sec = cur_sec;
-			break;
-		}
-	}
-
-	if (!sec) {
-		sec = darray_push_back_new(sizeof(struct config_section),
-				sections);
-		sec->name = bstrdup(section);
+	item = config_find_section_item(sec, name, hash);
+	if (item) {
+		bfree(item->value);
+		item->value = value;
+		return;
 	}
 
 	item = darray_push_back_new(sizeof(struct config_item), &sec->items);
 	item->name  = bstrdup(name);
 	item->value = value;
+
+	config_index_insert(&sec->index, sec->items.num, hash,
+			sec->items.num - 1);
 }
 
 void config_set_string(config_t config, const char *section,
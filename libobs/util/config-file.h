@@ -45,6 +45,14 @@ EXPORT config_t config_create(const char *file);
 EXPORT int config_open(config_t *config, const char *file,
 		enum config_open_type open_type);
 EXPORT int config_save(config_t config);
+
+/**
+ * Saves the config on a background thread.  The current values are copied
+ * before this returns, and saves made in quick succession are only written
+ * once.  The file is replaced atomically either way, and config_close waits
+ * for anything still queued to be written.
+ */
+EXPORT int config_save_async(config_t config);
 EXPORT void config_close(config_t config);
 
 EXPORT size_t config_num_sections(config_t config);
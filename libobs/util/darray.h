@@ -307,7 +307,7 @@ static inline void darray_erase(const size_t element_size, struct darray *dst,
 		return;
 	}
 
-	memcpy(darray_item(element_size, dst, idx),
+	memmove(darray_item(element_size, dst, idx),
 			darray_item(element_size, dst, idx+1),
 			element_size*(dst->num-idx));
 }
@@ -342,11 +342,21 @@ static inline void darray_erase_range(const size_t element_size,
 	if (move_count)
 		memmove(darray_item(element_size, dst, start),
 				darray_item(element_size, dst, end),
-				move_count);
+				move_count * element_size);
 
 	dst->num -= count;
 }
 
+/* removes the first count items with a single move */
+static inline void darray_pop_front_n(const size_t element_size,
+		struct darray *dst, size_t count)
+{
+	if (count > dst->num)
+		count = dst->num;
+	if (count)
+		darray_erase_range(element_size, dst, 0, count);
+}
+
 static inline void darray_pop_back(const size_t element_size,
 		struct darray *dst)
 {
@@ -516,6 +526,9 @@ static inline void darray_swap(const size_t element_size,
 #define da_pop_back(dst) \
 	darray_pop_back(sizeof(*dst.array), &dst.da);
 
+#define da_pop_front_n(dst, count) \
+	darray_pop_front_n(sizeof(*dst.array), &dst.da, count)
+
 #define da_join(dst, src) \
 	darray_join(sizeof(*dst.array), &dst.da, &src.da)
 
@@ -527,7 +540,7 @@ static inline void darray_swap(const size_t element_size,
 	darray_move_item(sizeof(*v.array), &v.da, from, to)
 
 #define da_swap_item(v, idx1, idx2) \
-	darray_swap(sizeof(v.array), &v.da, idx1, idx2)
+	darray_swap(sizeof(*v.array), &v.da, idx1, idx2)
 
 #ifdef __cplusplus
 }
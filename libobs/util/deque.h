@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+#include <string.h>
+#include <assert.h>
+
+#include "bmem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Double-ended queue
+ *
+ *   Ring-backed array of fixed size items with O(1) push and pop at both
+ * ends and random access.  Unlike circlebuf it works in items instead of
+ * bytes, and items can be accessed in place.  The capacity is always a power
+ * of two so indices wrap with a mask.
+ *
+ * NOTE: Not type-safe when using directly, see the DEQUE macro at the bottom
+ *       of the file.
+ */
+
+struct deque {
+	void   *array;
+	size_t start;
+	size_t num;
+	size_t capacity;
+};
+
+static inline void deque_init(struct deque *dq)
+{
+	memset(dq, 0, sizeof(struct deque));
+}
+
+static inline void deque_free(struct deque *dq)
+{
+	bfree(dq->array);
+	deque_init(dq);
+}
+
+static inline void deque_clear(struct deque *dq)
+{
+	dq->start = 0;
+	dq->num   = 0;
+}
+
+static inline void *deque_item(const size_t element_size,
+		const struct deque *dq, size_t idx)
+{
+	size_t pos = (dq->start + idx) & (dq->capacity - 1);
+	return (uint8_t*)dq->array + element_size * pos;
+}
+
+/* copies the items to a new array so that they start at 0 again */
+static inline void deque_realloc(const size_t element_size,
+		struct deque *dq, size_t new_capacity)
+{
+	uint8_t *array = bmalloc(element_size * new_capacity);
+	size_t  first  = dq->capacity - dq->start;
+
+	if (first > dq->num)
+		first = dq->num;
+
+	if (dq->num) {
+		memcpy(array, deque_item(element_size, dq, 0),
+				element_size * first);
+		memcpy(array + element_size * first, dq->array,
+				element_size * (dq->num - first));
+	}
+
+	bfree(dq->array);
+	dq->array    = array;
+	dq->start    = 0;
+	dq->capacity = new_capacity;
+}
+
+static inline void deque_reserve(const size_t element_size,
+		struct deque *dq, size_t capacity)
+{
+	size_t new_capacity = dq->capacity ? dq->capacity : 8;
+
+	while (new_capacity < capacity)
+		new_capacity *= 2;
+
+	if (new_capacity != dq->capacity)
+		deque_realloc(element_size, dq, new_capacity);
+}
+
+static inline void deque_ensure_space(const size_t element_size,
+		struct deque *dq)
+{
+	if (dq->num == dq->capacity)
+		deque_reserve(element_size, dq, dq->num + 1);
+}
+
+static inline void *deque_push_back_new(const size_t element_size,
+		struct deque *dq)
+{
+	void *item;
+
+	deque_ensure_space(element_size, dq);
+	item = deque_item(element_size, dq, dq->num++);
+	memset(item, 0, element_size);
+	return item;
+}
+
+static inline void deque_push_back(const size_t element_size,
+		struct deque *dq, const void *item)
+{
+	deque_ensure_space(element_size, dq);
+	memcpy(deque_item(element_size, dq, dq->num++), item, element_size);
+}
+
+static inline void deque_push_front(const size_t element_size,
+		struct deque *dq, const void *item)
+{
+	deque_ensure_space(element_size, dq);
+	dq->start = (dq->start - 1) & (dq->capacity - 1);
+	dq->num++;
+	memcpy(deque_item(element_size, dq, 0), item, element_size);
+}
+
+static inline void deque_pop_front(const size_t element_size,
+		struct deque *dq, void *item)
+{
+	assert(dq->num != 0);
+	if (!dq->num)
+		return;
+
+	if (item)
+		memcpy(item, deque_item(element_size, dq, 0), element_size);
+
+	dq->start = (dq->start + 1) & (dq->capacity - 1);
+	if (!--dq->num)
+		dq->start = 0;
+}
+
+static inline void deque_pop_back(const size_t element_size,
+		struct deque *dq, void *item)
+{
+	assert(dq->num != 0);
+	if (!dq->num)
+		return;
+
+	if (item)
+		memcpy(item, deque_item(element_size, dq, dq->num - 1),
+				element_size);
+
+	if (!--dq->num)
+		dq->start = 0;
+}
+
+static inline void deque_pop_front_n(struct deque *dq, size_t count)
+{
+	if (count >= dq->num) {
+		deque_clear(dq);
+		return;
+	}
+
+	dq->start = (dq->start + count) & (dq->capacity - 1);
+	dq->num  -= count;
+}
+
+/* ------------------------------------------------------------------------- */
+
+#define DEQUE(type)                      \
+	union {                          \
+		struct deque dq;         \
+		struct {                 \
+			type *array;     \
+			size_t start;    \
+			size_t num;      \
+			size_t capacity; \
+		};                       \
+	}
+
+#define dq_init(v) deque_init(&v.dq)
+
+#define dq_free(v) deque_free(&v.dq)
+
+#define dq_clear(v) deque_clear(&v.dq)
+
+#define dq_reserve(v, capacity) \
+	deque_reserve(sizeof(*v.array), &v.dq, capacity)
+
+/* pointer to the item at idx, counted from the front */
+#define dq_item(v, idx) \
+	(v.array + ((v.start + (idx)) & (v.capacity - 1)))
+
+#define dq_front(v) dq_item(v, 0)
+#define dq_back(v) dq_item(v, v.num - 1)
+
+#define dq_push_back(v, item) \
+	deque_push_back(sizeof(*v.array), &v.dq, item)
+
+#define dq_push_back_new(v) \
+	deque_push_back_new(sizeof(*v.array), &v.dq)
+
+#define dq_push_front(v, item) \
+	deque_push_front(sizeof(*v.array), &v.dq, item)
+
+#define dq_pop_front(v, item) \
+	deque_pop_front(sizeof(*v.array), &v.dq, item)
+
+#define dq_pop_back(v, item) \
+	deque_pop_back(sizeof(*v.array), &v.dq, item)
+
+#define dq_pop_front_n(v, count) \
+	deque_pop_front_n(&v.dq, count)
+
+#ifdef __cplusplus
+}
+#endif
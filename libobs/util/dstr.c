@@ -326,7 +326,8 @@ void dstr_ncopy(struct dstr *dst, const char *array, const size_t len)
 	if (!len)
 		return;
 
-	dst->array = bmemdup(array, len + 1);
+	dstr_ensure_capacity(dst, len + 1);
+	memcpy(dst->array, array, len);
 	dst->len   = len;
 
 	dst->array[len] = 0;
@@ -343,7 +344,8 @@ void dstr_ncopy_dstr(struct dstr *dst, const struct dstr *str, const size_t len)
 		return;
 
 	newlen = size_min(len, str->len);
-	dst->array = bmemdup(str->array, newlen + 1);
+	dstr_ensure_capacity(dst, newlen + 1);
+	memcpy(dst->array, str->array, newlen);
 	dst->len   = newlen;
 
 	dst->array[newlen] = 0;
@@ -485,26 +487,46 @@ void dstr_catf(struct dstr *dst, const char *format, ...)
 	va_end(args);
 }
 
-void dstr_vprintf(struct dstr *dst, const char *format, va_list args)
+/* formats in to the string starting at offset, growing it as needed */
+static void dstr_vprintf_at(struct dstr *dst, size_t offset,
+		const char *format, va_list args)
 {
-	dstr_ensure_capacity(dst, 4096);
-	vsnprintf(dst->array, 4095, format, args);
+	size_t capacity = dstr_capacity(dst);
+	size_t size     = (capacity > offset + 1) ? capacity - offset : 64;
 
-	if (!*dst->array) {
-		dstr_free(dst);
-		return;
+	for (;;) {
+		va_list args_copy;
+		size_t  avail;
+		int     len;
+
+		dstr_ensure_capacity(dst, offset + size);
+		avail = dstr_capacity(dst) - offset;
+
+		va_copy(args_copy, args);
+		len = vsnprintf(dst->array + offset, avail, format, args_copy);
+		va_end(args_copy);
+
+		if (len >= 0 && (size_t)len < avail) {
+			dst->len = offset + (size_t)len;
+			return;
+		}
+
+		/* older windows runtimes return -1 if it doesn't fit */
+		size = (len >= 0) ? (size_t)len + 1 : avail * 2;
 	}
+}
 
-	dst->len = strlen(dst->array);
+void dstr_vprintf(struct dstr *dst, const char *format, va_list args)
+{
+	dstr_vprintf_at(dst, 0, format, args);
+
+	if (!dst->len)
+		dstr_free(dst);
 }
 
 void dstr_vcatf(struct dstr *dst, const char *format, va_list args)
 {
-	struct dstr temp;
-	dstr_init(&temp);
-	dstr_vprintf(&temp, format, args);
-	dstr_cat_dstr(dst, &temp);
-	dstr_free(&temp);
+	dstr_vprintf_at(dst, dst->len, format, args);
 }
 
 void dstr_safe_printf(struct dstr *dst, const char *format,
@@ -634,7 +656,14 @@ void dstr_right(struct dstr *dst, const struct dstr *str, const size_t pos)
 void dstr_from_mbs(struct dstr *dst, const char *mbstr)
 {
 	dstr_free(dst);
-	dst->len = os_mbs_to_utf8_ptr(mbstr, 0, &dst->array);
+
+	/* the converted string is a new allocation, even if the old buffer
+	 * was borrowed */
+	dst->array    = NULL;
+	dst->capacity = 0;
+	dst->len      = os_mbs_to_utf8_ptr(mbstr, 0, &dst->array);
+	if (dst->array)
+		dst->capacity = dst->len + 1;
 }
 
 char *dstr_to_mbs(const struct dstr *str)
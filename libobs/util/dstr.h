@@ -39,6 +39,25 @@ struct dstr {
 	size_t capacity;
 };
 
+/*
+ *   A dstr can start out in a buffer it doesn't own, usually on the stack,
+ * and only moves to the heap once the string outgrows it.  This flag in
+ * the capacity marks a buffer that must not be freed or reallocated.
+ *
+ *   The array of such a string must never be handed off to be freed, and the
+ * buffer must outlive the dstr.  dstr_free empties the string but keeps the
+ * buffer, and still has to be called in case the string moved to the heap.
+ */
+#define DSTR_BORROWED ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+#define DSTR_SMALL_SIZE 128
+
+/* a dstr with its own small buffer.  must not be copied or moved */
+struct dstr_small {
+	struct dstr str;
+	char        buf[DSTR_SMALL_SIZE];
+};
+
 EXPORT int astrcmpi(const char *str1, const char *str2);
 EXPORT int wstrcmpi(const wchar_t *str1, const wchar_t *str2);
 EXPORT int astrcmp_n(const char *str1, const char *str2, size_t n);
@@ -55,6 +74,8 @@ EXPORT char **strlist_split(const char *str, char split_ch, bool include_empty);
 EXPORT void strlist_free(char **strlist);
 
 static inline void dstr_init(struct dstr *dst);
+static inline void dstr_init_buf(struct dstr *dst, char *buf, size_t size);
+static inline struct dstr *dstr_small_init(struct dstr_small *small);
 static inline void dstr_init_move(struct dstr *dst, struct dstr *src);
 static inline void dstr_init_move_array(struct dstr *dst, char *str);
 static inline void dstr_init_copy(struct dstr *dst, const char *src);
@@ -151,6 +172,35 @@ static inline void dstr_init(struct dstr *dst)
 	dst->capacity = 0;
 }
 
+static inline void dstr_init_buf(struct dstr *dst, char *buf, size_t size)
+{
+	if (!buf || !size) {
+		dstr_init(dst);
+		return;
+	}
+
+	*buf          = 0;
+	dst->array    = buf;
+	dst->len      = 0;
+	dst->capacity = size | DSTR_BORROWED;
+}
+
+static inline struct dstr *dstr_small_init(struct dstr_small *small)
+{
+	dstr_init_buf(&small->str, small->buf, sizeof(small->buf));
+	return &small->str;
+}
+
+static inline size_t dstr_capacity(const struct dstr *str)
+{
+	return str->capacity & ~DSTR_BORROWED;
+}
+
+static inline bool dstr_borrowed(const struct dstr *str)
+{
+	return (str->capacity & DSTR_BORROWED) != 0;
+}
+
 static inline void dstr_init_move_array(struct dstr *dst, char *str)
 {
 	dst->array    = str;
@@ -160,6 +210,13 @@ static inline void dstr_init_move_array(struct dstr *dst, char *str)
 
 static inline void dstr_init_move(struct dstr *dst, struct dstr *src)
 {
+	/* a borrowed buffer stays with its owner, so it has to be copied */
+	if (dstr_borrowed(src)) {
+		dstr_init_copy_dstr(dst, src);
+		dstr_free(src);
+		return;
+	}
+
 	*dst = *src;
 	dstr_init(src);
 }
@@ -178,6 +235,13 @@ static inline void dstr_init_copy_dstr(struct dstr *dst, const struct dstr *src)
 
 static inline void dstr_free(struct dstr *dst)
 {
+	/* a borrowed buffer is kept so the string can be reused */
+	if (dstr_borrowed(dst)) {
+		*dst->array = 0;
+		dst->len    = 0;
+		return;
+	}
+
 	bfree(dst->array);
 	dst->array    = NULL;
 	dst->len      = 0;
@@ -205,17 +269,37 @@ static inline void dstr_move(struct dstr *dst, struct dstr *src)
 	dstr_init_move(dst, src);
 }
 
+static inline void dstr_realloc(struct dstr *dst, const size_t new_cap)
+{
+	if (dstr_borrowed(dst)) {
+		/* callers can raise len before growing the string, so only
+		 * what fits in the borrowed buffer is copied */
+		size_t size   = dst->len + 1;
+		char   *array = (char*)bmalloc(new_cap);
+
+		if (size > dstr_capacity(dst))
+			size = dstr_capacity(dst);
+
+		memcpy(array, dst->array, size);
+		dst->array = array;
+	} else {
+		dst->array = (char*)brealloc(dst->array, new_cap);
+	}
+
+	dst->capacity = new_cap;
+}
+
 static inline void dstr_ensure_capacity(struct dstr *dst, const size_t new_size)
 {
+	size_t capacity = dstr_capacity(dst);
 	size_t new_cap;
-	if (new_size <= dst->capacity)
+	if (new_size <= capacity)
 		return;
 
-	new_cap = (!dst->capacity) ? new_size : dst->capacity*2;
+	new_cap = (!capacity) ? new_size : capacity*2;
 	if (new_size > new_cap)
 		new_cap = new_size;
-	dst->array = (char*)brealloc(dst->array, new_cap);
-	dst->capacity = new_cap;
+	dstr_realloc(dst, new_cap);
 }
 
 static inline void dstr_copy_dstr(struct dstr *dst, const struct dstr *src)
@@ -232,9 +316,10 @@ static inline void dstr_reserve(struct dstr *dst, const size_t capacity)
 {
 	if (capacity == 0 || capacity <= dst->len)
 		return;
+	if (dstr_borrowed(dst) && capacity <= dstr_capacity(dst))
+		return;
 
-	dst->array = (char*)brealloc(dst->array, capacity);
-	dst->capacity = capacity;
+	dstr_realloc(dst, capacity);
 }
 
 static inline void dstr_resize(struct dstr *dst, const size_t num)
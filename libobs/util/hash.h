@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 32-bit FNV-1a string hashes, used by the name indexes.  The _lower
+ * variants fold ASCII upper case to lower case, for names that are compared
+ * case-insensitively.
+ */
+
+#define HASH_FNV1A_BASIS 2166136261U
+#define HASH_FNV1A_PRIME 16777619U
+
+static inline uint32_t hash_fnv1a_byte(uint32_t hash, uint8_t byte)
+{
+	return (hash ^ byte) * HASH_FNV1A_PRIME;
+}
+
+static inline uint8_t hash_lower_char(char ch)
+{
+	return (uint8_t)((ch >= 'A' && ch <= 'Z') ? ch + 0x20 : ch);
+}
+
+static inline uint32_t hash_fnv1a(const char *str)
+{
+	uint32_t hash = HASH_FNV1A_BASIS;
+
+	while (*str)
+		hash = hash_fnv1a_byte(hash, (uint8_t)*(str++));
+
+	return hash;
+}
+
+static inline uint32_t hash_fnv1a_lower(const char *str)
+{
+	uint32_t hash = HASH_FNV1A_BASIS;
+
+	while (*str)
+		hash = hash_fnv1a_byte(hash, hash_lower_char(*(str++)));
+
+	return hash;
+}
+
+static inline uint32_t hash_fnv1a_lower_n(const char *str, size_t len)
+{
+	uint32_t hash = HASH_FNV1A_BASIS;
+
+	for (size_t i = 0; i < len; i++)
+		hash = hash_fnv1a_byte(hash, hash_lower_char(str[i]));
+
+	return hash;
+}
+
+#ifdef __cplusplus
+}
+#endif
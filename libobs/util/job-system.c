@@ -0,0 +1,557 @@
+/*
+ * Copyright (c) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "bmem.h"
+#include "base.h"
+#include "darray.h"
+#include "platform.h"
+#include "threading.h"
+#include "job-system.h"
+
+/* the calling thread is one of the callers of a parallel for, so there's no
+ * point in queueing more jobs for it than there are workers */
+#define MAX_PARALLEL_JOBS 64
+
+/*
+ * A job holds a reference for its creator, one while it's submitted (until
+ * it's been taken from a queue), and one for each job it has to wait for.
+ * pending starts at 1 for the submit, and is incremented for each
+ * dependency.  The job is queued by whoever decrements it to 0.
+ *
+ *   Whoever sets started first gets to run (or cancel) the job, so taking
+ * the same job from a queue and cancelling it can't both call it.
+ */
+
+struct job {
+	struct job_system        *js;
+	job_func_t               func;
+	void                     *param;
+	enum job_priority        priority;
+	uint64_t                 deadline;
+
+	volatile long            refs;
+	volatile long            pending;
+	volatile long            started;
+	volatile long            done;
+
+	/* jobs that wait for this one, protected by the dependency mutex */
+	DARRAY(struct job*)      dependents;
+};
+
+struct job_worker {
+	struct job_system        *js;
+	pthread_t                thread;
+
+	/* the worker pushes and pops the back, thieves take the front */
+	pthread_mutex_t          mutex;
+	DARRAY(struct job*)      jobs;
+};
+
+struct job_system {
+	/* workers[0] to workers[num_threads-1] are running */
+	struct job_worker        *workers;
+	size_t                   num_workers;
+	size_t                   num_threads;
+
+	/* sorted by deadline, latest first, so the next job is at the back */
+	pthread_mutex_t          queue_mutex;
+	DARRAY(struct job*)      queues[JOB_PRIORITY_COUNT];
+
+	pthread_mutex_t          dep_mutex;
+
+	/* threads in job_wait sleep here when there's nothing they can run */
+	pthread_mutex_t          wait_mutex;
+	pthread_cond_t           wait_cond;
+	bool                     wait_cond_valid;
+	volatile long            waiters;
+
+	os_sem_t                 sem;
+	volatile bool            stop;
+};
+
+#ifdef _MSC_VER
+static __declspec(thread) struct job_worker *current_worker = NULL;
+#else
+static __thread struct job_worker *current_worker = NULL;
+#endif
+
+static inline struct job_worker *get_worker(struct job_system *js)
+{
+	struct job_worker *worker = current_worker;
+	return (worker && worker->js == js) ? worker : NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void wake_waiters(struct job_system *js)
+{
+	if (os_atomic_load_long(&js->waiters)) {
+		pthread_mutex_lock(&js->wait_mutex);
+		pthread_cond_broadcast(&js->wait_cond);
+		pthread_mutex_unlock(&js->wait_mutex);
+	}
+}
+
+static void insert_job(struct job_system *js, struct job *job)
+{
+	struct darray *queue = &js->queues[job->priority].da;
+	struct job **jobs = queue->array;
+	size_t lo = 0, hi = queue->num;
+
+	/* before the jobs with the same deadline, which were queued earlier
+	 * and are taken first */
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (jobs[mid]->deadline <= job->deadline)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	darray_insert(sizeof(struct job*), queue, lo, &job);
+}
+
+static void enqueue_job(struct job *job)
+{
+	struct job_system *js = job->js;
+	struct job_worker *worker = get_worker(js);
+
+	if (worker && job->priority != JOB_PRIORITY_HIGH) {
+		pthread_mutex_lock(&worker->mutex);
+		da_push_back(worker->jobs, &job);
+		pthread_mutex_unlock(&worker->mutex);
+	} else {
+		pthread_mutex_lock(&js->queue_mutex);
+		insert_job(js, job);
+		pthread_mutex_unlock(&js->queue_mutex);
+	}
+
+	os_sem_post(js->sem);
+	wake_waiters(js);
+}
+
+static struct job *pop_shared(struct job_system *js,
+		enum job_priority from, enum job_priority to)
+{
+	struct job *job = NULL;
+
+	pthread_mutex_lock(&js->queue_mutex);
+
+	for (int i = (int)from; i >= (int)to; i--) {
+		size_t num = js->queues[i].num;
+
+		if (num) {
+			job = js->queues[i].array[num-1];
+			da_pop_back(js->queues[i]);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&js->queue_mutex);
+	return job;
+}
+
+static struct job *pop_local(struct job_worker *worker,
+		enum job_priority min_priority)
+{
+	struct job *job = NULL;
+
+	pthread_mutex_lock(&worker->mutex);
+
+	for (size_t i = worker->jobs.num; i > 0; i--) {
+		if (worker->jobs.array[i-1]->priority >= min_priority) {
+			job = worker->jobs.array[i-1];
+			da_erase(worker->jobs, i-1);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&worker->mutex);
+	return job;
+}
+
+static struct job *steal(struct job_worker *victim,
+		enum job_priority min_priority)
+{
+	struct job *job = NULL;
+
+	pthread_mutex_lock(&victim->mutex);
+
+	for (size_t i = 0; i < victim->jobs.num; i++) {
+		if (victim->jobs.array[i]->priority >= min_priority) {
+			job = victim->jobs.array[i];
+			da_erase(victim->jobs, i);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&victim->mutex);
+	return job;
+}
+
+/* @worker is NULL for threads that aren't workers of the system */
+static struct job *find_job(struct job_system *js, struct job_worker *worker,
+		enum job_priority min_priority)
+{
+	struct job *job;
+	size_t start;
+
+	job = pop_shared(js, JOB_PRIORITY_HIGH, JOB_PRIORITY_HIGH);
+	if (job)
+		return job;
+
+	if (worker) {
+		job = pop_local(worker, min_priority);
+		if (job)
+			return job;
+	}
+
+	if (min_priority < JOB_PRIORITY_HIGH) {
+		job = pop_shared(js, JOB_PRIORITY_HIGH - 1, min_priority);
+		if (job)
+			return job;
+	}
+
+	/* start after the worker itself so thieves spread out */
+	start = worker ? (size_t)(worker - js->workers) + 1 : 0;
+
+	for (size_t i = 0; i < js->num_workers; i++) {
+		struct job_worker *victim =
+			js->workers + (start + i) % js->num_workers;
+
+		if (victim == worker || !victim->jobs.num)
+			continue;
+
+		job = steal(victim, min_priority);
+		if (job)
+			return job;
+	}
+
+	return NULL;
+}
+
+static void finish_job(struct job *job)
+{
+	struct job_system *js = job->js;
+	struct darray dependents;
+
+	pthread_mutex_lock(&js->dep_mutex);
+	os_atomic_set_long(&job->done, 1);
+	dependents = job->dependents.da;
+	da_init(job->dependents);
+	pthread_mutex_unlock(&js->dep_mutex);
+
+	for (size_t i = 0; i < dependents.num; i++) {
+		struct job *dependent = ((struct job**)dependents.array)[i];
+
+		if (os_atomic_dec_long(&dependent->pending) == 0)
+			enqueue_job(dependent);
+		job_release(dependent);
+	}
+
+	darray_free(&dependents);
+	wake_waiters(js);
+}
+
+/* releases the reference of the queue it was taken from */
+static void run_job(struct job *job)
+{
+	if (os_atomic_set_long(&job->started, 1) == 0) {
+		job->func(job->param);
+		finish_job(job);
+	}
+
+	job_release(job);
+}
+
+static void *worker_thread(void *param)
+{
+	struct job_worker *worker = param;
+	struct job_system *js = worker->js;
+
+	current_worker = worker;
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "job worker");
+
+	for (;;) {
+		struct job *job = find_job(js, worker, JOB_PRIORITY_LOW);
+
+		if (job) {
+			run_job(job);
+			continue;
+		}
+
+		if (js->stop)
+			break;
+
+		os_sem_wait(js->sem);
+	}
+
+	current_worker = NULL;
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+job_system_t job_system_create(size_t threads)
+{
+	struct job_system *js = bzalloc(sizeof(struct job_system));
+
+	if (!threads) {
+		int cores = os_get_logical_cores();
+		threads = cores > 2 ? (size_t)cores - 1 : 1;
+	}
+
+	pthread_mutex_init_value(&js->queue_mutex);
+	pthread_mutex_init_value(&js->dep_mutex);
+	pthread_mutex_init_value(&js->wait_mutex);
+
+	if (pthread_mutex_init(&js->queue_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&js->dep_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&js->wait_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_cond_init(&js->wait_cond, NULL) != 0)
+		goto fail;
+	js->wait_cond_valid = true;
+	if (os_sem_init(&js->sem, 0) != 0)
+		goto fail;
+
+	js->workers = bzalloc(sizeof(struct job_worker) * threads);
+
+	for (size_t i = 0; i < threads; i++) {
+		js->workers[i].js = js;
+		if (pthread_mutex_init(&js->workers[i].mutex, NULL) != 0)
+			goto fail;
+		js->num_workers++;
+	}
+
+	for (size_t i = 0; i < threads; i++) {
+		if (pthread_create(&js->workers[i].thread, NULL,
+					worker_thread, js->workers+i) != 0)
+			break;
+		js->num_threads++;
+	}
+
+	if (!js->num_threads)
+		goto fail;
+
+	return js;
+
+fail:
+	blog(LOG_ERROR, "job_system_create: Failed to start the workers");
+	job_system_destroy(js);
+	return NULL;
+}
+
+void job_system_destroy(job_system_t js)
+{
+	struct job *job;
+
+	if (!js)
+		return;
+
+	js->stop = true;
+
+	for (size_t i = 0; i < js->num_threads; i++)
+		os_sem_post(js->sem);
+	for (size_t i = 0; i < js->num_threads; i++)
+		pthread_join(js->workers[i].thread, NULL);
+
+	/* a worker that exits can miss jobs queued by one that hadn't yet */
+	while ((job = find_job(js, NULL, JOB_PRIORITY_LOW)) != NULL)
+		run_job(job);
+
+	for (size_t i = 0; i < js->num_workers; i++) {
+		pthread_mutex_destroy(&js->workers[i].mutex);
+		da_free(js->workers[i].jobs);
+	}
+	for (size_t i = 0; i < JOB_PRIORITY_COUNT; i++)
+		da_free(js->queues[i]);
+
+	if (js->wait_cond_valid)
+		pthread_cond_destroy(&js->wait_cond);
+	os_sem_destroy(js->sem);
+	pthread_mutex_destroy(&js->queue_mutex);
+	pthread_mutex_destroy(&js->dep_mutex);
+	pthread_mutex_destroy(&js->wait_mutex);
+	bfree(js->workers);
+	bfree(js);
+}
+
+size_t job_system_threads(job_system_t js)
+{
+	return js ? js->num_threads : 0;
+}
+
+job_t job_create(job_system_t js, job_func_t func, void *param,
+		enum job_priority priority)
+{
+	struct job *job;
+
+	if (!js || !func)
+		return NULL;
+
+	job = bzalloc(sizeof(struct job));
+	job->js       = js;
+	job->func     = func;
+	job->param    = param;
+	job->priority = priority;
+	job->deadline = UINT64_MAX;
+	job->refs     = 1;
+	job->pending  = 1;
+	return job;
+}
+
+void job_release(job_t job)
+{
+	if (job && os_atomic_dec_long(&job->refs) == 0) {
+		da_free(job->dependents);
+		bfree(job);
+	}
+}
+
+void job_set_deadline(job_t job, uint64_t deadline_ns)
+{
+	if (job)
+		job->deadline = deadline_ns ? deadline_ns : UINT64_MAX;
+}
+
+void job_add_dependency(job_t job, job_t dependency)
+{
+	struct job_system *js;
+
+	if (!job || !dependency)
+		return;
+
+	js = job->js;
+
+	pthread_mutex_lock(&js->dep_mutex);
+
+	if (!dependency->done) {
+		os_atomic_inc_long(&job->refs);
+		os_atomic_inc_long(&job->pending);
+		da_push_back(dependency->dependents, &job);
+	}
+
+	pthread_mutex_unlock(&js->dep_mutex);
+}
+
+void job_submit(job_t job)
+{
+	if (!job)
+		return;
+
+	os_atomic_inc_long(&job->refs);
+
+	if (os_atomic_dec_long(&job->pending) == 0)
+		enqueue_job(job);
+}
+
+bool job_done(job_t job)
+{
+	return job ? os_atomic_load_long(&job->done) != 0 : true;
+}
+
+void job_wait(job_t job)
+{
+	struct job_system *js;
+	struct job_worker *worker;
+
+	if (!job)
+		return;
+
+	js     = job->js;
+	worker = get_worker(js);
+
+	/* only jobs that are at least as urgent are run in the meantime, so
+	 * a high priority waiter doesn't end up in a long low priority job */
+	while (!os_atomic_load_long(&job->done)) {
+		struct job *other = find_job(js, worker, job->priority);
+
+		if (other) {
+			run_job(other);
+			continue;
+		}
+
+		pthread_mutex_lock(&js->wait_mutex);
+		os_atomic_inc_long(&js->waiters);
+		if (!os_atomic_load_long(&job->done))
+			pthread_cond_wait(&js->wait_cond, &js->wait_mutex);
+		os_atomic_dec_long(&js->waiters);
+		pthread_mutex_unlock(&js->wait_mutex);
+	}
+}
+
+bool job_cancel(job_t job)
+{
+	if (!job || os_atomic_set_long(&job->started, 1) != 0)
+		return false;
+
+	/* the queue still has its reference, and drops it once it comes
+	 * across the job */
+	finish_job(job);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct parallel_range {
+	job_range_func_t         func;
+	void                     *param;
+	long                     count;
+	volatile long            next;
+};
+
+static void run_range(void *param)
+{
+	struct parallel_range *range = param;
+	long idx;
+
+	while ((idx = os_atomic_inc_long(&range->next) - 1) < range->count)
+		range->func(range->param, (size_t)idx);
+}
+
+void job_parallel_for(job_system_t js, size_t count,
+		job_range_func_t func, void *param,
+		enum job_priority priority, uint64_t deadline_ns)
+{
+	struct parallel_range range = {func, param, (long)count, 0};
+	job_t jobs[MAX_PARALLEL_JOBS];
+	size_t num_jobs = count ? count - 1 : 0;
+
+	if (num_jobs > job_system_threads(js))
+		num_jobs = job_system_threads(js);
+	if (num_jobs > MAX_PARALLEL_JOBS)
+		num_jobs = MAX_PARALLEL_JOBS;
+
+	for (size_t i = 0; i < num_jobs; i++) {
+		jobs[i] = job_create(js, run_range, &range, priority);
+		job_set_deadline(jobs[i], deadline_ns);
+		job_submit(jobs[i]);
+	}
+
+	run_range(&range);
+
+	/* the indices have all been handed out, so jobs that haven't
+	 * started have nothing left to do */
+	for (size_t i = 0; i < num_jobs; i++) {
+		if (!job_cancel(jobs[i]))
+			job_wait(jobs[i]);
+		job_release(jobs[i]);
+	}
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+
+/*
+ * Job system
+ *
+ *   A fixed set of worker threads shared by everything that has short pieces
+ * of CPU work to run in parallel, instead of each feature starting threads
+ * of its own.  Jobs are run by priority, and jobs of the same priority by
+ * deadline, earliest first (jobs without one go last, in submission order).
+ *
+ *   Jobs submitted by a worker (other than high priority ones) go on that
+ * worker's own queue, which it runs newest first before going back to the
+ * shared queues.  Idle workers steal from the other workers' queues, oldest
+ * first.
+ *
+ *   A job can depend on other jobs, in which case it's queued once all of
+ * them have finished.  Waiting for a job runs other queued jobs of the same
+ * or a higher priority in the meantime, so waiting from a worker can't
+ * deadlock and a waiting thread is never idle.
+ *
+ *   Jobs are meant for work that doesn't block.  Threads that wait on a
+ * clock, a device or the network should stay threads of their own.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct job_system;
+struct job;
+typedef struct job_system *job_system_t;
+typedef struct job        *job_t;
+
+enum job_priority {
+	JOB_PRIORITY_LOW,
+	JOB_PRIORITY_NORMAL,
+	JOB_PRIORITY_HIGH
+};
+
+#define JOB_PRIORITY_COUNT 3
+
+typedef void (*job_func_t)(void *param);
+typedef void (*job_range_func_t)(void *param, size_t idx);
+
+/**
+ * Creates a job system with @threads workers, or one less than the number
+ * of logical cores if 0.  Returns NULL if no worker could be started.
+ */
+EXPORT job_system_t job_system_create(size_t threads);
+
+/**
+ * Runs the jobs that are still queued, then stops the workers.  Jobs that
+ * are still waiting for their dependencies are never run.
+ */
+EXPORT void job_system_destroy(job_system_t js);
+
+EXPORT size_t job_system_threads(job_system_t js);
+
+/**
+ * Creates a job that calls @func once submitted.  The returned reference has
+ * to be released with job_release, which can be done right after submitting
+ * it if the job isn't waited on.
+ */
+EXPORT job_t job_create(job_system_t js, job_func_t func, void *param,
+		enum job_priority priority);
+
+EXPORT void job_release(job_t job);
+
+/**
+ * Sets the time (in os_gettime_ns time) by which the job should be done.
+ * Only orders jobs of the same priority.  Call before job_submit.
+ */
+EXPORT void job_set_deadline(job_t job, uint64_t deadline_ns);
+
+/**
+ * Makes @job wait for @dependency to finish before it's run.  Both have to
+ * belong to the same job system, and it has to be called before @job is
+ * submitted.
+ */
+EXPORT void job_add_dependency(job_t job, job_t dependency);
+
+/**
+ * Submits the job, which is queued right away, or once its dependencies
+ * have finished.  A job can only be submitted once.
+ */
+EXPORT void job_submit(job_t job);
+
+/**
+ * Waits for a submitted job to finish, running other jobs in the meantime.
+ */
+EXPORT void job_wait(job_t job);
+
+/**
+ * Takes back a job that hasn't started yet.  It won't be run, and counts as
+ * finished for its dependents and waiters.  Returns false if it had already
+ * started (or finished).
+ */
+EXPORT bool job_cancel(job_t job);
+
+EXPORT bool job_done(job_t job);
+
+/**
+ * Calls @func for each index below @count on the workers and the calling
+ * thread, and returns once all calls have returned.  Indices are handed out
+ * one at a time, so uneven calls balance out.
+ */
+EXPORT void job_parallel_for(job_system_t js, size_t count,
+		job_range_func_t func, void *param,
+		enum job_priority priority, uint64_t deadline_ns);
+
+#ifdef __cplusplus
+}
+#endif
@@ -87,6 +87,29 @@ void os_sleep_ms(uint32_t duration)
 	usleep(duration*1000);
 }
 
+#define PRECISE_SPIN_NS 100000ULL
+
+bool os_sleepto_ns_precise(uint64_t time_target)
+{
+	uint64_t current = os_gettime_ns();
+	if (time_target < current)
+		return false;
+
+	/* mach_wait_until takes an absolute time in mach units, which
+	 * os_gettime_ns converts to nanoseconds */
+	if (time_target - current > PRECISE_SPIN_NS) {
+		mach_timebase_info_data_t info = {1, 1};
+		uint64_t wake = time_target - PRECISE_SPIN_NS;
+
+		mach_timebase_info(&info);
+		mach_wait_until((uint64_t)((double)wake *
+					(double)info.denom / (double)info.numer));
+	}
+
+	while (os_gettime_ns() < time_target);
+	return true;
+}
+
 
 /* clock function selection taken from libc++ */
 static uint64_t ns_time_simple()
@@ -168,3 +191,9 @@ int os_mkdir(const char *path)
 
 	return MKDIR_ERROR;
 }
+
+int os_get_logical_cores(void)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return cores > 0 ? (int)cores : 1;
+}
@@ -77,6 +77,32 @@ bool os_sleepto_ns(uint64_t time_target)
 	return true;
 }
 
+/* absolute sleeps wake up within a few dozen microseconds */
+#define PRECISE_SPIN_NS 100000ULL
+
+bool os_sleepto_ns_precise(uint64_t time_target)
+{
+	uint64_t current = os_gettime_ns();
+	if (time_target < current)
+		return false;
+
+	/* os_gettime_ns uses the monotonic clock, so the target can be used
+	 * as the deadline directly */
+	if (time_target - current > PRECISE_SPIN_NS) {
+		uint64_t wake = time_target - PRECISE_SPIN_NS;
+		struct timespec ts;
+
+		ts.tv_sec  = (time_t)(wake / 1000000000);
+		ts.tv_nsec = (long)(wake % 1000000000);
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+					NULL) == EINTR);
+	}
+
+	while (os_gettime_ns() < time_target);
+	return true;
+}
+
 void os_sleep_ms(uint32_t duration)
 {
 	usleep(duration*1000);
@@ -116,3 +142,14 @@ int os_mkdir(const char *path)
 
 	return (errno == EEXIST) ? MKDIR_EXISTS : MKDIR_ERROR;
 }
+
+bool os_rename(const char *old_path, const char *new_path)
+{
+	return rename(old_path, new_path) == 0;
+}
+
+int os_get_logical_cores(void)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return cores > 0 ? (int)cores : 1;
+}
@@ -111,6 +111,55 @@ bool os_sleepto_ns(uint64_t time_target)
 	}
 }
 
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x2
+#endif
+
+/* even high resolution waitable timers can be a bit under a millisecond
+ * late, so spin for longer than on other platforms */
+#define PRECISE_SPIN_NS 1000000ULL
+
+static HANDLE create_precise_timer(void)
+{
+	HANDLE timer = CreateWaitableTimerExW(NULL, NULL,
+			CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+
+	/* high resolution timers need windows 10 1803 or later */
+	if (!timer)
+		timer = CreateWaitableTimerExW(NULL, NULL, 0,
+				TIMER_ALL_ACCESS);
+	return timer;
+}
+
+bool os_sleepto_ns_precise(uint64_t time_target)
+{
+	/* one timer per thread, kept for the life of the thread */
+	static __declspec(thread) HANDLE timer = NULL;
+	uint64_t t = os_gettime_ns();
+
+	if (t >= time_target)
+		return false;
+
+	if (!timer)
+		timer = create_precise_timer();
+
+	/* waitable timer deadlines are based on the system time rather
+	 * than the performance counter, so a relative due time is used */
+	if (timer && time_target - t > PRECISE_SPIN_NS) {
+		LARGE_INTEGER due;
+		due.QuadPart = -(LONGLONG)((time_target - PRECISE_SPIN_NS - t)
+				/ 100);
+
+		if (SetWaitableTimer(timer, &due, 0, NULL, NULL, false))
+			WaitForSingleObject(timer, INFINITE);
+	}
+
+	while (os_gettime_ns() < time_target)
+		YieldProcessor();
+
+	return true;
+}
+
 void os_sleep_ms(uint32_t duration)
 {
 	/* windows 8+ appears to have decreased sleep precision */
@@ -185,6 +234,29 @@ int os_mkdir(const char *path)
 	return MKDIR_SUCCESS;
 }
 
+bool os_rename(const char *old_path, const char *new_path)
+{
+	wchar_t *old_path_utf16 = NULL;
+	wchar_t *new_path_utf16 = NULL;
+	BOOL success = false;
+
+	if (os_utf8_to_wcs_ptr(old_path, 0, &old_path_utf16) &&
+	    os_utf8_to_wcs_ptr(new_path, 0, &new_path_utf16))
+		success = MoveFileExW(old_path_utf16, new_path_utf16,
+				MOVEFILE_REPLACE_EXISTING);
+
+	bfree(old_path_utf16);
+	bfree(new_path_utf16);
+	return !!success;
+}
+
+int os_get_logical_cores(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors ? (int)info.dwNumberOfProcessors : 1;
+}
+
 
 BOOL WINAPI DllMain(HINSTANCE hinst_dll, DWORD reason, LPVOID reserved)
 {
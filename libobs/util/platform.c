@@ -16,6 +16,15 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include "c99defs.h"
 #include "platform.h"
 #include "bmem.h"
@@ -75,6 +84,107 @@ off_t os_fgetsize(FILE *file)
 	return size;
 }
 
+int64_t os_get_file_mtime(const char *path)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	wchar_t *wpath;
+	int ret;
+
+	if (!path || !os_utf8_to_wcs_ptr(path, 0, &wpath))
+		return -1;
+
+	ret = _wstat64(wpath, &st);
+	bfree(wpath);
+#else
+	struct stat st;
+	int ret = path ? stat(path, &st) : -1;
+#endif
+
+	return (ret == 0) ? (int64_t)st.st_mtime : -1;
+}
+
+#ifdef _WIN32
+void *os_map_file(const char *path, size_t *size)
+{
+	LARGE_INTEGER file_size;
+	HANDLE        file;
+	HANDLE        mapping = NULL;
+	void          *data   = NULL;
+	wchar_t       *wpath;
+
+	if (!path || !size || !os_utf8_to_wcs_ptr(path, 0, &wpath))
+		return NULL;
+
+	file = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	bfree(wpath);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0 &&
+	    (uint64_t)file_size.QuadPart <= (uint64_t)SIZE_MAX)
+		mapping = CreateFileMappingW(file, NULL, PAGE_READONLY,
+				0, 0, NULL);
+
+	if (mapping) {
+		/* the view keeps the mapping alive after the handles close */
+		data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+	}
+
+	CloseHandle(file);
+
+	if (data)
+		*size = (size_t)file_size.QuadPart;
+	return data;
+}
+
+void os_unmap_file(void *data, size_t size)
+{
+	if (data)
+		UnmapViewOfFile(data);
+
+	UNUSED_PARAMETER(size);
+}
+
+#else
+void *os_map_file(const char *path, size_t *size)
+{
+	struct stat st;
+	void *data = NULL;
+	int  fd;
+
+	if (!path || !size)
+		return NULL;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+
+	if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+	    (uint64_t)st.st_size <= (uint64_t)SIZE_MAX) {
+		data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+				fd, 0);
+		if (data == MAP_FAILED)
+			data = NULL;
+	}
+
+	close(fd);
+
+	if (data)
+		*size = (size_t)st.st_size;
+	return data;
+}
+
+void os_unmap_file(void *data, size_t size)
+{
+	if (data)
+		munmap(data, size);
+}
+#endif
+
 size_t os_fread_mbs(FILE *file, char **pstr)
 {
 	size_t size = 0;
@@ -34,6 +34,13 @@ EXPORT FILE *os_wfopen(const wchar_t *path, const char *mode);
 EXPORT FILE *os_fopen(const char *path, const char *mode);
 EXPORT off_t os_fgetsize(FILE *file);
 
+/**
+ * Maps a file read-only in to memory.  Returns NULL on failure or if the file
+ * is empty.  Unmap with os_unmap_file using the size that was returned.
+ */
+EXPORT void *os_map_file(const char *path, size_t *size);
+EXPORT void os_unmap_file(void *data, size_t size);
+
 EXPORT size_t os_fread_mbs(FILE *file, char **pstr);
 EXPORT size_t os_fread_utf8(FILE *file, char **pstr);
 
@@ -68,6 +75,13 @@ EXPORT void os_dlclose(void *module);
  * Returns false if already at or past target time.
  */
 EXPORT bool os_sleepto_ns(uint64_t time_target);
+
+/**
+ * Same as os_sleepto_ns, but for pacing that has to hit the target closely:
+ * sleeps on an absolute deadline where the platform has one, and spins for
+ * the last stretch, at the cost of some CPU time.
+ */
+EXPORT bool os_sleepto_ns_precise(uint64_t time_target);
 EXPORT void os_sleep_ms(uint32_t duration);
 
 EXPORT uint64_t os_gettime_ns(void);
@@ -76,12 +90,21 @@ EXPORT char *os_get_config_path(const char *name);
 
 EXPORT bool os_file_exists(const char *path);
 
+/** Returns the last modification time of a file, or -1 on failure */
+EXPORT int64_t os_get_file_mtime(const char *path);
+
 #define MKDIR_EXISTS   1
 #define MKDIR_SUCCESS  0
 #define MKDIR_ERROR   -1
 
 EXPORT int os_mkdir(const char *path);
 
+/** Renames a file, replacing the destination if it already exists */
+EXPORT bool os_rename(const char *old_path, const char *new_path);
+
+/** Returns the number of logical processors (always at least 1) */
+EXPORT int os_get_logical_cores(void);
+
 #ifdef _MSC_VER
 EXPORT int fseeko(FILE *stream, off_t offset, int whence);
 EXPORT off_t ftello(FILE *stream);
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include "bmem.h"
+#include "base.h"
+#include "platform.h"
+#include "threading.h"
+#include "profiler.h"
+#include "trace.h"
+
+/*
+ * Each point owns a ring of the durations most recently added to it.
+ * Writers claim a slot by atomically incrementing the position, so any
+ * number of threads can add samples to the same point without locking.  A
+ * sample that's being overwritten while the statistics are calculated may
+ * be read torn on 32bit systems; for timing statistics that's acceptable.
+ */
+struct profile_point {
+	char                 *name;
+	volatile long        pos;
+	uint64_t             samples[PROFILE_MAX_SAMPLES];
+	struct profile_point *next;
+};
+
+static pthread_mutex_t      points_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct profile_point *first_point = NULL;
+static volatile long        enabled      = 0;
+
+void profiler_enable(bool enable)
+{
+	os_atomic_set_long(&enabled, enable ? 1 : 0);
+}
+
+bool profiler_enabled(void)
+{
+	return os_atomic_load_long(&enabled) != 0;
+}
+
+profile_point_t profile_point_get(const char *name)
+{
+	struct profile_point *point;
+
+	if (!name)
+		return NULL;
+
+	pthread_mutex_lock(&points_mutex);
+
+	point = first_point;
+	while (point) {
+		if (strcmp(point->name, name) == 0)
+			break;
+		point = point->next;
+	}
+
+	if (!point) {
+		point = bzalloc(sizeof(struct profile_point));
+		point->name = bstrdup(name);
+		point->next = first_point;
+		first_point = point;
+	}
+
+	pthread_mutex_unlock(&points_mutex);
+	return point;
+}
+
+const char *profile_point_name(profile_point_t point)
+{
+	return point ? point->name : NULL;
+}
+
+uint64_t profile_start(void)
+{
+	return (profiler_enabled() || trace_enabled()) ? os_gettime_ns() : 0;
+}
+
+void profile_end(profile_point_t point, uint64_t start_ns)
+{
+	uint64_t duration_ns;
+
+	if (!start_ns || !point)
+		return;
+
+	duration_ns = os_gettime_ns() - start_ns;
+
+	if (profiler_enabled())
+		profile_add_sample(point, duration_ns);
+	if (trace_enabled())
+		trace_add_scope(point->name, start_ns, duration_ns);
+}
+
+void profile_add_sample(profile_point_t point, uint64_t duration_ns)
+{
+	unsigned long idx;
+
+	if (!point)
+		return;
+
+	idx = (unsigned long)(os_atomic_inc_long(&point->pos) - 1);
+	point->samples[idx % PROFILE_MAX_SAMPLES] = duration_ns;
+}
+
+static int cmp_uint64(const void *a, const void *b)
+{
+	uint64_t val_a = *(const uint64_t*)a;
+	uint64_t val_b = *(const uint64_t*)b;
+	return (val_a > val_b) - (val_a < val_b);
+}
+
+/* copies the samples out of the ring, oldest first.  returns the count */
+static size_t copy_samples(profile_point_t point, uint64_t *samples)
+{
+	unsigned long pos = (unsigned long)os_atomic_load_long(&point->pos);
+	size_t count = pos < PROFILE_MAX_SAMPLES ?
+		(size_t)pos : PROFILE_MAX_SAMPLES;
+
+	for (size_t i = 0; i < count; i++) {
+		unsigned long idx = pos - (unsigned long)count + i;
+		samples[i] = point->samples[idx % PROFILE_MAX_SAMPLES];
+	}
+
+	return count;
+}
+
+static void calc_stats(uint64_t *samples, size_t count,
+		struct profile_stats *stats)
+{
+	uint64_t total = 0;
+
+	memset(stats, 0, sizeof(struct profile_stats));
+	if (!count)
+		return;
+
+	stats->samples = count;
+	stats->last_ns = samples[count-1];
+
+	qsort(samples, count, sizeof(uint64_t), cmp_uint64);
+
+	for (size_t i = 0; i < count; i++)
+		total += samples[i];
+
+	stats->min_ns = samples[0];
+	stats->max_ns = samples[count-1];
+	stats->avg_ns = total / count;
+	stats->p99_ns = samples[(count-1) * 99 / 100];
+}
+
+bool profile_point_get_stats(profile_point_t point,
+		struct profile_stats *stats)
+{
+	uint64_t *samples;
+
+	if (!point || !stats)
+		return false;
+
+	samples = bmalloc(sizeof(uint64_t) * PROFILE_MAX_SAMPLES);
+	calc_stats(samples, copy_samples(point, samples), stats);
+	bfree(samples);
+
+	return stats->samples != 0;
+}
+
+void profiler_enum_points(
+		bool (*enum_proc)(void *param, profile_point_t point),
+		void *param)
+{
+	struct profile_point *point;
+
+	if (!enum_proc)
+		return;
+
+	pthread_mutex_lock(&points_mutex);
+
+	point = first_point;
+	while (point) {
+		if (!enum_proc(param, point))
+			break;
+		point = point->next;
+	}
+
+	pthread_mutex_unlock(&points_mutex);
+}
+
+void profiler_reset(void)
+{
+	struct profile_point *point;
+
+	pthread_mutex_lock(&points_mutex);
+
+	point = first_point;
+	while (point) {
+		os_atomic_set_long(&point->pos, 0);
+		point = point->next;
+	}
+
+	pthread_mutex_unlock(&points_mutex);
+}
+
+static inline double ns_to_ms(uint64_t ns)
+{
+	return (double)ns / 1000000.0;
+}
+
+static void dump_point(FILE *file, struct profile_point *point,
+		uint64_t *samples, bool include_samples)
+{
+	struct profile_stats stats;
+	size_t count = copy_samples(point, samples);
+
+	if (include_samples) {
+		fprintf(file, "samples,%s", point->name);
+		for (size_t i = 0; i < count; i++)
+			fprintf(file, ",%"PRIu64, samples[i]);
+		fprintf(file, "\n");
+	}
+
+	calc_stats(samples, count, &stats);
+
+	fprintf(file, "stats,%s,%lu,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+			point->name, (unsigned long)stats.samples,
+			ns_to_ms(stats.last_ns),
+			ns_to_ms(stats.min_ns),
+			ns_to_ms(stats.avg_ns),
+			ns_to_ms(stats.p99_ns),
+			ns_to_ms(stats.max_ns));
+}
+
+bool profiler_dump(const char *path, bool include_samples)
+{
+	struct profile_point *point;
+	uint64_t *samples;
+	FILE *file;
+
+	file = os_fopen(path, "w");
+	if (!file) {
+		blog(LOG_WARNING, "profiler_dump: Failed to open '%s'", path);
+		return false;
+	}
+
+	samples = bmalloc(sizeof(uint64_t) * PROFILE_MAX_SAMPLES);
+
+	fprintf(file, "# stats,name,samples,last_ms,min_ms,avg_ms,p99_ms,"
+	              "max_ms\n");
+	if (include_samples)
+		fprintf(file, "# samples,name,duration_ns...\n");
+
+	pthread_mutex_lock(&points_mutex);
+
+	point = first_point;
+	while (point) {
+		dump_point(file, point, samples, include_samples);
+		point = point->next;
+	}
+
+	pthread_mutex_unlock(&points_mutex);
+
+	bfree(samples);
+	fclose(file);
+	return true;
+}
+
+void profiler_free(void)
+{
+	struct profile_point *point;
+
+	pthread_mutex_lock(&points_mutex);
+
+	point = first_point;
+	while (point) {
+		struct profile_point *next = point->next;
+		bfree(point->name);
+		bfree(point);
+		point = next;
+	}
+
+	first_point = NULL;
+
+	pthread_mutex_unlock(&points_mutex);
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+
+/*
+ * Lightweight stage timing
+ *
+ *   A profile point is a named stage of the pipeline.  Code measures the
+ * stage with profile_start/profile_end, and each duration is stored in a
+ * fixed-size ring owned by the point.  Adding a sample only takes an atomic
+ * increment and a store, so points can stay in hot paths, and while
+ * profiling is disabled (the default) profile_start doesn't even read the
+ * clock.  Statistics are calculated from the ring when they're queried.
+ *
+ *   While tracing is enabled (see trace.h), measurements are recorded as
+ * trace scopes as well, even if profiling is disabled.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of samples kept for each point (about 17 seconds at 60fps) */
+#define PROFILE_MAX_SAMPLES 1024
+
+struct profile_point;
+typedef struct profile_point *profile_point_t;
+
+struct profile_stats {
+	size_t   samples;
+	uint64_t last_ns;
+	uint64_t min_ns;
+	uint64_t avg_ns;
+	uint64_t p99_ns;
+	uint64_t max_ns;
+};
+
+EXPORT void profiler_enable(bool enable);
+EXPORT bool profiler_enabled(void);
+
+/**
+ * Returns the point with the given name, creating it if it doesn't exist.
+ * Points remain valid until profiler_free is called.
+ */
+EXPORT profile_point_t profile_point_get(const char *name);
+EXPORT const char *profile_point_name(profile_point_t point);
+
+/** Returns the start time of a measurement, or 0 if disabled */
+EXPORT uint64_t profile_start(void);
+
+/** Adds the time since start_ns (if it was returned while enabled) */
+EXPORT void profile_end(profile_point_t point, uint64_t start_ns);
+
+EXPORT void profile_add_sample(profile_point_t point, uint64_t duration_ns);
+
+/** Calculates the statistics over the samples currently in the ring */
+EXPORT bool profile_point_get_stats(profile_point_t point,
+		struct profile_stats *stats);
+
+EXPORT void profiler_enum_points(
+		bool (*enum_proc)(void *param, profile_point_t point),
+		void *param);
+
+/** Clears the samples of every point */
+EXPORT void profiler_reset(void);
+
+/**
+ * Writes the statistics of every point to a file, and optionally the raw
+ * samples as well (in the order they were added)
+ */
+EXPORT bool profiler_dump(const char *path, bool include_samples);
+
+/** Frees all points */
+EXPORT void profiler_free(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include "bmem.h"
+#include "str-arena.h"
+
+#define ARENA_ALIGN              16
+#define DEFAULT_ARENA_BLOCK_SIZE 4096
+
+struct str_arena_block {
+	struct str_arena_block *next;
+	size_t                 size;
+	size_t                 used;
+};
+
+static inline size_t align_size(size_t size)
+{
+	return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static inline char *block_data(struct str_arena_block *block)
+{
+	return (char*)block + align_size(sizeof(struct str_arena_block));
+}
+
+void str_arena_init(struct str_arena *arena, size_t block_size)
+{
+	memset(arena, 0, sizeof(struct str_arena));
+	arena->block_size = block_size ? block_size : DEFAULT_ARENA_BLOCK_SIZE;
+}
+
+void str_arena_init_buf(struct str_arena *arena, char *buf, size_t size)
+{
+	str_arena_init(arena, 0);
+	arena->buf      = buf;
+	arena->buf_size = buf ? size : 0;
+}
+
+static void free_blocks(struct str_arena_block *block)
+{
+	while (block) {
+		struct str_arena_block *next = block->next;
+		bfree(block);
+		block = next;
+	}
+}
+
+void str_arena_free(struct str_arena *arena)
+{
+	if (!arena)
+		return;
+
+	free_blocks(arena->first);
+	arena->first    = NULL;
+	arena->last     = NULL;
+	arena->buf_used = 0;
+}
+
+/* returns the free space of the current block without allocating */
+static inline char *arena_space(struct str_arena *arena, size_t *avail)
+{
+	struct str_arena_block *last = arena->last;
+
+	if (last) {
+		*avail = last->size - last->used;
+		return block_data(last) + last->used;
+	}
+
+	*avail = arena->buf_size - arena->buf_used;
+	return arena->buf + arena->buf_used;
+}
+
+static inline void arena_commit(struct str_arena *arena, size_t size)
+{
+	size = align_size(size);
+
+	if (arena->last) {
+		arena->last->used += size;
+		if (arena->last->used > arena->last->size)
+			arena->last->used = arena->last->size;
+	} else {
+		arena->buf_used += size;
+		if (arena->buf_used > arena->buf_size)
+			arena->buf_used = arena->buf_size;
+	}
+}
+
+static void add_block(struct str_arena *arena, size_t min_size)
+{
+	size_t                 size = align_size(min_size);
+	struct str_arena_block *block;
+
+	if (size < arena->block_size)
+		size = arena->block_size;
+
+	block = bmalloc(align_size(sizeof(struct str_arena_block)) + size);
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+
+	if (arena->last)
+		arena->last->next = block;
+	else
+		arena->first = block;
+	arena->last = block;
+}
+
+void *str_arena_alloc(struct str_arena *arena, size_t size)
+{
+	size_t avail;
+	char   *ptr;
+
+	if (!arena)
+		return NULL;
+
+	ptr = arena_space(arena, &avail);
+	if (!ptr || avail < size) {
+		add_block(arena, size);
+		ptr = arena_space(arena, &avail);
+	}
+
+	arena_commit(arena, size);
+	return ptr;
+}
+
+char *str_arena_strdup_n(struct str_arena *arena, const char *str,
+		size_t len)
+{
+	char *dup;
+
+	if (!str)
+		return NULL;
+
+	dup = str_arena_alloc(arena, len + 1);
+	if (dup) {
+		memcpy(dup, str, len);
+		dup[len] = 0;
+	}
+
+	return dup;
+}
+
+char *str_arena_strdup(struct str_arena *arena, const char *str)
+{
+	return str ? str_arena_strdup_n(arena, str, strlen(str)) : NULL;
+}
+
+char *str_arena_vprintf(struct str_arena *arena, const char *format,
+		va_list args)
+{
+	size_t avail;
+	char   *ptr;
+
+	if (!arena)
+		return NULL;
+
+	/* format straight in to the free space, and only take a new block if
+	 * it doesn't fit */
+	ptr = arena_space(arena, &avail);
+
+	for (;;) {
+		va_list args_copy;
+		int     len;
+
+		va_copy(args_copy, args);
+		len = ptr && avail ?
+			vsnprintf(ptr, avail, format, args_copy) : -1;
+		va_end(args_copy);
+
+		if (ptr && len >= 0 && (size_t)len < avail) {
+			arena_commit(arena, (size_t)len + 1);
+			return ptr;
+		}
+
+		/* older windows runtimes return -1 if it doesn't fit */
+		add_block(arena, (len >= 0) ? (size_t)len + 1 :
+				(avail ? avail * 2 : arena->block_size));
+		ptr = arena_space(arena, &avail);
+	}
+}
+
+char *str_arena_printf(struct str_arena *arena, const char *format, ...)
+{
+	va_list args;
+	char    *str;
+
+	va_start(args, format);
+	str = str_arena_vprintf(arena, format, args);
+	va_end(args);
+
+	return str;
+}
+
+struct str_arena_mark str_arena_get_mark(const struct str_arena *arena)
+{
+	struct str_arena_mark mark;
+	mark.block = arena->last;
+	mark.used  = arena->last ? arena->last->used : arena->buf_used;
+	return mark;
+}
+
+void str_arena_reset(struct str_arena *arena, struct str_arena_mark mark)
+{
+	if (mark.block) {
+		free_blocks(mark.block->next);
+		mark.block->next = NULL;
+		mark.block->used = mark.used;
+	} else {
+		free_blocks(arena->first);
+		arena->first    = NULL;
+		arena->buf_used = mark.used;
+	}
+
+	arena->last = mark.block;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdarg.h>
+#include "c99defs.h"
+
+/*
+ * String arena
+ *
+ *   Scratch allocator for short-lived strings.  Allocations are carved out
+ * of larger blocks and are never freed individually; the whole arena is
+ * reset or freed at once.  It can start out in a buffer provided by the
+ * caller, such as one on the stack, so that a few temporary strings need no
+ * heap allocations at all.
+ *
+ *   Usage:
+ *
+ *     char buf[512];
+ *     struct str_arena arena;
+ *     str_arena_init_buf(&arena, buf, sizeof(buf));
+ *     ...
+ *     str_arena_free(&arena);
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct str_arena_block;
+
+struct str_arena {
+	char                   *buf;
+	size_t                 buf_size;
+	size_t                 buf_used;
+
+	struct str_arena_block *first;
+	struct str_arena_block *last;
+	size_t                 block_size;
+};
+
+/* a position in the arena that can be returned to with str_arena_reset */
+struct str_arena_mark {
+	struct str_arena_block *block;
+	size_t                 used;
+};
+
+EXPORT void str_arena_init(struct str_arena *arena, size_t block_size);
+EXPORT void str_arena_init_buf(struct str_arena *arena, char *buf,
+		size_t size);
+EXPORT void str_arena_free(struct str_arena *arena);
+
+EXPORT void *str_arena_alloc(struct str_arena *arena, size_t size);
+EXPORT char *str_arena_strdup(struct str_arena *arena, const char *str);
+EXPORT char *str_arena_strdup_n(struct str_arena *arena, const char *str,
+		size_t len);
+EXPORT char *str_arena_printf(struct str_arena *arena,
+		const char *format, ...);
+EXPORT char *str_arena_vprintf(struct str_arena *arena,
+		const char *format, va_list args);
+
+/* everything allocated after the mark is released by str_arena_reset */
+EXPORT struct str_arena_mark str_arena_get_mark(const struct str_arena *arena);
+EXPORT void str_arena_reset(struct str_arena *arena,
+		struct str_arena_mark mark);
+
+#ifdef __cplusplus
+}
+#endif
@@ -14,167 +14,101 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdio.h>
 #include "dstr.h"
+#include "hash.h"
+#include "darray.h"
 #include "text-lookup.h"
 #include "lexer.h"
 #include "platform.h"
 
-/* ------------------------------------------------------------------------- */
+/*
+ * Each added file is stored as its own string table, an open addressing hash
+ * table of (name hash, name offset, value offset) slots followed by the
+ * string data.  Names are hashed case-insensitively, so a lookup is a single
+ * hash and usually a single probe per table.  Tables of files added later
+ * are searched first so that they override earlier ones.
+ *
+ * The table layout is the same in memory and on disk, so when a cache
+ * directory is used, tables are written out after parsing and mapped
+ * directly on later runs as long as the file hasn't been modified since.
+ */
 
-struct text_leaf {
-	char *lookup, *value;
-};
+#define LOOKUP_CACHE_MAGIC   0x4C53424F /* "OBSL" */
+#define LOOKUP_CACHE_VERSION 1
+#define LOOKUP_MIN_SLOTS     16
 
-static inline void text_leaf_destroy(struct text_leaf *leaf)
-{
-	bfree(leaf->lookup);
-	bfree(leaf->value);
-	bfree(leaf);
-}
+struct lookup_header {
+	uint32_t magic;
+	uint32_t version;
+	int64_t  mtime;
+	uint32_t num_slots;
+	uint32_t strings_size;
+};
 
-/* ------------------------------------------------------------------------- */
+/* offset 0 of the string data is always an empty string, so a name offset
+ * of 0 marks an empty slot */
+struct lookup_slot {
+	uint32_t hash;
+	uint32_t name;
+	uint32_t value;
+};
 
-struct text_node {
-	struct dstr str;
-	struct text_node *first_subnode;
-	struct text_leaf *leaf;
+struct text_table {
+	uint8_t                  *data;
+	size_t                   size;
+	bool                     mapped;
 
-	struct text_node *next;
+	const struct lookup_slot *slots;
+	uint32_t                 num_slots;
+	const char               *strings;
 };
 
-static void text_node_destroy(struct text_node *node)
+static inline bool names_match(const char *table_name, const char *name,
+		size_t len)
 {
-	struct text_node *subnode;
-
-	if (!node)
-		return;
-
-	subnode = node->first_subnode;
-	while (subnode) {
-		struct text_node *destroy_node = subnode;
-
-		subnode = subnode->next;
-		text_node_destroy(destroy_node);
-	}
-
-	dstr_free(&node->str);
-	if (node->leaf)
-		text_leaf_destroy(node->leaf);
-	bfree(node);
+	return astrcmpi_n(table_name, name, len) == 0 && !table_name[len];
 }
 
-static struct text_node *text_node_bychar(struct text_node *node, char ch)
+static inline void text_table_free(struct text_table *table)
 {
-	struct text_node *subnode = node->first_subnode;
-
-	while (subnode) {
-		if (!dstr_isempty(&subnode->str) && subnode->str.array[0] == ch)
-			return subnode;
-
-		subnode = subnode->next;
-	}
-
-	return NULL;
+	if (table->mapped)
+		os_unmap_file(table->data, table->size);
+	else
+		bfree(table->data);
 }
 
-static struct text_node *text_node_byname(struct text_node *node,
-		const char *name)
+static bool text_table_getstr(const struct text_table *table,
+		const char *name, size_t len, uint32_t hash, const char **out)
 {
-	struct text_node *subnode = node->first_subnode;
+	uint32_t mask = table->num_slots - 1;
+	uint32_t pos  = hash & mask;
 
-	while (subnode) {
-		if (astrcmpi_n(subnode->str.array, name, subnode->str.len) == 0)
-			return subnode;
+	while (table->slots[pos].name) {
+		const struct lookup_slot *slot = table->slots+pos;
 
-		subnode = subnode->next;
+		if (slot->hash == hash &&
+		    names_match(table->strings + slot->name, name, len)) {
+			*out = table->strings + slot->value;
+			return true;
+		}
+
+		pos = (pos + 1) & mask;
 	}
 
-	return NULL;
+	return false;
 }
 
 /* ------------------------------------------------------------------------- */
 
-struct text_lookup {
-	struct dstr language;
-	struct text_node *top;
+struct lookup_pair {
+	char *name, *value;
 };
 
-static void lookup_createsubnode(const char *lookup_val,
-		struct text_leaf *leaf, struct text_node *node)
-{
-	struct text_node *new = bzalloc(sizeof(struct text_node));
-	new->leaf = leaf;
-	new->next = node->first_subnode;
-	dstr_copy(&new->str, lookup_val);
-
-	node->first_subnode = new;
-}
-
-static void lookup_splitnode(const char *lookup_val, size_t len,
-		struct text_leaf *leaf, struct text_node *node)
-{
-	struct text_node *split = bzalloc(sizeof(struct text_node));
-
-	dstr_copy(&split->str, node->str.array+len);
-	split->leaf = node->leaf;
-	split->first_subnode = node->first_subnode;
-	node->first_subnode = split;
-
-	dstr_resize(&node->str, len);
-
-	if (lookup_val[len] != 0) {
-		node->leaf = NULL;
-		lookup_createsubnode(lookup_val+len, leaf, node);
-	} else {
-		node->leaf = leaf;
-	}
-}
-
-static inline void lookup_replaceleaf(struct text_node *node,
-		struct text_leaf *leaf)
-{
-	text_leaf_destroy(node->leaf);
-	node->leaf = leaf;
-}
-
-static void lookup_addstring(const char *lookup_val, struct text_leaf *leaf,
-		struct text_node *node)
-{
-	struct text_node *child;
-
-	/* value already exists, so replace */
-	if (!lookup_val || !*lookup_val) {
-		lookup_replaceleaf(node, leaf);
-		return;
-	}
-
-	child = text_node_bychar(node, *lookup_val);
-	if (child) {
-		size_t len;
-
-		for (len = 0; len < child->str.len; len++) {
-			char val1 = child->str.array[len],
-			        val2 = lookup_val[len];
-
-			if (val1 >= 'A' && val1 <= 'Z')
-				val1 += 0x20;
-			if (val2 >= 'A' && val2 <= 'Z')
-				val2 += 0x20;
-
-			if (val1 != val2)
-				break;
-		}
-
-		if (len == child->str.len) {
-			lookup_addstring(lookup_val+len, leaf, child);
-			return;
-		} else {
-			lookup_splitnode(lookup_val, len, leaf, child);
-		}
-	} else {
-		lookup_createsubnode(lookup_val, leaf, node);
-	}
-}
+struct text_lookup {
+	DARRAY(struct text_table) tables;
+	char                      *cache_dir;
+};
 
 static void lookup_getstringtoken(struct lexer *lex, struct strref *token)
 {
@@ -288,7 +222,7 @@ static char *convert_string(const char *str, size_t len)
 	return out.array;
 }
 
-static void lookup_addfiledata(struct text_lookup *lookup,
+static void lookup_addfiledata(struct darray *pairs,
 		const char *file_data)
 {
 	struct lexer lex;
@@ -300,7 +234,7 @@ static void lookup_addfiledata(struct text_lookup *lookup,
 	strref_clear(&value);
 
 	while (lookup_gettoken(&lex, &name)) {
-		struct text_leaf *leaf;
+		struct lookup_pair pair;
 		bool got_eq = false;
 
 		if (*name.array == '\n')
@@ -315,11 +249,9 @@ getval:
 			goto getval;
 		}
 
-		leaf = bmalloc(sizeof(struct text_leaf));
-		leaf->lookup = bstrdup_n(name.array,  name.len);
-		leaf->value  = convert_string(value.array, value.len);
-
-		lookup_addstring(leaf->lookup, leaf, lookup->top);
+		pair.name  = bstrdup_n(name.array,  name.len);
+		pair.value = convert_string(value.array, value.len);
+		darray_push_back(sizeof(struct lookup_pair), pairs, &pair);
 
 		if (!lookup_goto_nextline(&lex))
 			break;
@@ -328,39 +260,223 @@ getval:
 	lexer_free(&lex);
 }
 
-static inline bool lookup_getstring(const char *lookup_val,
-		const char **out, struct text_node *node)
+static inline size_t table_header_size(void)
+{
+	return sizeof(struct lookup_header);
+}
+
+static inline void text_table_set_pointers(struct text_table *table)
+{
+	const struct lookup_header *header = (void*)table->data;
+
+	table->num_slots = header->num_slots;
+	table->slots     = (void*)(table->data + table_header_size());
+	table->strings   = (const char*)(table->slots + table->num_slots);
+}
+
+/* later pairs with the same name replace earlier ones */
+static void build_text_table(struct text_table *table,
+		struct lookup_pair *pairs, size_t num, int64_t mtime)
+{
+	struct lookup_header *header;
+	struct lookup_slot   *slots;
+	uint32_t num_slots    = LOOKUP_MIN_SLOTS;
+	size_t   strings_size = 1;
+	char     *strings;
+
+	while (num_slots < num * 2)
+		num_slots *= 2;
+
+	for (size_t i = 0; i < num; i++)
+		strings_size += strlen(pairs[i].name) +
+		                strlen(pairs[i].value) + 2;
+
+	table->size   = table_header_size() +
+	                num_slots * sizeof(struct lookup_slot) + strings_size;
+	table->data   = bzalloc(table->size);
+	table->mapped = false;
+
+	header = (struct lookup_header*)table->data;
+	header->magic        = LOOKUP_CACHE_MAGIC;
+	header->version      = LOOKUP_CACHE_VERSION;
+	header->mtime        = mtime;
+	header->num_slots    = num_slots;
+	header->strings_size = (uint32_t)strings_size;
+
+	text_table_set_pointers(table);
+	slots   = (struct lookup_slot*)table->slots;
+	strings = (char*)table->strings;
+	strings_size = 1;
+
+	for (size_t i = 0; i < num; i++) {
+		size_t   name_len = strlen(pairs[i].name);
+		uint32_t hash     = hash_fnv1a_lower_n(pairs[i].name, name_len);
+		uint32_t pos      = hash & (num_slots - 1);
+		uint32_t value    = (uint32_t)(strings_size + name_len + 1);
+
+		if (!name_len)
+			continue;
+
+		while (slots[pos].name && (slots[pos].hash != hash ||
+		       !names_match(strings + slots[pos].name, pairs[i].name,
+			       name_len)))
+			pos = (pos + 1) & (num_slots - 1);
+
+		strcpy(strings + strings_size, pairs[i].name);
+		strcpy(strings + value, pairs[i].value);
+
+		if (!slots[pos].name) {
+			slots[pos].hash = hash;
+			slots[pos].name = (uint32_t)strings_size;
+		}
+		slots[pos].value = value;
+
+		strings_size = value + strlen(pairs[i].value) + 1;
+	}
+}
+
+static bool parse_text_table(struct text_table *table, const char *path,
+		int64_t mtime)
+{
+	DARRAY(struct lookup_pair) pairs;
+	struct dstr file_str;
+	char *temp = NULL;
+	FILE *file;
+
+	file = os_fopen(path, "rb");
+	if (!file)
+		return false;
+
+	os_fread_utf8(file, &temp);
+	dstr_init_move_array(&file_str, temp);
+	fclose(file);
+
+	if (!file_str.array)
+		return false;
+
+	da_init(pairs);
+
+	dstr_replace(&file_str, "\r", " ");
+	lookup_addfiledata(&pairs.da, file_str.array);
+	dstr_free(&file_str);
+
+	build_text_table(table, pairs.array, pairs.num, mtime);
+
+	for (size_t i = 0; i < pairs.num; i++) {
+		bfree(pairs.array[i].name);
+		bfree(pairs.array[i].value);
+	}
+
+	da_free(pairs);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* table cache */
+
+static char *get_cache_path(const char *cache_dir, const char *path)
+{
+	struct dstr cache_path = {0};
+
+	/* an exact hash of the path, unlike names */
+	uint32_t hash = hash_fnv1a(path);
+
+	dstr_printf(&cache_path, "%s/%08X.lookup", cache_dir, hash);
+	return cache_path.array;
+}
+
+/* a mapped table is validated once so that lookups don't need to check any
+ * offsets */
+static bool text_table_valid(const struct text_table *table, int64_t mtime)
 {
-	struct text_node *child;
-	char ch;
+	const struct lookup_header *header = (void*)table->data;
+	size_t strings_size;
 
-	if (!node)
+	if (table->size < table_header_size())
+		return false;
+	if (header->magic != LOOKUP_CACHE_MAGIC ||
+	    header->version != LOOKUP_CACHE_VERSION ||
+	    header->mtime != mtime)
+		return false;
+	if (header->num_slots < LOOKUP_MIN_SLOTS ||
+	    (header->num_slots & (header->num_slots - 1)) != 0)
 		return false;
 
-	child = text_node_byname(node, lookup_val);
-	if (!child)
+	strings_size = header->strings_size;
+	if (!strings_size || table->size != table_header_size() +
+			header->num_slots * sizeof(struct lookup_slot) +
+			strings_size)
+		return false;
+
+	if (table->strings[0] || table->strings[strings_size - 1])
+		return false;
+
+	for (uint32_t i = 0; i < table->num_slots; i++) {
+		const struct lookup_slot *slot = table->slots+i;
+		if (slot->name >= strings_size || slot->value >= strings_size)
+			return false;
+	}
+
+	/* there has to be an empty slot for probing to stop */
+	for (uint32_t i = 0; i < table->num_slots; i++)
+		if (!table->slots[i].name)
+			return true;
+
+	return false;
+}
+
+static bool load_cached_table(struct text_table *table, const char *cache_path,
+		int64_t mtime)
+{
+	table->data = os_map_file(cache_path, &table->size);
+	if (!table->data)
 		return false;
 
-	lookup_val += child->str.len;
-	ch = *lookup_val;
-	if (ch)
-		return lookup_getstring(lookup_val, out, child);
+	table->mapped = true;
+
+	if (table->size >= table_header_size())
+		text_table_set_pointers(table);
 
-	if (!child->leaf)
+	if (!text_table_valid(table, mtime)) {
+		text_table_free(table);
 		return false;
+	}
 
-	*out = child->leaf->value;
 	return true;
 }
 
+static void save_cached_table(const struct text_table *table,
+		const char *cache_path)
+{
+	FILE *file = os_fopen(cache_path, "wb");
+	bool success = false;
+
+	if (file) {
+		success = fwrite(table->data, 1, table->size, file) ==
+			table->size;
+		fclose(file);
+	}
+
+	if (!success)
+		blog(LOG_DEBUG, "text_lookup: Failed to write cache '%s'",
+				cache_path);
+}
+
 /* ------------------------------------------------------------------------- */
 
 lookup_t text_lookup_create(const char *path)
+{
+	return text_lookup_create_cached(path, NULL);
+}
+
+lookup_t text_lookup_create_cached(const char *path, const char *cache_dir)
 {
 	struct text_lookup *lookup = bzalloc(sizeof(struct text_lookup));
 
+	lookup->cache_dir = cache_dir ? bstrdup(cache_dir) : NULL;
+
 	if (!text_lookup_add(lookup, path)) {
-		bfree(lookup);
+		text_lookup_destroy(lookup);
 		lookup = NULL;
 	}
 
@@ -369,37 +485,44 @@ lookup_t text_lookup_create(const char *path)
 
 bool text_lookup_add(lookup_t lookup, const char *path)
 {
-	struct dstr file_str;
-	char *temp = NULL;
-	FILE *file;
+	struct text_table table = {0};
+	char    *cache_path = NULL;
+	int64_t mtime;
+	bool    success;
 
-	file = os_fopen(path, "rb");
-	if (!file)
+	if (!lookup || !path)
 		return false;
 
-	os_fread_utf8(file, &temp);
-	dstr_init_move_array(&file_str, temp);
-	fclose(file);
-
-	if (!file_str.array)
-		return false;
+	mtime = os_get_file_mtime(path);
 
-	if (!lookup->top)
-		lookup->top = bzalloc(sizeof(struct text_node));
+	if (lookup->cache_dir && mtime != -1) {
+		cache_path = get_cache_path(lookup->cache_dir, path);
+		if (load_cached_table(&table, cache_path, mtime)) {
+			da_push_back(lookup->tables, &table);
+			bfree(cache_path);
+			return true;
+		}
+	}
 
-	dstr_replace(&file_str, "\r", " ");
-	lookup_addfiledata(lookup, file_str.array);
-	dstr_free(&file_str);
+	success = parse_text_table(&table, path, mtime);
+	if (success) {
+		if (cache_path)
+			save_cached_table(&table, cache_path);
+		da_push_back(lookup->tables, &table);
+	}
 
-	return true;
+	bfree(cache_path);
+	return success;
 }
 
 void text_lookup_destroy(lookup_t lookup)
 {
 	if (lookup) {
-		dstr_free(&lookup->language);
-		text_node_destroy(lookup->top);
+		for (size_t i = 0; i < lookup->tables.num; i++)
+			text_table_free(lookup->tables.array+i);
+		da_free(lookup->tables);
 
+		bfree(lookup->cache_dir);
 		bfree(lookup);
 	}
 }
@@ -407,5 +530,20 @@ void text_lookup_destroy(lookup_t lookup)
 bool text_lookup_getstr(lookup_t lookup, const char *lookup_val,
 		const char **out)
 {
-	return lookup_getstring(lookup_val, out, lookup->top);
+	size_t   len;
+	uint32_t hash;
+
+	if (!lookup || !lookup_val)
+		return false;
+
+	len  = strlen(lookup_val);
+	hash = hash_fnv1a_lower_n(lookup_val, len);
+
+	for (size_t i = lookup->tables.num; i > 0; i--) {
+		if (text_table_getstr(lookup->tables.array+i-1, lookup_val,
+					len, hash, out))
+			return true;
+	}
+
+	return false;
 }
@@ -20,8 +20,11 @@
  * Text Lookup interface
  *
  *   Used for storing and looking up localized strings.  Stores locazation
- * strings in a radix/trie tree to efficiently look up associated strings via a
+ * strings in hash tables to efficiently look up associated strings via a
  * unique string identifier name.
+ *
+ *   When created with a cache directory, the tables built from each file are
+ * saved there and mapped directly on later runs until the file changes.
  */
 
 #include "c99defs.h"
@@ -36,6 +39,8 @@ typedef struct text_lookup *lookup_t;
 
 /* functions */
 EXPORT lookup_t text_lookup_create(const char *path);
+EXPORT lookup_t text_lookup_create_cached(const char *path,
+		const char *cache_dir);
 EXPORT bool text_lookup_add(lookup_t lookup, const char *path);
 EXPORT void text_lookup_destroy(lookup_t lookup);
 EXPORT bool text_lookup_getstr(lookup_t lookup, const char *lookup_val,
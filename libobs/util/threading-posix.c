@@ -14,6 +14,14 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
 #ifdef __APPLE__
 #include <sys/time.h>
 #include <mach/semaphore.h>
@@ -23,8 +31,12 @@
 #include <semaphore.h>
 #endif
 
+#include <string.h>
+
 #include "bmem.h"
+#include "base.h"
 #include "threading.h"
+#include "trace.h"
 
 struct os_event_data {
 	pthread_mutex_t mutex;
@@ -248,3 +260,159 @@ long os_atomic_dec_long(volatile long *val)
 {
 	return __sync_sub_and_fetch(val, 1);
 }
+
+long os_atomic_set_long(volatile long *ptr, long val)
+{
+	/* __sync_lock_test_and_set is only an acquire barrier */
+	__sync_synchronize();
+	return __sync_lock_test_and_set(ptr, val);
+}
+
+long os_atomic_load_long(const volatile long *ptr)
+{
+	return __sync_add_and_fetch((volatile long*)ptr, 0);
+}
+
+bool os_atomic_compare_swap_long(volatile long *val, long old_val,
+		long new_val)
+{
+	return __sync_bool_compare_and_swap(val, old_val, new_val);
+}
+
+void *os_atomic_set_ptr(void *volatile *ptr, void *val)
+{
+	__sync_synchronize();
+	return __sync_lock_test_and_set(ptr, val);
+}
+
+void *os_atomic_load_ptr(void *const volatile *ptr)
+{
+	return __sync_val_compare_and_swap((void *volatile*)ptr, NULL, NULL);
+}
+
+uint64_t os_atomic_set_uint64(volatile uint64_t *ptr, uint64_t val)
+{
+	uint64_t old = *ptr;
+	uint64_t prev;
+
+	while ((prev = __sync_val_compare_and_swap(ptr, old, val)) != old)
+		old = prev;
+
+	return old;
+}
+
+uint64_t os_atomic_load_uint64(const volatile uint64_t *ptr)
+{
+	return __sync_val_compare_and_swap((volatile uint64_t*)ptr, 0, 0);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static struct os_thread_policy thread_policies[OS_THREAD_CLASS_COUNT];
+
+void os_set_thread_policy(enum os_thread_class thread_class,
+		const struct os_thread_policy *policy)
+{
+	if (thread_class < OS_THREAD_CLASS_COUNT && policy)
+		thread_policies[thread_class] = *policy;
+}
+
+void os_get_thread_policy(enum os_thread_class thread_class,
+		struct os_thread_policy *policy)
+{
+	if (thread_class < OS_THREAD_CLASS_COUNT && policy)
+		*policy = thread_policies[thread_class];
+}
+
+void os_set_thread_name(const char *name)
+{
+#if defined(__APPLE__)
+	pthread_setname_np(name);
+#elif defined(__linux__)
+	/* linux thread names are limited to 15 characters */
+	char short_name[16];
+	strncpy(short_name, name, sizeof(short_name) - 1);
+	short_name[sizeof(short_name) - 1] = 0;
+	pthread_setname_np(pthread_self(), short_name);
+#else
+	UNUSED_PARAMETER(name);
+#endif
+}
+
+static bool set_high_priority(void)
+{
+#ifdef __linux__
+	/* SCHED_OTHER threads only have a nice value, which is per thread on
+	 * linux */
+	return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), -10) == 0;
+#else
+	struct sched_param param = {0};
+	param.sched_priority = sched_get_priority_max(SCHED_OTHER);
+	return pthread_setschedparam(pthread_self(), SCHED_OTHER,
+			&param) == 0;
+#endif
+}
+
+static bool set_realtime_priority(void)
+{
+	struct sched_param param = {0};
+	int min = sched_get_priority_min(SCHED_RR);
+	int max = sched_get_priority_max(SCHED_RR);
+
+	/* stay below the priority of kernel and sound server threads */
+	param.sched_priority = min + (max - min) / 4;
+	return pthread_setschedparam(pthread_self(), SCHED_RR, &param) == 0;
+}
+
+static void set_thread_priority(enum os_thread_priority priority,
+		const char *name)
+{
+	if (priority == OS_THREAD_PRIORITY_REALTIME) {
+		if (set_realtime_priority())
+			return;
+
+		blog(LOG_DEBUG, "Thread '%s': real-time priority not "
+		                "permitted, using high priority", name);
+		priority = OS_THREAD_PRIORITY_HIGH;
+	}
+
+	if (priority == OS_THREAD_PRIORITY_HIGH && !set_high_priority())
+		blog(LOG_DEBUG, "Thread '%s': high priority not permitted",
+				name);
+}
+
+static void set_thread_affinity(uint64_t mask, const char *name)
+{
+#ifdef __linux__
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	for (int i = 0; i < 64; i++) {
+		if (mask & (1ULL << i))
+			CPU_SET(i, &set);
+	}
+
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		blog(LOG_WARNING, "Thread '%s': failed to set the CPU "
+		                  "affinity mask 0x%llX", name,
+		                  (unsigned long long)mask);
+#else
+	blog(LOG_DEBUG, "Thread '%s': CPU affinity masks are not supported "
+	                "on this platform", name);
+	UNUSED_PARAMETER(mask);
+#endif
+}
+
+void os_thread_init(enum os_thread_class thread_class, const char *name)
+{
+	struct os_thread_policy policy = {0};
+
+	os_get_thread_policy(thread_class, &policy);
+	os_set_thread_name(name);
+	trace_set_thread_name(name);
+
+	if (policy.priority != OS_THREAD_PRIORITY_NORMAL)
+		set_thread_priority(policy.priority, name);
+	if (policy.affinity_mask)
+		set_thread_affinity(policy.affinity_mask, name);
+}
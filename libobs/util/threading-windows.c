@@ -15,7 +15,9 @@
  */
 
 #include "bmem.h"
+#include "base.h"
 #include "threading.h"
+#include "trace.h"
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -160,3 +162,166 @@ long os_atomic_dec_long(volatile long *val)
 {
 	return InterlockedDecrement(val);
 }
+
+long os_atomic_set_long(volatile long *ptr, long val)
+{
+	return InterlockedExchange(ptr, val);
+}
+
+long os_atomic_load_long(const volatile long *ptr)
+{
+	return InterlockedCompareExchange((volatile long*)ptr, 0, 0);
+}
+
+bool os_atomic_compare_swap_long(volatile long *val, long old_val,
+		long new_val)
+{
+	return InterlockedCompareExchange(val, new_val, old_val) == old_val;
+}
+
+void *os_atomic_set_ptr(void *volatile *ptr, void *val)
+{
+	return InterlockedExchangePointer(ptr, val);
+}
+
+void *os_atomic_load_ptr(void *const volatile *ptr)
+{
+	return InterlockedCompareExchangePointer((void *volatile*)ptr,
+			NULL, NULL);
+}
+
+/* InterlockedExchange64 isn't available on 32-bit, the compare exchange
+ * is */
+uint64_t os_atomic_set_uint64(volatile uint64_t *ptr, uint64_t val)
+{
+	LONGLONG old = (LONGLONG)*ptr;
+	LONGLONG prev;
+
+	while ((prev = InterlockedCompareExchange64((volatile LONGLONG*)ptr,
+					(LONGLONG)val, old)) != old)
+		old = prev;
+
+	return (uint64_t)old;
+}
+
+uint64_t os_atomic_load_uint64(const volatile uint64_t *ptr)
+{
+	return (uint64_t)InterlockedCompareExchange64(
+			(volatile LONGLONG*)ptr, 0, 0);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static struct os_thread_policy thread_policies[OS_THREAD_CLASS_COUNT];
+
+void os_set_thread_policy(enum os_thread_class thread_class,
+		const struct os_thread_policy *policy)
+{
+	if (thread_class < OS_THREAD_CLASS_COUNT && policy)
+		thread_policies[thread_class] = *policy;
+}
+
+void os_get_thread_policy(enum os_thread_class thread_class,
+		struct os_thread_policy *policy)
+{
+	if (thread_class < OS_THREAD_CLASS_COUNT && policy)
+		*policy = thread_policies[thread_class];
+}
+
+#ifdef _MSC_VER
+#define VC_EXCEPTION 0x406D1388
+
+#pragma pack(push,8)
+struct vs_threadname_info {
+	DWORD      type; /* 0x1000 */
+	const char *name;
+	DWORD      thread_id;
+	DWORD      flags;
+};
+#pragma pack(pop)
+
+#define THREADNAME_INFO_SIZE \
+	(sizeof(struct vs_threadname_info) / sizeof(ULONG_PTR))
+#endif
+
+void os_set_thread_name(const char *name)
+{
+#ifdef _MSC_VER
+	/* the visual studio debugger picks the name up from this exception */
+	struct vs_threadname_info info;
+	info.type      = 0x1000;
+	info.name      = name;
+	info.thread_id = GetCurrentThreadId();
+	info.flags     = 0;
+
+	__try {
+		RaiseException(VC_EXCEPTION, 0, THREADNAME_INFO_SIZE,
+				(ULONG_PTR*)&info);
+	} __except(EXCEPTION_EXECUTE_HANDLER) {
+	}
+#else
+	UNUSED_PARAMETER(name);
+#endif
+}
+
+typedef HANDLE (WINAPI *set_mm_thread_characteristics_t)(LPCWSTR task,
+		LPDWORD index);
+
+static bool set_mmcss_task(enum os_thread_class thread_class)
+{
+	static set_mm_thread_characteristics_t set_characteristics = NULL;
+	static bool                            loaded              = false;
+	DWORD                                  index               = 0;
+
+	if (!loaded) {
+		HMODULE avrt = LoadLibraryW(L"avrt.dll");
+		if (avrt)
+			set_characteristics = (set_mm_thread_characteristics_t)
+				GetProcAddress(avrt,
+					"AvSetMmThreadCharacteristicsW");
+		loaded = true;
+	}
+
+	if (!set_characteristics)
+		return false;
+
+	/* the task is reverted when the thread exits */
+	return set_characteristics(thread_class == OS_THREAD_CLASS_AUDIO ?
+			L"Pro Audio" : L"Capture", &index) != NULL;
+}
+
+static void set_thread_priority(enum os_thread_class thread_class,
+		enum os_thread_priority priority, const char *name)
+{
+	if (priority == OS_THREAD_PRIORITY_REALTIME) {
+		if (set_mmcss_task(thread_class))
+			return;
+
+		blog(LOG_DEBUG, "Thread '%s': MMCSS not available, using "
+		                "high priority", name);
+	}
+
+	if (!SetThreadPriority(GetCurrentThread(),
+				THREAD_PRIORITY_HIGHEST))
+		blog(LOG_DEBUG, "Thread '%s': failed to set the thread "
+		                "priority", name);
+}
+
+void os_thread_init(enum os_thread_class thread_class, const char *name)
+{
+	struct os_thread_policy policy = {0};
+
+	os_get_thread_policy(thread_class, &policy);
+	os_set_thread_name(name);
+	trace_set_thread_name(name);
+
+	if (policy.priority != OS_THREAD_PRIORITY_NORMAL)
+		set_thread_priority(thread_class, policy.priority, name);
+
+	if (policy.affinity_mask &&
+	    !SetThreadAffinityMask(GetCurrentThread(),
+		    (DWORD_PTR)policy.affinity_mask))
+		blog(LOG_WARNING, "Thread '%s': failed to set the CPU "
+		                  "affinity mask 0x%llX", name,
+		                  policy.affinity_mask);
+}
@@ -72,6 +72,75 @@ EXPORT int  os_sem_wait(os_sem_t sem);
 
 EXPORT long os_atomic_inc_long(volatile long *val);
 EXPORT long os_atomic_dec_long(volatile long *val);
+EXPORT long os_atomic_set_long(volatile long *ptr, long val);
+EXPORT long os_atomic_load_long(const volatile long *ptr);
+
+/** Sets *val to new_val if it's old_val, returns true if it was */
+EXPORT bool os_atomic_compare_swap_long(volatile long *val, long old_val,
+		long new_val);
+
+EXPORT void *os_atomic_set_ptr(void *volatile *ptr, void *val);
+EXPORT void *os_atomic_load_ptr(void *const volatile *ptr);
+
+/* 64-bit values aren't written in one go by 32-bit builds, so values that
+ * are read without a lock have to use these */
+EXPORT uint64_t os_atomic_set_uint64(volatile uint64_t *ptr, uint64_t val);
+EXPORT uint64_t os_atomic_load_uint64(const volatile uint64_t *ptr);
+
+/* ------------------------------------------------------------------------- */
+/* thread policies */
+
+/** The kinds of threads that libobs and its plugins start */
+enum os_thread_class {
+	OS_THREAD_CLASS_DEFAULT,
+	OS_THREAD_CLASS_VIDEO,   /**< video clock, rendering and conversion */
+	OS_THREAD_CLASS_AUDIO,   /**< audio clock and mixing */
+	OS_THREAD_CLASS_ENCODER, /**< encoding */
+	OS_THREAD_CLASS_OUTPUT,  /**< network and file output */
+
+	OS_THREAD_CLASS_COUNT
+};
+
+enum os_thread_priority {
+	OS_THREAD_PRIORITY_NORMAL,
+	OS_THREAD_PRIORITY_HIGH,
+
+	/**
+	 * Real-time scheduling on POSIX systems, MMCSS on windows.  Usually
+	 * needs extra privileges, otherwise high priority is used.
+	 */
+	OS_THREAD_PRIORITY_REALTIME,
+};
+
+struct os_thread_policy {
+	enum os_thread_priority priority;
+
+	/**
+	 * Mask of the CPUs the thread may run on, 0 for any.  To bind a
+	 * class of threads to a NUMA node, use the CPUs of that node.
+	 * Not supported on OSX.
+	 */
+	uint64_t                affinity_mask;
+};
+
+/**
+ * Sets the policy for a class of threads.  Only applies to threads started
+ * afterwards, so this is normally set before obs_startup.
+ */
+EXPORT void os_set_thread_policy(enum os_thread_class thread_class,
+		const struct os_thread_policy *policy);
+EXPORT void os_get_thread_policy(enum os_thread_class thread_class,
+		struct os_thread_policy *policy);
+
+/** Names the calling thread for debuggers and profilers */
+EXPORT void os_set_thread_name(const char *name);
+
+/**
+ * Names the calling thread and applies the policy of its class.  Call this
+ * at the start of a thread function.
+ */
+EXPORT void os_thread_init(enum os_thread_class thread_class,
+		const char *name);
 
 
 #ifdef __cplusplus
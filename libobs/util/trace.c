@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include "bmem.h"
+#include "base.h"
+#include "platform.h"
+#include "threading.h"
+#include "trace.h"
+
+/*
+ * Only the owning thread writes to a buffer.  It fills in the slot at pos,
+ * then publishes it by incrementing pos, so a reader knows which events are
+ * complete.  The oldest events can be overwritten while they're being read,
+ * so after copying them, the reader discards the ones the writer could have
+ * gotten to in the meantime.
+ *
+ *   Buffers are registered under buffers_mutex, which only happens once per
+ * thread, and otherwise only protects them from being freed while read.
+ */
+
+enum trace_event_type {
+	TRACE_EVENT_SCOPE,
+	TRACE_EVENT_INSTANT,
+	TRACE_EVENT_COUNTER
+};
+
+struct trace_event {
+	enum trace_event_type type;
+	const char            *name;
+	uint64_t              ts_ns;
+	uint64_t              duration_ns;
+	double                value;
+};
+
+struct trace_buffer {
+	volatile long         pos;
+	volatile long         reset_pos;
+	long                  tid;
+	char                  name[64];
+	struct trace_event    events[TRACE_MAX_EVENTS];
+};
+
+static pthread_mutex_t     buffers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_buffer *buffers[TRACE_MAX_THREADS];
+static size_t              num_buffers   = 0;
+static volatile long       enabled       = 0;
+
+/* incremented by trace_free, so threads know their buffer is gone */
+static volatile long       generation    = 1;
+
+#ifdef _MSC_VER
+static __declspec(thread) struct trace_buffer *thread_buffer = NULL;
+static __declspec(thread) long thread_generation = 0;
+static __declspec(thread) char thread_name[64] = {0};
+#else
+static __thread struct trace_buffer *thread_buffer = NULL;
+static __thread long thread_generation = 0;
+static __thread char thread_name[64] = {0};
+#endif
+
+void trace_enable(bool enable)
+{
+	os_atomic_set_long(&enabled, enable ? 1 : 0);
+}
+
+bool trace_enabled(void)
+{
+	return os_atomic_load_long(&enabled) != 0;
+}
+
+static struct trace_buffer *create_thread_buffer(void)
+{
+	struct trace_buffer *buf = NULL;
+
+	pthread_mutex_lock(&buffers_mutex);
+
+	if (num_buffers < TRACE_MAX_THREADS) {
+		buf = bzalloc(sizeof(struct trace_buffer));
+		buf->tid = (long)num_buffers + 1;
+		strncpy(buf->name, thread_name, sizeof(buf->name) - 1);
+		buffers[num_buffers++] = buf;
+	}
+
+	pthread_mutex_unlock(&buffers_mutex);
+
+	if (!buf)
+		blog(LOG_DEBUG, "trace: Too many threads, events of thread "
+		                "'%s' won't be recorded", thread_name);
+	return buf;
+}
+
+static inline struct trace_buffer *get_thread_buffer(void)
+{
+	long cur_generation = os_atomic_load_long(&generation);
+
+	/* a thread that couldn't get a buffer doesn't try again */
+	if (thread_generation != cur_generation) {
+		thread_generation = cur_generation;
+		thread_buffer     = create_thread_buffer();
+	}
+
+	return thread_buffer;
+}
+
+static void add_event(enum trace_event_type type, const char *name,
+		uint64_t ts_ns, uint64_t duration_ns, double value)
+{
+	struct trace_buffer *buf;
+	struct trace_event  *event;
+	long                pos;
+
+	if (!name)
+		return;
+
+	buf = get_thread_buffer();
+	if (!buf)
+		return;
+
+	pos   = buf->pos;
+	event = buf->events + ((unsigned long)pos % TRACE_MAX_EVENTS);
+
+	event->type        = type;
+	event->name        = name;
+	event->ts_ns       = ts_ns;
+	event->duration_ns = duration_ns;
+	event->value       = value;
+
+	os_atomic_set_long(&buf->pos, pos + 1);
+}
+
+uint64_t trace_begin(void)
+{
+	return trace_enabled() ? os_gettime_ns() : 0;
+}
+
+void trace_end(const char *name, uint64_t start_ns)
+{
+	if (start_ns && trace_enabled())
+		add_event(TRACE_EVENT_SCOPE, name, start_ns,
+				os_gettime_ns() - start_ns, 0.0);
+}
+
+void trace_add_scope(const char *name, uint64_t start_ns,
+		uint64_t duration_ns)
+{
+	if (trace_enabled())
+		add_event(TRACE_EVENT_SCOPE, name, start_ns, duration_ns, 0.0);
+}
+
+void trace_instant(const char *name)
+{
+	if (trace_enabled())
+		add_event(TRACE_EVENT_INSTANT, name, os_gettime_ns(), 0, 0.0);
+}
+
+void trace_counter(const char *name, double value)
+{
+	if (trace_enabled())
+		add_event(TRACE_EVENT_COUNTER, name, os_gettime_ns(), 0,
+				value);
+}
+
+void trace_set_thread_name(const char *name)
+{
+	if (!name)
+		return;
+
+	strncpy(thread_name, name, sizeof(thread_name) - 1);
+
+	/* named after the buffer was created, which is rare, so it doesn't
+	 * matter that a dump could see the name half-written */
+	if (thread_buffer && thread_generation ==
+			os_atomic_load_long(&generation))
+		strncpy(thread_buffer->name, name,
+				sizeof(thread_buffer->name) - 1);
+}
+
+void trace_reset(void)
+{
+	pthread_mutex_lock(&buffers_mutex);
+
+	for (size_t i = 0; i < num_buffers; i++)
+		os_atomic_set_long(&buffers[i]->reset_pos,
+				os_atomic_load_long(&buffers[i]->pos));
+
+	pthread_mutex_unlock(&buffers_mutex);
+}
+
+/* copies the complete events out of the ring, oldest first.  returns the
+ * count */
+static size_t copy_events(struct trace_buffer *buf, struct trace_event *out)
+{
+	long   pos   = os_atomic_load_long(&buf->pos);
+	long   first = os_atomic_load_long(&buf->reset_pos);
+	long   last_pos;
+	size_t count = 0;
+
+	if (pos - first > TRACE_MAX_EVENTS)
+		first = pos - TRACE_MAX_EVENTS;
+
+	for (long i = first; i < pos; i++)
+		out[count++] = buf->events[(unsigned long)i % TRACE_MAX_EVENTS];
+
+	/* the writer may have wrapped around to the oldest ones by now, and
+	 * could be in the middle of writing the slot at last_pos */
+	last_pos = os_atomic_load_long(&buf->pos);
+	first    = last_pos + 1 - TRACE_MAX_EVENTS;
+	if (pos - (long)count < first) {
+		size_t skip = (size_t)(first - (pos - (long)count));
+		if (skip > count)
+			skip = count;
+
+		memmove(out, out + skip,
+				(count - skip) * sizeof(struct trace_event));
+		count -= skip;
+	}
+
+	return count;
+}
+
+static void write_json_string(FILE *file, const char *str)
+{
+	fputc('"', file);
+
+	for (; *str; str++) {
+		unsigned char ch = (unsigned char)*str;
+
+		if (ch == '"' || ch == '\\')
+			fprintf(file, "\\%c", ch);
+		else if (ch < 0x20)
+			fprintf(file, "\\u%04x", ch);
+		else
+			fputc(ch, file);
+	}
+
+	fputc('"', file);
+}
+
+static inline double ns_to_us(uint64_t ns)
+{
+	return (double)ns / 1000.0;
+}
+
+static void write_event(FILE *file, long tid, const struct trace_event *event)
+{
+	fprintf(file, ",\n{\"name\":");
+	write_json_string(file, event->name);
+	fprintf(file, ",\"pid\":1,\"tid\":%ld,\"ts\":%.3f", tid,
+			ns_to_us(event->ts_ns));
+
+	switch (event->type) {
+	case TRACE_EVENT_SCOPE:
+		fprintf(file, ",\"ph\":\"X\",\"dur\":%.3f}",
+				ns_to_us(event->duration_ns));
+		break;
+	case TRACE_EVENT_INSTANT:
+		fprintf(file, ",\"ph\":\"i\",\"s\":\"t\"}");
+		break;
+	case TRACE_EVENT_COUNTER:
+		fprintf(file, ",\"ph\":\"C\",\"args\":{\"value\":%g}}",
+				event->value);
+		break;
+	}
+}
+
+static void write_buffer(FILE *file, struct trace_buffer *buf,
+		struct trace_event *events)
+{
+	size_t count = copy_events(buf, events);
+
+	fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+	              "\"tid\":%ld,\"args\":{\"name\":", buf->tid);
+	write_json_string(file, *buf->name ? buf->name : "unnamed");
+	fprintf(file, "}}");
+
+	for (size_t i = 0; i < count; i++)
+		write_event(file, buf->tid, events+i);
+}
+
+bool trace_dump_json(const char *path)
+{
+	struct trace_event *events;
+	FILE *file;
+
+	file = os_fopen(path, "w");
+	if (!file) {
+		blog(LOG_WARNING, "trace_dump_json: Failed to open '%s'",
+				path);
+		return false;
+	}
+
+	events = bmalloc(sizeof(struct trace_event) * TRACE_MAX_EVENTS);
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+	              "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+	              "\"args\":{\"name\":\"libobs\"}}");
+
+	pthread_mutex_lock(&buffers_mutex);
+
+	for (size_t i = 0; i < num_buffers; i++)
+		write_buffer(file, buffers[i], events);
+
+	pthread_mutex_unlock(&buffers_mutex);
+
+	fprintf(file, "\n]}\n");
+
+	bfree(events);
+	fclose(file);
+	return true;
+}
+
+void trace_free(void)
+{
+	pthread_mutex_lock(&buffers_mutex);
+
+	for (size_t i = 0; i < num_buffers; i++) {
+		bfree(buffers[i]);
+		buffers[i] = NULL;
+	}
+
+	num_buffers = 0;
+	os_atomic_inc_long(&generation);
+
+	pthread_mutex_unlock(&buffers_mutex);
+}
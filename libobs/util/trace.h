@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2014 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+
+/*
+ * Timeline tracing
+ *
+ *   While tracing is enabled, threads record timed scopes, instant events and
+ * counters into their own buffers, which only the thread itself writes to,
+ * so recording never takes a lock.  Each buffer is a ring of the most recent
+ * TRACE_MAX_EVENTS events, and the rings of all threads can be written out
+ * as Chrome trace JSON (chrome://tracing, or ui.perfetto.dev) to see what
+ * every thread was doing at the same time.
+ *
+ *   Event names aren't copied, so they have to stay valid until trace_free,
+ * such as string literals or the names of profile points.  Every profile
+ * point measured with profile_start/profile_end is traced as a scope too.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of events kept per thread */
+#define TRACE_MAX_EVENTS 16384
+
+/** Number of threads that can record events, later threads are ignored */
+#define TRACE_MAX_THREADS 128
+
+EXPORT void trace_enable(bool enable);
+EXPORT bool trace_enabled(void);
+
+/** Returns the start time of a scope, or 0 if tracing is disabled */
+EXPORT uint64_t trace_begin(void);
+
+/** Records the scope started at start_ns (if it was returned while enabled) */
+EXPORT void trace_end(const char *name, uint64_t start_ns);
+
+/** Records a scope that has already been measured */
+EXPORT void trace_add_scope(const char *name, uint64_t start_ns,
+		uint64_t duration_ns);
+
+EXPORT void trace_instant(const char *name);
+EXPORT void trace_counter(const char *name, double value);
+
+/**
+ * Names the calling thread in the trace.  os_thread_init calls this, so
+ * usually there's no need to.
+ */
+EXPORT void trace_set_thread_name(const char *name);
+
+/** Clears the events of every thread */
+EXPORT void trace_reset(void);
+
+/** Writes the events of every thread to a Chrome trace JSON file */
+EXPORT bool trace_dump_json(const char *path);
+
+/** Frees the buffers of every thread, only call once threads are stopped */
+EXPORT void trace_free(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -19,6 +19,7 @@
 #include <util/bmem.h>
 #include <util/dstr.h>
 #include <util/platform.h>
+#include <util/async-log.h>
 #include <obs.hpp>
 
 #include <QProxyStyle>
@@ -29,7 +30,6 @@
 #include "platform.hpp"
 
 #ifdef _WIN32
-#include <fstream>
 #include <windows.h>
 #else
 #include <signal.h>
@@ -38,23 +38,56 @@
 using namespace std;
 
 #ifdef _WIN32
-static void do_log(int log_level, const char *msg, va_list args, void *param)
+static void do_log(int log_level, const char *msg, void *param)
 {
-	fstream &logFile = *static_cast<fstream*>(param);
-	char bla[4096];
-	vsnprintf(bla, 4095, msg, args);
-
-	OutputDebugStringA(bla);
+	OutputDebugStringA(msg);
 	OutputDebugStringA("\n");
 
-	if (log_level <= LOG_INFO)
-		logFile << bla << endl;
+	UNUSED_PARAMETER(log_level);
+	UNUSED_PARAMETER(param);
+}
 
+// breaks on the thread that logged the error, not on the writer thread
+static void break_on_error(int log_level, const char *msg, void *param)
+{
 	if (log_level <= LOG_ERROR && IsDebuggerPresent())
 		__debugbreak();
+
+	UNUSED_PARAMETER(msg);
+	UNUSED_PARAMETER(param);
 }
 #endif
 
+// logging goes through a writer thread, so that a slow disk or console
+// can't hold up the threads that log
+static void StartLogging()
+{
+	struct async_log_info info = {};
+	char *logPath = os_get_config_path("obs-studio/log.txt");
+
+	info.path          = logPath;
+	info.max_file_size = 16 * 1024 * 1024;
+	info.max_files     = 2;
+	info.console       = true;
+#ifdef _DEBUG
+	info.level         = LOG_DEBUG;
+#else
+	info.level         = LOG_INFO;
+#endif
+#ifdef _WIN32
+	info.output        = do_log;
+	info.sync_output   = break_on_error;
+#endif
+
+	// the config directory may not have been created yet
+	if (!async_log_start(&info)) {
+		info.path = nullptr;
+		async_log_start(&info);
+	}
+
+	bfree(logPath);
+}
+
 bool OBSApp::InitGlobalConfigDefaults()
 {
 	config_set_default_string(globalConfig, "General", "Language", "en");
@@ -95,6 +128,10 @@ static bool MakeUserDirs()
 	if (!do_mkdir(configPath))
 		return false;
 
+	configPath = os_get_config_path("obs-studio/locale-cache");
+	if (!do_mkdir(configPath))
+		return false;
+
 	return true;
 }
 
@@ -129,7 +166,9 @@ bool OBSApp::InitLocale()
 		return false;
 	}
 
-	textLookup = text_lookup_create(englishPath.c_str());
+	BPtr<char> cacheDir(os_get_config_path("obs-studio/locale-cache"));
+
+	textLookup = text_lookup_create_cached(englishPath.c_str(), cacheDir);
 	if (!textLookup) {
 		OBSErrorBox(NULL, "Failed to create locale from file '%s'",
 				englishPath.c_str());
@@ -225,17 +264,7 @@ int main(int argc, char *argv[])
 
 	int ret = -1;
 	QCoreApplication::addLibraryPath(".");
-#ifdef _WIN32
-	char *logPath = os_get_config_path("obs-studio/log.txt");
-	fstream logFile;
-
-	logFile.open(logPath, ios_base::in | ios_base::out | ios_base::trunc,
-			_SH_DENYNO);
-	bfree(logPath);
-
-	if (logFile.is_open())
-		base_set_log_handler(do_log, &logFile);
-#endif
+	StartLogging();
 
 	try {
 		OBSApp program(argc, argv);
@@ -248,6 +277,6 @@ int main(int argc, char *argv[])
 	}
 
 	blog(LOG_INFO, "Number of memory leaks: %ld", bnum_allocs());
-	base_set_log_handler(nullptr, nullptr);
+	async_log_stop();
 	return ret;
 }
@@ -13,7 +13,27 @@ using namespace std;
 
 void OBSPropertiesView::RefreshProperties()
 {
+	/* modified callbacks usually only change values, visibility or list
+	 * items, so the existing widgets are updated in place unless
+	 * properties were added or reordered */
+	if (widget && !PropertiesChanged()) {
+		obs_property_t property = obs_properties_first(properties);
+
+		while (property) {
+			auto it = rows.find(obs_property_name(property));
+			if (it != rows.end())
+				UpdateProperty(property, it->second);
+			obs_property_next(&property);
+		}
+
+		lastFocused.clear();
+		return;
+	}
+
 	children.clear();
+	rows.clear();
+	rowNames.clear();
+	pendingLists.clear();
 	if (widget)
 		widget->deleteLater();
 
@@ -32,6 +52,7 @@ void OBSPropertiesView::RefreshProperties()
 	obs_property_t property = obs_properties_first(properties);
 
 	while (property) {
+		rowNames.push_back(obs_property_name(property));
 		AddProperty(property, layout);
 		obs_property_next(&property);
 	}
@@ -45,6 +66,44 @@ void OBSPropertiesView::RefreshProperties()
 		lastWidget->setFocus(Qt::OtherFocusReason);
 		lastWidget = nullptr;
 	}
+
+	/* list items are filled in once the view has had a chance to show,
+	 * so that long lists don't hold up opening it */
+	if (!pendingLists.empty())
+		QMetaObject::invokeMethod(this, "PopulateLists",
+				Qt::QueuedConnection);
+}
+
+bool OBSPropertiesView::PropertiesChanged()
+{
+	obs_property_t property = obs_properties_first(properties);
+	size_t         idx      = 0;
+
+	while (property) {
+		if (idx == rowNames.size() ||
+		    rowNames[idx].compare(obs_property_name(property)) != 0)
+			return true;
+
+		obs_property_next(&property);
+		idx++;
+	}
+
+	return idx != rowNames.size();
+}
+
+void OBSPropertiesView::PopulateLists()
+{
+	vector<string> names;
+	names.swap(pendingLists);
+
+	for (const string &name : names) {
+		obs_property_t property = obs_properties_get(properties,
+				name.c_str());
+		auto           it       = rows.find(name);
+
+		if (property && it != rows.end())
+			UpdateList(property, it->second);
+	}
 }
 
 OBSPropertiesView::OBSPropertiesView(OBSData settings_,
@@ -134,77 +193,205 @@ QWidget *OBSPropertiesView::AddFloat(obs_property_t prop)
 	return NewWidget(prop, spin, SIGNAL(valueChanged(double)));
 }
 
-static void AddComboItem(QComboBox *combo, obs_property_t prop,
-		obs_combo_format format, size_t idx)
+static QVariant ComboItemData(obs_property_t prop, obs_combo_format format,
+		size_t idx)
 {
-	const char *name = obs_property_list_item_name(prop, idx);
-	QVariant var;
-
 	if (format == OBS_COMBO_FORMAT_INT) {
 		long long val = obs_property_list_item_int(prop, idx);
-		var = QVariant::fromValue<long long>(val);
+		return QVariant::fromValue<long long>(val);
 
 	} else if (format == OBS_COMBO_FORMAT_FLOAT) {
 		double val = obs_property_list_item_float(prop, idx);
-		var = QVariant::fromValue<double>(val);
+		return QVariant::fromValue<double>(val);
 
 	} else if (format == OBS_COMBO_FORMAT_STRING) {
-		var = obs_property_list_item_string(prop, idx);
+		return obs_property_list_item_string(prop, idx);
 	}
 
-	combo->addItem(QT_UTF8(name), var);
+	return QVariant();
 }
 
-QWidget *OBSPropertiesView::AddList(obs_property_t prop)
+static bool ComboItemsMatch(QComboBox *combo, obs_property_t prop,
+		obs_combo_format format)
 {
-	const char       *name  = obs_property_name(prop);
-	QComboBox        *combo = new QComboBox();
-	obs_combo_type   type   = obs_property_list_type(prop);
-	obs_combo_format format = obs_property_list_format(prop);
-	size_t           count  = obs_property_list_item_count(prop);
-	int              idx    = -1;
+	size_t count = obs_property_list_item_count(prop);
 
-	for (size_t i = 0; i < count; i++)
-		AddComboItem(combo, prop, format, i);
+	if ((size_t)combo->count() != count)
+		return false;
 
+	for (size_t i = 0; i < count; i++) {
+		const char *name = obs_property_list_item_name(prop, i);
+
+		if (combo->itemText((int)i) != QT_UTF8(name) ||
+		    combo->itemData((int)i) != ComboItemData(prop, format, i))
+			return false;
+	}
+
+	return true;
+}
+
+static int FindComboIndex(QComboBox *combo, obs_data_t settings,
+		const char *name, obs_combo_format format)
+{
 	if (format == OBS_COMBO_FORMAT_INT) {
 		int    val       = (int)obs_data_getint(settings, name);
 		string valString = to_string(val);
-		idx              = combo->findData(QT_UTF8(valString.c_str()));
+		return combo->findData(QT_UTF8(valString.c_str()));
 
 	} else if (format == OBS_COMBO_FORMAT_FLOAT) {
 		double val       = obs_data_getdouble(settings, name);
 		string valString = to_string(val);
-		idx              = combo->findData(QT_UTF8(valString.c_str()));
+		return combo->findData(QT_UTF8(valString.c_str()));
 
 	} else if (format == OBS_COMBO_FORMAT_STRING) {
 		const char *val  = obs_data_getstring(settings, name);
-
-		if (type == OBS_COMBO_TYPE_EDITABLE)
-			combo->lineEdit()->setText(val);
-		else
-			idx      = combo->findData(QT_UTF8(val));
+		return combo->findData(QT_UTF8(val));
 	}
 
+	return -1;
+}
+
+static void ListReady(void *data, obs_property_t prop)
+{
+	/* called from the enumeration thread */
+	QMetaObject::invokeMethod(static_cast<OBSPropertiesView*>(data),
+			"RefreshProperties", Qt::QueuedConnection);
+	UNUSED_PARAMETER(prop);
+}
+
+QWidget *OBSPropertiesView::AddList(obs_property_t prop)
+{
+	QComboBox        *combo = new QComboBox();
+	obs_combo_type   type   = obs_property_list_type(prop);
+
+	/* the items are added by PopulateLists */
+	pendingLists.push_back(obs_property_name(prop));
+	obs_property_list_set_ready_callback(prop, ListReady, this);
+
 	if (type == OBS_COMBO_TYPE_EDITABLE) {
 		combo->setEditable(true);
 		return NewWidget(prop, combo,
-				SLOT(editTextChanged(const QString &)));
+				SIGNAL(editTextChanged(const QString &)));
+	}
+
+	return NewWidget(prop, combo, SIGNAL(currentIndexChanged(int)));
+}
+
+/* returns true if the items of the list changed */
+bool OBSPropertiesView::UpdateList(obs_property_t prop, PropertyRow &row)
+{
+	const char       *name  = obs_property_name(prop);
+	QComboBox        *combo = static_cast<QComboBox*>(row.widget);
+	obs_combo_type   type   = obs_property_list_type(prop);
+	obs_combo_format format = obs_property_list_format(prop);
+	size_t           count;
+	bool             reload;
+	int              idx;
+
+	obs_property_list_update(prop);
+	reload = !ComboItemsMatch(combo, prop, format);
+
+	/* async lists stay disabled until they've been enumerated */
+	combo->setEnabled(obs_property_enabled(prop) &&
+			!obs_property_list_pending(prop));
+
+	combo->blockSignals(true);
+
+	if (reload) {
+		count = obs_property_list_item_count(prop);
+		combo->clear();
+		for (size_t i = 0; i < count; i++)
+			combo->addItem(QT_UTF8(obs_property_list_item_name(
+						prop, i)),
+					ComboItemData(prop, format, i));
+	}
+
+	if (type == OBS_COMBO_TYPE_EDITABLE) {
+		const char *val = obs_data_getstring(settings, name);
+		if (combo->currentText() != QT_UTF8(val))
+			combo->lineEdit()->setText(QT_UTF8(val));
+
+		combo->blockSignals(false);
+		return reload;
 	}
 
-	if (idx != -1)
+	idx = FindComboIndex(combo, settings, name, format);
+	if (idx != -1 && idx != combo->currentIndex())
 		combo->setCurrentIndex(idx);
 
-	WidgetInfo *info = new WidgetInfo(this, prop, combo);
-	connect(combo, SIGNAL(currentIndexChanged(int)), info,
-				SLOT(ControlChanged()));
-	children.push_back(std::move(unique_ptr<WidgetInfo>(info)));
+	combo->blockSignals(false);
 
 	/* trigger a settings update if the index was not found */
-	if (idx == -1)
-		info->ControlChanged();
+	if (reload && idx == -1)
+		row.info->ControlChanged();
 
-	return combo;
+	return reload;
+}
+
+void OBSPropertiesView::UpdateProperty(obs_property_t property,
+		PropertyRow &row)
+{
+	const char        *name    = obs_property_name(property);
+	const char        *desc    = obs_property_description(property);
+	obs_property_type type     = obs_property_get_type(property);
+	bool              visible  = obs_property_visible(property);
+	QWidget           *widget  = row.widget;
+
+	widget->setEnabled(obs_property_enabled(property));
+	widget->setVisible(visible);
+	if (row.label) {
+		row.label->setVisible(visible);
+		if (row.label->text() != QT_UTF8(desc))
+			row.label->setText(QT_UTF8(desc));
+	}
+
+	if (type == OBS_PROPERTY_LIST) {
+		UpdateList(property, row);
+		return;
+	}
+
+	widget->blockSignals(true);
+
+	if (type == OBS_PROPERTY_BOOL) {
+		QCheckBox *checkbox = static_cast<QCheckBox*>(widget);
+		bool      val       = obs_data_getbool(settings, name);
+
+		if (checkbox->text() != QT_UTF8(desc))
+			checkbox->setText(QT_UTF8(desc));
+		if (checkbox->isChecked() != val)
+			checkbox->setCheckState(val ? Qt::Checked :
+					Qt::Unchecked);
+
+	} else if (type == OBS_PROPERTY_INT) {
+		QSpinBox *spin = static_cast<QSpinBox*>(widget);
+		int      val   = (int)obs_data_getint(settings, name);
+
+		spin->setRange(obs_property_int_min(property),
+				obs_property_int_max(property));
+		spin->setSingleStep(obs_property_int_step(property));
+		if (spin->value() != val)
+			spin->setValue(val);
+
+	} else if (type == OBS_PROPERTY_FLOAT) {
+		QDoubleSpinBox *spin = static_cast<QDoubleSpinBox*>(widget);
+		double         val   = obs_data_getdouble(settings, name);
+
+		spin->setRange(obs_property_float_min(property),
+				obs_property_float_max(property));
+		spin->setSingleStep(obs_property_float_step(property));
+		if (spin->value() != val)
+			spin->setValue(val);
+
+	} else if (type == OBS_PROPERTY_TEXT) {
+		QLineEdit *edit = static_cast<QLineEdit*>(widget);
+		QString   val   = QT_UTF8(obs_data_getstring(settings, name));
+
+		/* setting the same text would reset the cursor */
+		if (edit->text() != val)
+			edit->setText(val);
+	}
+
+	widget->blockSignals(false);
 }
 
 void OBSPropertiesView::AddProperty(obs_property_t property,
@@ -213,9 +400,6 @@ void OBSPropertiesView::AddProperty(obs_property_t property,
 	const char        *name = obs_property_name(property);
 	obs_property_type type  = obs_property_get_type(property);
 
-	if (!obs_property_visible(property))
-		return;
-
 	QWidget *widget = nullptr;
 
 	switch (type) {
@@ -261,6 +445,16 @@ void OBSPropertiesView::AddProperty(obs_property_t property,
 
 	layout->addRow(label, widget);
 
+	/* hidden properties still get widgets so a refresh can show them */
+	if (!obs_property_visible(property)) {
+		widget->setVisible(false);
+		if (label)
+			label->setVisible(false);
+	}
+
+	PropertyRow row = {label, widget, children.back().get()};
+	rows[name] = row;
+
 	if (!lastFocused.empty())
 		if (lastFocused.compare(name) == 0)
 			lastWidget = widget;
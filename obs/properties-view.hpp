@@ -4,8 +4,11 @@
 #include <obs.hpp>
 #include <vector>
 #include <memory>
+#include <string>
+#include <map>
 
 class QFormLayout;
+class QLabel;
 class OBSPropertiesView;
 
 typedef void (*PropertiesUpdateCallback)(void *obj, obs_data_t settings);
@@ -40,6 +43,14 @@ public slots:
 
 /* ------------------------------------------------------------------------- */
 
+/* the widgets created for a property, kept so that refreshes can update the
+ * existing widgets in place instead of rebuilding the whole view */
+struct PropertyRow {
+	QLabel     *label;
+	QWidget    *widget;
+	WidgetInfo *info;
+};
+
 class OBSPropertiesView : public QScrollArea {
 	Q_OBJECT
 
@@ -55,6 +66,9 @@ private:
 	std::vector<std::unique_ptr<WidgetInfo>> children;
 	std::string                              lastFocused;
 	QWidget                                  *lastWidget;
+	std::vector<std::string>                 rowNames;
+	std::map<std::string, PropertyRow>       rows;
+	std::vector<std::string>                 pendingLists;
 
 	QWidget *NewWidget(obs_property_t prop, QWidget *widget,
 			const char *signal);
@@ -68,6 +82,13 @@ private:
 
 	void AddProperty(obs_property_t property, QFormLayout *layout);
 
+	bool PropertiesChanged();
+	void UpdateProperty(obs_property_t property, PropertyRow &row);
+	bool UpdateList(obs_property_t property, PropertyRow &row);
+
+private slots:
+	void PopulateLists();
+
 public slots:
 	void RefreshProperties();
 
@@ -23,6 +23,7 @@
 
 #include <util/util.hpp>
 #include <util/platform.h>
+#include <util/threading.h>
 
 #include "obs-app.hpp"
 #include "platform.hpp"
@@ -51,8 +52,10 @@ OBSBasic::OBSBasic(QWidget *parent)
 	  service       (nullptr),
 	  aac           (nullptr),
 	  x264          (nullptr),
+	  signalQueue   (nullptr),
 	  sceneChanging (false),
 	  resizeTimer   (0),
+	  autosaveTimer (0),
 	  properties    (nullptr),
 	  ui            (new Ui::OBSBasic)
 {
@@ -81,18 +84,245 @@ static obs_data_t GenerateSaveData()
 	return saveData;
 }
 
+#define SCENES_PATH "obs-studio/basic/scenes.json"
+#define MODULE_MANIFEST_PATH "obs-studio/module-manifest.json"
+
+/* autosave appends changes to the journal, and a full save is done to fold
+ * it back in to the scene file once it gets too large */
+#define AUTOSAVE_INTERVAL_MS   10000
+#define JOURNAL_COMPACT_SIZE   (4 * 1024 * 1024)
+
+static inline string GetSavePath(const char *file, const char *ext)
+{
+	string path = file;
+	size_t pos  = path.rfind(".json");
+
+	if (pos != string::npos)
+		path.erase(pos);
+	return path + ext;
+}
+
+static inline string GetBinaryPath(const char *file)
+{
+	return GetSavePath(file, ".bin");
+}
+
+static inline string GetJournalPath(const char *file)
+{
+	return GetSavePath(file, ".journal");
+}
+
 void OBSBasic::Save(const char *file)
 {
 	obs_data_t saveData  = GenerateSaveData();
 	const char *jsonData = obs_data_getjson(saveData);
+	string     binFile   = GetBinaryPath(file);
+	bool       success;
 
 	/* TODO maybe a message box here? */
-	if (!os_quick_write_utf8_file(file, jsonData, strlen(jsonData), false))
+	success = os_quick_write_utf8_file(file, jsonData, strlen(jsonData),
+			false);
+	if (!success)
 		blog(LOG_ERROR, "Could not save scene data to %s", file);
 
+	/* the binary copy is written last so it's only used on load if the
+	 * json file hasn't been edited since */
+	if (!obs_data_save_binary_file(saveData, binFile.c_str()))
+		blog(LOG_WARNING, "Could not save binary scene data to %s",
+				binFile.c_str());
+
+	/* everything in the journal is part of the scene file now */
+	if (success)
+		remove(GetJournalPath(file).c_str());
+
+	lastSavedScene = obs_data_getstring(saveData, "current_scene");
 	obs_data_release(saveData);
 }
 
+void OBSBasic::AutoSave()
+{
+	BPtr<char>   savePath(os_get_config_path(SCENES_PATH));
+	obs_data_t   changes   = obs_save_source_changes();
+	obs_source_t curScene  = obs_get_output_source(0);
+	const char   *sceneName = obs_source_getname(curScene);
+	string       journal   = GetJournalPath(savePath);
+	const void   *record;
+	size_t       size      = 0;
+	FILE         *f;
+
+	if (sceneName && lastSavedScene != sceneName) {
+		if (!changes)
+			changes = obs_data_create();
+		obs_data_setstring(changes, "current_scene", sceneName);
+		lastSavedScene = sceneName;
+	}
+
+	obs_source_release(curScene);
+
+	if (!changes)
+		return;
+
+	/* each record is its size followed by the binary change data, so a
+	 * record cut off by a crash is simply ignored when loading */
+	record = obs_data_getbinary(changes, &size);
+	f      = os_fopen(journal.c_str(), "ab");
+
+	if (f) {
+		uint8_t header[4] = {
+			(uint8_t)size,         (uint8_t)(size >> 8),
+			(uint8_t)(size >> 16), (uint8_t)(size >> 24)
+		};
+
+		fwrite(header, 1, sizeof(header), f);
+		fwrite(record, 1, size, f);
+		fflush(f);
+		fclose(f);
+	} else {
+		blog(LOG_WARNING, "Could not open scene journal %s",
+				journal.c_str());
+	}
+
+	obs_data_release(changes);
+
+	f = os_fopen(journal.c_str(), "rb");
+	if (f) {
+		bool compact = os_fgetsize(f) > JOURNAL_COMPACT_SIZE;
+		fclose(f);
+
+		if (compact)
+			Save(savePath);
+	}
+}
+
+static size_t FindSavedSource(obs_data_array_t sources, const char *name)
+{
+	size_t count = obs_data_array_count(sources);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t source  = obs_data_array_item(sources, i);
+		bool       matches = strcmp(obs_data_getstring(source, "name"),
+				name) == 0;
+		obs_data_release(source);
+
+		if (matches)
+			return i;
+	}
+
+	return (size_t)-1;
+}
+
+static void ApplyJournalRecord(obs_data_t data, obs_data_t record)
+{
+	obs_data_array_t sources = obs_data_getarray(data, "sources");
+	obs_data_array_t removed = obs_data_getarray(record, "removed");
+	obs_data_array_t changed = obs_data_getarray(record, "sources");
+	size_t           count;
+
+	if (!sources) {
+		sources = obs_data_array_create();
+		obs_data_setarray(data, "sources", sources);
+	}
+
+	count = obs_data_array_count(removed);
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t name = obs_data_array_item(removed, i);
+		size_t     idx  = FindSavedSource(sources,
+				obs_data_getstring(name, "name"));
+
+		if (idx != (size_t)-1)
+			obs_data_array_erase(sources, idx);
+		obs_data_release(name);
+	}
+
+	count = obs_data_array_count(changed);
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t source = obs_data_array_item(changed, i);
+		size_t     idx    = FindSavedSource(sources,
+				obs_data_getstring(source, "name"));
+
+		if (idx != (size_t)-1)
+			obs_data_array_erase(sources, idx);
+		obs_data_array_push_back(sources, source);
+		obs_data_release(source);
+	}
+
+	obs_data_item_t scene = obs_data_item_byname(record, "current_scene");
+	if (scene) {
+		obs_data_setstring(data, "current_scene",
+				obs_data_item_getstring(scene));
+		obs_data_item_release(&scene);
+	}
+
+	obs_data_array_release(changed);
+	obs_data_array_release(removed);
+	obs_data_array_release(sources);
+}
+
+/* returns the number of records that were applied */
+static size_t ApplyJournal(obs_data_t data, const char *file)
+{
+	string journal = GetJournalPath(file);
+	size_t records = 0;
+	size_t size    = 0;
+	size_t pos     = 0;
+
+	/* the journal is only valid for the scene file it was started from */
+	if (os_get_file_mtime(file) > os_get_file_mtime(journal.c_str()))
+		return 0;
+
+	uint8_t *map = (uint8_t*)os_map_file(journal.c_str(), &size);
+	if (!map)
+		return 0;
+
+	while (size - pos >= 4) {
+		size_t recordSize = (size_t)map[pos] |
+			((size_t)map[pos + 1] << 8)  |
+			((size_t)map[pos + 2] << 16) |
+			((size_t)map[pos + 3] << 24);
+		pos += 4;
+
+		if (recordSize > size - pos)
+			break;
+
+		obs_data_t record = obs_data_create_from_binary(map + pos,
+				recordSize);
+		if (!record)
+			break;
+
+		ApplyJournalRecord(data, record);
+		obs_data_release(record);
+
+		pos += recordSize;
+		records++;
+	}
+
+	os_unmap_file(map, size);
+	return records;
+}
+
+static obs_data_t LoadSaveData(const char *file)
+{
+	string  binFile   = GetBinaryPath(file);
+	int64_t binMTime  = os_get_file_mtime(binFile.c_str());
+	int64_t jsonMTime = os_get_file_mtime(file);
+
+	if (binMTime >= 0 && binMTime >= jsonMTime) {
+		obs_data_t data = obs_data_create_from_binary_file(
+				binFile.c_str());
+		if (data)
+			return data;
+
+		blog(LOG_WARNING, "Failed to load binary scene data from %s, "
+		                  "falling back to json", binFile.c_str());
+	}
+
+	BPtr<char> jsonData = os_quick_read_utf8_file(file);
+	if (!jsonData)
+		return nullptr;
+
+	return obs_data_create_from_json(jsonData);
+}
+
 void OBSBasic::Load(const char *file)
 {
 	if (!file) {
@@ -100,11 +330,15 @@ void OBSBasic::Load(const char *file)
 		return;
 	}
 
-	BPtr<char> jsonData = os_quick_read_utf8_file(file);
-	if (!jsonData)
+	obs_data_t data = LoadSaveData(file);
+	if (!data)
 		return;
 
-	obs_data_t       data       = obs_data_create_from_json(jsonData);
+	size_t journalRecords = ApplyJournal(data, file);
+	if (journalRecords)
+		blog(LOG_INFO, "Recovered %u autosaved change(s) from the scene "
+		               "journal", (unsigned int)journalRecords);
+
 	obs_data_array_t sources    = obs_data_getarray(data, "sources");
 	const char       *sceneName = obs_data_getstring(data, "current_scene");
 	obs_source_t     curScene;
@@ -115,8 +349,14 @@ void OBSBasic::Load(const char *file)
 	obs_set_output_source(0, curScene);
 	obs_source_release(curScene);
 
+	lastSavedScene = sceneName;
+
 	obs_data_array_release(sources);
 	obs_data_release(data);
+
+	/* fold the recovered changes in to the scene file */
+	if (journalRecords)
+		Save(file);
 }
 
 static inline bool HasAudioDevices(const char *source_id)
@@ -210,17 +450,28 @@ bool OBSBasic::InitOutputs()
 	if (!streamOutput)
 		return false;
 
-	signal_handler_connect(obs_output_signalhandler(streamOutput),
-			"start", OBSStartStreaming, this);
-	signal_handler_connect(obs_output_signalhandler(streamOutput),
-			"stop", OBSStopStreaming, this);
+	signal_handler_connect_queued(obs_output_signalhandler(streamOutput),
+			"start", OBSStartStreaming, this, signalQueue, 0);
+	signal_handler_connect_queued(obs_output_signalhandler(streamOutput),
+			"stop", OBSStopStreaming, this, signalQueue, 0);
 
 	return true;
 }
 
+/* the native AAC encoders are cheaper than FFmpeg's, and are only
+ * registered on the platforms that have them */
+static const char *nativeAACEncoders[] = {"CoreAudio_AAC", "mf_aac"};
+
 bool OBSBasic::InitEncoders()
 {
-	aac = obs_audio_encoder_create("ffmpeg_aac", "aac", nullptr);
+	for (const char *id : nativeAACEncoders) {
+		aac = obs_audio_encoder_create(id, "aac", nullptr);
+		if (aac)
+			break;
+	}
+
+	if (!aac)
+		aac = obs_audio_encoder_create("ffmpeg_aac", "aac", nullptr);
 	if (!aac)
 		return false;
 
@@ -284,11 +535,20 @@ bool OBSBasic::InitBasicConfigDefaults()
 	config_set_default_uint  (basicConfig, "Video", "FPSInt", 30);
 	config_set_default_uint  (basicConfig, "Video", "FPSNum", 30);
 	config_set_default_uint  (basicConfig, "Video", "FPSDen", 1);
+	config_set_default_uint  (basicConfig, "Video", "PipelineDepth", 2);
+	config_set_default_string(basicConfig, "Video", "ColorFormat", "NV12");
+	config_set_default_uint  (basicConfig, "Video", "PreviewFPS", 0);
+	config_set_default_bool  (basicConfig, "Video", "PreviewEnabled", true);
+	config_set_default_bool  (basicConfig, "Video", "GPUScaling", true);
+	config_set_default_string(basicConfig, "Video", "ScaleType",
+			"bicubic");
 
 	config_set_default_uint  (basicConfig, "Audio", "SampleRate", 44100);
 	config_set_default_string(basicConfig, "Audio", "ChannelSetup",
 			"Stereo");
 	config_set_default_uint  (basicConfig, "Audio", "BufferingTime", 1000);
+	config_set_default_uint  (basicConfig, "Audio", "PeriodTime", 25);
+	config_set_default_bool  (basicConfig, "Audio", "LowLatency", false);
 
 	config_set_default_string(basicConfig, "Audio", "DesktopDevice1",
 			hasDesktopAudio ? "default" : "disabled");
@@ -317,45 +577,109 @@ bool OBSBasic::InitBasicConfig()
 	return InitBasicConfigDefaults();
 }
 
+static enum os_thread_priority GetThreadPriorityFromName(const char *name)
+{
+	if (name && strcmp(name, "High") == 0)
+		return OS_THREAD_PRIORITY_HIGH;
+	else if (name && strcmp(name, "Realtime") == 0)
+		return OS_THREAD_PRIORITY_REALTIME;
+
+	return OS_THREAD_PRIORITY_NORMAL;
+}
+
+/* the [Threads] section of global.ini, for example:
+ *   VideoPriority=Realtime
+ *   EncoderAffinity=0xFF00 */
+static void LoadThreadPolicies()
+{
+	static const struct {
+		enum os_thread_class thread_class;
+		const char           *name;
+	} classes[] = {
+		{OS_THREAD_CLASS_DEFAULT, "Default"},
+		{OS_THREAD_CLASS_VIDEO,   "Video"},
+		{OS_THREAD_CLASS_AUDIO,   "Audio"},
+		{OS_THREAD_CLASS_ENCODER, "Encoder"},
+		{OS_THREAD_CLASS_OUTPUT,  "Output"}
+	};
+
+	for (auto &c : classes) {
+		string priority = string(c.name) + "Priority";
+		string affinity = string(c.name) + "Affinity";
+		const char *affinityStr = config_get_string(GetGlobalConfig(),
+				"Threads", affinity.c_str());
+
+		struct os_thread_policy policy;
+		policy.priority = GetThreadPriorityFromName(config_get_string(
+				GetGlobalConfig(), "Threads",
+				priority.c_str()));
+		policy.affinity_mask = affinityStr ?
+			strtoull(affinityStr, nullptr, 0) : 0;
+
+		os_set_thread_policy(c.thread_class, &policy);
+	}
+}
+
 void OBSBasic::OBSInit()
 {
 	/* make sure it's fully displayed before doing any initialization */
 	show();
 	App()->processEvents();
 
+	LoadThreadPolicies();
+
 	if (!obs_startup())
 		throw "Failed to initialize libobs";
+
+	BPtr<char> shaderCachePath(
+			os_get_config_path("obs-studio/shader-cache"));
+	obs_set_shader_cache_path(shaderCachePath);
 	if (!InitBasicConfig())
 		throw "Failed to load basic.ini";
-	if (!ResetVideo())
+	/* the graphics device is created while the modules load */
+	if (!StartResetVideo(true))
 		throw "Failed to initialize video";
 	if (!ResetAudio())
 		throw "Failed to initialize audio";
 
-	signal_handler_connect(obs_signalhandler(), "source_add",
-			OBSBasic::SourceAdded, this);
-	signal_handler_connect(obs_signalhandler(), "source_remove",
-			OBSBasic::SourceRemoved, this);
-	signal_handler_connect(obs_signalhandler(), "channel_change",
-			OBSBasic::ChannelChanged, this);
+	signalQueue = obs_signal_queue_create(false);
+	if (!signalQueue)
+		throw "Failed to create the signal queue";
+	signal_queue_set_wakeup(signalQueue, OBSBasic::SignalsQueued, this);
+
+	signal_handler_connect_queued(obs_signalhandler(), "source_add",
+			OBSBasic::SourceAdded, this, signalQueue, 0);
+	signal_handler_connect_queued(obs_signalhandler(), "source_remove",
+			OBSBasic::SourceRemoved, this, signalQueue, 0);
+	signal_handler_connect_queued(obs_signalhandler(), "channel_change",
+			OBSBasic::ChannelChanged, this, signalQueue, 0);
 
 	/* TODO: this is a test, all modules will be searched for and loaded
 	 * automatically later */
-	obs_load_module("test-input");
-	obs_load_module("obs-ffmpeg");
-	obs_load_module("obs-x264");
-	obs_load_module("obs-outputs");
-	obs_load_module("rtmp-services");
+	const char *modules[] = {
+		"test-input",
+		"obs-ffmpeg",
+		"obs-x264",
+		"obs-outputs",
+		"rtmp-services",
 #ifdef __APPLE__
-	obs_load_module("mac-avcapture");
-	obs_load_module("mac-capture");
+		"mac-avcapture",
+		"mac-capture",
 #elif _WIN32
-	obs_load_module("win-wasapi");
-	obs_load_module("win-capture");
+		"win-wasapi",
+		"win-capture",
 #else
-	obs_load_module("linux-xshm");
-	obs_load_module("linux-pulseaudio");
+		"linux-xshm",
+		"linux-pulseaudio",
 #endif
+	};
+
+	BPtr<char> manifestPath(os_get_config_path(MODULE_MANIFEST_PATH));
+	obs_load_modules(modules, sizeof(modules) / sizeof(modules[0]),
+			manifestPath);
+
+	if (!FinishResetVideo())
+		throw "Failed to initialize video";
 
 	if (!InitOutputs())
 		throw "Failed to initialize outputs";
@@ -364,15 +688,17 @@ void OBSBasic::OBSInit()
 	if (!InitService())
 		throw "Failed to initialize service";
 
-	BPtr<char> savePath(os_get_config_path("obs-studio/basic/scenes.json"));
+	BPtr<char> savePath(os_get_config_path(SCENES_PATH));
 	Load(savePath);
 
+	autosaveTimer = startTimer(AUTOSAVE_INTERVAL_MS);
+
 	ResetAudioDevices();
 }
 
 OBSBasic::~OBSBasic()
 {
-	BPtr<char> savePath(os_get_config_path("obs-studio/basic/scenes.json"));
+	BPtr<char> savePath(os_get_config_path(SCENES_PATH));
 	SaveService();
 	Save(savePath);
 
@@ -383,6 +709,27 @@ OBSBasic::~OBSBasic()
 	 * references */
 	ui->sources->clear();
 	ui->scenes->clear();
+
+	/* the queue references the sources of the signals it still has */
+	if (signalQueue) {
+		signal_handler_disconnect(obs_signalhandler(), "source_add",
+				OBSBasic::SourceAdded, this);
+		signal_handler_disconnect(obs_signalhandler(), "source_remove",
+				OBSBasic::SourceRemoved, this);
+		signal_handler_disconnect(obs_signalhandler(),
+				"channel_change", OBSBasic::ChannelChanged,
+				this);
+	}
+	if (streamOutput) {
+		signal_handler_disconnect(
+				obs_output_signalhandler(streamOutput),
+				"start", OBSStartStreaming, this);
+		signal_handler_disconnect(
+				obs_output_signalhandler(streamOutput),
+				"stop", OBSStopStreaming, this);
+	}
+	signal_queue_destroy(signalQueue);
+
 	obs_shutdown();
 }
 
@@ -572,6 +919,17 @@ void OBSBasic::ChannelChanged(void *data, calldata_t params)
 				Q_ARG(OBSSource, OBSSource(source)));
 }
 
+void OBSBasic::SignalsQueued(void *data)
+{
+	QMetaObject::invokeMethod(static_cast<OBSBasic*>(data),
+			"DispatchSignals", Qt::QueuedConnection);
+}
+
+void OBSBasic::DispatchSignals()
+{
+	signal_queue_dispatch(signalQueue);
+}
+
 void OBSBasic::RenderMain(void *data, uint32_t cx, uint32_t cy)
 {
 	OBSBasic *window = static_cast<OBSBasic*>(data);
@@ -616,7 +974,31 @@ void OBSBasic::SetService(obs_service_t newService)
 	}
 }
 
-bool OBSBasic::ResetVideo()
+static enum video_format GetVideoFormatFromName(const char *name)
+{
+	if (strcmp(name, "I420") == 0)
+		return VIDEO_FORMAT_I420;
+	else if (strcmp(name, "I444") == 0)
+		return VIDEO_FORMAT_I444;
+	else if (strcmp(name, "I422") == 0)
+		return VIDEO_FORMAT_I422;
+
+	return VIDEO_FORMAT_NV12;
+}
+
+static enum video_scale_type GetScaleTypeFromName(const char *name)
+{
+	if (strcmp(name, "bilinear") == 0)
+		return VIDEO_SCALE_FAST_BILINEAR;
+	else if (strcmp(name, "area") == 0)
+		return VIDEO_SCALE_AREA;
+	else if (strcmp(name, "lanczos") == 0)
+		return VIDEO_SCALE_LANCZOS;
+
+	return VIDEO_SCALE_BICUBIC;
+}
+
+bool OBSBasic::StartResetVideo(bool async)
 {
 	struct obs_video_info ovi;
 
@@ -631,9 +1013,17 @@ bool OBSBasic::ResetVideo()
 			"Video", "OutputCX");
 	ovi.output_height  = (uint32_t)config_get_uint(basicConfig,
 			"Video", "OutputCY");
-	ovi.output_format  = VIDEO_FORMAT_NV12;
+	ovi.output_format  = GetVideoFormatFromName(config_get_string(
+				basicConfig, "Video", "ColorFormat"));
 	ovi.adapter        = 0;
 	ovi.gpu_conversion = true;
+	ovi.pipeline_depth = (uint32_t)config_get_uint(basicConfig,
+			"Video", "PipelineDepth");
+	ovi.gpu_scaling    = config_get_bool(basicConfig,
+			"Video", "GPUScaling");
+	ovi.scale_type     = VIDEO_SCALE_BICUBIC;
+	ovi.output_scale_type = GetScaleTypeFromName(config_get_string(
+				basicConfig, "Video", "ScaleType"));
 
 	QTToGSWindow(ui->preview->winId(), ovi.window);
 
@@ -644,13 +1034,28 @@ bool OBSBasic::ResetVideo()
 	ovi.window_width  = size.width();
 	ovi.window_height = size.height();
 
-	if (!obs_reset_video(&ovi))
+	return async ? obs_reset_video_async(&ovi) : obs_reset_video(&ovi);
+}
+
+bool OBSBasic::FinishResetVideo()
+{
+	if (!obs_wait_video_reset())
 		return false;
 
+	obs_set_preview_fps((uint32_t)config_get_uint(basicConfig,
+			"Video", "PreviewFPS"));
+	obs_set_preview_enabled(config_get_bool(basicConfig,
+			"Video", "PreviewEnabled"));
+
 	obs_add_draw_callback(OBSBasic::RenderMain, this);
 	return true;
 }
 
+bool OBSBasic::ResetVideo()
+{
+	return StartResetVideo(false) && FinishResetVideo();
+}
+
 bool OBSBasic::ResetAudio()
 {
 	struct audio_output_info ai;
@@ -669,6 +1074,10 @@ bool OBSBasic::ResetAudio()
 		ai.speakers = SPEAKERS_STEREO;
 
 	ai.buffer_ms = config_get_uint(basicConfig, "Audio", "BufferingTime");
+	ai.period_ms = (uint32_t)config_get_uint(basicConfig, "Audio",
+			"PeriodTime");
+	ai.low_latency = config_get_bool(basicConfig, "Audio", "LowLatency");
+	ai.mixes = MAX_AUDIO_MIXES;
 
 	return obs_reset_audio(&ai);
 }
@@ -747,8 +1156,13 @@ void OBSBasic::closeEvent(QCloseEvent *event)
 
 void OBSBasic::changeEvent(QEvent *event)
 {
-	/* TODO */
-	UNUSED_PARAMETER(event);
+	/* nothing needs to be drawn for the preview while minimized */
+	if (event->type() == QEvent::WindowStateChange && basicConfig)
+		obs_set_preview_enabled(!isMinimized() &&
+				config_get_bool(basicConfig, "Video",
+					"PreviewEnabled"));
+
+	QWidget::changeEvent(event);
 }
 
 void OBSBasic::resizeEvent(QResizeEvent *event)
@@ -769,6 +1183,9 @@ void OBSBasic::timerEvent(QTimerEvent *event)
 
 		QSize size = GetPixelSize(ui->preview);
 		obs_resize(size.width(), size.height());
+
+	} else if (event->timerId() == autosaveTimer) {
+		AutoSave();
 	}
 }
 
@@ -1021,12 +1438,16 @@ void OBSBasic::StreamingStop(int errorcode)
 {
 	UNUSED_PARAMETER(errorcode);
 	ui->streamButton->setText("Start Streaming");
+	ui->streamButton->setEnabled(true);
 }
 
 void OBSBasic::on_streamButton_clicked()
 {
 	if (obs_output_active(streamOutput)) {
-		obs_output_stop(streamOutput);
+		/* flushing a congested connection can take a while */
+		ui->streamButton->setText("Stopping Stream...");
+		ui->streamButton->setEnabled(false);
+		obs_output_stop_async(streamOutput);
 
 	} else {
 		obs_data_t x264Settings = obs_data_create();
@@ -20,6 +20,7 @@
 #include <obs.hpp>
 #include <unordered_map>
 #include <memory>
+#include <string>
 #include "window-main.hpp"
 #include "window-basic-properties.hpp"
 
@@ -42,11 +43,16 @@ private:
 	obs_encoder_t aac;
 	obs_encoder_t x264;
 
+	/* libobs signals are called from here on the UI thread */
+	signal_queue_t signalQueue;
+
 	bool          sceneChanging;
 
 	int           previewX,  previewY;
 	float         previewScale;
 	int           resizeTimer;
+	int           autosaveTimer;
+	std::string   lastSavedScene;
 
 	ConfigFile    basicConfig;
 
@@ -54,6 +60,7 @@ private:
 
 	void          Save(const char *file);
 	void          Load(const char *file);
+	void          AutoSave();
 
 	void          SaveService();
 	bool          LoadService();
@@ -91,6 +98,7 @@ private slots:
 	void AddScene(OBSSource source);
 	void RemoveScene(OBSSource source);
 	void UpdateSceneSelection(OBSSource source);
+	void DispatchSignals();
 
 private:
 	/* OBS Callbacks */
@@ -99,6 +107,7 @@ private:
 	static void SourceAdded(void *data, calldata_t params);
 	static void SourceRemoved(void *data, calldata_t params);
 	static void ChannelChanged(void *data, calldata_t params);
+	static void SignalsQueued(void *data);
 	static void RenderMain(void *data, uint32_t cx, uint32_t cy);
 
 	void ResizePreview(uint32_t cx, uint32_t cy);
@@ -110,6 +119,8 @@ public:
 	obs_service_t GetService();
 	void          SetService(obs_service_t service);
 
+	bool StartResetVideo(bool async);
+	bool FinishResetVideo();
 	bool ResetVideo();
 	bool ResetAudio();
 
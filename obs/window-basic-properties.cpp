@@ -22,6 +22,8 @@
 #include "display-helpers.hpp"
 
 #include <QCloseEvent>
+#include <QShowEvent>
+#include <QHideEvent>
 #include <QScreen>
 #include <QWindow>
 
@@ -52,6 +54,10 @@ OBSBasicProperties::OBSBasicProperties(QWidget *parent, OBSSource source_)
 	view->setMinimumHeight(150);
 	view->show();
 
+	// the preview shows the source, which also creates deferred sources
+	// that aren't in use anywhere else
+	obs_source_activate(source, AUX_VIEW);
+
 	connect(windowHandle(), &QWindow::screenChanged, [this]() {
 		if (resizeTimer)
 			killTimer(resizeTimer);
@@ -59,6 +65,11 @@ OBSBasicProperties::OBSBasicProperties(QWidget *parent, OBSSource source_)
 	});
 }
 
+OBSBasicProperties::~OBSBasicProperties()
+{
+	obs_source_deactivate(source, AUX_VIEW);
+}
+
 void OBSBasicProperties::SourceRemoved(void *data, calldata_t params)
 {
 	QMetaObject::invokeMethod(static_cast<OBSBasicProperties*>(data),
@@ -120,6 +131,31 @@ void OBSBasicProperties::timerEvent(QTimerEvent *event)
 	}
 }
 
+void OBSBasicProperties::UpdateDisplayVisibility()
+{
+	obs_display_set_visible(display, isVisible() && !isMinimized());
+}
+
+void OBSBasicProperties::changeEvent(QEvent *event)
+{
+	QDialog::changeEvent(event);
+
+	if (event->type() == QEvent::WindowStateChange)
+		UpdateDisplayVisibility();
+}
+
+void OBSBasicProperties::showEvent(QShowEvent *event)
+{
+	QDialog::showEvent(event);
+	UpdateDisplayVisibility();
+}
+
+void OBSBasicProperties::hideEvent(QHideEvent *event)
+{
+	QDialog::hideEvent(event);
+	UpdateDisplayVisibility();
+}
+
 void OBSBasicProperties::closeEvent(QCloseEvent *event)
 {
 	QDialog::closeEvent(event);
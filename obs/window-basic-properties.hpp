@@ -44,8 +44,11 @@ private:
 	static void SourceRemoved(void *data, calldata_t params);
 	static void DrawPreview(void *data, uint32_t cx, uint32_t cy);
 
+	void UpdateDisplayVisibility();
+
 public:
 	OBSBasicProperties(QWidget *parent, OBSSource source_);
+	~OBSBasicProperties();
 
 	void Init();
 
@@ -53,4 +56,7 @@ protected:
 	virtual void resizeEvent(QResizeEvent *event) override;
 	virtual void timerEvent(QTimerEvent *event) override;
 	virtual void closeEvent(QCloseEvent *event) override;
+	virtual void changeEvent(QEvent *event) override;
+	virtual void showEvent(QShowEvent *event) override;
+	virtual void hideEvent(QHideEvent *event) override;
 };
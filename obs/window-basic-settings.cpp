@@ -625,8 +625,8 @@ void OBSBasicSettings::SaveSettings()
 	if (videoChanged)
 		SaveVideoSettings();
 
-	config_save(main->Config());
-	config_save(GetGlobalConfig());
+	config_save_async(main->Config());
+	config_save_async(GetGlobalConfig());
 }
 
 bool OBSBasicSettings::QueryChanges()
@@ -0,0 +1,346 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <AudioToolbox/AudioToolbox.h>
+
+#include <util/darray.h>
+#include <obs-module.h>
+
+OBS_DECLARE_MODULE()
+
+/* AAC encoding with the AudioConverter of CoreAudio.  The converter pulls
+ * its input through a callback, so the PCM of each frame is queued and the
+ * callback hands it out until it runs dry, at which point the converter
+ * returns with whatever packets it could finish. */
+
+#define NO_MORE_INPUT 'nmin'
+
+#define ca_log(level, format, ...) \
+	blog(level, "[CoreAudio AAC] " format, ##__VA_ARGS__)
+
+struct ca_encoder {
+	obs_encoder_t       encoder;
+	AudioConverterRef   converter;
+
+	UInt32              channels;
+	UInt32              sample_rate;
+	UInt32              frame_size;
+	UInt32              bytes_per_frame;
+	UInt32              priming_frames;
+
+	DARRAY(uint8_t)     input;
+	size_t              input_offset;
+
+	DARRAY(uint8_t)     packet_buffer;
+	UInt32              max_packet_size;
+	uint64_t            packets_out;
+
+	uint8_t             extra_data[2];
+};
+
+static const char *ca_getname(const char *locale)
+{
+	UNUSED_PARAMETER(locale);
+	return "CoreAudio AAC Encoder";
+}
+
+static inline bool ca_success(OSStatus stat, const char *action)
+{
+	if (stat != noErr) {
+		ca_log(LOG_WARNING, "%s failed: %d", action, (int)stat);
+		return false;
+	}
+
+	return true;
+}
+
+static void ca_destroy(void *data)
+{
+	struct ca_encoder *enc = data;
+
+	if (enc->converter)
+		AudioConverterDispose(enc->converter);
+
+	da_free(enc->input);
+	da_free(enc->packet_buffer);
+	bfree(enc);
+}
+
+static int get_sample_rate_index(UInt32 sample_rate)
+{
+	static const UInt32 rates[] = {
+		96000, 88200, 64000, 48000, 44100, 32000,
+		24000, 22050, 16000, 12000, 11025, 8000
+	};
+
+	for (int i = 0; i < (int)(sizeof(rates) / sizeof(rates[0])); i++) {
+		if (rates[i] == sample_rate)
+			return i;
+	}
+
+	return -1;
+}
+
+/* the AudioSpecificConfig of AAC-LC, which is what the outputs expect as
+ * the header of an AAC track */
+static bool build_extra_data(struct ca_encoder *enc)
+{
+	int index = get_sample_rate_index(enc->sample_rate);
+
+	if (index < 0)
+		return false;
+
+	enc->extra_data[0] = (uint8_t)((2 << 3) | (index >> 1));
+	enc->extra_data[1] = (uint8_t)(((index & 1) << 7) |
+			(enc->channels << 3));
+	return true;
+}
+
+static bool init_converter(struct ca_encoder *enc, UInt32 bitrate)
+{
+	AudioStreamBasicDescription in  = {0};
+	AudioStreamBasicDescription out = {0};
+	AudioConverterPrimeInfo     prime = {0};
+	UInt32 size;
+	OSStatus stat;
+
+	/* interleaved float, which audio_info asks libobs to convert to */
+	in.mSampleRate       = enc->sample_rate;
+	in.mFormatID         = kAudioFormatLinearPCM;
+	in.mFormatFlags      = kAudioFormatFlagIsFloat |
+	                       kAudioFormatFlagIsPacked;
+	in.mChannelsPerFrame = enc->channels;
+	in.mBitsPerChannel   = 32;
+	in.mBytesPerFrame    = enc->bytes_per_frame;
+	in.mFramesPerPacket  = 1;
+	in.mBytesPerPacket   = enc->bytes_per_frame;
+
+	out.mSampleRate       = enc->sample_rate;
+	out.mFormatID         = kAudioFormatMPEG4AAC;
+	out.mChannelsPerFrame = enc->channels;
+	out.mFramesPerPacket  = enc->frame_size;
+
+	stat = AudioConverterNew(&in, &out, &enc->converter);
+	if (!ca_success(stat, "AudioConverterNew"))
+		return false;
+
+	stat = AudioConverterSetProperty(enc->converter,
+			kAudioConverterEncodeBitRate,
+			sizeof(bitrate), &bitrate);
+	if (!ca_success(stat, "set bitrate"))
+		return false;
+
+	size = sizeof(enc->max_packet_size);
+	stat = AudioConverterGetProperty(enc->converter,
+			kAudioConverterPropertyMaximumOutputPacketSize,
+			&size, &enc->max_packet_size);
+	if (!ca_success(stat, "get max packet size"))
+		return false;
+
+	/* the leading frames are the encoder delay, which the timestamps of
+	 * the packets are offset by */
+	size = sizeof(prime);
+	stat = AudioConverterGetProperty(enc->converter,
+			kAudioConverterPrimeInfo, &size, &prime);
+	if (stat == noErr)
+		enc->priming_frames = prime.leadingFrames;
+
+	da_resize(enc->packet_buffer, enc->max_packet_size);
+	return true;
+}
+
+static void *ca_create(obs_data_t settings, obs_encoder_t encoder)
+{
+	struct ca_encoder *enc;
+	UInt32             bitrate = (UInt32)obs_data_getint(settings,
+			"bitrate");
+	audio_t            audio   = obs_encoder_audio(encoder);
+
+	if (!bitrate) {
+		ca_log(LOG_WARNING, "Invalid bitrate specified");
+		return NULL;
+	}
+
+	enc = bzalloc(sizeof(struct ca_encoder));
+	enc->encoder         = encoder;
+	enc->channels        = (UInt32)audio_output_channels(audio);
+	enc->sample_rate     = audio_output_samplerate(audio);
+	enc->frame_size      = 1024;
+	enc->bytes_per_frame = enc->channels * sizeof(float);
+
+	/* the header only describes mono and stereo without a channel map */
+	if (enc->channels > 2) {
+		ca_log(LOG_WARNING, "%u channels are not supported",
+				(unsigned int)enc->channels);
+		goto fail;
+	}
+
+	if (!build_extra_data(enc)) {
+		ca_log(LOG_WARNING, "Sample rate %u is not supported",
+				(unsigned int)enc->sample_rate);
+		goto fail;
+	}
+
+	if (!init_converter(enc, bitrate * 1000))
+		goto fail;
+
+	ca_log(LOG_INFO, "bitrate: %u, channels: %u, sample rate: %u",
+			(unsigned int)bitrate, (unsigned int)enc->channels,
+			(unsigned int)enc->sample_rate);
+	return enc;
+
+fail:
+	ca_destroy(enc);
+	return NULL;
+}
+
+static OSStatus input_data_proc(AudioConverterRef converter,
+		UInt32 *packets, AudioBufferList *buffers,
+		AudioStreamPacketDescription **descs, void *data)
+{
+	struct ca_encoder *enc = data;
+	size_t available = enc->input.num - enc->input_offset;
+	UInt32 frames    = (UInt32)(available / enc->bytes_per_frame);
+
+	if (!frames) {
+		*packets = 0;
+		return NO_MORE_INPUT;
+	}
+
+	if (*packets > frames)
+		*packets = frames;
+
+	buffers->mNumberBuffers              = 1;
+	buffers->mBuffers[0].mNumberChannels = enc->channels;
+	buffers->mBuffers[0].mDataByteSize   = *packets * enc->bytes_per_frame;
+	buffers->mBuffers[0].mData           = enc->input.array +
+		enc->input_offset;
+
+	enc->input_offset += *packets * enc->bytes_per_frame;
+
+	UNUSED_PARAMETER(converter);
+	UNUSED_PARAMETER(descs);
+	return noErr;
+}
+
+static bool ca_encode(void *data, struct encoder_frame *frame,
+		struct encoder_packet *packet, bool *received_packet)
+{
+	struct ca_encoder            *enc = data;
+	AudioBufferList              buffers = {0};
+	AudioStreamPacketDescription desc    = {0};
+	UInt32                       packets = 1;
+	OSStatus                     stat;
+
+	/* whatever the converter didn't take last time stays queued */
+	if (enc->input_offset) {
+		da_erase_range(enc->input, 0, enc->input_offset);
+		enc->input_offset = 0;
+	}
+	da_push_back_array(enc->input, frame->data[0],
+			frame->frames * enc->bytes_per_frame);
+
+	buffers.mNumberBuffers              = 1;
+	buffers.mBuffers[0].mNumberChannels = enc->channels;
+	buffers.mBuffers[0].mDataByteSize   = enc->max_packet_size;
+	buffers.mBuffers[0].mData           = enc->packet_buffer.array;
+
+	stat = AudioConverterFillComplexBuffer(enc->converter,
+			input_data_proc, enc, &packets, &buffers, &desc);
+	if (stat != noErr && stat != NO_MORE_INPUT) {
+		ca_log(LOG_WARNING, "AudioConverterFillComplexBuffer failed: "
+		                    "%d", (int)stat);
+		return false;
+	}
+
+	*received_packet = packets > 0;
+	if (!packets)
+		return true;
+
+	packet->pts  = (int64_t)(enc->packets_out * enc->frame_size) -
+		(int64_t)enc->priming_frames;
+	packet->dts  = packet->pts;
+	packet->data = enc->packet_buffer.array;
+	packet->size = buffers.mBuffers[0].mDataByteSize;
+	packet->type = OBS_ENCODER_AUDIO;
+	packet->timebase_num = 1;
+	packet->timebase_den = (int32_t)enc->sample_rate;
+
+	enc->packets_out++;
+	return true;
+}
+
+static void ca_defaults(obs_data_t settings)
+{
+	obs_data_set_default_int(settings, "bitrate", 128);
+}
+
+static obs_properties_t ca_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_int(props, "bitrate", "Bitrate", 32, 320, 32);
+	return props;
+}
+
+static bool ca_extra_data(void *data, uint8_t **extra_data, size_t *size)
+{
+	struct ca_encoder *enc = data;
+
+	*extra_data = enc->extra_data;
+	*size       = sizeof(enc->extra_data);
+	return true;
+}
+
+static bool ca_audio_info(void *data, struct audio_convert_info *info)
+{
+	UNUSED_PARAMETER(data);
+
+	memset(info, 0, sizeof(struct audio_convert_info));
+	info->format = AUDIO_FORMAT_FLOAT;
+	return true;
+}
+
+static size_t ca_frame_size(void *data)
+{
+	struct ca_encoder *enc = data;
+	return enc->frame_size;
+}
+
+static struct obs_encoder_info ca_encoder_info = {
+	.id         = "CoreAudio_AAC",
+	.type       = OBS_ENCODER_AUDIO,
+	.codec      = "AAC",
+	.getname    = ca_getname,
+	.create     = ca_create,
+	.destroy    = ca_destroy,
+	.encode     = ca_encode,
+	.frame_size = ca_frame_size,
+	.defaults   = ca_defaults,
+	.properties = ca_properties,
+	.extra_data = ca_extra_data,
+	.audio_info = ca_audio_info
+};
+
+bool obs_module_load(uint32_t libobs_version)
+{
+	obs_register_encoder(&ca_encoder_info);
+
+	UNUSED_PARAMETER(libobs_version);
+	return true;
+}
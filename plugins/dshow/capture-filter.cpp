@@ -0,0 +1,649 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "capture-filter.hpp"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define FILTER_NAME  L"Capture Filter"
+#define PIN_NAME     L"Capture Pin"
+
+/* ------------------------------------------------------------------------- */
+
+void MediaTypeCopy(AM_MEDIA_TYPE &dst, const AM_MEDIA_TYPE &src)
+{
+	dst = src;
+
+	if (src.cbFormat) {
+		dst.pbFormat = (BYTE*)CoTaskMemAlloc(src.cbFormat);
+		if (dst.pbFormat)
+			memcpy(dst.pbFormat, src.pbFormat, src.cbFormat);
+		else
+			dst.cbFormat = 0;
+	}
+
+	if (dst.pUnk)
+		dst.pUnk->AddRef();
+}
+
+void MediaTypeFree(AM_MEDIA_TYPE &mt)
+{
+	if (mt.cbFormat)
+		CoTaskMemFree(mt.pbFormat);
+
+	if (mt.pUnk)
+		mt.pUnk->Release();
+
+	mt.cbFormat = 0;
+	mt.pbFormat = nullptr;
+	mt.pUnk     = nullptr;
+}
+
+void MediaTypeDelete(AM_MEDIA_TYPE *mt)
+{
+	if (mt) {
+		MediaTypeFree(*mt);
+		CoTaskMemFree(mt);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+CapturePin::CapturePin(CaptureFilter *filter_, const AM_MEDIA_TYPE &mt_,
+		CaptureCallback callback_, void *param_)
+	: filter       (filter_),
+	  connectedPin (nullptr),
+	  flushing     (false),
+	  callback     (callback_),
+	  param        (param_)
+{
+	MediaTypeCopy(mt, mt_);
+	memset(&connectedMT, 0, sizeof(connectedMT));
+}
+
+CapturePin::~CapturePin()
+{
+	if (connectedPin)
+		connectedPin->Release();
+
+	MediaTypeFree(mt);
+	MediaTypeFree(connectedMT);
+}
+
+/* only the exact format that was negotiated with the device is accepted, so
+ * the graph can never insert a conversion filter ahead of this pin */
+bool CapturePin::IsValidMediaType(const AM_MEDIA_TYPE *pmt) const
+{
+	if (pmt->majortype != mt.majortype)
+		return false;
+	if (mt.subtype != GUID_NULL && pmt->subtype != mt.subtype)
+		return false;
+
+	if (mt.majortype == MEDIATYPE_Video) {
+		const BITMAPINFOHEADER *bih1 = GetBitmapInfoHeader(mt);
+		const BITMAPINFOHEADER *bih2 = GetBitmapInfoHeader(*pmt);
+
+		if (!bih2)
+			return false;
+		if (bih1 && (bih1->biWidth != bih2->biWidth ||
+		             abs(bih1->biHeight) != abs(bih2->biHeight)))
+			return false;
+
+	} else if (mt.majortype == MEDIATYPE_Audio) {
+		const WAVEFORMATEX *wfex1 = GetWaveFormat(mt);
+		const WAVEFORMATEX *wfex2 = GetWaveFormat(*pmt);
+
+		if (!wfex2)
+			return false;
+		if (wfex1 && (wfex1->nChannels      != wfex2->nChannels ||
+		              wfex1->nSamplesPerSec != wfex2->nSamplesPerSec ||
+		              wfex1->wBitsPerSample != wfex2->wBitsPerSample))
+			return false;
+	}
+
+	return true;
+}
+
+STDMETHODIMP CapturePin::QueryInterface(REFIID riid, void **ppv)
+{
+	if (riid == IID_IUnknown || riid == IID_IPin) {
+		AddRef();
+		*ppv = static_cast<IPin*>(this);
+		return S_OK;
+
+	} else if (riid == IID_IMemInputPin) {
+		AddRef();
+		*ppv = static_cast<IMemInputPin*>(this);
+		return S_OK;
+	}
+
+	*ppv = nullptr;
+	return E_NOINTERFACE;
+}
+
+/* the pin lives and dies with its filter */
+STDMETHODIMP_(ULONG) CapturePin::AddRef()
+{
+	return filter->AddRef();
+}
+
+STDMETHODIMP_(ULONG) CapturePin::Release()
+{
+	return filter->Release();
+}
+
+STDMETHODIMP CapturePin::Connect(IPin *pReceivePin, const AM_MEDIA_TYPE *pmt)
+{
+	/* input pins only receive connections */
+	UNREFERENCED_PARAMETER(pReceivePin);
+	UNREFERENCED_PARAMETER(pmt);
+	return E_UNEXPECTED;
+}
+
+STDMETHODIMP CapturePin::ReceiveConnection(IPin *connector,
+		const AM_MEDIA_TYPE *pmt)
+{
+	if (filter->state != State_Stopped)
+		return VFW_E_NOT_STOPPED;
+	if (!connector || !pmt)
+		return E_POINTER;
+	if (connectedPin)
+		return VFW_E_ALREADY_CONNECTED;
+	if (!IsValidMediaType(pmt))
+		return VFW_E_TYPE_NOT_ACCEPTED;
+
+	connectedPin = connector;
+	connectedPin->AddRef();
+
+	MediaTypeFree(connectedMT);
+	MediaTypeCopy(connectedMT, *pmt);
+	return S_OK;
+}
+
+STDMETHODIMP CapturePin::Disconnect()
+{
+	if (!connectedPin)
+		return S_FALSE;
+
+	connectedPin->Release();
+	connectedPin = nullptr;
+	return S_OK;
+}
+
+STDMETHODIMP CapturePin::ConnectedTo(IPin **pPin)
+{
+	if (!connectedPin) {
+		*pPin = nullptr;
+		return VFW_E_NOT_CONNECTED;
+	}
+
+	connectedPin->AddRef();
+	*pPin = connectedPin;
+	return S_OK;
+}
+
+STDMETHODIMP CapturePin::ConnectionMediaType(AM_MEDIA_TYPE *pmt)
+{
+	if (!connectedPin)
+		return VFW_E_NOT_CONNECTED;
+
+	MediaTypeCopy(*pmt, connectedMT);
+	return S_OK;
+}
+
+STDMETHODIMP CapturePin::QueryPinInfo(PIN_INFO *pInfo)
+{
+	pInfo->pFilter = filter;
+	if (filter)
+		filter->AddRef();
+
+	memcpy(pInfo->achName, PIN_NAME, sizeof(PIN_NAME));
+	pInfo->dir = PINDIR_INPUT;
+	return S_OK;
+}
+
+STDMETHODIMP CapturePin::QueryDirection(PIN_DIRECTION *pPinDir)
+{
+	*pPinDir = PINDIR_INPUT;
+	return S_OK;
+}
+
+STDMETHODIMP CapturePin::QueryId(LPWSTR *lpId)
+{
+	*lpId = (LPWSTR)CoTaskMemAlloc(sizeof(PIN_NAME));
+	if (!*lpId)
+		return E_OUTOFMEMORY;
+
+	memcpy(*lpId, PIN_NAME, sizeof(PIN_NAME));
+	return S_OK;
+}
+
+STDMETHODIMP CapturePin::QueryAccept(const AM_MEDIA_TYPE *pmt)
+{
+	return IsValidMediaType(pmt) ? S_OK : S_FALSE;
+}
+
+STDMETHODIMP CapturePin::EnumMediaTypes(IEnumMediaTypes **ppEnum)
+{
+	*ppEnum = new CaptureEnumMediaTypes(this);
+	return S_OK;
+}
+
+STDMETHODIMP CapturePin::QueryInternalConnections(IPin **apPin, ULONG *nPin)
+{
+	UNREFERENCED_PARAMETER(apPin);
+	UNREFERENCED_PARAMETER(nPin);
+	return E_NOTIMPL;
+}
+
+STDMETHODIMP CapturePin::EndOfStream()
+{
+	return S_OK;
+}
+
+STDMETHODIMP CapturePin::BeginFlush()
+{
+	flushing = true;
+	return S_OK;
+}
+
+STDMETHODIMP CapturePin::EndFlush()
+{
+	flushing = false;
+	return S_OK;
+}
+
+STDMETHODIMP CapturePin::NewSegment(REFERENCE_TIME tStart,
+		REFERENCE_TIME tStop, double dRate)
+{
+	UNREFERENCED_PARAMETER(tStart);
+	UNREFERENCED_PARAMETER(tStop);
+	UNREFERENCED_PARAMETER(dRate);
+	return S_OK;
+}
+
+/* the device filter's own allocator is always used, so the buffers the
+ * callback reads are the ones the device wrote into */
+STDMETHODIMP CapturePin::GetAllocator(IMemAllocator **ppAllocator)
+{
+	*ppAllocator = nullptr;
+	return VFW_E_NO_ALLOCATOR;
+}
+
+STDMETHODIMP CapturePin::NotifyAllocator(IMemAllocator *pAllocator,
+		BOOL bReadOnly)
+{
+	UNREFERENCED_PARAMETER(pAllocator);
+	UNREFERENCED_PARAMETER(bReadOnly);
+	return S_OK;
+}
+
+STDMETHODIMP CapturePin::GetAllocatorRequirements(
+		ALLOCATOR_PROPERTIES *pProps)
+{
+	UNREFERENCED_PARAMETER(pProps);
+	return E_NOTIMPL;
+}
+
+STDMETHODIMP CapturePin::Receive(IMediaSample *pSample)
+{
+	AM_MEDIA_TYPE *pmt = nullptr;
+
+	if (flushing)
+		return S_FALSE;
+	if (filter->state == State_Stopped)
+		return VFW_E_WRONG_STATE;
+	if (!pSample)
+		return E_POINTER;
+
+	/* devices may change the buffer layout (such as the stride) on the
+	 * fly, in which case the new type is attached to the sample */
+	if (pSample->GetMediaType(&pmt) == S_OK && pmt) {
+		if (IsValidMediaType(pmt)) {
+			MediaTypeFree(connectedMT);
+			MediaTypeCopy(connectedMT, *pmt);
+		}
+
+		MediaTypeDelete(pmt);
+	}
+
+	callback(param, connectedMT, pSample);
+	return S_OK;
+}
+
+STDMETHODIMP CapturePin::ReceiveMultiple(IMediaSample **pSamples,
+		long nSamples, long *nSamplesProcessed)
+{
+	HRESULT hr = S_OK;
+	long    i;
+
+	for (i = 0; i < nSamples; i++) {
+		hr = Receive(pSamples[i]);
+		if (hr != S_OK)
+			break;
+	}
+
+	*nSamplesProcessed = i;
+	return hr;
+}
+
+STDMETHODIMP CapturePin::ReceiveCanBlock()
+{
+	return S_FALSE;
+}
+
+/* ------------------------------------------------------------------------- */
+
+CaptureFilter::CaptureFilter(const AM_MEDIA_TYPE &mt, CaptureCallback callback,
+		void *param)
+	: refCount (1),
+	  state    (State_Stopped),
+	  graph    (nullptr),
+	  pin      (nullptr)
+{
+	pin = new CapturePin(this, mt, callback, param);
+}
+
+CaptureFilter::~CaptureFilter()
+{
+	delete pin;
+}
+
+STDMETHODIMP CaptureFilter::QueryInterface(REFIID riid, void **ppv)
+{
+	if (riid == IID_IUnknown || riid == IID_IPersist ||
+	    riid == IID_IMediaFilter || riid == IID_IBaseFilter) {
+		AddRef();
+		*ppv = static_cast<IBaseFilter*>(this);
+		return S_OK;
+	}
+
+	*ppv = nullptr;
+	return E_NOINTERFACE;
+}
+
+STDMETHODIMP_(ULONG) CaptureFilter::AddRef()
+{
+	return (ULONG)InterlockedIncrement(&refCount);
+}
+
+STDMETHODIMP_(ULONG) CaptureFilter::Release()
+{
+	long newRefs = InterlockedDecrement(&refCount);
+	if (!newRefs) {
+		delete this;
+		return 0;
+	}
+
+	return (ULONG)newRefs;
+}
+
+STDMETHODIMP CaptureFilter::GetClassID(CLSID *pClsID)
+{
+	UNREFERENCED_PARAMETER(pClsID);
+	return E_NOTIMPL;
+}
+
+STDMETHODIMP CaptureFilter::GetState(DWORD dwMSecs, FILTER_STATE *State)
+{
+	UNREFERENCED_PARAMETER(dwMSecs);
+	*State = state;
+	return S_OK;
+}
+
+STDMETHODIMP CaptureFilter::SetSyncSource(IReferenceClock *pClock)
+{
+	UNREFERENCED_PARAMETER(pClock);
+	return S_OK;
+}
+
+STDMETHODIMP CaptureFilter::GetSyncSource(IReferenceClock **pClock)
+{
+	*pClock = nullptr;
+	return S_OK;
+}
+
+STDMETHODIMP CaptureFilter::Stop()
+{
+	state = State_Stopped;
+	return S_OK;
+}
+
+STDMETHODIMP CaptureFilter::Pause()
+{
+	state = State_Paused;
+	return S_OK;
+}
+
+STDMETHODIMP CaptureFilter::Run(REFERENCE_TIME tStart)
+{
+	UNREFERENCED_PARAMETER(tStart);
+	state = State_Running;
+	return S_OK;
+}
+
+STDMETHODIMP CaptureFilter::EnumPins(IEnumPins **ppEnum)
+{
+	*ppEnum = new CaptureEnumPins(this, nullptr);
+	return S_OK;
+}
+
+STDMETHODIMP CaptureFilter::FindPin(LPCWSTR Id, IPin **ppPin)
+{
+	if (wcscmp(Id, PIN_NAME) != 0) {
+		*ppPin = nullptr;
+		return VFW_E_NOT_FOUND;
+	}
+
+	pin->AddRef();
+	*ppPin = pin;
+	return S_OK;
+}
+
+STDMETHODIMP CaptureFilter::QueryFilterInfo(FILTER_INFO *pInfo)
+{
+	memcpy(pInfo->achName, FILTER_NAME, sizeof(FILTER_NAME));
+
+	pInfo->pGraph = graph;
+	if (graph)
+		graph->AddRef();
+	return S_OK;
+}
+
+/* the graph owns its filters, so it must not be referenced back */
+STDMETHODIMP CaptureFilter::JoinFilterGraph(IFilterGraph *pGraph,
+		LPCWSTR pName)
+{
+	UNREFERENCED_PARAMETER(pName);
+	graph = pGraph;
+	return S_OK;
+}
+
+STDMETHODIMP CaptureFilter::QueryVendorInfo(LPWSTR *pVendorInfo)
+{
+	UNREFERENCED_PARAMETER(pVendorInfo);
+	return E_NOTIMPL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+CaptureEnumPins::CaptureEnumPins(CaptureFilter *filter_,
+		CaptureEnumPins *pEnum)
+	: refCount (1),
+	  filter   (filter_),
+	  curPin   (pEnum ? pEnum->curPin : 0)
+{
+	filter->AddRef();
+}
+
+CaptureEnumPins::~CaptureEnumPins()
+{
+	filter->Release();
+}
+
+STDMETHODIMP CaptureEnumPins::QueryInterface(REFIID riid, void **ppv)
+{
+	if (riid == IID_IUnknown || riid == IID_IEnumPins) {
+		AddRef();
+		*ppv = static_cast<IEnumPins*>(this);
+		return S_OK;
+	}
+
+	*ppv = nullptr;
+	return E_NOINTERFACE;
+}
+
+STDMETHODIMP_(ULONG) CaptureEnumPins::AddRef()
+{
+	return (ULONG)InterlockedIncrement(&refCount);
+}
+
+STDMETHODIMP_(ULONG) CaptureEnumPins::Release()
+{
+	long newRefs = InterlockedDecrement(&refCount);
+	if (!newRefs) {
+		delete this;
+		return 0;
+	}
+
+	return (ULONG)newRefs;
+}
+
+STDMETHODIMP CaptureEnumPins::Next(ULONG cPins, IPin **ppPins,
+		ULONG *pcFetched)
+{
+	UINT nFetched = 0;
+
+	if (curPin == 0 && cPins > 0) {
+		IPin *pin = filter->GetPin();
+		pin->AddRef();
+		*ppPins = pin;
+		nFetched = 1;
+		curPin++;
+	}
+
+	if (pcFetched)
+		*pcFetched = nFetched;
+
+	return (nFetched == cPins) ? S_OK : S_FALSE;
+}
+
+STDMETHODIMP CaptureEnumPins::Skip(ULONG cPins)
+{
+	curPin += cPins;
+	return (curPin > 1) ? S_FALSE : S_OK;
+}
+
+STDMETHODIMP CaptureEnumPins::Reset()
+{
+	curPin = 0;
+	return S_OK;
+}
+
+STDMETHODIMP CaptureEnumPins::Clone(IEnumPins **ppEnum)
+{
+	*ppEnum = new CaptureEnumPins(filter, this);
+	return S_OK;
+}
+
+/* ------------------------------------------------------------------------- */
+
+CaptureEnumMediaTypes::CaptureEnumMediaTypes(CapturePin *pin_)
+	: refCount (1),
+	  pin      (pin_),
+	  curType  (0)
+{
+	pin->AddRef();
+}
+
+CaptureEnumMediaTypes::~CaptureEnumMediaTypes()
+{
+	pin->Release();
+}
+
+STDMETHODIMP CaptureEnumMediaTypes::QueryInterface(REFIID riid, void **ppv)
+{
+	if (riid == IID_IUnknown || riid == IID_IEnumMediaTypes) {
+		AddRef();
+		*ppv = static_cast<IEnumMediaTypes*>(this);
+		return S_OK;
+	}
+
+	*ppv = nullptr;
+	return E_NOINTERFACE;
+}
+
+STDMETHODIMP_(ULONG) CaptureEnumMediaTypes::AddRef()
+{
+	return (ULONG)InterlockedIncrement(&refCount);
+}
+
+STDMETHODIMP_(ULONG) CaptureEnumMediaTypes::Release()
+{
+	long newRefs = InterlockedDecrement(&refCount);
+	if (!newRefs) {
+		delete this;
+		return 0;
+	}
+
+	return (ULONG)newRefs;
+}
+
+STDMETHODIMP CaptureEnumMediaTypes::Next(ULONG cMediaTypes,
+		AM_MEDIA_TYPE **ppMediaTypes, ULONG *pcFetched)
+{
+	UINT nFetched = 0;
+
+	if (curType == 0 && cMediaTypes > 0) {
+		AM_MEDIA_TYPE *pmt = (AM_MEDIA_TYPE*)CoTaskMemAlloc(
+				sizeof(AM_MEDIA_TYPE));
+		if (!pmt)
+			return E_OUTOFMEMORY;
+
+		MediaTypeCopy(*pmt, pin->mt);
+		*ppMediaTypes = pmt;
+		nFetched = 1;
+		curType++;
+	}
+
+	if (pcFetched)
+		*pcFetched = nFetched;
+
+	return (nFetched == cMediaTypes) ? S_OK : S_FALSE;
+}
+
+STDMETHODIMP CaptureEnumMediaTypes::Skip(ULONG cMediaTypes)
+{
+	curType += cMediaTypes;
+	return (curType > 1) ? S_FALSE : S_OK;
+}
+
+STDMETHODIMP CaptureEnumMediaTypes::Reset()
+{
+	curType = 0;
+	return S_OK;
+}
+
+STDMETHODIMP CaptureEnumMediaTypes::Clone(IEnumMediaTypes **ppEnum)
+{
+	CaptureEnumMediaTypes *enumTypes = new CaptureEnumMediaTypes(pin);
+	enumTypes->curType = curType;
+
+	*ppEnum = enumTypes;
+	return S_OK;
+}
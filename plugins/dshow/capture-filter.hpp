@@ -0,0 +1,209 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <dshow.h>
+#include <dvdmedia.h>
+
+/*
+ * Minimal renderer filter that terminates a capture stream.
+ *
+ * Its single input pin only accepts the media type it was created with, so
+ * when it's connected directly to a device pin the graph can't insert any
+ * color converters or decoders between the two.  Each sample is handed to
+ * the callback on the device's streaming thread while the sample buffer is
+ * still locked, so the data can be read in place without being copied to an
+ * intermediate buffer first the way the stock sample grabber does.
+ */
+
+typedef void (*CaptureCallback)(void *param, const AM_MEDIA_TYPE &mt,
+		IMediaSample *sample);
+
+void MediaTypeCopy(AM_MEDIA_TYPE &dst, const AM_MEDIA_TYPE &src);
+void MediaTypeFree(AM_MEDIA_TYPE &mt);
+void MediaTypeDelete(AM_MEDIA_TYPE *mt);
+
+static inline BITMAPINFOHEADER *GetBitmapInfoHeader(const AM_MEDIA_TYPE &mt)
+{
+	if (mt.formattype == FORMAT_VideoInfo &&
+	    mt.cbFormat >= sizeof(VIDEOINFOHEADER))
+		return &((VIDEOINFOHEADER*)mt.pbFormat)->bmiHeader;
+
+	if (mt.formattype == FORMAT_VideoInfo2 &&
+	    mt.cbFormat >= sizeof(VIDEOINFOHEADER2))
+		return &((VIDEOINFOHEADER2*)mt.pbFormat)->bmiHeader;
+
+	return nullptr;
+}
+
+/* both video info headers start with the same members, so the frame
+ * interval is at the same place in either of them */
+static inline REFERENCE_TIME *GetFrameInterval(const AM_MEDIA_TYPE &mt)
+{
+	if (!GetBitmapInfoHeader(mt))
+		return nullptr;
+
+	return &((VIDEOINFOHEADER*)mt.pbFormat)->AvgTimePerFrame;
+}
+
+static inline WAVEFORMATEX *GetWaveFormat(const AM_MEDIA_TYPE &mt)
+{
+	if (mt.formattype == FORMAT_WaveFormatEx &&
+	    mt.cbFormat >= sizeof(WAVEFORMATEX))
+		return (WAVEFORMATEX*)mt.pbFormat;
+
+	return nullptr;
+}
+
+class CaptureFilter;
+
+class CapturePin : public IPin, public IMemInputPin {
+	friend class CaptureEnumMediaTypes;
+
+	CaptureFilter          *filter;
+	AM_MEDIA_TYPE          mt;
+	AM_MEDIA_TYPE          connectedMT;
+	IPin                   *connectedPin;
+	bool                   flushing;
+
+	CaptureCallback        callback;
+	void                   *param;
+
+	bool IsValidMediaType(const AM_MEDIA_TYPE *pmt) const;
+
+public:
+	CapturePin(CaptureFilter *filter, const AM_MEDIA_TYPE &mt,
+			CaptureCallback callback, void *param);
+	virtual ~CapturePin();
+
+	/* IUnknown */
+	STDMETHODIMP QueryInterface(REFIID riid, void **ppv);
+	STDMETHODIMP_(ULONG) AddRef();
+	STDMETHODIMP_(ULONG) Release();
+
+	/* IPin */
+	STDMETHODIMP Connect(IPin *pReceivePin, const AM_MEDIA_TYPE *pmt);
+	STDMETHODIMP ReceiveConnection(IPin *connector,
+			const AM_MEDIA_TYPE *pmt);
+	STDMETHODIMP Disconnect();
+	STDMETHODIMP ConnectedTo(IPin **pPin);
+	STDMETHODIMP ConnectionMediaType(AM_MEDIA_TYPE *pmt);
+	STDMETHODIMP QueryPinInfo(PIN_INFO *pInfo);
+	STDMETHODIMP QueryDirection(PIN_DIRECTION *pPinDir);
+	STDMETHODIMP QueryId(LPWSTR *lpId);
+	STDMETHODIMP QueryAccept(const AM_MEDIA_TYPE *pmt);
+	STDMETHODIMP EnumMediaTypes(IEnumMediaTypes **ppEnum);
+	STDMETHODIMP QueryInternalConnections(IPin **apPin, ULONG *nPin);
+	STDMETHODIMP EndOfStream();
+	STDMETHODIMP BeginFlush();
+	STDMETHODIMP EndFlush();
+	STDMETHODIMP NewSegment(REFERENCE_TIME tStart, REFERENCE_TIME tStop,
+			double dRate);
+
+	/* IMemInputPin */
+	STDMETHODIMP GetAllocator(IMemAllocator **ppAllocator);
+	STDMETHODIMP NotifyAllocator(IMemAllocator *pAllocator,
+			BOOL bReadOnly);
+	STDMETHODIMP GetAllocatorRequirements(ALLOCATOR_PROPERTIES *pProps);
+	STDMETHODIMP Receive(IMediaSample *pSample);
+	STDMETHODIMP ReceiveMultiple(IMediaSample **pSamples, long nSamples,
+			long *nSamplesProcessed);
+	STDMETHODIMP ReceiveCanBlock();
+};
+
+class CaptureFilter : public IBaseFilter {
+	friend class CapturePin;
+
+	volatile long          refCount;
+	FILTER_STATE           state;
+	IFilterGraph           *graph;
+	CapturePin             *pin;
+
+public:
+	CaptureFilter(const AM_MEDIA_TYPE &mt, CaptureCallback callback,
+			void *param);
+	virtual ~CaptureFilter();
+
+	/* IUnknown */
+	STDMETHODIMP QueryInterface(REFIID riid, void **ppv);
+	STDMETHODIMP_(ULONG) AddRef();
+	STDMETHODIMP_(ULONG) Release();
+
+	/* IPersist */
+	STDMETHODIMP GetClassID(CLSID *pClsID);
+
+	/* IMediaFilter */
+	STDMETHODIMP GetState(DWORD dwMSecs, FILTER_STATE *State);
+	STDMETHODIMP SetSyncSource(IReferenceClock *pClock);
+	STDMETHODIMP GetSyncSource(IReferenceClock **pClock);
+	STDMETHODIMP Stop();
+	STDMETHODIMP Pause();
+	STDMETHODIMP Run(REFERENCE_TIME tStart);
+
+	/* IBaseFilter */
+	STDMETHODIMP EnumPins(IEnumPins **ppEnum);
+	STDMETHODIMP FindPin(LPCWSTR Id, IPin **ppPin);
+	STDMETHODIMP QueryFilterInfo(FILTER_INFO *pInfo);
+	STDMETHODIMP JoinFilterGraph(IFilterGraph *pGraph, LPCWSTR pName);
+	STDMETHODIMP QueryVendorInfo(LPWSTR *pVendorInfo);
+
+	inline IPin *GetPin() const {return pin;}
+};
+
+class CaptureEnumPins : public IEnumPins {
+	volatile long          refCount;
+	CaptureFilter          *filter;
+	UINT                   curPin;
+
+public:
+	CaptureEnumPins(CaptureFilter *filter, CaptureEnumPins *pEnum);
+	virtual ~CaptureEnumPins();
+
+	/* IUnknown */
+	STDMETHODIMP QueryInterface(REFIID riid, void **ppv);
+	STDMETHODIMP_(ULONG) AddRef();
+	STDMETHODIMP_(ULONG) Release();
+
+	/* IEnumPins */
+	STDMETHODIMP Next(ULONG cPins, IPin **ppPins, ULONG *pcFetched);
+	STDMETHODIMP Skip(ULONG cPins);
+	STDMETHODIMP Reset();
+	STDMETHODIMP Clone(IEnumPins **ppEnum);
+};
+
+class CaptureEnumMediaTypes : public IEnumMediaTypes {
+	volatile long          refCount;
+	CapturePin             *pin;
+	UINT                   curType;
+
+public:
+	CaptureEnumMediaTypes(CapturePin *pin);
+	virtual ~CaptureEnumMediaTypes();
+
+	/* IUnknown */
+	STDMETHODIMP QueryInterface(REFIID riid, void **ppv);
+	STDMETHODIMP_(ULONG) AddRef();
+	STDMETHODIMP_(ULONG) Release();
+
+	/* IEnumMediaTypes */
+	STDMETHODIMP Next(ULONG cMediaTypes, AM_MEDIA_TYPE **ppMediaTypes,
+			ULONG *pcFetched);
+	STDMETHODIMP Skip(ULONG cMediaTypes);
+	STDMETHODIMP Reset();
+	STDMETHODIMP Clone(IEnumMediaTypes **ppEnum);
+};
@@ -0,0 +1,249 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "dshow-enum.hpp"
+
+#include <util/platform.h>
+#include <util/windows/ComPtr.hpp>
+
+using namespace std;
+
+/* subtypes without a named guid in the sdk use the fourcc as the first
+ * member of this base guid */
+static inline bool IsFourCC(const GUID &subtype, DWORD fourcc)
+{
+	static const GUID base = {0x00000000, 0x0000, 0x0010,
+		{0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71}};
+
+	return subtype.Data1 == fourcc &&
+	       subtype.Data2 == base.Data2 &&
+	       subtype.Data3 == base.Data3 &&
+	       memcmp(subtype.Data4, base.Data4, sizeof(base.Data4)) == 0;
+}
+
+video_format ConvertVideoFormat(const GUID &subtype)
+{
+	if (subtype == MEDIASUBTYPE_RGB32)
+		return VIDEO_FORMAT_BGRX;
+	if (subtype == MEDIASUBTYPE_ARGB32)
+		return VIDEO_FORMAT_BGRA;
+
+	if (IsFourCC(subtype, MAKEFOURCC('Y','U','Y','2')) ||
+	    IsFourCC(subtype, MAKEFOURCC('Y','U','Y','V')) ||
+	    IsFourCC(subtype, MAKEFOURCC('Y','U','N','V')))
+		return VIDEO_FORMAT_YUY2;
+
+	if (IsFourCC(subtype, MAKEFOURCC('U','Y','V','Y')) ||
+	    IsFourCC(subtype, MAKEFOURCC('H','D','Y','C')) ||
+	    IsFourCC(subtype, MAKEFOURCC('U','Y','N','V')))
+		return VIDEO_FORMAT_UYVY;
+
+	if (IsFourCC(subtype, MAKEFOURCC('Y','V','Y','U')))
+		return VIDEO_FORMAT_YVYU;
+
+	if (IsFourCC(subtype, MAKEFOURCC('N','V','1','2')))
+		return VIDEO_FORMAT_NV12;
+
+	if (IsFourCC(subtype, MAKEFOURCC('I','4','2','0')) ||
+	    IsFourCC(subtype, MAKEFOURCC('I','Y','U','V')))
+		return VIDEO_FORMAT_I420;
+
+	return VIDEO_FORMAT_NONE;
+}
+
+static string ReadProperty(IPropertyBag *bag, const wchar_t *name)
+{
+	string  str;
+	VARIANT var;
+
+	VariantInit(&var);
+
+	if (SUCCEEDED(bag->Read(name, &var, nullptr)) && var.vt == VT_BSTR) {
+		char *utf8 = nullptr;
+		os_wcs_to_utf8_ptr(var.bstrVal, 0, &utf8);
+		if (utf8)
+			str = utf8;
+		bfree(utf8);
+	}
+
+	VariantClear(&var);
+	return str;
+}
+
+/*
+ * Calls the callback for each device in the category until it returns false.
+ * The device path is used as the id so that several identical capture cards
+ * can be told apart; devices without one fall back to their name.
+ */
+template<typename F>
+static bool EnumDeviceMonikers(const GUID &category, F callback)
+{
+	ComPtr<ICreateDevEnum> deviceEnum;
+	ComPtr<IEnumMoniker>   enumMoniker;
+	ComPtr<IMoniker>       moniker;
+	HRESULT                hr;
+
+	hr = CoCreateInstance(CLSID_SystemDeviceEnum, nullptr,
+			CLSCTX_INPROC_SERVER, IID_ICreateDevEnum,
+			(void**)deviceEnum.Assign());
+	if (FAILED(hr)) {
+		blog(LOG_WARNING, "EnumDeviceMonikers: Failed to create "
+		                  "the device enumerator: 0x%lX", hr);
+		return false;
+	}
+
+	/* S_FALSE means there are no devices in the category */
+	hr = deviceEnum->CreateClassEnumerator(category,
+			enumMoniker.Assign(), 0);
+	if (hr != S_OK)
+		return hr == S_FALSE;
+
+	while (enumMoniker->Next(1, moniker.Assign(), nullptr) == S_OK) {
+		ComPtr<IPropertyBag> bag;
+		DeviceInfo           info;
+
+		hr = moniker->BindToStorage(nullptr, nullptr, IID_IPropertyBag,
+				(void**)bag.Assign());
+		if (FAILED(hr))
+			continue;
+
+		info.name = ReadProperty(bag, L"FriendlyName");
+		info.id   = ReadProperty(bag, L"DevicePath");
+		if (info.id.empty())
+			info.id = info.name;
+
+		if (!info.name.empty() && !callback(info, moniker.Get()))
+			break;
+	}
+
+	return true;
+}
+
+bool EnumDevices(const GUID &category, vector<DeviceInfo> &devices)
+{
+	return EnumDeviceMonikers(category,
+		[&] (const DeviceInfo &info, IMoniker*)
+		{
+			devices.push_back(info);
+			return true;
+		});
+}
+
+bool GetDeviceFilter(const GUID &category, const char *id,
+		IBaseFilter **filter)
+{
+	bool found = false;
+
+	*filter = nullptr;
+
+	EnumDeviceMonikers(category,
+		[&] (const DeviceInfo &info, IMoniker *moniker)
+		{
+			if (info.id != id)
+				return true;
+
+			HRESULT hr = moniker->BindToObject(nullptr, nullptr,
+					IID_IBaseFilter, (void**)filter);
+			if (FAILED(hr))
+				blog(LOG_WARNING, "GetDeviceFilter: Failed to "
+				                  "bind device '%s': 0x%lX",
+				                  info.name.c_str(), hr);
+
+			found = SUCCEEDED(hr);
+			return false;
+		});
+
+	return found;
+}
+
+static void AddVideoCap(VideoCaps &caps, AM_MEDIA_TYPE *mt,
+		long long minInterval, long long maxInterval)
+{
+	BITMAPINFOHEADER *bih   = GetBitmapInfoHeader(*mt);
+	video_format     format = ConvertVideoFormat(mt->subtype);
+
+	if (!bih || format == VIDEO_FORMAT_NONE) {
+		MediaTypeDelete(mt);
+		return;
+	}
+
+	VideoInfo info;
+	info.mt          = mt;
+	info.format      = format;
+	info.cx          = bih->biWidth;
+	info.cy          = labs(bih->biHeight);
+	info.minInterval = minInterval;
+	info.maxInterval = maxInterval;
+	caps.list.push_back(info);
+}
+
+static void EnumStreamCaps(IAMStreamConfig *config, VideoCaps &caps)
+{
+	int count, size;
+
+	if (FAILED(config->GetNumberOfCapabilities(&count, &size)))
+		return;
+	if (size != sizeof(VIDEO_STREAM_CONFIG_CAPS))
+		return;
+
+	for (int i = 0; i < count; i++) {
+		VIDEO_STREAM_CONFIG_CAPS vscc;
+		AM_MEDIA_TYPE            *mt;
+
+		if (FAILED(config->GetStreamCaps(i, &mt, (BYTE*)&vscc)))
+			continue;
+
+		AddVideoCap(caps, mt, vscc.MinFrameInterval,
+				vscc.MaxFrameInterval);
+	}
+}
+
+/* for pins without IAMStreamConfig, only the listed types are available */
+static void EnumPinMediaTypes(IPin *pin, VideoCaps &caps)
+{
+	ComPtr<IEnumMediaTypes> enumTypes;
+	AM_MEDIA_TYPE           *mt;
+
+	if (FAILED(pin->EnumMediaTypes(enumTypes.Assign())))
+		return;
+
+	while (enumTypes->Next(1, &mt, nullptr) == S_OK) {
+		REFERENCE_TIME *interval = GetFrameInterval(*mt);
+		long long      time      = interval ? *interval : 0;
+
+		AddVideoCap(caps, mt, time, time);
+	}
+}
+
+void EnumVideoCaps(ICaptureGraphBuilder2 *capture, IBaseFilter *filter,
+		VideoCaps &caps)
+{
+	ComPtr<IPin>            pin;
+	ComPtr<IAMStreamConfig> config;
+	HRESULT                 hr;
+
+	hr = capture->FindPin(filter, PINDIR_OUTPUT, &PIN_CATEGORY_CAPTURE,
+			&MEDIATYPE_Video, false, 0, pin.Assign());
+	if (FAILED(hr))
+		return;
+
+	hr = pin->QueryInterface(IID_IAMStreamConfig, (void**)config.Assign());
+	if (SUCCEEDED(hr))
+		EnumStreamCaps(config, caps);
+	else
+		EnumPinMediaTypes(pin, caps);
+}
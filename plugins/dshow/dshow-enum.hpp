@@ -0,0 +1,63 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs.h>
+
+#include <string>
+#include <vector>
+
+#include "capture-filter.hpp"
+
+struct DeviceInfo {
+	std::string                   name;
+	std::string                   id;
+};
+
+/* a format the device can output without any conversion filter */
+struct VideoInfo {
+	AM_MEDIA_TYPE                 *mt;
+	video_format                  format;
+	long                          cx;
+	long                          cy;
+	long long                     minInterval;
+	long long                     maxInterval;
+};
+
+class VideoCaps {
+	VideoCaps(const VideoCaps&);
+	VideoCaps &operator=(const VideoCaps&);
+
+public:
+	std::vector<VideoInfo>        list;
+
+	inline VideoCaps() {}
+	inline ~VideoCaps()
+	{
+		for (size_t i = 0; i < list.size(); i++)
+			MediaTypeDelete(list[i].mt);
+	}
+};
+
+video_format ConvertVideoFormat(const GUID &subtype);
+
+bool EnumDevices(const GUID &category, std::vector<DeviceInfo> &devices);
+bool GetDeviceFilter(const GUID &category, const char *id,
+		IBaseFilter **filter);
+void EnumVideoCaps(ICaptureGraphBuilder2 *capture, IBaseFilter *filter,
+		VideoCaps &caps);
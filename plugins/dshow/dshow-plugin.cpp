@@ -0,0 +1,747 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-module.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/windows/HRError.hpp>
+
+#include "dshow-plugin.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+OBS_DECLARE_MODULE()
+
+#define VIDEO_DEVICE_ID   "video_device_id"
+#define RESOLUTION        "resolution"
+#define FRAME_INTERVAL    "frame_interval"
+#define AUDIO_DEVICE_ID   "audio_device_id"
+
+/* most capture cards provide their audio on a pin of the video filter */
+#define AUDIO_FROM_VIDEO  "video"
+
+/* ------------------------------------------------------------------------- */
+
+/*
+ * Packed 4:2:2 frames are uploaded as-is and converted by the async texture
+ * shader, so they're preferred over the planar formats, which are still
+ * unpacked on the CPU.  RGB is only used when nothing else is offered.
+ */
+static int GetFormatPriority(video_format format)
+{
+	switch (format) {
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+	case VIDEO_FORMAT_YVYU:
+		return 0;
+
+	case VIDEO_FORMAT_NV12:
+		return 1;
+	case VIDEO_FORMAT_I420:
+		return 2;
+
+	case VIDEO_FORMAT_BGRX:
+	case VIDEO_FORMAT_BGRA:
+		return 3;
+
+	case VIDEO_FORMAT_NONE:
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_I422:
+		break;
+	}
+
+	return 4;
+}
+
+static const char *GetFormatName(video_format format)
+{
+	switch (format) {
+	case VIDEO_FORMAT_YUY2: return "YUY2";
+	case VIDEO_FORMAT_UYVY: return "UYVY";
+	case VIDEO_FORMAT_YVYU: return "YVYU";
+	case VIDEO_FORMAT_NV12: return "NV12";
+	case VIDEO_FORMAT_I420: return "I420";
+	case VIDEO_FORMAT_BGRX: return "RGB32";
+	case VIDEO_FORMAT_BGRA: return "ARGB32";
+	case VIDEO_FORMAT_NONE:
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_I422:
+		break;
+	}
+
+	return "unknown";
+}
+
+static bool IsBetterCap(const VideoInfo &cap, const VideoInfo &best)
+{
+	long long area     = (long long)cap.cx  * (long long)cap.cy;
+	long long bestArea = (long long)best.cx * (long long)best.cy;
+
+	if (area != bestArea)
+		return area > bestArea;
+	if (cap.minInterval != best.minInterval)
+		return cap.minInterval < best.minInterval;
+
+	return GetFormatPriority(cap.format) < GetFormatPriority(best.format);
+}
+
+/* a zero size or interval means 'highest' */
+static const VideoInfo *FindBestCap(const VideoCaps &caps, long cx, long cy,
+		long long interval)
+{
+	const VideoInfo *best = nullptr;
+
+	for (size_t i = 0; i < caps.list.size(); i++) {
+		const VideoInfo &cap = caps.list[i];
+
+		if (cx && (cap.cx != cx || cap.cy != cy))
+			continue;
+		if (interval && (interval < cap.minInterval ||
+		                 interval > cap.maxInterval))
+			continue;
+
+		if (!best || IsBetterCap(cap, *best))
+			best = &cap;
+	}
+
+	return best;
+}
+
+static bool ParseResolution(const char *res, long &cx, long &cy)
+{
+	cx = cy = 0;
+	return res && *res && sscanf(res, "%ldx%ld", &cx, &cy) == 2;
+}
+
+static int ScoreAudioFormat(const WAVEFORMATEX *wfex)
+{
+	int score = 0;
+
+	if (!wfex || wfex->wFormatTag != WAVE_FORMAT_PCM)
+		return -1;
+	if (wfex->wBitsPerSample != 8 &&
+	    wfex->wBitsPerSample != 16 &&
+	    wfex->wBitsPerSample != 32)
+		return -1;
+
+	if (wfex->wBitsPerSample == 16) score += 4;
+	if (wfex->nSamplesPerSec == 48000) score += 2;
+	if (wfex->nChannels == 2) score += 1;
+	return score;
+}
+
+static bool GetAudioMediaType(IPin *pin, AM_MEDIA_TYPE **best)
+{
+	ComPtr<IEnumMediaTypes> enumTypes;
+	AM_MEDIA_TYPE           *mt;
+	int                     bestScore = -1;
+
+	*best = nullptr;
+
+	if (FAILED(pin->EnumMediaTypes(enumTypes.Assign())))
+		return false;
+
+	while (enumTypes->Next(1, &mt, nullptr) == S_OK) {
+		int score = ScoreAudioFormat(GetWaveFormat(*mt));
+
+		if (score > bestScore) {
+			MediaTypeDelete(*best);
+			*best = mt;
+			bestScore = score;
+		} else {
+			MediaTypeDelete(mt);
+		}
+	}
+
+	return *best != nullptr;
+}
+
+static inline audio_format ConvertAudioFormat(WORD bits)
+{
+	switch (bits) {
+	case 8:  return AUDIO_FORMAT_U8BIT;
+	case 16: return AUDIO_FORMAT_16BIT;
+	case 32: return AUDIO_FORMAT_32BIT;
+	}
+
+	return AUDIO_FORMAT_UNKNOWN;
+}
+
+/* ------------------------------------------------------------------------- */
+
+DShowSource::DShowSource(obs_data_t settings, obs_source_t source_)
+	: source      (source_),
+	  active      (false),
+	  startTime   (0),
+	  videoFormat (VIDEO_FORMAT_NONE),
+	  audioFormat (AUDIO_FORMAT_UNKNOWN),
+	  speakers    (SPEAKERS_UNKNOWN),
+	  sampleRate  (0),
+	  blockSize   (0)
+{
+	memset(&frame, 0, sizeof(frame));
+	Initialize(settings);
+}
+
+DShowSource::~DShowSource()
+{
+	Stop();
+}
+
+void DShowSource::InitGraph()
+{
+	HRESULT hr;
+
+	hr = CoCreateInstance(CLSID_FilterGraph, nullptr,
+			CLSCTX_INPROC_SERVER, IID_IGraphBuilder,
+			(void**)graph.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to create the filter graph", hr);
+
+	hr = CoCreateInstance(CLSID_CaptureGraphBuilder2, nullptr,
+			CLSCTX_INPROC_SERVER, IID_ICaptureGraphBuilder2,
+			(void**)capture.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to create the capture graph builder", hr);
+
+	hr = capture->SetFiltergraph(graph);
+	if (FAILED(hr))
+		throw HRError("Failed to set the capture filter graph", hr);
+
+	hr = graph->QueryInterface(IID_IMediaControl,
+			(void**)control.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to get the media control", hr);
+}
+
+/*
+ * Picks the best format the device can output natively and connects the
+ * device pin straight to our filter with it, so that no converter is ever
+ * inserted and the device's buffers end up in libobs as they are.
+ */
+void DShowSource::InitVideo(obs_data_t settings)
+{
+	const char      *id       = obs_data_getstring(settings,
+			VIDEO_DEVICE_ID);
+	const char      *res      = obs_data_getstring(settings, RESOLUTION);
+	long long       interval  = obs_data_getint(settings, FRAME_INTERVAL);
+	VideoCaps       caps;
+	const VideoInfo *cap;
+	ComPtr<IPin>    pin;
+	ComPtr<IAMStreamConfig> config;
+	AM_MEDIA_TYPE   mt;
+	long            cx, cy;
+	HRESULT         hr;
+
+	if (!id || !*id)
+		throw "No video device selected";
+	if (!GetDeviceFilter(CLSID_VideoInputDeviceCategory, id,
+				videoFilter.Assign()))
+		throw "Video device not found";
+
+	hr = graph->AddFilter(videoFilter, L"Video Device");
+	if (FAILED(hr))
+		throw HRError("Failed to add the video device filter", hr);
+
+	hr = capture->FindPin(videoFilter, PINDIR_OUTPUT,
+			&PIN_CATEGORY_CAPTURE, &MEDIATYPE_Video, false, 0,
+			pin.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to find the video capture pin", hr);
+
+	EnumVideoCaps(capture, videoFilter, caps);
+
+	ParseResolution(res, cx, cy);
+	cap = FindBestCap(caps, cx, cy, interval);
+
+	/* fall back to the device's best format if the saved one is gone */
+	if (!cap && (cx || interval))
+		cap = FindBestCap(caps, 0, 0, 0);
+	if (!cap)
+		throw "The device has no formats that can be used without "
+		      "conversion";
+
+	MediaTypeCopy(mt, *cap->mt);
+
+	REFERENCE_TIME *frameInterval = GetFrameInterval(mt);
+	if (frameInterval)
+		*frameInterval = (interval >= cap->minInterval &&
+		                  interval <= cap->maxInterval) ?
+			interval : cap->minInterval;
+
+	hr = pin->QueryInterface(IID_IAMStreamConfig, (void**)config.Assign());
+	if (SUCCEEDED(hr)) {
+		hr = config->SetFormat(&mt);
+		if (FAILED(hr))
+			blog(LOG_WARNING, "DShowSource: Failed to set the "
+			                  "video format: 0x%lX", hr);
+	}
+
+	videoCapture.Set(new CaptureFilter(mt, ReceiveVideo, this));
+
+	hr = graph->AddFilter(videoCapture, L"Video Capture Filter");
+	if (SUCCEEDED(hr))
+		hr = graph->ConnectDirect(pin, videoCapture->GetPin(), &mt);
+
+	MediaTypeFree(mt);
+
+	if (FAILED(hr))
+		throw HRError("Failed to connect the video capture pin", hr);
+
+	memset(&frame, 0, sizeof(frame));
+
+	videoFormat  = cap->format;
+	frame.format = videoFormat;
+	frame.width  = (uint32_t)cap->cx;
+	frame.height = (uint32_t)cap->cy;
+
+	if (format_is_yuv(videoFormat))
+		video_format_get_parameters(
+				cap->cy >= 720 ? VIDEO_CS_709 : VIDEO_CS_601,
+				VIDEO_RANGE_PARTIAL, frame.color_matrix,
+				frame.color_range_min, frame.color_range_max);
+
+	blog(LOG_INFO, "DShowSource: Capturing video at %ldx%ld, "
+	               "interval %lld, format %s",
+	               cap->cx, cap->cy,
+	               frameInterval ? (long long)*frameInterval : 0LL,
+	               GetFormatName(videoFormat));
+}
+
+void DShowSource::InitAudio(obs_data_t settings)
+{
+	const char     *id = obs_data_getstring(settings, AUDIO_DEVICE_ID);
+	ComPtr<IPin>   pin;
+	AM_MEDIA_TYPE  *mt;
+	WAVEFORMATEX   *wfex;
+	HRESULT        hr;
+
+	if (!id || !*id)
+		return;
+
+	if (strcmp(id, AUDIO_FROM_VIDEO) == 0) {
+		audioFilter = videoFilter;
+
+	} else {
+		if (!GetDeviceFilter(CLSID_AudioInputDeviceCategory, id,
+					audioFilter.Assign()))
+			throw "Audio device not found";
+
+		hr = graph->AddFilter(audioFilter, L"Audio Device");
+		if (FAILED(hr))
+			throw HRError("Failed to add the audio device filter",
+					hr);
+	}
+
+	hr = capture->FindPin(audioFilter, PINDIR_OUTPUT,
+			&PIN_CATEGORY_CAPTURE, &MEDIATYPE_Audio, false, 0,
+			pin.Assign());
+	if (FAILED(hr)) {
+		blog(LOG_WARNING, "DShowSource: The device has no audio "
+		                  "capture pin");
+		audioFilter.Clear();
+		return;
+	}
+
+	if (!GetAudioMediaType(pin, &mt))
+		throw "The audio device has no PCM formats";
+
+	wfex        = GetWaveFormat(*mt);
+	audioFormat = ConvertAudioFormat(wfex->wBitsPerSample);
+	speakers    = (speaker_layout)wfex->nChannels;
+	sampleRate  = wfex->nSamplesPerSec;
+	blockSize   = wfex->nBlockAlign;
+
+	audioCapture.Set(new CaptureFilter(*mt, ReceiveAudio, this));
+
+	hr = graph->AddFilter(audioCapture, L"Audio Capture Filter");
+	if (SUCCEEDED(hr))
+		hr = graph->ConnectDirect(pin, audioCapture->GetPin(), mt);
+
+	MediaTypeDelete(mt);
+
+	if (FAILED(hr))
+		throw HRError("Failed to connect the audio capture pin", hr);
+}
+
+void DShowSource::Initialize(obs_data_t settings)
+{
+	try {
+		HRESULT hr;
+
+		InitGraph();
+		InitVideo(settings);
+		InitAudio(settings);
+
+		/* sample times are relative to when the graph started */
+		startTime = os_gettime_ns();
+
+		hr = control->Run();
+		if (FAILED(hr))
+			throw HRError("Failed to run the graph", hr);
+
+		active = true;
+
+	} catch (HRError error) {
+		blog(LOG_WARNING, "DShowSource::Initialize: %s: 0x%lX",
+				error.str, error.hr);
+		Stop();
+
+	} catch (const char *error) {
+		blog(LOG_WARNING, "DShowSource::Initialize: %s", error);
+		Stop();
+	}
+}
+
+/* stopping the graph waits for the streaming threads, so no callbacks can
+ * happen once this returns */
+void DShowSource::Stop()
+{
+	if (control)
+		control->Stop();
+
+	control.Clear();
+	videoCapture.Clear();
+	audioCapture.Clear();
+	videoFilter.Clear();
+	audioFilter.Clear();
+	capture.Clear();
+	graph.Clear();
+
+	active = false;
+}
+
+void DShowSource::Update(obs_data_t settings)
+{
+	Stop();
+	Initialize(settings);
+}
+
+static inline uint64_t GetSampleTime(uint64_t startTime, IMediaSample *sample)
+{
+	REFERENCE_TIME start, stop;
+
+	if (FAILED(sample->GetTime(&start, &stop)))
+		return os_gettime_ns();
+
+	return startTime + (uint64_t)start * 100;
+}
+
+/* frames point directly at the sample buffer, libobs copies them into its
+ * own frame cache before the sample is given back to the device */
+void DShowSource::ReceiveVideo(void *param, const AM_MEDIA_TYPE &mt,
+		IMediaSample *sample)
+{
+	DShowSource      *ds    = static_cast<DShowSource*>(param);
+	source_frame     &frame = ds->frame;
+	BITMAPINFOHEADER *bih   = GetBitmapInfoHeader(mt);
+	BYTE             *data;
+	uint32_t         stride, cy;
+	size_t           size;
+
+	if (!bih || FAILED(sample->GetPointer(&data)))
+		return;
+
+	/* the width of the bitmap is the stride of the buffer, which can be
+	 * wider than the frame itself */
+	stride = (uint32_t)bih->biWidth;
+	cy     = frame.height;
+	size   = (size_t)sample->GetActualDataLength();
+
+	switch (ds->videoFormat) {
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+	case VIDEO_FORMAT_YVYU:
+		if (size < (size_t)stride * cy * 2)
+			return;
+
+		frame.data[0]     = data;
+		frame.linesize[0] = stride * 2;
+		break;
+
+	case VIDEO_FORMAT_NV12:
+		if (size < (size_t)stride * cy * 3 / 2)
+			return;
+
+		frame.data[0]     = data;
+		frame.data[1]     = data + stride * cy;
+		frame.linesize[0] = stride;
+		frame.linesize[1] = stride;
+		break;
+
+	case VIDEO_FORMAT_I420:
+		if (size < (size_t)stride * cy * 3 / 2)
+			return;
+
+		frame.data[0]     = data;
+		frame.data[1]     = frame.data[0] + stride * cy;
+		frame.data[2]     = frame.data[1] + (stride / 2) * (cy / 2);
+		frame.linesize[0] = stride;
+		frame.linesize[1] = stride / 2;
+		frame.linesize[2] = stride / 2;
+		break;
+
+	case VIDEO_FORMAT_BGRX:
+	case VIDEO_FORMAT_BGRA:
+		if (size < (size_t)stride * cy * 4)
+			return;
+
+		/* RGB bitmaps with a positive height are bottom-up */
+		frame.data[0]     = data;
+		frame.linesize[0] = stride * 4;
+		frame.flip        = bih->biHeight > 0;
+		break;
+
+	case VIDEO_FORMAT_NONE:
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_I422:
+		return;
+	}
+
+	frame.timestamp = GetSampleTime(ds->startTime, sample);
+	obs_source_output_video(ds->source, &frame);
+}
+
+void DShowSource::ReceiveAudio(void *param, const AM_MEDIA_TYPE &mt,
+		IMediaSample *sample)
+{
+	DShowSource  *ds = static_cast<DShowSource*>(param);
+	source_audio audio = {};
+	BYTE         *data;
+
+	if (!ds->blockSize || FAILED(sample->GetPointer(&data)))
+		return;
+
+	audio.data[0]         = data;
+	audio.frames          = (uint32_t)sample->GetActualDataLength() /
+	                        ds->blockSize;
+	audio.speakers        = ds->speakers;
+	audio.format          = ds->audioFormat;
+	audio.samples_per_sec = ds->sampleRate;
+	audio.timestamp       = GetSampleTime(ds->startTime, sample);
+
+	if (audio.frames)
+		obs_source_output_audio(ds->source, &audio);
+
+	UNUSED_PARAMETER(mt);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const char *GetDShowInputName(const char *locale)
+{
+	/* TODO: translate */
+	UNUSED_PARAMETER(locale);
+	return "Video Capture Device";
+}
+
+static void *CreateDShowInput(obs_data_t settings, obs_source_t source)
+{
+	try {
+		return new DShowSource(settings, source);
+	} catch (const char *error) {
+		blog(LOG_ERROR, "CreateDShowInput: %s", error);
+	}
+
+	return nullptr;
+}
+
+static void DestroyDShowInput(void *data)
+{
+	delete static_cast<DShowSource*>(data);
+}
+
+static void UpdateDShowInput(void *data, obs_data_t settings)
+{
+	static_cast<DShowSource*>(data)->Update(settings);
+}
+
+static void GetDShowDefaults(obs_data_t settings)
+{
+	obs_data_set_default_string(settings, RESOLUTION, "");
+	obs_data_set_default_int(settings, FRAME_INTERVAL, 0);
+	obs_data_set_default_string(settings, AUDIO_DEVICE_ID, "");
+}
+
+struct FPSFormat {
+	const char *name;
+	long long  interval;
+};
+
+static const FPSFormat validFPSFormats[] = {
+	{"60",    166667},
+	{"59.94", 166833},
+	{"50",    200000},
+	{"30",    333333},
+	{"29.97", 333667},
+	{"25",    400000},
+	{"24",    416667},
+	{"20",    500000},
+	{"15",    666667},
+	{"10",   1000000},
+	{"5",    2000000},
+};
+
+static bool HasInterval(const VideoCaps &caps, long long interval)
+{
+	for (size_t i = 0; i < caps.list.size(); i++) {
+		const VideoInfo &cap = caps.list[i];
+		if (interval >= cap.minInterval && interval <= cap.maxInterval)
+			return true;
+	}
+
+	return false;
+}
+
+static bool HasResolution(obs_property_t p, const char *res)
+{
+	size_t count = obs_property_list_item_count(p);
+
+	for (size_t i = 0; i < count; i++) {
+		if (strcmp(obs_property_list_item_string(p, i), res) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+static void FillResolutions(obs_property_t p, const VideoCaps &caps)
+{
+	vector<const VideoInfo*> sorted;
+
+	obs_property_list_clear(p);
+	obs_property_list_add_string(p, "Highest", "");
+
+	for (size_t i = 0; i < caps.list.size(); i++)
+		sorted.push_back(&caps.list[i]);
+
+	sort(sorted.begin(), sorted.end(),
+		[] (const VideoInfo *a, const VideoInfo *b)
+		{
+			return (long long)a->cx * a->cy >
+			       (long long)b->cx * b->cy;
+		});
+
+	for (size_t i = 0; i < sorted.size(); i++) {
+		struct dstr res = {0};
+		dstr_printf(&res, "%ldx%ld", sorted[i]->cx, sorted[i]->cy);
+
+		if (!HasResolution(p, res.array))
+			obs_property_list_add_string(p, res.array, res.array);
+
+		dstr_free(&res);
+	}
+}
+
+static void FillFrameIntervals(obs_property_t p, const VideoCaps &caps)
+{
+	size_t count = sizeof(validFPSFormats) / sizeof(validFPSFormats[0]);
+
+	obs_property_list_clear(p);
+	obs_property_list_add_int(p, "Highest", 0);
+
+	for (size_t i = 0; i < count; i++) {
+		const FPSFormat &fps = validFPSFormats[i];
+		if (HasInterval(caps, fps.interval))
+			obs_property_list_add_int(p, fps.name, fps.interval);
+	}
+}
+
+static bool DeviceSelected(obs_properties_t props, obs_property_t p,
+		obs_data_t settings)
+{
+	const char                    *id = obs_data_getstring(settings,
+			VIDEO_DEVICE_ID);
+	ComPtr<ICaptureGraphBuilder2> capture;
+	ComPtr<IBaseFilter>           filter;
+	VideoCaps                     caps;
+	HRESULT                       hr;
+
+	hr = CoCreateInstance(CLSID_CaptureGraphBuilder2, nullptr,
+			CLSCTX_INPROC_SERVER, IID_ICaptureGraphBuilder2,
+			(void**)capture.Assign());
+
+	if (SUCCEEDED(hr) && id && *id &&
+	    GetDeviceFilter(CLSID_VideoInputDeviceCategory, id,
+		    filter.Assign()))
+		EnumVideoCaps(capture, filter, caps);
+
+	FillResolutions(obs_properties_get(props, RESOLUTION), caps);
+	FillFrameIntervals(obs_properties_get(props, FRAME_INTERVAL), caps);
+
+	UNUSED_PARAMETER(p);
+	return true;
+}
+
+static obs_properties_t GetDShowProperties(const char *locale)
+{
+	obs_properties_t   props = obs_properties_create(locale);
+	obs_property_t     p;
+	vector<DeviceInfo> devices;
+
+	/* TODO: translate */
+	p = obs_properties_add_list(props, VIDEO_DEVICE_ID, "Device",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_set_modified_callback(p, DeviceSelected);
+
+	EnumDevices(CLSID_VideoInputDeviceCategory, devices);
+	for (size_t i = 0; i < devices.size(); i++)
+		obs_property_list_add_string(p, devices[i].name.c_str(),
+				devices[i].id.c_str());
+
+	obs_properties_add_list(props, RESOLUTION, "Resolution",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_properties_add_list(props, FRAME_INTERVAL, "FPS",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+
+	p = obs_properties_add_list(props, AUDIO_DEVICE_ID, "Audio Device",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(p, "None", "");
+	obs_property_list_add_string(p, "Use Video Device Audio",
+			AUDIO_FROM_VIDEO);
+
+	devices.clear();
+	EnumDevices(CLSID_AudioInputDeviceCategory, devices);
+	for (size_t i = 0; i < devices.size(); i++)
+		obs_property_list_add_string(p, devices[i].name.c_str(),
+				devices[i].id.c_str());
+
+	return props;
+}
+
+bool obs_module_load(uint32_t libobs_ver)
+{
+	obs_source_info info = {};
+	info.id              = "dshow_input";
+	info.type            = OBS_SOURCE_TYPE_INPUT;
+	info.output_flags    = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_AUDIO;
+	info.getname         = GetDShowInputName;
+	info.create          = CreateDShowInput;
+	info.destroy         = DestroyDShowInput;
+	info.update          = UpdateDShowInput;
+	info.defaults        = GetDShowDefaults;
+	info.properties      = GetDShowProperties;
+	obs_register_source(&info);
+
+	UNUSED_PARAMETER(libobs_ver);
+	return true;
+}
@@ -17,9 +17,15 @@
 
 #pragma once
 
+#include <obs.h>
+
 #include "util/windows/ComPtr.hpp"
+#include "capture-filter.hpp"
+#include "dshow-enum.hpp"
 
 class DShowSource {
+	obs_source_t                  source;
+
 	ComPtr<IGraphBuilder>         graph;
 	ComPtr<ICaptureGraphBuilder2> capture;
 	ComPtr<IMediaControl>         control;
@@ -27,7 +33,34 @@ class DShowSource {
 	ComPtr<IBaseFilter>           videoFilter;
 	ComPtr<IBaseFilter>           audioFilter;
 
-	ComPtr<CaptureFilter>         captureFilter;
+	ComPtr<CaptureFilter>         videoCapture;
+	ComPtr<CaptureFilter>         audioCapture;
+
+	bool                          active;
+	uint64_t                      startTime;
+
+	video_format                  videoFormat;
+	source_frame                  frame;
+
+	audio_format                  audioFormat;
+	speaker_layout                speakers;
+	uint32_t                      sampleRate;
+	uint32_t                      blockSize;
+
+	static void ReceiveVideo(void *param, const AM_MEDIA_TYPE &mt,
+			IMediaSample *sample);
+	static void ReceiveAudio(void *param, const AM_MEDIA_TYPE &mt,
+			IMediaSample *sample);
+
+	void InitGraph();
+	void InitVideo(obs_data_t settings);
+	void InitAudio(obs_data_t settings);
+	void Initialize(obs_data_t settings);
+	void Stop();
+
+public:
+	DShowSource(obs_data_t settings, obs_source_t source);
+	~DShowSource();
 
-	
+	void Update(obs_data_t settings);
 };
@@ -0,0 +1,387 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "encoder-host-ipc.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+extern char **environ;
+#endif
+
+#define HOST_PREFIX "obs-enchost-"
+
+#ifdef _WIN32
+
+bool host_map_create(struct host_map *map, const char *id, size_t size)
+{
+	char     name[HOST_NAME_SIZE];
+	uint64_t size64 = (uint64_t)size;
+
+	memset(map, 0, sizeof(struct host_map));
+	snprintf(name, sizeof(name), HOST_PREFIX "%s", id);
+
+	map->handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL,
+			PAGE_READWRITE, (DWORD)(size64 >> 32),
+			(DWORD)(size64 & 0xFFFFFFFF), name);
+	if (!map->handle)
+		return false;
+
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		host_map_close(map);
+		return false;
+	}
+
+	map->data = MapViewOfFile(map->handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!map->data) {
+		host_map_close(map);
+		return false;
+	}
+
+	map->size  = size;
+	map->owner = true;
+	return true;
+}
+
+bool host_map_open(struct host_map *map, const char *id)
+{
+	char name[HOST_NAME_SIZE];
+	MEMORY_BASIC_INFORMATION info;
+
+	memset(map, 0, sizeof(struct host_map));
+	snprintf(name, sizeof(name), HOST_PREFIX "%s", id);
+
+	map->handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, false, name);
+	if (!map->handle)
+		return false;
+
+	map->data = MapViewOfFile(map->handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!map->data || !VirtualQuery(map->data, &info, sizeof(info))) {
+		host_map_close(map);
+		return false;
+	}
+
+	map->size = info.RegionSize;
+	return true;
+}
+
+void host_map_close(struct host_map *map)
+{
+	if (map->data)
+		UnmapViewOfFile(map->data);
+	if (map->handle)
+		CloseHandle(map->handle);
+
+	memset(map, 0, sizeof(struct host_map));
+}
+
+bool host_sem_create(struct host_sem *sem, const char *id)
+{
+	char name[HOST_NAME_SIZE];
+	snprintf(name, sizeof(name), HOST_PREFIX "%s-frames", id);
+
+	sem->handle = CreateSemaphoreA(NULL, 0, 0x7FFFFFFF, name);
+	return sem->handle != NULL;
+}
+
+bool host_sem_open(struct host_sem *sem, const char *id)
+{
+	char name[HOST_NAME_SIZE];
+	snprintf(name, sizeof(name), HOST_PREFIX "%s-frames", id);
+
+	sem->handle = OpenSemaphoreA(SEMAPHORE_ALL_ACCESS, false, name);
+	return sem->handle != NULL;
+}
+
+void host_sem_close(struct host_sem *sem)
+{
+	if (sem->handle)
+		CloseHandle(sem->handle);
+	sem->handle = NULL;
+}
+
+void host_sem_post(struct host_sem *sem)
+{
+	ReleaseSemaphore(sem->handle, 1, NULL);
+}
+
+bool host_sem_wait(struct host_sem *sem, uint32_t timeout_ms)
+{
+	return WaitForSingleObject(sem->handle, timeout_ms) == WAIT_OBJECT_0;
+}
+
+bool host_process_start(host_process_t *process, const char *path,
+		const char *id, unsigned long parent_pid)
+{
+	STARTUPINFOA        si = {0};
+	PROCESS_INFORMATION pi = {0};
+	char                cmd[MAX_PATH * 2];
+
+	snprintf(cmd, sizeof(cmd), "\"%s\" %s %lu", path, id, parent_pid);
+	si.cb = sizeof(si);
+
+	if (!CreateProcessA(path, cmd, NULL, NULL, false, CREATE_NO_WINDOW,
+				NULL, NULL, &si, &pi))
+		return false;
+
+	CloseHandle(pi.hThread);
+	*process = pi.hProcess;
+	return true;
+}
+
+bool host_process_alive(host_process_t process)
+{
+	return process && WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+}
+
+void host_process_kill(host_process_t process)
+{
+	if (process) {
+		TerminateProcess(process, 1);
+		WaitForSingleObject(process, INFINITE);
+	}
+}
+
+void host_process_close(host_process_t process)
+{
+	if (process)
+		CloseHandle(process);
+}
+
+unsigned long host_current_pid(void)
+{
+	return (unsigned long)GetCurrentProcessId();
+}
+
+bool host_pid_alive(unsigned long pid)
+{
+	HANDLE process = OpenProcess(SYNCHRONIZE, false, (DWORD)pid);
+	bool   alive;
+
+	if (!process)
+		return false;
+
+	alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+	CloseHandle(process);
+	return alive;
+}
+
+#else
+
+bool host_map_create(struct host_map *map, const char *id, size_t size)
+{
+	memset(map, 0, sizeof(struct host_map));
+	map->fd = -1;
+	snprintf(map->name, sizeof(map->name), "/" HOST_PREFIX "%s", id);
+
+	/* a mapping left behind by a crashed process is replaced */
+	shm_unlink(map->name);
+
+	map->fd = shm_open(map->name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (map->fd == -1)
+		return false;
+
+	map->owner = true;
+
+	if (ftruncate(map->fd, (off_t)size) != 0)
+		goto fail;
+
+	map->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			map->fd, 0);
+	if (map->data == MAP_FAILED) {
+		map->data = NULL;
+		goto fail;
+	}
+
+	map->size = size;
+	return true;
+
+fail:
+	host_map_close(map);
+	return false;
+}
+
+bool host_map_open(struct host_map *map, const char *id)
+{
+	struct stat st;
+
+	memset(map, 0, sizeof(struct host_map));
+	map->fd = -1;
+	snprintf(map->name, sizeof(map->name), "/" HOST_PREFIX "%s", id);
+
+	map->fd = shm_open(map->name, O_RDWR, 0600);
+	if (map->fd == -1)
+		return false;
+
+	if (fstat(map->fd, &st) != 0 || !st.st_size)
+		goto fail;
+
+	map->data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED, map->fd, 0);
+	if (map->data == MAP_FAILED) {
+		map->data = NULL;
+		goto fail;
+	}
+
+	map->size = (size_t)st.st_size;
+	return true;
+
+fail:
+	host_map_close(map);
+	return false;
+}
+
+void host_map_close(struct host_map *map)
+{
+	if (map->data)
+		munmap(map->data, map->size);
+	if (map->fd != -1)
+		close(map->fd);
+	if (map->owner)
+		shm_unlink(map->name);
+
+	memset(map, 0, sizeof(struct host_map));
+	map->fd = -1;
+}
+
+bool host_sem_create(struct host_sem *sem, const char *id)
+{
+	snprintf(sem->name, sizeof(sem->name), "/" HOST_PREFIX "%s-frames",
+			id);
+
+	sem_unlink(sem->name);
+	sem->sem   = sem_open(sem->name, O_CREAT | O_EXCL, 0600, 0);
+	sem->owner = true;
+	return sem->sem != SEM_FAILED;
+}
+
+bool host_sem_open(struct host_sem *sem, const char *id)
+{
+	snprintf(sem->name, sizeof(sem->name), "/" HOST_PREFIX "%s-frames",
+			id);
+
+	sem->sem   = sem_open(sem->name, 0);
+	sem->owner = false;
+	return sem->sem != SEM_FAILED;
+}
+
+void host_sem_close(struct host_sem *sem)
+{
+	if (sem->sem && sem->sem != SEM_FAILED)
+		sem_close(sem->sem);
+	if (sem->owner)
+		sem_unlink(sem->name);
+
+	sem->sem   = NULL;
+	sem->owner = false;
+}
+
+void host_sem_post(struct host_sem *sem)
+{
+	sem_post(sem->sem);
+}
+
+#ifdef __APPLE__
+/* no sem_timedwait */
+bool host_sem_wait(struct host_sem *sem, uint32_t timeout_ms)
+{
+	for (uint32_t i = 0; i < timeout_ms; i++) {
+		if (sem_trywait(sem->sem) == 0)
+			return true;
+		usleep(1000);
+	}
+
+	return false;
+}
+#else
+bool host_sem_wait(struct host_sem *sem, uint32_t timeout_ms)
+{
+	struct timespec ts;
+	int ret;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec  += timeout_ms / 1000;
+	ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	do {
+		ret = sem_timedwait(sem->sem, &ts);
+	} while (ret == -1 && errno == EINTR);
+
+	return ret == 0;
+}
+#endif
+
+bool host_process_start(host_process_t *process, const char *path,
+		const char *id, unsigned long parent_pid)
+{
+	char pid_str[32];
+	char *argv[4];
+
+	snprintf(pid_str, sizeof(pid_str), "%lu", parent_pid);
+	argv[0] = (char*)path;
+	argv[1] = (char*)id;
+	argv[2] = pid_str;
+	argv[3] = NULL;
+
+	/* searches PATH when there's no directory in the path */
+	return posix_spawnp(process, path, NULL, NULL, argv, environ) == 0;
+}
+
+bool host_process_alive(host_process_t process)
+{
+	return process > 0 && waitpid(process, NULL, WNOHANG) == 0;
+}
+
+void host_process_kill(host_process_t process)
+{
+	if (process > 0) {
+		kill(process, SIGKILL);
+		waitpid(process, NULL, 0);
+	}
+}
+
+void host_process_close(host_process_t process)
+{
+	UNUSED_PARAMETER(process);
+}
+
+unsigned long host_current_pid(void)
+{
+	return (unsigned long)getpid();
+}
+
+/* the host is reparented when its parent exits */
+bool host_pid_alive(unsigned long pid)
+{
+	return (unsigned long)getppid() == pid;
+}
+
+#endif
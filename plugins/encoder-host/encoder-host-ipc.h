@@ -0,0 +1,183 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <util/c99defs.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define HOST_BARRIER() MemoryBarrier()
+#else
+#include <sys/types.h>
+#include <semaphore.h>
+#define HOST_BARRIER() __sync_synchronize()
+#endif
+
+/*
+ * Shared memory of a hosted encoder
+ *
+ *   The plugin creates the mapping "obs-enchost-<id>" and the semaphore
+ * "obs-enchost-<id>-frames", and starts obs-encoder-host with the id and its
+ * own process id.  The host creates the encoder named in the header and sets
+ * state to HOST_READY (after filling in the extra data and SEI), or to
+ * HOST_FAILED.
+ *
+ *   Both rings have a single writer and a single reader.  The writer fills
+ * slot (write & (slots - 1)) while write - read < slots, then increments
+ * write, the reader uses slot (read & (slots - 1)) while read != write, then
+ * increments read, with HOST_BARRIER before each increment.  Frames go to
+ * the host (which is woken up through the semaphore), packets come back and
+ * are polled by the plugin.  Neither side ever waits for the other, a full
+ * ring drops the frame or packet.
+ *
+ *   settings_serial is odd while the plugin writes new settings, the host
+ * only applies them if the serial is even and the same before and after
+ * copying them.
+ */
+
+#define HOST_MAGIC            0x48424F00 /* "\0OBH" */
+#define HOST_VERSION          2
+#define HOST_MAX_PLANES       8
+#define HOST_SLOT_DATA_OFFSET 64
+#define HOST_NAME_SIZE        64
+#define HOST_SETTINGS_SIZE    16384
+#define HOST_HEADERS_SIZE     16384
+
+#define HOST_FRAME_SLOTS      4
+#define HOST_PACKET_SLOTS     8
+
+#define HOST_STARTING         0
+#define HOST_READY            1
+#define HOST_FAILED           2
+
+#define HOST_FRAME_DUPLICATE  (1<<0)
+#define HOST_FRAME_KEYFRAME   (1<<1)
+
+struct host_frame_slot {
+	int64_t           pts;
+	uint32_t          flags;
+	uint32_t          reserved;
+};
+
+struct host_packet_slot {
+	int64_t           pts;
+	int64_t           dts;
+	uint32_t          size;
+	uint32_t          keyframe;
+	int32_t           priority;
+	int32_t           drop_priority;
+
+	/* packet data is in AVCC format instead of using start codes */
+	uint32_t          avcc;
+	uint32_t          reserved;
+};
+
+struct host_header {
+	uint32_t          magic;
+	uint32_t          version;
+	volatile uint32_t state;
+
+	/* set by the plugin when the host should exit */
+	volatile uint32_t stop;
+
+	char              module[HOST_NAME_SIZE];
+	char              encoder_id[HOST_NAME_SIZE];
+
+	volatile uint32_t settings_serial;
+	char              settings[HOST_SETTINGS_SIZE];
+
+	uint32_t          format;
+	uint32_t          width;
+	uint32_t          height;
+	uint32_t          fps_num;
+	uint32_t          fps_den;
+	uint32_t          planes;
+	uint32_t          linesize[HOST_MAX_PLANES];
+	uint32_t          plane_offset[HOST_MAX_PLANES];
+
+	uint64_t          frame_offset;
+	uint32_t          frame_slot_size;
+	volatile uint32_t frame_write;
+	volatile uint32_t frame_read;
+
+	uint64_t          packet_offset;
+	uint32_t          packet_slot_size;
+	volatile uint32_t packet_write;
+	volatile uint32_t packet_read;
+
+	uint32_t          extra_size;
+	uint32_t          sei_size;
+	uint8_t           extra_data[HOST_HEADERS_SIZE];
+	uint8_t           sei_data[HOST_HEADERS_SIZE];
+};
+
+/* ------------------------------------------------------------------------- */
+/* platform helpers, shared by the plugin and the host */
+
+struct host_map {
+	uint8_t           *data;
+	size_t            size;
+	bool              owner;
+#ifdef _WIN32
+	HANDLE            handle;
+#else
+	int               fd;
+	char              name[HOST_NAME_SIZE];
+#endif
+};
+
+struct host_sem {
+#ifdef _WIN32
+	HANDLE            handle;
+#else
+	sem_t             *sem;
+	bool              owner;
+	char              name[HOST_NAME_SIZE];
+#endif
+};
+
+#ifdef _WIN32
+typedef HANDLE host_process_t;
+#else
+typedef pid_t  host_process_t;
+#endif
+
+extern bool host_map_create(struct host_map *map, const char *id,
+		size_t size);
+extern bool host_map_open(struct host_map *map, const char *id);
+extern void host_map_close(struct host_map *map);
+
+extern bool host_sem_create(struct host_sem *sem, const char *id);
+extern bool host_sem_open(struct host_sem *sem, const char *id);
+extern void host_sem_close(struct host_sem *sem);
+extern void host_sem_post(struct host_sem *sem);
+
+/* returns false on timeout */
+extern bool host_sem_wait(struct host_sem *sem, uint32_t timeout_ms);
+
+/* starts the host executable with the given arguments */
+extern bool host_process_start(host_process_t *process, const char *path,
+		const char *id, unsigned long parent_pid);
+/* returns false once the process has exited (the process is reaped) */
+extern bool host_process_alive(host_process_t process);
+extern void host_process_kill(host_process_t process);
+extern void host_process_close(host_process_t process);
+
+extern unsigned long host_current_pid(void);
+extern bool host_pid_alive(unsigned long pid);
@@ -0,0 +1,312 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <obs.h>
+#include "encoder-host-ipc.h"
+
+/* obs-encoder-host <id> <parent pid>
+ *
+ * Process started by the hosted encoder plugin.  Loads the module of the
+ * encoder, creates the encoder from the settings in the shared memory, and
+ * encodes the frames of the frame ring in place until the plugin asks it to
+ * stop or the parent process goes away. */
+
+#define WAIT_TIMEOUT_MS 100
+
+struct encoder_host {
+	struct host_map     map;
+	struct host_sem     frame_sem;
+	struct host_header  *header;
+	unsigned long       parent_pid;
+
+	video_t             video;
+	obs_encoder_t       encoder;
+	uint32_t            settings_serial;
+	char                settings[HOST_SETTINGS_SIZE];
+};
+
+/* returns NULL unless the settings changed since they were last read */
+static const char *read_settings(struct encoder_host *host)
+{
+	uint32_t serial = host->header->settings_serial;
+
+	if ((serial & 1) != 0 || serial == host->settings_serial)
+		return NULL;
+
+	HOST_BARRIER();
+	memcpy(host->settings, host->header->settings, HOST_SETTINGS_SIZE);
+	host->settings[HOST_SETTINGS_SIZE - 1] = 0;
+	HOST_BARRIER();
+
+	if (host->header->settings_serial != serial)
+		return NULL;
+
+	host->settings_serial = serial;
+	return host->settings;
+}
+
+static void update_settings(struct encoder_host *host)
+{
+	const char *json = read_settings(host);
+	obs_data_t settings;
+
+	if (!json)
+		return;
+
+	settings = obs_data_create_from_json(json);
+	obs_encoder_update(host->encoder, settings);
+	obs_data_release(settings);
+}
+
+static bool copy_headers(struct encoder_host *host)
+{
+	struct host_header *header = host->header;
+	uint8_t *data;
+	size_t  size;
+
+	if (obs_encoder_get_extra_data(host->encoder, &data, &size)) {
+		if (size > HOST_HEADERS_SIZE)
+			return false;
+
+		memcpy(header->extra_data, data, size);
+		header->extra_size = (uint32_t)size;
+	}
+
+	if (obs_encoder_get_sei_data(host->encoder, &data, &size)) {
+		if (size > HOST_HEADERS_SIZE)
+			return false;
+
+		memcpy(header->sei_data, data, size);
+		header->sei_size = (uint32_t)size;
+	}
+
+	return true;
+}
+
+static bool create_encoder(struct encoder_host *host)
+{
+	struct host_header *header = host->header;
+	struct video_output_info voi = {0};
+	const char *json;
+	obs_data_t settings;
+
+	if (obs_load_module(header->module) != MODULE_SUCCESS) {
+		blog(LOG_ERROR, "encoder host: failed to load module '%s'",
+				header->module);
+		return false;
+	}
+
+	/* the encoder only reads the format of its video output, frames are
+	 * given to it directly */
+	voi.name    = "encoder host";
+	voi.format  = (enum video_format)header->format;
+	voi.width   = header->width;
+	voi.height  = header->height;
+	voi.fps_num = header->fps_num;
+	voi.fps_den = header->fps_den;
+
+	if (video_output_open(&host->video, &voi) != VIDEO_OUTPUT_SUCCESS) {
+		blog(LOG_ERROR, "encoder host: failed to open video output");
+		return false;
+	}
+
+	json = read_settings(host);
+	settings = obs_data_create_from_json(json ? json : "{}");
+	host->encoder = obs_video_encoder_create(header->encoder_id, "hosted",
+			settings);
+	obs_data_release(settings);
+
+	if (!host->encoder) {
+		blog(LOG_ERROR, "encoder host: failed to create encoder '%s'",
+				header->encoder_id);
+		return false;
+	}
+
+	obs_encoder_set_video(host->encoder, host->video);
+
+	if (!obs_encoder_initialize(host->encoder)) {
+		blog(LOG_ERROR, "encoder host: failed to initialize encoder "
+		                "'%s'", header->encoder_id);
+		return false;
+	}
+
+	if (!copy_headers(host)) {
+		blog(LOG_ERROR, "encoder host: encoder headers too large");
+		return false;
+	}
+
+	return true;
+}
+
+static void send_packet(struct encoder_host *host,
+		struct encoder_packet *packet)
+{
+	struct host_header      *header = host->header;
+	struct host_packet_slot *slot;
+	uint32_t                write = header->packet_write;
+
+	if (write - header->packet_read >= HOST_PACKET_SLOTS) {
+		blog(LOG_WARNING, "encoder host: packet ring full, dropping "
+		                  "packet");
+		return;
+	}
+	if (packet->size > header->packet_slot_size - HOST_SLOT_DATA_OFFSET) {
+		blog(LOG_WARNING, "encoder host: packet too large, dropping "
+		                  "packet");
+		return;
+	}
+
+	slot = (struct host_packet_slot*)(host->map.data +
+			header->packet_offset +
+			(uint64_t)(write & (HOST_PACKET_SLOTS - 1)) *
+			header->packet_slot_size);
+
+	memcpy((uint8_t*)slot + HOST_SLOT_DATA_OFFSET, packet->data,
+			packet->size);
+	slot->pts           = packet->pts;
+	slot->dts           = packet->dts;
+	slot->size          = (uint32_t)packet->size;
+	slot->keyframe      = packet->keyframe;
+	slot->priority      = packet->priority;
+	slot->drop_priority = packet->drop_priority;
+	slot->avcc          = packet->avcc;
+
+	HOST_BARRIER();
+	header->packet_write = write + 1;
+}
+
+static bool encode_frames(struct encoder_host *host)
+{
+	struct host_header *header = host->header;
+
+	while (header->frame_read != header->frame_write) {
+		uint32_t               read = header->frame_read;
+		uint8_t                *slot_data;
+		struct host_frame_slot *slot;
+		struct encoder_frame   frame = {0};
+		struct encoder_packet  packet;
+		bool                   received = false;
+
+		HOST_BARRIER();
+
+		slot_data = host->map.data + header->frame_offset +
+			(uint64_t)(read & (HOST_FRAME_SLOTS - 1)) *
+			header->frame_slot_size;
+		slot = (struct host_frame_slot*)slot_data;
+
+		for (uint32_t i = 0; i < header->planes; i++) {
+			frame.data[i]     = slot_data + header->plane_offset[i];
+			frame.linesize[i] = header->linesize[i];
+		}
+
+		frame.frames         = 1;
+		frame.pts            = slot->pts;
+		frame.duplicate      = !!(slot->flags & HOST_FRAME_DUPLICATE);
+		frame.force_keyframe = !!(slot->flags & HOST_FRAME_KEYFRAME);
+
+		update_settings(host);
+
+		if (!obs_encoder_encode(host->encoder, &frame, &packet,
+					&received)) {
+			blog(LOG_ERROR, "encoder host: encode failed");
+			return false;
+		}
+
+		if (received)
+			send_packet(host, &packet);
+
+		HOST_BARRIER();
+		header->frame_read = read + 1;
+	}
+
+	return true;
+}
+
+static void host_loop(struct encoder_host *host)
+{
+	while (!host->header->stop) {
+		if (!host_sem_wait(&host->frame_sem, WAIT_TIMEOUT_MS)) {
+			if (!host_pid_alive(host->parent_pid))
+				break;
+			continue;
+		}
+
+		/* exiting makes the plugin start a new host */
+		if (!encode_frames(host))
+			break;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct encoder_host host = {0};
+	int ret = 1;
+
+	if (argc < 3) {
+		blog(LOG_ERROR, "usage: obs-encoder-host <id> <parent pid>");
+		return 1;
+	}
+
+	host.parent_pid = strtoul(argv[2], NULL, 10);
+
+	if (!host_map_open(&host.map, argv[1]) ||
+	    host.map.size < sizeof(struct host_header)) {
+		blog(LOG_ERROR, "encoder host: failed to open shared memory");
+		return 1;
+	}
+
+	host.header = (struct host_header*)host.map.data;
+	if (host.header->magic   != HOST_MAGIC ||
+	    host.header->version != HOST_VERSION) {
+		blog(LOG_ERROR, "encoder host: shared memory version mismatch");
+		goto exit;
+	}
+
+	if (!host_sem_open(&host.frame_sem, argv[1])) {
+		blog(LOG_ERROR, "encoder host: failed to open semaphore");
+		goto exit;
+	}
+
+	if (!obs_startup()) {
+		blog(LOG_ERROR, "encoder host: failed to start libobs");
+		goto exit;
+	}
+
+	if (create_encoder(&host)) {
+		HOST_BARRIER();
+		host.header->state = HOST_READY;
+
+		host_loop(&host);
+		ret = 0;
+	} else {
+		host.header->state = HOST_FAILED;
+	}
+
+	obs_encoder_destroy(host.encoder);
+	video_output_close(host.video);
+	obs_shutdown();
+
+exit:
+	if (host.header && host.header->state == HOST_STARTING)
+		host.header->state = HOST_FAILED;
+
+	host_sem_close(&host.frame_sem);
+	host_map_close(&host.map);
+	return ret;
+}
@@ -0,0 +1,628 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-module.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "encoder-host-ipc.h"
+
+#if defined(__APPLE__)
+#include <mach-o/dyld.h>
+#elif !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+/* Hosted encoder
+ *
+ * Runs another video encoder in a separate obs-encoder-host process, so that
+ * a crashing encoder only takes down its host.  Frames are copied into a
+ * shared memory ring once, the host encodes them in place and sends the
+ * packets back through a second ring.  When the host dies it's started
+ * again, and the new encoder starts with a keyframe; the frames that were in
+ * flight are lost. */
+
+OBS_DECLARE_MODULE()
+
+#ifdef _WIN32
+#define HOST_EXECUTABLE "obs-encoder-host.exe"
+#else
+#define HOST_EXECUTABLE "obs-encoder-host"
+#endif
+
+#define do_log(level, format, ...) \
+	blog(level, "[hosted encoder %s] " format, he->id, ##__VA_ARGS__)
+
+#define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
+
+#define START_TIMEOUT_MS    10000
+#define STOP_TIMEOUT_MS     2000
+#define STALL_TIMEOUT_NS    5000000000ULL
+#define RESTART_WINDOW_NS   60000000000ULL
+#define MAX_RESTARTS        3
+
+static volatile long    host_count = 0;
+
+struct hosted_encoder {
+	obs_encoder_t       encoder;
+
+	char                id[HOST_NAME_SIZE];
+	struct host_map     map;
+	struct host_sem     frame_sem;
+	struct host_header  *header;
+	host_process_t      process;
+	bool                running;
+
+	/* copies, so they stay valid while the host restarts */
+	DARRAY(uint8_t)     extra_data;
+	DARRAY(uint8_t)     sei_data;
+	DARRAY(uint8_t)     packet_data;
+
+	enum video_format   format;
+	uint32_t            plane_height[HOST_MAX_PLANES];
+
+	uint64_t            stall_start;
+	uint64_t            restart_window_start;
+	int                 restarts;
+	bool                keyframe_pending;
+};
+
+/* ------------------------------------------------------------------------- */
+
+static char *get_host_path(void)
+{
+	struct dstr path = {0};
+	char        *slash;
+
+#if defined(_WIN32)
+	char exe[MAX_PATH];
+	if (GetModuleFileNameA(NULL, exe, MAX_PATH))
+		dstr_copy(&path, exe);
+	dstr_replace(&path, "\\", "/");
+#elif defined(__APPLE__)
+	char     exe[1024];
+	uint32_t size = sizeof(exe);
+	if (_NSGetExecutablePath(exe, &size) == 0)
+		dstr_copy(&path, exe);
+#else
+	char    exe[1024];
+	ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	if (len > 0) {
+		exe[len] = 0;
+		dstr_copy(&path, exe);
+	}
+#endif
+
+	/* the host is installed next to the main executable, otherwise it's
+	 * looked up in the PATH */
+	slash = path.array ? strrchr(path.array, '/') : NULL;
+	if (slash) {
+		dstr_resize(&path, slash - path.array + 1);
+		dstr_cat(&path, HOST_EXECUTABLE);
+
+		if (os_file_exists(path.array))
+			return path.array;
+	}
+
+	dstr_copy(&path, HOST_EXECUTABLE);
+	return path.array;
+}
+
+/* only the YUV formats encoders take directly are sent to the host */
+static inline bool format_supported(enum video_format format)
+{
+	return format == VIDEO_FORMAT_I420 || format == VIDEO_FORMAT_NV12 ||
+	       format == VIDEO_FORMAT_I444 || format == VIDEO_FORMAT_I422;
+}
+
+static uint32_t get_planes(enum video_format format, uint32_t width,
+		uint32_t height, uint32_t *linesize, uint32_t *plane_height)
+{
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+		linesize[0] = width;   plane_height[0] = height;
+		linesize[1] = width/2; plane_height[1] = height/2;
+		linesize[2] = width/2; plane_height[2] = height/2;
+		return 3;
+	case VIDEO_FORMAT_NV12:
+		linesize[0] = width;   plane_height[0] = height;
+		linesize[1] = width;   plane_height[1] = height/2;
+		return 2;
+	case VIDEO_FORMAT_I444:
+		for (size_t i = 0; i < 3; i++) {
+			linesize[i]     = width;
+			plane_height[i] = height;
+		}
+		return 3;
+	case VIDEO_FORMAT_I422:
+		linesize[0] = width;   plane_height[0] = height;
+		linesize[1] = width/2; plane_height[1] = height;
+		linesize[2] = width/2; plane_height[2] = height;
+		return 3;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static inline uint32_t align_size(uint32_t size)
+{
+	return (size + 63) & ~63;
+}
+
+static void copy_settings(struct hosted_encoder *he, obs_data_t settings)
+{
+	obs_data_t  inner = obs_data_getobj(settings, "settings");
+	const char  *json = inner ? obs_data_getjson(inner) : "{}";
+	size_t      len   = strlen(json);
+
+	if (len >= HOST_SETTINGS_SIZE) {
+		warn("encoder settings too large, using the defaults");
+		json = "{}";
+		len  = 2;
+	}
+
+	he->header->settings_serial++;
+	HOST_BARRIER();
+	memcpy(he->header->settings, json, len + 1);
+	HOST_BARRIER();
+	he->header->settings_serial++;
+
+	obs_data_release(inner);
+}
+
+static bool init_layout(struct hosted_encoder *he, obs_data_t settings,
+		struct host_header *header, size_t *size)
+{
+	video_t  video = obs_encoder_video(he->encoder);
+	const struct video_output_info *voi = video_output_getinfo(video);
+	uint32_t width  = obs_encoder_get_width(he->encoder);
+	uint32_t height = obs_encoder_get_height(he->encoder);
+	uint32_t offset = HOST_SLOT_DATA_OFFSET;
+
+	if (!voi)
+		return false;
+
+	he->format = format_supported(voi->format) ?
+		voi->format : VIDEO_FORMAT_NV12;
+
+	header->magic   = HOST_MAGIC;
+	header->version = HOST_VERSION;
+	header->format  = (uint32_t)he->format;
+	header->width   = width;
+	header->height  = height;
+	header->fps_num = voi->fps_num;
+	header->fps_den = voi->fps_den *
+		obs_encoder_get_frame_rate_divisor(he->encoder);
+	header->planes  = get_planes(he->format, width, height,
+			header->linesize, he->plane_height);
+
+	strncpy(header->module, obs_data_getstring(settings, "module"),
+			HOST_NAME_SIZE - 1);
+	strncpy(header->encoder_id, obs_data_getstring(settings, "encoder"),
+			HOST_NAME_SIZE - 1);
+
+	for (uint32_t i = 0; i < header->planes; i++) {
+		header->plane_offset[i] = offset;
+		offset += align_size(header->linesize[i] * he->plane_height[i]);
+	}
+
+	/* packets are practically never larger than the raw frame */
+	header->frame_slot_size  = offset;
+	header->packet_slot_size = offset + HOST_SLOT_DATA_OFFSET;
+
+	header->frame_offset  = align_size(sizeof(struct host_header));
+	header->packet_offset = header->frame_offset +
+		(uint64_t)HOST_FRAME_SLOTS * header->frame_slot_size;
+	*size = (size_t)(header->packet_offset +
+		(uint64_t)HOST_PACKET_SLOTS * header->packet_slot_size);
+
+	return header->planes != 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void stop_host(struct hosted_encoder *he)
+{
+	uint64_t timeout;
+
+	if (!he->running)
+		return;
+
+	he->header->stop = 1;
+	HOST_BARRIER();
+	host_sem_post(&he->frame_sem);
+
+	timeout = os_gettime_ns() + STOP_TIMEOUT_MS * 1000000ULL;
+	while (host_process_alive(he->process)) {
+		if (os_gettime_ns() > timeout) {
+			warn("host didn't exit, killing it");
+			host_process_kill(he->process);
+			break;
+		}
+
+		os_sleep_ms(10);
+	}
+
+	host_process_close(he->process);
+	he->process = 0;
+	he->running = false;
+}
+
+static bool start_host(struct hosted_encoder *he)
+{
+	struct host_header *header = he->header;
+	char     *path = get_host_path();
+	uint64_t timeout;
+	bool     success;
+
+	/* the previous host is gone, so nothing else touches the rings */
+	header->state        = HOST_STARTING;
+	header->stop         = 0;
+	header->frame_write  = 0;
+	header->frame_read   = 0;
+	header->packet_write = 0;
+	header->packet_read  = 0;
+	HOST_BARRIER();
+
+	while (host_sem_wait(&he->frame_sem, 0));
+
+	success = host_process_start(&he->process, path, he->id,
+			host_current_pid());
+	if (!success)
+		warn("failed to start '%s'", path);
+
+	bfree(path);
+	if (!success)
+		return false;
+
+	he->running = true;
+
+	timeout = os_gettime_ns() + START_TIMEOUT_MS * 1000000ULL;
+	while (header->state == HOST_STARTING) {
+		if (!host_process_alive(he->process)) {
+			he->process = 0;
+			he->running = false;
+			warn("host exited while starting");
+			return false;
+		}
+		if (os_gettime_ns() > timeout) {
+			warn("host took too long to start");
+			host_process_kill(he->process);
+			host_process_close(he->process);
+			he->process = 0;
+			he->running = false;
+			return false;
+		}
+
+		os_sleep_ms(5);
+	}
+
+	HOST_BARRIER();
+
+	if (header->state != HOST_READY) {
+		warn("host failed to create encoder '%s'", header->encoder_id);
+		stop_host(he);
+		return false;
+	}
+
+	da_resize(he->extra_data, 0);
+	da_push_back_array(he->extra_data, header->extra_data,
+			header->extra_size);
+	da_resize(he->sei_data, 0);
+	da_push_back_array(he->sei_data, header->sei_data, header->sei_size);
+
+	he->stall_start = 0;
+	return true;
+}
+
+static bool restart_host(struct hosted_encoder *he)
+{
+	uint64_t now = os_gettime_ns();
+
+	if (he->running) {
+		host_process_kill(he->process);
+		host_process_close(he->process);
+		he->process = 0;
+		he->running = false;
+	}
+
+	if (now - he->restart_window_start > RESTART_WINDOW_NS) {
+		he->restart_window_start = now;
+		he->restarts = 0;
+	}
+
+	if (++he->restarts > MAX_RESTARTS) {
+		warn("host restarted too often, giving up");
+		return false;
+	}
+
+	info("restarting host");
+	he->keyframe_pending = true;
+	return start_host(he);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const char *hosted_getname(const char *locale)
+{
+	/* TODO: translate */
+	UNUSED_PARAMETER(locale);
+	return "Hosted Encoder (separate process)";
+}
+
+static void hosted_destroy(void *data)
+{
+	struct hosted_encoder *he = data;
+
+	if (he->header)
+		stop_host(he);
+
+	host_sem_close(&he->frame_sem);
+	host_map_close(&he->map);
+	da_free(he->extra_data);
+	da_free(he->sei_data);
+	da_free(he->packet_data);
+	bfree(he);
+}
+
+static void *hosted_create(obs_data_t settings, obs_encoder_t encoder)
+{
+	struct hosted_encoder *he = bzalloc(sizeof(struct hosted_encoder));
+	struct host_header header = {0};
+	size_t size;
+
+	he->encoder = encoder;
+	snprintf(he->id, sizeof(he->id), "%lu-%ld", host_current_pid(),
+			os_atomic_inc_long(&host_count));
+
+	if (!init_layout(he, settings, &header, &size)) {
+		warn("unsupported video output");
+		goto fail;
+	}
+
+	if (!host_map_create(&he->map, he->id, size)) {
+		warn("failed to create shared memory");
+		goto fail;
+	}
+	if (!host_sem_create(&he->frame_sem, he->id)) {
+		warn("failed to create semaphore");
+		goto fail;
+	}
+
+	he->header = (struct host_header*)he->map.data;
+	memcpy(he->header, &header, sizeof(header));
+	copy_settings(he, settings);
+
+	if (!start_host(he))
+		goto fail;
+
+	info("encoder '%s' running in host process", header.encoder_id);
+	return he;
+
+fail:
+	hosted_destroy(he);
+	return NULL;
+}
+
+static bool hosted_update(void *data, obs_data_t settings)
+{
+	struct hosted_encoder *he = data;
+
+	/* the host applies them with the next frame */
+	copy_settings(he, settings);
+	return true;
+}
+
+static bool send_frame(struct hosted_encoder *he, struct encoder_frame *frame)
+{
+	struct host_header     *header = he->header;
+	struct host_frame_slot *slot;
+	uint32_t               write = header->frame_write;
+	uint8_t                *slot_data;
+
+	if (write - header->frame_read >= HOST_FRAME_SLOTS)
+		return false;
+
+	slot_data = he->map.data + header->frame_offset +
+		(uint64_t)(write & (HOST_FRAME_SLOTS - 1)) *
+		header->frame_slot_size;
+	slot = (struct host_frame_slot*)slot_data;
+
+	for (uint32_t i = 0; i < header->planes; i++) {
+		uint8_t  *dst     = slot_data + header->plane_offset[i];
+		uint32_t linesize = header->linesize[i];
+		uint32_t height   = he->plane_height[i];
+
+		if (frame->linesize[i] == linesize) {
+			memcpy(dst, frame->data[i], linesize * height);
+			continue;
+		}
+
+		for (uint32_t y = 0; y < height; y++)
+			memcpy(dst + y * linesize,
+					frame->data[i] + y * frame->linesize[i],
+					linesize);
+	}
+
+	slot->pts   = frame->pts;
+	slot->flags = 0;
+	if (frame->duplicate)
+		slot->flags |= HOST_FRAME_DUPLICATE;
+	if (frame->force_keyframe || he->keyframe_pending)
+		slot->flags |= HOST_FRAME_KEYFRAME;
+
+	he->keyframe_pending = false;
+
+	HOST_BARRIER();
+	header->frame_write = write + 1;
+	host_sem_post(&he->frame_sem);
+	return true;
+}
+
+static bool receive_packet(struct hosted_encoder *he,
+		struct encoder_packet *packet)
+{
+	struct host_header      *header = he->header;
+	struct host_packet_slot *slot;
+	uint32_t                read = header->packet_read;
+
+	if (read == header->packet_write)
+		return false;
+
+	HOST_BARRIER();
+
+	slot = (struct host_packet_slot*)(he->map.data +
+			header->packet_offset +
+			(uint64_t)(read & (HOST_PACKET_SLOTS - 1)) *
+			header->packet_slot_size);
+
+	/* the slot is handed back right away, so the data is copied */
+	da_resize(he->packet_data, 0);
+	da_push_back_array(he->packet_data,
+			(uint8_t*)slot + HOST_SLOT_DATA_OFFSET, slot->size);
+
+	packet->data          = he->packet_data.array;
+	packet->size          = he->packet_data.num;
+	packet->pts           = slot->pts;
+	packet->dts           = slot->dts;
+	packet->keyframe      = slot->keyframe != 0;
+	packet->priority      = slot->priority;
+	packet->drop_priority = slot->drop_priority;
+	packet->avcc          = slot->avcc != 0;
+	packet->type          = OBS_ENCODER_VIDEO;
+
+	HOST_BARRIER();
+	header->packet_read = read + 1;
+	return true;
+}
+
+static bool hosted_encode(void *data, struct encoder_frame *frame,
+		struct encoder_packet *packet, bool *received_packet)
+{
+	struct hosted_encoder *he = data;
+
+	if (!he->running || !host_process_alive(he->process)) {
+		if (he->running) {
+			warn("host exited unexpectedly");
+			he->process = 0;
+			he->running = false;
+		}
+
+		if (!restart_host(he))
+			return false;
+	}
+
+	if (send_frame(he, frame)) {
+		he->stall_start = 0;
+
+	} else {
+		uint64_t now = os_gettime_ns();
+
+		/* a host that stops taking frames is treated as crashed */
+		if (!he->stall_start) {
+			he->stall_start = now;
+		} else if (now - he->stall_start > STALL_TIMEOUT_NS) {
+			warn("host stopped responding");
+			if (!restart_host(he))
+				return false;
+		}
+	}
+
+	/* packets come back at least a frame late, the encoder's delay is
+	 * one frame longer than it would be in process */
+	*received_packet = receive_packet(he, packet);
+	return true;
+}
+
+static bool hosted_extra_data(void *data, uint8_t **extra_data, size_t *size)
+{
+	struct hosted_encoder *he = data;
+
+	*extra_data = he->extra_data.array;
+	*size       = he->extra_data.num;
+	return he->extra_data.num != 0;
+}
+
+static bool hosted_sei_data(void *data, uint8_t **sei_data, size_t *size)
+{
+	struct hosted_encoder *he = data;
+
+	*sei_data = he->sei_data.array;
+	*size     = he->sei_data.num;
+	return he->sei_data.num != 0;
+}
+
+static bool hosted_video_info(void *data, struct video_scale_info *info)
+{
+	struct hosted_encoder *he = data;
+	video_t video = obs_encoder_video(he->encoder);
+	const struct video_output_info *voi = video_output_getinfo(video);
+
+	if (format_supported(voi->format))
+		return false;
+
+	info->format     = he->format;
+	info->width      = obs_encoder_get_width(he->encoder);
+	info->height     = obs_encoder_get_height(he->encoder);
+	info->range      = VIDEO_RANGE_DEFAULT;
+	info->colorspace = VIDEO_CS_DEFAULT;
+	return true;
+}
+
+static void hosted_defaults(obs_data_t settings)
+{
+	obs_data_set_default_string(settings, "module", "obs-x264");
+	obs_data_set_default_string(settings, "encoder", "obs_x264");
+}
+
+static obs_properties_t hosted_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_text(props, "module", "Module", OBS_TEXT_DEFAULT);
+	obs_properties_add_text(props, "encoder", "Encoder", OBS_TEXT_DEFAULT);
+	return props;
+}
+
+static struct obs_encoder_info hosted_encoder_info = {
+	.id         = "hosted_h264",
+	.type       = OBS_ENCODER_VIDEO,
+	.codec      = "h264",
+	.getname    = hosted_getname,
+	.create     = hosted_create,
+	.destroy    = hosted_destroy,
+	.encode     = hosted_encode,
+	.update     = hosted_update,
+	.extra_data = hosted_extra_data,
+	.sei_data   = hosted_sei_data,
+	.video_info = hosted_video_info,
+	.defaults   = hosted_defaults,
+	.properties = hosted_properties
+};
+
+bool obs_module_load(uint32_t libobs_ver)
+{
+	obs_register_encoder(&hosted_encoder_info);
+
+	UNUSED_PARAMETER(libobs_ver);
+	return true;
+}
@@ -0,0 +1,282 @@
+/*
+Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <jack/jack.h>
+
+#include <obs.h>
+#include <util/bmem.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+
+#define JACK_DATA(voidptr) struct jack_data *data = voidptr;
+
+/*
+ * A JACK client with one input port per channel.  Audio is output from the
+ * process callback on the real-time thread of JACK: the port buffers are
+ * already float planar, so they're passed to libobs as they are, one JACK
+ * period at a time, without allocating or copying anything here.
+ *
+ * The timestamp of a period is taken from the cycle times JACK filters from
+ * the hardware interrupts, so consecutive periods line up to the sample.
+ */
+struct jack_data {
+	obs_source_t        source;
+	char                *client_name;
+	enum speaker_layout speakers;
+	uint32_t            channels;
+	bool                start_server;
+
+	jack_client_t       *client;
+	jack_port_t         *ports[MAX_AV_PLANES];
+	uint32_t            samples_per_sec;
+
+	/* difference between os_gettime_ns and the jack clock */
+	int64_t             clock_offset;
+};
+
+static inline uint32_t speakers_to_channels(enum speaker_layout speakers)
+{
+	uint32_t channels = get_audio_channels(speakers);
+	return channels > MAX_AV_PLANES ? MAX_AV_PLANES : channels;
+}
+
+static uint64_t period_timestamp(struct jack_data *data,
+		jack_nframes_t frames)
+{
+	jack_nframes_t current_frames;
+	jack_time_t    current_usecs;
+	jack_time_t    next_usecs;
+	float          period_usecs;
+	uint64_t       ts;
+
+	/* the cycle started when the period was captured, so the first
+	 * sample is one period before that */
+	if (jack_get_cycle_times(data->client, &current_frames,
+				&current_usecs, &next_usecs,
+				&period_usecs) == 0)
+		ts = current_usecs * 1000ULL;
+	else
+		ts = jack_get_time() * 1000ULL;
+
+	ts = (uint64_t)((int64_t)ts + data->clock_offset);
+	return ts - (uint64_t)frames * 1000000000ULL / data->samples_per_sec;
+}
+
+static int jack_process_callback(jack_nframes_t frames, void *vptr)
+{
+	JACK_DATA(vptr);
+	struct source_audio out;
+
+	memset(out.data, 0, sizeof(out.data));
+
+	for (uint32_t i = 0; i < data->channels; i++)
+		out.data[i] = jack_port_get_buffer(data->ports[i], frames);
+
+	out.frames          = frames;
+	out.speakers        = data->speakers;
+	out.format          = AUDIO_FORMAT_FLOAT_PLANAR;
+	out.samples_per_sec = data->samples_per_sec;
+	out.timestamp       = period_timestamp(data, frames);
+
+	obs_source_output_audio(data->source, &out);
+	return 0;
+}
+
+static int jack_sample_rate_callback(jack_nframes_t rate, void *vptr)
+{
+	JACK_DATA(vptr);
+	data->samples_per_sec = rate;
+	return 0;
+}
+
+static void jack_shutdown_callback(void *vptr)
+{
+	JACK_DATA(vptr);
+	blog(LOG_WARNING, "jack-input: %s: JACK server shut down",
+			data->client_name);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void jack_stop_client(struct jack_data *data)
+{
+	if (!data->client)
+		return;
+
+	jack_deactivate(data->client);
+	jack_client_close(data->client);
+	data->client = NULL;
+	memset(data->ports, 0, sizeof(data->ports));
+}
+
+static bool jack_register_ports(struct jack_data *data)
+{
+	struct dstr name = {0};
+
+	for (uint32_t i = 0; i < data->channels; i++) {
+		dstr_printf(&name, "in_%u", i + 1);
+
+		data->ports[i] = jack_port_register(data->client, name.array,
+				JACK_DEFAULT_AUDIO_TYPE,
+				JackPortIsInput | JackPortIsTerminal, 0);
+		if (!data->ports[i])
+			break;
+	}
+
+	dstr_free(&name);
+	return data->ports[data->channels - 1] != NULL;
+}
+
+static void jack_start_client(struct jack_data *data)
+{
+	jack_options_t options = data->start_server ?
+		JackNullOption : JackNoStartServer;
+	jack_status_t  status;
+
+	data->client = jack_client_open(data->client_name, options, &status);
+	if (!data->client) {
+		blog(LOG_WARNING, "jack-input: %s: Failed to connect to the "
+		                  "JACK server (status 0x%x)",
+		                  data->client_name, (unsigned)status);
+		return;
+	}
+
+	if (!jack_register_ports(data)) {
+		blog(LOG_ERROR, "jack-input: %s: Failed to register ports",
+				data->client_name);
+		goto fail;
+	}
+
+	data->samples_per_sec = jack_get_sample_rate(data->client);
+	data->clock_offset    = (int64_t)os_gettime_ns() -
+		(int64_t)(jack_get_time() * 1000ULL);
+
+	jack_set_process_callback(data->client, jack_process_callback, data);
+	jack_set_sample_rate_callback(data->client,
+			jack_sample_rate_callback, data);
+	jack_on_shutdown(data->client, jack_shutdown_callback, data);
+
+	if (jack_activate(data->client) != 0) {
+		blog(LOG_ERROR, "jack-input: %s: Failed to activate client",
+				data->client_name);
+		goto fail;
+	}
+
+	blog(LOG_INFO, "jack-input: %s: Started with %u channels at %u Hz, "
+	               "%u frames per period", data->client_name,
+	               data->channels, data->samples_per_sec,
+	               (unsigned)jack_get_buffer_size(data->client));
+	return;
+
+fail:
+	jack_stop_client(data);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const char *jack_input_getname(const char *locale)
+{
+	/* TODO: locale */
+	UNUSED_PARAMETER(locale);
+	return "JACK Input Client";
+}
+
+static void jack_input_update(void *vptr, obs_data_t settings)
+{
+	JACK_DATA(vptr);
+	enum speaker_layout speakers = (enum speaker_layout)obs_data_getint(
+			settings, "speakers");
+	bool start_server = obs_data_getbool(settings, "start_server");
+
+	if (!speakers_to_channels(speakers))
+		speakers = SPEAKERS_STEREO;
+
+	/* ports can only be changed with the client stopped */
+	if (data->client && speakers == data->speakers &&
+	    start_server == data->start_server)
+		return;
+
+	jack_stop_client(data);
+
+	data->speakers     = speakers;
+	data->channels     = speakers_to_channels(speakers);
+	data->start_server = start_server;
+
+	jack_start_client(data);
+}
+
+static void jack_input_destroy(void *vptr)
+{
+	JACK_DATA(vptr);
+
+	if (data) {
+		jack_stop_client(data);
+		bfree(data->client_name);
+		bfree(data);
+	}
+}
+
+static void *jack_input_create(obs_data_t settings, obs_source_t source)
+{
+	struct jack_data *data = bzalloc(sizeof(struct jack_data));
+	const char       *name = obs_source_getname(source);
+
+	data->source      = source;
+	data->client_name = bstrdup(name && *name ? name : "OBS");
+
+	jack_input_update(data, settings);
+	return data;
+}
+
+static void jack_input_defaults(obs_data_t settings)
+{
+	obs_data_set_default_int(settings, "speakers", SPEAKERS_STEREO);
+	obs_data_set_default_bool(settings, "start_server", false);
+}
+
+static obs_properties_t jack_input_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+	obs_property_t   p;
+
+	/* TODO: translate */
+	p = obs_properties_add_list(props, "speakers", "Channels",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(p, "Mono",   SPEAKERS_MONO);
+	obs_property_list_add_int(p, "Stereo", SPEAKERS_STEREO);
+	obs_property_list_add_int(p, "2.1",    SPEAKERS_2POINT1);
+	obs_property_list_add_int(p, "4.0",    SPEAKERS_QUAD);
+	obs_property_list_add_int(p, "4.1",    SPEAKERS_4POINT1);
+	obs_property_list_add_int(p, "5.1",    SPEAKERS_5POINT1);
+	obs_property_list_add_int(p, "7.1",    SPEAKERS_7POINT1);
+
+	obs_properties_add_bool(props, "start_server",
+			"Start the JACK server if it isn't running");
+	return props;
+}
+
+struct obs_source_info jack_input = {
+	.id           = "jack_input_client",
+	.type         = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_AUDIO,
+	.getname      = jack_input_getname,
+	.create       = jack_input_create,
+	.destroy      = jack_input_destroy,
+	.update       = jack_input_update,
+	.defaults     = jack_input_defaults,
+	.properties   = jack_input_properties
+};
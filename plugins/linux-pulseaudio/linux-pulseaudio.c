@@ -20,11 +20,13 @@ OBS_DECLARE_MODULE()
 
 extern struct obs_source_info pulse_input_capture;
 extern struct obs_source_info pulse_output_capture;
+extern struct obs_output_info pulse_monitor_output;
 
 bool obs_module_load(uint32_t obs_version)
 {
 	UNUSED_PARAMETER(obs_version);
 	obs_register_source(&pulse_input_capture);
 	obs_register_source(&pulse_output_capture);
+	obs_register_output(&pulse_monitor_output);
 	return true;
 }
@@ -23,6 +23,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define PULSE_DATA(voidptr) struct pulse_data *data = voidptr;
 
+#define MIN_LATENCY_MS    1
+#define MAX_LATENCY_MS    100
+
+/* audio is passed on in blocks of this many milliseconds */
+#define BATCH_MS          10
+
+/* interval in nanoseconds at which the stream latency is queried again */
+#define SYNC_INTERVAL     1000000000ULL
+
+/* maximum drift in nanoseconds between the extrapolated timestamp and the
+ * measured one before the timestamps are resynced */
+#define MAX_DRIFT         20000000ULL
+
 struct pulse_data {
 	obs_source_t source;
 	char *device;
@@ -37,6 +50,18 @@ struct pulse_data {
 	pa_stream *stream;
 
 	bool ostime;
+	bool low_latency;
+	int_fast32_t latency_ms;
+
+	uint8_t *batch;
+	uint_fast32_t batch_frames;
+	uint_fast32_t batch_count;
+	uint64_t batch_ts;
+
+	bool synced;
+	uint64_t sync_ts;
+	uint64_t sync_frames;
+	uint64_t last_sync;
 };
 
 static void pulse_stop_recording(struct pulse_data *data);
@@ -72,6 +97,20 @@ static uint_fast32_t get_buffer_size(struct pulse_data *data,
 	return (length * data->samples_per_sec * data->bytes_per_frame) / 1000;
 }
 
+static inline int_fast32_t clamp_latency_ms(int_fast32_t ms)
+{
+	if (ms < MIN_LATENCY_MS)
+		return MIN_LATENCY_MS;
+	if (ms > MAX_LATENCY_MS)
+		return MAX_LATENCY_MS;
+	return ms;
+}
+
+static inline uint64_t frames_to_ns(struct pulse_data *data, uint64_t frames)
+{
+	return frames * 1000000000ULL / data->samples_per_sec;
+}
+
 /**
  * Get latency for a pulse audio stream
  */
@@ -86,6 +125,128 @@ static int pulse_get_stream_latency(pa_stream *stream, int64_t *latency)
 	return ret;
 }
 
+/**
+ * Get the timestamp of the data at the read index of the stream
+ */
+static bool pulse_get_timestamp(struct pulse_data *data, uint64_t *ts)
+{
+	pa_usec_t pa_time;
+	int64_t pa_latency;
+
+	if (pa_stream_get_time(data->stream, &pa_time) < 0)
+		return false;
+
+	pulse_get_stream_latency(data->stream, &pa_latency);
+
+	*ts = (!data->ostime) ? pa_time * 1000 : os_gettime_ns();
+	*ts -= pa_latency * 1000;
+	return true;
+}
+
+/**
+ * Pass audio data on to obs
+ */
+static void pulse_output_audio(struct pulse_data *data, const uint8_t *frames,
+	uint_fast32_t count, uint64_t timestamp)
+{
+	struct source_audio out;
+	out.speakers        = data->speakers;
+	out.samples_per_sec = data->samples_per_sec;
+	out.format          = pulse_to_obs_audio_format(data->format);
+	out.data[0]         = frames;
+	out.frames          = count;
+	out.timestamp       = timestamp;
+	obs_source_output_audio(data->source, &out);
+}
+
+/**
+ * Pass on the frames collected so far, even if the block isn't full
+ */
+static void pulse_flush_batch(struct pulse_data *data)
+{
+	if (data->batch_count) {
+		pulse_output_audio(data, data->batch, data->batch_count,
+			data->batch_ts);
+		data->batch_count = 0;
+	}
+}
+
+/**
+ * Collect audio data into blocks of batch_frames
+ *
+ * Whole blocks at the start of a chunk are passed on without a copy when
+ * there is nothing pending.
+ */
+static void pulse_batch_audio(struct pulse_data *data, const uint8_t *frames,
+	uint_fast32_t count, uint64_t timestamp)
+{
+	const uint_fast32_t bpf = data->bytes_per_frame;
+
+	if (!data->batch_count && count >= data->batch_frames) {
+		uint_fast32_t direct = count - count % data->batch_frames;
+
+		pulse_output_audio(data, frames, direct, timestamp);
+		frames    += direct * bpf;
+		count     -= direct;
+		timestamp += frames_to_ns(data, direct);
+	}
+
+	while (count) {
+		uint_fast32_t n = data->batch_frames - data->batch_count;
+		if (n > count)
+			n = count;
+
+		if (!data->batch_count)
+			data->batch_ts = timestamp;
+
+		memcpy(data->batch + data->batch_count * bpf, frames, n * bpf);
+		data->batch_count += n;
+		frames    += n * bpf;
+		count     -= n;
+		timestamp += frames_to_ns(data, n);
+
+		if (data->batch_count == data->batch_frames)
+			pulse_flush_batch(data);
+	}
+}
+
+/**
+ * Get the timestamp for the next chunk of audio
+ *
+ * Timestamps are extrapolated from the number of frames read since the last
+ * sync. The stream latency is only queried once every SYNC_INTERVAL, and the
+ * timestamps are only resynced when they drifted by more than MAX_DRIFT, so
+ * the jitter of the latency measurement doesn't end up in the timestamps.
+ */
+static bool pulse_sync_timestamp(struct pulse_data *data, uint64_t *ts)
+{
+	uint64_t now = os_gettime_ns();
+
+	if (!data->synced || now - data->last_sync >= SYNC_INTERVAL) {
+		uint64_t measured;
+		uint64_t expected;
+		uint64_t diff;
+
+		if (!pulse_get_timestamp(data, &measured))
+			return data->synced;
+
+		expected = data->sync_ts + frames_to_ns(data, data->sync_frames);
+		diff = (measured > expected)
+			? measured - expected : expected - measured;
+
+		if (!data->synced || diff > MAX_DRIFT) {
+			data->sync_ts     = measured;
+			data->sync_frames = 0;
+			data->synced      = true;
+		}
+
+		data->last_sync = now;
+	}
+
+	*ts = data->sync_ts + frames_to_ns(data, data->sync_frames);
+	return true;
+}
+
 /**
  * Callback for pulse which gets executed when new audio data is available
  *
@@ -99,8 +260,8 @@ static void pulse_stream_read(pa_stream *p, size_t nbytes, void *userdata)
 
 	const void *frames;
 	size_t bytes;
-	uint64_t pa_time;
-	int64_t pa_latency;
+	uint64_t timestamp;
+	uint_fast32_t count;
 
 	if (!data->stream)
 		goto exit;
@@ -115,28 +276,22 @@ static void pulse_stream_read(pa_stream *p, size_t nbytes, void *userdata)
 		blog(LOG_DEBUG,
 			"pulse-input: Got audio hole of %u bytes",
 			(unsigned int) bytes);
+		pulse_flush_batch(data);
+		data->synced = false;
 		pa_stream_drop(data->stream);
 		goto exit;
 	}
 
-	if (pa_stream_get_time(data->stream, &pa_time) < 0) {
+	if (!pulse_sync_timestamp(data, &timestamp)) {
 		blog(LOG_ERROR,
 			"pulse-input: Failed to get timing info !");
 		pa_stream_drop(data->stream);
 		goto exit;
 	}
-	pa_time = (!data->ostime) ? pa_time * 1000 : os_gettime_ns();
-
-	pulse_get_stream_latency(data->stream, &pa_latency);
 
-	struct source_audio out;
-	out.speakers        = data->speakers;
-	out.samples_per_sec = data->samples_per_sec;
-	out.format          = pulse_to_obs_audio_format(data->format);
-	out.data[0]         = (uint8_t *) frames;
-	out.frames          = bytes / data->bytes_per_frame;
-	out.timestamp       = pa_time - (pa_latency * 1000);
-	obs_source_output_audio(data->source, &out);
+	count = bytes / data->bytes_per_frame;
+	pulse_batch_audio(data, frames, count, timestamp);
+	data->sync_frames += count;
 
 	pa_stream_drop(data->stream);
 
@@ -189,6 +344,15 @@ static int_fast32_t pulse_start_recording(struct pulse_data *data)
 	blog(LOG_DEBUG, "pulse-input: %u bytes per frame",
 	     (unsigned int) data->bytes_per_frame);
 
+	uint_fast32_t batch_ms = BATCH_MS;
+	if (data->low_latency && data->latency_ms < BATCH_MS)
+		batch_ms = data->latency_ms;
+
+	data->batch_frames = data->samples_per_sec * batch_ms / 1000;
+	data->batch_count  = 0;
+	data->batch        = bmalloc(data->batch_frames * data->bytes_per_frame);
+	data->synced       = false;
+
 	data->stream = pulse_stream_new(obs_source_getname(data->source),
 		&spec, NULL);
 	if (!data->stream) {
@@ -201,9 +365,16 @@ static int_fast32_t pulse_start_recording(struct pulse_data *data)
 		(void *) data);
 	pulse_unlock();
 
+	/* in low latency mode the server is asked to deliver a fragment each
+	 * latency_ms, and to never keep more than a few of them buffered */
 	pa_buffer_attr attr;
-	attr.fragsize  = get_buffer_size(data, 250);
-	attr.maxlength = (uint32_t) -1;
+	if (data->low_latency) {
+		attr.fragsize  = get_buffer_size(data, data->latency_ms);
+		attr.maxlength = get_buffer_size(data, data->latency_ms * 4);
+	} else {
+		attr.fragsize  = get_buffer_size(data, 250);
+		attr.maxlength = (uint32_t) -1;
+	}
 	attr.minreq    = (uint32_t) -1;
 	attr.prebuf    = (uint32_t) -1;
 	attr.tlength   = (uint32_t) -1;
@@ -239,6 +410,11 @@ static void pulse_stop_recording(struct pulse_data *data)
 		data->stream = NULL;
 		pulse_unlock();
 	}
+
+	if (data->batch) {
+		bfree(data->batch);
+		data->batch = NULL;
+	}
 }
 
 /**
@@ -276,20 +452,42 @@ skip:
 }
 
 /**
- * Get plugin properties
+ * Enumerate the devices, called from the list enumeration thread
  */
-static obs_properties_t pulse_properties(const char *locale, bool input)
+static void pulse_fill_devices(obs_property_t devices, bool input)
 {
-	obs_properties_t props = obs_properties_create(locale);
-	obs_property_t devices = obs_properties_add_list(props, "device_id",
-		"Device", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
-
 	pulse_init();
 	pa_source_info_cb_t cb = (input) ? pulse_input_info : pulse_output_info;
 	pulse_get_source_info_list(cb, (void *) devices);
 	pulse_unref();
+}
+
+static void pulse_fill_input_devices(obs_property_t devices)
+{
+	pulse_fill_devices(devices, true);
+}
+
+static void pulse_fill_output_devices(obs_property_t devices)
+{
+	pulse_fill_devices(devices, false);
+}
+
+/**
+ * Get plugin properties
+ */
+static obs_properties_t pulse_properties(const char *locale, bool input)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	obs_properties_add_async_list(props, "device_id", "Device",
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING,
+		(input) ? "pulse_input_devices" : "pulse_output_devices",
+		(input) ? pulse_fill_input_devices : pulse_fill_output_devices);
 
 	obs_properties_add_bool(props, "ostime", "Use OS timestamps");
+	obs_properties_add_bool(props, "low_latency", "Low latency mode");
+	obs_properties_add_int(props, "latency_ms", "Latency (ms)",
+		MIN_LATENCY_MS, MAX_LATENCY_MS, 1);
 
 	return props;
 }
@@ -352,6 +550,8 @@ static void pulse_defaults(obs_data_t settings, bool input)
 	pulse_unref();
 
 	obs_data_set_default_bool(settings, "ostime", false);
+	obs_data_set_default_bool(settings, "low_latency", false);
+	obs_data_set_default_int(settings, "latency_ms", 10);
 }
 
 static void pulse_input_defaults(obs_data_t settings)
@@ -422,6 +622,18 @@ static void pulse_update(void *vptr, obs_data_t settings)
 		restart = true;
 	}
 
+	if (data->low_latency != obs_data_getbool(settings, "low_latency")) {
+		data->low_latency = obs_data_getbool(settings, "low_latency");
+		restart = true;
+	}
+
+	int_fast32_t latency_ms = clamp_latency_ms(
+		obs_data_getint(settings, "latency_ms"));
+	if (data->latency_ms != latency_ms) {
+		data->latency_ms = latency_ms;
+		restart = data->low_latency || restart;
+	}
+
 	if (!restart)
 		return;
 
@@ -453,7 +665,7 @@ static void *pulse_create(obs_data_t settings, obs_source_t source)
 struct obs_source_info pulse_input_capture = {
 	.id           = "pulse_input_capture",
 	.type         = OBS_SOURCE_TYPE_INPUT,
-	.output_flags = OBS_SOURCE_AUDIO,
+	.output_flags = OBS_SOURCE_AUDIO | OBS_SOURCE_THREADED_CREATE,
 	.getname      = pulse_input_getname,
 	.create       = pulse_create,
 	.destroy      = pulse_destroy,
@@ -465,7 +677,7 @@ struct obs_source_info pulse_input_capture = {
 struct obs_source_info pulse_output_capture = {
 	.id           = "pulse_output_capture",
 	.type         = OBS_SOURCE_TYPE_INPUT,
-	.output_flags = OBS_SOURCE_AUDIO,
+	.output_flags = OBS_SOURCE_AUDIO | OBS_SOURCE_THREADED_CREATE,
 	.getname      = pulse_output_getname,
 	.create       = pulse_create,
 	.destroy      = pulse_destroy,
@@ -0,0 +1,295 @@
+/*
+Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <util/bmem.h>
+#include <media-io/audio-monitor.h>
+#include <obs.h>
+
+#include "pulse-wrapper.h"
+
+#define PULSE_MONITOR(voidptr) struct pulse_monitor *data = voidptr;
+
+/* half of the latency is kept in the jitter buffer, the other half is the
+ * amount the server is asked to keep buffered */
+#define DEFAULT_LATENCY_MS 40
+
+struct pulse_monitor {
+	obs_output_t output;
+	char *device;
+	uint_fast32_t latency_ms;
+
+	uint_fast32_t samples_per_sec;
+	uint_fast32_t bytes_per_frame;
+
+	pa_stream *stream;
+	audio_monitor_t monitor;
+};
+
+static void pulse_monitor_stop(void *vptr);
+
+/**
+ * Get the buffer size needed for length msec with current settings
+ */
+static uint_fast32_t get_buffer_size(struct pulse_monitor *data,
+	uint_fast32_t length)
+{
+	return (length * data->samples_per_sec * data->bytes_per_frame) / 1000;
+}
+
+/**
+ * Callback for pulse which gets executed when the server wants more data
+ *
+ * Whatever the jitter buffer can't provide is filled with silence.
+ */
+static void pulse_monitor_write(pa_stream *p, size_t nbytes, void *userdata)
+{
+	PULSE_MONITOR(userdata);
+	void *buffer;
+
+	if (!data->stream || !data->monitor)
+		goto exit;
+
+	if (pa_stream_begin_write(p, &buffer, &nbytes) < 0 || !buffer)
+		goto exit;
+
+	nbytes -= nbytes % data->bytes_per_frame;
+	audio_monitor_pop(data->monitor, buffer,
+		(uint32_t) (nbytes / data->bytes_per_frame));
+	pa_stream_write(p, buffer, nbytes, NULL, 0, PA_SEEK_RELATIVE);
+
+exit:
+	pulse_signal(0);
+}
+
+/**
+ * Audio from the output, already converted to the stream format
+ */
+static void pulse_monitor_raw_audio(void *vptr, struct audio_data *frames)
+{
+	PULSE_MONITOR(vptr);
+	audio_monitor_push(data->monitor, frames);
+}
+
+static bool pulse_monitor_start(void *vptr)
+{
+	PULSE_MONITOR(vptr);
+	const struct audio_output_info *info;
+	struct audio_convert_info conv;
+	struct resample_info monitor_info;
+
+	if (!obs_output_can_begin_data_capture(data->output, 0))
+		return false;
+
+	info = audio_output_getinfo(obs_output_audio(data->output));
+
+	pa_sample_spec spec;
+	spec.format   = PA_SAMPLE_FLOAT32LE;
+	spec.rate     = info->samples_per_sec;
+	spec.channels = get_audio_channels(info->speakers);
+
+	if (!pa_sample_spec_valid(&spec)) {
+		blog(LOG_ERROR, "pulse-monitor: Sample spec is not valid");
+		return false;
+	}
+
+	data->samples_per_sec = spec.rate;
+	data->bytes_per_frame = pa_frame_size(&spec);
+
+	monitor_info.samples_per_sec = spec.rate;
+	monitor_info.format          = AUDIO_FORMAT_FLOAT;
+	monitor_info.speakers        = info->speakers;
+
+	data->monitor = audio_monitor_create(&monitor_info,
+		data->latency_ms / 2);
+	if (!data->monitor)
+		return false;
+
+	data->stream = pulse_stream_new("OBS Monitor",
+		&spec, NULL);
+	if (!data->stream) {
+		blog(LOG_ERROR, "pulse-monitor: Unable to create stream");
+		pulse_monitor_stop(data);
+		return false;
+	}
+
+	pulse_lock();
+	pa_stream_set_write_callback(data->stream, pulse_monitor_write,
+		(void *) data);
+	pulse_unlock();
+
+	/* playback starts right away, the jitter buffer outputs silence until
+	 * it has filled up */
+	pa_buffer_attr attr;
+	attr.tlength   = get_buffer_size(data, data->latency_ms / 2);
+	attr.minreq    = get_buffer_size(data, data->latency_ms / 8 + 1);
+	attr.prebuf    = 0;
+	attr.maxlength = (uint32_t) -1;
+	attr.fragsize  = (uint32_t) -1;
+
+	pa_stream_flags_t flags =
+		PA_STREAM_INTERPOLATE_TIMING
+		| PA_STREAM_AUTO_TIMING_UPDATE
+		| PA_STREAM_ADJUST_LATENCY;
+
+	const char *device = (data->device && *data->device)
+		? data->device : NULL;
+
+	pulse_lock();
+	int_fast32_t ret = pa_stream_connect_playback(data->stream, device,
+		&attr, flags, NULL, NULL);
+	pulse_unlock();
+	if (ret < 0) {
+		blog(LOG_ERROR, "pulse-monitor: Unable to connect to stream");
+		pulse_monitor_stop(data);
+		return false;
+	}
+
+	conv.samples_per_sec = monitor_info.samples_per_sec;
+	conv.format          = monitor_info.format;
+	conv.speakers        = monitor_info.speakers;
+	obs_output_set_audio_conversion(data->output, &conv);
+
+	if (!obs_output_begin_data_capture(data->output, 0)) {
+		pulse_monitor_stop(data);
+		return false;
+	}
+
+	blog(LOG_DEBUG, "pulse-monitor: Monitoring started");
+	return true;
+}
+
+static void pulse_monitor_stop(void *vptr)
+{
+	PULSE_MONITOR(vptr);
+
+	obs_output_end_data_capture(data->output);
+
+	if (data->stream) {
+		pulse_lock();
+		pa_stream_disconnect(data->stream);
+		pa_stream_unref(data->stream);
+		data->stream = NULL;
+		pulse_unlock();
+	}
+
+	audio_monitor_destroy(data->monitor);
+	data->monitor = NULL;
+}
+
+static void pulse_monitor_update(void *vptr, obs_data_t settings)
+{
+	PULSE_MONITOR(vptr);
+
+	bfree(data->device);
+	data->device     = bstrdup(obs_data_getstring(settings, "device_id"));
+	data->latency_ms = obs_data_getint(settings, "latency_ms");
+}
+
+static void *pulse_monitor_create(obs_data_t settings, obs_output_t output)
+{
+	struct pulse_monitor *data = bzalloc(sizeof(struct pulse_monitor));
+
+	data->output = output;
+
+	pulse_init();
+	pulse_monitor_update(data, settings);
+	return data;
+}
+
+static void pulse_monitor_destroy(void *vptr)
+{
+	PULSE_MONITOR(vptr);
+
+	if (!data)
+		return;
+
+	if (data->stream)
+		pulse_monitor_stop(data);
+	pulse_unref();
+
+	bfree(data->device);
+	bfree(data);
+}
+
+/**
+ * sink info callback
+ */
+static void pulse_sink_info(pa_context *c, const pa_sink_info *i, int eol,
+	void *userdata)
+{
+	UNUSED_PARAMETER(c);
+	if (eol != 0)
+		goto skip;
+
+	obs_property_list_add_string((obs_property_t) userdata,
+		i->description, i->name);
+
+skip:
+	pulse_signal(0);
+}
+
+/**
+ * Enumerate the sinks, called from the list enumeration thread
+ */
+static void pulse_fill_sinks(obs_property_t devices)
+{
+	obs_property_list_add_string(devices, "Default", "");
+
+	pulse_init();
+	pulse_get_sink_info_list(pulse_sink_info, (void *) devices);
+	pulse_unref();
+}
+
+static obs_properties_t pulse_monitor_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	obs_properties_add_async_list(props, "device_id", "Device",
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING,
+		"pulse_sinks", pulse_fill_sinks);
+	obs_properties_add_int(props, "latency_ms", "Latency (ms)",
+		AUDIO_MONITOR_MIN_LATENCY_MS * 2,
+		AUDIO_MONITOR_MAX_LATENCY_MS, 1);
+
+	return props;
+}
+
+static void pulse_monitor_defaults(obs_data_t settings)
+{
+	obs_data_set_default_string(settings, "device_id", "");
+	obs_data_set_default_int(settings, "latency_ms", DEFAULT_LATENCY_MS);
+}
+
+static const char *pulse_monitor_getname(const char *locale)
+{
+	UNUSED_PARAMETER(locale);
+	return "Pulse Audio Monitor";
+}
+
+struct obs_output_info pulse_monitor_output = {
+	.id         = "pulse_monitor_output",
+	.flags      = OBS_OUTPUT_AUDIO,
+	.getname    = pulse_monitor_getname,
+	.create     = pulse_monitor_create,
+	.destroy    = pulse_monitor_destroy,
+	.start      = pulse_monitor_start,
+	.stop       = pulse_monitor_stop,
+	.raw_audio  = pulse_monitor_raw_audio,
+	.update     = pulse_monitor_update,
+	.defaults   = pulse_monitor_defaults,
+	.properties = pulse_monitor_properties
+};
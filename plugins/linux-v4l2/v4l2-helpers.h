@@ -0,0 +1,75 @@
+/*
+Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/videodev2.h>
+
+#include <media-io/video-io.h>
+
+/* ioctls on a device can be interrupted by signals, in which case they are
+ * simply retried */
+static inline int v4l2_ioctl(int fd, unsigned long request, void *arg)
+{
+	int ret;
+
+	do {
+		ret = ioctl(fd, request, arg);
+	} while (ret == -1 && errno == EINTR);
+
+	return ret;
+}
+
+/* the pixel formats that can be output without conversion */
+static inline enum video_format v4l2_to_obs_video_format(uint32_t pixelformat)
+{
+	switch (pixelformat) {
+	case V4L2_PIX_FMT_YUYV:   return VIDEO_FORMAT_YUY2;
+	case V4L2_PIX_FMT_YVYU:   return VIDEO_FORMAT_YVYU;
+	case V4L2_PIX_FMT_UYVY:   return VIDEO_FORMAT_UYVY;
+	case V4L2_PIX_FMT_NV12:   return VIDEO_FORMAT_NV12;
+	case V4L2_PIX_FMT_YUV420: return VIDEO_FORMAT_I420;
+	case V4L2_PIX_FMT_BGR32:  return VIDEO_FORMAT_BGRX;
+	case V4L2_PIX_FMT_XBGR32: return VIDEO_FORMAT_BGRX;
+	case V4L2_PIX_FMT_ABGR32: return VIDEO_FORMAT_BGRA;
+	}
+
+	return VIDEO_FORMAT_NONE;
+}
+
+/* mjpeg is decoded by libobs, everything else is output as it is */
+static inline bool v4l2_format_supported(uint32_t pixelformat)
+{
+	return pixelformat == V4L2_PIX_FMT_MJPEG ||
+		v4l2_to_obs_video_format(pixelformat) != VIDEO_FORMAT_NONE;
+}
+
+/* frame intervals are stored in the settings as one integer, with the
+ * numerator in the upper and the denominator in the lower 32 bits */
+static inline long long v4l2_pack_interval(const struct v4l2_fract *interval)
+{
+	return ((long long)interval->numerator << 32) |
+		(long long)interval->denominator;
+}
+
+static inline void v4l2_unpack_interval(long long packed,
+		struct v4l2_fract *interval)
+{
+	interval->numerator   = (uint32_t)((uint64_t)packed >> 32);
+	interval->denominator = (uint32_t)packed;
+}
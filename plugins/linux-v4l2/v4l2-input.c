@@ -0,0 +1,904 @@
+/*
+Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <obs.h>
+#include <util/bmem.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include "v4l2-helpers.h"
+
+#define V4L2_DATA(voidptr) struct v4l2_data *data = voidptr;
+
+/* enough buffers that the device can keep capturing while a few frames are
+ * still waiting to be rendered */
+#define V4L2_BUFFER_COUNT  4
+
+/* how long the capture thread waits for a frame before it checks if it
+ * should stop */
+#define V4L2_POLL_TIMEOUT_MS 100
+
+/*
+ * Frames are captured on a separate thread, preferably into user pointer
+ * buffers: each buffer is a frame from the frame cache of the source, so a
+ * captured frame is handed to libobs as it is and replaced by another frame
+ * from the cache.  Devices that can't capture into user memory, or that use
+ * a memory layout that differs from the frame layout of libobs, capture into
+ * memory mapped buffers of the driver, which are copied on output.  MJPEG
+ * frames are always captured into mapped buffers, and are copied to the
+ * decode threads of libobs.
+ */
+struct v4l2_buffer_info {
+	void                *start;
+	size_t              length;
+	struct source_frame *frame;
+};
+
+struct v4l2_data {
+	obs_source_t            source;
+
+	/* settings */
+	char                    *device_id;
+	int                     input;
+	uint32_t                pixelformat;
+	uint32_t                req_width;
+	uint32_t                req_height;
+	long long               req_interval;
+
+	/* device state, only touched while the capture thread isn't running */
+	int                     dev;
+	enum v4l2_memory        memory;
+	uint32_t                fourcc;
+	bool                    mjpeg;
+	enum video_format       format;
+	uint32_t                width;
+	uint32_t                height;
+	uint32_t                linesize;
+	uint32_t                image_size;
+	uint32_t                buffer_count;
+	struct v4l2_buffer_info *buffers;
+
+	float                   color_matrix[16];
+	float                   color_range_min[3];
+	float                   color_range_max[3];
+
+	pthread_t               thread;
+	os_event_t              stop_event;
+	bool                    active;
+};
+
+/* ------------------------------------------------------------------------- */
+
+static inline uint64_t buffer_timestamp(const struct v4l2_buffer *buf)
+{
+	/* monotonic timestamps use the same clock as os_gettime_ns, and are
+	 * taken by the driver when the frame was captured */
+	if ((buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+			V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+		return (uint64_t)buf->timestamp.tv_sec * 1000000000ULL +
+			(uint64_t)buf->timestamp.tv_usec * 1000ULL;
+
+	return os_gettime_ns();
+}
+
+static void set_frame_info(struct v4l2_data *data, struct source_frame *frame,
+		uint64_t timestamp)
+{
+	frame->timestamp  = timestamp;
+	frame->full_range = false;
+	frame->flip       = false;
+	memcpy(frame->color_matrix, data->color_matrix, sizeof(float) * 16);
+	memcpy(frame->color_range_min, data->color_range_min,
+			sizeof(float) * 3);
+	memcpy(frame->color_range_max, data->color_range_max,
+			sizeof(float) * 3);
+}
+
+/* points the planes of a frame at the image in a mapped buffer */
+static void set_frame_planes(struct v4l2_data *data,
+		struct source_frame *frame, uint8_t *start)
+{
+	uint32_t luma_size = data->linesize * data->height;
+
+	memset(frame->data, 0, sizeof(frame->data));
+	memset(frame->linesize, 0, sizeof(frame->linesize));
+
+	frame->data[0]     = start;
+	frame->linesize[0] = data->linesize;
+
+	if (data->format == VIDEO_FORMAT_NV12) {
+		frame->data[1]     = start + luma_size;
+		frame->linesize[1] = data->linesize;
+
+	} else if (data->format == VIDEO_FORMAT_I420) {
+		frame->data[1]     = start + luma_size;
+		frame->data[2]     = frame->data[1] + luma_size / 4;
+		frame->linesize[1] = data->linesize / 2;
+		frame->linesize[2] = data->linesize / 2;
+	}
+}
+
+static bool queue_buffer(struct v4l2_data *data, uint32_t index)
+{
+	struct v4l2_buffer_info *info = data->buffers + index;
+	struct v4l2_buffer buf;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = data->memory;
+	buf.index  = index;
+
+	if (data->memory == V4L2_MEMORY_USERPTR) {
+		buf.m.userptr = (unsigned long)info->start;
+		buf.length    = (uint32_t)info->length;
+	}
+
+	return v4l2_ioctl(data->dev, VIDIOC_QBUF, &buf) == 0;
+}
+
+/* hands the captured frame to libobs and puts a new frame from the frame
+ * cache in its place */
+static void output_userptr_frame(struct v4l2_data *data,
+		struct v4l2_buffer_info *info, uint64_t timestamp)
+{
+	struct source_frame *frame = info->frame;
+
+	set_frame_info(data, frame, timestamp);
+	obs_source_output_video_direct(data->source, frame);
+
+	info->frame = obs_source_allocframe(data->source, data->format,
+			data->width, data->height);
+	info->start = info->frame->data[0];
+}
+
+static void output_mmap_frame(struct v4l2_data *data,
+		struct v4l2_buffer_info *info, uint64_t timestamp)
+{
+	struct source_frame frame;
+
+	frame.format = data->format;
+	frame.width  = data->width;
+	frame.height = data->height;
+	set_frame_planes(data, &frame, info->start);
+	set_frame_info(data, &frame, timestamp);
+
+	obs_source_output_video(data->source, &frame);
+}
+
+/* returns false if capturing can't continue */
+static bool v4l2_capture_frame(struct v4l2_data *data)
+{
+	struct v4l2_buffer_info *info;
+	struct v4l2_buffer buf;
+	uint64_t timestamp;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = data->memory;
+
+	if (v4l2_ioctl(data->dev, VIDIOC_DQBUF, &buf) != 0) {
+		if (errno == EAGAIN)
+			return true;
+
+		blog(LOG_ERROR, "v4l2-input: %s: Failed to dequeue buffer: %s",
+				data->device_id, strerror(errno));
+		return false;
+	}
+
+	if (buf.index >= data->buffer_count)
+		return false;
+
+	info      = data->buffers + buf.index;
+	timestamp = buffer_timestamp(&buf);
+
+	/* corrupted frames are dropped, the device carries on */
+	if ((buf.flags & V4L2_BUF_FLAG_ERROR) == 0 && buf.bytesused &&
+	    (data->mjpeg || buf.bytesused >= data->image_size)) {
+		if (data->mjpeg)
+			obs_source_output_mjpeg(data->source, info->start,
+					buf.bytesused, timestamp);
+		else if (data->memory == V4L2_MEMORY_USERPTR)
+			output_userptr_frame(data, info, timestamp);
+		else
+			output_mmap_frame(data, info, timestamp);
+	}
+
+	if (!queue_buffer(data, buf.index)) {
+		blog(LOG_ERROR, "v4l2-input: %s: Failed to queue buffer: %s",
+				data->device_id, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+static void *v4l2_capture_thread(void *vptr)
+{
+	V4L2_DATA(vptr);
+	struct pollfd fds = {.fd = data->dev, .events = POLLIN};
+
+	os_thread_init(OS_THREAD_CLASS_VIDEO, "v4l2 capture");
+
+	while (os_event_try(data->stop_event) == EAGAIN) {
+		int ret = poll(&fds, 1, V4L2_POLL_TIMEOUT_MS);
+
+		if (ret < 0 && errno != EINTR) {
+			blog(LOG_ERROR, "v4l2-input: %s: poll failed: %s",
+					data->device_id, strerror(errno));
+			break;
+		}
+		if (ret <= 0)
+			continue;
+
+		if (!v4l2_capture_frame(data))
+			break;
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void v4l2_free_buffers(struct v4l2_data *data)
+{
+	struct v4l2_requestbuffers req;
+
+	if (!data->buffers)
+		return;
+
+	/* mapped buffers have to be unmapped before the driver can free
+	 * them, user memory only after the driver has let go of it */
+	for (uint32_t i = 0; i < data->buffer_count; i++) {
+		struct v4l2_buffer_info *info = data->buffers + i;
+		if (!info->frame && info->start && info->start != MAP_FAILED)
+			munmap(info->start, info->length);
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory = data->memory;
+	v4l2_ioctl(data->dev, VIDIOC_REQBUFS, &req);
+
+	for (uint32_t i = 0; i < data->buffer_count; i++)
+		source_frame_destroy(data->buffers[i].frame);
+
+	bfree(data->buffers);
+	data->buffers      = NULL;
+	data->buffer_count = 0;
+}
+
+static bool v4l2_request_buffers(struct v4l2_data *data,
+		enum v4l2_memory memory)
+{
+	struct v4l2_requestbuffers req;
+
+	memset(&req, 0, sizeof(req));
+	req.count  = V4L2_BUFFER_COUNT;
+	req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory = memory;
+
+	if (v4l2_ioctl(data->dev, VIDIOC_REQBUFS, &req) != 0 || !req.count)
+		return false;
+
+	data->memory       = memory;
+	data->buffer_count = req.count;
+	data->buffers      = bzalloc(sizeof(struct v4l2_buffer_info) *
+			req.count);
+	return true;
+}
+
+/* the size of a frame of the frame cache if its planes directly follow each
+ * other with the same line sizes the device uses, otherwise 0 */
+static size_t userptr_frame_size(struct v4l2_data *data,
+		const struct source_frame *frame)
+{
+	uint32_t luma_size = data->linesize * data->height;
+
+	if (frame->linesize[0] != data->linesize)
+		return 0;
+
+	switch (data->format) {
+	case VIDEO_FORMAT_NV12:
+		if (frame->data[1] != frame->data[0] + luma_size)
+			return 0;
+		return luma_size + luma_size / 2;
+
+	case VIDEO_FORMAT_I420:
+		if (frame->data[1] != frame->data[0] + luma_size ||
+		    frame->data[2] != frame->data[1] + luma_size / 4)
+			return 0;
+		return luma_size + luma_size / 2;
+
+	default:
+		return luma_size;
+	}
+}
+
+static bool v4l2_init_userptr(struct v4l2_data *data)
+{
+	if (!v4l2_request_buffers(data, V4L2_MEMORY_USERPTR))
+		return false;
+
+	for (uint32_t i = 0; i < data->buffer_count; i++) {
+		struct v4l2_buffer_info *info = data->buffers + i;
+		size_t size;
+
+		info->frame = obs_source_allocframe(data->source,
+				data->format, data->width, data->height);
+
+		size = userptr_frame_size(data, info->frame);
+		if (size < data->image_size)
+			goto fail;
+
+		info->start  = info->frame->data[0];
+		info->length = size;
+
+		/* drivers that need physically contiguous memory refuse user
+		 * memory when it's queued */
+		if (!queue_buffer(data, i))
+			goto fail;
+	}
+
+	return true;
+
+fail:
+	v4l2_free_buffers(data);
+	return false;
+}
+
+static bool v4l2_init_mmap(struct v4l2_data *data)
+{
+	if (!v4l2_request_buffers(data, V4L2_MEMORY_MMAP)) {
+		blog(LOG_ERROR, "v4l2-input: %s: Failed to request buffers: %s",
+				data->device_id, strerror(errno));
+		return false;
+	}
+
+	for (uint32_t i = 0; i < data->buffer_count; i++) {
+		struct v4l2_buffer_info *info = data->buffers + i;
+		struct v4l2_buffer buf;
+
+		memset(&buf, 0, sizeof(buf));
+		buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.index  = i;
+
+		if (v4l2_ioctl(data->dev, VIDIOC_QUERYBUF, &buf) != 0)
+			goto fail;
+
+		info->length = buf.length;
+		info->start  = mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
+				MAP_SHARED, data->dev, buf.m.offset);
+		if (info->start == MAP_FAILED)
+			goto fail;
+
+		if (!queue_buffer(data, i))
+			goto fail;
+	}
+
+	return true;
+
+fail:
+	blog(LOG_ERROR, "v4l2-input: %s: Failed to map buffers: %s",
+			data->device_id, strerror(errno));
+	v4l2_free_buffers(data);
+	return false;
+}
+
+/* picks the first format that can be output as it is */
+static uint32_t v4l2_default_pixelformat(int dev)
+{
+	struct v4l2_fmtdesc desc;
+
+	memset(&desc, 0, sizeof(desc));
+	desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	while (v4l2_ioctl(dev, VIDIOC_ENUM_FMT, &desc) == 0) {
+		if (v4l2_format_supported(desc.pixelformat))
+			return desc.pixelformat;
+		desc.index++;
+	}
+
+	return 0;
+}
+
+static bool v4l2_set_format(struct v4l2_data *data)
+{
+	struct v4l2_format fmt;
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	if (v4l2_ioctl(data->dev, VIDIOC_G_FMT, &fmt) != 0)
+		return false;
+
+	fmt.fmt.pix.pixelformat = data->pixelformat ? data->pixelformat :
+		v4l2_default_pixelformat(data->dev);
+	fmt.fmt.pix.field       = V4L2_FIELD_ANY;
+
+	if (data->req_width && data->req_height) {
+		fmt.fmt.pix.width  = data->req_width;
+		fmt.fmt.pix.height = data->req_height;
+	}
+
+	/* the driver adjusts the format to the closest one it supports */
+	if (v4l2_ioctl(data->dev, VIDIOC_S_FMT, &fmt) != 0) {
+		blog(LOG_ERROR, "v4l2-input: %s: Failed to set format: %s",
+				data->device_id, strerror(errno));
+		return false;
+	}
+
+	data->fourcc     = fmt.fmt.pix.pixelformat;
+	data->mjpeg      = data->fourcc == V4L2_PIX_FMT_MJPEG;
+	data->format     = v4l2_to_obs_video_format(data->fourcc);
+	data->width      = fmt.fmt.pix.width;
+	data->height     = fmt.fmt.pix.height;
+	data->linesize   = fmt.fmt.pix.bytesperline;
+	data->image_size = fmt.fmt.pix.sizeimage;
+
+	if (data->format == VIDEO_FORMAT_NONE && !data->mjpeg) {
+		blog(LOG_ERROR, "v4l2-input: %s: Unsupported pixel format %.4s",
+				data->device_id,
+				(const char*)&data->fourcc);
+		return false;
+	}
+
+	if (!data->linesize && !data->mjpeg) {
+		data->linesize = data->width;
+		if (data->format != VIDEO_FORMAT_NV12 &&
+		    data->format != VIDEO_FORMAT_I420)
+			data->linesize *= data->format == VIDEO_FORMAT_BGRX ||
+				data->format == VIDEO_FORMAT_BGRA ? 4 : 2;
+	}
+
+	return true;
+}
+
+static void v4l2_set_interval(struct v4l2_data *data)
+{
+	struct v4l2_streamparm parm;
+
+	if (!data->req_interval)
+		return;
+
+	memset(&parm, 0, sizeof(parm));
+	parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	if (v4l2_ioctl(data->dev, VIDIOC_G_PARM, &parm) != 0 ||
+	    (parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME) == 0)
+		return;
+
+	v4l2_unpack_interval(data->req_interval,
+			&parm.parm.capture.timeperframe);
+
+	if (v4l2_ioctl(data->dev, VIDIOC_S_PARM, &parm) != 0)
+		blog(LOG_WARNING, "v4l2-input: %s: Failed to set frame "
+		                  "interval: %s", data->device_id,
+		                  strerror(errno));
+}
+
+static bool v4l2_open_device(struct v4l2_data *data)
+{
+	struct v4l2_capability cap;
+	uint32_t caps;
+
+	data->dev = open(data->device_id, O_RDWR | O_NONBLOCK);
+	if (data->dev == -1) {
+		blog(LOG_ERROR, "v4l2-input: %s: Failed to open device: %s",
+				data->device_id, strerror(errno));
+		return false;
+	}
+
+	if (v4l2_ioctl(data->dev, VIDIOC_QUERYCAP, &cap) != 0) {
+		blog(LOG_ERROR, "v4l2-input: %s: Not a video device",
+				data->device_id);
+		return false;
+	}
+
+	caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ?
+		cap.device_caps : cap.capabilities;
+
+	if ((caps & V4L2_CAP_VIDEO_CAPTURE) == 0 ||
+	    (caps & V4L2_CAP_STREAMING) == 0) {
+		blog(LOG_ERROR, "v4l2-input: %s: Device can't stream video",
+				data->device_id);
+		return false;
+	}
+
+	if (v4l2_ioctl(data->dev, VIDIOC_S_INPUT, &data->input) != 0)
+		blog(LOG_WARNING, "v4l2-input: %s: Failed to select input %d",
+				data->device_id, data->input);
+
+	return true;
+}
+
+static void v4l2_stop_capture(struct v4l2_data *data)
+{
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	if (data->active) {
+		os_event_signal(data->stop_event);
+		pthread_join(data->thread, NULL);
+		os_event_reset(data->stop_event);
+		data->active = false;
+	}
+
+	if (data->dev != -1) {
+		v4l2_ioctl(data->dev, VIDIOC_STREAMOFF, &type);
+		v4l2_free_buffers(data);
+		close(data->dev);
+		data->dev = -1;
+	}
+}
+
+static void v4l2_start_capture(struct v4l2_data *data)
+{
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	if (!data->device_id || !*data->device_id)
+		return;
+
+	if (!v4l2_open_device(data) || !v4l2_set_format(data))
+		goto fail;
+
+	v4l2_set_interval(data);
+
+	if ((data->mjpeg || !v4l2_init_userptr(data)) &&
+	    !v4l2_init_mmap(data))
+		goto fail;
+
+	if (v4l2_ioctl(data->dev, VIDIOC_STREAMON, &type) != 0) {
+		blog(LOG_ERROR, "v4l2-input: %s: Failed to start streaming: %s",
+				data->device_id, strerror(errno));
+		goto fail;
+	}
+
+	if (pthread_create(&data->thread, NULL, v4l2_capture_thread,
+				data) != 0)
+		goto fail;
+
+	data->active = true;
+
+	blog(LOG_INFO, "v4l2-input: %s: Capturing %ux%u %.4s, %s buffers",
+			data->device_id, data->width, data->height,
+			(const char*)&data->fourcc,
+			data->memory == V4L2_MEMORY_USERPTR ?
+				"user pointer" : "memory mapped");
+	return;
+
+fail:
+	v4l2_stop_capture(data);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const char *v4l2_getname(const char *locale)
+{
+	/* TODO: locale */
+	UNUSED_PARAMETER(locale);
+	return "Video Capture Device (V4L2)";
+}
+
+static void v4l2_update(void *vptr, obs_data_t settings)
+{
+	V4L2_DATA(vptr);
+	const char *res = obs_data_getstring(settings, "resolution");
+
+	v4l2_stop_capture(data);
+
+	bfree(data->device_id);
+	data->device_id    = bstrdup(obs_data_getstring(settings,
+				"device_id"));
+	data->input        = (int)obs_data_getint(settings, "input");
+	data->pixelformat  = (uint32_t)obs_data_getint(settings,
+			"pixelformat");
+	data->req_interval = obs_data_getint(settings, "frame_interval");
+
+	if (!res || sscanf(res, "%ux%u", &data->req_width,
+				&data->req_height) != 2)
+		data->req_width = data->req_height = 0;
+
+	v4l2_start_capture(data);
+}
+
+static void v4l2_destroy(void *vptr)
+{
+	V4L2_DATA(vptr);
+
+	if (data) {
+		v4l2_stop_capture(data);
+		os_event_destroy(data->stop_event);
+		bfree(data->device_id);
+		bfree(data);
+	}
+}
+
+static void *v4l2_create(obs_data_t settings, obs_source_t source)
+{
+	struct v4l2_data *data = bzalloc(sizeof(struct v4l2_data));
+
+	data->source = source;
+	data->dev    = -1;
+
+	if (os_event_init(&data->stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
+		bfree(data);
+		return NULL;
+	}
+
+	video_format_get_parameters(VIDEO_CS_DEFAULT, VIDEO_RANGE_PARTIAL,
+			data->color_matrix, data->color_range_min,
+			data->color_range_max);
+
+	v4l2_update(data, settings);
+	return data;
+}
+
+static void v4l2_defaults(obs_data_t settings)
+{
+	obs_data_set_default_int(settings, "input", 0);
+	obs_data_set_default_int(settings, "pixelformat", 0);
+	obs_data_set_default_string(settings, "resolution", "");
+	obs_data_set_default_int(settings, "frame_interval", 0);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline int open_device_path(const char *device_id)
+{
+	if (!device_id || !*device_id)
+		return -1;
+	return open(device_id, O_RDWR | O_NONBLOCK);
+}
+
+static bool device_can_capture(int dev, struct v4l2_capability *cap)
+{
+	uint32_t caps;
+
+	if (v4l2_ioctl(dev, VIDIOC_QUERYCAP, cap) != 0)
+		return false;
+
+	caps = (cap->capabilities & V4L2_CAP_DEVICE_CAPS) ?
+		cap->device_caps : cap->capabilities;
+	return (caps & V4L2_CAP_VIDEO_CAPTURE) &&
+	       (caps & V4L2_CAP_STREAMING);
+}
+
+static void fill_devices(obs_property_t p)
+{
+	DIR           *dir = opendir("/dev");
+	struct dirent *ent;
+	struct dstr   path = {0};
+
+	if (!dir)
+		return;
+
+	while ((ent = readdir(dir)) != NULL) {
+		struct v4l2_capability cap;
+		int dev;
+
+		if (strncmp(ent->d_name, "video", 5) != 0)
+			continue;
+
+		dstr_printf(&path, "/dev/%s", ent->d_name);
+
+		dev = open_device_path(path.array);
+		if (dev == -1)
+			continue;
+
+		if (device_can_capture(dev, &cap))
+			obs_property_list_add_string(p, (char*)cap.card,
+					path.array);
+
+		close(dev);
+	}
+
+	dstr_free(&path);
+	closedir(dir);
+}
+
+static void fill_inputs(obs_property_t p, int dev)
+{
+	struct v4l2_input input;
+
+	obs_property_list_clear(p);
+
+	memset(&input, 0, sizeof(input));
+	while (dev != -1 && v4l2_ioctl(dev, VIDIOC_ENUMINPUT, &input) == 0) {
+		if (input.type == V4L2_INPUT_TYPE_CAMERA)
+			obs_property_list_add_int(p, (char*)input.name,
+					input.index);
+		input.index++;
+	}
+}
+
+static void fill_formats(obs_property_t p, int dev)
+{
+	struct v4l2_fmtdesc desc;
+
+	obs_property_list_clear(p);
+	obs_property_list_add_int(p, "Default", 0);
+
+	memset(&desc, 0, sizeof(desc));
+	desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	while (dev != -1 && v4l2_ioctl(dev, VIDIOC_ENUM_FMT, &desc) == 0) {
+		if (v4l2_format_supported(desc.pixelformat))
+			obs_property_list_add_int(p, (char*)desc.description,
+					desc.pixelformat);
+		desc.index++;
+	}
+}
+
+static void fill_resolutions(obs_property_t p, int dev, uint32_t pixelformat)
+{
+	struct v4l2_frmsizeenum size;
+	struct dstr res = {0};
+
+	obs_property_list_clear(p);
+	obs_property_list_add_string(p, "Default", "");
+
+	if (dev == -1 || !pixelformat)
+		return;
+
+	memset(&size, 0, sizeof(size));
+	size.pixel_format = pixelformat;
+
+	/* stepwise ranges can't sensibly be listed, so only discrete sizes
+	 * are offered */
+	while (v4l2_ioctl(dev, VIDIOC_ENUM_FRAMESIZES, &size) == 0 &&
+	       size.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+		dstr_printf(&res, "%ux%u", size.discrete.width,
+				size.discrete.height);
+		obs_property_list_add_string(p, res.array, res.array);
+		size.index++;
+	}
+
+	dstr_free(&res);
+}
+
+static void fill_intervals(obs_property_t p, int dev, uint32_t pixelformat,
+		const char *resolution)
+{
+	struct v4l2_frmivalenum ival;
+	struct dstr name = {0};
+
+	obs_property_list_clear(p);
+	obs_property_list_add_int(p, "Default", 0);
+
+	memset(&ival, 0, sizeof(ival));
+	ival.pixel_format = pixelformat;
+
+	if (dev == -1 || !pixelformat || !resolution ||
+	    sscanf(resolution, "%ux%u", &ival.width, &ival.height) != 2)
+		return;
+
+	while (v4l2_ioctl(dev, VIDIOC_ENUM_FRAMEINTERVALS, &ival) == 0 &&
+	       ival.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
+		struct v4l2_fract *fract = &ival.discrete;
+
+		if (fract->numerator) {
+			dstr_printf(&name, "%.2f",
+					(double)fract->denominator /
+					(double)fract->numerator);
+			obs_property_list_add_int(p, name.array,
+					v4l2_pack_interval(fract));
+		}
+		ival.index++;
+	}
+
+	dstr_free(&name);
+}
+
+static bool format_selected(obs_properties_t props, obs_property_t p,
+		obs_data_t settings);
+static bool resolution_selected(obs_properties_t props, obs_property_t p,
+		obs_data_t settings);
+
+static bool device_selected(obs_properties_t props, obs_property_t p,
+		obs_data_t settings)
+{
+	int dev = open_device_path(obs_data_getstring(settings, "device_id"));
+
+	fill_inputs(obs_properties_get(props, "input"), dev);
+	fill_formats(obs_properties_get(props, "pixelformat"), dev);
+
+	if (dev != -1)
+		close(dev);
+
+	format_selected(props, p, settings);
+	return true;
+}
+
+static bool format_selected(obs_properties_t props, obs_property_t p,
+		obs_data_t settings)
+{
+	int dev = open_device_path(obs_data_getstring(settings, "device_id"));
+
+	fill_resolutions(obs_properties_get(props, "resolution"), dev,
+			(uint32_t)obs_data_getint(settings, "pixelformat"));
+
+	if (dev != -1)
+		close(dev);
+
+	resolution_selected(props, p, settings);
+	return true;
+}
+
+static bool resolution_selected(obs_properties_t props, obs_property_t p,
+		obs_data_t settings)
+{
+	int dev = open_device_path(obs_data_getstring(settings, "device_id"));
+
+	fill_intervals(obs_properties_get(props, "frame_interval"), dev,
+			(uint32_t)obs_data_getint(settings, "pixelformat"),
+			obs_data_getstring(settings, "resolution"));
+
+	if (dev != -1)
+		close(dev);
+
+	UNUSED_PARAMETER(p);
+	return true;
+}
+
+static obs_properties_t v4l2_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+	obs_property_t   p;
+
+	/* TODO: translate */
+	p = obs_properties_add_list(props, "device_id", "Device",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_set_modified_callback(p, device_selected);
+	fill_devices(p);
+
+	obs_properties_add_list(props, "input", "Input",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+
+	p = obs_properties_add_list(props, "pixelformat", "Video Format",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_set_modified_callback(p, format_selected);
+
+	p = obs_properties_add_list(props, "resolution", "Resolution",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_set_modified_callback(p, resolution_selected);
+
+	obs_properties_add_list(props, "frame_interval", "Frame Rate",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+
+	return props;
+}
+
+struct obs_source_info v4l2_input = {
+	.id           = "v4l2_input",
+	.type         = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_THREADED_CREATE |
+	                OBS_SOURCE_DEFERRED_CREATE,
+	.getname      = v4l2_getname,
+	.create       = v4l2_create,
+	.destroy      = v4l2_destroy,
+	.update       = v4l2_update,
+	.defaults     = v4l2_defaults,
+	.properties   = v4l2_properties
+};
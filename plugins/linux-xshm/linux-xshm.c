@@ -19,10 +19,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 OBS_DECLARE_MODULE()
 
 extern struct obs_source_info xshm_input;
+extern struct obs_source_info xcomposite_input;
 
 bool obs_module_load(uint32_t obs_version)
 {
 	UNUSED_PARAMETER(obs_version);
 	obs_register_source(&xshm_input);
+	obs_register_source(&xcomposite_input);
 	return true;
 }
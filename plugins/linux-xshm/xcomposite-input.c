@@ -0,0 +1,414 @@
+/*
+Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/Xcomposite.h>
+
+#include <obs.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+
+#define XCOMP_DATA(voidptr) struct xcomp_data *data = voidptr;
+
+/*
+ * Captures a single window without copying it: the window is redirected
+ * with XComposite and its backing pixmap is bound directly as a texture.
+ *
+ * All X and graphics work happens on the video thread, update only hands
+ * the newly selected window over.
+ */
+struct xcomp_data {
+	Display *dpy;
+	Window window;
+	uint32_t win_width, win_height;
+
+	Pixmap pixmap;
+	texture_t texture;
+	uint32_t width, height;
+	bool flip;
+	bool need_pixmap;
+	bool rebind;
+
+	pthread_mutex_t mutex;
+	Window new_window;
+	bool window_changed;
+};
+
+static bool x_error = false;
+
+static int xcomp_error_handler(Display *dpy, XErrorEvent *event)
+{
+	char str[128];
+
+	XGetErrorText(dpy, event->error_code, str, sizeof(str));
+	blog(LOG_DEBUG, "xcomposite-input: X error: %s", str);
+
+	x_error = true;
+	return 0;
+}
+
+static const char* xcomp_getname(const char* locale)
+{
+	UNUSED_PARAMETER(locale);
+	return "X11 Window Capture (XComposite)";
+}
+
+static void xcomp_release_window(struct xcomp_data *data)
+{
+	if (!data->window)
+		return;
+
+	XSelectInput(data->dpy, data->window, NoEventMask);
+	XCompositeUnredirectWindow(data->dpy, data->window,
+			CompositeRedirectAutomatic);
+	data->window = 0;
+}
+
+static void xcomp_set_window(struct xcomp_data *data, Window window)
+{
+	XWindowAttributes attr;
+
+	xcomp_release_window(data);
+	data->need_pixmap = true;
+
+	if (!window)
+		return;
+
+	if (!XGetWindowAttributes(data->dpy, window, &attr)) {
+		blog(LOG_WARNING, "xcomposite-input: Window %lu does not "
+		                  "exist", (unsigned long)window);
+		return;
+	}
+
+	/* the window keeps rendering to its pixmap while it is redirected,
+	 * even if it is covered */
+	XCompositeRedirectWindow(data->dpy, window,
+			CompositeRedirectAutomatic);
+	XSelectInput(data->dpy, window, StructureNotifyMask);
+
+	data->window     = window;
+	data->win_width  = attr.width;
+	data->win_height = attr.height;
+}
+
+static void xcomp_handle_events(struct xcomp_data *data)
+{
+	XEvent event;
+
+	while (XPending(data->dpy)) {
+		XNextEvent(data->dpy, &event);
+
+		switch (event.type) {
+		case ConfigureNotify:
+			/* the pixmap is only replaced when the size changes */
+			if (event.xconfigure.window != data->window ||
+			    ((uint32_t)event.xconfigure.width ==
+			     data->win_width &&
+			     (uint32_t)event.xconfigure.height ==
+			     data->win_height))
+				break;
+
+			data->win_width   = event.xconfigure.width;
+			data->win_height  = event.xconfigure.height;
+			data->need_pixmap = true;
+			break;
+
+		case MapNotify:
+		case UnmapNotify:
+			data->need_pixmap = true;
+			break;
+
+		case DestroyNotify:
+			if (event.xdestroywindow.window == data->window) {
+				data->window      = 0;
+				data->need_pixmap = true;
+			}
+			break;
+		}
+	}
+}
+
+static void xcomp_update_pixmap(struct xcomp_data *data)
+{
+	XWindowAttributes attr;
+
+	data->need_pixmap = false;
+
+	obs_queue_texture_destroy(data->texture);
+	data->texture = NULL;
+	data->width   = 0;
+	data->height  = 0;
+
+	if (data->pixmap) {
+		XFreePixmap(data->dpy, data->pixmap);
+		data->pixmap = 0;
+	}
+
+	/* unmapped windows don't have a pixmap */
+	if (!data->window ||
+	    !XGetWindowAttributes(data->dpy, data->window, &attr) ||
+	    attr.map_state != IsViewable)
+		return;
+
+	data->pixmap = XCompositeNameWindowPixmap(data->dpy, data->window);
+
+	/* the graphics module uses its own connection */
+	XSync(data->dpy, false);
+	if (x_error) {
+		data->pixmap = 0;
+		return;
+	}
+
+	gs_entercontext(obs_graphics());
+	data->texture = gs_create_texture_from_pixmap(data->pixmap,
+			&data->flip);
+	if (data->texture) {
+		data->width  = texture_getwidth(data->texture);
+		data->height = texture_getheight(data->texture);
+	}
+	gs_leavecontext();
+
+	if (!data->texture)
+		blog(LOG_WARNING, "xcomposite-input: Failed to create "
+		                  "texture from window pixmap");
+}
+
+static void xcomp_destroy(void *vptr)
+{
+	XCOMP_DATA(vptr);
+
+	if (!data)
+		return;
+
+	obs_queue_texture_destroy(data->texture);
+
+	if (data->dpy) {
+		if (data->pixmap)
+			XFreePixmap(data->dpy, data->pixmap);
+		xcomp_release_window(data);
+		XCloseDisplay(data->dpy);
+	}
+
+	pthread_mutex_destroy(&data->mutex);
+	bfree(data);
+}
+
+static void xcomp_update(void *vptr, obs_data_t settings)
+{
+	XCOMP_DATA(vptr);
+
+	pthread_mutex_lock(&data->mutex);
+	data->new_window     = (Window)obs_data_getint(settings, "window");
+	data->window_changed = true;
+	pthread_mutex_unlock(&data->mutex);
+}
+
+static void *xcomp_create(obs_data_t settings, obs_source_t source)
+{
+	UNUSED_PARAMETER(source);
+
+	struct xcomp_data *data = bzalloc(sizeof(struct xcomp_data));
+	int event_base, error_base;
+	int major = 0, minor = 2;
+
+	if (pthread_mutex_init(&data->mutex, NULL) != 0) {
+		bfree(data);
+		return NULL;
+	}
+
+	data->dpy = XOpenDisplay(NULL);
+	if (!data->dpy)
+		goto fail;
+
+	if (!XCompositeQueryExtension(data->dpy, &event_base, &error_base) ||
+	    !XCompositeQueryVersion(data->dpy, &major, &minor) ||
+	    (major == 0 && minor < 2)) {
+		blog(LOG_ERROR, "xcomposite-input: XComposite 0.2 or newer "
+		                "is required");
+		goto fail;
+	}
+
+	xcomp_update(data, settings);
+	return data;
+
+fail:
+	xcomp_destroy(data);
+	return NULL;
+}
+
+static void xcomp_video_tick(void *vptr, float seconds)
+{
+	UNUSED_PARAMETER(seconds);
+	XCOMP_DATA(vptr);
+
+	XErrorHandler prev_handler;
+	bool window_changed;
+	Window window;
+
+	pthread_mutex_lock(&data->mutex);
+	window_changed = data->window_changed;
+	window         = data->new_window;
+	data->window_changed = false;
+	pthread_mutex_unlock(&data->mutex);
+
+	/* the window can disappear at any time, so errors are expected */
+	prev_handler = XSetErrorHandler(xcomp_error_handler);
+	x_error = false;
+
+	if (window_changed)
+		xcomp_set_window(data, window);
+
+	xcomp_handle_events(data);
+
+	if (data->need_pixmap)
+		xcomp_update_pixmap(data);
+
+	XSync(data->dpy, false);
+	XSetErrorHandler(prev_handler);
+
+	/* pick up the new window contents once per frame */
+	data->rebind = data->texture != NULL;
+}
+
+static void xcomp_video_render(void *vptr, effect_t effect)
+{
+	XCOMP_DATA(vptr);
+
+	if (!data->texture)
+		return;
+
+	if (data->rebind) {
+		texture_rebind_pixmap(data->texture);
+		data->rebind = false;
+	}
+
+	eparam_t image = effect_getparambyname(effect, "image");
+	effect_settexture(effect, image, data->texture);
+
+	gs_draw_sprite(data->texture, data->flip ? GS_FLIP_V : 0, 0, 0);
+}
+
+static uint32_t xcomp_getwidth(void *vptr)
+{
+	XCOMP_DATA(vptr);
+
+	return data->width;
+}
+
+static uint32_t xcomp_getheight(void *vptr)
+{
+	XCOMP_DATA(vptr);
+
+	return data->height;
+}
+
+static void xcomp_defaults(obs_data_t settings)
+{
+	obs_data_set_default_int(settings, "window", 0);
+}
+
+static void xcomp_get_window_name(Display *dpy, Window window,
+		struct dstr *name)
+{
+	Atom net_wm_name = XInternAtom(dpy, "_NET_WM_NAME", true);
+	Atom utf8_string = XInternAtom(dpy, "UTF8_STRING", true);
+	unsigned long num_items, bytes_after;
+	unsigned char *prop = NULL;
+	char *fetched = NULL;
+	Atom type;
+	int format;
+
+	if (net_wm_name && utf8_string &&
+	    XGetWindowProperty(dpy, window, net_wm_name, 0, 1024, false,
+			    utf8_string, &type, &format, &num_items,
+			    &bytes_after, &prop) == Success &&
+	    prop && num_items) {
+		dstr_copy(name, (const char*)prop);
+	} else if (XFetchName(dpy, window, &fetched) && fetched) {
+		dstr_copy(name, fetched);
+	} else {
+		dstr_printf(name, "Window %lu", (unsigned long)window);
+	}
+
+	if (prop)
+		XFree(prop);
+	if (fetched)
+		XFree(fetched);
+}
+
+/* lists the top level windows known to the window manager */
+static void xcomp_add_windows(Display *dpy, obs_property_t list)
+{
+	Atom client_list = XInternAtom(dpy, "_NET_CLIENT_LIST", true);
+	unsigned long num_windows = 0, bytes_after;
+	unsigned char *prop = NULL;
+	struct dstr name = {0};
+	Atom type;
+	int format;
+
+	if (!client_list ||
+	    XGetWindowProperty(dpy, DefaultRootWindow(dpy), client_list,
+			    0, 4096, false, XA_WINDOW, &type, &format,
+			    &num_windows, &bytes_after, &prop) != Success ||
+	    !prop) {
+		blog(LOG_WARNING, "xcomposite-input: The window manager does "
+		                  "not provide a window list");
+		return;
+	}
+
+	for (unsigned long i = 0; i < num_windows; i++) {
+		Window window = ((Window*)prop)[i];
+
+		xcomp_get_window_name(dpy, window, &name);
+		obs_property_list_add_int(list, name.array, (long long)window);
+	}
+
+	dstr_free(&name);
+	XFree(prop);
+}
+
+static obs_properties_t xcomp_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+	obs_property_t list = obs_properties_add_list(props, "window",
+		"Window", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	Display *dpy = XOpenDisplay(NULL);
+
+	if (dpy) {
+		xcomp_add_windows(dpy, list);
+		XCloseDisplay(dpy);
+	}
+
+	return props;
+}
+
+struct obs_source_info xcomposite_input = {
+    .id           = "xcomposite_input",
+    .type         = OBS_SOURCE_TYPE_INPUT,
+    .output_flags = OBS_SOURCE_VIDEO,
+    .getname      = xcomp_getname,
+    .create       = xcomp_create,
+    .destroy      = xcomp_destroy,
+    .defaults     = xcomp_defaults,
+    .properties   = xcomp_properties,
+    .update       = xcomp_update,
+    .video_tick   = xcomp_video_tick,
+    .video_render = xcomp_video_render,
+    .getwidth     = xcomp_getwidth,
+    .getheight    = xcomp_getheight
+};
@@ -38,31 +38,186 @@ static uint32_t *xcursor_pixels(XFixesCursorImage *xc) {
 	return pixels;
 }
 
+struct xcursor_resize {
+	struct xcursor_image *image;
+	uint32_t *pixels;
+	uint32_t width;
+	uint32_t height;
+};
+
+/*
+ * Recreate a cursor texture with a new size, run from the graphics queue
+ */
+static void xcursor_resize_task(void *param) {
+	struct xcursor_resize *resize = param;
+	struct xcursor_image *image = resize->image;
+
+	if (image->tex)
+		texture_destroy(image->tex);
+
+	image->tex = gs_create_texture(resize->width, resize->height,
+		GS_RGBA, 1, (const void **) &resize->pixels, GS_DYNAMIC);
+
+	bfree(resize->pixels);
+	bfree(resize);
+}
+
+static void xcursor_destroy_task(void *param) {
+	xcursor_t *data = param;
+
+	for (size_t i = 0; i < XCURSOR_CACHE_SIZE; ++i) {
+		if (data->cache[i].tex)
+			texture_destroy(data->cache[i].tex);
+	}
+	bfree(data);
+}
+
+static struct xcursor_image *xcursor_find(xcursor_t *data,
+		unsigned long serial) {
+	for (size_t i = 0; i < XCURSOR_CACHE_SIZE; ++i) {
+		struct xcursor_image *image = &data->cache[i];
+		if (image->last_used && image->serial == serial)
+			return image;
+	}
+
+	return NULL;
+}
+
+/*
+ * Get the unused or least recently used cache entry
+ */
+static struct xcursor_image *xcursor_oldest(xcursor_t *data) {
+	struct xcursor_image *oldest = &data->cache[0];
+
+	for (size_t i = 1; i < XCURSOR_CACHE_SIZE; ++i) {
+		if (data->cache[i].last_used < oldest->last_used)
+			oldest = &data->cache[i];
+	}
+
+	return oldest;
+}
+
+static void xcursor_use(xcursor_t *data, struct xcursor_image *image) {
+	image->last_used = ++data->use_count;
+	data->current = image;
+}
+
 /*
- * Create the cursor texture, either by updating if the new cursor has the same
- * size or by creating a new texture if the size is different
+ * Store the cursor in the cache, either by updating the texture of the
+ * replaced entry if the new cursor has the same size or by creating a new
+ * texture if the size is different
  */
 static void xcursor_create(xcursor_t *data, XFixesCursorImage *xc) {
-	uint32_t *pixels = xcursor_pixels(xc);
+	struct xcursor_image *image = xcursor_find(data, xc->cursor_serial);
+	uint32_t *pixels;
 
-	if (data->tex
-	&& data->last_height == xc->width
-	&& data->last_width == xc->height) {
-		texture_setimage(data->tex, (void **) pixels,
-			xc->width * sizeof(uint32_t), False);
-	} else {
-		if (data->tex)
-			texture_destroy(data->tex);
+	if (!image) {
+		image = xcursor_oldest(data);
+		pixels = xcursor_pixels(xc);
+
+		if (image->tex
+		&& image->width == xc->width
+		&& image->height == xc->height) {
+			obs_queue_texture_setimage(image->tex, pixels,
+				xc->width * sizeof(uint32_t), xc->height,
+				False);
+			bfree(pixels);
+		} else {
+			struct xcursor_resize *resize =
+				bmalloc(sizeof(*resize));
+			resize->image = image;
+			resize->pixels = pixels;
+			resize->width = xc->width;
+			resize->height = xc->height;
+
+			obs_queue_graphics_task(xcursor_resize_task, resize);
+		}
+
+		image->serial = xc->cursor_serial;
+		image->width = xc->width;
+		image->height = xc->height;
+	}
+
+	image->xhot = xc->xhot;
+	image->yhot = xc->yhot;
+	xcursor_use(data, image);
+}
+
+/*
+ * Fetch the whole cursor image, used when the shape isn't cached
+ */
+static void xcursor_poll(xcursor_t *data) {
+	XFixesCursorImage *xc = XFixesGetCursorImage(data->dpy);
+	if (!xc)
+		return;
+
+	if (!data->current || data->current->serial != xc->cursor_serial)
+		xcursor_create(data, xc);
+	data->pos_x = -1.0 * (xc->x - xc->xhot);
+	data->pos_y = -1.0 * (xc->y - xc->yhot);
+
+	XFree(xc);
+}
+
+/*
+ * Switch to a cached cursor if it's the one the last notify event was for,
+ * otherwise the image has to be fetched
+ */
+static bool xcursor_handle_events(xcursor_t *data) {
+	XEvent event;
+
+	while (XCheckTypedEvent(data->dpy, data->cursor_event, &event)) {
+		XFixesCursorNotifyEvent *notify =
+			(XFixesCursorNotifyEvent *) &event;
+		data->next_serial = notify->cursor_serial;
+		data->shape_changed = true;
+	}
+
+	if (data->shape_changed) {
+		struct xcursor_image *image =
+			xcursor_find(data, data->next_serial);
+		if (!image)
+			return false;
 
-		data->tex = gs_create_texture(xc->width, xc->height,
-			GS_RGBA, 1, (const void **) &pixels, GS_DYNAMIC);
+		xcursor_use(data, image);
+		data->shape_changed = false;
 	}
 
-	bfree(pixels);
+	return data->current != NULL;
+}
+
+static void xcursor_query_position(xcursor_t *data) {
+	Window root, child;
+	int root_x, root_y, win_x, win_y;
+	unsigned int mask;
+
+	if (!XQueryPointer(data->dpy, DefaultRootWindow(data->dpy),
+			&root, &child, &root_x, &root_y,
+			&win_x, &win_y, &mask))
+		return;
+
+	data->pos_x = -1.0 * (root_x - data->current->xhot);
+	data->pos_y = -1.0 * (root_y - data->current->yhot);
+}
+
+/*
+ * Get notified of cursor shape changes instead of fetching the cursor image
+ * every frame, needs XFixes 2.0
+ */
+static void xcursor_init_events(xcursor_t *data) {
+	int event_base, error_base;
+	int major = 0, minor = 0;
+
+	if (!XFixesQueryExtension(data->dpy, &event_base, &error_base))
+		return;
+	if (!XFixesQueryVersion(data->dpy, &major, &minor) || major < 2)
+		return;
 
-	data->last_serial = xc->cursor_serial;
-	data->last_width = xc->width;
-	data->last_height = xc->height;
+	XFixesSelectCursorInput(data->dpy, DefaultRootWindow(data->dpy),
+		XFixesDisplayCursorNotifyMask);
+
+	data->cursor_event = event_base + XFixesCursorNotify;
+	data->use_events = true;
 }
 
 xcursor_t *xcursor_init(Display *dpy) {
@@ -70,34 +225,41 @@ xcursor_t *xcursor_init(Display *dpy) {
 	memset(data, 0, sizeof(xcursor_t));
 
 	data->dpy = dpy;
-	xcursor_tick(data);
+	xcursor_init_events(data);
+	xcursor_poll(data);
 
 	return data;
 }
 
 void xcursor_destroy(xcursor_t *data) {
-	if (data->tex)
-		texture_destroy(data->tex);
-	bfree(data);
+	if (!data)
+		return;
+
+	if (data->use_events)
+		XFixesSelectCursorInput(data->dpy,
+			DefaultRootWindow(data->dpy), 0);
+	obs_queue_graphics_task(xcursor_destroy_task, data);
 }
 
 void xcursor_tick(xcursor_t *data) {
-	XFixesCursorImage *xc = XFixesGetCursorImage(data->dpy);
-
-	if (!data->tex || data->last_serial != xc->cursor_serial)
-		xcursor_create(data, xc);
-	data->pos_x = -1.0 * (xc->x - xc->xhot);
-	data->pos_y = -1.0 * (xc->y - xc->yhot);
-
-	XFree(xc);
+	if (data->use_events && xcursor_handle_events(data)) {
+		xcursor_query_position(data);
+	} else {
+		xcursor_poll(data);
+		data->shape_changed = false;
+	}
 }
 
 void xcursor_render(xcursor_t *data) {
+	texture_t tex = data->current ? data->current->tex : NULL;
+	if (!tex)
+		return;
+
 	/* TODO: why do i need effects ? */
 	effect_t effect  = gs_geteffect();
 	eparam_t image = effect_getparambyname(effect, "image");
 
-	effect_settexture(effect, image, data->tex);
+	effect_settexture(effect, image, tex);
 
 	gs_matrix_push();
 
@@ -105,7 +267,7 @@ void xcursor_render(xcursor_t *data) {
 
 	gs_enable_blending(True);
 	gs_blendfunction(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
-	gs_draw_sprite(data->tex, 0, 0, 0);
+	gs_draw_sprite(tex, 0, 0, 0);
 	gs_enable_blending(False);
 
 	gs_matrix_pop();
@@ -23,32 +23,57 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 extern "C" {
 #endif
 
+#define XCURSOR_CACHE_SIZE 8
+
+/* a cursor image, identified by the serial XFixes gives it */
+struct xcursor_image {
+	unsigned long serial;
+	unsigned short int width;
+	unsigned short int height;
+	unsigned short int xhot;
+	unsigned short int yhot;
+	uint64_t last_used;
+	texture_t tex;
+};
+
 typedef struct {
 	Display *dpy;
 	float pos_x;
 	float pos_y;
-	unsigned long last_serial;
-	unsigned short int last_width;
-	unsigned short int last_height;
-	texture_t tex;
+
+	/* cursor shape changes are reported by XFixes notify events,
+	 * if the server supports it, otherwise the cursor is polled */
+	bool use_events;
+	int cursor_event;
+	bool shape_changed;
+	unsigned long next_serial;
+
+	/* recently used cursor images, so switching back to a cursor
+	 * doesn't have to fetch it again */
+	struct xcursor_image cache[XCURSOR_CACHE_SIZE];
+	struct xcursor_image *current;
+	uint64_t use_count;
 } xcursor_t;
 
 /**
  * Initializes the xcursor object
  *
- * This needs to be executed within a valid render context
+ * The textures are created asynchronously through the graphics queue
  */
 xcursor_t *xcursor_init(Display *dpy);
 
 /**
  * Destroys the xcursor object
+ *
+ * The object is freed once pending graphics queue work has finished
  */
 void xcursor_destroy(xcursor_t *data);
 
 /**
- * Update the cursor texture
+ * Update the cursor position and texture
  *
- * This needs to be executed within a valid render context
+ * The cursor image is only fetched from the server if the shape changed to
+ * one that isn't cached yet.  Changes are applied through the graphics queue
  */
 void xcursor_tick(xcursor_t *data);
 
@@ -21,21 +21,66 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
 
 #include <obs.h>
+#include <util/platform.h>
+#include <util/threading.h>
 #include "xcursor.h"
 
 #define XSHM_DATA(voidptr) struct xshm_data *data = voidptr;
 
+/* above this many damaged rectangles or this fraction of the screen it is
+ * cheaper to just grab the whole screen again */
+#define XSHM_MAX_DAMAGE_RECTS 32
+#define XSHM_MAX_DAMAGE_AREA  0.5f
+
+struct xshm_segment {
+	XShmSegmentInfo info;
+	XImage *image;
+	bool attached;
+};
+
+/*
+ * The capture thread has its own display connection so it never shares Xlib
+ * state with the video thread.  It alternates between two segments, the
+ * front one is the last complete grab and is only read with the mutex held.
+ */
+struct xshm_thread {
+	Display *dpy;
+	struct xshm_segment segments[2];
+	Damage damage;
+	int damage_event;
+	uint64_t interval;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	os_event_t stop_event;
+	bool active;
+	int front;
+	bool new_frame;
+};
+
 struct xshm_data {
 	Display *dpy;
 	Window root_window;
+	Visual *visual;
+	int depth;
 	uint32_t width, height;
-	int shm_attached;
-	XShmSegmentInfo shm_info;
-	XImage *image;
+	struct xshm_segment shm;
 	texture_t texture;
 	xcursor_t *cursor;
+
+	struct xshm_thread thread;
+	volatile bool threaded;
+
+	/* damage tracking, only used if the XDamage extension is present */
+	Damage damage;
+	XserverRegion damage_region;
+	int damage_event;
+	bool use_damage;
+	bool need_full;
 };
 
 static const char* xshm_getname(const char* locale)
@@ -44,6 +89,90 @@ static const char* xshm_getname(const char* locale)
 	return "X11 Shared Memory Screen Input";
 }
 
+static inline void xshm_segment_init(struct xshm_segment *seg)
+{
+	memset(seg, 0, sizeof(struct xshm_segment));
+	seg->info.shmid   = -1;
+	seg->info.shmaddr = (char *) -1;
+}
+
+static void xshm_segment_destroy(struct xshm_segment *seg, Display *dpy)
+{
+	if (seg->attached)
+		XShmDetach(dpy, &seg->info);
+
+	if (seg->info.shmaddr != (char *) -1)
+		shmdt(seg->info.shmaddr);
+
+	if (seg->info.shmid != -1)
+		shmctl(seg->info.shmid, IPC_RMID, NULL);
+
+	if (seg->image)
+		XDestroyImage(seg->image);
+
+	xshm_segment_init(seg);
+}
+
+/* creates a shared memory image of the given size for the default screen */
+static bool xshm_segment_create(struct xshm_segment *seg, Display *dpy,
+		uint32_t width, uint32_t height)
+{
+	Screen *screen = XDefaultScreenOfDisplay(dpy);
+
+	seg->image = XShmCreateImage(dpy, DefaultVisualOfScreen(screen),
+		DefaultDepthOfScreen(screen), ZPixmap, NULL, &seg->info,
+		width, height);
+	if (!seg->image)
+		return false;
+
+	seg->info.shmid = shmget(IPC_PRIVATE,
+		seg->image->bytes_per_line * seg->image->height,
+		IPC_CREAT | 0700);
+	if (seg->info.shmid < 0)
+		return false;
+
+	seg->info.shmaddr
+		= seg->image->data
+		= (char *) shmat(seg->info.shmid, 0, 0);
+	if (seg->info.shmaddr == (char *) -1)
+		return false;
+	seg->info.readOnly = False;
+
+	if (!XShmAttach(dpy, &seg->info))
+		return false;
+	seg->attached = true;
+
+	return true;
+}
+
+static void xshm_thread_stop(struct xshm_data *data)
+{
+	struct xshm_thread *t = &data->thread;
+
+	if (t->active) {
+		os_event_signal(t->stop_event);
+		pthread_join(t->thread, NULL);
+		os_event_reset(t->stop_event);
+		t->active = false;
+	}
+
+	/* make sure the video thread doesn't touch the segments anymore */
+	pthread_mutex_lock(&t->mutex);
+	t->new_frame = false;
+	pthread_mutex_unlock(&t->mutex);
+
+	if (t->dpy) {
+		for (size_t i = 0; i < 2; i++)
+			xshm_segment_destroy(&t->segments[i], t->dpy);
+		if (t->damage)
+			XDamageDestroy(t->dpy, t->damage);
+
+		XCloseDisplay(t->dpy);
+		t->dpy    = NULL;
+		t->damage = 0;
+	}
+}
+
 static void xshm_destroy(void *vptr)
 {
 	XSHM_DATA(vptr);
@@ -51,41 +180,180 @@ static void xshm_destroy(void *vptr)
 	if (!data)
 		return;
 
-	gs_entercontext(obs_graphics());
+	xshm_thread_stop(data);
+	pthread_mutex_destroy(&data->thread.mutex);
+	os_event_destroy(data->thread.stop_event);
 
-	texture_destroy(data->texture);
+	obs_queue_texture_destroy(data->texture);
 	xcursor_destroy(data->cursor);
 
-	gs_leavecontext();
+	if (data->damage_region)
+		XFixesDestroyRegion(data->dpy, data->damage_region);
+	if (data->damage)
+		XDamageDestroy(data->dpy, data->damage);
+
+	if (data->dpy) {
+		xshm_segment_destroy(&data->shm, data->dpy);
+		XCloseDisplay(data->dpy);
+	}
+
+	bfree(data);
+}
+
+static void *xshm_capture_thread(void *vptr)
+{
+	XSHM_DATA(vptr);
+	struct xshm_thread *t = &data->thread;
+	Window root = DefaultRootWindow(t->dpy);
+	uint64_t next_time = os_gettime_ns();
+	bool dirty = true;
+	XEvent event;
+
+	os_thread_init(OS_THREAD_CLASS_VIDEO, "xshm capture");
+
+	while (os_event_try(t->stop_event) == EAGAIN) {
+		/* with damage tracking, only grab when something changed */
+		if (t->damage) {
+			while (XCheckTypedEvent(t->dpy, t->damage_event,
+						&event))
+				dirty = true;
+
+			if (dirty)
+				XDamageSubtract(t->dpy, t->damage, None, None);
+		} else {
+			dirty = true;
+		}
+
+		if (dirty) {
+			int back = t->front ^ 1;
+			XImage *image = t->segments[back].image;
+
+			if (XShmGetImage(t->dpy, root, image, 0, 0,
+						AllPlanes)) {
+				pthread_mutex_lock(&t->mutex);
+				t->front     = back;
+				t->new_frame = true;
+				pthread_mutex_unlock(&t->mutex);
+			}
+
+			dirty = false;
+		}
+
+		/* don't try to catch up if a grab took too long */
+		next_time += t->interval;
+		if (!os_sleepto_ns(next_time))
+			next_time = os_gettime_ns();
+	}
 
-	if (data->shm_attached)
-		XShmDetach(data->dpy, &data->shm_info);
+	return NULL;
+}
 
-	if (data->shm_info.shmaddr != (char *) -1) {
-		shmdt(data->shm_info.shmaddr);
-		data->shm_info.shmaddr = (char *) -1;
+static bool xshm_thread_start(struct xshm_data *data)
+{
+	struct xshm_thread *t = &data->thread;
+	struct obs_video_info ovi;
+	int event_base, error_base;
+
+	t->dpy = XOpenDisplay(NULL);
+	if (!t->dpy)
+		goto fail;
+
+	for (size_t i = 0; i < 2; i++) {
+		if (!xshm_segment_create(&t->segments[i], t->dpy,
+					data->width, data->height))
+			goto fail;
 	}
 
-	if (data->shm_info.shmid != -1)
-		shmctl(data->shm_info.shmid, IPC_RMID, NULL);
+	if (XDamageQueryExtension(t->dpy, &event_base, &error_base)) {
+		t->damage = XDamageCreate(t->dpy, DefaultRootWindow(t->dpy),
+				XDamageReportNonEmpty);
+		t->damage_event = event_base + XDamageNotify;
+	}
 
-	if (data->image)
-		XDestroyImage(data->image);
+	/* pace the grabs to the output frame rate */
+	if (obs_get_video_info(&ovi) && ovi.fps_num)
+		t->interval = 1000000000ULL * ovi.fps_den / ovi.fps_num;
+	else
+		t->interval = 1000000000ULL / 60;
 
-	if (data->dpy)
-		XCloseDisplay(data->dpy);
+	t->front     = 0;
+	t->new_frame = false;
 
-	bfree(data);
+	if (pthread_create(&t->thread, NULL, xshm_capture_thread, data) != 0)
+		goto fail;
+	t->active = true;
+
+	return true;
+
+fail:
+	blog(LOG_WARNING, "xshm-input: Failed to start capture thread, "
+	                  "capturing on the video thread");
+	xshm_thread_stop(data);
+	return false;
+}
+
+static void xshm_init_damage(struct xshm_data *data)
+{
+	int event_base, error_base;
+
+	if (!XDamageQueryExtension(data->dpy, &event_base, &error_base)) {
+		blog(LOG_INFO, "xshm-input: XDamage not available, "
+		               "capturing the full screen every frame");
+		return;
+	}
+
+	/* report only once until the damage is subtracted again, the damaged
+	 * regions are fetched on every tick */
+	data->damage = XDamageCreate(data->dpy, data->root_window,
+			XDamageReportNonEmpty);
+	data->damage_region = XFixesCreateRegion(data->dpy, NULL, 0);
+	data->damage_event  = event_base + XDamageNotify;
+	data->use_damage    = data->damage && data->damage_region;
+
+	if (data->use_damage)
+		blog(LOG_INFO, "xshm-input: Using XDamage");
+}
+
+static void xshm_update(void *vptr, obs_data_t settings)
+{
+	XSHM_DATA(vptr);
+	bool threaded = obs_data_getbool(settings, "threaded");
+
+	if (threaded == data->threaded)
+		return;
+
+	if (threaded) {
+		data->threaded = xshm_thread_start(data);
+	} else {
+		data->threaded = false;
+		xshm_thread_stop(data);
+
+		/* the texture may be stale compared to the damage state */
+		data->need_full = true;
+	}
 }
 
 static void *xshm_create(obs_data_t settings, obs_source_t source)
 {
-	UNUSED_PARAMETER(settings);
 	UNUSED_PARAMETER(source);
 
 
 	struct xshm_data *data = bmalloc(sizeof(struct xshm_data));
 	memset(data, 0, sizeof(struct xshm_data));
+	xshm_segment_init(&data->shm);
+	for (size_t i = 0; i < 2; i++)
+		xshm_segment_init(&data->thread.segments[i]);
+
+	if (pthread_mutex_init(&data->thread.mutex, NULL) != 0) {
+		bfree(data);
+		return NULL;
+	}
+	if (os_event_init(&data->thread.stop_event, OS_EVENT_TYPE_MANUAL)
+			!= 0) {
+		pthread_mutex_destroy(&data->thread.mutex);
+		bfree(data);
+		return NULL;
+	}
 
 	data->dpy = XOpenDisplay(NULL);
 	if (!data->dpy)
@@ -95,36 +363,20 @@ static void *xshm_create(obs_data_t settings, obs_source_t source)
 	data->width = WidthOfScreen(screen);
 	data->height = HeightOfScreen(screen);
 	data->root_window = XRootWindowOfScreen(screen);
-	Visual *visual = DefaultVisualOfScreen(screen);
-	int depth = DefaultDepthOfScreen(screen);
+	data->visual = DefaultVisualOfScreen(screen);
+	data->depth = DefaultDepthOfScreen(screen);
 
 	if (!XShmQueryExtension(data->dpy))
 		goto fail;
 
-	data->image = XShmCreateImage(data->dpy, visual, depth,
-		ZPixmap, NULL, &data->shm_info, data->width, data->height);
-	if (!data->image)
-		goto fail;
-
-	data->shm_info.shmid = shmget(IPC_PRIVATE,
-		data->image->bytes_per_line * data->image->height,
-		IPC_CREAT | 0700);
-	if (data->shm_info.shmid < 0)
+	if (!xshm_segment_create(&data->shm, data->dpy,
+				data->width, data->height))
 		goto fail;
 
-	data->shm_info.shmaddr
-		= data->image->data
-		= (char *) shmat(data->shm_info.shmid, 0, 0);
-	if (data->shm_info.shmaddr == (char *) -1)
-		goto fail;
-	data->shm_info.readOnly = False;
+	/* start tracking before the first grab so nothing is missed */
+	xshm_init_damage(data);
 
-
-	if (!XShmAttach(data->dpy, &data->shm_info))
-		goto fail;
-	data->shm_attached = 1;
-
-	if (!XShmGetImage(data->dpy, data->root_window, data->image,
+	if (!XShmGetImage(data->dpy, data->root_window, data->shm.image,
 		0, 0, AllPlanes)) {
 		goto fail;
 	}
@@ -132,13 +384,14 @@ static void *xshm_create(obs_data_t settings, obs_source_t source)
 
 	gs_entercontext(obs_graphics());
 	data->texture = gs_create_texture(data->width, data->height,
-		GS_BGRA, 1, (const void**) &data->image->data, GS_DYNAMIC);
+		GS_BGRA, 1, (const void**) &data->shm.image->data, GS_DYNAMIC);
 	data->cursor = xcursor_init(data->dpy);
 	gs_leavecontext();
 
 	if (!data->texture)
 		goto fail;
 
+	xshm_update(data, settings);
 	return data;
 
 fail:
@@ -146,22 +399,128 @@ fail:
 	return NULL;
 }
 
+static void xshm_capture_full(struct xshm_data *data)
+{
+	XShmGetImage(data->dpy, data->root_window, data->shm.image,
+		0, 0, AllPlanes);
+
+	/* if the upload gets dropped, try again next frame instead of waiting
+	 * for the next damage */
+	data->need_full = !obs_queue_texture_setimage(data->texture,
+		data->shm.image->data, data->width * 4, data->height, False);
+}
+
+/*
+ * Grabs a single rectangle.  A temporary image header over the start of the
+ * shared memory segment is used, so the rectangle ends up tightly packed and
+ * can be uploaded as is.  This clobbers the full screen image, which is only
+ * ever used right after a full grab.
+ */
+static bool xshm_capture_rect(struct xshm_data *data, const XRectangle *rect)
+{
+	XImage *image;
+	bool success;
+
+	image = XShmCreateImage(data->dpy, data->visual, data->depth,
+		ZPixmap, data->shm.info.shmaddr, &data->shm.info,
+		rect->width, rect->height);
+	if (!image)
+		return false;
+
+	success = XShmGetImage(data->dpy, data->root_window, image,
+		rect->x, rect->y, AllPlanes) &&
+		obs_queue_texture_setimage_region(data->texture, image->data,
+		image->bytes_per_line, rect->x, rect->y,
+		rect->width, rect->height);
+
+	/* the data belongs to the segment, only free the header */
+	XFree(image);
+	return success;
+}
+
+static inline bool rect_in_screen(struct xshm_data *data,
+		const XRectangle *rect)
+{
+	return rect->x >= 0 && rect->y >= 0 &&
+		(uint32_t)rect->x + rect->width  <= data->width &&
+		(uint32_t)rect->y + rect->height <= data->height;
+}
+
+static void xshm_capture_damage(struct xshm_data *data)
+{
+	XEvent event;
+	XRectangle *rects;
+	int num_rects = 0;
+	uint64_t area = 0;
+	bool full = data->need_full;
+
+	/* the notify events only tell us that something changed */
+	while (XCheckTypedEvent(data->dpy, data->damage_event, &event))
+		;
+
+	XDamageSubtract(data->dpy, data->damage, None, data->damage_region);
+	rects = XFixesFetchRegion(data->dpy, data->damage_region, &num_rects);
+	if (!full && (!rects || !num_rects))
+		goto finish;
+
+	if (num_rects > XSHM_MAX_DAMAGE_RECTS)
+		full = true;
+
+	for (int i = 0; i < num_rects && !full; i++) {
+		if (!rect_in_screen(data, &rects[i]))
+			full = true;
+		area += (uint64_t)rects[i].width * rects[i].height;
+	}
+
+	if ((float)area > (float)data->width * (float)data->height *
+			XSHM_MAX_DAMAGE_AREA)
+		full = true;
+
+	for (int i = 0; i < num_rects && !full; i++) {
+		if (!xshm_capture_rect(data, &rects[i]))
+			full = true;
+	}
+
+	if (full)
+		xshm_capture_full(data);
+
+finish:
+	if (rects)
+		XFree(rects);
+}
+
+/* uploads the latest frame of the capture thread, if there is a new one */
+static void xshm_upload_threaded(struct xshm_data *data)
+{
+	struct xshm_thread *t = &data->thread;
+
+	pthread_mutex_lock(&t->mutex);
+
+	if (t->new_frame) {
+		XImage *image = t->segments[t->front].image;
+
+		/* keep the frame around if the upload gets dropped */
+		t->new_frame = !obs_queue_texture_setimage(data->texture,
+			image->data, image->bytes_per_line, data->height,
+			False);
+	}
+
+	pthread_mutex_unlock(&t->mutex);
+}
+
 static void xshm_video_tick(void *vptr, float seconds)
 {
 	UNUSED_PARAMETER(seconds);
 	XSHM_DATA(vptr);
 
-	gs_entercontext(obs_graphics());
-
-
-	XShmGetImage(data->dpy, data->root_window, data->image,
-		0, 0, AllPlanes);
-	texture_setimage(data->texture, (void *) data->image->data,
-		data->width * 4, False);
+	if (data->threaded)
+		xshm_upload_threaded(data);
+	else if (data->use_damage)
+		xshm_capture_damage(data);
+	else
+		xshm_capture_full(data);
 
 	xcursor_tick(data->cursor);
-
-	gs_leavecontext();
 }
 
 static void xshm_video_render(void *vptr, effect_t effect)
@@ -178,6 +537,21 @@ static void xshm_video_render(void *vptr, effect_t effect)
 	xcursor_render(data->cursor);
 }
 
+static void xshm_defaults(obs_data_t settings)
+{
+	obs_data_set_default_bool(settings, "threaded", false);
+}
+
+static obs_properties_t xshm_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	obs_properties_add_bool(props, "threaded",
+		"Capture on a separate thread");
+
+	return props;
+}
+
 static uint32_t xshm_getwidth(void *vptr)
 {
 	XSHM_DATA(vptr);
@@ -199,6 +573,9 @@ struct obs_source_info xshm_input = {
     .getname      = xshm_getname,
     .create       = xshm_create,
     .destroy      = xshm_destroy,
+    .defaults     = xshm_defaults,
+    .properties   = xshm_properties,
+    .update       = xshm_update,
     .video_tick   = xshm_video_tick,
     .video_render = xshm_video_render,
     .getwidth     = xshm_getwidth,
@@ -5,6 +5,7 @@
 
 #include <obs.h>
 #include <media-io/video-io.h>
+#include <util/threading.h>
 
 #define AV_REV_FOURCC(x) \
 	(x >> 24), ((x >> 16) & 255), ((x >> 8) & 255), (x & 255)
@@ -40,8 +41,38 @@ struct av_capture {
 	obs_source_t source;
 
 	struct source_frame frame;
+
+	/* with zero_copy, the pixel buffers' IOSurfaces are bound as textures
+	 * instead of copying each frame through the async frame cache */
+	bool zero_copy;
+	uint32_t width;
+	uint32_t height;
+
+	pthread_mutex_t buffer_mutex;
+	CVPixelBufferRef pending_buffer;
+	CVPixelBufferRef current_buffer;
+	texture_t tex;
 };
 
+/* only the newest buffer is kept, older ones go back to the capture pool
+ * right away */
+static void queue_pixel_buffer(struct av_capture *capture,
+		CVPixelBufferRef img)
+{
+	if (!CVPixelBufferGetIOSurface(img))
+		return;
+
+	CVPixelBufferRetain(img);
+
+	pthread_mutex_lock(&capture->buffer_mutex);
+	if (capture->pending_buffer)
+		CVPixelBufferRelease(capture->pending_buffer);
+	capture->pending_buffer = img;
+	capture->width  = (uint32_t)CVPixelBufferGetWidth(img);
+	capture->height = (uint32_t)CVPixelBufferGetHeight(img);
+	pthread_mutex_unlock(&capture->buffer_mutex);
+}
+
 @implementation OBSAVCaptureDelegate
 - (void)captureOutput:(AVCaptureOutput *)out
         didDropSampleBuffer:(CMSampleBufferRef)sampleBuffer
@@ -69,6 +100,12 @@ struct av_capture {
 	CMSampleBufferGetSampleTimingInfo(sampleBuffer, 0, &info);
 
 	CVImageBufferRef img = CMSampleBufferGetImageBuffer(sampleBuffer);
+
+	if (capture->zero_copy) {
+		queue_pixel_buffer(capture, img);
+		return;
+	}
+
 	CVPixelBufferLockBaseAddress(img, 0);
 	uint32_t h = CVPixelBufferGetHeight(img);
 	if (h != frame->height) {
@@ -84,6 +121,9 @@ struct av_capture {
 		frame->linesize[0] = w*2;
 	}
 
+	capture->width  = w;
+	capture->height = h;
+
 	uint8_t *addr = CVPixelBufferGetBaseAddress(img);
 
 	AVCaptureInputPort *port = capture->device_input.ports[0];
@@ -114,6 +154,18 @@ static void av_capture_destroy(void *data)
 
 	[capture->session stopRunning];
 
+	if (capture->tex) {
+		gs_entercontext(obs_graphics());
+		texture_destroy(capture->tex);
+		gs_leavecontext();
+	}
+
+	if (capture->pending_buffer)
+		CVPixelBufferRelease(capture->pending_buffer);
+	if (capture->current_buffer)
+		CVPixelBufferRelease(capture->current_buffer);
+	pthread_mutex_destroy(&capture->buffer_mutex);
+
 	[capture->out release];
 	[capture->device_input release];
 	[capture->device release];
@@ -203,10 +255,29 @@ static uint32_t uint_from_dict(NSDictionary *dict, CFStringRef key)
 	return ((NSNumber*)dict[(__bridge NSString*)key]).unsignedIntValue;
 }
 
+/* IOSurface textures can only be BGRA, so the conversion happens on the
+ * capture side instead */
+static void init_zero_copy_format(struct av_capture *capture)
+{
+	capture->out.videoSettings = @{
+		(__bridge NSString*)kCVPixelBufferPixelFormatTypeKey:
+			@(kCVPixelFormatType_32BGRA),
+		(__bridge NSString*)kCVPixelBufferIOSurfacePropertiesKey:
+			@{}
+	};
+
+	blog(LOG_DEBUG, "Binding frames directly as IOSurface textures");
+}
+
 static bool init_format(struct av_capture *capture)
 {
 	AVCaptureDeviceFormat *format = capture->device.activeFormat;
 
+	if (capture->zero_copy) {
+		init_zero_copy_format(capture);
+		return true;
+	}
+
 	CMMediaType mtype = CMFormatDescriptionGetMediaType(
 			format.formatDescription);
 	// TODO: support other media types
@@ -278,6 +349,8 @@ static bool init_frame(struct av_capture *capture)
 
 static void av_capture_init(struct av_capture *capture, obs_data_t settings)
 {
+	capture->zero_copy = obs_data_getbool(settings, "zero_copy");
+
 	if (!init_session(capture))
 		return;
 
@@ -308,6 +381,12 @@ static void *av_capture_create(obs_data_t settings, obs_source_t source)
 	struct av_capture *capture = bzalloc(sizeof(struct av_capture));
 	capture->source = source;
 
+	if (pthread_mutex_init(&capture->buffer_mutex, NULL) != 0) {
+		blog(LOG_ERROR, "Could not create buffer mutex");
+		bfree(capture);
+		return NULL;
+	}
+
 	av_capture_init(capture, settings);
 
 	return capture;
@@ -366,6 +445,20 @@ static void av_capture_defaults(obs_data_t settings)
 	obs_data_set_default_bool(settings, "use_preset", true);
 
 	obs_data_set_default_string(settings, "preset", highest.UTF8String);
+	obs_data_set_default_bool(settings, "zero_copy", false);
+}
+
+static void av_capture_fill_devices(obs_property_t dev_list)
+{
+	/* called from the list enumeration thread */
+	@autoreleasepool {
+		for (AVCaptureDevice *dev in [AVCaptureDevice
+				devicesWithMediaType:AVMediaTypeVideo]) {
+			obs_property_list_add_string(dev_list,
+					dev.localizedName.UTF8String,
+					dev.uniqueID.UTF8String);
+		}
+	}
 }
 
 static obs_properties_t av_capture_properties(char const *locale)
@@ -373,15 +466,10 @@ static obs_properties_t av_capture_properties(char const *locale)
 	obs_properties_t props = obs_properties_create(locale);
 
 	/* TODO: locale */
-	obs_property_t dev_list = obs_properties_add_list(props, "device",
-			"Device", OBS_COMBO_TYPE_LIST,
-			OBS_COMBO_FORMAT_STRING);
-	for (AVCaptureDevice *dev in [AVCaptureDevice
-			devicesWithMediaType:AVMediaTypeVideo]) {
-		obs_property_list_add_string(dev_list,
-				dev.localizedName.UTF8String,
-				dev.uniqueID.UTF8String);
-	}
+	obs_property_t dev_list = obs_properties_add_async_list(props,
+			"device", "Device", OBS_COMBO_TYPE_LIST,
+			OBS_COMBO_FORMAT_STRING, "av_capture_devices",
+			av_capture_fill_devices);
 	// TODO: implement device selection
 	obs_property_set_enabled(dev_list, false);
 
@@ -407,6 +495,9 @@ static obs_properties_t av_capture_properties(char const *locale)
 		}
 	}
 
+	obs_properties_add_bool(props, "zero_copy",
+			"Bind frames directly (IOSurface)");
+
 	return props;
 }
 
@@ -422,17 +513,95 @@ static void av_capture_update(void *data, obs_data_t settings)
 	if ([cap->device.uniqueID isEqualToString:uid]) {
 		cap->session.sessionPreset = get_string(settings, "preset");
 	}
+
+	bool zero_copy = obs_data_getbool(settings, "zero_copy");
+	if (zero_copy != cap->zero_copy && cap->device) {
+		/* the delegate runs on the capture queue, so switch there */
+		dispatch_sync(cap->queue, ^{
+			cap->zero_copy = zero_copy;
+			if (init_format(cap))
+				init_frame(cap);
+		});
+	}
+}
+
+/* swaps in the newest pixel buffer, keeping it retained for as long as its
+ * IOSurface is bound to the texture */
+static void update_texture(struct av_capture *capture)
+{
+	CVPixelBufferRef buffer;
+
+	pthread_mutex_lock(&capture->buffer_mutex);
+	buffer = capture->pending_buffer;
+	capture->pending_buffer = NULL;
+	pthread_mutex_unlock(&capture->buffer_mutex);
+
+	if (!buffer)
+		return;
+
+	IOSurfaceRef surface = CVPixelBufferGetIOSurface(buffer);
+
+	if (!capture->tex || !texture_rebind_iosurface(capture->tex, surface)) {
+		texture_destroy(capture->tex);
+		capture->tex = gs_create_texture_from_iosurface(surface);
+	}
+
+	if (capture->current_buffer)
+		CVPixelBufferRelease(capture->current_buffer);
+	capture->current_buffer = buffer;
+}
+
+static void av_capture_render(void *data, effect_t effect)
+{
+	struct av_capture *capture = data;
+
+	if (!capture->zero_copy) {
+		obs_source_render_async_video(capture->source);
+		return;
+	}
+
+	update_texture(capture);
+	if (!capture->tex)
+		return;
+
+	effect = obs_get_default_rect_effect();
+	technique_t tech = effect_gettechnique(effect, "Draw");
+
+	technique_begin(tech);
+	technique_beginpass(tech, 0);
+
+	effect_settexture(effect, effect_getparambyname(effect, "image"),
+			capture->tex);
+	gs_draw_sprite(capture->tex, 0, 0, 0);
+
+	technique_endpass(tech);
+	technique_end(tech);
+}
+
+static uint32_t av_capture_getwidth(void *data)
+{
+	struct av_capture *capture = data;
+	return capture->width;
+}
+
+static uint32_t av_capture_getheight(void *data)
+{
+	struct av_capture *capture = data;
+	return capture->height;
 }
 
 struct obs_source_info av_capture_info = {
 	.id           = "av_capture_input",
 	.type         = OBS_SOURCE_TYPE_INPUT,
-	.output_flags = OBS_SOURCE_ASYNC_VIDEO,
+	.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_CUSTOM_DRAW,
 	.getname      = av_capture_getname,
 	.create       = av_capture_create,
 	.destroy      = av_capture_destroy,
 	.defaults     = av_capture_defaults,
 	.properties   = av_capture_properties,
 	.update       = av_capture_update,
+	.video_render = av_capture_render,
+	.getwidth     = av_capture_getwidth,
+	.getheight    = av_capture_getheight,
 };
 
@@ -0,0 +1,360 @@
+#include <AudioUnit/AudioUnit.h>
+#include <CoreFoundation/CFString.h>
+#include <CoreAudio/CoreAudio.h>
+
+#include <obs.h>
+#include <media-io/audio-monitor.h>
+#include <util/c99defs.h>
+
+#include "mac-helpers.h"
+#include "audio-device-enum.h"
+
+#define SCOPE_INPUT  kAudioUnitScope_Input
+#define SCOPE_GLOBAL kAudioUnitScope_Global
+
+#define BUS_OUTPUT 0
+
+#define DEFAULT_LATENCY_MS 40
+
+#define set_property AudioUnitSetProperty
+
+/*
+ * Plays an audio mix back on an output device through a HAL output unit.
+ * The unit pulls audio from the render callback on its own real-time
+ * thread, and converts the stream format to the format of the device.  The
+ * device buffer is sized to half of the latency, and the jitter buffer of
+ * the audio monitor holds the other half.
+ */
+
+struct coreaudio_monitor {
+	obs_output_t        output;
+	char                *device_uid;
+	uint32_t            latency_ms;
+
+	AudioUnit           unit;
+	AudioDeviceID       device_id;
+	audio_monitor_t     monitor;
+
+	uint32_t            sample_rate;
+	enum speaker_layout speakers;
+};
+
+static inline bool cam_success(OSStatus stat, const char *func,
+		const char *action)
+{
+	if (stat != noErr) {
+		blog(LOG_WARNING, "[%s] %s failed: %d", func, action,
+				(int)stat);
+		return false;
+	}
+
+	return true;
+}
+
+static bool find_output_device_id(struct coreaudio_monitor *cam)
+{
+	UInt32      size      = sizeof(AudioDeviceID);
+	CFStringRef cf_uid    = NULL;
+	const void  *qual     = NULL;
+	UInt32      qual_size = 0;
+	OSStatus    stat;
+
+	AudioObjectPropertyAddress addr = {
+		.mSelector = kAudioHardwarePropertyDefaultOutputDevice,
+		.mScope    = kAudioObjectPropertyScopeGlobal,
+		.mElement  = kAudioObjectPropertyElementMaster
+	};
+
+	if (astrcmpi(cam->device_uid, "default") != 0) {
+		cf_uid = CFStringCreateWithCString(NULL, cam->device_uid,
+				kCFStringEncodingUTF8);
+
+		addr.mSelector = kAudioHardwarePropertyTranslateUIDToDevice;
+		qual      = &cf_uid;
+		qual_size = sizeof(CFStringRef);
+	}
+
+	stat = AudioObjectGetPropertyData(kAudioObjectSystemObject, &addr,
+			qual_size, qual, &size, &cam->device_id);
+
+	if (cf_uid)
+		CFRelease(cf_uid);
+
+	return stat == noErr && cam->device_id != kAudioObjectUnknown;
+}
+
+static OSStatus render_callback(
+		void *data,
+		AudioUnitRenderActionFlags *action_flags,
+		const AudioTimeStamp *ts_data,
+		UInt32 bus_num,
+		UInt32 frames,
+		AudioBufferList *buffers)
+{
+	struct coreaudio_monitor *cam = data;
+
+	audio_monitor_pop(cam->monitor, buffers->mBuffers[0].mData,
+			(uint32_t)frames);
+
+	UNUSED_PARAMETER(action_flags);
+	UNUSED_PARAMETER(ts_data);
+	UNUSED_PARAMETER(bus_num);
+	return noErr;
+}
+
+static bool coreaudio_monitor_init_unit(struct coreaudio_monitor *cam)
+{
+	AudioComponentDescription desc = {
+		.componentType    = kAudioUnitType_Output,
+		.componentSubType = kAudioUnitSubType_HALOutput
+	};
+
+	AudioComponent component = AudioComponentFindNext(NULL, &desc);
+	if (!component) {
+		blog(LOG_WARNING, "[coreaudio_monitor_init_unit] find "
+		                  "component failed");
+		return false;
+	}
+
+	OSStatus stat = AudioComponentInstanceNew(component, &cam->unit);
+	return cam_success(stat, "coreaudio_monitor_init_unit",
+			"instance unit");
+}
+
+static bool coreaudio_monitor_init_format(struct coreaudio_monitor *cam)
+{
+	UInt32 channels = get_audio_channels(cam->speakers);
+	UInt32 frames   = cam->sample_rate * (cam->latency_ms / 2) / 1000;
+	OSStatus stat;
+
+	AudioStreamBasicDescription desc = {
+		.mSampleRate       = (Float64)cam->sample_rate,
+		.mFormatID         = kAudioFormatLinearPCM,
+		.mFormatFlags      = kAudioFormatFlagIsFloat |
+		                     kAudioFormatFlagIsPacked,
+		.mBytesPerPacket   = channels * sizeof(float),
+		.mFramesPerPacket  = 1,
+		.mBytesPerFrame    = channels * sizeof(float),
+		.mChannelsPerFrame = channels,
+		.mBitsPerChannel   = 32
+	};
+
+	stat = set_property(cam->unit, kAudioUnitProperty_StreamFormat,
+			SCOPE_INPUT, BUS_OUTPUT, &desc, sizeof(desc));
+	if (!cam_success(stat, "coreaudio_monitor_init_format",
+				"set stream format"))
+		return false;
+
+	/* the device may not accept the requested size, which only changes
+	 * the latency, so it isn't treated as an error */
+	stat = set_property(cam->unit, kAudioDevicePropertyBufferFrameSize,
+			SCOPE_GLOBAL, 0, &frames, sizeof(frames));
+	cam_success(stat, "coreaudio_monitor_init_format",
+			"set buffer frame size");
+	return true;
+}
+
+static bool coreaudio_monitor_init(struct coreaudio_monitor *cam)
+{
+	AURenderCallbackStruct callback_info = {
+		.inputProc       = render_callback,
+		.inputProcRefCon = cam
+	};
+	OSStatus stat;
+
+	if (!find_output_device_id(cam)) {
+		blog(LOG_WARNING, "coreaudio monitor: failed to find device "
+		                  "uid: %s", cam->device_uid);
+		return false;
+	}
+	if (!coreaudio_monitor_init_unit(cam))
+		return false;
+
+	stat = set_property(cam->unit, kAudioOutputUnitProperty_CurrentDevice,
+			SCOPE_GLOBAL, 0, &cam->device_id, sizeof(cam->device_id));
+	if (!cam_success(stat, "coreaudio_monitor_init", "set current device"))
+		return false;
+
+	if (!coreaudio_monitor_init_format(cam))
+		return false;
+
+	stat = set_property(cam->unit, kAudioUnitProperty_SetRenderCallback,
+			SCOPE_INPUT, BUS_OUTPUT, &callback_info,
+			sizeof(callback_info));
+	if (!cam_success(stat, "coreaudio_monitor_init", "set render callback"))
+		return false;
+
+	stat = AudioUnitInitialize(cam->unit);
+	if (!cam_success(stat, "coreaudio_monitor_init", "initialize"))
+		return false;
+
+	stat = AudioOutputUnitStart(cam->unit);
+	return cam_success(stat, "coreaudio_monitor_init", "start audio");
+}
+
+static void coreaudio_monitor_uninit(struct coreaudio_monitor *cam)
+{
+	if (cam->unit) {
+		AudioOutputUnitStop(cam->unit);
+		AudioUnitUninitialize(cam->unit);
+		AudioComponentInstanceDispose(cam->unit);
+		cam->unit = NULL;
+	}
+
+	audio_monitor_destroy(cam->monitor);
+	cam->monitor = NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const char *coreaudio_monitor_getname(const char *locale)
+{
+	/* TODO: Locale */
+	UNUSED_PARAMETER(locale);
+	return "CoreAudio Monitor";
+}
+
+static void coreaudio_monitor_update(void *data, obs_data_t settings)
+{
+	struct coreaudio_monitor *cam = data;
+
+	bfree(cam->device_uid);
+	cam->device_uid = bstrdup(obs_data_getstring(settings, "device_id"));
+	cam->latency_ms = (uint32_t)obs_data_getint(settings, "latency_ms");
+
+	if (!cam->device_uid)
+		cam->device_uid = bstrdup("default");
+	if (cam->latency_ms < AUDIO_MONITOR_MIN_LATENCY_MS * 2)
+		cam->latency_ms = AUDIO_MONITOR_MIN_LATENCY_MS * 2;
+	if (cam->latency_ms > AUDIO_MONITOR_MAX_LATENCY_MS)
+		cam->latency_ms = AUDIO_MONITOR_MAX_LATENCY_MS;
+}
+
+static void *coreaudio_monitor_create(obs_data_t settings,
+		obs_output_t output)
+{
+	struct coreaudio_monitor *cam =
+		bzalloc(sizeof(struct coreaudio_monitor));
+
+	cam->output = output;
+	coreaudio_monitor_update(cam, settings);
+	return cam;
+}
+
+static void coreaudio_monitor_destroy(void *data)
+{
+	struct coreaudio_monitor *cam = data;
+
+	if (cam) {
+		coreaudio_monitor_uninit(cam);
+		bfree(cam->device_uid);
+		bfree(cam);
+	}
+}
+
+static bool coreaudio_monitor_start(void *data)
+{
+	struct coreaudio_monitor *cam = data;
+	const struct audio_output_info *info;
+	struct resample_info monitor_info;
+	struct audio_convert_info conv;
+
+	if (!obs_output_can_begin_data_capture(cam->output, 0))
+		return false;
+
+	info = audio_output_getinfo(obs_output_audio(cam->output));
+	cam->sample_rate = info->samples_per_sec;
+	cam->speakers    = info->speakers;
+
+	monitor_info.samples_per_sec = cam->sample_rate;
+	monitor_info.format          = AUDIO_FORMAT_FLOAT;
+	monitor_info.speakers        = cam->speakers;
+
+	cam->monitor = audio_monitor_create(&monitor_info,
+			cam->latency_ms / 2);
+	if (!cam->monitor)
+		return false;
+
+	conv.samples_per_sec = monitor_info.samples_per_sec;
+	conv.format          = monitor_info.format;
+	conv.speakers        = monitor_info.speakers;
+	obs_output_set_audio_conversion(cam->output, &conv);
+
+	if (!coreaudio_monitor_init(cam))
+		goto fail;
+	if (!obs_output_begin_data_capture(cam->output, 0))
+		goto fail;
+
+	blog(LOG_INFO, "coreaudio: monitoring on device '%s' started",
+			cam->device_uid);
+	return true;
+
+fail:
+	coreaudio_monitor_uninit(cam);
+	return false;
+}
+
+static void coreaudio_monitor_stop(void *data)
+{
+	struct coreaudio_monitor *cam = data;
+
+	obs_output_end_data_capture(cam->output);
+	coreaudio_monitor_uninit(cam);
+}
+
+static void coreaudio_monitor_audio(void *data, struct audio_data *frames)
+{
+	struct coreaudio_monitor *cam = data;
+	audio_monitor_push(cam->monitor, frames);
+}
+
+static void coreaudio_monitor_defaults(obs_data_t settings)
+{
+	obs_data_set_default_string(settings, "device_id", "default");
+	obs_data_set_default_int(settings, "latency_ms", DEFAULT_LATENCY_MS);
+}
+
+static obs_properties_t coreaudio_monitor_properties(const char *locale)
+{
+	obs_properties_t   props = obs_properties_create(locale);
+	obs_property_t     property;
+	struct device_list devices;
+
+	memset(&devices, 0, sizeof(struct device_list));
+
+	/* TODO: translate */
+	property = obs_properties_add_list(props, "device_id", "Device",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+
+	coreaudio_enum_devices(&devices, false);
+
+	/* TODO: translate */
+	obs_property_list_add_string(property, "Default", "default");
+
+	for (size_t i = 0; i < devices.items.num; i++) {
+		struct device_item *item = devices.items.array+i;
+		obs_property_list_add_string(property,
+				item->name.array, item->value.array);
+	}
+
+	device_list_free(&devices);
+
+	obs_properties_add_int(props, "latency_ms", "Latency (ms)",
+			AUDIO_MONITOR_MIN_LATENCY_MS * 2,
+			AUDIO_MONITOR_MAX_LATENCY_MS, 1);
+	return props;
+}
+
+struct obs_output_info coreaudio_monitor_info = {
+	.id         = "coreaudio_monitor_output",
+	.flags      = OBS_OUTPUT_AUDIO,
+	.getname    = coreaudio_monitor_getname,
+	.create     = coreaudio_monitor_create,
+	.destroy    = coreaudio_monitor_destroy,
+	.start      = coreaudio_monitor_start,
+	.stop       = coreaudio_monitor_stop,
+	.raw_audio  = coreaudio_monitor_audio,
+	.update     = coreaudio_monitor_update,
+	.defaults   = coreaudio_monitor_defaults,
+	.properties = coreaudio_monitor_properties
+};
@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <errno.h>
 
+#include <stddef.h>
 #include <obs.h>
 #include <util/threading.h>
 #include <util/c99defs.h>
@@ -39,8 +40,10 @@ struct coreaudio_data {
 	bool                no_devices;
 
 	uint32_t            sample_rate;
-	enum audio_format   format;
 	enum speaker_layout speakers;
+	UInt32              channels;
+	UInt32              max_frames;
+	volatile long       render_errors;
 
 	pthread_t           reconnect_thread;
 	os_event_t          exit_event;
@@ -158,29 +161,6 @@ static inline bool enable_io(struct coreaudio_data *ca,
 			&enable_int, sizeof(enable_int));
 }
 
-static inline enum audio_format convert_ca_format(UInt32 format_flags,
-		UInt32 bits)
-{
-	bool planar = (format_flags & kAudioFormatFlagIsNonInterleaved) != 0;
-
-	if (format_flags & kAudioFormatFlagIsFloat)
-		return planar ? AUDIO_FORMAT_FLOAT_PLANAR : AUDIO_FORMAT_FLOAT;
-
-	if (!(format_flags & kAudioFormatFlagIsSignedInteger) && bits == 8)
-		return planar ? AUDIO_FORMAT_U8BIT_PLANAR : AUDIO_FORMAT_U8BIT;
-
-	/* not float?  not signed int?  no clue, fail */
-	if ((format_flags & kAudioFormatFlagIsSignedInteger) == 0)
-		return AUDIO_FORMAT_UNKNOWN;
-
-	if (bits == 16)
-		return planar ? AUDIO_FORMAT_16BIT_PLANAR : AUDIO_FORMAT_16BIT;
-	else if (bits == 32)
-		return planar ? AUDIO_FORMAT_32BIT_PLANAR : AUDIO_FORMAT_32BIT;
-
-	return AUDIO_FORMAT_UNKNOWN;
-}
-
 static inline enum speaker_layout convert_ca_speaker_layout(UInt32 channels)
 {
 	/* directly map channel count to enum values */
@@ -190,9 +170,13 @@ static inline enum speaker_layout convert_ca_speaker_layout(UInt32 channels)
 	return SPEAKERS_UNKNOWN;
 }
 
+/* the unit converts to float planar, which is what libobs mixes in, so the
+ * audio only has to be resampled if the device rate differs from the mixer
+ * rate.  the unit can't convert the rate of input itself. */
 static bool coreaudio_init_format(struct coreaudio_data *ca)
 {
 	AudioStreamBasicDescription desc;
+	struct audio_output_info    oai;
 	OSStatus stat;
 	UInt32 size = sizeof(desc);
 
@@ -201,27 +185,9 @@ static bool coreaudio_init_format(struct coreaudio_data *ca)
 	if (!ca_success(stat, ca, "coreaudio_init_format", "get input format"))
 		return false;
 
-	stat = set_property(ca->unit, kAudioUnitProperty_StreamFormat,
-			SCOPE_OUTPUT, BUS_INPUT, &desc, size);
-	if (!ca_success(stat, ca, "coreaudio_init_format", "set output format"))
-		return false;
-
-	if (desc.mFormatID != kAudioFormatLinearPCM) {
-		ca_warn(ca, "coreaudio_init_format", "format is not PCM");
-		return false;
-	}
-
-	ca->format = convert_ca_format(desc.mFormatFlags, desc.mBitsPerChannel);
-	if (ca->format == AUDIO_FORMAT_UNKNOWN) {
-		ca_warn(ca, "coreaudio_init_format", "unknown format flags: "
-				"%u, bits: %u",
-				(unsigned int)desc.mFormatFlags,
-				(unsigned int)desc.mBitsPerChannel);
-		return false;
-	}
-
 	ca->sample_rate = (uint32_t)desc.mSampleRate;
-	ca->speakers = convert_ca_speaker_layout(desc.mChannelsPerFrame);
+	ca->channels    = desc.mChannelsPerFrame;
+	ca->speakers    = convert_ca_speaker_layout(desc.mChannelsPerFrame);
 
 	if (ca->speakers == SPEAKERS_UNKNOWN) {
 		ca_warn(ca, "coreaudio_init_format", "unknown speaker layout: "
@@ -230,25 +196,43 @@ static bool coreaudio_init_format(struct coreaudio_data *ca)
 		return false;
 	}
 
+	desc.mFormatID         = kAudioFormatLinearPCM;
+	desc.mFormatFlags      = kAudioFormatFlagIsFloat |
+	                         kAudioFormatFlagIsPacked |
+	                         kAudioFormatFlagIsNonInterleaved;
+	desc.mBitsPerChannel   = 32;
+	desc.mBytesPerFrame    = sizeof(float);
+	desc.mFramesPerPacket  = 1;
+	desc.mBytesPerPacket   = sizeof(float);
+
+	stat = set_property(ca->unit, kAudioUnitProperty_StreamFormat,
+			SCOPE_OUTPUT, BUS_INPUT, &desc, sizeof(desc));
+	if (!ca_success(stat, ca, "coreaudio_init_format", "set output format"))
+		return false;
+
+	if (obs_get_audio_info(&oai) &&
+	    oai.samples_per_sec != ca->sample_rate)
+		blog(LOG_INFO, "coreaudio: device '%s' runs at %u Hz, its "
+		               "audio is resampled to %u Hz",
+		               ca->device_name, ca->sample_rate,
+		               oai.samples_per_sec);
+
 	return true;
 }
 
+/* the buffers are sized for the most frames the unit renders at once, so
+ * nothing is allocated in the render callback */
 static bool coreaudio_init_buffer(struct coreaudio_data *ca)
 {
-	UInt32 buf_size = 0;
-	UInt32 size     = 0;
-	UInt32 frames   = 0;
+	UInt32 max_frames = 0;
+	UInt32 frames     = 0;
+	UInt32 size;
 	OSStatus stat;
 
-	AudioObjectPropertyAddress addr = {
-		kAudioDevicePropertyStreamConfiguration,
-		kAudioDevicePropertyScopeInput,
-		kAudioObjectPropertyElementMaster
-	};
-
-	stat = AudioObjectGetPropertyDataSize(ca->device_id, &addr, 0, NULL,
-			&buf_size);
-	if (!ca_success(stat, ca, "coreaudio_init_buffer", "get list size"))
+	size = sizeof(max_frames);
+	stat = get_property(ca->unit, kAudioUnitProperty_MaximumFramesPerSlice,
+			SCOPE_GLOBAL, 0, &max_frames, &size);
+	if (!ca_success(stat, ca, "coreaudio_init_buffer", "get max frames"))
 		return false;
 
 	size = sizeof(frames);
@@ -257,23 +241,28 @@ static bool coreaudio_init_buffer(struct coreaudio_data *ca)
 	if (!ca_success(stat, ca, "coreaudio_init_buffer", "get frame size"))
 		return false;
 
-	/* ---------------------- */
+	ca->max_frames = max_frames > frames ? max_frames : frames;
 
-	ca->buf_list = bmalloc(buf_size);
+	ca->buf_list = bzalloc(offsetof(AudioBufferList, mBuffers) +
+			sizeof(AudioBuffer) * ca->channels);
+	ca->buf_list->mNumberBuffers = ca->channels;
 
-	stat = AudioObjectGetPropertyData(ca->device_id, &addr, 0, NULL,
-			&buf_size, ca->buf_list);
-	if (!ca_success(stat, ca, "coreaudio_init_buffer", "allocate")) {
-		bfree(ca->buf_list);
-		ca->buf_list = NULL;
-		return false;
+	for (UInt32 i = 0; i < ca->channels; i++) {
+		AudioBuffer *buf = &ca->buf_list->mBuffers[i];
+
+		buf->mNumberChannels = 1;
+		buf->mDataByteSize   = ca->max_frames * sizeof(float);
+		buf->mData           = bzalloc(buf->mDataByteSize);
 	}
 
-	for (UInt32 i = 0; i < ca->buf_list->mNumberBuffers; i++) {
-		size = ca->buf_list->mBuffers[i].mDataByteSize;
-		ca->buf_list->mBuffers[i].mData = bmalloc(size);
+	if (!obs_source_init_rt_audio(ca->source, AUDIO_FORMAT_FLOAT_PLANAR,
+				ca->speakers, ca->sample_rate,
+				ca->max_frames)) {
+		ca_warn(ca, "coreaudio_init_buffer", "failed to create "
+				"audio ring");
+		return false;
 	}
-	
+
 	return true;
 }
 
@@ -287,6 +276,8 @@ static void buf_list_free(AudioBufferList *buf_list)
 	}
 }
 
+/* runs on the real-time thread of the device: nothing in here may
+ * allocate, lock, or log */
 static OSStatus input_callback(
 		void *data,
 		AudioUnitRenderActionFlags *action_flags,
@@ -296,24 +287,31 @@ static OSStatus input_callback(
 		AudioBufferList *ignored_buffers)
 {
 	struct coreaudio_data *ca = data;
+	AudioBufferList *buf_list = ca->buf_list;
+	const uint8_t *audio[MAX_AV_PLANES] = {0};
 	OSStatus stat;
-	struct source_audio audio;
 
-	stat = AudioUnitRender(ca->unit, action_flags, ts_data, bus_num, frames,
-			ca->buf_list);
-	if (!ca_success(stat, ca, "input_callback", "audio retrieval"))
+	if (frames > ca->max_frames) {
+		os_atomic_inc_long(&ca->render_errors);
 		return noErr;
+	}
 
-	for (UInt32 i = 0; i < ca->buf_list->mNumberBuffers; i++)
-		audio.data[i] = ca->buf_list->mBuffers[i].mData;
+	/* rendering sets the sizes to what was written */
+	for (UInt32 i = 0; i < buf_list->mNumberBuffers; i++)
+		buf_list->mBuffers[i].mDataByteSize = frames * sizeof(float);
+
+	stat = AudioUnitRender(ca->unit, action_flags, ts_data, bus_num, frames,
+			buf_list);
+	if (stat != noErr) {
+		os_atomic_inc_long(&ca->render_errors);
+		return noErr;
+	}
 
-	audio.frames          = frames;
-	audio.speakers        = ca->speakers;
-	audio.format          = ca->format;
-	audio.samples_per_sec = ca->sample_rate;
-	audio.timestamp       = ts_data->mHostTime;
+	for (UInt32 i = 0; i < buf_list->mNumberBuffers; i++)
+		audio[i] = buf_list->mBuffers[i].mData;
 
-	obs_source_output_audio(ca->source, &audio);
+	obs_source_output_rt_audio(ca->source, audio, frames,
+			ts_data->mHostTime);
 
 	UNUSED_PARAMETER(ignored_buffers);
 	return noErr;
@@ -327,6 +325,8 @@ static void *reconnect_thread(void *param)
 {
 	struct coreaudio_data *ca = param;
 
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "coreaudio reconnect");
+
 	ca->reconnecting = true;
 
 	while (os_event_timedwait(ca->exit_event, ca->retry_time) == ETIMEDOUT) {
@@ -625,8 +625,15 @@ static void coreaudio_uninit(struct coreaudio_data *ca)
 
 	ca->au_initialized = false;
 
+	obs_source_free_rt_audio(ca->source);
 	buf_list_free(ca->buf_list);
 	ca->buf_list = NULL;
+
+	long render_errors = os_atomic_set_long(&ca->render_errors, 0);
+	if (render_errors)
+		blog(LOG_WARNING, "coreaudio: %ld buffers of device '%s' "
+		                  "failed to render", render_errors,
+		                  ca->device_name);
 }
 
 /* ------------------------------------------------------------------------- */
@@ -6,9 +6,14 @@
 #import <CoreGraphics/CGDisplayStream.h>
 #import <Cocoa/Cocoa.h>
 
+/*
+ * The display stream hands out IOSurfaces, which are bound straight to a
+ * rectangle texture, so frames are never copied on the CPU.  The stream
+ * marks each frame with the rects that changed since the previous one, and
+ * frames without any changes are dropped before they reach the renderer.
+ */
+
 struct display_capture {
-	samplerstate_t sampler;
-	effect_t draw_effect;
 	texture_t tex;
 
 	unsigned display;
@@ -22,6 +27,15 @@ struct display_capture {
 	pthread_mutex_t mutex;
 };
 
+static inline void release_surface(IOSurfaceRef *surface)
+{
+	if (*surface) {
+		IOSurfaceDecrementUseCount(*surface);
+		CFRelease(*surface);
+		*surface = NULL;
+	}
+}
+
 static void destroy_display_stream(struct display_capture *dc)
 {
 	if (dc->disp) {
@@ -34,17 +48,8 @@ static void destroy_display_stream(struct display_capture *dc)
 		dc->tex = NULL;
 	}
 
-	if (dc->current) {
-		IOSurfaceDecrementUseCount(dc->current);
-		CFRelease(dc->current);
-		dc->current = NULL;
-	}
-
-	if (dc->prev) {
-		IOSurfaceDecrementUseCount(dc->prev);
-		CFRelease(dc->prev);
-		dc->prev = NULL;
-	}
+	release_surface(&dc->current);
+	release_surface(&dc->prev);
 
 	if (dc->disp) {
 		CFRelease(dc->disp);
@@ -52,6 +57,7 @@ static void destroy_display_stream(struct display_capture *dc)
 	}
 
 	os_event_destroy(dc->disp_finished);
+	dc->disp_finished = NULL;
 }
 
 static void display_capture_destroy(void *data)
@@ -61,22 +67,51 @@ static void display_capture_destroy(void *data)
 	if (!dc)
 		return;
 
-	pthread_mutex_lock(&dc->mutex);
 	gs_entercontext(obs_graphics());
-
 	destroy_display_stream(dc);
-
-	if (dc->sampler)
-		samplerstate_destroy(dc->sampler);
-	if (dc->draw_effect)
-		effect_destroy(dc->draw_effect);
-
 	gs_leavecontext();
 
 	pthread_mutex_destroy(&dc->mutex);
 	bfree(dc);
 }
 
+static inline bool frame_has_updates(CGDisplayStreamUpdateRef update_ref)
+{
+	size_t count = 0;
+
+	/* the first frame has no update, and is always the full display */
+	if (!update_ref)
+		return true;
+
+	CGDisplayStreamUpdateGetRects(update_ref,
+			kCGDisplayStreamUpdateDirtyRects, &count);
+	return count > 0;
+}
+
+static void display_stream_update(struct display_capture *dc,
+		CGDisplayStreamFrameStatus status, IOSurfaceRef frame_surface,
+		CGDisplayStreamUpdateRef update_ref)
+{
+	if (status == kCGDisplayStreamFrameStatusStopped) {
+		os_event_signal(dc->disp_finished);
+		return;
+	}
+
+	if (status != kCGDisplayStreamFrameStatusFrameComplete ||
+	    !frame_surface || !frame_has_updates(update_ref))
+		return;
+
+	/* the use count keeps the stream from reusing the surface while it's
+	 * queued or bound to the texture */
+	CFRetain(frame_surface);
+	IOSurfaceIncrementUseCount(frame_surface);
+
+	pthread_mutex_lock(&dc->mutex);
+	release_surface(&dc->current);
+	dc->current = frame_surface;
+	pthread_mutex_unlock(&dc->mutex);
+}
+
 static bool init_display_stream(struct display_capture *dc)
 {
 	if (dc->display >= [NSScreen screens].count)
@@ -105,77 +140,56 @@ static bool init_display_stream(struct display_capture *dc)
 			@(!dc->hide_cursor),
 	};
 
-	os_event_init(&dc->disp_finished, OS_EVENT_TYPE_MANUAL);
+	if (os_event_init(&dc->disp_finished, OS_EVENT_TYPE_MANUAL) != 0)
+		return false;
 
 	dc->disp = CGDisplayStreamCreateWithDispatchQueue(disp_id,
 			dc->width, dc->height, 'BGRA',
 			(__bridge CFDictionaryRef)dict,
 			dispatch_queue_create(NULL, NULL),
 			^(CGDisplayStreamFrameStatus status,
-				uint64_t displayTime,
-				IOSurfaceRef frameSurface,
-				CGDisplayStreamUpdateRef updateRef)
+				uint64_t display_time,
+				IOSurfaceRef frame_surface,
+				CGDisplayStreamUpdateRef update_ref)
 			{
-				UNUSED_PARAMETER(displayTime);
-				UNUSED_PARAMETER(updateRef);
-
-				if (status ==
-					kCGDisplayStreamFrameStatusStopped) {
-					os_event_signal(dc->disp_finished);
-					return;
-				}
-
-				if (!frameSurface ||
-					pthread_mutex_trylock(&dc->mutex))
-					return;
-
-				if (dc->current) {
-					IOSurfaceDecrementUseCount(dc->current);
-					CFRelease(dc->current);
-					dc->current = NULL;
-				}
-
-				dc->current = frameSurface;
-				CFRetain(dc->current);
-				IOSurfaceIncrementUseCount(dc->current);
-				pthread_mutex_unlock(&dc->mutex);
+				UNUSED_PARAMETER(display_time);
+				display_stream_update(dc, status,
+						frame_surface, update_ref);
 			}
 	);
 
-	return !CGDisplayStreamStart(dc->disp);
+	if (!dc->disp) {
+		blog(LOG_ERROR, "display_capture: Failed to create display "
+		                "stream for display %u", dc->display);
+		return false;
+	}
+
+	/* a stream that never started won't signal that it stopped */
+	if (CGDisplayStreamStart(dc->disp) != kCGErrorSuccess) {
+		blog(LOG_ERROR, "display_capture: Failed to start display "
+		                "stream for display %u", dc->display);
+		CFRelease(dc->disp);
+		dc->disp = NULL;
+		return false;
+	}
+
+	return true;
 }
 
 static void *display_capture_create(obs_data_t settings,
 		obs_source_t source)
 {
 	UNUSED_PARAMETER(source);
-	UNUSED_PARAMETER(settings);
 
 	struct display_capture *dc = bzalloc(sizeof(struct display_capture));
 
-	gs_entercontext(obs_graphics());
-
-	struct gs_sampler_info info = {
-		.filter = GS_FILTER_LINEAR,
-		.address_u = GS_ADDRESS_CLAMP,
-		.address_v = GS_ADDRESS_CLAMP,
-		.address_w = GS_ADDRESS_CLAMP,
-		.max_anisotropy = 1,
-	};
-	dc->sampler = gs_create_samplerstate(&info);
-	if (!dc->sampler)
-		goto fail;
-
-	char *effect_file = obs_find_plugin_file("test-input/draw_rect.effect");
-	dc->draw_effect = gs_create_effect_from_file(effect_file, NULL);
-	bfree(effect_file);
-	if (!dc->draw_effect)
-		goto fail;
-
-	gs_leavecontext();
+	if (pthread_mutex_init(&dc->mutex, NULL) != 0) {
+		bfree(dc);
+		return NULL;
+	}
 
-	dc->display = obs_data_getint(settings, "display");
-	pthread_mutex_init(&dc->mutex, NULL);
+	dc->display     = obs_data_getint(settings, "display");
+	dc->hide_cursor = !obs_data_getbool(settings, "show_cursor");
 
 	if (!init_display_stream(dc))
 		goto fail;
@@ -183,55 +197,56 @@ static void *display_capture_create(obs_data_t settings,
 	return dc;
 
 fail:
-	gs_leavecontext();
 	display_capture_destroy(dc);
 	return NULL;
 }
 
-static void display_capture_video_render(void *data, effect_t effect)
+static void update_texture(struct display_capture *dc)
 {
-	UNUSED_PARAMETER(effect);
-
-	struct display_capture *dc = data;
+	IOSurfaceRef surface;
 
 	pthread_mutex_lock(&dc->mutex);
+	surface = dc->current;
+	dc->current = NULL;
+	pthread_mutex_unlock(&dc->mutex);
 
-	if (dc->current && dc->prev != dc->current) {
-		if (dc->tex)
-			texture_rebind_iosurface(dc->tex, dc->current);
-		else
-			dc->tex = gs_create_texture_from_iosurface(
-					dc->current);
-
-		if (dc->prev) {
-			IOSurfaceDecrementUseCount(dc->prev);
-			CFRelease(dc->prev);
-		}
-		dc->prev = dc->current;
-		dc->current = NULL;
+	if (!surface)
+		return;
+
+	if (!dc->tex || !texture_rebind_iosurface(dc->tex, surface)) {
+		texture_destroy(dc->tex);
+		dc->tex = gs_create_texture_from_iosurface(surface);
 	}
 
-	if (!dc->tex) goto fail;
+	release_surface(&dc->prev);
+	dc->prev = surface;
+}
+
+static void display_capture_video_render(void *data, effect_t effect)
+{
+	struct display_capture *dc = data;
+
+	update_texture(dc);
+	if (!dc->tex)
+		return;
+
+	effect = obs_get_default_rect_effect();
+	technique_t tech = effect_gettechnique(effect, "Draw");
 
-	gs_load_samplerstate(dc->sampler, 0);
-	technique_t tech = effect_gettechnique(dc->draw_effect, "Default");
-	effect_settexture(dc->draw_effect,
-			effect_getparambyidx(dc->draw_effect, 1),
-			dc->tex);
 	technique_begin(tech);
 	technique_beginpass(tech, 0);
 
+	effect_settexture(effect, effect_getparambyname(effect, "image"),
+			dc->tex);
 	gs_draw_sprite(dc->tex, 0, 0, 0);
 
 	technique_endpass(tech);
 	technique_end(tech);
-
-fail:
-	pthread_mutex_unlock(&dc->mutex);
 }
 
 static const char *display_capture_getname(const char *locale)
 {
+	/* TODO: locale */
 	UNUSED_PARAMETER(locale);
 	return "Display Capture";
 }
@@ -259,7 +274,8 @@ static void display_capture_update(void *data, obs_data_t settings)
 	struct display_capture *dc = data;
 	unsigned display = obs_data_getint(settings, "display");
 	bool show_cursor = obs_data_getbool(settings, "show_cursor");
-	if (dc->display == display && dc->hide_cursor != show_cursor)
+
+	if (dc->display == display && dc->hide_cursor == !show_cursor)
 		return;
 
 	gs_entercontext(obs_graphics());
@@ -276,6 +292,7 @@ static obs_properties_t display_capture_properties(char const *locale)
 {
 	obs_properties_t props = obs_properties_create(locale);
 
+	/* TODO: locale */
 	obs_property_t list = obs_properties_add_list(props,
 			"display", "Display",
 			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
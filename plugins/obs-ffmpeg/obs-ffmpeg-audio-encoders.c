@@ -0,0 +1,455 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/base.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <obs.h>
+
+#include <libavformat/avformat.h>
+
+#include "obs-ffmpeg-formats.h"
+#include "obs-ffmpeg-compat.h"
+
+/* FFmpeg's AAC and Opus encoders, which only differ in how their codec is
+ * found and configured */
+
+struct enc_encoder {
+	const char       *type;
+	obs_encoder_t    encoder;
+
+	AVCodec          *codec;
+	AVCodecContext   *context;
+
+	uint8_t          *samples[MAX_AV_PLANES];
+	AVFrame          *aframe;
+	int              total_samples;
+
+	DARRAY(uint8_t)  packet_buffer;
+
+	size_t           audio_planes;
+	size_t           audio_size;
+
+	/* 1024 for AAC, the frame duration for Opus */
+	int              frame_size;
+	int              frame_size_bytes;
+};
+
+static const char *aac_getname(const char *locale)
+{
+	UNUSED_PARAMETER(locale);
+	return "FFmpeg Default AAC Encoder";
+}
+
+static const char *opus_getname(const char *locale)
+{
+	UNUSED_PARAMETER(locale);
+	return "FFmpeg Opus Encoder";
+}
+
+static void enc_warn(const char *func, const char *format, ...)
+{
+	va_list args;
+	char msg[1024];
+
+	va_start(args, format);
+	vsnprintf(msg, sizeof(msg), format, args);
+	blog(LOG_WARNING, "[%s]: %s", func, msg);
+	va_end(args);
+}
+
+static void enc_destroy(void *data)
+{
+	struct enc_encoder *enc = data;
+
+	if (enc->samples[0])
+		av_freep(&enc->samples[0]);
+	if (enc->context)
+		avcodec_close(enc->context);
+	if (enc->aframe)
+		av_frame_free(&enc->aframe);
+
+	da_free(enc->packet_buffer);
+	bfree(enc);
+}
+
+static bool initialize_codec(struct enc_encoder *enc, AVDictionary **opts)
+{
+	AVDictionaryEntry *unused = NULL;
+	int ret;
+
+	enc->aframe  = av_frame_alloc();
+	if (!enc->aframe) {
+		enc_warn("initialize_codec", "Failed to allocate audio frame");
+		return false;
+	}
+
+	ret = avcodec_open2(enc->context, enc->codec, opts);
+	if (ret < 0) {
+		enc_warn("initialize_codec", "Failed to open %s codec: %s",
+				enc->type, av_err2str(ret));
+		return false;
+	}
+
+	/* options the codec doesn't have are left in the dictionary */
+	while ((unused = av_dict_get(*opts, "", unused,
+					AV_DICT_IGNORE_SUFFIX)))
+		enc_warn("initialize_codec", "%s codec ignored option '%s'",
+				enc->type, unused->key);
+
+	enc->frame_size = enc->context->frame_size;
+	if (!enc->frame_size)
+		enc->frame_size = 1024;
+
+	enc->frame_size_bytes = enc->frame_size * (int)enc->audio_size;
+
+	ret = av_samples_alloc(enc->samples, NULL, enc->context->channels,
+			enc->frame_size, enc->context->sample_fmt, 0);
+	if (ret < 0) {
+		enc_warn("initialize_codec", "Failed to create audio buffer: "
+		                             "%s", av_err2str(ret));
+		return false;
+	}
+
+	return true;
+}
+
+static void init_sizes(struct enc_encoder *enc, audio_t audio)
+{
+	const struct audio_output_info *aoi;
+	enum audio_format format;
+
+	aoi    = audio_output_getinfo(audio);
+	format = convert_ffmpeg_sample_format(enc->context->sample_fmt);
+
+	enc->audio_planes = get_audio_planes(format, aoi->speakers);
+	enc->audio_size   = get_audio_size(format, aoi->speakers, 1);
+}
+
+/* the lowest supported rate that isn't below the output rate, otherwise the
+ * highest one (Opus only takes 8, 12, 16, 24 and 48 kHz) */
+static int get_supported_sample_rate(const AVCodec *codec, int rate)
+{
+	int above = 0;
+	int below = 0;
+
+	if (!codec->supported_samplerates)
+		return rate;
+
+	for (const int *r = codec->supported_samplerates; *r; r++) {
+		if (*r >= rate && (!above || *r < above))
+			above = *r;
+		else if (*r < rate && *r > below)
+			below = *r;
+	}
+
+	return above ? above : below;
+}
+
+static void *enc_create(obs_data_t settings, obs_encoder_t encoder,
+		const char *type, AVCodec *codec, AVDictionary **opts)
+{
+	struct enc_encoder *enc;
+	int                bitrate = (int)obs_data_getint(settings, "bitrate");
+	audio_t            audio   = obs_encoder_audio(encoder);
+
+	if (!bitrate) {
+		enc_warn("enc_create", "Invalid bitrate specified");
+		return NULL;
+	}
+
+	if (!codec) {
+		enc_warn("enc_create", "Couldn't find %s encoder", type);
+		return NULL;
+	}
+
+	enc          = bzalloc(sizeof(struct enc_encoder));
+	enc->type    = type;
+	enc->encoder = encoder;
+	enc->codec   = codec;
+
+	enc->context = avcodec_alloc_context3(enc->codec);
+	if (!enc->context) {
+		enc_warn("enc_create", "Failed to create codec context");
+		goto fail;
+	}
+
+	/* libobs resamples the audio if the codec doesn't support the rate
+	 * of the audio output, see enc_audio_info */
+	enc->context->bit_rate    = bitrate * 1000;
+	enc->context->channels    = (int)audio_output_channels(audio);
+	enc->context->sample_rate = get_supported_sample_rate(enc->codec,
+			(int)audio_output_samplerate(audio));
+	enc->context->sample_fmt  = enc->codec->sample_fmts ?
+		enc->codec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+	enc->context->time_base   = (AVRational){1,
+		enc->context->sample_rate};
+
+	init_sizes(enc, audio);
+
+	/* enable experimental FFmpeg encoder if the only one available */
+	enc->context->strict_std_compliance = -2;
+
+	if (initialize_codec(enc, opts))
+		return enc;
+
+fail:
+	enc_destroy(enc);
+	return NULL;
+}
+
+static void *aac_create(obs_data_t settings, obs_encoder_t encoder)
+{
+	AVDictionary *opts = NULL;
+	void         *enc;
+
+	avcodec_register_all();
+
+	enc = enc_create(settings, encoder, "AAC",
+			avcodec_find_encoder(AV_CODEC_ID_AAC), &opts);
+	av_dict_free(&opts);
+	return enc;
+}
+
+/* libopus is used over FFmpeg's own Opus encoder, which is experimental
+ * and has no low delay or FEC support.  in-band FEC only kicks in when the
+ * encoder expects packet loss, so the expected loss is part of the
+ * settings */
+static void *opus_create(obs_data_t settings, obs_encoder_t encoder)
+{
+	AVDictionary *opts     = NULL;
+	int          duration  = (int)obs_data_getint(settings,
+			"frame_duration");
+	bool         fec       = obs_data_getbool(settings, "fec");
+	int          loss      = (int)obs_data_getint(settings, "packet_loss");
+	AVCodec      *codec;
+	void         *enc;
+
+	avcodec_register_all();
+
+	codec = avcodec_find_encoder_by_name("libopus");
+	if (!codec)
+		codec = avcodec_find_encoder(AV_CODEC_ID_OPUS);
+
+	av_dict_set_int(&opts, "frame_duration", duration, 0);
+	av_dict_set(&opts, "application",
+			obs_data_getbool(settings, "low_delay") ?
+			"lowdelay" : "audio", 0);
+	if (fec) {
+		av_dict_set_int(&opts, "fec", 1, 0);
+		av_dict_set_int(&opts, "packet_loss", loss, 0);
+	}
+
+	enc = enc_create(settings, encoder, "Opus", codec, &opts);
+	av_dict_free(&opts);
+
+	if (enc)
+		blog(LOG_INFO, "Opus: %d ms frames, FEC %s", duration,
+				fec ? "on" : "off");
+	return enc;
+}
+
+/* points the frame at the input planes, no copy is made */
+static void fill_planar_frame(struct enc_encoder *enc,
+		struct encoder_frame *frame)
+{
+	AVFrame *aframe = enc->aframe;
+
+	for (size_t i = 0; i < enc->audio_planes; i++)
+		aframe->data[i] = frame->data[i];
+
+	aframe->extended_data  = aframe->data;
+	aframe->linesize[0]    = enc->frame_size_bytes;
+	aframe->format         = enc->context->sample_fmt;
+	aframe->channel_layout = enc->context->channel_layout;
+}
+
+static bool fill_packed_frame(struct enc_encoder *enc,
+		struct encoder_frame *frame)
+{
+	int ret;
+
+	memcpy(enc->samples[0], frame->data[0], enc->frame_size_bytes);
+
+	ret = avcodec_fill_audio_frame(enc->aframe, enc->context->channels,
+			enc->context->sample_fmt, enc->samples[0],
+			enc->frame_size_bytes * enc->context->channels, 1);
+	if (ret < 0) {
+		enc_warn("fill_packed_frame", "avcodec_fill_audio_frame "
+		                              "failed: %s", av_err2str(ret));
+		return false;
+	}
+
+	return true;
+}
+
+static bool do_encode(struct enc_encoder *enc,
+		struct encoder_frame *frame,
+		struct encoder_packet *packet, bool *received_packet)
+{
+	AVRational time_base = {1, enc->context->sample_rate};
+	AVPacket   avpacket  = {0};
+	int        got_packet;
+	int        ret;
+
+	enc->aframe->nb_samples = enc->frame_size;
+	enc->aframe->pts = av_rescale_q(enc->total_samples,
+			(AVRational){1, enc->context->sample_rate},
+			enc->context->time_base);
+
+	if (enc->audio_planes > 1)
+		fill_planar_frame(enc, frame);
+	else if (!fill_packed_frame(enc, frame))
+		return false;
+
+	enc->total_samples += enc->frame_size;
+
+	ret = avcodec_encode_audio2(enc->context, &avpacket, enc->aframe,
+			&got_packet);
+	if (ret < 0) {
+		enc_warn("do_encode", "avcodec_encode_audio2 failed: %s",
+				av_err2str(ret));
+		return false;
+	}
+
+	*received_packet = !!got_packet;
+	if (!got_packet)
+		return true;
+
+	da_resize(enc->packet_buffer, 0);
+	da_push_back_array(enc->packet_buffer, avpacket.data, avpacket.size);
+
+	packet->pts  = rescale_ts(avpacket.pts, enc->context, time_base);
+	packet->dts  = rescale_ts(avpacket.dts, enc->context, time_base);
+	packet->data = enc->packet_buffer.array;
+	packet->size = avpacket.size;
+	packet->type = OBS_ENCODER_AUDIO;
+	packet->timebase_num = 1;
+	packet->timebase_den = (int32_t)enc->context->sample_rate;
+	av_free_packet(&avpacket);
+	return true;
+}
+
+static bool enc_encode(void *data, struct encoder_frame *frame,
+		struct encoder_packet *packet, bool *received_packet)
+{
+	struct enc_encoder *enc = data;
+	return do_encode(enc, frame, packet, received_packet);
+}
+
+static void aac_defaults(obs_data_t settings)
+{
+	obs_data_set_default_int(settings, "bitrate", 128);
+}
+
+static void opus_defaults(obs_data_t settings)
+{
+	obs_data_set_default_int(settings, "bitrate", 96);
+	obs_data_set_default_int(settings, "frame_duration", 20);
+	obs_data_set_default_bool(settings, "low_delay", false);
+	obs_data_set_default_bool(settings, "fec", false);
+	obs_data_set_default_int(settings, "packet_loss", 10);
+}
+
+static obs_properties_t aac_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_int(props, "bitrate", "Bitrate", 32, 320, 32);
+	return props;
+}
+
+static obs_properties_t opus_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+	obs_property_t   list;
+
+	/* TODO: locale */
+	obs_properties_add_int(props, "bitrate", "Bitrate", 16, 320, 16);
+
+	list = obs_properties_add_list(props, "frame_duration",
+			"Frame Duration", OBS_COMBO_TYPE_LIST,
+			OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(list, "10 ms", 10);
+	obs_property_list_add_int(list, "20 ms", 20);
+	obs_property_list_add_int(list, "40 ms", 40);
+	obs_property_list_add_int(list, "60 ms", 60);
+
+	obs_properties_add_bool(props, "low_delay", "Low Delay Mode");
+	obs_properties_add_bool(props, "fec", "Forward Error Correction");
+	obs_properties_add_int(props, "packet_loss", "Expected Packet Loss "
+			"(%)", 0, 100, 1);
+	return props;
+}
+
+static bool enc_extra_data(void *data, uint8_t **extra_data, size_t *size)
+{
+	struct enc_encoder *enc = data;
+
+	*extra_data = enc->context->extradata;
+	*size       = enc->context->extradata_size;
+	return true;
+}
+
+static bool enc_audio_info(void *data, struct audio_convert_info *info)
+{
+	struct enc_encoder *enc = data;
+
+	memset(info, 0, sizeof(struct audio_convert_info));
+	info->format = convert_ffmpeg_sample_format(enc->context->sample_fmt);
+	info->samples_per_sec = (uint32_t)enc->context->sample_rate;
+	return true;
+}
+
+static size_t enc_frame_size(void *data)
+{
+	struct enc_encoder *enc =data;
+	return enc->frame_size;
+}
+
+struct obs_encoder_info aac_encoder_info = {
+	.id         = "ffmpeg_aac",
+	.type       = OBS_ENCODER_AUDIO,
+	.codec      = "AAC",
+	.getname    = aac_getname,
+	.create     = aac_create,
+	.destroy    = enc_destroy,
+	.encode     = enc_encode,
+	.frame_size = enc_frame_size,
+	.defaults   = aac_defaults,
+	.properties = aac_properties,
+	.extra_data = enc_extra_data,
+	.audio_info = enc_audio_info,
+	.caps       = OBS_ENCODER_CAP_DIRECT_AUDIO
+};
+
+struct obs_encoder_info opus_encoder_info = {
+	.id         = "ffmpeg_opus",
+	.type       = OBS_ENCODER_AUDIO,
+	.codec      = "opus",
+	.getname    = opus_getname,
+	.create     = opus_create,
+	.destroy    = enc_destroy,
+	.encode     = enc_encode,
+	.frame_size = enc_frame_size,
+	.defaults   = opus_defaults,
+	.properties = opus_properties,
+	.extra_data = enc_extra_data,
+	.audio_info = enc_audio_info,
+	.caps       = OBS_ENCODER_CAP_DIRECT_AUDIO
+};
@@ -20,11 +20,30 @@ static inline enum AVPixelFormat obs_to_ffmpeg_video_format(
 	case VIDEO_FORMAT_RGBA: return AV_PIX_FMT_RGBA;
 	case VIDEO_FORMAT_BGRA: return AV_PIX_FMT_BGRA;
 	case VIDEO_FORMAT_BGRX: return AV_PIX_FMT_BGRA;
+	case VIDEO_FORMAT_I444: return AV_PIX_FMT_YUV444P;
+	case VIDEO_FORMAT_I422: return AV_PIX_FMT_YUV422P;
 	}
 
 	return AV_PIX_FMT_NONE;
 }
 
+/* formats async video can take as-is, everything else has to be converted */
+static inline enum video_format ffmpeg_to_obs_video_format(
+		enum AVPixelFormat format)
+{
+	switch ((int)format) {
+	case AV_PIX_FMT_YUV420P:  return VIDEO_FORMAT_I420;
+	case AV_PIX_FMT_YUVJ420P: return VIDEO_FORMAT_I420;
+	case AV_PIX_FMT_NV12:     return VIDEO_FORMAT_NV12;
+	case AV_PIX_FMT_YUYV422:  return VIDEO_FORMAT_YUY2;
+	case AV_PIX_FMT_UYVY422:  return VIDEO_FORMAT_UYVY;
+	case AV_PIX_FMT_RGBA:     return VIDEO_FORMAT_RGBA;
+	case AV_PIX_FMT_BGRA:     return VIDEO_FORMAT_BGRA;
+	}
+
+	return VIDEO_FORMAT_NONE;
+}
+
 static inline enum audio_format convert_ffmpeg_sample_format(
 		enum AVSampleFormat format)
 {
@@ -42,3 +61,11 @@ static inline enum audio_format convert_ffmpeg_sample_format(
 	/* shouldn't get here */
 	return AUDIO_FORMAT_16BIT;
 }
+
+static inline bool ffmpeg_sample_format_supported(enum AVSampleFormat format)
+{
+	return format == AV_SAMPLE_FMT_U8  || format == AV_SAMPLE_FMT_U8P  ||
+	       format == AV_SAMPLE_FMT_S16 || format == AV_SAMPLE_FMT_S16P ||
+	       format == AV_SAMPLE_FMT_S32 || format == AV_SAMPLE_FMT_S32P ||
+	       format == AV_SAMPLE_FMT_FLT || format == AV_SAMPLE_FMT_FLTP;
+}
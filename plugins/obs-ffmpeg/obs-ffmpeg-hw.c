@@ -0,0 +1,493 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/* hardware h264 encoders (NVENC, Quick Sync, VA-API), driven through the
+ * libavcodec wrappers for each vendor API */
+
+#include <util/base.h>
+#include <util/darray.h>
+#include <obs.h>
+
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+
+#include "obs-ffmpeg-formats.h"
+#include "obs-ffmpeg-compat.h"
+
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(55, 13, 100)
+#include <libavutil/hwcontext.h>
+#define HAVE_HWCONTEXT
+#endif
+
+enum hw_type {
+	HW_NVENC,
+	HW_QSV,
+	HW_VAAPI
+};
+
+struct hw_encoder {
+	obs_encoder_t    encoder;
+	enum hw_type     type;
+
+	AVCodec          *codec;
+	AVCodecContext   *context;
+	AVFrame          *vframe;
+
+#ifdef HAVE_HWCONTEXT
+	AVBufferRef      *device;
+	AVBufferRef      *frames;
+	AVFrame          *hwframe;
+#endif
+
+	DARRAY(uint8_t)  packet_buffer;
+};
+
+struct hw_def {
+	const char       *codec_name;
+	const char       *display_name;
+	enum AVPixelFormat pix_fmt;
+};
+
+static const struct hw_def hw_defs[] = {
+	[HW_NVENC] = {"h264_nvenc", "NVENC H.264",      AV_PIX_FMT_NV12},
+	[HW_QSV]   = {"h264_qsv",   "Quick Sync H.264", AV_PIX_FMT_NV12},
+#ifdef HAVE_HWCONTEXT
+	[HW_VAAPI] = {"h264_vaapi", "VA-API H.264",     AV_PIX_FMT_VAAPI},
+#else
+	[HW_VAAPI] = {"h264_vaapi", "VA-API H.264",     AV_PIX_FMT_NONE},
+#endif
+};
+
+static void hw_warn(const char *func, const char *format, ...)
+{
+	va_list args;
+	char msg[1024];
+
+	va_start(args, format);
+	vsnprintf(msg, sizeof(msg), format, args);
+	blog(LOG_WARNING, "[%s]: %s", func, msg);
+	va_end(args);
+}
+
+static const char *nvenc_getname(const char *locale)
+{
+	UNUSED_PARAMETER(locale);
+	return hw_defs[HW_NVENC].display_name;
+}
+
+static const char *qsv_getname(const char *locale)
+{
+	UNUSED_PARAMETER(locale);
+	return hw_defs[HW_QSV].display_name;
+}
+
+static const char *vaapi_getname(const char *locale)
+{
+	UNUSED_PARAMETER(locale);
+	return hw_defs[HW_VAAPI].display_name;
+}
+
+static void hw_destroy(void *data)
+{
+	struct hw_encoder *enc = data;
+
+	if (enc->context) {
+		avcodec_close(enc->context);
+		av_free(enc->context);
+	}
+	if (enc->vframe)
+		av_frame_free(&enc->vframe);
+
+#ifdef HAVE_HWCONTEXT
+	if (enc->hwframe)
+		av_frame_free(&enc->hwframe);
+	av_buffer_unref(&enc->frames);
+	av_buffer_unref(&enc->device);
+#endif
+
+	da_free(enc->packet_buffer);
+	bfree(enc);
+}
+
+#ifdef HAVE_HWCONTEXT
+static bool init_vaapi(struct hw_encoder *enc, const char *device)
+{
+	AVHWFramesContext *frames_ctx;
+	int ret;
+
+	ret = av_hwdevice_ctx_create(&enc->device, AV_HWDEVICE_TYPE_VAAPI,
+			(device && *device) ? device : NULL, NULL, 0);
+	if (ret < 0) {
+		hw_warn("init_vaapi", "Failed to open VA-API device: %s",
+				av_err2str(ret));
+		return false;
+	}
+
+	enc->frames = av_hwframe_ctx_alloc(enc->device);
+	if (!enc->frames) {
+		hw_warn("init_vaapi", "Failed to allocate frames context");
+		return false;
+	}
+
+	frames_ctx            = (AVHWFramesContext*)enc->frames->data;
+	frames_ctx->format    = AV_PIX_FMT_VAAPI;
+	frames_ctx->sw_format = AV_PIX_FMT_NV12;
+	frames_ctx->width     = enc->context->width;
+	frames_ctx->height    = enc->context->height;
+	frames_ctx->initial_pool_size = 20;
+
+	ret = av_hwframe_ctx_init(enc->frames);
+	if (ret < 0) {
+		hw_warn("init_vaapi", "Failed to init frames context: %s",
+				av_err2str(ret));
+		return false;
+	}
+
+	enc->context->hw_frames_ctx = av_buffer_ref(enc->frames);
+	enc->hwframe = av_frame_alloc();
+	return enc->context->hw_frames_ctx && enc->hwframe;
+}
+#endif
+
+static void init_settings(struct hw_encoder *enc, obs_data_t settings)
+{
+	video_t video = obs_encoder_video(enc->encoder);
+	const struct video_output_info *voi = video_output_getinfo(video);
+
+	int bitrate     = (int)obs_data_getint(settings, "bitrate");
+	int buffer_size = (int)obs_data_getint(settings, "buffer_size");
+	int keyint_sec  = (int)obs_data_getint(settings, "keyint_sec");
+	bool cbr        = obs_data_getbool(settings, "cbr");
+	const char *preset = obs_data_getstring(settings, "preset");
+	int fps_den     = (int)(voi->fps_den *
+			obs_encoder_get_frame_rate_divisor(enc->encoder));
+
+	enc->context->bit_rate       = bitrate * 1000;
+	enc->context->rc_buffer_size = buffer_size * 1000;
+	enc->context->rc_max_rate    = bitrate * 1000;
+	enc->context->width          = obs_encoder_get_width(enc->encoder);
+	enc->context->height         = obs_encoder_get_height(enc->encoder);
+	enc->context->time_base.num  = fps_den;
+	enc->context->time_base.den  = voi->fps_num;
+	enc->context->pix_fmt        = hw_defs[enc->type].pix_fmt;
+	enc->context->flags         |= CODEC_FLAG_GLOBAL_HEADER;
+
+	if (cbr)
+		enc->context->rc_min_rate = enc->context->bit_rate;
+
+	enc->context->gop_size = keyint_sec ?
+		keyint_sec * (int)voi->fps_num / fps_den : 250;
+
+	if (preset && *preset)
+		av_opt_set(enc->context->priv_data, "preset", preset, 0);
+}
+
+static bool initialize_codec(struct hw_encoder *enc)
+{
+	int ret;
+
+	ret = avcodec_open2(enc->context, enc->codec, NULL);
+	if (ret < 0) {
+		hw_warn("initialize_codec", "Failed to open %s: %s",
+				enc->codec->name, av_err2str(ret));
+		return false;
+	}
+
+	enc->vframe = av_frame_alloc();
+	if (!enc->vframe) {
+		hw_warn("initialize_codec", "Failed to allocate video frame");
+		return false;
+	}
+
+	enc->vframe->format = AV_PIX_FMT_NV12;
+	enc->vframe->width  = enc->context->width;
+	enc->vframe->height = enc->context->height;
+	return true;
+}
+
+static void *hw_create(obs_data_t settings, obs_encoder_t encoder,
+		enum hw_type type)
+{
+	struct hw_encoder *enc;
+
+	if (hw_defs[type].pix_fmt == AV_PIX_FMT_NONE)
+		return NULL;
+
+	avcodec_register_all();
+
+	enc          = bzalloc(sizeof(struct hw_encoder));
+	enc->encoder = encoder;
+	enc->type    = type;
+	enc->codec   = avcodec_find_encoder_by_name(hw_defs[type].codec_name);
+	if (!enc->codec) {
+		hw_warn("hw_create", "Couldn't find encoder '%s'",
+				hw_defs[type].codec_name);
+		goto fail;
+	}
+
+	enc->context = avcodec_alloc_context3(enc->codec);
+	if (!enc->context) {
+		hw_warn("hw_create", "Failed to create codec context");
+		goto fail;
+	}
+
+	init_settings(enc, settings);
+
+#ifdef HAVE_HWCONTEXT
+	if (type == HW_VAAPI &&
+	    !init_vaapi(enc, obs_data_getstring(settings, "device")))
+		goto fail;
+#endif
+
+	if (initialize_codec(enc))
+		return enc;
+
+fail:
+	hw_destroy(enc);
+	return NULL;
+}
+
+static void *nvenc_create(obs_data_t settings, obs_encoder_t encoder)
+{
+	return hw_create(settings, encoder, HW_NVENC);
+}
+
+static void *qsv_create(obs_data_t settings, obs_encoder_t encoder)
+{
+	return hw_create(settings, encoder, HW_QSV);
+}
+
+static void *vaapi_create(obs_data_t settings, obs_encoder_t encoder)
+{
+	return hw_create(settings, encoder, HW_VAAPI);
+}
+
+static AVFrame *get_input_frame(struct hw_encoder *enc,
+		struct encoder_frame *frame)
+{
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		enc->vframe->data[i]     = frame->data[i];
+		enc->vframe->linesize[i] = (int)frame->linesize[i];
+	}
+
+	enc->vframe->pts = frame->pts;
+
+#ifdef HAVE_HWCONTEXT
+	if (enc->type == HW_VAAPI) {
+		int ret;
+
+		av_frame_unref(enc->hwframe);
+
+		ret = av_hwframe_get_buffer(enc->frames, enc->hwframe, 0);
+		if (ret == 0)
+			ret = av_hwframe_transfer_data(enc->hwframe,
+					enc->vframe, 0);
+		if (ret < 0) {
+			hw_warn("get_input_frame", "Failed to upload frame: "
+			                           "%s", av_err2str(ret));
+			return NULL;
+		}
+
+		enc->hwframe->pts = frame->pts;
+		return enc->hwframe;
+	}
+#endif
+
+	return enc->vframe;
+}
+
+static bool hw_encode(void *data, struct encoder_frame *frame,
+		struct encoder_packet *packet, bool *received_packet)
+{
+	struct hw_encoder *enc      = data;
+	AVPacket          avpacket  = {0};
+	AVFrame           *input;
+	int               got_packet;
+	int               ret;
+
+	input = get_input_frame(enc, frame);
+	if (!input)
+		return false;
+
+	input->pict_type = frame->force_keyframe ?
+		AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+
+	av_init_packet(&avpacket);
+
+	ret = avcodec_encode_video2(enc->context, &avpacket, input,
+			&got_packet);
+	if (ret < 0) {
+		hw_warn("hw_encode", "avcodec_encode_video2 failed: %s",
+				av_err2str(ret));
+		return false;
+	}
+
+	*received_packet = !!got_packet;
+	if (!got_packet)
+		return true;
+
+	da_resize(enc->packet_buffer, 0);
+	da_push_back_array(enc->packet_buffer, avpacket.data, avpacket.size);
+
+	packet->pts      = avpacket.pts;
+	packet->dts      = avpacket.dts;
+	packet->data     = enc->packet_buffer.array;
+	packet->size     = avpacket.size;
+	packet->type     = OBS_ENCODER_VIDEO;
+	packet->keyframe = !!(avpacket.flags & AV_PKT_FLAG_KEY);
+	av_free_packet(&avpacket);
+	return true;
+}
+
+static void hw_defaults(obs_data_t settings)
+{
+	obs_data_set_default_int   (settings, "bitrate",     2500);
+	obs_data_set_default_int   (settings, "buffer_size", 2500);
+	obs_data_set_default_int   (settings, "keyint_sec",  2);
+	obs_data_set_default_bool  (settings, "cbr",         true);
+	obs_data_set_default_string(settings, "preset",      "");
+	obs_data_set_default_string(settings, "device",      "");
+}
+
+static obs_properties_t hw_properties(const char *locale)
+{
+	/* TODO: locale */
+
+	obs_properties_t props = obs_properties_create(locale);
+
+	obs_properties_add_int(props, "bitrate", "Bitrate", 50, 100000, 1);
+	obs_properties_add_int(props, "buffer_size", "Buffer Size", 50, 100000,
+			1);
+	obs_properties_add_int(props,
+			"keyint_sec", "Keyframe interval (seconds, 0=auto)",
+			0, 20, 1);
+	obs_properties_add_bool(props, "cbr", "CBR");
+	obs_properties_add_text(props, "preset", "Preset", OBS_TEXT_DEFAULT);
+
+	return props;
+}
+
+static obs_properties_t vaapi_properties(const char *locale)
+{
+	obs_properties_t props = hw_properties(locale);
+
+	obs_properties_add_text(props, "device", "Device (e.g. "
+			"/dev/dri/renderD128)", OBS_TEXT_DEFAULT);
+	return props;
+}
+
+static bool hw_extra_data(void *data, uint8_t **extra_data, size_t *size)
+{
+	struct hw_encoder *enc = data;
+
+	*extra_data = enc->context->extradata;
+	*size       = enc->context->extradata_size;
+	return true;
+}
+
+/* the SPS/PPS in the extra data is all these encoders produce up front, so
+ * there is no separate SEI to prepend to the first packet */
+static bool hw_sei_data(void *data, uint8_t **sei, size_t *size)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(sei);
+	UNUSED_PARAMETER(size);
+	return false;
+}
+
+static bool hw_video_info(void *data, struct video_scale_info *info)
+{
+	struct hw_encoder *enc = data;
+	video_t video = obs_encoder_video(enc->encoder);
+	const struct video_output_info *vid_info = video_output_getinfo(video);
+
+	if (vid_info->format == VIDEO_FORMAT_NV12)
+		return false;
+
+	info->format     = VIDEO_FORMAT_NV12;
+	info->width      = obs_encoder_get_width(enc->encoder);
+	info->height     = obs_encoder_get_height(enc->encoder);
+	info->range      = VIDEO_RANGE_DEFAULT;
+	info->colorspace = VIDEO_CS_DEFAULT;
+	return true;
+}
+
+static struct obs_encoder_info nvenc_encoder_info = {
+	.id         = "ffmpeg_nvenc",
+	.type       = OBS_ENCODER_VIDEO,
+	.codec      = "h264",
+	.getname    = nvenc_getname,
+	.create     = nvenc_create,
+	.destroy    = hw_destroy,
+	.encode     = hw_encode,
+	.defaults   = hw_defaults,
+	.properties = hw_properties,
+	.extra_data = hw_extra_data,
+	.sei_data   = hw_sei_data,
+	.video_info = hw_video_info
+};
+
+static struct obs_encoder_info qsv_encoder_info = {
+	.id         = "ffmpeg_qsv",
+	.type       = OBS_ENCODER_VIDEO,
+	.codec      = "h264",
+	.getname    = qsv_getname,
+	.create     = qsv_create,
+	.destroy    = hw_destroy,
+	.encode     = hw_encode,
+	.defaults   = hw_defaults,
+	.properties = hw_properties,
+	.extra_data = hw_extra_data,
+	.sei_data   = hw_sei_data,
+	.video_info = hw_video_info
+};
+
+static struct obs_encoder_info vaapi_encoder_info = {
+	.id         = "ffmpeg_vaapi",
+	.type       = OBS_ENCODER_VIDEO,
+	.codec      = "h264",
+	.getname    = vaapi_getname,
+	.create     = vaapi_create,
+	.destroy    = hw_destroy,
+	.encode     = hw_encode,
+	.defaults   = hw_defaults,
+	.properties = vaapi_properties,
+	.extra_data = hw_extra_data,
+	.sei_data   = hw_sei_data,
+	.video_info = hw_video_info
+};
+
+/* only register the encoders the linked libavcodec was built with */
+static bool hw_available(enum hw_type type)
+{
+	if (hw_defs[type].pix_fmt == AV_PIX_FMT_NONE)
+		return false;
+
+	return avcodec_find_encoder_by_name(hw_defs[type].codec_name) != NULL;
+}
+
+void register_ffmpeg_hw_encoders(void)
+{
+	avcodec_register_all();
+
+	if (hw_available(HW_NVENC))
+		obs_register_encoder(&nvenc_encoder_info);
+	if (hw_available(HW_QSV))
+		obs_register_encoder(&qsv_encoder_info);
+	if (hw_available(HW_VAAPI))
+		obs_register_encoder(&vaapi_encoder_info);
+}
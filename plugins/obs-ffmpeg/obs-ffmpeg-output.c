@@ -19,8 +19,10 @@
 #include <util/circlebuf.h>
 #include <util/threading.h>
 #include <util/dstr.h>
-#include <util/darray.h>
+#include <util/deque.h>
 #include <util/platform.h>
+#include <media-io/video-frame.h>
+#include <obs-avc.h>
 
 #include <libavutil/opt.h>
 #include <libavformat/avformat.h>
@@ -28,17 +30,41 @@
 
 #include "obs-ffmpeg-formats.h"
 #include "obs-ffmpeg-compat.h"
+#include "obs-ffmpeg-writer.h"
 
 //#define OBS_FFMPEG_VIDEO_FORMAT VIDEO_FORMAT_I420
 #define OBS_FFMPEG_VIDEO_FORMAT VIDEO_FORMAT_NV12
 
+#define VIDEO_QUEUE_SIZE 4
+
+/* write_lagging is signaled once this much is waiting for the write thread
+ * (or half of the queue limit), and cleared again below half of it */
+#define LAG_WARNING_MS   2000
+
 /* NOTE: much of this stuff is test stuff that was more or less copied from
  * the muxing.c ffmpeg example */
 
+struct ffmpeg_cfg {
+	const char                *filename;
+	int                       video_bitrate;
+	int                       audio_bitrate;
+	bool                      fragmented;
+	struct ffmpeg_writer_info writer_info;
+
+	/* when set, packets come from these encoders and are only muxed */
+	obs_encoder_t             video_encoder;
+	obs_encoder_t             audio_encoders[MAX_AUDIO_MIXES];
+};
+
 struct ffmpeg_data {
 	AVStream           *video;
 	AVStream           *audio;
 	AVCodec            *acodec;
+
+	/* encoded mode: one stream per audio track, audio_tracks[0] is the
+	 * same as audio */
+	AVStream           *audio_tracks[MAX_AUDIO_MIXES];
+
 	AVCodec            *vcodec;
 	AVFormatContext    *output;
 	struct SwsContext  *swscale;
@@ -62,7 +88,13 @@ struct ffmpeg_data {
 	int                total_samples;
 
 	const char         *filename_test;
+	struct dstr        filename;
+	bool               fragmented;
+
+	struct ffmpeg_writer      *writer;
+	struct ffmpeg_writer_info writer_info;
 
+	bool               encoded;
 	bool               initialized;
 };
 
@@ -80,7 +112,61 @@ struct ffmpeg_output {
 	os_sem_t           write_sem;
 	os_event_t         stop_event;
 
-	DARRAY(AVPacket)   packets;
+	DEQUE(AVPacket)    packets;
+
+	/* all protected by write_mutex.  once the packets waiting for the write
+	 * thread take up more than max_queue_size, disposable video frames are
+	 * dropped (or raw frames skipped before encoding), or the output is
+	 * stopped if stop_on_full is set.  at twice the limit it's stopped with
+	 * either policy, as nothing else can be dropped without corrupting the
+	 * file */
+	size_t             queue_size;
+	size_t             max_queue_size;
+	bool               stop_on_full;
+	volatile bool      queue_full;
+	volatile bool      queue_overflow;
+	bool               lagging;
+	uint32_t           packets_dropped;
+	uint64_t           rate_start_ns;
+	uint64_t           rate_bytes;
+	uint64_t           bytes_written;
+	long               write_kbps;
+
+	/* encoding is done on its own thread so that it never holds up the
+	 * video/audio output threads */
+	bool               encode_thread_active;
+	volatile bool      encode_thread_stop;
+	pthread_t          encode_thread;
+	os_sem_t           encode_sem;
+	pthread_mutex_t    encode_mutex;
+	struct video_frame video_queue[VIDEO_QUEUE_SIZE];
+	size_t             video_queue_start;
+	size_t             video_queue_count;
+	uint32_t           frames_skipped;
+
+	/* encoded mode: the recording can be split in to segments at video
+	 * keyframes.  the next file is opened ahead of time on the segment
+	 * thread, so the write thread only has to swap it in, and the
+	 * trailer of the previous file is written on that thread as well */
+	int64_t            segment_max_time;
+	uint64_t           segment_max_size;
+	struct ffmpeg_cfg  segment_cfg;
+	struct dstr        segment_path;
+	uint32_t           segment_index;
+	int64_t            segment_start;
+	uint64_t           segment_size;
+	bool               segment_keyframe_requested;
+
+	bool               segment_thread_active;
+	volatile bool      segment_thread_stop;
+	pthread_t          segment_thread;
+	os_sem_t           segment_sem;
+
+	/* both protected by write_mutex */
+	struct ffmpeg_data segment_next;
+	struct ffmpeg_data segment_prev;
+	bool               segment_next_ready;
+	bool               segment_prev_pending;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -270,6 +356,169 @@ static bool create_audio_stream(struct ffmpeg_data *data)
 	return open_audio_codec(data);
 }
 
+/* ------------------------------------------------------------------------- */
+/* encoded (mux only) streams */
+
+static bool set_extra_data(AVCodecContext *context, obs_encoder_t encoder)
+{
+	uint8_t *extra_data;
+	size_t  size;
+
+	if (!obs_encoder_get_extra_data(encoder, &extra_data, &size))
+		return true;
+
+	context->extradata = av_mallocz(size + FF_INPUT_BUFFER_PADDING_SIZE);
+	if (!context->extradata)
+		return false;
+
+	memcpy(context->extradata, extra_data, size);
+	context->extradata_size = (int)size;
+	return true;
+}
+
+static inline int encoder_bitrate(obs_encoder_t encoder)
+{
+	obs_data_t settings = obs_encoder_get_settings(encoder);
+	int bitrate = (int)obs_data_getint(settings, "bitrate");
+
+	obs_data_release(settings);
+	return bitrate;
+}
+
+static enum AVCodecID get_codec_id(const char *codec)
+{
+	const AVCodecDescriptor *desc;
+
+	if (!codec)
+		return AV_CODEC_ID_NONE;
+
+	if (astrcmpi(codec, "h264") == 0)
+		return AV_CODEC_ID_H264;
+	else if (astrcmpi(codec, "aac") == 0)
+		return AV_CODEC_ID_AAC;
+
+	desc = avcodec_descriptor_get_by_name(codec);
+	return desc ? desc->id : AV_CODEC_ID_NONE;
+}
+
+static AVStream *new_encoded_stream(struct ffmpeg_data *data,
+		obs_encoder_t encoder, enum AVMediaType type)
+{
+	const char *codec = obs_encoder_get_codec(encoder);
+	enum AVCodecID id = get_codec_id(codec);
+	AVCodecContext *context;
+	AVStream *stream;
+
+	if (id == AV_CODEC_ID_NONE) {
+		blog(LOG_WARNING, "Unsupported encoder codec '%s'",
+				codec ? codec : "(null)");
+		return NULL;
+	}
+
+	stream = avformat_new_stream(data->output, NULL);
+	if (!stream) {
+		blog(LOG_WARNING, "Couldn't create stream for codec '%s'",
+				codec);
+		return NULL;
+	}
+
+	stream->id = data->output->nb_streams-1;
+
+	context             = stream->codec;
+	context->codec_type = type;
+	context->codec_id   = id;
+	context->bit_rate   = encoder_bitrate(encoder) * 1000;
+
+	if (data->output->oformat->flags & AVFMT_GLOBALHEADER)
+		context->flags |= CODEC_FLAG_GLOBAL_HEADER;
+
+	if (!set_extra_data(context, encoder)) {
+		blog(LOG_WARNING, "Failed to allocate extra data");
+		return NULL;
+	}
+
+	return stream;
+}
+
+static bool create_encoded_video_stream(struct ffmpeg_data *data,
+		obs_encoder_t encoder)
+{
+	const struct video_output_info *voi;
+	AVCodecContext *context;
+
+	voi = video_output_getinfo(obs_encoder_video(encoder));
+
+	data->video = new_encoded_stream(data, encoder, AVMEDIA_TYPE_VIDEO);
+	if (!data->video)
+		return false;
+
+	context                 = data->video->codec;
+	context->width          = obs_encoder_get_width(encoder);
+	context->height         = obs_encoder_get_height(encoder);
+	context->time_base.num  = voi->fps_den *
+		obs_encoder_get_frame_rate_divisor(encoder);
+	context->time_base.den  = voi->fps_num;
+	context->pix_fmt        = AV_PIX_FMT_YUV420P;
+	data->video->time_base  = context->time_base;
+	return true;
+}
+
+static bool create_encoded_audio_stream(struct ffmpeg_data *data,
+		obs_encoder_t encoder, size_t track)
+{
+	const struct audio_output_info *aoi;
+	AVCodecContext *context;
+	AVStream *stream;
+	uint32_t sample_rate;
+	size_t frame_size;
+
+	/* the encoder may encode at another rate than the audio output (Opus
+	 * is always 48khz), so its own rate and frame size are used */
+	aoi         = audio_output_getinfo(obs_encoder_audio(encoder));
+	sample_rate = obs_encoder_get_sample_rate(encoder);
+	frame_size  = obs_encoder_get_frame_size(encoder);
+
+	stream = new_encoded_stream(data, encoder, AVMEDIA_TYPE_AUDIO);
+	if (!stream)
+		return false;
+
+	data->audio_tracks[track] = stream;
+	if (track == 0)
+		data->audio = stream;
+
+	context                 = stream->codec;
+	context->channels       = get_audio_channels(aoi->speakers);
+	context->sample_rate    = (int)sample_rate;
+	context->sample_fmt     = AV_SAMPLE_FMT_FLTP;
+	context->frame_size     = frame_size ? (int)frame_size : 1024;
+	context->time_base.num  = 1;
+	context->time_base.den  = (int)sample_rate;
+	stream->time_base       = context->time_base;
+	return true;
+}
+
+static inline bool init_encoded_streams(struct ffmpeg_data *data,
+		const struct ffmpeg_cfg *config)
+{
+	if (config->video_encoder)
+		if (!create_encoded_video_stream(data, config->video_encoder))
+			return false;
+
+	/* extra audio tracks are only used along with video */
+	size_t tracks = config->video_encoder ? MAX_AUDIO_MIXES : 1;
+
+	for (size_t i = 0; i < tracks; i++) {
+		obs_encoder_t encoder = config->audio_encoders[i];
+
+		if (encoder && !create_encoded_audio_stream(data, encoder, i))
+			return false;
+	}
+
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
 static inline bool init_streams(struct ffmpeg_data *data)
 {
 	AVOutputFormat *format = data->output->oformat;
@@ -285,12 +534,54 @@ static inline bool init_streams(struct ffmpeg_data *data)
 	return true;
 }
 
+static inline bool is_mov_format(const AVOutputFormat *format)
+{
+	return strstr(format->name, "mp4") != NULL ||
+	       strstr(format->name, "mov") != NULL;
+}
+
+/* fragmented files start with an empty moov, and get a moof/mdat pair for
+ * each gop.  everything before the last complete fragment stays playable
+ * if the recording is cut off, and nothing is rewritten at the end, so the
+ * file is written strictly sequentially */
+static void set_fragment_options(struct ffmpeg_data *data,
+		AVDictionary **opts)
+{
+	if (!data->fragmented)
+		return;
+
+	if (!is_mov_format(data->output->oformat)) {
+		blog(LOG_WARNING, "Fragmented recording is only supported for "
+		                  "MP4/MOV files, writing '%s' as a regular "
+		                  "file", data->filename_test);
+		return;
+	}
+
+	av_dict_set(opts, "movflags", "frag_keyframe+empty_moov", 0);
+}
+
 static inline bool open_output_file(struct ffmpeg_data *data)
 {
 	AVOutputFormat *format = data->output->oformat;
+	AVDictionary   *opts   = NULL;
 	int ret;
 
-	if ((format->flags & AVFMT_NOFILE) == 0) {
+	/* local files go through the write-behind writer; URLs are left to
+	 * libavformat */
+	if ((format->flags & AVFMT_NOFILE) == 0 &&
+	    !strstr(data->filename_test, "://")) {
+		data->writer = ffmpeg_writer_create(data->filename_test,
+				&data->writer_info);
+		if (!data->writer) {
+			blog(LOG_WARNING, "Couldn't open file '%s'",
+					data->filename_test);
+			return false;
+		}
+
+		data->output->pb     = ffmpeg_writer_avio(data->writer);
+		data->output->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+	} else if ((format->flags & AVFMT_NOFILE) == 0) {
 		ret = avio_open(&data->output->pb, data->filename_test,
 				AVIO_FLAG_WRITE);
 		if (ret < 0) {
@@ -300,7 +591,10 @@ static inline bool open_output_file(struct ffmpeg_data *data)
 		}
 	}
 
-	ret = avformat_write_header(data->output, NULL);
+	set_fragment_options(data, &opts);
+	ret = avformat_write_header(data->output, &opts);
+	av_dict_free(&opts);
+
 	if (ret < 0) {
 		blog(LOG_WARNING, "Error opening file '%s': %s",
 				data->filename_test, av_err2str(ret));
@@ -337,29 +631,44 @@ static void ffmpeg_data_free(struct ffmpeg_data *data)
 	if (data->audio)
 		close_audio(data);
 
-	if (data->output) {
+	if (data->writer) {
+		if (!ffmpeg_writer_destroy(data->writer))
+			blog(LOG_WARNING, "Failed to write all data to '%s'",
+					data->filename_test);
+		data->output->pb = NULL;
+
+	} else if (data->output) {
 		if ((data->output->oformat->flags & AVFMT_NOFILE) == 0)
 			avio_close(data->output->pb);
+	}
 
+	if (data->output)
 		avformat_free_context(data->output);
-	}
 
+	dstr_free(&data->filename);
 	memset(data, 0, sizeof(struct ffmpeg_data));
 }
 
-static bool ffmpeg_data_init(struct ffmpeg_data *data, const char *filename,
-		int vbitrate, int abitrate)
+static bool ffmpeg_data_init(struct ffmpeg_data *data,
+		const struct ffmpeg_cfg *config)
 {
+	const char *filename = config->filename;
 	bool is_rtmp = false;
 
 	memset(data, 0, sizeof(struct ffmpeg_data));
-	data->filename_test = filename;
-	data->video_bitrate = vbitrate;
-	data->audio_bitrate = abitrate;
+	data->writer_info   = config->writer_info;
+	data->fragmented    = config->fragmented;
+	data->video_bitrate = config->video_bitrate;
+	data->audio_bitrate = config->audio_bitrate;
+	data->encoded       = config->video_encoder ||
+	                      config->audio_encoders[0];
 
 	if (!filename || !*filename)
 		return false;
 
+	dstr_copy(&data->filename, filename);
+	data->filename_test = data->filename.array;
+
 	av_register_all();
 	avformat_network_init();
 
@@ -378,8 +687,14 @@ static bool ffmpeg_data_init(struct ffmpeg_data *data, const char *filename,
 		goto fail;
 	}
 
-	if (!init_streams(data))
-		goto fail;
+	if (data->encoded) {
+		if (!init_encoded_streams(data, config))
+			goto fail;
+	} else {
+		if (!init_streams(data))
+			goto fail;
+	}
+
 	if (!open_output_file(data))
 		goto fail;
 
@@ -411,14 +726,20 @@ static void ffmpeg_log_callback(void *param, int level, const char *format,
 	UNUSED_PARAMETER(param);
 }
 
+static void get_write_stats_proc(void *data, calldata_t params);
+
 static void *ffmpeg_output_create(obs_data_t settings, obs_output_t output)
 {
 	struct ffmpeg_output *data = bzalloc(sizeof(struct ffmpeg_output));
 	pthread_mutex_init_value(&data->write_mutex);
 	data->output = output;
 
+	pthread_mutex_init_value(&data->encode_mutex);
+
 	if (pthread_mutex_init(&data->write_mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutex_init(&data->encode_mutex, NULL) != 0)
+		goto fail;
 	if (os_event_init(&data->stop_event, OS_EVENT_TYPE_AUTO) != 0)
 		goto fail;
 	if (os_sem_init(&data->write_sem, 0) != 0)
@@ -426,11 +747,22 @@ static void *ffmpeg_output_create(obs_data_t settings, obs_output_t output)
 
 	av_log_set_callback(ffmpeg_log_callback);
 
+	signal_handler_add(obs_output_signalhandler(output),
+			"void write_lagging(ptr output, bool lagging, "
+			"int queue_kb, int queue_ms, int write_kbps, "
+			"int dropped_frames)");
+	proc_handler_add(obs_output_prochandler(output),
+			"void get_write_stats(out bool lagging, "
+			"out int queue_kb, out int queue_ms, "
+			"out int write_kbps, out int dropped_frames)",
+			get_write_stats_proc, data);
+
 	UNUSED_PARAMETER(settings);
 	return data;
 
 fail:
 	pthread_mutex_destroy(&data->write_mutex);
+	pthread_mutex_destroy(&data->encode_mutex);
 	os_event_destroy(data->stop_event);
 	bfree(data);
 	return NULL;
@@ -449,13 +781,172 @@ static void ffmpeg_output_destroy(void *data)
 		ffmpeg_output_stop(output);
 
 		pthread_mutex_destroy(&output->write_mutex);
+		pthread_mutex_destroy(&output->encode_mutex);
 		os_sem_destroy(output->write_sem);
 		os_event_destroy(output->stop_event);
 		bfree(data);
 	}
 }
 
-static inline void copy_data(AVPicture *pic, const struct video_data *frame,
+/* ------------------------------------------------------------------------- */
+/* write queue */
+
+static inline int64_t packet_time_ms(struct ffmpeg_output *output,
+		const AVPacket *packet)
+{
+	AVStream *stream = output->ff_data.output->streams[packet->stream_index];
+	return av_rescale_q(packet->dts, stream->time_base,
+			(AVRational){1, 1000});
+}
+
+/* called with write_mutex held */
+static int64_t queue_duration_ms(struct ffmpeg_output *output)
+{
+	const AVPacket *first, *last;
+	int64_t        duration;
+
+	if (output->packets.num < 2)
+		return 0;
+
+	first = dq_item(output->packets, 0);
+	last  = dq_item(output->packets, output->packets.num - 1);
+	if (first->dts == AV_NOPTS_VALUE || last->dts == AV_NOPTS_VALUE)
+		return 0;
+
+	duration = packet_time_ms(output, last) - packet_time_ms(output, first);
+	return duration > 0 ? duration : 0;
+}
+
+/* called with write_mutex held, returns true if the state changed */
+static bool update_lagging(struct ffmpeg_output *output)
+{
+	int64_t duration = queue_duration_ms(output);
+	size_t  warn_size = output->max_queue_size / 2;
+	bool    lagging;
+
+	if (output->lagging)
+		lagging = duration >= LAG_WARNING_MS / 2 ||
+			(warn_size && output->queue_size >= warn_size / 2);
+	else
+		lagging = duration >= LAG_WARNING_MS ||
+			(warn_size && output->queue_size >= warn_size);
+
+	output->queue_full = output->max_queue_size &&
+		output->queue_size >= output->max_queue_size;
+
+	if (lagging == output->lagging)
+		return false;
+
+	output->lagging = lagging;
+	return true;
+}
+
+static void fill_write_stats(struct ffmpeg_output *output, calldata_t params)
+{
+	calldata_setbool(params, "lagging", output->lagging);
+	calldata_setint(params, "queue_kb",
+			(long long)(output->queue_size / 1024));
+	calldata_setint(params, "queue_ms", queue_duration_ms(output));
+	calldata_setint(params, "write_kbps", output->write_kbps);
+	calldata_setint(params, "dropped_frames", output->packets_dropped);
+}
+
+static void get_write_stats_proc(void *data, calldata_t params)
+{
+	struct ffmpeg_output *output = data;
+
+	pthread_mutex_lock(&output->write_mutex);
+	fill_write_stats(output, params);
+	pthread_mutex_unlock(&output->write_mutex);
+}
+
+static void signal_lagging(struct ffmpeg_output *output)
+{
+	struct calldata params = {0};
+
+	pthread_mutex_lock(&output->write_mutex);
+	fill_write_stats(output, &params);
+	pthread_mutex_unlock(&output->write_mutex);
+
+	if (calldata_bool(&params, "lagging"))
+		blog(LOG_WARNING, "ffmpeg_output: the disk can't keep up, "
+		                  "%lld KB (%lld ms) waiting to be written",
+		                  calldata_int(&params, "queue_kb"),
+		                  calldata_int(&params, "queue_ms"));
+	else
+		blog(LOG_INFO, "ffmpeg_output: the disk caught up again");
+
+	calldata_setptr(&params, "output", output->output);
+	signal_handler_signal(obs_output_signalhandler(output->output),
+			"write_lagging", &params);
+	calldata_free(&params);
+}
+
+/* hands a packet to the write thread.  droppable packets are dropped while
+ * the queue is full, a full queue can stop the output instead */
+static void push_packet(struct ffmpeg_output *output, AVPacket *packet,
+		bool droppable)
+{
+	bool queued = true;
+	bool changed;
+
+	pthread_mutex_lock(&output->write_mutex);
+
+	if (output->max_queue_size &&
+	    output->queue_size >= output->max_queue_size) {
+		if (output->stop_on_full ||
+		    output->queue_size >= output->max_queue_size * 2) {
+			output->queue_overflow = true;
+			queued = false;
+		} else if (droppable) {
+			output->packets_dropped++;
+			queued = false;
+		}
+	}
+
+	if (queued) {
+		dq_push_back(output->packets, packet);
+		output->queue_size += (size_t)packet->size;
+	}
+
+	changed = update_lagging(output);
+	pthread_mutex_unlock(&output->write_mutex);
+
+	if (!queued)
+		av_free_packet(packet);
+	if (changed)
+		signal_lagging(output);
+
+	os_sem_post(output->write_sem);
+}
+
+/* called with write_mutex held */
+static void update_write_rate(struct ffmpeg_output *output, int size)
+{
+	uint64_t ts = os_gettime_ns();
+	uint64_t elapsed;
+
+	output->bytes_written += (uint64_t)size;
+
+	if (!output->rate_start_ns) {
+		output->rate_start_ns = ts;
+		output->rate_bytes    = output->bytes_written;
+		return;
+	}
+
+	elapsed = ts - output->rate_start_ns;
+	if (elapsed < 1000000000ULL)
+		return;
+
+	output->write_kbps = (long)((output->bytes_written -
+			output->rate_bytes) * 8 * 1000000 / elapsed);
+	output->rate_start_ns = ts;
+	output->rate_bytes    = output->bytes_written;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void copy_data(AVPicture *pic, const struct video_frame *frame,
 		int height)
 {
 	for (int plane = 0; plane < MAX_AV_PLANES; plane++) {
@@ -479,9 +970,23 @@ static inline void copy_data(AVPicture *pic, const struct video_data *frame,
 	}
 }
 
-static void receive_video(void *param, struct video_data *frame)
+static void push_video_packet(struct ffmpeg_output *output,
+		AVPacket *packet)
+{
+	struct ffmpeg_data *data    = &output->ff_data;
+	AVCodecContext     *context = data->video->codec;
+
+	packet->pts = rescale_ts(packet->pts, context, data->video->time_base);
+	packet->dts = rescale_ts(packet->dts, context, data->video->time_base);
+	packet->duration = (int)av_rescale_q(packet->duration,
+			context->time_base, data->video->time_base);
+
+	push_packet(output, packet, false);
+}
+
+static void encode_video(struct ffmpeg_output *output,
+		struct video_frame *frame)
 {
-	struct ffmpeg_output *output = param;
 	struct ffmpeg_data   *data   = &output->ff_data;
 	AVCodecContext *context = data->video->codec;
 	AVPacket packet = {0};
@@ -490,9 +995,6 @@ static void receive_video(void *param, struct video_data *frame)
 
 	av_init_packet(&packet);
 
-	if (!data->start_timestamp)
-		data->start_timestamp = frame->timestamp;
-
 	format = obs_to_ffmpeg_video_format(OBS_FFMPEG_VIDEO_FORMAT);
 	if (context->pix_fmt != format)
 		sws_scale(data->swscale, (const uint8_t *const *)frame->data,
@@ -508,47 +1010,89 @@ static void receive_video(void *param, struct video_data *frame)
 		packet.data          = data->dst_picture.data[0];
 		packet.size          = sizeof(AVPicture);
 
-		pthread_mutex_lock(&output->write_mutex);
-		da_push_back(output->packets, &packet);
-		pthread_mutex_unlock(&output->write_mutex);
-		os_sem_post(output->write_sem);
+		push_packet(output, &packet, false);
 
 	} else {
 		data->vframe->pts = data->total_frames;
 		ret = avcodec_encode_video2(context, &packet, data->vframe,
 				&got_packet);
 		if (ret < 0) {
-			blog(LOG_WARNING, "receive_video: Error encoding "
+			blog(LOG_WARNING, "encode_video: Error encoding "
 			                  "video: %s", av_err2str(ret));
 			return;
 		}
 
 		if (!ret && got_packet && packet.size) {
-			packet.pts = rescale_ts(packet.pts, context,
-					data->video->time_base);
-			packet.dts = rescale_ts(packet.dts, context,
-					data->video->time_base);
-			packet.duration = (int)av_rescale_q(packet.duration,
-					context->time_base,
-					data->video->time_base);
-
-			pthread_mutex_lock(&output->write_mutex);
-			da_push_back(output->packets, &packet);
-			pthread_mutex_unlock(&output->write_mutex);
-			os_sem_post(output->write_sem);
+			push_video_packet(output, &packet);
 		} else {
 			ret = 0;
 		}
 	}
 
 	if (ret != 0) {
-		blog(LOG_WARNING, "receive_video: Error writing video: %s",
+		blog(LOG_WARNING, "encode_video: Error writing video: %s",
 				av_err2str(ret));
 	}
 
 	data->total_frames++;
 }
 
+/* queues a copy of the frame for the encode thread */
+static void receive_video(void *param, struct video_data *frame)
+{
+	struct ffmpeg_output *output = param;
+	struct ffmpeg_data   *data   = &output->ff_data;
+
+	pthread_mutex_lock(&output->encode_mutex);
+
+	if (!data->start_timestamp)
+		data->start_timestamp = frame->timestamp;
+
+	if (output->video_queue_count == VIDEO_QUEUE_SIZE) {
+		if (output->frames_skipped++ == 0)
+			blog(LOG_WARNING, "ffmpeg_output: encoding can't keep "
+			                  "up, skipping frames");
+
+	} else if (output->queue_full && !output->stop_on_full) {
+		/* encoded packets can't be dropped, so frames are skipped
+		 * before they're encoded while the write queue is full */
+		pthread_mutex_lock(&output->write_mutex);
+		output->packets_dropped++;
+		pthread_mutex_unlock(&output->write_mutex);
+
+	} else {
+		size_t idx = (output->video_queue_start +
+				output->video_queue_count) % VIDEO_QUEUE_SIZE;
+		struct video_frame src;
+
+		memcpy(src.data, frame->data, sizeof(src.data));
+		memcpy(src.linesize, frame->linesize, sizeof(src.linesize));
+		video_frame_copy(output->video_queue+idx, &src,
+				OBS_FFMPEG_VIDEO_FORMAT,
+				data->video->codec->height);
+
+		output->video_queue_count++;
+		os_sem_post(output->encode_sem);
+	}
+
+	pthread_mutex_unlock(&output->encode_mutex);
+}
+
+static void push_audio_packet(struct ffmpeg_output *output,
+		AVPacket *packet)
+{
+	struct ffmpeg_data *data    = &output->ff_data;
+	AVCodecContext     *context = data->audio->codec;
+
+	packet->pts = rescale_ts(packet->pts, context, data->audio->time_base);
+	packet->dts = rescale_ts(packet->dts, context, data->audio->time_base);
+	packet->duration = (int)av_rescale_q(packet->duration,
+			context->time_base, data->audio->time_base);
+	packet->stream_index = data->audio->index;
+
+	push_packet(output, packet, false);
+}
+
 static void encode_audio(struct ffmpeg_output *output,
 		struct AVCodecContext *context, size_t block_size)
 {
@@ -582,19 +1126,8 @@ static void encode_audio(struct ffmpeg_output *output,
 		return;
 	}
 
-	if (!got_packet)
-		return;
-
-	packet.pts = rescale_ts(packet.pts, context, data->audio->time_base);
-	packet.dts = rescale_ts(packet.dts, context, data->audio->time_base);
-	packet.duration = (int)av_rescale_q(packet.duration, context->time_base,
-			data->audio->time_base);
-	packet.stream_index = data->audio->index;
-
-	pthread_mutex_lock(&output->write_mutex);
-	da_push_back(output->packets, &packet);
-	pthread_mutex_unlock(&output->write_mutex);
-	os_sem_post(output->write_sem);
+	if (got_packet)
+		push_audio_packet(output, &packet);
 }
 
 static bool prepare_audio(struct ffmpeg_data *data,
@@ -630,50 +1163,359 @@ static void receive_audio(void *param, struct audio_data *frame)
 	size_t frame_size_bytes;
 	struct audio_data in;
 
-	AVCodecContext *context = data->audio->codec;
+	pthread_mutex_lock(&output->encode_mutex);
 
-	if (!data->start_timestamp)
-		return;
-	if (!prepare_audio(data, frame, &in))
-		return;
+	if (data->start_timestamp && prepare_audio(data, frame, &in)) {
+		for (size_t i = 0; i < data->audio_planes; i++)
+			circlebuf_push_back(&data->excess_frames[i],
+					in.data[i],
+					in.frames * data->audio_size);
+
+		frame_size_bytes = (size_t)data->frame_size * data->audio_size;
+		if (data->excess_frames[0].size >= frame_size_bytes)
+			os_sem_post(output->encode_sem);
+	}
+
+	pthread_mutex_unlock(&output->encode_mutex);
+}
+
+static void encode_pending_audio(struct ffmpeg_output *output)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+	AVCodecContext *context = data->audio->codec;
+	size_t frame_size_bytes;
 
 	frame_size_bytes = (size_t)data->frame_size * data->audio_size;
 
-	for (size_t i = 0; i < data->audio_planes; i++)
-		circlebuf_push_back(&data->excess_frames[i], in.data[i],
-				in.frames * data->audio_size);
+	for (;;) {
+		pthread_mutex_lock(&output->encode_mutex);
+
+		if (data->excess_frames[0].size < frame_size_bytes) {
+			pthread_mutex_unlock(&output->encode_mutex);
+			break;
+		}
 
-	while (data->excess_frames[0].size >= frame_size_bytes) {
 		for (size_t i = 0; i < data->audio_planes; i++)
 			circlebuf_pop_front(&data->excess_frames[i],
 					data->samples[i], frame_size_bytes);
 
+		pthread_mutex_unlock(&output->encode_mutex);
+
 		encode_audio(output, context, data->audio_size);
 	}
 }
 
+/* gets the packets that encoders with a delay are still holding on to */
+static void flush_encoders(struct ffmpeg_output *output)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+	int got_packet;
+
+	if (data->video && !(data->output->flags & AVFMT_RAWPICTURE) &&
+	    (data->video->codec->codec->capabilities & CODEC_CAP_DELAY)) {
+		do {
+			AVPacket packet = {0};
+
+			av_init_packet(&packet);
+			got_packet = 0;
+
+			if (avcodec_encode_video2(data->video->codec, &packet,
+						NULL, &got_packet) < 0)
+				break;
+			if (got_packet && packet.size)
+				push_video_packet(output, &packet);
+		} while (got_packet);
+	}
+
+	if (data->audio &&
+	    (data->audio->codec->codec->capabilities & CODEC_CAP_DELAY)) {
+		do {
+			AVPacket packet = {0};
+
+			av_init_packet(&packet);
+			got_packet = 0;
+
+			if (avcodec_encode_audio2(data->audio->codec, &packet,
+						NULL, &got_packet) < 0)
+				break;
+			if (got_packet)
+				push_audio_packet(output, &packet);
+		} while (got_packet);
+	}
+}
+
+/* on stop, the frames still queued are encoded and the encoders flushed
+ * before the thread exits, so nothing is lost from the end of the file */
+static void *encode_thread(void *param)
+{
+	struct ffmpeg_output *output = param;
+
+	os_thread_init(OS_THREAD_CLASS_ENCODER, "ffmpeg encode");
+
+	while (os_sem_wait(output->encode_sem) == 0) {
+		struct video_frame *frame = NULL;
+		bool stop;
+
+		/* the producer never touches the front slot while it's
+		 * counted, so it can be encoded without holding the lock */
+		pthread_mutex_lock(&output->encode_mutex);
+		if (output->video_queue_count)
+			frame = output->video_queue + output->video_queue_start;
+		stop = output->encode_thread_stop && !frame;
+		pthread_mutex_unlock(&output->encode_mutex);
+
+		if (frame && output->ff_data.video) {
+			encode_video(output, frame);
+
+			pthread_mutex_lock(&output->encode_mutex);
+			if (++output->video_queue_start == VIDEO_QUEUE_SIZE)
+				output->video_queue_start = 0;
+			output->video_queue_count--;
+			pthread_mutex_unlock(&output->encode_mutex);
+		}
+
+		if (output->ff_data.audio)
+			encode_pending_audio(output);
+
+		if (stop)
+			break;
+	}
+
+	flush_encoders(output);
+	return NULL;
+}
+
+static bool start_encode_thread(struct ffmpeg_output *output)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+
+	output->video_queue_start  = 0;
+	output->video_queue_count  = 0;
+	output->frames_skipped     = 0;
+	output->encode_thread_stop = false;
+
+	if (data->video) {
+		AVCodecContext *context = data->video->codec;
+
+		for (size_t i = 0; i < VIDEO_QUEUE_SIZE; i++)
+			video_frame_init(output->video_queue+i,
+					OBS_FFMPEG_VIDEO_FORMAT,
+					context->width, context->height);
+	}
+
+	if (os_sem_init(&output->encode_sem, 0) != 0)
+		return false;
+
+	output->encode_thread_active = pthread_create(&output->encode_thread,
+			NULL, encode_thread, output) == 0;
+	return output->encode_thread_active;
+}
+
+static void stop_encode_thread(struct ffmpeg_output *output)
+{
+	if (output->encode_thread_active) {
+		pthread_mutex_lock(&output->encode_mutex);
+		output->encode_thread_stop = true;
+		pthread_mutex_unlock(&output->encode_mutex);
+
+		os_sem_post(output->encode_sem);
+		pthread_join(output->encode_thread, NULL);
+		output->encode_thread_active = false;
+	}
+
+	if (output->frames_skipped)
+		blog(LOG_INFO, "ffmpeg_output: %u frames skipped",
+				output->frames_skipped);
+
+	for (size_t i = 0; i < VIDEO_QUEUE_SIZE; i++)
+		video_frame_free(output->video_queue+i);
+
+	os_sem_destroy(output->encode_sem);
+	output->encode_sem = NULL;
+}
+
+/* encoded mode: the packet is only copied in to an AVPacket and muxed */
+static void receive_packet(void *param, struct encoder_packet *encpacket)
+{
+	struct ffmpeg_output *output = param;
+	struct ffmpeg_data   *data   = &output->ff_data;
+	AVStream             *stream;
+	AVRational           timebase = {1, encpacket->timebase_den};
+	AVPacket             packet;
+
+	if (av_new_packet(&packet, (int)encpacket->size) < 0) {
+		blog(LOG_WARNING, "receive_packet: Failed to allocate packet");
+		return;
+	}
+
+	memcpy(packet.data, encpacket->data, encpacket->size);
+
+	/* the extra data uses start codes, so the packets have to as well */
+	if (encpacket->avcc)
+		obs_avcc_to_annexb(packet.data, encpacket->size);
+
+	if (encpacket->keyframe)
+		packet.flags |= AV_PKT_FLAG_KEY;
+
+	/* the write thread swaps in the file of the next segment with the
+	 * mutex held, so the stream is only looked up with it held too.  the
+	 * streams of all segments are the same, so the packet is still right
+	 * if that happens before it's queued */
+	pthread_mutex_lock(&output->write_mutex);
+
+	if (encpacket->type == OBS_ENCODER_VIDEO)
+		stream = data->video;
+	else if (encpacket->track_idx < MAX_AUDIO_MIXES)
+		stream = data->audio_tracks[encpacket->track_idx];
+	else
+		stream = NULL;
+
+	if (stream) {
+		packet.pts          = av_rescale_q(encpacket->pts, timebase,
+				stream->time_base);
+		packet.dts          = av_rescale_q(encpacket->dts, timebase,
+				stream->time_base);
+		packet.stream_index = stream->index;
+	}
+
+	pthread_mutex_unlock(&output->write_mutex);
+
+	if (stream)
+		push_packet(output, &packet,
+				encpacket->type == OBS_ENCODER_VIDEO &&
+				!encpacket->keyframe &&
+				encpacket->priority ==
+				OBS_NAL_PRIORITY_DISPOSABLE);
+	else
+		av_free_packet(&packet);
+}
+
+static inline bool segment_full(const struct ffmpeg_output *output,
+		int64_t time)
+{
+	return (output->segment_max_time &&
+	        time - output->segment_start >= output->segment_max_time) ||
+	       (output->segment_max_size &&
+	        output->segment_size >= output->segment_max_size);
+}
+
+/* asks the encoder for a keyframe once the segment is full and the next
+ * file is ready, so the split doesn't have to wait for the regular keyframe
+ * interval */
+static void request_segment_keyframe(struct ffmpeg_output *output)
+{
+	bool ready;
+
+	if (output->segment_keyframe_requested)
+		return;
+
+	pthread_mutex_lock(&output->write_mutex);
+	ready = output->segment_next_ready && !output->segment_prev_pending;
+	pthread_mutex_unlock(&output->write_mutex);
+
+	if (ready) {
+		obs_encoder_request_keyframe(
+				obs_output_get_video_encoder(output->output));
+		output->segment_keyframe_requested = true;
+	}
+}
+
+/* switches to the next file at the first video keyframe after the current
+ * segment is full.  if the next file isn't open yet, the current one is
+ * simply continued up to the keyframe after that */
+static void split_segment(struct ffmpeg_output *output,
+		const AVPacket *packet)
+{
+	AVStream *stream   = output->ff_data.video;
+	bool     switched  = false;
+	int64_t  time;
+
+	if (!stream || packet->stream_index != stream->index)
+		return;
+
+	time = av_rescale_q(packet->dts, stream->time_base, AV_TIME_BASE_Q);
+	if (!segment_full(output, time))
+		return;
+
+	if ((packet->flags & AV_PKT_FLAG_KEY) == 0) {
+		request_segment_keyframe(output);
+		return;
+	}
+
+	pthread_mutex_lock(&output->write_mutex);
+
+	if (output->segment_next_ready && !output->segment_prev_pending) {
+		output->segment_prev         = output->ff_data;
+		output->ff_data              = output->segment_next;
+		output->segment_next_ready   = false;
+		output->segment_prev_pending = true;
+		switched = true;
+	}
+
+	pthread_mutex_unlock(&output->write_mutex);
+
+	if (switched) {
+		output->segment_start = time;
+		output->segment_size  = 0;
+		output->segment_keyframe_requested = false;
+		os_sem_post(output->segment_sem);
+
+		blog(LOG_INFO, "ffmpeg_output: continuing recording in '%s'",
+				output->ff_data.filename_test);
+	}
+}
+
+/* segments after the first one start at zero.  both files were created
+ * from the same encoders, so their streams have the same time bases.  audio
+ * that was captured slightly before the keyframe ends up with negative
+ * timestamps, which the muxer shifts */
+static inline void rebase_packet(struct ffmpeg_output *output,
+		AVPacket *packet)
+{
+	AVFormatContext *context = output->ff_data.output;
+	AVStream        *stream  = context->streams[packet->stream_index];
+	int64_t         offset   = av_rescale_q(output->segment_start,
+			AV_TIME_BASE_Q, stream->time_base);
+
+	packet->pts -= offset;
+	packet->dts -= offset;
+}
+
 static bool process_packet(struct ffmpeg_output *output)
 {
 	AVPacket packet;
-	bool new_packet = false;
+	bool new_packet  = false;
+	bool lag_changed = false;
 	int ret;
 
 	pthread_mutex_lock(&output->write_mutex);
 	if (output->packets.num) {
-		packet = output->packets.array[0];
-		da_erase(output->packets, 0);
+		dq_pop_front(output->packets, &packet);
+		output->queue_size -= (size_t)packet.size;
+		update_write_rate(output, packet.size);
+		lag_changed = update_lagging(output);
 		new_packet = true;
 	}
 	pthread_mutex_unlock(&output->write_mutex);
 
 	if (!new_packet)
 		return true;
+	if (lag_changed)
+		signal_lagging(output);
 
 	/*blog(LOG_DEBUG, "size = %d, flags = %lX, stream = %d, "
 			"packets queued: %lu",
 			packet.size, packet.flags,
 			packet.stream_index, output->packets.num);*/
 
+	if (output->segment_thread_active) {
+		split_segment(output, &packet);
+		if (output->segment_start)
+			rebase_packet(output, &packet);
+
+		output->segment_size += (uint64_t)packet.size;
+	}
+
 	ret = av_interleaved_write_frame(output->ff_data.output, &packet);
 	if (ret < 0) {
 		av_free_packet(&packet);
@@ -685,16 +1527,55 @@ static bool process_packet(struct ffmpeg_output *output)
 	return true;
 }
 
+/* writes everything that was queued before the output was stopped */
+static void write_remaining_packets(struct ffmpeg_output *output)
+{
+	for (;;) {
+		bool empty;
+
+		pthread_mutex_lock(&output->write_mutex);
+		empty = !output->packets.num;
+		pthread_mutex_unlock(&output->write_mutex);
+
+		if (empty || !process_packet(output))
+			break;
+	}
+}
+
 static void *write_thread(void *data)
 {
 	struct ffmpeg_output *output = data;
 
+	os_thread_init(OS_THREAD_CLASS_OUTPUT, "ffmpeg write");
+
 	while (os_sem_wait(output->write_sem) == 0) {
+		uint64_t start;
+		bool     success;
+
 		/* check to see if shutting down */
-		if (os_event_try(output->stop_event) == 0)
+		if (os_event_try(output->stop_event) == 0) {
+			write_remaining_packets(output);
 			break;
+		}
+
+		if (output->queue_overflow) {
+			blog(LOG_ERROR, "ffmpeg_output: the disk can't keep "
+			                "up with the recording and the write "
+			                "queue is full, stopping");
 
-		if (!process_packet(output)) {
+			pthread_detach(output->write_thread);
+			output->write_thread_active = false;
+
+			ffmpeg_output_stop(output);
+			obs_output_signal_stop(output->output, OBS_OUTPUT_FAIL);
+			break;
+		}
+
+		start   = trace_begin();
+		success = process_packet(output);
+		trace_end("ffmpeg_write_packet", start);
+
+		if (!success) {
 			pthread_detach(output->write_thread);
 			output->write_thread_active = false;
 
@@ -707,25 +1588,248 @@ static void *write_thread(void *data)
 	return NULL;
 }
 
+/* "name.mp4" becomes "name_001.mp4", "name_002.mp4" and so on */
+static void segment_filename(struct dstr *name, const char *path,
+		uint32_t index)
+{
+	const char *ext    = strrchr(path, '.');
+	const char *slash  = strrchr(path, '/');
+	const char *bslash = strrchr(path, '\\');
+
+	if (ext && ((slash && ext < slash) || (bslash && ext < bslash)))
+		ext = NULL;
+	if (!ext)
+		ext = path + strlen(path);
+
+	dstr_ncopy(name, path, ext - path);
+	dstr_catf(name, "_%03u%s", index, ext);
+}
+
+static void prepare_next_segment(struct ffmpeg_output *output)
+{
+	struct ffmpeg_cfg config = output->segment_cfg;
+	struct dstr       name   = {0};
+	bool              success;
+
+	segment_filename(&name, output->segment_path.array,
+			++output->segment_index);
+	config.filename = name.array;
+
+	success = ffmpeg_data_init(&output->segment_next, &config);
+	if (success) {
+		pthread_mutex_lock(&output->write_mutex);
+		output->segment_next_ready = true;
+		pthread_mutex_unlock(&output->write_mutex);
+	} else {
+		blog(LOG_WARNING, "ffmpeg_output: failed to open '%s', the "
+		                  "recording continues in the current file",
+		                  name.array);
+	}
+
+	dstr_free(&name);
+}
+
+static void *segment_thread(void *data)
+{
+	struct ffmpeg_output *output = data;
+	struct ffmpeg_data   prev;
+	bool                 have_prev;
+
+	os_thread_init(OS_THREAD_CLASS_OUTPUT, "ffmpeg segment");
+
+	while (os_sem_wait(output->segment_sem) == 0) {
+		pthread_mutex_lock(&output->write_mutex);
+		have_prev = output->segment_prev_pending;
+		if (have_prev)
+			prev = output->segment_prev;
+		pthread_mutex_unlock(&output->write_mutex);
+
+		if (have_prev) {
+			ffmpeg_data_free(&prev);
+
+			pthread_mutex_lock(&output->write_mutex);
+			output->segment_prev_pending = false;
+			pthread_mutex_unlock(&output->write_mutex);
+		}
+
+		if (output->segment_thread_stop)
+			break;
+
+		if (!output->segment_next_ready)
+			prepare_next_segment(output);
+	}
+
+	return NULL;
+}
+
+static void init_segments(struct ffmpeg_output *output, obs_data_t settings,
+		struct ffmpeg_cfg *config, struct dstr *first_name)
+{
+	int64_t max_time = obs_data_getint(settings, "max_time_sec");
+	int64_t max_size = obs_data_getint(settings, "max_size_mb");
+
+	output->segment_max_time = max_time > 0 ? max_time * AV_TIME_BASE : 0;
+	output->segment_max_size = max_size > 0 ?
+		(uint64_t)max_size * 1024 * 1024 : 0;
+
+	if (!output->segment_max_time && !output->segment_max_size)
+		return;
+
+	/* the cuts are made at the keyframes of the video encoder, and only
+	 * local files are split */
+	if (!config->video_encoder || strstr(config->filename, "://")) {
+		blog(LOG_WARNING, "ffmpeg_output: segmented recording needs a "
+		                  "video encoder and a local file, '%s' is "
+		                  "written as one file", config->filename);
+		output->segment_max_time = 0;
+		output->segment_max_size = 0;
+		return;
+	}
+
+	dstr_copy(&output->segment_path, config->filename);
+	output->segment_index = 1;
+	output->segment_start = 0;
+	output->segment_size  = 0;
+	output->segment_keyframe_requested = false;
+
+	segment_filename(first_name, output->segment_path.array, 1);
+	config->filename    = first_name->array;
+	output->segment_cfg = *config;
+}
+
+static bool start_segment_thread(struct ffmpeg_output *output)
+{
+	output->segment_thread_stop  = false;
+	output->segment_next_ready   = false;
+	output->segment_prev_pending = false;
+
+	if (os_sem_init(&output->segment_sem, 0) != 0)
+		return false;
+
+	output->segment_thread_active = pthread_create(&output->segment_thread,
+			NULL, segment_thread, output) == 0;
+
+	/* open the file of the second segment right away */
+	if (output->segment_thread_active)
+		os_sem_post(output->segment_sem);
+	return output->segment_thread_active;
+}
+
+/* the write thread has to be stopped first, so that nothing is swapped
+ * while the remaining files are closed */
+static void stop_segment_thread(struct ffmpeg_output *output)
+{
+	if (output->segment_thread_active) {
+		output->segment_thread_stop = true;
+		os_sem_post(output->segment_sem);
+		pthread_join(output->segment_thread, NULL);
+		output->segment_thread_active = false;
+	}
+
+	/* the file of the next segment was never written to, so nothing is
+	 * lost by removing it */
+	if (output->segment_next_ready) {
+		struct dstr name = {0};
+
+		dstr_copy_dstr(&name, &output->segment_next.filename);
+		ffmpeg_data_free(&output->segment_next);
+		remove(name.array);
+		dstr_free(&name);
+
+		output->segment_next_ready = false;
+	}
+
+	os_sem_destroy(output->segment_sem);
+	output->segment_sem = NULL;
+	dstr_free(&output->segment_path);
+}
+
+static void init_write_queue(struct ffmpeg_output *output,
+		obs_data_t settings)
+{
+	int64_t max_size = obs_data_getint(settings, "max_queue_size");
+
+	output->max_queue_size  = max_size > 0 ?
+		(size_t)max_size * 1024 * 1024 : 0;
+	output->stop_on_full    = astrcmpi(obs_data_getstring(settings,
+				"queue_full_policy"), "stop") == 0;
+	output->queue_size      = 0;
+	output->queue_full      = false;
+	output->queue_overflow  = false;
+	output->lagging         = false;
+	output->packets_dropped = 0;
+	output->rate_start_ns   = 0;
+	output->rate_bytes      = 0;
+	output->bytes_written   = 0;
+	output->write_kbps      = 0;
+}
+
 static bool try_connect(struct ffmpeg_output *output)
 {
-	const char *filename_test;
+	struct ffmpeg_cfg config;
+	struct dstr first_segment = {0};
 	obs_data_t settings;
-	int audio_bitrate, video_bitrate;
+	uint32_t flags;
+	bool success;
 	int ret;
 
 	settings = obs_output_get_settings(output->output);
-	filename_test = obs_data_getstring(settings, "filename");
-	video_bitrate = (int)obs_data_getint(settings, "video_bitrate");
-	audio_bitrate = (int)obs_data_getint(settings, "audio_bitrate");
-	obs_data_release(settings);
-
-	if (!filename_test || !*filename_test)
+	config.filename      = obs_data_getstring(settings, "filename");
+	config.video_bitrate = (int)obs_data_getint(settings, "video_bitrate");
+	config.audio_bitrate = (int)obs_data_getint(settings, "audio_bitrate");
+	config.writer_info.block_size  = (size_t)obs_data_getint(settings,
+			"write_block_size") * 1024;
+	config.writer_info.max_pending = (size_t)obs_data_getint(settings,
+			"write_behind_size") * 1024 * 1024;
+	config.writer_info.direct      = obs_data_getbool(settings,
+			"direct_io");
+	config.writer_info.sync_interval_ns = (uint64_t)obs_data_getint(
+			settings, "sync_interval") * 1000000000ULL;
+	config.writer_info.prealloc_size = (uint64_t)obs_data_getint(settings,
+			"prealloc_size") * 1024 * 1024;
+	config.fragmented    = obs_data_getbool(settings, "fragmented");
+	config.video_encoder = obs_output_get_video_encoder(output->output);
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
+		config.audio_encoders[i] = obs_output_get_audio_encoder_track(
+				output->output, i);
+
+	if (!config.filename || !*config.filename) {
+		obs_data_release(settings);
 		return false;
+	}
 
-	if (!ffmpeg_data_init(&output->ff_data, filename_test,
-				video_bitrate, audio_bitrate))
+	if (config.video_encoder || config.audio_encoders[0])
+		init_segments(output, settings, &config, &first_segment);
+
+	init_write_queue(output, settings);
+
+	/* if encoders have been set, mux their packets instead of encoding
+	 * raw data here */
+	if (config.video_encoder || config.audio_encoders[0]) {
+		flags = OBS_OUTPUT_ENCODED;
+		if (config.video_encoder)
+			flags |= OBS_OUTPUT_VIDEO;
+		if (config.audio_encoders[0])
+			flags |= OBS_OUTPUT_AUDIO;
+
+		if (!obs_output_can_begin_data_capture(output->output, flags) ||
+		    !obs_output_initialize_encoders(output->output, flags)) {
+			obs_data_release(settings);
+			return false;
+		}
+	} else {
+		flags = OBS_OUTPUT_AV;
+	}
+
+	success = ffmpeg_data_init(&output->ff_data, &config);
+	obs_data_release(settings);
+	dstr_free(&first_segment);
+
+	if (!success) {
+		dstr_free(&output->segment_path);
 		return false;
+	}
 
 	struct audio_convert_info aci = {
 		.format = output->ff_data.audio_format
@@ -737,7 +1841,7 @@ static bool try_connect(struct ffmpeg_output *output)
 
 	output->active = true;
 
-	if (!obs_output_can_begin_data_capture(output->output, 0))
+	if (!obs_output_can_begin_data_capture(output->output, flags))
 		return false;
 
 	ret = pthread_create(&output->write_thread, NULL, write_thread, output);
@@ -748,10 +1852,28 @@ static bool try_connect(struct ffmpeg_output *output)
 		return false;
 	}
 
-	obs_output_set_video_conversion(output->output, &vsi);
-	obs_output_set_audio_conversion(output->output, &aci);
-	obs_output_begin_data_capture(output->output, 0);
 	output->write_thread_active = true;
+
+	if (output->segment_path.len && !start_segment_thread(output)) {
+		blog(LOG_WARNING, "ffmpeg_output_start: failed to create "
+		                  "segment thread.");
+		ffmpeg_output_stop(output);
+		return false;
+	}
+
+	if (!output->ff_data.encoded) {
+		if (!start_encode_thread(output)) {
+			blog(LOG_WARNING, "ffmpeg_output_start: failed to "
+			                  "create encode thread.");
+			ffmpeg_output_stop(output);
+			return false;
+		}
+
+		obs_output_set_video_conversion(output->output, &vsi);
+		obs_output_set_audio_conversion(output->output, &aci);
+	}
+
+	obs_output_begin_data_capture(output->output, flags);
 	return true;
 }
 
@@ -759,6 +1881,8 @@ static void *start_thread(void *data)
 {
 	struct ffmpeg_output *output = data;
 
+	os_thread_init(OS_THREAD_CLASS_OUTPUT, "ffmpeg connect");
+
 	if (!try_connect(output))
 		obs_output_signal_stop(output->output,
 				OBS_OUTPUT_CONNECT_FAILED);
@@ -785,6 +1909,7 @@ static void ffmpeg_output_stop(void *data)
 
 	if (output->active) {
 		obs_output_end_data_capture(output->output);
+		stop_encode_thread(output);
 
 		if (output->write_thread_active) {
 			os_event_signal(output->stop_event);
@@ -793,11 +1918,19 @@ static void ffmpeg_output_stop(void *data)
 			output->write_thread_active = false;
 		}
 
+		stop_segment_thread(output);
+
 		pthread_mutex_lock(&output->write_mutex);
 
 		for (size_t i = 0; i < output->packets.num; i++)
-			av_free_packet(output->packets.array+i);
-		da_free(output->packets);
+			av_free_packet(dq_item(output->packets, i));
+		dq_free(output->packets);
+		output->queue_size = 0;
+
+		if (output->packets_dropped)
+			blog(LOG_INFO, "ffmpeg_output: %u frames dropped "
+			               "because the disk couldn't keep up",
+			               output->packets_dropped);
 
 		pthread_mutex_unlock(&output->write_mutex);
 
@@ -805,9 +1938,24 @@ static void ffmpeg_output_stop(void *data)
 	}
 }
 
+static void ffmpeg_output_defaults(obs_data_t settings)
+{
+	obs_data_set_default_int(settings, "write_block_size", 1024);
+	obs_data_set_default_int(settings, "write_behind_size", 64);
+	obs_data_set_default_bool(settings, "direct_io", false);
+	obs_data_set_default_bool(settings, "fragmented", false);
+	obs_data_set_default_int(settings, "sync_interval", 0);
+	obs_data_set_default_int(settings, "max_time_sec", 0);
+	obs_data_set_default_int(settings, "max_size_mb", 0);
+	obs_data_set_default_int(settings, "prealloc_size", 64);
+	obs_data_set_default_int(settings, "max_queue_size", 512);
+	obs_data_set_default_string(settings, "queue_full_policy", "drop");
+}
+
 struct obs_output_info ffmpeg_output = {
 	.id        = "ffmpeg_output",
-	.flags     = OBS_OUTPUT_AUDIO | OBS_OUTPUT_VIDEO,
+	.flags     = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED |
+	             OBS_OUTPUT_MULTI_TRACK,
 	.getname   = ffmpeg_output_getname,
 	.create    = ffmpeg_output_create,
 	.destroy   = ffmpeg_output_destroy,
@@ -815,4 +1963,6 @@ struct obs_output_info ffmpeg_output = {
 	.stop      = ffmpeg_output_stop,
 	.raw_video = receive_video,
 	.raw_audio = receive_audio,
+	.encoded_packet = receive_packet,
+	.defaults  = ffmpeg_output_defaults,
 };
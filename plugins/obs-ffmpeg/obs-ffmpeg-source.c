@@ -0,0 +1,1024 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/* Media file source
+ *
+ * A demux thread reads packets into one queue per stream, and the video and
+ * audio decoders each run on their own thread.  Decoded frames are paced
+ * against the system clock and output slightly ahead of their display time,
+ * video into frames from the source's frame cache so the decoded image is
+ * only copied once.
+ *
+ * When looping, the demuxer seeks back to the start as soon as it reaches the
+ * end of the file, so the next pass is already queued and decoded by the time
+ * the current one finishes playing.  Sources that restart on activation are
+ * opened and preloaded up to their first frame while hidden, and stopped
+ * again when they're deactivated, so hidden clips cost nothing to keep
+ * around. */
+
+#include <obs.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include <util/deque.h>
+
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+
+#include "obs-ffmpeg-formats.h"
+#include "obs-ffmpeg-compat.h"
+
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 89, 100)
+#include <libavutil/hwcontext.h>
+#define HAVE_HW_DECODE
+
+#if defined(_WIN32)
+#define HW_DEVICE_TYPE AV_HWDEVICE_TYPE_DXVA2
+#define HW_PIX_FMT     AV_PIX_FMT_DXVA2_VLD
+#elif defined(__APPLE__)
+#define HW_DEVICE_TYPE AV_HWDEVICE_TYPE_VIDEOTOOLBOX
+#define HW_PIX_FMT     AV_PIX_FMT_VIDEOTOOLBOX
+#else
+#define HW_DEVICE_TYPE AV_HWDEVICE_TYPE_VAAPI
+#define HW_PIX_FMT     AV_PIX_FMT_VAAPI
+#endif
+#endif
+
+/* packets queued per stream before the demuxer waits for the decoder */
+#define PACKET_QUEUE_SIZE 256
+
+/* how far ahead of their display time frames are output.  has to stay well
+ * below the depth of the async frame queue */
+#define PRELOAD_NS 100000000LL
+
+static const AVRational ns_time_base = {1, 1000000000};
+
+struct ff_packet {
+	AVPacket                pkt;
+	int64_t                 base_ns;
+	bool                    flush;
+};
+
+struct packet_queue {
+	pthread_mutex_t         mutex;
+	os_sem_t                packets;
+	os_sem_t                space;
+	DEQUE(struct ff_packet) items;
+};
+
+struct ffmpeg_source;
+
+struct ff_decoder {
+	struct ffmpeg_source    *s;
+	AVStream                *stream;
+	AVCodecContext          *context;
+	AVFrame                 *frame;
+	struct packet_queue     queue;
+
+	pthread_t               thread;
+	bool                    thread_active;
+
+	/* start of the pass the current packets belong to, and the predicted
+	 * time of the next frame for frames without a timestamp */
+	int64_t                 base_ns;
+	int64_t                 next_ns;
+
+	struct SwsContext       *sws;
+	bool                    format_warned;
+
+#ifdef HAVE_HW_DECODE
+	AVBufferRef             *hw_device;
+	AVFrame                 *sw_frame;
+#endif
+};
+
+struct ffmpeg_source {
+	obs_source_t            source;
+	char                    *path;
+	bool                    looping;
+	bool                    restart_on_activate;
+	bool                    hw_decode;
+
+	AVFormatContext         *fmt;
+	struct ff_decoder       video;
+	struct ff_decoder       audio;
+	int64_t                 start_time_ns;
+
+	/* only touched by the demux thread */
+	int64_t                 pass_base_ns;
+	int64_t                 pass_end_ns;
+
+	pthread_t               demux_thread;
+	bool                    demux_active;
+
+	os_event_t              stop_event;
+	os_event_t              play_event;
+	uint64_t                play_sys_ns;
+};
+
+static inline bool stopping(struct ffmpeg_source *s)
+{
+	return os_event_try(s->stop_event) == 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool packet_queue_init(struct packet_queue *q)
+{
+	memset(q, 0, sizeof(struct packet_queue));
+
+	if (pthread_mutex_init(&q->mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&q->packets, 0) != 0)
+		return false;
+	if (os_sem_init(&q->space, PACKET_QUEUE_SIZE) != 0)
+		return false;
+
+	dq_init(q->items);
+	return true;
+}
+
+static void packet_queue_free(struct packet_queue *q)
+{
+	for (size_t i = 0; i < q->items.num; i++)
+		av_free_packet(&dq_item(q->items, i)->pkt);
+
+	dq_free(q->items);
+	os_sem_destroy(q->packets);
+	os_sem_destroy(q->space);
+	pthread_mutex_destroy(&q->mutex);
+}
+
+static bool packet_queue_push(struct ffmpeg_source *s, struct packet_queue *q,
+		struct ff_packet *packet)
+{
+	if (os_sem_wait(q->space) != 0 || stopping(s))
+		return false;
+
+	pthread_mutex_lock(&q->mutex);
+	dq_push_back(q->items, packet);
+	pthread_mutex_unlock(&q->mutex);
+
+	os_sem_post(q->packets);
+	return true;
+}
+
+static bool packet_queue_pop(struct ffmpeg_source *s, struct packet_queue *q,
+		struct ff_packet *packet)
+{
+	if (os_sem_wait(q->packets) != 0 || stopping(s))
+		return false;
+
+	pthread_mutex_lock(&q->mutex);
+	dq_pop_front(q->items, packet);
+	pthread_mutex_unlock(&q->mutex);
+
+	os_sem_post(q->space);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* waits until the source starts playing, then until the frame is due to be
+ * output.  returns false if the source is stopped in the meantime */
+static bool wait_for_frame(struct ffmpeg_source *s, int64_t media_ns)
+{
+	uint64_t target;
+	uint64_t now;
+
+	os_event_wait(s->play_event);
+	if (stopping(s))
+		return false;
+
+	target = s->play_sys_ns + media_ns - PRELOAD_NS;
+
+	while ((now = os_gettime_ns()) < target) {
+		unsigned long ms = (unsigned long)((target - now) / 1000000);
+		if (!ms)
+			break;
+		if (os_event_timedwait(s->stop_event, ms) != ETIMEDOUT)
+			return false;
+	}
+
+	return !stopping(s);
+}
+
+static int64_t frame_media_ns(struct ff_decoder *d, AVFrame *frame)
+{
+	int64_t pts = av_frame_get_best_effort_timestamp(frame);
+
+	if (pts == AV_NOPTS_VALUE)
+		return d->next_ns;
+
+	return d->base_ns - d->s->start_time_ns +
+		av_rescale_q(pts, d->stream->time_base, ns_time_base);
+}
+
+static inline enum video_colorspace convert_color_space(
+		enum AVColorSpace space)
+{
+	return space == AVCOL_SPC_BT709 ? VIDEO_CS_709 : VIDEO_CS_601;
+}
+
+static void set_frame_color(struct ff_decoder *d, struct source_frame *out,
+		enum AVPixelFormat format)
+{
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+	bool full;
+
+	if (desc && (desc->flags & AV_PIX_FMT_FLAG_RGB) != 0)
+		return;
+
+	full = format == AV_PIX_FMT_YUVJ420P ||
+	       d->context->color_range == AVCOL_RANGE_JPEG;
+
+	out->full_range = full;
+	video_format_get_parameters(convert_color_space(d->context->colorspace),
+			full ? VIDEO_RANGE_FULL : VIDEO_RANGE_PARTIAL,
+			out->color_matrix,
+			out->color_range_min, out->color_range_max);
+}
+
+static inline bool is_planar_yuv(enum video_format format)
+{
+	return format == VIDEO_FORMAT_I420 || format == VIDEO_FORMAT_NV12;
+}
+
+static struct source_frame *alloc_frame(struct ff_decoder *d,
+		enum video_format format, int width, int height)
+{
+	/* chroma planes of frame cache frames are allocated for even sizes */
+	if (is_planar_yuv(format)) {
+		width  &= ~1;
+		height &= ~1;
+	}
+
+	return obs_source_allocframe(d->s->source, format,
+			(uint32_t)width, (uint32_t)height);
+}
+
+static inline void get_linesizes(const struct source_frame *out,
+		int linesize[4])
+{
+	for (size_t i = 0; i < 4; i++)
+		linesize[i] = (int)out->linesize[i];
+}
+
+#ifdef HAVE_HW_DECODE
+static enum AVPixelFormat get_hw_format(AVCodecContext *context,
+		const enum AVPixelFormat *formats)
+{
+	for (const enum AVPixelFormat *f = formats; *f != AV_PIX_FMT_NONE; f++)
+		if (*f == HW_PIX_FMT)
+			return *f;
+
+	/* the hardware can't decode this stream, decode it in software */
+	return avcodec_default_get_format(context, formats);
+}
+
+static bool init_hw_decoder(struct ff_decoder *d)
+{
+	int ret = av_hwdevice_ctx_create(&d->hw_device, HW_DEVICE_TYPE,
+			NULL, NULL, 0);
+	if (ret < 0) {
+		blog(LOG_INFO, "ffmpeg source: Hardware decoding unavailable, "
+		               "decoding in software: %s", av_err2str(ret));
+		return false;
+	}
+
+	d->sw_frame = av_frame_alloc();
+	if (!d->sw_frame)
+		return false;
+
+	d->context->hw_device_ctx = av_buffer_ref(d->hw_device);
+	d->context->get_format    = get_hw_format;
+	return d->context->hw_device_ctx != NULL;
+}
+
+static void keep_frame_data(void *opaque, uint8_t *data)
+{
+	UNUSED_PARAMETER(opaque);
+	UNUSED_PARAMETER(data);
+}
+
+/* downloads NV12 surfaces straight into a frame cache frame.  the buffer
+ * reference only keeps the transfer from allocating a frame of its own, the
+ * memory stays owned by the source frame */
+static struct source_frame *download_nv12(struct ff_decoder *d,
+		AVFrame *frame)
+{
+	AVHWFramesContext   *frames_ctx;
+	struct source_frame *out;
+	AVFrame             *dst = d->sw_frame;
+	int                 ret;
+
+	frames_ctx = (AVHWFramesContext*)frame->hw_frames_ctx->data;
+	if (frames_ctx->sw_format != AV_PIX_FMT_NV12 ||
+	    (frame->width & 1) != 0 || (frame->height & 1) != 0)
+		return NULL;
+
+	out = alloc_frame(d, VIDEO_FORMAT_NV12, frame->width, frame->height);
+	if (!out)
+		return NULL;
+
+	av_frame_unref(dst);
+	dst->format      = AV_PIX_FMT_NV12;
+	dst->width       = frame->width;
+	dst->height      = frame->height;
+	dst->data[0]     = out->data[0];
+	dst->data[1]     = out->data[1];
+	dst->linesize[0] = (int)out->linesize[0];
+	dst->linesize[1] = (int)out->linesize[1];
+	dst->buf[0]      = av_buffer_create(out->data[0],
+			(int)(out->data[1] - out->data[0]) +
+			dst->linesize[1] * frame->height / 2,
+			keep_frame_data, NULL, 0);
+
+	ret = dst->buf[0] ? av_hwframe_transfer_data(dst, frame, 0) :
+		AVERROR(ENOMEM);
+	av_frame_unref(dst);
+
+	if (ret < 0) {
+		blog(LOG_WARNING, "ffmpeg source: Failed to download frame: %s",
+				av_err2str(ret));
+		source_frame_destroy(out);
+		return NULL;
+	}
+
+	set_frame_color(d, out, AV_PIX_FMT_NV12);
+	return out;
+}
+#endif
+
+static struct source_frame *scale_frame(struct ff_decoder *d, AVFrame *frame)
+{
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+	bool                     rgb   = desc &&
+		(desc->flags & AV_PIX_FMT_FLAG_RGB) != 0;
+	enum video_format        format;
+	struct source_frame      *out;
+	int                      linesize[4];
+
+	format = rgb ? VIDEO_FORMAT_BGRA : VIDEO_FORMAT_NV12;
+
+	out = alloc_frame(d, format, frame->width, frame->height);
+	if (!out)
+		return NULL;
+
+	d->sws = sws_getCachedContext(d->sws,
+			frame->width, frame->height, frame->format,
+			(int)out->width, (int)out->height,
+			obs_to_ffmpeg_video_format(format),
+			SWS_FAST_BILINEAR, NULL, NULL, NULL);
+	if (!d->sws) {
+		if (!d->format_warned)
+			blog(LOG_WARNING, "ffmpeg source: Can't convert "
+			                  "pixel format %s",
+			                  desc ? desc->name : "unknown");
+		d->format_warned = true;
+		source_frame_destroy(out);
+		return NULL;
+	}
+
+	get_linesizes(out, linesize);
+	sws_scale(d->sws, (const uint8_t *const *)frame->data,
+			frame->linesize, 0, frame->height,
+			out->data, linesize);
+
+	/* swscale outputs partial range 601 */
+	if (!rgb) {
+		out->full_range = false;
+		video_format_get_parameters(VIDEO_CS_601, VIDEO_RANGE_PARTIAL,
+				out->color_matrix,
+				out->color_range_min, out->color_range_max);
+	}
+
+	return out;
+}
+
+static struct source_frame *convert_video_frame(struct ff_decoder *d,
+		AVFrame *frame)
+{
+	struct source_frame *out;
+	enum video_format   format;
+	int                 linesize[4];
+
+#ifdef HAVE_HW_DECODE
+	if (frame->format == HW_PIX_FMT) {
+		int ret;
+
+		out = download_nv12(d, frame);
+		if (out)
+			return out;
+
+		av_frame_unref(d->sw_frame);
+		ret = av_hwframe_transfer_data(d->sw_frame, frame, 0);
+		if (ret < 0) {
+			blog(LOG_WARNING, "ffmpeg source: Failed to download "
+			                  "frame: %s", av_err2str(ret));
+			return NULL;
+		}
+
+		frame = d->sw_frame;
+	}
+#endif
+
+	format = ffmpeg_to_obs_video_format(frame->format);
+	if (format == VIDEO_FORMAT_NONE)
+		return scale_frame(d, frame);
+
+	out = alloc_frame(d, format, frame->width, frame->height);
+	if (!out)
+		return NULL;
+
+	get_linesizes(out, linesize);
+	av_image_copy(out->data, linesize,
+			(const uint8_t **)frame->data, frame->linesize,
+			frame->format, (int)out->width, (int)out->height);
+
+	set_frame_color(d, out, frame->format);
+	return out;
+}
+
+static bool output_video(struct ff_decoder *d, AVFrame *frame)
+{
+	struct ffmpeg_source *s = d->s;
+	struct source_frame  *out;
+	int64_t              media_ns = frame_media_ns(d, frame);
+	int64_t              duration;
+
+	duration = av_rescale_q(av_frame_get_pkt_duration(frame),
+			d->stream->time_base, ns_time_base);
+	if (duration <= 0 && d->stream->avg_frame_rate.num)
+		duration = av_rescale_q(1, av_inv_q(d->stream->avg_frame_rate),
+				ns_time_base);
+	d->next_ns = media_ns + duration;
+
+	if (!wait_for_frame(s, media_ns))
+		return false;
+
+	out = convert_video_frame(d, frame);
+	if (out) {
+		out->timestamp = s->play_sys_ns + (uint64_t)media_ns;
+		obs_source_output_video_direct(s->source, out);
+	}
+
+	return true;
+}
+
+static bool output_audio(struct ff_decoder *d, AVFrame *frame)
+{
+	struct ffmpeg_source *s = d->s;
+	struct source_audio  audio = {0};
+	int64_t              media_ns = frame_media_ns(d, frame);
+	int                  channels = d->context->channels;
+
+	d->next_ns = media_ns + av_rescale_q(frame->nb_samples,
+			(AVRational){1, frame->sample_rate}, ns_time_base);
+
+	if (!ffmpeg_sample_format_supported(frame->format) ||
+	    channels < 1 || channels > MAX_AV_PLANES || channels == 7) {
+		if (!d->format_warned)
+			blog(LOG_WARNING, "ffmpeg source: Unsupported audio "
+			                  "format %s with %d channels",
+			                  av_get_sample_fmt_name(frame->format),
+			                  channels);
+		d->format_warned = true;
+		return true;
+	}
+
+	if (!wait_for_frame(s, media_ns))
+		return false;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		audio.data[i] = frame->data[i];
+
+	audio.frames          = (uint32_t)frame->nb_samples;
+	audio.speakers        = (enum speaker_layout)channels;
+	audio.format          = convert_ffmpeg_sample_format(frame->format);
+	audio.samples_per_sec = (uint32_t)frame->sample_rate;
+	audio.timestamp       = s->play_sys_ns + (uint64_t)media_ns;
+
+	obs_source_output_audio(s->source, &audio);
+	return true;
+}
+
+/* decodes a packet, or drains the decoder when the packet is empty.
+ * returns false if the source was stopped */
+static bool decode_packet(struct ff_decoder *d, AVPacket *pkt, bool *drained)
+{
+	bool video = d->context->codec_type == AVMEDIA_TYPE_VIDEO;
+	int  got_frame;
+	int  ret;
+
+	*drained = true;
+
+	do {
+		if (video)
+			ret = avcodec_decode_video2(d->context, d->frame,
+					&got_frame, pkt);
+		else
+			ret = avcodec_decode_audio4(d->context, d->frame,
+					&got_frame, pkt);
+
+		if (ret < 0) {
+			blog(LOG_DEBUG, "ffmpeg source: Decode error: %s",
+					av_err2str(ret));
+			return true;
+		}
+
+		if (got_frame) {
+			bool success = video ?
+				output_video(d, d->frame) :
+				output_audio(d, d->frame);
+
+			*drained = false;
+			if (!success)
+				return false;
+		}
+
+		/* audio packets can hold more than one frame */
+		if (!video && pkt->data) {
+			pkt->data += ret;
+			pkt->size -= ret;
+		}
+	} while (!video && pkt->size > 0);
+
+	return true;
+}
+
+static bool flush_decoder(struct ff_decoder *d)
+{
+	AVPacket pkt;
+	bool     drained;
+
+	av_init_packet(&pkt);
+	pkt.data = NULL;
+	pkt.size = 0;
+
+	do {
+		if (!decode_packet(d, &pkt, &drained))
+			return false;
+	} while (!drained);
+
+	avcodec_flush_buffers(d->context);
+	return true;
+}
+
+static void *decoder_thread(void *data)
+{
+	struct ff_decoder *d = data;
+	struct ff_packet  packet;
+	bool              video = d == &d->s->video;
+	bool              success;
+	bool              drained;
+
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, video ?
+			"ffmpeg source video" : "ffmpeg source audio");
+
+	while (packet_queue_pop(d->s, &d->queue, &packet)) {
+		d->base_ns = packet.base_ns;
+
+		if (packet.flush) {
+			success = flush_decoder(d);
+		} else {
+			AVPacket pkt = packet.pkt;
+			success = decode_packet(d, &pkt, &drained);
+			av_free_packet(&packet.pkt);
+		}
+
+		if (!success)
+			break;
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool decoder_init(struct ffmpeg_source *s, struct ff_decoder *d,
+		enum AVMediaType type)
+{
+	AVCodec *codec = NULL;
+	int     idx;
+	int     ret;
+
+	idx = av_find_best_stream(s->fmt, type, -1, -1, &codec, 0);
+	if (idx < 0)
+		return false;
+
+	d->s       = s;
+	d->stream  = s->fmt->streams[idx];
+	d->context = d->stream->codec;
+
+	if (type == AVMEDIA_TYPE_VIDEO) {
+		d->context->thread_count = 0;
+
+#ifdef HAVE_HW_DECODE
+		if (s->hw_decode && init_hw_decoder(d))
+			d->context->thread_count = 1;
+#endif
+	}
+
+	ret = avcodec_open2(d->context, codec, NULL);
+	if (ret < 0) {
+		blog(LOG_WARNING, "ffmpeg source: Failed to open decoder "
+		                  "%s: %s", codec->name, av_err2str(ret));
+		d->stream = NULL;
+		return false;
+	}
+
+	d->frame = av_frame_alloc();
+	if (!d->frame) {
+		avcodec_close(d->context);
+		d->stream = NULL;
+		return false;
+	}
+
+	if (pthread_create(&d->thread, NULL, decoder_thread, d) != 0) {
+		blog(LOG_WARNING, "ffmpeg source: Failed to create decoder "
+		                  "thread");
+		return false;
+	}
+
+	d->thread_active = true;
+	return true;
+}
+
+static void decoder_free(struct ff_decoder *d)
+{
+	if (d->thread_active)
+		pthread_join(d->thread, NULL);
+
+	if (d->stream)
+		avcodec_close(d->context);
+
+	if (d->frame)
+		av_frame_free(&d->frame);
+	if (d->sws)
+		sws_freeContext(d->sws);
+
+#ifdef HAVE_HW_DECODE
+	if (d->sw_frame)
+		av_frame_free(&d->sw_frame);
+	av_buffer_unref(&d->hw_device);
+#endif
+
+	packet_queue_free(&d->queue);
+	memset(d, 0, sizeof(struct ff_decoder));
+}
+
+static int interrupt_callback(void *data)
+{
+	return stopping(data);
+}
+
+static bool open_media(struct ffmpeg_source *s)
+{
+	int ret;
+
+	s->fmt = avformat_alloc_context();
+	if (!s->fmt)
+		return false;
+
+	s->fmt->interrupt_callback.callback = interrupt_callback;
+	s->fmt->interrupt_callback.opaque   = s;
+
+	ret = avformat_open_input(&s->fmt, s->path, NULL, NULL);
+	if (ret < 0) {
+		blog(LOG_WARNING, "ffmpeg source: Failed to open '%s': %s",
+				s->path, av_err2str(ret));
+		return false;
+	}
+
+	ret = avformat_find_stream_info(s->fmt, NULL);
+	if (ret < 0) {
+		blog(LOG_WARNING, "ffmpeg source: Failed to find stream info "
+		                  "for '%s': %s", s->path, av_err2str(ret));
+		return false;
+	}
+
+	s->start_time_ns = s->fmt->start_time != AV_NOPTS_VALUE ?
+		s->fmt->start_time * 1000 : 0;
+
+	decoder_init(s, &s->video, AVMEDIA_TYPE_VIDEO);
+	decoder_init(s, &s->audio, AVMEDIA_TYPE_AUDIO);
+
+	if (!s->video.thread_active && !s->audio.thread_active) {
+		blog(LOG_WARNING, "ffmpeg source: No playable streams in '%s'",
+				s->path);
+		return false;
+	}
+
+	return true;
+}
+
+static struct ff_decoder *get_decoder(struct ffmpeg_source *s, int idx)
+{
+	if (s->video.thread_active && s->video.stream->index == idx)
+		return &s->video;
+	if (s->audio.thread_active && s->audio.stream->index == idx)
+		return &s->audio;
+	return NULL;
+}
+
+/* the end of the pass is the end of the last packet of any stream */
+static void update_pass_end(struct ffmpeg_source *s, struct ff_decoder *d,
+		const AVPacket *pkt)
+{
+	int64_t end;
+
+	if (pkt->pts == AV_NOPTS_VALUE)
+		return;
+
+	end = av_rescale_q(pkt->pts + pkt->duration, d->stream->time_base,
+			ns_time_base) - s->start_time_ns;
+	if (end > s->pass_end_ns)
+		s->pass_end_ns = end;
+}
+
+static bool push_flush(struct ffmpeg_source *s, struct ff_decoder *d)
+{
+	struct ff_packet packet = {0};
+
+	if (!d->thread_active)
+		return true;
+
+	packet.base_ns = s->pass_base_ns;
+	packet.flush   = true;
+	return packet_queue_push(s, &d->queue, &packet);
+}
+
+/* drains the decoders at the end of each pass, so frames still held back by
+ * the decoders don't end up with the timestamps of the next pass.  returns
+ * true if playback continues from the start */
+static bool end_pass(struct ffmpeg_source *s)
+{
+	int64_t start = s->fmt->start_time != AV_NOPTS_VALUE ?
+		s->fmt->start_time : 0;
+	int     ret;
+
+	if (!push_flush(s, &s->video) || !push_flush(s, &s->audio))
+		return false;
+
+	/* files without usable timestamps would loop as fast as they can be
+	 * read */
+	if (!s->looping || s->pass_end_ns <= 0)
+		return false;
+
+	s->pass_base_ns += s->pass_end_ns;
+	s->pass_end_ns   = 0;
+
+	ret = av_seek_frame(s->fmt, -1, start, AVSEEK_FLAG_BACKWARD);
+	if (ret < 0) {
+		blog(LOG_WARNING, "ffmpeg source: Failed to seek '%s' for "
+		                  "looping: %s", s->path, av_err2str(ret));
+		return false;
+	}
+
+	return true;
+}
+
+static void *demux_thread(void *data)
+{
+	struct ffmpeg_source *s = data;
+	struct ff_packet     packet = {0};
+
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "ffmpeg source demux");
+
+	if (!open_media(s))
+		return NULL;
+
+	while (!stopping(s)) {
+		struct ff_decoder *d;
+		int ret = av_read_frame(s->fmt, &packet.pkt);
+
+		if (ret == AVERROR(EAGAIN)) {
+			os_sleep_ms(1);
+			continue;
+		} else if (ret < 0) {
+			if (!end_pass(s))
+				break;
+			continue;
+		}
+
+		d = get_decoder(s, packet.pkt.stream_index);
+		if (!d || av_dup_packet(&packet.pkt) < 0) {
+			av_free_packet(&packet.pkt);
+			continue;
+		}
+
+		update_pass_end(s, d, &packet.pkt);
+		packet.base_ns = s->pass_base_ns;
+
+		if (!packet_queue_push(s, &d->queue, &packet)) {
+			av_free_packet(&packet.pkt);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void ffmpeg_source_play(struct ffmpeg_source *s)
+{
+	s->play_sys_ns = os_gettime_ns() + PRELOAD_NS;
+	os_event_signal(s->play_event);
+}
+
+/* the queues are created before the threads that wait on them, so they can
+ * be woken up without knowing which of the threads are running yet */
+static void wake_queue(struct packet_queue *q)
+{
+	os_sem_post(q->packets);
+	os_sem_post(q->space);
+}
+
+static void ffmpeg_source_stop(struct ffmpeg_source *s)
+{
+	if (!s->demux_active)
+		return;
+
+	os_event_signal(s->stop_event);
+	os_event_signal(s->play_event);
+
+	wake_queue(&s->video.queue);
+	wake_queue(&s->audio.queue);
+	pthread_join(s->demux_thread, NULL);
+
+	decoder_free(&s->video);
+	decoder_free(&s->audio);
+
+	if (s->fmt)
+		avformat_close_input(&s->fmt);
+
+	s->demux_active = false;
+	os_event_reset(s->stop_event);
+	os_event_reset(s->play_event);
+}
+
+/* opens the file and decodes up to the first frame.  playback begins right
+ * away unless the source waits for activation */
+static void ffmpeg_source_start(struct ffmpeg_source *s, bool play)
+{
+	if (!s->path || !*s->path)
+		return;
+
+	s->pass_base_ns = 0;
+	s->pass_end_ns  = 0;
+
+	if (!packet_queue_init(&s->video.queue) ||
+	    !packet_queue_init(&s->audio.queue)) {
+		blog(LOG_WARNING, "ffmpeg source: Failed to create packet "
+		                  "queues");
+		decoder_free(&s->video);
+		decoder_free(&s->audio);
+		return;
+	}
+
+	if (pthread_create(&s->demux_thread, NULL, demux_thread, s) != 0) {
+		blog(LOG_WARNING, "ffmpeg source: Failed to create demux "
+		                  "thread");
+		decoder_free(&s->video);
+		decoder_free(&s->audio);
+		return;
+	}
+
+	s->demux_active = true;
+
+	if (play)
+		ffmpeg_source_play(s);
+}
+
+static const char *ffmpeg_source_getname(const char *locale)
+{
+	/* TODO: locale stuff */
+	UNUSED_PARAMETER(locale);
+	return "Media Source";
+}
+
+static void ffmpeg_source_update(void *data, obs_data_t settings)
+{
+	struct ffmpeg_source *s = data;
+
+	ffmpeg_source_stop(s);
+
+	bfree(s->path);
+	s->path                = bstrdup(obs_data_getstring(settings,
+				"local_file"));
+	s->looping             = obs_data_getbool(settings, "looping");
+	s->restart_on_activate = obs_data_getbool(settings,
+			"restart_on_activate");
+	s->hw_decode           = obs_data_getbool(settings, "hw_decode");
+
+	ffmpeg_source_start(s, !s->restart_on_activate ||
+			obs_source_active(s->source));
+}
+
+static void ffmpeg_source_destroy(void *data)
+{
+	struct ffmpeg_source *s = data;
+
+	if (s) {
+		ffmpeg_source_stop(s);
+		os_event_destroy(s->stop_event);
+		os_event_destroy(s->play_event);
+		bfree(s->path);
+		bfree(s);
+	}
+}
+
+static void *ffmpeg_source_create(obs_data_t settings, obs_source_t source)
+{
+	struct ffmpeg_source *s = bzalloc(sizeof(struct ffmpeg_source));
+
+	s->source = source;
+
+	if (os_event_init(&s->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+	if (os_event_init(&s->play_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+
+	ffmpeg_source_update(s, settings);
+	return s;
+
+fail:
+	ffmpeg_source_destroy(s);
+	return NULL;
+}
+
+static void ffmpeg_source_activate(void *data)
+{
+	struct ffmpeg_source *s = data;
+
+	if (s->restart_on_activate && s->demux_active)
+		ffmpeg_source_play(s);
+}
+
+/* stopping also preloads the clip again for the next activation */
+static void ffmpeg_source_deactivate(void *data)
+{
+	struct ffmpeg_source *s = data;
+
+	if (s->restart_on_activate) {
+		ffmpeg_source_stop(s);
+		ffmpeg_source_start(s, false);
+	}
+}
+
+static void ffmpeg_source_defaults(obs_data_t settings)
+{
+	obs_data_set_default_bool(settings, "looping", false);
+	obs_data_set_default_bool(settings, "restart_on_activate", true);
+	obs_data_set_default_bool(settings, "hw_decode", true);
+}
+
+static obs_properties_t ffmpeg_source_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_path(props, "local_file", "Local File");
+	obs_properties_add_bool(props, "looping", "Loop");
+	obs_properties_add_bool(props, "restart_on_activate",
+			"Restart playback when source becomes active");
+#ifdef HAVE_HW_DECODE
+	obs_properties_add_bool(props, "hw_decode",
+			"Use hardware decoding when available");
+#endif
+
+	return props;
+}
+
+struct obs_source_info ffmpeg_source = {
+	.id           = "ffmpeg_source",
+	.type         = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_AUDIO |
+	                OBS_SOURCE_THREADED_CREATE |
+	                OBS_SOURCE_DEFERRED_CREATE,
+	.getname      = ffmpeg_source_getname,
+	.create       = ffmpeg_source_create,
+	.destroy      = ffmpeg_source_destroy,
+	.update       = ffmpeg_source_update,
+	.activate     = ffmpeg_source_activate,
+	.deactivate   = ffmpeg_source_deactivate,
+	.defaults     = ffmpeg_source_defaults,
+	.properties   = ffmpeg_source_properties
+};
@@ -0,0 +1,655 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* O_DIRECT */
+#endif
+
+#include <obs.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/threading.h>
+#include <util/platform.h>
+
+#include <libavutil/mem.h>
+#include <libavformat/avformat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <stdio.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include "obs-ffmpeg-writer.h"
+
+#define AVIO_BUFFER_SIZE (64 * 1024)
+#define DIRECT_ALIGN     4096
+
+#if !defined(_WIN32) && defined(O_DIRECT)
+#define HAVE_DIRECT_IO
+#endif
+
+struct writer_block {
+	uint8_t *data;
+	size_t  size;
+};
+
+struct ffmpeg_writer {
+#ifdef _WIN32
+	FILE                         *file;
+#else
+	int                          fd;
+#endif
+	struct ffmpeg_writer_info    info;
+	bool                         direct;
+	bool                         aligned_blocks;
+
+	AVIOContext                  *avio;
+
+	/* only touched by the muxing thread */
+	struct writer_block          cur;
+	int64_t                      pos;
+	int64_t                      size;
+	uint64_t                     last_enqueue;
+
+	/* only touched by the write thread */
+	uint64_t                     last_sync;
+	bool                         sync_failed;
+	int64_t                      allocated;
+	bool                         prealloc_failed;
+
+	pthread_mutex_t              mutex;
+	struct circlebuf             pending;
+	size_t                       pending_size;
+	DARRAY(struct writer_block)  free_blocks;
+
+	os_sem_t                     write_sem;
+	os_event_t                   written_event;
+	pthread_t                    thread;
+	bool                         thread_active;
+	volatile bool                stop;
+	volatile bool                error;
+};
+
+/* ------------------------------------------------------------------------- */
+/* file access */
+
+static bool open_file(struct ffmpeg_writer *writer, const char *path)
+{
+#ifdef _WIN32
+	writer->file = os_fopen(path, "wb");
+	return writer->file != NULL;
+#else
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+#ifdef HAVE_DIRECT_IO
+	if (writer->direct) {
+		writer->fd = open(path, flags | O_DIRECT, 0644);
+		if (writer->fd != -1)
+			return true;
+
+		blog(LOG_INFO, "ffmpeg writer: O_DIRECT not supported for "
+		               "'%s', using buffered writes", path);
+		writer->direct = false;
+	}
+#endif
+
+	writer->fd = open(path, flags, 0644);
+	return writer->fd != -1;
+#endif
+}
+
+static void close_file(struct ffmpeg_writer *writer)
+{
+#ifdef _WIN32
+	if (writer->file)
+		fclose(writer->file);
+#else
+	if (writer->fd != -1)
+		close(writer->fd);
+#endif
+}
+
+/* direct writes must be a multiple of the alignment, so the last partial
+ * block (and anything written after a seek) goes through the page cache */
+static void disable_direct(struct ffmpeg_writer *writer)
+{
+#ifdef HAVE_DIRECT_IO
+	if (writer->direct) {
+		int flags = fcntl(writer->fd, F_GETFL);
+		fcntl(writer->fd, F_SETFL, flags & ~O_DIRECT);
+		writer->direct = false;
+	}
+#else
+	UNUSED_PARAMETER(writer);
+#endif
+}
+
+static bool write_file(struct ffmpeg_writer *writer, const uint8_t *data,
+		size_t size)
+{
+#ifdef _WIN32
+	return fwrite(data, 1, size, writer->file) == size;
+#else
+	while (size) {
+		ssize_t ret = write(writer->fd, data, size);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		data += ret;
+		size -= (size_t)ret;
+	}
+
+	return true;
+#endif
+}
+
+static bool seek_file(struct ffmpeg_writer *writer, int64_t pos)
+{
+#ifdef _WIN32
+	return fseeko(writer->file, (off_t)pos, SEEK_SET) == 0;
+#else
+	return lseek(writer->fd, (off_t)pos, SEEK_SET) != (off_t)-1;
+#endif
+}
+
+static bool sync_file(struct ffmpeg_writer *writer)
+{
+#ifdef _WIN32
+	return fflush(writer->file) == 0 &&
+		_commit(_fileno(writer->file)) == 0;
+#elif defined(__APPLE__)
+	return fsync(writer->fd) == 0;
+#else
+	return fdatasync(writer->fd) == 0;
+#endif
+}
+
+static int64_t tell_file(struct ffmpeg_writer *writer)
+{
+#ifdef _WIN32
+	return (int64_t)ftello(writer->file);
+#else
+	return (int64_t)lseek(writer->fd, 0, SEEK_CUR);
+#endif
+}
+
+/* reserves space up to the given size without changing the file size, so no
+ * zeros are written and the size stays right if the recording is cut short */
+static bool alloc_file(struct ffmpeg_writer *writer, int64_t size)
+{
+#ifdef _WIN32
+	HANDLE              handle;
+	FILE_ALLOCATION_INFO info;
+
+	handle = (HANDLE)_get_osfhandle(_fileno(writer->file));
+	info.AllocationSize.QuadPart = size;
+	return SetFileInformationByHandle(handle, FileAllocationInfo, &info,
+			sizeof(info)) != 0;
+
+#elif defined(__APPLE__)
+	fstore_t store = {0};
+	struct stat st;
+
+	if (fstat(writer->fd, &st) != 0)
+		return false;
+	if (size <= (int64_t)st.st_size)
+		return true;
+
+	/* F_PEOFPOSMODE allocates from the end of the file */
+	store.fst_flags   = F_ALLOCATECONTIG;
+	store.fst_posmode = F_PEOFPOSMODE;
+	store.fst_length  = (off_t)(size - (int64_t)st.st_size);
+	if (fcntl(writer->fd, F_PREALLOCATE, &store) == 0)
+		return true;
+
+	store.fst_flags = F_ALLOCATEALL;
+	return fcntl(writer->fd, F_PREALLOCATE, &store) == 0;
+
+#elif defined(FALLOC_FL_KEEP_SIZE)
+	int ret;
+
+	do {
+		ret = fallocate(writer->fd, FALLOC_FL_KEEP_SIZE, 0,
+				(off_t)size);
+	} while (ret != 0 && errno == EINTR);
+
+	return ret == 0;
+
+#else
+	UNUSED_PARAMETER(writer);
+	UNUSED_PARAMETER(size);
+	return false;
+#endif
+}
+
+/* gives back what was reserved past the end of the file */
+static void release_file_space(struct ffmpeg_writer *writer)
+{
+	if (writer->allocated <= writer->size)
+		return;
+
+#ifdef _WIN32
+	fflush(writer->file);
+	alloc_file(writer, writer->size);
+#else
+	if (ftruncate(writer->fd, (off_t)writer->size) != 0)
+		blog(LOG_DEBUG, "ffmpeg writer: failed to release "
+		                "preallocated space");
+#endif
+}
+
+/* keeps the reserved space at least a block ahead of the write position */
+static void preallocate(struct ffmpeg_writer *writer, size_t block_size)
+{
+	int64_t pos;
+
+	if (!writer->info.prealloc_size || writer->prealloc_failed)
+		return;
+
+	pos = tell_file(writer);
+	if (pos < 0 || pos + (int64_t)block_size <= writer->allocated)
+		return;
+
+	if (!alloc_file(writer, pos + (int64_t)writer->info.prealloc_size)) {
+		blog(LOG_INFO, "ffmpeg writer: preallocation not supported, "
+		               "the file grows with each write");
+		writer->prealloc_failed = true;
+		return;
+	}
+
+	writer->allocated = pos + (int64_t)writer->info.prealloc_size;
+}
+
+/* ------------------------------------------------------------------------- */
+/* blocks */
+
+static uint8_t *alloc_block_data(struct ffmpeg_writer *writer)
+{
+#ifdef HAVE_DIRECT_IO
+	if (writer->aligned_blocks) {
+		void *ptr = NULL;
+		if (posix_memalign(&ptr, DIRECT_ALIGN,
+					writer->info.block_size) != 0)
+			return NULL;
+		return ptr;
+	}
+#endif
+
+	return bmalloc(writer->info.block_size);
+}
+
+static void free_block_data(struct ffmpeg_writer *writer, uint8_t *data)
+{
+#ifdef HAVE_DIRECT_IO
+	if (writer->aligned_blocks) {
+		free(data);
+		return;
+	}
+#endif
+
+	bfree(data);
+}
+
+static bool get_free_block(struct ffmpeg_writer *writer)
+{
+	pthread_mutex_lock(&writer->mutex);
+	if (writer->free_blocks.num) {
+		writer->cur = writer->free_blocks.array[
+			writer->free_blocks.num - 1];
+		da_pop_back(writer->free_blocks);
+	} else {
+		writer->cur.data = NULL;
+	}
+	pthread_mutex_unlock(&writer->mutex);
+
+	if (!writer->cur.data)
+		writer->cur.data = alloc_block_data(writer);
+
+	writer->cur.size = 0;
+	return writer->cur.data != NULL;
+}
+
+/* hands the current block to the write thread.  if more than the write-behind
+ * budget is already waiting on the disk, this blocks the muxer (but nothing
+ * upstream of it) until enough has been written. */
+static void enqueue_block(struct ffmpeg_writer *writer)
+{
+	if (!writer->cur.size)
+		return;
+
+	pthread_mutex_lock(&writer->mutex);
+
+	while (writer->pending.size && !writer->error &&
+	       writer->pending_size + writer->cur.size >
+	       writer->info.max_pending) {
+		pthread_mutex_unlock(&writer->mutex);
+		os_event_wait(writer->written_event);
+		pthread_mutex_lock(&writer->mutex);
+	}
+
+	circlebuf_push_back(&writer->pending, &writer->cur,
+			sizeof(writer->cur));
+	writer->pending_size += writer->cur.size;
+
+	pthread_mutex_unlock(&writer->mutex);
+	os_sem_post(writer->write_sem);
+
+	writer->cur.data = NULL;
+	writer->cur.size = 0;
+
+	if (writer->info.sync_interval_ns)
+		writer->last_enqueue = os_gettime_ns();
+}
+
+static void wait_for_pending(struct ffmpeg_writer *writer)
+{
+	pthread_mutex_lock(&writer->mutex);
+
+	while (writer->pending.size) {
+		pthread_mutex_unlock(&writer->mutex);
+		os_event_wait(writer->written_event);
+		pthread_mutex_lock(&writer->mutex);
+	}
+
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+static void sync_if_due(struct ffmpeg_writer *writer)
+{
+	uint64_t now;
+
+	if (!writer->info.sync_interval_ns || writer->error)
+		return;
+
+	now = os_gettime_ns();
+	if (now - writer->last_sync < writer->info.sync_interval_ns)
+		return;
+
+	if (!sync_file(writer) && !writer->sync_failed) {
+		blog(LOG_WARNING, "ffmpeg writer: failed to sync file to "
+		                  "disk");
+		writer->sync_failed = true;
+	}
+
+	writer->last_sync = now;
+}
+
+static void *write_thread(void *data)
+{
+	struct ffmpeg_writer *writer = data;
+
+	os_thread_init(OS_THREAD_CLASS_OUTPUT, "ffmpeg writer");
+
+	while (os_sem_wait(writer->write_sem) == 0) {
+		struct writer_block block;
+		uint64_t            start;
+
+		pthread_mutex_lock(&writer->mutex);
+		if (!writer->pending.size) {
+			pthread_mutex_unlock(&writer->mutex);
+			if (writer->stop)
+				break;
+			continue;
+		}
+
+		/* leave the block queued while writing so that it still
+		 * counts against the write-behind budget */
+		circlebuf_peek_front(&writer->pending, &block, sizeof(block));
+		pthread_mutex_unlock(&writer->mutex);
+
+		start = trace_begin();
+
+		if (!writer->error) {
+			if (writer->direct && (block.size % DIRECT_ALIGN) != 0)
+				disable_direct(writer);
+
+			preallocate(writer, block.size);
+
+			if (!write_file(writer, block.data, block.size)) {
+				blog(LOG_WARNING, "ffmpeg writer: failed to "
+				                  "write to file");
+				writer->error = true;
+			}
+		}
+
+		sync_if_due(writer);
+		trace_end("ffmpeg_write_block", start);
+
+		pthread_mutex_lock(&writer->mutex);
+		circlebuf_pop_front(&writer->pending, NULL, sizeof(block));
+		writer->pending_size -= block.size;
+		da_push_back(writer->free_blocks, &block);
+		pthread_mutex_unlock(&writer->mutex);
+
+		os_event_signal(writer->written_event);
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+/* avio callbacks (called from the muxing thread) */
+
+static int writer_write_packet(void *opaque, uint8_t *buf, int buf_size)
+{
+	struct ffmpeg_writer *writer = opaque;
+	size_t size = (size_t)buf_size;
+
+	if (writer->error)
+		return AVERROR(EIO);
+
+	while (size) {
+		size_t space = writer->info.block_size - writer->cur.size;
+		size_t copy  = size < space ? size : space;
+
+		if (!writer->cur.data && !get_free_block(writer))
+			return AVERROR(ENOMEM);
+
+		memcpy(writer->cur.data + writer->cur.size, buf, copy);
+		writer->cur.size += copy;
+		buf              += copy;
+		size             -= copy;
+
+		if (writer->cur.size == writer->info.block_size)
+			enqueue_block(writer);
+	}
+
+	/* when data comes in slowly, don't let it sit in a partial block for
+	 * longer than the sync interval */
+	if (writer->info.sync_interval_ns &&
+	    os_gettime_ns() - writer->last_enqueue >=
+	    writer->info.sync_interval_ns)
+		enqueue_block(writer);
+
+	writer->pos += buf_size;
+	if (writer->pos > writer->size)
+		writer->size = writer->pos;
+
+	return buf_size;
+}
+
+static int64_t writer_seek(void *opaque, int64_t offset, int whence)
+{
+	struct ffmpeg_writer *writer = opaque;
+	int64_t pos;
+
+	whence &= ~AVSEEK_FORCE;
+
+	switch (whence) {
+	case AVSEEK_SIZE: return writer->size;
+	case SEEK_SET:    pos = offset; break;
+	case SEEK_CUR:    pos = writer->pos + offset; break;
+	case SEEK_END:    pos = writer->size + offset; break;
+	default:          return AVERROR(EINVAL);
+	}
+
+	if (pos == writer->pos)
+		return pos;
+
+	/* muxers only seek to patch up headers, so just drain everything
+	 * and move the file pointer */
+	enqueue_block(writer);
+	wait_for_pending(writer);
+
+	if (writer->error)
+		return AVERROR(EIO);
+
+	disable_direct(writer);
+	if (!seek_file(writer, pos))
+		return AVERROR(EIO);
+
+	writer->pos = pos;
+	return pos;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void free_blocks(struct ffmpeg_writer *writer)
+{
+	while (writer->pending.size) {
+		struct writer_block block;
+		circlebuf_pop_front(&writer->pending, &block, sizeof(block));
+		free_block_data(writer, block.data);
+	}
+
+	for (size_t i = 0; i < writer->free_blocks.num; i++)
+		free_block_data(writer, writer->free_blocks.array[i].data);
+
+	if (writer->cur.data)
+		free_block_data(writer, writer->cur.data);
+
+	circlebuf_free(&writer->pending);
+	da_free(writer->free_blocks);
+}
+
+static void writer_free(struct ffmpeg_writer *writer)
+{
+	free_blocks(writer);
+	close_file(writer);
+
+	if (writer->avio) {
+		av_freep(&writer->avio->buffer);
+		av_free(writer->avio);
+	}
+
+	os_event_destroy(writer->written_event);
+	os_sem_destroy(writer->write_sem);
+	pthread_mutex_destroy(&writer->mutex);
+	bfree(writer);
+}
+
+struct ffmpeg_writer *ffmpeg_writer_create(const char *path,
+		const struct ffmpeg_writer_info *info)
+{
+	struct ffmpeg_writer *writer = bzalloc(sizeof(struct ffmpeg_writer));
+	uint8_t *avio_buffer;
+
+	pthread_mutex_init_value(&writer->mutex);
+#ifndef _WIN32
+	writer->fd = -1;
+#endif
+
+	writer->info = *info;
+#ifdef HAVE_DIRECT_IO
+	writer->direct = info->direct;
+#endif
+
+	/* direct writes need block sizes that are a multiple of the
+	 * alignment */
+	if (writer->info.block_size < DIRECT_ALIGN)
+		writer->info.block_size = DIRECT_ALIGN;
+	writer->info.block_size = (writer->info.block_size +
+		DIRECT_ALIGN - 1) & ~(size_t)(DIRECT_ALIGN - 1);
+	if (writer->info.max_pending < writer->info.block_size)
+		writer->info.max_pending = writer->info.block_size;
+
+	writer->aligned_blocks = writer->direct;
+	writer->last_enqueue   = os_gettime_ns();
+	writer->last_sync      = writer->last_enqueue;
+
+	if (pthread_mutex_init(&writer->mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&writer->write_sem, 0) != 0)
+		goto fail;
+	if (os_event_init(&writer->written_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
+	if (!open_file(writer, path)) {
+		blog(LOG_WARNING, "ffmpeg writer: couldn't open file '%s'",
+				path);
+		goto fail;
+	}
+
+	avio_buffer = av_malloc(AVIO_BUFFER_SIZE);
+	if (!avio_buffer)
+		goto fail;
+
+	writer->avio = avio_alloc_context(avio_buffer, AVIO_BUFFER_SIZE, 1,
+			writer, NULL, writer_write_packet, writer_seek);
+	if (!writer->avio) {
+		av_free(avio_buffer);
+		goto fail;
+	}
+
+	if (pthread_create(&writer->thread, NULL, write_thread, writer) != 0)
+		goto fail;
+
+	writer->thread_active = true;
+	return writer;
+
+fail:
+	writer_free(writer);
+	return NULL;
+}
+
+bool ffmpeg_writer_destroy(struct ffmpeg_writer *writer)
+{
+	bool success;
+
+	if (!writer)
+		return false;
+
+	avio_flush(writer->avio);
+	enqueue_block(writer);
+
+	if (writer->thread_active) {
+		writer->stop = true;
+		os_sem_post(writer->write_sem);
+		pthread_join(writer->thread, NULL);
+	}
+
+	release_file_space(writer);
+
+	success = !writer->error;
+	writer_free(writer);
+	return success;
+}
+
+AVIOContext *ffmpeg_writer_avio(struct ffmpeg_writer *writer)
+{
+	return writer ? writer->avio : NULL;
+}
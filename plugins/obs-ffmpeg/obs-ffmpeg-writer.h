@@ -0,0 +1,57 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <libavformat/avio.h>
+
+/* Write-behind file writer for libavformat.  Muxed data is gathered into
+ * large blocks that are written to disk on a separate thread, so the muxer
+ * only waits on the disk once more than max_pending bytes are outstanding.
+ * Where supported, blocks can be written with O_DIRECT to keep recordings
+ * out of the page cache. */
+
+/* with a sync interval, a partly filled block is also handed to the write
+ * thread once the interval has passed since the last block, and the write
+ * thread flushes the file to the disk at most once per interval, which bounds
+ * how much of a recording a crash or power loss can take with it.  partial
+ * blocks can't be written with O_DIRECT, so the first one turns direct writes
+ * off. */
+
+/* with a preallocation size, disk space is reserved that far ahead of the
+ * write position, so that a long recording grows in a few large extents
+ * instead of one allocation per block.  the file size isn't changed by it,
+ * and unused space is released when the file is closed. */
+
+struct ffmpeg_writer_info {
+	size_t   block_size;
+	size_t   max_pending;
+	bool     direct;
+	uint64_t sync_interval_ns;
+	uint64_t prealloc_size;
+};
+
+struct ffmpeg_writer;
+
+extern struct ffmpeg_writer *ffmpeg_writer_create(const char *path,
+		const struct ffmpeg_writer_info *info);
+
+/* flushes all pending data, closes the file, and frees the writer.  returns
+ * false if any write failed. */
+extern bool ffmpeg_writer_destroy(struct ffmpeg_writer *writer);
+
+extern AVIOContext *ffmpeg_writer_avio(struct ffmpeg_writer *writer);
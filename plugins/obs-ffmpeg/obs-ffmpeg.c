@@ -1,15 +1,63 @@
 #include <obs-module.h>
+#include <util/threading.h>
+#include <libavformat/avformat.h>
 
 OBS_DECLARE_MODULE()
 
 extern struct obs_output_info  ffmpeg_output;
 extern struct obs_encoder_info aac_encoder_info;
+extern struct obs_encoder_info opus_encoder_info;
+extern struct obs_source_info  ffmpeg_source;
+
+extern void register_ffmpeg_hw_encoders(void);
+
+/* codecs can be opened on several threads at the same time, for example when
+ * media sources are created while loading a scene collection */
+static int ffmpeg_lock(void **mutex, enum AVLockOp op)
+{
+	switch (op) {
+	case AV_LOCK_CREATE:
+		*mutex = bmalloc(sizeof(pthread_mutex_t));
+		if (pthread_mutex_init(*mutex, NULL) != 0) {
+			bfree(*mutex);
+			*mutex = NULL;
+			return 1;
+		}
+		return 0;
+
+	case AV_LOCK_OBTAIN:
+		return pthread_mutex_lock(*mutex) != 0;
+
+	case AV_LOCK_RELEASE:
+		return pthread_mutex_unlock(*mutex) != 0;
+
+	case AV_LOCK_DESTROY:
+		pthread_mutex_destroy(*mutex);
+		bfree(*mutex);
+		*mutex = NULL;
+		return 0;
+	}
+
+	return 1;
+}
 
 bool obs_module_load(uint32_t obs_version)
 {
+	av_lockmgr_register(ffmpeg_lock);
+	av_register_all();
+	avformat_network_init();
+
 	obs_register_output(&ffmpeg_output);
 	obs_register_encoder(&aac_encoder_info);
+	obs_register_encoder(&opus_encoder_info);
+	obs_register_source(&ffmpeg_source);
+	register_ffmpeg_hw_encoders();
 
 	UNUSED_PARAMETER(obs_version);
 	return true;
 }
+
+void obs_module_unload(void)
+{
+	av_lockmgr_register(NULL);
+}
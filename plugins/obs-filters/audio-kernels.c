@@ -0,0 +1,210 @@
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include "audio-kernels.h"
+
+bool audio_filter_format_get(struct audio_filter_format *format)
+{
+	const struct audio_output_info *info =
+		audio_output_getinfo(obs_audio());
+
+	if (!info)
+		return false;
+
+	format->channels    = get_audio_channels(info->speakers);
+	format->sample_rate = info->samples_per_sec;
+	format->planar      = info->format == AUDIO_FORMAT_FLOAT_PLANAR;
+
+	if (info->format != AUDIO_FORMAT_FLOAT &&
+	    info->format != AUDIO_FORMAT_FLOAT_PLANAR) {
+		blog(LOG_WARNING, "obs-filters: Audio filters only support "
+		                  "float audio, audio will pass through");
+		return false;
+	}
+
+	return format->channels > 0 && format->sample_rate > 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void peak_planar(float *peak, float *const *planes, size_t channels,
+		size_t frames)
+{
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		__m128 max4 = _mm_setzero_ps();
+
+		for (size_t ch = 0; ch < channels; ch++) {
+			__m128 v = _mm_loadu_ps(planes[ch] + i);
+			max4 = _mm_max_ps(max4, _mm_and_ps(v, abs_mask));
+		}
+
+		_mm_storeu_ps(peak + i, max4);
+	}
+
+	for (; i < frames; i++) {
+		float max = 0.0f;
+
+		for (size_t ch = 0; ch < channels; ch++) {
+			float v = fabsf(planes[ch][i]);
+			if (v > max) max = v;
+		}
+
+		peak[i] = max;
+	}
+}
+
+/* four stereo frames at a time: the maximum of each pair of samples is
+ * taken by swapping the samples of each frame, then the results of two
+ * vectors are packed in to one */
+static void peak_stereo(float *peak, const float *data, size_t frames)
+{
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		__m128 a = _mm_and_ps(_mm_loadu_ps(data + i*2),     abs_mask);
+		__m128 b = _mm_and_ps(_mm_loadu_ps(data + i*2 + 4), abs_mask);
+
+		a = _mm_max_ps(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(2,3,0,1)));
+		b = _mm_max_ps(b, _mm_shuffle_ps(b, b, _MM_SHUFFLE(2,3,0,1)));
+
+		_mm_storeu_ps(peak + i,
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)));
+	}
+
+	for (; i < frames; i++) {
+		float l = fabsf(data[i*2]);
+		float r = fabsf(data[i*2 + 1]);
+		peak[i] = l > r ? l : r;
+	}
+}
+
+static void peak_interleaved(float *peak, const float *data,
+		size_t channels, size_t frames)
+{
+	for (size_t i = 0; i < frames; i++) {
+		float max = 0.0f;
+
+		for (size_t ch = 0; ch < channels; ch++) {
+			float v = fabsf(data[i*channels + ch]);
+			if (v > max) max = v;
+		}
+
+		peak[i] = max;
+	}
+}
+
+void audio_peak(float *peak, const struct filtered_audio *audio,
+		const struct audio_filter_format *format)
+{
+	const float *data = (const float*)audio->data[0];
+
+	if (format->planar)
+		peak_planar(peak, (float *const *)audio->data,
+				format->channels, audio->frames);
+	else if (format->channels == 2)
+		peak_stereo(peak, data, audio->frames);
+	else
+		peak_interleaved(peak, data, format->channels, audio->frames);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void gain_planar(float **planes, size_t channels, const float *gain,
+		size_t frames)
+{
+	for (size_t ch = 0; ch < channels; ch++) {
+		float  *plane = planes[ch];
+		size_t i      = 0;
+
+		for (; i + 4 <= frames; i += 4) {
+			__m128 v = _mm_loadu_ps(plane + i);
+			_mm_storeu_ps(plane + i,
+					_mm_mul_ps(v, _mm_loadu_ps(gain + i)));
+		}
+
+		for (; i < frames; i++)
+			plane[i] *= gain[i];
+	}
+}
+
+/* the gains of four frames are duplicated for the two samples of each */
+static void gain_stereo(float *data, const float *gain, size_t frames)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		__m128 g  = _mm_loadu_ps(gain + i);
+		__m128 lo = _mm_unpacklo_ps(g, g);
+		__m128 hi = _mm_unpackhi_ps(g, g);
+
+		_mm_storeu_ps(data + i*2,
+				_mm_mul_ps(_mm_loadu_ps(data + i*2), lo));
+		_mm_storeu_ps(data + i*2 + 4,
+				_mm_mul_ps(_mm_loadu_ps(data + i*2 + 4), hi));
+	}
+
+	for (; i < frames; i++) {
+		data[i*2]     *= gain[i];
+		data[i*2 + 1] *= gain[i];
+	}
+}
+
+static void gain_interleaved(float *data, size_t channels, const float *gain,
+		size_t frames)
+{
+	for (size_t i = 0; i < frames; i++)
+		for (size_t ch = 0; ch < channels; ch++)
+			data[i*channels + ch] *= gain[i];
+}
+
+void audio_apply_gain(struct filtered_audio *audio,
+		const struct audio_filter_format *format, const float *gain)
+{
+	float *data = (float*)audio->data[0];
+
+	if (format->planar)
+		gain_planar((float**)audio->data, format->channels, gain,
+				audio->frames);
+	else if (format->channels == 2)
+		gain_stereo(data, gain, audio->frames);
+	else
+		gain_interleaved(data, format->channels, gain, audio->frames);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void audio_spectrum_power(float *power, const float *re,
+		const float *im, size_t bins)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= bins; i += 4) {
+		__m128 r = _mm_loadu_ps(re + i);
+		__m128 m = _mm_loadu_ps(im + i);
+		_mm_storeu_ps(power + i,
+				_mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m)));
+	}
+
+	for (; i < bins; i++)
+		power[i] = re[i] * re[i] + im[i] * im[i];
+}
+
+void audio_spectrum_mul(float *re, float *im, const float *gain,
+		size_t bins)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= bins; i += 4) {
+		__m128 g = _mm_loadu_ps(gain + i);
+		_mm_storeu_ps(re + i, _mm_mul_ps(_mm_loadu_ps(re + i), g));
+		_mm_storeu_ps(im + i, _mm_mul_ps(_mm_loadu_ps(im + i), g));
+	}
+
+	for (; i < bins; i++) {
+		re[i] *= gain[i];
+		im[i] *= gain[i];
+	}
+}
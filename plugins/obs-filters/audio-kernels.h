@@ -0,0 +1,62 @@
+#pragma once
+
+#include <obs-module.h>
+#include <util/darray.h>
+#include <math.h>
+
+/*
+ * Shared by the audio filters, which all process the float audio of the
+ * source in place.  Channels are linked: one gain is computed per frame
+ * from the loudest channel and applied to all of them, which keeps the
+ * stereo image from shifting.
+ */
+
+struct audio_filter_format {
+	size_t   channels;
+	uint32_t sample_rate;
+	bool     planar;
+};
+
+/* returns false if the audio isn't float, in which case the filter passes
+ * its audio through */
+extern bool audio_filter_format_get(struct audio_filter_format *format);
+
+/* ensures the scratch buffer can hold @frames values without shrinking it,
+ * so it stops growing once it's seen the largest packet */
+static inline float *audio_filter_scratch(struct darray *scratch,
+		size_t frames)
+{
+	if (scratch->num < frames)
+		darray_resize(sizeof(float), scratch, frames);
+	return scratch->array;
+}
+
+/* the coefficient of a one pole smoother that takes @ms to get most of the
+ * way to a new value */
+static inline float audio_time_coef(uint32_t sample_rate, float ms)
+{
+	if (ms <= 0.0f)
+		return 0.0f;
+	return expf(-1000.0f / (ms * (float)sample_rate));
+}
+
+static inline float db_to_mul(float db)
+{
+	return powf(10.0f, db / 20.0f);
+}
+
+/* writes the absolute peak of each frame (across its channels) to @peak */
+extern void audio_peak(float *peak, const struct filtered_audio *audio,
+		const struct audio_filter_format *format);
+
+/* multiplies every channel of each frame by the frame's gain */
+extern void audio_apply_gain(struct filtered_audio *audio,
+		const struct audio_filter_format *format, const float *gain);
+
+/* writes the power (squared magnitude) of each bin to @power */
+extern void audio_spectrum_power(float *power, const float *re,
+		const float *im, size_t bins);
+
+/* multiplies the real and imaginary parts of each bin by its gain */
+extern void audio_spectrum_mul(float *re, float *im, const float *gain,
+		size_t bins);
@@ -0,0 +1,184 @@
+#include <graphics/vec2.h>
+#include <graphics/vec4.h>
+#include "pointwise-filter.h"
+
+/* keys on the distance from the key color in CbCr, which ignores how bright
+ * the background is lit.  what's left of the key color around the edges is
+ * desaturated to remove the spill */
+static const char *chroma_key_code =
+"uniform float2 $key_cbcr;\n"
+"uniform float  $similarity = 0.4;\n"
+"uniform float  $smoothness = 0.08;\n"
+"uniform float  $spill      = 0.1;\n"
+"uniform float  $opacity    = 1.0;\n"
+"\n"
+"float4 $process(float4 rgba)\n"
+"{\n"
+"	float2 cbcr = float2(\n"
+"		dot(rgba.rgb, float3(-0.1146, -0.3854,  0.5000)),\n"
+"		dot(rgba.rgb, float3( 0.5000, -0.4542, -0.0458)));\n"
+"	float  dist = distance(cbcr, $key_cbcr);\n"
+"	float  mask = saturate((dist - $similarity) / $smoothness);\n"
+"	float  keep = pow(saturate((dist - $similarity) / $spill), 1.5);\n"
+"	float  luma = dot(rgba.rgb, float3(0.2126, 0.7152, 0.0722));\n"
+"\n"
+"	rgba.rgb = lerp(float3(luma, luma, luma), rgba.rgb, keep);\n"
+"	rgba.a  *= mask * $opacity;\n"
+"	return rgba;\n"
+"}\n";
+
+struct chroma_key {
+	struct pointwise_filter pf;
+
+	struct vec2             key_cbcr;
+	float                   similarity;
+	float                   smoothness;
+	float                   spill;
+	float                   opacity;
+};
+
+static const char *chroma_key_getname(const char *locale)
+{
+	/* TODO: translate */
+	UNUSED_PARAMETER(locale);
+	return "Chroma Key";
+}
+
+static uint32_t key_color(obs_data_t settings)
+{
+	const char *type = obs_data_getstring(settings, "key_color_type");
+
+	if (strcmp(type, "blue") == 0)
+		return 0xFFFF0000;
+	else if (strcmp(type, "magenta") == 0)
+		return 0xFFFF00FF;
+	else if (strcmp(type, "custom") == 0)
+		return (uint32_t)obs_data_getint(settings, "key_color");
+
+	return 0xFF00FF00;
+}
+
+/* the settings are from 1 to 1000, like the other keyers out there */
+static inline float key_setting(obs_data_t settings, const char *name)
+{
+	float val = (float)obs_data_getint(settings, name) * 0.001f;
+	return (val < 0.001f) ? 0.001f : val;
+}
+
+static void chroma_key_update(void *data, obs_data_t settings)
+{
+	struct chroma_key *ck = data;
+	struct vec4 color;
+
+	vec4_from_rgba(&color, key_color(settings));
+	vec2_set(&ck->key_cbcr,
+			-0.1146f * color.x - 0.3854f * color.y + 0.5000f * color.z,
+			 0.5000f * color.x - 0.4542f * color.y - 0.0458f * color.z);
+
+	ck->similarity = key_setting(settings, "similarity");
+	ck->smoothness = key_setting(settings, "smoothness");
+	ck->spill      = key_setting(settings, "spill");
+	ck->opacity    = (float)obs_data_getint(settings, "opacity") * 0.01f;
+}
+
+static void chroma_key_defaults(obs_data_t settings)
+{
+	obs_data_set_default_string(settings, "key_color_type", "green");
+	obs_data_set_default_int(settings, "key_color", 0xFF00FF00);
+	obs_data_set_default_int(settings, "similarity", 400);
+	obs_data_set_default_int(settings, "smoothness", 80);
+	obs_data_set_default_int(settings, "spill", 100);
+	obs_data_set_default_int(settings, "opacity", 100);
+}
+
+static obs_properties_t chroma_key_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+	obs_property_t   p;
+
+	/* TODO: locale */
+	p = obs_properties_add_list(props, "key_color_type", "Key Color Type",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(p, "Green", "green");
+	obs_property_list_add_string(p, "Blue", "blue");
+	obs_property_list_add_string(p, "Magenta", "magenta");
+	obs_property_list_add_string(p, "Custom", "custom");
+
+	obs_properties_add_color(props, "key_color", "Key Color");
+	obs_properties_add_int(props, "similarity", "Similarity", 1, 1000, 1);
+	obs_properties_add_int(props, "smoothness", "Smoothness", 1, 1000, 1);
+	obs_properties_add_int(props, "spill", "Key Color Spill Reduction",
+			1, 1000, 1);
+	obs_properties_add_int(props, "opacity", "Opacity", 0, 100, 1);
+
+	return props;
+}
+
+static void chroma_key_destroy(void *data)
+{
+	struct chroma_key *ck = data;
+
+	pointwise_filter_free(&ck->pf);
+	bfree(ck);
+}
+
+static void *chroma_key_create(obs_data_t settings, obs_source_t source)
+{
+	struct chroma_key *ck = bzalloc(sizeof(struct chroma_key));
+
+	if (!pointwise_filter_init(&ck->pf, source, chroma_key_code,
+				"chroma key")) {
+		chroma_key_destroy(ck);
+		return NULL;
+	}
+
+	chroma_key_update(ck, settings);
+	return ck;
+}
+
+static void chroma_key_params(void *data, effect_t effect, const char *prefix)
+{
+	struct chroma_key *ck = data;
+
+	effect_setvec2(effect, pointwise_param(effect, prefix, "key_cbcr"),
+			&ck->key_cbcr);
+	effect_setfloat(effect, pointwise_param(effect, prefix, "similarity"),
+			ck->similarity);
+	effect_setfloat(effect, pointwise_param(effect, prefix, "smoothness"),
+			ck->smoothness);
+	effect_setfloat(effect, pointwise_param(effect, prefix, "spill"),
+			ck->spill);
+	effect_setfloat(effect, pointwise_param(effect, prefix, "opacity"),
+			ck->opacity);
+}
+
+static const char *chroma_key_shader(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return chroma_key_code;
+}
+
+static void chroma_key_render(void *data, effect_t effect)
+{
+	struct chroma_key *ck = data;
+
+	chroma_key_params(ck, ck->pf.effect, "");
+	pointwise_filter_render(&ck->pf);
+
+	UNUSED_PARAMETER(effect);
+}
+
+struct obs_source_info chroma_key_filter = {
+	.id                      = "chroma_key_filter",
+	.type                    = OBS_SOURCE_TYPE_FILTER,
+	.output_flags            = OBS_SOURCE_VIDEO,
+	.getname                 = chroma_key_getname,
+	.create                  = chroma_key_create,
+	.destroy                 = chroma_key_destroy,
+	.update                  = chroma_key_update,
+	.defaults                = chroma_key_defaults,
+	.properties              = chroma_key_properties,
+	.video_render            = chroma_key_render,
+	.filter_pointwise_shader = chroma_key_shader,
+	.filter_pointwise_params = chroma_key_params
+};
@@ -0,0 +1,191 @@
+#include <graphics/matrix4.h>
+#include <graphics/math-defs.h>
+#include "pointwise-filter.h"
+
+/* hue, saturation, contrast and brightness are all linear in RGB, so they're
+ * combined in to one matrix on the CPU, and only gamma is left to the
+ * shader */
+static const char *color_correction_code =
+"uniform float4x4 $color_matrix;\n"
+"uniform float    $gamma   = 1.0;\n"
+"uniform float    $opacity = 1.0;\n"
+"\n"
+"float4 $process(float4 rgba)\n"
+"{\n"
+"	float3 rgb = pow(max(rgba.rgb, 0.0),\n"
+"			float3($gamma, $gamma, $gamma));\n"
+"	rgba.rgb = saturate(mul(float4(rgb, 1.0), $color_matrix).rgb);\n"
+"	rgba.a  *= $opacity;\n"
+"	return rgba;\n"
+"}\n";
+
+struct color_correction {
+	struct pointwise_filter pf;
+
+	struct matrix4          color_matrix;
+	float                   gamma;
+	float                   opacity;
+};
+
+static const char *color_correction_getname(const char *locale)
+{
+	/* TODO: translate */
+	UNUSED_PARAMETER(locale);
+	return "Color Correction";
+}
+
+/* rotation around the gray axis, rows are the input channels */
+static void hue_matrix(struct matrix4 *dst, float degrees)
+{
+	float c   = cosf(RAD(degrees));
+	float s   = sinf(RAD(degrees)) / sqrtf(3.0f);
+	float d   = (1.0f - c) / 3.0f;
+
+	matrix4_identity(dst);
+	vec4_set(&dst->x, c + d, d + s, d - s, 0.0f);
+	vec4_set(&dst->y, d - s, c + d, d + s, 0.0f);
+	vec4_set(&dst->z, d + s, d - s, c + d, 0.0f);
+}
+
+static void saturation_matrix(struct matrix4 *dst, float saturation)
+{
+	float r = 0.2126f * (1.0f - saturation);
+	float g = 0.7152f * (1.0f - saturation);
+	float b = 0.0722f * (1.0f - saturation);
+
+	matrix4_identity(dst);
+	vec4_set(&dst->x, r + saturation, r, r, 0.0f);
+	vec4_set(&dst->y, g, g + saturation, g, 0.0f);
+	vec4_set(&dst->z, b, b, b + saturation, 0.0f);
+}
+
+/* scales around mid gray, then offsets */
+static void contrast_brightness_matrix(struct matrix4 *dst, float contrast,
+		float brightness)
+{
+	float offset = 0.5f * (1.0f - contrast) + brightness;
+
+	matrix4_identity(dst);
+	vec4_set(&dst->x, contrast, 0.0f, 0.0f, 0.0f);
+	vec4_set(&dst->y, 0.0f, contrast, 0.0f, 0.0f);
+	vec4_set(&dst->z, 0.0f, 0.0f, contrast, 0.0f);
+	vec4_set(&dst->t, offset, offset, offset, 1.0f);
+}
+
+static void color_correction_update(void *data, obs_data_t settings)
+{
+	struct color_correction *cc = data;
+	float gamma      = (float)obs_data_getdouble(settings, "gamma");
+	float contrast   = (float)obs_data_getdouble(settings, "contrast");
+	float brightness = (float)obs_data_getdouble(settings, "brightness");
+	float saturation = (float)obs_data_getdouble(settings, "saturation");
+	float hue_shift  = (float)obs_data_getdouble(settings, "hue_shift");
+	struct matrix4 hue, sat, cb, tmp;
+
+	hue_matrix(&hue, hue_shift);
+	saturation_matrix(&sat, saturation);
+	contrast_brightness_matrix(&cb, contrast + 1.0f, brightness);
+
+	/* row vectors, so the first one is applied first */
+	matrix4_mul(&tmp, &hue, &sat);
+	matrix4_mul(&cc->color_matrix, &tmp, &cb);
+
+	/* positive gamma values brighten, like most editors */
+	cc->gamma   = (gamma < 0.0f) ? (1.0f - gamma) : 1.0f / (1.0f + gamma);
+	cc->opacity = (float)obs_data_getint(settings, "opacity") * 0.01f;
+}
+
+static void color_correction_defaults(obs_data_t settings)
+{
+	obs_data_set_default_double(settings, "gamma",      0.0);
+	obs_data_set_default_double(settings, "contrast",   0.0);
+	obs_data_set_default_double(settings, "brightness", 0.0);
+	obs_data_set_default_double(settings, "saturation", 1.0);
+	obs_data_set_default_double(settings, "hue_shift",  0.0);
+	obs_data_set_default_int(settings, "opacity", 100);
+}
+
+static obs_properties_t color_correction_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_float(props, "gamma", "Gamma", -3.0, 3.0, 0.01);
+	obs_properties_add_float(props, "contrast", "Contrast",
+			-1.0, 1.0, 0.01);
+	obs_properties_add_float(props, "brightness", "Brightness",
+			-1.0, 1.0, 0.01);
+	obs_properties_add_float(props, "saturation", "Saturation",
+			0.0, 3.0, 0.01);
+	obs_properties_add_float(props, "hue_shift", "Hue Shift",
+			-180.0, 180.0, 1.0);
+	obs_properties_add_int(props, "opacity", "Opacity", 0, 100, 1);
+
+	return props;
+}
+
+static void color_correction_destroy(void *data)
+{
+	struct color_correction *cc = data;
+
+	pointwise_filter_free(&cc->pf);
+	bfree(cc);
+}
+
+static void *color_correction_create(obs_data_t settings, obs_source_t source)
+{
+	struct color_correction *cc = bzalloc(sizeof(struct color_correction));
+
+	if (!pointwise_filter_init(&cc->pf, source, color_correction_code,
+				"color correction")) {
+		color_correction_destroy(cc);
+		return NULL;
+	}
+
+	color_correction_update(cc, settings);
+	return cc;
+}
+
+static void color_correction_params(void *data, effect_t effect,
+		const char *prefix)
+{
+	struct color_correction *cc = data;
+
+	effect_setmatrix4(effect, pointwise_param(effect, prefix,
+				"color_matrix"), &cc->color_matrix);
+	effect_setfloat(effect, pointwise_param(effect, prefix, "gamma"),
+			cc->gamma);
+	effect_setfloat(effect, pointwise_param(effect, prefix, "opacity"),
+			cc->opacity);
+}
+
+static const char *color_correction_shader(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return color_correction_code;
+}
+
+static void color_correction_render(void *data, effect_t effect)
+{
+	struct color_correction *cc = data;
+
+	color_correction_params(cc, cc->pf.effect, "");
+	pointwise_filter_render(&cc->pf);
+
+	UNUSED_PARAMETER(effect);
+}
+
+struct obs_source_info color_correction_filter = {
+	.id                      = "color_correction_filter",
+	.type                    = OBS_SOURCE_TYPE_FILTER,
+	.output_flags            = OBS_SOURCE_VIDEO,
+	.getname                 = color_correction_getname,
+	.create                  = color_correction_create,
+	.destroy                 = color_correction_destroy,
+	.update                  = color_correction_update,
+	.defaults                = color_correction_defaults,
+	.properties              = color_correction_properties,
+	.video_render            = color_correction_render,
+	.filter_pointwise_shader = color_correction_shader,
+	.filter_pointwise_params = color_correction_params
+};
@@ -0,0 +1,139 @@
+#include <graphics/vec4.h>
+#include "pointwise-filter.h"
+
+/* keys on the distance from the key color in RGB, for solid backgrounds
+ * that aren't green or blue, or keying out a black or white matte */
+static const char *color_key_code =
+"uniform float4 $key_rgb;\n"
+"uniform float  $similarity = 0.08;\n"
+"uniform float  $smoothness = 0.05;\n"
+"uniform float  $opacity    = 1.0;\n"
+"\n"
+"float4 $process(float4 rgba)\n"
+"{\n"
+"	float dist = distance(rgba.rgb, $key_rgb.rgb);\n"
+"	rgba.a *= saturate((dist - $similarity) / $smoothness) * $opacity;\n"
+"	return rgba;\n"
+"}\n";
+
+struct color_key {
+	struct pointwise_filter pf;
+
+	struct vec4             key_rgb;
+	float                   similarity;
+	float                   smoothness;
+	float                   opacity;
+};
+
+static const char *color_key_getname(const char *locale)
+{
+	/* TODO: translate */
+	UNUSED_PARAMETER(locale);
+	return "Color Key";
+}
+
+static inline float key_setting(obs_data_t settings, const char *name)
+{
+	float val = (float)obs_data_getint(settings, name) * 0.001f;
+	return (val < 0.001f) ? 0.001f : val;
+}
+
+static void color_key_update(void *data, obs_data_t settings)
+{
+	struct color_key *ck = data;
+
+	vec4_from_rgba(&ck->key_rgb,
+			(uint32_t)obs_data_getint(settings, "key_color"));
+
+	ck->similarity = key_setting(settings, "similarity");
+	ck->smoothness = key_setting(settings, "smoothness");
+	ck->opacity    = (float)obs_data_getint(settings, "opacity") * 0.01f;
+}
+
+static void color_key_defaults(obs_data_t settings)
+{
+	obs_data_set_default_int(settings, "key_color", 0xFF00FF00);
+	obs_data_set_default_int(settings, "similarity", 80);
+	obs_data_set_default_int(settings, "smoothness", 50);
+	obs_data_set_default_int(settings, "opacity", 100);
+}
+
+static obs_properties_t color_key_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_color(props, "key_color", "Key Color");
+	obs_properties_add_int(props, "similarity", "Similarity", 1, 1000, 1);
+	obs_properties_add_int(props, "smoothness", "Smoothness", 1, 1000, 1);
+	obs_properties_add_int(props, "opacity", "Opacity", 0, 100, 1);
+
+	return props;
+}
+
+static void color_key_destroy(void *data)
+{
+	struct color_key *ck = data;
+
+	pointwise_filter_free(&ck->pf);
+	bfree(ck);
+}
+
+static void *color_key_create(obs_data_t settings, obs_source_t source)
+{
+	struct color_key *ck = bzalloc(sizeof(struct color_key));
+
+	if (!pointwise_filter_init(&ck->pf, source, color_key_code,
+				"color key")) {
+		color_key_destroy(ck);
+		return NULL;
+	}
+
+	color_key_update(ck, settings);
+	return ck;
+}
+
+static void color_key_params(void *data, effect_t effect, const char *prefix)
+{
+	struct color_key *ck = data;
+
+	effect_setvec4(effect, pointwise_param(effect, prefix, "key_rgb"),
+			&ck->key_rgb);
+	effect_setfloat(effect, pointwise_param(effect, prefix, "similarity"),
+			ck->similarity);
+	effect_setfloat(effect, pointwise_param(effect, prefix, "smoothness"),
+			ck->smoothness);
+	effect_setfloat(effect, pointwise_param(effect, prefix, "opacity"),
+			ck->opacity);
+}
+
+static const char *color_key_shader(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return color_key_code;
+}
+
+static void color_key_render(void *data, effect_t effect)
+{
+	struct color_key *ck = data;
+
+	color_key_params(ck, ck->pf.effect, "");
+	pointwise_filter_render(&ck->pf);
+
+	UNUSED_PARAMETER(effect);
+}
+
+struct obs_source_info color_key_filter = {
+	.id                      = "color_key_filter",
+	.type                    = OBS_SOURCE_TYPE_FILTER,
+	.output_flags            = OBS_SOURCE_VIDEO,
+	.getname                 = color_key_getname,
+	.create                  = color_key_create,
+	.destroy                 = color_key_destroy,
+	.update                  = color_key_update,
+	.defaults                = color_key_defaults,
+	.properties              = color_key_properties,
+	.video_render            = color_key_render,
+	.filter_pointwise_shader = color_key_shader,
+	.filter_pointwise_params = color_key_params
+};
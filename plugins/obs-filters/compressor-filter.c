@@ -0,0 +1,140 @@
+#include "audio-kernels.h"
+
+/* feed-forward peak compressor without lookahead, the gain is only computed
+ * once per frame for all channels */
+
+struct compressor {
+	obs_source_t               source;
+	struct audio_filter_format format;
+	bool                       supported;
+
+	float                      ratio;
+	float                      threshold;
+	float                      attack_coef;
+	float                      release_coef;
+	float                      output_gain;
+
+	float                      envelope;
+	DARRAY(float)              gain;
+};
+
+static const char *compressor_getname(const char *locale)
+{
+	/* TODO: translate */
+	UNUSED_PARAMETER(locale);
+	return "Compressor";
+}
+
+static void compressor_update(void *data, obs_data_t settings)
+{
+	struct compressor *c = data;
+	uint32_t rate = c->format.sample_rate;
+
+	c->ratio        = (float)obs_data_getdouble(settings, "ratio");
+	c->threshold    = db_to_mul(
+			(float)obs_data_getdouble(settings, "threshold"));
+	c->attack_coef  = audio_time_coef(rate,
+			(float)obs_data_getint(settings, "attack_time"));
+	c->release_coef = audio_time_coef(rate,
+			(float)obs_data_getint(settings, "release_time"));
+	c->output_gain  = db_to_mul(
+			(float)obs_data_getdouble(settings, "output_gain"));
+
+	if (c->ratio < 1.0f)
+		c->ratio = 1.0f;
+}
+
+static void compressor_defaults(obs_data_t settings)
+{
+	obs_data_set_default_double(settings, "ratio", 10.0);
+	obs_data_set_default_double(settings, "threshold", -18.0);
+	obs_data_set_default_int(settings, "attack_time", 6);
+	obs_data_set_default_int(settings, "release_time", 60);
+	obs_data_set_default_double(settings, "output_gain", 0.0);
+}
+
+static obs_properties_t compressor_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_float(props, "ratio", "Ratio (X:1)",
+			1.0, 32.0, 0.5);
+	obs_properties_add_float(props, "threshold", "Threshold (dB)",
+			-60.0, 0.0, 0.1);
+	obs_properties_add_int(props, "attack_time", "Attack (ms)",
+			1, 500, 1);
+	obs_properties_add_int(props, "release_time", "Release (ms)",
+			1, 1000, 1);
+	obs_properties_add_float(props, "output_gain", "Output Gain (dB)",
+			-32.0, 32.0, 0.1);
+
+	return props;
+}
+
+static void compressor_destroy(void *data)
+{
+	struct compressor *c = data;
+
+	da_free(c->gain);
+	bfree(c);
+}
+
+static void *compressor_create(obs_data_t settings, obs_source_t source)
+{
+	struct compressor *c = bzalloc(sizeof(struct compressor));
+
+	c->source    = source;
+	c->supported = audio_filter_format_get(&c->format);
+
+	compressor_update(c, settings);
+	return c;
+}
+
+static struct filtered_audio *compressor_filter_audio(void *data,
+		struct filtered_audio *audio)
+{
+	struct compressor *c = data;
+	float  *gain;
+	float  envelope     = c->envelope;
+	float  threshold    = c->threshold;
+	float  exponent     = 1.0f / c->ratio - 1.0f;
+	float  attack_coef  = c->attack_coef;
+	float  release_coef = c->release_coef;
+
+	if (!c->supported || !audio->frames)
+		return audio;
+
+	gain = audio_filter_scratch(&c->gain.da, audio->frames);
+	audio_peak(gain, audio, &c->format);
+
+	/* the gain is written over the peak of the same frame */
+	for (uint32_t i = 0; i < audio->frames; i++) {
+		float peak = gain[i];
+		float coef = peak > envelope ? attack_coef : release_coef;
+
+		envelope = peak + coef * (envelope - peak);
+
+		gain[i] = envelope > threshold ?
+			powf(envelope / threshold, exponent) * c->output_gain :
+			c->output_gain;
+	}
+
+	c->envelope = envelope;
+
+	audio_apply_gain(audio, &c->format, gain);
+	return audio;
+}
+
+struct obs_source_info compressor_filter = {
+	.id           = "compressor_filter",
+	.type         = OBS_SOURCE_TYPE_FILTER,
+	.output_flags = OBS_SOURCE_AUDIO,
+	.getname      = compressor_getname,
+	.create       = compressor_create,
+	.destroy      = compressor_destroy,
+	.update       = compressor_update,
+	.defaults     = compressor_defaults,
+	.properties   = compressor_properties,
+	.filter_audio = compressor_filter_audio
+};
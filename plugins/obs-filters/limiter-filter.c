@@ -0,0 +1,114 @@
+#include "audio-kernels.h"
+
+/* the envelope jumps to any peak above it, so no frame goes past the
+ * threshold without having to delay the audio for a lookahead */
+
+struct limiter {
+	obs_source_t               source;
+	struct audio_filter_format format;
+	bool                       supported;
+
+	float                      threshold;
+	float                      release_coef;
+
+	float                      envelope;
+	DARRAY(float)              gain;
+};
+
+static const char *limiter_getname(const char *locale)
+{
+	/* TODO: translate */
+	UNUSED_PARAMETER(locale);
+	return "Limiter";
+}
+
+static void limiter_update(void *data, obs_data_t settings)
+{
+	struct limiter *l = data;
+
+	l->threshold    = db_to_mul(
+			(float)obs_data_getdouble(settings, "threshold"));
+	l->release_coef = audio_time_coef(l->format.sample_rate,
+			(float)obs_data_getint(settings, "release_time"));
+}
+
+static void limiter_defaults(obs_data_t settings)
+{
+	obs_data_set_default_double(settings, "threshold", -6.0);
+	obs_data_set_default_int(settings, "release_time", 60);
+}
+
+static obs_properties_t limiter_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_float(props, "threshold", "Threshold (dB)",
+			-60.0, 0.0, 0.1);
+	obs_properties_add_int(props, "release_time", "Release (ms)",
+			1, 1000, 1);
+
+	return props;
+}
+
+static void limiter_destroy(void *data)
+{
+	struct limiter *l = data;
+
+	da_free(l->gain);
+	bfree(l);
+}
+
+static void *limiter_create(obs_data_t settings, obs_source_t source)
+{
+	struct limiter *l = bzalloc(sizeof(struct limiter));
+
+	l->source    = source;
+	l->supported = audio_filter_format_get(&l->format);
+
+	limiter_update(l, settings);
+	return l;
+}
+
+static struct filtered_audio *limiter_filter_audio(void *data,
+		struct filtered_audio *audio)
+{
+	struct limiter *l = data;
+	float  *gain;
+	float  envelope     = l->envelope;
+	float  threshold    = l->threshold;
+	float  release_coef = l->release_coef;
+
+	if (!l->supported || !audio->frames)
+		return audio;
+
+	gain = audio_filter_scratch(&l->gain.da, audio->frames);
+	audio_peak(gain, audio, &l->format);
+
+	for (uint32_t i = 0; i < audio->frames; i++) {
+		float peak = gain[i];
+
+		envelope = peak > envelope ?
+			peak : peak + release_coef * (envelope - peak);
+
+		gain[i] = envelope > threshold ? threshold / envelope : 1.0f;
+	}
+
+	l->envelope = envelope;
+
+	audio_apply_gain(audio, &l->format, gain);
+	return audio;
+}
+
+struct obs_source_info limiter_filter = {
+	.id           = "limiter_filter",
+	.type         = OBS_SOURCE_TYPE_FILTER,
+	.output_flags = OBS_SOURCE_AUDIO,
+	.getname      = limiter_getname,
+	.create       = limiter_create,
+	.destroy      = limiter_destroy,
+	.update       = limiter_update,
+	.defaults     = limiter_defaults,
+	.properties   = limiter_properties,
+	.filter_audio = limiter_filter_audio
+};
@@ -0,0 +1,216 @@
+#include <graphics/vec2.h>
+#include <math.h>
+#include "pointwise-filter.h"
+
+/*
+ * Applies a 3D LUT stored as a 2D image of its blue slices, either side by
+ * side in one row (e.g. 256x16, 1024x32) or in a grid (e.g. 512x512 for a
+ * 64^3 LUT in 8x8 tiles), which is what most grading tools export.  The two
+ * slices around the blue value are sampled with bilinear filtering and
+ * blended, which makes the lookup trilinear.
+ */
+static const char *lut_code =
+"uniform texture2d $lut;\n"
+"uniform float     $lut_size  = 64.0;\n"
+"uniform float2    $lut_tiles = {8.0, 8.0};\n"
+"uniform float     $amount    = 1.0;\n"
+"\n"
+"sampler_state $lut_sampler {\n"
+"	Filter   = Linear;\n"
+"	AddressU = Clamp;\n"
+"	AddressV = Clamp;\n"
+"};\n"
+"\n"
+"float2 $slice_uv(float2 rg, float slice)\n"
+"{\n"
+"	float2 tile  = float2(fmod(slice, $lut_tiles.x),\n"
+"			floor(slice / $lut_tiles.x));\n"
+"	float2 texel = (rg * ($lut_size - 1.0) + 0.5) / $lut_size;\n"
+"	return (tile + texel) / $lut_tiles;\n"
+"}\n"
+"\n"
+"float4 $process(float4 rgba)\n"
+"{\n"
+"	float3 rgb   = saturate(rgba.rgb);\n"
+"	float  blue  = rgb.b * ($lut_size - 1.0);\n"
+"	float  slice = floor(blue);\n"
+"	float  next  = min(slice + 1.0, $lut_size - 1.0);\n"
+"	float3 lo    = $lut.Sample($lut_sampler, $slice_uv(rgb.rg, slice)).rgb;\n"
+"	float3 hi    = $lut.Sample($lut_sampler, $slice_uv(rgb.rg, next)).rgb;\n"
+"\n"
+"	rgba.rgb = lerp(rgba.rgb, lerp(lo, hi, blue - slice), $amount);\n"
+"	return rgba;\n"
+"}\n";
+
+struct lut_filter {
+	struct pointwise_filter pf;
+
+	char                    *file;
+	texture_t               texture;
+	float                   size;
+	struct vec2             tiles;
+	float                   amount;
+};
+
+static const char *lut_getname(const char *locale)
+{
+	/* TODO: translate */
+	UNUSED_PARAMETER(locale);
+	return "Apply LUT";
+}
+
+/* works out the size of the LUT and how its slices are laid out from the
+ * size of the image, the slices are square and there's one per LUT entry */
+static bool lut_layout(struct lut_filter *lf, uint32_t cx, uint32_t cy)
+{
+	uint32_t size = (uint32_t)(cbrt((double)cx * (double)cy) + 0.5);
+
+	if (size < 2 || cx % size || cy % size ||
+	    (cx / size) * (cy / size) != size)
+		return false;
+
+	lf->size = (float)size;
+	vec2_set(&lf->tiles, (float)(cx / size), (float)(cy / size));
+	return true;
+}
+
+static texture_t load_lut(struct lut_filter *lf, const char *file)
+{
+	texture_t texture = gs_create_texture_from_file(file, 0);
+
+	if (!texture) {
+		blog(LOG_WARNING, "obs-filters: Failed to load LUT '%s'", file);
+		return NULL;
+	}
+
+	if (!lut_layout(lf, texture_getwidth(texture),
+				texture_getheight(texture))) {
+		blog(LOG_WARNING, "obs-filters: '%s' is %ux%u, which isn't the "
+		                  "size of a LUT (slices of NxN side by side, "
+		                  "or in a grid, N slices in total)", file,
+		                  texture_getwidth(texture),
+		                  texture_getheight(texture));
+		texture_destroy(texture);
+		return NULL;
+	}
+
+	return texture;
+}
+
+static void lut_update(void *data, obs_data_t settings)
+{
+	struct lut_filter *lf = data;
+	const char *file = obs_data_getstring(settings, "image_path");
+
+	if (!file)
+		file = "";
+
+	lf->amount = (float)obs_data_getint(settings, "amount") * 0.01f;
+
+	if (lf->file && strcmp(lf->file, file) == 0)
+		return;
+
+	bfree(lf->file);
+	lf->file = bstrdup(file);
+
+	gs_entercontext(obs_graphics());
+
+	texture_destroy(lf->texture);
+	lf->texture = *file ? load_lut(lf, file) : NULL;
+
+	gs_leavecontext();
+}
+
+static void lut_defaults(obs_data_t settings)
+{
+	obs_data_set_default_int(settings, "amount", 100);
+}
+
+static obs_properties_t lut_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_path(props, "image_path", "LUT Image");
+	obs_properties_add_int(props, "amount", "Amount", 0, 100, 1);
+
+	return props;
+}
+
+static void lut_destroy(void *data)
+{
+	struct lut_filter *lf = data;
+
+	if (lf->texture) {
+		gs_entercontext(obs_graphics());
+		texture_destroy(lf->texture);
+		gs_leavecontext();
+	}
+
+	pointwise_filter_free(&lf->pf);
+	bfree(lf->file);
+	bfree(lf);
+}
+
+static void *lut_create(obs_data_t settings, obs_source_t source)
+{
+	struct lut_filter *lf = bzalloc(sizeof(struct lut_filter));
+
+	if (!pointwise_filter_init(&lf->pf, source, lut_code, "LUT")) {
+		lut_destroy(lf);
+		return NULL;
+	}
+
+	lut_update(lf, settings);
+	return lf;
+}
+
+static void lut_params(void *data, effect_t effect, const char *prefix)
+{
+	struct lut_filter *lf = data;
+
+	effect_settexture(effect, pointwise_param(effect, prefix, "lut"),
+			lf->texture);
+	effect_setfloat(effect, pointwise_param(effect, prefix, "lut_size"),
+			lf->size);
+	effect_setvec2(effect, pointwise_param(effect, prefix, "lut_tiles"),
+			&lf->tiles);
+	effect_setfloat(effect, pointwise_param(effect, prefix, "amount"),
+			lf->amount);
+}
+
+/* without a LUT there's nothing to combine */
+static const char *lut_shader(void *data)
+{
+	struct lut_filter *lf = data;
+	return lf->texture ? lut_code : NULL;
+}
+
+static void lut_render(void *data, effect_t effect)
+{
+	struct lut_filter *lf = data;
+
+	if (lf->texture) {
+		lut_params(lf, lf->pf.effect, "");
+		pointwise_filter_render(&lf->pf);
+	} else {
+		pointwise_filter_skip(&lf->pf);
+	}
+
+	UNUSED_PARAMETER(effect);
+}
+
+struct obs_source_info lut_filter = {
+	.id                      = "lut_filter",
+	.type                    = OBS_SOURCE_TYPE_FILTER,
+	.output_flags            = OBS_SOURCE_VIDEO,
+	.getname                 = lut_getname,
+	.create                  = lut_create,
+	.destroy                 = lut_destroy,
+	.update                  = lut_update,
+	.defaults                = lut_defaults,
+	.properties              = lut_properties,
+	.video_render            = lut_render,
+	.filter_pointwise_shader = lut_shader,
+	.filter_pointwise_params = lut_params
+};
@@ -0,0 +1,171 @@
+#include "audio-kernels.h"
+
+/* opens once the peak envelope goes above the open threshold, and closes
+ * when it's stayed below the close threshold for the hold time.  the two
+ * thresholds keep it from chattering on a signal around one of them */
+
+struct noise_gate {
+	obs_source_t               source;
+	struct audio_filter_format format;
+	bool                       supported;
+
+	float                      open_threshold;
+	float                      close_threshold;
+	float                      attack_rate;
+	float                      release_rate;
+	float                      hold_frames;
+	float                      detect_coef;
+
+	float                      envelope;
+	float                      level;
+	float                      held;
+	bool                       open;
+	DARRAY(float)              gain;
+};
+
+static const char *noise_gate_getname(const char *locale)
+{
+	/* TODO: translate */
+	UNUSED_PARAMETER(locale);
+	return "Noise Gate";
+}
+
+/* the gain ramps linearly between closed and open */
+static inline float ramp_rate(uint32_t sample_rate, float ms)
+{
+	return ms > 0.0f ? 1000.0f / (ms * (float)sample_rate) : 1.0f;
+}
+
+static void noise_gate_update(void *data, obs_data_t settings)
+{
+	struct noise_gate *ng = data;
+	uint32_t rate = ng->format.sample_rate;
+
+	ng->open_threshold  = db_to_mul(
+			(float)obs_data_getdouble(settings, "open_threshold"));
+	ng->close_threshold = db_to_mul(
+			(float)obs_data_getdouble(settings, "close_threshold"));
+	ng->attack_rate     = ramp_rate(rate,
+			(float)obs_data_getint(settings, "attack_time"));
+	ng->release_rate    = ramp_rate(rate,
+			(float)obs_data_getint(settings, "release_time"));
+	ng->hold_frames     = (float)obs_data_getint(settings, "hold_time") *
+			(float)rate / 1000.0f;
+
+	/* peaks are smoothed over about a period of the lowest voices, so
+	 * the gate doesn't see the zero crossings */
+	ng->detect_coef     = audio_time_coef(rate, 10.0f);
+}
+
+static void noise_gate_defaults(obs_data_t settings)
+{
+	obs_data_set_default_double(settings, "open_threshold", -26.0);
+	obs_data_set_default_double(settings, "close_threshold", -32.0);
+	obs_data_set_default_int(settings, "attack_time", 25);
+	obs_data_set_default_int(settings, "hold_time", 200);
+	obs_data_set_default_int(settings, "release_time", 150);
+}
+
+static obs_properties_t noise_gate_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_float(props, "close_threshold",
+			"Close Threshold (dB)", -96.0, 0.0, 0.1);
+	obs_properties_add_float(props, "open_threshold",
+			"Open Threshold (dB)", -96.0, 0.0, 0.1);
+	obs_properties_add_int(props, "attack_time", "Attack (ms)",
+			0, 10000, 1);
+	obs_properties_add_int(props, "hold_time", "Hold (ms)",
+			0, 10000, 1);
+	obs_properties_add_int(props, "release_time", "Release (ms)",
+			0, 10000, 1);
+
+	return props;
+}
+
+static void noise_gate_destroy(void *data)
+{
+	struct noise_gate *ng = data;
+
+	da_free(ng->gain);
+	bfree(ng);
+}
+
+static void *noise_gate_create(obs_data_t settings, obs_source_t source)
+{
+	struct noise_gate *ng = bzalloc(sizeof(struct noise_gate));
+
+	ng->source    = source;
+	ng->supported = audio_filter_format_get(&ng->format);
+
+	noise_gate_update(ng, settings);
+	return ng;
+}
+
+static struct filtered_audio *noise_gate_filter_audio(void *data,
+		struct filtered_audio *audio)
+{
+	struct noise_gate *ng = data;
+	float  *gain;
+	float  envelope = ng->envelope;
+	float  level    = ng->level;
+	float  held     = ng->held;
+	bool   open     = ng->open;
+
+	if (!ng->supported || !audio->frames)
+		return audio;
+
+	gain = audio_filter_scratch(&ng->gain.da, audio->frames);
+	audio_peak(gain, audio, &ng->format);
+
+	for (uint32_t i = 0; i < audio->frames; i++) {
+		float peak = gain[i];
+
+		envelope = peak > envelope ?
+			peak : peak + ng->detect_coef * (envelope - peak);
+
+		if (envelope >= ng->open_threshold) {
+			open = true;
+			held = 0.0f;
+		} else if (envelope >= ng->close_threshold) {
+			held = 0.0f;
+		} else if (open) {
+			held += 1.0f;
+			if (held >= ng->hold_frames)
+				open = false;
+		}
+
+		if (open) {
+			level += ng->attack_rate;
+			if (level > 1.0f) level = 1.0f;
+		} else {
+			level -= ng->release_rate;
+			if (level < 0.0f) level = 0.0f;
+		}
+
+		gain[i] = level;
+	}
+
+	ng->envelope = envelope;
+	ng->level    = level;
+	ng->held     = held;
+	ng->open     = open;
+
+	audio_apply_gain(audio, &ng->format, gain);
+	return audio;
+}
+
+struct obs_source_info noise_gate_filter = {
+	.id           = "noise_gate_filter",
+	.type         = OBS_SOURCE_TYPE_FILTER,
+	.output_flags = OBS_SOURCE_AUDIO,
+	.getname      = noise_gate_getname,
+	.create       = noise_gate_create,
+	.destroy      = noise_gate_destroy,
+	.update       = noise_gate_update,
+	.defaults     = noise_gate_defaults,
+	.properties   = noise_gate_properties,
+	.filter_audio = noise_gate_filter_audio
+};
@@ -0,0 +1,352 @@
+#include <util/circlebuf.h>
+#include <graphics/math-defs.h>
+#include "audio-kernels.h"
+
+/*
+ * Spectral noise suppression.  Each channel is split in to overlapping
+ * blocks, and every bin of a block is attenuated by how much of its power
+ * the estimated noise accounts for, down to the suppression level.  The
+ * noise is estimated as the minimum of each bin's smoothed power, which
+ * follows it down right away and rises slowly, so it settles on the noise
+ * floor in the pauses between words.
+ *
+ * The audio is delayed by the block size (about 10ms at 48khz), which is
+ * taken off the timestamps so it stays in sync.
+ */
+
+#define FFT_SIZE 512
+#define HOP_SIZE (FFT_SIZE / 2)
+#define BINS     (FFT_SIZE / 2 + 1)
+
+/* the minimum sits well below the average power of the noise, so the
+ * estimate is scaled up before it's subtracted */
+#define OVERSUBTRACT 4.0f
+
+struct ns_channel {
+	struct circlebuf input;
+	struct circlebuf output;
+
+	float            frame[FFT_SIZE];
+	float            overlap[FFT_SIZE];
+
+	float            smoothed[BINS];
+	float            noise[BINS];
+	float            gain[BINS];
+	size_t           blocks;
+	bool             noise_set;
+};
+
+struct noise_suppress {
+	obs_source_t               source;
+	struct audio_filter_format format;
+	bool                       supported;
+	uint64_t                   latency;
+
+	float                      floor;
+	float                      noise_rise;
+
+	float                      window[FFT_SIZE];
+	float                      cos_table[FFT_SIZE / 2];
+	float                      sin_table[FFT_SIZE / 2];
+	uint16_t                   bitrev[FFT_SIZE];
+
+	/* only used while processing a block */
+	float                      re[FFT_SIZE];
+	float                      im[FFT_SIZE];
+	float                      power[BINS];
+	float                      block[HOP_SIZE];
+
+	struct ns_channel          channels[MAX_AUDIO_CHANNELS];
+	DARRAY(float)              samples;
+};
+
+static const char *noise_suppress_getname(const char *locale)
+{
+	/* TODO: translate */
+	UNUSED_PARAMETER(locale);
+	return "Noise Suppression";
+}
+
+static void noise_suppress_update(void *data, obs_data_t settings)
+{
+	struct noise_suppress *ns = data;
+	ns->floor = db_to_mul((float)obs_data_getint(settings,
+				"suppress_level"));
+}
+
+static void noise_suppress_defaults(obs_data_t settings)
+{
+	obs_data_set_default_int(settings, "suppress_level", -30);
+}
+
+static obs_properties_t noise_suppress_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_int(props, "suppress_level",
+			"Suppression Level (dB)", -60, 0, 1);
+
+	return props;
+}
+
+static void noise_suppress_destroy(void *data)
+{
+	struct noise_suppress *ns = data;
+
+	for (size_t i = 0; i < MAX_AUDIO_CHANNELS; i++) {
+		circlebuf_free(&ns->channels[i].input);
+		circlebuf_free(&ns->channels[i].output);
+	}
+
+	da_free(ns->samples);
+	bfree(ns);
+}
+
+static void init_tables(struct noise_suppress *ns)
+{
+	size_t bits = 0;
+
+	while (((size_t)1 << bits) < FFT_SIZE)
+		bits++;
+
+	/* square root of a periodic hann window, applied both before and
+	 * after processing, so the overlapping blocks add up to one */
+	for (size_t i = 0; i < FFT_SIZE; i++) {
+		float hann = 0.5f - 0.5f * cosf(2.0f * M_PI * (float)i /
+				(float)FFT_SIZE);
+		ns->window[i] = sqrtf(hann);
+	}
+
+	for (size_t i = 0; i < FFT_SIZE / 2; i++) {
+		float angle = 2.0f * M_PI * (float)i / (float)FFT_SIZE;
+		ns->cos_table[i] = cosf(angle);
+		ns->sin_table[i] = sinf(angle);
+	}
+
+	for (size_t i = 0; i < FFT_SIZE; i++) {
+		size_t rev = 0;
+		for (size_t b = 0; b < bits; b++)
+			if (i & ((size_t)1 << b))
+				rev |= (size_t)1 << (bits - 1 - b);
+		ns->bitrev[i] = (uint16_t)rev;
+	}
+}
+
+static void *noise_suppress_create(obs_data_t settings, obs_source_t source)
+{
+	struct noise_suppress *ns = bzalloc(sizeof(struct noise_suppress));
+	float silence[HOP_SIZE] = {0};
+	float blocks_per_sec;
+
+	ns->source    = source;
+	ns->supported = audio_filter_format_get(&ns->format);
+
+	if (ns->supported) {
+		init_tables(ns);
+
+		ns->latency = (uint64_t)FFT_SIZE * 1000000000ULL /
+			(uint64_t)ns->format.sample_rate;
+
+		/* the noise estimate rises by up to 3dB a second */
+		blocks_per_sec = (float)ns->format.sample_rate /
+			(float)HOP_SIZE;
+		ns->noise_rise = powf(2.0f, 1.0f / blocks_per_sec);
+
+		/* a block of silence gives the first blocks something to be
+		 * output in place of, see filter_channel */
+		for (size_t i = 0; i < ns->format.channels; i++)
+			circlebuf_push_back(&ns->channels[i].output, silence,
+					sizeof(silence));
+	}
+
+	noise_suppress_update(ns, settings);
+	return ns;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void fft(const struct noise_suppress *ns, float *re, float *im,
+		bool inverse)
+{
+	for (size_t i = 0; i < FFT_SIZE; i++) {
+		size_t j = ns->bitrev[i];
+
+		if (i < j) {
+			float tmp;
+			tmp = re[i]; re[i] = re[j]; re[j] = tmp;
+			tmp = im[i]; im[i] = im[j]; im[j] = tmp;
+		}
+	}
+
+	for (size_t len = 2; len <= FFT_SIZE; len <<= 1) {
+		size_t half = len / 2;
+		size_t step = FFT_SIZE / len;
+
+		for (size_t i = 0; i < FFT_SIZE; i += len) {
+			for (size_t k = 0; k < half; k++) {
+				float  wr = ns->cos_table[k * step];
+				float  wi = inverse ?  ns->sin_table[k * step] :
+				                      -ns->sin_table[k * step];
+				size_t a  = i + k;
+				size_t b  = i + k + half;
+				float  tr = re[b] * wr - im[b] * wi;
+				float  ti = re[b] * wi + im[b] * wr;
+
+				re[b]  = re[a] - tr;
+				im[b]  = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+}
+
+static void update_gain(struct noise_suppress *ns, struct ns_channel *ch)
+{
+	/* the first blocks are partly the silence the frame starts out with,
+	 * which would start the noise estimate far too low */
+	if (ch->blocks < FFT_SIZE / HOP_SIZE) {
+		for (size_t i = 0; i < BINS; i++)
+			ch->gain[i] = 1.0f;
+		ch->blocks++;
+		return;
+	}
+
+	for (size_t i = 0; i < BINS; i++) {
+		float power = ns->power[i];
+		float gain;
+
+		if (!ch->noise_set) {
+			ch->smoothed[i] = power;
+			ch->noise[i]    = power;
+			ch->gain[i]     = 1.0f;
+		}
+
+		ch->smoothed[i] = 0.8f * ch->smoothed[i] + 0.2f * power;
+
+		if (ch->smoothed[i] < ch->noise[i])
+			ch->noise[i] = ch->smoothed[i];
+		else
+			ch->noise[i] *= ns->noise_rise;
+
+		gain = 1.0f - OVERSUBTRACT * ch->noise[i] /
+			(ch->smoothed[i] + 1e-12f);
+		if (gain < ns->floor)
+			gain = ns->floor;
+
+		/* opens right away, but closes over a few blocks, which keeps
+		 * isolated bins from flickering */
+		ch->gain[i] = gain > ch->gain[i] ?
+			gain : 0.6f * ch->gain[i] + 0.4f * gain;
+	}
+
+	ch->noise_set = true;
+}
+
+static void process_block(struct noise_suppress *ns, struct ns_channel *ch)
+{
+	const float scale = 1.0f / (float)FFT_SIZE;
+
+	memmove(ch->frame, ch->frame + HOP_SIZE,
+			(FFT_SIZE - HOP_SIZE) * sizeof(float));
+	memcpy(ch->frame + FFT_SIZE - HOP_SIZE, ns->block,
+			HOP_SIZE * sizeof(float));
+
+	for (size_t i = 0; i < FFT_SIZE; i++) {
+		ns->re[i] = ch->frame[i] * ns->window[i];
+		ns->im[i] = 0.0f;
+	}
+
+	fft(ns, ns->re, ns->im, false);
+
+	audio_spectrum_power(ns->power, ns->re, ns->im, BINS);
+	update_gain(ns, ch);
+	audio_spectrum_mul(ns->re, ns->im, ch->gain, BINS);
+
+	/* the input is real, so the upper half mirrors the lower half */
+	for (size_t i = 1; i < FFT_SIZE / 2; i++) {
+		ns->re[FFT_SIZE - i] =  ns->re[i];
+		ns->im[FFT_SIZE - i] = -ns->im[i];
+	}
+
+	fft(ns, ns->re, ns->im, true);
+
+	for (size_t i = 0; i < FFT_SIZE; i++)
+		ch->overlap[i] += ns->re[i] * ns->window[i] * scale;
+
+	circlebuf_push_back(&ch->output, ch->overlap,
+			HOP_SIZE * sizeof(float));
+
+	memmove(ch->overlap, ch->overlap + HOP_SIZE,
+			(FFT_SIZE - HOP_SIZE) * sizeof(float));
+	memset(ch->overlap + FFT_SIZE - HOP_SIZE, 0,
+			HOP_SIZE * sizeof(float));
+}
+
+/* the output starts a block ahead of the input, so there are always enough
+ * processed samples to replace the new ones with */
+static void filter_channel(struct noise_suppress *ns, struct ns_channel *ch,
+		float *samples, uint32_t frames)
+{
+	size_t size = frames * sizeof(float);
+
+	circlebuf_push_back(&ch->input, samples, size);
+
+	while (ch->input.size >= sizeof(ns->block)) {
+		circlebuf_pop_front(&ch->input, ns->block, sizeof(ns->block));
+		process_block(ns, ch);
+	}
+
+	circlebuf_pop_front(&ch->output, samples, size);
+}
+
+static struct filtered_audio *noise_suppress_filter_audio(void *data,
+		struct filtered_audio *audio)
+{
+	struct noise_suppress *ns = data;
+	size_t channels;
+	float  *samples;
+
+	if (!ns->supported || !audio->frames)
+		return audio;
+
+	channels = ns->format.channels;
+
+	if (ns->format.planar) {
+		for (size_t i = 0; i < channels; i++)
+			filter_channel(ns, ns->channels + i,
+					(float*)audio->data[i], audio->frames);
+	} else {
+		float *data = (float*)audio->data[0];
+
+		samples = audio_filter_scratch(&ns->samples.da, audio->frames);
+
+		for (size_t i = 0; i < channels; i++) {
+			for (uint32_t j = 0; j < audio->frames; j++)
+				samples[j] = data[j * channels + i];
+
+			filter_channel(ns, ns->channels + i, samples,
+					audio->frames);
+
+			for (uint32_t j = 0; j < audio->frames; j++)
+				data[j * channels + i] = samples[j];
+		}
+	}
+
+	audio->timestamp -= ns->latency;
+	return audio;
+}
+
+struct obs_source_info noise_suppress_filter = {
+	.id           = "noise_suppress_filter",
+	.type         = OBS_SOURCE_TYPE_FILTER,
+	.output_flags = OBS_SOURCE_AUDIO,
+	.getname      = noise_suppress_getname,
+	.create       = noise_suppress_create,
+	.destroy      = noise_suppress_destroy,
+	.update       = noise_suppress_update,
+	.defaults     = noise_suppress_defaults,
+	.properties   = noise_suppress_properties,
+	.filter_audio = noise_suppress_filter_audio
+};
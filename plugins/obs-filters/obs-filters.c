@@ -0,0 +1,29 @@
+#include <obs-module.h>
+
+OBS_DECLARE_MODULE()
+
+extern struct obs_source_info chroma_key_filter;
+extern struct obs_source_info color_key_filter;
+extern struct obs_source_info color_correction_filter;
+extern struct obs_source_info lut_filter;
+extern struct obs_source_info sharpen_filter;
+extern struct obs_source_info noise_gate_filter;
+extern struct obs_source_info compressor_filter;
+extern struct obs_source_info limiter_filter;
+extern struct obs_source_info noise_suppress_filter;
+
+bool obs_module_load(uint32_t libobs_ver)
+{
+	obs_register_source(&chroma_key_filter);
+	obs_register_source(&color_key_filter);
+	obs_register_source(&color_correction_filter);
+	obs_register_source(&lut_filter);
+	obs_register_source(&sharpen_filter);
+	obs_register_source(&noise_gate_filter);
+	obs_register_source(&compressor_filter);
+	obs_register_source(&limiter_filter);
+	obs_register_source(&noise_suppress_filter);
+
+	UNUSED_PARAMETER(libobs_ver);
+	return true;
+}
@@ -0,0 +1,131 @@
+#include <util/dstr.h>
+#include "pointwise-filter.h"
+
+/* the same as libobs' default effect, with the filter's code applied to the
+ * sampled color */
+static const char *standalone_header =
+"uniform float4x4 ViewProj;\n"
+"uniform float4x4 color_matrix;\n"
+"uniform float3 color_range_min = {0.0, 0.0, 0.0};\n"
+"uniform float3 color_range_max = {1.0, 1.0, 1.0};\n"
+"uniform texture2d image;\n"
+"\n"
+"sampler_state def_sampler {\n"
+"	Filter   = Linear;\n"
+"	AddressU = Clamp;\n"
+"	AddressV = Clamp;\n"
+"};\n"
+"\n"
+"struct VertInOut {\n"
+"	float4 pos : POSITION;\n"
+"	float2 uv  : TEXCOORD0;\n"
+"};\n"
+"\n"
+"VertInOut VSDefault(VertInOut vert_in)\n"
+"{\n"
+"	VertInOut vert_out;\n"
+"	vert_out.pos = mul(float4(vert_in.pos.xyz, 1.0), ViewProj);\n"
+"	vert_out.uv  = vert_in.uv;\n"
+"	return vert_out;\n"
+"}\n"
+"\n";
+
+static const char *standalone_footer =
+"\n"
+"float4 PSDrawBare(VertInOut vert_in) : TARGET\n"
+"{\n"
+"	return process(image.Sample(def_sampler, vert_in.uv));\n"
+"}\n"
+"\n"
+"float4 PSDrawMatrix(VertInOut vert_in) : TARGET\n"
+"{\n"
+"	float4 yuv = image.Sample(def_sampler, vert_in.uv);\n"
+"	yuv.xyz = clamp(yuv.xyz, color_range_min, color_range_max);\n"
+"	return process(saturate(mul(float4(yuv.xyz, 1.0), color_matrix)));\n"
+"}\n"
+"\n"
+"technique Draw\n"
+"{\n"
+"	pass\n"
+"	{\n"
+"		vertex_shader = VSDefault(vert_in);\n"
+"		pixel_shader  = PSDrawBare(vert_in);\n"
+"	}\n"
+"}\n"
+"\n"
+"technique DrawMatrix\n"
+"{\n"
+"	pass\n"
+"	{\n"
+"		vertex_shader = VSDefault(vert_in);\n"
+"		pixel_shader  = PSDrawMatrix(vert_in);\n"
+"	}\n"
+"}\n";
+
+bool pointwise_filter_init(struct pointwise_filter *pf,
+		obs_source_t source, const char *code, const char *name)
+{
+	struct dstr effect_code = {0};
+	struct dstr filter_code = {0};
+	char        *errors     = NULL;
+
+	dstr_copy(&filter_code, code);
+	dstr_replace(&filter_code, "$", "");
+
+	dstr_copy(&effect_code, standalone_header);
+	dstr_cat_dstr(&effect_code, &filter_code);
+	dstr_cat(&effect_code, standalone_footer);
+
+	pf->source = source;
+
+	gs_entercontext(obs_graphics());
+	pf->effect = gs_create_effect(effect_code.array, name, &errors);
+	gs_leavecontext();
+
+	if (!pf->effect)
+		blog(LOG_ERROR, "obs-filters: Failed to create the %s effect: %s",
+				name, errors ? errors : "(unknown error)");
+
+	bfree(errors);
+	dstr_free(&filter_code);
+	dstr_free(&effect_code);
+	return pf->effect != NULL;
+}
+
+void pointwise_filter_free(struct pointwise_filter *pf)
+{
+	if (pf->effect) {
+		gs_entercontext(obs_graphics());
+		effect_destroy(pf->effect);
+		gs_leavecontext();
+
+		pf->effect = NULL;
+	}
+}
+
+void pointwise_filter_render(struct pointwise_filter *pf)
+{
+	obs_source_process_filter(pf->source, pf->effect, 0, 0, GS_RGBA,
+			ALLOW_DIRECT_RENDERING);
+}
+
+void pointwise_filter_skip(struct pointwise_filter *pf)
+{
+	obs_source_process_filter(pf->source, obs_get_default_effect(), 0, 0,
+			GS_RGBA, ALLOW_DIRECT_RENDERING);
+}
+
+eparam_t pointwise_param(effect_t effect, const char *prefix,
+		const char *name)
+{
+	struct dstr full_name = {0};
+	eparam_t    param;
+
+	dstr_copy(&full_name, prefix);
+	dstr_cat(&full_name, name);
+
+	param = effect_getparambyname(effect, full_name.array);
+
+	dstr_free(&full_name);
+	return param;
+}
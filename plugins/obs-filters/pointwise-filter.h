@@ -0,0 +1,31 @@
+#pragma once
+
+#include <obs-module.h>
+
+/*
+ * Shared by the filters whose output pixel only depends on the same input
+ * pixel.  Their effect code is written once in the form libobs combines
+ * consecutive pointwise filters with (see filter_pointwise_shader), and the
+ * effect a filter draws with on its own is built from the same code.
+ */
+
+struct pointwise_filter {
+	obs_source_t source;
+	effect_t     effect;
+};
+
+extern bool pointwise_filter_init(struct pointwise_filter *pf,
+		obs_source_t source, const char *code, const char *name);
+extern void pointwise_filter_free(struct pointwise_filter *pf);
+
+/* draws the filter with its own effect, the parameters of which have to be
+ * set beforehand with an empty prefix */
+extern void pointwise_filter_render(struct pointwise_filter *pf);
+
+/* draws the filter's target unchanged, for when it has nothing to apply */
+extern void pointwise_filter_skip(struct pointwise_filter *pf);
+
+/* looks up a parameter of the code by the name it was declared with,
+ * without the '$' */
+extern eparam_t pointwise_param(effect_t effect, const char *prefix,
+		const char *name);
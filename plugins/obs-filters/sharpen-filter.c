@@ -0,0 +1,122 @@
+#include <obs-module.h>
+#include <graphics/vec2.h>
+
+/* samples the neighboring pixels, so unlike the other filters it can't be
+ * combined with the pointwise filters around it */
+
+struct sharpen_filter {
+	obs_source_t source;
+	effect_t     effect;
+	eparam_t     texel_param;
+	eparam_t     sharpness_param;
+
+	float        sharpness;
+};
+
+static const char *sharpen_getname(const char *locale)
+{
+	/* TODO: translate */
+	UNUSED_PARAMETER(locale);
+	return "Sharpen";
+}
+
+static void sharpen_update(void *data, obs_data_t settings)
+{
+	struct sharpen_filter *sf = data;
+	sf->sharpness = (float)obs_data_getdouble(settings, "sharpness");
+}
+
+static void sharpen_defaults(obs_data_t settings)
+{
+	obs_data_set_default_double(settings, "sharpness", 0.08);
+}
+
+static obs_properties_t sharpen_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_float(props, "sharpness", "Sharpness",
+			0.0, 1.0, 0.01);
+
+	return props;
+}
+
+static void sharpen_destroy(void *data)
+{
+	struct sharpen_filter *sf = data;
+
+	if (sf->effect) {
+		gs_entercontext(obs_graphics());
+		effect_destroy(sf->effect);
+		gs_leavecontext();
+	}
+
+	bfree(sf);
+}
+
+static void *sharpen_create(obs_data_t settings, obs_source_t source)
+{
+	struct sharpen_filter *sf = bzalloc(sizeof(struct sharpen_filter));
+	char *effect_file = obs_find_plugin_file("obs-filters/sharpen.effect");
+	char *error_string = NULL;
+
+	sf->source = source;
+
+	gs_entercontext(obs_graphics());
+	if (effect_file)
+		sf->effect = gs_create_effect_from_file(effect_file,
+				&error_string);
+	gs_leavecontext();
+
+	bfree(effect_file);
+
+	if (!sf->effect) {
+		blog(LOG_ERROR, "obs-filters: Failed to create sharpen "
+		                "effect: %s",
+		                error_string ? error_string : "file not found");
+		bfree(error_string);
+		sharpen_destroy(sf);
+		return NULL;
+	}
+
+	sf->texel_param     = effect_getparambyname(sf->effect, "texel");
+	sf->sharpness_param = effect_getparambyname(sf->effect, "sharpness");
+
+	sharpen_update(sf, settings);
+	return sf;
+}
+
+static void sharpen_render(void *data, effect_t effect)
+{
+	struct sharpen_filter *sf = data;
+	obs_source_t target = obs_filter_gettarget(sf->source);
+	uint32_t     cx     = obs_source_getwidth(target);
+	uint32_t     cy     = obs_source_getheight(target);
+	struct vec2  texel;
+
+	if (!cx || !cy)
+		return;
+
+	vec2_set(&texel, 1.0f / (float)cx, 1.0f / (float)cy);
+	effect_setvec2(sf->effect, sf->texel_param, &texel);
+	effect_setfloat(sf->effect, sf->sharpness_param, sf->sharpness);
+
+	obs_source_process_filter(sf->source, sf->effect, 0, 0, GS_RGBA,
+			ALLOW_DIRECT_RENDERING);
+
+	UNUSED_PARAMETER(effect);
+}
+
+struct obs_source_info sharpen_filter = {
+	.id           = "sharpen_filter",
+	.type         = OBS_SOURCE_TYPE_FILTER,
+	.output_flags = OBS_SOURCE_VIDEO,
+	.getname      = sharpen_getname,
+	.create       = sharpen_create,
+	.destroy      = sharpen_destroy,
+	.update       = sharpen_update,
+	.defaults     = sharpen_defaults,
+	.properties   = sharpen_properties,
+	.video_render = sharpen_render
+};
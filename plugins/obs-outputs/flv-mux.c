@@ -25,7 +25,6 @@
  * use anything else for a long time. */
 
 //#define DEBUG_TIMESTAMPS
-//#define WRITE_FLV_HEADER
 
 #define VIDEO_HEADER_SIZE 5
 #define MILLISECOND_DEN   1000
@@ -62,7 +61,8 @@ static void build_flv_meta_data(obs_output_t context,
 	enc_num_val(&enc, end, "height", (double)video_output_height(video));
 	enc_str_val(&enc, end, "videocodecid", "avc1");
 	enc_num_val(&enc, end, "videodatarate", encoder_bitrate(vencoder));
-	enc_num_val(&enc, end, "framerate", video_output_framerate(video));
+	enc_num_val(&enc, end, "framerate", video_output_framerate(video) /
+			obs_encoder_get_frame_rate_divisor(vencoder));
 
 	enc_str_val(&enc, end, "audiocodecid", "mp4a");
 	enc_num_val(&enc, end, "audiodatarate", encoder_bitrate(aencoder));
@@ -83,7 +83,8 @@ static void build_flv_meta_data(obs_output_t context,
 	*output = bmemdup(buf, *size);
 }
 
-void flv_meta_data(obs_output_t context, uint8_t **output, size_t *size)
+void flv_meta_data(obs_output_t context, uint8_t **output, size_t *size,
+		bool write_header)
 {
 	struct array_output_data data;
 	struct serializer s;
@@ -95,13 +96,13 @@ void flv_meta_data(obs_output_t context, uint8_t **output, size_t *size)
 
 	build_flv_meta_data(context, &meta_data, &meta_data_size);
 
-#ifdef WRITE_FLV_HEADER
-	s_write(&s, "FLV", 3);
-	s_w8(&s, 1);
-	s_w8(&s, 5);
-	s_wb32(&s, 9);
-	s_wb32(&s, 0);
-#endif
+	if (write_header) {
+		s_write(&s, "FLV", 3);
+		s_w8(&s, 1);
+		s_w8(&s, 5);
+		s_wb32(&s, 9);
+		s_wb32(&s, 0);
+	}
 
 	start_pos = serializer_get_pos(&s);
 
@@ -130,15 +131,12 @@ static uint32_t get_ms_time(struct encoder_packet *packet, int64_t val)
 static int32_t last_time = 0;
 #endif
 
-static void flv_video(struct serializer *s, struct encoder_packet *packet,
-		bool is_header)
+static void flv_video_header(struct serializer *s,
+		struct encoder_packet *packet, bool is_header)
 {
 	int64_t offset  = packet->pts - packet->dts;
 	int32_t time_ms = get_ms_time(packet, packet->dts);
 
-	if (!packet->data || !packet->size)
-		return;
-
 	s_w8(s, RTMP_PACKET_TYPE_VIDEO);
 
 #ifdef DEBUG_TIMESTAMPS
@@ -159,20 +157,13 @@ static void flv_video(struct serializer *s, struct encoder_packet *packet,
 	s_w8(s, packet->keyframe ? 0x17 : 0x27);
 	s_w8(s, is_header ? 0 : 1);
 	s_wb24(s, get_ms_time(packet, offset));
-	s_write(s, packet->data, packet->size);
-
-	/* write tag size (starting byte doesnt count) */
-	s_wb32(s, (uint32_t)serializer_get_pos(s) + 4 - 1);
 }
 
-static void flv_audio(struct serializer *s, struct encoder_packet *packet,
-		bool is_header)
+static void flv_audio_header(struct serializer *s,
+		struct encoder_packet *packet, bool is_header)
 {
 	int32_t time_ms = get_ms_time(packet, packet->dts);
 
-	if (!packet->data || !packet->size)
-		return;
-
 	s_w8(s, RTMP_PACKET_TYPE_AUDIO);
 
 #ifdef DEBUG_TIMESTAMPS
@@ -192,10 +183,45 @@ static void flv_audio(struct serializer *s, struct encoder_packet *packet,
 	/* these are the two extra bytes mentioned above */
 	s_w8(s, 0xaf);
 	s_w8(s, is_header ? 0 : 1);
-	s_write(s, packet->data, packet->size);
+}
 
-	/* write tag size (starting byte doesnt count) */
-	s_wb32(s, (uint32_t)serializer_get_pos(s) + 4 - 1);
+void flv_packet_header(struct serializer *s, struct encoder_packet *packet,
+		bool is_header)
+{
+	if (packet->type == OBS_ENCODER_VIDEO)
+		flv_video_header(s, packet, is_header);
+	else
+		flv_audio_header(s, packet, is_header);
+}
+
+struct header_buf {
+	uint8_t *data;
+	size_t  size;
+};
+
+static size_t header_buf_write(void *param, const void *data, size_t size)
+{
+	struct header_buf *buf = param;
+
+	if (buf->size + size > FLV_MAX_TAG_HEADER_SIZE)
+		return 0;
+
+	memcpy(buf->data + buf->size, data, size);
+	buf->size += size;
+	return size;
+}
+
+size_t flv_packet_header_buf(struct encoder_packet *packet, uint8_t *header,
+		bool is_header)
+{
+	struct header_buf buf = {header, 0};
+	struct serializer s   = {0};
+
+	s.data  = &buf;
+	s.write = header_buf_write;
+
+	flv_packet_header(&s, packet, is_header);
+	return buf.size;
 }
 
 void flv_packet_mux(struct encoder_packet *packet,
@@ -206,10 +232,13 @@ void flv_packet_mux(struct encoder_packet *packet,
 
 	array_output_serializer_init(&s, &data);
 
-	if (packet->type == OBS_ENCODER_VIDEO)
-		flv_video(&s, packet, is_header);
-	else
-		flv_audio(&s, packet, is_header);
+	if (packet->data && packet->size) {
+		flv_packet_header(&s, packet, is_header);
+		s_write(&s, packet->data, packet->size);
+
+		/* write tag size (starting byte doesnt count) */
+		s_wb32(&s, (uint32_t)serializer_get_pos(&s) + 4 - 1);
+	}
 
 	*output = data.bytes.array;
 	*size   = data.bytes.num;
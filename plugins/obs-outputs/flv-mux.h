@@ -18,7 +18,23 @@
 #pragma once
 
 #include <obs.h>
+#include <util/serializer.h>
 
-extern void flv_meta_data(obs_output_t context, uint8_t **output, size_t *size);
+extern void flv_meta_data(obs_output_t context, uint8_t **output, size_t *size,
+		bool write_header);
 extern void flv_packet_mux(struct encoder_packet *packet,
 		uint8_t **output, size_t *size, bool is_header);
+
+/* writes only the FLV tag header (including the codec-specific bytes that
+ * precede the payload), so the payload can be sent directly from the packet.
+ * the trailing tag size is not written. */
+extern void flv_packet_header(struct serializer *s,
+		struct encoder_packet *packet, bool is_header);
+
+/* largest tag header written by flv_packet_header */
+#define FLV_MAX_TAG_HEADER_SIZE 16
+
+/* same as flv_packet_header, but writes in to a fixed buffer of
+ * FLV_MAX_TAG_HEADER_SIZE bytes, and returns the size written */
+extern size_t flv_packet_header_buf(struct encoder_packet *packet,
+		uint8_t *header, bool is_header);
@@ -0,0 +1,465 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs.h>
+#include <util/platform.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include "ts-mux.h"
+
+/* HLS output
+ *
+ * Muxes the packets of its encoders in to MPEG-TS segments that start on
+ * keyframes, and keeps an HLS playlist of the most recent segments up to
+ * date, so a web server can serve the stream straight from the directory.
+ * Packets are muxed and written on a thread of their own, away from the
+ * encoders.  Segments and the playlist are written to temporary files and
+ * renamed once complete, so readers never see a partial file. */
+
+struct hls_segment {
+	uint32_t         index;
+	double           duration;
+};
+
+struct hls_output {
+	obs_output_t     output;
+
+	struct dstr      path;
+	struct dstr      name;
+	int64_t          target_usec;
+	size_t           playlist_size;
+	bool             delete_segments;
+
+	pthread_mutex_t  packets_mutex;
+	struct circlebuf packets;
+	os_sem_t         write_sem;
+	pthread_t        write_thread;
+	bool             write_thread_active;
+	volatile bool    stopping;
+
+	/* only used by the write thread */
+	struct ts_mux    mux;
+	bool             segment_started;
+	bool             keyframe_requested;
+	int64_t          segment_start_usec;
+	int64_t          last_dts_usec;
+	int64_t          frame_usec;
+	uint32_t         segment_index;
+	DARRAY(struct hls_segment) segments;
+	bool             write_failed;
+};
+
+static const char *hls_output_getname(const char *locale)
+{
+	/* TODO: locale stuff */
+	UNUSED_PARAMETER(locale);
+	return "HLS Output";
+}
+
+static void hls_segment_path(struct hls_output *hls, struct dstr *path,
+		uint32_t index)
+{
+	dstr_printf(path, "%s/%s%u.ts", hls->path.array, hls->name.array,
+			index);
+}
+
+static void free_packets(struct hls_output *hls)
+{
+	while (hls->packets.size) {
+		struct encoder_packet packet;
+		circlebuf_pop_front(&hls->packets, &packet, sizeof(packet));
+		obs_encoder_packet_release(&packet);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* writing */
+
+static bool write_file(const char *path, const void *data, size_t size)
+{
+	struct dstr temp = {0};
+	FILE        *file;
+	bool        success;
+
+	dstr_printf(&temp, "%s.tmp", path);
+
+	file = os_fopen(temp.array, "wb");
+	if (!file) {
+		dstr_free(&temp);
+		return false;
+	}
+
+	success = fwrite(data, 1, size, file) == size;
+	fclose(file);
+
+	if (success)
+		success = os_rename(temp.array, path);
+	else
+		remove(temp.array);
+
+	dstr_free(&temp);
+	return success;
+}
+
+static bool write_playlist(struct hls_output *hls, bool finished)
+{
+	struct dstr playlist = {0};
+	struct dstr path     = {0};
+	double      max_duration = 0.0;
+	uint32_t    first_index;
+	bool        success;
+
+	for (size_t i = 0; i < hls->segments.num; i++)
+		if (hls->segments.array[i].duration > max_duration)
+			max_duration = hls->segments.array[i].duration;
+
+	first_index = hls->segments.num ? hls->segments.array[0].index : 0;
+
+	dstr_copy(&playlist, "#EXTM3U\n#EXT-X-VERSION:3\n");
+	dstr_catf(&playlist, "#EXT-X-TARGETDURATION:%d\n",
+			(int)(max_duration + 0.999));
+	dstr_catf(&playlist, "#EXT-X-MEDIA-SEQUENCE:%u\n", first_index);
+
+	for (size_t i = 0; i < hls->segments.num; i++) {
+		struct hls_segment *segment = hls->segments.array+i;
+		dstr_catf(&playlist, "#EXTINF:%.3f,\n%s%u.ts\n",
+				segment->duration, hls->name.array,
+				segment->index);
+	}
+
+	if (finished)
+		dstr_cat(&playlist, "#EXT-X-ENDLIST\n");
+
+	dstr_printf(&path, "%s/%s.m3u8", hls->path.array, hls->name.array);
+	success = write_file(path.array, playlist.array, playlist.len);
+
+	dstr_free(&playlist);
+	dstr_free(&path);
+	return success;
+}
+
+/* segments are deleted one segment after they've left the playlist, so
+ * clients that just loaded the previous playlist can still get them */
+static void trim_segments(struct hls_output *hls)
+{
+	struct dstr path = {0};
+
+	if (!hls->playlist_size)
+		return;
+
+	while (hls->segments.num > hls->playlist_size) {
+		uint32_t index = hls->segments.array[0].index;
+
+		da_erase(hls->segments, 0);
+
+		if (hls->delete_segments && index > 0) {
+			hls_segment_path(hls, &path, index - 1);
+			remove(path.array);
+		}
+	}
+
+	dstr_free(&path);
+}
+
+static void finish_segment(struct hls_output *hls, int64_t end_usec,
+		bool finished)
+{
+	struct hls_segment segment;
+	struct dstr        path = {0};
+
+	segment.index    = hls->segment_index++;
+	segment.duration = (double)(end_usec - hls->segment_start_usec) /
+		1000000.0;
+
+	hls_segment_path(hls, &path, segment.index);
+
+	if (!write_file(path.array, hls->mux.data.array, hls->mux.data.num)) {
+		if (!hls->write_failed)
+			blog(LOG_WARNING, "HLS output: failed to write '%s'",
+					path.array);
+		hls->write_failed = true;
+
+	} else {
+		hls->write_failed = false;
+
+		da_push_back(hls->segments, &segment);
+		trim_segments(hls);
+
+		if (!write_playlist(hls, finished))
+			blog(LOG_WARNING, "HLS output: failed to write the "
+			                  "playlist of '%s'", hls->name.array);
+	}
+
+	da_resize(hls->mux.data, 0);
+	dstr_free(&path);
+}
+
+static void start_segment(struct hls_output *hls, int64_t start_usec)
+{
+	ts_mux_write_tables(&hls->mux);
+	hls->segment_start_usec = start_usec;
+	hls->segment_started    = true;
+	hls->keyframe_requested = false;
+}
+
+/* a new segment starts at the first keyframe after the target duration.  if
+ * the encoder's keyframe interval is longer than that, a keyframe is asked
+ * for once the target is reached, so segments don't run long */
+static void write_packet(struct hls_output *hls, struct encoder_packet *packet)
+{
+	bool keyframe = packet->type == OBS_ENCODER_VIDEO && packet->keyframe;
+
+	if (packet->type == OBS_ENCODER_VIDEO && !keyframe &&
+	    hls->segment_started && !hls->keyframe_requested &&
+	    packet->dts_usec - hls->segment_start_usec >= hls->target_usec) {
+		obs_encoder_request_keyframe(packet->encoder);
+		hls->keyframe_requested = true;
+	}
+
+	if (keyframe) {
+		if (!hls->segment_started) {
+			start_segment(hls, packet->dts_usec);
+
+		} else if (packet->dts_usec - hls->segment_start_usec >=
+				hls->target_usec) {
+			finish_segment(hls, packet->dts_usec, false);
+			start_segment(hls, packet->dts_usec);
+		}
+	}
+
+	/* anything before the first keyframe can't be decoded */
+	if (!hls->segment_started)
+		return;
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		hls->last_dts_usec = packet->dts_usec;
+
+	ts_mux_packet(&hls->mux, packet);
+}
+
+static void *write_thread(void *data)
+{
+	struct hls_output *hls = data;
+
+	os_thread_init(OS_THREAD_CLASS_OUTPUT, "hls write");
+
+	while (os_sem_wait(hls->write_sem) == 0) {
+		struct encoder_packet packet;
+		bool                  have_packet = false;
+
+		pthread_mutex_lock(&hls->packets_mutex);
+		if (hls->packets.size) {
+			circlebuf_pop_front(&hls->packets, &packet,
+					sizeof(packet));
+			have_packet = true;
+		}
+		pthread_mutex_unlock(&hls->packets_mutex);
+
+		if (have_packet) {
+			uint64_t start = trace_begin();
+			write_packet(hls, &packet);
+			obs_encoder_packet_release(&packet);
+			trace_end("hls_write_packet", start);
+		} else if (hls->stopping) {
+			break;
+		}
+	}
+
+	if (hls->segment_started)
+		finish_segment(hls, hls->last_dts_usec + hls->frame_usec,
+				true);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void hls_output_data(void *data, struct encoder_packet *packet)
+{
+	struct hls_output     *hls = data;
+	struct encoder_packet new_packet;
+
+	obs_encoder_packet_ref(&new_packet, packet);
+
+	pthread_mutex_lock(&hls->packets_mutex);
+	circlebuf_push_back(&hls->packets, &new_packet, sizeof(new_packet));
+	pthread_mutex_unlock(&hls->packets_mutex);
+
+	os_sem_post(hls->write_sem);
+}
+
+static void update_settings(struct hls_output *hls, obs_data_t settings)
+{
+	const char *path = obs_data_getstring(settings, "path");
+	const char *name = obs_data_getstring(settings, "name");
+	int64_t    duration = obs_data_getint(settings, "segment_duration");
+	int64_t    size     = obs_data_getint(settings, "playlist_size");
+
+	dstr_copy(&hls->path, path);
+	dstr_copy(&hls->name, name && *name ? name : "stream");
+
+	while (hls->path.len && (hls->path.array[hls->path.len - 1] == '/' ||
+	                         hls->path.array[hls->path.len - 1] == '\\'))
+		dstr_resize(&hls->path, hls->path.len - 1);
+
+	hls->target_usec     = (duration > 0 ? duration : 1) * 1000000LL;
+	hls->playlist_size   = size > 0 ? (size_t)size : 0;
+	hls->delete_segments = obs_data_getbool(settings, "delete_segments");
+}
+
+static void hls_output_destroy(void *data)
+{
+	struct hls_output *hls = data;
+
+	if (hls) {
+		free_packets(hls);
+		circlebuf_free(&hls->packets);
+		os_sem_destroy(hls->write_sem);
+		pthread_mutex_destroy(&hls->packets_mutex);
+		da_free(hls->segments);
+		dstr_free(&hls->path);
+		dstr_free(&hls->name);
+		bfree(hls);
+	}
+}
+
+static void *hls_output_create(obs_data_t settings, obs_output_t output)
+{
+	struct hls_output *hls = bzalloc(sizeof(struct hls_output));
+	hls->output = output;
+	pthread_mutex_init_value(&hls->packets_mutex);
+
+	if (pthread_mutex_init(&hls->packets_mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&hls->write_sem, 0) != 0)
+		goto fail;
+
+	UNUSED_PARAMETER(settings);
+	return hls;
+
+fail:
+	hls_output_destroy(hls);
+	return NULL;
+}
+
+static bool hls_output_start(void *data)
+{
+	struct hls_output *hls = data;
+	obs_encoder_t     vencoder;
+	video_t           video;
+	obs_data_t        settings;
+
+	if (!obs_output_can_begin_data_capture(hls->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(hls->output, 0))
+		return false;
+
+	settings = obs_output_get_settings(hls->output);
+	update_settings(hls, settings);
+	obs_data_release(settings);
+
+	if (!hls->path.len) {
+		blog(LOG_WARNING, "HLS output: no path specified");
+		return false;
+	}
+
+	vencoder = obs_output_get_video_encoder(hls->output);
+	video    = obs_encoder_video(vencoder);
+
+	ts_mux_init(&hls->mux, vencoder,
+			obs_output_get_audio_encoder(hls->output));
+
+	hls->frame_usec      = (int64_t)(1000000.0 *
+			obs_encoder_get_frame_rate_divisor(vencoder) /
+			video_output_framerate(video));
+	hls->segment_started = false;
+	hls->segment_index   = 0;
+	hls->write_failed    = false;
+	hls->stopping        = false;
+	da_resize(hls->segments, 0);
+
+	if (pthread_create(&hls->write_thread, NULL, write_thread, hls) != 0) {
+		blog(LOG_WARNING, "HLS output: failed to create write thread");
+		ts_mux_free(&hls->mux);
+		return false;
+	}
+
+	hls->write_thread_active = true;
+	return obs_output_begin_data_capture(hls->output, 0);
+}
+
+static void hls_output_stop(void *data)
+{
+	struct hls_output *hls = data;
+
+	obs_output_end_data_capture(hls->output);
+
+	/* the remaining packets are written before the thread exits, and the
+	 * last segment closes the playlist */
+	if (hls->write_thread_active) {
+		hls->stopping = true;
+		os_sem_post(hls->write_sem);
+		pthread_join(hls->write_thread, NULL);
+		hls->write_thread_active = false;
+
+		ts_mux_free(&hls->mux);
+	}
+
+	pthread_mutex_lock(&hls->packets_mutex);
+	free_packets(hls);
+	pthread_mutex_unlock(&hls->packets_mutex);
+}
+
+static void hls_output_defaults(obs_data_t defaults)
+{
+	obs_data_set_default_string(defaults, "name", "stream");
+	obs_data_set_default_int(defaults, "segment_duration", 4);
+	obs_data_set_default_int(defaults, "playlist_size", 5);
+	obs_data_set_default_bool(defaults, "delete_segments", true);
+}
+
+static obs_properties_t hls_output_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_path(props, "path", "Directory");
+	obs_properties_add_text(props, "name", "Playlist Name",
+			OBS_TEXT_DEFAULT);
+	obs_properties_add_int(props, "segment_duration",
+			"Segment Duration (s)", 1, 60, 1);
+	obs_properties_add_int(props, "playlist_size",
+			"Segments in Playlist (0 = all)", 0, 100, 1);
+	obs_properties_add_bool(props, "delete_segments",
+			"Delete Old Segments");
+	return props;
+}
+
+struct obs_output_info hls_output_info = {
+	.id             = "hls_output",
+	.flags          = OBS_OUTPUT_AV |
+	                  OBS_OUTPUT_ENCODED,
+	.getname        = hls_output_getname,
+	.create         = hls_output_create,
+	.destroy        = hls_output_destroy,
+	.start          = hls_output_start,
+	.stop           = hls_output_stop,
+	.encoded_packet = hls_output_data,
+	.defaults       = hls_output_defaults,
+	.properties     = hls_output_properties
+};
@@ -135,6 +135,7 @@ static void HandleClientBW(RTMP *r, const RTMPPacket *packet);
 
 static int ReadN(RTMP *r, char *buffer, int n);
 static int WriteN(RTMP *r, const char *buffer, int n);
+static int WriteV(RTMP *r, RTMPBuf *bufs, int count);
 
 static void DecodeTEA(AVal *key, AVal *text);
 
@@ -273,7 +274,7 @@ RTMP_TLS_Init()
     SSL_library_init();
     OpenSSL_add_all_digests();
     RTMP_TLS_ctx = SSL_CTX_new(SSLv23_method());
-    SSL_CTX_set_options(RTMP_TLS_ctx, SSL_OP_ALL);
+    SSL_CTX_set_options(RTMP_TLS_ctx, SSL_OP_ALL | SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3);
     SSL_CTX_set_default_verify_paths(RTMP_TLS_ctx);
 #endif
 #endif
@@ -348,6 +349,17 @@ RTMP_TLS_FreeServerContext(void *ctx)
 #endif
 }
 
+void
+RTMP_TLS_FreeSession(void *session)
+{
+#if defined(CRYPTO) && !defined(NO_SSL)
+    if (session)
+        TLS_freesession(session);
+#else
+    (void)session;
+#endif
+}
+
 RTMP *
 RTMP_Alloc()
 {
@@ -1251,8 +1263,23 @@ RTMP_Connect1(RTMP *r, RTMPPacket *cp)
     if (r->Link.protocol & RTMP_FEATURE_SSL)
     {
 #if defined(CRYPTO) && !defined(NO_SSL)
+        char host[256];
+        int len = r->Link.hostname.av_len;
+
+        if (len > (int)sizeof(host) - 1)
+            len = (int)sizeof(host) - 1;
+        memcpy(host, r->Link.hostname.av_val, len);
+        host[len] = 0;
+
         TLS_client(RTMP_TLS_ctx, r->m_sb.sb_ssl);
         TLS_setfd(r->m_sb.sb_ssl, r->m_sb.sb_socket);
+        TLS_sethost(r->m_sb.sb_ssl, host);
+
+        /* resuming the last session skips most of the handshake when
+         * reconnecting, the server falls back to a full one otherwise */
+        if (r->m_tlsSession)
+            TLS_setsession(r->m_sb.sb_ssl, r->m_tlsSession);
+
         if (TLS_connect(r->m_sb.sb_ssl) < 0)
         {
             RTMP_Log(RTMP_LOGERROR, "%s, TLS_Connect failed", __FUNCTION__);
@@ -1835,6 +1862,48 @@ WriteN(RTMP *r, const char *buffer, int n)
     return n == 0;
 }
 
+/* same as WriteN for several buffers at once, resumes partial writes */
+static int
+WriteV(RTMP *r, RTMPBuf *bufs, int count)
+{
+    while (count > 0)
+    {
+        int nBytes = RTMPSockBuf_SendV(&r->m_sb, bufs,
+                                       count < RTMP_MAX_IOV ? count : RTMP_MAX_IOV);
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__,
+                     sockerr);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        while (count > 0 && nBytes >= bufs->b_size)
+        {
+            nBytes -= bufs->b_size;
+            bufs++;
+            count--;
+        }
+
+        if (count > 0)
+        {
+            bufs->b_data += nBytes;
+            bufs->b_size -= nBytes;
+        }
+    }
+
+    return TRUE;
+}
+
 #define SAVC(x)	static const AVal av_##x = AVC(#x)
 
 SAVC(app);
@@ -1854,6 +1923,43 @@ SAVC(secureTokenResponse);
 SAVC(type);
 SAVC(nonprivate);
 
+static int
+SendChunkSize(RTMP *r)
+{
+    RTMPPacket packet;
+    char pbuf[RTMP_MAX_HEADER_SIZE + 4], *pend = pbuf + sizeof(pbuf);
+
+    packet.m_nChannel = 0x02;
+    packet.m_headerType = RTMP_PACKET_SIZE_LARGE;
+    packet.m_packetType = RTMP_PACKET_TYPE_CHUNK_SIZE;
+    packet.m_nTimeStamp = 0;
+    packet.m_nInfoField2 = 0;
+    packet.m_hasAbsTimestamp = 0;
+    packet.m_body = pbuf + RTMP_MAX_HEADER_SIZE;
+    packet.m_nBodySize = 4;
+
+    AMF_EncodeInt32(packet.m_body, pend, r->m_outChunkSize);
+
+    return RTMP_SendPacket(r, &packet, FALSE);
+}
+
+int
+RTMP_SetChunkSize(RTMP *r, int size)
+{
+    if (size < RTMP_DEFAULT_CHUNKSIZE)
+        size = RTMP_DEFAULT_CHUNKSIZE;
+    else if (size > RTMP_MAX_CHUNKSIZE)
+        size = RTMP_MAX_CHUNKSIZE;
+
+    r->m_outChunkSize = size;
+
+    /* before connecting, the size is sent along with the connect packet */
+    if (!RTMP_IsConnected(r))
+        return TRUE;
+
+    return SendChunkSize(r);
+}
+
 static int
 SendConnectPacket(RTMP *r, RTMPPacket *cp)
 {
@@ -1866,19 +1972,7 @@ SendConnectPacket(RTMP *r, RTMPPacket *cp)
 
     if((r->Link.protocol & RTMP_FEATURE_WRITE) && r->m_bSendChunkSizeInfo)
     {
-        packet.m_nChannel = 0x02;
-        packet.m_headerType = RTMP_PACKET_SIZE_LARGE;
-        packet.m_packetType = RTMP_PACKET_TYPE_CHUNK_SIZE;
-        packet.m_nTimeStamp = 0;
-        packet.m_nInfoField2 = 0;
-        packet.m_hasAbsTimestamp = 0;
-        packet.m_body = pbuf + RTMP_MAX_HEADER_SIZE;
-        packet.m_nBodySize = 4;
-
-        enc = packet.m_body;
-        AMF_EncodeInt32(enc, pend, r->m_outChunkSize);
-
-        if(!RTMP_SendPacket(r, &packet, FALSE))
+        if(!SendChunkSize(r))
             return 0;
     }
 
@@ -4262,6 +4356,63 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
     return wrote;
 }
 
+/* plain and TLS sockets only, everything else has to go through WriteN */
+static int
+CanWriteV(RTMP *r)
+{
+    if (r->Link.protocol & RTMP_FEATURE_HTTP)
+        return FALSE;
+    if (r->m_bCustomSend && r->m_customSendFunc)
+        return FALSE;
+#ifdef CRYPTO
+    if (r->Link.rc4keyOut)
+        return FALSE;
+#endif
+    return TRUE;
+}
+
+static int
+SendChunks(RTMP *r, const char *header, int hSize, const char *buffer,
+           int nSize, int nChunkSize, const char *chunkHeader,
+           int chunkHeaderSize)
+{
+    RTMPBuf bufs[RTMP_MAX_IOV];
+    int count = 0;
+    int first = TRUE;
+
+    RTMP_LogHexString(RTMP_LOGDEBUG2, (uint8_t *)header, hSize);
+
+    bufs[count].b_data = header;
+    bufs[count++].b_size = hSize;
+
+    while (nSize > 0)
+    {
+        int size = nSize < nChunkSize ? nSize : nChunkSize;
+
+        if (count + 2 > RTMP_MAX_IOV)
+        {
+            if (!WriteV(r, bufs, count))
+                return FALSE;
+            count = 0;
+        }
+
+        if (!first)
+        {
+            bufs[count].b_data = chunkHeader;
+            bufs[count++].b_size = chunkHeaderSize;
+        }
+        first = FALSE;
+
+        bufs[count].b_data = buffer;
+        bufs[count++].b_size = size;
+
+        buffer += size;
+        nSize -= size;
+    }
+
+    return WriteV(r, bufs, count);
+}
+
 int
 RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
 {
@@ -4390,6 +4541,29 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
 
     RTMP_Log(RTMP_LOGDEBUG2, "%s: fd=%d, size=%d", __FUNCTION__, r->m_sb.sb_socket,
              nSize);
+    /* gather the chunks straight from the body instead of writing them one
+     * at a time; the continuation headers are all the same */
+    if (CanWriteV(r))
+    {
+        char chunkHeader[3];
+        int chunkHeaderSize = 1 + cSize;
+
+        chunkHeader[0] = (0xc0 | c);
+        if (cSize)
+        {
+            int tmp = packet->m_nChannel - 64;
+            chunkHeader[1] = tmp & 0xff;
+            if (cSize == 2)
+                chunkHeader[2] = tmp >> 8;
+        }
+
+        if (!SendChunks(r, header, hSize, buffer, nSize, nChunkSize,
+                        chunkHeader, chunkHeaderSize))
+            return FALSE;
+
+        nSize = 0;
+        hSize = 0;
+    }
     /* send all chunks in one HTTP request */
     if (r->Link.protocol & RTMP_FEATURE_HTTP)
     {
@@ -4507,6 +4681,14 @@ RTMP_Close(RTMP *r)
             r->m_clientID.av_val = NULL;
             r->m_clientID.av_len = 0;
         }
+#if defined(CRYPTO) && !defined(NO_SSL)
+        if (r->m_sb.sb_ssl)
+        {
+            if (r->m_tlsSession)
+                TLS_freesession(r->m_tlsSession);
+            r->m_tlsSession = TLS_getsession(r->m_sb.sb_ssl);
+        }
+#endif
         RTMPSockBuf_Close(&r->m_sb);
     }
 
@@ -4689,6 +4871,113 @@ RTMPSockBuf_Send(RTMPSockBuf *sb, const char *buf, int len)
     return rc;
 }
 
+#if defined(CRYPTO) && !defined(NO_SSL)
+/* every TLS write becomes at least one record of its own, so the buffers
+ * are coalesced into full records rather than written one by one, which
+ * would mean a record (and its MAC and padding) per chunk header.  whole
+ * records are written in place. */
+static int
+SendV_TLS(RTMPSockBuf *sb, const RTMPBuf *bufs, int count)
+{
+    char rec[RTMP_TLS_RECORD_SIZE];
+    int used = 0;
+    int sent = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        const char *data = bufs[i].b_data;
+        int size = bufs[i].b_size;
+
+        while (size > 0)
+        {
+            int copy;
+
+            if (!used && size >= RTMP_TLS_RECORD_SIZE)
+            {
+                copy = size - size % RTMP_TLS_RECORD_SIZE;
+                if (TLS_write(sb->sb_ssl, data, copy) <= 0)
+                    return sent ? sent : -1;
+
+                sent += copy;
+                data += copy;
+                size -= copy;
+                continue;
+            }
+
+            copy = RTMP_TLS_RECORD_SIZE - used;
+            if (copy > size)
+                copy = size;
+
+            memcpy(rec + used, data, copy);
+            used += copy;
+            data += copy;
+            size -= copy;
+
+            if (used == RTMP_TLS_RECORD_SIZE)
+            {
+                if (TLS_write(sb->sb_ssl, rec, used) <= 0)
+                    return sent ? sent : -1;
+
+                sent += used;
+                used = 0;
+            }
+        }
+    }
+
+    if (used)
+    {
+        if (TLS_write(sb->sb_ssl, rec, used) <= 0)
+            return sent ? sent : -1;
+        sent += used;
+    }
+
+    return sent;
+}
+#endif
+
+int
+RTMPSockBuf_SendV(RTMPSockBuf *sb, const RTMPBuf *bufs, int count)
+{
+#ifdef _WIN32
+    WSABUF wbufs[RTMP_MAX_IOV];
+    DWORD sent = 0;
+#else
+    struct iovec iov[RTMP_MAX_IOV];
+#endif
+    int i;
+
+    if (count > RTMP_MAX_IOV)
+        count = RTMP_MAX_IOV;
+
+    for (i = 0; i < count; i++)
+    {
+#if defined(RTMP_NETSTACK_DUMP)
+        fwrite(bufs[i].b_data, 1, bufs[i].b_size, netstackdump);
+#endif
+#ifdef _WIN32
+        wbufs[i].buf = (char *)bufs[i].b_data;
+        wbufs[i].len = bufs[i].b_size;
+#else
+        iov[i].iov_base = (void *)bufs[i].b_data;
+        iov[i].iov_len = bufs[i].b_size;
+#endif
+    }
+
+#if defined(CRYPTO) && !defined(NO_SSL)
+    if (sb->sb_ssl)
+        return SendV_TLS(sb, bufs, count);
+#endif
+
+#ifdef _WIN32
+    if (WSASend(sb->sb_socket, wbufs, count, &sent, 0, NULL, NULL) != 0)
+        return -1;
+    return (int)sent;
+#else
+    return (int)writev(sb->sb_socket, iov, count);
+#endif
+}
+
 int
 RTMPSockBuf_Close(RTMPSockBuf *sb)
 {
@@ -5557,3 +5846,86 @@ RTMP_Write(RTMP *r, const char *buf, int size)
     }
     return size+s2;
 }
+
+int
+RTMP_WriteV(RTMP *r, const RTMPBuf *bufs, int count)
+{
+    RTMPPacket pkt = {0};
+    const char *buf;
+    char *enc, *pend;
+    int i, num, ret, total = 0;
+
+    if (count < 1 || bufs[0].b_size < 11)
+    {
+        /* FLV pkt too small */
+        return 0;
+    }
+
+    buf = bufs[0].b_data;
+
+    pkt.m_nChannel = 0x04;	/* source channel */
+    pkt.m_nInfoField2 = r->m_stream_id;
+    pkt.m_packetType = *buf++;
+    pkt.m_nBodySize = AMF_DecodeInt24(buf);
+    buf += 3;
+    pkt.m_nTimeStamp = AMF_DecodeInt24(buf);
+    buf += 3;
+    pkt.m_nTimeStamp |= *buf++ << 24;
+
+    if (((pkt.m_packetType == RTMP_PACKET_TYPE_AUDIO
+            || pkt.m_packetType == RTMP_PACKET_TYPE_VIDEO) &&
+            !pkt.m_nTimeStamp) || pkt.m_packetType == RTMP_PACKET_TYPE_INFO)
+    {
+        pkt.m_headerType = RTMP_PACKET_SIZE_LARGE;
+        if (pkt.m_packetType == RTMP_PACKET_TYPE_INFO)
+            pkt.m_nBodySize += 16;
+    }
+    else
+    {
+        pkt.m_headerType = RTMP_PACKET_SIZE_MEDIUM;
+    }
+
+    if (!RTMPPacket_Alloc(&pkt, pkt.m_nBodySize))
+    {
+        RTMP_Log(RTMP_LOGDEBUG, "%s, failed to allocate packet", __FUNCTION__);
+        return FALSE;
+    }
+    enc = pkt.m_body;
+    pend = enc + pkt.m_nBodySize;
+    if (pkt.m_packetType == RTMP_PACKET_TYPE_INFO)
+    {
+        enc = AMF_EncodeString(enc, pend, &av_setDataFrame);
+        pkt.m_nBytesRead = enc - pkt.m_body;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        int offset = (i == 0) ? 11 : 0;
+
+        buf = bufs[i].b_data + offset;
+        num = bufs[i].b_size - offset;
+        total += bufs[i].b_size;
+
+        if (num > (int)(pkt.m_nBodySize - pkt.m_nBytesRead))
+            num = pkt.m_nBodySize - pkt.m_nBytesRead;
+        if (num <= 0)
+            continue;
+
+        memcpy(pkt.m_body + pkt.m_nBytesRead, buf, num);
+        pkt.m_nBytesRead += num;
+    }
+
+    if (pkt.m_nBytesRead != pkt.m_nBodySize)
+    {
+        RTMP_Log(RTMP_LOGDEBUG, "%s, incomplete FLV tag", __FUNCTION__);
+        RTMPPacket_Free(&pkt);
+        return FALSE;
+    }
+
+    ret = RTMP_SendPacket(r, &pkt, FALSE);
+    RTMPPacket_Free(&pkt);
+    if (!ret)
+        return -1;
+
+    return total;
+}
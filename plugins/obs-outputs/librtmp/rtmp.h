@@ -25,7 +25,11 @@
  *  http://www.gnu.org/copyleft/lgpl.html
  */
 
+/* CRYPTO (along with the TLS library, USE_OPENSSL by default) is defined by
+ * the build when a TLS library was found, which enables rtmps:// */
+#ifndef CRYPTO
 #define NO_CRYPTO 1
+#endif
 
 #if !defined(NO_CRYPTO) && !defined(CRYPTO)
 #define CRYPTO
@@ -72,6 +76,7 @@ extern "C"
 #define RTMP_PROTOCOL_RTMFP     RTMP_FEATURE_MFP
 
 #define RTMP_DEFAULT_CHUNKSIZE	128
+#define RTMP_MAX_CHUNKSIZE	65536
 
     /* needs to fit largest number of bytes recv() may return */
 #define RTMP_BUFFER_CACHE_SIZE (16*1024)
@@ -284,6 +289,12 @@ extern "C"
         void*   m_customSendParam;
         CUSTOMSEND m_customSendFunc;
 
+        /* session of the last TLS connection, set by RTMP_Close and resumed
+         * by the next RTMP_Connect.  not freed by RTMP_Init, callers that
+         * reconnect keep it across RTMP_Init and free it with
+         * RTMP_TLS_FreeSession */
+        void *m_tlsSession;
+
         RTMP_BINDINFO m_bindIP;
 
         uint8_t m_bSendChunkSizeInfo;
@@ -377,6 +388,7 @@ extern "C"
 
     void *RTMP_TLS_AllocServerContext(const char* cert, const char* key);
     void RTMP_TLS_FreeServerContext(void *ctx);
+    void RTMP_TLS_FreeSession(void *session);
 
     int RTMP_LibVersion(void);
     void RTMP_UserInterrupt(void);	/* user typed Ctrl-C */
@@ -394,7 +406,6 @@ extern "C"
                                        AMFObjectProperty * p);
 
     int RTMPSockBuf_Fill(RTMPSockBuf *sb);
-    int RTMPSockBuf_Send(RTMPSockBuf *sb, const char *buf, int len);
     int RTMPSockBuf_Close(RTMPSockBuf *sb);
 
     int RTMP_SendCreateStream(RTMP *r);
@@ -405,6 +416,31 @@ extern "C"
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size);
 
+    /* writes a single FLV tag that is split across several buffers.  the
+     * first buffer must contain at least the 11 byte tag header; anything
+     * past the end of the tag body (i.e. the tag size) is ignored. */
+    typedef struct RTMPBuf
+    {
+        const char *b_data;
+        int b_size;
+    } RTMPBuf;
+
+    int RTMP_WriteV(RTMP *r, const RTMPBuf *bufs, int count);
+
+    /* buffers gathered by a single RTMPSockBuf_SendV call */
+#define RTMP_MAX_IOV	256
+
+    /* largest TLS record payload, small buffers are coalesced into records
+     * of this size when sending over TLS */
+#define RTMP_TLS_RECORD_SIZE	16384
+
+    int RTMPSockBuf_Send(RTMPSockBuf *sb, const char *buf, int len);
+    int RTMPSockBuf_SendV(RTMPSockBuf *sb, const RTMPBuf *bufs, int count);
+
+    /* sets the outgoing chunk size, and tells the server about it right
+     * away if already connected */
+    int RTMP_SetChunkSize(RTMP *r, int size);
+
     /* hashswf.c */
     int RTMP_HashSWF(const char *url, unsigned int *size, unsigned char *hash,
                      int age);
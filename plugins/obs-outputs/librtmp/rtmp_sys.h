@@ -60,6 +60,7 @@
 #else /* !_WIN32 */
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/times.h>
 #include <netdb.h>
 #include <unistd.h>
@@ -123,6 +124,11 @@ typedef struct tls_server_ctx
 #define TLS_write(s,b,l)	ssl_write(s,(unsigned char *)b,l)
 #define TLS_shutdown(s)	ssl_close_notify(s)
 #define TLS_close(s)	ssl_free(s); free(s)
+#define TLS_sethost(s,h)	ssl_set_hostname(s,h)
+/* the client session is already kept in the context */
+#define TLS_getsession(s)	NULL
+#define TLS_setsession(s,ssn)
+#define TLS_freesession(ssn)
 
 #elif defined(USE_GNUTLS)
 #include <gnutls/gnutls.h>
@@ -141,6 +147,10 @@ typedef struct tls_ctx
 #define TLS_write(s,b,l)	gnutls_record_send(s,b,l)
 #define TLS_shutdown(s)	gnutls_bye(s, GNUTLS_SHUT_RDWR)
 #define TLS_close(s)	gnutls_deinit(s)
+#define TLS_sethost(s,h)	gnutls_server_name_set(s, GNUTLS_NAME_DNS, h, strlen(h))
+#define TLS_getsession(s)	NULL
+#define TLS_setsession(s,ssn)
+#define TLS_freesession(ssn)
 
 #elif defined(USE_ONLY_MD5)
 #include "md5.h"
@@ -158,6 +168,10 @@ typedef struct tls_ctx
 #define TLS_write(s,b,l)	SSL_write(s,b,l)
 #define TLS_shutdown(s)	SSL_shutdown(s)
 #define TLS_close(s)	SSL_free(s)
+#define TLS_sethost(s,h)	SSL_set_tlsext_host_name(s,h)
+#define TLS_getsession(s)	SSL_get1_session(s)
+#define TLS_setsession(s,ssn)	SSL_set_session(s,ssn)
+#define TLS_freesession(ssn)	SSL_SESSION_free(ssn)
 
 #endif
 #endif
@@ -0,0 +1,222 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs.h>
+#include <util/platform.h>
+#include <util/profiler.h>
+#include <util/threading.h>
+
+/* Null output
+ *
+ * Takes encoded packets from its encoders and throws them away, so encoders
+ * can be tested without streaming or writing files.  The packet counts can be
+ * read with the get_stats procedure, and the time from when each frame was
+ * captured to when its packet arrived is added to the "null_output: video
+ * latency" and "null_output: audio latency" profile points. */
+
+struct null_output {
+	obs_output_t    output;
+
+	pthread_mutex_t mutex;
+	long long       video_packets;
+	long long       audio_packets;
+	long long       video_bytes;
+	long long       audio_bytes;
+	long long       keyframes;
+	int64_t         last_video_latency_usec;
+	int64_t         max_video_latency_usec;
+
+	uint64_t        start_time;
+	uint64_t        stop_time;
+
+	profile_point_t video_latency;
+	profile_point_t audio_latency;
+};
+
+static const char *null_output_getname(const char *locale)
+{
+	/* TODO: locale stuff */
+	UNUSED_PARAMETER(locale);
+	return "Null Output";
+}
+
+static void reset_stats(struct null_output *no)
+{
+	pthread_mutex_lock(&no->mutex);
+	no->video_packets           = 0;
+	no->audio_packets           = 0;
+	no->video_bytes             = 0;
+	no->audio_bytes             = 0;
+	no->keyframes               = 0;
+	no->last_video_latency_usec = 0;
+	no->max_video_latency_usec  = 0;
+	no->start_time              = os_gettime_ns();
+	no->stop_time               = 0;
+	pthread_mutex_unlock(&no->mutex);
+}
+
+static void null_output_get_stats(void *data, calldata_t params)
+{
+	struct null_output *no = data;
+	uint64_t           end_time;
+
+	pthread_mutex_lock(&no->mutex);
+
+	end_time = no->stop_time ? no->stop_time : os_gettime_ns();
+
+	calldata_setint(params, "video_packets", no->video_packets);
+	calldata_setint(params, "audio_packets", no->audio_packets);
+	calldata_setint(params, "video_bytes",   no->video_bytes);
+	calldata_setint(params, "audio_bytes",   no->audio_bytes);
+	calldata_setint(params, "keyframes",     no->keyframes);
+	calldata_setint(params, "last_video_latency_usec",
+			(long long)no->last_video_latency_usec);
+	calldata_setint(params, "max_video_latency_usec",
+			(long long)no->max_video_latency_usec);
+	calldata_setint(params, "elapsed_ns", no->start_time ?
+			(long long)(end_time - no->start_time) : 0);
+
+	pthread_mutex_unlock(&no->mutex);
+}
+
+static void null_output_reset_stats(void *data, calldata_t params)
+{
+	reset_stats(data);
+	UNUSED_PARAMETER(params);
+}
+
+static void null_output_destroy(void *data)
+{
+	struct null_output *no = data;
+
+	if (no) {
+		pthread_mutex_destroy(&no->mutex);
+		bfree(no);
+	}
+}
+
+static void *null_output_create(obs_data_t settings, obs_output_t output)
+{
+	struct null_output *no = bzalloc(sizeof(struct null_output));
+	proc_handler_t     ph  = obs_output_prochandler(output);
+
+	no->output = output;
+
+	if (pthread_mutex_init(&no->mutex, NULL) != 0) {
+		bfree(no);
+		return NULL;
+	}
+
+	no->video_latency = profile_point_get("null_output: video latency");
+	no->audio_latency = profile_point_get("null_output: audio latency");
+
+	proc_handler_add(ph, "void get_stats(out int video_packets, "
+			"out int audio_packets, out int video_bytes, "
+			"out int audio_bytes, out int keyframes, "
+			"out int last_video_latency_usec, "
+			"out int max_video_latency_usec, out int elapsed_ns)",
+			null_output_get_stats, no);
+	proc_handler_add(ph, "void reset_stats()",
+			null_output_reset_stats, no);
+
+	UNUSED_PARAMETER(settings);
+	return no;
+}
+
+static bool null_output_start(void *data)
+{
+	struct null_output *no = data;
+
+	if (!obs_output_can_begin_data_capture(no->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(no->output, 0))
+		return false;
+
+	reset_stats(no);
+	return obs_output_begin_data_capture(no->output, 0);
+}
+
+static void null_output_stop(void *data)
+{
+	struct null_output *no = data;
+
+	obs_output_end_data_capture(no->output);
+
+	pthread_mutex_lock(&no->mutex);
+	no->stop_time = os_gettime_ns();
+
+	blog(LOG_INFO, "null output: %lld video packets (%lld keyframes, "
+	               "%lld bytes), %lld audio packets (%lld bytes), "
+	               "max video latency %lldus",
+	               no->video_packets, no->keyframes, no->video_bytes,
+	               no->audio_packets, no->audio_bytes,
+	               (long long)no->max_video_latency_usec);
+	pthread_mutex_unlock(&no->mutex);
+}
+
+/* the system time of the frame the packet was encoded from.  the dts of
+ * packets with b-frames is earlier than the frame's timestamp, so the
+ * difference to the pts is added back */
+static inline int64_t packet_frame_usec(struct encoder_packet *packet)
+{
+	return packet->sys_dts_usec + (packet->pts - packet->dts) *
+		1000000LL * packet->timebase_num / packet->timebase_den;
+}
+
+static void null_output_data(void *data, struct encoder_packet *packet)
+{
+	struct null_output *no      = data;
+	int64_t            now_usec = (int64_t)(os_gettime_ns() / 1000);
+	int64_t            latency  = now_usec - packet_frame_usec(packet);
+
+	if (latency < 0)
+		latency = 0;
+
+	pthread_mutex_lock(&no->mutex);
+
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		no->video_packets++;
+		no->video_bytes += (long long)packet->size;
+		if (packet->keyframe)
+			no->keyframes++;
+
+		no->last_video_latency_usec = latency;
+		if (latency > no->max_video_latency_usec)
+			no->max_video_latency_usec = latency;
+	} else {
+		no->audio_packets++;
+		no->audio_bytes += (long long)packet->size;
+	}
+
+	pthread_mutex_unlock(&no->mutex);
+
+	if (profiler_enabled())
+		profile_add_sample(packet->type == OBS_ENCODER_VIDEO ?
+				no->video_latency : no->audio_latency,
+				(uint64_t)latency * 1000);
+}
+
+struct obs_output_info null_output_info = {
+	.id             = "null_output",
+	.flags          = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED,
+	.getname        = null_output_getname,
+	.create         = null_output_create,
+	.destroy        = null_output_destroy,
+	.start          = null_output_start,
+	.stop           = null_output_stop,
+	.encoded_packet = null_output_data
+};
@@ -5,9 +5,20 @@
 #include <winsock2.h>
 #endif
 
+#ifdef HAVE_SRT
+#include <srt/srt.h>
+#endif
+
 OBS_DECLARE_MODULE()
 
 extern struct obs_output_info rtmp_output_info;
+extern struct obs_output_info replay_buffer_info;
+extern struct obs_output_info null_output_info;
+extern struct obs_output_info hls_output_info;
+extern struct obs_output_info shmem_output_info;
+#ifdef HAVE_SRT
+extern struct obs_output_info srt_output_info;
+#endif
 
 bool obs_module_load(uint32_t libobs_ver)
 {
@@ -17,14 +28,28 @@ bool obs_module_load(uint32_t libobs_ver)
 #endif
 
 	obs_register_output(&rtmp_output_info);
+	obs_register_output(&replay_buffer_info);
+	obs_register_output(&null_output_info);
+	obs_register_output(&hls_output_info);
+	obs_register_output(&shmem_output_info);
+
+#ifdef HAVE_SRT
+	srt_startup();
+	obs_register_output(&srt_output_info);
+#endif
 
 	UNUSED_PARAMETER(libobs_ver);
 	return true;
 }
 
-#ifdef _WIN32
+#if defined(_WIN32) || defined(HAVE_SRT)
 void obs_module_unload(void)
 {
+#ifdef HAVE_SRT
+	srt_cleanup();
+#endif
+#ifdef _WIN32
 	WSACleanup();
+#endif
 }
 #endif
@@ -0,0 +1,471 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs.h>
+#include <obs-avc.h>
+#include <util/platform.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include "flv-mux.h"
+
+/* Replay buffer output
+ *
+ * Keeps the most recent encoded packets in memory, trimmed a GOP at a time so
+ * that the buffer always starts on a keyframe, and writes them out to an FLV
+ * file on request without interrupting the encoders. */
+
+struct replay_buffer {
+	obs_output_t     output;
+
+	pthread_mutex_t  packets_mutex;
+	struct circlebuf packets;
+	size_t           mem_size;
+	size_t           keyframes;
+	int64_t          last_dts_usec;
+
+	int64_t          max_time_usec;
+	size_t           max_size;
+
+	bool             save_thread_active;
+	volatile long    saving;
+	pthread_t        save_thread;
+};
+
+struct replay_save {
+	struct replay_buffer          *rb;
+	struct dstr                   path;
+	DARRAY(uint8_t)               header;
+	DARRAY(struct encoder_packet) packets;
+};
+
+static const char *replay_buffer_getname(const char *locale)
+{
+	/* TODO: locale stuff */
+	UNUSED_PARAMETER(locale);
+	return "Replay Buffer";
+}
+
+static inline size_t num_buffered_packets(struct replay_buffer *rb)
+{
+	return rb->packets.size / sizeof(struct encoder_packet);
+}
+
+static void free_packets(struct replay_buffer *rb)
+{
+	while (rb->packets.size) {
+		struct encoder_packet packet;
+		circlebuf_pop_front(&rb->packets, &packet, sizeof(packet));
+		obs_encoder_packet_release(&packet);
+	}
+
+	rb->mem_size  = 0;
+	rb->keyframes = 0;
+}
+
+static inline bool is_keyframe(struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO && packet->keyframe;
+}
+
+/* removes the oldest GOP, along with any audio that goes with it */
+static void purge_front(struct replay_buffer *rb)
+{
+	struct encoder_packet packet;
+
+	do {
+		circlebuf_pop_front(&rb->packets, &packet, sizeof(packet));
+
+		if (is_keyframe(&packet))
+			rb->keyframes--;
+		rb->mem_size -= packet.size;
+		obs_encoder_packet_release(&packet);
+
+		if (!rb->packets.size)
+			break;
+
+		circlebuf_peek_front(&rb->packets, &packet, sizeof(packet));
+	} while (!is_keyframe(&packet));
+}
+
+static inline int64_t buffered_duration(struct replay_buffer *rb)
+{
+	struct encoder_packet first;
+
+	if (!rb->packets.size)
+		return 0;
+
+	circlebuf_peek_front(&rb->packets, &first, sizeof(first));
+	return rb->last_dts_usec - first.dts_usec;
+}
+
+static inline bool over_limit(struct replay_buffer *rb)
+{
+	return buffered_duration(rb) > rb->max_time_usec ||
+		rb->mem_size > rb->max_size;
+}
+
+static void add_packet(struct replay_buffer *rb, struct encoder_packet *packet)
+{
+	/* the buffer must always start on a keyframe */
+	if (!rb->packets.size && !is_keyframe(packet)) {
+		obs_encoder_packet_release(packet);
+		return;
+	}
+
+	circlebuf_push_back(&rb->packets, packet, sizeof(*packet));
+	rb->mem_size      += packet->size;
+	rb->last_dts_usec  = packet->dts_usec;
+	if (is_keyframe(packet))
+		rb->keyframes++;
+
+	/* always keep at least one full GOP */
+	while (rb->keyframes > 1 && over_limit(rb))
+		purge_front(rb);
+}
+
+static void replay_buffer_data(void *data, struct encoder_packet *packet)
+{
+	struct replay_buffer  *rb = data;
+	struct encoder_packet new_packet;
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		obs_parse_avc_packet(&new_packet, packet);
+	else
+		obs_encoder_packet_ref(&new_packet, packet);
+
+	pthread_mutex_lock(&rb->packets_mutex);
+	add_packet(rb, &new_packet);
+	pthread_mutex_unlock(&rb->packets_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+/* saving */
+
+static void push_header_tag(struct replay_save *save,
+		struct encoder_packet *packet)
+{
+	uint8_t *data;
+	size_t  size;
+
+	flv_packet_mux(packet, &data, &size, true);
+	da_push_back_array(save->header, data, size);
+	bfree(data);
+}
+
+static void build_headers(struct replay_buffer *rb, struct replay_save *save)
+{
+	obs_encoder_t aencoder = obs_output_get_audio_encoder(rb->output);
+	obs_encoder_t vencoder = obs_output_get_video_encoder(rb->output);
+	uint8_t       *meta_data;
+	size_t        meta_data_size;
+	uint8_t       *header;
+	size_t        size;
+
+	struct encoder_packet audio_header = {
+		.type         = OBS_ENCODER_AUDIO,
+		.timebase_den = 1
+	};
+	struct encoder_packet video_header = {
+		.type         = OBS_ENCODER_VIDEO,
+		.timebase_den = 1,
+		.keyframe     = true
+	};
+
+	flv_meta_data(rb->output, &meta_data, &meta_data_size, true);
+	da_push_back_array(save->header, meta_data, meta_data_size);
+	bfree(meta_data);
+
+	obs_encoder_get_extra_data(aencoder, &audio_header.data,
+			&audio_header.size);
+	push_header_tag(save, &audio_header);
+
+	obs_encoder_get_extra_data(vencoder, &header, &size);
+	video_header.size = obs_parse_avc_header(&video_header.data,
+			header, size);
+	push_header_tag(save, &video_header);
+	bfree(video_header.data);
+}
+
+/* the same conversion as packet_dts_usec, timebase_num is already part of
+ * the timestamps, which count in steps of it */
+static inline int64_t usec_to_timebase(struct encoder_packet *packet,
+		int64_t usec)
+{
+	return usec * packet->timebase_den / 1000000LL;
+}
+
+/* the saved file starts at timestamp 0.  dts_usec shares one clock between
+ * the audio and video encoders, so the offset from the first packet is
+ * taken from it and the pts keeps its distance to the dts */
+static inline void rebase_packet(struct encoder_packet *packet,
+		int64_t base_usec)
+{
+	int64_t usec   = packet->dts_usec - base_usec;
+	int64_t offset = packet->pts - packet->dts;
+
+	packet->dts = usec_to_timebase(packet, usec > 0 ? usec : 0);
+	packet->pts = packet->dts + offset;
+}
+
+static bool write_replay(struct replay_save *save)
+{
+	FILE    *file = os_fopen(save->path.array, "wb");
+	int64_t base_usec;
+	bool    success;
+
+	if (!file)
+		return false;
+
+	success = fwrite(save->header.array, 1, save->header.num, file) ==
+		save->header.num;
+
+	base_usec = save->packets.array[0].dts_usec;
+
+	for (size_t i = 0; success && i < save->packets.num; i++) {
+		struct encoder_packet packet = save->packets.array[i];
+		uint8_t *data;
+		size_t  size;
+
+		rebase_packet(&packet, base_usec);
+		flv_packet_mux(&packet, &data, &size, false);
+		success = fwrite(data, 1, size, file) == size;
+		bfree(data);
+	}
+
+	fclose(file);
+	return success;
+}
+
+static void free_replay_save(struct replay_save *save)
+{
+	for (size_t i = 0; i < save->packets.num; i++)
+		obs_encoder_packet_release(save->packets.array+i);
+
+	da_free(save->packets);
+	da_free(save->header);
+	dstr_free(&save->path);
+	bfree(save);
+}
+
+static void *save_thread(void *data)
+{
+	struct replay_save   *save = data;
+	struct replay_buffer *rb   = save->rb;
+	struct calldata      params = {0};
+	bool                 success;
+
+	os_thread_init(OS_THREAD_CLASS_OUTPUT, "replay save");
+
+	success = write_replay(save);
+
+	if (success)
+		blog(LOG_INFO, "Replay buffer saved to '%s'", save->path.array);
+	else
+		blog(LOG_WARNING, "Failed to save replay buffer to '%s'",
+				save->path.array);
+
+	calldata_setptr(&params, "output", rb->output);
+	calldata_setstring(&params, "path", save->path.array);
+	calldata_setbool(&params, "success", success);
+	signal_handler_signal(obs_output_signalhandler(rb->output), "saved",
+			&params);
+	calldata_free(&params);
+
+	free_replay_save(save);
+	os_atomic_set_long(&rb->saving, 0);
+	return NULL;
+}
+
+static void replay_buffer_save(void *data, calldata_t params)
+{
+	struct replay_buffer *rb   = data;
+	const char           *path = calldata_string(params, "path");
+	struct replay_save   *save;
+	size_t               count;
+
+	if (!path || !*path) {
+		blog(LOG_WARNING, "Replay buffer: no path specified");
+		return;
+	}
+
+	if (os_atomic_load_long(&rb->saving)) {
+		blog(LOG_WARNING, "Replay buffer: already saving");
+		return;
+	}
+
+	if (rb->save_thread_active) {
+		pthread_join(rb->save_thread, NULL);
+		rb->save_thread_active = false;
+	}
+
+	save = bzalloc(sizeof(struct replay_save));
+	save->rb = rb;
+	dstr_copy(&save->path, path);
+
+	/* snapshot the buffer by taking a reference to each packet, so the
+	 * live buffer can keep going while the file is written */
+	pthread_mutex_lock(&rb->packets_mutex);
+
+	count = num_buffered_packets(rb);
+	da_resize(save->packets, count);
+
+	for (size_t i = 0; i < count; i++) {
+		struct encoder_packet packet;
+		circlebuf_peek_at(&rb->packets, i * sizeof(packet),
+				&packet, sizeof(packet));
+		obs_encoder_packet_ref(save->packets.array+i, &packet);
+	}
+
+	pthread_mutex_unlock(&rb->packets_mutex);
+
+	if (!count) {
+		blog(LOG_WARNING, "Replay buffer: nothing to save");
+		free_replay_save(save);
+		return;
+	}
+
+	build_headers(rb, save);
+
+	os_atomic_set_long(&rb->saving, 1);
+	if (pthread_create(&rb->save_thread, NULL, save_thread, save) != 0) {
+		blog(LOG_WARNING, "Replay buffer: failed to create save "
+		                  "thread");
+		os_atomic_set_long(&rb->saving, 0);
+		free_replay_save(save);
+		return;
+	}
+
+	rb->save_thread_active = true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void update_limits(struct replay_buffer *rb, obs_data_t settings)
+{
+	int64_t max_time_sec = obs_data_getint(settings, "max_time_sec");
+	int64_t max_size_mb  = obs_data_getint(settings, "max_size_mb");
+
+	pthread_mutex_lock(&rb->packets_mutex);
+	rb->max_time_usec = max_time_sec * 1000000LL;
+	rb->max_size      = (size_t)max_size_mb * 1024 * 1024;
+	pthread_mutex_unlock(&rb->packets_mutex);
+}
+
+static void replay_buffer_destroy(void *data)
+{
+	struct replay_buffer *rb = data;
+
+	if (rb) {
+		if (rb->save_thread_active)
+			pthread_join(rb->save_thread, NULL);
+
+		free_packets(rb);
+		circlebuf_free(&rb->packets);
+		pthread_mutex_destroy(&rb->packets_mutex);
+		bfree(rb);
+	}
+}
+
+static void *replay_buffer_create(obs_data_t settings, obs_output_t output)
+{
+	struct replay_buffer *rb = bzalloc(sizeof(struct replay_buffer));
+	rb->output = output;
+	pthread_mutex_init_value(&rb->packets_mutex);
+
+	if (pthread_mutex_init(&rb->packets_mutex, NULL) != 0)
+		goto fail;
+
+	proc_handler_add(obs_output_prochandler(output),
+			"void save(string path)", replay_buffer_save, rb);
+	signal_handler_add(obs_output_signalhandler(output),
+			"void saved(ptr output, string path, bool success)");
+
+	update_limits(rb, settings);
+	return rb;
+
+fail:
+	replay_buffer_destroy(rb);
+	return NULL;
+}
+
+static bool replay_buffer_start(void *data)
+{
+	struct replay_buffer *rb = data;
+	obs_data_t settings;
+
+	if (!obs_output_can_begin_data_capture(rb->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(rb->output, 0))
+		return false;
+
+	settings = obs_output_get_settings(rb->output);
+	update_limits(rb, settings);
+	obs_data_release(settings);
+
+	return obs_output_begin_data_capture(rb->output, 0);
+}
+
+static void replay_buffer_stop(void *data)
+{
+	struct replay_buffer *rb = data;
+
+	obs_output_end_data_capture(rb->output);
+
+	pthread_mutex_lock(&rb->packets_mutex);
+	free_packets(rb);
+	pthread_mutex_unlock(&rb->packets_mutex);
+}
+
+static void replay_buffer_update(void *data, obs_data_t settings)
+{
+	update_limits(data, settings);
+}
+
+static void replay_buffer_defaults(obs_data_t defaults)
+{
+	obs_data_set_default_int(defaults, "max_time_sec", 20);
+	obs_data_set_default_int(defaults, "max_size_mb", 512);
+}
+
+static obs_properties_t replay_buffer_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_int(props, "max_time_sec", "Maximum Replay Time (s)",
+			1, 21600, 1);
+	obs_properties_add_int(props, "max_size_mb", "Maximum Memory (MB)",
+			1, 65536, 1);
+	return props;
+}
+
+struct obs_output_info replay_buffer_info = {
+	.id             = "replay_buffer",
+	.flags          = OBS_OUTPUT_AV |
+	                  OBS_OUTPUT_ENCODED,
+	.getname        = replay_buffer_getname,
+	.create         = replay_buffer_create,
+	.destroy        = replay_buffer_destroy,
+	.start          = replay_buffer_start,
+	.stop           = replay_buffer_stop,
+	.update         = replay_buffer_update,
+	.encoded_packet = replay_buffer_data,
+	.defaults       = replay_buffer_defaults,
+	.properties     = replay_buffer_properties
+};
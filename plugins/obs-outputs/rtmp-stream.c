@@ -19,40 +19,136 @@
 #include <obs-avc.h>
 #include <util/platform.h>
 #include <util/circlebuf.h>
+#include <util/darray.h>
 #include <util/dstr.h>
 #include <util/threading.h>
 #include "librtmp/rtmp.h"
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#endif
 #include "librtmp/log.h"
 #include "flv-mux.h"
 
+#ifdef _WIN32
+#define SHUT_RDWR SD_BOTH
+#endif
+
 //#define FILE_TEST
 //#define TEST_FRAMEDROPS
 
-struct rtmp_stream {
-	obs_output_t     output;
+/* how often the send rate is measured and the stats signal is sent */
+#define STATS_INTERVAL_NS           1000000000ULL
+
+/* minimum time between bitrate decreases while congested */
+#define ABR_DECREASE_INTERVAL_USEC  1000000
+/* time without congestion before the bitrate is raised again */
+#define ABR_INCREASE_INTERVAL_USEC  5000000
+
+/*
+ * The stream can be sent to several servers at once.  The first destination
+ * is the service's, and any others come from the "destinations" array of the
+ * output settings.
+ *
+ * Each packet is parsed and its FLV tag header is muxed once when it arrives
+ * from the encoder, and the result is shared with every destination.  Each
+ * destination has its own connection, send thread and packet buffer, so a
+ * slow server drops frames or reconnects without holding up the others.
+ * The output only stops once every destination has disconnected for good.
+ *
+ * While a destination reconnects, the encoders keep running and its packets
+ * keep being buffered, up to reconnect_buffer_sec seconds and
+ * reconnect_buffer_mb megabytes, by dropping whole GOPs from the front.  The
+ * buffer always starts at a keyframe, so once the connection is back the
+ * stream resumes with the oldest GOP that was kept.
+ *
+ * Each destination keeps a set of stats (see get_stats below) updated with
+ * atomics from its send thread and from the encoder callback, so they can be
+ * polled at any time without waiting on packets_mutex.
+ *
+ * In bandwidth test mode, the stream is only sent to the service's server,
+ * with a test suffix added to the stream key so the service doesn't make it
+ * public.  After bandwidth_test_duration seconds the output stops itself and
+ * sends the bandwidth_test_result signal with the achieved send rate, how
+ * far the send buffer grew, and how many frames had to be dropped.  Adaptive
+ * bitrate and reconnecting are disabled for the test, so the result reflects
+ * the configured bitrate.
+ *
+ * When stopping, each destination gets up to stop_flush_sec seconds to send
+ * what's still buffered.  After that the rest is dropped, and a send that's
+ * stuck on a congested connection is aborted by shutting the socket down,
+ * so stopping never takes much longer than that.
+ */
+
+/* a packet with its FLV tag header, as queued for sending */
+struct rtmp_packet {
+	struct encoder_packet packet;
+	uint8_t               header[FLV_MAX_TAG_HEADER_SIZE];
+	size_t                header_size;
+};
 
-	pthread_mutex_t  packets_mutex;
-	struct circlebuf packets;
+struct rtmp_stream;
 
-	bool             connecting;
-	pthread_t        connect_thread;
+/* stats published for get_stats and the stats signal */
+struct rtmp_stats {
+	volatile long    sent_kb;
+	volatile long    send_kbps;
+	volatile long    buffer_ms;
+	volatile long    dropped[OBS_NAL_PRIORITY_HIGHEST + 1];
 
-	bool             active;
-	pthread_t        send_thread;
+	/* unsent bytes in the socket, or -1 if the platform can't tell */
+	volatile long    socket_queue;
+};
 
-	os_sem_t         send_sem;
-	os_event_t       stop_event;
+struct rtmp_dest {
+	struct rtmp_stream *stream;
+	size_t           index;
 
 	struct dstr      path, key;
 	struct dstr      username, password;
 
+	pthread_mutex_t  packets_mutex;
+	struct circlebuf packets;
+
+	/* packets are only queued while connected or reconnecting */
+	bool             connected;
+	bool             reconnecting;
+
+	bool             thread_created;
+	pthread_t        send_thread;
+	os_sem_t         send_sem;
+	os_event_t       send_done_event;
+
 	/* frame drop variables */
 	int64_t          drop_threshold_usec;
 	int64_t          min_drop_dts_usec;
 	int              min_priority;
+	bool             graduated_drop;
 
 	int64_t          last_dts_usec;
 
+	/* reconnect variables */
+	int              max_retries;
+	int              retry_delay_sec;
+	int              retry_max_delay_sec;
+	int              retries;
+
+	int64_t          reconnect_buffer_usec;
+	size_t           reconnect_buffer_size;
+
+	/* stats variables, the counters are only used by the send thread */
+	struct rtmp_stats stats;
+	uint64_t         bytes_sent;
+	uint64_t         rate_bytes;
+	uint64_t         rate_start_ns;
+	long             peak_kbps;
+
+	/* only changed with packets_mutex locked */
+	long             max_buffer_ms;
+
 #ifdef FILE_TEST
 	FILE             *test;
 #endif
@@ -60,6 +156,43 @@ struct rtmp_stream {
 	RTMP             rtmp;
 };
 
+struct rtmp_stream {
+	obs_output_t     output;
+
+	/* start and stop are the only places the array changes, the mutex
+	 * just keeps get_stats from reading it while it's freed */
+	pthread_mutex_t  dests_mutex;
+	DARRAY(struct rtmp_dest*) dests;
+	volatile long    active_dests;
+
+	bool             connecting;
+	pthread_t        connect_thread;
+
+	/* the encoders are initialized while connecting, the connect thread
+	 * waits for this before it sends the headers */
+	os_event_t       encoders_event;
+	bool             encoders_ready;
+
+	bool             active;
+	os_event_t       stop_event;
+
+	/* buffered packets are only sent until the deadline when stopping */
+	uint64_t         stop_flush_ns;
+	uint64_t         flush_deadline_ns;
+
+	/* adaptive bitrate variables, driven by the first destination */
+	bool             adaptive_bitrate;
+	int              max_bitrate;
+	int              min_bitrate;
+	int              cur_bitrate;
+	int64_t          last_abr_dts_usec;
+
+	/* bandwidth test variables */
+	bool             bandwidth_test;
+	uint64_t         test_duration_ns;
+	uint64_t         test_start_ns;
+};
+
 static const char *rtmp_stream_getname(const char *locale)
 {
 	/* TODO: locale stuff */
@@ -75,52 +208,135 @@ static void log_rtmp(int level, const char *format, va_list args)
 	blogva(LOG_INFO, format, args);
 }
 
-static inline void free_packets(struct rtmp_stream *stream)
+static inline void free_packets(struct rtmp_dest *dest)
 {
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
-		obs_free_encoder_packet(&packet);
+	while (dest->packets.size) {
+		struct rtmp_packet entry;
+		circlebuf_pop_front(&dest->packets, &entry, sizeof(entry));
+		obs_encoder_packet_release(&entry.packet);
 	}
 }
 
+static inline bool is_keyframe(const struct rtmp_packet *entry)
+{
+	return entry->packet.type == OBS_ENCODER_VIDEO &&
+		entry->packet.keyframe;
+}
+
+static inline void count_dropped(struct rtmp_dest *dest,
+		const struct encoder_packet *packet)
+{
+	int priority = packet->priority;
+
+	if (packet->type != OBS_ENCODER_VIDEO)
+		return;
+
+	if (priority < OBS_NAL_PRIORITY_DISPOSABLE)
+		priority = OBS_NAL_PRIORITY_DISPOSABLE;
+	else if (priority > OBS_NAL_PRIORITY_HIGHEST)
+		priority = OBS_NAL_PRIORITY_HIGHEST;
+
+	os_atomic_inc_long(&dest->stats.dropped[priority]);
+}
+
+/* a new connection has to start with a keyframe */
+static void trim_to_keyframe(struct rtmp_dest *dest)
+{
+	while (dest->packets.size) {
+		struct rtmp_packet entry;
+		circlebuf_peek_front(&dest->packets, &entry, sizeof(entry));
+
+		if (is_keyframe(&entry))
+			break;
+
+		circlebuf_pop_front(&dest->packets, NULL, sizeof(entry));
+		count_dropped(dest, &entry.packet);
+		obs_encoder_packet_release(&entry.packet);
+	}
+}
+
+static void destroy_dest(struct rtmp_dest *dest)
+{
+	free_packets(dest);
+	dstr_free(&dest->path);
+	dstr_free(&dest->key);
+	dstr_free(&dest->username);
+	dstr_free(&dest->password);
+	os_sem_destroy(dest->send_sem);
+	os_event_destroy(dest->send_done_event);
+	pthread_mutex_destroy(&dest->packets_mutex);
+	circlebuf_free(&dest->packets);
+	RTMP_TLS_FreeSession(dest->rtmp.m_tlsSession);
+	bfree(dest);
+}
+
+static void free_dests(struct rtmp_stream *stream)
+{
+	pthread_mutex_lock(&stream->dests_mutex);
+	for (size_t i = 0; i < stream->dests.num; i++)
+		destroy_dest(stream->dests.array[i]);
+	da_resize(stream->dests, 0);
+	pthread_mutex_unlock(&stream->dests_mutex);
+}
+
 static void rtmp_stream_stop(void *data);
 
 static void rtmp_stream_destroy(void *data)
 {
 	struct rtmp_stream *stream = data;
 
-	if (stream->active)
-		rtmp_stream_stop(data);
-
 	if (stream) {
-		free_packets(stream);
-		dstr_free(&stream->path);
-		dstr_free(&stream->key);
-		dstr_free(&stream->username);
-		dstr_free(&stream->password);
+		if (stream->stop_event)
+			rtmp_stream_stop(data);
+
+		da_free(stream->dests);
 		os_event_destroy(stream->stop_event);
-		os_sem_destroy(stream->send_sem);
-		pthread_mutex_destroy(&stream->packets_mutex);
-		circlebuf_free(&stream->packets);
+		os_event_destroy(stream->encoders_event);
+		pthread_mutex_destroy(&stream->dests_mutex);
 		bfree(stream);
 	}
 }
 
+static void get_stats_proc(void *data, calldata_t params);
+
 static void *rtmp_stream_create(obs_data_t settings, obs_output_t output)
 {
 	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
 	stream->output = output;
-	pthread_mutex_init_value(&stream->packets_mutex);
+	pthread_mutex_init_value(&stream->dests_mutex);
 
-	RTMP_Init(&stream->rtmp);
 	RTMP_LogSetCallback(log_rtmp);
 	RTMP_LogSetLevel(RTMP_LOGWARNING);
 
-	if (pthread_mutex_init(&stream->packets_mutex, NULL) != 0)
+	if (pthread_mutex_init(&stream->dests_mutex, NULL) != 0)
 		goto fail;
 	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
+	if (os_event_init(&stream->encoders_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+
+	signal_handler_add(obs_output_signalhandler(output),
+			"void bitrate_changed(ptr output, int bitrate)");
+	signal_handler_add(obs_output_signalhandler(output),
+			"void stats(ptr output, int dest, int sent_kb, "
+			"int send_kbps, int buffer_ms, int dropped_disposable, "
+			"int dropped_low, int dropped_high, "
+			"int dropped_highest, int socket_queue, "
+			"int queue_delay_ms, float congestion)");
+	proc_handler_add(obs_output_prochandler(output),
+			"void get_stats(in int dest, out bool found, "
+			"out int sent_kb, out int send_kbps, "
+			"out int buffer_ms, out int dropped_disposable, "
+			"out int dropped_low, out int dropped_high, "
+			"out int dropped_highest, out int socket_queue, "
+			"out int queue_delay_ms, out float congestion)",
+			get_stats_proc, stream);
+	signal_handler_add(obs_output_signalhandler(output),
+			"void bandwidth_test_result(ptr output, "
+			"bool completed, int duration_ms, int bitrate, "
+			"int sent_kb, int avg_kbps, int peak_kbps, "
+			"int buffer_ms, int max_buffer_ms, "
+			"int dropped_frames)");
 
 	UNUSED_PARAMETER(settings);
 	return stream;
@@ -130,27 +346,68 @@ fail:
 	return NULL;
 }
 
+static void set_video_bitrate(struct rtmp_stream *stream, int bitrate);
+
+/* waits until the flush deadline, then aborts whatever send the thread is
+ * stuck in */
+static void stop_send_thread(struct rtmp_dest *dest)
+{
+	uint64_t deadline = dest->stream->flush_deadline_ns;
+	uint64_t now      = os_gettime_ns();
+	unsigned long ms  = deadline > now ?
+		(unsigned long)((deadline - now) / 1000000) : 0;
+
+	os_sem_post(dest->send_sem);
+
+	if (os_event_timedwait(dest->send_done_event, ms) == ETIMEDOUT) {
+		blog(LOG_WARNING, "Could not send the remaining data to %s "
+		                  "in time, closing the connection",
+		                  dest->path.array);
+		shutdown(dest->rtmp.m_sb.sb_socket, SHUT_RDWR);
+	}
+
+	pthread_join(dest->send_thread, NULL);
+}
+
 static void rtmp_stream_stop(void *data)
 {
 	struct rtmp_stream *stream = data;
 	void *ret;
 
-#ifdef FILE_TEST
-	fclose(stream->test);
-#endif
-
+	stream->flush_deadline_ns = os_gettime_ns() + stream->stop_flush_ns;
 	os_event_signal(stream->stop_event);
 
-	if (stream->connecting)
+	if (stream->connecting) {
 		pthread_join(stream->connect_thread, &ret);
+		stream->connecting = false;
+	}
 
 	if (stream->active) {
 		obs_output_end_data_capture(stream->output);
-		os_sem_post(stream->send_sem);
-		pthread_join(stream->send_thread, &ret);
-		RTMP_Close(&stream->rtmp);
+		stream->active = false;
+
+		/* give the encoder back its configured bitrate */
+		if (stream->adaptive_bitrate &&
+		    stream->cur_bitrate != stream->max_bitrate)
+			set_video_bitrate(stream, stream->max_bitrate);
 	}
 
+	for (size_t i = 0; i < stream->dests.num; i++) {
+		struct rtmp_dest *dest = stream->dests.array[i];
+
+		if (dest->thread_created) {
+			stop_send_thread(dest);
+			dest->thread_created = false;
+		}
+
+		RTMP_Close(&dest->rtmp);
+#ifdef FILE_TEST
+		if (dest->test)
+			fclose(dest->test);
+#endif
+	}
+
+	free_dests(stream);
 	os_event_reset(stream->stop_event);
 }
 
@@ -168,149 +425,356 @@ static inline void set_rtmp_dstr(AVal *val, struct dstr *str)
 	val->av_len = valid ? (int)str->len : 0;
 }
 
-static inline bool get_next_packet(struct rtmp_stream *stream,
-		struct encoder_packet *packet)
+static inline bool get_next_packet(struct rtmp_dest *dest,
+		struct rtmp_packet *entry)
 {
 	bool new_packet = false;
 
-	pthread_mutex_lock(&stream->packets_mutex);
-	if (stream->packets.size) {
-		circlebuf_pop_front(&stream->packets, packet,
-				sizeof(struct encoder_packet));
+	pthread_mutex_lock(&dest->packets_mutex);
+	if (dest->packets.size) {
+		circlebuf_pop_front(&dest->packets, entry,
+				sizeof(struct rtmp_packet));
 		new_packet = true;
 	}
-	pthread_mutex_unlock(&stream->packets_mutex);
+	pthread_mutex_unlock(&dest->packets_mutex);
 
 	return new_packet;
 }
 
-static int send_packet(struct rtmp_stream *stream,
-		struct encoder_packet *packet, bool is_header)
+static long get_socket_queue(struct rtmp_dest *dest)
+{
+	int size = 0;
+
+#if defined(SIOCOUTQ)
+	if (ioctl(dest->rtmp.m_sb.sb_socket, SIOCOUTQ, &size) == 0)
+		return size;
+#elif defined(SO_NWRITE)
+	socklen_t int_size = sizeof(size);
+
+	if (getsockopt(dest->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_NWRITE,
+				&size, &int_size) == 0)
+		return size;
+#else
+	UNUSED_PARAMETER(dest);
+	UNUSED_PARAMETER(size);
+#endif
+	return -1;
+}
+
+static void fill_stats(struct rtmp_dest *dest, calldata_t params)
+{
+	struct rtmp_stats *stats = &dest->stats;
+	long      kbps         = os_atomic_load_long(&stats->send_kbps);
+	long      buffer_ms    = os_atomic_load_long(&stats->buffer_ms);
+	long      queue        = os_atomic_load_long(&stats->socket_queue);
+	long long threshold_ms = dest->drop_threshold_usec / 1000;
+	long long delay_ms     = 0;
+	double    congestion   = 0.0;
+
+	/* how long the socket takes to drain at the current rate */
+	if (queue > 0 && kbps > 0)
+		delay_ms = (long long)queue * 8 / kbps;
+
+	/* 1.0 means the send delay has reached the drop threshold */
+	if (threshold_ms > 0) {
+		congestion = (double)(buffer_ms + delay_ms) /
+			(double)threshold_ms;
+		if (congestion > 1.0)
+			congestion = 1.0;
+	}
+
+	calldata_setint(params, "dest", (long long)dest->index);
+	calldata_setint(params, "sent_kb",
+			os_atomic_load_long(&stats->sent_kb));
+	calldata_setint(params, "send_kbps", kbps);
+	calldata_setint(params, "buffer_ms", buffer_ms);
+	calldata_setint(params, "dropped_disposable", os_atomic_load_long(
+				&stats->dropped[OBS_NAL_PRIORITY_DISPOSABLE]));
+	calldata_setint(params, "dropped_low", os_atomic_load_long(
+				&stats->dropped[OBS_NAL_PRIORITY_LOW]));
+	calldata_setint(params, "dropped_high", os_atomic_load_long(
+				&stats->dropped[OBS_NAL_PRIORITY_HIGH]));
+	calldata_setint(params, "dropped_highest", os_atomic_load_long(
+				&stats->dropped[OBS_NAL_PRIORITY_HIGHEST]));
+	calldata_setint(params, "socket_queue", queue);
+	calldata_setint(params, "queue_delay_ms", delay_ms);
+	calldata_setfloat(params, "congestion", congestion);
+}
+
+static void get_stats_proc(void *data, calldata_t params)
+{
+	struct rtmp_stream *stream = data;
+	long long          idx     = calldata_int(params, "dest");
+	bool               found;
+
+	pthread_mutex_lock(&stream->dests_mutex);
+	found = idx >= 0 && (size_t)idx < stream->dests.num;
+	if (found)
+		fill_stats(stream->dests.array[idx], params);
+	pthread_mutex_unlock(&stream->dests_mutex);
+
+	calldata_setbool(params, "found", found);
+}
+
+static void signal_stats(struct rtmp_dest *dest)
+{
+	obs_output_t    output = dest->stream->output;
+	struct calldata params = {0};
+
+	calldata_setptr(&params, "output", output);
+	fill_stats(dest, &params);
+	signal_handler_signal(obs_output_signalhandler(output), "stats",
+			&params);
+	calldata_free(&params);
+}
+
+static void reset_send_rate(struct rtmp_dest *dest)
+{
+	dest->rate_start_ns = 0;
+	os_atomic_set_long(&dest->stats.send_kbps, 0);
+}
+
+/* the rate is measured over STATS_INTERVAL_NS, which is also when the
+ * socket queue is sampled and the stats signal goes out */
+static void update_send_stats(struct rtmp_dest *dest, int sent)
+{
+	uint64_t ts = os_gettime_ns();
+	uint64_t elapsed;
+	uint64_t bits_per_ms;
+
+	if (sent > 0)
+		dest->bytes_sent += (uint64_t)sent;
+	os_atomic_set_long(&dest->stats.sent_kb,
+			(long)(dest->bytes_sent / 1024));
+
+	if (!dest->rate_start_ns) {
+		dest->rate_start_ns = ts;
+		dest->rate_bytes    = dest->bytes_sent;
+		return;
+	}
+
+	elapsed = ts - dest->rate_start_ns;
+	if (elapsed < STATS_INTERVAL_NS)
+		return;
+
+	bits_per_ms = (dest->bytes_sent - dest->rate_bytes) * 8000000ULL /
+		elapsed;
+
+	os_atomic_set_long(&dest->stats.send_kbps, (long)bits_per_ms);
+	os_atomic_set_long(&dest->stats.socket_queue, get_socket_queue(dest));
+
+	if (dest->peak_kbps < (long)bits_per_ms)
+		dest->peak_kbps = (long)bits_per_ms;
+
+	dest->rate_start_ns = ts;
+	dest->rate_bytes    = dest->bytes_sent;
+
+	signal_stats(dest);
+}
+
+static int send_packet(struct rtmp_dest *dest, struct rtmp_packet *entry)
 {
-	uint8_t *data;
-	size_t  size;
-	int     ret = 0;
+	struct encoder_packet *packet = &entry->packet;
+	int ret = 0;
 
-	flv_packet_mux(packet, &data, &size, is_header);
+	if (packet->data && packet->size) {
 #ifdef FILE_TEST
-	fwrite(data, 1, size, stream->test);
+		uint32_t tag_size = (uint32_t)(entry->header_size +
+				packet->size);
+		uint8_t  size_buf[4] = {
+			(uint8_t)(tag_size >> 24), (uint8_t)(tag_size >> 16),
+			(uint8_t)(tag_size >> 8),  (uint8_t)tag_size
+		};
+
+		fwrite(entry->header, 1, entry->header_size, dest->test);
+		fwrite(packet->data, 1, packet->size, dest->test);
+		fwrite(size_buf, 1, sizeof(size_buf), dest->test);
 #else
-	ret = RTMP_Write(&stream->rtmp, (char*)data, (int)size);
+		RTMPBuf bufs[2];
+
+		bufs[0].b_data = (const char*)entry->header;
+		bufs[0].b_size = (int)entry->header_size;
+		bufs[1].b_data = (const char*)packet->data;
+		bufs[1].b_size = (int)packet->size;
+
+		ret = RTMP_WriteV(&dest->rtmp, bufs, 2);
 #endif
-	bfree(data);
+		if (ret > 0)
+			update_send_stats(dest, ret);
+	}
 
-	obs_free_encoder_packet(packet);
+	obs_encoder_packet_release(packet);
 	return ret;
 }
 
-static bool send_remaining_packets(struct rtmp_stream *stream)
+static bool send_remaining_packets(struct rtmp_dest *dest)
 {
-	struct encoder_packet packet;
+	struct rtmp_packet entry;
+
+	while (get_next_packet(dest, &entry)) {
+		if (os_gettime_ns() >= dest->stream->flush_deadline_ns) {
+			obs_encoder_packet_release(&entry.packet);
+			break;
+		}
 
-	while (get_next_packet(stream, &packet))
-		if (send_packet(stream, &packet, false) < 0)
+		if (send_packet(dest, &entry) < 0)
 			return false;
+	}
 
 	return true;
 }
 
-static void *send_thread(void *data)
+static inline bool bandwidth_test_done(struct rtmp_stream *stream)
 {
-	struct rtmp_stream *stream = data;
-	bool disconnected = false;
+	return stream->bandwidth_test &&
+		os_gettime_ns() - stream->test_start_ns >=
+		stream->test_duration_ns;
+}
+
+/* returns false if the connection was lost */
+static bool send_packets(struct rtmp_dest *dest)
+{
+	struct rtmp_stream *stream = dest->stream;
 
-	while (os_sem_wait(stream->send_sem) == 0) {
-		struct encoder_packet packet;
+	while (os_sem_wait(dest->send_sem) == 0) {
+		struct rtmp_packet entry;
+		uint64_t start;
+		int ret;
 
 		if (os_event_try(stream->stop_event) != EAGAIN)
 			break;
-		if (!get_next_packet(stream, &packet))
+
+		/* whatever is still buffered is part of the result, so it
+		 * doesn't need to be sent */
+		if (bandwidth_test_done(stream))
+			return true;
+		if (!get_next_packet(dest, &entry))
 			continue;
-		if (send_packet(stream, &packet, false) < 0) {
-			disconnected = true;
-			break;
-		}
-	}
 
-	if (!disconnected && !send_remaining_packets(stream))
-		disconnected = true;
+		start = trace_begin();
+		ret   = send_packet(dest, &entry);
+		trace_end("rtmp_send_packet", start);
 
-	if (disconnected) {
-		blog(LOG_INFO, "Disconnected from %s", stream->path.array);
-		free_packets(stream);
+		if (ret < 0)
+			return false;
 	}
 
-	if (os_event_try(stream->stop_event) == EAGAIN) {
-		pthread_detach(stream->send_thread);
-		obs_output_signal_stop(stream->output, OBS_OUTPUT_DISCONNECTED);
+	return send_remaining_packets(dest);
+}
+
+/* keeps the unsent packets from the point the next connection can start
+ * from, and keeps buffering new ones until end_reconnect */
+static void begin_reconnect(struct rtmp_dest *dest)
+{
+	reset_send_rate(dest);
+
+	pthread_mutex_lock(&dest->packets_mutex);
+	dest->connected    = false;
+	dest->reconnecting = dest->max_retries > 0;
+	dest->min_priority = 0;
+	if (dest->reconnecting)
+		trim_to_keyframe(dest);
+	else
+		free_packets(dest);
+	pthread_mutex_unlock(&dest->packets_mutex);
+}
+
+static void end_reconnect(struct rtmp_dest *dest, bool connected)
+{
+	bool need_keyframe = false;
+
+	pthread_mutex_lock(&dest->packets_mutex);
+	dest->connected    = connected;
+	dest->reconnecting = false;
+	dest->min_priority = 0;
+	if (connected) {
+		trim_to_keyframe(dest);
+		need_keyframe = dest->packets.size == 0;
+	} else {
+		free_packets(dest);
 	}
+	pthread_mutex_unlock(&dest->packets_mutex);
 
-	stream->active = false;
-	return NULL;
+	/* nothing buffered to resume from, so don't wait for the next
+	 * keyframe of the regular interval */
+	if (need_keyframe)
+		obs_encoder_request_keyframe(obs_output_get_video_encoder(
+					dest->stream->output));
 }
 
-static void send_meta_data(struct rtmp_stream *stream)
+static void send_meta_data(struct rtmp_dest *dest)
 {
 	uint8_t *meta_data;
 	size_t  meta_data_size;
 
-	flv_meta_data(stream->output, &meta_data, &meta_data_size);
+	flv_meta_data(dest->stream->output, &meta_data, &meta_data_size,
+			false);
 #ifdef FILE_TEST
-	fwrite(meta_data, 1, meta_data_size, stream->test);
+	fwrite(meta_data, 1, meta_data_size, dest->test);
 #else
-	RTMP_Write(&stream->rtmp, (char*)meta_data, (int)meta_data_size);
+	RTMP_Write(&dest->rtmp, (char*)meta_data, (int)meta_data_size);
 #endif
 	bfree(meta_data);
 }
 
-static void send_audio_header(struct rtmp_stream *stream)
+static void send_header_packet(struct rtmp_dest *dest,
+		struct encoder_packet *header_packet)
+{
+	struct rtmp_packet entry;
+
+	obs_encoder_packet_create_instance(&entry.packet, header_packet);
+	entry.header_size = flv_packet_header_buf(&entry.packet,
+			entry.header, true);
+	send_packet(dest, &entry);
+}
+
+static void send_audio_header(struct rtmp_dest *dest)
 {
-	obs_output_t  context  = stream->output;
+	obs_output_t  context  = dest->stream->output;
 	obs_encoder_t aencoder = obs_output_get_audio_encoder(context);
 	uint8_t       *header;
 
-	struct encoder_packet packet   = {
+	struct encoder_packet header_packet = {
 		.type         = OBS_ENCODER_AUDIO,
 		.timebase_den = 1
 	};
 
-	obs_encoder_get_extra_data(aencoder, &header, &packet.size);
-	packet.data = bmemdup(header, packet.size);
-	send_packet(stream, &packet, true);
+	obs_encoder_get_extra_data(aencoder, &header, &header_packet.size);
+	header_packet.data = header;
+
+	send_header_packet(dest, &header_packet);
 }
 
-static void send_video_header(struct rtmp_stream *stream)
+static void send_video_header(struct rtmp_dest *dest)
 {
-	obs_output_t  context  = stream->output;
+	obs_output_t  context  = dest->stream->output;
 	obs_encoder_t vencoder = obs_output_get_video_encoder(context);
 	uint8_t       *header;
 	size_t        size;
 
-	struct encoder_packet packet   = {
+	struct encoder_packet header_packet = {
 		.type         = OBS_ENCODER_VIDEO,
 		.timebase_den = 1,
 		.keyframe     = true
 	};
 
 	obs_encoder_get_extra_data(vencoder, &header, &size);
-	packet.size = obs_parse_avc_header(&packet.data, header, size);
-	send_packet(stream, &packet, true);
+	header_packet.size = obs_parse_avc_header(&header_packet.data,
+			header, size);
+
+	send_header_packet(dest, &header_packet);
+	bfree(header_packet.data);
 }
 
-static void send_headers(struct rtmp_stream *stream)
+static void send_headers(struct rtmp_dest *dest)
 {
 #ifdef FILE_TEST
-	stream->test = os_fopen("D:\\bla.flv", "wb");
+	if (!dest->test)
+		dest->test = os_fopen("D:\\bla.flv", "wb");
 #endif
-	send_meta_data(stream);
-	send_audio_header(stream);
-	send_video_header(stream);
-}
-
-static inline bool reset_semaphore(struct rtmp_stream *stream)
-{
-	os_sem_destroy(stream->send_sem);
-	return os_sem_init(&stream->send_sem, 0) == 0;
+	send_meta_data(dest);
+	send_audio_header(dest);
+	send_video_header(dest);
 }
 
 #ifdef _WIN32
@@ -319,13 +783,21 @@ static inline bool reset_semaphore(struct rtmp_stream *stream)
 
 #define MIN_SENDBUF_SIZE 65535
 
-static void adjust_sndbuf_size(struct rtmp_stream *stream, int new_size)
+/* larger chunks mean fewer chunk headers for each video frame */
+#define STREAM_CHUNK_SIZE 16384
+
+/* unsent data the kernel may queue before the socket stops being writable.
+ * keeping this low leaves packets in our own buffer, where they can still be
+ * dropped when congested, rather than stuck in the socket */
+#define NOTSENT_LOWAT_SIZE (128*1024)
+
+static void adjust_sndbuf_size(struct rtmp_dest *dest, int new_size)
 {
 	int cur_sendbuf_size = new_size;
 	socklen_t int_size = sizeof(int);
 
 #ifndef TEST_FRAMEDROPS
-	getsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
+	getsockopt(dest->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
 			(char*)&cur_sendbuf_size, &int_size);
 
 	if (cur_sendbuf_size < new_size) {
@@ -333,226 +805,880 @@ static void adjust_sndbuf_size(struct rtmp_stream *stream, int new_size)
 #else
 		{cur_sendbuf_size = 1024*8;
 #endif
-		setsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
+		setsockopt(dest->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
 				(const char*)&cur_sendbuf_size, int_size);
 	}
 }
 
-static int init_send(struct rtmp_stream *stream)
+static void set_notsent_lowat(struct rtmp_dest *dest)
 {
-	int ret;
+#ifdef TCP_NOTSENT_LOWAT
+	int size = NOTSENT_LOWAT_SIZE;
 
-#if defined(_WIN32) && !defined(FILE_TEST)
-	adjust_sndbuf_size(stream, MIN_SENDBUF_SIZE);
+	if (setsockopt(dest->rtmp.m_sb.sb_socket, IPPROTO_TCP,
+				TCP_NOTSENT_LOWAT, &size, sizeof(size)) != 0)
+		blog(LOG_DEBUG, "Could not set TCP_NOTSENT_LOWAT for %s",
+				dest->path.array);
+#else
+	UNUSED_PARAMETER(dest);
 #endif
-
-	reset_semaphore(stream);
-
-	ret = pthread_create(&stream->send_thread, NULL, send_thread, stream);
-	if (ret != 0) {
-		RTMP_Close(&stream->rtmp);
-		return OBS_OUTPUT_FAIL;
-	}
-
-	stream->active = true;
-	send_headers(stream);
-	obs_output_begin_data_capture(stream->output, 0);
-
-	return OBS_OUTPUT_SUCCESS;
 }
 
-static int try_connect(struct rtmp_stream *stream)
+static int try_connect(struct rtmp_dest *dest)
 {
 #ifndef FILE_TEST
-	blog(LOG_INFO, "Connecting to RTMP URL %s...", stream->path.array);
+	void *tls_session = dest->rtmp.m_tlsSession;
+
+	blog(LOG_INFO, "Connecting to RTMP URL %s...", dest->path.array);
 
-	if (!RTMP_SetupURL2(&stream->rtmp, stream->path.array,
-				stream->key.array))
+	/* the TLS session of the last connection is resumed when
+	 * reconnecting to an rtmps:// URL */
+	RTMP_Init(&dest->rtmp);
+	dest->rtmp.m_tlsSession = tls_session;
+
+	if (!RTMP_SetupURL2(&dest->rtmp, dest->path.array,
+				dest->key.array))
 		return OBS_OUTPUT_BAD_PATH;
 
-	RTMP_EnableWrite(&stream->rtmp);
+	RTMP_EnableWrite(&dest->rtmp);
 
-	set_rtmp_dstr(&stream->rtmp.Link.pubUser,   &stream->username);
-	set_rtmp_dstr(&stream->rtmp.Link.pubPasswd, &stream->password);
-	stream->rtmp.Link.swfUrl = stream->rtmp.Link.tcUrl;
-	set_rtmp_str(&stream->rtmp.Link.flashVer,
+	set_rtmp_dstr(&dest->rtmp.Link.pubUser,   &dest->username);
+	set_rtmp_dstr(&dest->rtmp.Link.pubPasswd, &dest->password);
+	dest->rtmp.Link.swfUrl = dest->rtmp.Link.tcUrl;
+	set_rtmp_str(&dest->rtmp.Link.flashVer,
 			"FMLE/3.0 (compatible; FMSc/1.0)");
 
-	stream->rtmp.m_outChunkSize       = 4096;
-	stream->rtmp.m_bSendChunkSizeInfo = true;
-	stream->rtmp.m_bUseNagle          = true;
+	/* each packet goes out in a single gathered write, so there's nothing
+	 * for nagle to coalesce and it would only add latency */
+	dest->rtmp.m_bSendChunkSizeInfo = true;
+	dest->rtmp.m_bUseNagle          = false;
+	RTMP_SetChunkSize(&dest->rtmp, STREAM_CHUNK_SIZE);
 
-	if (!RTMP_Connect(&stream->rtmp, NULL))
+	if (!RTMP_Connect(&dest->rtmp, NULL))
 		return OBS_OUTPUT_CONNECT_FAILED;
-	if (!RTMP_ConnectStream(&stream->rtmp, 0))
+	if (!RTMP_ConnectStream(&dest->rtmp, 0))
 		return OBS_OUTPUT_INVALID_STREAM;
 
-	blog(LOG_INFO, "Connection to %s successful", stream->path.array);
+	blog(LOG_INFO, "Connection to %s successful", dest->path.array);
+
+#ifdef _WIN32
+	adjust_sndbuf_size(dest, MIN_SENDBUF_SIZE);
+#endif
+	set_notsent_lowat(dest);
 #endif
 
-	return init_send(stream);
+	return OBS_OUTPUT_SUCCESS;
+}
+
+/* the delay doubles with each failed attempt, up to retry_max_delay_sec */
+static inline int get_retry_delay(struct rtmp_dest *dest)
+{
+	int delay = dest->retry_delay_sec;
+
+	for (int i = 1; i < dest->retries; i++) {
+		if (delay >= dest->retry_max_delay_sec)
+			break;
+		delay *= 2;
+	}
+
+	return (delay > dest->retry_max_delay_sec) ?
+		dest->retry_max_delay_sec : delay;
+}
+
+/* gives up when the output is stopped or the retries run out */
+static bool reconnect(struct rtmp_dest *dest)
+{
+	struct rtmp_stream *stream = dest->stream;
+
+	while (dest->retries < dest->max_retries) {
+		int delay;
+		int ret;
+
+		dest->retries++;
+		delay = get_retry_delay(dest);
+
+		blog(LOG_INFO, "Reconnecting to %s in %d seconds "
+		               "(attempt %d of %d)", dest->path.array,
+		               delay, dest->retries, dest->max_retries);
+
+		if (os_event_timedwait(stream->stop_event,
+					(unsigned long)delay * 1000) == 0)
+			return false;
+
+		ret = try_connect(dest);
+		if (ret == OBS_OUTPUT_SUCCESS) {
+			send_headers(dest);
+			end_reconnect(dest, true);
+			dest->retries = 0;
+
+			/* wake the send loop for the buffered packets */
+			os_sem_post(dest->send_sem);
+			return true;
+		}
+
+		blog(LOG_INFO, "Connection to %s failed: %d",
+				dest->path.array, ret);
+		RTMP_Close(&dest->rtmp);
+	}
+
+	return false;
+}
+
+static long total_dropped(struct rtmp_dest *dest)
+{
+	long total = 0;
+
+	for (size_t i = 0; i <= OBS_NAL_PRIORITY_HIGHEST; i++)
+		total += os_atomic_load_long(&dest->stats.dropped[i]);
+	return total;
+}
+
+static void signal_bandwidth_test_result(struct rtmp_dest *dest)
+{
+	struct rtmp_stream *stream = dest->stream;
+	obs_output_t    output = stream->output;
+	struct calldata params = {0};
+	uint64_t        elapsed_ms;
+	long long       avg_kbps = 0;
+	long            buffer_ms;
+	long            max_buffer_ms;
+	bool            completed;
+
+	completed  = bandwidth_test_done(stream);
+	elapsed_ms = (os_gettime_ns() - stream->test_start_ns) / 1000000;
+	if (elapsed_ms)
+		avg_kbps = (long long)(dest->bytes_sent * 8 / elapsed_ms);
+
+	pthread_mutex_lock(&dest->packets_mutex);
+	buffer_ms     = os_atomic_load_long(&dest->stats.buffer_ms);
+	max_buffer_ms = dest->max_buffer_ms;
+	pthread_mutex_unlock(&dest->packets_mutex);
+
+	blog(LOG_INFO, "Bandwidth test to %s %s after %d ms: "
+	               "bitrate %d, average %lld kbps, peak %ld kbps, "
+	               "buffer %ld ms (max %ld ms), %ld frames dropped",
+	               dest->path.array,
+	               completed ? "completed" : "was cut short",
+	               (int)elapsed_ms, stream->max_bitrate, avg_kbps,
+	               dest->peak_kbps, buffer_ms, max_buffer_ms,
+	               total_dropped(dest));
+
+	calldata_setptr(&params, "output", output);
+	calldata_setbool(&params, "completed", completed);
+	calldata_setint(&params, "duration_ms", (long long)elapsed_ms);
+	calldata_setint(&params, "bitrate", stream->max_bitrate);
+	calldata_setint(&params, "sent_kb",
+			(long long)(dest->bytes_sent / 1024));
+	calldata_setint(&params, "avg_kbps", avg_kbps);
+	calldata_setint(&params, "peak_kbps", dest->peak_kbps);
+	calldata_setint(&params, "buffer_ms", buffer_ms);
+	calldata_setint(&params, "max_buffer_ms", max_buffer_ms);
+	calldata_setint(&params, "dropped_frames", total_dropped(dest));
+	signal_handler_signal(obs_output_signalhandler(output),
+			"bandwidth_test_result", &params);
+	calldata_free(&params);
+}
+
+static void *send_thread(void *data)
+{
+	struct rtmp_dest   *dest   = data;
+	struct rtmp_stream *stream = dest->stream;
+	int                code    = OBS_OUTPUT_DISCONNECTED;
+
+	os_thread_init(OS_THREAD_CLASS_OUTPUT, "rtmp send");
+
+	while (dest->connected || reconnect(dest)) {
+		if (send_packets(dest))
+			break;
+
+		blog(LOG_INFO, "Disconnected from %s", dest->path.array);
+		begin_reconnect(dest);
+		RTMP_Close(&dest->rtmp);
+	}
+
+	end_reconnect(dest, false);
+
+	if (stream->bandwidth_test) {
+		if (bandwidth_test_done(stream))
+			code = OBS_OUTPUT_SUCCESS;
+		signal_bandwidth_test_result(dest);
+	}
+
+	os_event_signal(dest->send_done_event);
+
+	/* the last destination to go stops the output, unless the output
+	 * is already being stopped */
+	if (os_atomic_dec_long(&stream->active_dests) == 0 &&
+	    os_event_try(stream->stop_event) == EAGAIN) {
+		dest->thread_created = false;
+		stream->active       = false;
+		pthread_detach(dest->send_thread);
+		obs_output_signal_stop(stream->output, code);
+	}
+
+	return NULL;
+}
+
+static bool start_send_thread(struct rtmp_dest *dest)
+{
+	if (os_sem_init(&dest->send_sem, 0) != 0)
+		return false;
+	if (os_event_init(&dest->send_done_event, OS_EVENT_TYPE_MANUAL) != 0)
+		return false;
+
+	os_atomic_inc_long(&dest->stream->active_dests);
+
+	if (pthread_create(&dest->send_thread, NULL, send_thread, dest) != 0) {
+		os_atomic_dec_long(&dest->stream->active_dests);
+		return false;
+	}
+
+	dest->thread_created = true;
+	return true;
 }
 
 static void *connect_thread(void *data)
 {
 	struct rtmp_stream *stream = data;
-	int ret = try_connect(stream);
+	int ret = OBS_OUTPUT_FAIL;
 
-	if (ret != OBS_OUTPUT_SUCCESS) {
-		obs_output_signal_stop(stream->output, ret);
-		blog(LOG_INFO, "Connection to %s failed: %d",
-			stream->path.array, ret);
+	os_thread_init(OS_THREAD_CLASS_OUTPUT, "rtmp connect");
+
+	/* data capture has to begin before any of the send threads can get
+	 * packets, so every destination is connected first */
+	for (size_t i = 0; i < stream->dests.num; i++) {
+		struct rtmp_dest *dest = stream->dests.array[i];
+		int dest_ret;
+
+		if (os_event_try(stream->stop_event) != EAGAIN)
+			break;
+
+		dest_ret = try_connect(dest);
+
+		if (dest_ret == OBS_OUTPUT_SUCCESS) {
+			dest->connected = true;
+			ret = OBS_OUTPUT_SUCCESS;
+		} else {
+			blog(LOG_INFO, "Connection to %s failed: %d",
+					dest->path.array, dest_ret);
+			RTMP_Close(&dest->rtmp);
+
+			if (i == 0 && ret != OBS_OUTPUT_SUCCESS)
+				ret = dest_ret;
+		}
+	}
+
+	/* if the encoders failed, start stops the output and joins this
+	 * thread, the same as stopping while connecting */
+	os_event_wait(stream->encoders_event);
+	if (!stream->encoders_ready)
+		return NULL;
+
+	if (ret == OBS_OUTPUT_SUCCESS) {
+		for (size_t i = 0; i < stream->dests.num; i++) {
+			struct rtmp_dest *dest = stream->dests.array[i];
+			if (dest->connected)
+				send_headers(dest);
+		}
+
+		stream->active        = true;
+		stream->test_start_ns = os_gettime_ns();
+
+		for (size_t i = 0; i < stream->dests.num; i++) {
+			struct rtmp_dest *dest = stream->dests.array[i];
+
+			/* destinations that failed to connect only get a
+			 * thread if they're allowed to retry */
+			if (!dest->connected && !dest->max_retries)
+				continue;
+
+			if (!dest->connected)
+				dest->reconnecting = true;
+
+			if (!start_send_thread(dest))
+				blog(LOG_WARNING, "Failed to create send "
+				                  "thread for %s",
+				                  dest->path.array);
+		}
+
+		if (stream->active_dests)
+			obs_output_begin_data_capture(stream->output, 0);
+		else
+			ret = OBS_OUTPUT_FAIL;
 	}
 
+	if (ret != OBS_OUTPUT_SUCCESS)
+		stream->active = false;
+
+	/* stop may be called from the stop signal below, so the thread must
+	 * no longer be joinable by then */
+	stream->connecting = false;
 	if (os_event_try(stream->stop_event) == EAGAIN)
 		pthread_detach(stream->connect_thread);
 
-	stream->connecting = false;
+	if (ret != OBS_OUTPUT_SUCCESS)
+		obs_output_signal_stop(stream->output, ret);
 	return NULL;
 }
 
+static void init_adaptive_bitrate(struct rtmp_stream *stream,
+		obs_data_t settings)
+{
+	obs_encoder_t vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t    vsettings = obs_encoder_get_settings(vencoder);
+
+	stream->max_bitrate       = (int)obs_data_getint(vsettings, "bitrate");
+	stream->min_bitrate       = stream->max_bitrate / 4;
+	stream->cur_bitrate       = stream->max_bitrate;
+	stream->last_abr_dts_usec = 0;
+	stream->adaptive_bitrate  =
+		obs_data_getbool(settings, "adaptive_bitrate") &&
+		!stream->bandwidth_test &&
+		stream->min_bitrate > 0;
+
+	obs_data_release(vsettings);
+}
+
+/* destination settings fall back to the output's settings */
+static void add_dest(struct rtmp_stream *stream, obs_data_t settings,
+		obs_data_t dest_settings)
+{
+	struct rtmp_dest *dest = bzalloc(sizeof(struct rtmp_dest));
+	dest->stream = stream;
+
+	if (pthread_mutex_init(&dest->packets_mutex, NULL) != 0) {
+		bfree(dest);
+		return;
+	}
+
+	obs_data_set_default_int(dest_settings, "drop_threshold",
+			obs_data_getint(settings, "drop_threshold"));
+	obs_data_set_default_bool(dest_settings, "graduated_drop",
+			obs_data_getbool(settings, "graduated_drop"));
+	obs_data_set_default_int(dest_settings, "max_retries",
+			obs_data_getint(settings, "max_retries"));
+	obs_data_set_default_int(dest_settings, "retry_delay",
+			obs_data_getint(settings, "retry_delay"));
+	obs_data_set_default_int(dest_settings, "retry_max_delay",
+			obs_data_getint(settings, "retry_max_delay"));
+	obs_data_set_default_int(dest_settings, "reconnect_buffer_sec",
+			obs_data_getint(settings, "reconnect_buffer_sec"));
+	obs_data_set_default_int(dest_settings, "reconnect_buffer_mb",
+			obs_data_getint(settings, "reconnect_buffer_mb"));
+
+	dstr_copy(&dest->path,     obs_data_getstring(dest_settings, "path"));
+	dstr_copy(&dest->key,      obs_data_getstring(dest_settings, "key"));
+	dstr_copy(&dest->username,
+			obs_data_getstring(dest_settings, "username"));
+	dstr_copy(&dest->password,
+			obs_data_getstring(dest_settings, "password"));
+
+	dest->drop_threshold_usec =
+		obs_data_getint(dest_settings, "drop_threshold");
+	dest->graduated_drop  = obs_data_getbool(dest_settings,
+			"graduated_drop");
+	dest->max_retries     = (int)obs_data_getint(dest_settings,
+			"max_retries");
+	dest->retry_delay_sec = (int)obs_data_getint(dest_settings,
+			"retry_delay");
+	dest->retry_max_delay_sec = (int)obs_data_getint(dest_settings,
+			"retry_max_delay");
+	dest->reconnect_buffer_usec = obs_data_getint(dest_settings,
+			"reconnect_buffer_sec") * 1000000;
+	dest->reconnect_buffer_size = (size_t)obs_data_getint(dest_settings,
+			"reconnect_buffer_mb") * 1024 * 1024;
+
+	if (stream->bandwidth_test)
+		dest->max_retries = 0;
+	if (dest->retry_delay_sec < 1)
+		dest->retry_delay_sec = 1;
+	if (dest->retry_max_delay_sec < dest->retry_delay_sec)
+		dest->retry_max_delay_sec = dest->retry_delay_sec;
+
+	pthread_mutex_lock(&stream->dests_mutex);
+	dest->index = stream->dests.num;
+	da_push_back(stream->dests, &dest);
+	pthread_mutex_unlock(&stream->dests_mutex);
+}
+
+static void init_dests(struct rtmp_stream *stream, obs_data_t settings)
+{
+	obs_service_t    service = obs_output_get_service(stream->output);
+	obs_data_t       primary = obs_data_create();
+	obs_data_array_t array   = obs_data_getarray(settings, "destinations");
+	size_t           count   = obs_data_array_count(array);
+	struct dstr      key     = {0};
+
+	dstr_copy(&key, obs_service_get_key(service));
+
+	/* the test only measures the connection to the service */
+	if (stream->bandwidth_test) {
+		dstr_cat(&key, obs_data_getstring(settings,
+					"bandwidth_test_key_suffix"));
+		count = 0;
+	}
+
+	obs_data_setstring(primary, "path", obs_service_get_url(service));
+	obs_data_setstring(primary, "key",  key.array ? key.array : "");
+	dstr_free(&key);
+	obs_data_setstring(primary, "username",
+			obs_service_get_username(service));
+	obs_data_setstring(primary, "password",
+			obs_service_get_password(service));
+	add_dest(stream, settings, primary);
+	obs_data_release(primary);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t item = obs_data_array_item(array, i);
+		add_dest(stream, settings, item);
+		obs_data_release(item);
+	}
+
+	obs_data_array_release(array);
+}
+
 static bool rtmp_stream_start(void *data)
 {
 	struct rtmp_stream *stream = data;
-	obs_service_t service = obs_output_get_service(stream->output);
 	obs_data_t settings;
 
 	if (!obs_output_can_begin_data_capture(stream->output, 0))
 		return false;
-	if (!obs_output_initialize_encoders(stream->output, 0))
-		return false;
 
+	/* adaptive bitrate reconfigures the encoder, which mustn't affect
+	 * any other output */
 	settings = obs_output_get_settings(stream->output);
-	dstr_copy(&stream->path,     obs_service_get_url(service));
-	dstr_copy(&stream->key,      obs_service_get_key(service));
-	dstr_copy(&stream->username, obs_service_get_username(service));
-	dstr_copy(&stream->password, obs_service_get_password(service));
-	stream->drop_threshold_usec =
-		(int64_t)obs_data_getint(settings, "drop_threshold");
+	obs_output_set_share_encoders(stream->output,
+			!obs_data_getbool(settings, "adaptive_bitrate"));
+
+	stream->stop_flush_ns    = (uint64_t)obs_data_getint(settings,
+			"stop_flush_sec") * 1000000000ULL;
+	stream->bandwidth_test   = obs_data_getbool(settings, "bandwidth_test");
+	stream->test_duration_ns = (uint64_t)obs_data_getint(settings,
+			"bandwidth_test_duration") * 1000000000ULL;
+
+	init_dests(stream, settings);
+	init_adaptive_bitrate(stream, settings);
 	obs_data_release(settings);
 
-	return pthread_create(&stream->connect_thread, NULL, connect_thread,
-			stream) == 0;
+	if (!stream->dests.num)
+		return false;
+
+	/* connecting doesn't need the encoders, so they're initialized
+	 * while the connections are being made */
+	stream->encoders_ready = false;
+	os_event_reset(stream->encoders_event);
+
+	stream->connecting = true;
+	if (pthread_create(&stream->connect_thread, NULL, connect_thread,
+				stream) != 0) {
+		stream->connecting = false;
+		free_dests(stream);
+		return false;
+	}
+
+	stream->encoders_ready = obs_output_initialize_encoders(
+			stream->output, 0);
+	os_event_signal(stream->encoders_event);
+
+	if (!stream->encoders_ready) {
+		rtmp_stream_stop(stream);
+		return false;
+	}
+
+	return true;
 }
 
-static inline bool add_packet(struct rtmp_stream *stream,
-		struct encoder_packet *packet)
+static inline bool add_packet(struct rtmp_dest *dest,
+		const struct rtmp_packet *shared)
 {
-	circlebuf_push_back(&stream->packets, packet,
-			sizeof(struct encoder_packet));
-	stream->last_dts_usec = packet->dts_usec;
+	struct rtmp_packet entry = *shared;
+
+	obs_encoder_packet_ref(&entry.packet,
+			(struct encoder_packet*)&shared->packet);
+	circlebuf_push_back(&dest->packets, &entry,
+			sizeof(struct rtmp_packet));
+	dest->last_dts_usec = entry.packet.dts_usec;
 	return true;
 }
 
-static inline size_t num_buffered_packets(struct rtmp_stream *stream)
+static inline size_t num_buffered_packets(struct rtmp_dest *dest)
 {
-	return stream->packets.size / sizeof(struct encoder_packet);
+	return dest->packets.size / sizeof(struct rtmp_packet);
 }
 
-static void drop_frames(struct rtmp_stream *stream)
-{
-	struct circlebuf new_buf            = {0};
-	int              drop_priority      = 0;
-	uint64_t         last_drop_dts_usec = 0;
+enum drop_level {
+	DROP_DISPOSABLE,
+	DROP_GOP_TAILS,
+	DROP_GOPS
+};
 
-	blog(LOG_DEBUG, "Previous packet count: %d",
-			(int)num_buffered_packets(stream));
+struct drop_state {
+	enum drop_level level;
+	size_t          target_size;
+	size_t          dropped_size;
+	size_t          dropped_count;
+	bool            dropping_gop;
+	int             gop_drop_priority;
+};
 
-	circlebuf_reserve(&new_buf, sizeof(struct encoder_packet) * 8);
+static inline bool should_drop_packet(struct drop_state *state,
+		struct encoder_packet *packet)
+{
+	if (packet->type == OBS_ENCODER_AUDIO)
+		return false;
 
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
+	/* disposable frames are not referenced by any other frame, so they
+	 * can be dropped individually */
+	if (state->level == DROP_DISPOSABLE)
+		return packet->priority == OBS_NAL_PRIORITY_DISPOSABLE &&
+			state->dropped_size < state->target_size;
 
-		last_drop_dts_usec = packet.dts_usec;
+	/* past this point, any dropped frame invalidates the rest of its GOP,
+	 * so the decision is only made at GOP boundaries */
+	if (packet->keyframe) {
+		state->dropping_gop      =
+			state->dropped_size < state->target_size;
+		state->gop_drop_priority = 0;
 
-		if (packet.type == OBS_ENCODER_AUDIO) {
-			circlebuf_push_back(&new_buf, &packet, sizeof(packet));
+		if (state->level == DROP_GOP_TAILS)
+			return false;
+	}
 
-		} else {
-			if (drop_priority < packet.drop_priority)
-				drop_priority = packet.drop_priority;
+	return state->dropping_gop;
+}
 
-			obs_free_encoder_packet(&packet);
+/* removes the packets chosen by the drop level from the buffer in place,
+ * oldest first, until target_size bytes have been dropped */
+static void drop_packets(struct rtmp_dest *dest, struct drop_state *state)
+{
+	size_t count = num_buffered_packets(dest);
+	size_t kept  = 0;
+
+	/* the front of the buffer may be partway through a GOP whose
+	 * keyframe has already been sent */
+	state->dropping_gop      = state->dropped_size < state->target_size;
+	state->gop_drop_priority = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		struct rtmp_packet entry;
+		circlebuf_peek_at(&dest->packets, i * sizeof(entry),
+				&entry, sizeof(entry));
+
+		if (should_drop_packet(state, &entry.packet)) {
+			if (state->gop_drop_priority <
+			    entry.packet.drop_priority)
+				state->gop_drop_priority =
+					entry.packet.drop_priority;
+
+			state->dropped_size += entry.packet.size;
+			state->dropped_count++;
+			count_dropped(dest, &entry.packet);
+			obs_encoder_packet_release(&entry.packet);
+			continue;
 		}
+
+		if (kept != i)
+			circlebuf_place(&dest->packets, kept * sizeof(entry),
+					&entry, sizeof(entry));
+		kept++;
 	}
 
-	circlebuf_free(&stream->packets);
-	stream->packets           = new_buf;
-	stream->min_priority      = drop_priority;
-	stream->min_drop_dts_usec = last_drop_dts_usec;
+	circlebuf_pop_back(&dest->packets,
+			(count - kept) * sizeof(struct rtmp_packet));
+
+	/* if the newest GOP was cut, packets still to come from the encoder
+	 * need to be dropped until one arrives with a high enough priority */
+	if (state->level != DROP_DISPOSABLE && state->dropping_gop &&
+	    dest->min_priority < state->gop_drop_priority)
+		dest->min_priority = state->gop_drop_priority;
+}
+
+static inline size_t buffered_size(struct rtmp_dest *dest)
+{
+	size_t count = num_buffered_packets(dest);
+	size_t size  = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		struct rtmp_packet entry;
+		circlebuf_peek_at(&dest->packets, i * sizeof(entry),
+				&entry, sizeof(entry));
+		size += entry.packet.size;
+	}
 
+	return size;
+}
+
+static void drop_frames(struct rtmp_dest *dest, int64_t buffer_duration_usec)
+{
+	struct drop_state state = {0};
+	size_t            total = buffered_size(dest);
+	enum drop_level   level;
+
+	blog(LOG_DEBUG, "Previous packet count: %d",
+			(int)num_buffered_packets(dest));
+
+	/* in graduated mode, drop just enough data to bring the buffer back
+	 * to half the threshold, starting with the least important frames.
+	 * otherwise, flush all buffered video. */
+	if (dest->graduated_drop) {
+		double keep = (double)dest->drop_threshold_usec * 0.5 /
+			(double)buffer_duration_usec;
+
+		state.target_size = total - (size_t)((double)total * keep);
+		level = DROP_DISPOSABLE;
+	} else {
+		state.target_size = total;
+		level = DROP_GOPS;
+	}
+
+	for (; level <= DROP_GOPS; level++) {
+		state.level = level;
+		drop_packets(dest, &state);
+
+		if (state.dropped_size >= state.target_size)
+			break;
+	}
+
+	dest->min_drop_dts_usec = dest->last_dts_usec;
+
+	blog(LOG_INFO, "%s: Dropped %d video packets (%d bytes, "
+	               "drop level %d)", dest->path.array,
+	               (int)state.dropped_count, (int)state.dropped_size,
+	               (int)state.level);
 	blog(LOG_DEBUG, "New packet count: %d",
-			(int)num_buffered_packets(stream));
+			(int)num_buffered_packets(dest));
 }
 
-static void check_to_drop_frames(struct rtmp_stream *stream)
+/* also publishes the duration for the stats */
+static int64_t get_buffer_duration(struct rtmp_dest *dest,
+		struct rtmp_packet *first)
 {
-	struct encoder_packet first;
-	int64_t buffer_duration_usec;
+	int64_t duration = 0;
 
-	if (num_buffered_packets(stream) < 5)
-		return;
+	if (dest->packets.size) {
+		circlebuf_peek_front(&dest->packets, first, sizeof(*first));
+		duration = dest->last_dts_usec - first->packet.dts_usec;
+	}
+
+	os_atomic_set_long(&dest->stats.buffer_ms, (long)(duration / 1000));
+	if (dest->max_buffer_ms < (long)(duration / 1000))
+		dest->max_buffer_ms = (long)(duration / 1000);
+	return duration;
+}
 
-	circlebuf_peek_front(&stream->packets, &first, sizeof(first));
+static void check_to_drop_frames(struct rtmp_dest *dest)
+{
+	struct rtmp_packet first;
+	int64_t buffer_duration_usec = get_buffer_duration(dest, &first);
+
+	if (num_buffered_packets(dest) < 5)
+		return;
 
 	/* do not drop frames if frames were just dropped within this time */
-	if (first.dts_usec < stream->min_drop_dts_usec)
+	if (first.packet.dts_usec < dest->min_drop_dts_usec)
 		return;
 
 	/* if the amount of time stored in the buffered packets waiting to be
 	 * sent is higher than threshold, drop frames */
-	buffer_duration_usec = stream->last_dts_usec - first.dts_usec;
-	if (buffer_duration_usec > stream->drop_threshold_usec) {
-		drop_frames(stream);
+	if (buffer_duration_usec > dest->drop_threshold_usec) {
+		drop_frames(dest, buffer_duration_usec);
 		blog(LOG_INFO, "dropping %lld worth of frames",
 				buffer_duration_usec);
 	}
 }
 
-static bool add_video_packet(struct rtmp_stream *stream,
-		struct encoder_packet *packet)
+static bool add_video_packet(struct rtmp_dest *dest,
+		const struct rtmp_packet *shared)
 {
-	check_to_drop_frames(stream);
+	const struct encoder_packet *packet = &shared->packet;
+
+	check_to_drop_frames(dest);
 
 	/* if currently dropping frames, drop packets until it reaches the
 	 * desired priority */
-	if (packet->priority < stream->min_priority)
+	if (packet->priority < dest->min_priority) {
+		count_dropped(dest, packet);
 		return false;
-	else
-		stream->min_priority = 0;
+	} else {
+		dest->min_priority = 0;
+	}
 
-	return add_packet(stream, packet);
+	return add_packet(dest, shared);
+}
+
+/* drops the oldest GOP, so the buffer starts at the next keyframe */
+static void drop_front_gop(struct rtmp_dest *dest)
+{
+	struct rtmp_packet entry;
+
+	circlebuf_pop_front(&dest->packets, &entry, sizeof(entry));
+	count_dropped(dest, &entry.packet);
+	obs_encoder_packet_release(&entry.packet);
+	trim_to_keyframe(dest);
+}
+
+static void trim_reconnect_buffer(struct rtmp_dest *dest)
+{
+	size_t dropped = 0;
+
+	while (dest->packets.size) {
+		struct rtmp_packet first;
+		int64_t duration;
+
+		circlebuf_peek_front(&dest->packets, &first, sizeof(first));
+		duration = dest->last_dts_usec - first.packet.dts_usec;
+
+		if (duration <= dest->reconnect_buffer_usec &&
+		    buffered_size(dest) <= dest->reconnect_buffer_size)
+			break;
+
+		drop_front_gop(dest);
+		dropped++;
+	}
+
+	if (dropped)
+		blog(LOG_DEBUG, "%s: Dropped %d GOP(s) from the reconnect "
+		                "buffer", dest->path.array, (int)dropped);
+}
+
+/* the buffer is either empty or starts with a keyframe while reconnecting */
+static bool add_reconnect_packet(struct rtmp_dest *dest,
+		const struct rtmp_packet *shared)
+{
+	struct rtmp_packet first;
+
+	if (!dest->packets.size && !is_keyframe(shared))
+		return false;
+
+	add_packet(dest, shared);
+	trim_reconnect_buffer(dest);
+	get_buffer_duration(dest, &first);
+	return true;
+}
+
+static void set_video_bitrate(struct rtmp_stream *stream, int bitrate)
+{
+	obs_encoder_t   vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t      settings = obs_data_create();
+	struct calldata params   = {0};
+
+	obs_data_setint(settings, "bitrate", bitrate);
+	obs_encoder_update(vencoder, settings);
+	obs_data_release(settings);
+
+	blog(LOG_INFO, "Adaptive bitrate: video bitrate set to %d", bitrate);
+
+	calldata_setptr(&params, "output", stream->output);
+	calldata_setint(&params, "bitrate", bitrate);
+	signal_handler_signal(obs_output_signalhandler(stream->output),
+			"bitrate_changed", &params);
+	calldata_free(&params);
+}
+
+/* steps the bitrate down multiplicatively while the send buffer is backing
+ * up, and ramps it back up additively once it has stayed clear.  returns the
+ * new bitrate, or 0 if it should stay the same. */
+static int check_bitrate(struct rtmp_stream *stream, struct rtmp_dest *dest)
+{
+	struct rtmp_packet first;
+	int64_t buffer_duration_usec = 0;
+	int64_t elapsed_usec;
+	int     bitrate = stream->cur_bitrate;
+
+	if (dest->packets.size) {
+		circlebuf_peek_front(&dest->packets, &first, sizeof(first));
+		buffer_duration_usec =
+			dest->last_dts_usec - first.packet.dts_usec;
+	}
+
+	elapsed_usec = dest->last_dts_usec - stream->last_abr_dts_usec;
+
+	if (buffer_duration_usec > dest->drop_threshold_usec / 2) {
+		if (elapsed_usec >= ABR_DECREASE_INTERVAL_USEC)
+			bitrate = bitrate * 3 / 4;
+
+	} else if (buffer_duration_usec < dest->drop_threshold_usec / 8) {
+		if (elapsed_usec >= ABR_INCREASE_INTERVAL_USEC)
+			bitrate += stream->max_bitrate / 10;
+	}
+
+	if (bitrate < stream->min_bitrate)
+		bitrate = stream->min_bitrate;
+	else if (bitrate > stream->max_bitrate)
+		bitrate = stream->max_bitrate;
+
+	if (bitrate == stream->cur_bitrate)
+		return 0;
+
+	stream->cur_bitrate       = bitrate;
+	stream->last_abr_dts_usec = dest->last_dts_usec;
+	return bitrate;
 }
 
 static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 {
-	struct rtmp_stream    *stream = data;
-	struct encoder_packet new_packet;
-	bool                  added_packet;
+	struct rtmp_stream *stream = data;
+	struct rtmp_packet shared;
+	bool               video = packet->type == OBS_ENCODER_VIDEO;
+	int                new_bitrate = 0;
 
-	if (packet->type == OBS_ENCODER_VIDEO)
-		obs_parse_avc_packet(&new_packet, packet);
+	if (video)
+		obs_parse_avc_packet(&shared.packet, packet);
 	else
-		obs_duplicate_encoder_packet(&new_packet, packet);
+		obs_encoder_packet_ref(&shared.packet, packet);
 
-	pthread_mutex_lock(&stream->packets_mutex);
+	shared.header_size = flv_packet_header_buf(&shared.packet,
+			shared.header, false);
 
-	added_packet = (packet->type == OBS_ENCODER_VIDEO) ?
-		add_video_packet(stream, &new_packet) :
-		add_packet(stream, &new_packet);
+	for (size_t i = 0; i < stream->dests.num; i++) {
+		struct rtmp_dest *dest = stream->dests.array[i];
+		bool             added = false;
 
-	pthread_mutex_unlock(&stream->packets_mutex);
+		pthread_mutex_lock(&dest->packets_mutex);
 
-	if (added_packet)
-		os_sem_post(stream->send_sem);
-	else
-		obs_free_encoder_packet(&new_packet);
+		if (dest->connected)
+			added = video ?
+				add_video_packet(dest, &shared) :
+				add_packet(dest, &shared);
+		else if (dest->reconnecting)
+			added = add_reconnect_packet(dest, &shared);
+
+		if (i == 0 && stream->adaptive_bitrate && video &&
+		    dest->connected)
+			new_bitrate = check_bitrate(stream, dest);
+
+		pthread_mutex_unlock(&dest->packets_mutex);
+
+		if (added)
+			os_sem_post(dest->send_sem);
+	}
+
+	obs_encoder_packet_release(&shared.packet);
+
+	/* this is the interleaved packet thread, which usually isn't the
+	 * video encoder's.  obs_encoder_update waits for a frame being
+	 * encoded to finish, so the encoder is never reconfigured in the
+	 * middle of one */
+	if (new_bitrate)
+		set_video_bitrate(stream, new_bitrate);
 }
 
 static void rtmp_stream_defaults(obs_data_t defaults)
 {
 	obs_data_set_default_int(defaults, "drop_threshold", 600000);
+	obs_data_set_default_bool(defaults, "graduated_drop", true);
+	obs_data_set_default_bool(defaults, "adaptive_bitrate", false);
+	obs_data_set_default_int(defaults, "max_retries", 20);
+	obs_data_set_default_int(defaults, "retry_delay", 2);
+	obs_data_set_default_int(defaults, "retry_max_delay", 60);
+	obs_data_set_default_int(defaults, "reconnect_buffer_sec", 10);
+	obs_data_set_default_int(defaults, "reconnect_buffer_mb", 32);
+	obs_data_set_default_int(defaults, "stop_flush_sec", 5);
+	obs_data_set_default_bool(defaults, "bandwidth_test", false);
+	obs_data_set_default_int(defaults, "bandwidth_test_duration", 30);
+	obs_data_set_default_string(defaults, "bandwidth_test_key_suffix",
+			"?bandwidthtest=true");
 }
 
 static obs_properties_t rtmp_stream_properties(const char *locale)
@@ -566,6 +1692,24 @@ static obs_properties_t rtmp_stream_properties(const char *locale)
 			OBS_TEXT_DEFAULT);
 	obs_properties_add_text(props, "password", "Password",
 			OBS_TEXT_PASSWORD);
+	obs_properties_add_int(props, "max_retries", "Reconnect Attempts",
+			0, 10000, 1);
+	obs_properties_add_int(props, "retry_delay",
+			"Reconnect Delay (seconds)", 1, 60, 1);
+	obs_properties_add_int(props, "retry_max_delay",
+			"Maximum Reconnect Delay (seconds)", 1, 600, 1);
+	obs_properties_add_int(props, "reconnect_buffer_sec",
+			"Reconnect Buffer (seconds)", 0, 120, 1);
+	obs_properties_add_int(props, "reconnect_buffer_mb",
+			"Reconnect Buffer (MB)", 0, 1024, 1);
+	obs_properties_add_int(props, "stop_flush_sec",
+			"Time to Send Remaining Data on Stop (seconds)",
+			0, 60, 1);
+	obs_properties_add_bool(props, "bandwidth_test", "Bandwidth Test");
+	obs_properties_add_int(props, "bandwidth_test_duration",
+			"Bandwidth Test Duration (seconds)", 5, 300, 1);
+	obs_properties_add_text(props, "bandwidth_test_key_suffix",
+			"Bandwidth Test Stream Key Suffix", OBS_TEXT_DEFAULT);
 	return props;
 }
 
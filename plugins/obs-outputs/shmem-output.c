@@ -0,0 +1,513 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs.h>
+#include <util/dstr.h>
+#include "shmem-output.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+/* Shared memory output
+ *
+ * Publishes the raw frames of the video and audio outputs into a named
+ * shared memory ring, so other local processes (virtual cameras, analysis
+ * tools) can use them without encoding.  See shmem-output.h for the layout.
+ * Frames are copied into the ring once, readers use them in place. */
+
+#define SHMEM_PREFIX "obs-shmem-"
+
+struct shmem_map {
+	uint8_t             *data;
+	size_t              size;
+#ifdef _WIN32
+	HANDLE              handle;
+#else
+	int                 fd;
+	struct dstr         name;
+#endif
+};
+
+struct shmem_output {
+	obs_output_t        output;
+	struct shmem_map    map;
+	struct shmem_header *header;
+
+	uint32_t            video_plane_height[SHMEM_MAX_PLANES];
+	uint32_t            audio_bytes_per_frame;
+};
+
+/* ------------------------------------------------------------------------- */
+
+#ifdef _WIN32
+static bool shmem_map_create(struct shmem_map *map, const char *name,
+		size_t size)
+{
+	struct dstr full_name = {0};
+	uint64_t    size64    = (uint64_t)size;
+
+	dstr_printf(&full_name, SHMEM_PREFIX "%s", name);
+	map->handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL,
+			PAGE_READWRITE, (DWORD)(size64 >> 32),
+			(DWORD)(size64 & 0xFFFFFFFF), full_name.array);
+	dstr_free(&full_name);
+
+	if (!map->handle)
+		return false;
+
+	/* another process owning the name would give us its mapping */
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		CloseHandle(map->handle);
+		map->handle = NULL;
+		return false;
+	}
+
+	map->data = MapViewOfFile(map->handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!map->data) {
+		CloseHandle(map->handle);
+		map->handle = NULL;
+		return false;
+	}
+
+	map->size = size;
+	return true;
+}
+
+static void shmem_map_destroy(struct shmem_map *map)
+{
+	if (map->data)
+		UnmapViewOfFile(map->data);
+	if (map->handle)
+		CloseHandle(map->handle);
+
+	memset(map, 0, sizeof(struct shmem_map));
+}
+
+#else
+static bool shmem_map_create(struct shmem_map *map, const char *name,
+		size_t size)
+{
+	dstr_printf(&map->name, "/" SHMEM_PREFIX "%s", name);
+
+	/* a mapping left behind by a crashed process is replaced */
+	shm_unlink(map->name.array);
+
+	map->fd = shm_open(map->name.array, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (map->fd == -1)
+		goto fail;
+	if (ftruncate(map->fd, (off_t)size) != 0)
+		goto fail;
+
+	map->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			map->fd, 0);
+	if (map->data == MAP_FAILED) {
+		map->data = NULL;
+		goto fail;
+	}
+
+	map->size = size;
+	return true;
+
+fail:
+	if (map->fd != -1) {
+		close(map->fd);
+		shm_unlink(map->name.array);
+	}
+	map->fd = -1;
+	dstr_free(&map->name);
+	return false;
+}
+
+static void shmem_map_destroy(struct shmem_map *map)
+{
+	if (map->data)
+		munmap(map->data, map->size);
+	if (map->fd != -1) {
+		close(map->fd);
+		shm_unlink(map->name.array);
+	}
+
+	dstr_free(&map->name);
+	memset(map, 0, sizeof(struct shmem_map));
+	map->fd = -1;
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static inline uint32_t round_pow2(uint32_t val)
+{
+	uint32_t pow2 = 1;
+	while (pow2 < val && pow2 < 0x80000000)
+		pow2 <<= 1;
+	return pow2;
+}
+
+static inline uint32_t align_size(uint32_t size)
+{
+	return (size + 63) & ~63;
+}
+
+/* planes are packed tightly, without the alignment of the video output */
+static uint32_t get_video_planes(enum video_format format,
+		uint32_t width, uint32_t height,
+		uint32_t *linesize, uint32_t *plane_height)
+{
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+		linesize[0] = width;   plane_height[0] = height;
+		linesize[1] = width/2; plane_height[1] = height/2;
+		linesize[2] = width/2; plane_height[2] = height/2;
+		return 3;
+	case VIDEO_FORMAT_NV12:
+		linesize[0] = width;   plane_height[0] = height;
+		linesize[1] = width;   plane_height[1] = height/2;
+		return 2;
+	case VIDEO_FORMAT_YVYU:
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+		linesize[0] = width*2; plane_height[0] = height;
+		return 1;
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+		linesize[0] = width*4; plane_height[0] = height;
+		return 1;
+	case VIDEO_FORMAT_I444:
+		for (size_t i = 0; i < 3; i++) {
+			linesize[i]     = width;
+			plane_height[i] = height;
+		}
+		return 3;
+	case VIDEO_FORMAT_I422:
+		linesize[0] = width;   plane_height[0] = height;
+		linesize[1] = width/2; plane_height[1] = height;
+		linesize[2] = width/2; plane_height[2] = height;
+		return 3;
+	case VIDEO_FORMAT_NONE:
+		break;
+	}
+
+	return 0;
+}
+
+static bool init_video_layout(struct shmem_output *so,
+		struct shmem_header *header, uint32_t slots)
+{
+	video_t video = obs_output_video(so->output);
+	const struct video_output_info *info = video_output_getinfo(video);
+	uint32_t offset = SHMEM_SLOT_DATA_OFFSET;
+
+	if (!info)
+		return false;
+
+	header->video_format = (uint32_t)info->format;
+	header->width        = info->width;
+	header->height       = info->height;
+	header->fps_num      = info->fps_num;
+	header->fps_den      = info->fps_den;
+	header->video_planes = get_video_planes(info->format,
+			info->width, info->height,
+			header->video_linesize, so->video_plane_height);
+
+	if (!header->video_planes)
+		return false;
+
+	for (uint32_t i = 0; i < header->video_planes; i++) {
+		header->video_plane_offset[i] = offset;
+		offset += align_size(header->video_linesize[i] *
+				so->video_plane_height[i]);
+	}
+
+	header->video_slots     = round_pow2(slots);
+	header->video_slot_size = offset;
+	return true;
+}
+
+static bool init_audio_layout(struct shmem_output *so,
+		struct shmem_header *header, uint32_t slots)
+{
+	audio_t audio = obs_output_audio(so->output);
+	const struct audio_output_info *info = audio_output_getinfo(audio);
+	uint32_t slot_frames;
+
+	if (!info)
+		return false;
+
+	/* the mixing period is well below 100ms, larger blocks are split */
+	slot_frames = info->samples_per_sec / 10;
+
+	so->audio_bytes_per_frame = (uint32_t)get_audio_size(info->format,
+			info->speakers, 1);
+
+	header->audio_format      = (uint32_t)info->format;
+	header->samples_per_sec   = info->samples_per_sec;
+	header->channels          = get_audio_channels(info->speakers);
+	header->audio_planes      = (uint32_t)get_audio_planes(info->format,
+			info->speakers);
+	header->audio_slot_frames = slot_frames;
+	header->audio_plane_size  = align_size(slot_frames *
+			so->audio_bytes_per_frame);
+	header->audio_slots       = round_pow2(slots);
+	header->audio_slot_size   = SHMEM_SLOT_DATA_OFFSET +
+		header->audio_planes * header->audio_plane_size;
+
+	return header->audio_planes <= SHMEM_MAX_PLANES &&
+	       so->audio_bytes_per_frame != 0;
+}
+
+static inline struct shmem_slot *get_slot(struct shmem_output *so,
+		uint64_t offset, uint32_t slot_size, uint32_t idx)
+{
+	return (struct shmem_slot*)(so->map.data + offset +
+			(uint64_t)idx * slot_size);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const char *shmem_output_getname(const char *locale)
+{
+	/* TODO: locale stuff */
+	UNUSED_PARAMETER(locale);
+	return "Shared Memory Output";
+}
+
+static void shmem_output_destroy(void *data)
+{
+	struct shmem_output *so = data;
+	bfree(so);
+}
+
+static void *shmem_output_create(obs_data_t settings, obs_output_t output)
+{
+	struct shmem_output *so = bzalloc(sizeof(struct shmem_output));
+	so->output = output;
+#ifndef _WIN32
+	so->map.fd = -1;
+#endif
+
+	UNUSED_PARAMETER(settings);
+	return so;
+}
+
+static bool shmem_output_start(void *data)
+{
+	struct shmem_output *so = data;
+	struct shmem_header header = {0};
+	obs_data_t settings;
+	const char *name;
+	uint32_t   video_slots, audio_slots;
+	size_t     size;
+
+	if (!obs_output_can_begin_data_capture(so->output, 0))
+		return false;
+
+	settings    = obs_output_get_settings(so->output);
+	name        = obs_data_getstring(settings, "name");
+	video_slots = (uint32_t)obs_data_getint(settings, "video_slots");
+	audio_slots = (uint32_t)obs_data_getint(settings, "audio_slots");
+
+	if (!init_video_layout(so, &header, video_slots ? video_slots : 1) ||
+	    !init_audio_layout(so, &header, audio_slots ? audio_slots : 1)) {
+		blog(LOG_WARNING, "shmem output: unsupported video or audio "
+		                  "format");
+		obs_data_release(settings);
+		return false;
+	}
+
+	header.magic        = SHMEM_MAGIC;
+	header.version      = SHMEM_VERSION;
+	header.header_size  = sizeof(struct shmem_header);
+	header.video_offset = align_size(sizeof(struct shmem_header));
+	header.audio_offset = header.video_offset +
+		(uint64_t)header.video_slots * header.video_slot_size;
+	size = (size_t)(header.audio_offset +
+		(uint64_t)header.audio_slots * header.audio_slot_size);
+
+	if (!shmem_map_create(&so->map, name && *name ? name : "output",
+				size)) {
+		blog(LOG_WARNING, "shmem output: failed to create shared "
+		                  "memory '%s'", name);
+		obs_data_release(settings);
+		return false;
+	}
+
+	obs_data_release(settings);
+
+	/* the mapping starts out zeroed, so all slots are empty */
+	so->header = (struct shmem_header*)so->map.data;
+	memcpy(so->header, &header, sizeof(header));
+	SHMEM_BARRIER();
+	so->header->active = 1;
+
+	return obs_output_begin_data_capture(so->output, 0);
+}
+
+static void shmem_output_stop(void *data)
+{
+	struct shmem_output *so = data;
+
+	obs_output_end_data_capture(so->output);
+
+	if (so->header) {
+		so->header->active = 0;
+		SHMEM_BARRIER();
+		so->header = NULL;
+	}
+
+	shmem_map_destroy(&so->map);
+#ifndef _WIN32
+	so->map.fd = -1;
+#endif
+}
+
+static inline void begin_slot(struct shmem_slot *slot, uint32_t count)
+{
+	slot->sequence = count * 2 + 1;
+	SHMEM_BARRIER();
+}
+
+static inline void end_slot(struct shmem_slot *slot, uint32_t count,
+		volatile uint32_t *write_count)
+{
+	SHMEM_BARRIER();
+	slot->sequence = count * 2 + 2;
+	SHMEM_BARRIER();
+	*write_count = count + 1;
+}
+
+static void shmem_output_raw_video(void *data, struct video_data *frame)
+{
+	struct shmem_output *so     = data;
+	struct shmem_header *header = so->header;
+	struct shmem_slot   *slot;
+	uint32_t            count;
+
+	if (!header)
+		return;
+
+	count = header->video_write_count;
+	slot  = get_slot(so, header->video_offset, header->video_slot_size,
+			count & (header->video_slots - 1));
+
+	begin_slot(slot, count);
+
+	for (uint32_t i = 0; i < header->video_planes; i++) {
+		uint8_t  *dst      = (uint8_t*)slot +
+			header->video_plane_offset[i];
+		uint32_t linesize  = header->video_linesize[i];
+		uint32_t height    = so->video_plane_height[i];
+
+		if (frame->linesize[i] == linesize) {
+			memcpy(dst, frame->data[i], linesize * height);
+			continue;
+		}
+
+		for (uint32_t y = 0; y < height; y++)
+			memcpy(dst + y * linesize,
+					frame->data[i] + y * frame->linesize[i],
+					linesize);
+	}
+
+	slot->timestamp = frame->timestamp;
+	slot->frames    = 1;
+	slot->flags     = frame->duplicate ? SHMEM_SLOT_DUPLICATE : 0;
+
+	end_slot(slot, count, &header->video_write_count);
+}
+
+static void shmem_output_raw_audio(void *data, struct audio_data *frames)
+{
+	struct shmem_output *so     = data;
+	struct shmem_header *header = so->header;
+	uint32_t            offset  = 0;
+
+	if (!header)
+		return;
+
+	while (offset < frames->frames) {
+		uint32_t count  = header->audio_write_count;
+		uint32_t block  = frames->frames - offset;
+		uint64_t ts_offset;
+		struct shmem_slot *slot;
+
+		if (block > header->audio_slot_frames)
+			block = header->audio_slot_frames;
+
+		slot = get_slot(so, header->audio_offset,
+				header->audio_slot_size,
+				count & (header->audio_slots - 1));
+
+		begin_slot(slot, count);
+
+		for (uint32_t i = 0; i < header->audio_planes; i++) {
+			uint8_t *dst = (uint8_t*)slot +
+				SHMEM_SLOT_DATA_OFFSET +
+				i * header->audio_plane_size;
+
+			memcpy(dst, frames->data[i] +
+					offset * so->audio_bytes_per_frame,
+					block * so->audio_bytes_per_frame);
+		}
+
+		ts_offset = (uint64_t)offset * 1000000000ULL /
+			header->samples_per_sec;
+
+		slot->timestamp = frames->timestamp + ts_offset;
+		slot->frames    = block;
+		slot->flags     = 0;
+
+		end_slot(slot, count, &header->audio_write_count);
+		offset += block;
+	}
+}
+
+static void shmem_output_defaults(obs_data_t defaults)
+{
+	obs_data_set_default_string(defaults, "name", "output");
+	obs_data_set_default_int(defaults, "video_slots", 4);
+	obs_data_set_default_int(defaults, "audio_slots", 32);
+}
+
+static obs_properties_t shmem_output_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_text(props, "name", "Name", OBS_TEXT_DEFAULT);
+	obs_properties_add_int(props, "video_slots", "Video Frames", 1, 64, 1);
+	obs_properties_add_int(props, "audio_slots", "Audio Blocks", 1, 256,
+			1);
+	return props;
+}
+
+struct obs_output_info shmem_output_info = {
+	.id         = "shmem_output",
+	.flags      = OBS_OUTPUT_AV,
+	.getname    = shmem_output_getname,
+	.create     = shmem_output_create,
+	.destroy    = shmem_output_destroy,
+	.start      = shmem_output_start,
+	.stop       = shmem_output_stop,
+	.raw_video  = shmem_output_raw_video,
+	.raw_audio  = shmem_output_raw_audio,
+	.defaults   = shmem_output_defaults,
+	.properties = shmem_output_properties
+};
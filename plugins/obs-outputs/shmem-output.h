@@ -0,0 +1,99 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define SHMEM_BARRIER() MemoryBarrier()
+#else
+#define SHMEM_BARRIER() __sync_synchronize()
+#endif
+
+/*
+ * Layout of the shared memory of the shared memory output
+ *
+ *   The mapping is named "obs-shmem-<name>" ("/obs-shmem-<name>" for
+ * shm_open), and starts with a shmem_header followed by the video slots and
+ * then the audio slots.  Every slot starts with a shmem_slot header, and the
+ * plane offsets are from the start of the slot.  Audio planes are
+ * audio_plane_size apart, starting at SHMEM_SLOT_DATA_OFFSET.  The slot
+ * counts are powers of two.
+ *
+ *   Frame n (counting from 0, wrapping at 2^32) is written to slot
+ * n & (slots - 1).  The writer sets the slot's sequence to n*2+1, writes the
+ * data, sets the sequence to n*2+2, and then sets the write count to n+1.
+ * Readers check that the sequence is n*2+2 before and after reading the
+ * data (with SHMEM_BARRIER in between), and retry or skip the frame if it
+ * isn't, so the writer never has to wait for readers.
+ *
+ *   Video readers usually only read the newest frame (write count - 1),
+ * audio readers every block in order.  Video data is in the enum
+ * video_format of libobs and audio data in its enum audio_format, with the
+ * planes packed one after another.
+ */
+
+#define SHMEM_MAGIC            0x53424F00 /* "\0OBS" */
+#define SHMEM_VERSION          1
+#define SHMEM_MAX_PLANES       8
+#define SHMEM_SLOT_DATA_OFFSET 64
+
+#define SHMEM_SLOT_DUPLICATE (1<<0)
+
+struct shmem_slot {
+	volatile uint32_t sequence;
+	uint32_t          flags;
+	uint64_t          timestamp;
+	uint32_t          frames;
+	uint32_t          reserved;
+};
+
+struct shmem_header {
+	uint32_t          magic;
+	uint32_t          version;
+	uint32_t          header_size;
+
+	/* cleared when the output stops */
+	volatile uint32_t active;
+
+	uint32_t          video_format;
+	uint32_t          width;
+	uint32_t          height;
+	uint32_t          fps_num;
+	uint32_t          fps_den;
+	uint32_t          video_planes;
+	uint32_t          video_linesize[SHMEM_MAX_PLANES];
+	uint32_t          video_plane_offset[SHMEM_MAX_PLANES];
+	uint32_t          video_slots;
+	uint32_t          video_slot_size;
+	uint64_t          video_offset;
+	volatile uint32_t video_write_count;
+
+	uint32_t          audio_format;
+	uint32_t          samples_per_sec;
+	uint32_t          channels;
+	uint32_t          audio_planes;
+	uint32_t          audio_plane_size;
+	uint32_t          audio_slot_frames;
+	uint32_t          audio_slots;
+	uint32_t          audio_slot_size;
+	uint64_t          audio_offset;
+	volatile uint32_t audio_write_count;
+};
@@ -0,0 +1,694 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs.h>
+#include <obs-avc.h>
+#include <util/platform.h>
+#include <util/circlebuf.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include "ts-mux.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#endif
+
+#include <srt/srt.h>
+
+/* SRT output
+ *
+ * Sends the encoded packets as an MPEG-TS stream over SRT.  Lost packets are
+ * retransmitted by SRT until they're due at the receiver, after which they
+ * are dropped on their own, so a lossy link costs a few packets now and then
+ * instead of stalling the whole stream like TCP does.  The latency window,
+ * the bandwidth overhead allowed for retransmissions and the pacing rate are
+ * set from the output settings. */
+
+/* transport packets are sent seven at a time, which is the most that fits
+ * in to one SRT live mode payload */
+#define SRT_PAYLOAD_SIZE  (TS_PACKET_SIZE * 7)
+
+#define STATS_INTERVAL_NS 1000000000ULL
+
+struct srt_stats {
+	long long        sent_kb;
+	long long        send_kbps;
+	long long        buffer_ms;
+	long long        rtt_ms;
+	long long        lost_packets;
+	long long        retransmitted_packets;
+	long long        late_dropped_packets;
+	long long        dropped_frames;
+	double           congestion;
+};
+
+struct srt_stream {
+	obs_output_t     output;
+
+	struct dstr      host;
+	int              port;
+	struct dstr      stream_id;
+	struct dstr      passphrase;
+	int              latency_ms;
+	int              overhead_pct;
+	int64_t          max_bitrate;
+
+	SRTSOCKET        sock;
+	struct ts_mux    mux;
+
+	pthread_mutex_t  packets_mutex;
+	struct circlebuf packets;
+	long             dropped_frames;
+
+	bool             connecting;
+	pthread_t        connect_thread;
+	bool             active;
+	bool             send_thread_active;
+	pthread_t        send_thread;
+	os_sem_t         send_sem;
+	os_event_t       stop_event;
+
+	pthread_mutex_t  stats_mutex;
+	struct srt_stats stats;
+	uint64_t         last_stats_ns;
+};
+
+static const char *srt_stream_getname(const char *locale)
+{
+	/* TODO: locale stuff */
+	UNUSED_PARAMETER(locale);
+	return "SRT Stream";
+}
+
+static void free_packets(struct srt_stream *stream)
+{
+	while (stream->packets.size) {
+		struct encoder_packet packet;
+		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
+		obs_encoder_packet_release(&packet);
+	}
+}
+
+static void srt_stream_stop(void *data);
+
+static void srt_stream_destroy(void *data)
+{
+	struct srt_stream *stream = data;
+
+	if (stream) {
+		if (stream->stop_event)
+			srt_stream_stop(stream);
+
+		circlebuf_free(&stream->packets);
+		pthread_mutex_destroy(&stream->packets_mutex);
+		pthread_mutex_destroy(&stream->stats_mutex);
+		os_event_destroy(stream->stop_event);
+		dstr_free(&stream->host);
+		dstr_free(&stream->stream_id);
+		dstr_free(&stream->passphrase);
+		bfree(stream);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* stats, with the same names as the stats of the RTMP output where they mean
+ * the same thing */
+
+static void fill_stats(struct srt_stream *stream, calldata_t params)
+{
+	struct srt_stats *stats = &stream->stats;
+
+	pthread_mutex_lock(&stream->stats_mutex);
+	calldata_setint(params, "sent_kb", stats->sent_kb);
+	calldata_setint(params, "send_kbps", stats->send_kbps);
+	calldata_setint(params, "buffer_ms", stats->buffer_ms);
+	calldata_setint(params, "dropped_disposable", stats->dropped_frames);
+	calldata_setint(params, "rtt_ms", stats->rtt_ms);
+	calldata_setint(params, "lost_packets", stats->lost_packets);
+	calldata_setint(params, "retransmitted_packets",
+			stats->retransmitted_packets);
+	calldata_setint(params, "late_dropped_packets",
+			stats->late_dropped_packets);
+	calldata_setfloat(params, "congestion", stats->congestion);
+	pthread_mutex_unlock(&stream->stats_mutex);
+}
+
+static void get_stats_proc(void *data, calldata_t params)
+{
+	fill_stats(data, params);
+}
+
+static void update_stats(struct srt_stream *stream)
+{
+	struct srt_stats stats = {0};
+	SRT_TRACEBSTATS  perf;
+	struct calldata  params = {0};
+	uint64_t         now = os_gettime_ns();
+
+	if (now - stream->last_stats_ns < STATS_INTERVAL_NS)
+		return;
+	stream->last_stats_ns = now;
+
+	if (srt_bstats(stream->sock, &perf, 0) == SRT_ERROR)
+		return;
+
+	stats.sent_kb               = (long long)(perf.byteSentTotal / 1024);
+	stats.send_kbps             = (long long)(perf.mbpsSendRate * 1000.0);
+	stats.buffer_ms             = perf.msSndBuf;
+	stats.rtt_ms                = (long long)perf.msRTT;
+	stats.lost_packets          = perf.pktSndLossTotal;
+	stats.retransmitted_packets = perf.pktRetransTotal;
+	stats.late_dropped_packets  = perf.pktSndDropTotal;
+	stats.dropped_frames        = os_atomic_load_long(
+			&stream->dropped_frames);
+
+	/* 1.0 means the send buffer holds as much as the latency window, at
+	 * which point packets start being dropped for being too late */
+	if (stream->latency_ms > 0) {
+		stats.congestion = (double)perf.msSndBuf /
+			(double)stream->latency_ms;
+		if (stats.congestion > 1.0)
+			stats.congestion = 1.0;
+	}
+
+	pthread_mutex_lock(&stream->stats_mutex);
+	stream->stats = stats;
+	pthread_mutex_unlock(&stream->stats_mutex);
+
+	calldata_setptr(&params, "output", stream->output);
+	fill_stats(stream, &params);
+	signal_handler_signal(obs_output_signalhandler(stream->output),
+			"stats", &params);
+	calldata_free(&params);
+}
+
+/* ------------------------------------------------------------------------- */
+/* sending */
+
+static bool send_muxed_data(struct srt_stream *stream, bool flush)
+{
+	struct ts_mux *mux  = &stream->mux;
+	size_t        sent  = 0;
+
+	while (mux->data.num - sent >= SRT_PAYLOAD_SIZE ||
+	       (flush && mux->data.num > sent)) {
+		size_t size = mux->data.num - sent;
+		if (size > SRT_PAYLOAD_SIZE)
+			size = SRT_PAYLOAD_SIZE;
+
+		if (srt_sendmsg2(stream->sock,
+					(const char*)mux->data.array + sent,
+					(int)size, NULL) == SRT_ERROR) {
+			blog(LOG_WARNING, "SRT stream: send failed: %s",
+					srt_getlasterror_str());
+			return false;
+		}
+
+		sent += size;
+	}
+
+	da_erase_range(mux->data, 0, sent);
+	return true;
+}
+
+static inline bool get_next_packet(struct srt_stream *stream,
+		struct encoder_packet *packet)
+{
+	bool new_packet = false;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	if (stream->packets.size) {
+		circlebuf_pop_front(&stream->packets, packet, sizeof(*packet));
+		new_packet = true;
+	}
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	return new_packet;
+}
+
+static void *send_thread(void *data)
+{
+	struct srt_stream *stream = data;
+	bool              success = true;
+
+	os_thread_init(OS_THREAD_CLASS_OUTPUT, "srt send");
+
+	while (os_sem_wait(stream->send_sem) == 0) {
+		struct encoder_packet packet;
+		uint64_t start;
+
+		if (os_event_try(stream->stop_event) != EAGAIN)
+			break;
+		if (!get_next_packet(stream, &packet))
+			continue;
+
+		start = trace_begin();
+
+		/* receivers can join at any time, so the program tables are
+		 * repeated in front of every keyframe */
+		if (packet.type == OBS_ENCODER_VIDEO && packet.keyframe)
+			ts_mux_write_tables(&stream->mux);
+
+		ts_mux_packet(&stream->mux, &packet);
+		obs_encoder_packet_release(&packet);
+
+		success = send_muxed_data(stream, false);
+		trace_end("srt_send_packet", start);
+		if (!success)
+			break;
+
+		update_stats(stream);
+	}
+
+	if (!success && os_event_try(stream->stop_event) == EAGAIN) {
+		stream->send_thread_active = false;
+		stream->active             = false;
+		pthread_detach(stream->send_thread);
+		obs_output_signal_stop(stream->output, OBS_OUTPUT_DISCONNECTED);
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+/* connecting */
+
+static inline int64_t encoder_bitrate(obs_encoder_t encoder)
+{
+	obs_data_t settings = obs_encoder_get_settings(encoder);
+	int64_t    bitrate  = obs_data_getint(settings, "bitrate");
+
+	obs_data_release(settings);
+	return bitrate;
+}
+
+static bool set_flag(SRTSOCKET sock, SRT_SOCKOPT opt, const void *val,
+		int size, const char *name)
+{
+	if (srt_setsockflag(sock, opt, val, size) == SRT_ERROR) {
+		blog(LOG_WARNING, "SRT stream: failed to set %s: %s", name,
+				srt_getlasterror_str());
+		return false;
+	}
+
+	return true;
+}
+
+/* without a maximum bitrate, SRT paces to the bitrate of the encoders plus
+ * the overhead allowed for retransmissions */
+static bool set_options(struct srt_stream *stream)
+{
+	SRT_TRANSTYPE transtype = SRTT_LIVE;
+	int           yes       = 1;
+	int64_t       max_bw    = stream->max_bitrate * 1000 / 8;
+	int64_t       input_bw  = 0;
+
+	if (!max_bw) {
+		input_bw = encoder_bitrate(obs_output_get_video_encoder(
+					stream->output)) +
+			encoder_bitrate(obs_output_get_audio_encoder(
+					stream->output));
+		input_bw = input_bw * 1000 / 8;
+	}
+
+	if (!set_flag(stream->sock, SRTO_TRANSTYPE, &transtype,
+				sizeof(transtype), "transport type") ||
+	    !set_flag(stream->sock, SRTO_SENDER, &yes, sizeof(yes),
+				"sender mode") ||
+	    !set_flag(stream->sock, SRTO_TLPKTDROP, &yes, sizeof(yes),
+				"too late packet drop") ||
+	    !set_flag(stream->sock, SRTO_LATENCY, &stream->latency_ms,
+				sizeof(int), "latency") ||
+	    !set_flag(stream->sock, SRTO_OHEADBW, &stream->overhead_pct,
+				sizeof(int), "bandwidth overhead") ||
+	    !set_flag(stream->sock, SRTO_MAXBW, &max_bw, sizeof(max_bw),
+				"maximum bandwidth"))
+		return false;
+
+	if (input_bw && !set_flag(stream->sock, SRTO_INPUTBW, &input_bw,
+				sizeof(input_bw), "input bandwidth"))
+		return false;
+
+	if (stream->stream_id.len &&
+	    !set_flag(stream->sock, SRTO_STREAMID, stream->stream_id.array,
+				(int)stream->stream_id.len, "stream id"))
+		return false;
+
+	if (stream->passphrase.len &&
+	    !set_flag(stream->sock, SRTO_PASSPHRASE, stream->passphrase.array,
+				(int)stream->passphrase.len, "passphrase"))
+		return false;
+
+	return true;
+}
+
+static int try_connect(struct srt_stream *stream)
+{
+	struct addrinfo hints = {0};
+	struct addrinfo *addr;
+	struct dstr     port = {0};
+	int             ret;
+
+	if (!stream->host.len || stream->port <= 0)
+		return OBS_OUTPUT_BAD_PATH;
+
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	dstr_printf(&port, "%d", stream->port);
+	ret = getaddrinfo(stream->host.array, port.array, &hints, &addr);
+	dstr_free(&port);
+
+	if (ret != 0) {
+		blog(LOG_WARNING, "SRT stream: could not resolve '%s'",
+				stream->host.array);
+		return OBS_OUTPUT_BAD_PATH;
+	}
+
+	stream->sock = srt_create_socket();
+	if (stream->sock == SRT_INVALID_SOCK || !set_options(stream)) {
+		freeaddrinfo(addr);
+		return OBS_OUTPUT_FAIL;
+	}
+
+	ret = srt_connect(stream->sock, addr->ai_addr, (int)addr->ai_addrlen);
+	freeaddrinfo(addr);
+
+	if (ret == SRT_ERROR) {
+		blog(LOG_WARNING, "SRT stream: connection to %s:%d failed: %s",
+				stream->host.array, stream->port,
+				srt_getlasterror_str());
+		return OBS_OUTPUT_CONNECT_FAILED;
+	}
+
+	blog(LOG_INFO, "SRT stream: connected to %s:%d, latency %dms",
+			stream->host.array, stream->port, stream->latency_ms);
+	return OBS_OUTPUT_SUCCESS;
+}
+
+static void close_socket(struct srt_stream *stream)
+{
+	if (stream->sock != SRT_INVALID_SOCK) {
+		srt_close(stream->sock);
+		stream->sock = SRT_INVALID_SOCK;
+	}
+}
+
+static void *connect_thread(void *data)
+{
+	struct srt_stream *stream = data;
+	int               ret;
+
+	os_thread_init(OS_THREAD_CLASS_OUTPUT, "srt connect");
+
+	ret = try_connect(stream);
+
+	if (ret == OBS_OUTPUT_SUCCESS) {
+		ts_mux_init(&stream->mux,
+				obs_output_get_video_encoder(stream->output),
+				obs_output_get_audio_encoder(stream->output));
+
+		stream->last_stats_ns = os_gettime_ns();
+		stream->active        = true;
+
+		if (pthread_create(&stream->send_thread, NULL, send_thread,
+					stream) == 0) {
+			stream->send_thread_active = true;
+			obs_output_begin_data_capture(stream->output, 0);
+		} else {
+			blog(LOG_WARNING, "SRT stream: failed to create send "
+			                  "thread");
+			stream->active = false;
+			ret = OBS_OUTPUT_FAIL;
+		}
+	}
+
+	/* stop may be called from the stop signal below, so the thread must
+	 * no longer be joinable by then */
+	stream->connecting = false;
+	if (os_event_try(stream->stop_event) == EAGAIN)
+		pthread_detach(stream->connect_thread);
+
+	if (ret != OBS_OUTPUT_SUCCESS)
+		obs_output_signal_stop(stream->output, ret);
+	return NULL;
+}
+
+/* accepts "srt://host:port" as well as "host:port", anything after the
+ * port is ignored */
+static void parse_server(struct srt_stream *stream, const char *server)
+{
+	const char *colon;
+
+	dstr_free(&stream->host);
+	stream->port = 0;
+
+	if (!server)
+		return;
+	if (astrcmpi_n(server, "srt://", 6) == 0)
+		server += 6;
+
+	colon = strrchr(server, ':');
+	if (!colon)
+		return;
+
+	dstr_ncopy(&stream->host, server, colon - server);
+	stream->port = atoi(colon + 1);
+}
+
+static void update_settings(struct srt_stream *stream, obs_data_t settings)
+{
+	parse_server(stream, obs_data_getstring(settings, "server"));
+	dstr_copy(&stream->stream_id,
+			obs_data_getstring(settings, "stream_id"));
+	dstr_copy(&stream->passphrase,
+			obs_data_getstring(settings, "passphrase"));
+
+	stream->latency_ms   = (int)obs_data_getint(settings, "latency_ms");
+	stream->overhead_pct = (int)obs_data_getint(settings, "overhead_pct");
+	stream->max_bitrate  = obs_data_getint(settings, "max_bitrate");
+}
+
+static bool srt_stream_start(void *data)
+{
+	struct srt_stream *stream = data;
+	obs_data_t settings;
+
+	if (!obs_output_can_begin_data_capture(stream->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(stream->output, 0))
+		return false;
+
+	settings = obs_output_get_settings(stream->output);
+	update_settings(stream, settings);
+	obs_data_release(settings);
+
+	os_atomic_set_long(&stream->dropped_frames, 0);
+	memset(&stream->stats, 0, sizeof(stream->stats));
+
+	if (os_sem_init(&stream->send_sem, 0) != 0)
+		return false;
+
+	stream->connecting = true;
+	if (pthread_create(&stream->connect_thread, NULL, connect_thread,
+				stream) != 0) {
+		stream->connecting = false;
+		os_sem_destroy(stream->send_sem);
+		stream->send_sem = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+static void srt_stream_stop(void *data)
+{
+	struct srt_stream *stream = data;
+
+	os_event_signal(stream->stop_event);
+
+	if (stream->connecting)
+		pthread_join(stream->connect_thread, NULL);
+
+	if (stream->active) {
+		obs_output_end_data_capture(stream->output);
+		stream->active = false;
+	}
+
+	if (stream->send_thread_active) {
+		os_sem_post(stream->send_sem);
+		pthread_join(stream->send_thread, NULL);
+		stream->send_thread_active = false;
+	}
+
+	/* whatever is left of the last transport packets goes out before the
+	 * socket is closed */
+	if (stream->sock != SRT_INVALID_SOCK && stream->mux.data.num)
+		send_muxed_data(stream, true);
+
+	close_socket(stream);
+	ts_mux_free(&stream->mux);
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	free_packets(stream);
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	os_sem_destroy(stream->send_sem);
+	stream->send_sem = NULL;
+	os_event_reset(stream->stop_event);
+}
+
+static void *srt_stream_create(obs_data_t settings, obs_output_t output)
+{
+	struct srt_stream *stream = bzalloc(sizeof(struct srt_stream));
+	stream->output = output;
+	stream->sock   = SRT_INVALID_SOCK;
+	pthread_mutex_init_value(&stream->packets_mutex);
+	pthread_mutex_init_value(&stream->stats_mutex);
+
+	if (pthread_mutex_init(&stream->packets_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&stream->stats_mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+
+	signal_handler_add(obs_output_signalhandler(output),
+			"void stats(ptr output, int sent_kb, int send_kbps, "
+			"int buffer_ms, int dropped_disposable, int rtt_ms, "
+			"int lost_packets, int retransmitted_packets, "
+			"int late_dropped_packets, float congestion)");
+	proc_handler_add(obs_output_prochandler(output),
+			"void get_stats(out int sent_kb, out int send_kbps, "
+			"out int buffer_ms, out int dropped_disposable, "
+			"out int rtt_ms, out int lost_packets, "
+			"out int retransmitted_packets, "
+			"out int late_dropped_packets, out float congestion)",
+			get_stats_proc, stream);
+
+	UNUSED_PARAMETER(settings);
+	return stream;
+
+fail:
+	srt_stream_destroy(stream);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline int64_t queued_duration(struct srt_stream *stream,
+		const struct encoder_packet *last)
+{
+	struct encoder_packet first;
+
+	if (!stream->packets.size)
+		return 0;
+
+	circlebuf_peek_front(&stream->packets, &first, sizeof(first));
+	return last->dts_usec - first.dts_usec;
+}
+
+/* SRT drops whatever is late on its own, so the queue here only backs up
+ * if sending blocks, i.e. when the pacing rate is too low for the encoder.
+ * disposable frames are skipped while the queue holds more than the latency
+ * window, anything else is left to SRT */
+static inline bool should_drop(struct srt_stream *stream,
+		const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO &&
+		packet->priority == OBS_NAL_PRIORITY_DISPOSABLE &&
+		queued_duration(stream, packet) >
+			(int64_t)stream->latency_ms * 1000;
+}
+
+static void srt_stream_data(void *data, struct encoder_packet *packet)
+{
+	struct srt_stream     *stream = data;
+	struct encoder_packet new_packet;
+	bool                  added = false;
+
+	/* parsed for the priority of the frame, which leaves the data in
+	 * AVCC format */
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		obs_parse_avc_packet(&new_packet, packet);
+		new_packet.avcc = true;
+	} else {
+		obs_encoder_packet_ref(&new_packet, packet);
+	}
+
+	pthread_mutex_lock(&stream->packets_mutex);
+
+	if (!should_drop(stream, &new_packet)) {
+		circlebuf_push_back(&stream->packets, &new_packet,
+				sizeof(new_packet));
+		added = true;
+	}
+
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	if (added) {
+		os_sem_post(stream->send_sem);
+	} else {
+		os_atomic_inc_long(&stream->dropped_frames);
+		obs_encoder_packet_release(&new_packet);
+	}
+}
+
+static void srt_stream_defaults(obs_data_t defaults)
+{
+	obs_data_set_default_int(defaults, "latency_ms", 400);
+	obs_data_set_default_int(defaults, "overhead_pct", 25);
+	obs_data_set_default_int(defaults, "max_bitrate", 0);
+}
+
+static obs_properties_t srt_stream_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_text(props, "server", "Server (srt://host:port)",
+			OBS_TEXT_DEFAULT);
+	obs_properties_add_text(props, "stream_id", "Stream ID",
+			OBS_TEXT_DEFAULT);
+	obs_properties_add_text(props, "passphrase", "Passphrase",
+			OBS_TEXT_PASSWORD);
+	obs_properties_add_int(props, "latency_ms", "Latency (ms)",
+			20, 8000, 10);
+	obs_properties_add_int(props, "overhead_pct",
+			"Bandwidth Overhead (%)", 5, 100, 1);
+	obs_properties_add_int(props, "max_bitrate",
+			"Maximum Bitrate (kbps, 0 = automatic)",
+			0, 1000000, 100);
+	return props;
+}
+
+struct obs_output_info srt_output_info = {
+	.id             = "srt_output",
+	.flags          = OBS_OUTPUT_AV |
+	                  OBS_OUTPUT_ENCODED,
+	.getname        = srt_stream_getname,
+	.create         = srt_stream_create,
+	.destroy        = srt_stream_destroy,
+	.start          = srt_stream_start,
+	.stop           = srt_stream_stop,
+	.encoded_packet = srt_stream_data,
+	.defaults       = srt_stream_defaults,
+	.properties     = srt_stream_properties
+};
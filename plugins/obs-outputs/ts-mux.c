@@ -0,0 +1,454 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/dstr.h>
+#include "ts-mux.h"
+
+/* TODO: video is still hard-coded to h264.  audio is either aac (ADTS) or
+ * opus, which is mapped as described by the "Encapsulation of Opus in MPEG-2
+ * transport streams" draft: a private PES stream with a registration
+ * descriptor, and access units prefixed with a control header */
+
+#define PMT_PID           0x1000
+#define VIDEO_PID         0x100
+#define AUDIO_PID         0x101
+
+#define STREAM_TYPE_AAC     0x0F
+#define STREAM_TYPE_H264    0x1B
+#define STREAM_TYPE_PRIVATE 0x06
+
+#define VIDEO_STREAM_ID     0xE0
+#define AUDIO_STREAM_ID     0xC0
+#define PRIVATE_STREAM_ID   0xBD
+
+#define TS_CLOCK          90000
+
+/* b-frames make the first decode timestamps negative, which can't be stored,
+ * so all timestamps are shifted forward by a second */
+#define TS_OFFSET         TS_CLOCK
+
+/* the PCR runs ahead of the decode timestamps by this much, which gives
+ * decoders time to buffer each frame before it's due */
+#define PCR_DELAY         (TS_CLOCK * 7 / 10)
+
+#define ADTS_HEADER_SIZE  7
+
+static const uint32_t aac_sample_rates[] = {
+	96000, 88200, 64000, 48000, 44100, 32000,
+	24000, 22050, 16000, 12000, 11025, 8000, 7350
+};
+
+static uint32_t mpeg_crc32(const uint8_t *data, size_t size)
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	for (size_t i = 0; i < size; i++) {
+		crc ^= (uint32_t)data[i] << 24;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 0x80000000) ?
+				(crc << 1) ^ 0x04C11DB7 : crc << 1;
+	}
+
+	return crc;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void parse_audio_config(struct ts_mux *mux, obs_encoder_t aencoder)
+{
+	audio_t  audio = obs_encoder_audio(aencoder);
+	uint32_t rate  = audio_output_samplerate(audio);
+	uint8_t  *config;
+	size_t   size;
+
+	/* the AudioSpecificConfig of the encoder is preferred, but it can be
+	 * derived from the audio output as well */
+	if (obs_encoder_get_extra_data(aencoder, &config, &size) && size >= 2) {
+		mux->aac_profile  = (config[0] >> 3) - 1;
+		mux->aac_freq_idx = ((config[0] & 0x7) << 1) | (config[1] >> 7);
+		mux->aac_channels = (config[1] >> 3) & 0xF;
+		return;
+	}
+
+	mux->aac_profile  = 1; /* LC */
+	mux->aac_freq_idx = 3;
+	mux->aac_channels = (uint8_t)audio_output_channels(audio);
+
+	for (uint8_t i = 0; i < sizeof(aac_sample_rates) / sizeof(uint32_t);
+			i++) {
+		if (aac_sample_rates[i] == rate) {
+			mux->aac_freq_idx = i;
+			break;
+		}
+	}
+}
+
+void ts_mux_init(struct ts_mux *mux, obs_encoder_t vencoder,
+		obs_encoder_t aencoder)
+{
+	const char *codec = obs_encoder_get_codec(aencoder);
+	uint8_t    *header;
+	size_t     size;
+
+	memset(mux, 0, sizeof(struct ts_mux));
+
+	/* the sps/pps already use start codes, and are repeated before every
+	 * keyframe so each segment can be decoded by itself */
+	if (obs_encoder_get_extra_data(vencoder, &header, &size)) {
+		mux->video_header      = bmemdup(header, size);
+		mux->video_header_size = size;
+	}
+
+	if (codec && astrcmpi(codec, "opus") == 0) {
+		mux->opus          = true;
+		mux->opus_channels = (uint8_t)audio_output_channels(
+				obs_encoder_audio(aencoder));
+	} else {
+		parse_audio_config(mux, aencoder);
+	}
+}
+
+void ts_mux_free(struct ts_mux *mux)
+{
+	bfree(mux->video_header);
+	da_free(mux->data);
+	da_free(mux->pes);
+	memset(mux, 0, sizeof(struct ts_mux));
+}
+
+/* ------------------------------------------------------------------------- */
+/* program tables */
+
+static void write_section(struct ts_mux *mux, uint16_t pid, uint8_t *cc,
+		const uint8_t *section, size_t size)
+{
+	uint8_t packet[TS_PACKET_SIZE];
+	uint32_t crc = mpeg_crc32(section, size);
+
+	memset(packet, 0xFF, sizeof(packet));
+	packet[0] = 0x47;
+	packet[1] = 0x40 | (uint8_t)(pid >> 8);
+	packet[2] = (uint8_t)pid;
+	packet[3] = 0x10 | ((*cc)++ & 0xF);
+	packet[4] = 0; /* pointer field */
+
+	memcpy(packet + 5, section, size);
+	packet[5 + size]     = (uint8_t)(crc >> 24);
+	packet[5 + size + 1] = (uint8_t)(crc >> 16);
+	packet[5 + size + 2] = (uint8_t)(crc >> 8);
+	packet[5 + size + 3] = (uint8_t)crc;
+
+	da_push_back_array(mux->data, packet, TS_PACKET_SIZE);
+}
+
+void ts_mux_write_tables(struct ts_mux *mux)
+{
+	const uint8_t pat[] = {
+		0x00,                           /* table id */
+		0xB0, 13,                       /* section length */
+		0x00, 0x01,                     /* transport stream id */
+		0xC1, 0x00, 0x00,               /* version, section numbers */
+		0x00, 0x01,                     /* program number */
+		0xE0 | (PMT_PID >> 8), PMT_PID & 0xFF
+	};
+
+	const uint8_t pmt[] = {
+		0x02,                           /* table id */
+		0xB0, 23,                       /* section length */
+		0x00, 0x01,                     /* program number */
+		0xC1, 0x00, 0x00,               /* version, section numbers */
+		0xE0 | (VIDEO_PID >> 8), VIDEO_PID & 0xFF, /* PCR pid */
+		0xF0, 0x00,                     /* program info length */
+
+		STREAM_TYPE_H264,
+		0xE0 | (VIDEO_PID >> 8), VIDEO_PID & 0xFF,
+		0xF0, 0x00,
+
+		STREAM_TYPE_AAC,
+		0xE0 | (AUDIO_PID >> 8), AUDIO_PID & 0xFF,
+		0xF0, 0x00
+	};
+
+	/* the channel config code is the channel count for mono and stereo
+	 * mapping family 0 streams, which is all ffmpeg_opus produces */
+	const uint8_t opus_pmt[] = {
+		0x02,                           /* table id */
+		0xB0, 33,                       /* section length */
+		0x00, 0x01,                     /* program number */
+		0xC1, 0x00, 0x00,               /* version, section numbers */
+		0xE0 | (VIDEO_PID >> 8), VIDEO_PID & 0xFF, /* PCR pid */
+		0xF0, 0x00,                     /* program info length */
+
+		STREAM_TYPE_H264,
+		0xE0 | (VIDEO_PID >> 8), VIDEO_PID & 0xFF,
+		0xF0, 0x00,
+
+		STREAM_TYPE_PRIVATE,
+		0xE0 | (AUDIO_PID >> 8), AUDIO_PID & 0xFF,
+		0xF0, 10,                       /* ES info length */
+		0x05, 4, 'O', 'p', 'u', 's',    /* registration descriptor */
+		0x7F, 2, 0x80, mux->opus_channels /* extension descriptor */
+	};
+
+	write_section(mux, 0, &mux->pat_cc, pat, sizeof(pat));
+
+	if (mux->opus)
+		write_section(mux, PMT_PID, &mux->pmt_cc, opus_pmt,
+				sizeof(opus_pmt));
+	else
+		write_section(mux, PMT_PID, &mux->pmt_cc, pmt, sizeof(pmt));
+}
+
+/* ------------------------------------------------------------------------- */
+/* PES packets */
+
+static inline int64_t to_ts_clock(const struct encoder_packet *packet,
+		int64_t val)
+{
+	return (val * TS_CLOCK * packet->timebase_num / packet->timebase_den +
+		TS_OFFSET) & 0x1FFFFFFFFLL;
+}
+
+static void write_timestamp(uint8_t *p, uint8_t prefix, int64_t ts)
+{
+	p[0] = (uint8_t)((prefix << 4) | (((ts >> 30) & 0x7) << 1) | 1);
+	p[1] = (uint8_t)(ts >> 22);
+	p[2] = (uint8_t)((((ts >> 15) & 0x7F) << 1) | 1);
+	p[3] = (uint8_t)(ts >> 7);
+	p[4] = (uint8_t)(((ts & 0x7F) << 1) | 1);
+}
+
+static void write_pcr(uint8_t *p, int64_t ts)
+{
+	p[0] = (uint8_t)(ts >> 25);
+	p[1] = (uint8_t)(ts >> 17);
+	p[2] = (uint8_t)(ts >> 9);
+	p[3] = (uint8_t)(ts >> 1);
+	p[4] = (uint8_t)(((ts & 1) << 7) | 0x7E);
+	p[5] = 0;
+}
+
+/* each stream is split in to transport packets.  the first one of a PES
+ * packet can carry the PCR and random access flag, and the last one is
+ * padded out with adaptation field stuffing */
+static void write_pes(struct ts_mux *mux, uint16_t pid, uint8_t *cc,
+		bool keyframe, bool pcr, int64_t pcr_ts)
+{
+	const uint8_t *data = mux->pes.array;
+	size_t        size  = mux->pes.num;
+	bool          first = true;
+
+	while (size) {
+		uint8_t packet[TS_PACKET_SIZE];
+		uint8_t *p       = packet + 4;
+		uint8_t flags    = 0;
+		bool    has_af   = false;
+		size_t  af_size  = 0;
+		size_t  payload;
+
+		if (first && keyframe)
+			flags |= 0x40;
+		if (first && pcr)
+			flags |= 0x10;
+
+		if (flags) {
+			has_af  = true;
+			af_size = (flags & 0x10) ? 7 : 1;
+		}
+
+		payload = TS_PACKET_SIZE - 4 - (has_af ? 1 + af_size : 0);
+
+		if (size < payload) {
+			size_t stuffing = payload - size;
+
+			if (!has_af) {
+				has_af  = true;
+				af_size = stuffing - 1;
+			} else {
+				af_size += stuffing;
+			}
+
+			payload = size;
+		}
+
+		packet[0] = 0x47;
+		packet[1] = (first ? 0x40 : 0) | (uint8_t)((pid >> 8) & 0x1F);
+		packet[2] = (uint8_t)pid;
+		packet[3] = (has_af ? 0x30 : 0x10) | ((*cc)++ & 0xF);
+
+		if (has_af) {
+			uint8_t *af_end = p + 1 + af_size;
+
+			*(p++) = (uint8_t)af_size;
+			if (af_size) {
+				*(p++) = flags;
+				if (flags & 0x10) {
+					write_pcr(p, pcr_ts);
+					p += 6;
+				}
+				memset(p, 0xFF, af_end - p);
+				p = af_end;
+			}
+		}
+
+		memcpy(p, data, payload);
+		da_push_back_array(mux->data, packet, TS_PACKET_SIZE);
+
+		data  += payload;
+		size  -= payload;
+		first  = false;
+	}
+}
+
+static void start_pes(struct ts_mux *mux, uint8_t stream_id,
+		const struct encoder_packet *packet, size_t payload_size)
+{
+	int64_t pts       = to_ts_clock(packet, packet->pts);
+	int64_t dts       = to_ts_clock(packet, packet->dts);
+	bool    write_dts = pts != dts;
+	uint8_t header[19];
+	size_t  header_size = write_dts ? 19 : 14;
+	size_t  pes_size    = header_size - 6 + payload_size;
+
+	header[0] = 0;
+	header[1] = 0;
+	header[2] = 1;
+	header[3] = stream_id;
+
+	/* video PES packets can be larger than the length field allows, so
+	 * their length is left unspecified */
+	if (stream_id == VIDEO_STREAM_ID || pes_size > 0xFFFF)
+		pes_size = 0;
+
+	header[4] = (uint8_t)(pes_size >> 8);
+	header[5] = (uint8_t)pes_size;
+	header[6] = 0x80;
+	header[7] = write_dts ? 0xC0 : 0x80;
+	header[8] = write_dts ? 10 : 5;
+
+	write_timestamp(header + 9, write_dts ? 0x3 : 0x2, pts);
+	if (write_dts)
+		write_timestamp(header + 14, 0x1, dts);
+
+	da_resize(mux->pes, 0);
+	da_push_back_array(mux->pes, header, header_size);
+}
+
+/* length prefixed NAL units are converted to start codes as they're copied,
+ * the packet data itself is shared and can't be changed */
+static void push_avcc_nals(struct ts_mux *mux,
+		const struct encoder_packet *packet)
+{
+	static const uint8_t start_code[4] = {0, 0, 0, 1};
+	const uint8_t *data = packet->data;
+	const uint8_t *end  = packet->data + packet->size;
+
+	while (end - data >= 4) {
+		size_t nal_size = ((size_t)data[0] << 24) |
+			((size_t)data[1] << 16) |
+			((size_t)data[2] << 8) | (size_t)data[3];
+
+		data += 4;
+		if (nal_size > (size_t)(end - data))
+			break;
+
+		da_push_back_array(mux->pes, start_code, 4);
+		da_push_back_array(mux->pes, data, nal_size);
+		data += nal_size;
+	}
+}
+
+static void mux_video(struct ts_mux *mux, struct encoder_packet *packet)
+{
+	static const uint8_t aud[6] = {0, 0, 0, 1, 0x09, 0xF0};
+	size_t payload_size = packet->size + sizeof(aud);
+
+	if (packet->keyframe)
+		payload_size += mux->video_header_size;
+
+	start_pes(mux, VIDEO_STREAM_ID, packet, payload_size);
+
+	/* every access unit starts with a delimiter in transport streams */
+	da_push_back_array(mux->pes, aud, sizeof(aud));
+
+	if (packet->keyframe && mux->video_header)
+		da_push_back_array(mux->pes, mux->video_header,
+				mux->video_header_size);
+
+	if (packet->avcc)
+		push_avcc_nals(mux, packet);
+	else
+		da_push_back_array(mux->pes, packet->data, packet->size);
+
+	write_pes(mux, VIDEO_PID, &mux->video_cc, packet->keyframe, true,
+			(to_ts_clock(packet, packet->dts) - PCR_DELAY) &
+			0x1FFFFFFFFLL);
+}
+
+static void mux_audio(struct ts_mux *mux, struct encoder_packet *packet)
+{
+	size_t  frame_size = packet->size + ADTS_HEADER_SIZE;
+	uint8_t adts[ADTS_HEADER_SIZE];
+
+	adts[0] = 0xFF;
+	adts[1] = 0xF1;
+	adts[2] = (uint8_t)((mux->aac_profile << 6) |
+		(mux->aac_freq_idx << 2) | (mux->aac_channels >> 2));
+	adts[3] = (uint8_t)(((mux->aac_channels & 0x3) << 6) |
+		(frame_size >> 11));
+	adts[4] = (uint8_t)(frame_size >> 3);
+	adts[5] = (uint8_t)(((frame_size & 0x7) << 5) | 0x1F);
+	adts[6] = 0xFC;
+
+	start_pes(mux, AUDIO_STREAM_ID, packet, frame_size);
+	da_push_back_array(mux->pes, adts, ADTS_HEADER_SIZE);
+	da_push_back_array(mux->pes, packet->data, packet->size);
+
+	write_pes(mux, AUDIO_PID, &mux->audio_cc, false, false, 0);
+}
+
+/* each opus packet is an access unit, preceded by a control header: the
+ * 0x3FF prefix with no trim or extension flags, and the packet size coded as
+ * a run of 0xFF bytes plus the remainder */
+static void mux_opus(struct ts_mux *mux, struct encoder_packet *packet)
+{
+	static const uint8_t prefix[2] = {0x7F, 0xE0};
+	size_t  size_bytes   = packet->size / 255 + 1;
+	size_t  payload_size = sizeof(prefix) + size_bytes + packet->size;
+	uint8_t remainder    = (uint8_t)(packet->size % 255);
+
+	start_pes(mux, PRIVATE_STREAM_ID, packet, payload_size);
+	da_push_back_array(mux->pes, prefix, sizeof(prefix));
+
+	for (size_t i = 1; i < size_bytes; i++)
+		da_push_back(mux->pes, &(uint8_t){0xFF});
+	da_push_back(mux->pes, &remainder);
+
+	da_push_back_array(mux->pes, packet->data, packet->size);
+
+	write_pes(mux, AUDIO_PID, &mux->audio_cc, false, false, 0);
+}
+
+void ts_mux_packet(struct ts_mux *mux, struct encoder_packet *packet)
+{
+	if (packet->type == OBS_ENCODER_VIDEO)
+		mux_video(mux, packet);
+	else if (mux->opus)
+		mux_opus(mux, packet);
+	else
+		mux_audio(mux, packet);
+}
@@ -0,0 +1,58 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs.h>
+#include <util/darray.h>
+
+/* MPEG transport stream muxer for one H.264 and one AAC or Opus stream, as
+ * used by HLS and SRT.  packets are appended to the data array, which is
+ * taken and cleared by the caller at each segment boundary. */
+
+#define TS_PACKET_SIZE 188
+
+struct ts_mux {
+	DARRAY(uint8_t) data;
+
+	uint8_t         *video_header;
+	size_t          video_header_size;
+
+	uint8_t         aac_profile;
+	uint8_t         aac_freq_idx;
+	uint8_t         aac_channels;
+
+	bool            opus;
+	uint8_t         opus_channels;
+
+	uint8_t         pat_cc;
+	uint8_t         pmt_cc;
+	uint8_t         video_cc;
+	uint8_t         audio_cc;
+
+	/* scratch buffer for building PES packets */
+	DARRAY(uint8_t) pes;
+};
+
+extern void ts_mux_init(struct ts_mux *mux, obs_encoder_t vencoder,
+		obs_encoder_t aencoder);
+extern void ts_mux_free(struct ts_mux *mux);
+
+/* writes the PAT and PMT, each segment has to start with them */
+extern void ts_mux_write_tables(struct ts_mux *mux);
+
+extern void ts_mux_packet(struct ts_mux *mux, struct encoder_packet *packet);
@@ -17,9 +17,16 @@
 
 #include <util/dstr.h>
 #include <util/darray.h>
+#include <util/platform.h>
 #include <obs.h>
+#include <obs-avc.h>
 #include <x264.h>
 
+/* the limits x264 clamps these to internally, which its header doesn't
+ * export */
+#define MAX_THREADS   128
+#define MAX_LOOKAHEAD 250
+
 struct obs_x264 {
 	obs_encoder_t   encoder;
 
@@ -33,6 +40,14 @@ struct obs_x264 {
 
 	size_t          extra_data_size;
 	size_t          sei_size;
+
+	/* duplicate frames are skipped for up to max_skipped frames in a
+	 * row, and a keyframe is forced once the skipped frames would make
+	 * the keyframe interval too long */
+	bool            skip_duplicates;
+	int             max_skipped;
+	int             skipped;
+	int             frames_since_key;
 };
 
 
@@ -78,11 +93,19 @@ static void obs_x264_defaults(obs_data_t settings)
 	obs_data_set_default_int   (settings, "keyint_sec",  0);
 	obs_data_set_default_int   (settings, "crf",         23);
 	obs_data_set_default_bool  (settings, "cbr",         false);
+	obs_data_set_default_bool  (settings, "skip_duplicates", false);
 
 	obs_data_set_default_string(settings, "preset",      "veryfast");
 	obs_data_set_default_string(settings, "profile",     "");
 	obs_data_set_default_string(settings, "tune",        "");
 	obs_data_set_default_string(settings, "x264opts",    "");
+
+	obs_data_set_default_string(settings, "threading",   "default");
+	obs_data_set_default_int   (settings, "threads",     0);
+	obs_data_set_default_bool  (settings, "sliced_threads", false);
+	obs_data_set_default_int   (settings, "lookahead_threads", 0);
+	obs_data_set_default_int   (settings, "rc_lookahead", -1);
+	obs_data_set_default_int   (settings, "sync_lookahead", -1);
 }
 
 static inline void add_strings(obs_property_t list, const char *const *strings)
@@ -93,12 +116,36 @@ static inline void add_strings(obs_property_t list, const char *const *strings)
 	}
 }
 
+static const char *custom_threading_props[] = {
+	"threads",
+	"sliced_threads",
+	"lookahead_threads",
+	"rc_lookahead",
+	"sync_lookahead",
+	NULL
+};
+
+static bool threading_modified(obs_properties_t props, obs_property_t p,
+		obs_data_t settings)
+{
+	const char *mode = obs_data_getstring(settings, "threading");
+	bool custom = astrcmpi(mode, "custom") == 0;
+
+	for (const char **name = custom_threading_props; *name; name++)
+		obs_property_set_enabled(obs_properties_get(props, *name),
+				custom);
+
+	UNUSED_PARAMETER(p);
+	return true;
+}
+
 static obs_properties_t obs_x264_props(const char *locale)
 {
 	/* TODO: locale */
 
 	obs_properties_t props = obs_properties_create(locale);
 	obs_property_t list;
+	obs_property_t p;
 
 	obs_properties_add_int(props, "bitrate", "Bitrate", 50, 100000, 1);
 	obs_properties_add_int(props, "buffer_size", "Buffer Size", 50, 100000,
@@ -117,15 +164,40 @@ static obs_properties_t obs_x264_props(const char *locale)
 	obs_property_list_add_string(list, "baseline", "baseline");
 	obs_property_list_add_string(list, "main", "main");
 	obs_property_list_add_string(list, "high", "high");
+	obs_property_list_add_string(list, "high422", "high422");
+	obs_property_list_add_string(list, "high444", "high444");
 
 	list = obs_properties_add_list(props, "tune", "Tune",
 			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
 	add_strings(list, x264_tune_names);
 
+	obs_properties_add_bool(props, "skip_duplicates",
+			"Skip unchanged frames (variable frame rate)");
+
 	obs_properties_add_text(props, "x264opts",
 			"x264 encoder options (separated by ':')",
 			OBS_TEXT_DEFAULT);
 
+	p = obs_properties_add_list(props, "threading", "Threading",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(p, "Default", "default");
+	obs_property_list_add_string(p, "Low latency", "low_latency");
+	obs_property_list_add_string(p, "Throughput", "throughput");
+	obs_property_list_add_string(p, "Custom", "custom");
+	obs_property_set_modified_callback(p, threading_modified);
+
+	obs_properties_add_int(props, "threads", "Threads (0=auto)",
+			0, MAX_THREADS, 1);
+	obs_properties_add_bool(props, "sliced_threads", "Sliced threads");
+	obs_properties_add_int(props, "lookahead_threads",
+			"Lookahead threads (0=auto)", 0, MAX_THREADS, 1);
+	obs_properties_add_int(props, "rc_lookahead",
+			"Rate control lookahead (frames, -1=preset)",
+			-1, MAX_LOOKAHEAD, 1);
+	obs_properties_add_int(props, "sync_lookahead",
+			"Threaded lookahead buffer (frames, -1=auto)",
+			-1, MAX_LOOKAHEAD, 1);
+
 	return props;
 }
 
@@ -214,11 +286,101 @@ static void log_x264(void *param, int level, const char *format, va_list args)
 	UNUSED_PARAMETER(level);
 }
 
+/*
+ * Threading can only be set before the encoder is opened.
+ *
+ * - low_latency: sliced threads split each frame between the threads instead
+ *   of encoding several frames at once, which removes the frame of delay each
+ *   extra frame thread adds.  The lookahead and b-frames are disabled as well,
+ *   as they delay output by a frame per frame they look ahead.
+ * - throughput: two frame threads per core instead of x264's default of one
+ *   and a half, a lookahead thread for every three frame threads so the
+ *   lookahead doesn't become the bottleneck, and non-deterministic threading
+ *   so threads don't have to wait on each other to keep the output identical.
+ * - custom: the individual values from the settings.
+ */
+static void update_threading(struct obs_x264 *obsx264, obs_data_t settings)
+{
+	x264_param_t *params = &obsx264->params;
+	const char   *mode   = obs_data_getstring(settings, "threading");
+
+	if (astrcmpi(mode, "low_latency") == 0) {
+		params->i_threads           = X264_THREADS_AUTO;
+		params->b_sliced_threads    = true;
+		params->i_lookahead_threads = X264_THREADS_AUTO;
+		params->rc.i_lookahead      = 0;
+		params->i_sync_lookahead    = 0;
+		params->i_bframe            = 0;
+
+	} else if (astrcmpi(mode, "throughput") == 0) {
+		int threads = os_get_logical_cores() * 2;
+		if (threads > MAX_THREADS)
+			threads = MAX_THREADS;
+
+		params->i_threads           = threads;
+		params->b_sliced_threads    = false;
+		params->i_lookahead_threads = (threads >= 3) ? threads / 3 : 1;
+		params->b_deterministic     = false;
+
+	} else if (astrcmpi(mode, "custom") == 0) {
+		int rc_lookahead   = (int)obs_data_getint(settings,
+				"rc_lookahead");
+		int sync_lookahead = (int)obs_data_getint(settings,
+				"sync_lookahead");
+
+		params->i_threads           = (int)obs_data_getint(settings,
+				"threads");
+		params->b_sliced_threads    = obs_data_getbool(settings,
+				"sliced_threads");
+		params->i_lookahead_threads = (int)obs_data_getint(settings,
+				"lookahead_threads");
+
+		if (rc_lookahead >= 0)
+			params->rc.i_lookahead = rc_lookahead;
+		params->i_sync_lookahead = (sync_lookahead >= 0) ?
+			sync_lookahead : X264_SYNC_LOOKAHEAD_AUTO;
+	}
+}
+
+/*
+ * Frames of delay the encoder adds before the first packet comes out, the
+ * same way x264 computes it internally.  Uses the parameters of the opened
+ * encoder so the automatic values are resolved.
+ */
+static void log_x264_latency(struct obs_x264 *obsx264)
+{
+	x264_param_t params;
+	int          delay;
+	int          threads;
+
+	x264_encoder_parameters(obsx264->context, &params);
+
+	threads = params.b_sliced_threads ? 1 : params.i_threads;
+	delay   = (params.i_bframe > params.rc.i_lookahead) ?
+		params.i_bframe : params.rc.i_lookahead;
+	delay  += threads - 1 + params.i_sync_lookahead;
+
+	blog(LOG_INFO, "x264: %d thread(s)%s, %d lookahead thread(s), "
+	               "rc lookahead %d, sync lookahead %d, %d b-frame(s): "
+	               "%d frame(s) (%d ms) of encoder latency",
+	               params.i_threads,
+	               params.b_sliced_threads ? " (sliced)" : "",
+	               params.i_lookahead_threads,
+	               params.rc.i_lookahead,
+	               params.i_sync_lookahead,
+	               params.i_bframe,
+	               delay,
+	               (int)((int64_t)delay * 1000 * params.i_fps_den /
+	                     params.i_fps_num));
+}
+
 static void update_params(struct obs_x264 *obsx264, obs_data_t settings,
 		char **params)
 {
 	video_t video = obs_encoder_video(obsx264->encoder);
 	const struct video_output_info *voi = video_output_getinfo(video);
+	uint32_t fps_den = voi->fps_den *
+		obs_encoder_get_frame_rate_divisor(obsx264->encoder);
 
 	int bitrate      = (int)obs_data_getint(settings, "bitrate");
 	int buffer_size  = (int)obs_data_getint(settings, "buffer_size");
@@ -226,18 +388,26 @@ static void update_params(struct obs_x264 *obsx264, obs_data_t settings,
 	int crf          = (int)obs_data_getint(settings, "crf");
 	bool cbr         = obs_data_getbool(settings, "cbr");
 
+	/* still encode about one frame a second, so the stream doesn't
+	 * look stalled to players and servers */
+	obsx264->skip_duplicates = obs_data_getbool(settings,
+			"skip_duplicates");
+	obsx264->max_skipped     = (int)(voi->fps_num / fps_den);
+
 	if (keyint_sec)
 		obsx264->params.i_keyint_max =
-			keyint_sec * voi->fps_num / voi->fps_den;
+			keyint_sec * voi->fps_num / fps_den;
 
 	obsx264->params.b_vfr_input          = false;
 	obsx264->params.rc.i_vbv_max_bitrate = bitrate;
 	obsx264->params.rc.i_vbv_buffer_size = buffer_size;
 	obsx264->params.rc.i_bitrate         = bitrate;
-	obsx264->params.i_width              = voi->width;
-	obsx264->params.i_height             = voi->height;
+	obsx264->params.i_width              = obs_encoder_get_width(
+			obsx264->encoder);
+	obsx264->params.i_height             = obs_encoder_get_height(
+			obsx264->encoder);
 	obsx264->params.i_fps_num            = voi->fps_num;
-	obsx264->params.i_fps_den            = voi->fps_den;
+	obsx264->params.i_fps_den            = fps_den;
 	obsx264->params.pf_log               = log_x264;
 	obsx264->params.i_log_level          = X264_LOG_WARNING;
 
@@ -261,9 +431,16 @@ static void update_params(struct obs_x264 *obsx264, obs_data_t settings,
 		obsx264->params.i_csp = X264_CSP_NV12;
 	else if (voi->format == VIDEO_FORMAT_I420)
 		obsx264->params.i_csp = X264_CSP_I420;
+	else if (voi->format == VIDEO_FORMAT_I444)
+		obsx264->params.i_csp = X264_CSP_I444;
+	else if (voi->format == VIDEO_FORMAT_I422)
+		obsx264->params.i_csp = X264_CSP_I422;
 	else
 		obsx264->params.i_csp = X264_CSP_NV12;
 
+	if (!obsx264->context)
+		update_threading(obsx264, settings);
+
 	while (*params)
 		set_param(obsx264, *(params++));
 }
@@ -294,6 +471,9 @@ static bool update_settings(struct obs_x264 *obsx264, obs_data_t settings)
 
 	obsx264->params.b_repeat_headers = false;
 
+	/* output AVCC so outputs don't have to parse every packet again */
+	obsx264->params.b_annexb         = false;
+
 	strlist_free(paramlist);
 	bfree(preset);
 	bfree(profile);
@@ -313,6 +493,8 @@ static bool obs_x264_update(void *data, obs_data_t settings)
 		if (ret != 0)
 			blog(LOG_WARNING, "Failed to reconfigure x264: %d",
 					ret);
+		else
+			log_x264_latency(obsx264);
 		return ret == 0;
 	}
 
@@ -331,14 +513,22 @@ static void load_headers(struct obs_x264 *obsx264)
 
 	x264_encoder_headers(obsx264->context, &nals, &nal_count);
 
+	/* the SEI is sent in front of the first packet, so it stays in the
+	 * packet format, but the headers always use start codes */
 	for (int i = 0; i < nal_count; i++) {
 		x264_nal_t *nal = nals+i;
 
-		if (nal->i_type == NAL_SEI)
+		if (nal->i_type == NAL_SEI) {
 			da_push_back_array(sei, nal->p_payload, nal->i_payload);
-		else
+		} else {
+			size_t offset = header.num;
+
 			da_push_back_array(header, nal->p_payload,
 					nal->i_payload);
+			if (!obsx264->params.b_annexb)
+				obs_avcc_to_annexb(header.array + offset,
+						nal->i_payload);
+		}
 	}
 
 	obsx264->extra_data      = header.array;
@@ -355,10 +545,12 @@ static void *obs_x264_create(obs_data_t settings, obs_encoder_t encoder)
 	if (update_settings(obsx264, settings)) {
 		obsx264->context = x264_encoder_open(&obsx264->params);
 
-		if (obsx264->context == NULL)
+		if (obsx264->context == NULL) {
 			blog(LOG_WARNING, "x264 failed to load");
-		else
+		} else {
 			load_headers(obsx264);
+			log_x264_latency(obsx264);
+		}
 	} else {
 		blog(LOG_WARNING, "bad settings specified for x264");
 	}
@@ -381,6 +573,10 @@ static void parse_packet(struct obs_x264 *obsx264,
 
 	for (int i = 0; i < nal_count; i++) {
 		x264_nal_t *nal = nals+i;
+
+		if (nal->i_type == NAL_SLICE || nal->i_type == NAL_SLICE_IDR)
+			packet->priority = nal->i_ref_idc;
+
 		da_push_back_array(obsx264->packet_data, nal->p_payload,
 				nal->i_payload);
 	}
@@ -391,6 +587,7 @@ static void parse_packet(struct obs_x264 *obsx264,
 	packet->pts           = pic_out->i_pts;
 	packet->dts           = pic_out->i_dts;
 	packet->keyframe      = pic_out->b_keyframe != 0;
+	packet->avcc          = !obsx264->params.b_annexb;
 }
 
 static inline void init_pic_data(struct obs_x264 *obsx264, x264_picture_t *pic,
@@ -403,7 +600,9 @@ static inline void init_pic_data(struct obs_x264 *obsx264, x264_picture_t *pic,
 
 	if (obsx264->params.i_csp == X264_CSP_NV12)
 		pic->img.i_plane = 2;
-	else if (obsx264->params.i_csp == X264_CSP_I420)
+	else if (obsx264->params.i_csp == X264_CSP_I420 ||
+	         obsx264->params.i_csp == X264_CSP_I444 ||
+	         obsx264->params.i_csp == X264_CSP_I422)
 		pic->img.i_plane = 3;
 
 	for (int i = 0; i < pic->img.i_plane; i++) {
@@ -424,9 +623,31 @@ static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 	if (!frame || !packet || !received_packet)
 		return false;
 
+	if (obsx264->skip_duplicates && frame->duplicate &&
+	    !frame->force_keyframe &&
+	    obsx264->skipped < obsx264->max_skipped) {
+		obsx264->skipped++;
+		obsx264->frames_since_key++;
+		*received_packet = false;
+		return true;
+	}
+
+	obsx264->skipped = 0;
+
 	if (frame)
 		init_pic_data(obsx264, &pic, frame);
 
+	/* x264 counts the keyframe interval in encoded frames */
+	if (frame->force_keyframe) {
+		pic.i_type = X264_TYPE_IDR;
+		obsx264->frames_since_key = 0;
+
+	} else if (obsx264->skip_duplicates &&
+	    ++obsx264->frames_since_key >= obsx264->params.i_keyint_max) {
+		pic.i_type = X264_TYPE_KEYFRAME;
+		obsx264->frames_since_key = 0;
+	}
+
 	ret = x264_encoder_encode(obsx264->context, &nals, &nal_count,
 			(frame ? &pic : NULL), &pic_out);
 	if (ret < 0) {
@@ -471,12 +692,14 @@ static bool obs_x264_video_info(void *data, struct video_scale_info *info)
 	const struct video_output_info *vid_info = video_output_getinfo(video);
 
 	if (vid_info->format == VIDEO_FORMAT_I420 ||
-	    vid_info->format == VIDEO_FORMAT_NV12)
+	    vid_info->format == VIDEO_FORMAT_NV12 ||
+	    vid_info->format == VIDEO_FORMAT_I444 ||
+	    vid_info->format == VIDEO_FORMAT_I422)
 		return false;
 
 	info->format     = VIDEO_FORMAT_NV12;
-	info->width      = vid_info->width;
-	info->height     = vid_info->height;
+	info->width      = obs_encoder_get_width(obsx264->encoder);
+	info->height     = obs_encoder_get_height(obsx264->encoder);
 	info->range      = VIDEO_RANGE_DEFAULT;
 	info->colorspace = VIDEO_CS_DEFAULT;
 	return true;
@@ -1,13 +1,32 @@
 #include <util/platform.h>
+#include <util/threading.h>
+#include <util/darray.h>
 #include <obs-module.h>
 #include <jansson.h>
+#include <stdlib.h>
+#include "rtmp-ingest.h"
+
+#define AUTO_SERVER          "auto"
+#define AUTO_SERVER_WAIT_MS  3000
 
 struct rtmp_common {
 	char *service;
 	char *server;
 	char *key;
+
+	/* with the "auto" server, the fastest server of the service is picked
+	 * in the background as soon as the service is set */
+	struct ingest_select *ingest;
+	char *auto_url;
 };
 
+static inline bool is_auto_server(struct rtmp_common *service)
+{
+	return service->server && strcmp(service->server, AUTO_SERVER) == 0;
+}
+
+static void start_ingest_select(struct rtmp_common *service);
+
 static const char *rtmp_common_getname(const char *locale)
 {
 	UNUSED_PARAMETER(locale);
@@ -27,15 +46,25 @@ static void rtmp_common_update(void *data, obs_data_t settings)
 	service->service = bstrdup(obs_data_getstring(settings, "service"));
 	service->server  = bstrdup(obs_data_getstring(settings, "server"));
 	service->key     = bstrdup(obs_data_getstring(settings, "key"));
+
+	ingest_select_destroy(service->ingest);
+	service->ingest = NULL;
+	bfree(service->auto_url);
+	service->auto_url = NULL;
+
+	if (is_auto_server(service))
+		start_ingest_select(service);
 }
 
 static void rtmp_common_destroy(void *data)
 {
 	struct rtmp_common *service = data;
 
+	ingest_select_destroy(service->ingest);
 	bfree(service->service);
 	bfree(service->server);
 	bfree(service->key);
+	bfree(service->auto_url);
 	bfree(service);
 }
 
@@ -48,6 +77,35 @@ static void *rtmp_common_create(obs_data_t settings, obs_service_t service)
 	return data;
 }
 
+/*
+ * The services file is parsed once, into a list of services in file order
+ * plus an index sorted by name for lookups.  The file is loaded in the
+ * background when the module loads, and is only parsed again if its
+ * modification time changes.
+ */
+
+struct server_info {
+	char *name;
+	char *url;
+};
+
+struct service_info {
+	char *name;
+	DARRAY(struct server_info) servers;
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	bool            mutex_valid;
+
+	pthread_t       load_thread;
+	bool            load_thread_active;
+
+	DARRAY(struct service_info) services;
+	DARRAY(size_t)  index;
+	int64_t         mtime;
+} cache;
+
 static inline const char *get_string_val(json_t *service, const char *key)
 {
 	json_t *str_val = json_object_get(service, key);
@@ -57,8 +115,46 @@ static inline const char *get_string_val(json_t *service, const char *key)
 	return json_string_value(str_val);
 }
 
-static void add_service(obs_property_t list, json_t *service)
+static void free_services(void)
+{
+	for (size_t i = 0; i < cache.services.num; i++) {
+		struct service_info *info = cache.services.array+i;
+
+		for (size_t j = 0; j < info->servers.num; j++) {
+			bfree(info->servers.array[j].name);
+			bfree(info->servers.array[j].url);
+		}
+
+		da_free(info->servers);
+		bfree(info->name);
+	}
+
+	da_free(cache.services);
+	da_free(cache.index);
+}
+
+static void add_servers(struct service_info *info, json_t *servers)
 {
+	json_t *server;
+	size_t index;
+
+	json_array_foreach (servers, index, server) {
+		const char *server_name = get_string_val(server, "name");
+		const char *url         = get_string_val(server, "url");
+		struct server_info *server_info;
+
+		if (!server_name || !url)
+			continue;
+
+		server_info = da_push_back_new(info->servers);
+		server_info->name = bstrdup(server_name);
+		server_info->url  = bstrdup(url);
+	}
+}
+
+static void add_service(json_t *service)
+{
+	struct service_info *info;
 	json_t *servers;
 	const char *name;
 
@@ -82,10 +178,21 @@ static void add_service(obs_property_t list, json_t *service)
 		return;
 	}
 
-	obs_property_list_add_string(list, name, name);
+	info = da_push_back_new(cache.services);
+	info->name = bstrdup(name);
+	add_servers(info, servers);
 }
 
-static void add_services(obs_property_t list, const char *file, json_t *root)
+static int compare_services(const void *a, const void *b)
+{
+	size_t idx_a = *(const size_t*)a;
+	size_t idx_b = *(const size_t*)b;
+
+	return strcmp(cache.services.array[idx_a].name,
+			cache.services.array[idx_b].name);
+}
+
+static void add_services(const char *file, json_t *root)
 {
 	json_t *service;
 	size_t index;
@@ -97,18 +204,25 @@ static void add_services(obs_property_t list, const char *file, json_t *root)
 	}
 
 	json_array_foreach (root, index, service) {
-		add_service(list, service);
+		add_service(service);
 	}
+
+	da_resize(cache.index, cache.services.num);
+	for (size_t i = 0; i < cache.index.num; i++)
+		cache.index.array[i] = i;
+
+	qsort(cache.index.array, cache.index.num, sizeof(size_t),
+			compare_services);
 }
 
-static json_t *build_service_list(obs_property_t list, const char *file)
+static void build_service_list(const char *file)
 {
 	char         *file_data = os_quick_read_utf8_file(file);
 	json_error_t error;
 	json_t       *root;
 
 	if (!file_data)
-		return NULL;
+		return;
 
 	root = json_loads(file_data, JSON_REJECT_DUPLICATES, &error);
 	bfree(file_data);
@@ -117,100 +231,148 @@ static json_t *build_service_list(obs_property_t list, const char *file)
 		blog(LOG_WARNING, "rtmp-common.c: [build_service_list] "
 		                  "Error reading JSON file '%s' (%d): %s",
 		                  file, error.line, error.text);
-		return NULL;
+		return;
 	}
 
-	add_services(list, file, root);
-	return root;
+	add_services(file, root);
+	json_decref(root);
 }
 
-static void properties_data_destroy(void *data)
+/* must be called with the cache mutex locked */
+static void update_services(void)
 {
-	json_t *root = data;
-	if (root)
-		json_decref(root);
+	char    *file = obs_find_plugin_file("rtmp-services/services.json");
+	int64_t mtime;
+
+	if (!file)
+		return;
+
+	mtime = os_get_file_mtime(file);
+	if (mtime != cache.mtime || !cache.services.num) {
+		free_services();
+		build_service_list(file);
+		cache.mtime = mtime;
+	}
+
+	bfree(file);
 }
 
-static void fill_servers(obs_property_t servers_prop, json_t *service,
-		const char *name)
+static void *load_thread(void *unused)
 {
-	json_t *servers, *server;
-	size_t index;
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "rtmp services");
 
-	obs_property_list_clear(servers_prop);
+	pthread_mutex_lock(&cache.mutex);
+	update_services();
+	pthread_mutex_unlock(&cache.mutex);
 
-	servers = json_object_get(service, "servers");
+	UNUSED_PARAMETER(unused);
+	return NULL;
+}
 
-	if (!json_is_array(servers)) {
-		blog(LOG_WARNING, "rtmp-common.c: [fill_servers] "
-		                  "Servers for service '%s' not a valid object",
-		                  name);
+void rtmp_common_load_services(void)
+{
+	if (pthread_mutex_init(&cache.mutex, NULL) != 0)
 		return;
-	}
 
-	json_array_foreach (servers, index, server) {
-		const char *server_name = get_string_val(server, "name");
-		const char *url         = get_string_val(server, "url");
+	rtmp_ingest_init();
 
-		if (!server_name || !url)
-			continue;
+	cache.mutex_valid = true;
+	cache.mtime       = -1;
+	cache.load_thread_active =
+		pthread_create(&cache.load_thread, NULL, load_thread,
+				NULL) == 0;
+}
 
-		obs_property_list_add_string(servers_prop, server_name, url);
-	}
+void rtmp_common_free_services(void)
+{
+	if (!cache.mutex_valid)
+		return;
+
+	if (cache.load_thread_active)
+		pthread_join(cache.load_thread, NULL);
+
+	free_services();
+	pthread_mutex_destroy(&cache.mutex);
+	cache.mutex_valid = false;
+
+	rtmp_ingest_free();
 }
 
-static inline json_t *find_service(json_t *root, const char *name)
+static int find_service_cb(const void *key, const void *elem)
 {
-	size_t index;
-	json_t *service;
+	return strcmp(key, cache.services.array[*(const size_t*)elem].name);
+}
 
-	json_array_foreach (root, index, service) {
-		const char *cur_name = get_string_val(service, "name");
+static inline struct service_info *find_service(const char *name)
+{
+	size_t *idx = bsearch(name, cache.index.array, cache.index.num,
+			sizeof(size_t), find_service_cb);
 
-		if (strcmp(name, cur_name) == 0)
-			return service;
-	}
+	return idx ? cache.services.array + *idx : NULL;
+}
 
-	return NULL;
+static void fill_servers(obs_property_t servers_prop,
+		struct service_info *info)
+{
+	obs_property_list_clear(servers_prop);
+
+	/* TODO: locale */
+	if (info->servers.num > 1)
+		obs_property_list_add_string(servers_prop,
+				"Auto (fastest server)", AUTO_SERVER);
+
+	for (size_t i = 0; i < info->servers.num; i++) {
+		struct server_info *server = info->servers.array+i;
+		obs_property_list_add_string(servers_prop, server->name,
+				server->url);
+	}
 }
 
 static bool service_selected(obs_properties_t props, obs_property_t p,
 		obs_data_t settings)
 {
 	const char *name = obs_data_getstring(settings, "service");
-	json_t *root     = obs_properties_get_param(props);
-	json_t *service;
+	struct service_info *info;
+	bool found = false;
 
-	if (!name || !*name)
+	if (!name || !*name || !cache.mutex_valid)
 		return false;
 
-	service = find_service(root, name);
-	if (!service)
-		return false;
+	pthread_mutex_lock(&cache.mutex);
 
-	fill_servers(obs_properties_get(props, "server"), service, name);
+	info = find_service(name);
+	if (info) {
+		fill_servers(obs_properties_get(props, "server"), info);
+		found = true;
+	}
+
+	pthread_mutex_unlock(&cache.mutex);
 
 	UNUSED_PARAMETER(p);
-	return true;
+	return found;
 }
 
 static obs_properties_t rtmp_common_properties(const char *locale)
 {
 	obs_properties_t ppts = obs_properties_create(locale);
 	obs_property_t   list;
-	char             *file;
 
 	/* TODO: locale */
 
 	list = obs_properties_add_list(ppts, "service", "Service",
 			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
 
-	file = obs_find_plugin_file("rtmp-services/services.json");
-	if (file) {
-		json_t *root = build_service_list(list, file);
-		obs_properties_set_param(ppts, root, properties_data_destroy);
+	if (cache.mutex_valid) {
+		pthread_mutex_lock(&cache.mutex);
+		update_services();
+
+		for (size_t i = 0; i < cache.services.num; i++) {
+			const char *name = cache.services.array[i].name;
+			obs_property_list_add_string(list, name, name);
+		}
+
+		pthread_mutex_unlock(&cache.mutex);
 		obs_property_set_modified_callback(list, service_selected);
-		bfree(file);
 	}
 
 	obs_properties_add_list(ppts, "server", "Server",
@@ -220,10 +382,70 @@ static obs_properties_t rtmp_common_properties(const char *locale)
 	return ppts;
 }
 
+/* the servers are copied, so the probes don't need the cache locked */
+static void start_ingest_select(struct rtmp_common *service)
+{
+	struct service_info *info;
+	const char          **urls;
+	size_t              count = 0;
+
+	if (!service->service || !cache.mutex_valid)
+		return;
+
+	pthread_mutex_lock(&cache.mutex);
+
+	info = find_service(service->service);
+	if (info && info->servers.num) {
+		urls = bmalloc(sizeof(const char*) * info->servers.num);
+		for (size_t i = 0; i < info->servers.num; i++)
+			urls[count++] = info->servers.array[i].url;
+
+		service->ingest = ingest_select_start(service->service,
+				urls, count);
+		bfree(urls);
+	}
+
+	pthread_mutex_unlock(&cache.mutex);
+}
+
+/* used if no server could be reached in time, the connection attempt will
+ * then at least report why it failed */
+static char *first_server_url(struct rtmp_common *service)
+{
+	struct service_info *info;
+	char                *url = NULL;
+
+	pthread_mutex_lock(&cache.mutex);
+
+	info = find_service(service->service);
+	if (info && info->servers.num)
+		url = bstrdup(info->servers.array[0].url);
+
+	pthread_mutex_unlock(&cache.mutex);
+	return url;
+}
+
 static const char *rtmp_common_url(void *data)
 {
 	struct rtmp_common *service = data;
-	return service->server;
+	const char         *url;
+
+	if (!is_auto_server(service))
+		return service->server;
+	if (service->auto_url)
+		return service->auto_url;
+
+	/* the cached result may have expired, or the network may have changed
+	 * since the service was set, so probing starts again if needed */
+	if (!service->ingest)
+		start_ingest_select(service);
+
+	url = ingest_select_get(service->ingest, AUTO_SERVER_WAIT_MS);
+	service->auto_url = url ? bstrdup(url) : first_server_url(service);
+
+	ingest_select_destroy(service->ingest);
+	service->ingest = NULL;
+	return service->auto_url;
 }
 
 static const char *rtmp_common_key(void *data)
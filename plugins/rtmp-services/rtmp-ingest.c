@@ -0,0 +1,445 @@
+#include <util/platform.h>
+#include <util/threading.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <obs-module.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+typedef SOCKET probe_socket_t;
+#define INVALID_PROBE_SOCKET INVALID_SOCKET
+#define close_probe_socket   closesocket
+#define connect_in_progress() (WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+typedef int probe_socket_t;
+#define INVALID_PROBE_SOCKET -1
+#define close_probe_socket   close
+#define connect_in_progress() (errno == EINPROGRESS)
+#endif
+
+#include "rtmp-ingest.h"
+
+#define DEFAULT_RTMP_PORT  "1935"
+#define PROBE_TIMEOUT_MS   1000
+#define PROBE_ATTEMPTS     3
+#define CACHE_EXPIRE_NS    (15ULL * 60ULL * 1000000000ULL)
+
+struct ingest_server {
+	struct ingest_select *sel;
+	char                 *url;
+	struct dstr          host;
+	struct dstr          port;
+
+	/* the lowest connect time of all attempts, or -1 if unreachable */
+	int64_t              rtt_ns;
+
+	pthread_t            thread;
+	bool                 thread_active;
+};
+
+struct ingest_select {
+	char                 *service;
+	struct dstr          network;
+	DARRAY(struct ingest_server) servers;
+	const char           *best;
+	volatile bool        cancel;
+
+	pthread_t            thread;
+	bool                 thread_active;
+	os_event_t           done_event;
+};
+
+struct ingest_cache_entry {
+	char                 *service;
+	char                 *network;
+	char                 *url;
+	uint64_t             time;
+};
+
+static struct {
+	pthread_mutex_t      mutex;
+	bool                 mutex_valid;
+	DARRAY(struct ingest_cache_entry) entries;
+} ingest_cache;
+
+/* ------------------------------------------------------------------------- */
+/* cache */
+
+void rtmp_ingest_init(void)
+{
+#ifdef _WIN32
+	WSADATA wsad;
+	WSAStartup(MAKEWORD(2, 2), &wsad);
+#endif
+
+	ingest_cache.mutex_valid =
+		pthread_mutex_init(&ingest_cache.mutex, NULL) == 0;
+}
+
+void rtmp_ingest_free(void)
+{
+	for (size_t i = 0; i < ingest_cache.entries.num; i++) {
+		struct ingest_cache_entry *entry =
+			ingest_cache.entries.array+i;
+		bfree(entry->service);
+		bfree(entry->network);
+		bfree(entry->url);
+	}
+
+	da_free(ingest_cache.entries);
+
+	if (ingest_cache.mutex_valid)
+		pthread_mutex_destroy(&ingest_cache.mutex);
+	ingest_cache.mutex_valid = false;
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+/* must be called with the cache mutex locked */
+static struct ingest_cache_entry *find_cache_entry(const char *service,
+		const char *network)
+{
+	for (size_t i = 0; i < ingest_cache.entries.num; i++) {
+		struct ingest_cache_entry *entry =
+			ingest_cache.entries.array+i;
+
+		if (strcmp(entry->service, service) == 0 &&
+		    strcmp(entry->network, network) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/* the cached url is only used if it's still one of the service's servers */
+static bool get_cached_server(struct ingest_select *sel)
+{
+	struct ingest_cache_entry *entry;
+
+	if (!ingest_cache.mutex_valid)
+		return false;
+
+	pthread_mutex_lock(&ingest_cache.mutex);
+
+	entry = find_cache_entry(sel->service, sel->network.array);
+	if (entry && os_gettime_ns() - entry->time < CACHE_EXPIRE_NS) {
+		for (size_t i = 0; i < sel->servers.num; i++) {
+			struct ingest_server *server =
+				sel->servers.array+i;
+
+			if (strcmp(server->url, entry->url) == 0) {
+				sel->best = server->url;
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&ingest_cache.mutex);
+	return sel->best != NULL;
+}
+
+static void set_cached_server(struct ingest_select *sel)
+{
+	struct ingest_cache_entry *entry;
+
+	if (!ingest_cache.mutex_valid)
+		return;
+
+	pthread_mutex_lock(&ingest_cache.mutex);
+
+	entry = find_cache_entry(sel->service, sel->network.array);
+	if (!entry) {
+		entry = da_push_back_new(ingest_cache.entries);
+		entry->service = bstrdup(sel->service);
+		entry->network = bstrdup(sel->network.array);
+	}
+
+	bfree(entry->url);
+	entry->url  = bstrdup(sel->best);
+	entry->time = os_gettime_ns();
+
+	pthread_mutex_unlock(&ingest_cache.mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+/* probing */
+
+/* "rtmp://host:port/app" or "rtmp://[v6 address]:port/app" */
+static void parse_url(struct ingest_server *server)
+{
+	const char *host = strstr(server->url, "://");
+	const char *end;
+
+	host = host ? host + 3 : server->url;
+
+	if (*host == '[') {
+		end = strchr(++host, ']');
+		if (!end)
+			return;
+		dstr_ncopy(&server->host, host, end - host);
+		end++;
+	} else {
+		end = host + strcspn(host, ":/");
+		dstr_ncopy(&server->host, host, end - host);
+	}
+
+	if (*end == ':')
+		dstr_ncopy(&server->port, end + 1, strcspn(end + 1, "/"));
+	if (dstr_isempty(&server->port))
+		dstr_copy(&server->port, DEFAULT_RTMP_PORT);
+}
+
+static bool set_nonblocking(probe_socket_t sock)
+{
+#ifdef _WIN32
+	u_long nonblocking = 1;
+	return ioctlsocket(sock, FIONBIO, &nonblocking) == 0;
+#else
+	int flags = fcntl(sock, F_GETFL, 0);
+	return flags != -1 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) != -1;
+#endif
+}
+
+/* returns the time it took to connect, or -1 if it failed or timed out */
+static int64_t time_connect(const struct addrinfo *addr)
+{
+	probe_socket_t sock;
+	struct timeval timeout;
+	fd_set         write_set;
+	int            error = 0;
+	socklen_t      size  = sizeof(error);
+	uint64_t       start;
+	int64_t        rtt   = -1;
+
+	sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+	if (sock == INVALID_PROBE_SOCKET)
+		return -1;
+	if (!set_nonblocking(sock))
+		goto finish;
+
+	start = os_gettime_ns();
+
+	if (connect(sock, addr->ai_addr, (int)addr->ai_addrlen) != 0 &&
+	    !connect_in_progress())
+		goto finish;
+
+	FD_ZERO(&write_set);
+	FD_SET(sock, &write_set);
+	timeout.tv_sec  = PROBE_TIMEOUT_MS / 1000;
+	timeout.tv_usec = (PROBE_TIMEOUT_MS % 1000) * 1000;
+
+	if (select((int)sock + 1, NULL, &write_set, NULL, &timeout) != 1)
+		goto finish;
+	if (getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&error,
+				&size) != 0 || error != 0)
+		goto finish;
+
+	rtt = (int64_t)(os_gettime_ns() - start);
+
+finish:
+	close_probe_socket(sock);
+	return rtt;
+}
+
+static void *probe_thread(void *data)
+{
+	struct ingest_server *server = data;
+	struct addrinfo      hints = {0};
+	struct addrinfo      *addr;
+
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(server->host.array, server->port.array, &hints,
+				&addr) != 0)
+		return NULL;
+
+	/* the first connection also includes the time for the route to
+	 * settle, so the best of a few attempts is used */
+	for (int i = 0; i < PROBE_ATTEMPTS && !server->sel->cancel; i++) {
+		int64_t rtt = time_connect(addr);
+
+		if (rtt >= 0 && (server->rtt_ns < 0 || rtt < server->rtt_ns))
+			server->rtt_ns = rtt;
+	}
+
+	freeaddrinfo(addr);
+	return NULL;
+}
+
+/* the network is told apart by the local address that the first server is
+ * reached from.  connecting a UDP socket doesn't send anything, it only
+ * picks the route */
+static void get_network(struct ingest_select *sel)
+{
+	struct ingest_server    *server = sel->servers.array;
+	struct addrinfo         hints = {0};
+	struct addrinfo         *addr;
+	struct sockaddr_storage local;
+	socklen_t               size = sizeof(local);
+	char                    name[NI_MAXHOST];
+	probe_socket_t          sock;
+
+	dstr_copy(&sel->network, "unknown");
+
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	if (getaddrinfo(server->host.array, server->port.array, &hints,
+				&addr) != 0)
+		return;
+
+	sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+	if (sock != INVALID_PROBE_SOCKET) {
+		if (connect(sock, addr->ai_addr, (int)addr->ai_addrlen) == 0 &&
+		    getsockname(sock, (struct sockaddr*)&local, &size) == 0 &&
+		    getnameinfo((struct sockaddr*)&local, size, name,
+				    sizeof(name), NULL, 0, NI_NUMERICHOST) == 0)
+			dstr_copy(&sel->network, name);
+
+		close_probe_socket(sock);
+	}
+
+	freeaddrinfo(addr);
+}
+
+static void probe_servers(struct ingest_select *sel)
+{
+	struct ingest_server *best = NULL;
+
+	for (size_t i = 0; i < sel->servers.num; i++) {
+		struct ingest_server *server = sel->servers.array+i;
+		server->thread_active = pthread_create(&server->thread, NULL,
+				probe_thread, server) == 0;
+	}
+
+	for (size_t i = 0; i < sel->servers.num; i++) {
+		struct ingest_server *server = sel->servers.array+i;
+
+		if (server->thread_active) {
+			pthread_join(server->thread, NULL);
+			server->thread_active = false;
+		}
+
+		if (server->rtt_ns >= 0 &&
+		    (!best || server->rtt_ns < best->rtt_ns))
+			best = server;
+	}
+
+	if (best) {
+		sel->best = best->url;
+		blog(LOG_INFO, "rtmp-ingest.c: '%s' is the fastest server of "
+		               "'%s' (%lldms)", best->url, sel->service,
+		               (long long)(best->rtt_ns / 1000000));
+	} else {
+		blog(LOG_WARNING, "rtmp-ingest.c: none of the servers of '%s' "
+		                  "could be reached", sel->service);
+	}
+}
+
+static void *select_thread(void *data)
+{
+	struct ingest_select *sel = data;
+
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "rtmp ingest probe");
+
+	get_network(sel);
+
+	if (!get_cached_server(sel) && !sel->cancel) {
+		probe_servers(sel);
+		if (sel->best && !sel->cancel)
+			set_cached_server(sel);
+	}
+
+	os_event_signal(sel->done_event);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct ingest_select *ingest_select_start(const char *service,
+		const char **urls, size_t count)
+{
+	struct ingest_select *sel;
+
+	if (!count)
+		return NULL;
+
+	sel = bzalloc(sizeof(struct ingest_select));
+	sel->service = bstrdup(service);
+
+	if (os_event_init(&sel->done_event, OS_EVENT_TYPE_MANUAL) != 0) {
+		ingest_select_destroy(sel);
+		return NULL;
+	}
+
+	da_resize(sel->servers, count);
+	memset(sel->servers.array, 0,
+			sizeof(struct ingest_server) * count);
+
+	for (size_t i = 0; i < count; i++) {
+		struct ingest_server *server = sel->servers.array+i;
+		server->sel    = sel;
+		server->url    = bstrdup(urls[i]);
+		server->rtt_ns = -1;
+		parse_url(server);
+	}
+
+	sel->thread_active = pthread_create(&sel->thread, NULL,
+			select_thread, sel) == 0;
+	if (!sel->thread_active) {
+		ingest_select_destroy(sel);
+		return NULL;
+	}
+
+	return sel;
+}
+
+const char *ingest_select_get(struct ingest_select *sel,
+		uint32_t timeout_ms)
+{
+	if (!sel)
+		return NULL;
+	if (os_event_timedwait(sel->done_event, timeout_ms) != 0)
+		return NULL;
+
+	return sel->best;
+}
+
+void ingest_select_destroy(struct ingest_select *sel)
+{
+	if (!sel)
+		return;
+
+	if (sel->thread_active) {
+		sel->cancel = true;
+		pthread_join(sel->thread, NULL);
+	}
+
+	for (size_t i = 0; i < sel->servers.num; i++) {
+		struct ingest_server *server = sel->servers.array+i;
+		bfree(server->url);
+		dstr_free(&server->host);
+		dstr_free(&server->port);
+	}
+
+	da_free(sel->servers);
+	dstr_free(&sel->network);
+	os_event_destroy(sel->done_event);
+	bfree(sel->service);
+	bfree(sel);
+}
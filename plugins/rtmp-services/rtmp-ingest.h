@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Picks the ingest server of a service with the lowest TCP connect time.
+ * All servers are probed at the same time on background threads, and the
+ * result is cached per service and network, so the probing only has to be
+ * done again after switching networks or once the result is stale.
+ */
+
+struct ingest_select;
+
+extern void rtmp_ingest_init(void);
+extern void rtmp_ingest_free(void);
+
+/* starts selecting a server from the given urls in the background */
+extern struct ingest_select *ingest_select_start(const char *service,
+		const char **urls, size_t count);
+
+/* waits up to timeout_ms for the selection to finish, and returns the url of
+ * the fastest server, or NULL if none of them could be reached in time */
+extern const char *ingest_select_get(struct ingest_select *sel,
+		uint32_t timeout_ms);
+
+extern void ingest_select_destroy(struct ingest_select *sel);
@@ -3,11 +3,21 @@
 extern struct obs_service_info rtmp_common_service;
 extern struct obs_service_info rtmp_custom_service;
 
+extern void rtmp_common_load_services(void);
+extern void rtmp_common_free_services(void);
+
 bool obs_module_load(uint32_t libobs_ver)
 {
 	obs_register_service(&rtmp_common_service);
 	obs_register_service(&rtmp_custom_service);
 
+	rtmp_common_load_services();
+
 	UNUSED_PARAMETER(libobs_ver);
 	return true;
 }
+
+void obs_module_unload(void)
+{
+	rtmp_common_free_services();
+}
@@ -0,0 +1,463 @@
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <util/darray.h>
+#include <util/threading.h>
+#include "glyph-atlas.h"
+
+#define ATLAS_PADDING 1
+
+enum glyph_state {
+	GLYPH_PENDING,
+	GLYPH_RASTERIZED,
+	GLYPH_FAILED
+};
+
+struct glyph {
+	uint32_t          codepoint;
+	enum glyph_state  state;
+	long              serial;
+	struct glyph_info info;
+};
+
+struct glyph_atlas {
+	long              refs;
+	char              *path;
+	uint32_t          size;
+	FT_Face           face;
+
+	texture_t         texture;
+	uint32_t          tex_size;
+	int               ascender;
+	int               line_height;
+
+	/* sorted by code point */
+	pthread_mutex_t   mutex;
+	DARRAY(struct glyph) glyphs;
+	DARRAY(uint32_t)  pending;
+	long              serial;
+
+	/* serial of the last glyph that's been uploaded to the texture */
+	volatile long     uploaded;
+
+	/* only used by the rasterizer thread */
+	uint32_t          shelf_x;
+	uint32_t          shelf_y;
+	uint32_t          shelf_cy;
+	bool              full;
+	DARRAY(uint8_t)   bitmap;
+};
+
+struct upload_done {
+	struct glyph_atlas *atlas;
+	long               serial;
+};
+
+/* FreeType isn't thread safe, so all of its calls are made with the mutex
+ * held, which also guards the list of atlases */
+static struct {
+	pthread_mutex_t   mutex;
+	FT_Library        library;
+	DARRAY(struct glyph_atlas*) atlases;
+
+	pthread_t         thread;
+	os_sem_t          sem;
+	bool              stop;
+} ft;
+
+static size_t find_glyph(struct glyph_atlas *atlas, uint32_t codepoint,
+		bool *found)
+{
+	size_t low  = 0;
+	size_t high = atlas->glyphs.num;
+
+	while (low < high) {
+		size_t   mid = (low + high) / 2;
+		uint32_t cur = atlas->glyphs.array[mid].codepoint;
+
+		if (cur == codepoint) {
+			*found = true;
+			return mid;
+		}
+
+		if (cur < codepoint)
+			low  = mid + 1;
+		else
+			high = mid;
+	}
+
+	*found = false;
+	return low;
+}
+
+static bool atlas_alloc(struct glyph_atlas *atlas, uint32_t cx, uint32_t cy,
+		uint32_t *x, uint32_t *y)
+{
+	if (atlas->shelf_x + cx > atlas->tex_size) {
+		atlas->shelf_y  += atlas->shelf_cy;
+		atlas->shelf_x   = 0;
+		atlas->shelf_cy  = 0;
+	}
+
+	if (atlas->shelf_y + cy > atlas->tex_size)
+		return false;
+
+	*x = atlas->shelf_x;
+	*y = atlas->shelf_y;
+
+	atlas->shelf_x += cx;
+	if (cy > atlas->shelf_cy)
+		atlas->shelf_cy = cy;
+	return true;
+}
+
+static bool rasterize_glyph(struct glyph_atlas *atlas, uint32_t codepoint,
+		struct glyph_info *info)
+{
+	FT_UInt      index = FT_Get_Char_Index(atlas->face, codepoint);
+	FT_GlyphSlot slot;
+	FT_Bitmap    *bitmap;
+	uint32_t     cx, cy;
+
+	if (FT_Load_Glyph(atlas->face, index, FT_LOAD_RENDER) != 0)
+		return false;
+
+	slot   = atlas->face->glyph;
+	bitmap = &slot->bitmap;
+	cx     = (uint32_t)bitmap->width;
+	cy     = (uint32_t)bitmap->rows;
+
+	info->left    = slot->bitmap_left;
+	info->top     = slot->bitmap_top;
+	info->advance = (float)slot->advance.x / 64.0f;
+
+	if (!cx || !cy)
+		return true;
+	if (bitmap->pixel_mode != FT_PIXEL_MODE_GRAY)
+		return false;
+
+	/* glyphs are never removed, so a full atlas stays full */
+	if (!atlas_alloc(atlas, cx + ATLAS_PADDING, cy + ATLAS_PADDING,
+				&info->x, &info->y)) {
+		if (!atlas->full)
+			blog(LOG_WARNING, "text-freetype2: Glyph atlas of "
+			                  "'%s' (size %u) is full",
+			                  atlas->path, atlas->size);
+		atlas->full = true;
+		return false;
+	}
+
+	info->cx = cx;
+	info->cy = cy;
+
+	/* the pitch can be negative, so copy the rows to a packed bitmap */
+	da_resize(atlas->bitmap, cx * cy);
+	for (uint32_t y = 0; y < cy; y++)
+		memcpy(atlas->bitmap.array + y * cx,
+				bitmap->buffer + (int)y * bitmap->pitch, cx);
+
+	obs_queue_texture_setimage_region(atlas->texture, atlas->bitmap.array,
+			cx, info->x, info->y, cx, cy);
+	return true;
+}
+
+static void upload_done_task(void *param)
+{
+	struct upload_done *done = param;
+
+	os_atomic_set_long(&done->atlas->uploaded, done->serial);
+	bfree(done);
+}
+
+/* called with the FreeType mutex held */
+static void rasterize_pending(struct glyph_atlas *atlas)
+{
+	DARRAY(uint32_t) pending;
+	struct upload_done *done;
+	long serial = 0;
+
+	da_init(pending);
+
+	pthread_mutex_lock(&atlas->mutex);
+	da_move(pending, atlas->pending);
+	pthread_mutex_unlock(&atlas->mutex);
+
+	if (!pending.num)
+		return;
+
+	for (size_t i = 0; i < pending.num; i++) {
+		struct glyph_info info = {0};
+		uint32_t codepoint = pending.array[i];
+		bool     success   = rasterize_glyph(atlas, codepoint, &info);
+		struct glyph *glyph;
+		bool     found;
+
+		pthread_mutex_lock(&atlas->mutex);
+
+		glyph = atlas->glyphs.array +
+			find_glyph(atlas, codepoint, &found);
+		glyph->info   = info;
+		glyph->state  = success ? GLYPH_RASTERIZED : GLYPH_FAILED;
+		glyph->serial = serial = ++atlas->serial;
+
+		pthread_mutex_unlock(&atlas->mutex);
+	}
+
+	da_free(pending);
+
+	/* the graphics queue runs in order, so once this task has run all the
+	 * glyph uploads before it have too */
+	done = bmalloc(sizeof(struct upload_done));
+	done->atlas  = atlas;
+	done->serial = serial;
+	obs_queue_graphics_task(upload_done_task, done);
+}
+
+static void *rasterizer_thread(void *param)
+{
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "text rasterizer");
+
+	while (os_sem_wait(ft.sem) == 0) {
+		bool stop;
+
+		pthread_mutex_lock(&ft.mutex);
+
+		stop = ft.stop;
+		if (!stop) {
+			for (size_t i = 0; i < ft.atlases.num; i++)
+				rasterize_pending(ft.atlases.array[i]);
+		}
+
+		pthread_mutex_unlock(&ft.mutex);
+
+		if (stop)
+			break;
+	}
+
+	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+bool glyph_atlas_init(void)
+{
+	if (pthread_mutex_init(&ft.mutex, NULL) != 0)
+		return false;
+	if (FT_Init_FreeType(&ft.library) != 0) {
+		blog(LOG_WARNING, "text-freetype2: Failed to initialize "
+		                  "FreeType");
+		goto fail_library;
+	}
+	if (os_sem_init(&ft.sem, 0) != 0)
+		goto fail_sem;
+	if (pthread_create(&ft.thread, NULL, rasterizer_thread, NULL) != 0)
+		goto fail_thread;
+
+	return true;
+
+fail_thread:
+	os_sem_destroy(ft.sem);
+fail_sem:
+	FT_Done_FreeType(ft.library);
+fail_library:
+	pthread_mutex_destroy(&ft.mutex);
+	return false;
+}
+
+void glyph_atlas_free(void)
+{
+	pthread_mutex_lock(&ft.mutex);
+	ft.stop = true;
+	pthread_mutex_unlock(&ft.mutex);
+
+	os_sem_post(ft.sem);
+	pthread_join(ft.thread, NULL);
+	os_sem_destroy(ft.sem);
+
+	if (ft.atlases.num)
+		blog(LOG_WARNING, "text-freetype2: %u glyph atlases were "
+		                  "never released",
+		                  (unsigned int)ft.atlases.num);
+	da_free(ft.atlases);
+
+	FT_Done_FreeType(ft.library);
+	pthread_mutex_destroy(&ft.mutex);
+}
+
+static inline int ft_ceil(FT_Pos val)
+{
+	return (int)((val + 63) >> 6);
+}
+
+static struct glyph_atlas *atlas_create(const char *path, uint32_t size)
+{
+	struct glyph_atlas *atlas;
+	FT_Face  face;
+	uint32_t tex_size = size <= 48 ? 1024 : 2048;
+	uint8_t  *zero;
+
+	if (FT_New_Face(ft.library, path, 0, &face) != 0) {
+		blog(LOG_WARNING, "text-freetype2: Failed to open font '%s'",
+				path);
+		return NULL;
+	}
+
+	if (FT_Set_Pixel_Sizes(face, 0, size) != 0) {
+		blog(LOG_WARNING, "text-freetype2: Font '%s' has no size %u",
+				path, size);
+		FT_Done_Face(face);
+		return NULL;
+	}
+
+	atlas = bzalloc(sizeof(struct glyph_atlas));
+	atlas->refs        = 1;
+	atlas->path        = bstrdup(path);
+	atlas->size        = size;
+	atlas->face        = face;
+	atlas->tex_size    = tex_size;
+	atlas->ascender    = ft_ceil(face->size->metrics.ascender);
+	atlas->line_height = ft_ceil(face->size->metrics.height);
+	pthread_mutex_init(&atlas->mutex, NULL);
+
+	zero = bzalloc(tex_size * tex_size);
+
+	gs_entercontext(obs_graphics());
+	atlas->texture = gs_create_texture(tex_size, tex_size, GS_A8, 1,
+			(const void**)&zero, 0);
+	gs_leavecontext();
+
+	bfree(zero);
+
+	if (!atlas->texture) {
+		blog(LOG_WARNING, "text-freetype2: Failed to create glyph "
+		                  "atlas texture");
+		FT_Done_Face(face);
+		pthread_mutex_destroy(&atlas->mutex);
+		bfree(atlas->path);
+		bfree(atlas);
+		return NULL;
+	}
+
+	return atlas;
+}
+
+struct glyph_atlas *glyph_atlas_get(const char *path, uint32_t size)
+{
+	struct glyph_atlas *atlas = NULL;
+
+	if (!path || !*path || !size)
+		return NULL;
+
+	pthread_mutex_lock(&ft.mutex);
+
+	for (size_t i = 0; i < ft.atlases.num; i++) {
+		struct glyph_atlas *cur = ft.atlases.array[i];
+
+		if (cur->size == size && strcmp(cur->path, path) == 0) {
+			atlas = cur;
+			atlas->refs++;
+			break;
+		}
+	}
+
+	if (!atlas) {
+		atlas = atlas_create(path, size);
+		if (atlas)
+			da_push_back(ft.atlases, &atlas);
+	}
+
+	pthread_mutex_unlock(&ft.mutex);
+	return atlas;
+}
+
+/* queued after the uploads and upload_done tasks of the atlas */
+static void destroy_atlas_task(void *param)
+{
+	struct glyph_atlas *atlas = param;
+
+	texture_destroy(atlas->texture);
+	pthread_mutex_destroy(&atlas->mutex);
+	da_free(atlas->glyphs);
+	da_free(atlas->pending);
+	da_free(atlas->bitmap);
+	bfree(atlas->path);
+	bfree(atlas);
+}
+
+void glyph_atlas_release(struct glyph_atlas *atlas)
+{
+	bool destroy = false;
+
+	if (!atlas)
+		return;
+
+	pthread_mutex_lock(&ft.mutex);
+	if (--atlas->refs == 0) {
+		da_erase_item(ft.atlases, &atlas);
+		FT_Done_Face(atlas->face);
+		destroy = true;
+	}
+	pthread_mutex_unlock(&ft.mutex);
+
+	if (destroy)
+		obs_queue_graphics_task(destroy_atlas_task, atlas);
+}
+
+texture_t glyph_atlas_texture(struct glyph_atlas *atlas)
+{
+	return atlas ? atlas->texture : NULL;
+}
+
+int glyph_atlas_ascender(struct glyph_atlas *atlas)
+{
+	return atlas ? atlas->ascender : 0;
+}
+
+int glyph_atlas_line_height(struct glyph_atlas *atlas)
+{
+	return atlas ? atlas->line_height : 0;
+}
+
+long glyph_atlas_revision(struct glyph_atlas *atlas)
+{
+	return atlas ? atlas->uploaded : 0;
+}
+
+void glyph_atlas_lookup(struct glyph_atlas *atlas,
+		const uint32_t *codepoints, size_t count,
+		struct glyph_info *glyphs, bool *available)
+{
+	long uploaded = atlas->uploaded;
+	bool queued   = false;
+
+	pthread_mutex_lock(&atlas->mutex);
+
+	for (size_t i = 0; i < count; i++) {
+		struct glyph *glyph;
+		bool   found;
+		size_t idx = find_glyph(atlas, codepoints[i], &found);
+
+		if (!found) {
+			glyph = da_insert_new(atlas->glyphs, idx);
+			glyph->codepoint = codepoints[i];
+			glyph->state     = GLYPH_PENDING;
+			da_push_back(atlas->pending, &codepoints[i]);
+
+			available[i] = false;
+			queued       = true;
+			continue;
+		}
+
+		/* glyphs that failed are drawn as empty, for as far as they
+		 * got rasterized */
+		glyph = atlas->glyphs.array+idx;
+		available[i] = glyph->state != GLYPH_PENDING &&
+		               glyph->serial <= uploaded;
+		if (available[i])
+			glyphs[i] = glyph->info;
+	}
+
+	pthread_mutex_unlock(&atlas->mutex);
+
+	if (queued)
+		os_sem_post(ft.sem);
+}
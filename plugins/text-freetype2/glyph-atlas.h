@@ -0,0 +1,52 @@
+#pragma once
+
+#include <obs.h>
+
+/*
+ * Shared glyph atlases, one for each font file and size.
+ *
+ *   Glyphs are rasterized with FreeType on a worker thread the first time
+ * they're looked up, and only the new glyphs are uploaded into the atlas
+ * texture through the graphics queue.  Until a glyph has been uploaded it
+ * isn't available, so text that uses it has to be laid out again once
+ * glyph_atlas_revision changes.
+ */
+
+struct glyph_atlas;
+
+struct glyph_info {
+	/* region of the atlas texture, cx/cy are 0 for empty glyphs */
+	uint32_t x;
+	uint32_t y;
+	uint32_t cx;
+	uint32_t cy;
+
+	/* offset of the bitmap from the pen position on the baseline */
+	int      left;
+	int      top;
+	float    advance;
+};
+
+extern bool glyph_atlas_init(void);
+extern void glyph_atlas_free(void);
+
+/* returns NULL if the font couldn't be opened */
+extern struct glyph_atlas *glyph_atlas_get(const char *path, uint32_t size);
+extern void glyph_atlas_release(struct glyph_atlas *atlas);
+
+extern texture_t glyph_atlas_texture(struct glyph_atlas *atlas);
+extern int glyph_atlas_ascender(struct glyph_atlas *atlas);
+extern int glyph_atlas_line_height(struct glyph_atlas *atlas);
+
+/* changes whenever newly rasterized glyphs finish uploading */
+extern long glyph_atlas_revision(struct glyph_atlas *atlas);
+
+/*
+ * Looks up the glyphs of a string of code points, queueing the ones that
+ * haven't been rasterized yet.  available[i] is false for glyphs that
+ * aren't uploaded yet, otherwise glyphs[i] is set.  Glyphs that couldn't
+ * be rasterized are available, but empty.
+ */
+extern void glyph_atlas_lookup(struct glyph_atlas *atlas,
+		const uint32_t *codepoints, size_t count,
+		struct glyph_info *glyphs, bool *available);
@@ -0,0 +1,367 @@
+#include <obs-module.h>
+#include <util/darray.h>
+#include <util/threading.h>
+#include <graphics/vec4.h>
+#include <math.h>
+#include "glyph-atlas.h"
+
+OBS_DECLARE_MODULE()
+
+#if defined(_WIN32)
+#define DEFAULT_FONT "C:\\Windows\\Fonts\\arial.ttf"
+#elif defined(__APPLE__)
+#define DEFAULT_FONT "/Library/Fonts/Arial.ttf"
+#else
+#define DEFAULT_FONT "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf"
+#endif
+
+struct text_quad {
+	float             x;
+	float             y;
+	struct glyph_info glyph;
+};
+
+struct text_source {
+	obs_source_t       source;
+	effect_t           effect;
+
+	/* changed by updates */
+	pthread_mutex_t    mutex;
+	struct glyph_atlas *atlas;
+	DARRAY(uint32_t)   text;
+	uint32_t           color;
+	bool               text_changed;
+
+	/* only used on the graphics thread, the text is laid out again when
+	 * it changes, or when glyphs it's missing might have been uploaded */
+	long               atlas_revision;
+	bool               missing_glyphs;
+	DARRAY(struct glyph_info) glyphs;
+	DARRAY(bool)       available;
+	DARRAY(struct text_quad) quads;
+	uint32_t           cx;
+	uint32_t           cy;
+};
+
+/* invalid sequences are skipped */
+static void utf8_to_codepoints(const char *str, struct darray *out_da)
+{
+	DARRAY(uint32_t) out;
+	const uint8_t *p = (const uint8_t*)str;
+
+	out.da = *out_da;
+	da_resize(out, 0);
+
+	while (p && *p) {
+		uint32_t codepoint;
+		size_t   extra;
+
+		if (*p < 0x80) {
+			codepoint = *p; extra = 0;
+		} else if ((*p & 0xE0) == 0xC0) {
+			codepoint = *p & 0x1F; extra = 1;
+		} else if ((*p & 0xF0) == 0xE0) {
+			codepoint = *p & 0x0F; extra = 2;
+		} else if ((*p & 0xF8) == 0xF0) {
+			codepoint = *p & 0x07; extra = 3;
+		} else {
+			p++;
+			continue;
+		}
+
+		p++;
+		while (extra && (*p & 0xC0) == 0x80) {
+			codepoint = (codepoint << 6) | (*p & 0x3F);
+			p++;
+			extra--;
+		}
+
+		if (!extra)
+			da_push_back(out, &codepoint);
+	}
+
+	*out_da = out.da;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void layout_text(struct text_source *ts)
+{
+	int      ascender    = glyph_atlas_ascender(ts->atlas);
+	int      line_height = glyph_atlas_line_height(ts->atlas);
+	size_t   count       = ts->text.num;
+	float    pen_x       = 0.0f;
+	float    width       = 0.0f;
+	uint32_t lines       = count ? 1 : 0;
+
+	da_resize(ts->glyphs,    count);
+	da_resize(ts->available, count);
+	da_resize(ts->quads,     0);
+
+	ts->atlas_revision = glyph_atlas_revision(ts->atlas);
+	ts->missing_glyphs = false;
+
+	glyph_atlas_lookup(ts->atlas, ts->text.array, count,
+			ts->glyphs.array, ts->available.array);
+
+	for (size_t i = 0; i < count; i++) {
+		struct glyph_info *glyph = ts->glyphs.array+i;
+		uint32_t codepoint = ts->text.array[i];
+
+		if (codepoint == '\n') {
+			pen_x = 0.0f;
+			lines++;
+			continue;
+		} else if (codepoint == '\r') {
+			continue;
+		}
+
+		if (!ts->available.array[i]) {
+			ts->missing_glyphs = true;
+			continue;
+		}
+
+		if (glyph->cx && glyph->cy) {
+			struct text_quad *quad = da_push_back_new(ts->quads);
+			quad->x     = floorf(pen_x) + (float)glyph->left;
+			quad->y     = (float)((lines - 1) * line_height +
+			                      ascender - glyph->top);
+			quad->glyph = *glyph;
+		}
+
+		pen_x += glyph->advance;
+		if (pen_x > width)
+			width = pen_x;
+	}
+
+	ts->cx = (uint32_t)ceilf(width);
+	ts->cy = lines * (uint32_t)line_height;
+}
+
+static void text_tick(void *data, float seconds)
+{
+	struct text_source *ts = data;
+
+	pthread_mutex_lock(&ts->mutex);
+
+	if (ts->atlas) {
+		bool uploaded = false;
+
+		/* other sources using the same atlas change its revision too,
+		 * so only text that's missing glyphs cares about it */
+		if (ts->missing_glyphs &&
+		    ts->atlas_revision != glyph_atlas_revision(ts->atlas))
+			uploaded = true;
+
+		if (ts->text_changed || uploaded)
+			layout_text(ts);
+
+		/* updates invalidate cached output by themselves, glyphs that
+		 * show up later don't */
+		if (uploaded && !ts->text_changed)
+			obs_source_content_changed(ts->source);
+
+		ts->text_changed = false;
+	} else {
+		ts->cx = 0;
+		ts->cy = 0;
+	}
+
+	pthread_mutex_unlock(&ts->mutex);
+
+	UNUSED_PARAMETER(seconds);
+}
+
+static void text_render(void *data, effect_t effect)
+{
+	struct text_source *ts = data;
+	technique_t tech  = effect_gettechnique(ts->effect, "Draw");
+	eparam_t    image = effect_getparambyname(ts->effect, "image");
+	eparam_t    color = effect_getparambyname(ts->effect, "color");
+	texture_t   tex;
+	struct vec4 color_val;
+
+	pthread_mutex_lock(&ts->mutex);
+
+	tex = glyph_atlas_texture(ts->atlas);
+	if (!tex || !ts->quads.num)
+		goto finish;
+
+	vec4_from_rgba(&color_val, ts->color);
+	effect_setvec4(ts->effect, color, &color_val);
+	effect_settexture(ts->effect, image, tex);
+
+	/* all glyphs come from one texture, so the whole string is a single
+	 * draw call */
+	gs_sprite_batch_begin(ts->effect, image);
+
+	technique_begin(tech);
+	technique_beginpass(tech, 0);
+
+	for (size_t i = 0; i < ts->quads.num; i++) {
+		struct text_quad *quad = ts->quads.array+i;
+
+		gs_matrix_push();
+		gs_matrix_translate3f(quad->x, quad->y, 0.0f);
+		gs_draw_sprite_subregion(tex, 0, quad->glyph.x, quad->glyph.y,
+				quad->glyph.cx, quad->glyph.cy);
+		gs_matrix_pop();
+	}
+
+	technique_endpass(tech);
+	technique_end(tech);
+
+	gs_sprite_batch_end();
+
+finish:
+	pthread_mutex_unlock(&ts->mutex);
+
+	UNUSED_PARAMETER(effect);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const char *text_getname(const char *locale)
+{
+	/* TODO: translate */
+	UNUSED_PARAMETER(locale);
+	return "Text (FreeType 2)";
+}
+
+static void text_update(void *data, obs_data_t settings)
+{
+	struct text_source *ts = data;
+	const char *font_file = obs_data_getstring(settings, "font_file");
+	uint32_t    font_size = (uint32_t)obs_data_getint(settings,
+			"font_size");
+	const char *text      = obs_data_getstring(settings, "text");
+	struct glyph_atlas *atlas;
+
+	/* the atlas is shared, so getting it again is cheap if the font
+	 * hasn't changed */
+	atlas = glyph_atlas_get(font_file, font_size);
+
+	pthread_mutex_lock(&ts->mutex);
+
+	glyph_atlas_release(ts->atlas);
+	ts->atlas = atlas;
+
+	utf8_to_codepoints(text, &ts->text.da);
+	ts->color        = (uint32_t)obs_data_getint(settings, "color");
+	ts->text_changed = true;
+
+	pthread_mutex_unlock(&ts->mutex);
+}
+
+static void text_defaults(obs_data_t settings)
+{
+	obs_data_set_default_string(settings, "font_file", DEFAULT_FONT);
+	obs_data_set_default_int(settings, "font_size", 32);
+	obs_data_set_default_int(settings, "color", 0xFFFFFFFF);
+}
+
+static obs_properties_t text_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_text(props, "text", "Text", OBS_TEXT_DEFAULT);
+	obs_properties_add_path(props, "font_file", "Font File");
+	obs_properties_add_int(props, "font_size", "Font Size", 4, 512, 1);
+	obs_properties_add_color(props, "color", "Color");
+
+	return props;
+}
+
+static void text_destroy(void *data)
+{
+	struct text_source *ts = data;
+
+	glyph_atlas_release(ts->atlas);
+
+	gs_entercontext(obs_graphics());
+	effect_destroy(ts->effect);
+	gs_leavecontext();
+
+	pthread_mutex_destroy(&ts->mutex);
+	da_free(ts->text);
+	da_free(ts->glyphs);
+	da_free(ts->available);
+	da_free(ts->quads);
+	bfree(ts);
+}
+
+static void *text_create(obs_data_t settings, obs_source_t source)
+{
+	struct text_source *ts = bzalloc(sizeof(struct text_source));
+	char *effect_file = obs_find_plugin_file("text-freetype2/text.effect");
+	char *error_string = NULL;
+
+	ts->source = source;
+	pthread_mutex_init(&ts->mutex, NULL);
+
+	gs_entercontext(obs_graphics());
+	if (effect_file)
+		ts->effect = gs_create_effect_from_file(effect_file,
+				&error_string);
+	gs_leavecontext();
+
+	bfree(effect_file);
+
+	if (!ts->effect) {
+		blog(LOG_ERROR, "text-freetype2: Failed to create text "
+		                "effect: %s",
+		                error_string ? error_string : "file not found");
+		bfree(error_string);
+		text_destroy(ts);
+		return NULL;
+	}
+
+	text_update(ts, settings);
+	return ts;
+}
+
+static uint32_t text_getwidth(void *data)
+{
+	struct text_source *ts = data;
+	return ts->cx;
+}
+
+static uint32_t text_getheight(void *data)
+{
+	struct text_source *ts = data;
+	return ts->cy;
+}
+
+static struct obs_source_info text_freetype2_info = {
+	.id           = "text_ft2_source",
+	.type         = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW |
+	                OBS_SOURCE_STATIC_VIDEO | OBS_SOURCE_THREADED_TICK,
+	.getname      = text_getname,
+	.create       = text_create,
+	.destroy      = text_destroy,
+	.update       = text_update,
+	.getwidth     = text_getwidth,
+	.getheight    = text_getheight,
+	.defaults     = text_defaults,
+	.properties   = text_properties,
+	.video_tick   = text_tick,
+	.video_render = text_render
+};
+
+bool obs_module_load(uint32_t libobs_ver)
+{
+	if (!glyph_atlas_init())
+		return false;
+
+	obs_register_source(&text_freetype2_info);
+
+	UNUSED_PARAMETER(libobs_ver);
+	return true;
+}
+
+void obs_module_unload(void)
+{
+	glyph_atlas_free();
+}
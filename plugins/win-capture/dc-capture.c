@@ -1,3 +1,4 @@
+#include <util/platform.h>
 #include "dc-capture.h"
 
 #define WIN32_MEAN_AND_LEAN
@@ -24,7 +25,41 @@ static inline void init_textures(struct dc_capture *capture)
 	capture->valid = true;
 }
 
-void dc_capture_init(struct dc_capture *capture, int x, int y,
+static bool init_buffer(struct dc_capture_buffer *buf,
+		uint32_t width, uint32_t height)
+{
+	BITMAPINFO bi = {0};
+	BITMAPINFOHEADER *bih = &bi.bmiHeader;
+	bih->biSize     = sizeof(BITMAPINFOHEADER);
+	bih->biBitCount = 32;
+	bih->biWidth    = width;
+	bih->biHeight   = height;
+	bih->biPlanes   = 1;
+
+	buf->hdc = CreateCompatibleDC(NULL);
+	buf->bmp = CreateDIBSection(buf->hdc, &bi, DIB_RGB_COLORS,
+			(void**)&buf->bits, NULL, 0);
+	if (!buf->hdc || !buf->bmp)
+		return false;
+
+	buf->old_bmp = SelectObject(buf->hdc, buf->bmp);
+	return true;
+}
+
+static void free_buffer(struct dc_capture_buffer *buf)
+{
+	if (buf->hdc) {
+		if (buf->old_bmp)
+			SelectObject(buf->hdc, buf->old_bmp);
+		DeleteDC(buf->hdc);
+	}
+	if (buf->bmp)
+		DeleteObject(buf->bmp);
+
+	memset(buf, 0, sizeof(struct dc_capture_buffer));
+}
+
+static void init_capture(struct dc_capture *capture, int x, int y,
 		uint32_t width, uint32_t height, bool cursor,
 		bool compatibility)
 {
@@ -47,34 +82,46 @@ void dc_capture_init(struct dc_capture *capture, int x, int y,
 	init_textures(capture);
 
 	gs_leavecontext();
+}
+
+void dc_capture_init(struct dc_capture *capture, int x, int y,
+		uint32_t width, uint32_t height, bool cursor,
+		bool compatibility)
+{
+	init_capture(capture, x, y, width, height, cursor, compatibility);
 
 	if (!capture->valid)
 		return;
 
-	if (compatibility) {
-		BITMAPINFO bi = {0};
-		BITMAPINFOHEADER *bih = &bi.bmiHeader;
-		bih->biSize     = sizeof(BITMAPINFOHEADER);
-		bih->biBitCount = 32;
-		bih->biWidth    = width;
-		bih->biHeight   = height;
-		bih->biPlanes   = 1;
+	if (capture->compatibility &&
+	    !init_buffer(&capture->dib, width, height)) {
+		blog(LOG_WARNING, "[dc_capture_init] Failed to create DIB "
+		                  "section");
+		capture->valid = false;
+	}
+}
+
+static void stop_capture_thread(struct dc_capture *capture)
+{
+	if (capture->thread_active) {
+		os_event_signal(capture->stop_event);
+		pthread_join(capture->thread, NULL);
+		capture->thread_active = false;
+	}
 
-		capture->hdc = CreateCompatibleDC(NULL);
-		capture->bmp = CreateDIBSection(capture->hdc, &bi,
-				DIB_RGB_COLORS, (void**)&capture->bits,
-				NULL, 0);
-		capture->old_bmp = SelectObject(capture->hdc, capture->bmp);
+	if (capture->async) {
+		pthread_mutex_destroy(&capture->mutex);
+		os_event_destroy(capture->stop_event);
 	}
+
+	for (int i = 0; i < NUM_DC_BUFFERS; i++)
+		free_buffer(&capture->buffers[i]);
 }
 
 void dc_capture_free(struct dc_capture *capture)
 {
-	if (capture->hdc) {
-		SelectObject(capture->hdc, capture->old_bmp);
-		DeleteDC(capture->hdc);
-		DeleteObject(capture->bmp);
-	}
+	stop_capture_thread(capture);
+	free_buffer(&capture->dib);
 
 	gs_entercontext(obs_graphics());
 
@@ -113,13 +160,179 @@ static void draw_cursor(struct dc_capture *capture, HDC hdc)
 	DestroyIcon(icon);
 }
 
+/* copies the window (or the screen if window is NULL) to the given DC */
+static void blit_window(struct dc_capture *capture, HDC hdc, HWND window)
+{
+	HDC hdc_target;
+
+	if (capture->capture_cursor) {
+		memset(&capture->ci, 0, sizeof(CURSORINFO));
+		capture->ci.cbSize = sizeof(CURSORINFO);
+		capture->cursor_captured = GetCursorInfo(&capture->ci);
+	}
+
+	hdc_target = GetDC(window);
+
+	BitBlt(hdc, 0, 0, capture->width, capture->height,
+			hdc_target, capture->x, capture->y, SRCCOPY);
+
+	ReleaseDC(window, hdc_target);
+
+	if (capture->cursor_captured)
+		draw_cursor(capture, hdc);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* the buffer being uploaded and the newest finished one are never written
+ * to, with three buffers there is always one left for the thread */
+static int get_write_buffer(struct dc_capture *capture)
+{
+	int buffer = 0;
+
+	pthread_mutex_lock(&capture->mutex);
+	while (buffer == capture->latest || buffer == capture->uploading)
+		buffer++;
+	pthread_mutex_unlock(&capture->mutex);
+
+	return buffer;
+}
+
+/* windows that haven't repainted produce the same image, those frames are
+ * not uploaded again */
+static bool buffer_changed(struct dc_capture *capture, int buffer)
+{
+	size_t size = capture->width * capture->height * 4;
+
+	if (capture->latest == -1)
+		return true;
+
+	return memcmp(capture->buffers[buffer].bits,
+			capture->buffers[capture->latest].bits, size) != 0;
+}
+
+static void capture_buffer(struct dc_capture *capture)
+{
+	int buffer = get_write_buffer(capture);
+
+	blit_window(capture, capture->buffers[buffer].hdc, capture->window);
+	GdiFlush();
+
+	/* only this thread changes latest, so it can be read without
+	 * locking here */
+	if (buffer_changed(capture, buffer)) {
+		pthread_mutex_lock(&capture->mutex);
+		capture->latest    = buffer;
+		capture->new_frame = true;
+		pthread_mutex_unlock(&capture->mutex);
+	}
+}
+
+static void *capture_thread(void *param)
+{
+	struct dc_capture *capture = param;
+	uint64_t next_time = os_gettime_ns();
+
+	os_thread_init(OS_THREAD_CLASS_VIDEO, "dc capture");
+
+	while (os_event_try(capture->stop_event) == EAGAIN) {
+		/* minimized windows have nothing to copy */
+		if (!capture->window || !IsIconic(capture->window))
+			capture_buffer(capture);
+
+		/* don't try to catch up if the blit took too long */
+		next_time += capture->interval;
+		if (!os_sleepto_ns(next_time))
+			next_time = os_gettime_ns();
+	}
+
+	return NULL;
+}
+
+void dc_capture_init_async(struct dc_capture *capture, HWND window,
+		int x, int y, uint32_t width, uint32_t height, bool cursor)
+{
+	struct obs_video_info ovi;
+
+	/* buffers are uploaded from memory, so gdi textures aren't used */
+	init_capture(capture, x, y, width, height, cursor, true);
+
+	if (!capture->valid)
+		return;
+
+	capture->valid = false;
+
+	for (int i = 0; i < NUM_DC_BUFFERS; i++) {
+		if (!init_buffer(&capture->buffers[i], width, height)) {
+			blog(LOG_WARNING, "[dc_capture_init_async] Failed "
+			                  "to create DIB sections");
+			return;
+		}
+	}
+
+	if (pthread_mutex_init(&capture->mutex, NULL) != 0)
+		return;
+	if (os_event_init(&capture->stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
+		pthread_mutex_destroy(&capture->mutex);
+		return;
+	}
+
+	capture->async     = true;
+	capture->window    = window;
+	capture->latest    = -1;
+	capture->uploading = -1;
+
+	/* pace the blits to the output frame rate */
+	if (obs_get_video_info(&ovi) && ovi.fps_num)
+		capture->interval = 1000000000ULL * ovi.fps_den / ovi.fps_num;
+	else
+		capture->interval = 1000000000ULL / 60;
+
+	if (pthread_create(&capture->thread, NULL, capture_thread,
+				capture) != 0) {
+		blog(LOG_WARNING, "[dc_capture_init_async] Failed to "
+		                  "create capture thread");
+		return;
+	}
+
+	capture->thread_active = true;
+	capture->valid         = true;
+}
+
+static void dc_capture_upload_async(struct dc_capture *capture)
+{
+	int buffer = -1;
+
+	pthread_mutex_lock(&capture->mutex);
+	if (capture->new_frame) {
+		buffer = capture->latest;
+		capture->uploading = buffer;
+		capture->new_frame = false;
+	}
+	pthread_mutex_unlock(&capture->mutex);
+
+	if (buffer == -1)
+		return;
+
+	texture_setimage(capture->textures[0], capture->buffers[buffer].bits,
+			capture->width*4, false);
+
+	pthread_mutex_lock(&capture->mutex);
+	capture->uploading = -1;
+	pthread_mutex_unlock(&capture->mutex);
+
+	capture->textures_written[0] = true;
+}
+
+/* ------------------------------------------------------------------------- */
+
 static inline HDC dc_capture_get_dc(struct dc_capture *capture)
 {
 	if (!capture->valid)
 		return NULL;
 
 	if (capture->compatibility)
-		return capture->hdc;
+		return capture->dib.hdc;
 	else
 		return texture_get_dc(capture->textures[capture->cur_tex]);
 }
@@ -128,7 +341,7 @@ static inline void dc_capture_release_dc(struct dc_capture *capture)
 {
 	if (capture->compatibility) {
 		texture_setimage(capture->textures[capture->cur_tex],
-				capture->bits, capture->width*4, false);
+				capture->dib.bits, capture->width*4, false);
 	} else {
 		texture_release_dc(capture->textures[capture->cur_tex]);
 	}
@@ -136,13 +349,12 @@ static inline void dc_capture_release_dc(struct dc_capture *capture)
 
 void dc_capture_capture(struct dc_capture *capture, HWND window)
 {
-	HDC hdc_target;
 	HDC hdc;
 
-	if (capture->capture_cursor) {
-		memset(&capture->ci, 0, sizeof(CURSORINFO));
-		capture->ci.cbSize = sizeof(CURSORINFO);
-		capture->cursor_captured = GetCursorInfo(&capture->ci);
+	if (capture->async) {
+		if (capture->valid)
+			dc_capture_upload_async(capture);
+		return;
 	}
 
 	if (++capture->cur_tex == capture->num_textures)
@@ -155,15 +367,7 @@ void dc_capture_capture(struct dc_capture *capture, HWND window)
 		return;
 	}
 
-	hdc_target = GetDC(window);
-
-	BitBlt(hdc, 0, 0, capture->width, capture->height,
-			hdc_target, capture->x, capture->y, SRCCOPY);
-
-	ReleaseDC(NULL, hdc_target);
-
-	if (capture->cursor_captured)
-		draw_cursor(capture, hdc);
+	blit_window(capture, hdc, window);
 
 	dc_capture_release_dc(capture);
 
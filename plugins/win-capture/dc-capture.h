@@ -4,8 +4,16 @@
 #include <windows.h>
 
 #include <obs.h>
+#include <util/threading.h>
 
 #define NUM_TEXTURES 2
+#define NUM_DC_BUFFERS 3
+
+struct dc_capture_buffer {
+	HDC        hdc;
+	HBITMAP    bmp, old_bmp;
+	BYTE       *bits;
+};
 
 struct dc_capture {
 	int        cur_tex;
@@ -17,20 +25,34 @@ struct dc_capture {
 	int        num_textures;
 
 	bool       compatibility;
-	HDC        hdc;
-	HBITMAP    bmp, old_bmp;
-	BYTE       *bits;
+	struct dc_capture_buffer dib;
 
 	bool       capture_cursor;
 	bool       cursor_captured;
 	CURSORINFO ci;
 
+	/* async mode: a thread blits into a ring of DIB sections, and the
+	 * video thread only uploads the newest one that changed */
+	bool       async;
+	HWND       window;
+	struct dc_capture_buffer buffers[NUM_DC_BUFFERS];
+	int        latest;
+	int        uploading;
+	bool       new_frame;
+	uint64_t   interval;
+	pthread_mutex_t mutex;
+	os_event_t stop_event;
+	pthread_t  thread;
+	bool       thread_active;
+
 	bool       valid;
 };
 
 extern void dc_capture_init(struct dc_capture *capture, int x, int y,
 		uint32_t width, uint32_t height, bool cursor,
 		bool compatibility);
+extern void dc_capture_init_async(struct dc_capture *capture, HWND window,
+		int x, int y, uint32_t width, uint32_t height, bool cursor);
 extern void dc_capture_free(struct dc_capture *capture);
 
 extern void dc_capture_capture(struct dc_capture *capture, HWND window);
@@ -0,0 +1,608 @@
+#include <stdlib.h>
+#include <dxgiformat.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include "dc-capture.h"
+#include "window-helpers.h"
+#include "graphics-hook-info.h"
+
+/* seconds to wait before looking for the window or hooking again */
+#define HOOK_RETRY_INTERVAL 2.0f
+
+/* milliseconds to wait for the hook to be loaded */
+#define INJECT_TIMEOUT 4000
+
+/*
+ * Captures games by injecting a hook into the game process.  The hook copies
+ * each presented frame to a shared texture, which is opened directly on our
+ * device, or to shared memory if texture sharing isn't possible.
+ */
+struct game_capture {
+	obs_source_t         source;
+
+	char                 *title;
+	char                 *class;
+	char                 *executable;
+	enum window_priority priority;
+	bool                 force_shmem;
+
+	float                retry_time;
+	bool                 reset;
+	HWND                 window;
+	DWORD                process_id;
+	HANDLE               process;
+	bool                 hooked;
+
+	HANDLE               restart_event;
+	HANDLE               stop_event;
+	HANDLE               ready_event;
+	HANDLE               hook_info_map;
+	struct hook_info     *hook_info;
+
+	/* shared memory capture */
+	HANDLE               texture_map;
+	struct shmem_data    *shmem_data;
+	HANDLE               texture_mutexes[2];
+
+	texture_t            texture;
+	uint32_t             cx;
+	uint32_t             cy;
+	uint32_t             pitch;
+	bool                 flip;
+	enum capture_type    type;
+
+	effect_t             opaque_effect;
+};
+
+/* ------------------------------------------------------------------------- */
+
+static inline void do_log(int level, const char *msg, ...)
+{
+	va_list args;
+	struct dstr str = {0};
+
+	va_start(args, msg);
+
+	dstr_copy(&str, "[game-capture]: ");
+	dstr_vcatf(&str, msg, args);
+	blog(level, "%s", str.array);
+	dstr_free(&str);
+
+	va_end(args);
+}
+
+static inline void close_handle(HANDLE *handle)
+{
+	if (*handle) {
+		CloseHandle(*handle);
+		*handle = NULL;
+	}
+}
+
+static void free_capture_data(struct game_capture *gc)
+{
+	if (gc->shmem_data) {
+		UnmapViewOfFile(gc->shmem_data);
+		gc->shmem_data = NULL;
+	}
+
+	close_handle(&gc->texture_map);
+	close_handle(&gc->texture_mutexes[0]);
+	close_handle(&gc->texture_mutexes[1]);
+
+	texture_destroy(gc->texture);
+	gc->texture = NULL;
+}
+
+/* called from within the graphics context */
+static void stop_capture(struct game_capture *gc)
+{
+	if (gc->hooked)
+		SetEvent(gc->stop_event);
+
+	free_capture_data(gc);
+
+	if (gc->hook_info) {
+		UnmapViewOfFile(gc->hook_info);
+		gc->hook_info = NULL;
+	}
+
+	close_handle(&gc->hook_info_map);
+	close_handle(&gc->restart_event);
+	close_handle(&gc->stop_event);
+	close_handle(&gc->ready_event);
+	close_handle(&gc->process);
+
+	gc->window     = NULL;
+	gc->process_id = 0;
+	gc->hooked     = false;
+	gc->retry_time = HOOK_RETRY_INTERVAL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline bool is_64bit_windows(void)
+{
+#ifdef _WIN64
+	return true;
+#else
+	BOOL x86 = false;
+	return IsWow64Process(GetCurrentProcess(), &x86) && x86;
+#endif
+}
+
+static inline bool is_64bit_process(HANDLE process)
+{
+	BOOL x86 = true;
+
+	if (is_64bit_windows())
+		IsWow64Process(process, &x86);
+
+	return is_64bit_windows() && !x86;
+}
+
+static bool inject_library(HANDLE process, const wchar_t *dll)
+{
+	LPTHREAD_START_ROUTINE load_library;
+	size_t  size = (wcslen(dll) + 1) * sizeof(wchar_t);
+	HANDLE  thread = NULL;
+	bool    success = false;
+	bool    finished = false;
+	SIZE_T  written;
+	DWORD   code;
+	void    *mem;
+
+	load_library = (LPTHREAD_START_ROUTINE)GetProcAddress(
+			GetModuleHandleW(L"kernel32"), "LoadLibraryW");
+	if (!load_library)
+		return false;
+
+	mem = VirtualAllocEx(process, NULL, size, MEM_RESERVE | MEM_COMMIT,
+			PAGE_READWRITE);
+	if (!mem)
+		return false;
+
+	if (!WriteProcessMemory(process, mem, dll, size, &written))
+		goto fail;
+
+	thread = CreateRemoteThread(process, NULL, 0, load_library, mem, 0,
+			NULL);
+	if (!thread)
+		goto fail;
+
+	if (WaitForSingleObject(thread, INJECT_TIMEOUT) == WAIT_OBJECT_0) {
+		finished = true;
+		success  = GetExitCodeThread(thread, &code) && code != 0;
+	}
+
+fail:
+	/* the path can't be freed while LoadLibrary might still use it */
+	if (finished || !thread)
+		VirtualFreeEx(process, mem, 0, MEM_RELEASE);
+	if (thread)
+		CloseHandle(thread);
+	return success;
+}
+
+static bool inject_hook(struct game_capture *gc)
+{
+	const char *name = sizeof(void*) == 8 ?
+		"win-capture/graphics-hook64.dll" :
+		"win-capture/graphics-hook32.dll";
+	wchar_t *path_w = NULL;
+	char *path;
+	bool success;
+
+	/* the hook has to be the same architecture as the game */
+	if (is_64bit_process(gc->process) != (sizeof(void*) == 8)) {
+		do_log(LOG_WARNING, "Can't hook a %s bit process from a %s "
+		                    "bit process",
+		                    sizeof(void*) == 8 ? "32" : "64",
+		                    sizeof(void*) == 8 ? "64" : "32");
+		return false;
+	}
+
+	path = obs_find_plugin_file(name);
+	if (!path) {
+		do_log(LOG_ERROR, "Could not find %s", name);
+		return false;
+	}
+
+	os_utf8_to_wcs_ptr(path, 0, &path_w);
+	success = inject_library(gc->process, path_w);
+	if (!success)
+		do_log(LOG_WARNING, "Failed to inject %s", path);
+
+	bfree(path_w);
+	bfree(path);
+	return success;
+}
+
+static HANDLE create_event(struct game_capture *gc, const wchar_t *base)
+{
+	wchar_t name[HOOK_NAME_SIZE];
+
+	hook_name(name, base, gc->process_id);
+	return CreateEventW(NULL, false, false, name);
+}
+
+static bool init_hook_info(struct game_capture *gc, bool *already_hooked)
+{
+	struct obs_video_info ovi;
+	wchar_t name[HOOK_NAME_SIZE];
+
+	hook_name(name, SHMEM_HOOK_INFO, gc->process_id);
+	gc->hook_info_map = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL,
+			PAGE_READWRITE, 0, sizeof(struct hook_info), name);
+	if (!gc->hook_info_map)
+		return false;
+
+	/* the hook keeps its handles open, so the mapping still exists if
+	 * the game was hooked before */
+	*already_hooked = GetLastError() == ERROR_ALREADY_EXISTS;
+
+	gc->hook_info = MapViewOfFile(gc->hook_info_map, FILE_MAP_ALL_ACCESS,
+			0, 0, sizeof(struct hook_info));
+	if (!gc->hook_info)
+		return false;
+
+	if (obs_get_video_info(&ovi) && ovi.fps_num)
+		gc->hook_info->frame_interval =
+			1000000000ULL * ovi.fps_den / ovi.fps_num;
+	else
+		gc->hook_info->frame_interval = 1000000000ULL / 60;
+
+	gc->hook_info->force_shmem = gc->force_shmem;
+	return true;
+}
+
+static bool start_capture(struct game_capture *gc)
+{
+	bool already_hooked = false;
+
+	GetWindowThreadProcessId(gc->window, &gc->process_id);
+	if (!gc->process_id || gc->process_id == GetCurrentProcessId())
+		return false;
+
+	gc->process = OpenProcess(PROCESS_CREATE_THREAD |
+			PROCESS_QUERY_INFORMATION | PROCESS_VM_OPERATION |
+			PROCESS_VM_WRITE | PROCESS_VM_READ | SYNCHRONIZE,
+			false, gc->process_id);
+	if (!gc->process) {
+		do_log(LOG_WARNING, "Could not open process %lu (%lu), the "
+		                    "game may need to run with the same "
+		                    "privileges", gc->process_id,
+		                    GetLastError());
+		return false;
+	}
+
+	gc->restart_event = create_event(gc, EVENT_CAPTURE_RESTART);
+	gc->stop_event    = create_event(gc, EVENT_CAPTURE_STOP);
+	gc->ready_event   = create_event(gc, EVENT_HOOK_READY);
+	if (!gc->restart_event || !gc->stop_event || !gc->ready_event) {
+		do_log(LOG_WARNING, "Failed to create hook events (%lu)",
+				GetLastError());
+		return false;
+	}
+
+	if (!init_hook_info(gc, &already_hooked)) {
+		do_log(LOG_WARNING, "Failed to create hook info (%lu)",
+				GetLastError());
+		return false;
+	}
+
+	if (!already_hooked && !inject_hook(gc))
+		return false;
+
+	/* clear anything left over from an earlier capture of the game */
+	ResetEvent(gc->stop_event);
+	ResetEvent(gc->ready_event);
+	SetEvent(gc->restart_event);
+	gc->hooked = true;
+
+	do_log(LOG_INFO, "Hooked process %lu", gc->process_id);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline enum gs_color_format convert_format(uint32_t format)
+{
+	switch (format) {
+	case DXGI_FORMAT_R8G8B8A8_UNORM:    return GS_RGBA;
+	case DXGI_FORMAT_B8G8R8X8_UNORM:    return GS_BGRX;
+	case DXGI_FORMAT_B8G8R8A8_UNORM:    return GS_BGRA;
+	case DXGI_FORMAT_R10G10B10A2_UNORM: return GS_R10G10B10A2;
+	}
+
+	return GS_UNKNOWN;
+}
+
+static HANDLE open_mutex(struct game_capture *gc, const wchar_t *base)
+{
+	wchar_t name[HOOK_NAME_SIZE];
+
+	hook_name(name, base, gc->process_id);
+	return OpenMutexW(SYNCHRONIZE, false, name);
+}
+
+static bool init_shmem_capture(struct game_capture *gc)
+{
+	enum gs_color_format format = convert_format(gc->hook_info->format);
+	wchar_t name[HOOK_NAME_SIZE];
+
+	if (format == GS_UNKNOWN) {
+		do_log(LOG_WARNING, "Unsupported frame format %u",
+				gc->hook_info->format);
+		return false;
+	}
+
+	gc->texture_mutexes[0] = open_mutex(gc, MUTEX_TEXTURE1);
+	gc->texture_mutexes[1] = open_mutex(gc, MUTEX_TEXTURE2);
+	if (!gc->texture_mutexes[0] || !gc->texture_mutexes[1])
+		return false;
+
+	hook_name_map(name, gc->process_id, gc->hook_info->map_id);
+	gc->texture_map = OpenFileMappingW(FILE_MAP_READ, false, name);
+	if (!gc->texture_map)
+		return false;
+
+	gc->shmem_data = MapViewOfFile(gc->texture_map, FILE_MAP_READ, 0, 0,
+			gc->hook_info->map_size);
+	if (!gc->shmem_data)
+		return false;
+
+	gc->texture = gs_create_texture(gc->cx, gc->cy, format, 1, NULL,
+			GS_DYNAMIC);
+	return gc->texture != NULL;
+}
+
+static void init_capture_data(struct game_capture *gc)
+{
+	bool success;
+
+	free_capture_data(gc);
+
+	gc->type  = (enum capture_type)gc->hook_info->type;
+	gc->cx    = gc->hook_info->cx;
+	gc->cy    = gc->hook_info->cy;
+	gc->pitch = gc->hook_info->pitch;
+	gc->flip  = gc->hook_info->flip != 0;
+
+	if (gc->type == CAPTURE_TYPE_TEXTURE) {
+		gc->texture = gs_texture_open_shared(
+				gc->hook_info->shared_handle);
+		success = gc->texture != NULL;
+	} else {
+		success = init_shmem_capture(gc);
+	}
+
+	if (success) {
+		do_log(LOG_INFO, "Capturing %ux%u with %s", gc->cx, gc->cy,
+				gc->type == CAPTURE_TYPE_TEXTURE ?
+				"a shared texture" : "shared memory");
+	} else {
+		do_log(LOG_WARNING, "Failed to open the hook's frames");
+		free_capture_data(gc);
+	}
+}
+
+/* copies the newest frame that the hook isn't writing to */
+static void copy_shmem_frame(struct game_capture *gc)
+{
+	int      idx = gc->shmem_data->last_tex;
+	uint32_t offset;
+
+	if (idx < 0 || idx > 1)
+		return;
+
+	if (WaitForSingleObject(gc->texture_mutexes[idx], 0) != WAIT_OBJECT_0)
+		return;
+
+	offset = idx == 0 ?
+		gc->shmem_data->tex1_offset : gc->shmem_data->tex2_offset;
+	texture_setimage(gc->texture, (uint8_t*)gc->shmem_data + offset,
+			gc->pitch, false);
+
+	ReleaseMutex(gc->texture_mutexes[idx]);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void update_settings(struct game_capture *gc, obs_data_t settings)
+{
+	const char *window = obs_data_getstring(settings, "window");
+
+	bfree(gc->title);
+	bfree(gc->class);
+	bfree(gc->executable);
+
+	build_window_strings(window, &gc->class, &gc->title,
+			&gc->executable);
+
+	gc->priority = (enum window_priority)obs_data_getint(settings,
+			"priority");
+	gc->force_shmem = obs_data_getbool(settings, "force_shmem");
+}
+
+static const char *game_capture_getname(const char *locale)
+{
+	/* TODO: locale */
+	UNUSED_PARAMETER(locale);
+	return "Game Capture";
+}
+
+static void game_capture_destroy(void *data)
+{
+	struct game_capture *gc = data;
+
+	if (!gc)
+		return;
+
+	gs_entercontext(obs_graphics());
+	stop_capture(gc);
+	effect_destroy(gc->opaque_effect);
+	gs_leavecontext();
+
+	bfree(gc->title);
+	bfree(gc->class);
+	bfree(gc->executable);
+	bfree(gc);
+}
+
+static void game_capture_update(void *data, obs_data_t settings)
+{
+	struct game_capture *gc = data;
+
+	update_settings(gc, settings);
+
+	/* forces the window to be found again on the next tick */
+	gc->reset = true;
+}
+
+static void *game_capture_create(obs_data_t settings, obs_source_t source)
+{
+	struct game_capture *gc;
+	effect_t opaque_effect = create_opaque_effect();
+
+	if (!opaque_effect)
+		return NULL;
+
+	gc = bzalloc(sizeof(struct game_capture));
+	gc->source        = source;
+	gc->opaque_effect = opaque_effect;
+
+	update_settings(gc, settings);
+	return gc;
+}
+
+static void game_capture_tick(void *data, float seconds)
+{
+	struct game_capture *gc = data;
+
+	if (gc->reset) {
+		gs_entercontext(obs_graphics());
+		stop_capture(gc);
+		gs_leavecontext();
+
+		gc->reset      = false;
+		gc->retry_time = 0.0f;
+	}
+
+	if (!gc->hooked) {
+		gc->retry_time -= seconds;
+		if (gc->retry_time > 0.0f || (!gc->title && !gc->class))
+			return;
+
+		gc->window = find_window(gc->priority, gc->class, gc->title,
+				gc->executable);
+
+		gs_entercontext(obs_graphics());
+		if (!gc->window || !start_capture(gc))
+			stop_capture(gc);
+		gs_leavecontext();
+		return;
+	}
+
+	gs_entercontext(obs_graphics());
+
+	if (WaitForSingleObject(gc->process, 0) == WAIT_OBJECT_0) {
+		do_log(LOG_INFO, "Process %lu exited", gc->process_id);
+		stop_capture(gc);
+
+	} else {
+		/* signaled for the first frame and whenever the hook had to
+		 * recreate its capture, for example after a resize */
+		if (WaitForSingleObject(gc->ready_event, 0) == WAIT_OBJECT_0)
+			init_capture_data(gc);
+
+		if (gc->texture && gc->type == CAPTURE_TYPE_MEMORY)
+			copy_shmem_frame(gc);
+	}
+
+	gs_leavecontext();
+}
+
+static void game_capture_render(void *data, effect_t effect)
+{
+	struct game_capture *gc = data;
+	technique_t tech;
+	eparam_t    image;
+	size_t      passes;
+
+	if (!gc->texture)
+		return;
+
+	tech  = effect_gettechnique(gc->opaque_effect, "Draw");
+	image = effect_getparambyname(gc->opaque_effect, "image");
+
+	effect_settexture(gc->opaque_effect, image, gc->texture);
+
+	passes = technique_begin(tech);
+	for (size_t i = 0; i < passes; i++) {
+		if (technique_beginpass(tech, i)) {
+			gs_draw_sprite(gc->texture, gc->flip ? GS_FLIP_V : 0,
+					0, 0);
+			technique_endpass(tech);
+		}
+	}
+	technique_end(tech);
+
+	UNUSED_PARAMETER(effect);
+}
+
+static uint32_t game_capture_width(void *data)
+{
+	struct game_capture *gc = data;
+	return gc->texture ? gc->cx : 0;
+}
+
+static uint32_t game_capture_height(void *data)
+{
+	struct game_capture *gc = data;
+	return gc->texture ? gc->cy : 0;
+}
+
+static void game_capture_defaults(obs_data_t defaults)
+{
+	obs_data_set_default_int(defaults, "priority", WINDOW_PRIORITY_EXE);
+	obs_data_set_default_bool(defaults, "force_shmem", false);
+}
+
+static obs_properties_t game_capture_properties(const char *locale)
+{
+	obs_properties_t ppts = obs_properties_create(locale);
+	obs_property_t p;
+
+	/* TODO: locale */
+	obs_properties_add_async_list(ppts, "window", "Window",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING,
+			"window_list", fill_window_list);
+
+	p = obs_properties_add_list(ppts, "priority", "Window Match Priority",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(p, "Window Title", WINDOW_PRIORITY_TITLE);
+	obs_property_list_add_int(p, "Window Class", WINDOW_PRIORITY_CLASS);
+	obs_property_list_add_int(p, "Executable",   WINDOW_PRIORITY_EXE);
+
+	obs_properties_add_bool(ppts, "force_shmem",
+			"Use Shared Memory Instead of Shared Textures");
+
+	return ppts;
+}
+
+struct obs_source_info game_capture_info = {
+	.id           = "game_capture",
+	.type         = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW,
+	.getname      = game_capture_getname,
+	.create       = game_capture_create,
+	.destroy      = game_capture_destroy,
+	.update       = game_capture_update,
+	.getwidth     = game_capture_width,
+	.getheight    = game_capture_height,
+	.defaults     = game_capture_defaults,
+	.properties   = game_capture_properties,
+	.video_render = game_capture_render,
+	.video_tick   = game_capture_tick
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Shared between the game capture source and the graphics hook.  Every name
+ * is followed by the process id of the hooked process, so multiple games can
+ * be captured at the same time.
+ *
+ * The source creates the events and the hook info mapping before injecting
+ * the hook.  The hook signals EVENT_HOOK_READY once it has filled in the hook
+ * info and shared the first frame, and recreates its capture whenever
+ * EVENT_CAPTURE_RESTART is signaled.
+ */
+
+#define EVENT_CAPTURE_RESTART L"CaptureHook_Restart"
+#define EVENT_CAPTURE_STOP    L"CaptureHook_Stop"
+#define EVENT_HOOK_READY      L"CaptureHook_HookReady"
+
+#define SHMEM_HOOK_INFO       L"CaptureHook_HookInfo"
+#define SHMEM_TEXTURE         L"CaptureHook_Texture"
+
+#define MUTEX_TEXTURE1        L"CaptureHook_TextureMutex1"
+#define MUTEX_TEXTURE2        L"CaptureHook_TextureMutex2"
+
+#define HOOK_NAME_SIZE        64
+
+enum capture_type {
+	/* the frame is copied to a D3D11 texture shared between devices */
+	CAPTURE_TYPE_TEXTURE,
+
+	/* frames are copied to a ring of two frames in shared memory */
+	CAPTURE_TYPE_MEMORY
+};
+
+#pragma pack(push, 8)
+
+struct shmem_data {
+	volatile int last_tex;
+	uint32_t     tex1_offset;
+	uint32_t     tex2_offset;
+};
+
+struct hook_info {
+	/* set by the hook */
+	uint32_t     type;
+	uint32_t     window;
+	uint32_t     format; /* DXGI_FORMAT */
+	uint32_t     cx;
+	uint32_t     cy;
+	uint32_t     pitch;
+	uint32_t     flip;
+
+	/* CAPTURE_TYPE_TEXTURE */
+	uint32_t     shared_handle;
+
+	/* CAPTURE_TYPE_MEMORY, the id changes with every new mapping */
+	uint32_t     map_id;
+	uint32_t     map_size;
+
+	/* set by the source */
+	uint64_t     frame_interval;
+	uint32_t     force_shmem;
+};
+
+#pragma pack(pop)
+
+static inline void hook_name(wchar_t *name, const wchar_t *base,
+		unsigned long id)
+{
+	_snwprintf(name, HOOK_NAME_SIZE, L"%s%lu", base, id);
+	name[HOOK_NAME_SIZE - 1] = 0;
+}
+
+static inline void hook_name_map(wchar_t *name, unsigned long id,
+		uint32_t map_id)
+{
+	_snwprintf(name, HOOK_NAME_SIZE, L"%s%lu_%u", SHMEM_TEXTURE, id,
+			map_id);
+	name[HOOK_NAME_SIZE - 1] = 0;
+}
@@ -0,0 +1,388 @@
+#include <d3d11.h>
+#include <dxgi.h>
+
+#include "graphics-hook.h"
+#include "funchook.h"
+
+typedef HRESULT (STDMETHODCALLTYPE *present_t)(IDXGISwapChain*, UINT, UINT);
+typedef HRESULT (STDMETHODCALLTYPE *resize_buffers_t)(IDXGISwapChain*, UINT,
+		UINT, UINT, DXGI_FORMAT, UINT);
+
+#define PRESENT_VTABLE_INDEX        8
+#define RESIZE_BUFFERS_VTABLE_INDEX 13
+
+static struct func_hook present;
+static struct func_hook resize_buffers;
+
+struct d3d11_data {
+	ID3D11Device        *device;
+	ID3D11DeviceContext *context;
+	IDXGISwapChain      *swap;
+
+	uint32_t            cx;
+	uint32_t            cy;
+	DXGI_FORMAT         format;
+	bool                multisampled;
+	bool                using_shtex;
+
+	/* shared texture capture */
+	ID3D11Texture2D     *texture;
+
+	/* shared memory capture, frames are read back one frame late so the
+	 * map doesn't stall the game */
+	ID3D11Texture2D     *resolve_texture;
+	ID3D11Texture2D     *copy_surfaces[2];
+	bool                texture_ready[2];
+	int                 cur_tex;
+};
+
+static struct d3d11_data data = {};
+
+template<typename T> static inline void safe_release(T *&obj)
+{
+	if (obj) {
+		obj->Release();
+		obj = nullptr;
+	}
+}
+
+static void d3d11_free(void)
+{
+	for (size_t i = 0; i < 2; i++)
+		safe_release(data.copy_surfaces[i]);
+
+	safe_release(data.resolve_texture);
+	safe_release(data.texture);
+	safe_release(data.context);
+	safe_release(data.device);
+
+	capture_free();
+	memset(&data, 0, sizeof(data));
+
+	hlog("D3D11 capture freed");
+}
+
+/* the copy targets can't be sRGB, copying between formats of the same
+ * group is allowed */
+static inline DXGI_FORMAT strip_srgb(DXGI_FORMAT format)
+{
+	switch ((unsigned long)format) {
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB: return DXGI_FORMAT_B8G8R8A8_UNORM;
+	case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB: return DXGI_FORMAT_B8G8R8X8_UNORM;
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB: return DXGI_FORMAT_R8G8B8A8_UNORM;
+	}
+
+	return format;
+}
+
+static ID3D11Texture2D *create_texture(UINT bind, UINT misc, bool staging)
+{
+	D3D11_TEXTURE2D_DESC desc = {};
+	ID3D11Texture2D *texture;
+	HRESULT hr;
+
+	desc.Width            = data.cx;
+	desc.Height           = data.cy;
+	desc.MipLevels        = 1;
+	desc.ArraySize        = 1;
+	desc.Format           = data.format;
+	desc.SampleDesc.Count = 1;
+	desc.BindFlags        = bind;
+	desc.MiscFlags        = misc;
+	desc.Usage            = staging ? D3D11_USAGE_STAGING :
+	                                  D3D11_USAGE_DEFAULT;
+	desc.CPUAccessFlags   = staging ? D3D11_CPU_ACCESS_READ : 0;
+
+	hr = data.device->CreateTexture2D(&desc, nullptr, &texture);
+	if (FAILED(hr)) {
+		hlog_hr("d3d11: Failed to create texture", hr);
+		return nullptr;
+	}
+
+	return texture;
+}
+
+static bool d3d11_shtex_init(HWND window)
+{
+	IDXGIResource *resource;
+	HANDLE handle;
+	HRESULT hr;
+
+	data.texture = create_texture(D3D11_BIND_RENDER_TARGET |
+			D3D11_BIND_SHADER_RESOURCE,
+			D3D11_RESOURCE_MISC_SHARED, false);
+	if (!data.texture)
+		return false;
+
+	hr = data.texture->QueryInterface(__uuidof(IDXGIResource),
+			(void**)&resource);
+	if (FAILED(hr)) {
+		hlog_hr("d3d11: Failed to query IDXGIResource", hr);
+		return false;
+	}
+
+	hr = resource->GetSharedHandle(&handle);
+	resource->Release();
+	if (FAILED(hr)) {
+		hlog_hr("d3d11: Failed to get shared handle", hr);
+		return false;
+	}
+
+	data.using_shtex = true;
+	return shtex_init(window, data.cx, data.cy, data.format, false,
+			(uintptr_t)handle);
+}
+
+static bool d3d11_shmem_init(HWND window)
+{
+	D3D11_MAPPED_SUBRESOURCE map;
+	HRESULT hr;
+
+	for (size_t i = 0; i < 2; i++) {
+		data.copy_surfaces[i] = create_texture(0, 0, true);
+		if (!data.copy_surfaces[i])
+			return false;
+	}
+
+	if (data.multisampled) {
+		data.resolve_texture = create_texture(0, 0, false);
+		if (!data.resolve_texture)
+			return false;
+	}
+
+	/* the pitch is only known after mapping */
+	hr = data.context->Map(data.copy_surfaces[0], 0, D3D11_MAP_READ, 0,
+			&map);
+	if (FAILED(hr)) {
+		hlog_hr("d3d11: Failed to map copy surface", hr);
+		return false;
+	}
+	data.context->Unmap(data.copy_surfaces[0], 0);
+
+	data.using_shtex = false;
+	return shmem_init(window, data.cx, data.cy, map.RowPitch, data.format,
+			false);
+}
+
+static void d3d11_init(IDXGISwapChain *swap)
+{
+	DXGI_SWAP_CHAIN_DESC desc;
+	bool success;
+	HRESULT hr;
+
+	/* D3D10 swap chains are presented through the same function, leave
+	 * the capture to the next swap chain or context */
+	hr = swap->GetDevice(__uuidof(ID3D11Device), (void**)&data.device);
+	if (FAILED(hr)) {
+		capture_request_restart();
+		return;
+	}
+
+	hr = swap->GetDesc(&desc);
+	if (FAILED(hr)) {
+		hlog_hr("d3d11: Failed to get swap chain description", hr);
+		d3d11_free();
+		return;
+	}
+
+	data.device->GetImmediateContext(&data.context);
+
+	data.swap         = swap;
+	data.cx           = desc.BufferDesc.Width;
+	data.cy           = desc.BufferDesc.Height;
+	data.format       = strip_srgb(desc.BufferDesc.Format);
+	data.multisampled = desc.SampleDesc.Count > 1;
+
+	success = global_hook_info->force_shmem ?
+		d3d11_shmem_init(desc.OutputWindow) :
+		d3d11_shtex_init(desc.OutputWindow);
+
+	/* shared textures don't work on every setup */
+	if (!success && !global_hook_info->force_shmem) {
+		safe_release(data.texture);
+		success = d3d11_shmem_init(desc.OutputWindow);
+	}
+
+	if (!success)
+		d3d11_free();
+}
+
+static inline void copy_backbuffer(ID3D11Resource *dst,
+		ID3D11Resource *backbuffer)
+{
+	if (data.multisampled)
+		data.context->ResolveSubresource(dst, 0, backbuffer, 0,
+				data.format);
+	else
+		data.context->CopyResource(dst, backbuffer);
+}
+
+static void d3d11_shmem_capture(ID3D11Resource *backbuffer)
+{
+	D3D11_MAPPED_SUBRESOURCE map;
+	int next_tex = data.cur_tex == 0 ? 1 : 0;
+	HRESULT hr;
+
+	if (data.multisampled) {
+		copy_backbuffer(data.resolve_texture, backbuffer);
+		data.context->CopyResource(data.copy_surfaces[data.cur_tex],
+				data.resolve_texture);
+	} else {
+		data.context->CopyResource(data.copy_surfaces[data.cur_tex],
+				backbuffer);
+	}
+	data.texture_ready[data.cur_tex] = true;
+
+	if (data.texture_ready[next_tex]) {
+		hr = data.context->Map(data.copy_surfaces[next_tex], 0,
+				D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT,
+				&map);
+		if (SUCCEEDED(hr)) {
+			shmem_copy_data(map.pData);
+			data.context->Unmap(data.copy_surfaces[next_tex], 0);
+			data.texture_ready[next_tex] = false;
+		}
+	}
+
+	data.cur_tex = next_tex;
+}
+
+static void d3d11_capture(IDXGISwapChain *swap)
+{
+	ID3D11Resource *backbuffer;
+	HRESULT hr;
+
+	/* only stop the capture if this swap chain owns it */
+	if (data.swap && capture_should_stop())
+		d3d11_free();
+	if (capture_should_init())
+		d3d11_init(swap);
+	if (swap != data.swap || !capture_ready())
+		return;
+
+	hr = swap->GetBuffer(0, __uuidof(ID3D11Resource),
+			(void**)&backbuffer);
+	if (FAILED(hr))
+		return;
+
+	if (data.using_shtex)
+		copy_backbuffer(data.texture, backbuffer);
+	else
+		d3d11_shmem_capture(backbuffer);
+
+	backbuffer->Release();
+}
+
+static HRESULT STDMETHODCALLTYPE hook_present(IDXGISwapChain *swap,
+		UINT sync_interval, UINT flags)
+{
+	HRESULT hr;
+
+	/* test presents don't show anything */
+	if ((flags & DXGI_PRESENT_TEST) == 0)
+		d3d11_capture(swap);
+
+	unhook(&present);
+	present_t call = (present_t)present.func_addr;
+	hr = call(swap, sync_interval, flags);
+	rehook(&present);
+
+	return hr;
+}
+
+static HRESULT STDMETHODCALLTYPE hook_resize_buffers(IDXGISwapChain *swap,
+		UINT buffer_count, UINT width, UINT height, DXGI_FORMAT format,
+		UINT flags)
+{
+	HRESULT hr;
+
+	/* the copy targets have to match the new buffers */
+	if (swap == data.swap && capture_active()) {
+		d3d11_free();
+		capture_request_restart();
+	}
+
+	unhook(&resize_buffers);
+	resize_buffers_t call = (resize_buffers_t)resize_buffers.func_addr;
+	hr = call(swap, buffer_count, width, height, format, flags);
+	rehook(&resize_buffers);
+
+	return hr;
+}
+
+/* the swap chain functions are found through the vtable of a swap chain
+ * created on a dummy window */
+static bool get_swap_chain_funcs(HMODULE d3d11_module, void **present_addr,
+		void **resize_addr)
+{
+	PFN_D3D11_CREATE_DEVICE_AND_SWAP_CHAIN create;
+	DXGI_SWAP_CHAIN_DESC desc = {};
+	IDXGISwapChain *swap = nullptr;
+	ID3D11Device *device = nullptr;
+	ID3D11DeviceContext *context = nullptr;
+	D3D_FEATURE_LEVEL level;
+	HWND window;
+	HRESULT hr;
+
+	create = (PFN_D3D11_CREATE_DEVICE_AND_SWAP_CHAIN)GetProcAddress(
+			d3d11_module, "D3D11CreateDeviceAndSwapChain");
+	if (!create)
+		return false;
+
+	window = CreateWindowExW(0, L"STATIC", L"graphics-hook dummy",
+			WS_POPUP, 0, 0, 2, 2, nullptr, nullptr,
+			GetModuleHandleW(nullptr), nullptr);
+	if (!window)
+		return false;
+
+	desc.BufferCount       = 2;
+	desc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.BufferDesc.Width  = 2;
+	desc.BufferDesc.Height = 2;
+	desc.BufferUsage       = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+	desc.OutputWindow      = window;
+	desc.SampleDesc.Count  = 1;
+	desc.Windowed          = true;
+
+	hr = create(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, nullptr, 0,
+			D3D11_SDK_VERSION, &desc, &swap, &device, &level,
+			&context);
+	if (SUCCEEDED(hr)) {
+		void **vtable = *(void***)swap;
+		*present_addr = vtable[PRESENT_VTABLE_INDEX];
+		*resize_addr  = vtable[RESIZE_BUFFERS_VTABLE_INDEX];
+
+		swap->Release();
+		device->Release();
+		context->Release();
+	} else {
+		hlog_hr("d3d11: Failed to create dummy swap chain", hr);
+	}
+
+	DestroyWindow(window);
+	return SUCCEEDED(hr);
+}
+
+bool hook_d3d11(void)
+{
+	HMODULE d3d11_module = GetModuleHandleW(L"d3d11.dll");
+	HMODULE dxgi_module  = GetModuleHandleW(L"dxgi.dll");
+	void *present_addr, *resize_addr;
+
+	if (!d3d11_module || !dxgi_module)
+		return false;
+
+	if (!get_swap_chain_funcs(d3d11_module, &present_addr, &resize_addr))
+		return false;
+
+	hook_init(&present, present_addr, (void*)hook_present,
+			"IDXGISwapChain::Present");
+	hook_init(&resize_buffers, resize_addr, (void*)hook_resize_buffers,
+			"IDXGISwapChain::ResizeBuffers");
+
+	rehook(&resize_buffers);
+	rehook(&present);
+
+	hlog("Hooked D3D11");
+	return true;
+}
@@ -0,0 +1,70 @@
+#include <windows.h>
+#include <string.h>
+#include "funchook.h"
+
+#ifdef _WIN64
+/* jmp [rip+0], followed by the absolute address */
+#define JMP_SIZE 14
+#else
+/* jmp rel32 */
+#define JMP_SIZE 5
+#endif
+
+static void patch_code(uintptr_t addr, const void *data, size_t size)
+{
+	DWORD protect;
+
+	VirtualProtect((void*)addr, size, PAGE_EXECUTE_READWRITE, &protect);
+	memcpy((void*)addr, data, size);
+	VirtualProtect((void*)addr, size, protect, &protect);
+
+	FlushInstructionCache(GetCurrentProcess(), (void*)addr, size);
+}
+
+void hook_init(struct func_hook *hook, void *func_addr, void *hook_addr,
+		const char *name)
+{
+	memset(hook, 0, sizeof(*hook));
+
+	hook->func_addr = (uintptr_t)func_addr;
+	hook->hook_addr = (uintptr_t)hook_addr;
+	hook->name      = name;
+
+	memcpy(hook->unhook_data, func_addr, JMP_SIZE);
+}
+
+void rehook(struct func_hook *hook)
+{
+	uint8_t jmp[JMP_SIZE];
+
+	if (!hook->func_addr || hook->hooked)
+		return;
+
+#ifdef _WIN64
+	uint64_t addr = (uint64_t)hook->hook_addr;
+	uint32_t zero = 0;
+
+	jmp[0] = 0xFF;
+	jmp[1] = 0x25;
+	memcpy(&jmp[2], &zero, sizeof(zero));
+	memcpy(&jmp[6], &addr, sizeof(addr));
+#else
+	uint32_t offset = (uint32_t)(hook->hook_addr -
+			(hook->func_addr + JMP_SIZE));
+
+	jmp[0] = 0xE9;
+	memcpy(&jmp[1], &offset, sizeof(offset));
+#endif
+
+	patch_code(hook->func_addr, jmp, JMP_SIZE);
+	hook->hooked = true;
+}
+
+void unhook(struct func_hook *hook)
+{
+	if (!hook->hooked)
+		return;
+
+	patch_code(hook->func_addr, hook->unhook_data, JMP_SIZE);
+	hook->hooked = false;
+}
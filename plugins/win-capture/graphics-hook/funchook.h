@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hooks a function by overwriting its first instructions with a jump to the
+ * hook.  To call the original function, the hook unhooks, calls it, and
+ * rehooks.
+ */
+struct func_hook {
+	uint8_t    unhook_data[14];
+	uintptr_t  func_addr;
+	uintptr_t  hook_addr;
+	bool       hooked;
+	const char *name;
+};
+
+extern void hook_init(struct func_hook *hook, void *func_addr,
+		void *hook_addr, const char *name);
+extern void rehook(struct func_hook *hook);
+extern void unhook(struct func_hook *hook);
+
+#ifdef __cplusplus
+}
+#endif
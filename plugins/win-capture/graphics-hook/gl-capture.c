@@ -0,0 +1,279 @@
+#include <dxgiformat.h>
+
+#include "graphics-hook.h"
+#include "funchook.h"
+
+/*
+ * OpenGL is captured to shared memory only: the back buffer is read into a
+ * pair of pixel buffer objects, and each one is mapped a frame after its
+ * read was started so the game doesn't wait for the transfer.
+ *
+ * The hook can't link to opengl32, so everything is loaded at runtime.
+ */
+
+#define GL_UNSIGNED_BYTE              0x1401
+#define GL_BACK                       0x0405
+#define GL_READ_BUFFER                0x0C02
+#define GL_BGRA                       0x80E1
+#define GL_STREAM_READ                0x88E1
+#define GL_READ_ONLY                  0x88B8
+#define GL_PIXEL_PACK_BUFFER          0x88EB
+#define GL_PIXEL_PACK_BUFFER_BINDING  0x88ED
+#define GL_READ_FRAMEBUFFER           0x8CA8
+#define GL_READ_FRAMEBUFFER_BINDING   0x8CAA
+
+typedef unsigned int  GLenum;
+typedef unsigned int  GLuint;
+typedef int           GLint;
+typedef int           GLsizei;
+typedef unsigned char GLboolean;
+typedef ptrdiff_t     GLsizeiptr;
+
+typedef void (WINAPI *GLREADBUFFERPROC)(GLenum);
+typedef void (WINAPI *GLREADPIXELSPROC)(GLint, GLint, GLsizei, GLsizei,
+		GLenum, GLenum, void*);
+typedef void (WINAPI *GLGETINTEGERVPROC)(GLenum, GLint*);
+typedef void (WINAPI *GLGENBUFFERSPROC)(GLsizei, GLuint*);
+typedef void (WINAPI *GLDELETEBUFFERSPROC)(GLsizei, const GLuint*);
+typedef void (WINAPI *GLBINDBUFFERPROC)(GLenum, GLuint);
+typedef void (WINAPI *GLBUFFERDATAPROC)(GLenum, GLsizeiptr, const void*,
+		GLenum);
+typedef void *(WINAPI *GLMAPBUFFERPROC)(GLenum, GLenum);
+typedef GLboolean (WINAPI *GLUNMAPBUFFERPROC)(GLenum);
+typedef void (WINAPI *GLBINDFRAMEBUFFERPROC)(GLenum, GLuint);
+
+typedef HGLRC (WINAPI *WGLGETCURRENTCONTEXTPROC)(void);
+typedef PROC (WINAPI *WGLGETPROCADDRESSPROC)(LPCSTR);
+
+typedef BOOL (WINAPI *SWAPBUFFERSPROC)(HDC);
+
+static struct func_hook swap_buffers;
+
+static struct {
+	GLREADBUFFERPROC         ReadBuffer;
+	GLREADPIXELSPROC         ReadPixels;
+	GLGETINTEGERVPROC        GetIntegerv;
+	GLGENBUFFERSPROC         GenBuffers;
+	GLDELETEBUFFERSPROC      DeleteBuffers;
+	GLBINDBUFFERPROC         BindBuffer;
+	GLBUFFERDATAPROC         BufferData;
+	GLMAPBUFFERPROC          MapBuffer;
+	GLUNMAPBUFFERPROC        UnmapBuffer;
+	GLBINDFRAMEBUFFERPROC    BindFramebuffer;
+	WGLGETCURRENTCONTEXTPROC GetCurrentContext;
+	WGLGETPROCADDRESSPROC    GetProcAddress;
+} gl;
+
+struct gl_data {
+	HDC      hdc;
+	HGLRC    context;
+	uint32_t cx;
+	uint32_t cy;
+	GLuint   pbos[2];
+	bool     pbo_ready[2];
+	int      cur_pbo;
+};
+
+static struct gl_data data = {0};
+
+static void *get_gl_func(HMODULE module, const char *name)
+{
+	void *func = (void*)GetProcAddress(module, name);
+	if (!func)
+		func = (void*)gl.GetProcAddress(name);
+	return func;
+}
+
+/* buffer objects are extensions in opengl32, and can only be loaded while
+ * a context is current */
+static bool load_gl_funcs(void)
+{
+	HMODULE module = GetModuleHandleW(L"opengl32.dll");
+
+	if (gl.MapBuffer)
+		return true;
+
+	gl.GetProcAddress = (WGLGETPROCADDRESSPROC)GetProcAddress(module,
+			"wglGetProcAddress");
+	if (!gl.GetProcAddress)
+		return false;
+
+	gl.ReadBuffer      = get_gl_func(module, "glReadBuffer");
+	gl.ReadPixels      = get_gl_func(module, "glReadPixels");
+	gl.GetIntegerv     = get_gl_func(module, "glGetIntegerv");
+	gl.GenBuffers      = get_gl_func(module, "glGenBuffers");
+	gl.DeleteBuffers   = get_gl_func(module, "glDeleteBuffers");
+	gl.BindBuffer      = get_gl_func(module, "glBindBuffer");
+	gl.BufferData      = get_gl_func(module, "glBufferData");
+	gl.UnmapBuffer     = get_gl_func(module, "glUnmapBuffer");
+	gl.BindFramebuffer = get_gl_func(module, "glBindFramebuffer");
+	gl.MapBuffer       = get_gl_func(module, "glMapBuffer");
+
+	if (!gl.ReadBuffer || !gl.ReadPixels || !gl.GetIntegerv ||
+	    !gl.GenBuffers || !gl.DeleteBuffers || !gl.BindBuffer ||
+	    !gl.BufferData || !gl.UnmapBuffer || !gl.MapBuffer) {
+		hlog("gl: Pixel buffer objects are not supported");
+		gl.MapBuffer = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+static void gl_free(void)
+{
+	/* the buffers belong to the context, which may already be gone */
+	if (data.pbos[0] && gl.GetCurrentContext() == data.context)
+		gl.DeleteBuffers(2, data.pbos);
+
+	capture_free();
+	memset(&data, 0, sizeof(data));
+
+	hlog("GL capture freed");
+}
+
+static inline bool get_window_size(HWND window, uint32_t *cx, uint32_t *cy)
+{
+	RECT rect;
+
+	if (!window || !GetClientRect(window, &rect))
+		return false;
+
+	*cx = (uint32_t)rect.right;
+	*cy = (uint32_t)rect.bottom;
+	return *cx && *cy;
+}
+
+static void gl_init(HDC hdc)
+{
+	HWND  window = WindowFromDC(hdc);
+	GLint last_pbo;
+
+	if (!load_gl_funcs() || !get_window_size(window, &data.cx, &data.cy)) {
+		capture_request_restart();
+		return;
+	}
+
+	data.hdc     = hdc;
+	data.context = gl.GetCurrentContext();
+
+	gl.GetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &last_pbo);
+	gl.GenBuffers(2, data.pbos);
+
+	for (size_t i = 0; i < 2; i++) {
+		gl.BindBuffer(GL_PIXEL_PACK_BUFFER, data.pbos[i]);
+		gl.BufferData(GL_PIXEL_PACK_BUFFER, data.cx * data.cy * 4,
+				NULL, GL_STREAM_READ);
+	}
+
+	gl.BindBuffer(GL_PIXEL_PACK_BUFFER, (GLuint)last_pbo);
+
+	/* the rows are read bottom to top */
+	if (!shmem_init(window, data.cx, data.cy, data.cx * 4,
+				DXGI_FORMAT_B8G8R8A8_UNORM, true))
+		gl_free();
+}
+
+static void gl_copy_frame(void)
+{
+	int   next_pbo = data.cur_pbo == 0 ? 1 : 0;
+	GLint last_pbo, last_fbo = 0, last_read_buffer;
+
+	/* leave the game's state as it was */
+	gl.GetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &last_pbo);
+	gl.GetIntegerv(GL_READ_BUFFER, &last_read_buffer);
+	if (gl.BindFramebuffer) {
+		gl.GetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &last_fbo);
+		gl.BindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	}
+
+	gl.ReadBuffer(GL_BACK);
+	gl.BindBuffer(GL_PIXEL_PACK_BUFFER, data.pbos[data.cur_pbo]);
+	gl.ReadPixels(0, 0, data.cx, data.cy, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+	data.pbo_ready[data.cur_pbo] = true;
+
+	if (data.pbo_ready[next_pbo]) {
+		void *frame;
+
+		gl.BindBuffer(GL_PIXEL_PACK_BUFFER, data.pbos[next_pbo]);
+		frame = gl.MapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+		if (frame) {
+			shmem_copy_data(frame);
+			gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+
+		data.pbo_ready[next_pbo] = false;
+	}
+
+	gl.BindBuffer(GL_PIXEL_PACK_BUFFER, (GLuint)last_pbo);
+	gl.ReadBuffer((GLenum)last_read_buffer);
+	if (gl.BindFramebuffer)
+		gl.BindFramebuffer(GL_READ_FRAMEBUFFER, (GLuint)last_fbo);
+
+	data.cur_pbo = next_pbo;
+}
+
+static void gl_capture(HDC hdc)
+{
+	uint32_t cx, cy;
+
+	if (!gl.GetCurrentContext())
+		return;
+
+	/* only stop the capture if this context owns it */
+	if (data.hdc && capture_should_stop())
+		gl_free();
+	if (capture_should_init())
+		gl_init(hdc);
+	if (hdc != data.hdc || !capture_ready())
+		return;
+
+	if (!get_window_size(WindowFromDC(hdc), &cx, &cy))
+		return;
+
+	if (cx != data.cx || cy != data.cy) {
+		gl_free();
+		capture_request_restart();
+		return;
+	}
+
+	gl_copy_frame();
+}
+
+static BOOL WINAPI hook_swap_buffers(HDC hdc)
+{
+	SWAPBUFFERSPROC call;
+	BOOL ret;
+
+	gl_capture(hdc);
+
+	unhook(&swap_buffers);
+	call = (SWAPBUFFERSPROC)swap_buffers.func_addr;
+	ret = call(hdc);
+	rehook(&swap_buffers);
+
+	return ret;
+}
+
+bool hook_gl(void)
+{
+	HMODULE gl_module  = GetModuleHandleW(L"opengl32.dll");
+	HMODULE gdi_module = GetModuleHandleW(L"gdi32.dll");
+	void    *swap_addr;
+
+	if (!gl_module || !gdi_module)
+		return false;
+
+	gl.GetCurrentContext = (WGLGETCURRENTCONTEXTPROC)GetProcAddress(
+			gl_module, "wglGetCurrentContext");
+	swap_addr = (void*)GetProcAddress(gdi_module, "SwapBuffers");
+	if (!gl.GetCurrentContext || !swap_addr)
+		return false;
+
+	hook_init(&swap_buffers, swap_addr, (void*)hook_swap_buffers,
+			"SwapBuffers");
+	rehook(&swap_buffers);
+
+	hlog("Hooked GL");
+	return true;
+}
@@ -0,0 +1,321 @@
+#include <stdarg.h>
+#include "graphics-hook.h"
+
+#define HOOK_RETRY_INTERVAL 1000
+
+struct hook_info         *global_hook_info = NULL;
+
+static HANDLE            signal_restart    = NULL;
+static HANDLE            signal_stop       = NULL;
+static HANDLE            signal_ready      = NULL;
+static HANDLE            hook_info_map     = NULL;
+static HANDLE            texture_mutexes[2] = {NULL, NULL};
+
+static HANDLE            shmem_map         = NULL;
+static struct shmem_data *shmem_info       = NULL;
+static uint32_t          shmem_size        = 0;
+
+static DWORD             process_id        = 0;
+static bool              active            = false;
+static bool              restart_pending   = false;
+
+static LARGE_INTEGER     perf_freq;
+static LARGE_INTEGER     last_capture;
+
+void hlog(const char *format, ...)
+{
+	char message[512];
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(message, sizeof(message) - 2, format, args);
+	va_end(args);
+
+	message[sizeof(message) - 3] = 0;
+	strcat(message, "\n");
+
+	OutputDebugStringA("[graphics-hook] ");
+	OutputDebugStringA(message);
+}
+
+void hlog_hr(const char *text, HRESULT hr)
+{
+	hlog("%s (0x%08lX)", text, hr);
+}
+
+static HANDLE open_event(const wchar_t *base)
+{
+	wchar_t name[HOOK_NAME_SIZE];
+	HANDLE  event;
+
+	hook_name(name, base, process_id);
+	event = OpenEventW(EVENT_MODIFY_STATE | SYNCHRONIZE, false, name);
+	if (!event)
+		hlog("Failed to open event %ls (%lu)", name, GetLastError());
+
+	return event;
+}
+
+static HANDLE create_mutex(const wchar_t *base)
+{
+	wchar_t name[HOOK_NAME_SIZE];
+	HANDLE  mutex;
+
+	hook_name(name, base, process_id);
+	mutex = CreateMutexW(NULL, false, name);
+	if (!mutex)
+		hlog("Failed to create mutex %ls (%lu)", name, GetLastError());
+
+	return mutex;
+}
+
+/* the source creates the events and the hook info before injecting */
+static bool init_hook_objects(void)
+{
+	wchar_t name[HOOK_NAME_SIZE];
+
+	signal_restart = open_event(EVENT_CAPTURE_RESTART);
+	signal_stop    = open_event(EVENT_CAPTURE_STOP);
+	signal_ready   = open_event(EVENT_HOOK_READY);
+	if (!signal_restart || !signal_stop || !signal_ready)
+		return false;
+
+	texture_mutexes[0] = create_mutex(MUTEX_TEXTURE1);
+	texture_mutexes[1] = create_mutex(MUTEX_TEXTURE2);
+	if (!texture_mutexes[0] || !texture_mutexes[1])
+		return false;
+
+	hook_name(name, SHMEM_HOOK_INFO, process_id);
+	hook_info_map = OpenFileMappingW(FILE_MAP_ALL_ACCESS, false, name);
+	if (!hook_info_map) {
+		hlog("Failed to open hook info (%lu)", GetLastError());
+		return false;
+	}
+
+	global_hook_info = MapViewOfFile(hook_info_map, FILE_MAP_ALL_ACCESS,
+			0, 0, sizeof(struct hook_info));
+	if (!global_hook_info) {
+		hlog("Failed to map hook info (%lu)", GetLastError());
+		return false;
+	}
+
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool capture_active(void)
+{
+	return active;
+}
+
+bool capture_should_init(void)
+{
+	if (active)
+		return false;
+
+	if (restart_pending) {
+		restart_pending = false;
+		return true;
+	}
+
+	return WaitForSingleObject(signal_restart, 0) == WAIT_OBJECT_0;
+}
+
+bool capture_should_stop(void)
+{
+	return active && WaitForSingleObject(signal_stop, 0) == WAIT_OBJECT_0;
+}
+
+/* limits captures to the frame rate requested by the source */
+bool capture_ready(void)
+{
+	LARGE_INTEGER now;
+	uint64_t      elapsed;
+
+	if (!active)
+		return false;
+
+	QueryPerformanceCounter(&now);
+	elapsed = (uint64_t)(now.QuadPart - last_capture.QuadPart) *
+		1000000000ULL / (uint64_t)perf_freq.QuadPart;
+
+	if (elapsed < global_hook_info->frame_interval)
+		return false;
+
+	last_capture = now;
+	return true;
+}
+
+/* used when the swap chain or window is resized */
+void capture_request_restart(void)
+{
+	restart_pending = true;
+}
+
+void capture_free(void)
+{
+	if (shmem_info) {
+		UnmapViewOfFile(shmem_info);
+		shmem_info = NULL;
+	}
+	if (shmem_map) {
+		CloseHandle(shmem_map);
+		shmem_map = NULL;
+	}
+
+	active = false;
+}
+
+static inline void set_hook_info(enum capture_type type, HWND window,
+		uint32_t cx, uint32_t cy, uint32_t pitch, uint32_t format,
+		bool flip)
+{
+	global_hook_info->type   = type;
+	global_hook_info->window = (uint32_t)(uintptr_t)window;
+	global_hook_info->format = format;
+	global_hook_info->cx     = cx;
+	global_hook_info->cy     = cy;
+	global_hook_info->pitch  = pitch;
+	global_hook_info->flip   = flip;
+}
+
+bool shtex_init(HWND window, uint32_t cx, uint32_t cy, uint32_t format,
+		bool flip, uintptr_t handle)
+{
+	set_hook_info(CAPTURE_TYPE_TEXTURE, window, cx, cy, 0, format, flip);
+	global_hook_info->shared_handle = (uint32_t)handle;
+
+	active = true;
+	last_capture.QuadPart = 0;
+	SetEvent(signal_ready);
+
+	hlog("Capturing with a shared texture (%ux%u)", cx, cy);
+	return true;
+}
+
+static inline uint32_t align_16(uint32_t size)
+{
+	return (size + 15) & ~15;
+}
+
+bool shmem_init(HWND window, uint32_t cx, uint32_t cy, uint32_t pitch,
+		uint32_t format, bool flip)
+{
+	wchar_t  name[HOOK_NAME_SIZE];
+	uint32_t frame_size = align_16(pitch * cy);
+	uint32_t offset     = align_16(sizeof(struct shmem_data));
+	uint32_t map_id     = global_hook_info->map_id + 1;
+
+	shmem_size = offset + frame_size * 2;
+
+	/* every mapping gets a new name, the source might still have the
+	 * previous one open */
+	hook_name_map(name, process_id, map_id);
+	shmem_map = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL,
+			PAGE_READWRITE, 0, shmem_size, name);
+	if (!shmem_map) {
+		hlog("Failed to create shared memory (%lu)", GetLastError());
+		return false;
+	}
+
+	shmem_info = MapViewOfFile(shmem_map, FILE_MAP_ALL_ACCESS, 0, 0,
+			shmem_size);
+	if (!shmem_info) {
+		hlog("Failed to map shared memory (%lu)", GetLastError());
+		capture_free();
+		return false;
+	}
+
+	shmem_info->last_tex    = -1;
+	shmem_info->tex1_offset = offset;
+	shmem_info->tex2_offset = offset + frame_size;
+
+	set_hook_info(CAPTURE_TYPE_MEMORY, window, cx, cy, pitch, format,
+			flip);
+	global_hook_info->map_id   = map_id;
+	global_hook_info->map_size = shmem_size;
+
+	active = true;
+	last_capture.QuadPart = 0;
+	SetEvent(signal_ready);
+
+	hlog("Capturing with shared memory (%ux%u)", cx, cy);
+	return true;
+}
+
+/* writes to whichever frame the source isn't reading from */
+void shmem_copy_data(const void *data)
+{
+	uint32_t offset;
+	int      idx;
+
+	if (!shmem_info)
+		return;
+
+	idx = shmem_info->last_tex == 0 ? 1 : 0;
+
+	if (WaitForSingleObject(texture_mutexes[idx], 0) != WAIT_OBJECT_0) {
+		idx = idx == 0 ? 1 : 0;
+		if (WaitForSingleObject(texture_mutexes[idx], 0) !=
+				WAIT_OBJECT_0)
+			return;
+	}
+
+	offset = idx == 0 ? shmem_info->tex1_offset : shmem_info->tex2_offset;
+	memcpy((uint8_t*)shmem_info + offset, data,
+			global_hook_info->pitch * global_hook_info->cy);
+
+	ReleaseMutex(texture_mutexes[idx]);
+	shmem_info->last_tex = idx;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* the game might load its graphics libraries after the hook is injected,
+ * so keep trying until everything that can be hooked is */
+static DWORD WINAPI main_capture_thread(LPVOID param)
+{
+	bool d3d11_hooked = false;
+	bool gl_hooked    = false;
+
+	if (!init_hook_objects()) {
+		hlog("Failed to initialize the hook");
+		return 0;
+	}
+
+	while (!d3d11_hooked || !gl_hooked) {
+		if (!d3d11_hooked)
+			d3d11_hooked = hook_d3d11();
+		if (!gl_hooked)
+			gl_hooked = hook_gl();
+
+		Sleep(HOOK_RETRY_INTERVAL);
+	}
+
+	(void)param;
+	return 0;
+}
+
+BOOL WINAPI DllMain(HINSTANCE hinst, DWORD reason, LPVOID unused)
+{
+	if (reason == DLL_PROCESS_ATTACH) {
+		HANDLE thread;
+
+		process_id = GetCurrentProcessId();
+		QueryPerformanceFrequency(&perf_freq);
+
+		/* nothing else can safely be done while the loader lock
+		 * is held */
+		thread = CreateThread(NULL, 0, main_capture_thread, NULL, 0,
+				NULL);
+		if (!thread)
+			return false;
+
+		CloseHandle(thread);
+	}
+
+	(void)hinst;
+	(void)unused;
+	return true;
+}
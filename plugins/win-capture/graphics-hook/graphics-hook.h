@@ -0,0 +1,42 @@
+#pragma once
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "../graphics-hook-info.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void hlog(const char *format, ...);
+extern void hlog_hr(const char *text, HRESULT hr);
+
+extern bool hook_d3d11(void);
+extern bool hook_gl(void);
+
+/*
+ * Capture state shared by all hooks.  Only one swap chain or context is
+ * captured at a time, the first one that is presented after a restart.
+ */
+extern bool capture_active(void);
+extern bool capture_should_init(void);
+extern bool capture_should_stop(void);
+extern bool capture_ready(void);
+extern void capture_request_restart(void);
+extern void capture_free(void);
+
+extern bool shtex_init(HWND window, uint32_t cx, uint32_t cy,
+		uint32_t format, bool flip, uintptr_t handle);
+extern bool shmem_init(HWND window, uint32_t cx, uint32_t cy,
+		uint32_t pitch, uint32_t format, bool flip);
+extern void shmem_copy_data(const void *data);
+
+extern struct hook_info *global_hook_info;
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,15 +1,27 @@
 #include <util/dstr.h>
 #include "dc-capture.h"
 
+/* seconds to wait before trying to duplicate the output again */
+#define DUPLICATOR_RETRY_TIME 1.0f
+
 struct monitor_capture {
 	obs_source_t      source;
 
 	int               monitor;
+	HMONITOR          handle;
 	bool              capture_cursor;
 	bool              compatibility;
 
 	struct dc_capture data;
 
+	/* desktop duplication is used when available (windows 8 and newer),
+	 * GDI capture is the fallback */
+	duplicator_t      duplicator;
+	bool              duplicator_failed;
+	float             retry_time;
+	uint32_t          width;
+	uint32_t          height;
+
 	effect_t          opaque_effect;
 };
 
@@ -18,6 +30,7 @@ struct monitor_info {
 	int               desired_id;
 	int               id;
 	RECT              rect;
+	HMONITOR          handle;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -43,8 +56,9 @@ static BOOL CALLBACK enum_monitor(HMONITOR handle, HDC hdc, LPRECT rect,
 	struct monitor_info *monitor = (struct monitor_info *)param;
 
 	if (monitor->cur_id == 0 || monitor->desired_id == monitor->cur_id) {
-		monitor->rect = *rect;
-		monitor->id   = monitor->cur_id;
+		monitor->rect   = *rect;
+		monitor->id     = monitor->cur_id;
+		monitor->handle = handle;
 	}
 
 	return (monitor->desired_id < monitor->cur_id++);
@@ -60,6 +74,7 @@ static void update_monitor(struct monitor_capture *capture,
 	EnumDisplayMonitors(NULL, NULL, enum_monitor, (LPARAM)&monitor);
 
 	capture->monitor = monitor.id;
+	capture->handle  = monitor.handle;
 
 	width  = monitor.rect.right  - monitor.rect.left;
 	height = monitor.rect.bottom - monitor.rect.top;
@@ -77,6 +92,13 @@ static inline void update_settings(struct monitor_capture *capture,
 
 	dc_capture_free(&capture->data);
 	update_monitor(capture, settings);
+
+	/* settings are only applied on creation, so the duplicator doesn't
+	 * exist yet and will be created on the next tick */
+	capture->duplicator_failed = false;
+	capture->retry_time        = 0.0f;
+	capture->width             = capture->data.width;
+	capture->height            = capture->data.height;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -94,6 +116,7 @@ static void monitor_capture_destroy(void *data)
 	gs_entercontext(obs_graphics());
 
 	dc_capture_free(&capture->data);
+	duplicator_destroy(capture->duplicator);
 	effect_destroy(capture->opaque_effect);
 
 	gs_leavecontext();
@@ -123,33 +146,146 @@ static void *monitor_capture_create(obs_data_t settings, obs_source_t source)
 	return capture;
 }
 
+/* returns false if GDI capture has to be used for this frame */
+static bool update_duplicator(struct monitor_capture *capture, float seconds)
+{
+	if (capture->compatibility)
+		return false;
+
+	if (!capture->duplicator) {
+		capture->retry_time -= seconds;
+		if (capture->retry_time > 0.0f)
+			return false;
+
+		capture->duplicator = gs_create_duplicator(capture->handle);
+		if (!capture->duplicator) {
+			/* only log once, this fails every time on windows 7 */
+			if (!capture->duplicator_failed)
+				do_log(LOG_INFO, "Desktop duplication is not "
+				                 "available, using GDI capture");
+
+			capture->duplicator_failed = true;
+			capture->retry_time        = DUPLICATOR_RETRY_TIME;
+			return false;
+		}
+
+		capture->duplicator_failed = false;
+	}
+
+	/* access to the output is lost on mode changes, UAC prompts, and
+	 * full screen applications taking over, so recreate it later */
+	if (!duplicator_update_frame(capture->duplicator)) {
+		duplicator_destroy(capture->duplicator);
+		capture->duplicator = NULL;
+		capture->retry_time = DUPLICATOR_RETRY_TIME;
+		return false;
+	}
+
+	return true;
+}
+
 static void monitor_capture_tick(void *data, float seconds)
 {
 	struct monitor_capture *capture = data;
+	texture_t texture = NULL;
 
 	gs_entercontext(obs_graphics());
-	dc_capture_capture(&capture->data, NULL);
+
+	if (update_duplicator(capture, seconds))
+		texture = duplicator_gettexture(capture->duplicator);
+	else
+		dc_capture_capture(&capture->data, NULL);
+
+	/* the size is queried outside of the graphics context */
+	capture->width  = texture ?
+		texture_getwidth(texture)  : capture->data.width;
+	capture->height = texture ?
+		texture_getheight(texture) : capture->data.height;
+
 	gs_leavecontext();
+}
+
+static void draw_duplicator_cursor(struct monitor_capture *capture)
+{
+	effect_t    effect = obs_get_default_effect();
+	technique_t tech   = effect_gettechnique(effect, "Draw");
+	eparam_t    image  = effect_getparambyname(effect, "image");
+	texture_t   cursor;
+	int32_t     x, y;
+	size_t      passes;
+
+	cursor = duplicator_getcursor(capture->duplicator, &x, &y);
+	if (!cursor)
+		return;
+
+	/* the pointer shape has straight alpha */
+	gs_blendfunction(GS_BLEND_SRCALPHA, GS_BLEND_INVSRCALPHA);
+
+	gs_matrix_push();
+	gs_matrix_translate3f((float)x, (float)y, 0.0f);
+
+	effect_settexture(effect, image, cursor);
+
+	passes = technique_begin(tech);
+	for (size_t i = 0; i < passes; i++) {
+		if (technique_beginpass(tech, i)) {
+			gs_draw_sprite(cursor, 0, 0, 0);
+			technique_endpass(tech);
+		}
+	}
+	technique_end(tech);
+
+	gs_matrix_pop();
+}
+
+static void draw_duplicator(struct monitor_capture *capture)
+{
+	effect_t    effect  = capture->opaque_effect;
+	technique_t tech    = effect_gettechnique(effect, "Draw");
+	eparam_t    image   = effect_getparambyname(effect, "image");
+	texture_t   texture = duplicator_gettexture(capture->duplicator);
+	size_t      passes;
+
+	if (!texture)
+		return;
+
+	effect_settexture(effect, image, texture);
+
+	passes = technique_begin(tech);
+	for (size_t i = 0; i < passes; i++) {
+		if (technique_beginpass(tech, i)) {
+			gs_draw_sprite(texture, 0, 0, 0);
+			technique_endpass(tech);
+		}
+	}
+	technique_end(tech);
 
-	UNUSED_PARAMETER(seconds);
+	if (capture->capture_cursor)
+		draw_duplicator_cursor(capture);
 }
 
 static void monitor_capture_render(void *data, effect_t effect)
 {
 	struct monitor_capture *capture = data;
-	dc_capture_render(&capture->data, capture->opaque_effect);
+
+	if (capture->duplicator)
+		draw_duplicator(capture);
+	else
+		dc_capture_render(&capture->data, capture->opaque_effect);
+
+	UNUSED_PARAMETER(effect);
 }
 
 static uint32_t monitor_capture_width(void *data)
 {
 	struct monitor_capture *capture = data;
-	return capture->data.width;
+	return capture->width;
 }
 
 static uint32_t monitor_capture_height(void *data)
 {
 	struct monitor_capture *capture = data;
-	return capture->data.height;
+	return capture->height;
 }
 
 struct obs_source_info monitor_capture_info = {
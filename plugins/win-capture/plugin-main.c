@@ -4,11 +4,13 @@ OBS_DECLARE_MODULE()
 
 extern struct obs_source_info monitor_capture_info;
 extern struct obs_source_info window_capture_info;
+extern struct obs_source_info game_capture_info;
 
 bool obs_module_load(uint32_t libobs_ver)
 {
 	obs_register_source(&monitor_capture_info);
 	obs_register_source(&window_capture_info);
+	obs_register_source(&game_capture_info);
 
 	UNUSED_PARAMETER(libobs_ver);
 	return true;
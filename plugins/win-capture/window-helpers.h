@@ -0,0 +1,40 @@
+#pragma once
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <obs.h>
+
+struct dstr;
+
+enum window_priority {
+	WINDOW_PRIORITY_CLASS,
+	WINDOW_PRIORITY_TITLE,
+	WINDOW_PRIORITY_EXE,
+};
+
+/* window settings are stored as "title:class:executable" */
+extern void build_window_strings(const char *str,
+		char **class,
+		char **title,
+		char **exe);
+
+extern bool get_window_exe(struct dstr *name, HWND window);
+extern void get_window_title(struct dstr *name, HWND hwnd);
+extern void get_window_class(struct dstr *class, HWND hwnd);
+
+extern void fill_window_list(obs_property_t p);
+
+/* visible, not minimized, not a tool window and not empty */
+extern bool is_window_valid(HWND window);
+
+/* how well a window matches the settings, 0 if it doesn't match at all */
+extern int window_rating(enum window_priority priority,
+		const char *class_str, const char *title_str,
+		const char *exe_str,
+		struct dstr *title,
+		struct dstr *class,
+		struct dstr *executable);
+
+extern HWND find_window(enum window_priority priority, const char *class,
+		const char *title, const char *exe);
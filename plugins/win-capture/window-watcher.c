@@ -0,0 +1,280 @@
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include "window-watcher.h"
+
+struct watched_window {
+	HWND        window;
+	struct dstr title;
+	struct dstr class;
+	struct dstr exe;
+};
+
+struct window_watcher {
+	long            refs;
+
+	pthread_t       thread;
+	DWORD           thread_id;
+	os_event_t      started_event;
+	bool            hooked;
+
+	/* only changed on the watcher thread, so that thread can read it
+	 * without locking */
+	pthread_mutex_t mutex;
+	DARRAY(struct watched_window) windows;
+
+	volatile long   revision;
+};
+
+static pthread_mutex_t      refs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct window_watcher watcher   = {0};
+
+static inline bool is_top_level(HWND window)
+{
+	return GetAncestor(window, GA_PARENT) == GetDesktopWindow();
+}
+
+static size_t find_watched(HWND window)
+{
+	for (size_t i = 0; i < watcher.windows.num; i++) {
+		if (watcher.windows.array[i].window == window)
+			return i;
+	}
+
+	return DARRAY_INVALID;
+}
+
+static inline void free_watched(struct watched_window *ww)
+{
+	dstr_free(&ww->title);
+	dstr_free(&ww->class);
+	dstr_free(&ww->exe);
+}
+
+static void add_window(HWND window)
+{
+	struct watched_window ww = {0};
+
+	if (find_watched(window) != DARRAY_INVALID)
+		return;
+
+	/* windows of our own process are never captured */
+	ww.window = window;
+	if (!get_window_exe(&ww.exe, window))
+		return;
+	get_window_title(&ww.title, window);
+	get_window_class(&ww.class, window);
+
+	pthread_mutex_lock(&watcher.mutex);
+	da_push_back(watcher.windows, &ww);
+	pthread_mutex_unlock(&watcher.mutex);
+}
+
+static void rename_window(HWND window)
+{
+	struct dstr title = {0};
+	size_t      idx   = find_watched(window);
+
+	if (idx == DARRAY_INVALID) {
+		add_window(window);
+		return;
+	}
+
+	get_window_title(&title, window);
+
+	pthread_mutex_lock(&watcher.mutex);
+	dstr_move(&watcher.windows.array[idx].title, &title);
+	pthread_mutex_unlock(&watcher.mutex);
+}
+
+static bool remove_window(HWND window)
+{
+	size_t idx = find_watched(window);
+	if (idx == DARRAY_INVALID)
+		return false;
+
+	pthread_mutex_lock(&watcher.mutex);
+	free_watched(watcher.windows.array+idx);
+	da_erase(watcher.windows, idx);
+	pthread_mutex_unlock(&watcher.mutex);
+	return true;
+}
+
+static BOOL CALLBACK index_window(HWND window, LPARAM param)
+{
+	add_window(window);
+
+	UNUSED_PARAMETER(param);
+	return true;
+}
+
+static void CALLBACK window_event(HWINEVENTHOOK hook, DWORD event,
+		HWND window, LONG id_object, LONG id_child,
+		DWORD event_thread, DWORD event_time)
+{
+	UNUSED_PARAMETER(hook);
+	UNUSED_PARAMETER(event_thread);
+	UNUSED_PARAMETER(event_time);
+
+	if (!window || id_object != OBJID_WINDOW || id_child != CHILDID_SELF)
+		return;
+
+	/* destroyed windows can't be queried any more */
+	if (event == EVENT_OBJECT_DESTROY) {
+		if (remove_window(window))
+			os_atomic_inc_long(&watcher.revision);
+		return;
+	}
+
+	if (!is_top_level(window))
+		return;
+
+	if (event == EVENT_OBJECT_NAMECHANGE)
+		rename_window(window);
+	else if (event != EVENT_OBJECT_LOCATIONCHANGE)
+		add_window(window);
+
+	os_atomic_inc_long(&watcher.revision);
+}
+
+static inline HWINEVENTHOOK hook_events(DWORD min, DWORD max)
+{
+	return SetWinEventHook(min, max, NULL, window_event, 0, 0,
+			WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+}
+
+static void *watcher_thread(void *param)
+{
+	HWINEVENTHOOK hooks[3];
+	MSG           msg;
+
+	os_thread_init(OS_THREAD_CLASS_DEFAULT, "window watcher");
+
+	/* creates the message queue, so the quit message can't get lost */
+	PeekMessage(&msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+	watcher.thread_id = GetCurrentThreadId();
+
+	/* out of context hooks are delivered through this thread's messages */
+	hooks[0] = hook_events(EVENT_OBJECT_CREATE, EVENT_OBJECT_HIDE);
+	hooks[1] = hook_events(EVENT_OBJECT_LOCATIONCHANGE,
+			EVENT_OBJECT_NAMECHANGE);
+	hooks[2] = hook_events(EVENT_SYSTEM_MINIMIZESTART,
+			EVENT_SYSTEM_MINIMIZEEND);
+
+	watcher.hooked = hooks[0] && hooks[1] && hooks[2];
+
+	/* windows are indexed after hooking, so none of them are missed */
+	if (watcher.hooked)
+		EnumWindows(index_window, 0);
+
+	os_event_signal(watcher.started_event);
+
+	if (watcher.hooked) {
+		while (GetMessage(&msg, NULL, 0, 0) > 0) {
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+	}
+
+	for (size_t i = 0; i < 3; i++) {
+		if (hooks[i])
+			UnhookWinEvent(hooks[i]);
+	}
+
+	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+static void stop_watcher(void)
+{
+	PostThreadMessage(watcher.thread_id, WM_QUIT, 0, 0);
+	pthread_join(watcher.thread, NULL);
+
+	for (size_t i = 0; i < watcher.windows.num; i++)
+		free_watched(watcher.windows.array+i);
+	da_free(watcher.windows);
+
+	pthread_mutex_destroy(&watcher.mutex);
+	os_event_destroy(watcher.started_event);
+	watcher.started_event = NULL;
+	watcher.hooked        = false;
+}
+
+static bool start_watcher(void)
+{
+	if (pthread_mutex_init(&watcher.mutex, NULL) != 0)
+		return false;
+	if (os_event_init(&watcher.started_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail_event;
+	if (pthread_create(&watcher.thread, NULL, watcher_thread, NULL) != 0)
+		goto fail_thread;
+
+	os_event_wait(watcher.started_event);
+	if (watcher.hooked)
+		return true;
+
+	blog(LOG_WARNING, "window_watcher: Failed to hook window events, "
+	                  "windows will be searched for instead");
+	stop_watcher();
+	return false;
+
+fail_thread:
+	os_event_destroy(watcher.started_event);
+	watcher.started_event = NULL;
+fail_event:
+	pthread_mutex_destroy(&watcher.mutex);
+	return false;
+}
+
+bool window_watcher_acquire(void)
+{
+	bool success = true;
+
+	pthread_mutex_lock(&refs_mutex);
+	if (watcher.refs == 0)
+		success = start_watcher();
+	if (success)
+		watcher.refs++;
+	pthread_mutex_unlock(&refs_mutex);
+
+	return success;
+}
+
+void window_watcher_release(void)
+{
+	pthread_mutex_lock(&refs_mutex);
+	if (watcher.refs && --watcher.refs == 0)
+		stop_watcher();
+	pthread_mutex_unlock(&refs_mutex);
+}
+
+long window_watcher_revision(void)
+{
+	return watcher.revision;
+}
+
+HWND window_watcher_find(enum window_priority priority, const char *class,
+		const char *title, const char *exe)
+{
+	HWND best_window = NULL;
+	int  best_rating = 0;
+
+	pthread_mutex_lock(&watcher.mutex);
+
+	for (size_t i = 0; i < watcher.windows.num; i++) {
+		struct watched_window *ww = watcher.windows.array+i;
+		int rating = window_rating(priority, class, title, exe,
+				&ww->title, &ww->class, &ww->exe);
+
+		/* visibility and size aren't tracked, so they're checked for
+		 * the windows that would be picked */
+		if (rating > best_rating && is_window_valid(ww->window)) {
+			best_rating = rating;
+			best_window = ww->window;
+		}
+	}
+
+	pthread_mutex_unlock(&watcher.mutex);
+
+	return best_window;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "window-helpers.h"
+
+/*
+ * Keeps an index of the top-level windows up to date from WinEvent hooks,
+ * shared by all window capture sources.  The title, class and executable of
+ * each window are looked up once when the window appears (and the title
+ * again when it's renamed), so finding a window doesn't have to enumerate
+ * all windows and open their processes every time.
+ */
+
+/* starts the watcher for the first user, returns false if it couldn't hook
+ * the window events, in which case find_window has to be used instead */
+extern bool window_watcher_acquire(void);
+extern void window_watcher_release(void);
+
+/* changes whenever a top-level window is created, destroyed, shown, hidden,
+ * minimized, restored, renamed, moved or resized */
+extern long window_watcher_revision(void);
+
+/* same as find_window, but from the index */
+extern HWND window_watcher_find(enum window_priority priority,
+		const char *class, const char *title, const char *exe);
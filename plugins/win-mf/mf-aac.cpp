@@ -0,0 +1,378 @@
+#include <obs-module.h>
+#include <util/windows/ComPtr.hpp>
+
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mferror.h>
+#include <mftransform.h>
+#include <wmcodecdsp.h>
+
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+/* AAC encoding with the AAC encoder MFT of Media Foundation.  The MFT only
+ * takes 16 bit PCM at 44.1 or 48 kHz, and only encodes at 96, 128, 160 and
+ * 192 kbps, so other bitrates are rounded to the nearest one. */
+
+#define MF_LOG(level, format, ...) \
+	blog(level, "[Media Foundation AAC] " format, ##__VA_ARGS__)
+
+#define MF_TIME_DEN 10000000ULL
+#define FRAME_SIZE  1024
+
+static const UINT32 supportedBitrates[] = {96, 128, 160, 192};
+
+struct MFAACEncoder {
+	obs_encoder_t          encoder;
+	ComPtr<IMFTransform>   transform;
+	ComPtr<IMFSample>      outputSample;
+	ComPtr<IMFMediaBuffer> outputBuffer;
+
+	UINT32                 channels;
+	UINT32                 sampleRate;
+	UINT32                 bitrate;
+	UINT32                 bytesPerFrame;
+	uint64_t               framesIn;
+
+	vector<uint8_t>        packetBuffer;
+	uint8_t                extraData[2];
+
+	inline MFAACEncoder(obs_encoder_t encoder_)
+		: encoder(encoder_), channels(0), sampleRate(0), bitrate(0),
+		  bytesPerFrame(0), framesIn(0)
+	{}
+
+	bool Initialize(UINT32 requestedBitrate);
+	bool ProcessOutput(encoder_packet *packet, bool *received);
+	bool Encode(encoder_frame *frame, encoder_packet *packet,
+			bool *received);
+};
+
+static inline bool Failed(HRESULT hr, const char *action)
+{
+	if (FAILED(hr)) {
+		MF_LOG(LOG_WARNING, "%s failed: 0x%08lX", action, hr);
+		return true;
+	}
+
+	return false;
+}
+
+static UINT32 GetSupportedBitrate(UINT32 bitrate)
+{
+	UINT32 best = supportedBitrates[0];
+
+	for (UINT32 supported : supportedBitrates) {
+		if (abs((int)supported - (int)bitrate) <
+		    abs((int)best      - (int)bitrate))
+			best = supported;
+	}
+
+	return best;
+}
+
+/* the AudioSpecificConfig of AAC-LC, which is what the outputs expect as
+ * the header of an AAC track */
+static void BuildExtraData(uint8_t *data, UINT32 sampleRate, UINT32 channels)
+{
+	uint8_t index = (sampleRate == 44100) ? 4 : 3;
+
+	data[0] = (uint8_t)((2 << 3) | (index >> 1));
+	data[1] = (uint8_t)(((index & 1) << 7) | (channels << 3));
+}
+
+static HRESULT CreateMediaType(IMFMediaType **type, const GUID &subtype,
+		UINT32 sampleRate, UINT32 channels)
+{
+	HRESULT hr = MFCreateMediaType(type);
+	if (FAILED(hr))
+		return hr;
+
+	(*type)->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
+	(*type)->SetGUID(MF_MT_SUBTYPE, subtype);
+	(*type)->SetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, 16);
+	(*type)->SetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, sampleRate);
+	(*type)->SetUINT32(MF_MT_AUDIO_NUM_CHANNELS, channels);
+	return S_OK;
+}
+
+bool MFAACEncoder::Initialize(UINT32 requestedBitrate)
+{
+	ComPtr<IMFMediaType> inputType;
+	ComPtr<IMFMediaType> outputType;
+	MFT_OUTPUT_STREAM_INFO streamInfo = {};
+	HRESULT hr;
+
+	audio_t audio = obs_encoder_audio(encoder);
+	channels      = (UINT32)audio_output_channels(audio);
+	sampleRate    = audio_output_samplerate(audio);
+	bitrate       = GetSupportedBitrate(requestedBitrate);
+	bytesPerFrame = channels * sizeof(int16_t);
+
+	/* the header only describes mono and stereo without a channel map */
+	if (channels > 2) {
+		MF_LOG(LOG_WARNING, "%u channels are not supported", channels);
+		return false;
+	}
+	if (sampleRate != 44100 && sampleRate != 48000) {
+		MF_LOG(LOG_WARNING, "Sample rate %u is not supported",
+				sampleRate);
+		return false;
+	}
+
+	hr = CoCreateInstance(CLSID_AACMFTEncoder, NULL, CLSCTX_INPROC_SERVER,
+			__uuidof(IMFTransform), (void**)transform.Assign());
+	if (Failed(hr, "Create AAC encoder"))
+		return false;
+
+	/* the output type has to be set before the input type */
+	hr = CreateMediaType(outputType.Assign(), MFAudioFormat_AAC,
+			sampleRate, channels);
+	if (Failed(hr, "Create output type"))
+		return false;
+
+	outputType->SetUINT32(MF_MT_AUDIO_AVG_BYTES_PER_SECOND,
+			bitrate * 1000 / 8);
+	outputType->SetUINT32(MF_MT_AAC_PAYLOAD_TYPE, 0);
+	outputType->SetUINT32(MF_MT_AAC_AUDIO_PROFILE_LEVEL_INDICATION, 0x29);
+
+	hr = transform->SetOutputType(0, outputType, 0);
+	if (Failed(hr, "Set output type"))
+		return false;
+
+	hr = CreateMediaType(inputType.Assign(), MFAudioFormat_PCM,
+			sampleRate, channels);
+	if (Failed(hr, "Create input type"))
+		return false;
+
+	inputType->SetUINT32(MF_MT_AUDIO_BLOCK_ALIGNMENT, bytesPerFrame);
+	inputType->SetUINT32(MF_MT_AUDIO_AVG_BYTES_PER_SECOND,
+			bytesPerFrame * sampleRate);
+
+	hr = transform->SetInputType(0, inputType, 0);
+	if (Failed(hr, "Set input type"))
+		return false;
+
+	/* the MFT doesn't allocate its output, so one sample is reused for
+	 * every packet */
+	hr = transform->GetOutputStreamInfo(0, &streamInfo);
+	if (Failed(hr, "Get output stream info"))
+		return false;
+
+	hr = MFCreateSample(outputSample.Assign());
+	if (Failed(hr, "Create output sample"))
+		return false;
+
+	hr = MFCreateMemoryBuffer(streamInfo.cbSize, outputBuffer.Assign());
+	if (Failed(hr, "Create output buffer"))
+		return false;
+
+	outputSample->AddBuffer(outputBuffer);
+
+	hr = transform->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, 0);
+	if (Failed(hr, "Begin streaming"))
+		return false;
+
+	hr = transform->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, 0);
+	if (Failed(hr, "Start stream"))
+		return false;
+
+	BuildExtraData(extraData, sampleRate, channels);
+
+	MF_LOG(LOG_INFO, "bitrate: %u, channels: %u, sample rate: %u",
+			bitrate, channels, sampleRate);
+	if (bitrate != requestedBitrate)
+		MF_LOG(LOG_INFO, "bitrate %u is not supported, using %u",
+				requestedBitrate, bitrate);
+	return true;
+}
+
+bool MFAACEncoder::ProcessOutput(encoder_packet *packet, bool *received)
+{
+	MFT_OUTPUT_DATA_BUFFER output = {};
+	DWORD   status = 0;
+	BYTE    *data;
+	DWORD   length;
+	LONGLONG time;
+	HRESULT hr;
+
+	outputBuffer->SetCurrentLength(0);
+	output.pSample = outputSample;
+
+	hr = transform->ProcessOutput(0, 1, &output, &status);
+	if (output.pEvents)
+		output.pEvents->Release();
+
+	if (hr == MF_E_TRANSFORM_NEED_MORE_INPUT)
+		return true;
+	if (Failed(hr, "ProcessOutput"))
+		return false;
+
+	hr = outputBuffer->Lock(&data, NULL, &length);
+	if (Failed(hr, "Lock output buffer"))
+		return false;
+
+	packetBuffer.assign(data, data + length);
+	outputBuffer->Unlock();
+
+	outputSample->GetSampleTime(&time);
+
+	packet->pts  = (int64_t)(((uint64_t)time * sampleRate +
+				MF_TIME_DEN / 2) / MF_TIME_DEN);
+	packet->dts  = packet->pts;
+	packet->data = packetBuffer.data();
+	packet->size = packetBuffer.size();
+	packet->type = OBS_ENCODER_AUDIO;
+	packet->timebase_num = 1;
+	packet->timebase_den = (int32_t)sampleRate;
+
+	*received = true;
+	return true;
+}
+
+bool MFAACEncoder::Encode(encoder_frame *frame, encoder_packet *packet,
+		bool *received)
+{
+	ComPtr<IMFSample>      sample;
+	ComPtr<IMFMediaBuffer> buffer;
+	DWORD   size = frame->frames * bytesPerFrame;
+	BYTE    *data;
+	HRESULT hr;
+
+	*received = false;
+
+	/* the MFT may still hold on to the previous input, so each frame gets
+	 * its own sample */
+	hr = MFCreateMemoryBuffer(size, buffer.Assign());
+	if (Failed(hr, "Create input buffer"))
+		return false;
+
+	hr = buffer->Lock(&data, NULL, NULL);
+	if (Failed(hr, "Lock input buffer"))
+		return false;
+
+	memcpy(data, frame->data[0], size);
+	buffer->Unlock();
+	buffer->SetCurrentLength(size);
+
+	hr = MFCreateSample(sample.Assign());
+	if (Failed(hr, "Create input sample"))
+		return false;
+
+	sample->AddBuffer(buffer);
+	sample->SetSampleTime((LONGLONG)(framesIn * MF_TIME_DEN / sampleRate));
+	sample->SetSampleDuration((LONGLONG)((uint64_t)frame->frames *
+				MF_TIME_DEN / sampleRate));
+	framesIn += frame->frames;
+
+	hr = transform->ProcessInput(0, sample, 0);
+
+	/* a packet that wasn't picked up yet has to be taken out first */
+	if (hr == MF_E_NOTACCEPTING) {
+		if (!ProcessOutput(packet, received))
+			return false;
+
+		hr = transform->ProcessInput(0, sample, 0);
+	}
+
+	if (Failed(hr, "ProcessInput"))
+		return false;
+
+	return *received ? true : ProcessOutput(packet, received);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const char *MFAACGetName(const char *locale)
+{
+	UNUSED_PARAMETER(locale);
+	return "Media Foundation AAC Encoder";
+}
+
+static void *MFAACCreate(obs_data_t settings, obs_encoder_t encoder)
+{
+	UINT32 bitrate = (UINT32)obs_data_getint(settings, "bitrate");
+
+	if (!bitrate) {
+		MF_LOG(LOG_WARNING, "Invalid bitrate specified");
+		return nullptr;
+	}
+
+	MFAACEncoder *enc = new MFAACEncoder(encoder);
+	if (!enc->Initialize(bitrate)) {
+		delete enc;
+		return nullptr;
+	}
+
+	return enc;
+}
+
+static void MFAACDestroy(void *data)
+{
+	delete static_cast<MFAACEncoder*>(data);
+}
+
+static bool MFAACEncode(void *data, encoder_frame *frame,
+		encoder_packet *packet, bool *received_packet)
+{
+	MFAACEncoder *enc = static_cast<MFAACEncoder*>(data);
+	return enc->Encode(frame, packet, received_packet);
+}
+
+static size_t MFAACFrameSize(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return FRAME_SIZE;
+}
+
+static void MFAACDefaults(obs_data_t settings)
+{
+	obs_data_set_default_int(settings, "bitrate", 128);
+}
+
+static obs_properties_t MFAACProperties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale */
+	obs_properties_add_int(props, "bitrate", "Bitrate", 96, 192, 32);
+	return props;
+}
+
+static bool MFAACExtraData(void *data, uint8_t **extra_data, size_t *size)
+{
+	MFAACEncoder *enc = static_cast<MFAACEncoder*>(data);
+
+	*extra_data = enc->extraData;
+	*size       = sizeof(enc->extraData);
+	return true;
+}
+
+static bool MFAACAudioInfo(void *data, audio_convert_info *info)
+{
+	UNUSED_PARAMETER(data);
+
+	memset(info, 0, sizeof(audio_convert_info));
+	info->format = AUDIO_FORMAT_16BIT;
+	return true;
+}
+
+void RegisterMFAACEncoder()
+{
+	obs_encoder_info info = {};
+	info.id               = "mf_aac";
+	info.type             = OBS_ENCODER_AUDIO;
+	info.codec            = "AAC";
+	info.getname          = MFAACGetName;
+	info.create           = MFAACCreate;
+	info.destroy          = MFAACDestroy;
+	info.encode           = MFAACEncode;
+	info.frame_size       = MFAACFrameSize;
+	info.defaults         = MFAACDefaults;
+	info.properties       = MFAACProperties;
+	info.extra_data       = MFAACExtraData;
+	info.audio_info       = MFAACAudioInfo;
+	obs_register_encoder(&info);
+}
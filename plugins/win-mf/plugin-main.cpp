@@ -0,0 +1,31 @@
+#include <obs-module.h>
+
+#include <mfapi.h>
+
+OBS_DECLARE_MODULE()
+
+void RegisterMFAACEncoder();
+
+static bool mfStarted = false;
+
+bool obs_module_load(uint32_t libobs_ver)
+{
+	/* the encoders are only registered if Media Foundation is there,
+	 * which it isn't on the N editions of Windows */
+	if (FAILED(MFStartup(MF_VERSION, MFSTARTUP_LITE))) {
+		blog(LOG_INFO, "win-mf: Media Foundation not available");
+		return true;
+	}
+
+	mfStarted = true;
+	RegisterMFAACEncoder();
+
+	UNUSED_PARAMETER(libobs_ver);
+	return true;
+}
+
+void obs_module_unload(void)
+{
+	if (mfStarted)
+		MFShutdown();
+}
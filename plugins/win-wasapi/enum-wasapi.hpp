@@ -7,6 +7,8 @@
 #include <propsys.h>
 #include <functiondiscoverykeys_devpkey.h>
 
+#include <media-io/audio-io.h>
+
 #include <vector>
 #include <string>
 
@@ -17,3 +19,4 @@ struct AudioDeviceInfo {
 
 std::string GetDeviceName(IMMDevice *device);
 void GetWASAPIAudioDevices(std::vector<AudioDeviceInfo> &devices, bool input);
+speaker_layout ConvertSpeakerLayout(DWORD layout, WORD channels);
@@ -4,10 +4,12 @@ OBS_DECLARE_MODULE()
 
 void RegisterWASAPIInput();
 void RegisterWASAPIOutput();
+void RegisterWASAPIMonitor();
 
 bool obs_module_load(uint32_t libobs_ver)
 {
 	RegisterWASAPIInput();
 	RegisterWASAPIOutput();
+	RegisterWASAPIMonitor();
 	return true;
 }
@@ -0,0 +1,440 @@
+#include "enum-wasapi.hpp"
+
+#include <obs.h>
+#include <media-io/audio-monitor.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <util/windows/HRError.hpp>
+#include <util/windows/ComPtr.hpp>
+#include <util/windows/WinHandle.hpp>
+#include <util/windows/CoTaskMemPtr.hpp>
+
+#include <avrt.h>
+
+using namespace std;
+
+void FillWASAPIOutputDevices(obs_property_t device_prop);
+
+#define DEFAULT_LATENCY_MS 40
+
+/* Plays an audio mix back on a render device.  The device buffer holds half
+ * of the requested latency, the jitter buffer of the audio monitor holds the
+ * other half and absorbs the clock drift between the device and libobs. */
+class WASAPIMonitor {
+	ComPtr<IMMDevice>          device;
+	ComPtr<IAudioClient>       client;
+	ComPtr<IAudioRenderClient> render;
+
+	obs_output_t               output;
+	string                     device_id;
+	string                     device_name;
+	bool                       isDefaultDevice;
+	int                        latencyMS;
+
+	audio_monitor_t            monitor;
+	WinHandle                  renderThread;
+	WinHandle                  stopSignal;
+	WinHandle                  renderSignal;
+
+	speaker_layout             speakers;
+	uint32_t                   sampleRate;
+	UINT32                     bufferFrames;
+
+	static DWORD WINAPI RenderThread(LPVOID param);
+
+	bool ProcessRenderData();
+
+	bool InitDevice(IMMDeviceEnumerator *enumerator);
+	void InitClient();
+	void InitRender();
+	void Initialize();
+
+	void Release();
+
+public:
+	WASAPIMonitor(obs_data_t settings, obs_output_t output_);
+	inline ~WASAPIMonitor();
+
+	bool Start();
+	void Stop();
+	void Update(obs_data_t settings);
+	inline void Push(const struct audio_data *data);
+};
+
+WASAPIMonitor::WASAPIMonitor(obs_data_t settings, obs_output_t output_)
+	: output       (output_),
+	  monitor      (nullptr),
+	  renderThread (nullptr),
+	  bufferFrames (0)
+{
+	Update(settings);
+
+	stopSignal = CreateEvent(nullptr, true, false, nullptr);
+	if (!stopSignal.Valid())
+		throw "Could not create stop signal";
+
+	renderSignal = CreateEvent(nullptr, false, false, nullptr);
+	if (!renderSignal.Valid())
+		throw "Could not create render signal";
+}
+
+inline WASAPIMonitor::~WASAPIMonitor()
+{
+	Stop();
+}
+
+void WASAPIMonitor::Update(obs_data_t settings)
+{
+	device_id       = obs_data_getstring(settings, "device_id");
+	isDefaultDevice = _strcmpi(device_id.c_str(), "default") == 0;
+	latencyMS       = (int)obs_data_getint(settings, "latency_ms");
+
+	if (latencyMS < AUDIO_MONITOR_MIN_LATENCY_MS * 2)
+		latencyMS = AUDIO_MONITOR_MIN_LATENCY_MS * 2;
+	if (latencyMS > AUDIO_MONITOR_MAX_LATENCY_MS)
+		latencyMS = AUDIO_MONITOR_MAX_LATENCY_MS;
+}
+
+bool WASAPIMonitor::InitDevice(IMMDeviceEnumerator *enumerator)
+{
+	HRESULT res;
+
+	if (isDefaultDevice) {
+		res = enumerator->GetDefaultAudioEndpoint(eRender, eConsole,
+				device.Assign());
+	} else {
+		wchar_t *w_id;
+		os_utf8_to_wcs_ptr(device_id.c_str(), device_id.size(), &w_id);
+
+		res = enumerator->GetDevice(w_id, device.Assign());
+
+		bfree(w_id);
+	}
+
+	return SUCCEEDED(res);
+}
+
+void WASAPIMonitor::InitClient()
+{
+	CoTaskMemPtr<WAVEFORMATEX> wfex;
+	HRESULT                    res;
+	DWORD                      layout = 0;
+	REFERENCE_TIME             bufferTime;
+
+	res = device->Activate(__uuidof(IAudioClient), CLSCTX_ALL,
+			nullptr, (void**)client.Assign());
+	if (FAILED(res))
+		throw HRError("Failed to activate client context", res);
+
+	res = client->GetMixFormat(&wfex);
+	if (FAILED(res))
+		throw HRError("Failed to get mix format", res);
+
+	if (wfex->wFormatTag == WAVE_FORMAT_EXTENSIBLE) {
+		WAVEFORMATEXTENSIBLE *ext =
+			(WAVEFORMATEXTENSIBLE*)(WAVEFORMATEX*)wfex;
+		layout = ext->dwChannelMask;
+	}
+
+	/* the shared mode mix format is always float */
+	sampleRate = wfex->nSamplesPerSec;
+	speakers   = ConvertSpeakerLayout(layout, wfex->nChannels);
+
+	bufferTime = (REFERENCE_TIME)(latencyMS / 2) * 10000;
+
+	res = client->Initialize(
+			AUDCLNT_SHAREMODE_SHARED,
+			AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+			bufferTime, 0, wfex, nullptr);
+	if (FAILED(res))
+		throw HRError("Failed to initialize audio client", res);
+
+	res = client->GetBufferSize(&bufferFrames);
+	if (FAILED(res))
+		throw HRError("Failed to get buffer size", res);
+}
+
+void WASAPIMonitor::InitRender()
+{
+	struct resample_info      info;
+	struct audio_convert_info conv;
+	HRESULT                   res;
+
+	res = client->GetService(__uuidof(IAudioRenderClient),
+			(void**)render.Assign());
+	if (FAILED(res))
+		throw HRError("Failed to create render context", res);
+
+	res = client->SetEventHandle(renderSignal);
+	if (FAILED(res))
+		throw HRError("Failed to set event handle", res);
+
+	info.samples_per_sec = sampleRate;
+	info.format          = AUDIO_FORMAT_FLOAT;
+	info.speakers        = speakers;
+
+	monitor = audio_monitor_create(&info, latencyMS / 2);
+	if (!monitor)
+		throw "Failed to create audio monitor";
+
+	conv.samples_per_sec = info.samples_per_sec;
+	conv.format          = info.format;
+	conv.speakers        = info.speakers;
+	obs_output_set_audio_conversion(output, &conv);
+
+	renderThread = CreateThread(nullptr, 0,
+			WASAPIMonitor::RenderThread, this,
+			0, nullptr);
+	if (!renderThread.Valid())
+		throw "Failed to create render thread";
+
+	client->Start();
+}
+
+void WASAPIMonitor::Initialize()
+{
+	ComPtr<IMMDeviceEnumerator> enumerator;
+	HRESULT res;
+
+	res = CoCreateInstance(__uuidof(MMDeviceEnumerator),
+			nullptr, CLSCTX_ALL,
+			__uuidof(IMMDeviceEnumerator),
+			(void**)enumerator.Assign());
+	if (FAILED(res))
+		throw HRError("Failed to create enumerator", res);
+
+	if (!InitDevice(enumerator))
+		throw "Device not found";
+
+	device_name = GetDeviceName(device);
+
+	InitClient();
+	InitRender();
+}
+
+void WASAPIMonitor::Release()
+{
+	if (renderThread.Valid()) {
+		SetEvent(stopSignal);
+		WaitForSingleObject(renderThread, INFINITE);
+		renderThread = nullptr;
+		ResetEvent(stopSignal);
+	}
+
+	if (client)
+		client->Stop();
+
+	render.Clear();
+	client.Clear();
+	device.Clear();
+
+	audio_monitor_destroy(monitor);
+	monitor = nullptr;
+}
+
+bool WASAPIMonitor::Start()
+{
+	if (!obs_output_can_begin_data_capture(output, 0))
+		return false;
+
+	try {
+		Initialize();
+
+	} catch (HRError error) {
+		blog(LOG_WARNING, "[WASAPIMonitor::Start]:[%s] %s: %lX",
+				device_name.empty() ?
+					device_id.c_str() : device_name.c_str(),
+				error.str, error.hr);
+		Release();
+		return false;
+
+	} catch (const char *error) {
+		blog(LOG_WARNING, "[WASAPIMonitor::Start]:[%s] %s",
+				device_name.empty() ?
+					device_id.c_str() : device_name.c_str(),
+				error);
+		Release();
+		return false;
+	}
+
+	if (!obs_output_begin_data_capture(output, 0)) {
+		Release();
+		return false;
+	}
+
+	blog(LOG_INFO, "WASAPI: Monitoring on device '%s' started",
+			device_name.c_str());
+	return true;
+}
+
+void WASAPIMonitor::Stop()
+{
+	if (!monitor)
+		return;
+
+	obs_output_end_data_capture(output);
+	Release();
+
+	blog(LOG_INFO, "WASAPI: Monitoring on device '%s' stopped",
+			device_name.c_str());
+}
+
+inline void WASAPIMonitor::Push(const struct audio_data *data)
+{
+	audio_monitor_push(monitor, data);
+}
+
+/* fills whatever part of the device buffer has already been played.  the
+ * audio monitor outputs silence on its own when it runs dry */
+bool WASAPIMonitor::ProcessRenderData()
+{
+	HRESULT res;
+	UINT32  padding;
+	UINT32  frames;
+	BYTE    *buffer;
+
+	res = client->GetCurrentPadding(&padding);
+	if (FAILED(res)) {
+		if (res != AUDCLNT_E_DEVICE_INVALIDATED)
+			blog(LOG_WARNING, "[WASAPIMonitor::ProcessRenderData]"
+			                  " client->GetCurrentPadding"
+			                  " failed: %lX", res);
+		return false;
+	}
+
+	frames = bufferFrames - padding;
+	if (!frames)
+		return true;
+
+	res = render->GetBuffer(frames, &buffer);
+	if (FAILED(res)) {
+		if (res != AUDCLNT_E_DEVICE_INVALIDATED)
+			blog(LOG_WARNING, "[WASAPIMonitor::ProcessRenderData]"
+			                  " render->GetBuffer"
+			                  " failed: %lX", res);
+		return false;
+	}
+
+	audio_monitor_pop(monitor, (uint8_t*)buffer, (uint32_t)frames);
+	render->ReleaseBuffer(frames, 0);
+	return true;
+}
+
+DWORD WINAPI WASAPIMonitor::RenderThread(LPVOID param)
+{
+	WASAPIMonitor *monitor  = (WASAPIMonitor*)param;
+	DWORD         taskIndex = 0;
+	HANDLE        task;
+
+	os_thread_init(OS_THREAD_CLASS_AUDIO, "wasapi monitor");
+
+	task = AvSetMmThreadCharacteristicsW(L"Pro Audio", &taskIndex);
+	if (!task)
+		blog(LOG_WARNING, "[WASAPIMonitor::RenderThread] "
+		                  "Failed to set the thread's MMCSS "
+		                  "task: %lu", GetLastError());
+
+	HANDLE sigs[2] = {
+		monitor->renderSignal,
+		monitor->stopSignal
+	};
+
+	while (WaitForMultipleObjects(2, sigs, false, INFINITE) ==
+			WAIT_OBJECT_0) {
+		if (!monitor->ProcessRenderData()) {
+			blog(LOG_INFO, "WASAPI: Monitoring device '%s' "
+			               "invalidated",
+			               monitor->device_name.c_str());
+			obs_output_signal_stop(monitor->output,
+					OBS_OUTPUT_DISCONNECTED);
+			break;
+		}
+	}
+
+	if (task)
+		AvRevertMmThreadCharacteristics(task);
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const char *GetWASAPIMonitorName(const char *locale)
+{
+	/* TODO: translate */
+	return "Audio Monitor (WASAPI)";
+}
+
+static void GetWASAPIMonitorDefaults(obs_data_t settings)
+{
+	obs_data_set_default_string(settings, "device_id", "default");
+	obs_data_set_default_int(settings, "latency_ms", DEFAULT_LATENCY_MS);
+}
+
+static void *CreateWASAPIMonitor(obs_data_t settings, obs_output_t output)
+{
+	try {
+		return new WASAPIMonitor(settings, output);
+	} catch (const char *error) {
+		blog(LOG_ERROR, "[CreateWASAPIMonitor] %s", error);
+	}
+
+	return nullptr;
+}
+
+static void DestroyWASAPIMonitor(void *obj)
+{
+	delete static_cast<WASAPIMonitor*>(obj);
+}
+
+static bool StartWASAPIMonitor(void *obj)
+{
+	return static_cast<WASAPIMonitor*>(obj)->Start();
+}
+
+static void StopWASAPIMonitor(void *obj)
+{
+	static_cast<WASAPIMonitor*>(obj)->Stop();
+}
+
+static void UpdateWASAPIMonitor(void *obj, obs_data_t settings)
+{
+	static_cast<WASAPIMonitor*>(obj)->Update(settings);
+}
+
+static void WASAPIMonitorAudio(void *obj, struct audio_data *frames)
+{
+	static_cast<WASAPIMonitor*>(obj)->Push(frames);
+}
+
+static obs_properties_t GetWASAPIMonitorProperties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: translate */
+	obs_properties_add_async_list(props, "device_id", "Device",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING,
+			"wasapi_output_devices", FillWASAPIOutputDevices);
+	obs_properties_add_int(props, "latency_ms", "Latency (ms)",
+			AUDIO_MONITOR_MIN_LATENCY_MS * 2,
+			AUDIO_MONITOR_MAX_LATENCY_MS, 1);
+
+	return props;
+}
+
+void RegisterWASAPIMonitor()
+{
+	obs_output_info info = {};
+	info.id              = "wasapi_monitor_output";
+	info.flags           = OBS_OUTPUT_AUDIO;
+	info.getname         = GetWASAPIMonitorName;
+	info.create          = CreateWASAPIMonitor;
+	info.destroy         = DestroyWASAPIMonitor;
+	info.start           = StartWASAPIMonitor;
+	info.stop            = StopWASAPIMonitor;
+	info.update          = UpdateWASAPIMonitor;
+	info.raw_audio       = WASAPIMonitorAudio;
+	info.defaults        = GetWASAPIMonitorDefaults;
+	info.properties      = GetWASAPIMonitorProperties;
+	obs_register_output(&info);
+}
@@ -7,13 +7,12 @@
 #include <util/windows/WinHandle.hpp>
 #include <util/windows/CoTaskMemPtr.hpp>
 
+#include <avrt.h>
+
 using namespace std;
 
 static void GetWASAPIDefaults(obs_data_t settings);
 
-#define KSAUDIO_SPEAKER_4POINT1 (KSAUDIO_SPEAKER_QUAD|SPEAKER_LOW_FREQUENCY)
-#define KSAUDIO_SPEAKER_2POINT1 (KSAUDIO_SPEAKER_STEREO|SPEAKER_LOW_FREQUENCY)
-
 class WASAPISource {
 	ComPtr<IMMDevice>           device;
 	ComPtr<IAudioClient>        client;
@@ -25,6 +24,8 @@ class WASAPISource {
 	bool                        isInputDevice;
 	bool                        useDeviceTiming;
 	bool                        isDefaultDevice;
+	bool                        lowLatency;
+	int                         bufferMS;
 
 	bool                        reconnecting;
 	WinHandle                   reconnectThread;
@@ -38,6 +39,18 @@ class WASAPISource {
 	speaker_layout              speakers;
 	audio_format                format;
 	uint32_t                    sampleRate;
+	uint32_t                    blockAlign;
+
+	/* small packets are collected into fixed-size blocks before they're
+	 * output, so the audio subsystem isn't called for every packet */
+	vector<uint8_t>             batch;
+	uint32_t                    batchFrames;
+	uint32_t                    batchCount;
+	uint64_t                    batchTimestamp;
+
+	void OutputAudio(const uint8_t *data, uint32_t frames, uint64_t ts);
+	void FlushBatch();
+	void BatchAudio(const uint8_t *data, uint32_t frames, uint64_t ts);
 
 	static DWORD WINAPI ReconnectThread(LPVOID param);
 	static DWORD WINAPI CaptureThread(LPVOID param);
@@ -70,6 +83,9 @@ WASAPISource::WASAPISource(obs_data_t settings, obs_source_t source_,
 		bool input)
 	: reconnecting    (false),
 	  active          (false),
+	  batchFrames     (0),
+	  batchCount      (0),
+	  batchTimestamp  (0),
 	  reconnectThread (nullptr),
 	  captureThread   (nullptr),
 	  source          (source_),
@@ -124,12 +140,18 @@ void WASAPISource::UpdateSettings(obs_data_t settings)
 	device_id       = obs_data_getstring(settings, "device_id");
 	useDeviceTiming = obs_data_getbool(settings, "useDeviceTiming");
 	isDefaultDevice = _strcmpi(device_id.c_str(), "default") == 0;
+	lowLatency      = obs_data_getbool(settings, "low_latency");
+	bufferMS        = (int)obs_data_getint(settings, "buffer_ms");
 }
 
 void WASAPISource::Update(obs_data_t settings)
 {
 	string newDevice = obs_data_getstring(settings, "device_id");
-	bool restart = newDevice.compare(device_id) != 0;
+	bool newLowLatency = obs_data_getbool(settings, "low_latency");
+	int newBufferMS = (int)obs_data_getint(settings, "buffer_ms");
+	bool restart = newDevice.compare(device_id) != 0 ||
+	               newLowLatency != lowLatency ||
+	               (lowLatency && newBufferMS != bufferMS);
 
 	if (restart)
 		Stop();
@@ -162,12 +184,26 @@ bool WASAPISource::InitDevice(IMMDeviceEnumerator *enumerator)
 }
 
 #define BUFFER_TIME_100NS (5*10000000)
+#define MIN_BUFFER_MS     1
+#define MAX_BUFFER_MS     100
+
+/* the size of the blocks packets are batched into, or the buffer period in
+ * low latency mode */
+#define BATCH_MS          10
+
+static inline int ClampBufferMS(int ms)
+{
+	if (ms < MIN_BUFFER_MS) return MIN_BUFFER_MS;
+	if (ms > MAX_BUFFER_MS) return MAX_BUFFER_MS;
+	return ms;
+}
 
 void WASAPISource::InitClient()
 {
 	CoTaskMemPtr<WAVEFORMATEX> wfex;
 	HRESULT                    res;
 	DWORD                      flags = AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
+	REFERENCE_TIME             bufferTime = BUFFER_TIME_100NS;
 
 	res = device->Activate(__uuidof(IAudioClient), CLSCTX_ALL,
 			nullptr, (void**)client.Assign());
@@ -183,29 +219,18 @@ void WASAPISource::InitClient()
 	if (!isInputDevice)
 		flags |= AUDCLNT_STREAMFLAGS_LOOPBACK;
 
+	/* in low latency mode, the buffer only holds a few milliseconds and
+	 * the device signals as soon as each period is ready */
+	if (lowLatency)
+		bufferTime = (REFERENCE_TIME)ClampBufferMS(bufferMS) * 10000;
+
 	res = client->Initialize(
 			AUDCLNT_SHAREMODE_SHARED, flags,
-			BUFFER_TIME_100NS, 0, wfex, nullptr);
+			bufferTime, 0, wfex, nullptr);
 	if (FAILED(res))
 		throw HRError("Failed to get initialize audio client", res);
 }
 
-static speaker_layout ConvertSpeakerLayout(DWORD layout, WORD channels)
-{
-	switch (layout) {
-	case KSAUDIO_SPEAKER_QUAD:             return SPEAKERS_QUAD;
-	case KSAUDIO_SPEAKER_2POINT1:          return SPEAKERS_2POINT1;
-	case KSAUDIO_SPEAKER_4POINT1:          return SPEAKERS_4POINT1;
-	case KSAUDIO_SPEAKER_SURROUND:         return SPEAKERS_SURROUND;
-	case KSAUDIO_SPEAKER_5POINT1:          return SPEAKERS_5POINT1;
-	case KSAUDIO_SPEAKER_5POINT1_SURROUND: return SPEAKERS_5POINT1_SURROUND;
-	case KSAUDIO_SPEAKER_7POINT1:          return SPEAKERS_7POINT1;
-	case KSAUDIO_SPEAKER_7POINT1_SURROUND: return SPEAKERS_7POINT1_SURROUND;
-	}
-
-	return (speaker_layout)channels;
-}
-
 void WASAPISource::InitFormat(WAVEFORMATEX *wfex)
 {
 	DWORD layout = 0;
@@ -219,6 +244,12 @@ void WASAPISource::InitFormat(WAVEFORMATEX *wfex)
 	sampleRate = wfex->nSamplesPerSec;
 	format     = AUDIO_FORMAT_FLOAT;
 	speakers   = ConvertSpeakerLayout(layout, wfex->nChannels);
+	blockAlign = wfex->nBlockAlign;
+
+	batchFrames = sampleRate *
+		(lowLatency ? ClampBufferMS(bufferMS) : BATCH_MS) / 1000;
+	batchCount  = 0;
+	batch.resize(batchFrames * blockAlign);
 }
 
 void WASAPISource::InitCapture()
@@ -354,16 +385,11 @@ bool WASAPISource::ProcessCaptureData()
 			return false;
 		}
 
-		source_audio data    = {};
-		data.data[0]         = (const uint8_t*)buffer;
-		data.frames          = (uint32_t)frames;
-		data.speakers        = speakers;
-		data.samples_per_sec = sampleRate;
-		data.format          = format;
-		data.timestamp       = useDeviceTiming ?
-			ts*100 : os_gettime_ns();
+		if (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY)
+			FlushBatch();
 
-		obs_source_output_audio(source, &data);
+		BatchAudio((const uint8_t*)buffer, (uint32_t)frames,
+				useDeviceTiming ? ts*100 : os_gettime_ns());
 
 		capture->ReleaseBuffer(frames);
 	}
@@ -371,6 +397,59 @@ bool WASAPISource::ProcessCaptureData()
 	return true;
 }
 
+void WASAPISource::OutputAudio(const uint8_t *data, uint32_t frames,
+		uint64_t ts)
+{
+	source_audio audio    = {};
+	audio.data[0]         = data;
+	audio.frames          = frames;
+	audio.speakers        = speakers;
+	audio.samples_per_sec = sampleRate;
+	audio.format          = format;
+	audio.timestamp       = ts;
+
+	obs_source_output_audio(source, &audio);
+}
+
+void WASAPISource::FlushBatch()
+{
+	if (batchCount) {
+		OutputAudio(batch.data(), batchCount, batchTimestamp);
+		batchCount = 0;
+	}
+}
+
+/* packets that are already a full block or larger are output without being
+ * copied, everything else is copied into the current block */
+void WASAPISource::BatchAudio(const uint8_t *data, uint32_t frames,
+		uint64_t ts)
+{
+	while (frames) {
+		if (!batchCount && frames >= batchFrames) {
+			OutputAudio(data, frames, ts);
+			return;
+		}
+
+		uint32_t count = batchFrames - batchCount;
+		if (count > frames)
+			count = frames;
+
+		if (!batchCount)
+			batchTimestamp = ts;
+
+		memcpy(batch.data() + batchCount * blockAlign, data,
+				count * blockAlign);
+
+		batchCount += count;
+		frames     -= count;
+		data       += count * blockAlign;
+		ts         += (uint64_t)count * 1000000000ULL / sampleRate;
+
+		if (batchCount == batchFrames)
+			FlushBatch();
+	}
+}
+
 static inline bool WaitForCaptureSignal(DWORD numSignals, const HANDLE *signals,
 		DWORD duration)
 {
@@ -387,6 +466,21 @@ DWORD WINAPI WASAPISource::CaptureThread(LPVOID param)
 
 	/* Output devices don't signal, so just make it check every 10 ms */
 	DWORD        dur       = source->isInputDevice ? INFINITE : 10;
+	HANDLE       task      = nullptr;
+	DWORD        taskIndex = 0;
+
+	if (source->lowLatency) {
+		task = AvSetMmThreadCharacteristicsW(L"Pro Audio", &taskIndex);
+		if (!task)
+			blog(LOG_WARNING, "[WASAPISource::CaptureThread] "
+			                  "Failed to set the thread's MMCSS "
+			                  "task: %lu", GetLastError());
+
+		/* loopback only signals while something is playing, so poll
+		 * once per buffer period instead */
+		if (!source->isInputDevice)
+			dur = (DWORD)ClampBufferMS(source->bufferMS);
+	}
 
 	HANDLE sigs[2] = {
 		source->receiveSignal,
@@ -401,6 +495,10 @@ DWORD WINAPI WASAPISource::CaptureThread(LPVOID param)
 	}
 
 	source->client->Stop();
+	source->batchCount = 0;
+
+	if (task)
+		AvRevertMmThreadCharacteristics(task);
 
 	source->captureThread = nullptr;
 	source->active        = false;
@@ -432,6 +530,8 @@ static void GetWASAPIDefaults(obs_data_t settings)
 {
 	obs_data_set_default_string(settings, "device_id", "default");
 	obs_data_set_default_bool(settings, "use_device_timing", true);
+	obs_data_set_default_bool(settings, "low_latency", false);
+	obs_data_set_default_int(settings, "buffer_ms", 10);
 }
 
 static void *CreateWASAPISource(obs_data_t settings, obs_source_t source,
@@ -466,17 +566,15 @@ static void UpdateWASAPISource(void *obj, obs_data_t settings)
 	static_cast<WASAPISource*>(obj)->Update(settings);
 }
 
-static obs_properties_t GetWASAPIProperties(const char *locale, bool input)
+static void FillWASAPIDevices(obs_property_t device_prop, bool input)
 {
-	obs_properties_t props = obs_properties_create(locale);
 	vector<AudioDeviceInfo> devices;
 
-	/* TODO: translate */
-	obs_property_t device_prop = obs_properties_add_list(props,
-			"device_id", "Device",
-			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
-
+	/* this runs on the list enumeration thread */
+	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
 	GetWASAPIAudioDevices(devices, input);
+	if (SUCCEEDED(hr))
+		CoUninitialize();
 
 	if (devices.size())
 		obs_property_list_add_string(device_prop, "Default", "default");
@@ -486,11 +584,37 @@ static obs_properties_t GetWASAPIProperties(const char *locale, bool input)
 		obs_property_list_add_string(device_prop,
 				device.name.c_str(), device.id.c_str());
 	}
+}
+
+static void FillWASAPIInputDevices(obs_property_t device_prop)
+{
+	FillWASAPIDevices(device_prop, true);
+}
+
+void FillWASAPIOutputDevices(obs_property_t device_prop)
+{
+	FillWASAPIDevices(device_prop, false);
+}
+
+static obs_properties_t GetWASAPIProperties(const char *locale, bool input)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: translate */
+	obs_properties_add_async_list(props, "device_id", "Device",
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING,
+			input ? "wasapi_input_devices" : "wasapi_output_devices",
+			input ? FillWASAPIInputDevices :
+			        FillWASAPIOutputDevices);
 
 	obs_property_t prop;
 	prop = obs_properties_add_bool(props, "use_device_timing",
 			"Use Device Timing");
 
+	obs_properties_add_bool(props, "low_latency", "Low Latency Mode");
+	obs_properties_add_int(props, "buffer_ms",
+			"Low Latency Buffer (ms)", MIN_BUFFER_MS, MAX_BUFFER_MS, 1);
+
 	return props;
 }
 
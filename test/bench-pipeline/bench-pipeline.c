@@ -0,0 +1,804 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * End-to-end pipeline benchmark
+ *
+ *   Builds a scene out of the test sources, encodes it with x264 and AAC, and
+ * sends the packets to a output that either throws them away or writes them
+ * to an FLV file.  Nothing is shown on screen.  After the warmup period the
+ * profiler and the per-thread CPU times are reset, and at the end a single
+ * JSON report is written to stdout:
+ *
+ *   fps, frame drops/duplicates of the video output, frames skipped and queue
+ *   latency of the video encoder, every profile point, and the CPU time used
+ *   by each thread of the process.
+ *
+ * Log output goes to stderr so stdout only contains the report.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <obs.h>
+#include <obs-avc.h>
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <util/profiler.h>
+#include <util/threading.h>
+#include <graphics/vec2.h>
+
+#include "flv-mux.h"
+#include "bench-platform.h"
+
+struct bench_options {
+	uint32_t   duration_sec;
+	uint32_t   warmup_sec;
+	uint32_t   width;
+	uint32_t   height;
+	uint32_t   fps;
+	uint32_t   sources;
+	bool       filters;
+	bool       audio;
+	int        video_bitrate;
+	int        audio_bitrate;
+	const char *preset;
+	const char *output_path;
+};
+
+static struct bench_options options = {
+	.duration_sec  = 10,
+	.warmup_sec    = 2,
+	.width         = 1280,
+	.height        = 720,
+	.fps           = 30,
+	.sources       = 4,
+	.filters       = false,
+	.audio         = true,
+	.video_bitrate = 2500,
+	.audio_bitrate = 160,
+	.preset        = "veryfast",
+	.output_path   = NULL
+};
+
+/* ------------------------------------------------------------------------- */
+/* output */
+
+struct bench_output {
+	obs_output_t    output;
+	FILE            *file;
+
+	pthread_mutex_t mutex;
+	uint64_t        video_packets;
+	uint64_t        audio_packets;
+	uint64_t        video_bytes;
+	uint64_t        audio_bytes;
+	uint64_t        keyframes;
+};
+
+/* only one output is created, and its stats are read through this */
+static struct bench_output *bench_output;
+
+static const char *bench_output_getname(const char *locale)
+{
+	UNUSED_PARAMETER(locale);
+	return "Benchmark Output";
+}
+
+static void *bench_output_create(obs_data_t settings, obs_output_t output)
+{
+	struct bench_output *bo = bzalloc(sizeof(struct bench_output));
+	bo->output = output;
+
+	if (pthread_mutex_init(&bo->mutex, NULL) != 0) {
+		bfree(bo);
+		return NULL;
+	}
+
+	bench_output = bo;
+
+	UNUSED_PARAMETER(settings);
+	return bo;
+}
+
+static void bench_output_destroy(void *data)
+{
+	struct bench_output *bo = data;
+
+	if (bo) {
+		if (bo->file)
+			fclose(bo->file);
+		pthread_mutex_destroy(&bo->mutex);
+		bfree(bo);
+		bench_output = NULL;
+	}
+}
+
+static void write_packet(struct bench_output *bo,
+		struct encoder_packet *packet, bool is_header)
+{
+	uint8_t *data;
+	size_t  size;
+
+	flv_packet_mux(packet, &data, &size, is_header);
+	fwrite(data, 1, size, bo->file);
+	bfree(data);
+}
+
+static void write_headers(struct bench_output *bo)
+{
+	obs_encoder_t vencoder = obs_output_get_video_encoder(bo->output);
+	obs_encoder_t aencoder = obs_output_get_audio_encoder(bo->output);
+	uint8_t       *meta_data;
+	size_t        meta_data_size;
+	uint8_t       *header;
+	size_t        size;
+
+	flv_meta_data(bo->output, &meta_data, &meta_data_size, true);
+	fwrite(meta_data, 1, meta_data_size, bo->file);
+	bfree(meta_data);
+
+	if (aencoder && obs_encoder_get_extra_data(aencoder, &header, &size)) {
+		struct encoder_packet packet = {
+			.type         = OBS_ENCODER_AUDIO,
+			.timebase_den = 1,
+			.data         = header,
+			.size         = size
+		};
+
+		write_packet(bo, &packet, true);
+	}
+
+	if (obs_encoder_get_extra_data(vencoder, &header, &size)) {
+		struct encoder_packet packet = {
+			.type         = OBS_ENCODER_VIDEO,
+			.timebase_den = 1,
+			.keyframe     = true
+		};
+
+		packet.size = obs_parse_avc_header(&packet.data, header, size);
+		write_packet(bo, &packet, true);
+		bfree(packet.data);
+	}
+}
+
+static bool bench_output_start(void *data)
+{
+	struct bench_output *bo = data;
+	uint32_t flags = options.audio ? 0 : OBS_OUTPUT_VIDEO;
+
+	if (!obs_output_can_begin_data_capture(bo->output, flags))
+		return false;
+	if (!obs_output_initialize_encoders(bo->output, flags))
+		return false;
+
+	if (options.output_path) {
+		bo->file = os_fopen(options.output_path, "wb");
+		if (!bo->file) {
+			blog(LOG_ERROR, "bench_output_start: Failed to open "
+			                "'%s'", options.output_path);
+			return false;
+		}
+
+		write_headers(bo);
+	}
+
+	return obs_output_begin_data_capture(bo->output, flags);
+}
+
+static void bench_output_stop(void *data)
+{
+	struct bench_output *bo = data;
+
+	obs_output_end_data_capture(bo->output);
+
+	if (bo->file) {
+		fclose(bo->file);
+		bo->file = NULL;
+	}
+}
+
+static void bench_output_data(void *data, struct encoder_packet *packet)
+{
+	struct bench_output   *bo   = data;
+	bool                  video = packet->type == OBS_ENCODER_VIDEO;
+	struct encoder_packet avc_packet;
+
+	pthread_mutex_lock(&bo->mutex);
+
+	if (video) {
+		bo->video_packets++;
+		bo->video_bytes += packet->size;
+		if (packet->keyframe)
+			bo->keyframes++;
+	} else {
+		bo->audio_packets++;
+		bo->audio_bytes += packet->size;
+	}
+
+	if (bo->file) {
+		if (video) {
+			obs_parse_avc_packet(&avc_packet, packet);
+			write_packet(bo, &avc_packet, false);
+			obs_encoder_packet_release(&avc_packet);
+		} else {
+			write_packet(bo, packet, false);
+		}
+	}
+
+	pthread_mutex_unlock(&bo->mutex);
+}
+
+static void bench_output_reset_stats(struct bench_output *bo)
+{
+	pthread_mutex_lock(&bo->mutex);
+	bo->video_packets = 0;
+	bo->audio_packets = 0;
+	bo->video_bytes   = 0;
+	bo->audio_bytes   = 0;
+	bo->keyframes     = 0;
+	pthread_mutex_unlock(&bo->mutex);
+}
+
+static struct obs_output_info bench_output_info = {
+	.id             = "bench_output",
+	.flags          = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED,
+	.getname        = bench_output_getname,
+	.create         = bench_output_create,
+	.destroy        = bench_output_destroy,
+	.start          = bench_output_start,
+	.stop           = bench_output_stop,
+	.encoded_packet = bench_output_data
+};
+
+/* ------------------------------------------------------------------------- */
+/* thread cpu times */
+
+typedef DARRAY(struct bench_thread_cpu) thread_cpu_array_t;
+
+static void add_thread_cpu(void *param, const struct bench_thread_cpu *cpu)
+{
+	struct darray *threads = param;
+	darray_push_back(sizeof(struct bench_thread_cpu), threads, cpu);
+}
+
+static void snapshot_threads(thread_cpu_array_t *threads)
+{
+	threads->num = 0;
+	bench_enum_thread_cpu(add_thread_cpu, &threads->da);
+}
+
+static uint64_t get_start_cpu_ns(const thread_cpu_array_t *start, uint64_t id)
+{
+	for (size_t i = 0; i < start->num; i++) {
+		if (start->array[i].id == id)
+			return start->array[i].cpu_ns;
+	}
+
+	/* threads started after the snapshot used no time before it */
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* video output counters, which count from the start of the video output */
+
+struct video_counts {
+	uint32_t rendered;
+	uint32_t duplicated;
+	uint32_t late;
+};
+
+static void get_video_counts(struct video_counts *counts)
+{
+	video_t video = obs_video();
+
+	counts->rendered   = video_output_get_frames_rendered(video);
+	counts->duplicated = video_output_get_frames_duplicated(video);
+	counts->late       = video_output_get_frames_late(video);
+}
+
+/* ------------------------------------------------------------------------- */
+/* setup */
+
+static void do_log(int log_level, const char *msg, va_list args, void *param)
+{
+	if (log_level <= LOG_INFO) {
+		vfprintf(stderr, msg, args);
+		fputc('\n', stderr);
+	}
+
+	UNUSED_PARAMETER(param);
+}
+
+static bool reset_video(void)
+{
+	struct obs_video_info ovi;
+	memset(&ovi, 0, sizeof(ovi));
+
+	ovi.graphics_module = "libobs-opengl";
+	ovi.fps_num         = options.fps;
+	ovi.fps_den         = 1;
+	ovi.base_width      = options.width;
+	ovi.base_height     = options.height;
+	ovi.output_width    = options.width;
+	ovi.output_height   = options.height;
+	ovi.output_format   = VIDEO_FORMAT_NV12;
+	ovi.window_width    = options.width;
+	ovi.window_height   = options.height;
+	ovi.gpu_conversion  = true;
+
+	if (!bench_window_create(&ovi.window, options.width, options.height)) {
+		blog(LOG_ERROR, "Failed to create the offscreen window");
+		return false;
+	}
+
+	return obs_reset_video(&ovi);
+}
+
+static bool reset_audio(void)
+{
+	struct audio_output_info ai;
+	memset(&ai, 0, sizeof(ai));
+
+	ai.name            = "Benchmark Audio";
+	ai.samples_per_sec = 48000;
+	ai.format          = AUDIO_FORMAT_FLOAT;
+	ai.speakers        = SPEAKERS_STEREO;
+	ai.buffer_ms       = 700;
+
+	return obs_reset_audio(&ai);
+}
+
+/* lays the sources out in a grid that covers the canvas */
+static obs_scene_t create_scene(void)
+{
+	obs_scene_t scene = obs_scene_create("bench scene");
+	uint32_t    cols  = 1;
+
+	while (cols * cols < options.sources)
+		cols++;
+
+	uint32_t rows    = (options.sources + cols - 1) / cols;
+	float    cell_cx = (float)options.width  / (float)cols;
+	float    cell_cy = (float)options.height / (float)rows;
+
+	for (uint32_t i = 0; i < options.sources; i++) {
+		obs_source_t    source;
+		obs_sceneitem_t item;
+		struct vec2     pos, scale;
+		char            name[32];
+
+		sprintf(name, "random %u", i);
+		source = obs_source_create(OBS_SOURCE_TYPE_INPUT, "random",
+				name, NULL);
+		if (!source)
+			continue;
+
+		if (options.filters) {
+			obs_source_t filter;
+
+			sprintf(name, "filter %u", i);
+			filter = obs_source_create(OBS_SOURCE_TYPE_FILTER,
+					"test_filter", name, NULL);
+			if (filter) {
+				obs_source_filter_add(source, filter);
+				obs_source_release(filter);
+			}
+		}
+
+		/* the random source is 20x20 */
+		vec2_set(&pos, cell_cx * (float)(i % cols),
+				cell_cy * (float)(i / cols));
+		vec2_set(&scale, cell_cx / 20.0f, cell_cy / 20.0f);
+
+		item = obs_scene_add(scene, source);
+		obs_sceneitem_setpos(item, &pos);
+		obs_sceneitem_setscale(item, &scale);
+
+		obs_source_release(source);
+	}
+
+	return scene;
+}
+
+static obs_encoder_t create_video_encoder(void)
+{
+	obs_data_t    settings = obs_data_create();
+	obs_encoder_t encoder;
+
+	obs_data_setint(settings, "bitrate", options.video_bitrate);
+	obs_data_setbool(settings, "cbr", true);
+	obs_data_setstring(settings, "preset", options.preset);
+
+	encoder = obs_video_encoder_create("obs_x264", "bench_x264", settings);
+	obs_data_release(settings);
+
+	if (encoder)
+		obs_encoder_set_video(encoder, obs_video());
+	return encoder;
+}
+
+static obs_encoder_t create_audio_encoder(void)
+{
+	obs_data_t    settings = obs_data_create();
+	obs_encoder_t encoder;
+
+	obs_data_setint(settings, "bitrate", options.audio_bitrate);
+
+	encoder = obs_audio_encoder_create("ffmpeg_aac", "bench_aac",
+			settings);
+	obs_data_release(settings);
+
+	if (encoder)
+		obs_encoder_set_audio(encoder, obs_audio());
+	return encoder;
+}
+
+/* ------------------------------------------------------------------------- */
+/* report */
+
+static long long get_encoder_int(obs_encoder_t encoder, const char *proc,
+		const char *param)
+{
+	struct calldata data;
+	long long       val = 0;
+
+	calldata_init(&data);
+	if (proc_handler_call(obs_encoder_prochandler(encoder), proc, &data))
+		val = calldata_int(&data, param);
+	calldata_free(&data);
+
+	return val;
+}
+
+static void print_json_string(const char *str)
+{
+	putchar('"');
+
+	for (; *str; str++) {
+		unsigned char ch = (unsigned char)*str;
+
+		if (ch == '"' || ch == '\\')
+			printf("\\%c", ch);
+		else if (ch < 0x20)
+			printf("\\u%04x", ch);
+		else
+			putchar(ch);
+	}
+
+	putchar('"');
+}
+
+static bool print_profile_point(void *param, profile_point_t point)
+{
+	bool                 *first = param;
+	struct profile_stats stats;
+
+	if (!profile_point_get_stats(point, &stats) || !stats.samples)
+		return true;
+
+	printf("%s\n\t\t{\"name\": ", *first ? "" : ",");
+	print_json_string(profile_point_name(point));
+	printf(", \"samples\": %"PRIu64", \"min_ns\": %"PRIu64
+	       ", \"avg_ns\": %"PRIu64", \"p99_ns\": %"PRIu64
+	       ", \"max_ns\": %"PRIu64"}",
+	       (uint64_t)stats.samples, stats.min_ns, stats.avg_ns,
+	       stats.p99_ns, stats.max_ns);
+
+	*first = false;
+	return true;
+}
+
+static void print_threads(const thread_cpu_array_t *start,
+		const thread_cpu_array_t *end, uint64_t wall_ns)
+{
+	uint64_t total_ns = 0;
+
+	printf("\t\"threads\": [");
+
+	for (size_t i = 0; i < end->num; i++) {
+		const struct bench_thread_cpu *thread = end->array + i;
+		uint64_t start_ns = get_start_cpu_ns(start, thread->id);
+		uint64_t used_ns  = thread->cpu_ns > start_ns ?
+			thread->cpu_ns - start_ns : 0;
+
+		total_ns += used_ns;
+
+		printf("%s\n\t\t{\"id\": %"PRIu64", \"name\": ",
+				i ? "," : "", thread->id);
+		print_json_string(thread->name);
+		printf(", \"cpu_ns\": %"PRIu64", \"cpu_percent\": %.2f}",
+				used_ns, (double)used_ns * 100.0 /
+				(double)wall_ns);
+	}
+
+	printf("\n\t],\n");
+	printf("\t\"process_cpu_percent\": %.2f\n",
+			(double)total_ns * 100.0 / (double)wall_ns);
+}
+
+static void print_report(struct bench_output *bo, obs_encoder_t vencoder,
+		const struct video_counts *start_counts,
+		const thread_cpu_array_t *start,
+		const thread_cpu_array_t *end, uint64_t wall_ns)
+{
+	struct video_counts counts;
+	double              seconds = (double)wall_ns / 1000000000.0;
+	bool                first   = true;
+
+	get_video_counts(&counts);
+
+	pthread_mutex_lock(&bo->mutex);
+
+	printf("{\n");
+	printf("\t\"duration_sec\": %.3f,\n", seconds);
+	printf("\t\"width\": %u, \"height\": %u, \"target_fps\": %u,\n",
+			options.width, options.height, options.fps);
+	printf("\t\"sources\": %u, \"filters\": %s, \"audio\": %s,\n",
+			options.sources, options.filters ? "true" : "false",
+			options.audio ? "true" : "false");
+	printf("\t\"preset\": ");
+	print_json_string(options.preset);
+	printf(",\n");
+
+	printf("\t\"fps\": %.2f,\n", (double)bo->video_packets / seconds);
+	printf("\t\"video_packets\": %"PRIu64", \"keyframes\": %"PRIu64
+	       ", \"video_kbps\": %.1f,\n",
+	       bo->video_packets, bo->keyframes,
+	       (double)bo->video_bytes * 8.0 / 1000.0 / seconds);
+	printf("\t\"audio_packets\": %"PRIu64", \"audio_kbps\": %.1f,\n",
+			bo->audio_packets,
+			(double)bo->audio_bytes * 8.0 / 1000.0 / seconds);
+
+	pthread_mutex_unlock(&bo->mutex);
+
+	printf("\t\"frames_rendered\": %u, \"frames_duplicated\": %u"
+	       ", \"frames_late\": %u,\n",
+	       counts.rendered   - start_counts->rendered,
+	       counts.duplicated - start_counts->duplicated,
+	       counts.late       - start_counts->late);
+	printf("\t\"encoder_frames_skipped\": %lld"
+	       ", \"encoder_queue_latency_ns\": %lld,\n",
+	       get_encoder_int(vencoder, "get_frames_skipped",
+		       "frames_skipped"),
+	       get_encoder_int(vencoder, "get_queue_latency", "latency_ns"));
+
+	printf("\t\"stages\": [");
+	profiler_enum_points(print_profile_point, &first);
+	printf("\n\t],\n");
+
+	print_threads(start, end, wall_ns);
+	printf("}\n");
+	fflush(stdout);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void print_usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  --duration <sec>     measured time (default 10)\n"
+		"  --warmup <sec>       time before measuring (default 2)\n"
+		"  --width <px>         canvas width (default 1280)\n"
+		"  --height <px>        canvas height (default 720)\n"
+		"  --fps <fps>          frame rate (default 30)\n"
+		"  --sources <count>    random sources in the scene "
+		"(default 4)\n"
+		"  --filters            adds a test filter to each source\n"
+		"  --no-audio           encodes video only\n"
+		"  --vbitrate <kbps>    x264 bitrate (default 2500)\n"
+		"  --abitrate <kbps>    aac bitrate (default 160)\n"
+		"  --preset <name>      x264 preset (default veryfast)\n"
+		"  --output <file.flv>  writes the packets to a file instead "
+		"of discarding them\n",
+		name);
+}
+
+static bool get_uint_arg(int argc, char *argv[], int *i, uint32_t *val,
+		uint32_t min_val)
+{
+	if (*i + 1 >= argc)
+		return false;
+
+	*val = (uint32_t)strtoul(argv[++(*i)], NULL, 10);
+	return *val >= min_val;
+}
+
+static bool parse_args(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		uint32_t   val;
+		bool       success = true;
+
+		if (strcmp(arg, "--duration") == 0) {
+			success = get_uint_arg(argc, argv, &i,
+					&options.duration_sec, 1);
+		} else if (strcmp(arg, "--warmup") == 0) {
+			success = get_uint_arg(argc, argv, &i,
+					&options.warmup_sec, 0);
+		} else if (strcmp(arg, "--width") == 0) {
+			success = get_uint_arg(argc, argv, &i,
+					&options.width, 16);
+		} else if (strcmp(arg, "--height") == 0) {
+			success = get_uint_arg(argc, argv, &i,
+					&options.height, 16);
+		} else if (strcmp(arg, "--fps") == 0) {
+			success = get_uint_arg(argc, argv, &i,
+					&options.fps, 1);
+		} else if (strcmp(arg, "--sources") == 0) {
+			success = get_uint_arg(argc, argv, &i,
+					&options.sources, 0);
+		} else if (strcmp(arg, "--filters") == 0) {
+			options.filters = true;
+		} else if (strcmp(arg, "--no-audio") == 0) {
+			options.audio = false;
+		} else if (strcmp(arg, "--vbitrate") == 0) {
+			success = get_uint_arg(argc, argv, &i, &val, 1);
+			options.video_bitrate = (int)val;
+		} else if (strcmp(arg, "--abitrate") == 0) {
+			success = get_uint_arg(argc, argv, &i, &val, 1);
+			options.audio_bitrate = (int)val;
+		} else if (strcmp(arg, "--preset") == 0 && i + 1 < argc) {
+			options.preset = argv[++i];
+		} else if (strcmp(arg, "--output") == 0 && i + 1 < argc) {
+			options.output_path = argv[++i];
+		} else {
+			success = false;
+		}
+
+		if (!success) {
+			fprintf(stderr, "invalid argument '%s'\n", arg);
+			return false;
+		}
+	}
+
+	/* NV12 needs even dimensions */
+	options.width  &= ~1;
+	options.height &= ~1;
+	return true;
+}
+
+static int run_benchmark(void)
+{
+	thread_cpu_array_t  start_cpu = {0};
+	thread_cpu_array_t  end_cpu   = {0};
+	obs_scene_t         scene     = NULL;
+	obs_source_t        sinewave  = NULL;
+	obs_encoder_t       vencoder  = NULL;
+	obs_encoder_t       aencoder  = NULL;
+	obs_output_t        output    = NULL;
+	struct bench_output *bo;
+	struct video_counts start_counts;
+	uint64_t            start_ns;
+	int                 ret       = 1;
+
+	scene = create_scene();
+	obs_set_output_source(0, obs_scene_getsource(scene));
+
+	if (options.audio) {
+		sinewave = obs_source_create(OBS_SOURCE_TYPE_INPUT,
+				"test_sinewave", "sinewave", NULL);
+		obs_set_output_source(1, sinewave);
+	}
+
+	vencoder = create_video_encoder();
+	if (!vencoder) {
+		blog(LOG_ERROR, "Failed to create the x264 encoder");
+		goto cleanup;
+	}
+
+	if (options.audio) {
+		aencoder = create_audio_encoder();
+		if (!aencoder) {
+			blog(LOG_ERROR, "Failed to create the aac encoder");
+			goto cleanup;
+		}
+	}
+
+	output = obs_output_create("bench_output", "bench output", NULL);
+	if (!output)
+		goto cleanup;
+
+	obs_output_set_video_encoder(output, vencoder);
+	if (aencoder)
+		obs_output_set_audio_encoder(output, aencoder);
+
+	profiler_enable(true);
+
+	if (!obs_output_start(output)) {
+		blog(LOG_ERROR, "Failed to start the output");
+		goto cleanup;
+	}
+
+	os_sleep_ms(options.warmup_sec * 1000);
+
+	bo = bench_output;
+	bench_output_reset_stats(bo);
+	profiler_reset();
+	get_video_counts(&start_counts);
+	snapshot_threads(&start_cpu);
+	start_ns = os_gettime_ns();
+
+	os_sleep_ms(options.duration_sec * 1000);
+
+	snapshot_threads(&end_cpu);
+	print_report(bo, vencoder, &start_counts, &start_cpu, &end_cpu,
+			os_gettime_ns() - start_ns);
+
+	obs_output_stop(output);
+	ret = 0;
+
+cleanup:
+	obs_output_destroy(output);
+	obs_encoder_destroy(vencoder);
+	obs_encoder_destroy(aencoder);
+
+	obs_set_output_source(0, NULL);
+	obs_set_output_source(1, NULL);
+	obs_source_release(sinewave);
+	obs_scene_release(scene);
+
+	da_free(start_cpu);
+	da_free(end_cpu);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = 1;
+
+	if (!parse_args(argc, argv)) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	base_set_log_handler(do_log, NULL);
+
+	if (!obs_startup()) {
+		blog(LOG_ERROR, "Couldn't start OBS");
+		return 1;
+	}
+
+	if (!reset_video()) {
+		blog(LOG_ERROR, "Couldn't initialize video");
+		goto shutdown;
+	}
+
+	if (!reset_audio()) {
+		blog(LOG_ERROR, "Couldn't initialize audio");
+		goto shutdown;
+	}
+
+	obs_load_module("test-input");
+	obs_load_module("obs-x264");
+	obs_load_module("obs-ffmpeg");
+	obs_register_output(&bench_output_info);
+
+	ret = run_benchmark();
+
+shutdown:
+	obs_shutdown();
+	bench_window_destroy();
+
+	blog(LOG_INFO, "Number of memory leaks: %ld", bnum_allocs());
+	return ret;
+}
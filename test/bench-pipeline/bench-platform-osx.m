@@ -0,0 +1,113 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <mach/mach.h>
+
+#import <Cocoa/Cocoa.h>
+
+#include "bench-platform.h"
+
+static NSWindow *window = nil;
+
+/* the window is never ordered front, so its view is never drawn on screen */
+bool bench_window_create(struct gs_window *gs_window, uint32_t cx,
+		uint32_t cy)
+{
+	[NSApplication sharedApplication];
+
+	window = [[NSWindow alloc]
+		initWithContentRect:NSMakeRect(0, 0, cx, cy)
+		styleMask:NSBorderlessWindowMask
+		backing:NSBackingStoreBuffered
+		defer:NO];
+	if (!window)
+		return false;
+
+	window.releasedWhenClosed = NO;
+
+	gs_window->view = window.contentView;
+	return true;
+}
+
+void bench_window_destroy(void)
+{
+	[window close];
+	window = nil;
+}
+
+static inline uint64_t time_value_to_ns(time_value_t time)
+{
+	return (uint64_t)time.seconds * 1000000000ULL +
+	       (uint64_t)time.microseconds * 1000ULL;
+}
+
+bool bench_enum_thread_cpu(
+		void (*callback)(void *param, const struct bench_thread_cpu *cpu),
+		void *param)
+{
+	thread_act_array_t     threads;
+	mach_msg_type_number_t count;
+
+	if (task_threads(mach_task_self(), &threads, &count) != KERN_SUCCESS)
+		return false;
+
+	for (mach_msg_type_number_t i = 0; i < count; i++) {
+		struct bench_thread_cpu       cpu;
+		struct thread_basic_info      basic;
+		struct thread_identifier_info ident;
+		struct thread_extended_info   extended;
+		mach_msg_type_number_t        size;
+
+		size = THREAD_BASIC_INFO_COUNT;
+		if (thread_info(threads[i], THREAD_BASIC_INFO,
+					(thread_info_t)&basic, &size) != KERN_SUCCESS)
+			goto next;
+
+		memset(&cpu, 0, sizeof(cpu));
+		cpu.cpu_ns = time_value_to_ns(basic.user_time) +
+		             time_value_to_ns(basic.system_time);
+
+		size = THREAD_IDENTIFIER_INFO_COUNT;
+		if (thread_info(threads[i], THREAD_IDENTIFIER_INFO,
+					(thread_info_t)&ident, &size) == KERN_SUCCESS)
+			cpu.id = ident.thread_id;
+		else
+			cpu.id = threads[i];
+
+		size = THREAD_EXTENDED_INFO_COUNT;
+		if (thread_info(threads[i], THREAD_EXTENDED_INFO,
+					(thread_info_t)&extended, &size) == KERN_SUCCESS)
+			strlcpy(cpu.name, extended.pth_name,
+					BENCH_THREAD_NAME_SIZE);
+
+		if (!*cpu.name)
+			snprintf(cpu.name, BENCH_THREAD_NAME_SIZE, "thread %llu",
+					(unsigned long long)cpu.id);
+
+		callback(param, &cpu);
+
+next:
+		mach_port_deallocate(mach_task_self(), threads[i]);
+	}
+
+	vm_deallocate(mach_task_self(), (vm_address_t)threads,
+			count * sizeof(thread_act_t));
+	return true;
+}
@@ -0,0 +1,148 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+
+#include <stdio.h>
+#include <windows.h>
+#include <tlhelp32.h>
+
+#include "bench-platform.h"
+
+static HWND window = NULL;
+
+static LRESULT CALLBACK bench_window_proc(HWND hwnd, UINT message,
+		WPARAM wparam, LPARAM lparam)
+{
+	return DefWindowProcW(hwnd, message, wparam, lparam);
+}
+
+/* a popup window that's never shown, so nothing appears on the screen or in
+ * the task bar */
+bool bench_window_create(struct gs_window *gs_window, uint32_t cx,
+		uint32_t cy)
+{
+	WNDCLASSW wc;
+
+	memset(&wc, 0, sizeof(wc));
+	wc.lpszClassName = L"obs-bench-pipeline";
+	wc.hInstance     = GetModuleHandleW(NULL);
+	wc.lpfnWndProc   = bench_window_proc;
+
+	if (!RegisterClassW(&wc))
+		return false;
+
+	window = CreateWindowExW(0, wc.lpszClassName, L"obs-bench-pipeline",
+			WS_POPUP, 0, 0, cx, cy, NULL, NULL, wc.hInstance,
+			NULL);
+	if (!window)
+		return false;
+
+	gs_window->hwnd = window;
+	return true;
+}
+
+void bench_window_destroy(void)
+{
+	if (window) {
+		DestroyWindow(window);
+		window = NULL;
+	}
+}
+
+static inline uint64_t filetime_to_ns(const FILETIME *time)
+{
+	ULARGE_INTEGER val;
+	val.LowPart  = time->dwLowDateTime;
+	val.HighPart = time->dwHighDateTime;
+	return val.QuadPart * 100;
+}
+
+typedef HRESULT (WINAPI *get_thread_description_t)(HANDLE, PWSTR*);
+
+/* thread descriptions are only available on newer versions of windows */
+static void get_thread_name(HANDLE thread, DWORD id, char *name)
+{
+	static get_thread_description_t get_thread_description = NULL;
+	static bool                     loaded = false;
+	wchar_t                         *desc = NULL;
+
+	if (!loaded) {
+		HMODULE kernel32 = GetModuleHandleW(L"kernel32");
+		get_thread_description = (get_thread_description_t)
+			GetProcAddress(kernel32, "GetThreadDescription");
+		loaded = true;
+	}
+
+	name[0] = 0;
+
+	if (get_thread_description &&
+	    SUCCEEDED(get_thread_description(thread, &desc)) && desc) {
+		if (!WideCharToMultiByte(CP_UTF8, 0, desc, -1, name,
+					BENCH_THREAD_NAME_SIZE, NULL, NULL))
+			name[0] = 0;
+		LocalFree(desc);
+	}
+
+	if (!*name)
+		sprintf(name, "thread %lu", id);
+}
+
+bool bench_enum_thread_cpu(
+		void (*callback)(void *param, const struct bench_thread_cpu *cpu),
+		void *param)
+{
+	DWORD         process_id = GetCurrentProcessId();
+	THREADENTRY32 entry;
+	HANDLE        snapshot;
+
+	snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+	if (snapshot == INVALID_HANDLE_VALUE)
+		return false;
+
+	entry.dwSize = sizeof(entry);
+
+	if (Thread32First(snapshot, &entry)) {
+		do {
+			struct bench_thread_cpu cpu;
+			FILETIME create, exit, kernel, user;
+			HANDLE   thread;
+
+			if (entry.th32OwnerProcessID != process_id)
+				continue;
+
+			thread = OpenThread(THREAD_QUERY_LIMITED_INFORMATION,
+					false, entry.th32ThreadID);
+			if (!thread)
+				continue;
+
+			if (GetThreadTimes(thread, &create, &exit, &kernel,
+						&user)) {
+				cpu.id     = entry.th32ThreadID;
+				cpu.cpu_ns = filetime_to_ns(&kernel) +
+				             filetime_to_ns(&user);
+				get_thread_name(thread, entry.th32ThreadID,
+						cpu.name);
+				callback(param, &cpu);
+			}
+
+			CloseHandle(thread);
+		} while (Thread32Next(snapshot, &entry));
+	}
+
+	CloseHandle(snapshot);
+	return true;
+}
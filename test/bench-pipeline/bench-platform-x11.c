@@ -0,0 +1,139 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <X11/Xlib.h>
+
+#include "bench-platform.h"
+
+static Display *display = NULL;
+static Window  window   = 0;
+
+/* the opengl module creates its own child window with a matching visual, so
+ * this window only needs to exist, and is never mapped */
+bool bench_window_create(struct gs_window *gs_window, uint32_t cx,
+		uint32_t cy)
+{
+	display = XOpenDisplay(NULL);
+	if (!display) {
+		fprintf(stderr, "bench_window_create: Failed to open the X "
+		                "display (is an X server or Xvfb running?)\n");
+		return false;
+	}
+
+	window = XCreateSimpleWindow(display, DefaultRootWindow(display),
+			0, 0, cx, cy, 0, 0, 0);
+	if (!window) {
+		XCloseDisplay(display);
+		display = NULL;
+		return false;
+	}
+
+	XSync(display, false);
+
+	gs_window->id      = (uint32_t)window;
+	gs_window->display = display;
+	return true;
+}
+
+void bench_window_destroy(void)
+{
+	if (display) {
+		if (window)
+			XDestroyWindow(display, window);
+		XCloseDisplay(display);
+
+		display = NULL;
+		window  = 0;
+	}
+}
+
+/* /proc/self/task/<tid>/stat: the name is in parentheses and may contain
+ * spaces, so the remaining fields are parsed from after the last ')' */
+static bool read_thread_stat(const char *tid, long ticks_per_sec,
+		struct bench_thread_cpu *cpu)
+{
+	char        path[64];
+	char        buf[1024];
+	char        *name_start, *name_end;
+	unsigned long long utime, stime;
+	size_t      len;
+	FILE        *file;
+
+	snprintf(path, sizeof(path), "/proc/self/task/%s/stat", tid);
+	file = fopen(path, "r");
+
+	if (!file)
+		return false;
+
+	len = fread(buf, 1, sizeof(buf) - 1, file);
+	fclose(file);
+	buf[len] = 0;
+
+	name_start = strchr(buf, '(');
+	name_end   = strrchr(buf, ')');
+	if (!name_start || !name_end || name_end < name_start)
+		return false;
+
+	/* skips state, ppid, pgrp, session, tty_nr, tpgid, flags, minflt,
+	 * cminflt, majflt, cmajflt to get to utime and stime */
+	if (sscanf(name_end + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u "
+	                         "%*u %llu %llu", &utime, &stime) != 2)
+		return false;
+
+	len = name_end - name_start - 1;
+	if (len >= BENCH_THREAD_NAME_SIZE)
+		len = BENCH_THREAD_NAME_SIZE - 1;
+
+	memcpy(cpu->name, name_start + 1, len);
+	cpu->name[len] = 0;
+	cpu->id        = strtoull(tid, NULL, 10);
+	cpu->cpu_ns    = (utime + stime) * 1000000000ULL /
+		(unsigned long long)ticks_per_sec;
+	return true;
+}
+
+bool bench_enum_thread_cpu(
+		void (*callback)(void *param, const struct bench_thread_cpu *cpu),
+		void *param)
+{
+	long          ticks_per_sec = sysconf(_SC_CLK_TCK);
+	DIR           *dir;
+	struct dirent *entry;
+
+	dir = opendir("/proc/self/task");
+	if (!dir)
+		return false;
+
+	while ((entry = readdir(dir)) != NULL) {
+		struct bench_thread_cpu cpu;
+
+		if (entry->d_name[0] == '.')
+			continue;
+
+		if (read_thread_stat(entry->d_name, ticks_per_sec, &cpu))
+			callback(param, &cpu);
+	}
+
+	closedir(dir);
+	return true;
+}
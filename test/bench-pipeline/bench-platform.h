@@ -0,0 +1,55 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <util/c99defs.h>
+#include <graphics/graphics.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Platform parts of the pipeline benchmark
+ *
+ *   The graphics subsystem needs a native window to create its context on,
+ * so an invisible window is created that's never shown or presented to.
+ */
+
+bool bench_window_create(struct gs_window *window, uint32_t cx,
+		uint32_t cy);
+void bench_window_destroy(void);
+
+#define BENCH_THREAD_NAME_SIZE 64
+
+struct bench_thread_cpu {
+	uint64_t id;
+	char     name[BENCH_THREAD_NAME_SIZE];
+
+	/* user + kernel time the thread has used so far */
+	uint64_t cpu_ns;
+};
+
+/** Calls the callback for each thread of the process */
+bool bench_enum_thread_cpu(
+		void (*callback)(void *param, const struct bench_thread_cpu *cpu),
+		void *param);
+
+#ifdef __cplusplus
+}
+#endif
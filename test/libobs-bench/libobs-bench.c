@@ -0,0 +1,782 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * Microbenchmarks for libobs hot paths
+ *
+ *   Usage: libobs-bench [--runs N] [--list] [name filters...]
+ *
+ *   Every benchmark is run once to warm up and then N times (5 by default)
+ * with a fixed number of iterations and fixed input data, so results can be
+ * compared between builds.  Results are written to stdout as one JSON object
+ * per line, everything else goes to the log (stderr).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <util/bmem.h>
+#include <util/base.h>
+#include <util/darray.h>
+#include <util/circlebuf.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <callback/signal.h>
+#include <media-io/audio-io.h>
+#include <media-io/format-conversion.h>
+#include <obs.h>
+#include <obs-avc.h>
+
+#include "flv-mux.h"
+
+#define DEFAULT_RUNS 5
+#define MAX_RUNS     100
+
+struct bench_info {
+	const char *name;
+	uint64_t   iterations;
+
+	/* bytes processed per iteration, for throughput, or 0 */
+	size_t     bytes;
+
+	void *(*create)(void);
+	void (*destroy)(void *data);
+
+	/* returns the time that was measured in nanoseconds, or 0 to use the
+	 * time the whole call took */
+	uint64_t (*run)(void *data, uint64_t iterations);
+};
+
+/* keeps the compiler from optimizing away results */
+static volatile uintptr_t bench_sink;
+
+/* fixed seed so every run uses the same data */
+static uint32_t bench_rand_state = 0x1234567;
+
+static inline uint32_t bench_rand(void)
+{
+	bench_rand_state = bench_rand_state * 1103515245 + 12345;
+	return bench_rand_state >> 8;
+}
+
+static void fill_random(uint8_t *data, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		data[i] = (uint8_t)bench_rand();
+}
+
+/* ------------------------------------------------------------------------- */
+/* format conversion */
+
+#define FRAME_CX 1920
+#define FRAME_CY 1080
+
+struct frame_data {
+	uint8_t  *packed;
+	uint32_t packed_linesize;
+
+	uint8_t  *planes[3];
+	uint32_t plane_linesize[3];
+
+	uint8_t  *packed_422;
+	uint32_t packed_422_linesize;
+};
+
+static void *frame_create(void)
+{
+	struct frame_data *frame = bzalloc(sizeof(struct frame_data));
+
+	frame->packed_linesize     = FRAME_CX * 4;
+	frame->packed_422_linesize = FRAME_CX * 2;
+	frame->plane_linesize[0]   = FRAME_CX;
+	frame->plane_linesize[1]   = FRAME_CX / 2;
+	frame->plane_linesize[2]   = FRAME_CX / 2;
+
+	frame->packed     = bmalloc(frame->packed_linesize * FRAME_CY);
+	frame->packed_422 = bmalloc(frame->packed_422_linesize * FRAME_CY);
+
+	/* the nv12 chroma plane is twice the size of an i420 one, so
+	 * plane 1 has room for either */
+	frame->planes[0] = bmalloc(FRAME_CX * FRAME_CY);
+	frame->planes[1] = bmalloc(FRAME_CX * FRAME_CY / 2);
+	frame->planes[2] = bmalloc(FRAME_CX * FRAME_CY / 4);
+
+	fill_random(frame->packed, frame->packed_linesize * FRAME_CY);
+	fill_random(frame->packed_422, frame->packed_422_linesize * FRAME_CY);
+	fill_random(frame->planes[0], FRAME_CX * FRAME_CY);
+	fill_random(frame->planes[1], FRAME_CX * FRAME_CY / 2);
+	fill_random(frame->planes[2], FRAME_CX * FRAME_CY / 4);
+	return frame;
+}
+
+static void frame_destroy(void *data)
+{
+	struct frame_data *frame = data;
+
+	bfree(frame->packed);
+	bfree(frame->packed_422);
+	for (size_t i = 0; i < 3; i++)
+		bfree(frame->planes[i]);
+	bfree(frame);
+}
+
+static uint64_t run_compress_i420(void *data, uint64_t iterations)
+{
+	struct frame_data *frame = data;
+
+	for (uint64_t i = 0; i < iterations; i++)
+		compress_uyvx_to_i420(frame->packed, frame->packed_linesize,
+				0, FRAME_CY, frame->planes,
+				frame->plane_linesize);
+	return 0;
+}
+
+static uint64_t run_compress_i420_c(void *data, uint64_t iterations)
+{
+	struct frame_data *frame = data;
+
+	for (uint64_t i = 0; i < iterations; i++)
+		compress_uyvx_to_i420_c(frame->packed, frame->packed_linesize,
+				0, FRAME_CY, frame->planes,
+				frame->plane_linesize);
+	return 0;
+}
+
+static uint64_t run_compress_nv12(void *data, uint64_t iterations)
+{
+	struct frame_data *frame = data;
+	const uint32_t linesize[2] = {FRAME_CX, FRAME_CX};
+
+	for (uint64_t i = 0; i < iterations; i++)
+		compress_uyvx_to_nv12(frame->packed, frame->packed_linesize,
+				0, FRAME_CY, frame->planes, linesize);
+	return 0;
+}
+
+static uint64_t run_decompress_420(void *data, uint64_t iterations)
+{
+	struct frame_data *frame = data;
+
+	for (uint64_t i = 0; i < iterations; i++)
+		decompress_420((const uint8_t *const *)frame->planes,
+				frame->plane_linesize, 0, FRAME_CY,
+				frame->packed, frame->packed_linesize);
+	return 0;
+}
+
+static uint64_t run_decompress_nv12(void *data, uint64_t iterations)
+{
+	struct frame_data *frame = data;
+	const uint32_t linesize[2] = {FRAME_CX, FRAME_CX};
+
+	for (uint64_t i = 0; i < iterations; i++)
+		decompress_nv12((const uint8_t *const *)frame->planes,
+				linesize, 0, FRAME_CY,
+				frame->packed, frame->packed_linesize);
+	return 0;
+}
+
+static uint64_t run_decompress_422(void *data, uint64_t iterations)
+{
+	struct frame_data *frame = data;
+
+	for (uint64_t i = 0; i < iterations; i++)
+		decompress_422(frame->packed_422, frame->packed_422_linesize,
+				0, FRAME_CY, frame->packed,
+				frame->packed_linesize, false);
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* audio mixing
+ *
+ *   Mixing happens on the audio output's own thread, so this measures the
+ * time from the last line receiving a period of data to the mixed period
+ * being output, in low latency mode.  It runs in real time. */
+
+#define MIX_LINES      8
+#define MIX_PERIOD_MS  10
+#define MIX_RATE       48000
+#define MIX_FRAMES     (MIX_RATE * MIX_PERIOD_MS / 1000)
+#define MIX_BUFFER_MS  100
+
+struct mix_data {
+	audio_t      audio;
+	audio_line_t lines[MIX_LINES];
+	float        *samples[2];
+	os_event_t   output_event;
+	uint64_t     output_time;
+	uint64_t     timestamp;
+};
+
+static void mix_output_callback(void *param, struct audio_data *data)
+{
+	struct mix_data *mix = param;
+
+	mix->output_time = os_gettime_ns();
+	os_event_signal(mix->output_event);
+
+	UNUSED_PARAMETER(data);
+}
+
+static void mix_destroy(void *data)
+{
+	struct mix_data *mix = data;
+
+	if (mix->audio)
+		audio_output_disconnect(mix->audio, mix_output_callback, mix);
+	for (size_t i = 0; i < MIX_LINES; i++)
+		audio_line_destroy(mix->lines[i]);
+
+	audio_output_close(mix->audio);
+	os_event_destroy(mix->output_event);
+	bfree(mix->samples[0]);
+	bfree(mix->samples[1]);
+	bfree(mix);
+}
+
+static void *mix_create(void)
+{
+	struct mix_data *mix = bzalloc(sizeof(struct mix_data));
+	struct audio_output_info info = {
+		.name            = "libobs-bench",
+		.samples_per_sec = MIX_RATE,
+		.format          = AUDIO_FORMAT_FLOAT_PLANAR,
+		.speakers        = SPEAKERS_STEREO,
+		.buffer_ms       = MIX_BUFFER_MS,
+		.period_ms       = MIX_PERIOD_MS,
+		.low_latency     = true
+	};
+
+	for (size_t i = 0; i < 2; i++) {
+		mix->samples[i] = bmalloc(MIX_FRAMES * sizeof(float));
+		for (size_t j = 0; j < MIX_FRAMES; j++)
+			mix->samples[i][j] =
+				(float)(bench_rand() % 2000) / 4000.0f - 0.25f;
+	}
+
+	if (os_event_init(&mix->output_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+	if (audio_output_open(&mix->audio, &info) != AUDIO_OUTPUT_SUCCESS)
+		goto fail;
+	if (!audio_output_connect(mix->audio, NULL, mix_output_callback, mix))
+		goto fail;
+
+	for (size_t i = 0; i < MIX_LINES; i++)
+		mix->lines[i] = audio_output_createline(mix->audio, NULL);
+
+	/* line data is treated as being buffer_ms old, so start at the
+	 * current time to line up with the audio thread */
+	mix->timestamp = os_gettime_ns();
+	return mix;
+
+fail:
+	mix_destroy(mix);
+	return NULL;
+}
+
+static uint64_t run_mix(void *data, uint64_t iterations)
+{
+	struct mix_data *mix = data;
+	uint64_t period = MIX_PERIOD_MS * 1000000ULL;
+	uint64_t total = 0;
+	struct audio_data audio = {
+		.data   = {(uint8_t*)mix->samples[0],
+		           (uint8_t*)mix->samples[1]},
+		.frames = MIX_FRAMES,
+		.volume = 1.0f
+	};
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		uint64_t start;
+
+		os_sleepto_ns(mix->timestamp + period);
+		audio.timestamp = mix->timestamp;
+
+		os_event_reset(mix->output_event);
+
+		for (size_t j = 0; j < MIX_LINES; j++)
+			audio_line_output(mix->lines[j], &audio);
+		start = os_gettime_ns();
+
+		/* a period that wasn't mixed in time isn't counted */
+		if (os_event_timedwait(mix->output_event,
+					MIX_PERIOD_MS * 4) == 0 &&
+		    mix->output_time > start)
+			total += mix->output_time - start;
+
+		mix->timestamp += period;
+	}
+
+	/* the runner treats 0 as unmeasured */
+	return total ? total : 1;
+}
+
+/* ------------------------------------------------------------------------- */
+/* circular buffer */
+
+#define CIRCLEBUF_CHUNK 4096
+
+struct circlebuf_data {
+	struct circlebuf buf;
+	uint8_t          chunk[CIRCLEBUF_CHUNK];
+};
+
+static void *circlebuf_create(void)
+{
+	struct circlebuf_data *cb = bzalloc(sizeof(struct circlebuf_data));
+
+	fill_random(cb->chunk, CIRCLEBUF_CHUNK);
+
+	/* start partially filled so pushes wrap around the end */
+	for (size_t i = 0; i < 3; i++)
+		circlebuf_push_back(&cb->buf, cb->chunk, CIRCLEBUF_CHUNK);
+	circlebuf_pop_front(&cb->buf, NULL, CIRCLEBUF_CHUNK / 2);
+	return cb;
+}
+
+static void circlebuf_destroy(void *data)
+{
+	struct circlebuf_data *cb = data;
+
+	circlebuf_free(&cb->buf);
+	bfree(cb);
+}
+
+static uint64_t run_circlebuf(void *data, uint64_t iterations)
+{
+	struct circlebuf_data *cb = data;
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		circlebuf_push_back(&cb->buf, cb->chunk, CIRCLEBUF_CHUNK);
+		circlebuf_pop_front(&cb->buf, cb->chunk, CIRCLEBUF_CHUNK);
+	}
+
+	bench_sink = cb->chunk[0];
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* dynamic array */
+
+#define DARRAY_ELEMENTS 1024
+
+struct darray_data {
+	DARRAY(uint64_t) array;
+};
+
+static void *darray_create(void)
+{
+	struct darray_data *da = bzalloc(sizeof(struct darray_data));
+
+	for (uint64_t i = 0; i < DARRAY_ELEMENTS; i++)
+		da_push_back(da->array, &i);
+	return da;
+}
+
+static void darray_destroy(void *data)
+{
+	struct darray_data *da = data;
+
+	da_free(da->array);
+	bfree(da);
+}
+
+static uint64_t run_darray(void *data, uint64_t iterations)
+{
+	struct darray_data *da = data;
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		size_t idx = (size_t)(bench_rand() % DARRAY_ELEMENTS);
+
+		da_insert(da->array, idx, &i);
+		da_erase(da->array, idx);
+	}
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* settings data */
+
+#define DATA_KEYS 64
+
+struct data_data {
+	obs_data_t data;
+	char       names[DATA_KEYS][16];
+	char       *json;
+};
+
+static void *data_create(void)
+{
+	struct data_data *dd = bzalloc(sizeof(struct data_data));
+	obs_data_array_t array;
+
+	dd->data = obs_data_create();
+
+	for (size_t i = 0; i < DATA_KEYS; i++) {
+		sprintf(dd->names[i], "setting_%u", (unsigned)i);
+		obs_data_setint(dd->data, dd->names[i], (long long)i);
+	}
+
+	/* roughly the shape of a saved scene collection */
+	array = obs_data_array_create();
+	for (size_t i = 0; i < 32; i++) {
+		obs_data_t item     = obs_data_create();
+		obs_data_t settings = obs_data_create();
+
+		obs_data_setstring(settings, "file", "/path/to/some/file.png");
+		obs_data_setbool(settings, "unload", false);
+		obs_data_setdouble(settings, "volume", 0.75);
+
+		obs_data_setstring(item, "name", dd->names[i]);
+		obs_data_setstring(item, "id", "image_source");
+		obs_data_setobj(item, "settings", settings);
+		obs_data_array_push_back(array, item);
+
+		obs_data_release(settings);
+		obs_data_release(item);
+	}
+
+	obs_data_setarray(dd->data, "sources", array);
+	obs_data_array_release(array);
+
+	dd->json = bstrdup(obs_data_getjson(dd->data));
+	return dd;
+}
+
+static void data_destroy(void *data)
+{
+	struct data_data *dd = data;
+
+	obs_data_release(dd->data);
+	bfree(dd->json);
+	bfree(dd);
+}
+
+static uint64_t run_data_get_set(void *data, uint64_t iterations)
+{
+	struct data_data *dd = data;
+	long long total = 0;
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		const char *name = dd->names[i % DATA_KEYS];
+
+		obs_data_setint(dd->data, name, (long long)i);
+		total += obs_data_getint(dd->data, name);
+	}
+
+	bench_sink = (uintptr_t)total;
+	return 0;
+}
+
+static uint64_t run_data_json(void *data, uint64_t iterations)
+{
+	struct data_data *dd = data;
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		obs_data_t parsed = obs_data_create_from_json(dd->json);
+		bench_sink = (uintptr_t)obs_data_getjson(parsed);
+		obs_data_release(parsed);
+	}
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* avc packets */
+
+#define AVC_SLICE_SIZE (64 * 1024)
+
+struct avc_data {
+	struct encoder_packet packet;
+	DARRAY(uint8_t)       bytes;
+};
+
+static void push_nal(struct avc_data *avc, uint8_t header, size_t size)
+{
+	static const uint8_t start_code[4] = {0, 0, 0, 1};
+
+	da_push_back_array(avc->bytes, start_code, 4);
+	da_push_back(avc->bytes, &header);
+
+	/* random data that doesn't contain any start codes */
+	for (size_t i = 1; i < size; i++) {
+		uint8_t val = (uint8_t)(bench_rand() | 0x10);
+		da_push_back(avc->bytes, &val);
+	}
+}
+
+static void *avc_create(void)
+{
+	struct avc_data *avc = bzalloc(sizeof(struct avc_data));
+
+	push_nal(avc, 0x67, 16);             /* sps */
+	push_nal(avc, 0x68, 4);              /* pps */
+	push_nal(avc, 0x65, AVC_SLICE_SIZE); /* idr slice */
+
+	avc->packet.data         = avc->bytes.array;
+	avc->packet.size         = avc->bytes.num;
+	avc->packet.pts          = 0;
+	avc->packet.dts          = 0;
+	avc->packet.timebase_num = 1;
+	avc->packet.timebase_den = 30;
+	avc->packet.type         = OBS_ENCODER_VIDEO;
+	avc->packet.keyframe     = true;
+	return avc;
+}
+
+static void avc_destroy(void *data)
+{
+	struct avc_data *avc = data;
+
+	da_free(avc->bytes);
+	bfree(avc);
+}
+
+static uint64_t run_avc_parse(void *data, uint64_t iterations)
+{
+	struct avc_data *avc = data;
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		struct encoder_packet parsed;
+
+		obs_parse_avc_packet(&parsed, &avc->packet);
+		bench_sink = parsed.size;
+		obs_encoder_packet_release(&parsed);
+	}
+
+	return 0;
+}
+
+static uint64_t run_flv_mux(void *data, uint64_t iterations)
+{
+	struct avc_data *avc = data;
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		uint8_t *output;
+		size_t  size;
+
+		flv_packet_mux(&avc->packet, &output, &size, false);
+		bench_sink = size;
+		bfree(output);
+	}
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* signals */
+
+#define SIGNAL_CALLBACKS 4
+
+struct signal_data {
+	signal_handler_t handler;
+	long long        total;
+};
+
+static void signal_callback(void *param, calldata_t cd)
+{
+	struct signal_data *sd = param;
+	sd->total += calldata_int(cd, "val");
+}
+
+static void *signal_create(void)
+{
+	struct signal_data *sd = bzalloc(sizeof(struct signal_data));
+
+	sd->handler = signal_handler_create();
+	signal_handler_add(sd->handler, "void bench(int val)");
+
+	for (size_t i = 0; i < SIGNAL_CALLBACKS; i++)
+		signal_handler_connect(sd->handler, "bench", signal_callback,
+				sd);
+	return sd;
+}
+
+static void signal_destroy(void *data)
+{
+	struct signal_data *sd = data;
+
+	signal_handler_destroy(sd->handler);
+	bfree(sd);
+}
+
+static uint64_t run_signal(void *data, uint64_t iterations)
+{
+	struct signal_data *sd = data;
+	uint8_t stack[CALLDATA_FIXED_SIZE];
+	struct calldata cd;
+
+	calldata_init_fixed(&cd, stack, sizeof(stack));
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		calldata_setint(&cd, "val", (long long)i);
+		signal_handler_signal(sd->handler, "bench", &cd);
+	}
+
+	calldata_free(&cd);
+	bench_sink = (uintptr_t)sd->total;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+#define FRAME_BYTES (FRAME_CX * FRAME_CY * 4)
+
+static const struct bench_info benchmarks[] = {
+	{"compress_uyvx_to_i420",   200,     FRAME_BYTES,
+		frame_create, frame_destroy, run_compress_i420},
+	{"compress_uyvx_to_i420_c", 50,      FRAME_BYTES,
+		frame_create, frame_destroy, run_compress_i420_c},
+	{"compress_uyvx_to_nv12",   200,     FRAME_BYTES,
+		frame_create, frame_destroy, run_compress_nv12},
+	{"decompress_420",          200,     FRAME_BYTES,
+		frame_create, frame_destroy, run_decompress_420},
+	{"decompress_nv12",         200,     FRAME_BYTES,
+		frame_create, frame_destroy, run_decompress_nv12},
+	{"decompress_422",          200,     FRAME_BYTES,
+		frame_create, frame_destroy, run_decompress_422},
+	{"mix_and_output",          50,      0,
+		mix_create, mix_destroy, run_mix},
+	{"circlebuf_push_pop",      1000000, CIRCLEBUF_CHUNK,
+		circlebuf_create, circlebuf_destroy, run_circlebuf},
+	{"darray_insert_erase",     1000000, 0,
+		darray_create, darray_destroy, run_darray},
+	{"obs_data_get_set",        1000000, 0,
+		data_create, data_destroy, run_data_get_set},
+	{"obs_data_json",           2000,    0,
+		data_create, data_destroy, run_data_json},
+	{"obs_parse_avc_packet",    10000,   AVC_SLICE_SIZE,
+		avc_create, avc_destroy, run_avc_parse},
+	{"flv_packet_mux",          10000,   AVC_SLICE_SIZE,
+		avc_create, avc_destroy, run_flv_mux},
+	{"signal_handler_signal",   1000000, 0,
+		signal_create, signal_destroy, run_signal},
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static int compare_uint64(const void *a, const void *b)
+{
+	uint64_t val_a = *(const uint64_t*)a;
+	uint64_t val_b = *(const uint64_t*)b;
+	return (val_a > val_b) - (val_a < val_b);
+}
+
+static uint64_t run_timed(const struct bench_info *info, void *data)
+{
+	uint64_t start = os_gettime_ns();
+	uint64_t time  = info->run(data, info->iterations);
+
+	return time ? time : os_gettime_ns() - start;
+}
+
+static bool run_benchmark(const struct bench_info *info, int runs)
+{
+	uint64_t times[MAX_RUNS];
+	double   min_ns, median_ns;
+	void     *data = info->create();
+
+	if (!data) {
+		blog(LOG_ERROR, "%s: Failed to create benchmark data",
+				info->name);
+		return false;
+	}
+
+	run_timed(info, data);
+
+	for (int i = 0; i < runs; i++)
+		times[i] = run_timed(info, data);
+
+	info->destroy(data);
+
+	qsort(times, runs, sizeof(uint64_t), compare_uint64);
+	min_ns    = (double)times[0]        / (double)info->iterations;
+	median_ns = (double)times[runs / 2] / (double)info->iterations;
+
+	printf("{\"name\": \"%s\", \"iterations\": %"PRIu64", "
+	       "\"runs\": %d, \"min_ns_per_op\": %.2f, "
+	       "\"median_ns_per_op\": %.2f",
+	       info->name, info->iterations, runs, min_ns, median_ns);
+
+	if (info->bytes)
+		printf(", \"median_mb_per_sec\": %.2f",
+				(double)info->bytes * 1000000000.0 /
+				median_ns / (1024.0 * 1024.0));
+
+	printf("}\n");
+	fflush(stdout);
+	return true;
+}
+
+static bool matches_filters(const char *name, int argc, char *argv[],
+		int first_filter)
+{
+	if (first_filter >= argc)
+		return true;
+
+	for (int i = first_filter; i < argc; i++)
+		if (strstr(name, argv[i]))
+			return true;
+
+	return false;
+}
+
+int main(int argc, char *argv[])
+{
+	int  runs = DEFAULT_RUNS;
+	int  first_filter = 1;
+	bool success = true;
+
+	while (first_filter < argc && argv[first_filter][0] == '-') {
+		const char *arg = argv[first_filter++];
+
+		if (strcmp(arg, "--list") == 0) {
+			for (size_t i = 0; i < NUM_BENCHMARKS; i++)
+				printf("%s\n", benchmarks[i].name);
+			return 0;
+
+		} else if (strcmp(arg, "--runs") == 0 && first_filter < argc) {
+			runs = atoi(argv[first_filter++]);
+
+		} else {
+			fprintf(stderr, "Usage: %s [--runs N] [--list] "
+			                "[name filters...]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (runs < 1)
+		runs = 1;
+	if (runs > MAX_RUNS)
+		runs = MAX_RUNS;
+
+	for (size_t i = 0; i < NUM_BENCHMARKS; i++) {
+		const struct bench_info *info = benchmarks+i;
+
+		if (matches_filters(info->name, argc, argv, first_filter))
+			if (!run_benchmark(info, runs))
+				success = false;
+	}
+
+	blog(LOG_INFO, "Number of memory leaks: %llu",
+			(unsigned long long)bnum_allocs());
+	return success ? 0 : 1;
+}